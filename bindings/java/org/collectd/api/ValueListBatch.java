@@ -0,0 +1,147 @@
+/**
+ * collectd - bindings/java/org/collectd/api/ValueListBatch.java
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+package org.collectd.api;
+
+/**
+ * A batch of value lists handed to a {@link CollectdWriteBatchInterface}.
+ *
+ * The values of all value lists are stored in flat primitive arrays, so
+ * building a batch does not allocate one object per value. The values of
+ * value list <code>i</code> are found at the indices
+ * <code>getValueOffset (i)</code> up to (excluding)
+ * <code>getValueOffset (i + 1)</code>.
+ *
+ * Identifier and data set objects are cached by the native code and shared
+ * between batches, so they must not be modified. Use {@link #getValueList}
+ * to get a private copy of a value list.
+ *
+ * A batch is only valid for the duration of the
+ * {@link CollectdWriteBatchInterface#writeBatch} call.
+ */
+public class ValueListBatch {
+
+    private final PluginData[] _identifiers;
+    private final DataSet[] _datasets;
+    private final long[] _times;
+    private final long[] _intervals;
+    private final int[] _offsets;
+    private final long[] _longs;
+    private final double[] _doubles;
+
+    /* Called by the native code. */
+    ValueListBatch (PluginData[] identifiers, DataSet[] datasets,
+            long[] times, long[] intervals, int[] offsets,
+            long[] longs, double[] doubles) {
+        _identifiers = identifiers;
+        _datasets = datasets;
+        _times = times;
+        _intervals = intervals;
+        _offsets = offsets;
+        _longs = longs;
+        _doubles = doubles;
+    }
+
+    /** Returns the number of value lists in this batch. */
+    public int size () {
+        return _identifiers.length;
+    }
+
+    /**
+     * Returns the host, plugin, plugin instance, type and type instance of
+     * value list <code>i</code>. The returned object is shared and must not
+     * be modified.
+     */
+    public PluginData getIdentifier (int i) {
+        return _identifiers[i];
+    }
+
+    /**
+     * Returns the data set of value list <code>i</code>. The returned object
+     * is shared and must not be modified.
+     */
+    public DataSet getDataSet (int i) {
+        return _datasets[i];
+    }
+
+    /** Returns the time (in milliseconds) of value list <code>i</code>. */
+    public long getTime (int i) {
+        return _times[i];
+    }
+
+    /** Returns the interval (in milliseconds) of value list <code>i</code>. */
+    public long getInterval (int i) {
+        return _intervals[i];
+    }
+
+    /** Returns the index of the first value of value list <code>i</code>. */
+    public int getValueOffset (int i) {
+        return _offsets[i];
+    }
+
+    /** Returns the number of values of value list <code>i</code>. */
+    public int getValueCount (int i) {
+        return _offsets[i + 1] - _offsets[i];
+    }
+
+    /**
+     * Returns value <code>j</code> of value list <code>i</code> as a double.
+     * Counter, derive and absolute values are converted.
+     */
+    public double getDouble (int i, int j) {
+        return _doubles[_offsets[i] + j];
+    }
+
+    /**
+     * Returns value <code>j</code> of value list <code>i</code> as a long.
+     * Gauge values are truncated.
+     */
+    public long getLong (int i, int j) {
+        return _longs[_offsets[i] + j];
+    }
+
+    /**
+     * Returns value <code>j</code> of value list <code>i</code> boxed the same
+     * way {@link ValueList#getValues} does: gauges as Double, all other types
+     * as Long.
+     */
+    public Number getValue (int i, int j) {
+        int type = _datasets[i].getDataSources ().get (j).getType ();
+        if (type == DataSource.TYPE_GAUGE)
+            return Double.valueOf (getDouble (i, j));
+        return Long.valueOf (getLong (i, j));
+    }
+
+    /** Returns a newly allocated copy of value list <code>i</code>. */
+    public ValueList getValueList (int i) {
+        ValueList vl = new ValueList (_identifiers[i]);
+        vl.setDataSet (_datasets[i]);
+        vl.setTime (_times[i]);
+        vl.setInterval (_intervals[i]);
+        for (int j = 0; j < getValueCount (i); j++)
+            vl.addValue (getValue (i, j));
+        return vl;
+    }
+}
+
+/* vim: set sw=4 sts=4 et : */
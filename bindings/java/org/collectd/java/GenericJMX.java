@@ -30,6 +30,11 @@ import java.util.List;
 import java.util.ArrayList;
 import java.util.Map;
 import java.util.TreeMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.ThreadFactory;
 
 import org.collectd.api.Collectd;
 import org.collectd.api.CollectdConfigInterface;
@@ -47,6 +52,8 @@ public class GenericJMX implements CollectdConfigInterface,
     = new TreeMap<String,GenericJMXConfMBean> ();
 
   private List<GenericJMXConfConnection> _connections = null;
+  /* queries the connections concurrently, one thread per connection */
+  private ExecutorService _executor = null;
 
   public GenericJMX ()
   {
@@ -107,18 +114,82 @@ public class GenericJMX implements CollectdConfigInterface,
     return (0);
   } /* }}} int config */
 
+  private static void queryConnection (GenericJMXConfConnection conn) /* {{{ */
+  {
+    try
+    {
+      conn.query ();
+    }
+    catch (Exception e)
+    {
+      Collectd.logError ("GenericJMX: Caught unexpected exception: " + e);
+      e.printStackTrace ();
+    }
+  } /* }}} void queryConnection */
+
+  private ExecutorService getExecutor () /* {{{ */
+  {
+    if (this._executor != null)
+      return (this._executor);
+
+    this._executor = Executors.newFixedThreadPool (this._connections.size (),
+        new ThreadFactory ()
+        {
+          private int _threads_num = 0;
+
+          public Thread newThread (Runnable r)
+          {
+            Thread t = new Thread (r, "GenericJMX#" + (this._threads_num++));
+            /* Don't keep the JVM from shutting down. */
+            t.setDaemon (true);
+            return (t);
+          }
+        });
+    return (this._executor);
+  } /* }}} ExecutorService getExecutor */
+
   public int read () /* {{{ */
   {
+    /* With a single connection, there is nothing to wait for in parallel. */
+    if (this._connections.size () <= 1)
+    {
+      if (this._connections.size () == 1)
+        queryConnection (this._connections.get (0));
+      return (0);
+    }
+
+    /* Remote MBeanServers are queried over the network, so query them all at
+     * once instead of adding up their round trip times. */
+    ExecutorService executor = getExecutor ();
+    List<Future<?>> futures = new ArrayList<Future<?>> ();
     for (int i = 0; i < this._connections.size (); i++)
+    {
+      final GenericJMXConfConnection conn = this._connections.get (i);
+
+      futures.add (executor.submit (new Runnable ()
+            {
+              public void run ()
+              {
+                queryConnection (conn);
+              }
+            }));
+    }
+
+    for (int i = 0; i < futures.size (); i++)
     {
       try
       {
-        this._connections.get (i).query ();
+        futures.get (i).get ();
+      }
+      catch (InterruptedException e)
+      {
+        Thread.currentThread ().interrupt ();
+        return (-1);
       }
-      catch (Exception e)
+      catch (ExecutionException e)
       {
-        Collectd.logError ("GenericJMX: Caught unexpected exception: " + e);
-        e.printStackTrace ();
+        Collectd.logError ("GenericJMX: Caught unexpected exception: "
+            + e.getCause ());
       }
     }
 
@@ -128,6 +199,11 @@ public class GenericJMX implements CollectdConfigInterface,
   public int shutdown () /* {{{ */
   {
     System.out.print ("org.collectd.java.GenericJMX.Shutdown ();\n");
+    if (this._executor != null)
+    {
+      this._executor.shutdownNow ();
+      this._executor = null;
+    }
     this._connections = null;
     return (0);
   } /* }}} int shutdown */
@@ -28,6 +28,7 @@ package org.collectd.java;
 
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
 import java.util.Iterator;
 import java.util.ArrayList;
 import java.util.HashMap;
@@ -35,6 +36,7 @@ import java.net.InetAddress;
 import java.net.UnknownHostException;
 
 import javax.management.MBeanServerConnection;
+import javax.management.ObjectName;
 
 import javax.management.remote.JMXServiceURL;
 import javax.management.remote.JMXConnector;
@@ -55,6 +57,11 @@ class GenericJMXConfConnection
   private JMXConnector _jmx_connector = null;
   private MBeanServerConnection _mbean_connection = null;
   private List<GenericJMXConfMBean> _mbeans = null;
+  /* resolved ObjectName patterns, per MBean block */
+  private Map<GenericJMXConfMBean,Set<ObjectName>> _names
+    = new HashMap<GenericJMXConfMBean,Set<ObjectName>> ();
+  private long _names_refresh_interval = 60000; /* milliseconds */
+  private long _names_expire = 0;
 
   /*
    * private methods
@@ -83,6 +90,30 @@ class GenericJMXConfConnection
     return (v.getString ());
   } /* }}} String getConfigString */
 
+  private Number getConfigNumber (OConfigItem ci) /* {{{ */
+  {
+    List<OConfigValue> values;
+    OConfigValue v;
+
+    values = ci.getValues ();
+    if (values.size () != 1)
+    {
+      Collectd.logError ("GenericJMXConfConnection: The " + ci.getKey ()
+          + " configuration option needs exactly one numeric argument.");
+      return (null);
+    }
+
+    v = values.get (0);
+    if (v.getType () != OConfigValue.OCONFIG_TYPE_NUMBER)
+    {
+      Collectd.logError ("GenericJMXConfConnection: The " + ci.getKey ()
+          + " configuration option needs exactly one numeric argument.");
+      return (null);
+    }
+
+    return (v.getNumber ());
+  } /* }}} Number getConfigNumber */
+
   private String getHost () /* {{{ */
   {
     if (this._host != null)
@@ -148,6 +179,7 @@ class GenericJMXConfConnection
 
     this._jmx_connector = null;
     this._mbean_connection = null;
+    this._names.clear ();
   } /* }}} void disconnect */
 
   /*
@@ -158,6 +190,7 @@ class GenericJMXConfConnection
    *   ServiceURL "service:jmx:rmi:///jndi/rmi://localhost:17264/jmxrmi"
    *   Collect "java.lang:type=GarbageCollector,name=Copy"
    *   Collect "java.lang:type=Memory"
+   *   ObjectNameRefreshInterval 60
    * </Connection>
    *
    */
@@ -205,6 +238,13 @@ class GenericJMXConfConnection
         if (tmp != null)
           this._instance_prefix = tmp;
       }
+      else if (child.getKey ().equalsIgnoreCase ("ObjectNameRefreshInterval"))
+      {
+        Number tmp = getConfigNumber (child);
+        if (tmp != null)
+          this._names_refresh_interval
+            = (long) (1000.0 * Math.max (0.0, tmp.doubleValue ()));
+      }
       else if (child.getKey ().equalsIgnoreCase ("Collect"))
       {
         String tmp = getConfigString (child);
@@ -251,17 +291,43 @@ class GenericJMXConfConnection
     pd.setHost (this.getHost ());
     pd.setPlugin ("GenericJMX");
 
+    long now = System.currentTimeMillis ();
+    if (now >= this._names_expire)
+    {
+      this._names.clear ();
+      this._names_expire = now + this._names_refresh_interval;
+    }
+
     for (int i = 0; i < this._mbeans.size (); i++)
     {
+      GenericJMXConfMBean mbean = this._mbeans.get (i);
+      Set<ObjectName> names;
       int status;
 
-      status = this._mbeans.get (i).query (this._mbean_connection, pd,
-          this._instance_prefix);
-      if (status != 0)
+      names = this._names.get (mbean);
+      if (names == null)
+      {
+        names = mbean.queryNames (this._mbean_connection);
+        if (names == null)
+        {
+          disconnect ();
+          return;
+        }
+        this._names.put (mbean, names);
+      }
+
+      status = mbean.query (this._mbean_connection, pd,
+          this._instance_prefix, names);
+      if (status < 0)
       {
         disconnect ();
         return;
       }
+      else if (status > 0)
+      {
+        /* Some MBeans are gone, resolve the pattern again next time. */
+        this._names.remove (mbean);
+      }
     } /* for */
   } /* }}} void query */
 
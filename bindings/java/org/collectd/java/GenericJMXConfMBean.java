@@ -26,11 +26,19 @@
 
 package org.collectd.java;
 
+import java.io.IOException;
+
 import java.util.Iterator;
 import java.util.List;
+import java.util.Map;
 import java.util.Set;
 import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.LinkedHashSet;
 
+import javax.management.Attribute;
+import javax.management.AttributeList;
+import javax.management.InstanceNotFoundException;
 import javax.management.MBeanServerConnection;
 import javax.management.ObjectName;
 import javax.management.MalformedObjectNameException;
@@ -47,6 +55,9 @@ class GenericJMXConfMBean
   private String _instance_prefix;
   private List<String> _instance_from;
   private List<GenericJMXConfValue> _values;
+  /* names of all top-level attributes read by _values, fetched with a single
+   * getAttributes call per MBean */
+  private String[] _attribute_names;
 
   private String getConfigString (OConfigItem ci) /* {{{ */
   {
@@ -152,6 +163,10 @@ class GenericJMXConfMBean
     if (this._values.size () == 0)
       throw (new IllegalArgumentException ("No value block was defined."));
 
+    Set<String> attribute_names = new LinkedHashSet<String> ();
+    for (int i = 0; i < this._values.size (); i++)
+      this._values.get (i).addAttributeNames (attribute_names);
+    this._attribute_names = attribute_names.toArray (new String[0]);
   } /* }}} GenericJMXConfMBean (OConfigItem ci) */
 
   public String getName () /* {{{ */
@@ -159,11 +174,12 @@ class GenericJMXConfMBean
     return (this._name);
   } /* }}} */
 
-  public int query (MBeanServerConnection conn, PluginData pd, /* {{{ */
-      String instance_prefix)
+  /*
+   * Resolves the ObjectName pattern. Returns null if the query failed.
+   */
+  public Set<ObjectName> queryNames (MBeanServerConnection conn) /* {{{ */
   {
     Set<ObjectName> names;
-    Iterator<ObjectName> iter;
 
     try
     {
@@ -172,7 +188,7 @@ class GenericJMXConfMBean
     catch (Exception e)
     {
       Collectd.logError ("GenericJMXConfMBean: queryNames failed: " + e);
-      return (-1);
+      return (null);
     }
 
     if (names.size () == 0)
@@ -181,6 +197,49 @@ class GenericJMXConfMBean
           + "the ObjectName " + this._obj_name);
     }
 
+    return (names);
+  } /* }}} Set<ObjectName> queryNames */
+
+  /*
+   * Fetches all attributes used by this block from one MBean at once.
+   * Attributes the server doesn't return, for example because they are
+   * really operations, are left out and queried one by one later.
+   */
+  private Map<String,Object> fetchAttributes ( /* {{{ */
+      MBeanServerConnection conn, ObjectName objName) throws Exception
+  {
+    Map<String,Object> ret = new HashMap<String,Object> ();
+    AttributeList list;
+
+    list = conn.getAttributes (objName, this._attribute_names);
+    for (Attribute attr : list.asList ())
+      ret.put (attr.getName (), attr.getValue ());
+
+    return (ret);
+  } /* }}} Map<String,Object> fetchAttributes */
+
+  public int query (MBeanServerConnection conn, PluginData pd, /* {{{ */
+      String instance_prefix)
+  {
+    Set<ObjectName> names = queryNames (conn);
+    if (names == null)
+      return (-1);
+
+    return (query (conn, pd, instance_prefix, names));
+  } /* }}} int query */
+
+  /*
+   * Queries the MBeans in "names", as returned by queryNames. Returns zero
+   * on success, less than zero if the connection failed and greater than zero
+   * if at least one of the MBeans no longer exists, i.e. the names need to be
+   * resolved again.
+   */
+  public int query (MBeanServerConnection conn, PluginData pd, /* {{{ */
+      String instance_prefix, Set<ObjectName> names)
+  {
+    Iterator<ObjectName> iter;
+    int status = 0;
+
     iter = names.iterator ();
     while (iter.hasNext ())
     {
@@ -232,12 +291,36 @@ class GenericJMXConfMBean
 
       Collectd.logDebug ("GenericJMXConfMBean: instance = " + instance.toString ());
 
+      Map<String,Object> fetched;
+      try
+      {
+        fetched = fetchAttributes (conn, objName);
+      }
+      catch (InstanceNotFoundException e)
+      {
+        Collectd.logDebug ("GenericJMXConfMBean: " + objName
+            + " has been unregistered.");
+        status = 1;
+        continue;
+      }
+      catch (IOException e)
+      {
+        Collectd.logError ("GenericJMXConfMBean: getAttributes failed: " + e);
+        return (-1);
+      }
+      catch (Exception e)
+      {
+        Collectd.logDebug ("GenericJMXConfMBean: getAttributes failed for "
+            + objName + ", querying attributes one by one: " + e);
+        fetched = null;
+      }
+
       for (int i = 0; i < this._values.size (); i++)
-        this._values.get (i).query (conn, objName, pd_tmp);
+        this._values.get (i).query (conn, objName, pd_tmp, fetched);
     }
 
-    return (0);
-  } /* }}} void query */
+    return (status);
+  } /* }}} int query */
 }
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -29,6 +29,7 @@ package org.collectd.java;
 import java.util.Arrays;
 import java.util.List;
 import java.util.Collection;
+import java.util.Map;
 import java.util.Set;
 import java.util.concurrent.atomic.AtomicInteger;
 import java.util.concurrent.atomic.AtomicLong;
@@ -69,7 +70,7 @@ class GenericJMXConfValue {
 private
   String _ds_name;
 private
-  DataSet _ds;
+  volatile DataSet _ds;
 private
   List<String> _attributes;
 private
@@ -132,10 +133,10 @@ private
    * Returns null if one or more objects could not be converted.
    */
 private
-  List<Number> genericListToNumber(List<Object> objects) /* {{{ */
-  {
+  List<Number> genericListToNumber(DataSet ds, /* {{{ */
+                                   List<Object> objects) {
     List<Number> ret = new ArrayList<Number>();
-    List<DataSource> dsrc = this._ds.getDataSources();
+    List<DataSource> dsrc = ds.getDataSources();
 
     assert(objects.size() == dsrc.size());
 
@@ -160,7 +161,8 @@ private
    * object cannot converted to a number then the function will return null.
    */
 private
-  List<Number> genericCompositeToNumber(List<CompositeData> cdlist, /* {{{ */
+  List<Number> genericCompositeToNumber(DataSet ds, /* {{{ */
+                                        List<CompositeData> cdlist,
                                         String key) {
     List<Object> objects = new ArrayList<Object>();
 
@@ -177,12 +179,12 @@ private
       objects.add(value);
     }
 
-    return (genericListToNumber(objects));
+    return (genericListToNumber(ds, objects));
   } /* }}} List<Number> genericCompositeToNumber */
 
 private
-  void submitTable(List<Object> objects, ValueList vl, /* {{{ */
-                   String instancePrefix) {
+  void submitTable(DataSet ds, List<Object> objects, /* {{{ */
+                   ValueList vl, String instancePrefix) {
     List<CompositeData> cdlist;
     Set<String> keySet = null;
     Iterator<String> keyIter;
@@ -218,7 +220,7 @@ private
       List<Number> values;
 
       key = keyIter.next();
-      values = genericCompositeToNumber(cdlist, key);
+      values = genericCompositeToNumber(ds, cdlist, key);
       if (values == null) {
         Collectd.logError("GenericJMXConfValue: Cannot build a list of " +
                           "numbers for key " + key +
@@ -238,11 +240,11 @@ private
   } /* }}} void submitTable */
 
 private
-  void submitScalar(List<Object> objects, ValueList vl, /* {{{ */
-                    String instancePrefix) {
+  void submitScalar(DataSet ds, List<Object> objects, /* {{{ */
+                    ValueList vl, String instancePrefix) {
     List<Number> values;
 
-    values = genericListToNumber(objects);
+    values = genericListToNumber(ds, objects);
     if (values == null) {
       Collectd.logError("GenericJMXConfValue: Cannot convert list of " +
                         "objects to numbers.");
@@ -317,7 +319,8 @@ private
 
 private
   Object queryAttribute(MBeanServerConnection conn, /* {{{ */
-                        ObjectName objName, String attrName) {
+                        ObjectName objName, String attrName,
+                        Map<String, Object> fetched) {
     List<String> attrNameList;
     String key;
     Object value;
@@ -331,11 +334,15 @@ private
       attrNameList.add(attrNameArray[i]);
 
     try {
-      try {
-        value = conn.getAttribute(objName, key);
-      } catch (javax.management.AttributeNotFoundException e) {
-        value =
-            conn.invoke(objName, key, /* args = */ null, /* types = */ null);
+      if ((fetched != null) && fetched.containsKey(key)) {
+        value = fetched.get(key);
+      } else {
+        try {
+          value = conn.getAttribute(objName, key);
+        } catch (javax.management.AttributeNotFoundException e) {
+          value =
+              conn.invoke(objName, key, /* args = */ null, /* types = */ null);
+        }
       }
     } catch (Exception e) {
       Collectd.logError("GenericJMXConfValue.query: getAttribute failed: " + e);
@@ -405,6 +412,18 @@ private
     return (v.getString());
   } /* }}} String getConfigString */
 
+  /**
+   * Adds the names of the MBean attributes this value reads to
+   * <em>names</em>. For paths into composite types, only the name of the
+   * top-level attribute is added.
+   */
+public
+  void addAttributeNames(Set<String> names) /* {{{ */
+  {
+    for (int i = 0; i < this._attributes.size(); i++)
+      names.add(this._attributes.get(i).split("\\.")[0]);
+  } /* }}} void addAttributeNames */
+
 private
   Boolean getConfigBoolean(OConfigItem ci) /* {{{ */
   {
@@ -511,26 +530,46 @@ public
 public
   void query(MBeanServerConnection conn, ObjectName objName, /* {{{ */
              PluginData pd) {
+    query(conn, objName, pd, /* fetched = */ null);
+  } /* }}} void query */
+
+  /**
+   * Like {@link #query(MBeanServerConnection, ObjectName, PluginData)}, but
+   * takes the values of top-level attributes from <em>fetched</em>, if
+   * present, instead of requesting each of them from the MBeanServer.
+   *
+   * This may be called for different connections concurrently.
+   *
+   * @param fetched Attribute values already retrieved with
+   *                <em>getAttributes</em>, keyed by attribute name. May be
+   *                null.
+   */
+public
+  void query(MBeanServerConnection conn, ObjectName objName, /* {{{ */
+             PluginData pd, Map<String, Object> fetched) {
     ValueList vl;
+    DataSet ds;
     List<DataSource> dsrc;
     List<Object> values;
     List<String> instanceList;
     String instancePrefix;
 
-    if (this._ds == null) {
-      this._ds = Collectd.getDS(this._ds_name);
-      if (this._ds == null) {
+    ds = this._ds;
+    if (ds == null) {
+      ds = Collectd.getDS(this._ds_name);
+      if (ds == null) {
         Collectd.logError("GenericJMXConfValue: Unknown type: " +
                           this._ds_name);
         return;
       }
+      this._ds = ds;
     }
 
-    dsrc = this._ds.getDataSources();
+    dsrc = ds.getDataSources();
     if (dsrc.size() != this._attributes.size()) {
       Collectd.logError(
           "GenericJMXConfValue.query: The data set " + this._ds_name + " has " +
-          this._ds.getDataSources().size() + " data sources, but there were " +
+          dsrc.size() + " data sources, but there were " +
           this._attributes.size() +
           " attributes configured. This doesn't match!");
       this._ds = null;
@@ -577,7 +616,7 @@ public
     for (int i = 0; i < this._attributes.size(); i++) {
       Object v;
 
-      v = queryAttribute(conn, objName, this._attributes.get(i));
+      v = queryAttribute(conn, objName, this._attributes.get(i), fetched);
       if (v == null) {
         Collectd.logError(
             "GenericJMXConfValue.query: " + "Querying attribute " +
@@ -589,9 +628,9 @@ public
     }
 
     if (this._is_table)
-      submitTable(values, vl, instancePrefix);
+      submitTable(ds, values, vl, instancePrefix);
     else
-      submitScalar(values, vl, instancePrefix);
+      submitScalar(ds, values, vl, instancePrefix);
   } /* }}} void query */
 } /* class GenericJMXConfValue */
 
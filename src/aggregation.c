@@ -28,14 +28,21 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/latency/latency.h"
 #include "utils/lookup/vl_lookup.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h" /* for uc_get_rate() */
+#include "utils_identity.h"
 #include "utils_subst.h"
 
 #define AGG_MATCHES_ALL(str) (strcmp("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Values are accumulated in shards, chosen by the hash of the value list's
+ * identity, so that write threads updating the same instance rarely contend
+ * for a lock. agg_instance_read() merges the shards. */
+#define AGG_SHARDS_NUM 8
+
 struct aggregation_s /* {{{ */
 {
   lookup_identifier_t ident;
@@ -54,17 +61,15 @@ struct aggregation_s /* {{{ */
   bool calc_min;
   bool calc_max;
   bool calc_stddev;
+
+  double *percentiles;
+  size_t percentiles_num;
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+struct agg_shard_s /* {{{ */
 {
   pthread_mutex_t lock;
-  lookup_identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -73,16 +78,46 @@ struct agg_instance_s /* {{{ */
   gauge_t min;
   gauge_t max;
 
+  /* Distribution of the values, if percentiles are calculated. See
+   * agg_sketch_value(). */
+  latency_counter_t *sketch;
+}; /* }}} */
+typedef struct agg_shard_s agg_shard_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  lookup_identifier_t ident;
+
+  int ds_type;
+  aggregation_t const *agg;
+
+  agg_shard_t shards[AGG_SHARDS_NUM];
+  /* The shards' sketches are merged into this one when reading. */
+  latency_counter_t *sketch;
+
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
   rate_to_value_state_t *state_average;
   rate_to_value_state_t *state_min;
   rate_to_value_state_t *state_max;
   rate_to_value_state_t *state_stddev;
+  /* One for each of agg->percentiles. */
+  rate_to_value_state_t *state_percentiles;
 
   agg_instance_t *next;
 }; /* }}} */
 
+/* The value lists of one read, which are dispatched in one go. "values" holds
+ * the value of each value list. */
+typedef struct {
+  value_list_t *vls;
+  value_t *values;
+  size_t num;
+  size_t size;
+} agg_batch_t;
+
 static lookup_t *lookup;
 
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -103,8 +138,20 @@ static bool agg_is_regex(char const *str) /* {{{ */
     return false;
 } /* }}} bool agg_is_regex */
 
+/* The latency counter records integers greater than zero. Values are scaled
+ * like times and shifted by one, so that zero is counted, too. Negative values
+ * can not be recorded. */
+static cdtime_t agg_sketch_value(gauge_t value) /* {{{ */
+{
+  return DOUBLE_TO_CDTIME_T(value) + 1;
+} /* }}} cdtime_t agg_sketch_value */
+
 static void agg_destroy(aggregation_t *agg) /* {{{ */
 {
+  if (agg == NULL)
+    return;
+
+  sfree(agg->percentiles);
   sfree(agg);
 } /* }}} void agg_destroy */
 
@@ -133,11 +180,20 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   sfree(inst->state_min);
   sfree(inst->state_max);
   sfree(inst->state_stddev);
+  sfree(inst->state_percentiles);
+
+  for (size_t i = 0; i < AGG_SHARDS_NUM; i++) {
+    pthread_mutex_destroy(&inst->shards[i].lock);
+    latency_counter_destroy(inst->shards[i].sketch);
+  }
+  latency_counter_destroy(inst->sketch);
 
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
+  for (size_t i = 0; i < AGG_SHARDS_NUM; i++) {
+    inst->shards[i].min = NAN;
+    inst->shards[i].max = NAN;
+  }
 } /* }}} void agg_instance_destroy */
 
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
@@ -238,15 +294,17 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
     ERROR("aggregation plugin: calloc() failed.");
     return NULL;
   }
-  pthread_mutex_init(&inst->lock, /* attr = */ NULL);
+  for (size_t i = 0; i < AGG_SHARDS_NUM; i++) {
+    pthread_mutex_init(&inst->shards[i].lock, /* attr = */ NULL);
+    inst->shards[i].min = NAN;
+    inst->shards[i].max = NAN;
+  }
 
   inst->ds_type = ds->ds[0].type;
+  inst->agg = agg;
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
-
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
     inst->state_##field = NULL;                                                \
@@ -270,6 +328,26 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
 
 #undef INIT_STATE
 
+  if (agg->percentiles_num > 0) {
+    bool ok = true;
+
+    inst->state_percentiles =
+        calloc(agg->percentiles_num, sizeof(*inst->state_percentiles));
+    inst->sketch = latency_counter_create();
+    ok = (inst->state_percentiles != NULL) && (inst->sketch != NULL);
+    for (size_t i = 0; ok && (i < AGG_SHARDS_NUM); i++) {
+      inst->shards[i].sketch = latency_counter_create();
+      ok = (inst->shards[i].sketch != NULL);
+    }
+
+    if (!ok) {
+      agg_instance_destroy(inst);
+      free(inst);
+      ERROR("aggregation plugin: calloc() failed.");
+      return NULL;
+    }
+  }
+
   pthread_mutex_lock(&agg_instance_list_lock);
   inst->next = agg_instance_list_head;
   agg_instance_list_head = inst;
@@ -306,28 +384,65 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return 0;
   }
 
-  pthread_mutex_lock(&inst->lock);
+  /* Without an identity, e.g. if a target modified the value list, the first
+   * shard is used. */
+  vl_identity_t const *id = plugin_value_list_identity(vl);
+  agg_shard_t *shard =
+      inst->shards + ((id != NULL) ? (id->hash >> 58) % AGG_SHARDS_NUM : 0);
+
+  pthread_mutex_lock(&shard->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  shard->num++;
+  shard->sum += rate[0];
+  shard->squares_sum += (rate[0] * rate[0]);
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (isnan(shard->min) || (shard->min > rate[0]))
+    shard->min = rate[0];
+  if (isnan(shard->max) || (shard->max < rate[0]))
+    shard->max = rate[0];
+  if ((shard->sketch != NULL) && (rate[0] >= 0.0))
+    latency_counter_add(shard->sketch, agg_sketch_value(rate[0]));
 
-  pthread_mutex_unlock(&inst->lock);
+  pthread_mutex_unlock(&shard->lock);
 
   sfree(rate);
   return 0;
 } /* }}} int agg_instance_update */
 
+/* Appends a copy of "vl" to the batch. The value is stored in the batch, too;
+ * "values" are assigned before dispatching, since the array may move. */
+static int agg_batch_append(agg_batch_t *b, value_list_t const *vl, /* {{{ */
+                            value_t v) {
+  if (b->num == b->size) {
+    size_t size = (b->size == 0) ? 64 : 2 * b->size;
+
+    value_list_t *vls = realloc(b->vls, size * sizeof(*vls));
+    if (vls == NULL) {
+      ERROR("aggregation plugin: realloc failed.");
+      return ENOMEM;
+    }
+    b->vls = vls;
+
+    value_t *values = realloc(b->values, size * sizeof(*values));
+    if (values == NULL) {
+      ERROR("aggregation plugin: realloc failed.");
+      return ENOMEM;
+    }
+    b->values = values;
+    b->size = size;
+  }
+
+  b->vls[b->num] = *vl;
+  b->values[b->num] = v;
+  b->num++;
+  return 0;
+} /* }}} int agg_batch_append */
+
 static int agg_instance_read_func(agg_instance_t *inst, /* {{{ */
                                   char const *func, gauge_t rate,
                                   rate_to_value_state_t *state,
                                   value_list_t *vl, char const *pi_prefix,
-                                  cdtime_t t) {
+                                  cdtime_t t, agg_batch_t *batch) {
   if (pi_prefix[0] != 0)
     subst_string(vl->plugin_instance, sizeof(vl->plugin_instance), pi_prefix,
                  AGG_FUNC_PLACEHOLDER, func);
@@ -348,34 +463,21 @@ static int agg_instance_read_func(agg_instance_t *inst, /* {{{ */
     return -1;
   }
 
-  vl->values = &v;
-  vl->values_len = 1;
-
-  plugin_dispatch_values(vl);
-
-  vl->values = NULL;
-  vl->values_len = 0;
-
-  return 0;
+  return agg_batch_append(batch, vl, v);
 } /* }}} int agg_instance_read_func */
 
-static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
-{
+/* Merges the shards of the instance and appends the value lists of all
+ * configured functions to "batch". "meta" is attached to all of them. */
+static int agg_instance_read(agg_instance_t *inst, cdtime_t t, /* {{{ */
+                             meta_data_t *meta, agg_batch_t *batch) {
   value_list_t vl = VALUE_LIST_INIT;
 
   /* Pre-set all the fields in the value list that will not change per
-   * aggregation type (sum, average, ...). The struct will be re-used and must
-   * therefore be dispatched using the "secure" function. */
+   * aggregation type (sum, average, ...). */
 
   vl.time = t;
   vl.interval = 0;
-
-  vl.meta = meta_data_create();
-  if (vl.meta == NULL) {
-    ERROR("aggregation plugin: meta_data_create failed.");
-    return -1;
-  }
-  meta_data_add_boolean(vl.meta, "aggregation:created", 1);
+  vl.meta = meta;
 
   sstrncpy(vl.host, inst->ident.host, sizeof(vl.host));
   sstrncpy(vl.plugin, inst->ident.plugin, sizeof(vl.plugin));
@@ -387,37 +489,69 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
   do {                                                                         \
     if (inst->state_##func != NULL) {                                          \
       agg_instance_read_func(inst, #func, rate, inst->state_##func, &vl,       \
-                             inst->ident.plugin_instance, t);                  \
+                             inst->ident.plugin_instance, t, batch);           \
     }                                                                          \
   } while (0)
 
-  pthread_mutex_lock(&inst->lock);
+  /* Merge and reset the shards. */
+  agg_shard_t total = {.min = NAN, .max = NAN};
+  if (inst->sketch != NULL)
+    latency_counter_reset(inst->sketch);
+  for (size_t i = 0; i < AGG_SHARDS_NUM; i++) {
+    agg_shard_t *shard = inst->shards + i;
+
+    pthread_mutex_lock(&shard->lock);
+
+    total.num += shard->num;
+    total.sum += shard->sum;
+    total.squares_sum += shard->squares_sum;
+    if (!isnan(shard->min) && (isnan(total.min) || (total.min > shard->min)))
+      total.min = shard->min;
+    if (!isnan(shard->max) && (isnan(total.max) || (total.max < shard->max)))
+      total.max = shard->max;
+    if (shard->sketch != NULL) {
+      latency_counter_merge(inst->sketch, shard->sketch);
+      latency_counter_reset(shard->sketch);
+    }
+
+    shard->num = 0;
+    shard->sum = 0.0;
+    shard->squares_sum = 0.0;
+    shard->min = NAN;
+    shard->max = NAN;
 
-  READ_FUNC(num, (gauge_t)inst->num);
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  READ_FUNC(num, (gauge_t)total.num);
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
-    READ_FUNC(stddev, sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                           (inst->sum * inst->sum)) /
-                          ((gauge_t)inst->num));
+  if (total.num > 0) {
+    READ_FUNC(sum, total.sum);
+    READ_FUNC(average, (total.sum / ((gauge_t)total.num)));
+    READ_FUNC(min, total.min);
+    READ_FUNC(max, total.max);
+    READ_FUNC(stddev, sqrt((((gauge_t)total.num) * total.squares_sum) -
+                           (total.sum * total.sum)) /
+                          ((gauge_t)total.num));
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
+#undef READ_FUNC
 
-  pthread_mutex_unlock(&inst->lock);
+  /* The sketch is empty if all values were negative. */
+  if ((inst->sketch != NULL) && (latency_counter_get_num(inst->sketch) > 0)) {
+    for (size_t i = 0; i < inst->agg->percentiles_num; i++) {
+      double percent = inst->agg->percentiles[i];
+      char func[DATA_MAX_NAME_LEN];
+      ssnprintf(func, sizeof(func), "percentile-%g", percent);
 
-  meta_data_destroy(vl.meta);
-  vl.meta = NULL;
+      cdtime_t v = latency_counter_get_percentile(inst->sketch, percent);
+      agg_instance_read_func(inst, func, CDTIME_T_TO_DOUBLE(v - 1),
+                             inst->state_percentiles + i, &vl,
+                             inst->ident.plugin_instance, t, batch);
+    }
+  }
 
   return 0;
 } /* }}} int agg_instance_read */
@@ -499,6 +633,33 @@ static int agg_config_handle_group_by(oconfig_item_t const *ci, /* {{{ */
   return 0;
 } /* }}} int agg_config_handle_group_by */
 
+static int agg_config_add_percentile(oconfig_item_t const *ci, /* {{{ */
+                                     aggregation_t *agg) {
+  double percent;
+  int status = cf_util_get_double(ci, &percent);
+  if (status != 0)
+    return status;
+
+  if ((percent <= 0.0) || (percent >= 100.0)) {
+    ERROR("aggregation plugin: The value for \"%s\" must be between 0 and "
+          "100, exclusively.",
+          ci->key);
+    return ERANGE;
+  }
+
+  double *tmp = realloc(agg->percentiles,
+                        sizeof(*agg->percentiles) * (agg->percentiles_num + 1));
+  if (tmp == NULL) {
+    ERROR("aggregation plugin: realloc failed.");
+    return ENOMEM;
+  }
+  agg->percentiles = tmp;
+  agg->percentiles[agg->percentiles_num] = percent;
+  agg->percentiles_num++;
+
+  return 0;
+} /* }}} int agg_config_add_percentile */
+
 static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
 {
   aggregation_t *agg = calloc(1, sizeof(*agg));
@@ -555,13 +716,15 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &agg->calc_max);
     else if (strcasecmp("CalculateStddev", child->key) == 0)
       status = cf_util_get_boolean(child, &agg->calc_stddev);
+    else if (strcasecmp("CalculatePercentile", child->key) == 0)
+      status = agg_config_add_percentile(child, agg);
     else
       WARNING("aggregation plugin: The \"%s\" key is not allowed inside "
               "<Aggregation /> blocks and will be ignored.",
               child->key);
 
     if (status != 0) {
-      sfree(agg);
+      agg_destroy(agg);
       return status;
     }
   } /* for (int i = 0; i < ci->children_num; i++) */
@@ -620,7 +783,8 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
   } /* }}} */
 
   if (!agg->calc_num && !agg->calc_sum && !agg->calc_average /* {{{ */
-      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev) {
+      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev &&
+      (agg->percentiles_num == 0)) {
     ERROR("aggregation plugin: No aggregation function has been specified. "
           "Without this, I don't know what I should be calculating. "
           "(Host \"%s\", Plugin \"%s\", PluginInstance \"%s\", "
@@ -631,14 +795,14 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
   } /* }}} */
 
   if (!is_valid) { /* {{{ */
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   } /* }}} */
 
   int status = lookup_add(lookup, &agg->ident, agg->group_by, agg);
   if (status != 0) {
     ERROR("aggregation plugin: lookup_add failed with status %i.", status);
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   }
 
@@ -699,9 +863,19 @@ static int agg_read(void) /* {{{ */
     return 0;
   }
 
+  meta_data_t *meta = meta_data_create();
+  if (meta == NULL) {
+    pthread_mutex_unlock(&agg_instance_list_lock);
+    ERROR("aggregation plugin: meta_data_create failed.");
+    return -1;
+  }
+  meta_data_add_boolean(meta, "aggregation:created", 1);
+
+  /* The value lists of all instances are dispatched together. */
+  agg_batch_t batch = {0};
   for (agg_instance_t *this = agg_instance_list_head; this != NULL;
        this = this->next) {
-    int status = agg_instance_read(this, t);
+    int status = agg_instance_read(this, t, meta, &batch);
     if (status != 0)
       WARNING("aggregation plugin: Reading an aggregation instance "
               "failed with status %i.",
@@ -712,6 +886,17 @@ static int agg_read(void) /* {{{ */
 
   pthread_mutex_unlock(&agg_instance_list_lock);
 
+  for (size_t i = 0; i < batch.num; i++) {
+    batch.vls[i].values = batch.values + i;
+    batch.vls[i].values_len = 1;
+  }
+  if (batch.num > 0)
+    plugin_dispatch_values_batch(batch.vls, batch.num);
+
+  sfree(batch.vls);
+  sfree(batch.values);
+  meta_data_destroy(meta);
+
   return (success > 0) ? 0 : -1;
 } /* }}} int agg_read */
 
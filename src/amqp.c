@@ -33,6 +33,7 @@
 #include "utils/common/common.h"
 #include "utils/format_graphite/format_graphite.h"
 #include "utils/format_json/format_json.h"
+#include "utils_complain.h"
 #include "utils_random.h"
 
 #include <amqp.h>
@@ -64,9 +65,34 @@ int amqp_socket_close(amqp_socket_t *);
 
 #define CAMQP_CHANNEL 1
 
+/* Publisher confirms need amqp_confirm_select() and the non-blocking frame
+ * reader, which were added in rabbitmq-c 0.4. */
+#if defined(AMQP_VERSION) && AMQP_VERSION >= 0x00040000
+#define CAMQP_HAVE_CONFIRMS 1
+#endif
+
+#define CAMQP_DEFAULT_BATCH_MAX_SIZE 65536
+/* Number of published but not yet confirmed messages. */
+#define CAMQP_CONFIRM_WINDOW 64
+#define CAMQP_CONFIRM_POLL MS_TO_CDTIME_T(100)
+/* How long the publisher thread tries to deliver queued messages on shutdown.
+ */
+#define CAMQP_DRAIN_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(5)
+
 /*
  * Data types
  */
+struct camqp_message_s;
+typedef struct camqp_message_s camqp_message_t;
+struct camqp_message_s {
+  char *routing_key;
+  char *body;
+  size_t body_len;
+  uint64_t delivery_tag;
+
+  camqp_message_t *next;
+};
+
 struct camqp_config_s {
   bool publish;
   char *name;
@@ -100,6 +126,32 @@ struct camqp_config_s {
   char *postfix;
   char escape_char;
   unsigned int graphite_flags;
+  /* publish only: batching */
+  size_t batch_size;
+  size_t batch_max_size;
+  cdtime_t batch_timeout;
+  char *batch;
+  size_t batch_fill;
+  size_t batch_alloc;
+  size_t batch_num;
+  cdtime_t batch_first;
+  char *batch_routing_key;
+  /* publish only: the publisher thread owns "connection" and the list of
+   * unconfirmed messages; the send queue is protected by "lock". */
+  bool publisher_confirms;
+  int send_queue_limit;
+  camqp_message_t *queue_head;
+  camqp_message_t *queue_tail;
+  int queue_num;
+  camqp_message_t *unconfirmed_head;
+  camqp_message_t *unconfirmed_tail;
+  int unconfirmed_num;
+  uint64_t delivery_tag;
+  c_complain_t queue_complaint;
+  pthread_cond_t publish_cond;
+  pthread_t publish_thread;
+  bool publish_thread_running;
+  bool publish_thread_stop;
 
   /* subscribe only */
   char *exchange_type;
@@ -144,6 +196,19 @@ static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
   conf->connection = NULL;
 } /* }}} void camqp_close_connection */
 
+static void camqp_message_free(camqp_message_t *msg) /* {{{ */
+{
+  while (msg != NULL) {
+    camqp_message_t *next = msg->next;
+
+    sfree(msg->routing_key);
+    sfree(msg->body);
+    sfree(msg);
+
+    msg = next;
+  }
+} /* }}} void camqp_message_free */
+
 static void camqp_config_free(void *ptr) /* {{{ */
 {
   camqp_config_t *conf = ptr;
@@ -151,8 +216,25 @@ static void camqp_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+  if (conf->publish_thread_running) {
+    pthread_mutex_lock(&conf->lock);
+    conf->publish_thread_stop = true;
+    pthread_cond_signal(&conf->publish_cond);
+    pthread_mutex_unlock(&conf->lock);
+
+    pthread_join(conf->publish_thread, /* retval = */ NULL);
+    conf->publish_thread_running = false;
+  }
+
   camqp_close_connection(conf);
 
+  camqp_message_free(conf->queue_head);
+  camqp_message_free(conf->unconfirmed_head);
+  sfree(conf->batch);
+  sfree(conf->batch_routing_key);
+  pthread_cond_destroy(&conf->publish_cond);
+  pthread_mutex_destroy(&conf->lock);
+
   sfree(conf->name);
   strarray_free(conf->hosts, conf->hosts_count);
   sfree(conf->vhost);
@@ -550,6 +632,22 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
 
   if (!conf->publish)
     return camqp_setup_queue(conf);
+
+#if CAMQP_HAVE_CONFIRMS
+  if (conf->publisher_confirms) {
+    amqp_confirm_select_ok_t *cs_ret =
+        amqp_confirm_select(conf->connection, CAMQP_CHANNEL);
+    if ((cs_ret == NULL) && camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_confirm_select failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      camqp_close_connection(conf);
+      return -1;
+    }
+    /* Delivery tags start at one on every new channel. */
+    conf->delivery_tag = 0;
+  }
+#endif
   return 0;
 } /* }}} int camqp_connect */
 
@@ -616,9 +714,29 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
   } /* while (received < body_size) */
 
   if (strcasecmp("text/collectd", content_type) == 0) {
-    status = cmd_handle_putval(stderr, body);
-    if (status != 0)
-      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", status);
+    /* Batched messages contain one PUTVAL command per line. Their value
+     * lists are dispatched together. */
+    cmd_error_handler_t err = {cmd_error_fh, stderr};
+    cmd_putval_batch_t *batch = cmd_putval_batch_create();
+    if (batch == NULL) {
+      ERROR("amqp plugin: cmd_putval_batch_create failed.");
+      return ENOMEM;
+    }
+
+    char *saveptr = NULL;
+    status = 0;
+    for (char *line = strtok_r(body, "\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\n", &saveptr)) {
+      int tmp = cmd_putval_batch_add(batch, line, NULL, &err);
+      if (tmp != 0) {
+        ERROR("amqp plugin: cmd_putval_batch_add failed with status %i.",
+              tmp);
+        status = tmp;
+      }
+    }
+
+    cmd_putval_batch_dispatch(batch);
+    cmd_putval_batch_destroy(batch);
     return status;
   } else if (strcasecmp("application/json", content_type) == 0) {
     ERROR("amqp plugin: camqp_read_body: Parsing JSON data has not "
@@ -749,43 +867,398 @@ static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 /*
  * Publishing code
  */
-/* XXX: You must hold "conf->lock" when calling this function! */
-static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
-                              const char *buffer, const char *routing_key) {
-  int status;
-
-  status = camqp_connect(conf);
-  if (status != 0)
-    return status;
-
-  amqp_basic_properties_t props = {._flags = AMQP_BASIC_CONTENT_TYPE_FLAG |
-                                             AMQP_BASIC_DELIVERY_MODE_FLAG |
-                                             AMQP_BASIC_APP_ID_FLAG,
-                                   .delivery_mode = conf->delivery_mode,
-                                   .app_id = amqp_cstring_bytes("collectd")};
-
+static char const *camqp_content_type(camqp_config_t const *conf) /* {{{ */
+{
   if (conf->format == CAMQP_FORMAT_COMMAND)
-    props.content_type = amqp_cstring_bytes("text/collectd");
+    return "text/collectd";
   else if (conf->format == CAMQP_FORMAT_JSON)
-    props.content_type = amqp_cstring_bytes("application/json");
+    return "application/json";
   else if (conf->format == CAMQP_FORMAT_GRAPHITE)
-    props.content_type = amqp_cstring_bytes("text/graphite");
+    return "text/graphite";
+
+  assert(23 == 42);
+  return NULL;
+} /* }}} char const *camqp_content_type */
+
+/* XXX: You must hold "conf->lock" when calling this function! */
+static void camqp_enqueue_locked(camqp_config_t *conf, /* {{{ */
+                                 camqp_message_t *msg) {
+  if ((conf->send_queue_limit > 0) &&
+      (conf->queue_num >= conf->send_queue_limit)) {
+    camqp_message_t *oldest = conf->queue_head;
+
+    c_complain(LOG_WARNING, &conf->queue_complaint,
+               "amqp plugin: Send queue of \"%s\" is full (%d messages). "
+               "Dropping the oldest messages.",
+               conf->name, conf->queue_num);
+
+    conf->queue_head = oldest->next;
+    if (conf->queue_head == NULL)
+      conf->queue_tail = NULL;
+    conf->queue_num--;
+
+    oldest->next = NULL;
+    camqp_message_free(oldest);
+  } else {
+    c_release(LOG_INFO, &conf->queue_complaint,
+              "amqp plugin: Send queue of \"%s\" has room again.",
+              conf->name);
+  }
+
+  msg->next = NULL;
+  if (conf->queue_tail == NULL)
+    conf->queue_head = msg;
   else
-    assert(23 == 42);
+    conf->queue_tail->next = msg;
+  conf->queue_tail = msg;
+  conf->queue_num++;
+
+  pthread_cond_signal(&conf->publish_cond);
+} /* }}} void camqp_enqueue_locked */
+
+/* Moves the current batch to the send queue.
+ * XXX: You must hold "conf->lock" when calling this function! */
+static int camqp_batch_flush_locked(camqp_config_t *conf) /* {{{ */
+{
+  if (conf->batch_num == 0)
+    return 0;
+
+  /* Room for the closing bracket and the terminating null byte is reserved
+   * by camqp_batch_add_locked(). */
+  if (conf->format == CAMQP_FORMAT_JSON)
+    conf->batch[conf->batch_fill++] = ']';
+  conf->batch[conf->batch_fill] = 0;
+
+  camqp_message_t *msg = calloc(1, sizeof(*msg));
+  if (msg == NULL) {
+    ERROR("amqp plugin: calloc failed. Dropping %" PRIsz " value lists.",
+          conf->batch_num);
+    conf->batch_fill = 0;
+    conf->batch_num = 0;
+    sfree(conf->batch_routing_key);
+    return ENOMEM;
+  }
+
+  msg->routing_key = conf->batch_routing_key;
+  msg->body = conf->batch;
+  msg->body_len = conf->batch_fill;
+
+  conf->batch_routing_key = NULL;
+  conf->batch = NULL;
+  conf->batch_alloc = 0;
+  conf->batch_fill = 0;
+  conf->batch_num = 0;
+
+  camqp_enqueue_locked(conf, msg);
+  return 0;
+} /* }}} int camqp_batch_flush_locked */
+
+/* Appends one formatted value list to the current batch. With the JSON
+ * format, "entry" is a single element array whose brackets are stripped.
+ * XXX: You must hold "conf->lock" when calling this function! */
+static int camqp_batch_add_locked(camqp_config_t *conf, /* {{{ */
+                                  char const *entry,
+                                  char const *routing_key) {
+  size_t len = strlen(entry);
+
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    if ((len < 2) || (entry[0] != '[') || (entry[len - 1] != ']'))
+      return EINVAL;
+    entry++;
+    len -= 2;
+  }
+
+  /* Messages carry a single routing key, so a value list with a different
+   * key starts a new batch. */
+  if ((conf->batch_num > 0) &&
+      ((strcmp(conf->batch_routing_key, routing_key) != 0) ||
+       (conf->batch_fill + len + 1 > conf->batch_max_size)))
+    camqp_batch_flush_locked(conf);
+
+  /* Opening bracket or separator, closing bracket and null byte. */
+  size_t need = conf->batch_fill + len + 3;
+  if (need > conf->batch_alloc) {
+    size_t alloc = (need > conf->batch_max_size) ? need : conf->batch_max_size;
+    char *tmp = realloc(conf->batch, alloc);
+    if (tmp == NULL) {
+      ERROR("amqp plugin: realloc failed.");
+      return ENOMEM;
+    }
+    conf->batch = tmp;
+    conf->batch_alloc = alloc;
+  }
 
-  status = amqp_basic_publish(
+  if (conf->batch_num == 0) {
+    conf->batch_routing_key = strdup(routing_key);
+    if (conf->batch_routing_key == NULL) {
+      ERROR("amqp plugin: strdup failed.");
+      return ENOMEM;
+    }
+    conf->batch_first = cdtime();
+
+    if (conf->format == CAMQP_FORMAT_JSON)
+      conf->batch[conf->batch_fill++] = '[';
+  } else if (conf->format == CAMQP_FORMAT_JSON) {
+    conf->batch[conf->batch_fill++] = ',';
+  } else if (conf->format == CAMQP_FORMAT_COMMAND) {
+    conf->batch[conf->batch_fill++] = '\n';
+  }
+  /* Graphite lines are already terminated by a newline. */
+
+  memcpy(conf->batch + conf->batch_fill, entry, len);
+  conf->batch_fill += len;
+  conf->batch_num++;
+
+  if (conf->batch_num >= conf->batch_size)
+    return camqp_batch_flush_locked(conf);
+  return 0;
+} /* }}} int camqp_batch_add_locked */
+
+/* Only called from the publisher thread. */
+static int camqp_publish(camqp_config_t *conf, /* {{{ */
+                         camqp_message_t const *msg) {
+  amqp_basic_properties_t props = {
+      ._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG |
+                AMQP_BASIC_APP_ID_FLAG,
+      .content_type = amqp_cstring_bytes(camqp_content_type(conf)),
+      .delivery_mode = conf->delivery_mode,
+      .app_id = amqp_cstring_bytes("collectd")};
+  amqp_bytes_t body = {
+      .len = msg->body_len,
+      .bytes = msg->body,
+  };
+
+  int status = amqp_basic_publish(
       conf->connection,
-      /* channel = */ 1, amqp_cstring_bytes(CONF(conf, exchange)),
-      amqp_cstring_bytes(routing_key),
+      /* channel = */ CAMQP_CHANNEL, amqp_cstring_bytes(CONF(conf, exchange)),
+      amqp_cstring_bytes(msg->routing_key),
       /* mandatory = */ 0,
-      /* immediate = */ 0, &props, amqp_cstring_bytes(buffer));
+      /* immediate = */ 0, &props, body);
   if (status != 0) {
     ERROR("amqp plugin: amqp_basic_publish failed with status %i.", status);
     camqp_close_connection(conf);
   }
 
   return status;
-} /* }}} int camqp_write_locked */
+} /* }}} int camqp_publish */
+
+#if CAMQP_HAVE_CONFIRMS
+/* Removes the messages covered by an ack or nack from the unconfirmed list.
+ * Only called from the publisher thread. */
+static void camqp_confirm(camqp_config_t *conf, uint64_t delivery_tag, /* {{{ */
+                          bool multiple, bool ack) {
+  camqp_message_t *prev = NULL;
+  camqp_message_t *msg = conf->unconfirmed_head;
+
+  while (msg != NULL) {
+    camqp_message_t *next = msg->next;
+
+    if ((msg->delivery_tag != delivery_tag) &&
+        (!multiple || (msg->delivery_tag > delivery_tag))) {
+      prev = msg;
+      msg = next;
+      continue;
+    }
+
+    if (!ack)
+      ERROR("amqp plugin: The broker rejected message %" PRIu64 " of \"%s\". "
+            "Its values are lost.",
+            msg->delivery_tag, conf->name);
+
+    if (prev == NULL)
+      conf->unconfirmed_head = next;
+    else
+      prev->next = next;
+    if (conf->unconfirmed_tail == msg)
+      conf->unconfirmed_tail = prev;
+    conf->unconfirmed_num--;
+
+    msg->next = NULL;
+    camqp_message_free(msg);
+    msg = next;
+  }
+} /* }}} void camqp_confirm */
+
+/* Waits up to "timeout" for one frame from the broker and handles publisher
+ * confirms. Only called from the publisher thread. */
+static int camqp_wait_confirms(camqp_config_t *conf, /* {{{ */
+                               cdtime_t timeout) {
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(timeout);
+  amqp_frame_t frame;
+
+  int status = amqp_simple_wait_frame_noblock(conf->connection, &frame, &tv);
+  if (status == AMQP_STATUS_TIMEOUT)
+    return 0;
+  if (status != AMQP_STATUS_OK) {
+    ERROR("amqp plugin: amqp_simple_wait_frame_noblock failed: %s",
+          amqp_error_string2(status));
+    camqp_close_connection(conf);
+    return status;
+  }
+
+  if (frame.frame_type != AMQP_FRAME_METHOD)
+    return 0;
+
+  switch (frame.payload.method.id) {
+  case AMQP_BASIC_ACK_METHOD: {
+    amqp_basic_ack_t *ack = frame.payload.method.decoded;
+    camqp_confirm(conf, ack->delivery_tag, ack->multiple, /* ack = */ true);
+    break;
+  }
+  case AMQP_BASIC_NACK_METHOD: {
+    amqp_basic_nack_t *nack = frame.payload.method.decoded;
+    camqp_confirm(conf, nack->delivery_tag, nack->multiple, /* ack = */ false);
+    break;
+  }
+  case AMQP_CHANNEL_CLOSE_METHOD:
+  case AMQP_CONNECTION_CLOSE_METHOD:
+    ERROR("amqp plugin: The broker closed the connection of \"%s\".",
+          conf->name);
+    camqp_close_connection(conf);
+    return -1;
+  default:
+    DEBUG("amqp plugin: Unexpected method id: %#" PRIx32,
+          frame.payload.method.id);
+  }
+
+  amqp_maybe_release_buffers(conf->connection);
+  return 0;
+} /* }}} int camqp_wait_confirms */
+#endif /* CAMQP_HAVE_CONFIRMS */
+
+/* Puts unconfirmed messages back at the head of the send queue after the
+ * connection was lost, so that they are published again.
+ * XXX: You must hold "conf->lock" when calling this function! */
+static void camqp_requeue_unconfirmed_locked(camqp_config_t *conf) /* {{{ */
+{
+  if (conf->unconfirmed_head == NULL)
+    return;
+
+  conf->unconfirmed_tail->next = conf->queue_head;
+  if (conf->queue_tail == NULL)
+    conf->queue_tail = conf->unconfirmed_tail;
+  conf->queue_head = conf->unconfirmed_head;
+  conf->queue_num += conf->unconfirmed_num;
+
+  conf->unconfirmed_head = NULL;
+  conf->unconfirmed_tail = NULL;
+  conf->unconfirmed_num = 0;
+} /* }}} void camqp_requeue_unconfirmed_locked */
+
+static void *camqp_publish_thread(void *user_data) /* {{{ */
+{
+  camqp_config_t *conf = user_data;
+  cdtime_t drain_deadline = 0;
+
+  pthread_mutex_lock(&conf->lock);
+  while (true) {
+    cdtime_t now = cdtime();
+
+    if ((conf->batch_num > 0) &&
+        (conf->publish_thread_stop ||
+         (now >= conf->batch_first + conf->batch_timeout)))
+      camqp_batch_flush_locked(conf);
+
+    if (conf->publish_thread_stop && (drain_deadline == 0))
+      drain_deadline = now + CAMQP_DRAIN_TIMEOUT;
+
+    if ((conf->queue_head == NULL) && (conf->unconfirmed_num == 0)) {
+      if (conf->publish_thread_stop)
+        break;
+
+      cdtime_t wakeup = now + TIME_T_TO_CDTIME_T(1);
+      if ((conf->batch_num > 0) &&
+          (conf->batch_first + conf->batch_timeout < wakeup))
+        wakeup = conf->batch_first + conf->batch_timeout;
+      pthread_cond_timedwait(&conf->publish_cond, &conf->lock,
+                             &CDTIME_T_TO_TIMESPEC(wakeup));
+      continue;
+    }
+
+    if (conf->publish_thread_stop && (now >= drain_deadline)) {
+      WARNING("amqp plugin: Dropping %d unsent and %d unconfirmed messages "
+              "of \"%s\" on shutdown.",
+              conf->queue_num, conf->unconfirmed_num, conf->name);
+      break;
+    }
+
+    if (conf->connection == NULL) {
+      pthread_mutex_unlock(&conf->lock);
+      int status = camqp_connect(conf);
+      pthread_mutex_lock(&conf->lock);
+
+      if (status != 0) {
+        cdtime_t wakeup = now + TIME_T_TO_CDTIME_T(1);
+        pthread_cond_timedwait(&conf->publish_cond, &conf->lock,
+                               &CDTIME_T_TO_TIMESPEC(wakeup));
+        continue;
+      }
+
+      camqp_requeue_unconfirmed_locked(conf);
+    }
+
+    while ((conf->queue_head != NULL) && (conf->connection != NULL) &&
+           (!conf->publisher_confirms ||
+            (conf->unconfirmed_num < CAMQP_CONFIRM_WINDOW))) {
+      camqp_message_t *msg = conf->queue_head;
+      conf->queue_head = msg->next;
+      if (conf->queue_head == NULL)
+        conf->queue_tail = NULL;
+      conf->queue_num--;
+      msg->next = NULL;
+      pthread_mutex_unlock(&conf->lock);
+
+      int status = camqp_publish(conf, msg);
+
+      pthread_mutex_lock(&conf->lock);
+      if (status != 0) {
+        /* Retry after reconnecting. */
+        msg->next = conf->queue_head;
+        conf->queue_head = msg;
+        if (conf->queue_tail == NULL)
+          conf->queue_tail = msg;
+        conf->queue_num++;
+        break;
+      }
+
+      if (!conf->publisher_confirms) {
+        camqp_message_free(msg);
+        continue;
+      }
+
+      msg->delivery_tag = ++conf->delivery_tag;
+      if (conf->unconfirmed_tail == NULL)
+        conf->unconfirmed_head = msg;
+      else
+        conf->unconfirmed_tail->next = msg;
+      conf->unconfirmed_tail = msg;
+      conf->unconfirmed_num++;
+    }
+
+#if CAMQP_HAVE_CONFIRMS
+    if ((conf->unconfirmed_num > 0) && (conf->connection != NULL)) {
+      pthread_mutex_unlock(&conf->lock);
+      camqp_wait_confirms(conf, CAMQP_CONFIRM_POLL);
+      pthread_mutex_lock(&conf->lock);
+    }
+#endif
+  } /* while (true) */
+  pthread_mutex_unlock(&conf->lock);
+
+  return NULL;
+} /* }}} void *camqp_publish_thread */
+
+static int camqp_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+
+  pthread_mutex_lock(&conf->lock);
+  int status = camqp_batch_flush_locked(conf);
+  pthread_mutex_unlock(&conf->lock);
+
+  return status;
+} /* }}} int camqp_flush */
 
 static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                        user_data_t *user_data) {
@@ -841,7 +1314,7 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   }
 
   pthread_mutex_lock(&conf->lock);
-  status = camqp_write_locked(conf, buffer, routing_key);
+  status = camqp_batch_add_locked(conf, buffer, routing_key);
   pthread_mutex_unlock(&conf->lock);
 
   return status;
@@ -915,6 +1388,13 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->prefix = NULL;
   conf->postfix = NULL;
   conf->escape_char = '_';
+  /* publish only: batching and the publisher thread */
+  conf->batch_size = 1;
+  conf->batch_max_size = CAMQP_DEFAULT_BATCH_MAX_SIZE;
+  conf->batch_timeout = 0;
+  conf->publisher_confirms = false;
+  conf->send_queue_limit = 0;
+  C_COMPLAIN_INIT(&conf->queue_complaint);
   /* subscribe only */
   conf->exchange_type = NULL;
   conf->queue = NULL;
@@ -923,6 +1403,7 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   /* general */
   conf->connection = NULL;
   pthread_mutex_init(&conf->lock, /* attr = */ NULL);
+  pthread_cond_init(&conf->publish_cond, /* attr = */ NULL);
   /* }}} */
 
   status = cf_util_get_string(ci, &conf->name);
@@ -1021,7 +1502,31 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                 "only one character. Others will be ignored.");
       conf->escape_char = tmp_buff[0];
       sfree(tmp_buff);
-    } else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
+    } else if ((strcasecmp("BatchSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp plugin: \"BatchSize\" must be at least 1.");
+        status = EINVAL;
+      }
+      if (status == 0)
+        conf->batch_size = (size_t)tmp;
+    } else if ((strcasecmp("BatchMaxSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        ERROR("amqp plugin: \"BatchMaxSize\" must be at least 1024.");
+        status = EINVAL;
+      }
+      if (status == 0)
+        conf->batch_max_size = (size_t)tmp;
+    } else if ((strcasecmp("BatchTimeout", child->key) == 0) && publish)
+      status = cf_util_get_cdtime(child, &conf->batch_timeout);
+    else if ((strcasecmp("PublisherConfirms", child->key) == 0) && publish)
+      status = cf_util_get_boolean(child, &conf->publisher_confirms);
+    else if ((strcasecmp("SendQueueLimit", child->key) == 0) && publish)
+      status = cf_util_get_int(child, &conf->send_queue_limit);
+    else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
       status = cf_util_get_int(child, &conf->connection_retry_delay);
     else
       WARNING("amqp plugin: Ignoring unknown "
@@ -1062,6 +1567,20 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
     status = 1;
   }
 #endif
+#if !CAMQP_HAVE_CONFIRMS
+  if (status == 0 && conf->publisher_confirms) {
+    ERROR("amqp plugin: PublisherConfirms is set but not supported. "
+          "rebuild collectd with rabbitmq-c >= 0.4");
+    status = 1;
+  }
+#endif
+  if (status == 0 && publish && conf->batch_timeout == 0)
+    conf->batch_timeout = plugin_get_interval();
+  if (status == 0 && publish && conf->batch_size > 1 &&
+      conf->routing_key == NULL)
+    WARNING("amqp plugin: \"BatchSize\" is set without \"RoutingKey\". "
+            "Only consecutive value lists with the same identifier can "
+            "share a message.");
   if (status == 0 &&
       (conf->tls_client_cert != NULL || conf->tls_client_key != NULL)) {
     if (conf->tls_client_cert == NULL || conf->tls_client_key == NULL) {
@@ -1085,6 +1604,15 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
     char cbname[128];
     ssnprintf(cbname, sizeof(cbname), "amqp/%s", conf->name);
 
+    status = plugin_thread_create(&conf->publish_thread, camqp_publish_thread,
+                                  conf, "amqp publish");
+    if (status != 0) {
+      ERROR("amqp plugin: pthread_create failed: %s", STRERROR(status));
+      camqp_config_free(conf);
+      return status;
+    }
+    conf->publish_thread_running = true;
+
     status = plugin_register_write(cbname, camqp_write,
                                    &(user_data_t){
                                        .data = conf,
@@ -1094,6 +1622,11 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
       camqp_config_free(conf);
       return status;
     }
+
+    plugin_register_flush(cbname, camqp_flush,
+                          &(user_data_t){
+                              .data = conf,
+                          });
   } else {
     status = camqp_subscribe_init(conf);
     if (status != 0) {
@@ -50,6 +50,10 @@
 #include <stdlib.h>
 
 #define BUFSIZE 8192
+#define AMQP1_DEFAULT_BATCH_MAX_SIZE 65536
+/* Interval in which the event thread flushes batches older than their
+ * timeout, in milliseconds. */
+#define AMQP1_BATCH_CHECK_INTERVAL 1000
 #define AMQP1_FORMAT_JSON 0
 #define AMQP1_FORMAT_COMMAND 1
 #define AMQP1_FORMAT_GRAPHITE 2
@@ -78,6 +82,16 @@ typedef struct amqp1_config_instance_s {
   char escape_char;
   bool pre_settle;
   char send_to[1024];
+  /* batching of value lists into one message, protected by "batch_lock" */
+  int batch_size;
+  size_t batch_max_size;
+  cdtime_t batch_timeout;
+  pthread_mutex_t batch_lock;
+  char *batch;
+  size_t batch_fill;
+  size_t batch_alloc;
+  int batch_num;
+  cdtime_t batch_first;
 } amqp1_config_instance_t;
 
 DEQ_DECLARE(amqp1_config_instance_t, amqp1_config_instance_list_t);
@@ -100,6 +114,9 @@ static pthread_mutex_t send_lock;
 static cd_message_list_t out_messages;
 static uint64_t cd_tag = 1;
 static uint64_t acknowledged;
+static uint64_t rejected;
+/* Instances with BatchSize > 1; only modified while reading the config. */
+static amqp1_config_instance_list_t batch_instances;
 static amqp1_config_transport_t *transport;
 static bool stopping;
 static bool event_thread_running;
@@ -108,6 +125,8 @@ static pthread_t event_thread_id;
 /*
  * Functions
  */
+static void amqp1_batch_flush_stale(void);
+
 static void cd_message_free(cd_message_t *cdm) {
   free(cdm->mbuf.start);
   free(cdm);
@@ -200,9 +219,17 @@ static bool handle(pn_event_t *event) /* {{{ */
   case PN_DELIVERY: {
     /* acknowledgement from peer that a message was delivered */
     pn_delivery_t *dlv = pn_event_delivery(event);
-    if (pn_delivery_remote_state(dlv) == PN_ACCEPTED) {
+    uint64_t state = pn_delivery_remote_state(dlv);
+    if (state == PN_ACCEPTED) {
       pn_delivery_settle(dlv);
       acknowledged++;
+    } else if ((state == PN_REJECTED) || (state == PN_RELEASED) ||
+               (state == PN_MODIFIED)) {
+      pn_delivery_settle(dlv);
+      rejected++;
+      WARNING("amqp1 plugin: The peer did not accept a message; %" PRIu64
+              " messages were not accepted so far.",
+              rejected);
     }
     break;
   }
@@ -240,6 +267,13 @@ static bool handle(pn_event_t *event) /* {{{ */
     break;
   }
 
+  case PN_PROACTOR_TIMEOUT: {
+    amqp1_batch_flush_stale();
+    pn_proactor_set_timeout(pn_event_proactor(event),
+                            AMQP1_BATCH_CHECK_INTERVAL);
+    break;
+  }
+
   case PN_PROACTOR_INACTIVE: {
     return false;
   }
@@ -258,6 +292,8 @@ static void *event_thread(void __attribute__((unused)) * arg) /* {{{ */
   /* setup proactor */
   proactor = pn_proactor();
   pn_proactor_addr(addr, sizeof(addr), transport->host, transport->port);
+  if (!DEQ_IS_EMPTY(batch_instances))
+    pn_proactor_set_timeout(proactor, AMQP1_BATCH_CHECK_INTERVAL);
 
   while (!stopping) {
     /* make connection */
@@ -364,6 +400,133 @@ static int encqueue(cd_message_t *cdm,
   return 0;
 } /* }}} int encqueue */
 
+/* Turns the current batch into a message and places it on the outbound
+ * queue.
+ * XXX: You must hold "instance->batch_lock" when calling this function! */
+static int amqp1_batch_flush_locked(amqp1_config_instance_t *instance) /* {{{ */
+{
+  if (instance->batch_num == 0)
+    return 0;
+
+  /* Room for the closing bracket is reserved by amqp1_batch_add(). */
+  if (instance->format == AMQP1_FORMAT_JSON)
+    instance->batch[instance->batch_fill++] = ']';
+
+  cd_message_t *cdm = malloc(sizeof(*cdm));
+  if (cdm == NULL) {
+    ERROR("amqp1 plugin: malloc failed. Dropping %d value lists.",
+          instance->batch_num);
+    instance->batch_fill = 0;
+    instance->batch_num = 0;
+    return -1;
+  }
+  DEQ_ITEM_INIT(cdm);
+  cdm->mbuf.start = instance->batch;
+  cdm->mbuf.size = instance->batch_fill;
+  cdm->instance = instance;
+
+  instance->batch = NULL;
+  instance->batch_alloc = 0;
+  instance->batch_fill = 0;
+  instance->batch_num = 0;
+
+  int status = encqueue(cdm, instance);
+  if (status != 0) {
+    ERROR("amqp1 plugin: batch enqueue failed");
+    cd_message_free(cdm);
+  }
+  return status;
+} /* }}} int amqp1_batch_flush_locked */
+
+/* Appends one formatted value list to the batch of "instance". With the JSON
+ * format, "entry" is a single element array whose brackets are stripped. */
+static int amqp1_batch_add(amqp1_config_instance_t *instance, /* {{{ */
+                           char const *entry, size_t len) {
+  if (instance->format == AMQP1_FORMAT_JSON) {
+    if ((len < 2) || (entry[0] != '[') || (entry[len - 1] != ']'))
+      return EINVAL;
+    entry++;
+    len -= 2;
+  }
+
+  pthread_mutex_lock(&instance->batch_lock);
+
+  if ((instance->batch_num > 0) &&
+      (instance->batch_fill + len + 1 > instance->batch_max_size))
+    amqp1_batch_flush_locked(instance);
+
+  /* Opening bracket or separator and closing bracket. encqueue() re-uses the
+   * buffer for the encoded message, so it must hold at least BUFSIZE bytes.
+   */
+  size_t need = instance->batch_fill + len + 2;
+  if (need > instance->batch_alloc) {
+    size_t alloc = instance->batch_max_size;
+    if (alloc < BUFSIZE)
+      alloc = BUFSIZE;
+    if (alloc < need)
+      alloc = need;
+
+    char *tmp = realloc(instance->batch, alloc);
+    if (tmp == NULL) {
+      ERROR("amqp1 plugin: realloc failed.");
+      pthread_mutex_unlock(&instance->batch_lock);
+      return ENOMEM;
+    }
+    instance->batch = tmp;
+    instance->batch_alloc = alloc;
+  }
+
+  if (instance->batch_num == 0) {
+    instance->batch_first = cdtime();
+    if (instance->format == AMQP1_FORMAT_JSON)
+      instance->batch[instance->batch_fill++] = '[';
+  } else if (instance->format == AMQP1_FORMAT_JSON) {
+    instance->batch[instance->batch_fill++] = ',';
+  } else if (instance->format == AMQP1_FORMAT_COMMAND) {
+    instance->batch[instance->batch_fill++] = '\n';
+  }
+  /* Graphite lines are already terminated by a newline. */
+
+  memcpy(instance->batch + instance->batch_fill, entry, len);
+  instance->batch_fill += len;
+  instance->batch_num++;
+
+  int status = 0;
+  if ((instance->batch_num >= instance->batch_size) ||
+      (cdtime() >= instance->batch_first + instance->batch_timeout))
+    status = amqp1_batch_flush_locked(instance);
+
+  pthread_mutex_unlock(&instance->batch_lock);
+  return status;
+} /* }}} int amqp1_batch_add */
+
+/* Called from the event thread. */
+static void amqp1_batch_flush_stale(void) /* {{{ */
+{
+  cdtime_t now = cdtime();
+
+  for (amqp1_config_instance_t *instance = DEQ_HEAD(batch_instances);
+       instance != NULL; instance = DEQ_NEXT(instance)) {
+    pthread_mutex_lock(&instance->batch_lock);
+    if ((instance->batch_num > 0) &&
+        (now >= instance->batch_first + instance->batch_timeout))
+      amqp1_batch_flush_locked(instance);
+    pthread_mutex_unlock(&instance->batch_lock);
+  }
+} /* }}} void amqp1_batch_flush_stale */
+
+static int amqp1_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *user_data) {
+  amqp1_config_instance_t *instance = user_data->data;
+
+  pthread_mutex_lock(&instance->batch_lock);
+  int status = amqp1_batch_flush_locked(instance);
+  pthread_mutex_unlock(&instance->batch_lock);
+
+  return status;
+} /* }}} int amqp1_flush */
+
 static int amqp1_notify(notification_t const *n,
                         user_data_t *user_data) /* {{{ */
 {
@@ -517,6 +680,12 @@ static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     return -1;
   }
 
+  if (instance->batch_size > 1) {
+    status = amqp1_batch_add(instance, cdm->mbuf.start, cdm->mbuf.size);
+    cd_message_free(cdm);
+    return status;
+  }
+
   /* encode message and place on outbound queue */
   status = encqueue(cdm, instance);
   if (status != 0) {
@@ -551,9 +720,15 @@ static void amqp1_config_instance_free(void *ptr) /* {{{ */
   if (instance == NULL)
     return;
 
+  if (instance->batch_size > 1) {
+    DEQ_REMOVE(batch_instances, instance);
+    pthread_mutex_destroy(&instance->batch_lock);
+  }
+
   sfree(instance->name);
   sfree(instance->prefix);
   sfree(instance->postfix);
+  sfree(instance->batch);
 
   sfree(instance);
 } /* }}} void amqp1_config_instance_free */
@@ -566,12 +741,16 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
 
+  instance->batch_size = 1;
+  instance->batch_max_size = AMQP1_DEFAULT_BATCH_MAX_SIZE;
+
   int status = cf_util_get_string(ci, &instance->name);
   if (status != 0) {
     sfree(instance);
     return status;
   }
 
+  int batch_size = 1;
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -622,7 +801,28 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
         instance->escape_char = tmp_buff[0];
       }
       sfree(tmp_buff);
-    } else
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("amqp1 plugin: \"BatchSize\" must be at least 1.");
+        status = EINVAL;
+      } else if (status == 0) {
+        /* Not yet in batch_instances, see below. */
+        batch_size = tmp;
+      }
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        ERROR("amqp1 plugin: \"BatchMaxSize\" must be at least 1024.");
+        status = EINVAL;
+      } else if (status == 0) {
+        instance->batch_max_size = (size_t)tmp;
+      }
+    } else if (strcasecmp("BatchTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &instance->batch_timeout);
+    else
       WARNING("amqp1 plugin: Ignoring unknown "
               "instance configuration option "
               "\"%s\".",
@@ -649,6 +849,19 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
       amqp1_config_instance_free(instance);
       return -1;
     }
+    if (instance->notify && (batch_size > 1)) {
+      WARNING("amqp1 plugin: Notifications are not batched. Ignoring "
+              "\"BatchSize\" in instance \"%s\".",
+              instance->name);
+    } else if (batch_size > 1) {
+      instance->batch_size = batch_size;
+      if (instance->batch_timeout == 0)
+        instance->batch_timeout = plugin_get_interval();
+      pthread_mutex_init(&instance->batch_lock, /* attr = */ NULL);
+      DEQ_ITEM_INIT(instance);
+      DEQ_INSERT_TAIL(batch_instances, instance);
+    }
+
     if (instance->notify) {
       status = plugin_register_notification(
           tpname, amqp1_notify,
@@ -663,6 +876,11 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
                                     .data = instance,
                                     .free_func = amqp1_config_instance_free,
                                 });
+      if ((status == 0) && (instance->batch_size > 1))
+        plugin_register_flush(tpname, amqp1_flush,
+                              &(user_data_t){
+                                  .data = instance,
+                              });
     }
 
     if (status != 0) {
@@ -28,6 +28,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/curl_engine/curl_engine.h"
 
 #include <curl/curl.h>
 
@@ -50,6 +51,7 @@ struct apache_s {
   size_t apache_buffer_size;
   size_t apache_buffer_fill;
   int timeout;
+  curl_engine_t *engine;
   CURL *curl;
 }; /* apache_s */
 
@@ -64,6 +66,9 @@ static void apache_free(void *arg) {
   if (st == NULL)
     return;
 
+  /* Waits for a response callback using this instance to return. */
+  curl_engine_cancel(st->engine, st->curl);
+
   sfree(st->name);
   sfree(st->host);
   sfree(st->url);
@@ -77,6 +82,7 @@ static void apache_free(void *arg) {
     curl_easy_cleanup(st->curl);
     st->curl = NULL;
   }
+  curl_engine_release(st->engine);
   sfree(st);
 } /* apache_free */
 
@@ -257,11 +263,18 @@ static int init_host(apache_t *st) /* {{{ */
     st->curl = NULL;
   }
 
+  if (st->engine == NULL) {
+    st->engine = curl_engine_acquire();
+    if (st->engine == NULL)
+      return -1;
+  }
+
   if ((st->curl = curl_easy_init()) == NULL) {
     ERROR("apache plugin: init_host: `curl_easy_init' failed.");
     return -1;
   }
 
+  curl_easy_setopt(st->curl, CURLOPT_URL, st->url);
   curl_easy_setopt(st->curl, CURLOPT_NOSIGNAL, 1L);
   curl_easy_setopt(st->curl, CURLOPT_WRITEFUNCTION, apache_curl_callback);
   curl_easy_setopt(st->curl, CURLOPT_WRITEDATA, st);
@@ -465,26 +478,15 @@ static void submit_scoreboard(char *buf, apache_t *st) {
   }
 }
 
-static int apache_read_host(user_data_t *user_data) /* {{{ */
-{
-  apache_t *st = user_data->data;
-
-  assert(st->url != NULL);
-  /* (Assured by `config_add') */
-
-  if (st->curl == NULL) {
-    if (init_host(st) != 0)
-      return -1;
-  }
-  assert(st->curl != NULL);
-
-  st->apache_buffer_fill = 0;
-
-  curl_easy_setopt(st->curl, CURLOPT_URL, st->url);
+/* Called by the curl engine once the status page has been fetched. */
+static void apache_read_done(CURL *curl, CURLcode curl_status, /* {{{ */
+                             void *user_data) {
+  apache_t *st = user_data;
 
-  if (curl_easy_perform(st->curl) != CURLE_OK) {
+  if (curl_status != CURLE_OK) {
     ERROR("apache: curl_easy_perform failed: %s", st->apache_curl_error);
-    return -1;
+    st->apache_buffer_fill = 0;
+    return;
   }
 
   /* fallback - server_type to apache if not set at this time */
@@ -496,8 +498,7 @@ static int apache_read_host(user_data_t *user_data) /* {{{ */
 
   char *content_type;
   static const char *text_plain = "text/plain";
-  int status =
-      curl_easy_getinfo(st->curl, CURLINFO_CONTENT_TYPE, &content_type);
+  int status = curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &content_type);
   if ((status == CURLE_OK) && (content_type != NULL) &&
       (strncasecmp(content_type, text_plain, strlen(text_plain)) != 0)) {
     WARNING("apache plugin: `Content-Type' response header is not `%s' "
@@ -547,8 +548,33 @@ static int apache_read_host(user_data_t *user_data) /* {{{ */
   }
 
   st->apache_buffer_fill = 0;
+} /* }}} void apache_read_done */
 
-  return 0;
+static int apache_read_host(user_data_t *user_data) /* {{{ */
+{
+  apache_t *st = user_data->data;
+
+  assert(st->url != NULL);
+  /* (Assured by `config_add') */
+
+  if (st->curl == NULL) {
+    if (init_host(st) != 0)
+      return -1;
+  }
+  assert(st->curl != NULL);
+
+  /* The status page is fetched by the curl engine; apache_read_done parses
+   * it. */
+  int status =
+      curl_engine_perform(st->engine, st->curl, apache_read_done, st);
+  if (status == EBUSY) {
+    WARNING("apache plugin: The previous request for `%s' has not completed "
+            "yet. Skipping this interval.",
+            st->url);
+    return 0;
+  }
+
+  return (status == 0) ? 0 : -1;
 } /* }}} int apache_read_host */
 
 static int apache_init(void) /* {{{ */
@@ -40,6 +40,8 @@
 #include <netinet/in.h>
 #endif
 
+#include <poll.h>
+
 #ifndef APCUPS_SERVER_TIMEOUT
 #define APCUPS_SERVER_TIMEOUT 15.0
 #endif
@@ -75,6 +77,8 @@ static char *conf_service;
 /* Defaults to false for backwards compatibility. */
 static bool conf_report_seconds;
 static bool conf_persistent_conn = true;
+/* Time a query, including connecting, may take. Defaults to the interval. */
+static cdtime_t conf_timeout;
 
 static int global_sockfd = -1;
 
@@ -103,12 +107,83 @@ static int apcups_shutdown(void) {
   return 0;
 } /* int apcups_shutdown */
 
+/* Waits until "fd" is ready for "events" or "deadline" has passed. Returns
+ * zero if it is ready and an errno value otherwise. */
+static int net_wait(int fd, short events, cdtime_t deadline) {
+  while (true) {
+    cdtime_t now = cdtime();
+    if (now >= deadline)
+      return ETIMEDOUT;
+
+    struct pollfd pfd = {.fd = fd, .events = events};
+    int status = poll(&pfd, 1, (int)CDTIME_T_TO_MS(deadline - now) + 1);
+    if (status > 0)
+      return 0;
+    else if (status == 0)
+      return ETIMEDOUT;
+    else if (errno != EINTR)
+      return errno;
+  }
+} /* int net_wait */
+
+/* Connects "sd" like connect(2), but gives up at "deadline". */
+static int net_connect(int sd, struct sockaddr const *addr, socklen_t addrlen,
+                       cdtime_t deadline) {
+  int flags = fcntl(sd, F_GETFL);
+  if ((flags < 0) || (fcntl(sd, F_SETFL, flags | O_NONBLOCK) != 0))
+    return errno;
+
+  int status = 0;
+  if (connect(sd, addr, addrlen) != 0) {
+    status = errno;
+    if (status == EINPROGRESS)
+      status = net_wait(sd, POLLOUT, deadline);
+    if (status == 0) {
+      socklen_t len = sizeof(status);
+      if (getsockopt(sd, SOL_SOCKET, SO_ERROR, &status, &len) != 0)
+        status = errno;
+    }
+  }
+
+  if ((status == 0) && (fcntl(sd, F_SETFL, flags) != 0))
+    status = errno;
+  return status;
+} /* int net_connect */
+
+/* Like sread(), but gives up at "deadline". */
+static int net_read(int fd, void *buf, size_t count, cdtime_t deadline) {
+  char *ptr = buf;
+
+  while (count > 0) {
+    int status = net_wait(fd, POLLIN, deadline);
+    if (status != 0) {
+      errno = status;
+      return -1;
+    }
+
+    ssize_t n = read(fd, ptr, count);
+    if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+      continue;
+    if (n <= 0) {
+      if (n == 0)
+        errno = EPIPE;
+      return -1;
+    }
+
+    ptr += n;
+    count -= (size_t)n;
+  }
+
+  return 0;
+} /* int net_read */
+
 /*
  * Open a TCP connection to the UPS network server
  * Returns -1 on error
  * Returns socket file descriptor otherwise
  */
-static int net_open(char const *node, char const *service) {
+static int net_open(char const *node, char const *service,
+                    cdtime_t deadline) {
   int sd;
   int status;
   struct addrinfo *ai_return;
@@ -139,13 +214,13 @@ static int net_open(char const *node, char const *service) {
     return -1;
   }
 
-  status = connect(sd, ai_list->ai_addr, ai_list->ai_addrlen);
+  status = net_connect(sd, ai_list->ai_addr, ai_list->ai_addrlen, deadline);
 
   freeaddrinfo(ai_return);
 
   if (status != 0) /* `connect(2)' failed */
   {
-    INFO("apcups plugin: connect failed: %s", STRERRNO);
+    INFO("apcups plugin: connect failed: %s", STRERROR(status));
     close(sd);
     return -1;
   }
@@ -164,11 +239,12 @@ static int net_open(char const *node, char const *service) {
  * Returns -1 on hard end of file (i.e. network connection close)
  * Returns -2 on error
  */
-static int net_recv(int *sockfd, char *buf, int buflen) {
+static int net_recv(int *sockfd, char *buf, int buflen, cdtime_t deadline) {
   uint16_t packet_size;
 
   /* get data size -- in short */
-  if (sread(*sockfd, (void *)&packet_size, sizeof(packet_size)) != 0) {
+  if (net_read(*sockfd, (void *)&packet_size, sizeof(packet_size),
+               deadline) != 0) {
     close(*sockfd);
     *sockfd = -1;
     return -1;
@@ -188,7 +264,7 @@ static int net_recv(int *sockfd, char *buf, int buflen) {
     return 0;
 
   /* now read the actual data */
-  if (sread(*sockfd, (void *)buf, packet_size) != 0) {
+  if (net_read(*sockfd, (void *)buf, packet_size, deadline) != 0) {
     close(*sockfd);
     *sockfd = -1;
     return -1;
@@ -247,9 +323,13 @@ static int apc_query_server(char const *node, char const *service,
 #define PRINT_VALUE(name, val) /**/
 #endif
 
+  /* The whole query has to finish within the timeout, so that an apcupsd
+   * that stopped responding cannot block a read thread. */
+  cdtime_t deadline = cdtime() + conf_timeout;
+
   while (1) {
     if (global_sockfd < 0) {
-      global_sockfd = net_open(node, service);
+      global_sockfd = net_open(node, service, deadline);
       if (global_sockfd < 0) {
         ERROR("apcups plugin: Connecting to the "
               "apcupsd failed.");
@@ -288,7 +368,8 @@ static int apc_query_server(char const *node, char const *service,
     conf_persistent_conn = false;
   }
 
-  while ((n = net_recv(&global_sockfd, recvline, sizeof(recvline) - 1)) > 0) {
+  while ((n = net_recv(&global_sockfd, recvline, sizeof(recvline) - 1,
+                       deadline)) > 0) {
     assert((size_t)n < sizeof(recvline));
     recvline[n] = 0;
 #if APCMAIN
@@ -361,7 +442,9 @@ static int apcups_config(oconfig_item_t *ci) {
     else if (strcasecmp(child->key, "PersistentConnection") == 0) {
       cf_util_get_boolean(child, &conf_persistent_conn);
       persistent_conn_set = true;
-    } else
+    } else if (strcasecmp(child->key, "Timeout") == 0)
+      cf_util_get_cdtime(child, &conf_timeout);
+    else
       ERROR("apcups plugin: Unknown config option \"%s\".", child->key);
   }
 
@@ -437,6 +520,9 @@ static int apcups_init(void) {
   if (conf_service == NULL)
     conf_service = APCUPS_DEFAULT_SERVICE;
 
+  if (conf_timeout == 0)
+    conf_timeout = plugin_get_interval();
+
   return 0;
 } /* apcups_init */
 
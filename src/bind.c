@@ -55,6 +55,8 @@
 #endif
 
 #include <curl/curl.h>
+#include <libxml/SAX2.h>
+#include <libxml/chvalid.h>
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 
@@ -114,6 +116,7 @@ static _Bool global_zone_maint_stats = 1;
 static _Bool global_resolver_stats;
 static _Bool global_memory_stats = 1;
 static int timeout = -1;
+static bool config_streaming;
 
 static cb_view_t *views;
 static size_t views_num;
@@ -125,6 +128,15 @@ static size_t bind_buffer_size;
 static size_t bind_buffer_fill;
 static char bind_curl_error[CURL_ERROR_SIZE];
 
+/* State of a streaming parse, see bind_stream_start(). */
+static xmlParserCtxt *bind_parser;
+static xmlXPathContext *bind_parser_xpath;
+static int bind_stream_version;
+static int bind_stream_depth;
+static cb_view_t *bind_stream_view;
+static time_t bind_stream_time;
+static bool bind_stream_have_time;
+
 /* Translation table for the `nsstats' values. */
 static const translation_info_t nsstats_translation_table[] = /* {{{ */
     {
@@ -265,6 +277,8 @@ static void submit(time_t ts, const char *plugin_instance, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void submit */
 
+static size_t bind_stream_feed(const char *buf, size_t len);
+
 static size_t bind_curl_callback(void *buf, size_t size, /* {{{ */
                                  size_t nmemb,
                                  void __attribute__((unused)) * stream) {
@@ -273,6 +287,9 @@ static size_t bind_curl_callback(void *buf, size_t size, /* {{{ */
   if (len == 0)
     return len;
 
+  if (bind_parser != NULL)
+    return bind_stream_feed(buf, len);
+
   if ((bind_buffer_fill + len) >= bind_buffer_size) {
     char *temp = realloc(bind_buffer, bind_buffer_fill + len + 1);
     if (temp == NULL) {
@@ -656,6 +673,16 @@ static int bind_parse_generic_name_attr_value_list(
   return 0;
 } /* }}} int bind_parse_generic_name_attr_value_list */
 
+/* Returns the configured view called "name" or NULL. */
+static cb_view_t *bind_get_view(const char *name) /* {{{ */
+{
+  for (size_t i = 0; i < views_num; i++) {
+    if (strcasecmp(name, views[i].name) == 0)
+      return views + i;
+  }
+  return NULL;
+} /* }}} cb_view_t *bind_get_view */
+
 static int bind_xml_stats_handle_zone(int version, xmlDoc *doc, /* {{{ */
                                       xmlXPathContext *path_ctx, xmlNode *node,
                                       cb_view_t *view, time_t current_time) {
@@ -758,7 +785,8 @@ static int bind_xml_stats_search_zones(int version, xmlDoc *doc, /* {{{ */
     return -1;
   }
 
-  for (int i = 0; i < zone_nodes->nodesetval->nodeNr; i++) {
+  for (int i = 0;
+       zone_nodes->nodesetval && (i < zone_nodes->nodesetval->nodeNr); i++) {
     node = zone_nodes->nodesetval->nodeTab[i];
     assert(node != NULL);
 
@@ -778,7 +806,6 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
                                       time_t current_time) {
   char *view_name = NULL;
   cb_view_t *view;
-  size_t j;
 
   if (version == 3) {
     view_name = (char *)xmlGetProp(node, BAD_CAST "name");
@@ -788,10 +815,7 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
       return -1;
     }
 
-    for (j = 0; j < views_num; j++) {
-      if (strcasecmp(view_name, views[j].name) == 0)
-        break;
-    }
+    view = bind_get_view(view_name);
 
     xmlFree(view_name);
     view_name = NULL;
@@ -817,10 +841,7 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
       return -1;
     }
 
-    for (j = 0; j < views_num; j++) {
-      if (strcasecmp(view_name, views[j].name) == 0)
-        break;
-    }
+    view = bind_get_view(view_name);
 
     xmlFree(view_name);
     xmlXPathFreeObject(path_obj);
@@ -829,11 +850,9 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
     path_obj = NULL;
   }
 
-  if (j >= views_num)
+  if (view == NULL)
     return 0;
 
-  view = views + j;
-
   DEBUG("bind plugin: bind_xml_stats_handle_view: Found view `%s'.",
         view->name);
 
@@ -1222,6 +1241,30 @@ static void bind_xml_stats_v1_v2(int version, xmlDoc *doc, /* {{{ */
   }
 } /* }}} bind_xml_stats_v1_v2 */
 
+static void bind_xml_stats_memory(xmlDoc *doc, /* {{{ */
+                                  xmlXPathContext *xpathCtx,
+                                  time_t current_time) {
+  /* XPath:  memory/summary
+   * Variables: TotalUse, InUse, BlockSize, ContextSize, Lost
+   * Layout: v2 and v3:
+   *   <summary>
+   *     <TotalUse>6587096</TotalUse>
+   *     <InUse>1345424</InUse>
+   *     <BlockSize>5505024</BlockSize>
+   *     <ContextSize>3732456</ContextSize>
+   *     <Lost>0</Lost>
+   *   </summary>
+   */
+  translation_table_ptr_t table_ptr = {
+      memsummary_translation_table, memsummary_translation_table_length,
+      /* plugin_instance = */ "global-memory_stats"};
+
+  bind_parse_generic_value_list("memory/summary",
+                                /* callback = */ bind_xml_table_callback,
+                                /* user_data = */ &table_ptr, doc, xpathCtx,
+                                current_time, DS_TYPE_GAUGE);
+} /* }}} bind_xml_stats_memory */
+
 static int bind_xml_stats(int version, xmlDoc *doc, /* {{{ */
                           xmlXPathContext *xpathCtx, xmlNode *statsnode) {
   time_t current_time = 0;
@@ -1244,27 +1287,8 @@ static int bind_xml_stats(int version, xmlDoc *doc, /* {{{ */
     bind_xml_stats_v1_v2(version, doc, xpathCtx, current_time);
   }
 
-  /* XPath:  memory/summary
-   * Variables: TotalUse, InUse, BlockSize, ContextSize, Lost
-   * Layout: v2 and v3:
-   *   <summary>
-   *     <TotalUse>6587096</TotalUse>
-   *     <InUse>1345424</InUse>
-   *     <BlockSize>5505024</BlockSize>
-   *     <ContextSize>3732456</ContextSize>
-   *     <Lost>0</Lost>
-   *   </summary>
-   */
-  if (global_memory_stats != 0) {
-    translation_table_ptr_t table_ptr = {
-        memsummary_translation_table, memsummary_translation_table_length,
-        /* plugin_instance = */ "global-memory_stats"};
-
-    bind_parse_generic_value_list("memory/summary",
-                                  /* callback = */ bind_xml_table_callback,
-                                  /* user_data = */ &table_ptr, doc, xpathCtx,
-                                  current_time, DS_TYPE_GAUGE);
-  }
+  if (global_memory_stats != 0)
+    bind_xml_stats_memory(doc, xpathCtx, current_time);
 
   if (views_num > 0)
     bind_xml_stats_search_views(version, doc, xpathCtx, current_time);
@@ -1272,20 +1296,13 @@ static int bind_xml_stats(int version, xmlDoc *doc, /* {{{ */
   return 0;
 } /* }}} int bind_xml_stats */
 
-static int bind_xml(const char *data) /* {{{ */
+static int bind_xml_doc(xmlDoc *doc) /* {{{ */
 {
   int ret = -1;
 
-  xmlDoc *doc = xmlParseMemory(data, strlen(data));
-  if (doc == NULL) {
-    ERROR("bind plugin: xmlParseMemory failed.");
-    return -1;
-  }
-
   xmlXPathContext *xpathCtx = xmlXPathNewContext(doc);
   if (xpathCtx == NULL) {
     ERROR("bind plugin: xmlXPathNewContext failed.");
-    xmlFreeDoc(doc);
     return -1;
   }
 
@@ -1337,7 +1354,6 @@ static int bind_xml(const char *data) /* {{{ */
     // we are finished, early-return
     xmlXPathFreeObject(xpathObj);
     xmlXPathFreeContext(xpathCtx);
-    xmlFreeDoc(doc);
 
     return ret;
   }
@@ -1350,13 +1366,11 @@ static int bind_xml(const char *data) /* {{{ */
   if (xpathObj == NULL) {
     ERROR("bind plugin: Cannot find the <statistics> tag.");
     xmlXPathFreeContext(xpathCtx);
-    xmlFreeDoc(doc);
     return -1;
   } else if (xpathObj->nodesetval == NULL) {
     ERROR("bind plugin: xmlXPathEvalExpression failed.");
     xmlXPathFreeObject(xpathObj);
     xmlXPathFreeContext(xpathCtx);
-    xmlFreeDoc(doc);
     return -1;
   }
 
@@ -1403,11 +1417,233 @@ static int bind_xml(const char *data) /* {{{ */
 
   xmlXPathFreeObject(xpathObj);
   xmlXPathFreeContext(xpathCtx);
-  xmlFreeDoc(doc);
 
+  return ret;
+} /* }}} int bind_xml_doc */
+
+static int bind_xml(const char *data) /* {{{ */
+{
+  xmlDoc *doc = xmlParseMemory(data, strlen(data));
+  if (doc == NULL) {
+    ERROR("bind plugin: xmlParseMemory failed.");
+    return -1;
+  }
+
+  int ret = bind_xml_doc(doc);
+  xmlFreeDoc(doc);
   return ret;
 } /* }}} int bind_xml */
 
+/* Streaming mode {{{
+ *
+ * The statistics are parsed while they are received. Version 3 documents are
+ * processed one section at a time: the children of <statistics>, each <view>
+ * and each <zone> are handed to the regular XPath handling once they have
+ * been closed and released afterwards, so that only the section being parsed
+ * is kept in memory. Older versions are kept completely and handled by
+ * bind_xml_doc() once the document is complete. */
+
+static xmlXPathContext *bind_stream_xpath(xmlNode *node) /* {{{ */
+{
+  if (bind_parser_xpath == NULL) {
+    bind_parser_xpath = xmlXPathNewContext(node->doc);
+    if (bind_parser_xpath == NULL) {
+      ERROR("bind plugin: xmlXPathNewContext failed.");
+      return NULL;
+    }
+  }
+
+  bind_parser_xpath->node = node;
+  return bind_parser_xpath;
+} /* }}} xmlXPathContext *bind_stream_xpath */
+
+/* Handles a child of <statistics>. */
+static void bind_stream_handle_section(xmlNode *node) /* {{{ */
+{
+  xmlXPathContext *xpathCtx = bind_stream_xpath(node->parent);
+  if (xpathCtx == NULL)
+    return;
+
+  if (xmlStrEqual(node->name, BAD_CAST "server")) {
+    int status = bind_xml_read_timestamp("server/current-time", node->doc,
+                                         xpathCtx, &bind_stream_time);
+    if (status != 0) {
+      ERROR("bind plugin: Reading `server/current-time' failed.");
+      return;
+    }
+    DEBUG("bind plugin: Current server time is %i.", (int)bind_stream_time);
+    bind_stream_have_time = true;
+
+    bind_xml_stats_v3(node->doc, xpathCtx, bind_stream_time);
+  } else if (xmlStrEqual(node->name, BAD_CAST "memory")) {
+    if (global_memory_stats != 0)
+      bind_xml_stats_memory(node->doc, xpathCtx, bind_stream_time);
+  }
+} /* }}} void bind_stream_handle_section */
+
+static bool bind_stream_is_element(xmlNode *node, /* {{{ */
+                                   const char *name) {
+  return (node != NULL) && (node->type == XML_ELEMENT_NODE) &&
+         xmlStrEqual(node->name, BAD_CAST name);
+} /* }}} bool bind_stream_is_element */
+
+static void bind_stream_start_element( /* {{{ */
+    void *ctx, const xmlChar *localname, const xmlChar *prefix,
+    const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces,
+    int nb_attributes, int nb_defaulted, const xmlChar **attributes) {
+  xmlParserCtxt *parser = ctx;
+
+  xmlSAX2StartElementNs(ctx, localname, prefix, URI, nb_namespaces, namespaces,
+                        nb_attributes, nb_defaulted, attributes);
+  bind_stream_depth++;
+
+  xmlNode *node = parser->node;
+  if ((bind_stream_depth == 1) && bind_stream_is_element(node, "statistics")) {
+    char *attr_version = (char *)xmlGetProp(node, BAD_CAST "version");
+    /* Anything else is left to bind_xml_doc(). */
+    if ((attr_version != NULL) &&
+        (strncmp("3.", attr_version, strlen("3.")) == 0))
+      bind_stream_version = 3;
+    xmlFree(attr_version);
+  } else if ((bind_stream_version == 3) && (bind_stream_depth == 3) &&
+             bind_stream_is_element(node, "view") &&
+             bind_stream_is_element(node->parent, "views")) {
+    char *view_name = (char *)xmlGetProp(node, BAD_CAST "name");
+    bind_stream_view = (view_name != NULL) ? bind_get_view(view_name) : NULL;
+    xmlFree(view_name);
+  }
+} /* }}} void bind_stream_start_element */
+
+static void bind_stream_end_element(void *ctx, /* {{{ */
+                                    const xmlChar *localname,
+                                    const xmlChar *prefix, const xmlChar *URI) {
+  xmlParserCtxt *parser = ctx;
+  xmlNode *node = parser->node;
+  int depth = bind_stream_depth;
+
+  xmlSAX2EndElementNs(ctx, localname, prefix, URI);
+  bind_stream_depth--;
+
+  if ((bind_stream_version != 3) || (node == NULL) || (depth < 2))
+    return;
+
+  if (depth == 2) {
+    bind_stream_handle_section(node);
+  } else if ((depth == 3) && bind_stream_is_element(node, "view")) {
+    xmlXPathContext *xpathCtx = bind_stream_xpath(node);
+    if ((bind_stream_view != NULL) && (xpathCtx != NULL))
+      bind_xml_stats_handle_view(3, node->doc, xpathCtx, node,
+                                 bind_stream_time);
+    bind_stream_view = NULL;
+  } else if ((depth == 5) && bind_stream_is_element(node, "zone") &&
+             bind_stream_is_element(node->parent, "zones")) {
+    xmlXPathContext *xpathCtx = bind_stream_xpath(node);
+    if ((bind_stream_view != NULL) && (bind_stream_view->zones_num > 0) &&
+        (xpathCtx != NULL))
+      bind_xml_stats_handle_zone(3, node->doc, xpathCtx, node,
+                                 bind_stream_view, bind_stream_time);
+  } else {
+    return;
+  }
+
+  xmlUnlinkNode(node);
+  xmlFreeNode(node);
+} /* }}} void bind_stream_end_element */
+
+/* Whitespace between the sections would pile up in their parents. The
+ * statistics never contain text made up of whitespace only. */
+static void bind_stream_characters(void *ctx, /* {{{ */
+                                   const xmlChar *ch, int len) {
+  if (bind_stream_version == 3) {
+    int i = 0;
+    while ((i < len) && xmlIsBlank_ch(ch[i]))
+      i++;
+    if (i == len)
+      return;
+  }
+
+  xmlSAX2Characters(ctx, ch, len);
+} /* }}} void bind_stream_characters */
+
+static void bind_stream_reset(void) /* {{{ */
+{
+  if (bind_parser_xpath != NULL) {
+    xmlXPathFreeContext(bind_parser_xpath);
+    bind_parser_xpath = NULL;
+  }
+  if (bind_parser != NULL) {
+    xmlFreeDoc(bind_parser->myDoc);
+    bind_parser->myDoc = NULL;
+    xmlFreeParserCtxt(bind_parser);
+    bind_parser = NULL;
+  }
+} /* }}} void bind_stream_reset */
+
+static int bind_stream_start(const char *stream_url) /* {{{ */
+{
+  xmlSAXHandler sax;
+  memset(&sax, 0, sizeof(sax));
+  xmlSAXVersion(&sax, /* version = */ 2);
+  sax.startElementNs = bind_stream_start_element;
+  sax.endElementNs = bind_stream_end_element;
+  sax.characters = bind_stream_characters;
+  sax.ignorableWhitespace = bind_stream_characters;
+  sax.comment = NULL;
+  sax.processingInstruction = NULL;
+
+  bind_stream_reset();
+  bind_stream_version = 0;
+  bind_stream_depth = 0;
+  bind_stream_view = NULL;
+  bind_stream_time = 0;
+  bind_stream_have_time = false;
+
+  bind_parser = xmlCreatePushParserCtxt(&sax, /* user_data = */ NULL,
+                                        /* chunk = */ NULL, /* size = */ 0,
+                                        stream_url);
+  if (bind_parser == NULL) {
+    ERROR("bind plugin: xmlCreatePushParserCtxt failed.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int bind_stream_start */
+
+static size_t bind_stream_feed(const char *buf, size_t len) /* {{{ */
+{
+  if ((xmlParseChunk(bind_parser, buf, (int)len, /* terminate = */ 0) != 0) ||
+      (bind_parser->disableSAX != 0)) {
+    ERROR("bind plugin: Parsing the statistics failed.");
+    return 0;
+  }
+
+  return len;
+} /* }}} size_t bind_stream_feed */
+
+static int bind_stream_finish(void) /* {{{ */
+{
+  int status = xmlParseChunk(bind_parser, NULL, 0, /* terminate = */ 1);
+  if ((status != 0) || !bind_parser->wellFormed ||
+      (bind_parser->myDoc == NULL)) {
+    ERROR("bind plugin: Parsing the statistics failed.");
+    bind_stream_reset();
+    return -1;
+  }
+
+  if (bind_stream_version != 3) {
+    DEBUG("bind plugin: Statistics appears not to be v3");
+    status = bind_xml_doc(bind_parser->myDoc);
+  } else if (!bind_stream_have_time) {
+    ERROR("bind plugin: Reading `server/current-time' failed.");
+    status = -1;
+  }
+
+  bind_stream_reset();
+  return status;
+} /* }}} int bind_stream_finish */
+
+/* }}} End of streaming mode */
+
 static int bind_config_add_view_zone(cb_view_t *view, /* {{{ */
                                      oconfig_item_t *ci) {
   if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
@@ -1509,6 +1745,8 @@ static int bind_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &config_parse_time);
     else if (strcasecmp("Timeout", child->key) == 0)
       cf_util_get_int(child, &timeout);
+    else if (strcasecmp("Streaming", child->key) == 0)
+      cf_util_get_boolean(child, &config_streaming);
     else {
       WARNING("bind plugin: Unknown configuration option "
               "`%s' will be ignored.",
@@ -1555,14 +1793,19 @@ static int bind_read(void) /* {{{ */
 
   bind_buffer_fill = 0;
 
-  curl_easy_setopt(curl, CURLOPT_URL, (url != NULL) ? url : BIND_DEFAULT_URL);
+  const char *read_url = (url != NULL) ? url : BIND_DEFAULT_URL;
+  curl_easy_setopt(curl, CURLOPT_URL, read_url);
+
+  if (config_streaming && (bind_stream_start(read_url) != 0))
+    return -1;
 
   if (curl_easy_perform(curl) != CURLE_OK) {
     ERROR("bind plugin: curl_easy_perform failed: %s", bind_curl_error);
+    bind_stream_reset();
     return -1;
   }
 
-  int status = bind_xml(bind_buffer);
+  int status = config_streaming ? bind_stream_finish() : bind_xml(bind_buffer);
   if (status != 0)
     return -1;
   else
@@ -1571,6 +1814,8 @@ static int bind_read(void) /* {{{ */
 
 static int bind_shutdown(void) /* {{{ */
 {
+  bind_stream_reset();
+
   if (curl != NULL) {
     curl_easy_cleanup(curl);
     curl = NULL;
@@ -75,6 +75,9 @@
 /** Timeout interval in seconds */
 #define CEPH_TIMEOUT_INTERVAL 1
 
+/** Size of the chunks the JSON replies are read and parsed in */
+#define CEPH_READ_BUFFER_SIZE 16384
+
 /** Maximum path length for a UNIX domain socket on this system */
 #define UNIX_DOMAIN_SOCK_PATH_MAX (sizeof(((struct sockaddr_un *)0)->sun_path))
 
@@ -102,6 +105,18 @@ enum ceph_dset_type_d {
 static const char *const ceph_dset_types[CEPH_DSET_TYPES_NUM] = {
     "ceph_latency", "ceph_bytes", "ceph_rate"};
 
+/**
+ * A counter of the perf dump. The keys are reported in the same order with
+ * each dump, so looking up the data source of a key is done once and the
+ * result is remembered by position.
+ */
+struct ceph_key {
+  /** The full JSON key, e.g. "osd.op_latency.sum" */
+  char *path;
+  /** Index into ds_names / ds_types */
+  int ds_index;
+};
+
 /******* ceph_daemon *******/
 struct ceph_daemon {
   /** Version of the admin_socket interface */
@@ -119,6 +134,11 @@ struct ceph_daemon {
   /** Track ds names to match with types */
   char **ds_names;
 
+  /** Keys of the last perf dump, in order */
+  struct ceph_key *keys;
+  /** Number of elements in keys */
+  size_t keys_num;
+
   /**
    * Keep track of last data for latency values so we can calculate rate
    * since last poll.
@@ -176,6 +196,8 @@ struct values_tmp {
   uint64_t avgcount;
   /** current index of counters - used to get type of counter */
   int index;
+  /** position of the current key in the perf dump, see struct ceph_key */
+  size_t key_index;
   /**
    * similar to index, but current index of latency type counters -
    * used to get last poll data of counter
@@ -233,8 +255,11 @@ struct cconn {
   /** Length of the JSON to read */
   uint32_t json_len;
 
-  /** Buffer containing JSON data */
-  unsigned char *json;
+  /** Parser the JSON is fed to while it is read */
+  yajl_handle hand;
+
+  /** Values of a perf dump being parsed */
+  struct values_tmp *vtmp;
 
   /** Keep data important to yajl processing */
   struct yajl_struct yajl;
@@ -394,6 +419,11 @@ static void ceph_daemon_free(struct ceph_daemon *d) {
   }
   sfree(d->ds_types);
   sfree(d->ds_names);
+
+  for (size_t i = 0; i < d->keys_num; i++) {
+    sfree(d->keys[i].path);
+  }
+  sfree(d->keys);
   sfree(d);
 }
 
@@ -851,36 +881,31 @@ static double get_last_avg(struct ceph_daemon *d, const char *ds_n, int index,
 /**
  * If using index guess failed, resort to searching for counter name
  */
-static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name) {
+static int backup_search_for_ds(struct ceph_daemon *d, const char *ds_name) {
   for (int i = 0; i < d->ds_num; i++) {
     if (strcmp(d->ds_names[i], ds_name) == 0) {
-      return d->ds_types[i];
+      return i;
     }
   }
-  return DSET_TYPE_UNFOUND;
+  return -1;
 }
 
 /**
- * Process counter data and dispatch values
+ * Look up the data source of a perf dump key. Returns the index into ds_names
+ * and ds_types, -1 if there is no such data source and another negative value
+ * on error.
  */
-static int node_handler_fetch_data(void *arg, const char *val,
-                                   const char *key) {
-  value_t uv;
-  double tmp_d;
-  uint64_t tmp_u;
-  struct values_tmp *vtmp = (struct values_tmp *)arg;
-  uint32_t type = DSET_TYPE_UNFOUND;
-  int index = vtmp->index;
-
+static int ceph_daemon_lookup_ds(struct ceph_daemon *d, int index,
+                                 const char *key) {
   char ds_name[DATA_MAX_NAME_LEN];
 
   if (parse_keys(ds_name, sizeof(ds_name), key)) {
-    return 1;
+    return -EINVAL;
   }
 
-  if (index >= vtmp->d->ds_num) {
+  if (index >= d->ds_num) {
     // don't overflow bounds of array
-    index = (vtmp->d->ds_num - 1);
+    index = (d->ds_num - 1);
   }
 
   /**
@@ -889,20 +914,84 @@ static int node_handler_fetch_data(void *arg, const char *val,
    * use index to guess point in array for retrieving type. if that doesn't
    * work, use the old way to get the counter type
    */
-  if (strcmp(ds_name, vtmp->d->ds_names[index]) == 0) {
+  if (strcmp(ds_name, d->ds_names[index]) == 0) {
     // found match
-    type = vtmp->d->ds_types[index];
-  } else if ((index > 0) &&
-             (strcmp(ds_name, vtmp->d->ds_names[index - 1]) == 0)) {
+    return index;
+  } else if ((index > 0) && (strcmp(ds_name, d->ds_names[index - 1]) == 0)) {
     // try previous key
-    type = vtmp->d->ds_types[index - 1];
+    return index - 1;
   }
 
-  if (type == DSET_TYPE_UNFOUND) {
-    // couldn't find right type by guessing, check the old way
-    type = backup_search_for_type(vtmp->d, ds_name);
+  // couldn't find right type by guessing, check the old way
+  int ds_index = backup_search_for_ds(d, ds_name);
+  if (ds_index < 0) {
+    ERROR("ceph plugin: ds %s was not properly initialized.", ds_name);
+  }
+  return ds_index;
+}
+
+/**
+ * Remember the data source of the key at position key_index of the perf dump.
+ */
+static int ceph_daemon_cache_key(struct ceph_daemon *d, size_t key_index,
+                                 const char *key, int ds_index) {
+  if (key_index >= d->keys_num) {
+    struct ceph_key *tmp =
+        realloc(d->keys, (key_index + 1) * sizeof(*d->keys));
+    if (tmp == NULL) {
+      return -ENOMEM;
+    }
+    d->keys = tmp;
+    for (size_t i = d->keys_num; i <= key_index; i++) {
+      d->keys[i] = (struct ceph_key){.path = NULL, .ds_index = -1};
+    }
+    d->keys_num = key_index + 1;
+  }
+
+  char *path = strdup(key);
+  if (path == NULL) {
+    return -ENOMEM;
+  }
+  sfree(d->keys[key_index].path);
+  d->keys[key_index] = (struct ceph_key){.path = path, .ds_index = ds_index};
+  return 0;
+}
+
+/**
+ * Process counter data and dispatch values
+ */
+static int node_handler_fetch_data(void *arg, const char *val,
+                                   const char *key) {
+  value_t uv;
+  double tmp_d;
+  uint64_t tmp_u;
+  struct values_tmp *vtmp = (struct values_tmp *)arg;
+  struct ceph_daemon *d = vtmp->d;
+  size_t key_index = vtmp->key_index;
+  int ds_index;
+
+  vtmp->key_index++;
+
+  /* Only the first dump and keys that have changed since the last dump need
+   * the ds name to be built and looked up. */
+  if ((key_index < d->keys_num) && (d->keys[key_index].path != NULL) &&
+      (strcmp(d->keys[key_index].path, key) == 0)) {
+    ds_index = d->keys[key_index].ds_index;
+  } else {
+    ds_index = ceph_daemon_lookup_ds(d, vtmp->index, key);
+    if (ds_index < -1) {
+      return 1;
+    } else if (ds_index < 0) {
+      return -1;
+    }
+    if (ceph_daemon_cache_key(d, key_index, key, ds_index) != 0) {
+      return -ENOMEM;
+    }
   }
 
+  char const *ds_name = d->ds_names[ds_index];
+  uint32_t type = d->ds_types[ds_index];
+
   switch (type) {
   case DSET_LATENCY:
     if (has_suffix(key, ".avgcount")) {
@@ -1011,10 +1100,17 @@ static int cconn_connect(struct cconn *io) {
   io->state = CSTATE_WRITE_REQUEST;
   io->amt = 0;
   io->json_len = 0;
-  io->json = NULL;
   return 0;
 }
 
+static void cconn_json_free(struct cconn *io) {
+  if (io->hand != NULL) {
+    yajl_free(io->hand);
+    io->hand = NULL;
+  }
+  sfree(io->vtmp);
+}
+
 static void cconn_close(struct cconn *io) {
   io->state = CSTATE_UNCONNECTED;
   if (io->asok != -1) {
@@ -1024,65 +1120,52 @@ static void cconn_close(struct cconn *io) {
   io->asok = -1;
   io->amt = 0;
   io->json_len = 0;
-  sfree(io->json);
-  io->json = NULL;
-}
-
-/* Process incoming JSON counter data */
-static int cconn_process_data(struct cconn *io, yajl_struct *yajl,
-                              yajl_handle hand) {
-  int ret;
-  struct values_tmp *vtmp = calloc(1, sizeof(*vtmp));
-  if (!vtmp) {
-    return -ENOMEM;
-  }
-
-  vtmp->vlist = (value_list_t)VALUE_LIST_INIT;
-  sstrncpy(vtmp->vlist.plugin, "ceph", sizeof(vtmp->vlist.plugin));
-  sstrncpy(vtmp->vlist.plugin_instance, io->d->name,
-           sizeof(vtmp->vlist.plugin_instance));
-
-  vtmp->d = io->d;
-  vtmp->latency_index = 0;
-  vtmp->index = 0;
-  yajl->handler_arg = vtmp;
-  ret = traverse_json(io->json, io->json_len, hand);
-  sfree(vtmp);
-  return ret;
+  cconn_json_free(io);
 }
 
 /**
- * Initiate JSON parsing and print error if one occurs
+ * Set up parsing of the JSON reply. The JSON is parsed while it is being read,
+ * see cconn_handle_event().
  */
-static int cconn_process_json(struct cconn *io) {
+static int cconn_json_start(struct cconn *io) {
   if ((io->request_type != ASOK_REQ_DATA) &&
       (io->request_type != ASOK_REQ_SCHEMA)) {
     return -EDOM;
   }
 
-  int result = 1;
-  yajl_handle hand;
-  yajl_status status;
-
-  hand = yajl_alloc(&callbacks,
+  io->hand = yajl_alloc(&callbacks,
 #if HAVE_YAJL_V2
-                    /* alloc funcs = */ NULL,
+                        /* alloc funcs = */ NULL,
 #else
-                    /* alloc funcs = */ NULL, NULL,
+                        /* alloc funcs = */ NULL, NULL,
 #endif
-                    /* context = */ (void *)(&io->yajl));
+                        /* context = */ (void *)(&io->yajl));
 
-  if (!hand) {
+  if (!io->hand) {
     ERROR("ceph plugin: yajl_alloc failed.");
-    return ENOMEM;
+    return -ENOMEM;
   }
 
   io->yajl.depth = 0;
 
   switch (io->request_type) {
   case ASOK_REQ_DATA:
+    io->vtmp = calloc(1, sizeof(*io->vtmp));
+    if (!io->vtmp) {
+      return -ENOMEM;
+    }
+
+    io->vtmp->vlist = (value_list_t)VALUE_LIST_INIT;
+    sstrncpy(io->vtmp->vlist.plugin, "ceph", sizeof(io->vtmp->vlist.plugin));
+    sstrncpy(io->vtmp->vlist.plugin_instance, io->d->name,
+             sizeof(io->vtmp->vlist.plugin_instance));
+
+    io->vtmp->d = io->d;
+    io->vtmp->latency_index = 0;
+    io->vtmp->index = 0;
+    io->vtmp->key_index = 0;
     io->yajl.handler = node_handler_fetch_data;
-    result = cconn_process_data(io, &io->yajl, hand);
+    io->yajl.handler_arg = io->vtmp;
     break;
   case ASOK_REQ_SCHEMA:
     // init daemon specific variables
@@ -1091,33 +1174,34 @@ static int cconn_process_json(struct cconn *io) {
     io->d->last_poll_data = NULL;
     io->yajl.handler = node_handler_define_schema;
     io->yajl.handler_arg = io->d;
-    result = traverse_json(io->json, io->json_len, hand);
     break;
   }
 
-  if (result) {
-    goto done;
-  }
+  return 0;
+}
+
+/** Finish parsing once the complete JSON reply has been read */
+static int cconn_json_finish(struct cconn *io) {
+  yajl_status status;
 
 #if HAVE_YAJL_V2
-  status = yajl_complete_parse(hand);
+  status = yajl_complete_parse(io->hand);
 #else
-  status = yajl_parse_complete(hand);
+  status = yajl_parse_complete(io->hand);
 #endif
 
   if (status != yajl_status_ok) {
     unsigned char *errmsg =
-        yajl_get_error(hand, /* verbose = */ 0,
+        yajl_get_error(io->hand, /* verbose = */ 0,
                        /* jsonText = */ NULL, /* jsonTextLen = */ 0);
     ERROR("ceph plugin: yajl_parse_complete failed: %s", (char *)errmsg);
-    yajl_free_error(hand, errmsg);
-    yajl_free(hand);
+    yajl_free_error(io->hand, errmsg);
+    cconn_json_free(io);
     return 1;
   }
 
-done:
-  yajl_free(hand);
-  return result;
+  cconn_json_free(io);
+  return 0;
 }
 
 static int cconn_validate_revents(struct cconn *io, int revents) {
@@ -1216,25 +1300,37 @@ static ssize_t cconn_handle_event(struct cconn *io) {
       io->json_len = ntohl(io->json_len);
       io->amt = 0;
       io->state = CSTATE_READ_JSON;
-      io->json = calloc(1, io->json_len + 1);
-      if (!io->json) {
-        ERROR("ceph plugin: error callocing io->json");
-        return -ENOMEM;
+      ret = cconn_json_start(io);
+      if (ret) {
+        return ret;
       }
     }
     return 0;
   }
   case CSTATE_READ_JSON: {
-    RETRY_ON_EINTR(ret,
-                   read(io->asok, io->json + io->amt, io->json_len - io->amt));
+    unsigned char buffer[CEPH_READ_BUFFER_SIZE];
+    size_t len = io->json_len - io->amt;
+    if (len > sizeof(buffer)) {
+      len = sizeof(buffer);
+    }
+    RETRY_ON_EINTR(ret, read(io->asok, buffer, len));
     DEBUG("ceph plugin: cconn_handle_event(name=%s,state=%d,ret=%zd)",
           io->d->name, io->state, ret);
     if (ret < 0) {
       return ret;
+    } else if (ret == 0) {
+      ERROR("ceph plugin: cconn_handle_event(name=%s): connection closed "
+            "after %" PRIu32 " of %" PRIu32 " bytes",
+            io->d->name, io->amt, io->json_len);
+      return -EPIPE;
     }
     io->amt += ret;
+    ret = traverse_json(buffer, (uint32_t)ret, io->hand);
+    if (ret) {
+      return ret;
+    }
     if (io->amt >= io->json_len) {
-      ret = cconn_process_json(io);
+      ret = cconn_json_finish(io);
       if (ret) {
         return ret;
       }
@@ -181,9 +181,48 @@ DEF_TEST(parse_keys) {
   return 0;
 }
 
+DEF_TEST(fetch_data_key_cache) {
+  struct ceph_daemon d = {.name = "test"};
+  struct values_tmp vtmp = {.d = &d, .vlist = VALUE_LIST_INIT};
+
+  CHECK_ZERO(ceph_daemon_add_ds_entry(&d, "WBThrottle.bytes_dirtied.type", 2));
+  CHECK_ZERO(ceph_daemon_add_ds_entry(&d, "WBThrottle.ios_wb.type", 2));
+
+  /* The first dump looks up and remembers the data sources. */
+  CHECK_ZERO(node_handler_fetch_data(&vtmp, "1", "WBThrottle.bytes_dirtied"));
+  CHECK_ZERO(node_handler_fetch_data(&vtmp, "2", "WBThrottle.ios_wb"));
+  EXPECT_EQ_INT(2, (int)d.keys_num);
+  EXPECT_EQ_STR("WBThrottle.bytes_dirtied", d.keys[0].path);
+  EXPECT_EQ_INT(0, d.keys[0].ds_index);
+  EXPECT_EQ_INT(1, d.keys[1].ds_index);
+  EXPECT_EQ_STR("WBThrottle.iosWb", vtmp.vlist.type_instance);
+
+  /* Keys that moved are looked up again. */
+  vtmp.index = 0;
+  vtmp.key_index = 0;
+  CHECK_ZERO(node_handler_fetch_data(&vtmp, "3", "WBThrottle.ios_wb"));
+  EXPECT_EQ_STR("WBThrottle.iosWb", vtmp.vlist.type_instance);
+  EXPECT_EQ_STR("WBThrottle.ios_wb", d.keys[0].path);
+  EXPECT_EQ_INT(1, d.keys[0].ds_index);
+  EXPECT_EQ_INT(2, (int)d.keys_num);
+
+  /* Unknown keys are an error. */
+  EXPECT_EQ_INT(-1, node_handler_fetch_data(&vtmp, "4", "WBThrottle.nope"));
+
+  for (int i = 0; i < d.ds_num; i++)
+    sfree(d.ds_names[i]);
+  sfree(d.ds_names);
+  sfree(d.ds_types);
+  for (size_t i = 0; i < d.keys_num; i++)
+    sfree(d.keys[i].path);
+  sfree(d.keys);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(traverse_json);
   RUN_TEST(parse_keys);
+  RUN_TEST(fetch_data_key_cache);
 
   END_TEST;
 }
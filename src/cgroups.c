@@ -26,26 +26,87 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/avltree/avltree.h"
+#include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
 
-static char const *config_keys[] = {"CGroup", "IgnoreSelected"};
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#define CG2_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+/* Large enough for memory.stat and for io.stat with a few dozen devices. */
+#define CG2_BUFFER_SIZE 8192
+#define CG2_MAX_READ_THREADS 64
+
+static char const *config_keys[] = {
+    "CGroup",         "IgnoreSelected", "CGroupVersion",   "ReadThreads",
+    "ReportCPU",      "ReportMemory",   "ReportIO",        "ReportPressure"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_cgroup;
 
-__attribute__((nonnull(1))) __attribute__((nonnull(2))) static void
-cgroups_submit_one(char const *plugin_instance, char const *type_instance,
-                   value_t value) {
+/* 0 means "v1 if the cpuacct controller is mounted, v2 otherwise". */
+static int cgroup_version;
+static int read_threads = 1;
+static bool report_cpu = true;
+static bool report_memory = true;
+static bool report_io = true;
+static bool report_pressure = true;
+
+/* A cgroup of the unified (v2) hierarchy. The directory is kept open, so the
+ * interface files are opened relative to it, as long as that leaves enough
+ * file descriptors for the rest of the daemon. */
+typedef struct {
+  char *path; /* relative to the mount point */
+  char *name; /* last component, used as the plugin instance */
+  int dir_fd; /* -1 if the files are opened relative to the mount point */
+  int wd;
+  bool selected;
+} cg2_t;
+
+/* Cgroups are discovered once and then kept up to date from inotify(7)
+ * events, so the tree is only scanned again if events have been lost or
+ * watching is not possible. Discovery takes the write lock, the read
+ * callbacks take the read lock and each read their share of "cg2_list". */
+static pthread_rwlock_t cg2_lock = PTHREAD_RWLOCK_INITIALIZER;
+static char *cg2_mount;
+static int cg2_mount_fd = -1;
+static int cg2_notify_fd = -1;
+static bool cg2_watch_disabled;
+static bool cg2_rescan = true;
+static c_avl_tree_t *cg2_by_path; /* path -> cg2_t */
+static c_avl_tree_t *cg2_by_wd;   /* watch descriptor -> cg2_t */
+static cg2_t **cg2_list;          /* selected cgroups, sorted by path */
+static size_t cg2_list_num;
+static bool cg2_list_dirty;
+static long clock_ticks;
+static size_t cg2_fds_num;
+static size_t cg2_fds_max;
+
+static void cgroups_submit(char const *plugin_instance, char const *type,
+                           char const *type_instance, value_t *values,
+                           size_t values_num) {
   value_list_t vl = VALUE_LIST_INIT;
 
-  vl.values = &value;
-  vl.values_len = 1;
+  vl.values = values;
+  vl.values_len = values_num;
   sstrncpy(vl.plugin, "cgroups", sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, "cpu", sizeof(vl.type));
-  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
 
   plugin_dispatch_values(&vl);
+} /* void cgroups_submit */
+
+__attribute__((nonnull(1))) __attribute__((nonnull(2))) static void
+cgroups_submit_one(char const *plugin_instance, char const *type_instance,
+                   value_t value) {
+  cgroups_submit(plugin_instance, "cpu", type_instance, &value, 1);
 } /* void cgroups_submit_one */
 
 /*
@@ -154,10 +215,567 @@ static int read_cpuacct_root(const char *dirname, const char *filename,
   return 0;
 }
 
+/*
+ * cgroup v2
+ */
+static int cg2_compare_wd(const void *a, const void *b) {
+  int wd_a = *(const int *)a;
+  int wd_b = *(const int *)b;
+  return (wd_a > wd_b) - (wd_a < wd_b);
+} /* int cg2_compare_wd */
+
+static void cg2_free(cg2_t *cg) {
+  if (cg == NULL)
+    return;
+
+  if (cg->dir_fd >= 0) {
+    close(cg->dir_fd);
+    cg2_fds_num--;
+  }
+  sfree(cg->path);
+  sfree(cg->name);
+  sfree(cg);
+} /* void cg2_free */
+
+static void cg2_remove(cg2_t *cg) {
+  char *key = NULL;
+  cg2_t *value = NULL;
+
+  c_avl_remove(cg2_by_path, cg->path, (void *)&key, (void *)&value);
+  if (cg->wd >= 0) {
+#if HAVE_SYS_INOTIFY_H
+    /* Fails if the directory is gone already, which is fine. */
+    inotify_rm_watch(cg2_notify_fd, cg->wd);
+#endif
+    c_avl_remove(cg2_by_wd, &cg->wd, (void *)&key, (void *)&value);
+  }
+
+  cg2_free(cg);
+  cg2_list_dirty = true;
+} /* void cg2_remove */
+
+static void cg2_clear(void) {
+  void *key;
+  void *value;
+
+  if (cg2_by_wd != NULL) {
+    /* The key is part of the value. */
+    while (c_avl_pick(cg2_by_wd, &key, &value) == 0)
+      ;
+  }
+  if (cg2_by_path != NULL) {
+    while (c_avl_pick(cg2_by_path, &key, &value) == 0)
+      cg2_free(value);
+  }
+
+  if (cg2_notify_fd >= 0) {
+    close(cg2_notify_fd);
+    cg2_notify_fd = -1;
+  }
+
+  sfree(cg2_list);
+  cg2_list_num = 0;
+  cg2_list_dirty = true;
+} /* void cg2_clear */
+
+/* Adds the cgroup at "path", relative to the mount point, and all cgroups
+ * below it. */
+static int cg2_scan(char const *path) {
+  int fd = openat(cg2_mount_fd, (path[0] == 0) ? "." : path,
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    /* The cgroup may have been removed in the meantime. */
+    if (errno == ENOENT)
+      return 0;
+    ERROR("cgroups plugin: Cannot open \"%s/%s\": %s", cg2_mount, path,
+          STRERRNO);
+    return -1;
+  }
+
+  cg2_t *cg = NULL;
+  if ((c_avl_get(cg2_by_path, path, (void *)&cg) == 0) && (cg != NULL)) {
+    /* Known already, e.g. from an event for a parent. */
+    close(fd);
+    return 0;
+  }
+
+  cg = calloc(1, sizeof(*cg));
+  if (cg == NULL) {
+    close(fd);
+    return ENOMEM;
+  }
+  cg->dir_fd = fd;
+  cg2_fds_num++;
+  cg->wd = -1;
+  cg->path = strdup(path);
+  char const *name = strrchr(path, '/');
+  cg->name = strdup((name != NULL) ? name + 1 : path);
+  if ((cg->path == NULL) || (cg->name == NULL) ||
+      (c_avl_insert(cg2_by_path, cg->path, cg) != 0)) {
+    ERROR("cgroups plugin: Adding cgroup \"%s\" failed.", path);
+    cg2_free(cg);
+    return ENOMEM;
+  }
+
+  /* The root cgroup is not reported, like with cgroup v1. */
+  cg->selected = (path[0] != 0) && (ignorelist_match(il_cgroup, cg->name) == 0);
+  cg2_list_dirty = true;
+
+#if HAVE_SYS_INOTIFY_H
+  if (cg2_notify_fd >= 0) {
+    char abs_path[PATH_MAX];
+    snprintf(abs_path, sizeof(abs_path), "%s/%s", cg2_mount, path);
+
+    cg->wd = inotify_add_watch(cg2_notify_fd, abs_path,
+                               CG2_WATCH_MASK | IN_ONLYDIR);
+    if (cg->wd < 0) {
+      WARNING("cgroups plugin: Watching \"%s\" failed: %s. Scanning the "
+              "cgroups on every read.",
+              abs_path, STRERRNO);
+      close(cg2_notify_fd);
+      cg2_notify_fd = -1;
+      cg2_watch_disabled = true;
+    } else {
+      /* A directory may be watched again after being moved. */
+      void *key = NULL;
+      cg2_t *old = NULL;
+      if (c_avl_remove(cg2_by_wd, &cg->wd, &key, (void *)&old) == 0)
+        old->wd = -1;
+      c_avl_insert(cg2_by_wd, &cg->wd, cg);
+    }
+  }
+#endif
+
+  /* Scan the children after the watch has been added, so that none are
+   * missed. */
+  int dup_fd = dup(fd);
+  DIR *dh = (dup_fd >= 0) ? fdopendir(dup_fd) : NULL;
+  if (dh == NULL) {
+    if (dup_fd >= 0)
+      close(dup_fd);
+    ERROR("cgroups plugin: Cannot read \"%s/%s\": %s", cg2_mount, path,
+          STRERRNO);
+    return -1;
+  }
+
+  struct dirent *ent;
+  while ((ent = readdir(dh)) != NULL) {
+    if (ent->d_name[0] == '.')
+      continue;
+    if ((ent->d_type != DT_DIR) && (ent->d_type != DT_UNKNOWN))
+      continue;
+
+    struct stat statbuf;
+    if ((ent->d_type == DT_UNKNOWN) &&
+        ((fstatat(fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) ||
+         !S_ISDIR(statbuf.st_mode)))
+      continue;
+
+    char child[PATH_MAX];
+    int len = snprintf(child, sizeof(child), "%s%s%s", path,
+                       (path[0] == 0) ? "" : "/", ent->d_name);
+    if ((len < 0) || ((size_t)len >= sizeof(child)))
+      continue;
+
+    cg2_scan(child);
+  }
+  closedir(dh);
+
+  if (cg2_fds_num > cg2_fds_max) {
+    close(cg->dir_fd);
+    cg->dir_fd = -1;
+    cg2_fds_num--;
+  }
+
+  return 0;
+} /* int cg2_scan */
+
+#if HAVE_SYS_INOTIFY_H
+/* Applies the events queued since the last read. Returns non-zero if the
+ * hierarchy needs to be scanned again. */
+static int cg2_watch_read(void) {
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool rescan = false;
+  ssize_t len;
+
+  while ((len = read(cg2_notify_fd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      struct inotify_event *event = (struct inotify_event *)ptr;
+      ptr += sizeof(*event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        WARNING("cgroups plugin: Events have been lost. Scanning the "
+                "cgroups.");
+        rescan = true;
+        continue;
+      }
+
+      cg2_t *parent = NULL;
+      if (c_avl_get(cg2_by_wd, &event->wd, (void *)&parent) != 0)
+        continue;
+
+      if (event->mask & IN_IGNORED) {
+        void *key = NULL;
+        c_avl_remove(cg2_by_wd, &event->wd, &key, (void *)&parent);
+        parent->wd = -1;
+        continue;
+      }
+
+      if ((event->len == 0) || !(event->mask & IN_ISDIR))
+        continue;
+
+      char path[PATH_MAX];
+      int status = snprintf(path, sizeof(path), "%s%s%s", parent->path,
+                            (parent->path[0] == 0) ? "" : "/", event->name);
+      if ((status < 0) || ((size_t)status >= sizeof(path)))
+        continue;
+
+      if (event->mask & IN_MOVED_FROM) {
+        /* The paths of the cgroups below have changed, too. */
+        rescan = true;
+      } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (cg2_scan(path) != 0)
+          rescan = true;
+      } else if (event->mask & IN_DELETE) {
+        /* Only empty cgroups can be removed, so there are no children. */
+        cg2_t *cg = NULL;
+        if (c_avl_get(cg2_by_path, path, (void *)&cg) == 0)
+          cg2_remove(cg);
+      }
+
+      /* cg2_scan() stops watching if adding a watch fails. */
+      if (cg2_notify_fd < 0)
+        return 1;
+    }
+  }
+
+  if ((len < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+    ERROR("cgroups plugin: Reading events failed: %s", STRERRNO);
+    return 1;
+  }
+
+  return rescan ? 1 : 0;
+} /* int cg2_watch_read */
+#endif /* HAVE_SYS_INOTIFY_H */
+
+static int cg2_list_update(void) {
+  if (!cg2_list_dirty)
+    return 0;
+
+  size_t num = (size_t)c_avl_size(cg2_by_path);
+  cg2_t **list = realloc(cg2_list, (num + 1) * sizeof(*list));
+  if (list == NULL) {
+    ERROR("cgroups plugin: realloc failed.");
+    return ENOMEM;
+  }
+  cg2_list = list;
+  cg2_list_num = 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(cg2_by_path);
+  char *key;
+  cg2_t *cg;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&cg) == 0) {
+    if (cg->selected)
+      cg2_list[cg2_list_num++] = cg;
+  }
+  c_avl_iterator_destroy(iter);
+
+  cg2_list_dirty = false;
+  return 0;
+} /* int cg2_list_update */
+
+/* Brings the list of cgroups up to date. Called with the write lock held. */
+static int cg2_update(void) {
+  if (cg2_by_path == NULL) {
+    cg2_by_path = c_avl_create((int (*)(const void *, const void *))strcmp);
+    cg2_by_wd = c_avl_create(cg2_compare_wd);
+    if ((cg2_by_path == NULL) || (cg2_by_wd == NULL)) {
+      ERROR("cgroups plugin: c_avl_create failed.");
+      return ENOMEM;
+    }
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  if (!cg2_rescan && (cg2_notify_fd >= 0) && (cg2_watch_read() != 0))
+    cg2_rescan = true;
+#endif
+  if (cg2_notify_fd < 0)
+    cg2_rescan = true;
+
+  if (cg2_rescan) {
+    cg2_clear();
+#if HAVE_SYS_INOTIFY_H
+    if (!cg2_watch_disabled) {
+      cg2_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (cg2_notify_fd < 0) {
+        WARNING("cgroups plugin: inotify_init1 failed: %s. Scanning the "
+                "cgroups on every read.",
+                STRERRNO);
+        cg2_watch_disabled = true;
+      }
+    }
+#endif
+    int status = cg2_scan("");
+    if (status != 0)
+      return status;
+    cg2_rescan = false;
+  }
+
+  return cg2_list_update();
+} /* int cg2_update */
+
+/* Reads the interface file "file" of "cg". Returns the length read or -1 if
+ * the file doesn't exist, e.g. because the controller is not enabled. */
+static ssize_t cg2_read_file(cg2_t const *cg, char const *file, char *buffer,
+                             size_t buffer_size) {
+  int fd;
+  if (cg->dir_fd >= 0) {
+    fd = openat(cg->dir_fd, file, O_RDONLY | O_CLOEXEC);
+  } else {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", cg->path, file);
+    fd = openat(cg2_mount_fd, path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0)
+    return -1;
+
+  size_t len = 0;
+  while (len < buffer_size - 1) {
+    ssize_t status = read(fd, buffer + len, buffer_size - 1 - len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return -1;
+    }
+    if (status == 0)
+      break;
+    len += (size_t)status;
+  }
+  close(fd);
+
+  buffer[len] = 0;
+  return (ssize_t)len;
+} /* ssize_t cg2_read_file */
+
+/* Returns the next "key value" line of a flat keyed file, or false at the
+ * end of "*ptr". */
+static bool cg2_next_pair(char **ptr, char **ret_key, char **ret_value) {
+  while (**ptr != 0) {
+    char *line = *ptr;
+    char *end = strchr(line, '\n');
+    if (end != NULL) {
+      *end = 0;
+      *ptr = end + 1;
+    } else {
+      *ptr = line + strlen(line);
+    }
+
+    char *value = strchr(line, ' ');
+    if (value == NULL)
+      continue;
+    *value++ = 0;
+
+    *ret_key = line;
+    *ret_value = value;
+    return true;
+  }
+  return false;
+} /* bool cg2_next_pair */
+
+static void cg2_read_cpu(cg2_t const *cg, char *buffer) {
+  if (cg2_read_file(cg, "cpu.stat", buffer, CG2_BUFFER_SIZE) < 0)
+    return;
+
+  char *ptr = buffer;
+  char *key;
+  char *value;
+  while (cg2_next_pair(&ptr, &key, &value)) {
+    uint64_t usec = (uint64_t)strtoull(value, NULL, 10);
+
+    /* Reported in USER_HZ, like cpuacct.stat of cgroup v1. */
+    if (strcmp(key, "user_usec") == 0)
+      cgroups_submit_one(cg->name, "user",
+                         (value_t){.derive = (derive_t)(usec * clock_ticks /
+                                                        1000000)});
+    else if (strcmp(key, "system_usec") == 0)
+      cgroups_submit_one(cg->name, "system",
+                         (value_t){.derive = (derive_t)(usec * clock_ticks /
+                                                        1000000)});
+    else if (strcmp(key, "throttled_usec") == 0)
+      cgroups_submit(cg->name, "total_time_in_ms", "throttled",
+                     &(value_t){.derive = (derive_t)(usec / 1000)}, 1);
+  }
+} /* void cg2_read_cpu */
+
+static void cg2_read_memory(cg2_t const *cg, char *buffer) {
+  static char const *const keys[] = {"anon",         "file", "kernel_stack",
+                                     "slab",         "sock", "shmem",
+                                     "file_mapped",  "file_dirty"};
+
+  if (cg2_read_file(cg, "memory.current", buffer, CG2_BUFFER_SIZE) > 0)
+    cgroups_submit(cg->name, "memory", "current",
+                   &(value_t){.gauge = (gauge_t)strtoull(buffer, NULL, 10)},
+                   1);
+
+  if (cg2_read_file(cg, "memory.stat", buffer, CG2_BUFFER_SIZE) < 0)
+    return;
+
+  char *ptr = buffer;
+  char *key;
+  char *value;
+  while (cg2_next_pair(&ptr, &key, &value)) {
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++) {
+      if (strcmp(key, keys[i]) != 0)
+        continue;
+      cgroups_submit(cg->name, "memory", key,
+                     &(value_t){.gauge = (gauge_t)strtoull(value, NULL, 10)},
+                     1);
+      break;
+    }
+  }
+} /* void cg2_read_memory */
+
+/* Sums the counters of all devices in io.stat:
+ *   8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 dbytes=0 dios=0
+ */
+static void cg2_read_io(cg2_t const *cg, char *buffer) {
+  if (cg2_read_file(cg, "io.stat", buffer, CG2_BUFFER_SIZE) < 0)
+    return;
+
+  derive_t rbytes = 0, wbytes = 0, rios = 0, wios = 0;
+  char *saveptr = NULL;
+  for (char *field = strtok_r(buffer, " \n", &saveptr); field != NULL;
+       field = strtok_r(NULL, " \n", &saveptr)) {
+    char *value = strchr(field, '=');
+    if (value == NULL)
+      continue;
+    *value++ = 0;
+
+    derive_t v = (derive_t)strtoull(value, NULL, 10);
+    if (strcmp(field, "rbytes") == 0)
+      rbytes += v;
+    else if (strcmp(field, "wbytes") == 0)
+      wbytes += v;
+    else if (strcmp(field, "rios") == 0)
+      rios += v;
+    else if (strcmp(field, "wios") == 0)
+      wios += v;
+  }
+
+  cgroups_submit(cg->name, "io_octets", NULL,
+                 (value_t[]){{.derive = rbytes}, {.derive = wbytes}}, 2);
+  cgroups_submit(cg->name, "io_ops", NULL,
+                 (value_t[]){{.derive = rios}, {.derive = wios}}, 2);
+} /* void cg2_read_io */
+
+/* Reports the total stall time of a pressure file:
+ *   some avg10=0.00 avg60=0.00 avg300=0.00 total=123456
+ *   full avg10=0.00 avg60=0.00 avg300=0.00 total=2345
+ */
+static void cg2_read_pressure(cg2_t const *cg, char const *resource,
+                              char *buffer) {
+  char file[32];
+  snprintf(file, sizeof(file), "%s.pressure", resource);
+  if (cg2_read_file(cg, file, buffer, CG2_BUFFER_SIZE) < 0)
+    return;
+
+  char *ptr = buffer;
+  char *key;
+  char *value;
+  while (cg2_next_pair(&ptr, &key, &value)) {
+    char *total = strstr(value, "total=");
+    if (total == NULL)
+      continue;
+
+    char type_instance[DATA_MAX_NAME_LEN];
+    snprintf(type_instance, sizeof(type_instance), "pressure-%s-%s", resource,
+             key);
+    uint64_t usec = (uint64_t)strtoull(total + strlen("total="), NULL, 10);
+    cgroups_submit(cg->name, "total_time_in_ms", type_instance,
+                   &(value_t){.derive = (derive_t)(usec / 1000)}, 1);
+  }
+} /* void cg2_read_pressure */
+
+static void cg2_read_one(cg2_t const *cg) {
+  char buffer[CG2_BUFFER_SIZE];
+
+  if (report_cpu)
+    cg2_read_cpu(cg, buffer);
+  if (report_memory)
+    cg2_read_memory(cg, buffer);
+  if (report_io)
+    cg2_read_io(cg, buffer);
+  if (report_pressure) {
+    cg2_read_pressure(cg, "cpu", buffer);
+    cg2_read_pressure(cg, "memory", buffer);
+    cg2_read_pressure(cg, "io", buffer);
+  }
+} /* void cg2_read_one */
+
+/* Returns a copy of the mount point of the first file system of type "type"
+ * with the given option, or with any options if "option" is NULL. */
+static char *cgroups_find_mount(char const *type, char const *option) {
+  cu_mount_t *mnt_list = NULL;
+  char *dir = NULL;
+
+  if (cu_mount_getlist(&mnt_list) == NULL) {
+    ERROR("cgroups plugin: cu_mount_getlist failed.");
+    return NULL;
+  }
+
+  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+       mnt_ptr = mnt_ptr->next) {
+    if (strcmp(mnt_ptr->type, type) != 0)
+      continue;
+    if ((option != NULL) &&
+        !cu_mount_checkoption(mnt_ptr->options, option, /* full = */ 1))
+      continue;
+
+    dir = strdup(mnt_ptr->dir);
+    break;
+  }
+
+  cu_mount_freelist(mnt_list);
+  return dir;
+} /* char *cgroups_find_mount */
+
+/* Opens the cgroup2 mount point. Called with the write lock held. */
+static int cg2_open(void) {
+  if (cg2_mount_fd >= 0)
+    return 0;
+
+  sfree(cg2_mount);
+  cg2_mount = cgroups_find_mount("cgroup2", /* option = */ NULL);
+  if (cg2_mount == NULL)
+    return ENOENT;
+
+  cg2_mount_fd = open(cg2_mount, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (cg2_mount_fd < 0) {
+    ERROR("cgroups plugin: Cannot open \"%s\": %s", cg2_mount, STRERRNO);
+    return -1;
+  }
+
+  INFO("cgroups plugin: Reading cgroup v2 hierarchy at \"%s\".", cg2_mount);
+  cg2_rescan = true;
+  return 0;
+} /* int cg2_open */
+
 static int cgroups_init(void) {
   if (il_cgroup == NULL)
     il_cgroup = ignorelist_create(1);
 
+  clock_ticks = sysconf(_SC_CLK_TCK);
+  if (clock_ticks <= 0)
+    clock_ticks = 100;
+
+  /* Use at most half of the file descriptors for cgroup directories. */
+  struct rlimit rl;
+  if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) && (rl.rlim_cur != RLIM_INFINITY))
+    cg2_fds_max = (size_t)rl.rlim_cur / 2;
+  else
+    cg2_fds_max = SIZE_MAX;
+
   return 0;
 }
 
@@ -174,51 +792,140 @@ static int cgroups_config(const char *key, const char *value) {
     else
       ignorelist_set_invert(il_cgroup, 1);
     return 0;
+  } else if (strcasecmp(key, "CGroupVersion") == 0) {
+    if (strcasecmp(value, "auto") == 0)
+      cgroup_version = 0;
+    else if ((atoi(value) == 1) || (atoi(value) == 2))
+      cgroup_version = atoi(value);
+    else {
+      ERROR("cgroups plugin: CGroupVersion must be \"auto\", 1 or 2.");
+      return 1;
+    }
+    return 0;
+  } else if (strcasecmp(key, "ReadThreads") == 0) {
+    int num = atoi(value);
+    if ((num < 1) || (num > CG2_MAX_READ_THREADS)) {
+      ERROR("cgroups plugin: ReadThreads must be between 1 and %d.",
+            CG2_MAX_READ_THREADS);
+      return 1;
+    }
+    read_threads = num;
+    return 0;
+  } else if (strcasecmp(key, "ReportCPU") == 0) {
+    report_cpu = IS_TRUE(value);
+    return 0;
+  } else if (strcasecmp(key, "ReportMemory") == 0) {
+    report_memory = IS_TRUE(value);
+    return 0;
+  } else if (strcasecmp(key, "ReportIO") == 0) {
+    report_io = IS_TRUE(value);
+    return 0;
+  } else if (strcasecmp(key, "ReportPressure") == 0) {
+    report_pressure = IS_TRUE(value);
+    return 0;
   }
 
   return -1;
 }
 
-static int cgroups_read(void) {
-  cu_mount_t *mnt_list = NULL;
-  bool cgroup_found = false;
-
-  if (cu_mount_getlist(&mnt_list) == NULL) {
-    ERROR("cgroups plugin: cu_mount_getlist failed.");
+static int cgroups_read_v1(char *dir) {
+  if (dir == NULL) {
+    WARNING("cgroups plugin: Unable to find cgroup "
+            "mount-point with the \"cpuacct\" option.");
     return -1;
   }
 
-  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
-       mnt_ptr = mnt_ptr->next) {
-    /* Find the cgroup mountpoint which contains the cpuacct
-     * controller. */
-    if ((strcmp(mnt_ptr->type, "cgroup") != 0) ||
-        !cu_mount_checkoption(mnt_ptr->options, "cpuacct", /* full = */ 1))
-      continue;
-
-    walk_directory(mnt_ptr->dir, read_cpuacct_root,
-                   /* user_data = */ NULL,
-                   /* include_hidden = */ 0);
-    cgroup_found = true;
-    /* It doesn't make sense to check other cpuacct mount-points
-     * (if any), they contain the same data. */
-    break;
+  /* It doesn't make sense to check other cpuacct mount-points
+   * (if any), they contain the same data. */
+  walk_directory(dir, read_cpuacct_root,
+                 /* user_data = */ NULL,
+                 /* include_hidden = */ 0);
+  sfree(dir);
+  return 0;
+} /* int cgroups_read_v1 */
+
+/* Reads every "read_threads"th cgroup, starting with "shard". The first
+ * shard also updates the list of cgroups. */
+static int cgroups_read_shard(size_t shard) {
+  if (shard == 0) {
+    pthread_rwlock_wrlock(&cg2_lock);
+
+    /* In "auto" mode, keep reading cpuacct where it exists, for
+     * compatibility. */
+    char *v1 = NULL;
+    if ((cgroup_version == 1) || ((cgroup_version == 0) && (cg2_mount_fd < 0)))
+      v1 = cgroups_find_mount("cgroup", "cpuacct");
+    if ((cgroup_version == 1) || (v1 != NULL)) {
+      pthread_rwlock_unlock(&cg2_lock);
+      return cgroups_read_v1(v1);
+    }
+
+    int status = cg2_open();
+    if (status == 0)
+      status = cg2_update();
+    pthread_rwlock_unlock(&cg2_lock);
+
+    if (status != 0) {
+      if (status == ENOENT)
+        WARNING("cgroups plugin: Unable to find a cgroup2 mount-point.");
+      return -1;
+    }
   }
 
-  cu_mount_freelist(mnt_list);
+  pthread_rwlock_rdlock(&cg2_lock);
+  for (size_t i = shard; i < cg2_list_num; i += (size_t)read_threads)
+    cg2_read_one(cg2_list[i]);
+  pthread_rwlock_unlock(&cg2_lock);
 
-  if (!cgroup_found) {
-    WARNING("cgroups plugin: Unable to find cgroup "
-            "mount-point with the \"cpuacct\" option.");
-    return -1;
-  }
+  return 0;
+} /* int cgroups_read_shard */
+
+static int cgroups_read(void) { return cgroups_read_shard(0); }
+
+static int cgroups_read_cb(user_data_t *ud) {
+  return cgroups_read_shard((size_t)(uintptr_t)ud->data);
+}
 
+static int cgroups_start(void) {
+  cgroups_init();
+
+  if (read_threads == 1)
+    return plugin_register_read("cgroups", cgroups_read);
+
+  for (int i = 0; i < read_threads; i++) {
+    char name[DATA_MAX_NAME_LEN];
+    snprintf(name, sizeof(name), "cgroups/%d", i);
+    plugin_register_complex_read(/* group = */ "cgroups", name,
+                                 cgroups_read_cb, /* interval = */ 0,
+                                 &(user_data_t){
+                                     .data = (void *)(uintptr_t)i,
+                                 });
+  }
+  return 0;
+} /* int cgroups_start */
+
+static int cgroups_shutdown(void) {
+  pthread_rwlock_wrlock(&cg2_lock);
+  cg2_clear();
+  if (cg2_by_path != NULL)
+    c_avl_destroy(cg2_by_path);
+  if (cg2_by_wd != NULL)
+    c_avl_destroy(cg2_by_wd);
+  cg2_by_path = cg2_by_wd = NULL;
+  if (cg2_mount_fd >= 0)
+    close(cg2_mount_fd);
+  cg2_mount_fd = -1;
+  sfree(cg2_mount);
+  pthread_rwlock_unlock(&cg2_lock);
+
+  ignorelist_free(il_cgroup);
+  il_cgroup = NULL;
   return 0;
-} /* int cgroup_read */
+} /* int cgroups_shutdown */
 
 void module_register(void) {
   plugin_register_config("cgroups", cgroups_config, config_keys,
                          config_keys_num);
-  plugin_register_init("cgroups", cgroups_init);
-  plugin_register_read("cgroups", cgroups_read);
+  plugin_register_init("cgroups", cgroups_start);
+  plugin_register_shutdown("cgroups", cgroups_shutdown);
 } /* void module_register */
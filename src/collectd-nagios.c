@@ -269,62 +269,74 @@ __attribute__((noreturn)) static void usage(const char *name) {
   exit(1);
 } /* void usage */
 
-static int do_listval(lcc_connection_t *connection) {
-  lcc_identifier_t *ret_ident = NULL;
-  size_t ret_ident_num = 0;
-
-  char *hostname = NULL;
-
+typedef struct {
+  lcc_connection_t *connection;
+  char *hostname;
+} listval_state_t;
+
+static int listval_print(const lcc_identifier_t *ident,
+                         double __attribute__((unused)) time, void *ud) {
+  listval_state_t *state = ud;
+  lcc_identifier_t copy = *ident;
+  char id[1024];
   int status;
 
-  status = lcc_listval(connection, &ret_ident, &ret_ident_num);
-  if (status != 0) {
-    printf("UNKNOWN: %s\n", lcc_strerror(connection));
-    if (ret_ident != NULL)
-      free(ret_ident);
-    return RET_UNKNOWN;
+  /* The daemon returns the identifiers sorted by name, so all identifiers of
+   * a host are listed one after another. */
+  if ((state->hostname == NULL) || strcasecmp(state->hostname, copy.host)) {
+    free(state->hostname);
+    state->hostname = strdup(copy.host);
+    printf("Host: %s\n", copy.host);
   }
 
-  status = lcc_sort_identifiers(connection, ret_ident, ret_ident_num);
+  /* empty hostname; not to be printed again */
+  copy.host[0] = '\0';
+
+  status = lcc_identifier_to_string(state->connection, id, sizeof(id), &copy);
   if (status != 0) {
-    printf("UNKNOWN: %s\n", lcc_strerror(connection));
-    if (ret_ident != NULL)
-      free(ret_ident);
-    return RET_UNKNOWN;
+    printf("ERROR: listval: Failed to convert returned "
+           "identifier to a string: %s\n",
+           lcc_strerror(state->connection));
+    free(state->hostname);
+    state->hostname = NULL;
+    return 0;
   }
 
-  for (size_t i = 0; i < ret_ident_num; ++i) {
-    char id[1024];
+  /* skip over the (empty) hostname and following '/' */
+  printf("\t%s\n", id + 1);
+  return 0;
+} /* int listval_print */
 
-    if ((hostname_g != NULL) && (strcasecmp(hostname_g, ret_ident[i].host)))
-      continue;
+static int do_listval(lcc_connection_t *connection) {
+  listval_state_t state = {.connection = connection};
+  char glob[2 * LCC_NAME_LEN + 3];
+  char *glob_ptr = NULL;
 
-    if ((hostname == NULL) || strcasecmp(hostname, ret_ident[i].host)) {
-      free(hostname);
-      hostname = strdup(ret_ident[i].host);
-      printf("Host: %s\n", hostname);
-    }
+  int status;
 
-    /* empty hostname; not to be printed again */
-    ret_ident[i].host[0] = '\0';
-
-    status =
-        lcc_identifier_to_string(connection, id, sizeof(id), ret_ident + i);
-    if (status != 0) {
-      printf("ERROR: listval: Failed to convert returned "
-             "identifier to a string: %s\n",
-             lcc_strerror(connection));
-      free(hostname);
-      hostname = NULL;
-      continue;
+  /* Let the daemon select the host's values. Wildcard characters in the host
+   * name are escaped. */
+  if (hostname_g != NULL) {
+    size_t pos = 0;
+    for (char const *ptr = hostname_g;
+         (*ptr != 0) && (pos < sizeof(glob) - 4); ptr++) {
+      if ((*ptr == '*') || (*ptr == '?') || (*ptr == '[') || (*ptr == '\\'))
+        glob[pos++] = '\\';
+      glob[pos++] = *ptr;
     }
+    glob[pos++] = '/';
+    glob[pos++] = '*';
+    glob[pos] = 0;
+    glob_ptr = glob;
+  }
 
-    /* skip over the (empty) hostname and following '/' */
-    printf("\t%s\n", id + 1);
+  status = lcc_listval_filtered(connection, glob_ptr, listval_print, &state);
+  free(state.hostname);
+  if (status != 0) {
+    printf("UNKNOWN: %s\n", lcc_strerror(connection));
+    return RET_UNKNOWN;
   }
 
-  free(ret_ident);
-  free(hostname);
   return RET_OKAY;
 } /* int do_listval */
 
@@ -33,9 +33,12 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,31 +46,89 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "utils/hashtable/hashtable.h"
 #include "utils/heap/heap.h"
 
 #include "collectd/client.h"
 #include "collectd/network.h"
+#include "collectd/server.h"
 
 #define DEF_NUM_HOSTS 1000
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
+#define DEF_NUM_THREADS 1
 #define DEF_INTERVAL 10.0
 
+/* Senders publish their counters after this many values, or before sleeping.
+ */
+#define PUBLISH_EVERY 1024
+
+/* Senders only sleep if the next value is due in more than MIN_SLEEP seconds
+ * and no longer than MAX_SLEEP seconds at a time, so that packets fill up at
+ * high rates and shutting down isn't delayed at low rates. */
+#define MIN_SLEEP 0.001
+#define MAX_SLEEP 0.1
+
+/* The latency histogram has logarithmic buckets of microseconds, with eight
+ * buckets per power of two. This gives about 9% resolution and covers up to
+ * 2^32 microseconds. */
+#define LATENCY_BUCKETS_PER_OCTAVE 8
+#define LATENCY_BUCKETS_NUM (32 * LATENCY_BUCKETS_PER_OCTAVE)
+
+typedef struct {
+  uint64_t buckets[LATENCY_BUCKETS_NUM];
+  uint64_t num;
+  double max;
+} histogram_t;
+
+/* Each sender thread sends its own share of the value lists through its own
+ * socket. */
+typedef struct {
+  pthread_t thread;
+  unsigned int seed;
+  int values_num;
+  c_heap_t *heap;
+  lcc_network_t *net;
+} sender_t;
+
+/* seen_t records when the receiver last got a value list, to detect gaps. */
+typedef struct {
+  char *key;
+  double time;
+} seen_t;
+
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
 static int conf_num_values = DEF_NUM_VALUES;
+static int conf_num_threads = DEF_NUM_THREADS;
 static double conf_interval = DEF_INTERVAL;
-static const char *conf_destination = NET_DEFAULT_V6_ADDR;
+static double conf_rate;
+static double conf_churn;
+static double conf_duration;
+static bool conf_listen;
+static lcc_security_level_t conf_security_level = NONE;
+static char *conf_username;
+static char *conf_password;
+static const char *conf_destination;
 static const char *conf_service = NET_DEFAULT_PORT;
 
-static lcc_network_t *net;
-
-static c_heap_t *values_heap;
-
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
 
-static bool loop = true;
+static volatile bool loop = true;
+
+/* stats_lock protects all stats_* variables. */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t stats_sent;
+static uint64_t stats_send_errors;
+static uint64_t stats_received;
+static uint64_t stats_lost;
+static uint64_t stats_reordered;
+static uint64_t stats_skewed;
+/* stats_latency is reset with every report, stats_latency_total is not. */
+static histogram_t stats_latency;
+static histogram_t stats_latency_total;
+static c_hashtable_t *stats_seen;
 
 __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
 {
@@ -75,23 +136,35 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       (exit_status == EXIT_FAILURE) ? stderr : stdout,
       "collectd-tg -- collectd traffic generator\n"
       "\n"
-      "  Usage: collectd-ng [OPTION]\n"
+      "  Usage: collectd-tg [OPTION]\n"
       "\n"
       "  Valid options:\n"
       "    -n <number>    Number of value lists. (Default: %i)\n"
       "    -H <number>    Number of hosts to emulate. (Default: %i)\n"
       "    -p <number>    Number of plugins to emulate. (Default: %i)\n"
       "    -i <seconds>   Interval of each value in seconds. (Default: %.3f)\n"
-      "    -d <dest>      Destination address of the network packets.\n"
-      "                   (Default: %s)\n"
-      "    -D <port>      Destination port of the network packets.\n"
-      "                   (Default: %s)\n"
+      "    -r <number>    Number of values to send per second. Overrides the\n"
+      "                   interval.\n"
+      "    -c <percent>   Percentage of value lists that get a new identifier\n"
+      "                   each time they are sent. (Default: 0)\n"
+      "    -t <number>    Number of threads sending or receiving.\n"
+      "                   (Default: %i)\n"
+      "    -T <seconds>   Stop after this many seconds. (Default: run until\n"
+      "                   interrupted)\n"
+      "    -s <user:pw>   Sign the packets, or require signed packets.\n"
+      "    -e <user:pw>   Encrypt the packets, or require encrypted packets.\n"
+      "    -l             Receive traffic and report loss and latency instead\n"
+      "                   of sending.\n"
+      "    -d <dest>      Destination address of the network packets, or the\n"
+      "                   address to listen on. (Default: %s)\n"
+      "    -D <port>      Destination port of the network packets, or the\n"
+      "                   port to listen on. (Default: %s)\n"
       "    -h             Print usage information (this output).\n"
       "\n"
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      DEF_NUM_THREADS, NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -123,6 +196,16 @@ static double dtime(void) /* {{{ */
 } /* }}} double dtime */
 #endif
 
+static void sleep_for(double seconds) /* {{{ */
+{
+  struct timespec ts = {
+      .tv_sec = (time_t)seconds,
+  };
+  ts.tv_nsec = (long)((seconds - ((double)ts.tv_sec)) * 1e9);
+
+  nanosleep(&ts, /* remaining = */ NULL);
+} /* }}} void sleep_for */
+
 static int compare_time(const void *v0, const void *v1) /* {{{ */
 {
   const lcc_value_list_t *vl0 = v0;
@@ -136,7 +219,7 @@ static int compare_time(const void *v0, const void *v1) /* {{{ */
     return 0;
 } /* }}} int compare_time */
 
-static int get_boundet_random(int min, int max) /* {{{ */
+static int get_boundet_random(unsigned int *seed, int min, int max) /* {{{ */
 {
   int range;
 
@@ -147,12 +230,55 @@ static int get_boundet_random(int min, int max) /* {{{ */
 
   range = max - min;
 
-  return min + ((int)(((double)range) * ((double)random()) /
+  return min + ((int)(((double)range) * ((double)rand_r(seed)) /
                       (((double)RAND_MAX) + 1.0)));
 } /* }}} int get_boundet_random */
 
-static lcc_value_list_t *create_value_list(void) /* {{{ */
+static void histogram_add(histogram_t *h, double latency) /* {{{ */
+{
+  double us = latency * 1e6;
+  size_t i = 0;
+
+  if (us > 1.0)
+    i = (size_t)(log2(us) * LATENCY_BUCKETS_PER_OCTAVE);
+  if (i >= LATENCY_BUCKETS_NUM)
+    i = LATENCY_BUCKETS_NUM - 1;
+
+  h->buckets[i]++;
+  h->num++;
+  if (h->max < latency)
+    h->max = latency;
+} /* }}} void histogram_add */
+
+/* Returns the upper bound of the bucket holding the given percentile, in
+ * seconds. */
+static double histogram_percentile(histogram_t const *h, /* {{{ */
+                                   double percent) {
+  if (h->num == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t)ceil(((double)h->num) * percent / 100.0);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS_NUM; i++) {
+    sum += h->buckets[i];
+    if (sum < rank)
+      continue;
+
+    double bound = exp2(((double)(i + 1)) / LATENCY_BUCKETS_PER_OCTAVE) / 1e6;
+    return (bound < h->max) ? bound : h->max;
+  }
+
+  return h->max;
+} /* }}} double histogram_percentile */
+
+static void new_type_instance(sender_t *s, lcc_value_list_t *vl) /* {{{ */
 {
+  snprintf(vl->identifier.type_instance, sizeof(vl->identifier.type_instance),
+           "ti%i", rand_r(&s->seed));
+} /* }}} void new_type_instance */
+
+static lcc_value_list_t *create_value_list(sender_t *s, int index, /* {{{ */
+                                           double start) {
   lcc_value_list_t *vl;
   int host_num;
 
@@ -179,12 +305,17 @@ static lcc_value_list_t *create_value_list(void) /* {{{ */
 
   vl->values_len = 1;
 
-  host_num = get_boundet_random(0, conf_num_hosts);
+  host_num = get_boundet_random(&s->seed, 0, conf_num_hosts);
 
   vl->interval = conf_interval;
-  vl->time = 1.0 + dtime() + (host_num % (1 + (int)vl->interval));
+  /* With a target rate, spread the value lists evenly over the interval.
+   * Otherwise mimic hosts which send all their values at the same time. */
+  if (conf_rate > 0)
+    vl->time = start + vl->interval * ((double)index) / ((double)s->values_num);
+  else
+    vl->time = 1.0 + start + (host_num % (1 + (int)vl->interval));
 
-  if (get_boundet_random(0, 2) == 0)
+  if (get_boundet_random(&s->seed, 0, 2) == 0)
     vl->values_types[0] = LCC_TYPE_GAUGE;
   else
     vl->values_types[0] = LCC_TYPE_DERIVE;
@@ -192,13 +323,12 @@ static lcc_value_list_t *create_value_list(void) /* {{{ */
   snprintf(vl->identifier.host, sizeof(vl->identifier.host), "host%04i",
            host_num);
   snprintf(vl->identifier.plugin, sizeof(vl->identifier.plugin), "plugin%03i",
-           get_boundet_random(0, conf_num_plugins));
+           get_boundet_random(&s->seed, 0, conf_num_plugins));
   strncpy(vl->identifier.type,
           (vl->values_types[0] == LCC_TYPE_GAUGE) ? "gauge" : "derive",
           sizeof(vl->identifier.type));
   vl->identifier.type[sizeof(vl->identifier.type) - 1] = '\0';
-  snprintf(vl->identifier.type_instance, sizeof(vl->identifier.type_instance),
-           "ti%li", random());
+  new_type_instance(s, vl);
 
   return vl;
 } /* }}} int create_value_list */
@@ -213,25 +343,394 @@ static void destroy_value_list(lcc_value_list_t *vl) /* {{{ */
   free(vl);
 } /* }}} void destroy_value_list */
 
-static int send_value(lcc_value_list_t *vl) /* {{{ */
+static int send_value(sender_t *s, lcc_value_list_t *vl, double now) /* {{{ */
 {
   int status;
 
   if (vl->values_types[0] == LCC_TYPE_GAUGE)
     vl->values[0].gauge =
-        100.0 * ((gauge_t)random()) / (((gauge_t)RAND_MAX) + 1.0);
+        100.0 * ((gauge_t)rand_r(&s->seed)) / (((gauge_t)RAND_MAX) + 1.0);
   else
-    vl->values[0].derive += (derive_t)get_boundet_random(0, 100);
+    vl->values[0].derive += (derive_t)get_boundet_random(&s->seed, 0, 100);
 
-  status = lcc_network_values_send(net, vl);
+  /* Send the actual time, so that receivers measure the latency of the
+   * transport and not how far behind schedule the sender is. */
+  double due = vl->time;
+  vl->time = now;
+  status = lcc_network_values_send(s->net, vl);
   if (status != 0)
     fprintf(stderr, "lcc_network_values_send failed with status %i.\n", status);
 
-  vl->time += vl->interval;
+  vl->time = due + vl->interval;
 
-  return 0;
+  if ((conf_churn > 0) &&
+      (100.0 * ((double)rand_r(&s->seed)) / (((double)RAND_MAX) + 1.0) <
+       conf_churn)) {
+    new_type_instance(s, vl);
+    vl->values[0].derive = 0;
+  }
+
+  return status;
 } /* }}} int send_value */
 
+static void publish_sent(uint64_t *sent, uint64_t *errors) /* {{{ */
+{
+  pthread_mutex_lock(&stats_lock);
+  stats_sent += *sent;
+  stats_send_errors += *errors;
+  pthread_mutex_unlock(&stats_lock);
+
+  *sent = 0;
+  *errors = 0;
+} /* }}} void publish_sent */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+  uint64_t sent = 0;
+  uint64_t errors = 0;
+
+  while (loop) {
+    lcc_value_list_t *vl = c_heap_get_root(s->heap);
+    if (vl == NULL)
+      break;
+
+    double now = dtime();
+    if (vl->time - now > MIN_SLEEP) {
+      c_heap_insert(s->heap, vl);
+
+      /* Nothing is due: don't hold back the values sent so far. */
+      if (lcc_network_flush(s->net) != 0)
+        errors++;
+      publish_sent(&sent, &errors);
+
+      double diff = vl->time - now;
+      sleep_for((diff < MAX_SLEEP) ? diff : MAX_SLEEP);
+      continue;
+    }
+
+    if (send_value(s, vl, now) != 0)
+      errors++;
+    sent++;
+
+    c_heap_insert(s->heap, vl);
+
+    if (sent >= PUBLISH_EVERY)
+      publish_sent(&sent, &errors);
+  }
+
+  if (lcc_network_flush(s->net) != 0)
+    errors++;
+  publish_sent(&sent, &errors);
+
+  return NULL;
+} /* }}} void *sender_thread */
+
+static lcc_network_t *create_network(void) /* {{{ */
+{
+  lcc_network_t *net;
+  lcc_server_t *srv;
+  int status;
+
+  net = lcc_network_create();
+  if (net == NULL) {
+    fprintf(stderr, "lcc_network_create failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  srv = lcc_server_create(net, conf_destination, conf_service);
+  if (srv == NULL) {
+    fprintf(stderr, "lcc_server_create failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  lcc_server_set_ttl(srv, 42);
+
+  if (conf_security_level != NONE) {
+    status = lcc_server_set_security_level(srv, conf_security_level,
+                                           conf_username, conf_password);
+    if (status != 0) {
+      fprintf(stderr, "lcc_server_set_security_level failed with status %i.\n",
+              status);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  return net;
+} /* }}} lcc_network_t *create_network */
+
+static uint64_t hash_key(char const *key) /* {{{ */
+{
+  /* FNV-1a */
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *key != 0; key++) {
+    hash ^= (uint64_t)(unsigned char)*key;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* }}} uint64_t hash_key */
+
+/* Counts the intervals missing since the identifier was last received. Must
+ * be called with stats_lock held. */
+static void check_loss(lcc_value_list_t const *vl) /* {{{ */
+{
+  char key[5 * LCC_NAME_LEN];
+  lcc_identifier_t const *id = &vl->identifier;
+
+  snprintf(key, sizeof(key), "%s/%s-%s/%s-%s", id->host, id->plugin,
+           id->plugin_instance, id->type, id->type_instance);
+  uint64_t hash = hash_key(key);
+
+  seen_t *seen = NULL;
+  if (c_hashtable_get(stats_seen, hash, key, (void *)&seen) != 0) {
+    seen = calloc(1, sizeof(*seen));
+    if (seen == NULL)
+      return;
+    seen->key = strdup(key);
+    seen->time = vl->time;
+    if ((seen->key == NULL) ||
+        (c_hashtable_insert(stats_seen, hash, seen->key, seen) != 0)) {
+      free(seen->key);
+      free(seen);
+    }
+    return;
+  }
+
+  if (vl->time < seen->time) {
+    /* This value has been counted as lost when its successor arrived. */
+    stats_reordered++;
+    if (stats_lost > 0)
+      stats_lost--;
+    return;
+  }
+
+  if (vl->interval > 0) {
+    double missing = round((vl->time - seen->time) / vl->interval) - 1.0;
+    if (missing > 0)
+      stats_lost += (uint64_t)missing;
+  }
+  seen->time = vl->time;
+} /* }}} void check_loss */
+
+static int receive_batch(lcc_value_list_t const *vls, size_t vls_num) /* {{{ */
+{
+  double now = dtime();
+
+  pthread_mutex_lock(&stats_lock);
+  for (size_t i = 0; i < vls_num; i++) {
+    double latency = now - vls[i].time;
+    if (latency < 0) {
+      stats_skewed++;
+      latency = 0;
+    }
+    histogram_add(&stats_latency, latency);
+    histogram_add(&stats_latency_total, latency);
+
+    check_loss(vls + i);
+  }
+  stats_received += vls_num;
+  pthread_mutex_unlock(&stats_lock);
+
+  return 0;
+} /* }}} int receive_batch */
+
+static char const *password_lookup(char const *username) /* {{{ */
+{
+  if ((conf_username == NULL) || (strcmp(username, conf_username) != 0))
+    return NULL;
+  return conf_password;
+} /* }}} char const *password_lookup */
+
+static void *listener_thread(void *arg) /* {{{ */
+{
+  lcc_listener_t *srv = arg;
+
+  int status = lcc_listen_and_write(*srv);
+  fprintf(stderr, "lcc_listen_and_write failed with status %i.\n", status);
+  loop = false;
+
+  return NULL;
+} /* }}} void *listener_thread */
+
+/* Prints a report every second until interrupted or until the configured
+ * duration has passed. Returns the elapsed time. */
+static double report_loop(void) /* {{{ */
+{
+  double begin = dtime();
+  double last = begin;
+  double now = begin;
+  uint64_t last_count = 0;
+
+  while (loop) {
+    sleep_for(1.0);
+    now = dtime();
+    if ((conf_duration > 0) && (now - begin >= conf_duration))
+      loop = false;
+
+    pthread_mutex_lock(&stats_lock);
+    uint64_t count = conf_listen ? stats_received : stats_sent;
+    double rate = ((double)(count - last_count)) / (now - last);
+    if (conf_listen) {
+      printf("%.0f values/s received, %" PRIu64 " lost, latency p50 %.3f ms, "
+             "p99 %.3f ms, max %.3f ms\n",
+             rate, stats_lost, 1e3 * histogram_percentile(&stats_latency, 50),
+             1e3 * histogram_percentile(&stats_latency, 99),
+             1e3 * stats_latency.max);
+      stats_latency = (histogram_t){0};
+    } else {
+      printf("%.0f values/s sent, %" PRIu64 " total\n", rate, count);
+    }
+    pthread_mutex_unlock(&stats_lock);
+    fflush(stdout);
+
+    last = now;
+    last_count = count;
+  }
+
+  return now - begin;
+} /* }}} double report_loop */
+
+static int run_sender(void) /* {{{ */
+{
+  sender_t *senders;
+
+  if (conf_rate > 0)
+    conf_interval = ((double)conf_num_values) / conf_rate;
+
+  senders = calloc((size_t)conf_num_threads, sizeof(*senders));
+  if (senders == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stdout, "Creating %i values ... ", conf_num_values);
+  fflush(stdout);
+  double start = dtime();
+  for (int i = 0; i < conf_num_threads; i++) {
+    sender_t *s = senders + i;
+
+    s->seed = (unsigned int)time(NULL) ^ (unsigned int)(getpid() << 8) ^
+              (unsigned int)i;
+    s->values_num = conf_num_values / conf_num_threads;
+    if (i < (conf_num_values % conf_num_threads))
+      s->values_num++;
+
+    s->heap = c_heap_create(compare_time);
+    if (s->heap == NULL) {
+      fprintf(stderr, "c_heap_create failed.\n");
+      exit(EXIT_FAILURE);
+    }
+
+    s->net = create_network();
+
+    for (int j = 0; j < s->values_num; j++) {
+      lcc_value_list_t *vl = create_value_list(s, j, start);
+      if (vl == NULL) {
+        fprintf(stderr, "create_value_list failed.\n");
+        exit(EXIT_FAILURE);
+      }
+
+      c_heap_insert(s->heap, vl);
+    }
+  }
+  fprintf(stdout, "done\n");
+
+  for (int i = 0; i < conf_num_threads; i++) {
+    int status = pthread_create(&senders[i].thread, /* attr = */ NULL,
+                                sender_thread, senders + i);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  double elapsed = report_loop();
+
+  fprintf(stdout, "Shutting down.\n");
+  fflush(stdout);
+
+  for (int i = 0; i < conf_num_threads; i++) {
+    sender_t *s = senders + i;
+
+    pthread_join(s->thread, /* retval = */ NULL);
+
+    while (42) {
+      lcc_value_list_t *vl = c_heap_get_root(s->heap);
+      if (vl == NULL)
+        break;
+      destroy_value_list(vl);
+    }
+    c_heap_destroy(s->heap);
+
+    lcc_network_destroy(s->net);
+  }
+  free(senders);
+
+  printf("Sent %" PRIu64 " values in %.3f s (%.0f values/s), %" PRIu64
+         " errors.\n",
+         stats_sent, elapsed, ((double)stats_sent) / elapsed,
+         stats_send_errors);
+  return 0;
+} /* }}} int run_sender */
+
+static int run_receiver(void) /* {{{ */
+{
+  pthread_t thread;
+
+  stats_seen = c_hashtable_create();
+  if (stats_seen == NULL) {
+    fprintf(stderr, "c_hashtable_create failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  lcc_listener_t srv = {
+      .conn = -1,
+      .node = (char *)conf_destination,
+      .service = (char *)conf_service,
+      .parse_options =
+          {
+              .password_lookup = password_lookup,
+              .security_level = conf_security_level,
+          },
+      .threads = conf_num_threads,
+      .batch_writer = receive_batch,
+  };
+
+  /* lcc_listen_and_write() doesn't return unless it fails. */
+  int status =
+      pthread_create(&thread, /* attr = */ NULL, listener_thread, &srv);
+  if (status != 0) {
+    fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+    exit(EXIT_FAILURE);
+  }
+
+  double elapsed = report_loop();
+
+  pthread_mutex_lock(&stats_lock);
+  uint64_t total = stats_received + stats_lost;
+  printf("Received %" PRIu64 " values in %.3f s (%.0f values/s).\n",
+         stats_received, elapsed, ((double)stats_received) / elapsed);
+  printf("Lost %" PRIu64 " values (%.3f%%), %" PRIu64 " reordered.\n",
+         stats_lost,
+         (total > 0) ? 100.0 * ((double)stats_lost) / ((double)total) : 0.0,
+         stats_reordered);
+  printf("Latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, "
+         "max %.3f ms\n",
+         1e3 * histogram_percentile(&stats_latency_total, 50),
+         1e3 * histogram_percentile(&stats_latency_total, 90),
+         1e3 * histogram_percentile(&stats_latency_total, 99),
+         1e3 * histogram_percentile(&stats_latency_total, 99.9),
+         1e3 * stats_latency_total.max);
+  if (stats_skewed > 0)
+    printf("%" PRIu64 " values were received before they were sent. Are the "
+           "clocks synchronized?\n",
+           stats_skewed);
+  pthread_mutex_unlock(&stats_lock);
+
+  /* The listener threads are still running, exit() ends them. */
+  return 0;
+} /* }}} int run_receiver */
+
 static int get_integer_opt(const char *str, int *ret_value) /* {{{ */
 {
   char *endptr;
@@ -280,11 +779,32 @@ static int get_double_opt(const char *str, double *ret_value) /* {{{ */
   return 0;
 } /* }}} int get_double_opt */
 
+static int get_credentials_opt(const char *str, /* {{{ */
+                               lcc_security_level_t level) {
+  char const *sep = strchr(str, ':');
+  if ((sep == NULL) || (sep == str) || (sep[1] == 0)) {
+    fprintf(stderr, "Expected \"<user>:<password>\", got \"%s\"\n", str);
+    exit(EXIT_FAILURE);
+  }
+
+  free(conf_username);
+  free(conf_password);
+  conf_username = strndup(str, (size_t)(sep - str));
+  conf_password = strdup(sep + 1);
+  if ((conf_username == NULL) || (conf_password == NULL)) {
+    fprintf(stderr, "strdup failed.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  conf_security_level = level;
+  return 0;
+} /* }}} int get_credentials_opt */
+
 static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:r:c:t:T:s:e:ld:D:h")) != -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -302,6 +822,34 @@ static int read_options(int argc, char **argv) /* {{{ */
       get_double_opt(optarg, &conf_interval);
       break;
 
+    case 'r':
+      get_double_opt(optarg, &conf_rate);
+      break;
+
+    case 'c':
+      get_double_opt(optarg, &conf_churn);
+      break;
+
+    case 't':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
+
+    case 'T':
+      get_double_opt(optarg, &conf_duration);
+      break;
+
+    case 's':
+      get_credentials_opt(optarg, SIGN);
+      break;
+
+    case 'e':
+      get_credentials_opt(optarg, ENCRYPT);
+      break;
+
+    case 'l':
+      conf_listen = true;
+      break;
+
     case 'd':
       conf_destination = optarg;
       break;
@@ -318,13 +866,27 @@ static int read_options(int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   }   /* while (getopt) */
 
+  if ((conf_num_values < 1) || (conf_num_hosts < 1) ||
+      (conf_num_plugins < 1) || (conf_num_threads < 1) ||
+      (conf_interval <= 0) || (conf_rate < 0) || (conf_churn < 0) ||
+      (conf_churn > 100) || (conf_duration < 0)) {
+    fprintf(stderr, "Invalid option value.\n");
+    exit_usage(EXIT_FAILURE);
+  }
+
+  if (conf_num_threads > conf_num_values)
+    conf_num_threads = conf_num_values;
+
+  /* When listening, lcc_listen_and_write() picks the default address. */
+  if ((conf_destination == NULL) && !conf_listen)
+    conf_destination = NET_DEFAULT_V6_ADDR;
+
   return 0;
 } /* }}} int read_options */
 
 int main(int argc, char **argv) /* {{{ */
 {
-  double last_time;
-  int values_sent = 0;
+  int status;
 
   read_options(argc, argv);
 
@@ -334,93 +896,10 @@ int main(int argc, char **argv) /* {{{ */
   sigterm_action.sa_handler = signal_handler;
   sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
 
-  values_heap = c_heap_create(compare_time);
-  if (values_heap == NULL) {
-    fprintf(stderr, "c_heap_create failed.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  net = lcc_network_create();
-  if (net == NULL) {
-    fprintf(stderr, "lcc_network_create failed.\n");
-    exit(EXIT_FAILURE);
-  } else {
-    lcc_server_t *srv;
-
-    srv = lcc_server_create(net, conf_destination, conf_service);
-    if (srv == NULL) {
-      fprintf(stderr, "lcc_server_create failed.\n");
-      exit(EXIT_FAILURE);
-    }
-
-    lcc_server_set_ttl(srv, 42);
-#if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
-#endif
-  }
-
-  fprintf(stdout, "Creating %i values ... ", conf_num_values);
-  fflush(stdout);
-  for (int i = 0; i < conf_num_values; i++) {
-    lcc_value_list_t *vl;
-
-    vl = create_value_list();
-    if (vl == NULL) {
-      fprintf(stderr, "create_value_list failed.\n");
-      exit(EXIT_FAILURE);
-    }
-
-    c_heap_insert(values_heap, vl);
-  }
-  fprintf(stdout, "done\n");
-
-  last_time = 0;
-  while (loop) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-
-    if (vl == NULL)
-      break;
-
-    if (vl->time != last_time) {
-      printf("%i values have been sent.\n", values_sent);
-
-      /* Check if we need to sleep */
-      double now = dtime();
-
-      while (now < vl->time) {
-        double diff = vl->time - now;
-        struct timespec ts = {
-            .tv_sec = (time_t)diff,
-        };
-        ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
-
-        nanosleep(&ts, /* remaining = */ NULL);
-        now = dtime();
-
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
-    }
-
-    send_value(vl);
-    values_sent++;
-
-    c_heap_insert(values_heap, vl);
-  }
-
-  fprintf(stdout, "Shutting down.\n");
-  fflush(stdout);
-
-  while (42) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list(vl);
-  }
-  c_heap_destroy(values_heap);
+  if (conf_listen)
+    status = run_receiver();
+  else
+    status = run_sender();
 
-  lcc_network_destroy(net);
-  exit(EXIT_SUCCESS);
+  exit((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 } /* }}} int main */
@@ -108,7 +108,7 @@ __attribute__((noreturn)) static void exit_usage(const char *name, int status) {
 
       " * getval <identifier>\n"
       " * flush [timeout=<seconds>] [plugin=<name>] [identifier=<id>]\n"
-      " * listval\n"
+      " * listval [glob=<pattern>]\n"
       " * putval <identifier> [interval=<seconds>] <value-list(s)>\n"
 
       "\nIdentifiers:\n\n"
@@ -352,49 +352,44 @@ static int flush(lcc_connection_t *c, int argc, char **argv) {
 #undef BAIL_OUT
 } /* flush */
 
-static int listval(lcc_connection_t *c, int argc, char **argv) {
-  lcc_identifier_t *ret_ident = NULL;
-  size_t ret_ident_num = 0;
+static int listval_print(const lcc_identifier_t *ident,
+                         double __attribute__((unused)) time, void *ud) {
+  lcc_connection_t *c = ud;
+  char id[1024];
+
+  if (lcc_identifier_to_string(c, id, sizeof(id), ident) != 0) {
+    fprintf(stderr,
+            "ERROR: listval: Failed to convert returned "
+            "identifier to a string: %s\n",
+            lcc_strerror(c));
+    return 0;
+  }
+
+  printf("%s\n", id);
+  return 0;
+} /* listval_print */
 
+static int listval(lcc_connection_t *c, int argc, char **argv) {
+  char *glob = NULL;
   int status;
 
   assert(strcasecmp(argv[0], "listval") == 0);
 
-  if (argc != 1) {
-    fprintf(stderr, "ERROR: listval: Does not accept any arguments.\n");
-    return -1;
-  }
+  for (int i = 1; i < argc; ++i) {
+    if (strncasecmp(argv[i], "glob=", strlen("glob=")) != 0) {
+      fprintf(stderr, "ERROR: listval: Invalid option ``%s''.\n", argv[i]);
+      return -1;
+    }
 
-#define BAIL_OUT(s)                                                            \
-  do {                                                                         \
-    if (ret_ident != NULL)                                                     \
-      free(ret_ident);                                                         \
-    ret_ident_num = 0;                                                         \
-    return s;                                                                  \
-  } while (0)
+    glob = argv[i] + strlen("glob=");
+  }
 
-  status = lcc_listval(c, &ret_ident, &ret_ident_num);
+  status = lcc_listval_filtered(c, glob, listval_print, c);
   if (status != 0) {
     fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
-    BAIL_OUT(status);
-  }
-
-  for (size_t i = 0; i < ret_ident_num; ++i) {
-    char id[1024];
-
-    status = lcc_identifier_to_string(c, id, sizeof(id), ret_ident + i);
-    if (status != 0) {
-      fprintf(stderr,
-              "ERROR: listval: Failed to convert returned "
-              "identifier to a string: %s\n",
-              lcc_strerror(c));
-      continue;
-    }
-
-    printf("%s\n", id);
+    return status;
   }
-  BAIL_OUT(0);
-#undef BAIL_OUT
+  return 0;
 } /* listval */
 
 static int putval(lcc_connection_t *c, int argc, char **argv) {
@@ -528,7 +523,7 @@ static int putval(lcc_connection_t *c, int argc, char **argv) {
       assert(values_len >= 1);
       vl.values_len = values_len;
 
-      status = lcc_putval(c, &vl);
+      status = lcc_putval_async(c, &vl);
       if (status != 0) {
         fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
         return -1;
@@ -540,6 +535,12 @@ static int putval(lcc_connection_t *c, int argc, char **argv) {
     fprintf(stderr, "ERROR: putval: Missing value list(s).\n");
     return -1;
   }
+
+  status = lcc_wait(c, /* ret_failed = */ NULL);
+  if (status != 0) {
+    fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
+    return -1;
+  }
   return 0;
 } /* putval */
 
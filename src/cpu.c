@@ -31,6 +31,9 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/config_cores/config_cores.h"
+#include "utils/proc_file/proc_file.h"
+#include "utils_batch.h"
 
 #ifdef HAVE_MACH_KERN_RETURN_H
 #include <mach/kern_return.h>
@@ -130,7 +133,7 @@ static mach_msg_type_number_t cpu_list_len;
 /* #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX)
-/* no variables needed */
+static proc_file_t *proc_stat;
 /* #endif KERNEL_LINUX */
 
 #elif defined(HAVE_LIBKSTAT)
@@ -182,9 +185,15 @@ static int pnumcpu;
       (sum) += (val);                                                          \
   } while (0)
 
+/* The read functions only store the raw counters in "value". cpu_rates()
+ * turns the whole array into rates in one pass at the end of the iteration,
+ * using the same interval for all CPUs and states. */
 struct cpu_state_s {
-  value_to_rate_state_t conv;
+  derive_t value;
+  derive_t last_value;
   gauge_t rate;
+  bool staged;   /* value was set in this iteration */
+  bool has_last; /* last_value was set in the previous iteration */
   bool has_value;
 };
 typedef struct cpu_state_s cpu_state_t;
@@ -192,6 +201,18 @@ typedef struct cpu_state_s cpu_state_t;
 static cpu_state_t *cpu_states;
 static size_t cpu_states_num; /* #cpu_states allocated */
 
+/* Time of the current and of the previous iteration. */
+static cdtime_t cpu_time;
+static cdtime_t cpu_last_time;
+
+/* Value lists of one iteration, dispatched with a single call to
+ * plugin_dispatch_values_batch(). */
+static vl_batch_t cpu_batch = VL_BATCH_INIT;
+
+/* Groups of CPUs to report instead of the individual CPUs. Empty unless the
+ * "Cores" option is set. */
+static core_groups_list_t cpu_groups;
+
 /* Highest CPU number in the current iteration. Used by the dispatch logic to
  * determine how many CPUs there were. Reset to 0 by cpu_reset(). */
 static size_t global_cpu_num;
@@ -203,27 +224,36 @@ static bool report_num_cpu;
 static bool report_guest;
 static bool subtract_guest = true;
 
-static const char *config_keys[] = {"ReportByCpu",      "ReportByState",
-                                    "ReportNumCpu",     "ValuesPercentage",
-                                    "ReportGuestState", "SubtractGuestState"};
-static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
-
-static int cpu_config(char const *key, char const *value) /* {{{ */
+static int cpu_config(oconfig_item_t *ci) /* {{{ */
 {
-  if (strcasecmp(key, "ReportByCpu") == 0)
-    report_by_cpu = IS_TRUE(value);
-  else if (strcasecmp(key, "ValuesPercentage") == 0)
-    report_percent = IS_TRUE(value);
-  else if (strcasecmp(key, "ReportByState") == 0)
-    report_by_state = IS_TRUE(value);
-  else if (strcasecmp(key, "ReportNumCpu") == 0)
-    report_num_cpu = IS_TRUE(value);
-  else if (strcasecmp(key, "ReportGuestState") == 0)
-    report_guest = IS_TRUE(value);
-  else if (strcasecmp(key, "SubtractGuestState") == 0)
-    subtract_guest = IS_TRUE(value);
-  else
-    return -1;
+  int status = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("ReportByCpu", child->key) == 0)
+      status = cf_util_get_boolean(child, &report_by_cpu);
+    else if (strcasecmp("ValuesPercentage", child->key) == 0)
+      status = cf_util_get_boolean(child, &report_percent);
+    else if (strcasecmp("ReportByState", child->key) == 0)
+      status = cf_util_get_boolean(child, &report_by_state);
+    else if (strcasecmp("ReportNumCpu", child->key) == 0)
+      status = cf_util_get_boolean(child, &report_num_cpu);
+    else if (strcasecmp("ReportGuestState", child->key) == 0)
+      status = cf_util_get_boolean(child, &report_guest);
+    else if (strcasecmp("SubtractGuestState", child->key) == 0)
+      status = cf_util_get_boolean(child, &subtract_guest);
+    else if (strcasecmp("Cores", child->key) == 0) {
+      config_cores_cleanup(&cpu_groups);
+      status = config_cores_parse(child, &cpu_groups);
+    } else {
+      ERROR("cpu plugin: Unknown config option \"%s\".", child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return -1;
+  }
 
   return 0;
 } /* }}} int cpu_config */
@@ -324,36 +354,48 @@ static int init(void) {
   return 0;
 } /* int init */
 
-static void submit_value(int cpu_num, int cpu_state, const char *type,
-                         value_t value) {
+/* Appends a value list to cpu_batch. plugin_instance and type_instance may be
+ * NULL. */
+static void submit_value(char const *plugin_instance, const char *type,
+                         char const *type_instance, value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &value;
   vl.values_len = 1;
 
   sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  if (plugin_instance != NULL)
+    sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
   sstrncpy(vl.type, type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, cpu_state_names[cpu_state],
-           sizeof(vl.type_instance));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
 
-  if (cpu_num >= 0) {
-    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%i", cpu_num);
-  }
-  plugin_dispatch_values(&vl);
+  if (vl_batch_add(&cpu_batch, &vl) != 0)
+    ERROR("cpu plugin: vl_batch_add failed.");
 }
 
-static void submit_percent(int cpu_num, int cpu_state, gauge_t value) {
+/* Dispatches all value lists collected by submit_value(). */
+static void cpu_batch_flush(void) /* {{{ */
+{
+  vl_batch_dispatch(&cpu_batch);
+} /* }}} void cpu_batch_flush */
+
+static void submit_percent(char const *instance, int cpu_state,
+                           gauge_t value) {
   /* This function is called for all known CPU states, but each read
    * method will only report a subset. The remaining states are left as
    * NAN and we ignore them here. */
   if (isnan(value))
     return;
 
-  submit_value(cpu_num, cpu_state, "percent", (value_t){.gauge = value});
+  submit_value(instance, "percent", cpu_state_names[cpu_state],
+               (value_t){.gauge = value});
 }
 
-static void submit_derive(int cpu_num, int cpu_state, derive_t value) {
-  submit_value(cpu_num, cpu_state, "cpu", (value_t){.derive = value});
+static void submit_derive(char const *instance, int cpu_state,
+                          derive_t value) {
+  submit_value(instance, "cpu", cpu_state_names[cpu_state],
+               (value_t){.derive = value});
 }
 
 /* Takes the zero-index number of a CPU and makes sure that the module-global
@@ -411,6 +453,28 @@ static int total_rate(gauge_t *sum_by_state, size_t state, derive_t d,
 }
 #endif /* }}} HAVE_PERFSTAT */
 
+/* Calculates the rates of all staged values. Since all values of an iteration
+ * share the same interval, this is a single branch-free pass over the
+ * cpu_states array. Values staged for the first time get a rate but no
+ * has_value flag, like value_to_rate() returning EAGAIN. */
+static void cpu_rates(void) /* {{{ */
+{
+  bool valid = (cpu_last_time != 0) && (cpu_time > cpu_last_time);
+  gauge_t factor =
+      valid ? 1.0 / CDTIME_T_TO_DOUBLE(cpu_time - cpu_last_time) : NAN;
+
+  for (size_t i = 0; i < cpu_states_num; i++) {
+    cpu_state_t *s = cpu_states + i;
+
+    s->rate = ((gauge_t)(s->value - s->last_value)) * factor;
+    s->has_value = valid && s->staged && s->has_last;
+    s->last_value = s->value;
+    s->has_last = s->staged;
+  }
+
+  cpu_last_time = cpu_time;
+} /* }}} void cpu_rates */
+
 /* Populates the per-CPU COLLECTD_CPU_STATE_ACTIVE rate and the global
  * rate_by_state
  * array. */
@@ -465,13 +529,14 @@ static void aggregate(gauge_t *sum_by_state) /* {{{ */
 #endif /* }}} HAVE_PERFSTAT */
 } /* }}} void aggregate */
 
-/* Commits (dispatches) the values for one CPU or the global aggregation.
- * cpu_num is the index of the CPU to be committed or -1 in case of the global
- * aggregation. rates is a pointer to COLLECTD_CPU_STATE_MAX gauge_t values
+/* Commits (dispatches) the values for one CPU, one group of CPUs or the
+ * global aggregation. instance is the plugin instance to use, i.e. the CPU
+ * number or group description, or NULL in case of the global aggregation.
+ * rates is a pointer to COLLECTD_CPU_STATE_MAX gauge_t values
  * holding the
  * current rate; each rate may be NAN. Calculates the percentage of each state
  * and dispatches the metric. */
-static void cpu_commit_one(int cpu_num, /* {{{ */
+static void cpu_commit_one(char const *instance, /* {{{ */
                            gauge_t rates[static COLLECTD_CPU_STATE_MAX]) {
   gauge_t sum;
 
@@ -480,36 +545,30 @@ static void cpu_commit_one(int cpu_num, /* {{{ */
 
   if (!report_by_state) {
     gauge_t percent = 100.0 * rates[COLLECTD_CPU_STATE_ACTIVE] / sum;
-    submit_percent(cpu_num, COLLECTD_CPU_STATE_ACTIVE, percent);
+    submit_percent(instance, COLLECTD_CPU_STATE_ACTIVE, percent);
     return;
   }
 
   for (size_t state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
     gauge_t percent = 100.0 * rates[state] / sum;
-    submit_percent(cpu_num, state, percent);
+    submit_percent(instance, state, percent);
   }
 } /* }}} void cpu_commit_one */
 
 /* Commits the number of cores */
 static void cpu_commit_num_cpu(gauge_t value) /* {{{ */
 {
-  value_list_t vl = VALUE_LIST_INIT;
-
-  vl.values = &(value_t){.gauge = value};
-  vl.values_len = 1;
-
-  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
-  sstrncpy(vl.type, "count", sizeof(vl.type));
-
-  plugin_dispatch_values(&vl);
+  submit_value(NULL, "count", NULL, (value_t){.gauge = value});
 } /* }}} void cpu_commit_num_cpu */
 
 /* Resets the internal aggregation. This is called by the read callback after
  * each iteration / after each call to cpu_commit(). */
 static void cpu_reset(void) /* {{{ */
 {
-  for (size_t i = 0; i < cpu_states_num; i++)
+  for (size_t i = 0; i < cpu_states_num; i++) {
+    cpu_states[i].staged = false;
     cpu_states[i].has_value = false;
+  }
 
   global_cpu_num = 0;
 } /* }}} void cpu_reset */
@@ -520,15 +579,68 @@ static void cpu_commit_without_aggregation(void) /* {{{ */
   for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
     for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
       cpu_state_t *s = get_cpu_state(cpu_num, state);
+      char instance[DATA_MAX_NAME_LEN];
 
       if (!s->has_value)
         continue;
 
-      submit_derive((int)cpu_num, (int)state, s->conv.last_value.derive);
+      snprintf(instance, sizeof(instance), "%" PRIsz, cpu_num);
+      submit_derive(instance, state, s->value);
     }
   }
 } /* }}} void cpu_commit_without_aggregation */
 
+/* Like cpu_commit_without_aggregation(), but dispatches the sum of the raw
+ * derive values of each group of CPUs. */
+static void cpu_commit_groups_without_aggregation(void) /* {{{ */
+{
+  for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
+    for (size_t i = 0; i < cpu_groups.num_cgroups; i++) {
+      core_group_t *cg = cpu_groups.cgroups + i;
+      derive_t sum = 0;
+      bool has_value = false;
+
+      for (size_t j = 0; j < cg->num_cores; j++) {
+        if (cg->cores[j] >= global_cpu_num)
+          continue;
+
+        cpu_state_t *s = get_cpu_state(cg->cores[j], state);
+        if (!s->has_value)
+          continue;
+
+        sum += s->value;
+        has_value = true;
+      }
+
+      if (has_value)
+        submit_derive(cg->desc, state, sum);
+    }
+  }
+} /* }}} void cpu_commit_groups_without_aggregation */
+
+/* Dispatches the summed rates of each group of CPUs. Expects aggregate() to
+ * have populated the per-CPU COLLECTD_CPU_STATE_ACTIVE rates. */
+static void cpu_commit_groups(void) /* {{{ */
+{
+  for (size_t i = 0; i < cpu_groups.num_cgroups; i++) {
+    core_group_t *cg = cpu_groups.cgroups + i;
+    gauge_t rates[COLLECTD_CPU_STATE_MAX] = {
+        NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN};
+
+    for (size_t j = 0; j < cg->num_cores; j++) {
+      if (cg->cores[j] >= global_cpu_num)
+        continue;
+
+      cpu_state_t *this_cpu_states = get_cpu_state(cg->cores[j], 0);
+      for (size_t state = 0; state < COLLECTD_CPU_STATE_MAX; state++)
+        if (this_cpu_states[state].has_value)
+          RATE_ADD(rates[state], this_cpu_states[state].rate);
+    }
+
+    cpu_commit_one(cg->desc, rates);
+  }
+} /* }}} void cpu_commit_groups */
+
 /* Aggregates the internal state and dispatches the metrics. */
 static void cpu_commit(void) /* {{{ */
 {
@@ -536,18 +648,31 @@ static void cpu_commit(void) /* {{{ */
       NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN, NAN /* Batman! */
   };
 
+  cpu_rates();
+
   if (report_num_cpu)
     cpu_commit_num_cpu((gauge_t)global_cpu_num);
 
   if (report_by_state && report_by_cpu && !report_percent) {
-    cpu_commit_without_aggregation();
+    if (cpu_groups.num_cgroups > 0)
+      cpu_commit_groups_without_aggregation();
+    else
+      cpu_commit_without_aggregation();
+    cpu_batch_flush();
     return;
   }
 
   aggregate(global_rates);
 
   if (!report_by_cpu) {
-    cpu_commit_one(-1, global_rates);
+    cpu_commit_one(NULL, global_rates);
+    cpu_batch_flush();
+    return;
+  }
+
+  if (cpu_groups.num_cgroups > 0) {
+    cpu_commit_groups();
+    cpu_batch_flush();
     return;
   }
 
@@ -560,8 +685,12 @@ static void cpu_commit(void) /* {{{ */
       if (this_cpu_states[state].has_value)
         local_rates[state] = this_cpu_states[state].rate;
 
-    cpu_commit_one((int)cpu_num, local_rates);
+    char instance[DATA_MAX_NAME_LEN];
+    snprintf(instance, sizeof(instance), "%" PRIsz, cpu_num);
+    cpu_commit_one(instance, local_rates);
   }
+
+  cpu_batch_flush();
 } /* }}} void cpu_commit */
 
 /* Adds a derive value to the internal state. This should be used by each read
@@ -572,8 +701,6 @@ static int cpu_stage(size_t cpu_num, size_t state, derive_t d,
 {
   int status;
   cpu_state_t *s;
-  gauge_t rate = NAN;
-  value_t val = {.derive = d};
 
   if (state >= COLLECTD_CPU_STATE_ACTIVE)
     return EINVAL;
@@ -586,13 +713,9 @@ static int cpu_stage(size_t cpu_num, size_t state, derive_t d,
     global_cpu_num = cpu_num + 1;
 
   s = get_cpu_state(cpu_num, state);
-
-  status = value_to_rate(&rate, val, DS_TYPE_DERIVE, now, &s->conv);
-  if (status != 0)
-    return status;
-
-  s->rate = rate;
-  s->has_value = true;
+  s->value = d;
+  s->staged = true;
+  cpu_time = now;
   return 0;
 } /* }}} int cpu_stage */
 
@@ -638,24 +761,31 @@ static int cpu_read(void) {
 
 #elif defined(KERNEL_LINUX) /* {{{ */
   int cpu;
-  FILE *fh;
-  char buf[1024];
+  char *buf;
 
   char *fields[11];
   int numfields;
 
-  if ((fh = fopen("/proc/stat", "r")) == NULL) {
-    ERROR("cpu plugin: fopen (/proc/stat) failed: %s", STRERRNO);
+  if (proc_stat == NULL) {
+    proc_stat = proc_file_create("/proc/stat");
+    if (proc_stat == NULL) {
+      ERROR("cpu plugin: proc_file_create failed.");
+      return -1;
+    }
+  }
+
+  if (proc_file_read(proc_stat) < 0) {
+    ERROR("cpu plugin: reading /proc/stat failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buf, 1024, fh) != NULL) {
+  while ((buf = proc_file_next_line(proc_stat)) != NULL) {
     if (strncmp(buf, "cpu", 3))
       continue;
     if ((buf[3] < '0') || (buf[3] > '9'))
       continue;
 
-    numfields = strsplit(buf, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = (int)proc_file_split(buf, fields, STATIC_ARRAY_SIZE(fields));
     if (numfields < 5)
       continue;
 
@@ -663,26 +793,30 @@ static int cpu_read(void) {
 
     /* Do not stage User and Nice immediately: we may need to alter them later:
      */
-    long long user_value = atoll(fields[1]);
-    long long nice_value = atoll(fields[2]);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)atoll(fields[3]), now);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)atoll(fields[4]), now);
+    long long user_value = (long long)proc_atou64(fields[1]);
+    long long nice_value = (long long)proc_atou64(fields[2]);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)proc_atou64(fields[3]),
+              now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)proc_atou64(fields[4]),
+              now);
 
     if (numfields >= 8) {
-      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)atoll(fields[5]), now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)atoll(fields[6]),
-                now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)atoll(fields[7]),
+      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)proc_atou64(fields[5]),
                 now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT,
+                (derive_t)proc_atou64(fields[6]), now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ,
+                (derive_t)proc_atou64(fields[7]), now);
     }
 
     if (numfields >= 9) { /* Steal (since Linux 2.6.11) */
-      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)atoll(fields[8]), now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)proc_atou64(fields[8]),
+                now);
     }
 
     if (numfields >= 10) { /* Guest (since Linux 2.6.24) */
       if (report_guest) {
-        long long value = atoll(fields[9]);
+        long long value = (long long)proc_atou64(fields[9]);
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST, (derive_t)value, now);
         /* Guest is included in User; optionally subtract Guest from User: */
         if (subtract_guest) {
@@ -695,7 +829,7 @@ static int cpu_read(void) {
 
     if (numfields >= 11) { /* Guest_nice (since Linux 2.6.33) */
       if (report_guest) {
-        long long value = atoll(fields[10]);
+        long long value = (long long)proc_atou64(fields[10]);
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST_NICE, (derive_t)value, now);
         /* Guest_nice is included in Nice; optionally subtract Guest_nice from
            Nice: */
@@ -711,7 +845,6 @@ static int cpu_read(void) {
     cpu_stage(cpu, COLLECTD_CPU_STATE_USER, (derive_t)user_value, now);
     cpu_stage(cpu, COLLECTD_CPU_STATE_NICE, (derive_t)nice_value, now);
   }
-  fclose(fh);
   /* }}} #endif defined(KERNEL_LINUX) */
 
 #elif defined(HAVE_LIBKSTAT) /* {{{ */
@@ -907,8 +1040,24 @@ static int cpu_read(void) {
   return 0;
 }
 
+static int cpu_shutdown(void) {
+#ifdef KERNEL_LINUX
+  proc_file_destroy(proc_stat);
+  proc_stat = NULL;
+#endif
+
+  vl_batch_free(&cpu_batch);
+
+  sfree(cpu_states);
+  cpu_states_num = 0;
+
+  config_cores_cleanup(&cpu_groups);
+  return 0;
+} /* int cpu_shutdown */
+
 void module_register(void) {
   plugin_register_init("cpu", init);
-  plugin_register_config("cpu", cpu_config, config_keys, config_keys_num);
+  plugin_register_complex_config("cpu", cpu_config);
   plugin_register_read("cpu", cpu_read);
+  plugin_register_shutdown("cpu", cpu_shutdown);
 } /* void module_register */
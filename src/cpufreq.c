@@ -31,22 +31,72 @@
 #endif
 
 #if KERNEL_LINUX
+#include "utils/proc_file/proc_file.h"
+
 #define MAX_AVAIL_FREQS 20
 
+/* Buffer sizes for the single value attributes and for time_in_state. */
+#define CPUFREQ_VALUE_FILE_SIZE 64
+#define CPUFREQ_STATE_FILE_SIZE 1024
+
 static int num_cpu;
+static int num_cpu_alloc;
 
+/* The attribute files are kept open, see proc_file.h. */
 struct cpu_data_t {
+  proc_file_t *cur_freq;
+  proc_file_t *total_trans;
+  proc_file_t *time_in_state;
   value_to_rate_state_t time_state[MAX_AVAIL_FREQS];
 } * cpu_data;
 
 /* Flags denoting capability of reporting CPU frequency statistics. */
 static bool report_p_stats = false;
 
-static void cpufreq_stats_init(void) {
-  cpu_data = calloc(num_cpu, sizeof(*cpu_data));
-  if (cpu_data == NULL)
-    return;
+/* The CPUs are scanned again when the set of online CPUs changes. */
+static proc_file_t *cpus_online;
+static char cpus_online_last[256];
+
+static proc_file_t *cpufreq_file_create(int cpu, char const *name,
+                                        size_t size) {
+  char filename[PATH_MAX];
+  snprintf(filename, sizeof(filename),
+           "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, name);
+  return proc_file_create_size(filename, size);
+}
+
+static int cpufreq_cpu_data_grow(int num) {
+  if (num <= num_cpu_alloc)
+    return 0;
 
+  struct cpu_data_t *tmp = realloc(cpu_data, num * sizeof(*cpu_data));
+  if (tmp == NULL)
+    return ENOMEM;
+  cpu_data = tmp;
+
+  for (int i = num_cpu_alloc; i < num; i++) {
+    cpu_data[i] = (struct cpu_data_t){
+        .cur_freq =
+            cpufreq_file_create(i, "scaling_cur_freq", CPUFREQ_VALUE_FILE_SIZE),
+        .total_trans = cpufreq_file_create(i, "stats/total_trans",
+                                           CPUFREQ_VALUE_FILE_SIZE),
+        .time_in_state = cpufreq_file_create(i, "stats/time_in_state",
+                                             CPUFREQ_STATE_FILE_SIZE),
+    };
+    if ((cpu_data[i].cur_freq == NULL) || (cpu_data[i].total_trans == NULL) ||
+        (cpu_data[i].time_in_state == NULL)) {
+      proc_file_destroy(cpu_data[i].cur_freq);
+      proc_file_destroy(cpu_data[i].total_trans);
+      proc_file_destroy(cpu_data[i].time_in_state);
+      num_cpu_alloc = i;
+      return ENOMEM;
+    }
+  }
+  num_cpu_alloc = num;
+  return 0;
+}
+
+static void cpufreq_stats_init(void) {
   report_p_stats = true;
 
   /* Check for stats module and disable if not present. */
@@ -77,30 +127,79 @@ static void cpufreq_stats_init(void) {
   }
   return;
 }
-#endif /* KERNEL_LINUX */
 
-static int cpufreq_init(void) {
-#if KERNEL_LINUX
+/* Counts the CPUs with a cpufreq directory. The state of CPUs that went away
+ * is kept, in case they come back. */
+static void cpufreq_scan(void) {
   char filename[PATH_MAX];
-
-  num_cpu = 0;
+  int num = 0;
 
   while (1) {
     int status = snprintf(filename, sizeof(filename),
                           "/sys/devices/system/cpu/cpu%d/cpufreq/"
                           "scaling_cur_freq",
-                          num_cpu);
+                          num);
     if ((status < 1) || ((unsigned int)status >= sizeof(filename)))
       break;
 
     if (access(filename, R_OK))
       break;
 
-    num_cpu++;
+    num++;
   }
 
-  INFO("cpufreq plugin: Found %d CPU%s", num_cpu, (num_cpu == 1) ? "" : "s");
+  if (cpufreq_cpu_data_grow(num) != 0) {
+    ERROR("cpufreq plugin: realloc failed.");
+    num = num_cpu_alloc;
+  }
+
+  if (num != num_cpu)
+    INFO("cpufreq plugin: Found %d CPU%s", num, (num == 1) ? "" : "s");
+  num_cpu = num;
   cpufreq_stats_init();
+}
+
+/* Returns true if the contents of /sys/devices/system/cpu/online changed
+ * since the last call. */
+static bool cpufreq_cpus_changed(void) {
+  if (proc_file_read(cpus_online) < 0)
+    return false;
+
+  char const *line = proc_file_next_line(cpus_online);
+  if (line == NULL)
+    line = "";
+  if (strcmp(line, cpus_online_last) == 0)
+    return false;
+
+  sstrncpy(cpus_online_last, line, sizeof(cpus_online_last));
+  return true;
+}
+
+/* Reads the first line of an attribute file. */
+static int cpufreq_read_value(proc_file_t *pf, value_t *ret, int ds_type) {
+  if (proc_file_read(pf) < 0)
+    return -1;
+
+  char const *line = proc_file_next_line(pf);
+  if (line == NULL)
+    return -1;
+
+  return parse_value(line, ret, ds_type);
+}
+#endif /* KERNEL_LINUX */
+
+static int cpufreq_init(void) {
+#if KERNEL_LINUX
+  if (cpus_online == NULL)
+    cpus_online = proc_file_create_size("/sys/devices/system/cpu/online",
+                                        sizeof(cpus_online_last));
+  if (cpus_online == NULL) {
+    ERROR("cpufreq plugin: proc_file_create failed.");
+    return -1;
+  }
+
+  cpufreq_cpus_changed();
+  cpufreq_scan();
 
   if (num_cpu == 0)
     plugin_unregister_read("cpufreq");
@@ -136,34 +235,29 @@ static void cpufreq_submit(int cpu_num, const char *type,
 
 #if KERNEL_LINUX
 static void cpufreq_read_stats(int cpu) {
-  char filename[PATH_MAX];
   /* Read total transitions for cpu frequency */
-  snprintf(filename, sizeof(filename),
-           "/sys/devices/system/cpu/cpu%d/cpufreq/stats/total_trans", cpu);
+  proc_file_t *pf = cpu_data[cpu].total_trans;
 
   value_t v;
-  if (parse_value_file(filename, &v, DS_TYPE_DERIVE) != 0) {
-    ERROR("cpufreq plugin: Reading \"%s\" failed.", filename);
+  if (cpufreq_read_value(pf, &v, DS_TYPE_DERIVE) != 0) {
+    ERROR("cpufreq plugin: Reading \"%s\" failed.", proc_file_path(pf));
     return;
   }
   cpufreq_submit(cpu, "transitions", NULL, &v);
 
   /* Determine percentage time in each state for cpu during previous
    * interval. */
-  snprintf(filename, sizeof(filename),
-           "/sys/devices/system/cpu/cpu%d/cpufreq/stats/time_in_state", cpu);
-
-  FILE *fh = fopen(filename, "r");
-  if (fh == NULL) {
-    ERROR("cpufreq plugin: Reading \"%s\" failed.", filename);
+  pf = cpu_data[cpu].time_in_state;
+  if (proc_file_read(pf) < 0) {
+    ERROR("cpufreq plugin: Reading \"%s\" failed.", proc_file_path(pf));
     return;
   }
 
   int state_index = 0;
   cdtime_t now = cdtime();
-  char buffer[DATA_MAX_NAME_LEN];
+  char *buffer;
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while ((buffer = proc_file_next_line(pf)) != NULL) {
     unsigned int frequency;
     unsigned long long time;
 
@@ -173,7 +267,7 @@ static void cpufreq_read_stats(int cpu) {
      * by 100 back. So, just use parsed value directly.
      */
     if (!sscanf(buffer, "%u%llu", &frequency, &time)) {
-      ERROR("cpufreq plugin: Reading \"%s\" failed.", filename);
+      ERROR("cpufreq plugin: Reading \"%s\" failed.", proc_file_path(pf));
       break;
     }
 
@@ -201,21 +295,21 @@ static void cpufreq_read_stats(int cpu) {
     }
     state_index++;
   }
-  fclose(fh);
 }
 #endif /* KERNEL_LINUX */
 
 static int cpufreq_read(void) {
 #if KERNEL_LINUX
+  if (cpufreq_cpus_changed())
+    cpufreq_scan();
+
   for (int cpu = 0; cpu < num_cpu; cpu++) {
-    char filename[PATH_MAX];
     /* Read cpu frequency */
-    snprintf(filename, sizeof(filename),
-             "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    proc_file_t *pf = cpu_data[cpu].cur_freq;
 
     value_t v;
-    if (parse_value_file(filename, &v, DS_TYPE_GAUGE) != 0) {
-      WARNING("cpufreq plugin: Reading \"%s\" failed.", filename);
+    if (cpufreq_read_value(pf, &v, DS_TYPE_GAUGE) != 0) {
+      WARNING("cpufreq plugin: Reading \"%s\" failed.", proc_file_path(pf));
       continue;
     }
 
@@ -247,7 +341,26 @@ static int cpufreq_read(void) {
   return 0;
 } /* int cpufreq_read */
 
+#if KERNEL_LINUX
+static int cpufreq_shutdown(void) {
+  for (int i = 0; i < num_cpu_alloc; i++) {
+    proc_file_destroy(cpu_data[i].cur_freq);
+    proc_file_destroy(cpu_data[i].total_trans);
+    proc_file_destroy(cpu_data[i].time_in_state);
+  }
+  sfree(cpu_data);
+  num_cpu = num_cpu_alloc = 0;
+
+  proc_file_destroy(cpus_online);
+  cpus_online = NULL;
+  return 0;
+}
+#endif
+
 void module_register(void) {
   plugin_register_init("cpufreq", cpufreq_init);
   plugin_register_read("cpufreq", cpufreq_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("cpufreq", cpufreq_shutdown);
+#endif
 }
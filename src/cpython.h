@@ -178,6 +178,9 @@ typedef struct {
 extern PyTypeObject ValuesType;
 #define Values_New()                                                           \
   PyObject_CallFunctionObjArgs((PyObject *)&ValuesType, (void *)0)
+/* Converts a Values object into "vl". On success, the caller must free
+ * vl->values and vl->meta. Returns -1 with a Python exception set on error. */
+int Values_to_value_list(PyObject *v, value_list_t *vl);
 
 typedef struct {
   PluginData data;
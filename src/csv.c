@@ -24,13 +24,31 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
+/*
+ * Private types
+ */
+/* An open CSV file. Open files are kept in a list ordered by last use, the
+ * most recently used one first, so the least recently used one is closed when
+ * "MaxOpenFiles" is exceeded. */
+typedef struct csv_file_s {
+  char *filename;
+  FILE *fh;
+  cdtime_t last_write;
+  bool dirty;
+
+  struct csv_file_s *prev;
+  struct csv_file_s *next;
+} csv_file_t;
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates", "FileDate"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "FileDate",
+                                    "MaxOpenFiles", "FlushInterval"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir;
@@ -38,6 +56,16 @@ static int store_rates;
 static int use_stdio;
 static int file_date = 1;
 
+/* If max_open_files is zero, every file is opened and closed for each write. */
+static int max_open_files;
+static cdtime_t flush_interval;
+static cdtime_t flush_last;
+static c_avl_tree_t *files;
+static csv_file_t *files_head;
+static csv_file_t *files_tail;
+static int files_num;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
   int offset;
@@ -157,27 +185,13 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static int csv_create_file(const char *filename, const data_set_t *ds) {
-  FILE *csv;
-
-  if (check_create_dir(filename))
-    return -1;
-
-  csv = fopen(filename, "w");
-  if (csv == NULL) {
-    ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
-    return -1;
-  }
-
+static void csv_write_header(FILE *csv, const data_set_t *ds) {
   fprintf(csv, "epoch");
   for (size_t i = 0; i < ds->ds_num; i++)
     fprintf(csv, ",%s", ds->ds[i].name);
 
   fprintf(csv, "\n");
-  fclose(csv);
-
-  return 0;
-} /* int csv_create_file */
+} /* void csv_write_header */
 
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
@@ -214,20 +228,216 @@ static int csv_config(const char *key, const char *value) {
       file_date = 1;
     else
       file_date = 0;
+  } else if (strcasecmp("MaxOpenFiles", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR("csv plugin: \"MaxOpenFiles\" must not be negative.");
+      return 1;
+    }
+    max_open_files = tmp;
+  } else if (strcasecmp("FlushInterval", key) == 0) {
+    double tmp = atof(value);
+    if (tmp <= 0.0) {
+      ERROR("csv plugin: \"FlushInterval\" must be greater than zero.");
+      return 1;
+    }
+    flush_interval = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
   return 0;
 } /* int csv_config */
 
+/* Opens "filename" for appending and locks it. New files are created, along
+ * with their directory, and get a header line. The lock is released when the
+ * file is closed. */
+static FILE *csv_open(const char *filename, const data_set_t *ds) {
+  struct stat statbuf;
+  FILE *csv;
+  struct flock fl = {0};
+  int status;
+
+  csv = fopen(filename, "a");
+  if ((csv == NULL) && (errno == ENOENT)) {
+    if (check_create_dir(filename))
+      return NULL;
+    csv = fopen(filename, "a");
+  }
+  if (csv == NULL) {
+    ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
+    return NULL;
+  }
+
+  fl.l_pid = getpid();
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+
+  status = fcntl(fileno(csv), F_SETLK, &fl);
+  if (status != 0) {
+    ERROR("csv plugin: flock (%s) failed: %s", filename, STRERRNO);
+    fclose(csv);
+    return NULL;
+  }
+
+  if (fstat(fileno(csv), &statbuf) != 0) {
+    ERROR("csv plugin: fstat (%s) failed: %s", filename, STRERRNO);
+    fclose(csv);
+    return NULL;
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    ERROR("stat(%s): Not a regular file!", filename);
+    fclose(csv);
+    return NULL;
+  }
+
+  /* Empty files are new and need the header. */
+  if (statbuf.st_size == 0)
+    csv_write_header(csv, ds);
+
+  return csv;
+} /* FILE *csv_open */
+
+/* XXX: You must hold "files_lock" when calling the csv_file_* functions! */
+static void csv_file_unlink(csv_file_t *f) {
+  if (f->prev != NULL)
+    f->prev->next = f->next;
+  else
+    files_head = f->next;
+
+  if (f->next != NULL)
+    f->next->prev = f->prev;
+  else
+    files_tail = f->prev;
+
+  f->prev = f->next = NULL;
+} /* void csv_file_unlink */
+
+static void csv_file_link_head(csv_file_t *f) {
+  f->prev = NULL;
+  f->next = files_head;
+  if (files_head != NULL)
+    files_head->prev = f;
+  files_head = f;
+  if (files_tail == NULL)
+    files_tail = f;
+} /* void csv_file_link_head */
+
+static void csv_file_close(csv_file_t *f) {
+  c_avl_remove(files, f->filename, NULL, NULL);
+  csv_file_unlink(f);
+  files_num--;
+
+  /* The lock is implicitely released. */
+  if (fclose(f->fh) != 0)
+    ERROR("csv plugin: fclose (%s) failed: %s", f->filename, STRERRNO);
+
+  sfree(f->filename);
+  sfree(f);
+} /* void csv_file_close */
+
+static csv_file_t *csv_file_get(const char *filename, const data_set_t *ds) {
+  csv_file_t *f = NULL;
+
+  if (c_avl_get(files, filename, (void *)&f) == 0) {
+    if (f != files_head) {
+      csv_file_unlink(f);
+      csv_file_link_head(f);
+    }
+    return f;
+  }
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL) {
+    ERROR("csv plugin: calloc failed.");
+    return NULL;
+  }
+
+  f->filename = strdup(filename);
+  if (f->filename == NULL) {
+    ERROR("csv plugin: strdup failed.");
+    sfree(f);
+    return NULL;
+  }
+
+  f->fh = csv_open(filename, ds);
+  if (f->fh == NULL) {
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files, f->filename, f) != 0) {
+    ERROR("csv plugin: c_avl_insert (%s) failed.", filename);
+    fclose(f->fh);
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+  csv_file_link_head(f);
+  files_num++;
+
+  while (files_num > max_open_files)
+    csv_file_close(files_tail);
+
+  return f;
+} /* csv_file_t *csv_file_get */
+
+/* Writes the buffered lines of all open files to disk. Files that have not
+ * been written to for two flush intervals, e.g. files of the previous day, are
+ * closed. */
+static void csv_files_flush(cdtime_t now) {
+  csv_file_t *f = files_head;
+
+  while (f != NULL) {
+    csv_file_t *next = f->next;
+
+    if (f->dirty) {
+      if (fflush(f->fh) != 0)
+        ERROR("csv plugin: fflush (%s) failed: %s", f->filename, STRERRNO);
+      f->dirty = false;
+    }
+
+    if ((now - f->last_write) > (2 * flush_interval))
+      csv_file_close(f);
+
+    f = next;
+  }
+
+  flush_last = now;
+} /* void csv_files_flush */
+
+static int csv_write_cached(const char *filename, const char *values,
+                            const data_set_t *ds) {
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&files_lock);
+
+  csv_file_t *f = csv_file_get(filename, ds);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+
+  if (fprintf(f->fh, "%s\n", values) < 0) {
+    ERROR("csv plugin: Writing to %s failed: %s", filename, STRERRNO);
+    csv_file_close(f);
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+  f->last_write = now;
+  f->dirty = true;
+
+  if ((now - flush_last) >= flush_interval)
+    csv_files_flush(now);
+
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_write_cached */
+
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
   char filename[512];
   char values[4096];
   FILE *csv;
-  int csv_fd;
-  struct flock fl = {0};
   int status;
 
   if (0 != strcmp(ds->type, vl->type)) {
@@ -260,36 +470,12 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      ERROR("stat(%s) failed: %s", filename, STRERRNO);
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
-    return -1;
-  }
+  if (files != NULL)
+    return csv_write_cached(filename, values, ds);
 
-  csv = fopen(filename, "a");
-  if (csv == NULL) {
-    ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
+  csv = csv_open(filename, ds);
+  if (csv == NULL)
     return -1;
-  }
-  csv_fd = fileno(csv);
-
-  fl.l_pid = getpid();
-  fl.l_type = F_WRLCK;
-  fl.l_whence = SEEK_SET;
-
-  status = fcntl(csv_fd, F_SETLK, &fl);
-  if (status != 0) {
-    ERROR("csv plugin: flock (%s) failed: %s", filename, STRERRNO);
-    fclose(csv);
-    return -1;
-  }
 
   fprintf(csv, "%s\n", values);
 
@@ -300,7 +486,51 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int csv_write */
 
+static int csv_flush(__attribute__((unused)) cdtime_t timeout,
+                     __attribute__((unused)) const char *identifier,
+                     __attribute__((unused)) user_data_t *user_data) {
+  pthread_mutex_lock(&files_lock);
+  if (files != NULL)
+    csv_files_flush(cdtime());
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_flush */
+
+static int csv_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
+  if (files != NULL) {
+    while (files_head != NULL)
+      csv_file_close(files_head);
+    c_avl_destroy(files);
+    files = NULL;
+  }
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_shutdown */
+
+static int csv_init(void) {
+  if ((max_open_files == 0) || use_stdio)
+    return 0;
+
+  if (flush_interval == 0)
+    flush_interval = plugin_get_interval();
+
+  pthread_mutex_lock(&files_lock);
+  files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  flush_last = cdtime();
+  pthread_mutex_unlock(&files_lock);
+  if (files == NULL) {
+    ERROR("csv plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
+  return 0;
+} /* int csv_init */
+
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
+  plugin_register_init("csv", csv_init);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
 } /* void module_register */
@@ -25,6 +25,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/curl_engine/curl_engine.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils/match/match.h"
 #include "utils_time.h"
@@ -72,6 +73,7 @@ struct web_page_s /* {{{ */
   int timeout;
   curl_stats_t *stats;
 
+  curl_engine_t *engine;
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
   char *buffer;
@@ -139,9 +141,11 @@ static void cc_web_page_free(void *arg) /* {{{ */
   if (wp == NULL)
     return;
 
+  curl_engine_cancel(wp->engine, wp->curl);
   if (wp->curl != NULL)
     curl_easy_cleanup(wp->curl);
   wp->curl = NULL;
+  curl_engine_release(wp->engine);
 
   sfree(wp->plugin_name);
   sfree(wp->instance);
@@ -333,12 +337,17 @@ static int cc_config_add_match(web_page_t *page, /* {{{ */
 
 static int cc_page_init_curl(web_page_t *wp) /* {{{ */
 {
+  wp->engine = curl_engine_acquire();
+  if (wp->engine == NULL)
+    return -1;
+
   wp->curl = curl_easy_init();
   if (wp->curl == NULL) {
     ERROR("curl plugin: curl_easy_init failed.");
     return -1;
   }
 
+  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
   curl_easy_setopt(wp->curl, CURLOPT_NOSIGNAL, 1L);
   curl_easy_setopt(wp->curl, CURLOPT_WRITEFUNCTION, cc_curl_callback);
   curl_easy_setopt(wp->curl, CURLOPT_WRITEDATA, wp);
@@ -632,42 +641,28 @@ static void cc_submit_response_time(const web_page_t *wp, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void cc_submit_response_time */
 
-static int cc_read_page(user_data_t *ud) /* {{{ */
-{
-
-  if ((ud == NULL) || (ud->data == NULL)) {
-    ERROR("curl plugin: cc_read_page: Invalid user data.");
-    return -1;
-  }
-
-  web_page_t *wp = (web_page_t *)ud->data;
-
-  int status;
-  cdtime_t start = 0;
-
-  if (wp->response_time)
-    start = cdtime();
-
-  wp->buffer_fill = 0;
-
-  curl_easy_setopt(wp->curl, CURLOPT_URL, wp->url);
+/* Called by the curl engine once the page has been fetched. */
+static void cc_page_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  web_page_t *wp = user_data;
 
-  status = curl_easy_perform(wp->curl);
   if (status != CURLE_OK) {
     ERROR("curl plugin: curl_easy_perform failed with status %i: %s", status,
           wp->curl_errbuf);
-    return -1;
+    goto out;
   }
 
-  if (wp->response_time)
-    cc_submit_response_time(wp, CDTIME_T_TO_DOUBLE(cdtime() - start));
+  if (wp->response_time) {
+    double total_time = 0.0;
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total_time);
+    cc_submit_response_time(wp, (gauge_t)total_time);
+  }
   if (wp->stats != NULL)
-    curl_stats_dispatch(wp->stats, wp->curl, NULL, "curl", wp->instance);
+    curl_stats_dispatch(wp->stats, curl, NULL, "curl", wp->instance);
 
   if (wp->response_code) {
     long response_code = 0;
-    status =
-        curl_easy_getinfo(wp->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    status = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
     if (status != CURLE_OK) {
       ERROR("curl plugin: Fetching response code failed with status %i: %s",
             status, wp->curl_errbuf);
@@ -676,11 +671,11 @@ static int cc_read_page(user_data_t *ud) /* {{{ */
     }
   }
 
-  for (web_match_t *wm = wp->matches; wm != NULL; wm = wm->next) {
+  for (web_match_t *wm = wp->matches; (wm != NULL) && (wp->buffer != NULL);
+       wm = wm->next) {
     cu_match_value_t *mv;
 
-    status = match_apply(wm->match, wp->buffer);
-    if (status != 0) {
+    if (match_apply(wm->match, wp->buffer) != 0) {
       WARNING("curl plugin: match_apply failed.");
       continue;
     }
@@ -695,7 +690,34 @@ static int cc_read_page(user_data_t *ud) /* {{{ */
     match_value_reset(mv);
   } /* for (wm = wp->matches; wm != NULL; wm = wm->next) */
 
-  return 0;
+out:
+  /* The next response is written to an empty buffer. */
+  wp->buffer_fill = 0;
+  if (wp->buffer != NULL)
+    wp->buffer[0] = 0;
+} /* }}} void cc_page_done */
+
+static int cc_read_page(user_data_t *ud) /* {{{ */
+{
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl plugin: cc_read_page: Invalid user data.");
+    return -1;
+  }
+
+  web_page_t *wp = (web_page_t *)ud->data;
+
+  /* The page is fetched by the curl engine; cc_page_done handles the
+   * response. */
+  int status = curl_engine_perform(wp->engine, wp->curl, cc_page_done, wp);
+  if (status == EBUSY) {
+    WARNING("curl plugin: The previous request for `%s' has not completed "
+            "yet. Skipping this interval.",
+            wp->url);
+    return 0;
+  }
+
+  return (status == 0) ? 0 : -1;
 } /* }}} int cc_read_page */
 
 void module_register(void) {
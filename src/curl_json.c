@@ -24,9 +24,11 @@
 #include "collectd.h"
 
 #include "plugin.h"
-#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/curl_engine/curl_engine.h"
 #include "utils/curl_stats/curl_stats.h"
+#include "utils/hashtable/hashtable.h"
+#include "utils_batch.h"
 #include "utils_complain.h"
 
 #include <sys/types.h>
@@ -58,11 +60,13 @@ struct cj_key_s /* {{{ */
 /* }}} */
 
 /* cj_tree_entry_t is a union of either a metric configuration ("key") or a tree
- * mapping array indexes / map keys to a descendant cj_tree_entry_t*. */
+ * mapping array indexes / map keys to a descendant cj_tree_entry_t*. The trees
+ * are hash tables keyed by cj_hash(), so that the keys of large documents
+ * which are not configured are discarded with a single lookup. */
 typedef struct {
   enum { KEY, TREE } type;
   union {
-    c_avl_tree_t *tree;
+    c_hashtable_t *tree;
     cj_key_t *key;
   };
 } cj_tree_entry_t;
@@ -101,13 +105,19 @@ struct cj_s /* {{{ */
   int timeout;
   curl_stats_t *stats;
 
+  curl_engine_t *engine;
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
 
   yajl_handle yajl;
-  c_avl_tree_t *tree;
+  c_hashtable_t *tree;
+  /* Parsing of a document fetched by the curl engine outlives cj_read, so
+   * the root of the state stack is kept here. */
+  cj_tree_entry_t root;
   int depth;
   cj_state_t state[YAJL_MAX_DEPTH];
+  /* The values of a document, dispatched by cj_parse_end. */
+  vl_batch_t batch;
 };
 typedef struct cj_s cj_t; /* }}} */
 
@@ -184,30 +194,61 @@ static int cj_get_type(cj_key_t *key) {
   return ds->ds[0].type;
 }
 
+/* 64 bit FNV-1a of a string which is not necessarily null-terminated, such as
+ * the map keys passed to the yajl callbacks. */
+static uint64_t cj_hash(char const *str, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint64_t)(unsigned char)str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* Returns true if the parent context has a tree in which the keys of the
+ * current context can be looked up. Everything below a part of the document
+ * without configuration is skipped without copying or formatting its keys. */
+static bool cj_parent_is_tree(cj_t *db) {
+  cj_tree_entry_t *parent = db->state[db->depth - 1].entry;
+  return (parent != NULL) && (parent->type == TREE);
+}
+
 /* cj_load_key loads the configuration for "key" from the parent context and
  * sets either .key or .tree in the current context. */
-static int cj_load_key(cj_t *db, char const *key) {
+static int cj_load_key(cj_t *db, char const *key, size_t key_len) {
   if (db == NULL || key == NULL || db->depth <= 0)
     return EINVAL;
 
-  sstrncpy(db->state[db->depth].name, key, sizeof(db->state[db->depth].name));
-
-  if (db->state[db->depth - 1].entry == NULL ||
-      db->state[db->depth - 1].entry->type != TREE) {
+  cj_state_t *state = db->state + db->depth;
+  if (!cj_parent_is_tree(db)) {
+    state->entry = NULL;
     return 0;
   }
 
-  c_avl_tree_t *tree = db->state[db->depth - 1].entry->tree;
+  c_hashtable_t *tree = db->state[db->depth - 1].entry->tree;
+  uint64_t hash = cj_hash(key, key_len);
   cj_tree_entry_t *e = NULL;
+  int status;
 
-  if (c_avl_get(tree, key, (void *)&e) == 0) {
-    db->state[db->depth].entry = e;
-  } else if (c_avl_get(tree, CJ_ANY, (void *)&e) == 0) {
-    db->state[db->depth].entry = e;
+  /* The name is kept for the type instance of keys without an "Instance". */
+  if (key_len < sizeof(state->name)) {
+    memcpy(state->name, key, key_len);
+    state->name[key_len] = 0;
+    status = c_hashtable_get(tree, hash, state->name, (void *)&e);
   } else {
-    db->state[db->depth].entry = NULL;
+    char *name = strndup(key, key_len);
+    if (name == NULL)
+      return ENOMEM;
+    sstrncpy(state->name, name, sizeof(state->name));
+    status = c_hashtable_get(tree, hash, name, (void *)&e);
+    sfree(name);
   }
 
+  if ((status != 0) && (c_hashtable_get(tree, cj_hash(CJ_ANY, strlen(CJ_ANY)),
+                                        CJ_ANY, (void *)&e) != 0))
+    e = NULL;
+
+  state->entry = e;
   return 0;
 }
 
@@ -216,10 +257,14 @@ static void cj_advance_array(cj_t *db) {
     return;
 
   db->state[db->depth].index++;
+  if (!cj_parent_is_tree(db)) {
+    db->state[db->depth].entry = NULL;
+    return;
+  }
 
   char name[DATA_MAX_NAME_LEN];
-  snprintf(name, sizeof(name), "%d", db->state[db->depth].index);
-  cj_load_key(db, name);
+  int len = snprintf(name, sizeof(name), "%d", db->state[db->depth].index);
+  cj_load_key(db, name, (size_t)len);
 }
 
 /* yajl callbacks */
@@ -234,18 +279,20 @@ static int cj_cb_null(void *ctx) {
 static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
   cj_t *db = (cj_t *)ctx;
 
+  if (db->state[db->depth].entry == NULL) {
+    cj_advance_array(ctx);
+    return CJ_CB_CONTINUE;
+  }
+
   /* Create a null-terminated version of the string. */
   char buffer[number_len + 1];
   memcpy(buffer, number, number_len);
   buffer[sizeof(buffer) - 1] = '\0';
 
-  if (db->state[db->depth].entry == NULL ||
-      db->state[db->depth].entry->type != KEY) {
-    if (db->state[db->depth].entry != NULL) {
-      NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
-             "map.",
-             buffer);
-    }
+  if (db->state[db->depth].entry->type != KEY) {
+    NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
+           "map.",
+           buffer);
     cj_advance_array(ctx);
     return CJ_CB_CONTINUE;
   }
@@ -270,12 +317,7 @@ static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
  * NULL. */
 static int cj_cb_map_key(void *ctx, unsigned char const *in_name,
                          yajl_len_t in_name_len) {
-  char name[in_name_len + 1];
-
-  memmove(name, in_name, in_name_len);
-  name[sizeof(name) - 1] = '\0';
-
-  if (cj_load_key(ctx, name) != 0)
+  if (cj_load_key(ctx, (char const *)in_name, (size_t)in_name_len) != 0)
     return CJ_CB_ABORT;
 
   return CJ_CB_CONTINUE;
@@ -327,7 +369,7 @@ static int cj_cb_start_array(void *ctx) {
   db->state[db->depth].in_array = true;
   db->state[db->depth].index = 0;
 
-  cj_load_key(db, "0");
+  cj_load_key(db, "0", 1);
 
   return CJ_CB_CONTINUE;
 }
@@ -360,12 +402,13 @@ static void cj_key_free(cj_key_t *key) /* {{{ */
   sfree(key);
 } /* }}} void cj_key_free */
 
-static void cj_tree_free(c_avl_tree_t *tree) /* {{{ */
+static void cj_tree_free(c_hashtable_t *tree) /* {{{ */
 {
+  size_t pos = 0;
   char *name;
   cj_tree_entry_t *e;
 
-  while (c_avl_pick(tree, (void *)&name, (void *)&e) == 0) {
+  while (c_hashtable_next(tree, &pos, &name, (void *)&e) == 0) {
     sfree(name);
 
     if (e->type == KEY)
@@ -375,7 +418,7 @@ static void cj_tree_free(c_avl_tree_t *tree) /* {{{ */
     sfree(e);
   }
 
-  c_avl_destroy(tree);
+  c_hashtable_destroy(tree);
 } /* }}} void cj_tree_free */
 
 static void cj_free(void *arg) /* {{{ */
@@ -389,14 +432,23 @@ static void cj_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
+  /* Waits for a response callback using this instance to return. */
+  curl_engine_cancel(db->engine, db->curl);
   if (db->curl != NULL)
     curl_easy_cleanup(db->curl);
   db->curl = NULL;
+  curl_engine_release(db->engine);
+
+  if (db->yajl != NULL)
+    yajl_free(db->yajl);
+  db->yajl = NULL;
 
   if (db->tree != NULL)
     cj_tree_free(db->tree);
   db->tree = NULL;
 
+  vl_batch_free(&db->batch);
+
   sfree(db->instance);
   sfree(db->plugin_name);
   sfree(db->host);
@@ -417,10 +469,6 @@ static void cj_free(void *arg) /* {{{ */
 
 /* Configuration handling functions {{{ */
 
-static c_avl_tree_t *cj_avl_create(void) {
-  return c_avl_create((int (*)(const void *, const void *))strcmp);
-}
-
 static int cj_config_append_string(const char *name,
                                    struct curl_slist **dest, /* {{{ */
                                    oconfig_item_t *ci) {
@@ -439,6 +487,23 @@ static int cj_config_append_string(const char *name,
   return 0;
 } /* }}} int cj_config_append_string */
 
+/* cj_tree_insert adds the entry "e" for the map key or array index "name" to
+ * "tree". The hash of the name is computed once, here. */
+static int cj_tree_insert(c_hashtable_t *tree, char const *name,
+                          cj_tree_entry_t *e) {
+  char *key = strdup(name);
+  if (key == NULL)
+    return ENOMEM;
+
+  int status = c_hashtable_insert(tree, cj_hash(key, strlen(key)), key, e);
+  if (status != 0) {
+    sfree(key);
+    return (status > 0) ? EEXIST : ENOMEM;
+  }
+
+  return 0;
+}
+
 /* cj_append_key adds key to the configuration stored in db.
  *
  * For example:
@@ -448,9 +513,11 @@ static int cj_config_append_string(const char *name,
  */
 static int cj_append_key(cj_t *db, cj_key_t *key) { /* {{{ */
   if (db->tree == NULL)
-    db->tree = cj_avl_create();
+    db->tree = c_hashtable_create();
+  if (db->tree == NULL)
+    return ENOMEM;
 
-  c_avl_tree_t *tree = db->tree;
+  c_hashtable_t *tree = db->tree;
 
   char const *start = key->path;
   if (*start == '/')
@@ -468,14 +535,18 @@ static int cj_append_key(cj_t *db, cj_key_t *key) { /* {{{ */
     sstrncpy(name, start, len + 1);
 
     cj_tree_entry_t *e;
-    if (c_avl_get(tree, name, (void *)&e) != 0) {
+    if (c_hashtable_get(tree, cj_hash(name, strlen(name)), name,
+                        (void *)&e) != 0) {
       e = calloc(1, sizeof(*e));
       if (e == NULL)
         return ENOMEM;
       e->type = TREE;
-      e->tree = cj_avl_create();
-
-      c_avl_insert(tree, strdup(name), e);
+      e->tree = c_hashtable_create();
+      if ((e->tree == NULL) || (cj_tree_insert(tree, name, e) != 0)) {
+        c_hashtable_destroy(e->tree);
+        sfree(e);
+        return ENOMEM;
+      }
     }
 
     if (e->type != TREE)
@@ -496,7 +567,14 @@ static int cj_append_key(cj_t *db, cj_key_t *key) { /* {{{ */
   e->type = KEY;
   e->key = key;
 
-  c_avl_insert(tree, strdup(start), e);
+  int status = cj_tree_insert(tree, start, e);
+  if (status != 0) {
+    if (status == EEXIST)
+      ERROR("curl_json plugin: duplicate key: %s", key->path);
+    sfree(e);
+    return status;
+  }
+
   return 0;
 } /* }}} int cj_append_key */
 
@@ -570,12 +648,17 @@ static int cj_config_add_key(cj_t *db, /* {{{ */
 
 static int cj_init_curl(cj_t *db) /* {{{ */
 {
+  db->engine = curl_engine_acquire();
+  if (db->engine == NULL)
+    return -1;
+
   db->curl = curl_easy_init();
   if (db->curl == NULL) {
     ERROR("curl_json plugin: curl_easy_init failed.");
     return -1;
   }
 
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
   curl_easy_setopt(db->curl, CURLOPT_NOSIGNAL, 1L);
   curl_easy_setopt(db->curl, CURLOPT_WRITEFUNCTION, cj_curl_callback);
   curl_easy_setopt(db->curl, CURLOPT_WRITEDATA, db);
@@ -840,7 +923,7 @@ static void cj_submit_impl(cj_t *db, cj_key_t *key, value_t *value) /* {{{ */
   sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
   sstrncpy(vl.type, key->type, sizeof(vl.type));
 
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&db->batch, &vl);
 } /* }}} int cj_submit_impl */
 
 static int cj_sock_perform(cj_t *db) /* {{{ */
@@ -877,41 +960,18 @@ static int cj_sock_perform(cj_t *db) /* {{{ */
   return 0;
 } /* }}} int cj_sock_perform */
 
-static int cj_curl_perform(cj_t *db) /* {{{ */
+/* Prepares the parser for a new document. */
+static int cj_parse_begin(cj_t *db) /* {{{ */
 {
-  int status;
-  long rc;
-  char *url;
-
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
-
-  status = curl_easy_perform(db->curl);
-  if (status != CURLE_OK) {
-    ERROR("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
-          status, db->curl_errbuf, db->url);
-    return -1;
-  }
-  if (db->stats != NULL)
-    curl_stats_dispatch(db->stats, db->curl, cj_host(db), "curl_json",
-                        db->instance);
-
-  curl_easy_getinfo(db->curl, CURLINFO_EFFECTIVE_URL, &url);
-  curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
-
-  /* The response code is zero if a non-HTTP transport was used. */
-  if ((rc != 0) && (rc != 200)) {
-    ERROR("curl_json plugin: curl_easy_perform failed with "
-          "response code %ld (%s)",
-          rc, url);
-    return -1;
-  }
-  return 0;
-} /* }}} int cj_curl_perform */
+  db->depth = 0;
+  memset(&db->state, 0, sizeof(db->state));
 
-static int cj_perform(cj_t *db) /* {{{ */
-{
-  int status;
-  yajl_handle yprev = db->yajl;
+  /* This is not a compound literal because EPEL6's GCC is not cool enough to
+   * handle anonymous unions within compound literals. */
+  memset(&db->root, 0, sizeof(db->root));
+  db->root.type = TREE;
+  db->root.tree = db->tree;
+  db->state[0].entry = &db->root;
 
   db->yajl = yajl_alloc(&ycallbacks,
 #if HAVE_YAJL_V2
@@ -922,41 +982,80 @@ static int cj_perform(cj_t *db) /* {{{ */
                         /* context = */ (void *)db);
   if (db->yajl == NULL) {
     ERROR("curl_json plugin: yajl_alloc failed.");
-    db->yajl = yprev;
+    db->state[0].entry = NULL;
     return -1;
   }
 
-  if (db->url)
-    status = cj_curl_perform(db);
-  else
-    status = cj_sock_perform(db);
-  if (status < 0) {
-    yajl_free(db->yajl);
-    db->yajl = yprev;
-    return -1;
-  }
+  return 0;
+} /* }}} int cj_parse_begin */
 
+/* Frees the parser. If "complete" is true, the end of the document is parsed
+ * first. */
+static int cj_parse_end(cj_t *db, bool complete) /* {{{ */
+{
+  int status = 0;
+
+  if (complete) {
 #if HAVE_YAJL_V2
-  status = yajl_complete_parse(db->yajl);
+    status = yajl_complete_parse(db->yajl);
 #else
-  status = yajl_parse_complete(db->yajl);
+    status = yajl_parse_complete(db->yajl);
 #endif
-  if (status != yajl_status_ok) {
-    unsigned char *errmsg;
-
-    errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
-                            /* jsonText = */ NULL, /* jsonTextLen = */ 0);
-    ERROR("curl_json plugin: yajl_parse_complete failed: %s", (char *)errmsg);
-    yajl_free_error(db->yajl, errmsg);
-    yajl_free(db->yajl);
-    db->yajl = yprev;
-    return -1;
+    if (status != yajl_status_ok) {
+      unsigned char *errmsg;
+
+      errmsg = yajl_get_error(db->yajl, /* verbose = */ 0,
+                              /* jsonText = */ NULL, /* jsonTextLen = */ 0);
+      ERROR("curl_json plugin: yajl_parse_complete failed: %s",
+            (char *)errmsg);
+      yajl_free_error(db->yajl, errmsg);
+      status = -1;
+    } else {
+      status = 0;
+    }
   }
 
   yajl_free(db->yajl);
-  db->yajl = yprev;
-  return 0;
-} /* }}} int cj_perform */
+  db->yajl = NULL;
+  db->state[0].entry = NULL;
+
+  /* Values parsed before an error are reported all the same. */
+  vl_batch_dispatch(&db->batch);
+  return status;
+} /* }}} int cj_parse_end */
+
+/* Called by the curl engine once the document has been fetched. The body has
+ * already been fed to the parser by cj_curl_callback. */
+static void cj_curl_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  cj_t *db = user_data;
+  long rc;
+  char *url;
+
+  if (status != CURLE_OK) {
+    ERROR("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
+          status, db->curl_errbuf, db->url);
+    cj_parse_end(db, /* complete = */ false);
+    return;
+  }
+  if (db->stats != NULL)
+    curl_stats_dispatch(db->stats, curl, cj_host(db), "curl_json",
+                        db->instance);
+
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
+
+  /* The response code is zero if a non-HTTP transport was used. */
+  if ((rc != 0) && (rc != 200)) {
+    ERROR("curl_json plugin: curl_easy_perform failed with "
+          "response code %ld (%s)",
+          rc, url);
+    cj_parse_end(db, /* complete = */ false);
+    return;
+  }
+
+  cj_parse_end(db, /* complete = */ true);
+} /* }}} void cj_curl_done */
 
 static int cj_read(user_data_t *ud) /* {{{ */
 {
@@ -969,21 +1068,34 @@ static int cj_read(user_data_t *ud) /* {{{ */
 
   db = (cj_t *)ud->data;
 
-  db->depth = 0;
-  memset(&db->state, 0, sizeof(db->state));
+  /* The parser state belongs to the transfer in flight. */
+  if ((db->url != NULL) && curl_engine_in_flight(db->engine, db->curl)) {
+    WARNING("curl_json plugin: The previous request for `%s' has not "
+            "completed yet. Skipping this interval.",
+            db->url);
+    return 0;
+  }
 
-  /* This is not a compound literal because EPEL6's GCC is not cool enough to
-   * handle anonymous unions within compound literals. */
-  cj_tree_entry_t root = {0};
-  root.type = TREE;
-  root.tree = db->tree;
-  db->state[0].entry = &root;
+  if (cj_parse_begin(db) != 0)
+    return -1;
 
-  int status = cj_perform(db);
+  /* URLs are fetched by the curl engine and parsed by cj_curl_done. Sockets
+   * are read synchronously. */
+  if (db->url != NULL) {
+    int status = curl_engine_perform(db->engine, db->curl, cj_curl_done, db);
+    if (status != 0) {
+      cj_parse_end(db, /* complete = */ false);
+      return -1;
+    }
+    return 0;
+  }
 
-  db->state[0].entry = NULL;
+  if (cj_sock_perform(db) < 0) {
+    cj_parse_end(db, /* complete = */ false);
+    return -1;
+  }
 
-  return status;
+  return cj_parse_end(db, /* complete = */ true);
 } /* }}} int cj_read */
 
 static int cj_init(void) /* {{{ */
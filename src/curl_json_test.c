@@ -11,6 +11,7 @@
 #include "curl_json.c"
 
 #include "testing.h"
+#include "utils/avltree/avltree.h"
 
 static void test_submit(cj_t *db, cj_key_t *key, value_t *value) {
   /* hack: we repurpose db->curl to store received values. */
@@ -44,7 +45,8 @@ static cj_t *test_setup(char *json, char *key_path) {
                         /* context = */ (void *)db);
 
   /* hack; see above. */
-  db->curl = (void *)cj_avl_create();
+  db->curl =
+      (void *)c_avl_create((int (*)(const void *, const void *))strcmp);
 
   cj_key_t *key = calloc(1, sizeof(*key));
   key->path = strdup(key_path);
@@ -126,6 +128,11 @@ DEF_TEST(parse) {
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/2", 12},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/3", 13},
       {"{\"a\":[[10,11,12,13,14]]}", "a/0/4", 14},
+      /* keys below unconfigured parts of the document are ignored */
+      {"{\"x\":{\"foo\":1},\"foo\":2}", "foo", 2},
+      {"{\"x\":[{\"foo\":1}],\"foo\":2}", "foo", 2},
+      {"{\"foo\":2,\"x\":{\"foo\":{\"foo\":1}}}", "foo", 2},
+      {"[[5,6],7]", "1", 7},
   };
 
   for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
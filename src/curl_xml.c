@@ -23,10 +23,13 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/curl_engine/curl_engine.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils_llist.h"
 
+#include <libxml/SAX2.h>
 #include <libxml/parser.h>
+#include <libxml/pattern.h>
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
@@ -57,6 +60,12 @@ struct cx_xpath_s /* {{{ */
   char *plugin_instance_from;
   int is_table;
   unsigned long magic;
+
+  /* Streaming mode: matches "path" while the document is parsed. */
+  xmlPatternPtr pattern;
+  xmlStreamCtxtPtr stream;
+  const data_set_t *ds;
+  size_t matches_num;
 };
 typedef struct cx_xpath_s cx_xpath_t;
 /* }}} */
@@ -69,6 +78,14 @@ struct cx_namespace_s /* {{{ */
 typedef struct cx_namespace_s cx_namespace_t;
 /* }}} */
 
+struct cx_match_s /* {{{ */
+{
+  xmlNodePtr node;
+  cx_xpath_t *xpath;
+};
+typedef struct cx_match_s cx_match_t;
+/* }}} */
+
 struct cx_s /* {{{ */
 {
   char *instance;
@@ -92,12 +109,24 @@ struct cx_s /* {{{ */
   cx_namespace_t *namespaces;
   size_t namespaces_num;
 
+  curl_engine_t *engine;
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
   char *buffer;
   size_t buffer_size;
   size_t buffer_fill;
 
+  /* In streaming mode, the document is parsed while it is received. Only the
+   * elements matched by an xpath block and their ancestors are kept in memory
+   * and each match is released once it has been dispatched. */
+  bool streaming;
+  xmlParserCtxtPtr parser;
+  xmlXPathContextPtr parser_xpath;
+  bool parser_discard;
+  cx_match_t *matches; /* stack of the matched elements not yet closed */
+  size_t matches_num;
+  size_t matches_size;
+
   llist_t *xpath_list; /* list of xpath blocks */
 };
 typedef struct cx_s cx_t; /* }}} */
@@ -105,6 +134,8 @@ typedef struct cx_s cx_t; /* }}} */
 /*
  * Private functions
  */
+static size_t cx_stream_feed(cx_t *db, const char *buf, size_t len);
+
 static size_t cx_curl_callback(void *buf, /* {{{ */
                                size_t size, size_t nmemb, void *user_data) {
   size_t len = size * nmemb;
@@ -119,6 +150,9 @@ static size_t cx_curl_callback(void *buf, /* {{{ */
   if (len == 0)
     return len;
 
+  if (db->streaming)
+    return cx_stream_feed(db, buf, len);
+
   if ((db->buffer_fill + len) >= db->buffer_size) {
     char *temp = realloc(db->buffer, db->buffer_fill + len + 1);
     if (temp == NULL) {
@@ -147,6 +181,10 @@ static void cx_xpath_free(cx_xpath_t *xpath) /* {{{ */
   sfree(xpath->plugin_instance_from);
   sfree(xpath->instance);
   sfree(xpath->values);
+  if (xpath->stream != NULL)
+    xmlFreeStreamCtxt(xpath->stream);
+  if (xpath->pattern != NULL)
+    xmlFreePattern(xpath->pattern);
   sfree(xpath);
 } /* }}} void cx_xpath_free */
 
@@ -167,6 +205,23 @@ static void cx_xpath_list_free(llist_t *list) /* {{{ */
   llist_destroy(list);
 } /* }}} void cx_xpath_list_free */
 
+/* Releases the state of a streaming parse. */
+static void cx_stream_reset(cx_t *db) /* {{{ */
+{
+  if (db->parser_xpath != NULL) {
+    xmlXPathFreeContext(db->parser_xpath);
+    db->parser_xpath = NULL;
+  }
+  if (db->parser != NULL) {
+    xmlFreeDoc(db->parser->myDoc);
+    db->parser->myDoc = NULL;
+    xmlFreeParserCtxt(db->parser);
+    db->parser = NULL;
+  }
+  db->parser_discard = false;
+  db->matches_num = 0;
+} /* }}} void cx_stream_reset */
+
 static void cx_free(void *arg) /* {{{ */
 {
   cx_t *db;
@@ -178,13 +233,17 @@ static void cx_free(void *arg) /* {{{ */
   if (db == NULL)
     return;
 
+  curl_engine_cancel(db->engine, db->curl);
   if (db->curl != NULL)
     curl_easy_cleanup(db->curl);
   db->curl = NULL;
+  curl_engine_release(db->engine);
 
   if (db->xpath_list != NULL)
     cx_xpath_list_free(db->xpath_list);
 
+  cx_stream_reset(db);
+  sfree(db->matches);
   sfree(db->buffer);
   sfree(db->instance);
   sfree(db->plugin_name);
@@ -421,6 +480,30 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
   return 0;
 } /* }}} int cx_handle_instance_xpath */
 
+/* Dispatches the values of one node matched by the base xpath. */
+static int cx_handle_base_node(const cx_t *db, /* {{{ */
+                               xmlXPathContextPtr xpath_ctx, cx_xpath_t *xpath,
+                               const data_set_t *ds, xmlNodePtr node) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  /* set the values for the value_list */
+  vl.values_len = ds->ds_num;
+  sstrncpy(vl.type, xpath->type, sizeof(vl.type));
+  sstrncpy(vl.plugin, (db->plugin_name != NULL) ? db->plugin_name : "curl_xml",
+           sizeof(vl.plugin));
+  sstrncpy(vl.host, cx_host(db), sizeof(vl.host));
+
+  xpath_ctx->node = node;
+
+  if (db->instance != NULL)
+    sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
+
+  if (cx_handle_instance_xpath(xpath_ctx, xpath, &vl) != 0)
+    return -1; /* An error has already been reported. */
+
+  return cx_handle_all_value_xpaths(xpath_ctx, xpath, ds, &vl);
+} /* }}} int cx_handle_base_node */
+
 static int cx_handle_xpath(const cx_t *db, /* {{{ */
                            xmlXPathContextPtr xpath_ctx, cx_xpath_t *xpath) {
 
@@ -457,27 +540,8 @@ static int cx_handle_xpath(const cx_t *db, /* {{{ */
     return -1;
   }
 
-  value_list_t vl = VALUE_LIST_INIT;
-
-  /* set the values for the value_list */
-  vl.values_len = ds->ds_num;
-  sstrncpy(vl.type, xpath->type, sizeof(vl.type));
-  sstrncpy(vl.plugin, (db->plugin_name != NULL) ? db->plugin_name : "curl_xml",
-           sizeof(vl.plugin));
-  sstrncpy(vl.host, cx_host(db), sizeof(vl.host));
-
-  for (int i = 0; i < total_nodes; i++) {
-    xpath_ctx->node = base_nodes->nodeTab[i];
-
-    if (db->instance != NULL)
-      sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
-
-    if (cx_handle_instance_xpath(xpath_ctx, xpath, &vl) != 0)
-      continue; /* An error has already been reported. */
-
-    if (cx_handle_all_value_xpaths(xpath_ctx, xpath, ds, &vl) != 0)
-      continue; /* An error has been logged. */
-  }             /* for (i = 0; i < total_nodes; i++) */
+  for (int i = 0; i < total_nodes; i++)
+    cx_handle_base_node(db, xpath_ctx, xpath, ds, base_nodes->nodeTab[i]);
 
   /* free up the allocated memory */
   xmlXPathFreeObject(base_node_obj);
@@ -502,20 +566,13 @@ static int cx_handle_parsed_xml(cx_t *db, xmlDocPtr doc, /* {{{ */
   return status;
 } /* }}} cx_handle_parsed_xml */
 
-static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
-{
-  /* Load the XML */
-  xmlDocPtr doc = xmlParseDoc(BAD_CAST xml);
-  if (doc == NULL) {
-    ERROR("curl_xml plugin: Failed to parse the xml document  - %s", xml);
-    return -1;
-  }
-
+/* Returns an XPath context for "doc" knowing the configured namespaces. */
+static xmlXPathContextPtr cx_xpath_context(const cx_t *db, /* {{{ */
+                                           xmlDocPtr doc) {
   xmlXPathContextPtr xpath_ctx = xmlXPathNewContext(doc);
   if (xpath_ctx == NULL) {
     ERROR("curl_xml plugin: Failed to create the xml context");
-    xmlFreeDoc(doc);
-    return -1;
+    return NULL;
   }
 
   for (size_t i = 0; i < db->namespaces_num; i++) {
@@ -527,11 +584,28 @@ static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
             "unable to register NS with prefix=\"%s\" and href=\"%s\"\n",
             ns->prefix, ns->url);
       xmlXPathFreeContext(xpath_ctx);
-      xmlFreeDoc(doc);
-      return status;
+      return NULL;
     }
   }
 
+  return xpath_ctx;
+} /* }}} xmlXPathContextPtr cx_xpath_context */
+
+static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
+{
+  /* Load the XML */
+  xmlDocPtr doc = xmlParseDoc(BAD_CAST xml);
+  if (doc == NULL) {
+    ERROR("curl_xml plugin: Failed to parse the xml document  - %s", xml);
+    return -1;
+  }
+
+  xmlXPathContextPtr xpath_ctx = cx_xpath_context(db, doc);
+  if (xpath_ctx == NULL) {
+    xmlFreeDoc(doc);
+    return -1;
+  }
+
   int status = cx_handle_parsed_xml(db, doc, xpath_ctx);
   /* Cleanup */
   xmlXPathFreeContext(xpath_ctx);
@@ -539,46 +613,301 @@ static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
   return status;
 } /* }}} cx_parse_xml */
 
-static int cx_read(user_data_t *ud) /* {{{ */
+/* Streaming mode {{{
+ *
+ * The base xpath of each block is compiled into a pattern which is matched
+ * against the elements as they are opened. A matched element is completed in
+ * memory, passed to the regular `InstanceFrom' and `ValuesFrom' handling once
+ * it is closed and released afterwards, just like all elements outside of a
+ * match. Relative expressions therefore only see the matched subtree. */
+
+static void cx_stream_handle_match(cx_t *db, cx_xpath_t *xpath, /* {{{ */
+                                   xmlNodePtr node) {
+  xpath->matches_num++;
+
+  /* If base_xpath returned multiple results, then */
+  /* InstanceFrom or PluginInstanceFrom in the xpath block is required */
+  if ((xpath->matches_num > 1) && (xpath->instance == NULL) &&
+      (xpath->plugin_instance_from == NULL)) {
+    if (xpath->matches_num == 2)
+      ERROR("curl_xml plugin: "
+            "InstanceFrom or PluginInstanceFrom is must in xpath block "
+            "since the base xpath expression \"%s\" "
+            "returned multiple results. Skipping further results...",
+            xpath->path);
+    return;
+  }
+
+  if (db->parser_xpath == NULL) {
+    db->parser_xpath = cx_xpath_context(db, node->doc);
+    if (db->parser_xpath == NULL)
+      return;
+  }
+
+  cx_handle_base_node(db, db->parser_xpath, xpath, xpath->ds, node);
+} /* }}} void cx_stream_handle_match */
+
+static void cx_stream_start_element( /* {{{ */
+    void *ctx, const xmlChar *localname, const xmlChar *prefix,
+    const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces,
+    int nb_attributes, int nb_defaulted, const xmlChar **attributes) {
+  xmlParserCtxtPtr parser = ctx;
+  cx_t *db = parser->_private;
+
+  xmlSAX2StartElementNs(ctx, localname, prefix, URI, nb_namespaces, namespaces,
+                        nb_attributes, nb_defaulted, attributes);
+
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+
+    if (xpath->stream == NULL)
+      continue;
+    if (xmlStreamPush(xpath->stream, localname, URI) != 1)
+      continue;
+
+    if (db->matches_num >= db->matches_size) {
+      size_t size = (db->matches_size == 0) ? 8 : 2 * db->matches_size;
+      cx_match_t *tmp = realloc(db->matches, size * sizeof(*db->matches));
+      if (tmp == NULL) {
+        ERROR("curl_xml plugin: realloc failed.");
+        xmlStopParser(parser);
+        return;
+      }
+      db->matches = tmp;
+      db->matches_size = size;
+    }
+
+    db->matches[db->matches_num] = (cx_match_t){
+        .node = parser->node,
+        .xpath = xpath,
+    };
+    db->matches_num++;
+  }
+} /* }}} void cx_stream_start_element */
+
+static void cx_stream_end_element(void *ctx, /* {{{ */
+                                  const xmlChar *localname,
+                                  const xmlChar *prefix, const xmlChar *URI) {
+  xmlParserCtxtPtr parser = ctx;
+  cx_t *db = parser->_private;
+  xmlNodePtr node = parser->node;
+
+  xmlSAX2EndElementNs(ctx, localname, prefix, URI);
+
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+    if (xpath->stream != NULL)
+      xmlStreamPop(xpath->stream);
+  }
+
+  while ((db->matches_num > 0) &&
+         (db->matches[db->matches_num - 1].node == node)) {
+    db->matches_num--;
+    cx_stream_handle_match(db, db->matches[db->matches_num].xpath, node);
+  }
+
+  /* Elements are kept as long as an enclosing match is open. The root element
+   * is released together with the document. */
+  if ((db->matches_num == 0) && (node != NULL) && (node->parent != NULL) &&
+      (node->parent->type == XML_ELEMENT_NODE)) {
+    xmlUnlinkNode(node);
+    xmlFreeNode(node);
+  }
+} /* }}} void cx_stream_end_element */
+
+/* Text outside of a match is never looked at and thus not kept. */
+static void cx_stream_characters(void *ctx, /* {{{ */
+                                 const xmlChar *ch, int len) {
+  xmlParserCtxtPtr parser = ctx;
+  cx_t *db = parser->_private;
+
+  if (db->matches_num > 0)
+    xmlSAX2Characters(ctx, ch, len);
+} /* }}} void cx_stream_characters */
+
+static void cx_stream_cdata(void *ctx, const xmlChar *value, int len) /* {{{ */
 {
-  if ((ud == NULL) || (ud->data == NULL)) {
-    ERROR("curl_xml plugin: cx_read: Invalid user data.");
+  xmlParserCtxtPtr parser = ctx;
+  cx_t *db = parser->_private;
+
+  if (db->matches_num > 0)
+    xmlSAX2CDataBlock(ctx, value, len);
+} /* }}} void cx_stream_cdata */
+
+static int cx_stream_start(cx_t *db) /* {{{ */
+{
+  xmlSAXHandler sax;
+  memset(&sax, 0, sizeof(sax));
+  xmlSAXVersion(&sax, /* version = */ 2);
+  sax.startElementNs = cx_stream_start_element;
+  sax.endElementNs = cx_stream_end_element;
+  sax.characters = cx_stream_characters;
+  sax.ignorableWhitespace = cx_stream_characters;
+  sax.cdataBlock = cx_stream_cdata;
+  sax.comment = NULL;
+  sax.processingInstruction = NULL;
+
+  db->parser = xmlCreatePushParserCtxt(&sax, /* user_data = */ NULL,
+                                       /* chunk = */ NULL, /* size = */ 0,
+                                       db->url);
+  if (db->parser == NULL) {
+    ERROR("curl_xml plugin: xmlCreatePushParserCtxt failed.");
     return -1;
   }
+  db->parser->_private = db;
 
-  long rc;
-  char *url;
-  cx_t *db = (cx_t *)ud->data;
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
 
-  db->buffer_fill = 0;
+    if (xpath->stream != NULL) {
+      xmlFreeStreamCtxt(xpath->stream);
+      xpath->stream = NULL;
+    }
+    xpath->matches_num = 0;
 
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+    xpath->ds = plugin_get_ds(xpath->type);
+    if (cx_check_type(xpath->ds, xpath) != 0)
+      continue;
+
+    xpath->stream = xmlPatternGetStreamCtxt(xpath->pattern);
+    if (xpath->stream == NULL) {
+      ERROR("curl_xml plugin: xmlPatternGetStreamCtxt failed.");
+      continue;
+    }
+    /* Absolute paths start at the document node. */
+    xmlStreamPush(xpath->stream, /* name = */ NULL, /* ns = */ NULL);
+  }
+
+  return 0;
+} /* }}} int cx_stream_start */
+
+static size_t cx_stream_feed(cx_t *db, const char *buf, size_t len) /* {{{ */
+{
+  if (db->parser_discard)
+    return len;
+
+  if (db->parser == NULL) {
+    long rc = 0;
+
+    /* The response code is reported by cx_read_done(). */
+    curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
+    if ((rc != 0) && (rc != 200)) {
+      db->parser_discard = true;
+      return len;
+    }
+
+    if (cx_stream_start(db) != 0)
+      return 0;
+  }
+
+  if ((xmlParseChunk(db->parser, buf, (int)len, /* terminate = */ 0) != 0) ||
+      (db->parser->disableSAX != 0)) {
+    ERROR("curl_xml plugin: Failed to parse the xml document from `%s'.",
+          db->url);
+    return 0;
+  }
+
+  return len;
+} /* }}} size_t cx_stream_feed */
+
+static int cx_stream_finish(cx_t *db) /* {{{ */
+{
+  if (db->parser == NULL) {
+    ERROR("curl_xml plugin: Failed to parse the xml document from `%s': "
+          "No data received.",
+          db->url);
+    return -1;
+  }
+
+  int status = xmlParseChunk(db->parser, NULL, 0, /* terminate = */ 1);
+  if ((status != 0) || !db->parser->wellFormed) {
+    ERROR("curl_xml plugin: Failed to parse the xml document from `%s'.",
+          db->url);
+    cx_stream_reset(db);
+    return -1;
+  }
+
+  status = -1;
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+
+    if (xpath->stream == NULL)
+      continue; /* An error has already been reported. */
+
+    if (xpath->matches_num == 0)
+      ERROR("curl_xml plugin: "
+            "xpath expression \"%s\" doesn't match any of the nodes. "
+            "Skipping the xpath block...",
+            xpath->path);
+    else
+      status = 0; /* we got atleast one success */
+  }
+
+  cx_stream_reset(db);
+  return status;
+} /* }}} int cx_stream_finish */
+
+/* }}} End of streaming mode */
+
+/* Called by the curl engine once the document has been fetched. */
+static void cx_read_done(CURL *curl, CURLcode status, /* {{{ */
+                         void *user_data) {
+  cx_t *db = user_data;
+  long rc;
+  char *url;
 
-  int status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
     ERROR("curl_xml plugin: curl_easy_perform failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
-    return -1;
+    db->buffer_fill = 0;
+    cx_stream_reset(db);
+    return;
   }
   if (db->stats != NULL)
-    curl_stats_dispatch(db->stats, db->curl, cx_host(db), "curl_xml",
+    curl_stats_dispatch(db->stats, curl, cx_host(db), "curl_xml",
                         db->instance);
 
-  curl_easy_getinfo(db->curl, CURLINFO_EFFECTIVE_URL, &url);
-  curl_easy_getinfo(db->curl, CURLINFO_RESPONSE_CODE, &rc);
+  curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
 
   /* The response code is zero if a non-HTTP transport was used. */
   if ((rc != 0) && (rc != 200)) {
     ERROR(
         "curl_xml plugin: curl_easy_perform failed with response code %ld (%s)",
         rc, url);
-    return -1;
+    db->buffer_fill = 0;
+    cx_stream_reset(db);
+    return;
   }
 
-  status = cx_parse_xml(db, db->buffer);
+  if (db->streaming) {
+    cx_stream_finish(db);
+    return;
+  }
+
+  cx_parse_xml(db, db->buffer);
   db->buffer_fill = 0;
+} /* }}} void cx_read_done */
 
-  return status;
+static int cx_read(user_data_t *ud) /* {{{ */
+{
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl_xml plugin: cx_read: Invalid user data.");
+    return -1;
+  }
+
+  cx_t *db = (cx_t *)ud->data;
+
+  /* The document is fetched by the curl engine; cx_read_done parses it. */
+  int status = curl_engine_perform(db->engine, db->curl, cx_read_done, db);
+  if (status == EBUSY) {
+    WARNING("curl_xml plugin: The previous request for `%s' has not "
+            "completed yet. Skipping this interval.",
+            db->url);
+    return 0;
+  }
+
+  return (status == 0) ? 0 : -1;
 } /* }}} int cx_read */
 
 /* Configuration handling functions {{{ */
@@ -721,15 +1050,53 @@ static int cx_config_add_namespace(cx_t *db, /* {{{ */
   return 0;
 } /* }}} int cx_config_add_namespace */
 
+/* Compiles the base xpaths into patterns for the streaming mode. */
+static int cx_config_compile_patterns(cx_t *db) /* {{{ */
+{
+  const xmlChar *namespaces[2 * db->namespaces_num + 2];
+
+  for (size_t i = 0; i < db->namespaces_num; i++) {
+    namespaces[2 * i] = BAD_CAST db->namespaces[i].url;
+    namespaces[2 * i + 1] = BAD_CAST db->namespaces[i].prefix;
+  }
+  namespaces[2 * db->namespaces_num] = NULL;
+  namespaces[2 * db->namespaces_num + 1] = NULL;
+
+  for (llentry_t *le = llist_head(db->xpath_list); le != NULL; le = le->next) {
+    cx_xpath_t *xpath = le->value;
+
+    /* Attributes are not matched while streaming. */
+    if (strchr(xpath->path, '@') == NULL)
+      xpath->pattern =
+          xmlPatterncompile(BAD_CAST xpath->path, /* dict = */ NULL,
+                            XML_PATTERN_XPATH, namespaces);
+    if ((xpath->pattern == NULL) ||
+        (xmlPatternStreamable(xpath->pattern) != 1)) {
+      ERROR("curl_xml plugin: The xpath expression \"%s\" cannot be used with "
+            "`Streaming'. Only location paths selecting elements and without "
+            "predicates are supported.",
+            xpath->path);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int cx_config_compile_patterns */
+
 /* Initialize db->curl */
 static int cx_init_curl(cx_t *db) /* {{{ */
 {
+  db->engine = curl_engine_acquire();
+  if (db->engine == NULL)
+    return -1;
+
   db->curl = curl_easy_init();
   if (db->curl == NULL) {
     ERROR("curl_xml plugin: curl_easy_init failed.");
     return -1;
   }
 
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
   curl_easy_setopt(db->curl, CURLOPT_NOSIGNAL, 1L);
   curl_easy_setopt(db->curl, CURLOPT_WRITEFUNCTION, cx_curl_callback);
   curl_easy_setopt(db->curl, CURLOPT_WRITEDATA, db);
@@ -862,6 +1229,8 @@ static int cx_config_add_url(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_cdtime(child, &interval);
     else if (strcasecmp("Timeout", child->key) == 0)
       status = cf_util_get_int(child, &db->timeout);
+    else if (strcasecmp("Streaming", child->key) == 0)
+      status = cf_util_get_boolean(child, &db->streaming);
     else if (strcasecmp("Statistics", child->key) == 0) {
       db->stats = curl_stats_from_config(child);
       if (db->stats == NULL)
@@ -912,6 +1281,11 @@ static int cx_config_add_url(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (db->streaming && (cx_config_compile_patterns(db) != 0)) {
+    cx_free(db);
+    return -1;
+  }
+
   if (cx_init_curl(db) != 0) {
     cx_free(db);
     return -1;
@@ -25,17 +25,22 @@
 #define CMD_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct cmdline_config {
   bool test_config;
   bool test_readall;
+  size_t bench_iterations;
+  bool bench_write;
+  bool bench_json;
   bool create_basedir;
   const char *configfile;
   bool daemonize;
 };
 
 void stop_collectd(void);
+void reload_collectd(void);
 struct cmdline_config init_config(int argc, char **argv);
-int run_loop(bool test_readall);
+int run_loop(struct cmdline_config const *config);
 
 #endif /* CMD_H */
@@ -60,6 +60,11 @@
 #endif
 
 static int loop;
+static int reload;
+
+/* Absolute path of the configuration file, for reloading it after the
+ * working directory has been changed. */
+static char *configfile;
 
 static int init_hostname(void) {
   const char *str = global_option_get("Hostname");
@@ -212,6 +217,10 @@ __attribute__((noreturn)) static void exit_usage(int status) {
          "                    Default: " CONFIGFILE "\n"
          "    -t              Test config and exit.\n"
          "    -T              Test plugin read and exit.\n"
+         "    -b <num>        Benchmark plugins: call every read callback\n"
+         "                    <num> times, print statistics and exit.\n"
+         "    -w              With -b: also benchmark the write callbacks.\n"
+         "    -j              With -b: print the statistics as JSON.\n"
          "    -P <file>       PID-file.\n"
          "                    Default: " PIDFILE "\n"
 #if COLLECT_DAEMON
@@ -265,11 +274,23 @@ static int do_init(void) {
   return plugin_init_all();
 } /* int do_init () */
 
+static void do_reload(void) {
+  reload = 0;
+
+  INFO("Reloading the configuration from %s.", configfile);
+  if (cf_reload(configfile) != 0)
+    ERROR("Reloading the configuration failed, some changes may not have "
+          "been applied.");
+} /* void do_reload */
+
 static int do_loop(void) {
   cdtime_t interval = cf_get_default_interval();
   cdtime_t wait_until = cdtime() + interval;
 
   while (loop == 0) {
+    if (reload != 0)
+      do_reload();
+
 #if HAVE_LIBKSTAT
     update_kstat();
 #endif
@@ -294,6 +315,8 @@ static int do_loop(void) {
         ERROR("nanosleep failed: %s", STRERRNO);
         return -1;
       }
+      if (reload != 0)
+        do_reload();
     }
   } /* while (loop == 0) */
 
@@ -307,7 +330,7 @@ static int do_shutdown(void) {
 static void read_cmdline(int argc, char **argv, struct cmdline_config *config) {
   /* read options */
   while (1) {
-    int c = getopt(argc, argv, "BhtTfC:P:");
+    int c = getopt(argc, argv, "BhtTfjwb:C:P:");
     if (c == -1)
       break;
 
@@ -328,6 +351,28 @@ static void read_cmdline(int argc, char **argv, struct cmdline_config *config) {
       config->daemonize = false;
 #endif /* COLLECT_DAEMON */
       break;
+    case 'b': {
+      char *endptr = NULL;
+      errno = 0;
+      unsigned long num = strtoul(optarg, &endptr, 10);
+      if ((errno != 0) || (endptr == optarg) || (*endptr != 0) || (num == 0)) {
+        fprintf(stderr, "Invalid number of iterations: %s\n", optarg);
+        exit_usage(EXIT_FAILURE);
+      }
+      config->bench_iterations = (size_t)num;
+      /* Read callbacks are called from the main thread only. */
+      global_option_set("ReadThreads", "-1", 1);
+#if COLLECT_DAEMON
+      config->daemonize = false;
+#endif /* COLLECT_DAEMON */
+      break;
+    }
+    case 'w':
+      config->bench_write = true;
+      break;
+    case 'j':
+      config->bench_json = true;
+      break;
     case 'P':
 #if COLLECT_DAEMON
       global_option_set("PIDFile", optarg, 1);
@@ -386,6 +431,8 @@ static int configure_collectd(struct cmdline_config *config) {
 
 void stop_collectd(void) { loop++; }
 
+void reload_collectd(void) { reload++; }
+
 struct cmdline_config init_config(int argc, char **argv) {
   struct cmdline_config config = {
       .daemonize = true,
@@ -400,6 +447,12 @@ struct cmdline_config init_config(int argc, char **argv) {
 
   plugin_init_ctx();
 
+#ifndef WIN32
+  configfile = realpath(config.configfile, NULL);
+#endif
+  if (configfile == NULL)
+    configfile = sstrdup(config.configfile);
+
   if (configure_collectd(&config) != 0)
     exit(EXIT_FAILURE);
 
@@ -409,7 +462,7 @@ struct cmdline_config init_config(int argc, char **argv) {
   return config;
 }
 
-int run_loop(bool test_readall) {
+int run_loop(struct cmdline_config const *config) {
   int exit_status = 0;
 
   if (do_init() != 0) {
@@ -417,7 +470,21 @@ int run_loop(bool test_readall) {
     exit_status = 1;
   }
 
-  if (test_readall) {
+  if (config->bench_iterations > 0) {
+    plugin_bench_options_t opts = {
+        .iterations = config->bench_iterations,
+        .write = config->bench_write,
+        .json = config->bench_json,
+    };
+    int status = plugin_bench_all(&opts, stdout);
+    if (status > 0) {
+      ERROR("Error: benchmarking the plugins failed: %s", STRERROR(status));
+      exit_status = 1;
+    } else if (status != 0) {
+      ERROR("Error: one or more plugin callbacks failed.");
+      exit_status = 1;
+    }
+  } else if (config->test_readall) {
     if (plugin_read_all_once() != 0) {
       ERROR("Error: one or more plugin read callbacks failed.");
       exit_status = 1;
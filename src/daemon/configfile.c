@@ -34,6 +34,7 @@
 #include "plugin.h"
 #include "types_list.h"
 #include "utils/common/common.h"
+#include "utils_downsample.h"
 
 #if HAVE_WORDEXP_H
 #include <wordexp.h>
@@ -85,6 +86,7 @@ typedef struct cf_global_option_s {
  */
 static int dispatch_value_typesdb(oconfig_item_t *ci);
 static int dispatch_value_plugindir(oconfig_item_t *ci);
+static int dispatch_value_threads_cpus(oconfig_item_t *ci);
 static int dispatch_loadplugin(oconfig_item_t *ci);
 static int dispatch_block_plugin(oconfig_item_t *ci);
 
@@ -94,10 +96,13 @@ static int dispatch_block_plugin(oconfig_item_t *ci);
 static cf_callback_t *first_callback;
 static cf_complex_callback_t *complex_callback_head;
 
-static cf_value_map_t cf_value_map[] = {{"TypesDB", dispatch_value_typesdb},
-                                        {"PluginDir", dispatch_value_plugindir},
-                                        {"LoadPlugin", dispatch_loadplugin},
-                                        {"Plugin", dispatch_block_plugin}};
+static cf_value_map_t cf_value_map[] = {
+    {"TypesDB", dispatch_value_typesdb},
+    {"PluginDir", dispatch_value_plugindir},
+    {"ReadThreadsCPUs", dispatch_value_threads_cpus},
+    {"WriteThreadsCPUs", dispatch_value_threads_cpus},
+    {"LoadPlugin", dispatch_loadplugin},
+    {"Plugin", dispatch_block_plugin}};
 static int cf_value_map_num = STATIC_ARRAY_SIZE(cf_value_map);
 
 static cf_global_option_t cf_global_options[] = {
@@ -107,19 +112,38 @@ static cf_global_option_t cf_global_options[] = {
     {"FQDNLookup", NULL, 0, "true"},
     {"Interval", NULL, 0, NULL},
     {"ReadThreads", NULL, 0, "5"},
+    {"ReadThreadsMax", NULL, 0, NULL},
+    {"InitThreads", NULL, 0, "1"},
     {"WriteThreads", NULL, 0, "5"},
+    {"WriteThreadsMax", NULL, 0, NULL},
+    {"ThreadIdleTimeout", NULL, 0, "60"},
+    {"CallbackTimeout", NULL, 0, "0"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
     {"Timeout", NULL, 0, "2"},
+    {"CompressHistory", NULL, 0, "false"},
+    {"CacheFile", NULL, 0, NULL},
+    {"CacheFileInterval", NULL, 0, "0"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
-    {"MaxReadInterval", NULL, 0, "86400"}};
+    {"MaxReadInterval", NULL, 0, "86400"},
+    {"SpreadReads", NULL, 0, "false"},
+    {"LogQueueLength", NULL, 0, "0"},
+    {"NotificationQueueLength", NULL, 0, "0"},
+    {"NotificationThreads", NULL, 0, "1"},
+    {"CacheEventQueueLength", NULL, 0, "0"},
+    {"FlushThreads", NULL, 0, "0"},
+    {"ConfigCache", NULL, 0, NULL}};
 static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
 
+/* The configuration read by cf_read(), compared against the new one by
+ * cf_reload(). */
+static oconfig_item_t *cf_config;
+
 /*
  * Functions to handle register/unregister, search, and other plugin related
  * stuff
@@ -268,6 +292,19 @@ static int dispatch_value_plugindir(oconfig_item_t *ci) {
   return 0;
 }
 
+static int dispatch_value_threads_cpus(oconfig_item_t *ci) {
+  plugin_cpus_t cpus = {0};
+  int status = plugin_cpus_parse(ci, &cpus);
+  if (status != 0)
+    return status;
+
+  if (strcasecmp("ReadThreadsCPUs", ci->key) == 0)
+    plugin_set_read_threads_cpus(cpus);
+  else
+    plugin_set_write_threads_cpus(cpus);
+  return 0;
+} /* int dispatch_value_threads_cpus */
+
 static int dispatch_loadplugin(oconfig_item_t *ci) {
   bool global = false;
 
@@ -302,7 +339,86 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
-    else {
+    else if (strcasecmp("WriteQueueLimit", child->key) == 0) {
+      int limit = 0;
+      if ((cf_util_get_int(child, &limit) == 0) && (limit >= 0))
+        ctx.write_queue_limit = (long)limit;
+      else
+        ERROR("configfile: WriteQueueLimit must be positive or zero.");
+    } else if (strcasecmp("WriteQueueThreads", child->key) == 0) {
+      cf_util_get_int(child, &ctx.write_queue_threads);
+    } else if (strcasecmp("WriteQueueDropPolicy", child->key) == 0) {
+      char policy[16];
+      if (cf_util_get_string_buffer(child, policy, sizeof(policy)) != 0)
+        continue;
+
+      if (strcasecmp("Oldest", policy) == 0)
+        ctx.write_queue_drop_oldest = true;
+      else if (strcasecmp("Newest", policy) == 0)
+        ctx.write_queue_drop_oldest = false;
+      else
+        ERROR("configfile: Invalid WriteQueueDropPolicy \"%s\". Valid "
+              "policies are \"Oldest\" and \"Newest\".",
+              policy);
+    } else if (strcasecmp("WriteQueueSpool", child->key) == 0) {
+      cf_util_get_string(child, &ctx.write_queue_spool);
+    } else if (strcasecmp("WriteQueueSpoolSize", child->key) == 0) {
+      int size = 0;
+      if ((cf_util_get_int(child, &size) == 0) && (size > 0))
+        ctx.write_queue_spool_size = (uint64_t)size * 1024 * 1024;
+      else
+        ERROR("configfile: WriteQueueSpoolSize must be positive.");
+    } else if (strcasecmp("WriteQueueReplayRate", child->key) == 0) {
+      double rate = 0;
+      if ((cf_util_get_double(child, &rate) == 0) && (rate >= 0))
+        ctx.write_queue_replay_rate = rate;
+      else
+        ERROR("configfile: WriteQueueReplayRate must be positive or zero.");
+    } else if (strcasecmp("DownsampleInterval", child->key) == 0) {
+      cf_util_get_cdtime(child, &ctx.downsample_interval);
+    } else if (strcasecmp("DownsampleFunction", child->key) == 0) {
+      char function[16];
+      if (cf_util_get_string_buffer(child, function, sizeof(function)) != 0)
+        continue;
+
+      if (strcasecmp("Average", function) == 0)
+        ctx.downsample_function = DOWNSAMPLE_AVERAGE;
+      else if (strcasecmp("Minimum", function) == 0)
+        ctx.downsample_function = DOWNSAMPLE_MINIMUM;
+      else if (strcasecmp("Maximum", function) == 0)
+        ctx.downsample_function = DOWNSAMPLE_MAXIMUM;
+      else if (strcasecmp("Last", function) == 0)
+        ctx.downsample_function = DOWNSAMPLE_LAST;
+      else
+        ERROR("configfile: Invalid DownsampleFunction \"%s\". Valid "
+              "functions are \"Average\", \"Minimum\", \"Maximum\" and "
+              "\"Last\".",
+              function);
+    } else if (strcasecmp("SuppressUnchanged", child->key) == 0) {
+      cf_util_get_boolean(child, &ctx.suppress_unchanged);
+    } else if (strcasecmp("SuppressUnchangedHeartbeat", child->key) == 0) {
+      cf_util_get_cdtime(child, &ctx.suppress_unchanged_heartbeat);
+    } else if (strcasecmp("ThreadsCPUs", child->key) == 0) {
+      plugin_cpus_parse(child, &ctx.threads_cpus);
+    } else if (strcasecmp("DispatchPriority", child->key) == 0) {
+      char priority[16];
+      if (cf_util_get_string_buffer(child, priority, sizeof(priority)) != 0)
+        continue;
+
+      if (strcasecmp("Low", priority) == 0)
+        ctx.dispatch_priority = PLUGIN_PRIORITY_LOW;
+      else if (strcasecmp("Normal", priority) == 0)
+        ctx.dispatch_priority = PLUGIN_PRIORITY_NORMAL;
+      else if (strcasecmp("High", priority) == 0)
+        ctx.dispatch_priority = PLUGIN_PRIORITY_HIGH;
+      else if (strcasecmp("Critical", priority) == 0)
+        ctx.dispatch_priority = PLUGIN_PRIORITY_CRITICAL;
+      else
+        ERROR("configfile: Invalid DispatchPriority \"%s\". Valid "
+              "priorities are \"Low\", \"Normal\", \"High\" and "
+              "\"Critical\".",
+              priority);
+    } else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
               child->key, name);
@@ -543,6 +659,530 @@ static int cf_ci_append_children(oconfig_item_t *dst, oconfig_item_t *src) {
 static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
                                        int depth);
 
+/*
+ * Parallel parsing
+ */
+/* Upper limit for the number of threads used by cf_parallel_for(). */
+#define CF_PARALLEL_THREADS_MAX 8
+
+typedef struct {
+  void (*func)(size_t, void *);
+  void *arg;
+  size_t num;
+  size_t next;
+  pthread_mutex_t lock;
+} cf_parallel_t;
+
+static void *cf_parallel_worker(void *arg) {
+  cf_parallel_t *p = arg;
+
+  while (42) {
+    pthread_mutex_lock(&p->lock);
+    size_t i = p->next;
+    if (i < p->num)
+      p->next++;
+    pthread_mutex_unlock(&p->lock);
+
+    if (i >= p->num)
+      break;
+    p->func(i, p->arg);
+  }
+
+  return NULL;
+} /* void *cf_parallel_worker */
+
+void cf_parallel_for(size_t num, void (*func)(size_t, void *), void *arg) {
+  cf_parallel_t p = {
+      .func = func,
+      .arg = arg,
+      .num = num,
+      .next = 0,
+  };
+  pthread_t threads[CF_PARALLEL_THREADS_MAX - 1];
+  size_t threads_num = 0;
+
+  size_t threads_max = CF_PARALLEL_THREADS_MAX;
+#ifdef _SC_NPROCESSORS_ONLN
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((cpus > 0) && ((size_t)cpus < threads_max))
+    threads_max = (size_t)cpus;
+#endif
+  if (threads_max > num)
+    threads_max = num;
+
+  pthread_mutex_init(&p.lock, NULL);
+
+  /* The calling thread is one of the workers. */
+  for (size_t i = 1; i < threads_max; i++) {
+    if (pthread_create(threads + threads_num, NULL, cf_parallel_worker, &p) !=
+        0)
+      break;
+    threads_num++;
+  }
+
+  cf_parallel_worker(&p);
+
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&p.lock);
+} /* void cf_parallel_for */
+
+/*
+ * Config cache
+ *
+ * With "ConfigCache", the parsed trees of included files are stored in a
+ * file, so that unchanged files do not have to be parsed again on the next
+ * start. A file is parsed again if its size, modification time or content
+ * changed. The cache is written once all files have been read if any of them
+ * was parsed or the set of files changed.
+ *
+ * The file starts with CF_CACHE_MAGIC, followed by one record per file: the
+ * length of the file name as uint32_t, the file name, size, mtime and FNV-1a
+ * hash of the content as uint64_t, the length of the serialized tree as
+ * uint64_t and the tree as returned by oconfig_serialize().
+ */
+#define CF_CACHE_MAGIC "collectd config cache 1\n"
+
+typedef struct {
+  char *file;
+  uint64_t size;
+  uint64_t mtime;
+  uint64_t hash;
+  char *data;
+  size_t data_len;
+  bool data_owned;
+} cf_cache_entry_t;
+
+typedef struct {
+  cf_cache_entry_t *entries;
+  size_t entries_num;
+  size_t entries_size;
+} cf_cache_list_t;
+
+static struct {
+  char *path;
+  /* Contents of the cache file; the loaded entries point into it. */
+  char *buffer;
+  /* Entries of the cache file, sorted by file name. Not modified while
+   * files are parsed, so it is read without holding the lock. */
+  cf_cache_list_t loaded;
+  /* Entries of the files read by this run. */
+  cf_cache_list_t used;
+  bool dirty;
+  pthread_mutex_t lock;
+} cf_cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int cf_cache_compare(const void *a, const void *b) {
+  return strcmp(((const cf_cache_entry_t *)a)->file,
+                ((const cf_cache_entry_t *)b)->file);
+}
+
+static int cf_cache_append(cf_cache_list_t *l, cf_cache_entry_t const *e) {
+  if (l->entries_num >= l->entries_size) {
+    size_t size = (l->entries_size == 0) ? 64 : 2 * l->entries_size;
+    cf_cache_entry_t *tmp = realloc(l->entries, size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    l->entries = tmp;
+    l->entries_size = size;
+  }
+
+  l->entries[l->entries_num] = *e;
+  l->entries_num++;
+  return 0;
+} /* int cf_cache_append */
+
+static void cf_cache_list_free(cf_cache_list_t *l, bool entries_owned) {
+  for (size_t i = 0; entries_owned && (i < l->entries_num); i++) {
+    sfree(l->entries[i].file);
+    if (l->entries[i].data_owned)
+      sfree(l->entries[i].data);
+  }
+  sfree(l->entries);
+  l->entries_num = 0;
+  l->entries_size = 0;
+} /* void cf_cache_list_free */
+
+static int cf_cache_read(char const **pos, char const *end, void *data,
+                         size_t len) {
+  if ((size_t)(end - *pos) < len)
+    return -1;
+  memcpy(data, *pos, len);
+  *pos += len;
+  return 0;
+} /* int cf_cache_read */
+
+/* Reads the cache file into cf_cache.loaded. A missing or invalid file is
+ * treated like an empty one. */
+static void cf_cache_load(void) {
+  FILE *fh = fopen(cf_cache.path, "r");
+  if (fh == NULL) {
+    if (errno != ENOENT)
+      WARNING("configfile: Opening the config cache `%s' failed: %s",
+              cf_cache.path, STRERRNO);
+    return;
+  }
+
+  struct stat statbuf;
+  if ((fstat(fileno(fh), &statbuf) != 0) || (statbuf.st_size <= 0)) {
+    fclose(fh);
+    return;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  cf_cache.buffer = malloc(size);
+  if ((cf_cache.buffer == NULL) ||
+      (fread(cf_cache.buffer, 1, size, fh) != size)) {
+    WARNING("configfile: Reading the config cache `%s' failed.",
+            cf_cache.path);
+    sfree(cf_cache.buffer);
+    fclose(fh);
+    return;
+  }
+  fclose(fh);
+
+  char const *pos = cf_cache.buffer;
+  char const *end = cf_cache.buffer + size;
+  if ((size < strlen(CF_CACHE_MAGIC)) ||
+      (memcmp(pos, CF_CACHE_MAGIC, strlen(CF_CACHE_MAGIC)) != 0)) {
+    WARNING("configfile: Ignoring the config cache `%s', which has an "
+            "unknown format.",
+            cf_cache.path);
+    return;
+  }
+  pos += strlen(CF_CACHE_MAGIC);
+
+  while (pos < end) {
+    cf_cache_entry_t e = {0};
+    uint32_t file_len;
+    uint64_t data_len;
+
+    if ((cf_cache_read(&pos, end, &file_len, sizeof(file_len)) != 0) ||
+        ((size_t)(end - pos) < file_len))
+      break;
+    char const *file = pos;
+    pos += file_len;
+
+    if ((cf_cache_read(&pos, end, &e.size, sizeof(e.size)) != 0) ||
+        (cf_cache_read(&pos, end, &e.mtime, sizeof(e.mtime)) != 0) ||
+        (cf_cache_read(&pos, end, &e.hash, sizeof(e.hash)) != 0) ||
+        (cf_cache_read(&pos, end, &data_len, sizeof(data_len)) != 0) ||
+        ((uint64_t)(end - pos) < data_len))
+      break;
+    e.data = (char *)pos;
+    e.data_len = (size_t)data_len;
+    pos += data_len;
+
+    e.file = malloc(file_len + 1);
+    if (e.file == NULL)
+      break;
+    memcpy(e.file, file, file_len);
+    e.file[file_len] = 0;
+
+    if (cf_cache_append(&cf_cache.loaded, &e) != 0) {
+      sfree(e.file);
+      break;
+    }
+  }
+
+  if (pos != end)
+    WARNING("configfile: The config cache `%s' is truncated.", cf_cache.path);
+
+  qsort(cf_cache.loaded.entries, cf_cache.loaded.entries_num,
+        sizeof(*cf_cache.loaded.entries), cf_cache_compare);
+} /* void cf_cache_load */
+
+/* Enables the cache if the "ConfigCache" option is among the children of
+ * `root'. Only the first occurrence is used. */
+static void cf_cache_configure(oconfig_item_t const *root) {
+  for (int i = 0; (i < root->children_num) && (cf_cache.path == NULL); i++) {
+    oconfig_item_t const *ci = root->children + i;
+    if (strcasecmp("ConfigCache", ci->key) != 0)
+      continue;
+
+    if ((ci->values_num != 1) ||
+        (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+      ERROR("configfile: `ConfigCache' needs exactly one string argument.");
+      continue;
+    }
+
+    cf_cache.path = sstrdup(ci->values[0].value.string);
+    if (cf_cache.path != NULL)
+      cf_cache_load();
+  }
+} /* void cf_cache_configure */
+
+static int cf_cache_write_file(FILE *fh) {
+  if (fwrite(CF_CACHE_MAGIC, 1, strlen(CF_CACHE_MAGIC), fh) !=
+      strlen(CF_CACHE_MAGIC))
+    return -1;
+
+  for (size_t i = 0; i < cf_cache.used.entries_num; i++) {
+    cf_cache_entry_t const *e = cf_cache.used.entries + i;
+    uint32_t file_len = (uint32_t)strlen(e->file);
+    uint64_t data_len = (uint64_t)e->data_len;
+
+    if ((fwrite(&file_len, sizeof(file_len), 1, fh) != 1) ||
+        (fwrite(e->file, 1, file_len, fh) != file_len) ||
+        (fwrite(&e->size, sizeof(e->size), 1, fh) != 1) ||
+        (fwrite(&e->mtime, sizeof(e->mtime), 1, fh) != 1) ||
+        (fwrite(&e->hash, sizeof(e->hash), 1, fh) != 1) ||
+        (fwrite(&data_len, sizeof(data_len), 1, fh) != 1) ||
+        (fwrite(e->data, 1, e->data_len, fh) != e->data_len))
+      return -1;
+  }
+
+  return 0;
+} /* int cf_cache_write_file */
+
+/* Replaces the cache file atomically, so a concurrently starting daemon never
+ * sees a partially written cache. */
+static void cf_cache_write(void) {
+  char tmp[PATH_MAX];
+  if (ssnprintf(tmp, sizeof(tmp), "%s.%d", cf_cache.path, (int)getpid()) >=
+      (int)sizeof(tmp)) {
+    WARNING("configfile: The config cache path is too long.");
+    return;
+  }
+
+  FILE *fh = fopen(tmp, "w");
+  if (fh == NULL) {
+    WARNING("configfile: Creating the config cache `%s' failed: %s", tmp,
+            STRERRNO);
+    return;
+  }
+
+  int status = cf_cache_write_file(fh);
+  if (fclose(fh) != 0)
+    status = -1;
+
+  if ((status != 0) || (rename(tmp, cf_cache.path) != 0)) {
+    WARNING("configfile: Writing the config cache `%s' failed: %s",
+            cf_cache.path, STRERRNO);
+    unlink(tmp);
+  }
+} /* void cf_cache_write */
+
+/* Writes the cache if necessary and disables it. */
+static void cf_cache_close(void) {
+  if (cf_cache.path == NULL)
+    return;
+
+  if (cf_cache.dirty ||
+      (cf_cache.used.entries_num != cf_cache.loaded.entries_num))
+    cf_cache_write();
+
+  /* The used entries share file names and data with the loaded ones or own
+   * them, see cf_parse_file(). */
+  for (size_t i = 0; i < cf_cache.used.entries_num; i++) {
+    cf_cache_entry_t *e = cf_cache.used.entries + i;
+    if (e->data_owned) {
+      sfree(e->file);
+      sfree(e->data);
+    }
+  }
+  cf_cache_list_free(&cf_cache.used, /* entries_owned = */ false);
+  cf_cache_list_free(&cf_cache.loaded, /* entries_owned = */ true);
+  sfree(cf_cache.buffer);
+  sfree(cf_cache.path);
+  cf_cache.dirty = false;
+} /* void cf_cache_close */
+
+/* FNV-1a. Blocks are chained by passing the hash of the previous ones as
+ * `hash'. */
+static uint64_t cf_cache_hash(uint64_t hash, char const *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint64_t)(unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* uint64_t cf_cache_hash */
+
+/* Reads `file' and computes the key its cache entry has to match. */
+static int cf_cache_key(char const *file, cf_cache_entry_t *key) {
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL)
+    return errno;
+
+  struct stat statbuf;
+  if (fstat(fileno(fh), &statbuf) != 0) {
+    int status = errno;
+    fclose(fh);
+    return status;
+  }
+
+  key->size = (uint64_t)statbuf.st_size;
+  key->mtime = (uint64_t)statbuf.st_mtime;
+  key->hash = 14695981039346656037ULL;
+
+  char buffer[4096];
+  uint64_t size = 0;
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), fh)) > 0) {
+    key->hash = cf_cache_hash(key->hash, buffer, len);
+    size += len;
+  }
+  fclose(fh);
+
+  /* The file changed while it was read. */
+  if (size != key->size)
+    return EAGAIN;
+  return 0;
+} /* int cf_cache_key */
+
+/* Parses `file', using the cache if it is enabled. Called concurrently by
+ * cf_prefetch() threads. */
+static oconfig_item_t *cf_parse_file(char const *file) {
+  if (cf_cache.path == NULL)
+    return oconfig_parse_file(file);
+
+  cf_cache_entry_t key = {.file = (char *)file};
+  if (cf_cache_key(file, &key) != 0)
+    return oconfig_parse_file(file);
+
+  cf_cache_entry_t *e =
+      bsearch(&key, cf_cache.loaded.entries, cf_cache.loaded.entries_num,
+              sizeof(*cf_cache.loaded.entries), cf_cache_compare);
+  if ((e != NULL) && (e->size == key.size) && (e->mtime == key.mtime) &&
+      (e->hash == key.hash)) {
+    oconfig_item_t *root = oconfig_deserialize(e->data, e->data_len);
+    if (root != NULL) {
+      pthread_mutex_lock(&cf_cache.lock);
+      if (cf_cache_append(&cf_cache.used, e) != 0)
+        cf_cache.dirty = true;
+      pthread_mutex_unlock(&cf_cache.lock);
+      return root;
+    }
+  }
+
+  oconfig_item_t *root = oconfig_parse_file(file);
+  if (root == NULL)
+    return NULL;
+
+  key.data_len = oconfig_serialize(root, &key.data);
+  key.data_owned = true;
+  key.file = strdup(file);
+
+  pthread_mutex_lock(&cf_cache.lock);
+  cf_cache.dirty = true;
+  if ((key.data_len == 0) || (key.file == NULL) ||
+      (cf_cache_append(&cf_cache.used, &key) != 0)) {
+    sfree(key.file);
+    sfree(key.data);
+  }
+  pthread_mutex_unlock(&cf_cache.lock);
+
+  return root;
+} /* oconfig_item_t *cf_parse_file */
+
+/*
+ * Prefetching
+ *
+ * Before the files of a directory or a wildcard are read one by one, they
+ * are parsed in parallel. cf_read_file() then takes the parsed trees from the
+ * innermost prefetch that has them instead of parsing the files itself.
+ */
+typedef struct cf_prefetch_s {
+  char **files;
+  oconfig_item_t **roots;
+  bool *parsed;
+  size_t num;
+  /* The files are usually taken in order. */
+  size_t next;
+  char const *pattern;
+  struct cf_prefetch_s *prev;
+} cf_prefetch_t;
+
+static cf_prefetch_t *cf_prefetch_top;
+
+static void cf_prefetch_one(size_t i, void *arg) {
+  cf_prefetch_t *p = arg;
+  char const *file = p->files[i];
+
+  struct stat statbuf;
+  if ((stat(file, &statbuf) != 0) || !S_ISREG(statbuf.st_mode))
+    return;
+
+#if HAVE_FNMATCH_H && HAVE_LIBGEN_H
+  if (p->pattern != NULL) {
+    char *tmp = strdup(file);
+    char *filename = (tmp != NULL) ? basename(tmp) : NULL;
+    int status = (filename != NULL) ? fnmatch(p->pattern, filename, 0) : 0;
+    free(tmp);
+    if (status != 0)
+      return;
+  }
+#endif
+
+  p->roots[i] = cf_parse_file(file);
+  p->parsed[i] = true;
+} /* void cf_prefetch_one */
+
+/* Parses the regular files among `files' in parallel and makes the results
+ * available to cf_read_file() until cf_prefetch_end() is called. */
+static void cf_prefetch_begin(cf_prefetch_t *p, char **files, size_t num,
+                              char const *pattern) {
+  *p = (cf_prefetch_t){
+      .files = files,
+      .pattern = pattern,
+  };
+
+  if (num < 2)
+    return;
+
+  p->roots = calloc(num, sizeof(*p->roots));
+  p->parsed = calloc(num, sizeof(*p->parsed));
+  if ((p->roots == NULL) || (p->parsed == NULL)) {
+    sfree(p->roots);
+    sfree(p->parsed);
+    return;
+  }
+  p->num = num;
+
+  cf_parallel_for(num, cf_prefetch_one, p);
+
+  p->prev = cf_prefetch_top;
+  cf_prefetch_top = p;
+} /* void cf_prefetch_begin */
+
+static void cf_prefetch_end(cf_prefetch_t *p) {
+  if (p->num == 0)
+    return;
+
+  assert(cf_prefetch_top == p);
+  cf_prefetch_top = p->prev;
+
+  for (size_t i = 0; i < p->num; i++)
+    if (p->roots[i] != NULL)
+      oconfig_free(p->roots[i]);
+  sfree(p->roots);
+  sfree(p->parsed);
+  p->num = 0;
+} /* void cf_prefetch_end */
+
+/* Returns true if `file' has been prefetched and moves the parsed tree, which
+ * is NULL if parsing failed, to `ret'. */
+static bool cf_prefetch_take(char const *file, oconfig_item_t **ret) {
+  for (cf_prefetch_t *p = cf_prefetch_top; p != NULL; p = p->prev) {
+    size_t i = p->next;
+    if ((i >= p->num) || (strcmp(p->files[i], file) != 0)) {
+      for (i = 0; i < p->num; i++)
+        if (strcmp(p->files[i], file) == 0)
+          break;
+    }
+    if ((i >= p->num) || !p->parsed[i])
+      continue;
+
+    *ret = p->roots[i];
+    p->roots[i] = NULL;
+    p->parsed[i] = false;
+    p->next = i + 1;
+    return true;
+  }
+
+  return false;
+} /* bool cf_prefetch_take */
+
 static int cf_include_all(oconfig_item_t *root, int depth) {
   for (int i = 0; i < root->children_num; i++) {
     oconfig_item_t *new;
@@ -623,12 +1263,17 @@ static oconfig_item_t *cf_read_file(const char *file, const char *pattern,
 #endif /* HAVE_FNMATCH_H && HAVE_LIBGEN_H */
   }
 
-  root = oconfig_parse_file(file);
+  if (!cf_prefetch_take(file, &root))
+    root = cf_parse_file(file);
   if (root == NULL) {
     ERROR("configfile: Cannot read file `%s'.", file);
     return NULL;
   }
 
+  /* The cache has to be known before the first include is read. */
+  if (depth == 0)
+    cf_cache_configure(root);
+
   status = cf_include_all(root, depth);
   if (status != 0) {
     oconfig_free(root);
@@ -710,25 +1355,30 @@ static oconfig_item_t *cf_read_dir(const char *dir, const char *pattern,
   qsort((void *)filenames, filenames_num, sizeof(*filenames),
         cf_compare_string);
 
+  /* The names are looked up while the prefetch is in use, so they are freed
+   * afterwards. */
+  cf_prefetch_t prefetch;
+  cf_prefetch_begin(&prefetch, filenames, (size_t)filenames_num, pattern);
+
   for (int i = 0; i < filenames_num; ++i) {
     oconfig_item_t *temp;
-    char *name = filenames[i];
 
-    temp = cf_read_generic(name, pattern, depth);
+    temp = cf_read_generic(filenames[i], pattern, depth);
     if (temp == NULL) {
       /* An error should already have been reported. */
-      sfree(name);
       continue;
     }
 
     cf_ci_append_children(root, temp);
     sfree(temp->children);
     sfree(temp);
-
-    free(name);
   }
 
+  cf_prefetch_end(&prefetch);
+
   closedir(dh);
+  for (int i = 0; i < filenames_num; ++i)
+    free(filenames[i]);
   free(filenames);
   return root;
 } /* oconfig_item_t *cf_read_dir */
@@ -776,6 +1426,9 @@ static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
   qsort((void *)we.we_wordv, we.we_wordc, sizeof(*we.we_wordv),
         cf_compare_string);
 
+  cf_prefetch_t prefetch;
+  cf_prefetch_begin(&prefetch, we.we_wordv, we.we_wordc, pattern);
+
   for (size_t i = 0; i < we.we_wordc; i++) {
     oconfig_item_t *temp;
     struct stat statbuf;
@@ -800,6 +1453,8 @@ static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
     }
 
     if (temp == NULL) {
+      cf_prefetch_end(&prefetch);
+      wordfree(&we);
       oconfig_free(root);
       return NULL;
     }
@@ -809,6 +1464,7 @@ static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
     sfree(temp);
   }
 
+  cf_prefetch_end(&prefetch);
   wordfree(&we);
 
   return root;
@@ -1015,11 +1671,43 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *)) {
   return 0;
 } /* int cf_register_complex */
 
+/* Parses the files of all "TypesDB" options in parallel, before the options
+ * are dispatched in order. */
+static void cf_prefetch_typesdb(oconfig_item_t const *conf) {
+  char const **files = NULL;
+  size_t files_num = 0;
+
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t const *ci = conf->children + i;
+    if ((strcasecmp("TypesDB", ci->key) != 0) || (ci->values_num < 1))
+      continue;
+
+    char const **tmp =
+        realloc(files, (files_num + ci->values_num) * sizeof(*files));
+    if (tmp == NULL) {
+      free(files);
+      return;
+    }
+    files = tmp;
+
+    for (int j = 0; j < ci->values_num; j++)
+      if (ci->values[j].type == OCONFIG_TYPE_STRING)
+        files[files_num++] = ci->values[j].value.string;
+  }
+
+  /* Parsing a single file in parallel gains nothing. */
+  if (files_num > 1)
+    types_list_prefetch(files, files_num);
+
+  free(files);
+} /* void cf_prefetch_typesdb */
+
 int cf_read(const char *filename) {
   oconfig_item_t *conf;
   int ret = 0;
 
   conf = cf_read_generic(filename, /* pattern = */ NULL, /* depth = */ 0);
+  cf_cache_close();
   if (conf == NULL) {
     ERROR("Unable to read config file %s.", filename);
     return -1;
@@ -1029,6 +1717,8 @@ int cf_read(const char *filename) {
     return -1;
   }
 
+  cf_prefetch_typesdb(conf);
+
   for (int i = 0; i < conf->children_num; i++) {
     if (conf->children[i].children == NULL) {
       if (dispatch_value(conf->children + i) != 0)
@@ -1039,18 +1729,285 @@ int cf_read(const char *filename) {
     }
   }
 
-  oconfig_free(conf);
+  oconfig_free(cf_config);
+  cf_config = conf;
 
   /* Read the default types.db if no `TypesDB' option was given. */
   if (cf_default_typesdb) {
     if (read_types_list(PKGDATADIR "/types.db") != 0)
       ret = -1;
   }
+  types_list_prefetch_clear();
 
   return ret;
 
 } /* int cf_read */
 
+static bool cf_item_equal(oconfig_item_t const *a, oconfig_item_t const *b) {
+  if ((strcasecmp(a->key, b->key) != 0) || (a->values_num != b->values_num) ||
+      (a->children_num != b->children_num))
+    return false;
+
+  for (int i = 0; i < a->values_num; i++) {
+    oconfig_value_t const *va = a->values + i;
+    oconfig_value_t const *vb = b->values + i;
+    if (va->type != vb->type)
+      return false;
+    if ((va->type == OCONFIG_TYPE_STRING) &&
+        (strcmp(va->value.string, vb->value.string) != 0))
+      return false;
+    if ((va->type == OCONFIG_TYPE_NUMBER) &&
+        (va->value.number != vb->value.number))
+      return false;
+    if ((va->type == OCONFIG_TYPE_BOOLEAN) &&
+        (va->value.boolean != vb->value.boolean))
+      return false;
+  }
+
+  for (int i = 0; i < a->children_num; i++)
+    if (!cf_item_equal(a->children + i, b->children + i))
+      return false;
+
+  return true;
+} /* bool cf_item_equal */
+
+/* Returns the name of the plugin a "LoadPlugin" option or a "Plugin" block
+ * refers to, NULL for other items. */
+static char const *cf_item_plugin(oconfig_item_t const *ci) {
+  if ((strcasecmp("LoadPlugin", ci->key) != 0) &&
+      (strcasecmp("Plugin", ci->key) != 0))
+    return NULL;
+  if ((ci->values_num < 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return NULL;
+
+  char const *name = ci->values[0].value.string;
+  return (strcmp("libvirt", name) == 0) ? "virt" : name;
+} /* char const *cf_item_plugin */
+
+/* Selects the top level items that are compared as a group: the items with the
+ * key `key' and, if `plugin' is not NULL, referring to that plugin. */
+static bool cf_item_selected(oconfig_item_t const *ci, char const *key,
+                             char const *plugin) {
+  if (strcasecmp(key, ci->key) != 0)
+    return false;
+  if (plugin == NULL)
+    return true;
+
+  char const *name = cf_item_plugin(ci);
+  return (name != NULL) && (strcasecmp(plugin, name) == 0);
+} /* bool cf_item_selected */
+
+static bool cf_selected_equal(oconfig_item_t const *a, oconfig_item_t const *b,
+                              char const *key, char const *plugin) {
+  int i = 0;
+  int j = 0;
+  while (true) {
+    while ((i < a->children_num) &&
+           !cf_item_selected(a->children + i, key, plugin))
+      i++;
+    while ((j < b->children_num) &&
+           !cf_item_selected(b->children + j, key, plugin))
+      j++;
+
+    if ((i == a->children_num) || (j == b->children_num))
+      return (i == a->children_num) && (j == b->children_num);
+    if (!cf_item_equal(a->children + i, b->children + j))
+      return false;
+    i++;
+    j++;
+  }
+} /* bool cf_selected_equal */
+
+static bool cf_item_is_global(oconfig_item_t const *ci) {
+  return (strcasecmp("LoadPlugin", ci->key) != 0) &&
+         (strcasecmp("Plugin", ci->key) != 0) &&
+         (strcasecmp("Chain", ci->key) != 0);
+} /* bool cf_item_is_global */
+
+/* Applies the change of the global option `key'. Only the names of the filter
+ * chains can be changed at runtime. Returns true if the chains need to be
+ * looked up again. */
+static bool cf_reload_global(oconfig_item_t const *conf, char const *key) {
+  if ((strcasecmp("PreCacheChain", key) != 0) &&
+      (strcasecmp("PostCacheChain", key) != 0)) {
+    WARNING("configfile: Changing the `%s' option requires a restart.", key);
+    return false;
+  }
+
+  oconfig_item_t const *last = NULL;
+  for (int i = 0; i < conf->children_num; i++)
+    if (strcasecmp(key, conf->children[i].key) == 0)
+      last = conf->children + i;
+
+  if (last != NULL)
+    dispatch_global_option(last);
+  else
+    global_option_set(key, NULL, /* from_cli = */ false);
+  return true;
+} /* bool cf_reload_global */
+
+/* Loads or reconfigures the plugin `name' if its items differ between the old
+ * configuration `old' and the new one, `conf'. */
+static int cf_reload_plugin(oconfig_item_t const *old, oconfig_item_t *conf,
+                            char const *name) {
+  bool load_equal = cf_selected_equal(old, conf, "LoadPlugin", name);
+  bool blocks_equal = cf_selected_equal(old, conf, "Plugin", name);
+  if (load_equal && blocks_equal)
+    return 0;
+
+  bool loaded = plugin_is_loaded(name);
+  if (loaded && !load_equal) {
+    WARNING("configfile: Changing or removing `LoadPlugin %s' requires a "
+            "restart.",
+            name);
+    return 0;
+  }
+
+  if (loaded) {
+    int status = plugin_reload_plugin(name);
+    if (status == ENOENT) {
+      WARNING("configfile: The `%s' plugin can not be reconfigured without a "
+              "restart.",
+              name);
+      return 0;
+    } else if (status != 0)
+      return status;
+  }
+
+  int ret = 0;
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t *ci = conf->children + i;
+    int status = 0;
+
+    if (!loaded && cf_item_selected(ci, "LoadPlugin", name))
+      status = dispatch_loadplugin(ci);
+    else if (cf_item_selected(ci, "Plugin", name))
+      status = dispatch_block_plugin(ci);
+
+    if (status != 0)
+      ret = -1;
+  }
+
+  if (!plugin_is_loaded(name))
+    return ret;
+
+  if (plugin_init_plugin(name) != 0)
+    return -1;
+
+  INFO("configfile: %s plugin `%s'.", loaded ? "Reconfigured" : "Loaded",
+       name);
+  return ret;
+} /* int cf_reload_plugin */
+
+/* Returns true if an item before `conf->children[n]' refers to the same
+ * plugin or, for global options, has the same key. */
+static bool cf_item_seen(oconfig_item_t const *conf, int n) {
+  oconfig_item_t const *ci = conf->children + n;
+  char const *name = cf_item_plugin(ci);
+
+  for (int i = 0; i < n; i++) {
+    oconfig_item_t const *prev = conf->children + i;
+    if (name != NULL) {
+      char const *prev_name = cf_item_plugin(prev);
+      if ((prev_name != NULL) && (strcasecmp(name, prev_name) == 0))
+        return true;
+    } else if (strcasecmp(ci->key, prev->key) == 0)
+      return true;
+  }
+  return false;
+} /* bool cf_item_seen */
+
+static bool cf_item_contained(oconfig_item_t const *conf,
+                              oconfig_item_t const *ci) {
+  char const *name = cf_item_plugin(ci);
+
+  for (int i = 0; i < conf->children_num; i++) {
+    oconfig_item_t const *other = conf->children + i;
+    if (name != NULL) {
+      char const *other_name = cf_item_plugin(other);
+      if ((other_name != NULL) && (strcasecmp(name, other_name) == 0))
+        return true;
+    } else if (strcasecmp(ci->key, other->key) == 0)
+      return true;
+  }
+  return false;
+} /* bool cf_item_contained */
+
+/* Applies the changes of a group of items: the global option or the plugin
+ * `ci' belongs to. Returns true if the filter chains need to be reloaded. */
+static bool cf_reload_item(oconfig_item_t const *old, oconfig_item_t *conf,
+                           oconfig_item_t const *ci, int *ret) {
+  char const *name = cf_item_plugin(ci);
+  if (name != NULL) {
+    if (cf_reload_plugin(old, conf, name) != 0)
+      *ret = -1;
+    return false;
+  }
+
+  if (!cf_item_is_global(ci) || cf_selected_equal(old, conf, ci->key, NULL))
+    return false;
+  return cf_reload_global(conf, ci->key);
+} /* bool cf_reload_item */
+
+int cf_reload(const char *filename) {
+  if (cf_config == NULL)
+    return EINVAL;
+
+  oconfig_item_t *conf =
+      cf_read_generic(filename, /* pattern = */ NULL, /* depth = */ 0);
+  cf_cache_close();
+  if (conf == NULL) {
+    ERROR("Unable to read config file %s.", filename);
+    return -1;
+  } else if (conf->children_num == 0) {
+    ERROR("Configuration file %s is empty.", filename);
+    oconfig_free(conf);
+    return -1;
+  }
+
+  int ret = 0;
+  bool chains_changed = false;
+
+  /* Plugins are handled before the chains, which may use the matches and
+   * targets of newly loaded plugins. */
+  for (int i = 0; i < conf->children_num; i++)
+    if (!cf_item_seen(conf, i) &&
+        cf_reload_item(cf_config, conf, conf->children + i, &ret))
+      chains_changed = true;
+
+  /* Removed options and plugins. */
+  for (int i = 0; i < cf_config->children_num; i++) {
+    oconfig_item_t const *ci = cf_config->children + i;
+    if (!cf_item_seen(cf_config, i) && !cf_item_contained(conf, ci) &&
+        cf_reload_item(cf_config, conf, ci, &ret))
+      chains_changed = true;
+  }
+
+  if (chains_changed || !cf_selected_equal(cf_config, conf, "Chain", NULL)) {
+    oconfig_item_t const **blocks =
+        calloc((size_t)conf->children_num, sizeof(*blocks));
+    if (blocks == NULL) {
+      ERROR("cf_reload: calloc failed.");
+      ret = -1;
+    } else {
+      size_t blocks_num = 0;
+      for (int i = 0; i < conf->children_num; i++)
+        if (strcasecmp("Chain", conf->children[i].key) == 0)
+          blocks[blocks_num++] = conf->children + i;
+
+      if (plugin_reload_chains(blocks, blocks_num) != 0)
+        ret = -1;
+      free(blocks);
+    }
+  }
+
+  oconfig_free(cf_config);
+  cf_config = conf;
+
+  INFO("configfile: Reloaded %s.", filename);
+  return ret;
+} /* int cf_reload */
+
 /* Assures the config option is a string, duplicates it and returns the copy in
  * "ret_string". If necessary "*ret_string" is freed first. Returns zero upon
  * success. */
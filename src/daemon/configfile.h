@@ -89,6 +89,33 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *));
  */
 int cf_read(const char *filename);
 
+/*
+ * DESCRIPTION
+ *  `cf_reload' reads the config file `filename' again and applies the
+ *  differences to the configuration read by `cf_read': plugins that are not
+ *  loaded yet are loaded and initialized, plugins whose <Plugin> blocks
+ *  changed are reconfigured if they registered a reload callback and the
+ *  filter chains are replaced if they changed. Other changes are logged as
+ *  requiring a restart. The value cache and the write queues are kept.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success and non-zero otherwise.
+ */
+int cf_reload(const char *filename);
+
+/*
+ * DESCRIPTION
+ *  `cf_parallel_for' calls `func' once for each index from zero to `num' - 1,
+ *  using up to one thread per CPU. The calling thread is one of them. Returns
+ *  once all calls have returned.
+ *
+ * PARAMETERS
+ *  `num'       Number of calls.
+ *  `func'      Function to call with the index and `arg'.
+ *  `arg'       Passed to `func' unchanged.
+ */
+void cf_parallel_for(size_t num, void (*func)(size_t, void *), void *arg);
+
 int global_option_set(const char *option, const char *value, bool from_cli);
 const char *global_option_get(const char *option);
 long global_option_get_long(const char *option, long default_value);
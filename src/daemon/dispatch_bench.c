@@ -0,0 +1,623 @@
+/**
+ * collectd - src/daemon/dispatch_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Measures the throughput and latency of plugin_dispatch_values() through the
+ * real write queue, value cache and filter chains. Dispatch threads send
+ * values for a fixed set of series as fast as possible; a write callback
+ * records how long each value took from dispatch to being written. The
+ * results are printed as one line of JSON.
+ *
+ * Usage: bench_dispatch [-t <write threads>] [-d <dispatch threads>]
+ *                       [-n <series>] [-T <seconds> | -N <values>]
+ *                       [-m <meta entries>] [-M <meta bytes>]
+ *                       [-f <rules> | -C <config file>] [-b]
+ */
+
+#include "collectd.h"
+
+#include "configfile.h"
+#include "filter_chain.h"
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Latencies are counted in logarithmic buckets of nanoseconds with eight
+ * buckets per power of two, i.e. with a resolution of about 9%. Unlike
+ * latency_counter_t, these histograms can be merged exactly. */
+#define LATENCY_BUCKETS_PER_OCTAVE 8
+#define LATENCY_BUCKETS_NUM (40 * LATENCY_BUCKETS_PER_OCTAVE)
+
+typedef struct {
+  uint64_t buckets[LATENCY_BUCKETS_NUM];
+  uint64_t num;
+  cdtime_t sum;
+  cdtime_t max;
+} histogram_t;
+
+/* Writers record their statistics in thread-local structures, so that the
+ * benchmark's own locking does not serialize the write threads. */
+typedef struct writer_stats_s {
+  pthread_mutex_t lock;
+  histogram_t latency;
+  uint64_t written;
+  struct writer_stats_s *next;
+} writer_stats_t;
+
+typedef struct {
+  pthread_t thread;
+  size_t id;
+  size_t series_num;
+  uint64_t limit;
+  bool started;
+  uint64_t dispatched;
+  uint64_t failed;
+} dispatcher_t;
+
+static size_t conf_write_threads;
+static size_t conf_dispatch_threads = 1;
+static size_t conf_series = 10000;
+static double conf_duration = 5.0;
+static uint64_t conf_values;
+static size_t conf_meta_entries;
+static size_t conf_meta_size = 16;
+static size_t conf_rules;
+static char const *conf_file;
+static bool conf_batch;
+
+static volatile bool running = true;
+
+/* Counts log messages that are not printed, see bench_log(). */
+static pthread_mutex_t notices_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t notices;
+
+static pthread_key_t writer_stats_key;
+static pthread_once_t writer_stats_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t writer_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static writer_stats_t *writer_stats;
+
+static void histogram_add(histogram_t *h, cdtime_t latency) {
+  double ns = (double)CDTIME_T_TO_NS(latency);
+  size_t i = 0;
+
+  if (ns > 1.0)
+    i = (size_t)(log2(ns) * LATENCY_BUCKETS_PER_OCTAVE);
+  if (i >= LATENCY_BUCKETS_NUM)
+    i = LATENCY_BUCKETS_NUM - 1;
+
+  h->buckets[i]++;
+  h->num++;
+  h->sum += latency;
+  if (h->max < latency)
+    h->max = latency;
+}
+
+static void histogram_merge(histogram_t *dst, histogram_t const *src) {
+  for (size_t i = 0; i < LATENCY_BUCKETS_NUM; i++)
+    dst->buckets[i] += src->buckets[i];
+  dst->num += src->num;
+  dst->sum += src->sum;
+  if (dst->max < src->max)
+    dst->max = src->max;
+}
+
+/* Returns the upper bound of the bucket holding the percentile, in
+ * microseconds. */
+static double histogram_percentile(histogram_t const *h, double percent) {
+  if (h->num == 0)
+    return 0;
+
+  double max = CDTIME_T_TO_DOUBLE(h->max) * 1e6;
+  uint64_t rank = (uint64_t)ceil(((double)h->num) * percent / 100.0);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS_NUM; i++) {
+    sum += h->buckets[i];
+    if (sum < rank)
+      continue;
+
+    double bound = exp2(((double)(i + 1)) / LATENCY_BUCKETS_PER_OCTAVE) / 1e3;
+    return (bound < max) ? bound : max;
+  }
+
+  return max;
+}
+
+static void writer_stats_init(void) {
+  pthread_key_create(&writer_stats_key, /* destructor = */ NULL);
+}
+
+static writer_stats_t *writer_stats_get(void) {
+  pthread_once(&writer_stats_once, writer_stats_init);
+
+  writer_stats_t *ws = pthread_getspecific(writer_stats_key);
+  if (ws != NULL)
+    return ws;
+
+  ws = calloc(1, sizeof(*ws));
+  if (ws == NULL)
+    return NULL;
+  pthread_mutex_init(&ws->lock, NULL);
+  pthread_setspecific(writer_stats_key, ws);
+
+  pthread_mutex_lock(&writer_stats_lock);
+  ws->next = writer_stats;
+  writer_stats = ws;
+  pthread_mutex_unlock(&writer_stats_lock);
+
+  return ws;
+}
+
+static uint64_t writer_stats_written(void) {
+  uint64_t written = 0;
+
+  pthread_mutex_lock(&writer_stats_lock);
+  for (writer_stats_t *ws = writer_stats; ws != NULL; ws = ws->next) {
+    pthread_mutex_lock(&ws->lock);
+    written += ws->written;
+    pthread_mutex_unlock(&ws->lock);
+  }
+  pthread_mutex_unlock(&writer_stats_lock);
+
+  return written;
+}
+
+static void writer_stats_record(writer_stats_t *ws, value_list_t const *vl,
+                                cdtime_t now) {
+  if (now > vl->time)
+    histogram_add(&ws->latency, now - vl->time);
+  ws->written++;
+}
+
+/* Prints warnings and errors. Less severe messages, for example about values
+ * being written out of order when there are too few series for the number of
+ * write threads, are only counted, so that printing them doesn't slow down
+ * the benchmark. */
+static void bench_log(int severity, char const *msg,
+                      __attribute__((unused)) user_data_t *ud) {
+  if (severity <= LOG_WARNING) {
+    fprintf(stderr, "%s\n", msg);
+    return;
+  }
+
+  pthread_mutex_lock(&notices_lock);
+  notices++;
+  pthread_mutex_unlock(&notices_lock);
+}
+
+/* plugin_init_all() only starts the write threads if there are init or read
+ * callbacks. */
+static int bench_init(void) { return 0; }
+
+static int bench_write(__attribute__((unused)) data_set_t const *ds,
+                       value_list_t const *vl,
+                       __attribute__((unused)) user_data_t *ud) {
+  writer_stats_t *ws = writer_stats_get();
+  if (ws == NULL)
+    return ENOMEM;
+
+  cdtime_t now = cdtime();
+  pthread_mutex_lock(&ws->lock);
+  writer_stats_record(ws, vl, now);
+  pthread_mutex_unlock(&ws->lock);
+  return 0;
+}
+
+static int bench_write_batch(write_batch_entry_t const *entries,
+                             size_t entries_num,
+                             __attribute__((unused)) user_data_t *ud) {
+  writer_stats_t *ws = writer_stats_get();
+  if (ws == NULL)
+    return ENOMEM;
+
+  cdtime_t now = cdtime();
+  pthread_mutex_lock(&ws->lock);
+  for (size_t i = 0; i < entries_num; i++)
+    writer_stats_record(ws, entries[i].vl, now);
+  pthread_mutex_unlock(&ws->lock);
+  return 0;
+}
+
+/* The "bench" match compares the type instance with a string that never
+ * occurs, so that every rule of a generated chain is evaluated. */
+static int bench_match(__attribute__((unused)) data_set_t const *ds,
+                       value_list_t const *vl,
+                       __attribute__((unused)) notification_meta_t **meta,
+                       __attribute__((unused)) void **user_data) {
+  if (strcmp(vl->type_instance, "never") == 0)
+    return FC_MATCH_MATCHES;
+  return FC_MATCH_NO_MATCH;
+}
+
+static int bench_match_create(__attribute__((unused)) oconfig_item_t const *ci,
+                              void **user_data) {
+  *user_data = NULL;
+  return 0;
+}
+
+static int bench_match_destroy(__attribute__((unused)) void **user_data) {
+  return 0;
+}
+
+/* Writes a PreCache chain with conf_rules rules to a temporary file and
+ * returns its name. */
+static char *write_rules_config(void) {
+  static char name[] = "/tmp/bench_dispatch.XXXXXX";
+
+  int fd = mkstemp(name);
+  if (fd < 0) {
+    fprintf(stderr, "mkstemp failed: %s\n", STRERRNO);
+    return NULL;
+  }
+
+  FILE *fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    fprintf(stderr, "fdopen failed: %s\n", STRERRNO);
+    close(fd);
+    unlink(name);
+    return NULL;
+  }
+
+  /* The benchmark registers its only type itself. */
+  fprintf(fh, "TypesDB \"/dev/null\"\n"
+              "PreCacheChain \"PreCache\"\n"
+              "<Chain \"PreCache\">\n");
+  for (size_t i = 0; i < conf_rules; i++)
+    fprintf(fh,
+            "  <Rule \"rule%zu\">\n"
+            "    <Match \"bench\">\n"
+            "    </Match>\n"
+            "    Target \"stop\"\n"
+            "  </Rule>\n",
+            i);
+  fprintf(fh, "</Chain>\n");
+
+  if (fclose(fh) != 0) {
+    fprintf(stderr, "Writing %s failed: %s\n", name, STRERRNO);
+    unlink(name);
+    return NULL;
+  }
+
+  return name;
+}
+
+static meta_data_t *create_meta(void) {
+  if (conf_meta_entries == 0)
+    return NULL;
+
+  meta_data_t *meta = meta_data_create();
+  char *value = calloc(1, conf_meta_size + 1);
+  if ((meta == NULL) || (value == NULL)) {
+    meta_data_destroy(meta);
+    free(value);
+    return NULL;
+  }
+  memset(value, 'x', conf_meta_size);
+
+  for (size_t i = 0; i < conf_meta_entries; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%zu", i);
+    meta_data_add_string(meta, key, value);
+  }
+
+  free(value);
+  return meta;
+}
+
+static void *dispatch_thread(void *arg) {
+  dispatcher_t *d = arg;
+
+  char(*names)[DATA_MAX_NAME_LEN] = calloc(d->series_num, sizeof(*names));
+  if (names == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return NULL;
+  }
+  for (size_t i = 0; i < d->series_num; i++)
+    snprintf(names[i], sizeof(names[i]), "series%zu", i);
+
+  value_t value = {.gauge = 0};
+  value_list_t vl = {
+      .values = &value,
+      .values_len = 1,
+      .interval = interval_g,
+      .meta = create_meta(),
+  };
+  sstrncpy(vl.plugin, "bench", sizeof(vl.plugin));
+  snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%zu", d->id);
+  sstrncpy(vl.type, "bench", sizeof(vl.type));
+
+  /* The plugin instance differs between threads, so each series is only
+   * dispatched by one thread and its times only ever increase. */
+  while (running && ((d->limit == 0) || (d->dispatched < d->limit))) {
+    for (size_t i = 0; i < d->series_num; i++) {
+      sstrncpy(vl.type_instance, names[i], sizeof(vl.type_instance));
+      value.gauge = (gauge_t)d->dispatched;
+      vl.time = cdtime();
+
+      if (plugin_dispatch_values(&vl) != 0)
+        d->failed++;
+      d->dispatched++;
+
+      if ((d->limit != 0) && (d->dispatched >= d->limit))
+        break;
+    }
+  }
+
+  meta_data_destroy(vl.meta);
+  free(names);
+  return NULL;
+}
+
+static int parse_size(char const *str, size_t *ret) {
+  char *endptr = NULL;
+
+  errno = 0;
+  unsigned long long tmp = strtoull(str, &endptr, 0);
+  if ((errno != 0) || (endptr == str) || (*endptr != 0)) {
+    fprintf(stderr, "Invalid number: \"%s\"\n", str);
+    return EINVAL;
+  }
+
+  *ret = (size_t)tmp;
+  return 0;
+}
+
+__attribute__((noreturn)) static void exit_usage(char const *name,
+                                                 int status) {
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr,
+          "Usage: %s [OPTIONS]\n"
+          "\n"
+          "  -t <number>   Number of write threads. (Default: WriteThreads)\n"
+          "  -d <number>   Number of dispatching threads. (Default: 1)\n"
+          "  -n <number>   Number of series per dispatching thread.\n"
+          "                (Default: 10000)\n"
+          "  -T <seconds>  Duration of the run. (Default: 5)\n"
+          "  -N <number>   Number of values to dispatch instead of running\n"
+          "                for a fixed time.\n"
+          "  -m <number>   Number of meta data entries per value list.\n"
+          "  -M <bytes>    Size of each meta data string. (Default: 16)\n"
+          "  -f <number>   Number of non-matching PreCache chain rules.\n"
+          "  -C <file>     Configuration file to read, for example with\n"
+          "                filter chains or write queue limits.\n"
+          "  -b            Use a write_batch callback.\n"
+          "  -h            Print this help.\n",
+          name);
+  exit(status);
+}
+
+static void read_options(int argc, char **argv) {
+  int opt;
+  size_t tmp;
+
+  while ((opt = getopt(argc, argv, "t:d:n:T:N:m:M:f:C:bh")) != -1) {
+    int status = 0;
+    switch (opt) {
+    case 't':
+      status = parse_size(optarg, &conf_write_threads);
+      break;
+    case 'd':
+      status = parse_size(optarg, &conf_dispatch_threads);
+      break;
+    case 'n':
+      status = parse_size(optarg, &conf_series);
+      break;
+    case 'T':
+      conf_duration = atof(optarg);
+      break;
+    case 'N':
+      status = parse_size(optarg, &tmp);
+      conf_values = (uint64_t)tmp;
+      break;
+    case 'm':
+      status = parse_size(optarg, &conf_meta_entries);
+      break;
+    case 'M':
+      status = parse_size(optarg, &conf_meta_size);
+      break;
+    case 'f':
+      status = parse_size(optarg, &conf_rules);
+      break;
+    case 'C':
+      conf_file = optarg;
+      break;
+    case 'b':
+      conf_batch = true;
+      break;
+    case 'h':
+      exit_usage(argv[0], EXIT_SUCCESS);
+    default:
+      exit_usage(argv[0], EXIT_FAILURE);
+    }
+    if (status != 0)
+      exit_usage(argv[0], EXIT_FAILURE);
+  }
+
+  if ((optind < argc) || (conf_dispatch_threads == 0) || (conf_series == 0) ||
+      ((conf_values == 0) && (conf_duration <= 0)) ||
+      ((conf_rules > 0) && (conf_file != NULL)))
+    exit_usage(argv[0], EXIT_FAILURE);
+}
+
+static int configure(void) {
+  plugin_init_ctx();
+  hostname_set("localhost");
+  plugin_register_log("bench", bench_log, NULL);
+
+  if (conf_write_threads > 0) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%zu", conf_write_threads);
+    global_option_set("WriteThreads", buffer, /* from_cli = */ true);
+  }
+
+  match_proc_t mproc = {
+      .create = bench_match_create,
+      .destroy = bench_match_destroy,
+      .match = bench_match,
+  };
+  fc_register_match("bench", mproc);
+
+  char const *file = conf_file;
+  if (conf_rules > 0) {
+    file = write_rules_config();
+    if (file == NULL)
+      return -1;
+  }
+
+  if (file != NULL) {
+    int status = cf_read(file);
+    if (conf_rules > 0)
+      unlink(file);
+    if (status != 0) {
+      fprintf(stderr, "Reading the configuration failed.\n");
+      return -1;
+    }
+  }
+
+  interval_g = cf_get_default_interval();
+
+  data_set_t ds = {
+      .type = "bench",
+      .ds_num = 1,
+      .ds =
+          &(data_source_t){
+              .name = "value",
+              .type = DS_TYPE_GAUGE,
+              .min = NAN,
+              .max = NAN,
+          },
+  };
+  plugin_register_data_set(&ds);
+
+  plugin_register_init("bench", bench_init);
+  if (conf_batch)
+    plugin_register_write_batch("bench", bench_write_batch, NULL);
+  else
+    plugin_register_write("bench", bench_write, NULL);
+
+  return plugin_init_all();
+}
+
+int main(int argc, char **argv) {
+  read_options(argc, argv);
+
+  if (configure() != 0)
+    return 1;
+
+  dispatcher_t *dispatchers =
+      calloc(conf_dispatch_threads, sizeof(*dispatchers));
+  if (dispatchers == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return 1;
+  }
+
+  cdtime_t start = cdtime();
+  for (size_t i = 0; i < conf_dispatch_threads; i++) {
+    dispatcher_t *d = dispatchers + i;
+    d->id = i;
+    d->series_num = conf_series;
+    d->limit = conf_values / conf_dispatch_threads;
+    if (i < conf_values % conf_dispatch_threads)
+      d->limit++;
+    if ((conf_values > 0) && (d->limit == 0))
+      continue;
+
+    int status = pthread_create(&d->thread, NULL, dispatch_thread, d);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", STRERROR(status));
+      return 1;
+    }
+    d->started = true;
+  }
+
+  if (conf_values == 0) {
+    struct timespec ts =
+        CDTIME_T_TO_TIMESPEC(DOUBLE_TO_CDTIME_T_STATIC(conf_duration));
+    nanosleep(&ts, NULL);
+    running = false;
+  }
+
+  uint64_t dispatched = 0;
+  uint64_t failed = 0;
+  for (size_t i = 0; i < conf_dispatch_threads; i++) {
+    dispatcher_t *d = dispatchers + i;
+    if (!d->started)
+      continue;
+    pthread_join(d->thread, NULL);
+    dispatched += d->dispatched;
+    failed += d->failed;
+  }
+  cdtime_t dispatch_end = cdtime();
+
+  /* Wait for the write threads to drain the queue. Values that have been
+   * dropped, for example because of write queue limits, never arrive. */
+  uint64_t written = writer_stats_written();
+  uint64_t last_written = 0;
+  cdtime_t last_progress = cdtime();
+  while (written < dispatched - failed) {
+    if (written != last_written) {
+      last_written = written;
+      last_progress = cdtime();
+    } else if (cdtime() - last_progress > TIME_T_TO_CDTIME_T(1)) {
+      break;
+    }
+    nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    written = writer_stats_written();
+  }
+  cdtime_t end = cdtime();
+
+  plugin_shutdown_all();
+
+  histogram_t latency = {0};
+  for (writer_stats_t *ws = writer_stats; ws != NULL; ws = ws->next)
+    histogram_merge(&latency, &ws->latency);
+
+  double dispatch_secs = CDTIME_T_TO_DOUBLE(dispatch_end - start);
+  double total_secs = CDTIME_T_TO_DOUBLE(end - start);
+  printf("{\"write_threads\":%ld,\"dispatch_threads\":%zu,\"series\":%zu,"
+         "\"meta_entries\":%zu,\"meta_size\":%zu,\"rules\":%zu,"
+         "\"batch\":%s,\"dispatched\":%" PRIu64 ",\"failed\":%" PRIu64
+         ",\"written\":%" PRIu64 ",\"dispatch_seconds\":%.6f,"
+         "\"total_seconds\":%.6f,\"dispatch_per_second\":%.0f,"
+         "\"written_per_second\":%.0f,\"latency_avg_us\":%.1f,"
+         "\"latency_p50_us\":%.1f,\"latency_p90_us\":%.1f,"
+         "\"latency_p99_us\":%.1f,\"latency_p999_us\":%.1f,"
+         "\"latency_max_us\":%.1f,\"log_notices\":%" PRIu64 "}\n",
+         global_option_get_long("WriteThreads", 5), conf_dispatch_threads,
+         conf_series * conf_dispatch_threads, conf_meta_entries,
+         conf_meta_size, conf_rules, conf_batch ? "true" : "false", dispatched,
+         failed, written, dispatch_secs, total_secs,
+         (double)dispatched / dispatch_secs, (double)written / total_secs,
+         (latency.num > 0) ? 1e6 * CDTIME_T_TO_DOUBLE(latency.sum) /
+                                 (double)latency.num
+                           : 0.0,
+         histogram_percentile(&latency, 50), histogram_percentile(&latency, 90),
+         histogram_percentile(&latency, 99),
+         histogram_percentile(&latency, 99.9),
+         1e6 * CDTIME_T_TO_DOUBLE(latency.max), notices);
+
+  free(dispatchers);
+  return 0;
+}
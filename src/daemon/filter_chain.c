@@ -29,8 +29,12 @@
 #include "configfile.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "probes.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
+#include "utils/lru/lru.h"
 #include "utils_complain.h"
+#include "utils_identity.h"
 
 /*
  * Data types
@@ -65,6 +69,29 @@ struct fc_rule_s {
   fc_match_t *matches;
   fc_target_t *targets;
   fc_rule_t *next;
+
+  /* Position in the chain, starting at zero. */
+  size_t position;
+  /* Plugin and type a value list needs for the matches to succeed, taken
+   * from the matches' hints. Empty if not constrained. */
+  char plugin[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  /* Set if all matches are pure, see fc_match_hint_t. */
+  bool pure;
+
+  /* Statistics, see fc_rule_stats_t. */
+  uint64_t evaluated;
+  uint64_t matched;
+  uint64_t time_total;
+}; /* }}} */
+
+/* Rules that require the same plugin and / or type, in chain order. */
+struct fc_rule_list_s;
+typedef struct fc_rule_list_s fc_rule_list_t; /* {{{ */
+struct fc_rule_list_s {
+  char *key;
+  fc_rule_t **rules;
+  size_t rules_num;
 }; /* }}} */
 
 /* List of chains, used for `chain_list_head' */
@@ -74,6 +101,50 @@ struct fc_chain_s /* {{{ */
   fc_rule_t *rules;
   fc_target_t *targets;
   fc_chain_t *next;
+
+  /* Index of the rules, see fc_chain_compile(). Rules without hints are in
+   * `unhinted', all others are in `index', keyed by fc_index_key(). */
+  fc_rule_list_t unhinted;
+  c_hashtable_t *index;
+  size_t rules_num;
+
+  /* fc_verdicts_t by identity hash, see the CacheSize option. NULL if
+   * disabled. */
+  c_lru_t *cache;
+  pthread_mutex_t cache_lock;
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+}; /* }}} */
+
+/* Only the verdicts of the first rules of a chain are cached, so that they
+ * can be copied to the stack. */
+#define FC_VERDICTS_MAX 256
+
+#define FC_VERDICT_UNKNOWN 0
+#define FC_VERDICT_NO_MATCH 1
+#define FC_VERDICT_MATCH 2
+
+/* Verdicts of a chain's pure rules for one identity, by rule position. The
+ * name guards against hash collisions and is stored after the verdicts. */
+struct fc_verdicts_s;
+typedef struct fc_verdicts_s fc_verdicts_t; /* {{{ */
+struct fc_verdicts_s {
+  char *name;
+  size_t verdicts_num;
+  uint8_t verdicts[];
+}; /* }}} */
+
+/* Largest number of rule lists a value list can select from a chain's index:
+ * the unhinted rules and the rules for "<plugin>/<type>", "<plugin>/" and
+ * "/<type>". */
+#define FC_CANDIDATES_MAX 4
+
+struct fc_candidates_s;
+typedef struct fc_candidates_s fc_candidates_t; /* {{{ */
+struct fc_candidates_s {
+  fc_rule_list_t *lists[FC_CANDIDATES_MAX];
+  size_t pos[FC_CANDIDATES_MAX];
+  size_t lists_num;
 }; /* }}} */
 
 /* Writer configuration. */
@@ -91,6 +162,11 @@ static fc_match_t *match_list_head;
 static fc_target_t *target_list_head;
 static fc_chain_t *chain_list_head;
 
+static bool fc_record_statistics;
+#if !HAVE_ATOMIC_BUILTINS
+static pthread_mutex_t fc_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
  * Private functions
  */
@@ -146,11 +222,42 @@ static void fc_free_rules(fc_rule_t *r) /* {{{ */
   free(r);
 } /* }}} void fc_free_rules */
 
+static void fc_free_rule_list(fc_rule_list_t *l) /* {{{ */
+{
+  free(l->key);
+  free(l->rules);
+  l->key = NULL;
+  l->rules = NULL;
+  l->rules_num = 0;
+} /* }}} void fc_free_rule_list */
+
+static void fc_free_index(fc_chain_t *c) /* {{{ */
+{
+  fc_free_rule_list(&c->unhinted);
+
+  if (c->index == NULL)
+    return;
+
+  size_t pos = 0;
+  fc_rule_list_t *l;
+  while (c_hashtable_next(c->index, &pos, NULL, (void *)&l) == 0) {
+    fc_free_rule_list(l);
+    free(l);
+  }
+  c_hashtable_destroy(c->index);
+  c->index = NULL;
+} /* }}} void fc_free_index */
+
 static void fc_free_chains(fc_chain_t *c) /* {{{ */
 {
   if (c == NULL)
     return;
 
+  fc_free_index(c);
+  if (c->cache != NULL) {
+    c_lru_destroy(c->cache);
+    pthread_mutex_destroy(&c->cache_lock);
+  }
   fc_free_rules(c->rules);
   fc_free_targets(c->targets);
 
@@ -178,6 +285,178 @@ static char *fc_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *fc_strdup */
 
+/*
+ * Rule index.
+ *
+ * Matches may hint at the plugin and type a value list must have for them to
+ * succeed, e.g. the regex match for "^cpu$". fc_chain_compile() files the
+ * rules of a chain under these fields, so that fc_process_chain() only
+ * evaluates the rules a value list can possibly match. The candidates are
+ * merged back into chain order, so the index does not change which rules run
+ * or in which order.
+ */
+static void fc_index_key(char *buffer, size_t buffer_size, /* {{{ */
+                         char const *plugin, char const *type) {
+  ssnprintf(buffer, buffer_size, "%s/%s", plugin, type);
+} /* }}} void fc_index_key */
+
+static int fc_rule_list_append(fc_rule_list_t *l, fc_rule_t *rule) /* {{{ */
+{
+  fc_rule_t **tmp = realloc(l->rules, (l->rules_num + 1) * sizeof(*l->rules));
+  if (tmp == NULL)
+    return ENOMEM;
+
+  l->rules = tmp;
+  l->rules[l->rules_num] = rule;
+  l->rules_num++;
+  return 0;
+} /* }}} int fc_rule_list_append */
+
+/* Merges the hints of the rule's matches into rule->plugin and rule->type. */
+static void fc_rule_hint(fc_rule_t *rule) /* {{{ */
+{
+  rule->plugin[0] = 0;
+  rule->type[0] = 0;
+  rule->pure = true;
+
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next) {
+    fc_match_hint_t hint = {{0}};
+
+    if ((m->proc.hint == NULL) ||
+        ((*m->proc.hint)(&m->user_data, &hint) != 0)) {
+      rule->pure = false;
+      continue;
+    }
+
+    if (!hint.pure)
+      rule->pure = false;
+
+    /* Conflicting hints mean the rule never matches. Keeping the first one
+     * is correct nonetheless, because the matches are still evaluated. */
+    if ((rule->plugin[0] == 0) && (hint.plugin[0] != 0))
+      sstrncpy(rule->plugin, hint.plugin, sizeof(rule->plugin));
+    if ((rule->type[0] == 0) && (hint.type[0] != 0))
+      sstrncpy(rule->type, hint.type, sizeof(rule->type));
+  }
+} /* }}} void fc_rule_hint */
+
+/* (Re-)builds the index of the chain's rules. */
+static int fc_chain_compile(fc_chain_t *chain) /* {{{ */
+{
+  fc_free_index(chain);
+
+  chain->rules_num = 0;
+  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+    chain->rules_num++;
+
+    if ((rule->plugin[0] == 0) && (rule->type[0] == 0)) {
+      if (fc_rule_list_append(&chain->unhinted, rule) != 0)
+        goto error;
+      continue;
+    }
+
+    if (chain->index == NULL) {
+      chain->index = c_hashtable_create();
+      if (chain->index == NULL)
+        goto error;
+    }
+
+    char key[2 * DATA_MAX_NAME_LEN];
+    fc_index_key(key, sizeof(key), rule->plugin, rule->type);
+    uint64_t hash = vl_identity_hash(key);
+
+    fc_rule_list_t *l = NULL;
+    if (c_hashtable_get(chain->index, hash, key, (void *)&l) != 0) {
+      l = calloc(1, sizeof(*l));
+      if (l == NULL)
+        goto error;
+      l->key = strdup(key);
+      if ((l->key == NULL) ||
+          (c_hashtable_insert(chain->index, hash, l->key, l) != 0)) {
+        fc_free_rule_list(l);
+        free(l);
+        goto error;
+      }
+    }
+
+    if (fc_rule_list_append(l, rule) != 0)
+      goto error;
+  }
+
+  return 0;
+
+error:
+  ERROR("Filter subsystem: Chain %s: Building the rule index failed.",
+        chain->name);
+  fc_free_index(chain);
+  /* Without an index, all rules are evaluated. */
+  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+    if (fc_rule_list_append(&chain->unhinted, rule) != 0) {
+      fc_free_rule_list(&chain->unhinted);
+      return ENOMEM;
+    }
+  }
+  return ENOMEM;
+} /* }}} int fc_chain_compile */
+
+static void fc_candidates_add(fc_candidates_t *c, /* {{{ */
+                              fc_chain_t *chain, char const *plugin,
+                              char const *type) {
+  char key[2 * DATA_MAX_NAME_LEN];
+  fc_rule_list_t *l = NULL;
+
+  fc_index_key(key, sizeof(key), plugin, type);
+  if (c_hashtable_get(chain->index, vl_identity_hash(key), key, (void *)&l) ==
+      0)
+    c->lists[c->lists_num++] = l;
+} /* }}} void fc_candidates_add */
+
+/* Selects the rules of `chain' that `vl' can match, skipping all rules up to
+ * and including position `after' (unless `after' is SIZE_MAX). */
+static void fc_candidates_init(fc_candidates_t *c, /* {{{ */
+                               fc_chain_t *chain, value_list_t const *vl,
+                               size_t after) {
+  c->lists_num = 0;
+  c->lists[c->lists_num++] = &chain->unhinted;
+
+  if (chain->index != NULL) {
+    fc_candidates_add(c, chain, vl->plugin, vl->type);
+    fc_candidates_add(c, chain, vl->plugin, "");
+    fc_candidates_add(c, chain, "", vl->type);
+  }
+
+  for (size_t i = 0; i < c->lists_num; i++) {
+    fc_rule_list_t *l = c->lists[i];
+    c->pos[i] = 0;
+    if (after == SIZE_MAX)
+      continue;
+    while ((c->pos[i] < l->rules_num) &&
+           (l->rules[c->pos[i]]->position <= after))
+      c->pos[i]++;
+  }
+} /* }}} void fc_candidates_init */
+
+/* Returns the next candidate in chain order, or NULL. */
+static fc_rule_t *fc_candidates_next(fc_candidates_t *c) /* {{{ */
+{
+  fc_rule_t *rule = NULL;
+  size_t which = 0;
+
+  for (size_t i = 0; i < c->lists_num; i++) {
+    fc_rule_list_t *l = c->lists[i];
+    if (c->pos[i] >= l->rules_num)
+      continue;
+    if ((rule == NULL) || (l->rules[c->pos[i]]->position < rule->position)) {
+      rule = l->rules[c->pos[i]];
+      which = i;
+    }
+  }
+
+  if (rule != NULL)
+    c->pos[which]++;
+  return rule;
+} /* }}} fc_rule_t *fc_candidates_next */
+
 /*
  * Configuration.
  *
@@ -437,6 +716,8 @@ static int fc_config_add_rule(fc_chain_t *chain, /* {{{ */
     return -1;
   }
 
+  fc_rule_hint(rule);
+
   if (chain->rules != NULL) {
     fc_rule_t *ptr;
 
@@ -445,13 +726,46 @@ static int fc_config_add_rule(fc_chain_t *chain, /* {{{ */
       ptr = ptr->next;
 
     ptr->next = rule;
+    rule->position = ptr->position + 1;
   } else {
     chain->rules = rule;
+    rule->position = 0;
   }
 
+  fc_chain_compile(chain);
   return 0;
 } /* }}} int fc_config_add_rule */
 
+static void fc_free_verdicts(void *v) /* {{{ */
+{
+  free(v);
+} /* }}} void fc_free_verdicts */
+
+static int fc_config_set_cache_size(fc_chain_t *chain, /* {{{ */
+                                    oconfig_item_t *ci) {
+  int size = 0;
+
+  if (cf_util_get_int(ci, &size) != 0)
+    return -1;
+
+  if (chain->cache != NULL) {
+    c_lru_destroy(chain->cache);
+    pthread_mutex_destroy(&chain->cache_lock);
+    chain->cache = NULL;
+  }
+  if (size <= 0)
+    return 0;
+
+  chain->cache = c_lru_create((size_t)size, fc_free_verdicts);
+  if (chain->cache == NULL) {
+    ERROR("Filter subsystem: Chain %s: c_lru_create failed.", chain->name);
+    return -1;
+  }
+  pthread_mutex_init(&chain->cache_lock, /* attr = */ NULL);
+
+  return 0;
+} /* }}} int fc_config_set_cache_size */
+
 static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
 {
   fc_chain_t *chain = NULL;
@@ -485,6 +799,8 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
       status = fc_config_add_rule(chain, option);
     else if (strcasecmp("Target", option->key) == 0)
       status = fc_config_add_target(&chain->targets, option);
+    else if (strcasecmp("CacheSize", option->key) == 0)
+      status = fc_config_set_cache_size(chain, option);
     else {
       WARNING("Filter subsystem: Chain %s: Option `%s' not allowed "
               "inside a <Chain> block.",
@@ -497,7 +813,9 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
   } /* for (ci->children) */
 
   if (status != 0) {
-    fc_free_chains(chain);
+    /* A chain that is on the list already is still referenced. */
+    if (new_chain)
+      fc_free_chains(chain);
     return -1;
   }
 
@@ -855,24 +1173,66 @@ fc_chain_t *fc_chain_get_by_name(const char *chain_name) /* {{{ */
   return NULL;
 } /* }}} int fc_chain_get_by_name */
 
-int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
-                     fc_chain_t *chain) {
-  fc_target_t *target;
-  int status = FC_TARGET_CONTINUE;
+/* Invokes a target. Value lists may be shared with writers that have already
+ * been handed the value list, so they are unshared before any target other
+ * than the built-in ones, which never modify the value list, is run. */
+static int fc_target_invoke(fc_target_t *target, /* {{{ */
+                            const data_set_t *ds, value_list_t *vl) {
+  if ((target->proc.invoke != fc_bit_jump_invoke) &&
+      (target->proc.invoke != fc_bit_stop_invoke) &&
+      (target->proc.invoke != fc_bit_return_invoke) &&
+      (target->proc.invoke != fc_bit_write_invoke))
+    plugin_value_list_unshare(vl);
 
-  if (chain == NULL)
-    return -1;
+  /* FIXME: Pass the meta-data to match targets here (when implemented). */
+  return (*target->proc.invoke)(ds, vl, /* meta = */ NULL, &target->user_data);
+} /* }}} int fc_target_invoke */
+
+/* Records the result of a rule. `start' is zero if the result was taken from
+ * the chain's cache. */
+static void fc_rule_stats_record(fc_rule_t *rule, bool evaluated, /* {{{ */
+                                 bool matched, cdtime_t start) {
+  cdtime_t elapsed = (start != 0) ? cdtime() - start : 0;
+
+#if HAVE_ATOMIC_BUILTINS
+  if (evaluated)
+    __atomic_add_fetch(&rule->evaluated, 1, __ATOMIC_RELAXED);
+  if (matched)
+    __atomic_add_fetch(&rule->matched, 1, __ATOMIC_RELAXED);
+  if (elapsed != 0)
+    __atomic_add_fetch(&rule->time_total, (uint64_t)elapsed, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&fc_stats_lock);
+  if (evaluated)
+    rule->evaluated++;
+  if (matched)
+    rule->matched++;
+  rule->time_total += (uint64_t)elapsed;
+  pthread_mutex_unlock(&fc_stats_lock);
+#endif
+} /* }}} void fc_rule_stats_record */
+
+/* Evaluates the rule's matches and, if all of them match, invokes its targets.
+ * Sets `matched' accordingly and returns the status of the last target. If
+ * `verdict' is not NULL, a known verdict is used instead of evaluating the
+ * matches, and an unknown one is set once the matches have been evaluated. */
+static int fc_process_rule(const data_set_t *ds, value_list_t *vl, /* {{{ */
+                           fc_chain_t *chain, fc_rule_t *rule,
+                           uint8_t *verdict, bool *matched) {
+  int status = FC_TARGET_CONTINUE;
 
-  DEBUG("fc_process_chain (chain = %s);", chain->name);
+  if (rule->name[0] != 0) {
+    DEBUG("fc_process_chain (%s): Testing the `%s' rule.", chain->name,
+          rule->name);
+  }
 
-  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+  if ((verdict != NULL) && (*verdict != FC_VERDICT_UNKNOWN)) {
+    *matched = (*verdict == FC_VERDICT_MATCH);
+    fc_rule_stats_record(rule, /* evaluated = */ false, *matched,
+                         /* start = */ 0);
+  } else {
     fc_match_t *match;
-    status = FC_TARGET_CONTINUE;
-
-    if (rule->name[0] != 0) {
-      DEBUG("fc_process_chain (%s): Testing the `%s' rule.", chain->name,
-            rule->name);
-    }
+    cdtime_t start = fc_record_statistics ? cdtime() : 0;
 
     /* N. B.: rule->matches may be NULL. */
     for (match = rule->matches; match != NULL; match = match->next) {
@@ -887,48 +1247,187 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
     }
 
     /* for-loop has been aborted: Either error or no match. */
-    if (match != NULL) {
-      status = FC_TARGET_CONTINUE;
+    *matched = (match == NULL);
+    fc_rule_stats_record(rule, /* evaluated = */ true, *matched, start);
+
+    /* Failures are not cached. */
+    if ((verdict != NULL) && (status >= 0))
+      *verdict = *matched ? FC_VERDICT_MATCH : FC_VERDICT_NO_MATCH;
+  }
+
+  if (!*matched)
+    return FC_TARGET_CONTINUE;
+
+  if (rule->name[0] != 0) {
+    DEBUG("fc_process_chain (%s): Rule `%s' matches.", chain->name,
+          rule->name);
+  }
+
+  status = FC_TARGET_CONTINUE;
+  for (fc_target_t *target = rule->targets; target != NULL;
+       target = target->next) {
+    /* If we get here, all matches have matched the value. Execute the
+     * target. */
+    status = fc_target_invoke(target, ds, vl);
+    if (status < 0) {
+      WARNING("fc_process_chain (%s): A target failed.", chain->name);
       continue;
+    } else if (status == FC_TARGET_CONTINUE)
+      continue;
+    else if (status == FC_TARGET_STOP)
+      break;
+    else if (status == FC_TARGET_RETURN)
+      break;
+    else {
+      WARNING("fc_process_chain (%s): Unknown return value "
+              "from target `%s': %i",
+              chain->name, target->name, status);
     }
+  }
 
+  if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN)) {
     if (rule->name[0] != 0) {
-      DEBUG("fc_process_chain (%s): Rule `%s' matches.", chain->name,
-            rule->name);
+      DEBUG("fc_process_chain (%s): Rule `%s' signaled "
+            "the %s condition.",
+            chain->name, rule->name,
+            (status == FC_TARGET_STOP) ? "stop" : "return");
     }
+  }
 
-    for (target = rule->targets; target != NULL; target = target->next) {
-      /* If we get here, all matches have matched the value. Execute the
-       * target. */
-      /* FIXME: Pass the meta-data to match targets here (when implemented). */
-      status =
-          (*target->proc.invoke)(ds, vl, /* meta = */ NULL, &target->user_data);
-      if (status < 0) {
-        WARNING("fc_process_chain (%s): A target failed.", chain->name);
-        continue;
-      } else if (status == FC_TARGET_CONTINUE)
-        continue;
-      else if (status == FC_TARGET_STOP)
-        break;
-      else if (status == FC_TARGET_RETURN)
-        break;
-      else {
-        WARNING("fc_process_chain (%s): Unknown return value "
-                "from target `%s': %i",
-                chain->name, target->name, status);
+  return status;
+} /* }}} int fc_process_rule */
+
+static void fc_cache_count(uint64_t *counter) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&fc_stats_lock);
+  (*counter)++;
+  pthread_mutex_unlock(&fc_stats_lock);
+#endif
+} /* }}} void fc_cache_count */
+
+/* Copies the cached verdicts for `id' to `verdicts', or marks all of them
+ * unknown if there are none. */
+static void fc_cache_get(fc_chain_t *chain, /* {{{ */
+                         vl_identity_t const *id, uint8_t *verdicts,
+                         size_t verdicts_num) {
+  fc_verdicts_t *v = NULL;
+  bool found = false;
+
+  pthread_mutex_lock(&chain->cache_lock);
+  if ((c_lru_get(chain->cache, id->hash, (void *)&v) == 0) &&
+      (v->verdicts_num == verdicts_num) && (strcmp(v->name, id->name) == 0)) {
+    memcpy(verdicts, v->verdicts, verdicts_num);
+    found = true;
+  }
+  pthread_mutex_unlock(&chain->cache_lock);
+
+  if (!found)
+    memset(verdicts, FC_VERDICT_UNKNOWN, verdicts_num);
+  fc_cache_count(found ? &chain->cache_hits : &chain->cache_misses);
+} /* }}} void fc_cache_get */
+
+/* Stores `verdicts', merged with those cached in the meantime, for `id'. */
+static void fc_cache_put(fc_chain_t *chain, /* {{{ */
+                         vl_identity_t const *id, uint8_t const *verdicts,
+                         size_t verdicts_num) {
+  size_t name_size = strlen(id->name) + 1;
+  fc_verdicts_t *v = malloc(sizeof(*v) + verdicts_num + name_size);
+  if (v == NULL)
+    return;
+
+  v->verdicts_num = verdicts_num;
+  memcpy(v->verdicts, verdicts, verdicts_num);
+  v->name = (char *)v->verdicts + verdicts_num;
+  memcpy(v->name, id->name, name_size);
+
+  pthread_mutex_lock(&chain->cache_lock);
+  fc_verdicts_t *old = NULL;
+  if ((c_lru_get(chain->cache, id->hash, (void *)&old) == 0) &&
+      (old->verdicts_num == verdicts_num) &&
+      (strcmp(old->name, id->name) == 0)) {
+    for (size_t i = 0; i < verdicts_num; i++)
+      if (v->verdicts[i] == FC_VERDICT_UNKNOWN)
+        v->verdicts[i] = old->verdicts[i];
+  }
+  c_lru_put(chain->cache, id->hash, v);
+  pthread_mutex_unlock(&chain->cache_lock);
+} /* }}} void fc_cache_put */
+
+static int fc_process_chain_rules(const data_set_t *ds, /* {{{ */
+                                  value_list_t *vl, fc_chain_t *chain) {
+  fc_target_t *target;
+  int status = FC_TARGET_CONTINUE;
+
+  if (chain == NULL)
+    return -1;
+
+  DEBUG("fc_process_chain (chain = %s);", chain->name);
+
+  /* The fields the candidates were selected by. Only needed with an index. */
+  char plugin[sizeof(vl->plugin)] = "";
+  char type[sizeof(vl->type)] = "";
+  if (chain->index != NULL) {
+    sstrncpy(plugin, vl->plugin, sizeof(plugin));
+    sstrncpy(type, vl->type, sizeof(type));
+  }
+
+  /* Cached verdicts of the pure rules, looked up when the first pure rule is
+   * reached. They are only used while the value list matches its identity,
+   * i.e. until a target modifies it. A reference keeps the identity around
+   * for fc_cache_put() once something was learned. */
+  uint8_t verdicts[FC_VERDICTS_MAX];
+  size_t verdicts_num = (chain->rules_num < FC_VERDICTS_MAX) ? chain->rules_num
+                                                             : FC_VERDICTS_MAX;
+  vl_identity_t const *id =
+      (chain->cache != NULL) ? plugin_value_list_identity(vl) : NULL;
+  bool cache_usable = (id != NULL);
+  bool looked_up = false;
+  bool learned = false;
+
+  fc_candidates_t candidates;
+  fc_candidates_init(&candidates, chain, vl, /* after = */ SIZE_MAX);
+
+  fc_rule_t *rule;
+  while ((rule = fc_candidates_next(&candidates)) != NULL) {
+    bool matched = false;
+    uint8_t *verdict = NULL;
+
+    if (cache_usable && rule->pure && (rule->position < verdicts_num)) {
+      if (!looked_up) {
+        fc_cache_get(chain, id, verdicts, verdicts_num);
+        looked_up = true;
+      }
+      verdict = verdicts + rule->position;
+      if ((*verdict == FC_VERDICT_UNKNOWN) && !learned) {
+        vl_identity_ref(id);
+        learned = true;
       }
     }
 
-    if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN)) {
-      if (rule->name[0] != 0) {
-        DEBUG("fc_process_chain (%s): Rule `%s' signaled "
-              "the %s condition.",
-              chain->name, rule->name,
-              (status == FC_TARGET_STOP) ? "stop" : "return");
-      }
+    status = fc_process_rule(ds, vl, chain, rule, verdict, &matched);
+
+    if (matched && cache_usable && (plugin_value_list_identity(vl) != id))
+      cache_usable = false;
+
+    if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN))
       break;
+
+    /* Targets may have changed the fields the index is keyed by. */
+    if (matched && (chain->index != NULL) &&
+        ((strcmp(plugin, vl->plugin) != 0) || (strcmp(type, vl->type) != 0))) {
+      sstrncpy(plugin, vl->plugin, sizeof(plugin));
+      sstrncpy(type, vl->type, sizeof(type));
+      fc_candidates_init(&candidates, chain, vl, rule->position);
     }
-  } /* for (rule) */
+  } /* while (rule) */
+
+  if (learned) {
+    fc_cache_put(chain, id, verdicts, verdicts_num);
+    vl_identity_release(id);
+  }
 
   if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN))
     return status;
@@ -939,9 +1438,7 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
   for (target = chain->targets; target != NULL; target = target->next) {
     /* If we get here, all matches have matched the value. Execute the
      * target. */
-    /* FIXME: Pass the meta-data to match targets here (when implemented). */
-    status =
-        (*target->proc.invoke)(ds, vl, /* meta = */ NULL, &target->user_data);
+    status = fc_target_invoke(target, ds, vl);
     if (status < 0) {
       WARNING("fc_process_chain (%s): The default target failed.", chain->name);
     } else if (status == FC_TARGET_CONTINUE)
@@ -973,6 +1470,17 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
         chain->name);
 
   return FC_TARGET_CONTINUE;
+} /* }}} int fc_process_chain_rules */
+
+int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
+                     fc_chain_t *chain) {
+  if (chain == NULL)
+    return -1;
+
+  COLLECTD_PROBE1(chain_start, chain->name);
+  int status = fc_process_chain_rules(ds, vl, chain);
+  COLLECTD_PROBE2(chain_done, chain->name, status);
+  return status;
 } /* }}} int fc_process_chain */
 
 /* Iterate over all rules in the chain and execute all targets for which all
@@ -983,6 +1491,79 @@ int fc_default_action(const data_set_t *ds, value_list_t *vl) /* {{{ */
   return fc_bit_write_invoke(ds, vl, NULL, NULL);
 } /* }}} int fc_default_action */
 
+void fc_enable_statistics(void) /* {{{ */
+{
+  fc_record_statistics = true;
+} /* }}} void fc_enable_statistics */
+
+int fc_chain_stats_foreach(int (*callback)(fc_chain_stats_t const *stats, /* {{{ */
+                                           void *user_data),
+                           void *user_data) {
+  for (fc_chain_t *chain = chain_list_head; chain != NULL;
+       chain = chain->next) {
+    if (chain->cache == NULL)
+      continue;
+
+    fc_chain_stats_t stats = {
+        .chain = chain->name,
+    };
+#if HAVE_ATOMIC_BUILTINS
+    stats.cache_hits = __atomic_load_n(&chain->cache_hits, __ATOMIC_RELAXED);
+    stats.cache_misses =
+        __atomic_load_n(&chain->cache_misses, __ATOMIC_RELAXED);
+#else
+    pthread_mutex_lock(&fc_stats_lock);
+    stats.cache_hits = chain->cache_hits;
+    stats.cache_misses = chain->cache_misses;
+    pthread_mutex_unlock(&fc_stats_lock);
+#endif
+
+    int status = (*callback)(&stats, user_data);
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int fc_chain_stats_foreach */
+
+int fc_rule_stats_foreach(int (*callback)(fc_rule_stats_t const *stats, /* {{{ */
+                                          void *user_data),
+                          void *user_data) {
+  for (fc_chain_t *chain = chain_list_head; chain != NULL;
+       chain = chain->next) {
+    for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+      char name[DATA_MAX_NAME_LEN];
+      if (rule->name[0] != 0)
+        sstrncpy(name, rule->name, sizeof(name));
+      else
+        ssnprintf(name, sizeof(name), "rule%zu", rule->position);
+
+      fc_rule_stats_t stats = {
+          .chain = chain->name,
+          .rule = name,
+      };
+#if HAVE_ATOMIC_BUILTINS
+      stats.evaluated = __atomic_load_n(&rule->evaluated, __ATOMIC_RELAXED);
+      stats.matched = __atomic_load_n(&rule->matched, __ATOMIC_RELAXED);
+      stats.time_total =
+          (cdtime_t)__atomic_load_n(&rule->time_total, __ATOMIC_RELAXED);
+#else
+      pthread_mutex_lock(&fc_stats_lock);
+      stats.evaluated = rule->evaluated;
+      stats.matched = rule->matched;
+      stats.time_total = (cdtime_t)rule->time_total;
+      pthread_mutex_unlock(&fc_stats_lock);
+#endif
+
+      int status = (*callback)(&stats, user_data);
+      if (status != 0)
+        return status;
+    }
+  }
+
+  return 0;
+} /* }}} int fc_rule_stats_foreach */
+
 int fc_configure(const oconfig_item_t *ci) /* {{{ */
 {
   fc_init_once();
@@ -997,3 +1578,25 @@ int fc_configure(const oconfig_item_t *ci) /* {{{ */
 
   return -1;
 } /* }}} int fc_configure */
+
+int fc_reconfigure(oconfig_item_t const *const *blocks, size_t num) /* {{{ */
+{
+  fc_init_once();
+
+  /* fc_config_add_chain() merges blocks into the chains on the list, so the
+   * new chains are built on an empty list. */
+  fc_chain_t *old_head = chain_list_head;
+  chain_list_head = NULL;
+
+  for (size_t i = 0; i < num; i++) {
+    int status = fc_configure(blocks[i]);
+    if (status != 0) {
+      fc_free_chains(chain_list_head);
+      chain_list_head = old_head;
+      return status;
+    }
+  }
+
+  fc_free_chains(old_head);
+  return 0;
+} /* }}} int fc_reconfigure */
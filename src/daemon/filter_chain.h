@@ -41,11 +41,28 @@
 /*
  * Match functions
  */
+/* Fields a value list must have literally for a match to succeed. Empty
+ * strings don't constrain the field. Chains use these hints to skip rules that
+ * cannot match a value list. */
+struct fc_match_hint_s {
+  char plugin[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  /* Set if the result of the match only depends on the identifier (host,
+   * plugin, plugin instance, type and type instance) of the value list, so
+   * that chains may cache it, see the CacheSize option of <Chain> blocks. */
+  bool pure;
+};
+typedef struct fc_match_hint_s fc_match_hint_t;
+
 struct match_proc_s {
   int (*create)(const oconfig_item_t *ci, void **user_data);
   int (*destroy)(void **user_data);
   int (*match)(const data_set_t *ds, const value_list_t *vl,
                notification_meta_t **meta, void **user_data);
+  /* Optional. Fills in `hint' after `create' succeeded. If the match never
+   * succeeds for a value list that does not have the hinted fields, the rule
+   * is only evaluated for value lists that do. */
+  int (*hint)(void **user_data, fc_match_hint_t *hint);
 };
 typedef struct match_proc_s match_proc_t;
 
@@ -95,9 +112,53 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, fc_chain_t *chain);
 
 int fc_default_action(const data_set_t *ds, value_list_t *vl);
 
+/*
+ * Statistics
+ */
+struct fc_rule_stats_s {
+  char const *chain;
+  /* The rule's name or, for unnamed rules, "rule<position>". */
+  char const *rule;
+  /* Number of value lists the rule's matches were evaluated for, that the
+   * rule matched, including results taken from the chain's cache, and the time
+   * spent evaluating the matches. The time is only measured after
+   * fc_enable_statistics() has been called. */
+  uint64_t evaluated;
+  uint64_t matched;
+  cdtime_t time_total;
+};
+typedef struct fc_rule_stats_s fc_rule_stats_t;
+
+struct fc_chain_stats_s {
+  char const *chain;
+  /* Number of value lists the chain's cache had results for, and didn't. */
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+};
+typedef struct fc_chain_stats_s fc_chain_stats_t;
+
+void fc_enable_statistics(void);
+
+/* Calls `callback' for every chain with a cache. Stops and returns the status
+ * if the callback returns non-zero. */
+int fc_chain_stats_foreach(int (*callback)(fc_chain_stats_t const *stats,
+                                           void *user_data),
+                           void *user_data);
+
+/* Calls `callback' for every rule of every chain. Stops and returns the status
+ * if the callback returns non-zero. */
+int fc_rule_stats_foreach(int (*callback)(fc_rule_stats_t const *stats,
+                                          void *user_data),
+                          void *user_data);
+
 /*
  * Shortcut for global configuration
  */
 int fc_configure(const oconfig_item_t *ci);
 
+/* Replaces all chains with the chains configured by the `num' <Chain> blocks.
+ * If one of the blocks fails, the old chains are kept. The caller must make
+ * sure no chain is processed concurrently. */
+int fc_reconfigure(oconfig_item_t const *const *blocks, size_t num);
+
 #endif /* FILTER_CHAIN_H */
@@ -33,13 +33,21 @@
 #include "configfile.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "probes.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/config_cores/config_cores.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/heap/heap.h"
+#include "utils/mempool/mempool.h"
+#include "utils/memtrack/memtrack.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
+#include "utils_downsample.h"
+#include "utils_identity.h"
 #include "utils_llist.h"
 #include "utils_random.h"
+#include "utils_spool.h"
 #include "utils_time.h"
 
 #ifdef WIN32
@@ -54,15 +62,46 @@
 #include <pthread_np.h> /* for pthread_set_name_np(3) */
 #endif
 
+#if HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+#include <sched.h>
+#endif
+
 #include <dlfcn.h>
 
+#if HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
 /*
  * Private structures
  */
+struct writer_queue_s;
+typedef struct writer_queue_s writer_queue_t;
+
+/* Execution time statistics of a callback. Only recorded if
+ * "CollectInternalStats" is enabled. Times are cdtime_t values. */
+struct callback_stats_s {
+  uint64_t calls;
+  uint64_t time_total;
+  /* Maximum since the statistics were last reported. */
+  uint64_t time_max;
+  /* Number of calls that took longer than the callback's interval. */
+  uint64_t overruns;
+};
+typedef struct callback_stats_s callback_stats_t;
+
 struct callback_func_s {
   void *cf_callback;
   user_data_t cf_udata;
   plugin_ctx_t cf_ctx;
+  /* Dedicated delivery queue; only used by write callbacks. */
+  writer_queue_t *cf_queue;
+  /* Set for write callbacks registered with plugin_register_write_batch(). */
+  bool cf_batch;
+  /* Per-series state if the writer receives downsampled values, see
+   * "DownsampleInterval"; only used by write callbacks. */
+  downsample_t *cf_downsample;
+  callback_stats_t cf_stats;
 };
 typedef struct callback_func_s callback_func_t;
 
@@ -82,6 +121,7 @@ struct read_func_s {
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+  size_t rf_heap_index; /* see c_heap_create_indexed() */
 };
 typedef struct read_func_s read_func_t;
 
@@ -93,20 +133,230 @@ struct cache_event_func_s {
 };
 typedef struct cache_event_func_s cache_event_func_t;
 
+/* Value lists copied by plugin_value_list_clone() are reference counted, so
+ * that the write queue, writer queues and "write_batch" callbacks can share a
+ * single copy. Once shared, a value list must not be modified; the filter
+ * chain calls plugin_value_list_unshare() before running targets that may. */
+struct shared_value_list_s {
+  /* Must be the first member, so the value_list_t pointer handed out can be
+   * converted back. */
+  value_list_t vl;
+  long refcount;
+  /* Interned identity of `vl', set by plugin_dispatch_values_internal(). NULL
+   * if interning failed or `vl' has been modified by the filter chain. */
+  vl_identity_t const *identity;
+  /* Data set of `vl', if the dispatching plugin already looked it up. */
+  data_set_t const *ds;
+  /* Set if allocated from `value_list_pool'. */
+  bool pooled;
+  value_t values[];
+};
+typedef struct shared_value_list_s shared_value_list_t;
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
 struct write_queue_s {
   value_list_t *vl;
   plugin_ctx_t ctx;
+  /* Only set for entries in a writer queue. */
+  const data_set_t *ds;
   write_queue_t *next;
 };
 
+/* The write queue is split into shards, each protected by its own lock, so
+ * that read threads dispatching values don't all contend on one mutex. Each
+ * producing thread sticks to one shard; write threads drain their "home" shard
+ * in batches and take work from the other shards when it runs empty. */
+struct write_queue_shard_s {
+  pthread_mutex_t lock;
+  write_queue_t *head;
+  write_queue_t *tail;
+  long length;
+};
+typedef struct write_queue_shard_s write_queue_shard_t;
+
+/* Maximum number of value lists a write thread takes off a shard at once.
+ * This is also the largest batch passed to "write_batch" callbacks. */
+#define WRITE_QUEUE_BATCH_SIZE 256
+
+/* Value lists with up to this many values are allocated from
+ * `value_list_pool'. */
+#define VALUE_LIST_POOL_VALUES 4
+
+/* A value list waiting to be passed to a "write_batch" callback or a writer
+ * queue. Each entry holds a reference to `vl'. */
+struct write_batch_value_s {
+  callback_func_t *cf;
+  const data_set_t *ds;
+  /* NULL while the entry refers to the value list currently being dispatched
+   * and no reference has been taken yet. */
+  value_list_t *vl;
+  plugin_ctx_t ctx;
+};
+typedef struct write_batch_value_s write_batch_value_t;
+
+/* Per write thread collection of values for "write_batch" callbacks and
+ * writer queues. Values are added by plugin_write() while the thread works
+ * through a batch from the write queue and are passed on by
+ * plugin_write_batch_flush(). */
+struct write_batch_s {
+  write_batch_value_t *values;
+  size_t values_num;
+  size_t values_size;
+  /* Entries before this index all hold a reference. */
+  size_t values_bound;
+  /* The value list currently being dispatched by the write thread. Entries
+   * for it only take a reference once the filter chain is done with it or is
+   * about to modify it, so that usually no copy is needed at all. */
+  value_list_t *current;
+  /* Scratch buffer with room for `values_size' entries. */
+  write_batch_entry_t *entries;
+};
+typedef struct write_batch_s write_batch_t;
+
+/* A writer queue decouples one write callback from the write threads: values
+ * are queued here by plugin_write() and delivered by the queue's own threads,
+ * so a slow or hanging sink only delays itself. */
+struct writer_queue_s {
+  char *name;
+  callback_func_t *cf;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  write_queue_t *head;
+  write_queue_t *tail;
+  long length;
+  long limit;
+  bool drop_oldest;
+  derive_t dropped;
+
+  /* Disk spool, see "WriteQueueSpool". Values go to the spool once the
+   * queue is full or the write callback failed, and are replayed from there
+   * once the queue is empty. While the spool is not empty, `spooling' is set
+   * and new values go to the spool directly, so they stay in order. */
+  spool_t *spool;
+  bool spooling;
+  bool replaying;
+  double replay_rate;
+  cdtime_t replay_next;
+  cdtime_t retry_interval;
+  derive_t spooled;
+
+  bool loop;
+  pthread_t *threads;
+  size_t threads_num;
+};
+
 struct flush_callback_s {
   char *name;
   cdtime_t timeout;
 };
 typedef struct flush_callback_s flush_callback_t;
 
+/* A flush of one writer, queued for the flush threads. */
+struct flush_job_s {
+  char *plugin;
+  char *identifier;
+  cdtime_t timeout;
+  plugin_flush_done_cb done;
+  void *done_ud;
+  struct flush_job_s *next;
+};
+typedef struct flush_job_s flush_job_t;
+
+/* Ordering constraint between init callbacks, see
+ * plugin_register_init_dependency(). */
+struct init_dependency_s;
+typedef struct init_dependency_s init_dependency_t;
+struct init_dependency_s {
+  char *name;
+  char *depends_on;
+  init_dependency_t *next;
+};
+
+typedef enum {
+  INIT_PENDING,
+  INIT_RUNNING,
+  INIT_DONE,
+} init_state_t;
+
+struct init_task_s {
+  char name[DATA_MAX_NAME_LEN];
+  plugin_init_cb callback;
+  plugin_ctx_t ctx;
+  init_state_t state;
+  int status;
+};
+typedef struct init_task_s init_task_t;
+
+/* Init callbacks being run by plugin_init_all(). */
+struct init_queue_s {
+  init_task_t *tasks;
+  size_t tasks_num;
+  size_t running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+typedef struct init_queue_s init_queue_t;
+
+typedef enum {
+  POOL_THREAD_FREE,
+  POOL_THREAD_RUNNING,
+  /* The thread left the pool because it was not needed; it has to be joined
+   * before the slot can be used again. */
+  POOL_THREAD_EXITED,
+} pool_thread_state_t;
+
+struct thread_pool_s;
+
+/* A slot of a thread pool. `state' is protected by the pool's lock. The
+ * callback the thread is running is only recorded if a "CallbackTimeout" is
+ * configured and is protected by `lock'. */
+struct pool_thread_s {
+  pthread_t tid;
+  struct thread_pool_s *pool;
+  size_t index;
+  pool_thread_state_t state;
+
+  pthread_mutex_t lock;
+  cdtime_t busy_since;
+  char busy_name[DATA_MAX_NAME_LEN];
+  bool stuck;
+};
+typedef struct pool_thread_s pool_thread_t;
+
+/* The read and write threads. A pool grows from `min' towards `max' threads
+ * while read callbacks are overdue or values back up in the write queue, and
+ * shrinks again when threads stayed idle for "ThreadIdleTimeout". Threads
+ * stuck in a callback for longer than "CallbackTimeout" do not count towards
+ * `max', so the pool can replace them, up to `threads_size' threads in total.
+ * Apart from the slots' busy state, everything is protected by `lock'. */
+struct thread_pool_s {
+  char const *name;
+  pthread_mutex_t *lock;
+  pthread_cond_t *cond; /* idle threads wait on this */
+  plugin_cpus_t *cpus;
+  void *(*start_routine)(void *);
+
+  pool_thread_t *threads;
+  size_t threads_size;
+  size_t threads_num;
+  size_t threads_idle;
+  size_t threads_stuck;
+  size_t min;
+  size_t max;
+
+  /* Number of idle threads that should leave the pool. */
+  size_t exit_pending;
+  /* Fewest idle threads seen since `window_start'. */
+  size_t idle_min;
+  cdtime_t window_start;
+
+  derive_t started;
+  derive_t stopped;
+};
+typedef struct thread_pool_s thread_pool_t;
+
 /*
  * Private variables
  */
@@ -117,16 +367,27 @@ static llist_t *list_write;
 static llist_t *list_flush;
 static llist_t *list_missing;
 static llist_t *list_shutdown;
+static llist_t *list_reload;
 static llist_t *list_log;
 static llist_t *list_notification;
+/* Protects the callback lists above against init callbacks registering
+ * callbacks concurrently, see "InitThreads". */
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static init_dependency_t *init_dependencies;
 
 static size_t list_cache_event_num;
 static cache_event_func_t list_cache_event[32];
 
 static fc_chain_t *pre_cache_chain;
 static fc_chain_t *post_cache_chain;
+/* Held for reading while the chains are processed and for writing while they
+ * are replaced, see plugin_reload_chains(). */
+static pthread_rwlock_t chains_lock = PTHREAD_RWLOCK_INITIALIZER;
 
-static c_avl_tree_t *data_sets;
+/* Data sets by type name, hashed with vl_identity_hash(). */
+static c_hashtable_t *data_sets;
+static memtrack_t *data_set_memtrack;
 
 static char *plugindir;
 
@@ -138,18 +399,81 @@ static llist_t *read_list;
 static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t *read_threads;
-static size_t read_threads_num;
+/* Read threads use a leader/followers scheme: one read thread, the leader,
+ * waits on `read_leader_cond' for the next read function to become due. All
+ * other idle read threads wait on `read_cond'. When the leader's read function
+ * is due, it wakes exactly one follower to take over as leader before calling
+ * the function. `read_leader_next' is the time the leader is waiting for, or
+ * zero if the heap was empty. All of these are protected by `read_lock'. */
+static bool read_leader;
+static cdtime_t read_leader_next;
+static pthread_cond_t read_leader_cond = PTHREAD_COND_INITIALIZER;
+static plugin_cpus_t read_threads_cpus;
+static void *plugin_read_thread(void *args);
+static thread_pool_t read_pool = {
+    .name = "reader",
+    .lock = &read_lock,
+    .cond = &read_cond,
+    .cpus = &read_threads_cpus,
+    .start_routine = plugin_read_thread,
+};
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
 
-static write_queue_t *write_queue_head;
-static write_queue_t *write_queue_tail;
+static write_queue_shard_t *write_queue_shards;
+static size_t write_queue_shards_num;
+static pthread_once_t write_queue_once = PTHREAD_ONCE_INIT;
+static pthread_key_t write_queue_shard_key;
+static pthread_key_t write_batch_key;
+/* The shared_value_list_t whose identity plugin_value_list_identity() returns
+ * on this thread. */
+static pthread_key_t dispatch_identity_key;
+/* Pools for the value list copies and queue entries made for every dispatched
+ * value, which are usually allocated and freed on different threads. */
+static c_mempool_t *value_list_pool;
+static c_mempool_t *write_queue_pool;
+/* Value lists with too many values for the pool are charged to the pool's
+ * tag. */
+static memtrack_t *value_list_memtrack;
+static long write_queue_next_shard;
+/* write_queue_length and write_threads_waiting are accessed with atomic
+ * operations if available, or with write_counter_lock held otherwise. */
 static long write_queue_length;
+static long write_threads_waiting;
+/* Number of value lists enqueued while plugin_bench_all() counts them. Also
+ * accessed with write_counter_add() and write_counter_get(). */
+static bool bench_count_values;
+static long bench_values_num;
+/* Number of values dropped because of "SuppressUnchanged". */
+static long values_suppressed;
+#if !HAVE_ATOMIC_BUILTINS
+static pthread_mutex_t write_counter_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 static bool write_loop = true;
+/* write_lock and write_cond are only used by idle write threads waiting for
+ * new values; enqueueing a value only touches them if a thread is waiting. */
 static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t *write_threads;
-static size_t write_threads_num;
+static plugin_cpus_t write_threads_cpus;
+static void *plugin_write_thread(void *args);
+static thread_pool_t write_pool = {
+    .name = "writer",
+    .lock = &write_lock,
+    .cond = &write_cond,
+    .cpus = &write_threads_cpus,
+    .start_routine = plugin_write_thread,
+};
+/* See "ThreadIdleTimeout" and "CallbackTimeout". */
+static cdtime_t thread_idle_timeout;
+static cdtime_t callback_timeout;
+/* The calling thread's pool_thread_t, if it belongs to a thread pool. */
+static pthread_key_t pool_thread_key;
+/* The watchdog resizes the thread pools and reports stuck callbacks. */
+static pthread_t pool_watchdog;
+static bool pool_watchdog_running;
+static bool pool_watchdog_loop;
+static pthread_mutex_t pool_watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_watchdog_cond = PTHREAD_COND_INITIALIZER;
+static bool writer_queues_started;
 
 static pthread_key_t plugin_ctx_key;
 static bool plugin_ctx_key_initialized;
@@ -157,14 +481,91 @@ static bool plugin_ctx_key_initialized;
 static long write_limit_high;
 static long write_limit_low;
 
+/* Number of priority classes, PLUGIN_PRIORITY_LOW to PLUGIN_PRIORITY_CRITICAL.
+ */
+#define PRIORITY_CLASSES_NUM 4
+static char const *const priority_class_names[PRIORITY_CLASSES_NUM] = {
+    "low", "normal", "high", "critical"};
+
 static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 static derive_t stats_values_dropped;
+static derive_t stats_values_dropped_class[PRIORITY_CLASSES_NUM];
 static bool record_statistics;
 
+/* Asynchronous notifications, see "NotificationQueueLength". Queued
+ * notifications are delivered in FIFO order by the notification threads.
+ * Queued notifications without meta data are indexed by their contents in
+ * `notif_index', so that duplicates are coalesced into the queued one. All of
+ * these are protected by `notif_lock'. */
+typedef struct notif_entry_s {
+  notification_t n;
+  plugin_ctx_t ctx;
+  /* Key in `notif_index', NULL if not indexed. */
+  char *key;
+  uint64_t hash;
+  struct notif_entry_s *next;
+} notif_entry_t;
+
+static notif_entry_t *notif_head;
+static notif_entry_t *notif_tail;
+static c_hashtable_t *notif_index;
+static size_t notif_length;
+/* Set once by start_notification_threads(); zero dispatches synchronously. */
+static size_t notif_limit;
+static derive_t notif_dropped;
+static derive_t notif_coalesced;
+/* Drops not reported in the log yet. */
+static uint64_t notif_dropped_unreported;
+static bool notif_loop;
+static pthread_mutex_t notif_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notif_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *notif_threads;
+static size_t notif_threads_num;
+
+/* Asynchronous cache events, see "CacheEventQueueLength". The NEW and UPDATE
+ * events raised by the value cache are queued under `cache_event_lock' and
+ * delivered in batches, in FIFO order, by a single thread. */
+typedef struct cache_event_entry_s {
+  enum cache_event_type_e type;
+  unsigned long callbacks_mask;
+  char *name;
+  value_list_t *vl;
+  struct cache_event_entry_s *next;
+} cache_event_entry_t;
+
+static cache_event_entry_t *cache_event_head;
+static cache_event_entry_t *cache_event_tail;
+static size_t cache_event_length;
+/* Set once by start_cache_event_thread(); zero delivers synchronously. */
+static size_t cache_event_limit;
+static derive_t cache_event_dropped;
+/* Drops not reported in the log yet. */
+static uint64_t cache_event_dropped_unreported;
+static bool cache_event_loop;
+static bool cache_event_thread_running;
+static pthread_t cache_event_thread;
+static pthread_mutex_t cache_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_event_cond = PTHREAD_COND_INITIALIZER;
+
+/* With "FlushThreads" set, the flush callbacks are called by a pool of flush
+ * threads, so a slow writer does not hold up the others. */
+static flush_job_t *flush_head;
+static flush_job_t *flush_tail;
+static size_t flush_length;
+static bool flush_loop;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *flush_threads;
+static size_t flush_threads_num;
+#if !HAVE_ATOMIC_BUILTINS
+static pthread_mutex_t callback_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
  * Static functions
  */
 static int plugin_dispatch_values_internal(value_list_t *vl);
+static bool check_drop_value(void);
 
 static const char *plugin_get_dir(void) {
   if (plugindir == NULL)
@@ -173,8 +574,268 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+static long write_counter_add(long *counter, long n) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  return __atomic_add_fetch(counter, n, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock(&write_counter_lock);
+  long ret = (*counter += n);
+  pthread_mutex_unlock(&write_counter_lock);
+  return ret;
+#endif
+} /* }}} long write_counter_add */
+
+static long write_counter_get(long *counter) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock(&write_counter_lock);
+  long ret = *counter;
+  pthread_mutex_unlock(&write_counter_lock);
+  return ret;
+#endif
+} /* }}} long write_counter_get */
+
+#define MEMPOOL_STATS_MAX 16
+
+struct mempool_stats_s {
+  char name[DATA_MAX_NAME_LEN];
+  uint64_t hits;
+  uint64_t misses;
+};
+typedef struct mempool_stats_s mempool_stats_t;
+
+struct mempool_stats_list_s {
+  mempool_stats_t stats[MEMPOOL_STATS_MAX];
+  size_t num;
+};
+typedef struct mempool_stats_list_s mempool_stats_list_t;
+
+/* Collects the pools' statistics. They are dispatched after the iteration, so
+ * that allocating from a pool cannot deadlock with the pool list's lock. */
+static int plugin_collect_mempool_stats(c_mempool_t *pool, /* {{{ */
+                                        void *user_data) {
+  mempool_stats_list_t *list = user_data;
+  if (list->num >= MEMPOOL_STATS_MAX)
+    return 0;
+
+  mempool_stats_t *st = list->stats + list->num;
+  sstrncpy(st->name, c_mempool_name(pool), sizeof(st->name));
+  c_mempool_stats(pool, &st->hits, &st->misses);
+  list->num++;
+
+  return 0;
+} /* }}} int plugin_collect_mempool_stats */
+
+static int plugin_dispatch_memtrack(memtrack_t *tag, void *user_data) /* {{{ */
+{
+  value_list_t *vl = user_data;
+
+  vl->values = &(value_t){.gauge = (gauge_t)memtrack_bytes(tag)};
+  sstrncpy(vl->type_instance, memtrack_name(tag), sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  return 0;
+} /* }}} int plugin_dispatch_memtrack */
+
+/* Returns the start time of a callback if statistics are recorded, zero
+ * otherwise. */
+static cdtime_t callback_stats_start(void) /* {{{ */
+{
+  return record_statistics ? cdtime() : 0;
+} /* }}} cdtime_t callback_stats_start */
+
+static void callback_stats_record(callback_func_t *cf, /* {{{ */
+                                  cdtime_t elapsed, bool overrun) {
+  callback_stats_t *st = &cf->cf_stats;
+
+#if HAVE_ATOMIC_BUILTINS
+  __atomic_add_fetch(&st->calls, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&st->time_total, (uint64_t)elapsed, __ATOMIC_RELAXED);
+  if (overrun)
+    __atomic_add_fetch(&st->overruns, 1, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&st->time_max, __ATOMIC_RELAXED);
+  while ((uint64_t)elapsed > max) {
+    if (__atomic_compare_exchange_n(&st->time_max, &max, (uint64_t)elapsed,
+                                    /* weak = */ true, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED))
+      break;
+  }
+#else
+  pthread_mutex_lock(&callback_stats_lock);
+  st->calls++;
+  st->time_total += (uint64_t)elapsed;
+  if (overrun)
+    st->overruns++;
+  if ((uint64_t)elapsed > st->time_max)
+    st->time_max = (uint64_t)elapsed;
+  pthread_mutex_unlock(&callback_stats_lock);
+#endif
+} /* }}} void callback_stats_record */
+
+/* Records a call of `cf' that started at `start', as returned by
+ * callback_stats_start(). */
+static void callback_stats_finish(callback_func_t *cf, /* {{{ */
+                                  cdtime_t start) {
+  if (start == 0)
+    return;
+
+  callback_stats_record(cf, cdtime() - start, /* overrun = */ false);
+} /* }}} void callback_stats_finish */
+
+/* Returns a copy of the statistics and resets the maximum. */
+static callback_stats_t callback_stats_get(callback_func_t *cf) /* {{{ */
+{
+  callback_stats_t *st = &cf->cf_stats;
+  callback_stats_t copy;
+
+#if HAVE_ATOMIC_BUILTINS
+  copy.calls = __atomic_load_n(&st->calls, __ATOMIC_RELAXED);
+  copy.time_total = __atomic_load_n(&st->time_total, __ATOMIC_RELAXED);
+  copy.overruns = __atomic_load_n(&st->overruns, __ATOMIC_RELAXED);
+  copy.time_max = __atomic_exchange_n(&st->time_max, 0, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&callback_stats_lock);
+  copy = *st;
+  st->time_max = 0;
+  pthread_mutex_unlock(&callback_stats_lock);
+#endif
+
+  return copy;
+} /* }}} callback_stats_t callback_stats_get */
+
+/* Dispatches the execution time statistics of a callback as
+ * "collectd-<kind>-<name>". */
+static void callback_stats_dispatch(value_list_t *vl, /* {{{ */
+                                    char const *kind, char const *name,
+                                    callback_func_t *cf, bool with_overruns) {
+  callback_stats_t st = callback_stats_get(cf);
+
+  ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%s-%s", kind,
+            name);
+  vl->values_len = 1;
+
+  vl->values = &(value_t){.derive = (derive_t)st.calls};
+  sstrncpy(vl->type, "operations", sizeof(vl->type));
+  vl->type_instance[0] = 0;
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){
+      .derive = (derive_t)CDTIME_T_TO_MS((cdtime_t)st.time_total)};
+  sstrncpy(vl->type, "total_time_in_ms", sizeof(vl->type));
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE((cdtime_t)st.time_max)};
+  sstrncpy(vl->type, "duration", sizeof(vl->type));
+  sstrncpy(vl->type_instance, "max", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  if (with_overruns) {
+    vl->values = &(value_t){.derive = (derive_t)st.overruns};
+    sstrncpy(vl->type, "derive", sizeof(vl->type));
+    sstrncpy(vl->type_instance, "overruns", sizeof(vl->type_instance));
+    plugin_dispatch_values(vl);
+  }
+} /* }}} void callback_stats_dispatch */
+
+/* Dispatches the statistics of a filter chain rule as
+ * "collectd-filter-<chain>". */
+static int plugin_dispatch_rule_stats(fc_rule_stats_t const *st, /* {{{ */
+                                      void *user_data) {
+  value_list_t *vl = user_data;
+
+  ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "filter-%s",
+            st->chain);
+  vl->values_len = 1;
+
+  vl->values = &(value_t){.derive = (derive_t)st->evaluated};
+  sstrncpy(vl->type, "derive", sizeof(vl->type));
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "evaluated-%s",
+            st->rule);
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.derive = (derive_t)st->matched};
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "matched-%s",
+            st->rule);
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.derive = (derive_t)CDTIME_T_TO_MS(st->time_total)};
+  sstrncpy(vl->type, "total_time_in_ms", sizeof(vl->type));
+  sstrncpy(vl->type_instance, st->rule, sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  return 0;
+} /* }}} int plugin_dispatch_rule_stats */
+
+/* Dispatches the hit rate of a filter chain's cache as
+ * "collectd-filter-<chain>". */
+static int plugin_dispatch_chain_stats(fc_chain_stats_t const *st, /* {{{ */
+                                       void *user_data) {
+  value_list_t *vl = user_data;
+
+  ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "filter-%s",
+            st->chain);
+  vl->values_len = 1;
+
+  vl->values = &(value_t){.derive = (derive_t)st->cache_hits};
+  sstrncpy(vl->type, "cache_result", sizeof(vl->type));
+  sstrncpy(vl->type_instance, "hit", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.derive = (derive_t)st->cache_misses};
+  sstrncpy(vl->type_instance, "miss", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  return 0;
+} /* }}} int plugin_dispatch_chain_stats */
+
+static void plugin_dispatch_pool_stats(value_list_t *vl, /* {{{ */
+                                       char const *plugin_instance,
+                                       thread_pool_t *pool) {
+  pthread_mutex_lock(pool->lock);
+  if (pool->threads == NULL) {
+    pthread_mutex_unlock(pool->lock);
+    return;
+  }
+  gauge_t running = (gauge_t)pool->threads_num;
+  gauge_t idle = (gauge_t)pool->threads_idle;
+  gauge_t stuck = (gauge_t)pool->threads_stuck;
+  derive_t started = pool->started;
+  derive_t stopped = pool->stopped;
+  pthread_mutex_unlock(pool->lock);
+
+  sstrncpy(vl->plugin_instance, plugin_instance, sizeof(vl->plugin_instance));
+  vl->values_len = 1;
+
+  sstrncpy(vl->type, "threads", sizeof(vl->type));
+  vl->values = &(value_t){.gauge = running};
+  sstrncpy(vl->type_instance, "running", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.gauge = idle};
+  sstrncpy(vl->type_instance, "idle", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.gauge = stuck};
+  sstrncpy(vl->type_instance, "stuck", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  sstrncpy(vl->type, "total_threads", sizeof(vl->type));
+  vl->values = &(value_t){.derive = started};
+  sstrncpy(vl->type_instance, "started", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.derive = stopped};
+  sstrncpy(vl->type_instance, "stopped", sizeof(vl->type_instance));
+  plugin_dispatch_values(vl);
+} /* }}} void plugin_dispatch_pool_stats */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
-  gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+  gauge_t copy_write_queue_length =
+      (gauge_t)write_counter_get(&write_queue_length);
 
   /* Initialize `vl' */
   value_list_t vl = VALUE_LIST_INIT;
@@ -192,22 +853,252 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   plugin_dispatch_values(&vl);
 
   /* Write queue : Values dropped (queue length > low limit) */
-  vl.values = &(value_t){.gauge = (gauge_t)stats_values_dropped};
+  derive_t dropped_class[PRIORITY_CLASSES_NUM];
+  pthread_mutex_lock(&statistics_lock);
+  derive_t dropped = stats_values_dropped;
+  memcpy(dropped_class, stats_values_dropped_class, sizeof(dropped_class));
+  pthread_mutex_unlock(&statistics_lock);
+
+  vl.values = &(value_t){.derive = dropped};
   vl.values_len = 1;
   sstrncpy(vl.type, "derive", sizeof(vl.type));
   sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Write queue : Values dropped per priority class */
+  for (size_t i = 0; i < PRIORITY_CLASSES_NUM; i++) {
+    vl.values = &(value_t){.derive = dropped_class[i]};
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "dropped-%s",
+              priority_class_names[i]);
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Writer queues */
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    writer_queue_t *wq = cf->cf_queue;
+    if (wq == NULL)
+      continue;
+
+    pthread_mutex_lock(&wq->lock);
+    gauge_t length = (gauge_t)wq->length;
+    derive_t dropped = wq->dropped;
+    derive_t spooled = wq->spooled;
+    gauge_t spool_bytes =
+        (wq->spool != NULL) ? (gauge_t)spool_size(wq->spool) : NAN;
+    pthread_mutex_unlock(&wq->lock);
+
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "write_queue-%s",
+              wq->name);
+
+    vl.values = &(value_t){.gauge = length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    if (isnan(spool_bytes))
+      continue;
+
+    vl.values = &(value_t){.derive = spooled};
+    sstrncpy(vl.type_instance, "spooled", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = spool_bytes};
+    sstrncpy(vl.type, "bytes", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "spool", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Thread pools : threads running, waiting for work and stuck in a
+   * callback, and threads started and stopped as the pools grow and shrink */
+  plugin_dispatch_pool_stats(&vl, "read_threads", &read_pool);
+  plugin_dispatch_pool_stats(&vl, "write_threads", &write_pool);
+
+  /* Flush queue */
+  if (flush_threads_num > 0) {
+    pthread_mutex_lock(&flush_lock);
+    gauge_t length = (gauge_t)flush_length;
+    pthread_mutex_unlock(&flush_lock);
+
+    sstrncpy(vl.plugin_instance, "flush_queue", sizeof(vl.plugin_instance));
+    vl.values = &(value_t){.gauge = length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Notification queue */
+  if (notif_limit > 0) {
+    pthread_mutex_lock(&notif_lock);
+    gauge_t length = (gauge_t)notif_length;
+    derive_t dropped = notif_dropped;
+    derive_t coalesced = notif_coalesced;
+    pthread_mutex_unlock(&notif_lock);
+
+    sstrncpy(vl.plugin_instance, "notification_queue",
+             sizeof(vl.plugin_instance));
+
+    vl.values = &(value_t){.gauge = length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = coalesced};
+    sstrncpy(vl.type_instance, "coalesced", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Cache event queue */
+  if (cache_event_limit > 0) {
+    pthread_mutex_lock(&cache_event_lock);
+    gauge_t length = (gauge_t)cache_event_length;
+    derive_t dropped = cache_event_dropped;
+    pthread_mutex_unlock(&cache_event_lock);
+
+    sstrncpy(vl.plugin_instance, "cache_event_queue",
+             sizeof(vl.plugin_instance));
+
+    vl.values = &(value_t){.gauge = length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Memory pools : objects served from free memory vs. newly allocated */
+  mempool_stats_list_t mempools = {.num = 0};
+  c_mempool_foreach(plugin_collect_mempool_stats, &mempools);
+  for (size_t i = 0; i < mempools.num; i++) {
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "mempool-%s",
+              mempools.stats[i].name);
+
+    vl.values = &(value_t){.derive = (derive_t)mempools.stats[i].hits};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "cache_result", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "hit", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = (derive_t)mempools.stats[i].misses};
+    sstrncpy(vl.type_instance, "miss", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Memory : bytes held by the cache entries and charged to the tags of the
+   * other core structures and of plugins */
+  sstrncpy(vl.plugin_instance, "memory", sizeof(vl.plugin_instance));
+  vl.values = &(value_t){.gauge = (gauge_t)uc_get_memory()};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "bytes", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "cache", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  memtrack_foreach(plugin_dispatch_memtrack, &vl);
+
+  /* Callbacks : calls, execution time and overruns */
+  pthread_mutex_lock(&read_lock);
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next)
+    callback_stats_dispatch(&vl, "read", le->key, le->value,
+                            /* with_overruns = */ true);
+  pthread_mutex_unlock(&read_lock);
+
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+    callback_stats_dispatch(&vl, "write", le->key, le->value,
+                            /* with_overruns = */ false);
+  for (llentry_t *le = llist_head(list_flush); le != NULL; le = le->next)
+    callback_stats_dispatch(&vl, "flush", le->key, le->value,
+                            /* with_overruns = */ false);
+  for (llentry_t *le = llist_head(list_notification); le != NULL;
+       le = le->next)
+    callback_stats_dispatch(&vl, "notification", le->key, le->value,
+                            /* with_overruns = */ false);
+
+  /* Filter chains : rules evaluated and matched, time spent in matches and
+   * cache hits */
+  pthread_rwlock_rdlock(&chains_lock);
+  fc_rule_stats_foreach(plugin_dispatch_rule_stats, &vl);
+  fc_chain_stats_foreach(plugin_dispatch_chain_stats, &vl);
+  pthread_rwlock_unlock(&chains_lock);
+
   /* Cache */
   sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
 
   /* Cache : Nb entry in cache tree */
-  vl.values = &(value_t){.gauge = (gauge_t)uc_get_size()};
+  size_t cache_entries = uc_get_size();
+  vl.values = &(value_t){.gauge = (gauge_t)cache_entries};
   vl.values_len = 1;
   sstrncpy(vl.type, "cache_size", sizeof(vl.type));
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Cache : Nb interned value list identities */
+  vl.values = &(value_t){.gauge = (gauge_t)vl_identity_count()};
+  sstrncpy(vl.type_instance, "identities", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Cache : Values not written because of "SuppressUnchanged" */
+  vl.values = &(value_t){
+      .derive = (derive_t)write_counter_get(&values_suppressed)};
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "suppressed", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Cache : Memory used by the entries, in total and per entry */
+  size_t cache_memory = uc_get_memory();
+  vl.values = &(value_t){.gauge = (gauge_t)cache_memory};
+  sstrncpy(vl.type, "bytes", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "entries", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){
+      .gauge = (cache_entries > 0) ? (gauge_t)cache_memory / cache_entries
+                                   : NAN};
+  sstrncpy(vl.type_instance, "per_entry", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Cache : Copies taken by iterators and uc_get_names() */
+  uc_snapshot_stats_t snapshots;
+  uc_get_snapshot_stats(&snapshots);
+
+  vl.values = &(value_t){.derive = (derive_t)snapshots.count};
+  sstrncpy(vl.type, "operations", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "snapshot", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)snapshots.entries};
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "snapshot_entries", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){
+      .derive = (derive_t)CDTIME_T_TO_MS(snapshots.time_total)};
+  sstrncpy(vl.type, "total_time_in_ms", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "snapshot", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(snapshots.lock_max)};
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "snapshot_lock_max", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -221,10 +1112,15 @@ static void free_userdata(user_data_t const *ud) /* {{{ */
   }
 } /* }}} void free_userdata */
 
+static void writer_queue_destroy(writer_queue_t *wq);
+
 static void destroy_callback(callback_func_t *cf) /* {{{ */
 {
   if (cf == NULL)
     return;
+  /* Stop delivering values before the user data goes away. */
+  writer_queue_destroy(cf->cf_queue);
+  downsample_destroy(cf->cf_downsample);
   free_userdata(&cf->cf_udata);
   sfree(cf);
 } /* }}} void destroy_callback */
@@ -253,6 +1149,12 @@ static void destroy_all_callbacks(llist_t **list) /* {{{ */
   *list = NULL;
 } /* }}} void destroy_all_callbacks */
 
+static void destroy_read_func(read_func_t *rf) /* {{{ */
+{
+  sfree(rf->rf_name);
+  destroy_callback((callback_func_t *)rf);
+} /* }}} void destroy_read_func */
+
 static void destroy_read_heap(void) /* {{{ */
 {
   if (read_heap == NULL)
@@ -264,16 +1166,15 @@ static void destroy_read_heap(void) /* {{{ */
     rf = c_heap_get_root(read_heap);
     if (rf == NULL)
       break;
-    sfree(rf->rf_name);
-    destroy_callback((callback_func_t *)rf);
+    destroy_read_func(rf);
   }
 
   c_heap_destroy(read_heap);
   read_heap = NULL;
 } /* }}} void destroy_read_heap */
 
-static int register_callback(llist_t **list, /* {{{ */
-                             const char *name, callback_func_t *cf) {
+static int register_callback_locked(llist_t **list, /* {{{ */
+                                    const char *name, callback_func_t *cf) {
 
   if (*list == NULL) {
     *list = llist_create();
@@ -318,6 +1219,15 @@ static int register_callback(llist_t **list, /* {{{ */
   }
 
   return 0;
+} /* }}} int register_callback_locked */
+
+static int register_callback(llist_t **list, /* {{{ */
+                             const char *name, callback_func_t *cf) {
+  pthread_mutex_lock(&register_lock);
+  int status = register_callback_locked(list, name, cf);
+  pthread_mutex_unlock(&register_lock);
+
+  return status;
 } /* }}} int register_callback */
 
 static void log_list_callbacks(llist_t **list, /* {{{ */
@@ -392,11 +1302,15 @@ static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
   if (list == NULL)
     return -1;
 
+  pthread_mutex_lock(&register_lock);
   e = llist_search(list, name);
-  if (e == NULL)
+  if (e == NULL) {
+    pthread_mutex_unlock(&register_lock);
     return -1;
+  }
 
   llist_remove(list, e);
+  pthread_mutex_unlock(&register_lock);
 
   sfree(e->key);
   destroy_callback(e->value);
@@ -447,7 +1361,84 @@ static int plugin_load_file(char const *file, bool global) {
   return 0;
 }
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
+/* Wakes the read thread that has to take care of `rf' after it has been
+ * inserted into the read heap. Must be called with `read_lock' held. */
+static void plugin_read_notify(read_func_t const *rf) /* {{{ */
+{
+  if (!read_leader) {
+    pthread_cond_signal(&read_cond);
+    return;
+  }
+
+  /* Only interrupt the leader if `rf' is due before the read function it is
+   * waiting for. */
+  if ((read_leader_next == 0) || (rf->rf_next_read < read_leader_next))
+    pthread_cond_signal(&read_leader_cond);
+} /* }}} void plugin_read_notify */
+
+/* Records that the calling pool thread starts running the callback "name",
+ * so the watchdog can report it if it does not return. */
+static void pool_thread_busy(char const *name) /* {{{ */
+{
+  if (callback_timeout == 0)
+    return;
+
+  pool_thread_t *t = pthread_getspecific(pool_thread_key);
+  if (t == NULL)
+    return;
+
+  pthread_mutex_lock(&t->lock);
+  t->busy_since = cdtime();
+  sstrncpy(t->busy_name, name, sizeof(t->busy_name));
+  pthread_mutex_unlock(&t->lock);
+} /* }}} void pool_thread_busy */
+
+static void pool_thread_done(void) /* {{{ */
+{
+  if (callback_timeout == 0)
+    return;
+
+  pool_thread_t *t = pthread_getspecific(pool_thread_key);
+  if (t == NULL)
+    return;
+
+  pthread_mutex_lock(&t->lock);
+  bool stuck = t->stuck;
+  cdtime_t elapsed = cdtime() - t->busy_since;
+  char name[sizeof(t->busy_name)];
+  sstrncpy(name, t->busy_name, sizeof(name));
+  t->busy_since = 0;
+  t->stuck = false;
+  pthread_mutex_unlock(&t->lock);
+
+  if (stuck)
+    INFO("plugin: The callback of `%s' returned after %.3f seconds.", name,
+         CDTIME_T_TO_DOUBLE(elapsed));
+} /* }}} void pool_thread_done */
+
+/* Removes the calling thread from its pool. Must be called with the pool's
+ * lock held; the thread must exit right after releasing it. */
+static void pool_thread_exit(pool_thread_t *t) /* {{{ */
+{
+  thread_pool_t *pool = t->pool;
+
+  t->state = POOL_THREAD_EXITED;
+  pool->threads_num--;
+  pool->stopped++;
+  if (pool->exit_pending > 0)
+    pool->exit_pending--;
+
+  DEBUG("plugin: %s#%" PRIsz " is leaving the pool, %" PRIsz
+        " threads remain.",
+        pool->name, t->index, pool->threads_num);
+} /* }}} void pool_thread_exit */
+
+static void *plugin_read_thread(void *args) {
+  pool_thread_t *self = args;
+
+  pthread_setspecific(pool_thread_key, self);
+  pthread_mutex_lock(&read_lock);
+
   while (read_loop != 0) {
     read_func_t *rf;
     plugin_ctx_t old_ctx;
@@ -456,19 +1447,53 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     cdtime_t elapsed;
     int status;
     int rf_type;
-    int rc;
 
-    /* Get the read function that needs to be read next.
-     * We don't need to hold "read_lock" for the heap, but we need
-     * to call c_heap_get_root() and pthread_cond_wait() in the
-     * same protected block. */
-    pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL) {
+    if (read_leader) {
+      if (read_pool.exit_pending > 0) {
+        pool_thread_exit(self);
+        break;
+      }
+      read_pool.threads_idle++;
       pthread_cond_wait(&read_cond, &read_lock);
-      pthread_mutex_unlock(&read_lock);
+      read_pool.threads_idle--;
       continue;
     }
+
+    /* Become the leader and wait for the read function that needs to be
+     * read next. It stays in the heap while the leader is waiting, so it may
+     * be unregistered in the meantime. */
+    rf = c_heap_peek_root(read_heap);
+    cdtime_t next_read = (rf != NULL) ? rf->rf_next_read : 0;
+
+    read_leader = true;
+    read_leader_next = next_read;
+    if (rf == NULL)
+      pthread_cond_wait(&read_leader_cond, &read_lock);
+    else if (cdtime() < next_read)
+      pthread_cond_timedwait(&read_leader_cond, &read_lock,
+                             &CDTIME_T_TO_TIMESPEC(next_read));
+    read_leader = false;
+
+    /* Check if we're supposed to stop.. This may have interrupted
+     * the sleep, too. */
+    if (read_loop == 0)
+      continue;
+
+    /* Spurious wakeups and wakeups by plugin_read_notify() are handled by
+     * starting over. */
+    rf = c_heap_peek_root(read_heap);
+    if ((rf == NULL) || (cdtime() < rf->rf_next_read))
+      continue;
+    c_heap_get_root(read_heap);
+
+    /* `rf' is due: let one of the idle threads take over as leader. */
+    pthread_cond_signal(&read_cond);
+
+    /* Must hold `read_lock' when accessing `rf->rf_type'. Read functions
+     * in the heap are never marked for removal, see
+     * plugin_read_unschedule(). */
+    rf_type = rf->rf_type;
+    assert(rf_type != RF_REMOVE);
     pthread_mutex_unlock(&read_lock);
 
     if (rf->rf_interval == 0) {
@@ -481,50 +1506,13 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       rf->rf_next_read = cdtime();
     }
 
-    /* sleep until this entry is due,
-     * using pthread_cond_timedwait */
-    pthread_mutex_lock(&read_lock);
-    /* In pthread_cond_timedwait, spurious wakeups are possible
-     * (and really happen, at least on NetBSD with > 1 CPU), thus
-     * we need to re-evaluate the condition every time
-     * pthread_cond_timedwait returns. */
-    rc = 0;
-    while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
-                                  &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
-    }
-
-    /* Must hold `read_lock' when accessing `rf->rf_type'. */
-    rf_type = rf->rf_type;
-    pthread_mutex_unlock(&read_lock);
-
-    /* Check if we're supposed to stop.. This may have interrupted
-     * the sleep, too. */
-    if (read_loop == 0) {
-      /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
-      break;
-    }
-
-    /* The entry has been marked for deletion. The linked list
-     * entry has already been removed by `plugin_unregister_read'.
-     * All we have to do here is free the `read_func_t' and
-     * continue. */
-    if (rf_type == RF_REMOVE) {
-      DEBUG("plugin_read_thread: Destroying the `%s' "
-            "callback.",
-            rf->rf_name);
-      sfree(rf->rf_name);
-      destroy_callback((callback_func_t *)rf);
-      rf = NULL;
-      continue;
-    }
-
     DEBUG("plugin_read_thread: Handling `%s'.", rf->rf_name);
 
     start = cdtime();
 
     old_ctx = plugin_set_ctx(rf->rf_ctx);
+    pool_thread_busy(rf->rf_name);
+    COLLECTD_PROBE1(read_start, rf->rf_name);
 
     if (rf_type == RF_SIMPLE) {
       int (*callback)(void);
@@ -540,6 +1528,8 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       status = (*callback)(&rf->rf_udata);
     }
 
+    COLLECTD_PROBE2(read_done, rf->rf_name, status);
+    pool_thread_done();
     plugin_set_ctx(old_ctx);
 
     /* If the function signals failure, we will increase the
@@ -563,6 +1553,10 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     /* calculate the time spent in the read function */
     elapsed = (now - start);
 
+    if (record_statistics)
+      callback_stats_record(&rf->rf_super, elapsed,
+                            /* overrun = */ elapsed > rf->rf_interval);
+
     if (elapsed > rf->rf_effective_interval)
       WARNING(
           "plugin_read_thread: read-function of the `%s' plugin took %.3f "
@@ -594,10 +1588,24 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
 
-    /* Re-insert this read function into the heap again. */
+    /* Re-insert this read function into the heap again, unless it has been
+     * unregistered while it was being read. */
+    pthread_mutex_lock(&read_lock);
+    if (rf->rf_type == RF_REMOVE) {
+      pthread_mutex_unlock(&read_lock);
+      DEBUG("plugin_read_thread: Destroying the `%s' callback.", rf->rf_name);
+      destroy_read_func(rf);
+      pthread_mutex_lock(&read_lock);
+      continue;
+    }
     c_heap_insert(read_heap, rf);
+    /* Without a leader, this thread becomes the leader itself. */
+    if (read_leader)
+      plugin_read_notify(rf);
   } /* while (read_loop) */
 
+  pthread_mutex_unlock(&read_lock);
+
   pthread_exit(NULL);
   return (void *)0;
 } /* void *plugin_read_thread */
@@ -630,96 +1638,360 @@ static void set_thread_name(pthread_t tid, char const *name) {
 #endif
 }
 
-static void start_read_threads(size_t num) /* {{{ */
+/* Creates a thread that is pinned to "cpus" right from the start. The kernel
+ * allocates memory on the NUMA node of the CPU that touches it first, so the
+ * thread's stack and the memory it allocates stay local to its CPUs. */
+static int create_pinned_thread(pthread_t *thread, /* {{{ */
+                                plugin_cpus_t const *cpus,
+                                void *(*start_routine)(void *), void *arg) {
+  if ((cpus == NULL) || (cpus->cpus_num == 0))
+    return pthread_create(thread, /* attr = */ NULL, start_routine, arg);
+
+#if HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t i = 0; i < cpus->cpus_num; i++)
+    CPU_SET(cpus->cpus[i], &set);
+
+  pthread_attr_t attr;
+  int status = pthread_attr_init(&attr);
+  if (status != 0)
+    return status;
+
+  status = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+  if (status == 0)
+    status = pthread_create(thread, &attr, start_routine, arg);
+
+  pthread_attr_destroy(&attr);
+  return status;
+#else
+  /* plugin_cpus_parse() does not return CPU lists on these systems. */
+  return pthread_create(thread, /* attr = */ NULL, start_routine, arg);
+#endif
+} /* }}} int create_pinned_thread */
+
+int plugin_cpus_parse(oconfig_item_t const *ci, plugin_cpus_t *ret) /* {{{ */
 {
-  if (read_threads != NULL)
-    return;
+#if HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+  core_groups_list_t cgl = {0};
+  int status = config_cores_parse(ci, &cgl);
+  if (status != 0) {
+    ERROR("plugin: Invalid CPU list in the \"%s\" option.", ci->key);
+    return EINVAL;
+  }
 
-  read_threads = calloc(num, sizeof(*read_threads));
-  if (read_threads == NULL) {
-    ERROR("plugin: start_read_threads: calloc failed.");
-    return;
+  /* Pinning a thread to a CPU the process may not use fails, so this is
+   * reported here rather than when starting the threads. */
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    WARNING("plugin: sched_getaffinity failed: %s", STRERRNO);
+    for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, &allowed);
   }
 
-  read_threads_num = 0;
-  for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
-                                /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
-    if (status != 0) {
-      ERROR("plugin: start_read_threads: pthread_create failed with status %i "
-            "(%s).",
-            status, STRERROR(status));
-      return;
-    }
+  size_t cpus_num = 0;
+  for (size_t i = 0; i < cgl.num_cgroups; i++)
+    cpus_num += cgl.cgroups[i].num_cores;
 
-    char name[THREAD_NAME_MAX];
-    ssnprintf(name, sizeof(name), "reader#%" PRIu64,
-              (uint64_t)read_threads_num);
-    set_thread_name(read_threads[read_threads_num], name);
+  unsigned int *cpus = calloc(cpus_num + 1, sizeof(*cpus));
+  if (cpus == NULL) {
+    ERROR("plugin: plugin_cpus_parse: calloc failed.");
+    config_cores_cleanup(&cgl);
+    return ENOMEM;
+  }
 
-    read_threads_num++;
-  } /* for (i) */
-} /* }}} void start_read_threads */
+  cpus_num = 0;
+  for (size_t i = 0; i < cgl.num_cgroups; i++) {
+    for (size_t j = 0; j < cgl.cgroups[i].num_cores; j++) {
+      unsigned int cpu = cgl.cgroups[i].cores[j];
+      if ((cpu >= CPU_SETSIZE) || !CPU_ISSET(cpu, &allowed)) {
+        ERROR("plugin: CPU %u in the \"%s\" option is not available.", cpu,
+              ci->key);
+        config_cores_cleanup(&cgl);
+        sfree(cpus);
+        return EINVAL;
+      }
+      cpus[cpus_num] = cpu;
+      cpus_num++;
+    }
+  }
+  config_cores_cleanup(&cgl);
 
-static void stop_read_threads(void) {
-  if (read_threads == NULL)
-    return;
+  sfree(ret->cpus);
+  ret->cpus = cpus;
+  ret->cpus_num = cpus_num;
+  return 0;
+#else
+  ERROR("plugin: The \"%s\" option is not supported on this system.",
+        ci->key);
+  return ENOTSUP;
+#endif
+} /* }}} int plugin_cpus_parse */
 
-  INFO("collectd: Stopping %" PRIsz " read threads.", read_threads_num);
+void plugin_set_read_threads_cpus(plugin_cpus_t cpus) {
+  sfree(read_threads_cpus.cpus);
+  read_threads_cpus = cpus;
+}
 
-  pthread_mutex_lock(&read_lock);
-  read_loop = 0;
-  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
-  pthread_mutex_unlock(&read_lock);
+void plugin_set_write_threads_cpus(plugin_cpus_t cpus) {
+  sfree(write_threads_cpus.cpus);
+  write_threads_cpus = cpus;
+}
 
-  for (size_t i = 0; i < read_threads_num; i++) {
-    if (pthread_join(read_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_read_threads: pthread_join failed.");
+/* Starts a thread in a free slot of "pool". Must be called with the pool's
+ * lock held. */
+static int thread_pool_spawn(thread_pool_t *pool) /* {{{ */
+{
+  pool_thread_t *t = NULL;
+  for (size_t i = 0; i < pool->threads_size; i++) {
+    if (pool->threads[i].state != POOL_THREAD_RUNNING) {
+      t = pool->threads + i;
+      break;
     }
-    read_threads[i] = (pthread_t)0;
   }
-  sfree(read_threads);
-  read_threads_num = 0;
-} /* void stop_read_threads */
+  if (t == NULL)
+    return ENOSPC;
+
+  /* The thread released the lock for the last time before we acquired it,
+   * so this does not block for long. */
+  if (t->state == POOL_THREAD_EXITED) {
+    pthread_join(t->tid, NULL);
+    t->state = POOL_THREAD_FREE;
+  }
 
-static void plugin_value_list_free(value_list_t *vl) /* {{{ */
+  t->busy_since = 0;
+  t->stuck = false;
+
+  int status = create_pinned_thread(&t->tid, pool->cpus, pool->start_routine,
+                                    /* arg = */ t);
+  if (status != 0) {
+    ERROR("plugin: thread_pool_spawn: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return status;
+  }
+
+  char name[THREAD_NAME_MAX];
+  ssnprintf(name, sizeof(name), "%s#%" PRIu64, pool->name, (uint64_t)t->index);
+  set_thread_name(t->tid, name);
+
+  t->state = POOL_THREAD_RUNNING;
+  pool->threads_num++;
+  pool->started++;
+  return 0;
+} /* }}} int thread_pool_spawn */
+
+static void thread_pool_start(thread_pool_t *pool, size_t min, /* {{{ */
+                              size_t max) {
+  if (pool->threads != NULL)
+    return;
+
+  /* Leave room for as many threads again to replace stuck ones. */
+  size_t size = (callback_timeout > 0) ? 2 * max : max;
+  pool->threads = calloc(size, sizeof(*pool->threads));
+  if (pool->threads == NULL) {
+    ERROR("plugin: thread_pool_start: calloc failed.");
+    return;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    pool->threads[i].pool = pool;
+    pool->threads[i].index = i;
+    pthread_mutex_init(&pool->threads[i].lock, /* attr = */ NULL);
+  }
+  pool->threads_size = size;
+  pool->min = min;
+  pool->max = max;
+  pool->idle_min = SIZE_MAX;
+  pool->window_start = cdtime();
+
+  pthread_mutex_lock(pool->lock);
+  for (size_t i = 0; i < min; i++)
+    if (thread_pool_spawn(pool) != 0)
+      break;
+  pthread_mutex_unlock(pool->lock);
+} /* }}} void thread_pool_start */
+
+/* Joins all threads of "pool". The caller must have told them to stop. */
+static void thread_pool_join(thread_pool_t *pool) /* {{{ */
+{
+  for (size_t i = 0; i < pool->threads_size; i++) {
+    pool_thread_t *t = pool->threads + i;
+    if (t->state == POOL_THREAD_FREE)
+      continue;
+
+    if (pthread_join(t->tid, NULL) != 0)
+      ERROR("plugin: thread_pool_join: pthread_join failed.");
+    t->state = POOL_THREAD_FREE;
+    pthread_mutex_destroy(&t->lock);
+  }
+
+  sfree(pool->threads);
+  pool->threads_size = 0;
+  pool->threads_num = 0;
+  pool->threads_idle = 0;
+  pool->exit_pending = 0;
+} /* }}} void thread_pool_join */
+
+/* Counts the threads of "pool" that have been running the same callback for
+ * longer than "CallbackTimeout" and reports the ones found for the first
+ * time. Must be called with the pool's lock held. */
+static size_t thread_pool_count_stuck(thread_pool_t *pool, /* {{{ */
+                                      cdtime_t now) {
+  size_t stuck = 0;
+
+  for (size_t i = 0; i < pool->threads_size; i++) {
+    pool_thread_t *t = pool->threads + i;
+    if (t->state != POOL_THREAD_RUNNING)
+      continue;
+
+    pthread_mutex_lock(&t->lock);
+    if ((t->busy_since != 0) && (now - t->busy_since > callback_timeout)) {
+      stuck++;
+      if (!t->stuck) {
+        t->stuck = true;
+        WARNING("plugin: The callback of `%s' has been running for %.3f "
+                "seconds in thread %s#%" PRIsz ", which is above the "
+                "CallbackTimeout of %.3f seconds. Another thread may be "
+                "started in its place.",
+                t->busy_name, CDTIME_T_TO_DOUBLE(now - t->busy_since),
+                pool->name, t->index, CDTIME_T_TO_DOUBLE(callback_timeout));
+      }
+    }
+    pthread_mutex_unlock(&t->lock);
+  }
+
+  return stuck;
+} /* }}} size_t thread_pool_count_stuck */
+
+/* Grows "pool" by one thread if it has a "backlog" and fewer than `max'
+ * threads that are not stuck. Otherwise asks idle threads to leave the pool
+ * once at least one thread has been idle for the whole "ThreadIdleTimeout".
+ * Must be called with the pool's lock held. */
+static void thread_pool_resize(thread_pool_t *pool, bool backlog, /* {{{ */
+                               cdtime_t now) {
+  if (callback_timeout > 0)
+    pool->threads_stuck = thread_pool_count_stuck(pool, now);
+
+  size_t active = pool->threads_num - pool->threads_stuck;
+  if (backlog) {
+    pool->exit_pending = 0;
+    pool->idle_min = 0;
+    if ((active < pool->max) && (pool->threads_num < pool->threads_size) &&
+        (thread_pool_spawn(pool) == 0))
+      DEBUG("plugin: Added a %s thread, %" PRIsz " threads are running.",
+            pool->name, pool->threads_num);
+  } else if (pool->threads_idle < pool->idle_min) {
+    pool->idle_min = pool->threads_idle;
+  }
+
+  if (now - pool->window_start < thread_idle_timeout)
+    return;
+
+  pool->exit_pending = 0;
+  if ((active > pool->min) && (pool->idle_min != SIZE_MAX) &&
+      (pool->idle_min > 0)) {
+    pool->exit_pending = active - pool->min;
+    if (pool->exit_pending > pool->idle_min)
+      pool->exit_pending = pool->idle_min;
+    pthread_cond_broadcast(pool->cond);
+  }
+
+  pool->idle_min = SIZE_MAX;
+  pool->window_start = now;
+} /* }}} void thread_pool_resize */
+
+static void start_read_threads(size_t min, size_t max) /* {{{ */
+{
+  thread_pool_start(&read_pool, min, max);
+} /* }}} void start_read_threads */
+
+static void stop_read_threads(void) {
+  if (read_pool.threads == NULL)
+    return;
+
+  INFO("collectd: Stopping %" PRIsz " read threads.", read_pool.threads_num);
+
+  pthread_mutex_lock(&read_lock);
+  read_loop = 0;
+  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
+  pthread_cond_broadcast(&read_cond);
+  pthread_cond_broadcast(&read_leader_cond);
+  pthread_mutex_unlock(&read_lock);
+
+  thread_pool_join(&read_pool);
+} /* void stop_read_threads */
+
+static void plugin_write_queue_init(void);
+
+static value_list_t *plugin_value_list_ref(value_list_t *vl) /* {{{ */
+{
+  shared_value_list_t *svl = (shared_value_list_t *)vl;
+
+  write_counter_add(&svl->refcount, 1);
+  return vl;
+} /* }}} value_list_t *plugin_value_list_ref */
+
+/* Releases a reference to a value list returned by plugin_value_list_clone()
+ * and frees it once the last reference is gone. */
+static void plugin_value_list_free(value_list_t *vl) /* {{{ */
 {
   if (vl == NULL)
     return;
 
+  shared_value_list_t *svl = (shared_value_list_t *)vl;
+  if (write_counter_add(&svl->refcount, -1) > 0)
+    return;
+
+  vl_identity_release(svl->identity);
   meta_data_destroy(vl->meta);
-  sfree(vl->values);
-  sfree(vl);
+  if (svl->pooled)
+    c_mempool_free(value_list_pool, svl);
+  else
+    memtrack_free(svl);
 } /* }}} void plugin_value_list_free */
 
 static value_list_t *
 plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
 {
+  shared_value_list_t *svl;
   value_list_t *vl;
 
   if (vl_orig == NULL)
     return NULL;
 
-  vl = malloc(sizeof(*vl));
-  if (vl == NULL)
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+
+  /* The values are stored in the same allocation as the value list. */
+  bool pooled = (vl_orig->values_len <= VALUE_LIST_POOL_VALUES);
+  if (pooled)
+    svl = c_mempool_alloc(value_list_pool);
+  else
+    svl = memtrack_malloc(value_list_memtrack,
+                          sizeof(*svl) +
+                              vl_orig->values_len * sizeof(*svl->values));
+  if (svl == NULL)
     return NULL;
+  svl->refcount = 1;
+  svl->pooled = pooled;
+
+  vl = &svl->vl;
   memcpy(vl, vl_orig, sizeof(*vl));
 
   if (vl->host[0] == 0)
     sstrncpy(vl->host, hostname_g, sizeof(vl->host));
 
-  vl->values = calloc(vl_orig->values_len, sizeof(*vl->values));
-  if (vl->values == NULL) {
-    plugin_value_list_free(vl);
-    return NULL;
-  }
+  svl->identity = NULL;
+  svl->ds = NULL;
+
+  vl->values = svl->values;
   memcpy(vl->values, vl_orig->values,
          vl_orig->values_len * sizeof(*vl->values));
 
   vl->meta = meta_data_clone(vl->meta);
   if ((vl_orig->meta != NULL) && (vl->meta == NULL)) {
+    vl->meta = NULL;
     plugin_value_list_free(vl);
     return NULL;
   }
@@ -734,133 +2006,496 @@ plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
   return vl;
 } /* }}} value_list_t *plugin_value_list_clone */
 
-static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+static void plugin_write_queue_init(void) /* {{{ */
 {
-  write_queue_t *q;
+  pthread_key_create(&write_queue_shard_key, /* destructor = */ NULL);
+  pthread_key_create(&write_batch_key, /* destructor = */ NULL);
+  pthread_key_create(&dispatch_identity_key, /* destructor = */ NULL);
+  pthread_key_create(&pool_thread_key, /* destructor = */ NULL);
+
+  value_list_pool = c_mempool_create(
+      "value_list",
+      sizeof(shared_value_list_t) + VALUE_LIST_POOL_VALUES * sizeof(value_t));
+  write_queue_pool = c_mempool_create("write_queue", sizeof(write_queue_t));
+  value_list_memtrack = memtrack_get("value_list");
+  if ((value_list_pool == NULL) || (write_queue_pool == NULL)) {
+    ERROR("plugin: plugin_write_queue_init: c_mempool_create failed.");
+    return;
+  }
 
-  q = malloc(sizeof(*q));
-  if (q == NULL)
-    return ENOMEM;
-  q->next = NULL;
+  long num = global_option_get_long("WriteThreads", /* default = */ 5);
+  if (num < 1)
+    num = 5;
 
-  q->vl = plugin_value_list_clone(vl);
-  if (q->vl == NULL) {
-    sfree(q);
-    return ENOMEM;
+  write_queue_shards = calloc((size_t)num, sizeof(*write_queue_shards));
+  if (write_queue_shards == NULL) {
+    ERROR("plugin: plugin_write_queue_init: calloc failed.");
+    return;
+  }
+
+  for (long i = 0; i < num; i++)
+    pthread_mutex_init(&write_queue_shards[i].lock, /* attr = */ NULL);
+  write_queue_shards_num = (size_t)num;
+} /* }}} void plugin_write_queue_init */
+
+/* Returns the shard the calling thread enqueues its values to. Threads are
+ * assigned to shards in a round-robin fashion the first time they enqueue. */
+static write_queue_shard_t *plugin_write_queue_shard(void) /* {{{ */
+{
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+  if (write_queue_shards_num == 0)
+    return NULL;
+
+  uintptr_t idx = (uintptr_t)pthread_getspecific(write_queue_shard_key);
+  if (idx == 0) {
+    long n = write_counter_add(&write_queue_next_shard, 1);
+    idx = 1 + ((uintptr_t)(n - 1) % write_queue_shards_num);
+    pthread_setspecific(write_queue_shard_key, (void *)idx);
   }
 
+  return write_queue_shards + (idx - 1);
+} /* }}} write_queue_shard_t *plugin_write_queue_shard */
+
+/* Appends copies of the `num' value lists at `vls' to the calling thread's
+ * shard, taking the shard lock only once. `dss', if not NULL, holds the data
+ * sets of the value lists, which are then not looked up again. If `check_drop'
+ * is set, each value list is subject to the high / low water marks
+ * individually. If memory runs out, the copies made so far are still enqueued
+ * and ENOMEM is returned. */
+static int plugin_write_enqueue_list(value_list_t const *vls, /* {{{ */
+                                     data_set_t const *const *dss, size_t num,
+                                     bool check_drop) {
+  write_queue_shard_t *shard = plugin_write_queue_shard();
+  if (shard == NULL)
+    return ENOMEM;
+
   /* Store context of caller (read plugin); otherwise, it would not be
    * available to the write plugins when actually dispatching the
    * value-list later on. */
-  q->ctx = plugin_get_ctx();
+  plugin_ctx_t ctx = plugin_get_ctx();
 
-  pthread_mutex_lock(&write_lock);
+  write_queue_t *head = NULL;
+  write_queue_t *tail = NULL;
+  long length = 0;
+  int status = 0;
 
-  if (write_queue_tail == NULL) {
-    write_queue_head = q;
-    write_queue_tail = q;
-    write_queue_length = 1;
-  } else {
-    write_queue_tail->next = q;
-    write_queue_tail = q;
-    write_queue_length += 1;
+  for (size_t i = 0; i < num; i++) {
+    if (check_drop && check_drop_value())
+      continue;
+
+    write_queue_t *q = c_mempool_alloc(write_queue_pool);
+    if (q == NULL) {
+      status = ENOMEM;
+      break;
+    }
+    q->next = NULL;
+
+    q->vl = plugin_value_list_clone(vls + i);
+    if (q->vl == NULL) {
+      c_mempool_free(write_queue_pool, q);
+      status = ENOMEM;
+      break;
+    }
+    if (dss != NULL)
+      ((shared_value_list_t *)q->vl)->ds = dss[i];
+    q->ctx = ctx;
+    q->ds = NULL;
+    COLLECTD_PROBE2(write_queue_enqueue, q, ctx.name);
+
+    if (tail == NULL)
+      head = q;
+    else
+      tail->next = q;
+    tail = q;
+    length++;
   }
 
-  pthread_cond_signal(&write_cond);
-  pthread_mutex_unlock(&write_lock);
+  if (head == NULL)
+    return status;
 
-  return 0;
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->tail == NULL)
+    shard->head = head;
+  else
+    shard->tail->next = head;
+  shard->tail = tail;
+  shard->length += length;
+
+  /* Increment the global length before releasing the shard lock, so it never
+   * drops below the number of entries actually queued. */
+  write_counter_add(&write_queue_length, length);
+
+  pthread_mutex_unlock(&shard->lock);
+
+  if (bench_count_values)
+    write_counter_add(&bench_values_num, length);
+
+  /* Only wake write threads if some are actually idle. Busy write threads
+   * will pick up these values when they fetch their next batch. */
+  if (write_counter_get(&write_threads_waiting) > 0) {
+    pthread_mutex_lock(&write_lock);
+    if (length > 1)
+      pthread_cond_broadcast(&write_cond);
+    else
+      pthread_cond_signal(&write_cond);
+    pthread_mutex_unlock(&write_lock);
+  }
+
+  return status;
+} /* }}} int plugin_write_enqueue_list */
+
+static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+{
+  return plugin_write_enqueue_list(vl, NULL, 1, /* check_drop = */ false);
 } /* }}} int plugin_write_enqueue */
 
-static value_list_t *plugin_write_dequeue(void) /* {{{ */
+/* Removes up to WRITE_QUEUE_BATCH_SIZE entries from the shard and returns them
+ * as a linked list. To not starve the other write threads, at most a fair
+ * share of the shard's entries is taken. */
+static write_queue_t *
+plugin_write_dequeue_shard(write_queue_shard_t *shard) /* {{{ */
 {
-  write_queue_t *q;
-  value_list_t *vl;
+  pthread_mutex_lock(&shard->lock);
 
-  pthread_mutex_lock(&write_lock);
+  if (shard->head == NULL) {
+    pthread_mutex_unlock(&shard->lock);
+    return NULL;
+  }
+
+  long batch_size = (shard->length + (long)write_queue_shards_num - 1) /
+                    (long)write_queue_shards_num;
+  if (batch_size > WRITE_QUEUE_BATCH_SIZE)
+    batch_size = WRITE_QUEUE_BATCH_SIZE;
+  else if (batch_size < 1)
+    batch_size = 1;
+
+  write_queue_t *head = shard->head;
+  write_queue_t *last = head;
+  long num = 1;
+  while ((num < batch_size) && (last->next != NULL)) {
+    last = last->next;
+    num++;
+  }
+
+  shard->head = last->next;
+  last->next = NULL;
+  shard->length -= num;
+  if (shard->head == NULL) {
+    shard->tail = NULL;
+    assert(0 == shard->length);
+  }
+
+  write_counter_add(&write_queue_length, -num);
 
-  while (write_loop && (write_queue_head == NULL))
-    pthread_cond_wait(&write_cond, &write_lock);
+  pthread_mutex_unlock(&shard->lock);
+  return head;
+} /* }}} write_queue_t *plugin_write_dequeue_shard */
+
+/* Returns a batch of queued value lists, starting the search at the shard
+ * "home". Blocks until values are available. Returns NULL if the write
+ * threads are being shut down or if "self" has to leave the write thread
+ * pool. */
+static write_queue_t *plugin_write_dequeue(pool_thread_t *self, /* {{{ */
+                                           size_t home) {
+  while (write_loop) {
+    for (size_t i = 0; i < write_queue_shards_num; i++) {
+      write_queue_shard_t *shard =
+          write_queue_shards + ((home + i) % write_queue_shards_num);
+      write_queue_t *q = plugin_write_dequeue_shard(shard);
+      if (q != NULL)
+        return q;
+    }
 
-  if (write_queue_head == NULL) {
+    /* Announce that we're waiting before re-checking the queue length, so
+     * that either we see the new value or the enqueueing thread sees us. */
+    pthread_mutex_lock(&write_lock);
+    write_counter_add(&write_threads_waiting, 1);
+    write_pool.threads_idle++;
+    while (write_loop && (write_counter_get(&write_queue_length) == 0)) {
+      if (write_pool.exit_pending > 0) {
+        write_pool.threads_idle--;
+        write_counter_add(&write_threads_waiting, -1);
+        pool_thread_exit(self);
+        pthread_mutex_unlock(&write_lock);
+        return NULL;
+      }
+      pthread_cond_wait(&write_cond, &write_lock);
+    }
+    write_pool.threads_idle--;
+    write_counter_add(&write_threads_waiting, -1);
     pthread_mutex_unlock(&write_lock);
-    return NULL;
   }
 
-  q = write_queue_head;
-  write_queue_head = q->next;
-  write_queue_length -= 1;
-  if (write_queue_head == NULL) {
-    write_queue_tail = NULL;
-    assert(0 == write_queue_length);
+  return NULL;
+} /* }}} write_queue_t *plugin_write_dequeue */
+
+static int plugin_write_batch_call(callback_func_t *cf, /* {{{ */
+                                   write_batch_entry_t const *entries,
+                                   size_t entries_num, plugin_ctx_t ctx) {
+  plugin_write_batch_cb callback = cf->cf_callback;
+
+  /* Keep the read plugin's interval and flush information but update the
+   * plugin name. */
+  ctx.name = cf->cf_ctx.name;
+  plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+
+  COLLECTD_PROBE2(write_start, cf->cf_ctx.name, entries_num);
+  pool_thread_busy(cf->cf_ctx.name);
+  cdtime_t start = callback_stats_start();
+  int status = (*callback)(entries, entries_num, &cf->cf_udata);
+  callback_stats_finish(cf, start);
+  pool_thread_done();
+  COLLECTD_PROBE2(write_done, cf->cf_ctx.name, status);
+
+  plugin_set_ctx(old_ctx);
+  return status;
+} /* }}} int plugin_write_batch_call */
+
+static int writer_queue_enqueue(writer_queue_t *wq, data_set_t const *ds,
+                                value_list_t *vl, plugin_ctx_t ctx);
+
+/* Passes all values collected by this write thread to the writer queues and
+ * "write_batch" callbacks they are destined for. */
+static void plugin_write_batch_flush(write_batch_t *b) /* {{{ */
+{
+  if (b->values_num == 0)
+    return;
+
+  /* The references are handed over to the writer queues. */
+  for (size_t i = 0; i < b->values_num; i++) {
+    write_batch_value_t *v = b->values + i;
+    if (v->cf->cf_queue == NULL)
+      continue;
+
+    writer_queue_enqueue(v->cf->cf_queue, v->ds, v->vl, v->ctx);
+    v->vl = NULL;
   }
 
-  pthread_mutex_unlock(&write_lock);
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    if (!cf->cf_batch || (cf->cf_queue != NULL))
+      continue;
+
+    size_t entries_num = 0;
+    plugin_ctx_t ctx = {0};
+    for (size_t i = 0; i < b->values_num; i++) {
+      write_batch_value_t *v = b->values + i;
+      if (v->cf != cf)
+        continue;
 
-  (void)plugin_set_ctx(q->ctx);
+      if (entries_num == 0)
+        ctx = v->ctx;
+      b->entries[entries_num] = (write_batch_entry_t){
+          .ds = v->ds,
+          .vl = v->vl,
+          .identity = ((shared_value_list_t *)v->vl)->identity,
+      };
+      entries_num++;
+    }
 
-  vl = q->vl;
-  sfree(q);
-  return vl;
-} /* }}} value_list_t *plugin_write_dequeue */
+    if (entries_num == 0)
+      continue;
+
+    int status = plugin_write_batch_call(cf, b->entries, entries_num, ctx);
+    if (status != 0)
+      DEBUG("plugin: plugin_write_batch_flush: Write callback \"%s\" failed "
+            "with status %i.",
+            le->key, status);
+  }
+
+  for (size_t i = 0; i < b->values_num; i++)
+    plugin_value_list_free(b->values[i].vl);
+  b->values_num = 0;
+  b->values_bound = 0;
+} /* }}} void plugin_write_batch_flush */
+
+/* Makes all entries added for the value list currently being dispatched hold
+ * a reference to `vl'. */
+static void plugin_write_batch_bind(write_batch_t *b, /* {{{ */
+                                    value_list_t *vl) {
+  for (size_t i = b->values_bound; i < b->values_num; i++)
+    if (b->values[i].vl == NULL)
+      b->values[i].vl = plugin_value_list_ref(vl);
+  b->values_bound = b->values_num;
+} /* }}} void plugin_write_batch_bind */
+
+/* Adds a value for the writer queue or "write_batch" callback `cf'. Values
+ * added from a write thread are collected and passed on by
+ * plugin_write_batch_flush(); otherwise the value is passed on right away. */
+static int plugin_write_batch_add(callback_func_t *cf, /* {{{ */
+                                  data_set_t const *ds,
+                                  value_list_t const *vl) {
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+
+  write_batch_t *b = pthread_getspecific(write_batch_key);
+  if (b == NULL) {
+    if (cf->cf_queue != NULL) {
+      value_list_t *copy = plugin_value_list_clone(vl);
+      if (copy == NULL)
+        return ENOMEM;
+      return writer_queue_enqueue(cf->cf_queue, ds, copy, plugin_get_ctx());
+    }
+
+    write_batch_entry_t entry = {
+        .ds = ds,
+        .vl = vl,
+        .identity = plugin_value_list_identity(vl),
+    };
+    return plugin_write_batch_call(cf, &entry, 1, plugin_get_ctx());
+  }
+
+  if (b->values_num >= b->values_size) {
+    size_t new_size = (b->values_size == 0) ? WRITE_QUEUE_BATCH_SIZE
+                                            : 2 * b->values_size;
+
+    write_batch_value_t *values =
+        realloc(b->values, new_size * sizeof(*b->values));
+    if (values == NULL)
+      return ENOMEM;
+    b->values = values;
+
+    write_batch_entry_t *entries =
+        realloc(b->entries, new_size * sizeof(*b->entries));
+    if (entries == NULL)
+      return ENOMEM;
+    b->entries = entries;
 
-static void *plugin_write_thread(void __attribute__((unused)) * args) /* {{{ */
+    b->values_size = new_size;
+  }
+
+  /* The value list being dispatched is shared once the filter chain is done
+   * with it. Value lists from anywhere else are copied. */
+  value_list_t *ref = NULL;
+  if (vl != b->current) {
+    ref = plugin_value_list_clone(vl);
+    if (ref == NULL)
+      return ENOMEM;
+  }
+
+  b->values[b->values_num] = (write_batch_value_t){
+      .cf = cf,
+      .ds = ds,
+      .vl = ref,
+      .ctx = plugin_get_ctx(),
+  };
+  b->values_num++;
+
+  return 0;
+} /* }}} int plugin_write_batch_add */
+
+EXPORT int plugin_value_list_unshare(value_list_t const *vl) /* {{{ */
+{
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+
+  write_batch_t *b = pthread_getspecific(write_batch_key);
+  if ((b == NULL) || (vl != b->current))
+    return 0;
+
+  shared_value_list_t *svl = (shared_value_list_t *)b->current;
+
+  /* Writers handed `vl' so far get to keep the current version, including its
+   * identity. */
+  if (b->values_bound < b->values_num) {
+    value_list_t *copy = plugin_value_list_clone(vl);
+    if (copy == NULL) {
+      ERROR("plugin_value_list_unshare: plugin_value_list_clone failed.");
+      return ENOMEM;
+    }
+
+    ((shared_value_list_t *)copy)->identity = svl->identity;
+    svl->identity = NULL;
+
+    plugin_write_batch_bind(b, copy);
+    plugin_value_list_free(copy);
+  }
+
+  /* The identity no longer matches once `vl' is modified. */
+  vl_identity_release(svl->identity);
+  svl->identity = NULL;
+
+  return 0;
+} /* }}} int plugin_value_list_unshare */
+
+EXPORT vl_identity_t const *
+plugin_value_list_identity(value_list_t const *vl) /* {{{ */
+{
+  if (vl == NULL)
+    return NULL;
+
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+
+  shared_value_list_t *svl = pthread_getspecific(dispatch_identity_key);
+  if ((svl == NULL) || (vl != &svl->vl))
+    return NULL;
+
+  return svl->identity;
+} /* }}} vl_identity_t const *plugin_value_list_identity */
+
+static void *plugin_write_thread(void *args) /* {{{ */
 {
+  pool_thread_t *self = args;
+  size_t home = self->index % write_queue_shards_num;
+  write_batch_t batch = {0};
+
+  pthread_setspecific(pool_thread_key, self);
+  pthread_setspecific(write_batch_key, &batch);
+
   while (write_loop) {
-    value_list_t *vl = plugin_write_dequeue();
-    if (vl == NULL)
-      continue;
+    write_queue_t *q = plugin_write_dequeue(self, home);
+    if (q == NULL)
+      break;
 
-    plugin_dispatch_values_internal(vl);
+    while (q != NULL) {
+      write_queue_t *next = q->next;
+
+      COLLECTD_PROBE2(write_queue_dequeue, q, q->ctx.name);
+      (void)plugin_set_ctx(q->ctx);
+      batch.current = q->vl;
+      pthread_setspecific(dispatch_identity_key, q->vl);
+      plugin_dispatch_values_internal(q->vl);
+      pthread_setspecific(dispatch_identity_key, NULL);
+      plugin_write_batch_bind(&batch, q->vl);
+      batch.current = NULL;
+
+      plugin_value_list_free(q->vl);
+      c_mempool_free(write_queue_pool, q);
+      q = next;
+    }
 
-    plugin_value_list_free(vl);
+    plugin_write_batch_flush(&batch);
   }
 
+  pthread_setspecific(write_batch_key, NULL);
+  sfree(batch.values);
+  sfree(batch.entries);
+
   pthread_exit(NULL);
   return (void *)0;
 } /* }}} void *plugin_write_thread */
 
-static void start_write_threads(size_t num) /* {{{ */
+static void start_write_threads(size_t min, size_t max) /* {{{ */
 {
-  if (write_threads != NULL)
+  if (write_pool.threads != NULL)
     return;
 
-  write_threads = calloc(num, sizeof(*write_threads));
-  if (write_threads == NULL) {
-    ERROR("plugin: start_write_threads: calloc failed.");
+  pthread_once(&write_queue_once, plugin_write_queue_init);
+  if (write_queue_shards_num == 0) {
+    ERROR("plugin: start_write_threads: The write queue is not available.");
     return;
   }
 
-  write_threads_num = 0;
-  for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(write_threads + write_threads_num,
-                                /* attr = */ NULL, plugin_write_thread,
-                                /* arg = */ NULL);
-    if (status != 0) {
-      ERROR("plugin: start_write_threads: pthread_create failed with status %i "
-            "(%s).",
-            status, STRERROR(status));
-      return;
-    }
-
-    char name[THREAD_NAME_MAX];
-    ssnprintf(name, sizeof(name), "writer#%" PRIu64,
-              (uint64_t)write_threads_num);
-    set_thread_name(write_threads[write_threads_num], name);
-
-    write_threads_num++;
-  } /* for (i) */
+  thread_pool_start(&write_pool, min, max);
 } /* }}} void start_write_threads */
 
 static void stop_write_threads(void) /* {{{ */
 {
-  write_queue_t *q;
   size_t i;
 
-  if (write_threads == NULL)
+  if (write_pool.threads == NULL)
     return;
 
-  INFO("collectd: Stopping %" PRIsz " write threads.", write_threads_num);
+  INFO("collectd: Stopping %" PRIsz " write threads.", write_pool.threads_num);
 
   pthread_mutex_lock(&write_lock);
   write_loop = false;
@@ -868,28 +2503,26 @@ static void stop_write_threads(void) /* {{{ */
   pthread_cond_broadcast(&write_cond);
   pthread_mutex_unlock(&write_lock);
 
-  for (i = 0; i < write_threads_num; i++) {
-    if (pthread_join(write_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_write_threads: pthread_join failed.");
-    }
-    write_threads[i] = (pthread_t)0;
-  }
-  sfree(write_threads);
-  write_threads_num = 0;
+  thread_pool_join(&write_pool);
 
-  pthread_mutex_lock(&write_lock);
   i = 0;
-  for (q = write_queue_head; q != NULL;) {
-    write_queue_t *q1 = q;
-    plugin_value_list_free(q->vl);
-    q = q->next;
-    sfree(q1);
-    i++;
+  for (size_t j = 0; j < write_queue_shards_num; j++) {
+    write_queue_shard_t *shard = write_queue_shards + j;
+
+    pthread_mutex_lock(&shard->lock);
+    for (write_queue_t *q = shard->head; q != NULL;) {
+      write_queue_t *q1 = q;
+      plugin_value_list_free(q->vl);
+      q = q->next;
+      c_mempool_free(write_queue_pool, q1);
+      i++;
+    }
+    shard->head = NULL;
+    shard->tail = NULL;
+    write_counter_add(&write_queue_length, -shard->length);
+    shard->length = 0;
+    pthread_mutex_unlock(&shard->lock);
   }
-  write_queue_head = NULL;
-  write_queue_tail = NULL;
-  write_queue_length = 0;
-  pthread_mutex_unlock(&write_lock);
 
   if (i > 0) {
     WARNING("plugin: %" PRIsz " value list%s left after shutting down "
@@ -898,48 +2531,575 @@ static void stop_write_threads(void) /* {{{ */
   }
 } /* }}} void stop_write_threads */
 
-/*
- * Public functions
- */
-void plugin_set_dir(const char *dir) {
-  sfree(plugindir);
-
-  if (dir == NULL) {
-    plugindir = NULL;
-    return;
-  }
+#define POOL_WATCHDOG_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
 
-  plugindir = strdup(dir);
-  if (plugindir == NULL)
-    ERROR("plugin_set_dir: strdup(\"%s\") failed", dir);
-}
+static void *pool_watchdog_thread(void __attribute__((unused)) * args) /* {{{ */
+{
+  pthread_mutex_lock(&pool_watchdog_lock);
+  while (pool_watchdog_loop) {
+    cdtime_t next = cdtime() + POOL_WATCHDOG_INTERVAL;
+    pthread_cond_timedwait(&pool_watchdog_cond, &pool_watchdog_lock,
+                           &CDTIME_T_TO_TIMESPEC(next));
+    if (!pool_watchdog_loop)
+      break;
+    pthread_mutex_unlock(&pool_watchdog_lock);
 
-bool plugin_is_loaded(char const *name) {
-  if (plugins_loaded == NULL)
-    plugins_loaded =
-        c_avl_create((int (*)(const void *, const void *))strcasecmp);
-  assert(plugins_loaded != NULL);
+    cdtime_t now = cdtime();
 
-  int status = c_avl_get(plugins_loaded, name, /* ret_value = */ NULL);
-  return status == 0;
-}
+    /* Read callbacks are overdue if none of the read threads is waiting for
+     * them to become due. */
+    pthread_mutex_lock(&read_lock);
+    if (read_pool.threads != NULL) {
+      read_func_t *rf = c_heap_peek_root(read_heap);
+      bool backlog = (read_loop != 0) && !read_leader && (rf != NULL) &&
+                     (rf->rf_next_read <= now);
+      thread_pool_resize(&read_pool, backlog, now);
+    }
+    pthread_mutex_unlock(&read_lock);
 
-static int plugin_mark_loaded(char const *name) {
-  char *name_copy;
-  int status;
+    /* The write queue backs up if no write thread is idle and there are more
+     * values queued than the threads take in one batch each. */
+    pthread_mutex_lock(&write_lock);
+    if (write_pool.threads != NULL) {
+      long queued = write_counter_get(&write_queue_length);
+      size_t active = write_pool.threads_num - write_pool.threads_stuck;
+      bool backlog = write_loop && (write_pool.threads_idle == 0) &&
+                     (queued > (long)(active * WRITE_QUEUE_BATCH_SIZE));
+      thread_pool_resize(&write_pool, backlog, now);
+    }
+    pthread_mutex_unlock(&write_lock);
 
-  name_copy = strdup(name);
-  if (name_copy == NULL)
-    return ENOMEM;
+    pthread_mutex_lock(&pool_watchdog_lock);
+  }
+  pthread_mutex_unlock(&pool_watchdog_lock);
 
-  status = c_avl_insert(plugins_loaded,
-                        /* key = */ name_copy, /* value = */ NULL);
-  return status;
-}
+  return NULL;
+} /* }}} void *pool_watchdog_thread */
 
-static void plugin_free_loaded(void) {
-  void *key;
-  void *value;
+/* The watchdog is only needed if a pool may change its size. */
+static void start_pool_watchdog(void) /* {{{ */
+{
+  if ((read_pool.max <= read_pool.min) && (write_pool.max <= write_pool.min) &&
+      (callback_timeout == 0))
+    return;
+
+  pool_watchdog_loop = true;
+  int status = pthread_create(&pool_watchdog, /* attr = */ NULL,
+                              pool_watchdog_thread, /* arg = */ NULL);
+  if (status != 0) {
+    ERROR("plugin: start_pool_watchdog: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return;
+  }
+  set_thread_name(pool_watchdog, "pool-watchdog");
+  pool_watchdog_running = true;
+} /* }}} void start_pool_watchdog */
+
+static void stop_pool_watchdog(void) /* {{{ */
+{
+  if (!pool_watchdog_running)
+    return;
+
+  pthread_mutex_lock(&pool_watchdog_lock);
+  pool_watchdog_loop = false;
+  pthread_cond_broadcast(&pool_watchdog_cond);
+  pthread_mutex_unlock(&pool_watchdog_lock);
+
+  pthread_join(pool_watchdog, NULL);
+  pool_watchdog_running = false;
+} /* }}} void stop_pool_watchdog */
+
+/* Delay before the spool is replayed again after the write callback failed.
+ * Doubles with each failure in a row. */
+#define WRITER_QUEUE_RETRY_MIN TIME_T_TO_CDTIME_T_STATIC(1)
+#define WRITER_QUEUE_RETRY_MAX TIME_T_TO_CDTIME_T_STATIC(64)
+
+/* Default for "WriteQueueSpoolSize". */
+#define WRITER_QUEUE_SPOOL_SIZE_DEFAULT (UINT64_C(1024) * 1024 * 1024)
+
+static data_set_t *plugin_lookup_ds(char const *type);
+
+/* Passes `num' value lists to the queue's write callback. Without batching,
+ * `num' must be one. */
+static int writer_queue_call(writer_queue_t *wq, /* {{{ */
+                             data_set_t const *const *dss,
+                             value_list_t *const *vls, size_t num,
+                             plugin_ctx_t ctx) {
+  callback_func_t *cf = wq->cf;
+
+  if (cf->cf_batch) {
+    write_batch_entry_t entries[WRITE_QUEUE_BATCH_SIZE];
+    for (size_t i = 0; i < num; i++)
+      entries[i] = (write_batch_entry_t){
+          .ds = dss[i],
+          .vl = vls[i],
+          .identity = ((shared_value_list_t *)vls[i])->identity,
+      };
+
+    return plugin_write_batch_call(cf, entries, num, ctx);
+  }
+
+  assert(num == 1);
+  plugin_write_cb callback = cf->cf_callback;
+
+  /* Keep the read plugin's interval and flush information but update the
+   * plugin name. */
+  ctx.name = cf->cf_ctx.name;
+  plugin_set_ctx(ctx);
+
+  pthread_setspecific(dispatch_identity_key, vls[0]);
+  COLLECTD_PROBE2(write_start, cf->cf_ctx.name, (size_t)1);
+  cdtime_t start = callback_stats_start();
+  int status = (*callback)(dss[0], vls[0], &cf->cf_udata);
+  callback_stats_finish(cf, start);
+  COLLECTD_PROBE2(write_done, cf->cf_ctx.name, status);
+  pthread_setspecific(dispatch_identity_key, NULL);
+
+  return status;
+} /* }}} int writer_queue_call */
+
+static void writer_queue_retry_later(writer_queue_t *wq) /* {{{ */
+{
+  if (wq->retry_interval == 0)
+    wq->retry_interval = WRITER_QUEUE_RETRY_MIN;
+  else if (wq->retry_interval < WRITER_QUEUE_RETRY_MAX)
+    wq->retry_interval *= 2;
+  wq->replay_next = cdtime() + wq->retry_interval;
+} /* }}} void writer_queue_retry_later */
+
+/* Moves the value lists starting at `head', whose delivery failed, and all
+ * queued value lists to the spool. The entries starting at `head' are left
+ * to the caller. */
+static void writer_queue_spool_failed(writer_queue_t *wq, /* {{{ */
+                                      write_queue_t const *head) {
+  pthread_mutex_lock(&wq->lock);
+
+  for (write_queue_t const *q = head; q != NULL; q = q->next) {
+    if (spool_append(wq->spool, q->ds, q->vl) == 0)
+      wq->spooled++;
+    else
+      wq->dropped++;
+  }
+
+  while (wq->head != NULL) {
+    write_queue_t *q = wq->head;
+    wq->head = q->next;
+
+    if (spool_append(wq->spool, q->ds, q->vl) == 0)
+      wq->spooled++;
+    else
+      wq->dropped++;
+
+    plugin_value_list_free(q->vl);
+    c_mempool_free(write_queue_pool, q);
+  }
+  wq->tail = NULL;
+  wq->length = 0;
+
+  wq->spooling = !spool_empty(wq->spool);
+  writer_queue_retry_later(wq);
+
+  pthread_mutex_unlock(&wq->lock);
+} /* }}} void writer_queue_spool_failed */
+
+/* Delivers the next batch of value lists from the spool. Called and returns
+ * with `wq->lock' held. */
+static void writer_queue_replay(writer_queue_t *wq) /* {{{ */
+{
+  callback_func_t *cf = wq->cf;
+  size_t batch_size = cf->cf_batch ? WRITE_QUEUE_BATCH_SIZE : 1;
+  if ((wq->replay_rate > 0) && (wq->replay_rate < (double)batch_size))
+    batch_size = (wq->replay_rate >= 1.0) ? (size_t)wq->replay_rate : 1;
+
+  data_set_t const *dss[WRITE_QUEUE_BATCH_SIZE];
+  value_list_t *vls[WRITE_QUEUE_BATCH_SIZE];
+  size_t num = 0;
+
+  value_t values[256];
+  while (num < batch_size) {
+    value_list_t vl;
+    if (spool_read(wq->spool, &vl, values, STATIC_ARRAY_SIZE(values)) != 0)
+      break;
+
+    /* The data set may have changed since the values have been spooled. */
+    data_set_t const *ds = plugin_lookup_ds(vl.type);
+    if ((ds == NULL) || (ds->ds_num != vl.values_len) ||
+        ((vls[num] = plugin_value_list_clone(&vl)) == NULL)) {
+      wq->dropped++;
+      continue;
+    }
+    dss[num] = ds;
+    num++;
+  }
+
+  if (num == 0) {
+    /* Only value lists that have been dropped were read. */
+    spool_commit(wq->spool);
+    wq->spooling = !spool_empty(wq->spool);
+    return;
+  }
+
+  wq->replaying = true;
+  pthread_mutex_unlock(&wq->lock);
+
+  int status = writer_queue_call(wq, dss, vls, num, cf->cf_ctx);
+  for (size_t i = 0; i < num; i++)
+    plugin_value_list_free(vls[i]);
+
+  pthread_mutex_lock(&wq->lock);
+  wq->replaying = false;
+
+  if (status != 0) {
+    spool_rewind(wq->spool);
+    writer_queue_retry_later(wq);
+    return;
+  }
+
+  spool_commit(wq->spool);
+  wq->spooling = !spool_empty(wq->spool);
+  wq->retry_interval = 0;
+  wq->replay_next = 0;
+  if (wq->replay_rate > 0)
+    wq->replay_next = cdtime() + DOUBLE_TO_CDTIME_T((double)num /
+                                                    wq->replay_rate);
+} /* }}} void writer_queue_replay */
+
+static void *writer_queue_thread(void *arg) /* {{{ */
+{
+  writer_queue_t *wq = arg;
+  callback_func_t *cf = wq->cf;
+  /* "write_batch" callbacks get up to WRITE_QUEUE_BATCH_SIZE values at once. */
+  long batch_size = cf->cf_batch ? WRITE_QUEUE_BATCH_SIZE : 1;
+  data_set_t const *dss[WRITE_QUEUE_BATCH_SIZE];
+  value_list_t *vls[WRITE_QUEUE_BATCH_SIZE];
+
+  pthread_mutex_lock(&wq->lock);
+  while (42) {
+    /* The spool is only replayed once the queue is empty, and is kept on
+     * disk on shutdown. */
+    if ((wq->head == NULL) && wq->loop && (wq->spool != NULL) &&
+        !spool_empty(wq->spool) && !wq->replaying) {
+      if (cdtime() >= wq->replay_next) {
+        writer_queue_replay(wq);
+        continue;
+      }
+
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(wq->replay_next);
+      pthread_cond_timedwait(&wq->cond, &wq->lock, &ts);
+      continue;
+    }
+
+    while (wq->loop && (wq->head == NULL) &&
+           ((wq->spool == NULL) || spool_empty(wq->spool) || wq->replaying))
+      pthread_cond_wait(&wq->cond, &wq->lock);
+
+    /* Only exit once the queue has been drained. */
+    write_queue_t *head = wq->head;
+    if (head == NULL) {
+      if (!wq->loop)
+        break;
+      continue;
+    }
+
+    write_queue_t *last = head;
+    long num = 1;
+    while ((num < batch_size) && (last->next != NULL)) {
+      last = last->next;
+      num++;
+    }
+
+    wq->head = last->next;
+    last->next = NULL;
+    if (wq->head == NULL)
+      wq->tail = NULL;
+    wq->length -= num;
+    pthread_mutex_unlock(&wq->lock);
+
+    size_t entries_num = 0;
+    for (write_queue_t *q = head; q != NULL; q = q->next) {
+      dss[entries_num] = q->ds;
+      vls[entries_num] = q->vl;
+      entries_num++;
+    }
+
+    int status = writer_queue_call(wq, dss, vls, entries_num, head->ctx);
+    if (status != 0) {
+      DEBUG("plugin: writer_queue_thread: Write callback \"%s\" failed with "
+            "status %i.",
+            wq->name, status);
+      if (wq->spool != NULL)
+        writer_queue_spool_failed(wq, head);
+    }
+
+    while (head != NULL) {
+      write_queue_t *next = head->next;
+      plugin_value_list_free(head->vl);
+      c_mempool_free(write_queue_pool, head);
+      head = next;
+    }
+
+    pthread_mutex_lock(&wq->lock);
+  }
+  pthread_mutex_unlock(&wq->lock);
+
+  return (void *)0;
+} /* }}} void *writer_queue_thread */
+
+static writer_queue_t *writer_queue_create(char const *name, /* {{{ */
+                                           callback_func_t *cf) {
+  writer_queue_t *wq = calloc(1, sizeof(*wq));
+  if (wq == NULL)
+    return NULL;
+
+  wq->name = strdup(name);
+  if (wq->name == NULL) {
+    sfree(wq);
+    return NULL;
+  }
+
+  wq->cf = cf;
+  pthread_mutex_init(&wq->lock, /* attr = */ NULL);
+  pthread_cond_init(&wq->cond, /* attr = */ NULL);
+  wq->limit = cf->cf_ctx.write_queue_limit;
+  wq->drop_oldest = cf->cf_ctx.write_queue_drop_oldest;
+  wq->threads_num = (cf->cf_ctx.write_queue_threads > 0)
+                        ? (size_t)cf->cf_ctx.write_queue_threads
+                        : 1;
+  wq->loop = true;
+
+  if (cf->cf_ctx.write_queue_spool != NULL) {
+    uint64_t size = (cf->cf_ctx.write_queue_spool_size > 0)
+                        ? cf->cf_ctx.write_queue_spool_size
+                        : WRITER_QUEUE_SPOOL_SIZE_DEFAULT;
+    wq->spool = spool_open(cf->cf_ctx.write_queue_spool, name, size);
+    if (wq->spool == NULL)
+      ERROR("plugin: Opening the spool of \"%s\" failed. Values that don't "
+            "fit into the write queue will be dropped.",
+            name);
+    else
+      wq->spooling = !spool_empty(wq->spool);
+    wq->replay_rate = cf->cf_ctx.write_queue_replay_rate;
+  }
+
+  return wq;
+} /* }}} writer_queue_t *writer_queue_create */
+
+static void writer_queue_start(writer_queue_t *wq) /* {{{ */
+{
+  if (wq->threads != NULL)
+    return;
+
+  wq->threads = calloc(wq->threads_num, sizeof(*wq->threads));
+  if (wq->threads == NULL) {
+    ERROR("plugin: writer_queue_start: calloc failed.");
+    return;
+  }
+
+  /* Without CPUs of its own, the queue runs where the write threads run. */
+  plugin_cpus_t const *cpus = &wq->cf->cf_ctx.threads_cpus;
+  if (cpus->cpus_num == 0)
+    cpus = &write_threads_cpus;
+
+  size_t started = 0;
+  for (size_t i = 0; i < wq->threads_num; i++) {
+    int status = create_pinned_thread(wq->threads + started, cpus,
+                                      writer_queue_thread, /* arg = */ wq);
+    if (status != 0) {
+      ERROR("plugin: writer_queue_start: pthread_create failed with status %i "
+            "(%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char thread_name[THREAD_NAME_MAX];
+    ssnprintf(thread_name, sizeof(thread_name), "wq:%s", wq->name);
+    set_thread_name(wq->threads[started], thread_name);
+
+    started++;
+  }
+  wq->threads_num = started;
+
+  INFO("plugin: Started %" PRIsz " thread%s for the write queue of \"%s\".",
+       started, (started == 1) ? "" : "s", wq->name);
+} /* }}} void writer_queue_start */
+
+/* Stops the queue's threads after all queued values have been delivered. */
+static void writer_queue_stop(writer_queue_t *wq) /* {{{ */
+{
+  if (wq->threads == NULL)
+    return;
+
+  pthread_mutex_lock(&wq->lock);
+  wq->loop = false;
+  pthread_cond_broadcast(&wq->cond);
+  pthread_mutex_unlock(&wq->lock);
+
+  for (size_t i = 0; i < wq->threads_num; i++) {
+    if (pthread_join(wq->threads[i], NULL) != 0)
+      ERROR("plugin: writer_queue_stop: pthread_join failed.");
+  }
+  sfree(wq->threads);
+  wq->threads_num = 0;
+} /* }}} void writer_queue_stop */
+
+static void writer_queue_destroy(writer_queue_t *wq) /* {{{ */
+{
+  if (wq == NULL)
+    return;
+
+  writer_queue_stop(wq);
+
+  size_t i = 0;
+  while (wq->head != NULL) {
+    write_queue_t *q = wq->head;
+    wq->head = q->next;
+    plugin_value_list_free(q->vl);
+    c_mempool_free(write_queue_pool, q);
+    i++;
+  }
+
+  if (i > 0)
+    WARNING("plugin: %" PRIsz " value list%s left in the write queue of "
+            "\"%s\".",
+            i, (i == 1) ? " was" : "s were", wq->name);
+
+  spool_close(wq->spool);
+  pthread_cond_destroy(&wq->cond);
+  pthread_mutex_destroy(&wq->lock);
+  sfree(wq->name);
+  sfree(wq);
+} /* }}} void writer_queue_destroy */
+
+/* Queues `vl' for delivery by the queue's threads. The caller's reference to
+ * `vl' is handed over to the queue. */
+static int writer_queue_enqueue(writer_queue_t *wq, /* {{{ */
+                                data_set_t const *ds, value_list_t *vl,
+                                plugin_ctx_t ctx) {
+  write_queue_t *q = c_mempool_alloc(write_queue_pool);
+  if (q == NULL) {
+    plugin_value_list_free(vl);
+    return ENOMEM;
+  }
+
+  q->vl = vl;
+  q->ctx = ctx;
+  q->ds = ds;
+  q->next = NULL;
+
+  write_queue_t *dropped = NULL;
+
+  pthread_mutex_lock(&wq->lock);
+
+  if ((wq->spool != NULL) &&
+      (wq->spooling || ((wq->limit > 0) && (wq->length >= wq->limit))) &&
+      (spool_append(wq->spool, ds, vl) == 0)) {
+    wq->spooled++;
+    wq->spooling = true;
+    pthread_cond_signal(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+    plugin_value_list_free(q->vl);
+    c_mempool_free(write_queue_pool, q);
+    return 0;
+  }
+
+  /* Without a spool, or if the spool is full, the drop policy applies. */
+  if ((wq->limit > 0) && (wq->length >= wq->limit)) {
+    wq->dropped++;
+    if (!wq->drop_oldest) {
+      pthread_mutex_unlock(&wq->lock);
+      plugin_value_list_free(q->vl);
+      c_mempool_free(write_queue_pool, q);
+      return 0;
+    }
+
+    dropped = wq->head;
+    wq->head = dropped->next;
+    if (wq->head == NULL)
+      wq->tail = NULL;
+    wq->length--;
+  }
+
+  if (wq->tail == NULL)
+    wq->head = q;
+  else
+    wq->tail->next = q;
+  wq->tail = q;
+  wq->length++;
+
+  pthread_cond_signal(&wq->cond);
+  pthread_mutex_unlock(&wq->lock);
+
+  if (dropped != NULL) {
+    plugin_value_list_free(dropped->vl);
+    c_mempool_free(write_queue_pool, dropped);
+  }
+
+  return 0;
+} /* }}} int writer_queue_enqueue */
+
+static void start_writer_queues(void) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    if (cf->cf_queue != NULL)
+      writer_queue_start(cf->cf_queue);
+  }
+  writer_queues_started = true;
+} /* }}} void start_writer_queues */
+
+static void stop_writer_queues(void) /* {{{ */
+{
+  for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    if (cf->cf_queue != NULL)
+      writer_queue_stop(cf->cf_queue);
+  }
+  writer_queues_started = false;
+} /* }}} void stop_writer_queues */
+
+/*
+ * Public functions
+ */
+void plugin_set_dir(const char *dir) {
+  sfree(plugindir);
+
+  if (dir == NULL) {
+    plugindir = NULL;
+    return;
+  }
+
+  plugindir = strdup(dir);
+  if (plugindir == NULL)
+    ERROR("plugin_set_dir: strdup(\"%s\") failed", dir);
+}
+
+bool plugin_is_loaded(char const *name) {
+  if (plugins_loaded == NULL)
+    plugins_loaded =
+        c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  assert(plugins_loaded != NULL);
+
+  int status = c_avl_get(plugins_loaded, name, /* ret_value = */ NULL);
+  return status == 0;
+}
+
+static int plugin_mark_loaded(char const *name) {
+  char *name_copy;
+  int status;
+
+  name_copy = strdup(name);
+  if (name_copy == NULL)
+    return ENOMEM;
+
+  status = c_avl_insert(plugins_loaded,
+                        /* key = */ name_copy, /* value = */ NULL);
+  return status;
+}
+
+static void plugin_free_loaded(void) {
+  void *key;
+  void *value;
 
   if (plugins_loaded == NULL)
     return;
@@ -977,6 +3137,16 @@ int plugin_load(char const *plugin_name, bool global) {
   if (plugin_is_loaded(plugin_name))
     return 0;
 
+  /* Callbacks registered by the plugin keep its context, so memory allocated
+   * with plugin_malloc() from them is charged to the plugin. */
+  plugin_ctx_t ctx = plugin_get_ctx();
+  if (ctx.memtrack == NULL) {
+    char tag[DATA_MAX_NAME_LEN];
+    ssnprintf(tag, sizeof(tag), "plugin-%s", plugin_name);
+    ctx.memtrack = memtrack_get(tag);
+    plugin_set_ctx(ctx);
+  }
+
   dir = plugin_get_dir();
   ret = 1;
 
@@ -1070,6 +3240,32 @@ EXPORT int plugin_register_init(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_init, name, (void *)callback, NULL);
 } /* plugin_register_init */
 
+EXPORT int plugin_register_init_dependency(const char *name, /* {{{ */
+                                           const char *depends_on) {
+  if ((name == NULL) || (depends_on == NULL))
+    return EINVAL;
+
+  init_dependency_t *dep = calloc(1, sizeof(*dep));
+  if (dep == NULL)
+    return ENOMEM;
+
+  dep->name = strdup(name);
+  dep->depends_on = strdup(depends_on);
+  if ((dep->name == NULL) || (dep->depends_on == NULL)) {
+    sfree(dep->name);
+    sfree(dep->depends_on);
+    sfree(dep);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&register_lock);
+  dep->next = init_dependencies;
+  init_dependencies = dep;
+  pthread_mutex_unlock(&register_lock);
+
+  return 0;
+} /* }}} int plugin_register_init_dependency */
+
 static int plugin_compare_read_func(const void *arg0, const void *arg1) {
   const read_func_t *rf0;
   const read_func_t *rf1;
@@ -1085,6 +3281,57 @@ static int plugin_compare_read_func(const void *arg0, const void *arg1) {
     return 0;
 } /* int plugin_compare_read_func */
 
+/* Determines when `rf' is read for the first time. With "SpreadReads" enabled,
+ * each read function gets a fixed offset within its interval, derived from its
+ * name, so that not all read functions fire at the same time. */
+static void plugin_read_schedule_first(read_func_t *rf) /* {{{ */
+{
+  cdtime_t now = cdtime();
+
+  rf->rf_next_read = now;
+  rf->rf_effective_interval = rf->rf_interval;
+
+  if ((rf->rf_interval == 0) || !IS_TRUE(global_option_get("SpreadReads")))
+    return;
+
+  /* FNV-1a */
+  uint64_t hash = 14695981039346656037ULL;
+  for (char const *c = rf->rf_name; *c != 0; c++) {
+    hash ^= (uint64_t)(unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+
+  cdtime_t offset = (cdtime_t)(hash % rf->rf_interval);
+  rf->rf_next_read = now - (now % rf->rf_interval) + offset;
+  if (rf->rf_next_read < now)
+    rf->rf_next_read += rf->rf_interval;
+} /* }}} void plugin_read_schedule_first */
+
+/* Recalculates the first read of all read functions. Read functions registered
+ * while reading the configuration may have been inserted before the
+ * "SpreadReads" option was known. */
+static void plugin_read_reschedule_all(void) /* {{{ */
+{
+  if (read_heap == NULL)
+    return;
+
+  pthread_mutex_lock(&read_lock);
+
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+
+    /* Read functions that are being called are rescheduled when they are
+     * inserted into the heap again. */
+    if (!c_heap_contains(read_heap, rf))
+      continue;
+
+    plugin_read_schedule_first(rf);
+    c_heap_update(read_heap, rf);
+  }
+
+  pthread_mutex_unlock(&read_lock);
+} /* }}} void plugin_read_reschedule_all */
+
 /* Add a read function to both, the heap and a linked list. The linked list if
  * used to look-up read functions, especially for the remove function. The heap
  * is used to determine which plugin to read next. */
@@ -1092,8 +3339,7 @@ static int plugin_insert_read(read_func_t *rf) {
   int status;
   llentry_t *le;
 
-  rf->rf_next_read = cdtime();
-  rf->rf_effective_interval = rf->rf_interval;
+  plugin_read_schedule_first(rf);
 
   pthread_mutex_lock(&read_lock);
 
@@ -1107,7 +3353,9 @@ static int plugin_insert_read(read_func_t *rf) {
   }
 
   if (read_heap == NULL) {
-    read_heap = c_heap_create(plugin_compare_read_func);
+    /* The heap is only accessed with `read_lock' held. */
+    read_heap = c_heap_create_indexed(plugin_compare_read_func,
+                                      offsetof(read_func_t, rf_heap_index));
     if (read_heap == NULL) {
       pthread_mutex_unlock(&read_lock);
       ERROR("plugin_insert_read: c_heap_create failed.");
@@ -1142,8 +3390,7 @@ static int plugin_insert_read(read_func_t *rf) {
   /* This does not fail. */
   llist_append(read_list, le);
 
-  /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
+  plugin_read_notify(rf);
   pthread_mutex_unlock(&read_lock);
   return 0;
 } /* int plugin_insert_read */
@@ -1221,15 +3468,70 @@ EXPORT int plugin_register_complex_read(const char *group, const char *name,
   return status;
 } /* int plugin_register_complex_read */
 
+static int register_write_callback(const char *name, void *callback, /* {{{ */
+                                   bool batch, user_data_t const *ud) {
+  if (name == NULL || callback == NULL)
+    return EINVAL;
+
+  callback_func_t *cf = calloc(1, sizeof(*cf));
+  if (cf == NULL) {
+    free_userdata(ud);
+    ERROR("plugin: register_write_callback: calloc failed.");
+    return ENOMEM;
+  }
+
+  cf->cf_callback = callback;
+  if (ud != NULL)
+    cf->cf_udata = *ud;
+  cf->cf_ctx = plugin_get_ctx();
+  cf->cf_batch = batch;
+
+  if (cf->cf_ctx.downsample_interval != 0) {
+    cf->cf_downsample = downsample_create(cf->cf_ctx.downsample_interval,
+                                          cf->cf_ctx.downsample_function);
+    if (cf->cf_downsample == NULL) {
+      ERROR("plugin: register_write_callback: downsample_create failed.");
+      destroy_callback(cf);
+      return ENOMEM;
+    }
+  }
+
+  if (cf->cf_ctx.write_queue_limit != 0) {
+    cf->cf_queue = writer_queue_create(name, cf);
+    if (cf->cf_queue == NULL) {
+      ERROR("plugin: register_write_callback: writer_queue_create failed.");
+      destroy_callback(cf);
+      return ENOMEM;
+    }
+  }
+
+  int status = register_callback(&list_write, name, cf);
+  if ((status == 0) && (cf->cf_queue != NULL) && writer_queues_started)
+    writer_queue_start(cf->cf_queue);
+
+  return status;
+} /* }}} int register_write_callback */
+
 EXPORT int plugin_register_write(const char *name, plugin_write_cb callback,
                                  user_data_t const *ud) {
-  return create_register_callback(&list_write, name, (void *)callback, ud);
+  return register_write_callback(name, (void *)callback, /* batch = */ false,
+                                 ud);
 } /* int plugin_register_write */
 
+EXPORT int plugin_register_write_batch(const char *name,
+                                       plugin_write_batch_cb callback,
+                                       user_data_t const *ud) {
+  return register_write_callback(name, (void *)callback, /* batch = */ true,
+                                 ud);
+} /* int plugin_register_write_batch */
+
+/* Only queues the flush, so that a slow writer does not block a read thread.
+ * */
 static int plugin_flush_timeout_callback(user_data_t *ud) {
   flush_callback_t *cb = ud->data;
 
-  return plugin_flush(cb->name, cb->timeout, NULL);
+  plugin_flush_async(cb->name, cb->timeout, NULL, NULL, NULL);
+  return 0;
 } /* static int plugin_flush_callback */
 
 static void plugin_flush_timeout_callback_free(void *data) {
@@ -1378,52 +3680,76 @@ EXPORT int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_shutdown, name, (void *)callback, NULL);
 } /* int plugin_register_shutdown */
 
+EXPORT int plugin_register_reload(const char *name, plugin_reload_cb callback) {
+  return create_register_callback(&list_reload, name, (void *)callback, NULL);
+} /* int plugin_register_reload */
+
 static void plugin_free_data_sets(void) {
-  void *key;
+  size_t pos = 0;
+  char *key;
   void *value;
 
   if (data_sets == NULL)
     return;
 
-  while (c_avl_pick(data_sets, &key, &value) == 0) {
+  while (c_hashtable_next(data_sets, &pos, &key, &value) == 0) {
     data_set_t *ds = value;
     /* key is a pointer to ds->type */
 
-    sfree(ds->ds);
-    sfree(ds);
+    memtrack_free(ds->ds);
+    memtrack_free(ds);
   }
 
-  c_avl_destroy(data_sets);
+  c_hashtable_destroy(data_sets);
   data_sets = NULL;
 } /* void plugin_free_data_sets */
 
-EXPORT int plugin_register_data_set(const data_set_t *ds) {
-  data_set_t *ds_copy;
+static data_set_t *plugin_lookup_ds(char const *type) {
+  void *ds = NULL;
 
-  if ((data_sets != NULL) && (c_avl_get(data_sets, ds->type, NULL) == 0)) {
+  if (c_hashtable_get(data_sets, vl_identity_hash(type), type, &ds) != 0)
+    return NULL;
+  return ds;
+} /* data_set_t *plugin_lookup_ds */
+
+EXPORT int plugin_register_data_set(const data_set_t *ds) {
+  data_set_t *ds_copy;
+
+  if (plugin_lookup_ds(ds->type) != NULL) {
     NOTICE("Replacing DS `%s' with another version.", ds->type);
     plugin_unregister_data_set(ds->type);
   } else if (data_sets == NULL) {
-    data_sets = c_avl_create((int (*)(const void *, const void *))strcmp);
+    data_sets = c_hashtable_create();
     if (data_sets == NULL)
       return -1;
   }
 
-  ds_copy = malloc(sizeof(*ds_copy));
+  if (data_set_memtrack == NULL)
+    data_set_memtrack = memtrack_get("data_set");
+
+  ds_copy = memtrack_malloc(data_set_memtrack, sizeof(*ds_copy));
   if (ds_copy == NULL)
     return -1;
   memcpy(ds_copy, ds, sizeof(data_set_t));
 
-  ds_copy->ds = malloc(sizeof(*ds_copy->ds) * ds->ds_num);
+  ds_copy->ds =
+      memtrack_malloc(data_set_memtrack, sizeof(*ds_copy->ds) * ds->ds_num);
   if (ds_copy->ds == NULL) {
-    sfree(ds_copy);
+    memtrack_free(ds_copy);
     return -1;
   }
 
   for (size_t i = 0; i < ds->ds_num; i++)
     memcpy(ds_copy->ds + i, ds->ds + i, sizeof(data_source_t));
 
-  return c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  int status = c_hashtable_insert(data_sets, vl_identity_hash(ds_copy->type),
+                                  ds_copy->type, ds_copy);
+  if (status != 0) {
+    memtrack_free(ds_copy->ds);
+    memtrack_free(ds_copy);
+    return -1;
+  }
+  return 0;
 } /* int plugin_register_data_set */
 
 EXPORT int plugin_register_log(const char *name, plugin_log_cb callback,
@@ -1452,6 +3778,17 @@ EXPORT int plugin_unregister_init(const char *name) {
   return plugin_unregister(list_init, name);
 }
 
+/* Takes `rf' out of the read schedule once it has been removed from
+ * `read_list'. Returns true if `rf' has been removed from the heap and has to
+ * be destroyed by the caller after releasing `read_lock'. Otherwise a read
+ * thread is calling `rf' right now and destroys it afterwards. Must be called
+ * with `read_lock' held. */
+static bool plugin_read_unschedule(read_func_t *rf) /* {{{ */
+{
+  rf->rf_type = RF_REMOVE;
+  return c_heap_remove(read_heap, rf) == 0;
+} /* }}} bool plugin_read_unschedule */
+
 EXPORT int plugin_unregister_read(const char *name) /* {{{ */
 {
   llentry_t *le;
@@ -1478,13 +3815,17 @@ EXPORT int plugin_unregister_read(const char *name) /* {{{ */
 
   rf = le->value;
   assert(rf != NULL);
-  rf->rf_type = RF_REMOVE;
+  bool unscheduled = plugin_read_unschedule(rf);
 
   pthread_mutex_unlock(&read_lock);
 
   llentry_destroy(le);
 
-  DEBUG("plugin_unregister_read: Marked `%s' for removal.", name);
+  if (unscheduled) {
+    DEBUG("plugin_unregister_read: Destroying `%s'.", name);
+    destroy_read_func(rf);
+  } else
+    DEBUG("plugin_unregister_read: Marked `%s' for removal.", name);
 
   return 0;
 } /* }}} int plugin_unregister_read */
@@ -1530,13 +3871,23 @@ EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
 
     rf = le->value;
     assert(rf != NULL);
-    rf->rf_type = RF_REMOVE;
 
     llentry_destroy(le);
 
-    DEBUG("plugin_unregister_read_group: "
-          "Marked `%s' (group `%s') for removal.",
+    if (!plugin_read_unschedule(rf)) {
+      DEBUG("plugin_unregister_read_group: "
+            "Marked `%s' (group `%s') for removal.",
+            rf->rf_name, group);
+      continue;
+    }
+
+    /* Nothing else refers to `rf' any more, so it's destroyed without
+     * holding the lock. The search above starts over anyway. */
+    pthread_mutex_unlock(&read_lock);
+    DEBUG("plugin_unregister_read_group: Destroying `%s' (group `%s').",
           rf->rf_name, group);
+    destroy_read_func(rf);
+    pthread_mutex_lock(&read_lock);
   }
 
   pthread_mutex_unlock(&read_lock);
@@ -1605,17 +3956,22 @@ EXPORT int plugin_unregister_shutdown(const char *name) {
   return plugin_unregister(list_shutdown, name);
 }
 
+EXPORT int plugin_unregister_reload(const char *name) {
+  return plugin_unregister(list_reload, name);
+}
+
 EXPORT int plugin_unregister_data_set(const char *name) {
   data_set_t *ds;
 
   if (data_sets == NULL)
     return -1;
 
-  if (c_avl_remove(data_sets, name, NULL, (void *)&ds) != 0)
+  if (c_hashtable_remove(data_sets, vl_identity_hash(name), name, NULL,
+                         (void *)&ds) != 0)
     return -1;
 
-  sfree(ds->ds);
-  sfree(ds);
+  memtrack_free(ds->ds);
+  memtrack_free(ds);
 
   return 0;
 } /* int plugin_unregister_data_set */
@@ -1628,17 +3984,1091 @@ EXPORT int plugin_unregister_notification(const char *name) {
   return plugin_unregister(list_notification, name);
 }
 
+static void destroy_init_dependencies(void) /* {{{ */
+{
+  pthread_mutex_lock(&register_lock);
+  while (init_dependencies != NULL) {
+    init_dependency_t *dep = init_dependencies;
+    init_dependencies = dep->next;
+
+    sfree(dep->name);
+    sfree(dep->depends_on);
+    sfree(dep);
+  }
+  pthread_mutex_unlock(&register_lock);
+} /* }}} void destroy_init_dependencies */
+
+/* Returns true if no init callback `t' depends on is pending or running. The
+ * queue's lock must be held. */
+static bool init_task_is_ready(init_queue_t *q, init_task_t *t) /* {{{ */
+{
+  for (init_dependency_t *dep = init_dependencies; dep != NULL;
+       dep = dep->next) {
+    if (strcasecmp(t->name, dep->name) != 0)
+      continue;
+
+    for (size_t i = 0; i < q->tasks_num; i++) {
+      init_task_t *other = q->tasks + i;
+      if ((other != t) && (other->state != INIT_DONE) &&
+          (strcasecmp(other->name, dep->depends_on) == 0))
+        return false;
+    }
+  }
+
+  return true;
+} /* }}} bool init_task_is_ready */
+
+/* Returns the next init callback to run, or NULL if the caller has to wait for
+ * a running callback to finish. Sets `done' if no callbacks are pending. The
+ * queue's lock must be held. */
+static init_task_t *init_queue_next(init_queue_t *q, bool *done) /* {{{ */
+{
+  init_task_t *first_pending = NULL;
+
+  for (size_t i = 0; i < q->tasks_num; i++) {
+    init_task_t *t = q->tasks + i;
+    if (t->state != INIT_PENDING)
+      continue;
+
+    if (first_pending == NULL)
+      first_pending = t;
+    if (init_task_is_ready(q, t))
+      return t;
+  }
+
+  if (first_pending == NULL) {
+    *done = true;
+    return NULL;
+  }
+
+  /* Nothing is running that could satisfy the pending dependencies. */
+  if (q->running == 0) {
+    WARNING("plugin_init_all: The init dependencies of plugin `%s' form a "
+            "cycle. Initializing it anyway.",
+            first_pending->name);
+    return first_pending;
+  }
+
+  return NULL;
+} /* }}} init_task_t *init_queue_next */
+
+static void *plugin_init_thread(void *arg) /* {{{ */
+{
+  init_queue_t *q = arg;
+
+  pthread_mutex_lock(&q->lock);
+  while (42) {
+    bool done = false;
+    init_task_t *t = init_queue_next(q, &done);
+    if (done)
+      break;
+    if (t == NULL) {
+      pthread_cond_wait(&q->cond, &q->lock);
+      continue;
+    }
+
+    t->state = INIT_RUNNING;
+    q->running++;
+    pthread_mutex_unlock(&q->lock);
+
+    plugin_ctx_t old_ctx = plugin_set_ctx(t->ctx);
+    cdtime_t start = cdtime();
+    int status = (*t->callback)();
+    cdtime_t elapsed = cdtime() - start;
+    plugin_set_ctx(old_ctx);
+
+    INFO("plugin_init_all: Initialization of plugin `%s' took %.3f seconds.",
+         t->name, CDTIME_T_TO_DOUBLE(elapsed));
+
+    pthread_mutex_lock(&q->lock);
+    t->status = status;
+    t->state = INIT_DONE;
+    q->running--;
+    pthread_cond_broadcast(&q->cond);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+} /* }}} void *plugin_init_thread */
+
+/* Runs all init callbacks using `threads_num' threads, including the calling
+ * one. Callbacks are started in the order they have been registered in, as
+ * soon as the callbacks they depend on have finished. */
+static int plugin_init_run_all(size_t threads_num) /* {{{ */
+{
+  init_queue_t q = {
+      .lock = PTHREAD_MUTEX_INITIALIZER,
+      .cond = PTHREAD_COND_INITIALIZER,
+  };
+  int ret = 0;
+
+  /* Callbacks may unregister themselves, so don't keep pointers into
+   * list_init. */
+  pthread_mutex_lock(&register_lock);
+  int tasks_num = llist_size(list_init);
+  if (tasks_num == 0) {
+    pthread_mutex_unlock(&register_lock);
+    return 0;
+  }
+  q.tasks = calloc((size_t)tasks_num, sizeof(*q.tasks));
+  if (q.tasks == NULL) {
+    pthread_mutex_unlock(&register_lock);
+    ERROR("plugin_init_all: calloc failed.");
+    return -1;
+  }
+  for (llentry_t *le = llist_head(list_init); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    init_task_t *t = q.tasks + q.tasks_num;
+
+    sstrncpy(t->name, le->key, sizeof(t->name));
+    t->callback = cf->cf_callback;
+    t->ctx = cf->cf_ctx;
+    t->state = INIT_PENDING;
+    q.tasks_num++;
+  }
+  pthread_mutex_unlock(&register_lock);
+
+  if (threads_num > q.tasks_num)
+    threads_num = q.tasks_num;
+
+  pthread_t *threads = NULL;
+  size_t threads_started = 0;
+  if (threads_num > 1) {
+    threads = calloc(threads_num - 1, sizeof(*threads));
+    if (threads == NULL)
+      ERROR("plugin_init_all: calloc failed.");
+  }
+
+  for (size_t i = 0; (threads != NULL) && (i < threads_num - 1); i++) {
+    int status = pthread_create(threads + threads_started, /* attr = */ NULL,
+                                plugin_init_thread, &q);
+    if (status != 0) {
+      ERROR("plugin_init_all: pthread_create failed with status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "init#%" PRIu64, (uint64_t)threads_started);
+    set_thread_name(threads[threads_started], name);
+
+    threads_started++;
+  }
+
+  plugin_init_thread(&q);
+
+  for (size_t i = 0; i < threads_started; i++)
+    pthread_join(threads[i], NULL);
+  sfree(threads);
+
+  for (size_t i = 0; i < q.tasks_num; i++) {
+    init_task_t *t = q.tasks + i;
+    if (t->status == 0)
+      continue;
+
+    ERROR("Initialization of plugin `%s' "
+          "failed with status %i. "
+          "Plugin will be unloaded.",
+          t->name, t->status);
+    /* Plugins that register read callbacks from the init
+     * callback should take care of appropriate error
+     * handling themselves. */
+    /* FIXME: Unload _all_ functions */
+    plugin_unregister_read(t->name);
+    ret = -1;
+  }
+
+  pthread_mutex_destroy(&q.lock);
+  pthread_cond_destroy(&q.cond);
+  sfree(q.tasks);
+  return ret;
+} /* }}} int plugin_init_run_all */
+
+/* Asynchronous logging: with "LogQueueLength" set, plugin_log() formats the
+ * message into a slot of a bounded multi-producer / single-consumer ring and
+ * returns. A single log thread hands the messages to the log callbacks. Slots
+ * carry a sequence number, so producers only need a compare-and-swap on
+ * `log_ring_tail' to claim a slot and never block each other. When the ring is
+ * full, messages are dropped and counted. */
+#define LOG_MSG_SIZE 1024
+#define LOG_REPEAT_INTERVAL TIME_T_TO_CDTIME_T_STATIC(10)
+
+typedef struct {
+  uint64_t seq;
+  int level;
+  char msg[LOG_MSG_SIZE];
+} log_slot_t;
+
+static log_slot_t *log_ring;
+static uint64_t log_ring_size;
+static uint64_t log_ring_tail; /* next slot to claim, producers */
+static uint64_t log_ring_head; /* next slot to read, log thread */
+static uint64_t log_dropped;
+static bool log_thread_running;
+static bool log_thread_sleeping;
+static bool log_thread_loop;
+static pthread_t log_thread;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+
+static void plugin_log_deliver(int level, const char *msg) /* {{{ */
+{
+  llentry_t *le = llist_head(list_log);
+  while (le != NULL) {
+    callback_func_t *cf;
+    plugin_log_cb callback;
+
+    cf = le->value;
+    callback = cf->cf_callback;
+
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+
+    (*callback)(level, msg, &cf->cf_udata);
+
+    le = le->next;
+  }
+} /* }}} void plugin_log_deliver */
+
+#if HAVE_ATOMIC_BUILTINS
+/* Returns a claimed slot, or NULL if the ring is full. */
+static log_slot_t *log_ring_claim(uint64_t *ret_pos) /* {{{ */
+{
+  uint64_t pos = __atomic_load_n(&log_ring_tail, __ATOMIC_RELAXED);
+
+  while (42) {
+    log_slot_t *slot = log_ring + (pos & (log_ring_size - 1));
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&log_ring_tail, &pos, pos + 1,
+                                      /* weak = */ true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        *ret_pos = pos;
+        return slot;
+      }
+      /* `pos' has been updated by the failed compare-and-swap. */
+    } else if (diff < 0) {
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&log_ring_tail, __ATOMIC_RELAXED);
+    }
+  }
+} /* }}} log_slot_t *log_ring_claim */
+
+static bool plugin_log_async(int level, const char *format, /* {{{ */
+                             va_list ap) {
+  uint64_t pos;
+
+  if (!__atomic_load_n(&log_thread_loop, __ATOMIC_ACQUIRE))
+    return false;
+
+  log_slot_t *slot = log_ring_claim(&pos);
+  if (slot == NULL) {
+    __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  slot->level = level;
+  vsnprintf(slot->msg, sizeof(slot->msg), format, ap);
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+  if (__atomic_load_n(&log_thread_sleeping, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&log_lock);
+    pthread_cond_signal(&log_cond);
+    pthread_mutex_unlock(&log_lock);
+  }
+  return true;
+} /* }}} bool plugin_log_async */
+
+/* Copies the next message off the ring. Returns false if the ring is empty. */
+static bool log_ring_take(int *level, char *msg) /* {{{ */
+{
+  log_slot_t *slot = log_ring + (log_ring_head & (log_ring_size - 1));
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_ring_head + 1)
+    return false;
+
+  *level = slot->level;
+  memcpy(msg, slot->msg, LOG_MSG_SIZE);
+  __atomic_store_n(&slot->seq, log_ring_head + log_ring_size,
+                   __ATOMIC_RELEASE);
+  __atomic_add_fetch(&log_ring_head, 1, __ATOMIC_RELEASE);
+  return true;
+} /* }}} bool log_ring_take */
+
+static void *plugin_log_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  /* Consecutive duplicates are counted and reported as
+   * "last message repeated N times", at most every LOG_REPEAT_INTERVAL. */
+  char last_msg[LOG_MSG_SIZE] = "";
+  int last_level = -1;
+  uint64_t repeated = 0;
+  cdtime_t repeated_since = 0;
+
+  char msg[LOG_MSG_SIZE];
+  int level;
+
+  while (42) {
+    bool loop = __atomic_load_n(&log_thread_loop, __ATOMIC_ACQUIRE);
+    bool have_msg = log_ring_take(&level, msg);
+    bool is_repeat = have_msg && (level == last_level) &&
+                     (strcmp(msg, last_msg) == 0);
+    uint64_t dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    cdtime_t now = cdtime();
+
+    if ((repeated > 0) &&
+        ((have_msg && !is_repeat) || (!have_msg && !loop) || (dropped > 0) ||
+         ((now - repeated_since) >= LOG_REPEAT_INTERVAL))) {
+      char buffer[64];
+      ssnprintf(buffer, sizeof(buffer), "last message repeated %" PRIu64
+                " times", repeated);
+      plugin_log_deliver(last_level, buffer);
+      repeated = 0;
+    }
+
+    if (dropped > 0) {
+      char buffer[128];
+      ssnprintf(buffer, sizeof(buffer),
+                "plugin_log: %" PRIu64 " messages have been dropped because "
+                "the log queue was full.",
+                dropped);
+      plugin_log_deliver(LOG_WARNING, buffer);
+      last_level = -1;
+      is_repeat = false;
+    }
+
+    if (have_msg) {
+      if (is_repeat) {
+        if (repeated == 0)
+          repeated_since = now;
+        repeated++;
+      } else {
+        plugin_log_deliver(level, msg);
+        last_level = level;
+        sstrncpy(last_msg, msg, sizeof(last_msg));
+      }
+      continue;
+    }
+
+    /* The ring is empty. */
+    if (!loop)
+      break;
+
+    pthread_mutex_lock(&log_lock);
+    __atomic_store_n(&log_thread_sleeping, true, __ATOMIC_SEQ_CST);
+    /* A producer may have missed the flag, so don't sleep for long. */
+    struct timespec ts =
+        CDTIME_T_TO_TIMESPEC(cdtime() + TIME_T_TO_CDTIME_T(1) / 10);
+    if (__atomic_load_n(&log_thread_loop, __ATOMIC_ACQUIRE) &&
+        (__atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE) == log_ring_head))
+      pthread_cond_timedwait(&log_cond, &log_lock, &ts);
+    __atomic_store_n(&log_thread_sleeping, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  return NULL;
+} /* }}} void *plugin_log_thread */
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+static void start_log_thread(void) /* {{{ */
+{
+  long num = global_option_get_long("LogQueueLength", /* default = */ 0);
+  if (num <= 0)
+    return;
+
+#if HAVE_ATOMIC_BUILTINS
+  log_ring_size = 1;
+  while (log_ring_size < (uint64_t)num)
+    log_ring_size <<= 1;
+
+  log_ring = calloc(log_ring_size, sizeof(*log_ring));
+  if (log_ring == NULL) {
+    ERROR("plugin: start_log_thread: calloc failed.");
+    return;
+  }
+  for (uint64_t i = 0; i < log_ring_size; i++)
+    log_ring[i].seq = i;
+  log_ring_head = log_ring_tail = 0;
+
+  __atomic_store_n(&log_thread_loop, true, __ATOMIC_RELEASE);
+  int status = pthread_create(&log_thread, /* attr = */ NULL,
+                              plugin_log_thread, /* arg = */ NULL);
+  if (status != 0) {
+    __atomic_store_n(&log_thread_loop, false, __ATOMIC_RELEASE);
+    ERROR("plugin: start_log_thread: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    sfree(log_ring);
+    return;
+  }
+  set_thread_name(log_thread, "log");
+  log_thread_running = true;
+#else
+  WARNING("plugin: \"LogQueueLength\" requires atomic builtins, which are not "
+          "available on this platform. Logging synchronously.");
+#endif
+} /* }}} void start_log_thread */
+
+/* Delivers all queued messages and switches back to synchronous logging. */
+static void stop_log_thread(void) /* {{{ */
+{
+  if (!log_thread_running)
+    return;
+
+  __atomic_store_n(&log_thread_loop, false, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&log_lock);
+  pthread_cond_signal(&log_cond);
+  pthread_mutex_unlock(&log_lock);
+
+  pthread_join(log_thread, NULL);
+  log_thread_running = false;
+  /* Producers which claimed a slot just before the loop ended may still be
+   * writing to it, so the ring is not freed. */
+} /* }}} void stop_log_thread */
+
+EXPORT int plugin_log_backlog(void) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  if (!log_thread_running)
+    return 0;
+  return (int)(__atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&log_ring_head, __ATOMIC_ACQUIRE));
+#else
+  return 0;
+#endif
+} /* }}} int plugin_log_backlog */
+
+static void plugin_notification_deliver(const notification_t *notif) {
+  for (llentry_t *le = llist_head(list_notification); le != NULL;
+       le = le->next) {
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+
+    callback_func_t *cf = le->value;
+    plugin_notification_cb callback = cf->cf_callback;
+    cdtime_t start = callback_stats_start();
+    int status = (*callback)(notif, &cf->cf_udata);
+    callback_stats_finish(cf, start);
+    if (status != 0) {
+      WARNING("plugin_dispatch_notification: Notification "
+              "callback %s returned %i.",
+              le->key, status);
+    }
+  }
+} /* void plugin_notification_deliver */
+
+static void notif_entry_free(notif_entry_t *e) {
+  if (e == NULL)
+    return;
+  plugin_notification_meta_free(e->n.meta);
+  sfree(e->key);
+  sfree(e);
+} /* void notif_entry_free */
+
+/* Queues a copy of `notif'. Returns non-zero if the notification has to be
+ * delivered synchronously because the notification threads are not running.
+ */
+static int plugin_notification_enqueue(const notification_t *notif) {
+  notif_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return ENOMEM;
+
+  e->n = *notif;
+  e->n.meta = NULL;
+  e->ctx = plugin_get_ctx();
+
+  if (notif->meta != NULL) {
+    plugin_notification_meta_copy(&e->n, notif);
+  } else {
+    /* The unit separator does not occur in identifiers. */
+    char key[sizeof(notif->host) + sizeof(notif->plugin) +
+             sizeof(notif->plugin_instance) + sizeof(notif->type) +
+             sizeof(notif->type_instance) + sizeof(notif->message) + 16];
+    ssnprintf(key, sizeof(key), "%d\x1f%s\x1f%s\x1f%s\x1f%s\x1f%s\x1f%s",
+              notif->severity, notif->host, notif->plugin,
+              notif->plugin_instance, notif->type, notif->type_instance,
+              notif->message);
+    e->key = strdup(key);
+    e->hash = vl_identity_hash(key);
+  }
+
+  pthread_mutex_lock(&notif_lock);
+
+  if (!notif_loop) {
+    pthread_mutex_unlock(&notif_lock);
+    notif_entry_free(e);
+    return -1;
+  }
+
+  void *value;
+  if ((e->key != NULL) &&
+      (c_hashtable_get(notif_index, e->hash, e->key, &value) == 0)) {
+    notif_entry_t *queued = value;
+    /* The queued notification is delivered with the latest time. */
+    if (queued->n.time < notif->time)
+      queued->n.time = notif->time;
+    notif_coalesced++;
+    pthread_mutex_unlock(&notif_lock);
+    notif_entry_free(e);
+    return 0;
+  }
+
+  if (notif_length >= notif_limit) {
+    notif_dropped++;
+    notif_dropped_unreported++;
+    pthread_mutex_unlock(&notif_lock);
+    notif_entry_free(e);
+    return 0;
+  }
+
+  if ((e->key != NULL) &&
+      (c_hashtable_insert(notif_index, e->hash, e->key, e) != 0))
+    sfree(e->key);
+
+  if (notif_tail == NULL)
+    notif_head = e;
+  else
+    notif_tail->next = e;
+  notif_tail = e;
+  notif_length++;
+
+  pthread_cond_signal(&notif_cond);
+  pthread_mutex_unlock(&notif_lock);
+  return 0;
+} /* int plugin_notification_enqueue */
+
+static void *plugin_notification_thread(void __attribute__((unused)) * arg) {
+  while (42) {
+    pthread_mutex_lock(&notif_lock);
+    while (notif_loop && (notif_head == NULL))
+      pthread_cond_wait(&notif_cond, &notif_lock);
+
+    /* The queue is drained before the threads exit. */
+    notif_entry_t *e = notif_head;
+    if (e == NULL) {
+      pthread_mutex_unlock(&notif_lock);
+      break;
+    }
+
+    notif_head = e->next;
+    if (notif_head == NULL)
+      notif_tail = NULL;
+    notif_length--;
+    if (e->key != NULL)
+      c_hashtable_remove(notif_index, e->hash, e->key, NULL, NULL);
+
+    uint64_t dropped = notif_dropped_unreported;
+    notif_dropped_unreported = 0;
+    pthread_mutex_unlock(&notif_lock);
+
+    if (dropped > 0)
+      WARNING("plugin_dispatch_notification: %" PRIu64 " notifications have "
+              "been dropped because the notification queue was full.",
+              dropped);
+
+    plugin_ctx_t old_ctx = plugin_set_ctx(e->ctx);
+    plugin_notification_deliver(&e->n);
+    plugin_set_ctx(old_ctx);
+
+    notif_entry_free(e);
+  }
+
+  return NULL;
+} /* void *plugin_notification_thread */
+
+static void start_notification_threads(void) /* {{{ */
+{
+  long limit = global_option_get_long("NotificationQueueLength",
+                                      /* default = */ 0);
+  if (limit <= 0)
+    return;
+
+  long num = global_option_get_long("NotificationThreads", /* default = */ 1);
+  if (num < 1) {
+    ERROR("NotificationThreads must be positive.");
+    num = 1;
+  }
+
+  notif_index = c_hashtable_create();
+  notif_threads = calloc((size_t)num, sizeof(*notif_threads));
+  if ((notif_index == NULL) || (notif_threads == NULL)) {
+    ERROR("plugin: start_notification_threads: allocation failed.");
+    c_hashtable_destroy(notif_index);
+    notif_index = NULL;
+    sfree(notif_threads);
+    return;
+  }
+
+  notif_limit = (size_t)limit;
+  notif_loop = true;
+
+  for (long i = 0; i < num; i++) {
+    int status =
+        pthread_create(notif_threads + notif_threads_num, /* attr = */ NULL,
+                       plugin_notification_thread, /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_notification_threads: pthread_create failed with "
+            "status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "notify#%" PRIu64, (uint64_t)i);
+    set_thread_name(notif_threads[notif_threads_num], name);
+    notif_threads_num++;
+  }
+
+  if (notif_threads_num == 0) {
+    pthread_mutex_lock(&notif_lock);
+    notif_loop = false;
+    pthread_mutex_unlock(&notif_lock);
+  }
+} /* }}} void start_notification_threads */
+
+/* Delivers all queued notifications and switches back to synchronous
+ * delivery. */
+static void stop_notification_threads(void) /* {{{ */
+{
+  if (notif_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&notif_lock);
+  notif_loop = false;
+  pthread_cond_broadcast(&notif_cond);
+  pthread_mutex_unlock(&notif_lock);
+
+  for (size_t i = 0; i < notif_threads_num; i++)
+    pthread_join(notif_threads[i], NULL);
+  sfree(notif_threads);
+  notif_threads_num = 0;
+
+  c_hashtable_destroy(notif_index);
+  notif_index = NULL;
+} /* }}} void stop_notification_threads */
+
+static void cache_event_entry_free(cache_event_entry_t *e) {
+  if (e == NULL)
+    return;
+  plugin_value_list_free(e->vl);
+  sfree(e->name);
+  sfree(e);
+} /* void cache_event_entry_free */
+
+static void plugin_cache_event_deliver(enum cache_event_type_e event_type,
+                                       unsigned long callbacks_mask,
+                                       const char *name,
+                                       const value_list_t *vl);
+
+/* Queues a copy of the event. Returns non-zero if the event has to be
+ * delivered synchronously. A NEW event is never dropped: the callbacks only
+ * subscribe to a value list when they see it, so when the queue is full it is
+ * delivered right away and only UPDATE events are dropped. */
+static int plugin_cache_event_enqueue(enum cache_event_type_e type, /* {{{ */
+                                      unsigned long callbacks_mask,
+                                      const char *name,
+                                      const value_list_t *vl) {
+  cache_event_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return ENOMEM;
+
+  e->type = type;
+  e->callbacks_mask = callbacks_mask;
+  e->name = strdup(name);
+  e->vl = plugin_value_list_clone(vl);
+  if ((e->name == NULL) || (e->vl == NULL)) {
+    cache_event_entry_free(e);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&cache_event_lock);
+
+  if (!cache_event_loop) {
+    pthread_mutex_unlock(&cache_event_lock);
+    cache_event_entry_free(e);
+    return -1;
+  }
+
+  if (cache_event_length >= cache_event_limit) {
+    int status = 0;
+    if (type == CE_VALUE_NEW) {
+      status = -1;
+    } else {
+      cache_event_dropped++;
+      cache_event_dropped_unreported++;
+    }
+    pthread_mutex_unlock(&cache_event_lock);
+    cache_event_entry_free(e);
+    return status;
+  }
+
+  /* The thread takes all queued events at once, so it only needs to be
+   * woken up for the first one. */
+  if (cache_event_tail == NULL) {
+    cache_event_head = e;
+    pthread_cond_signal(&cache_event_cond);
+  } else {
+    cache_event_tail->next = e;
+  }
+  cache_event_tail = e;
+  cache_event_length++;
+
+  pthread_mutex_unlock(&cache_event_lock);
+  return 0;
+} /* }}} int plugin_cache_event_enqueue */
+
+static void *plugin_cache_event_thread(void __attribute__((unused)) *
+                                       arg) /* {{{ */
+{
+  while (42) {
+    pthread_mutex_lock(&cache_event_lock);
+    while (cache_event_loop && (cache_event_head == NULL))
+      pthread_cond_wait(&cache_event_cond, &cache_event_lock);
+
+    /* The queue is drained before the thread exits. */
+    cache_event_entry_t *batch = cache_event_head;
+    if (batch == NULL) {
+      pthread_mutex_unlock(&cache_event_lock);
+      break;
+    }
+
+    cache_event_head = cache_event_tail = NULL;
+    cache_event_length = 0;
+
+    uint64_t dropped = cache_event_dropped_unreported;
+    cache_event_dropped_unreported = 0;
+    pthread_mutex_unlock(&cache_event_lock);
+
+    if (dropped > 0)
+      WARNING("plugin_dispatch_cache_event: %" PRIu64 " cache events have "
+              "been dropped because the cache event queue was full.",
+              dropped);
+
+    while (batch != NULL) {
+      cache_event_entry_t *e = batch;
+      batch = e->next;
+
+      plugin_cache_event_deliver(e->type, e->callbacks_mask, e->name, e->vl);
+      cache_event_entry_free(e);
+    }
+  }
+
+  return NULL;
+} /* }}} void *plugin_cache_event_thread */
+
+static void start_cache_event_thread(void) /* {{{ */
+{
+  long limit = global_option_get_long("CacheEventQueueLength",
+                                      /* default = */ 0);
+  if ((limit <= 0) || (list_cache_event_num == 0))
+    return;
+
+  cache_event_limit = (size_t)limit;
+  cache_event_loop = true;
+
+  int status = pthread_create(&cache_event_thread, /* attr = */ NULL,
+                              plugin_cache_event_thread, /* arg = */ NULL);
+  if (status != 0) {
+    ERROR("plugin: start_cache_event_thread: pthread_create failed with "
+          "status %i (%s).",
+          status, STRERROR(status));
+    pthread_mutex_lock(&cache_event_lock);
+    cache_event_loop = false;
+    pthread_mutex_unlock(&cache_event_lock);
+    return;
+  }
+  set_thread_name(cache_event_thread, "cache_event");
+  cache_event_thread_running = true;
+} /* }}} void start_cache_event_thread */
+
+/* Delivers all queued cache events and switches back to synchronous
+ * delivery. */
+static void stop_cache_event_thread(void) /* {{{ */
+{
+  if (!cache_event_thread_running)
+    return;
+
+  pthread_mutex_lock(&cache_event_lock);
+  cache_event_loop = false;
+  pthread_cond_broadcast(&cache_event_cond);
+  pthread_mutex_unlock(&cache_event_lock);
+
+  pthread_join(cache_event_thread, NULL);
+  cache_event_thread_running = false;
+} /* }}} void stop_cache_event_thread */
+
+/* Calls the flush callback of the writer `plugin' and reports the result to
+ * `done', if not NULL. */
+static int plugin_flush_one(char const *plugin, cdtime_t timeout, /* {{{ */
+                            char const *identifier, plugin_flush_done_cb done,
+                            void *done_ud) {
+  pthread_mutex_lock(&register_lock);
+  llentry_t *le = llist_search(list_flush, plugin);
+  callback_func_t *cf = (le != NULL) ? le->value : NULL;
+  pthread_mutex_unlock(&register_lock);
+
+  int status = ENOENT;
+  cdtime_t start = cdtime();
+  if (cf != NULL) {
+    plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+    plugin_flush_cb callback = cf->cf_callback;
+    status = (*callback)(timeout, identifier, &cf->cf_udata);
+    plugin_set_ctx(old_ctx);
+  }
+  cdtime_t duration = cdtime() - start;
+
+  if ((cf != NULL) && record_statistics)
+    callback_stats_record(cf, duration, /* overrun = */ false);
+
+  if (done != NULL)
+    (*done)(plugin, status, duration, done_ud);
+  return status;
+} /* }}} int plugin_flush_one */
+
+static void *plugin_flush_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  while (42) {
+    pthread_mutex_lock(&flush_lock);
+    while (flush_loop && (flush_head == NULL))
+      pthread_cond_wait(&flush_cond, &flush_lock);
+
+    /* The queue is drained before the threads exit. */
+    flush_job_t *job = flush_head;
+    if (job == NULL) {
+      pthread_mutex_unlock(&flush_lock);
+      break;
+    }
+
+    flush_head = job->next;
+    if (flush_head == NULL)
+      flush_tail = NULL;
+    flush_length--;
+    pthread_mutex_unlock(&flush_lock);
+
+    plugin_flush_one(job->plugin, job->timeout, job->identifier, job->done,
+                     job->done_ud);
+
+    sfree(job->plugin);
+    sfree(job->identifier);
+    sfree(job);
+  }
+
+  return NULL;
+} /* }}} void *plugin_flush_thread */
+
+/* Returns true if a flush of `plugin' without a completion callback is
+ * waiting in the queue already. Must be called with `flush_lock' held. */
+static bool flush_job_queued(char const *plugin, /* {{{ */
+                             char const *identifier) {
+  for (flush_job_t *job = flush_head; job != NULL; job = job->next) {
+    if ((job->done != NULL) || (strcmp(plugin, job->plugin) != 0))
+      continue;
+    if ((identifier == NULL) && (job->identifier == NULL))
+      return true;
+    if ((identifier != NULL) && (job->identifier != NULL) &&
+        (strcmp(identifier, job->identifier) == 0))
+      return true;
+  }
+  return false;
+} /* }}} bool flush_job_queued */
+
+/* Queues the flush of `plugin'. Returns EAGAIN if the flush has to be done by
+ * the calling thread, because there are no flush threads or the caller is
+ * one of them. */
+static int flush_job_enqueue(char const *plugin, cdtime_t timeout, /* {{{ */
+                             char const *identifier, plugin_flush_done_cb done,
+                             void *done_ud) {
+  pthread_mutex_lock(&flush_lock);
+  if (!flush_loop) {
+    pthread_mutex_unlock(&flush_lock);
+    return EAGAIN;
+  }
+  for (size_t i = 0; i < flush_threads_num; i++) {
+    if (pthread_equal(pthread_self(), flush_threads[i])) {
+      pthread_mutex_unlock(&flush_lock);
+      return EAGAIN;
+    }
+  }
+
+  /* Periodic flushes of a slow writer would pile up otherwise. */
+  if ((done == NULL) && flush_job_queued(plugin, identifier)) {
+    pthread_mutex_unlock(&flush_lock);
+    return 0;
+  }
+
+  flush_job_t *job = calloc(1, sizeof(*job));
+  if (job == NULL) {
+    pthread_mutex_unlock(&flush_lock);
+    return EAGAIN;
+  }
+  job->plugin = strdup(plugin);
+  job->identifier = (identifier != NULL) ? strdup(identifier) : NULL;
+  if ((job->plugin == NULL) || ((identifier != NULL) && !job->identifier)) {
+    pthread_mutex_unlock(&flush_lock);
+    sfree(job->plugin);
+    sfree(job->identifier);
+    sfree(job);
+    return EAGAIN;
+  }
+  job->timeout = timeout;
+  job->done = done;
+  job->done_ud = done_ud;
+
+  if (flush_tail == NULL)
+    flush_head = job;
+  else
+    flush_tail->next = job;
+  flush_tail = job;
+  flush_length++;
+
+  pthread_cond_signal(&flush_cond);
+  pthread_mutex_unlock(&flush_lock);
+  return 0;
+} /* }}} int flush_job_enqueue */
+
+EXPORT int plugin_flush_async(const char *plugin, cdtime_t timeout, /* {{{ */
+                              const char *identifier,
+                              plugin_flush_done_cb done, void *done_ud) {
+  /* Copy the names, flush callbacks may unregister themselves. */
+  char **names = NULL;
+  size_t names_num = 0;
+
+  pthread_mutex_lock(&register_lock);
+  for (llentry_t *le = llist_head(list_flush); le != NULL; le = le->next)
+    if ((plugin == NULL) || (strcmp(plugin, le->key) == 0))
+      strarray_add(&names, &names_num, le->key);
+  pthread_mutex_unlock(&register_lock);
+
+  for (size_t i = 0; i < names_num; i++)
+    if (flush_job_enqueue(names[i], timeout, identifier, done, done_ud) != 0)
+      plugin_flush_one(names[i], timeout, identifier, done, done_ud);
+
+  strarray_free(names, names_num);
+  return (int)names_num;
+} /* }}} int plugin_flush_async */
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t done;
+  int status;
+} flush_wait_t;
+
+static void plugin_flush_wait_done(char const __attribute__((unused)) * plugin,
+                                   int status,
+                                   cdtime_t __attribute__((unused)) duration,
+                                   void *ud) {
+  flush_wait_t *w = ud;
+
+  pthread_mutex_lock(&w->lock);
+  w->done++;
+  if (status != 0)
+    w->status = -1;
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+} /* void plugin_flush_wait_done */
+
+EXPORT int plugin_flush(const char *plugin, cdtime_t timeout,
+                        const char *identifier) {
+  flush_wait_t w = {
+      .lock = PTHREAD_MUTEX_INITIALIZER,
+      .cond = PTHREAD_COND_INITIALIZER,
+  };
+
+  int num = plugin_flush_async(plugin, timeout, identifier,
+                               plugin_flush_wait_done, &w);
+
+  pthread_mutex_lock(&w.lock);
+  while (w.done < (size_t)num)
+    pthread_cond_wait(&w.cond, &w.lock);
+  pthread_mutex_unlock(&w.lock);
+
+  pthread_mutex_destroy(&w.lock);
+  pthread_cond_destroy(&w.cond);
+
+  if ((num == 0) && (plugin != NULL))
+    return ENOENT;
+  return w.status;
+} /* int plugin_flush */
+
+static void start_flush_threads(void) /* {{{ */
+{
+  long num = global_option_get_long("FlushThreads", /* default = */ 0);
+  if (num < 0) {
+    ERROR("FlushThreads must be positive or zero.");
+    return;
+  }
+  if (num == 0)
+    return;
+
+  flush_threads = calloc((size_t)num, sizeof(*flush_threads));
+  if (flush_threads == NULL) {
+    ERROR("plugin: start_flush_threads: calloc failed.");
+    return;
+  }
+
+  /* The threads are added to `flush_threads' under the lock, so that
+   * flush_job_enqueue() recognizes them. */
+  pthread_mutex_lock(&flush_lock);
+  flush_loop = true;
+  for (long i = 0; i < num; i++) {
+    int status =
+        pthread_create(flush_threads + flush_threads_num, /* attr = */ NULL,
+                       plugin_flush_thread, /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_flush_threads: pthread_create failed with "
+            "status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "flush#%" PRIu64, (uint64_t)i);
+    set_thread_name(flush_threads[flush_threads_num], name);
+    flush_threads_num++;
+  }
+
+  if (flush_threads_num == 0) {
+    flush_loop = false;
+    sfree(flush_threads);
+  }
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void start_flush_threads */
+
+/* Finishes the queued flushes and switches back to flushing on the calling
+ * thread. */
+static void stop_flush_threads(void) /* {{{ */
+{
+  if (flush_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&flush_lock);
+  flush_loop = false;
+  pthread_cond_broadcast(&flush_cond);
+  pthread_mutex_unlock(&flush_lock);
+
+  for (size_t i = 0; i < flush_threads_num; i++)
+    pthread_join(flush_threads[i], NULL);
+
+  pthread_mutex_lock(&flush_lock);
+  sfree(flush_threads);
+  flush_threads_num = 0;
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void stop_flush_threads */
+
 EXPORT int plugin_init_all(void) {
   char const *chain_name;
-  llentry_t *le;
-  int status;
   int ret = 0;
 
   /* Init the value cache */
   uc_init();
 
+  start_log_thread();
+
   if (IS_TRUE(global_option_get("CollectInternalStats"))) {
     record_statistics = true;
+    fc_enable_statistics();
     plugin_register_read("collectd", plugin_update_internal_statistics);
   }
 
@@ -1667,48 +5097,49 @@ EXPORT int plugin_init_all(void) {
     write_limit_low = write_limit_high;
   }
 
-  write_threads_num = global_option_get_long("WriteThreads",
-                                             /* default = */ 5);
+  long write_threads_num = global_option_get_long("WriteThreads",
+                                                  /* default = */ 5);
   if (write_threads_num < 1) {
     ERROR("WriteThreads must be positive.");
     write_threads_num = 5;
   }
 
-  if ((list_init == NULL) && (read_heap == NULL))
+  long write_threads_max =
+      global_option_get_long("WriteThreadsMax", write_threads_num);
+  if (write_threads_max < write_threads_num) {
+    ERROR("WriteThreadsMax must not be smaller than WriteThreads.");
+    write_threads_max = write_threads_num;
+  }
+
+  thread_idle_timeout = global_option_get_time("ThreadIdleTimeout",
+                                               TIME_T_TO_CDTIME_T_STATIC(60));
+  callback_timeout =
+      global_option_get_time("CallbackTimeout", /* default = */ 0);
+
+  long init_threads_num = global_option_get_long("InitThreads",
+                                                 /* default = */ 1);
+  if (init_threads_num < 1) {
+    ERROR("InitThreads must be positive.");
+    init_threads_num = 1;
+  }
+
+  if ((list_init == NULL) && (read_heap == NULL)) {
+    destroy_init_dependencies();
     return ret;
+  }
 
   /* Calling all init callbacks before checking if read callbacks
    * are available allows the init callbacks to register the read
    * callback. */
-  le = llist_head(list_init);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_init_cb callback;
-    plugin_ctx_t old_ctx;
-
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
-    status = (*callback)();
-    plugin_set_ctx(old_ctx);
+  if (list_init != NULL)
+    ret = plugin_init_run_all((size_t)init_threads_num);
+  destroy_init_dependencies();
 
-    if (status != 0) {
-      ERROR("Initialization of plugin `%s' "
-            "failed with status %i. "
-            "Plugin will be unloaded.",
-            le->key, status);
-      /* Plugins that register read callbacks from the init
-       * callback should take care of appropriate error
-       * handling themselves. */
-      /* FIXME: Unload _all_ functions */
-      plugin_unregister_read(le->key);
-      ret = -1;
-    }
-
-    le = le->next;
-  }
-
-  start_write_threads((size_t)write_threads_num);
+  start_writer_queues();
+  start_write_threads((size_t)write_threads_num, (size_t)write_threads_max);
+  start_notification_threads();
+  start_cache_event_thread();
+  start_flush_threads();
 
   max_read_interval =
       global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
@@ -1718,21 +5149,125 @@ EXPORT int plugin_init_all(void) {
     const char *rt;
     int num;
 
+    if (IS_TRUE(global_option_get("SpreadReads")))
+      plugin_read_reschedule_all();
+
     rt = global_option_get("ReadThreads");
     num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
+    if (num != -1) {
+      if (num <= 0)
+        num = 5;
+
+      long max = global_option_get_long("ReadThreadsMax", num);
+      if (max < num) {
+        ERROR("ReadThreadsMax must not be smaller than ReadThreads.");
+        max = num;
+      }
+      start_read_threads((size_t)num, (size_t)max);
+    }
   }
+
+  start_pool_watchdog();
   return ret;
 } /* void plugin_init_all */
 
+/* Calls the init callback of a plugin loaded or reconfigured after
+ * plugin_init_all(). Like there, the plugin's read callbacks are unregistered
+ * if it fails. */
+EXPORT int plugin_init_plugin(const char *name) /* {{{ */
+{
+  pthread_mutex_lock(&register_lock);
+  llentry_t *le = llist_search(list_init, name);
+  if (le == NULL) {
+    pthread_mutex_unlock(&register_lock);
+    return 0;
+  }
+  callback_func_t *cf = le->value;
+  plugin_init_cb callback = cf->cf_callback;
+  plugin_ctx_t ctx = cf->cf_ctx;
+  pthread_mutex_unlock(&register_lock);
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+  int status = (*callback)();
+  plugin_set_ctx(old_ctx);
+
+  if (status != 0) {
+    ERROR("Initialization of plugin `%s' "
+          "failed with status %i. "
+          "Plugin will be unloaded.",
+          name, status);
+    plugin_unregister_read(name);
+  }
+  return status;
+} /* }}} int plugin_init_plugin */
+
+EXPORT int plugin_reload_plugin(const char *name) /* {{{ */
+{
+  pthread_mutex_lock(&register_lock);
+  llentry_t *le = llist_search(list_reload, name);
+  if (le == NULL) {
+    pthread_mutex_unlock(&register_lock);
+    return ENOENT;
+  }
+  callback_func_t *cf = le->value;
+  plugin_reload_cb callback = cf->cf_callback;
+  plugin_ctx_t ctx = cf->cf_ctx;
+  pthread_mutex_unlock(&register_lock);
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
+  int status = (*callback)();
+  plugin_set_ctx(old_ctx);
+
+  if (status != 0)
+    ERROR("Reloading plugin `%s' failed with status %i.", name, status);
+  return status;
+} /* }}} int plugin_reload_plugin */
+
+EXPORT int plugin_reload_chains(oconfig_item_t const *const *blocks, /* {{{ */
+                                size_t blocks_num) {
+  /* The write threads keep running: they only wait for the chains that are
+   * being processed to finish. */
+  pthread_rwlock_wrlock(&chains_lock);
+  int status = fc_reconfigure(blocks, blocks_num);
+  pre_cache_chain = fc_chain_get_by_name(global_option_get("PreCacheChain"));
+  post_cache_chain = fc_chain_get_by_name(global_option_get("PostCacheChain"));
+  pthread_rwlock_unlock(&chains_lock);
+
+  if (status != 0)
+    ERROR("Reconfiguring the filter chains failed, keeping the old chains.");
+  return status;
+} /* }}} int plugin_reload_chains */
+
 /* TODO: Rename this function. */
 EXPORT void plugin_read_all(void) {
   uc_check_timeout();
+  uc_persist(/* force = */ false);
 
   return;
 } /* void plugin_read_all */
 
+/* Calls the read callback of `rf' once in the caller's thread. */
+static int plugin_read_call(read_func_t *rf) /* {{{ */
+{
+  int status;
+  plugin_ctx_t old_ctx = plugin_set_ctx(rf->rf_ctx);
+
+  if (rf->rf_type == RF_SIMPLE) {
+    int (*callback)(void);
+
+    callback = rf->rf_callback;
+    status = (*callback)();
+  } else {
+    plugin_read_cb callback;
+
+    callback = rf->rf_callback;
+    status = (*callback)(&rf->rf_udata);
+  }
+
+  plugin_set_ctx(old_ctx);
+  return status;
+} /* }}} int plugin_read_call */
+
 /* Read function called when the `-T' command line argument is given. */
 EXPORT int plugin_read_all_once(void) {
   int status;
@@ -1744,41 +5279,57 @@ EXPORT int plugin_read_all_once(void) {
   }
 
   while (42) {
-    read_func_t *rf;
-    plugin_ctx_t old_ctx;
-
-    rf = c_heap_get_root(read_heap);
+    read_func_t *rf = c_heap_get_root(read_heap);
     if (rf == NULL)
       break;
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
-
-    if (rf->rf_type == RF_SIMPLE) {
-      int (*callback)(void);
-
-      callback = rf->rf_callback;
-      status = (*callback)();
-    } else {
-      plugin_read_cb callback;
-
-      callback = rf->rf_callback;
-      status = (*callback)(&rf->rf_udata);
-    }
-
-    plugin_set_ctx(old_ctx);
-
+    status = plugin_read_call(rf);
     if (status != 0) {
       NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
       return_status = -1;
     }
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
+    destroy_read_func(rf);
   }
 
   return return_status;
 } /* int plugin_read_all_once */
 
+/* Passes `vl' to the write callback `cf'. Writers with "DownsampleInterval"
+ * only receive a reduced value list once per interval and series. */
+static int plugin_write_one(callback_func_t *cf, /* {{{ */
+                            const data_set_t *ds, const value_list_t *vl) {
+  value_list_t reduced;
+  value_t reduced_values[ds->ds_num];
+
+  if (cf->cf_downsample != NULL) {
+    vl_identity_t const *id = plugin_value_list_identity(vl);
+    vl_identity_t const *interned = NULL;
+    if (id == NULL)
+      id = interned = vl_identity_intern(vl);
+    if (id == NULL)
+      return ENOMEM;
+
+    int status = downsample_add(cf->cf_downsample, ds, vl, id, &reduced,
+                                reduced_values);
+    vl_identity_release(interned);
+    if (status <= 0)
+      return -status;
+    vl = &reduced;
+  }
+
+  if ((cf->cf_queue != NULL) || cf->cf_batch)
+    return plugin_write_batch_add(cf, ds, vl);
+
+  plugin_write_cb callback = cf->cf_callback;
+  COLLECTD_PROBE2(write_start, cf->cf_ctx.name, (size_t)1);
+  cdtime_t start = callback_stats_start();
+  int status = (*callback)(ds, vl, &cf->cf_udata);
+  callback_stats_finish(cf, start);
+  COLLECTD_PROBE2(write_done, cf->cf_ctx.name, status);
+  return status;
+} /* }}} int plugin_write_one */
+
 EXPORT int plugin_write(const char *plugin, /* {{{ */
                         const data_set_t *ds, const value_list_t *vl) {
   llentry_t *le;
@@ -1801,11 +5352,9 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
   if (plugin == NULL) {
     int success = 0;
     int failure = 0;
-
     le = llist_head(list_write);
     while (le != NULL) {
       callback_func_t *cf = le->value;
-      plugin_write_cb callback;
 
       /* Keep the read plugin's interval and flush information but update the
        * plugin name. */
@@ -1815,8 +5364,7 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
       plugin_set_ctx(ctx);
 
       DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-      callback = cf->cf_callback;
-      status = (*callback)(ds, vl, &cf->cf_udata);
+      status = plugin_write_one(cf, ds, vl);
       if (status != 0)
         failure++;
       else
@@ -1833,7 +5381,6 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
   } else /* plugin != NULL */
   {
     callback_func_t *cf;
-    plugin_write_cb callback;
 
     le = llist_head(list_write);
     while (le != NULL) {
@@ -1852,43 +5399,305 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
      * information of the calling read plugin */
 
     DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-    callback = cf->cf_callback;
-    status = (*callback)(ds, vl, &cf->cf_udata);
+    status = plugin_write_one(cf, ds, vl);
   }
 
   return status;
 } /* }}} int plugin_write */
 
-EXPORT int plugin_flush(const char *plugin, cdtime_t timeout,
-                        const char *identifier) {
-  llentry_t *le;
+/* Number of series the synthetic values written by plugin_bench_all() are
+ * spread across. */
+#define BENCH_WRITE_SERIES 100
+/* How long plugin_bench_all() waits for the write threads to catch up after
+ * each read callback. */
+#define BENCH_DRAIN_TIMEOUT TIME_T_TO_CDTIME_T(10)
+
+/* Statistics of one callback, collected by plugin_bench_all(). */
+typedef struct {
+  char const *kind;
+  char *name;
+  cdtime_t *latencies; /* one per call, sorted after the run */
+  size_t calls;
+  size_t failures;
+  cdtime_t cpu_total;
+  int64_t values;
+  int64_t heap_bytes;
+  int64_t tracked_bytes;
+} bench_result_t;
+
+/* Returns the CPU time used by the calling thread, or zero if that is not
+ * available. */
+static cdtime_t bench_thread_cputime(void) /* {{{ */
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return TIMESPEC_TO_CDTIME_T(&ts);
+#endif
+  return 0;
+} /* }}} cdtime_t bench_thread_cputime */
+
+/* Returns the number of bytes in use on the heap, or zero if that is not
+ * available. */
+static int64_t bench_heap_bytes(void) /* {{{ */
+{
+#if HAVE_MALLINFO2
+  struct mallinfo2 mi = mallinfo2();
+  return (int64_t)(mi.uordblks + mi.hblkhd);
+#else
+  return 0;
+#endif
+} /* }}} int64_t bench_heap_bytes */
+
+/* Waits until the write threads have dequeued everything the last callback
+ * dispatched, so that its values are not charged to the next one. */
+static void bench_drain_write_queue(void) /* {{{ */
+{
+  cdtime_t deadline = cdtime() + BENCH_DRAIN_TIMEOUT;
+  struct timespec ts = CDTIME_T_TO_TIMESPEC(MS_TO_CDTIME_T(1));
+
+  while ((write_counter_get(&write_queue_length) > 0) &&
+         (cdtime() < deadline))
+    nanosleep(&ts, NULL);
+} /* }}} void bench_drain_write_queue */
+
+/* Measures one call of a callback. `call' returns the callback's status. */
+static void bench_measure(bench_result_t *r, memtrack_t *tag, /* {{{ */
+                          int (*call)(void *), void *arg) {
+  int64_t heap_start = bench_heap_bytes();
+  int64_t tracked_start = memtrack_bytes(tag);
+  long values_start = write_counter_get(&bench_values_num);
+  cdtime_t cpu_start = bench_thread_cputime();
+  cdtime_t start = cdtime();
+
+  int status = (*call)(arg);
+
+  r->latencies[r->calls] = cdtime() - start;
+  r->cpu_total += bench_thread_cputime() - cpu_start;
+  r->calls++;
+  if (status != 0)
+    r->failures++;
+
+  bench_drain_write_queue();
+  r->values += (int64_t)(write_counter_get(&bench_values_num) - values_start);
+  r->heap_bytes += bench_heap_bytes() - heap_start;
+  r->tracked_bytes += memtrack_bytes(tag) - tracked_start;
+} /* }}} void bench_measure */
+
+static int bench_read_call(void *arg) /* {{{ */
+{
+  return plugin_read_call(arg);
+} /* }}} int bench_read_call */
+
+typedef struct {
+  callback_func_t *cf;
+  data_set_t const *ds;
+  value_list_t vl;
+  size_t num;
+} bench_write_t;
+
+static int bench_write_call(void *arg) /* {{{ */
+{
+  bench_write_t *bw = arg;
+
+  bw->vl.values[0].gauge = (gauge_t)bw->num;
+  bw->vl.time = cdtime();
+  ssnprintf(bw->vl.type_instance, sizeof(bw->vl.type_instance), "%zu",
+            bw->num % BENCH_WRITE_SERIES);
+  bw->num++;
+
+  plugin_ctx_t old_ctx = plugin_get_ctx();
+  plugin_ctx_t ctx = old_ctx;
+  ctx.name = bw->cf->cf_ctx.name;
+  plugin_set_ctx(ctx);
+
+  int status = plugin_write_one(bw->cf, bw->ds, &bw->vl);
+
+  plugin_set_ctx(old_ctx);
+  return status;
+} /* }}} int bench_write_call */
+
+static int bench_cmp_cdtime(void const *a, void const *b) /* {{{ */
+{
+  cdtime_t x = *(cdtime_t const *)a;
+  cdtime_t y = *(cdtime_t const *)b;
+  return (x > y) - (x < y);
+} /* }}} int bench_cmp_cdtime */
+
+/* Returns the `percent' percentile of the sorted latencies in milliseconds. */
+static double bench_percentile(bench_result_t const *r, /* {{{ */
+                               double percent) {
+  if (r->calls == 0)
+    return 0.0;
+
+  size_t idx = (size_t)ceil(percent / 100.0 * (double)r->calls);
+  if (idx > 0)
+    idx--;
+  return CDTIME_T_TO_DOUBLE(r->latencies[idx]) * 1000.0;
+} /* }}} double bench_percentile */
+
+static void bench_print_table(FILE *fh, bench_result_t *results, /* {{{ */
+                              size_t results_num) {
+  fprintf(fh,
+          "%-5s %-24s %7s %5s %9s %9s %9s %9s %9s %8s %10s %10s\n", "kind",
+          "callback", "calls", "fail", "p50[ms]", "p90[ms]", "p99[ms]",
+          "max[ms]", "cpu[ms]", "values", "heap[B]", "plugin[B]");
+
+  for (size_t i = 0; i < results_num; i++) {
+    bench_result_t *r = results + i;
+    double n = (r->calls > 0) ? (double)r->calls : 1.0;
+
+    fprintf(fh,
+            "%-5s %-24s %7zu %5zu %9.3f %9.3f %9.3f %9.3f %9.3f %8.1f %10.1f "
+            "%10.1f\n",
+            r->kind, r->name, r->calls, r->failures, bench_percentile(r, 50),
+            bench_percentile(r, 90), bench_percentile(r, 99),
+            bench_percentile(r, 100),
+            CDTIME_T_TO_DOUBLE(r->cpu_total) * 1000.0 / n,
+            (double)r->values / n, (double)r->heap_bytes / n,
+            (double)r->tracked_bytes / n);
+  }
+} /* }}} void bench_print_table */
+
+static void bench_print_json_string(FILE *fh, char const *s) /* {{{ */
+{
+  fputc('"', fh);
+  for (; *s != 0; s++) {
+    if ((*s == '"') || (*s == '\\'))
+      fprintf(fh, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(fh, "\\u%04x", (unsigned int)*s);
+    else
+      fputc(*s, fh);
+  }
+  fputc('"', fh);
+} /* }}} void bench_print_json_string */
+
+static void bench_print_json(FILE *fh, bench_result_t *results, /* {{{ */
+                             size_t results_num) {
+  fprintf(fh, "[");
+
+  for (size_t i = 0; i < results_num; i++) {
+    bench_result_t *r = results + i;
+    double n = (r->calls > 0) ? (double)r->calls : 1.0;
+
+    fprintf(fh, "%s\n  {\"kind\":\"%s\",\"callback\":", (i == 0) ? "" : ",",
+            r->kind);
+    bench_print_json_string(fh, r->name);
+    fprintf(fh,
+            ",\"calls\":%zu,\"failures\":%zu,\"latency_ms\":{\"p50\":%.6f,"
+            "\"p90\":%.6f,\"p99\":%.6f,\"max\":%.6f},\"cpu_ms\":%.6f,"
+            "\"values\":%.3f,\"heap_bytes\":%.1f,\"plugin_bytes\":%.1f}",
+            r->calls, r->failures, bench_percentile(r, 50),
+            bench_percentile(r, 90),
+            bench_percentile(r, 99), bench_percentile(r, 100),
+            CDTIME_T_TO_DOUBLE(r->cpu_total) * 1000.0 / n,
+            (double)r->values / n, (double)r->heap_bytes / n,
+            (double)r->tracked_bytes / n);
+  }
+
+  fprintf(fh, "\n]\n");
+} /* }}} void bench_print_json */
 
-  if (list_flush == NULL)
+/* Benchmark called when the `-b' command line argument is given. */
+EXPORT int plugin_bench_all(plugin_bench_options_t const *opts, /* {{{ */
+                            FILE *fh) {
+  if ((opts == NULL) || (opts->iterations == 0) || (fh == NULL))
+    return EINVAL;
+
+  /* No read threads are running in this mode and read functions are only
+   * added and removed by init and shutdown callbacks, so the list is stable
+   * while the benchmark runs. */
+  size_t results_num = (size_t)llist_size(read_list);
+  if (opts->write)
+    results_num += (size_t)llist_size(list_write);
+
+  if (results_num == 0) {
+    NOTICE("plugin_bench_all: No read or write callbacks are registered.");
     return 0;
+  }
 
-  le = llist_head(list_flush);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_flush_cb callback;
-    plugin_ctx_t old_ctx;
+  bench_result_t *results = calloc(results_num, sizeof(*results));
+  if (results == NULL)
+    return ENOMEM;
 
-    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0)) {
-      le = le->next;
-      continue;
+  size_t n = 0;
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next)
+    results[n++] = (bench_result_t){.kind = "read", .name = le->key};
+  if (opts->write)
+    for (llentry_t *le = llist_head(list_write); le != NULL; le = le->next)
+      results[n++] = (bench_result_t){.kind = "write", .name = le->key};
+
+  for (size_t i = 0; i < results_num; i++) {
+    results[i].latencies = calloc(opts->iterations, sizeof(cdtime_t));
+    if (results[i].latencies == NULL) {
+      for (size_t j = 0; j < i; j++)
+        sfree(results[j].latencies);
+      sfree(results);
+      return ENOMEM;
     }
+  }
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
+  bench_count_values = true;
 
-    (*callback)(timeout, identifier, &cf->cf_udata);
+  n = 0;
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+    for (size_t i = 0; i < opts->iterations; i++)
+      bench_measure(results + n, rf->rf_ctx.memtrack, bench_read_call, rf);
+    n++;
+  }
 
-    plugin_set_ctx(old_ctx);
+  bench_count_values = false;
+
+  if (opts->write) {
+    data_set_t const *ds = plugin_get_ds("gauge");
+    value_t value = {.gauge = 0};
+    if (ds == NULL)
+      ERROR("plugin_bench_all: Unable to look up type \"gauge\"; not "
+            "benchmarking write callbacks.");
+
+    for (llentry_t *le = llist_head(list_write); (ds != NULL) && (le != NULL);
+         le = le->next) {
+      bench_write_t bw = {
+          .cf = le->value,
+          .ds = ds,
+          .vl = VALUE_LIST_INIT,
+      };
+      bw.vl.values = &value;
+      bw.vl.values_len = 1;
+      bw.vl.interval = cf_get_default_interval();
+      sstrncpy(bw.vl.host, hostname_g, sizeof(bw.vl.host));
+      sstrncpy(bw.vl.plugin, "bench", sizeof(bw.vl.plugin));
+      sstrncpy(bw.vl.type, "gauge", sizeof(bw.vl.type));
+
+      for (size_t i = 0; i < opts->iterations; i++)
+        bench_measure(results + n, bw.cf->cf_ctx.memtrack, bench_write_call,
+                      &bw);
+      n++;
+    }
+  }
 
-    le = le->next;
+  int ret = 0;
+  for (size_t i = 0; i < results_num; i++) {
+    qsort(results[i].latencies, results[i].calls, sizeof(cdtime_t),
+          bench_cmp_cdtime);
+    if (results[i].failures > 0)
+      ret = -1;
   }
-  return 0;
-} /* int plugin_flush */
+
+  if (opts->json)
+    bench_print_json(fh, results, results_num);
+  else
+    bench_print_table(fh, results, results_num);
+  fflush(fh);
+
+  for (size_t i = 0; i < results_num; i++)
+    sfree(results[i].latencies);
+  sfree(results);
+
+  return ret;
+} /* }}} int plugin_bench_all */
 
 EXPORT int plugin_shutdown_all(void) {
   llentry_t *le;
@@ -1896,6 +5705,7 @@ EXPORT int plugin_shutdown_all(void) {
 
   destroy_all_callbacks(&list_init);
 
+  stop_pool_watchdog();
   stop_read_threads();
 
   pthread_mutex_lock(&read_lock);
@@ -1908,10 +5718,25 @@ EXPORT int plugin_shutdown_all(void) {
   /* blocks until all write threads have shut down. */
   stop_write_threads();
 
+  /* blocks until all writer queues have been drained. */
+  stop_writer_queues();
+
+  /* delivers the queued notifications before the notification plugins are
+   * shut down. Later notifications are delivered synchronously. */
+  stop_notification_threads();
+
+  /* delivers the queued cache events. No more values are dispatched, and
+   * expired values are reported synchronously anyway. */
+  stop_cache_event_thread();
+
+  /* save the cache, now that no more values are dispatched. */
+  uc_persist(/* force = */ true);
+
   /* ask all plugins to write out the state they kept. */
   plugin_flush(/* plugin = */ NULL,
                /* timeout = */ 0,
                /* identifier = */ NULL);
+  stop_flush_threads();
 
   le = NULL;
   if (list_shutdown != NULL)
@@ -1950,6 +5775,9 @@ EXPORT int plugin_shutdown_all(void) {
 
   destroy_all_callbacks(&list_notification);
   destroy_all_callbacks(&list_shutdown);
+  destroy_all_callbacks(&list_reload);
+
+  stop_log_thread();
   destroy_all_callbacks(&list_log);
 
   plugin_free_loaded();
@@ -1986,9 +5814,10 @@ EXPORT int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
   return 0;
 } /* int }}} plugin_dispatch_missing */
 
-void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
-                                 unsigned long callbacks_mask, const char *name,
-                                 const value_list_t *vl) {
+static void plugin_cache_event_deliver(enum cache_event_type_e event_type,
+                                       unsigned long callbacks_mask,
+                                       const char *name,
+                                       const value_list_t *vl) {
   switch (event_type) {
   case CE_VALUE_NEW:
     callbacks_mask = 0;
@@ -2017,7 +5846,7 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
           DEBUG(
               "plugin_dispatch_cache_event: Callback \"%s\" subscribed to %s.",
               cef->name, name);
-          callbacks_mask |= (1 << (i));
+          callbacks_mask |= (1UL << i);
         } else {
           DEBUG("plugin_dispatch_cache_event: Callback \"%s\" ignores %s.",
                 cef->name, name);
@@ -2038,7 +5867,7 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
       if (!callback)
         continue;
 
-      if (callbacks_mask && (1 << (i)) == 0)
+      if ((callbacks_mask & (1UL << i)) == 0)
         continue;
 
       cache_event_t event = (cache_event_t){.type = event_type,
@@ -2059,15 +5888,24 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
     }
     break;
   }
-  return;
-}
+} /* void plugin_cache_event_deliver */
+
+void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
+                                 unsigned long callbacks_mask, const char *name,
+                                 const value_list_t *vl) {
+  /* The cache entry is removed right after the EXPIRED event, so it is
+   * delivered synchronously, while the callbacks can still look it up. */
+  if ((cache_event_limit > 0) && (event_type != CE_VALUE_EXPIRED) &&
+      (plugin_cache_event_enqueue(event_type, callbacks_mask, name, vl) == 0))
+    return;
+
+  plugin_cache_event_deliver(event_type, callbacks_mask, name, vl);
+} /* void plugin_dispatch_cache_event */
 
 static int plugin_dispatch_values_internal(value_list_t *vl) {
   int status;
   static c_complain_t no_write_complaint = C_COMPLAIN_INIT_STATIC;
 
-  bool free_meta_data = false;
-
   assert(vl != NULL);
 
   /* These fields are initialized by plugin_value_list_clone() if needed: */
@@ -2082,12 +5920,6 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     return -1;
   }
 
-  /* Free meta data only if the calling function didn't specify any. In
-   * this case matches and targets may add some and the calling function
-   * may not expect (and therefore free) that data. */
-  if (vl->meta == NULL)
-    free_meta_data = true;
-
   if (list_write == NULL)
     c_complain_once(LOG_WARNING, &no_write_complaint,
                     "plugin_dispatch_values: No write callback has been "
@@ -2101,8 +5933,13 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     return -1;
   }
 
-  data_set_t *ds = NULL;
-  if (c_avl_get(data_sets, vl->type, (void *)&ds) != 0) {
+  /* Use the data set looked up by the dispatching plugin, if any. */
+  shared_value_list_t *svl = pthread_getspecific(dispatch_identity_key);
+  if ((svl != NULL) && (vl != &svl->vl))
+    svl = NULL;
+
+  data_set_t const *ds = (svl != NULL) ? svl->ds : NULL;
+  if ((ds == NULL) && ((ds = plugin_lookup_ds(vl->type)) == NULL)) {
     char ident[6 * DATA_MAX_NAME_LEN];
 
     FORMAT_VL(ident, sizeof(ident), vl);
@@ -2147,6 +5984,12 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   escape_slashes(vl->type, sizeof(vl->type));
   escape_slashes(vl->type_instance, sizeof(vl->type_instance));
 
+  /* Compute the canonical name and its hash once, for the filter chain, the
+   * cache and the writers. */
+  if ((svl != NULL) && (svl->identity == NULL))
+    svl->identity = vl_identity_intern(vl);
+
+  pthread_rwlock_rdlock(&chains_lock);
   if (pre_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, pre_cache_chain);
     if (status < 0) {
@@ -2154,13 +5997,34 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
               "pre-cache chain failed with "
               "status %i (%#x).",
               status, status);
-    } else if (status == FC_TARGET_STOP)
+    } else if (status == FC_TARGET_STOP) {
+      pthread_rwlock_unlock(&chains_lock);
       return 0;
+    }
   }
+  pthread_rwlock_unlock(&chains_lock);
 
   /* Update the value cache */
-  uc_update(ds, vl);
+  COLLECTD_PROBE2(cache_update_start, vl->plugin, vl->type);
+  plugin_ctx_t ctx = plugin_get_ctx();
+  bool unchanged = false;
+  if (ctx.suppress_unchanged) {
+    cdtime_t heartbeat = ctx.suppress_unchanged_heartbeat;
+    if (heartbeat == 0)
+      heartbeat = 10 * vl->interval;
+
+    if (uc_update_unchanged(ds, vl, heartbeat, &unchanged) != 0)
+      unchanged = false;
+  } else
+    uc_update(ds, vl);
+  COLLECTD_PROBE2(cache_update_done, vl->plugin, vl->type);
+
+  if (unchanged) {
+    write_counter_add(&values_suppressed, 1);
+    return 0;
+  }
 
+  pthread_rwlock_rdlock(&chains_lock);
   if (post_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, post_cache_chain);
     if (status < 0) {
@@ -2171,24 +6035,24 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     }
   } else
     fc_default_action(ds, vl);
-
-  if ((free_meta_data == true) && (vl->meta != NULL)) {
-    meta_data_destroy(vl->meta);
-    vl->meta = NULL;
-  }
+  pthread_rwlock_unlock(&chains_lock);
 
   return 0;
 } /* int plugin_dispatch_values_internal */
 
-static double get_drop_probability(void) /* {{{ */
+/* Returns the probability with which values of the given priority class are
+ * dropped. Without priorities, it grows linearly from zero at
+ * "WriteQueueLimitLow" to one at "WriteQueueLimitHigh". Lower classes are
+ * shed first: "Low" values are dropped twice as fast, "High" values only once
+ * the queue is half-way to the high limit and "Critical" values only once the
+ * high limit is reached. */
+static double get_drop_probability(int priority) /* {{{ */
 {
   long pos;
   long size;
   long wql;
 
-  pthread_mutex_lock(&write_lock);
-  wql = write_queue_length;
-  pthread_mutex_unlock(&write_lock);
+  wql = write_counter_get(&write_queue_length);
 
   if (wql < write_limit_low)
     return 0.0;
@@ -2198,7 +6062,19 @@ static double get_drop_probability(void) /* {{{ */
   pos = 1 + wql - write_limit_low;
   size = 1 + write_limit_high - write_limit_low;
 
-  return (double)pos / (double)size;
+  double p = (double)pos / (double)size;
+  if (priority <= PLUGIN_PRIORITY_LOW)
+    p = 2.0 * p;
+  else if (priority == PLUGIN_PRIORITY_HIGH)
+    p = 2.0 * p - 1.0;
+  else if (priority >= PLUGIN_PRIORITY_CRITICAL)
+    p = 0.0;
+
+  if (p < 0.0)
+    return 0.0;
+  if (p > 1.0)
+    return 1.0;
+  return p;
 } /* }}} double get_drop_probability */
 
 static bool check_drop_value(void) /* {{{ */
@@ -2213,7 +6089,13 @@ static bool check_drop_value(void) /* {{{ */
   if (write_limit_high == 0)
     return false;
 
-  p = get_drop_probability();
+  int priority = plugin_get_ctx().dispatch_priority;
+  if (priority < PLUGIN_PRIORITY_LOW)
+    priority = PLUGIN_PRIORITY_LOW;
+  else if (priority > PLUGIN_PRIORITY_CRITICAL)
+    priority = PLUGIN_PRIORITY_CRITICAL;
+
+  p = get_drop_probability(priority);
   if (p == 0.0)
     return false;
 
@@ -2225,35 +6107,37 @@ static bool check_drop_value(void) /* {{{ */
     if ((now - last_message_time) > TIME_T_TO_CDTIME_T(1)) {
       last_message_time = now;
       ERROR("plugin_dispatch_values: Low water mark "
-            "reached. Dropping %.0f%% of metrics.",
-            100.0 * p);
+            "reached. Dropping %.0f%% of metrics with normal priority.",
+            100.0 * get_drop_probability(PLUGIN_PRIORITY_NORMAL));
     }
     pthread_mutex_unlock(&last_message_lock);
   }
 
-  if (p == 1.0)
-    return true;
+  if (p != 1.0) {
+    q = cdrand_d();
+    if (q >= p)
+      return false;
+  }
 
-  q = cdrand_d();
-  if (q > p)
-    return true;
-  else
-    return false;
+  if (record_statistics) {
+    pthread_mutex_lock(&statistics_lock);
+    stats_values_dropped++;
+    stats_values_dropped_class[priority - PLUGIN_PRIORITY_LOW]++;
+    pthread_mutex_unlock(&statistics_lock);
+  }
+
+  return true;
 } /* }}} bool check_drop_value */
 
 EXPORT int plugin_dispatch_values(value_list_t const *vl) {
   int status;
 
-  if (check_drop_value()) {
-    if (record_statistics) {
-      pthread_mutex_lock(&statistics_lock);
-      stats_values_dropped++;
-      pthread_mutex_unlock(&statistics_lock);
-    }
+  if (check_drop_value())
     return 0;
-  }
 
+  COLLECTD_PROBE2(dispatch_start, vl->plugin, vl->type);
   status = plugin_write_enqueue(vl);
+  COLLECTD_PROBE2(dispatch_done, vl->plugin, status);
   if (status != 0) {
     ERROR("plugin_dispatch_values: plugin_write_enqueue failed with status %i "
           "(%s).",
@@ -2264,6 +6148,31 @@ EXPORT int plugin_dispatch_values(value_list_t const *vl) {
   return 0;
 }
 
+EXPORT int plugin_dispatch_values_batch(value_list_t const *vls, /* {{{ */
+                                        size_t num) {
+  return plugin_dispatch_values_batch_ds(vls, NULL, num);
+} /* }}} int plugin_dispatch_values_batch */
+
+EXPORT int plugin_dispatch_values_batch_ds(value_list_t const *vls, /* {{{ */
+                                           data_set_t const *const *dss,
+                                           size_t num) {
+  if ((vls == NULL) && (num != 0))
+    return EINVAL;
+
+  COLLECTD_PROBE1(dispatch_batch_start, num);
+  int status =
+      plugin_write_enqueue_list(vls, dss, num, /* check_drop = */ true);
+  COLLECTD_PROBE2(dispatch_batch_done, num, status);
+  if (status != 0) {
+    ERROR("plugin_dispatch_values_batch: plugin_write_enqueue_list failed "
+          "with status %i (%s).",
+          status, STRERROR(status));
+    return status;
+  }
+
+  return 0;
+} /* }}} int plugin_dispatch_values_batch_ds */
+
 __attribute__((sentinel)) int
 plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
                            bool store_percentage, int store_type, ...) {
@@ -2272,14 +6181,8 @@ plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
   gauge_t sum = 0.0;
   va_list ap;
 
-  if (check_drop_value()) {
-    if (record_statistics) {
-      pthread_mutex_lock(&statistics_lock);
-      stats_values_dropped++;
-      pthread_mutex_unlock(&statistics_lock);
-    }
+  if (check_drop_value())
     return 0;
-  }
 
   assert(template->values_len == 1);
 
@@ -2349,7 +6252,6 @@ plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
 } /* }}} int plugin_dispatch_multivalue */
 
 EXPORT int plugin_dispatch_notification(const notification_t *notif) {
-  llentry_t *le;
   /* Possible TODO: Add flap detection here */
 
   DEBUG("plugin_dispatch_notification: severity = %i; message = %s; "
@@ -2361,40 +6263,32 @@ EXPORT int plugin_dispatch_notification(const notification_t *notif) {
   if (list_notification == NULL)
     return -1;
 
-  le = llist_head(list_notification);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_notification_cb callback;
-    int status;
-
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
-
-    cf = le->value;
-    callback = cf->cf_callback;
-    status = (*callback)(notif, &cf->cf_udata);
-    if (status != 0) {
-      WARNING("plugin_dispatch_notification: Notification "
-              "callback %s returned %i.",
-              le->key, status);
-    }
-
-    le = le->next;
-  }
+  if ((notif_limit > 0) && (plugin_notification_enqueue(notif) == 0))
+    return 0;
 
+  plugin_notification_deliver(notif);
   return 0;
 } /* int plugin_dispatch_notification */
 
 EXPORT void plugin_log(int level, const char *format, ...) {
-  char msg[1024];
+  char msg[LOG_MSG_SIZE];
   va_list ap;
-  llentry_t *le;
 
 #if !COLLECT_DEBUG
   if (level >= LOG_DEBUG)
     return;
 #endif
 
+#if HAVE_ATOMIC_BUILTINS
+  if (log_thread_running) {
+    va_start(ap, format);
+    bool queued = plugin_log_async(level, format, ap);
+    va_end(ap);
+    if (queued)
+      return;
+  }
+#endif
+
   va_start(ap, format);
   vsnprintf(msg, sizeof(msg), format, ap);
   msg[sizeof(msg) - 1] = '\0';
@@ -2405,21 +6299,7 @@ EXPORT void plugin_log(int level, const char *format, ...) {
     return;
   }
 
-  le = llist_head(list_log);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_log_cb callback;
-
-    cf = le->value;
-    callback = cf->cf_callback;
-
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
-
-    (*callback)(level, msg, &cf->cf_udata);
-
-    le = le->next;
-  }
+  plugin_log_deliver(level, msg);
 } /* void plugin_log */
 
 void daemon_log(int level, const char *format, ...) {
@@ -2480,7 +6360,7 @@ EXPORT const data_set_t *plugin_get_ds(const char *name) {
     return NULL;
   }
 
-  if (c_avl_get(data_sets, name, (void *)&ds) != 0) {
+  if ((ds = plugin_lookup_ds(name)) == NULL) {
     DEBUG("No such dataset registered: %s", name);
     return NULL;
   }
@@ -2712,6 +6592,26 @@ EXPORT cdtime_t plugin_get_interval(void) {
   return cf_get_default_interval();
 } /* cdtime_t plugin_get_interval */
 
+EXPORT void *plugin_malloc(size_t size) {
+  return memtrack_malloc(plugin_get_ctx().memtrack, size);
+} /* void *plugin_malloc */
+
+EXPORT void *plugin_calloc(size_t nmemb, size_t size) {
+  return memtrack_calloc(plugin_get_ctx().memtrack, nmemb, size);
+} /* void *plugin_calloc */
+
+EXPORT void *plugin_realloc(void *ptr, size_t size) {
+  return memtrack_realloc(plugin_get_ctx().memtrack, ptr, size);
+} /* void *plugin_realloc */
+
+EXPORT char *plugin_strdup(char const *s) {
+  return memtrack_strdup(plugin_get_ctx().memtrack, s);
+} /* char *plugin_strdup */
+
+EXPORT void plugin_free(void *ptr) {
+  memtrack_free(ptr);
+} /* void plugin_free */
+
 typedef struct {
   plugin_ctx_t ctx;
   void *(*start_routine)(void *);
@@ -2743,7 +6643,8 @@ int plugin_thread_create(pthread_t *thread, void *(*start_routine)(void *),
   plugin_thread->start_routine = start_routine;
   plugin_thread->arg = arg;
 
-  int ret = pthread_create(thread, NULL, plugin_thread_start, plugin_thread);
+  int ret = create_pinned_thread(thread, &plugin_thread->ctx.threads_cpus,
+                                 plugin_thread_start, plugin_thread);
   if (ret != 0) {
     sfree(plugin_thread);
     return ret;
@@ -31,6 +31,7 @@
 #include "collectd.h"
 
 #include "configfile.h"
+#include "utils/memtrack/memtrack.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_time.h"
 
@@ -180,11 +181,70 @@ typedef struct cache_event_s {
   int ret;
 } cache_event_t;
 
+/* Interned identity of a value list, see utils_identity.h. */
+struct vl_identity_s;
+typedef struct vl_identity_s vl_identity_t;
+
+/* One value list of a batch passed to a "write_batch" callback. */
+struct write_batch_entry_s {
+  const data_set_t *ds;
+  const value_list_t *vl;
+  /* Identity of `vl' computed at dispatch time. May be NULL. */
+  const vl_identity_t *identity;
+};
+typedef struct write_batch_entry_s write_batch_entry_t;
+
+/* Priority classes of dispatched values, see "DispatchPriority". When the
+ * write queue grows beyond "WriteQueueLimitLow", values of lower classes are
+ * dropped first. */
+#define PLUGIN_PRIORITY_LOW -1
+#define PLUGIN_PRIORITY_NORMAL 0
+#define PLUGIN_PRIORITY_HIGH 1
+#define PLUGIN_PRIORITY_CRITICAL 2
+
+/* CPUs threads are pinned to, see "ReadThreadsCPUs". An empty list means
+ * threads may run on any CPU. */
+struct plugin_cpus_s {
+  unsigned int *cpus;
+  size_t cpus_num;
+};
+typedef struct plugin_cpus_s plugin_cpus_t;
+
 struct plugin_ctx_s {
   char *name;
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* Options of the dedicated write queue, see "WriteQueueLimit". A limit of
+   * zero means write callbacks are called from the write threads directly. */
+  long write_queue_limit;
+  int write_queue_threads;
+  bool write_queue_drop_oldest;
+  /* Spool directory of the dedicated write queue, see "WriteQueueSpool".
+   * NULL if values are not spooled. */
+  char *write_queue_spool;
+  uint64_t write_queue_spool_size;
+  /* Values per second replayed from the spool. Zero means no limit. */
+  double write_queue_replay_rate;
+  /* One of the PLUGIN_PRIORITY_* classes. Applies to values dispatched from
+   * this context. */
+  int dispatch_priority;
+  /* CPUs of the threads started with plugin_thread_create() and of the
+   * dedicated write queue, see "ThreadsCPUs". */
+  plugin_cpus_t threads_cpus;
+  /* Values dispatched from this context that equal the previous values of
+   * their series are not written, see "SuppressUnchanged". They are written
+   * at least once per heartbeat; zero means ten times the values' interval. */
+  bool suppress_unchanged;
+  cdtime_t suppress_unchanged_heartbeat;
+  /* Write callbacks registered from this context receive one value list per
+   * series and "DownsampleInterval", reduced with one of the DOWNSAMPLE_*
+   * functions. Zero means values are written as they are. */
+  cdtime_t downsample_interval;
+  int downsample_function;
+  /* Memory allocated with plugin_malloc() and friends from this context is
+   * charged to this tag, "plugin-<name>" for contexts of loaded plugins. */
+  memtrack_t *memtrack;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -195,6 +255,14 @@ typedef int (*plugin_init_cb)(void);
 typedef int (*plugin_read_cb)(user_data_t *);
 typedef int (*plugin_write_cb)(const data_set_t *, const value_list_t *,
                                user_data_t *);
+/* "write_batch" callback. Receives all value lists a write thread has handled
+ * in one go. The entries are only valid for the duration of the call. */
+typedef int (*plugin_write_batch_cb)(const write_batch_entry_t *entries,
+                                     size_t entries_num, user_data_t *);
+/* Reports the completion of the flush of the writer `plugin', see
+ * plugin_flush_async(). */
+typedef void (*plugin_flush_done_cb)(const char *plugin, int status,
+                                     cdtime_t duration, void *user_data);
 typedef int (*plugin_flush_cb)(cdtime_t timeout, const char *identifier,
                                user_data_t *);
 /* "missing" callback. Returns less than zero on failure, zero if other
@@ -208,6 +276,9 @@ typedef int (*plugin_missing_cb)(const value_list_t *, user_data_t *);
 typedef int (*plugin_cache_event_cb)(cache_event_t *, user_data_t *);
 typedef void (*plugin_log_cb)(int severity, const char *message, user_data_t *);
 typedef int (*plugin_shutdown_cb)(void);
+/* "reload" callback. Called when the configuration of the plugin changed and
+ * is reloaded, see plugin_register_reload(). */
+typedef int (*plugin_reload_cb)(void);
 typedef int (*plugin_notification_cb)(const notification_t *, user_data_t *);
 /*
  * NAME
@@ -252,8 +323,75 @@ bool plugin_is_loaded(char const *name);
 int plugin_init_all(void);
 void plugin_read_all(void);
 int plugin_read_all_once(void);
+
+typedef struct {
+  size_t iterations;
+  bool write; /* also benchmark the write callbacks */
+  bool json;
+} plugin_bench_options_t;
+
+/*
+ * NAME
+ *  plugin_bench_all
+ *
+ * DESCRIPTION
+ *  Calls every read callback `iterations' times in the calling thread and, if
+ *  `write' is set, passes `iterations' synthetic "gauge" values to every write
+ *  callback. For each callback, the latency percentiles as well as the CPU
+ *  time, number of dispatched values and heap growth per call are printed to
+ *  `fh', as a table or as JSON.
+ *
+ * RETURN VALUE
+ *  Zero if all calls succeeded, -1 if some failed and an errno value if the
+ *  benchmark could not be run.
+ */
+int plugin_bench_all(plugin_bench_options_t const *opts, FILE *fh);
 int plugin_shutdown_all(void);
 
+/*
+ * NAME
+ *  plugin_init_plugin
+ *
+ * DESCRIPTION
+ *  Calls the init callback of the plugin `name', if it has one. Used for
+ *  plugins that are loaded or reconfigured after plugin_init_all(). If the
+ *  callback fails, the plugin's read callback is unregistered.
+ *
+ * RETURN VALUE
+ *  Returns the status of the init callback, zero if there is none.
+ */
+int plugin_init_plugin(const char *name);
+
+/*
+ * NAME
+ *  plugin_reload_plugin
+ *
+ * DESCRIPTION
+ *  Calls the reload callback of the plugin `name'. Its configuration callback
+ *  and its init callback are called with the new configuration afterwards.
+ *
+ * RETURN VALUE
+ *  Returns ENOENT if the plugin did not register a reload callback, the status
+ *  of the callback otherwise.
+ */
+int plugin_reload_plugin(const char *name);
+
+/*
+ * NAME
+ *  plugin_reload_chains
+ *
+ * DESCRIPTION
+ *  Replaces the filter chains with the chains configured by the `blocks_num'
+ *  <Chain> blocks and looks up the "PreCacheChain" and "PostCacheChain"
+ *  again. Values are not dispatched through the chains while they are
+ *  replaced. If the new chains are invalid, the old ones are kept.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, non-zero otherwise.
+ */
+int plugin_reload_chains(oconfig_item_t const *const *blocks,
+                         size_t blocks_num);
+
 /*
  * NAME
  *  plugin_write
@@ -284,8 +422,76 @@ int plugin_shutdown_all(void);
 int plugin_write(const char *plugin, const data_set_t *ds,
                  const value_list_t *vl);
 
+/*
+ * NAME
+ *  plugin_value_list_unshare
+ *
+ * DESCRIPTION
+ *  Value lists being dispatched are passed to writer queues and "write_batch"
+ *  callbacks by reference. This function makes sure `vl' may be modified
+ *  without changing the values these writers have already been handed, by
+ *  giving them a copy of `vl' if necessary. It must be called before
+ *  modifying a value list in the filter chain.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success or ENOMEM if copying the value list failed.
+ */
+int plugin_value_list_unshare(const value_list_t *vl);
+
+/*
+ * NAME
+ *  plugin_value_list_identity
+ *
+ * DESCRIPTION
+ *  Returns the identity of the value list being dispatched, which holds its
+ *  canonical name as returned by FORMAT_VL() and a hash of that name. The
+ *  identity is computed once per value list and available to the filter
+ *  chain, the value cache and write callbacks, so they don't have to format
+ *  the name themselves.
+ *
+ * RETURN VALUE
+ *  The identity or NULL if `vl' is not the value list currently being
+ *  dispatched by this thread, or if it has been modified by the filter chain.
+ *  Callers must fall back to FORMAT_VL() in that case. The identity remains
+ *  valid while `vl' does.
+ */
+const vl_identity_t *plugin_value_list_identity(const value_list_t *vl);
+
+/*
+ * NAME
+ *  plugin_flush
+ *
+ * DESCRIPTION
+ *  Calls the flush callback of the writer `plugin' or, if `plugin' is NULL,
+ *  of all writers and waits for them to return. With "FlushThreads" set, the
+ *  writers are flushed in parallel.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOENT if `plugin' has no flush callback and
+ *  -1 if a flush callback failed.
+ */
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier);
 
+/*
+ * NAME
+ *  plugin_flush_async
+ *
+ * DESCRIPTION
+ *  Like plugin_flush(), but only queues the flushes for the flush threads and
+ *  returns. If `done' is not NULL, it is called with `user_data' once for each
+ *  writer, with the status the flush callback returned and the time it took.
+ *  It may be called by the calling thread before this function returns:
+ *  without flush threads the writers are flushed right away. Flushes without
+ *  `done' are skipped if the same flush is queued already.
+ *
+ * RETURN VALUE
+ *  Returns the number of writers flushed, i.e. the number of times `done'
+ *  will be called.
+ */
+int plugin_flush_async(const char *plugin, cdtime_t timeout,
+                       const char *identifier, plugin_flush_done_cb done,
+                       void *user_data);
+
 /*
  * The `plugin_register_*' functions are used to make `config', `init',
  * `read', `write' and `shutdown' functions known to the plugin
@@ -297,6 +503,21 @@ int plugin_register_config(const char *name,
 int plugin_register_complex_config(const char *type,
                                    int (*callback)(oconfig_item_t *));
 int plugin_register_init(const char *name, plugin_init_cb callback);
+/*
+ * NAME
+ *  plugin_register_init_dependency
+ *
+ * DESCRIPTION
+ *  Makes sure the init callback `name' is not called before the init callback
+ *  `depends_on' has returned. This only matters if "InitThreads" is greater
+ *  than one; otherwise init callbacks are called in the order they have been
+ *  registered in. Dependencies on plugins that are not loaded are ignored.
+ *  Must be called before plugin_init_all(), e.g. from `module_register'.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success or an errno value if an error occurred.
+ */
+int plugin_register_init_dependency(const char *name, const char *depends_on);
 int plugin_register_read(const char *name, int (*callback)(void));
 /* "user_data" will be freed automatically, unless
  * "plugin_register_complex_read" returns an error (non-zero). */
@@ -305,6 +526,21 @@ int plugin_register_complex_read(const char *group, const char *name,
                                  user_data_t const *user_data);
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *user_data);
+/*
+ * NAME
+ *  plugin_register_write_batch
+ *
+ * DESCRIPTION
+ *  Registers a write callback that is called with an array of value lists
+ *  rather than a single one. The write threads collect all values they
+ *  dequeue in one go and pass them to the callback after running the filter
+ *  chains, which allows the writer to amortize locking and I/O over many
+ *  values. Write batch callbacks are unregistered using
+ *  `plugin_unregister_write'.
+ */
+int plugin_register_write_batch(const char *name,
+                                plugin_write_batch_cb callback,
+                                user_data_t const *user_data);
 int plugin_register_flush(const char *name, plugin_flush_cb callback,
                           user_data_t const *user_data);
 int plugin_register_missing(const char *name, plugin_missing_cb callback,
@@ -313,6 +549,19 @@ int plugin_register_cache_event(const char *name,
                                 plugin_cache_event_cb callback,
                                 user_data_t const *ud);
 int plugin_register_shutdown(const char *name, plugin_shutdown_cb callback);
+/*
+ * NAME
+ *  plugin_register_reload
+ *
+ * DESCRIPTION
+ *  Allows the plugin `name' to be reconfigured without restarting the daemon
+ *  when its <Plugin> blocks change. The callback is called first and has to
+ *  release the current configuration, including read callbacks registered for
+ *  it. The new blocks are then passed to the configuration callback and the
+ *  init callback is called again. Plugins without a reload callback keep
+ *  their configuration until the daemon is restarted.
+ */
+int plugin_register_reload(const char *name, plugin_reload_cb callback);
 int plugin_register_data_set(const data_set_t *ds);
 int plugin_register_log(const char *name, plugin_log_cb callback,
                         user_data_t const *user_data);
@@ -330,6 +579,7 @@ int plugin_unregister_flush(const char *name);
 int plugin_unregister_missing(const char *name);
 int plugin_unregister_cache_event(const char *name);
 int plugin_unregister_shutdown(const char *name);
+int plugin_unregister_reload(const char *name);
 int plugin_unregister_data_set(const char *name);
 int plugin_unregister_log(const char *name);
 int plugin_unregister_notification(const char *name);
@@ -362,6 +612,36 @@ void plugin_log_available_writers(void);
  */
 int plugin_dispatch_values(value_list_t const *vl);
 
+/*
+ * NAME
+ *  plugin_dispatch_values_batch
+ *
+ * DESCRIPTION
+ *  Dispatches the `num' value lists in the array `vls', like calling
+ *  `plugin_dispatch_values' for each of them, but hands them to the write
+ *  queue in one go. The value lists are copied; the caller keeps ownership
+ *  of `vls'. See utils_batch.h for collecting the value lists of a read.
+ *
+ * RETURNS
+ *  Zero on success, an errno value otherwise. Value lists dropped because the
+ *  write queue is full are not considered a failure.
+ */
+int plugin_dispatch_values_batch(value_list_t const *vls, size_t num);
+
+/*
+ * NAME
+ *  plugin_dispatch_values_batch_ds
+ *
+ * DESCRIPTION
+ *  Like `plugin_dispatch_values_batch', for callers that have already looked
+ *  up the data sets of the value lists, e.g. to parse the values. `dss[i]'
+ *  must be the data set returned by `plugin_get_ds' for `vls[i].type', or
+ *  NULL to have it looked up. The data sets are handed on with the value
+ *  lists, so a type is resolved only once per value list.
+ */
+int plugin_dispatch_values_batch_ds(value_list_t const *vls,
+                                    data_set_t const *const *dss, size_t num);
+
 /*
  * NAME
  *  plugin_dispatch_multivalue
@@ -408,6 +688,11 @@ int plugin_dispatch_notification(const notification_t *notif);
 void plugin_log(int level, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
 
+/* Returns the number of log messages waiting to be delivered by the log thread
+ * (see "LogQueueLength"). Log callbacks may use this to batch their output.
+ * Always zero when logging synchronously. */
+int plugin_log_backlog(void);
+
 /* These functions return the parsed severity or less than zero on failure. */
 int parse_log_severity(const char *severity);
 int parse_notif_severity(const char *severity);
@@ -469,6 +754,22 @@ plugin_ctx_t plugin_set_ctx(plugin_ctx_t ctx);
  */
 cdtime_t plugin_get_interval(void);
 
+/*
+ * NAME
+ *  plugin_malloc, plugin_calloc, plugin_realloc, plugin_strdup, plugin_free
+ *
+ * DESCRIPTION
+ *  Like malloc(3) and friends, but the memory is charged to the plugin
+ *  context's tag, so it is reported with "CollectInternalStats". Memory
+ *  allocated with these functions must be freed with plugin_free() and may
+ *  be freed from any context.
+ */
+void *plugin_malloc(size_t size);
+void *plugin_calloc(size_t nmemb, size_t size);
+void *plugin_realloc(void *ptr, size_t size);
+char *plugin_strdup(char const *s);
+void plugin_free(void *ptr);
+
 /*
  * Context-aware thread management.
  */
@@ -476,6 +777,32 @@ cdtime_t plugin_get_interval(void);
 int plugin_thread_create(pthread_t *thread, void *(*start_routine)(void *),
                          void *arg, char const *name);
 
+/*
+ * NAME
+ *  plugin_cpus_parse
+ *
+ * DESCRIPTION
+ *  Parses the CPUs listed in a config item into a CPU list. The syntax is
+ *  the one of config_cores_parse(), all groups are merged into one list.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ENOTSUP if threads cannot be pinned on this
+ *  system and another errno value if the item is invalid. On failure, `ret'
+ *  is not modified.
+ */
+int plugin_cpus_parse(oconfig_item_t const *ci, plugin_cpus_t *ret);
+
+/*
+ * NAME
+ *  plugin_set_read_threads_cpus, plugin_set_write_threads_cpus
+ *
+ * DESCRIPTION
+ *  Sets the CPUs the read and write threads are pinned to once they are
+ *  started. Takes ownership of the list.
+ */
+void plugin_set_read_threads_cpus(plugin_cpus_t cpus);
+void plugin_set_write_threads_cpus(plugin_cpus_t cpus);
+
 /*
  * Plugins need to implement this
  */
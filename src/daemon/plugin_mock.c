@@ -43,6 +43,15 @@ int plugin_load(const char *name, bool global) { return ENOTSUP; }
 
 bool plugin_is_loaded(const char *name) { return false; }
 
+int plugin_init_plugin(const char *name) { return ENOTSUP; }
+
+int plugin_reload_plugin(const char *name) { return ENOTSUP; }
+
+int plugin_reload_chains(oconfig_item_t const *const *blocks,
+                         size_t blocks_num) {
+  return ENOTSUP;
+}
+
 int plugin_register_config(const char *name,
                            int (*callback)(const char *key, const char *val),
                            const char **keys, int keys_num) {
@@ -58,6 +67,10 @@ int plugin_register_init(const char *name, plugin_init_cb callback) {
   return ENOTSUP;
 }
 
+int plugin_register_init_dependency(const char *name, const char *depends_on) {
+  return ENOTSUP;
+}
+
 int plugin_register_read(__attribute__((unused)) const char *name,
                          __attribute__((unused)) int (*callback)(void)) {
   return ENOTSUP;
@@ -69,6 +82,13 @@ int plugin_register_write(__attribute__((unused)) const char *name,
   return ENOTSUP;
 }
 
+int plugin_register_write_batch(__attribute__((unused)) const char *name,
+                                __attribute__((unused))
+                                plugin_write_batch_cb callback,
+                                __attribute__((unused)) user_data_t const *ud) {
+  return ENOTSUP;
+}
+
 int plugin_register_flush(__attribute__((unused)) const char *name,
                           __attribute__((unused)) plugin_flush_cb callback,
                           __attribute__((unused))
@@ -92,6 +112,10 @@ int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
 
+int plugin_register_reload(const char *name, plugin_reload_cb callback) {
+  return ENOTSUP;
+}
+
 int plugin_register_data_set(const data_set_t *ds) { return ENOTSUP; }
 
 int plugin_register_notification(__attribute__((unused)) const char *name,
@@ -115,12 +139,32 @@ DECLARE_UNREGISTER(write)
 DECLARE_UNREGISTER(flush)
 DECLARE_UNREGISTER(missing)
 DECLARE_UNREGISTER(shutdown)
+DECLARE_UNREGISTER(reload)
 DECLARE_UNREGISTER(data_set)
 DECLARE_UNREGISTER(log)
 DECLARE_UNREGISTER(notification)
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
 
+int plugin_dispatch_values_batch(value_list_t const *vls, size_t num) {
+  int status = 0;
+  for (size_t i = 0; i < num; i++) {
+    int tmp = plugin_dispatch_values(vls + i);
+    if (tmp != 0)
+      status = tmp;
+  }
+  return status;
+}
+
+int plugin_dispatch_values_batch_ds(value_list_t const *vls,
+                                    data_set_t const *const *dss, size_t num) {
+  return plugin_dispatch_values_batch(vls, num);
+}
+
+const vl_identity_t *plugin_value_list_identity(const value_list_t *vl) {
+  return NULL;
+}
+
 int plugin_dispatch_notification(__attribute__((unused))
                                  const notification_t *notif) {
   return ENOTSUP;
@@ -184,6 +228,12 @@ int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_flush_async(const char *plugin, cdtime_t timeout,
+                       const char *identifier, plugin_flush_done_cb done,
+                       void *user_data) {
+  return 0;
+}
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
 const data_set_t *plugin_get_ds(const char *name) {
@@ -204,6 +254,8 @@ void plugin_log(int level, char const *format, ...) {
   printf("plugin_log (%i, \"%s\");\n", level, buffer);
 }
 
+int plugin_log_backlog(void) { return 0; }
+
 void daemon_log(int level, char const *format, ...) {
   char buffer[1024];
   va_list ap;
@@ -239,6 +291,15 @@ int plugin_thread_create(__attribute__((unused)) pthread_t *thread,
   return ENOTSUP;
 }
 
+int plugin_cpus_parse(__attribute__((unused)) oconfig_item_t const *ci,
+                      __attribute__((unused)) plugin_cpus_t *ret) {
+  return ENOTSUP;
+}
+
+void plugin_set_read_threads_cpus(plugin_cpus_t cpus) { free(cpus.cpus); }
+
+void plugin_set_write_threads_cpus(plugin_cpus_t cpus) { free(cpus.cpus); }
+
 /* TODO(octo): this function is actually from filter_chain.h, but in order not
  * to tumble down that rabbit hole, we're declaring it here. A better solution
  * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
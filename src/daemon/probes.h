@@ -0,0 +1,55 @@
+/**
+ * collectd - src/daemon/probes.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef PROBES_H
+#define PROBES_H 1
+
+/*
+ * Statically defined tracing (USDT) probes of the "collectd" provider. With
+ * <sys/sdt.h> available, each probe compiles to a single no-op instruction
+ * plus a note describing where its arguments are, which tools like bpftrace
+ * or perf turn into a breakpoint only while the probe is attached. The
+ * arguments are evaluated even if nothing is attached, so they must be cheap,
+ * such as pointers or values already at hand. See contrib/usdt/ for scripts
+ * using these probes.
+ */
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define COLLECTD_PROBE1(name, a1) DTRACE_PROBE1(collectd, name, a1)
+#define COLLECTD_PROBE2(name, a1, a2) DTRACE_PROBE2(collectd, name, a1, a2)
+#else
+/* sizeof() keeps variables that are only passed to probes from being
+ * reported as unused, without evaluating anything. */
+#define COLLECTD_PROBE1(name, a1)                                              \
+  do {                                                                         \
+    (void)sizeof(a1);                                                          \
+  } while (0)
+#define COLLECTD_PROBE2(name, a1, a2)                                          \
+  do {                                                                         \
+    (void)sizeof(a1);                                                          \
+    (void)sizeof(a2);                                                          \
+  } while (0)
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* PROBES_H */
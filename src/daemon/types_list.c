@@ -32,6 +32,29 @@
 #include "plugin.h"
 #include "types_list.h"
 
+/* The data sets of one types.db file, in the order they are defined. */
+typedef struct {
+  data_set_t *ds;
+  size_t ds_num;
+  size_t ds_size;
+} types_list_t;
+
+/* Files parsed by types_list_prefetch(). */
+static struct {
+  char **files;
+  types_list_t *lists;
+  bool *parsed;
+  size_t num;
+} prefetch;
+
+static void types_list_free(types_list_t *l) {
+  for (size_t i = 0; i < l->ds_num; i++)
+    sfree(l->ds[i].ds);
+  sfree(l->ds);
+  l->ds_num = 0;
+  l->ds_size = 0;
+} /* void types_list_free */
+
 static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   char *dummy;
   char *saveptr;
@@ -93,7 +116,7 @@ static int parse_ds(data_source_t *dsrc, char *buf, size_t buf_len) {
   return 0;
 } /* int parse_ds */
 
-static void parse_line(char *buf) {
+static void parse_line(char *buf, types_list_t *l) {
   char *fields[64];
   size_t fields_num;
   fields_num = strsplit(buf, fields, 64);
@@ -122,12 +145,23 @@ static void parse_line(char *buf) {
       return;
     }
 
-  plugin_register_data_set(&ds);
+  if (l->ds_num >= l->ds_size) {
+    size_t size = (l->ds_size == 0) ? 256 : 2 * l->ds_size;
+    data_set_t *tmp = realloc(l->ds, size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("types_list: parse_line: realloc failed.");
+      sfree(ds.ds);
+      return;
+    }
+    l->ds = tmp;
+    l->ds_size = size;
+  }
 
-  sfree(ds.ds);
+  l->ds[l->ds_num] = ds;
+  l->ds_num++;
 } /* void parse_line */
 
-static void parse_file(FILE *fh) {
+static void parse_file(FILE *fh, types_list_t *l) {
   char buf[4096];
   size_t buf_len;
 
@@ -154,28 +188,96 @@ static void parse_file(FILE *fh) {
     if (buf_len == 0)
       continue;
 
-    parse_line(buf);
+    parse_line(buf, l);
   } /* while (fgets) */
 } /* void parse_file */
 
-int read_types_list(const char *file) {
-  FILE *fh;
+/* Returns zero and the data sets in "ret" if "file" has been read. */
+static int read_file(char const *file, types_list_t *ret) {
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL)
+    return errno;
+
+  parse_file(fh, ret);
 
+  fclose(fh);
+  return 0;
+} /* int read_file */
+
+static void prefetch_one(size_t i, void *arg) {
+  if (read_file(prefetch.files[i], prefetch.lists + i) == 0)
+    prefetch.parsed[i] = true;
+} /* void prefetch_one */
+
+int types_list_prefetch(char const *const *files, size_t files_num) {
+  types_list_prefetch_clear();
+
+  if (files_num == 0)
+    return 0;
+
+  prefetch.files = calloc(files_num, sizeof(*prefetch.files));
+  prefetch.lists = calloc(files_num, sizeof(*prefetch.lists));
+  prefetch.parsed = calloc(files_num, sizeof(*prefetch.parsed));
+  if ((prefetch.files == NULL) || (prefetch.lists == NULL) ||
+      (prefetch.parsed == NULL)) {
+    types_list_prefetch_clear();
+    return ENOMEM;
+  }
+  prefetch.num = files_num;
+
+  for (size_t i = 0; i < files_num; i++) {
+    prefetch.files[i] = strdup(files[i]);
+    if (prefetch.files[i] == NULL) {
+      types_list_prefetch_clear();
+      return ENOMEM;
+    }
+  }
+
+  cf_parallel_for(files_num, prefetch_one, NULL);
+  return 0;
+} /* int types_list_prefetch */
+
+void types_list_prefetch_clear(void) {
+  for (size_t i = 0; i < prefetch.num; i++) {
+    sfree(prefetch.files[i]);
+    types_list_free(prefetch.lists + i);
+  }
+  sfree(prefetch.files);
+  sfree(prefetch.lists);
+  sfree(prefetch.parsed);
+  prefetch.num = 0;
+} /* void types_list_prefetch_clear */
+
+int read_types_list(const char *file) {
   if (file == NULL)
     return -1;
 
-  fh = fopen(file, "r");
-  if (fh == NULL) {
+  types_list_t l = {0};
+  bool found = false;
+  for (size_t i = 0; i < prefetch.num; i++) {
+    if (!prefetch.parsed[i] || (strcmp(file, prefetch.files[i]) != 0))
+      continue;
+
+    /* A file listed twice is registered twice, just like without
+     * prefetching, so the list is moved rather than shared. */
+    l = prefetch.lists[i];
+    prefetch.lists[i] = (types_list_t){0};
+    prefetch.parsed[i] = false;
+    found = true;
+    break;
+  }
+
+  int status = found ? 0 : read_file(file, &l);
+  if (status != 0) {
     fprintf(stderr, "Failed to open types database `%s': %s.\n", file,
-            STRERRNO);
-    ERROR("Failed to open types database `%s': %s", file, STRERRNO);
+            STRERROR(status));
+    ERROR("Failed to open types database `%s': %s", file, STRERROR(status));
     return -1;
   }
 
-  parse_file(fh);
-
-  fclose(fh);
-  fh = NULL;
+  for (size_t i = 0; i < l.ds_num; i++)
+    plugin_register_data_set(l.ds + i);
+  types_list_free(&l);
 
   DEBUG("Done parsing `%s'", file);
 
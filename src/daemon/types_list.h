@@ -29,4 +29,10 @@
 
 int read_types_list(const char *file);
 
+/* Parses "files" in parallel. read_types_list() then registers the data sets
+ * of these files without reading them again, until
+ * types_list_prefetch_clear() is called. */
+int types_list_prefetch(char const *const *files, size_t files_num);
+void types_list_prefetch_clear(void);
+
 #endif /* TYPES_LIST_H */
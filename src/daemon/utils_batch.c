@@ -0,0 +1,82 @@
+/**
+ * collectd - src/daemon/utils_batch.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_batch.h"
+
+int vl_batch_add(vl_batch_t *b, value_list_t const *vl) {
+  if (b->vls_num >= b->vls_size) {
+    size_t size = (b->vls_size == 0) ? 64 : 2 * b->vls_size;
+    value_list_t *vls = realloc(b->vls, size * sizeof(*vls));
+    if (vls == NULL)
+      return ENOMEM;
+    b->vls = vls;
+    b->vls_size = size;
+  }
+
+  if (b->values_num + vl->values_len > b->values_size) {
+    size_t size = (b->values_size == 0) ? 64 : 2 * b->values_size;
+    while (size < b->values_num + vl->values_len)
+      size *= 2;
+    value_t *values = realloc(b->values, size * sizeof(*values));
+    if (values == NULL)
+      return ENOMEM;
+    b->values = values;
+    b->values_size = size;
+  }
+
+  memcpy(b->values + b->values_num, vl->values,
+         vl->values_len * sizeof(*vl->values));
+  b->values_num += vl->values_len;
+
+  /* The values pointers are set by vl_batch_dispatch(), because the values
+   * may still move. */
+  b->vls[b->vls_num] = *vl;
+  b->vls[b->vls_num].values = NULL;
+  b->vls_num++;
+  return 0;
+} /* int vl_batch_add */
+
+int vl_batch_dispatch(vl_batch_t *b) {
+  if (b->vls_num == 0)
+    return 0;
+
+  value_t *values = b->values;
+  for (size_t i = 0; i < b->vls_num; i++) {
+    b->vls[i].values = values;
+    values += b->vls[i].values_len;
+  }
+
+  int status = plugin_dispatch_values_batch(b->vls, b->vls_num);
+  b->vls_num = 0;
+  b->values_num = 0;
+  return status;
+} /* int vl_batch_dispatch */
+
+void vl_batch_free(vl_batch_t *b) {
+  sfree(b->vls);
+  sfree(b->values);
+  *b = (vl_batch_t)VL_BATCH_INIT;
+} /* void vl_batch_free */
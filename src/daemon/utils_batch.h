@@ -0,0 +1,88 @@
+/**
+ * collectd - src/daemon/utils_batch.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_BATCH_H
+#define UTILS_BATCH_H 1
+
+#include "plugin.h"
+
+/*
+ * Collects value lists for plugin_dispatch_values_batch(), so that a plugin
+ * reporting many series per read hands them to the daemon in one go. The
+ * value lists and their values are copied into storage that grows as needed
+ * and is reused by the next batch. A batch is not protected by a lock: it is
+ * meant to be used by one read callback at a time.
+ */
+typedef struct {
+  value_list_t *vls;
+  size_t vls_num;
+  size_t vls_size;
+
+  value_t *values;
+  size_t values_num;
+  size_t values_size;
+} vl_batch_t;
+
+#define VL_BATCH_INIT                                                          \
+  { NULL, 0, 0, NULL, 0, 0 }
+
+/*
+ * NAME
+ *   vl_batch_add
+ *
+ * DESCRIPTION
+ *   Appends a copy of `vl' to the batch. The identifier fields and values are
+ *   copied, so the caller may reuse `vl' as a template for the next value
+ *   list right away. Meta data is not copied: `vl->meta' must stay valid
+ *   until the batch has been dispatched.
+ *
+ * RETURN VALUE
+ *   Zero on success, ENOMEM if the batch could not grow.
+ */
+int vl_batch_add(vl_batch_t *b, value_list_t const *vl);
+
+/*
+ * NAME
+ *   vl_batch_dispatch
+ *
+ * DESCRIPTION
+ *   Dispatches the value lists added so far with
+ *   plugin_dispatch_values_batch() and empties the batch, keeping its
+ *   storage. Does nothing if the batch is empty.
+ *
+ * RETURN VALUE
+ *   The return value of plugin_dispatch_values_batch().
+ */
+int vl_batch_dispatch(vl_batch_t *b);
+
+/*
+ * NAME
+ *   vl_batch_free
+ *
+ * DESCRIPTION
+ *   Frees the storage of the batch, dropping value lists not dispatched yet.
+ *   The batch can be used again afterwards.
+ */
+void vl_batch_free(vl_batch_t *b);
+
+#endif /* UTILS_BATCH_H */
@@ -0,0 +1,87 @@
+/**
+ * collectd - src/daemon/utils_batch_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_batch.h"
+
+DEF_TEST(add) {
+  vl_batch_t b = VL_BATCH_INIT;
+  value_list_t vl = {
+      .host = "example.com",
+      .plugin = "test",
+      .type = "test",
+  };
+
+  value_t vl_values[2];
+  vl.values = vl_values;
+
+  /* Enough value lists to make both arrays grow a few times. */
+  for (int i = 0; i < 500; i++) {
+    vl_values[0].derive = i;
+    vl_values[1].derive = -i;
+    vl.values_len = (i % 2) ? 2 : 1;
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "%d", i);
+    EXPECT_EQ_INT(0, vl_batch_add(&b, &vl));
+  }
+  EXPECT_EQ_INT(500, (int)b.vls_num);
+  EXPECT_EQ_INT(750, (int)b.values_num);
+
+  /* The values are only attached when dispatching; the mock fails. */
+  EXPECT_EQ_INT(ENOTSUP, vl_batch_dispatch(&b));
+  EXPECT_EQ_INT(0, (int)b.vls_num);
+  EXPECT_EQ_INT(0, (int)b.values_num);
+
+  value_t *values = b.values;
+  for (int i = 0; i < 500; i++) {
+    char instance[DATA_MAX_NAME_LEN];
+    snprintf(instance, sizeof(instance), "%d", i);
+    EXPECT_EQ_STR("example.com", b.vls[i].host);
+    EXPECT_EQ_STR(instance, b.vls[i].type_instance);
+    EXPECT_EQ_PTR(values, b.vls[i].values);
+    EXPECT_EQ_UINT64(i, (uint64_t)b.vls[i].values[0].derive);
+    if (i % 2)
+      EXPECT_EQ_UINT64(-i, (uint64_t)b.vls[i].values[1].derive);
+    values += b.vls[i].values_len;
+  }
+
+  /* The storage is reused by the next batch. */
+  value_list_t *vls = b.vls;
+  EXPECT_EQ_INT(0, vl_batch_add(&b, &vl));
+  EXPECT_EQ_PTR(vls, b.vls);
+  EXPECT_EQ_INT(1, (int)b.vls_num);
+
+  vl_batch_free(&b);
+  EXPECT_EQ_PTR(NULL, b.vls);
+  EXPECT_EQ_INT(0, (int)b.vls_num);
+  EXPECT_EQ_INT(0, vl_batch_dispatch(&b));
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(add);
+
+  END_TEST;
+}
@@ -28,19 +28,43 @@
 
 #include "collectd.h"
 
+#include "configfile.h"
 #include "plugin.h"
-#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/gorilla/gorilla.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
+#include "utils_identity.h"
 
 #include <assert.h>
 
+/* Each entry is allocated as one block: the struct is followed by the
+ * `values_gauge', `values_raw', `values_prev', `values_min', `values_max' and
+ * `values_type' arrays and the name, to which the pointers point. Only
+ * `history' and `meta' are allocated separately. */
 typedef struct cache_entry_s {
-  char name[6 * DATA_MAX_NAME_LEN];
+  /* Key of the entry in its shard's table. */
+  char *name;
+  uint64_t hash;
   size_t values_num;
+  /* Rates of the last update. Only valid if `rates_stale' is false, see
+   * cache_entry_rates(). */
   gauge_t *values_gauge;
   value_t *values_raw;
+  /* Raw values and time of the update before the last one, from which the
+   * rates are computed. */
+  value_t *values_prev;
+  cdtime_t prev_time;
+  /* Valid range and type of each data source, copied from the data set of
+   * the last update. Plugins can replace data sets at runtime, which frees the
+   * old ones, so the entry must not keep a pointer to one. */
+  gauge_t *values_min;
+  gauge_t *values_max;
+  uint8_t *values_type;
+  /* Set by uc_update() and cleared once the rates have been computed, so that
+   * rates nobody asks for are never computed. */
+  bool rates_stale;
   /* Time contained in the package
    * (for calculating rates) */
   cdtime_t last_time;
@@ -50,8 +74,13 @@ typedef struct cache_entry_s {
   /* Interval in which the data is collected
    * (for purging old entries) */
   cdtime_t interval;
+  /* Time of the last values uc_update_unchanged() did not report as
+   * unchanged. */
+  cdtime_t last_passed;
   int state;
   int hits;
+  /* Restored from the cache file and not updated since. */
+  bool restored;
 
   /*
    * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
@@ -65,47 +94,308 @@ typedef struct cache_entry_s {
   gauge_t *history;
   size_t history_index; /* points to the next position to write to. */
   size_t history_length;
+  /* Used instead of `history' if "CompressHistory" is enabled. */
+  c_gorilla_history_t *history_compressed;
 
   meta_data_t *meta;
   unsigned long callbacks_mask;
+
+  /* Threshold matching the entry, or NULL if none matches. Only valid if
+   * `threshold_generation' is current, see uc_get_threshold(). */
+  void *threshold;
+  unsigned int threshold_generation;
+
+  /* Links of the timing wheel bucket the entry is scheduled in. */
+  struct cache_entry_s *wheel_next;
+  struct cache_entry_s **wheel_pprev;
 } cache_entry_t;
 
+/* A copy of a cache entry, taken while its shard was locked. Iterators work
+ * on copies so that long scans don't stall uc_update(). */
+typedef struct {
+  char *name;
+  uint64_t hash;
+  cdtime_t last_time;
+  cdtime_t interval;
+  size_t values_num;
+  value_t *values;
+  /* Points into the allocation of `values'. */
+  gauge_t *rates;
+} cache_snapshot_t;
+
 struct uc_iter_s {
-  c_avl_iterator_t *iter;
+  /* Copies of all entries, sorted by name. */
+  cache_snapshot_t *entries;
+  size_t entries_num;
+  size_t index;
 
   char *name;
-  cache_entry_t *entry;
+  cache_snapshot_t *entry;
 };
 
-static c_avl_tree_t *cache_tree;
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+/* The cache is split into shards by the hash of the entries' names, each with
+ * its own lock, so that threads updating different values rarely contend.
+ * Must be a power of two. */
+#define CACHE_SHARDS_NUM 64
+
+/* Entries are scheduled for expiry in a timing wheel, so that
+ * uc_check_timeout() only looks at entries that may have expired. A bucket
+ * covers 2^CACHE_WHEEL_SHIFT cdtime_t units (about one second). Entries whose
+ * deadline lies more than a full turn ahead are looked at, and rescheduled,
+ * once per turn. Must be a power of two. */
+#define CACHE_WHEEL_SIZE 256
+#define CACHE_WHEEL_SHIFT 30
+
+typedef struct {
+  pthread_mutex_t lock;
+  c_hashtable_t *table;
+  /* Bytes allocated for the shard's entries, see cache_entry_memory(). */
+  size_t memory;
+
+  cache_entry_t *wheel[CACHE_WHEEL_SIZE];
+  /* The earliest tick whose bucket may hold expired entries. */
+  uint64_t wheel_tick;
+} cache_shard_t;
+
+static cache_shard_t cache_shards[CACHE_SHARDS_NUM];
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static bool cache_compress_history;
+
+/* See uc_persist(). */
+static char *cache_file;
+static cdtime_t cache_file_interval;
+static cdtime_t cache_file_last;
+
+static void cache_init_shards(void) {
+  for (size_t i = 0; i < CACHE_SHARDS_NUM; i++) {
+    pthread_mutex_init(&cache_shards[i].lock, /* attr = */ NULL);
+    cache_shards[i].table = c_hashtable_create();
+    if (cache_shards[i].table == NULL)
+      ERROR("utils_cache: c_hashtable_create failed.");
+  }
+} /* void cache_init_shards */
+
+/* Returns the shard holding the entry with the given hash. The shard is not
+ * locked. */
+static cache_shard_t *cache_shard(uint64_t hash) {
+  pthread_once(&cache_once, cache_init_shards);
+  return cache_shards + ((hash >> 58) & (CACHE_SHARDS_NUM - 1));
+} /* cache_shard_t *cache_shard */
+
+/* Looks up `name' and locks its shard. The shard is returned in `ret_shard'
+ * and remains locked even if the entry does not exist. */
+static cache_entry_t *cache_get(char const *name, uint64_t hash, /* {{{ */
+                                cache_shard_t **ret_shard) {
+  cache_shard_t *shard = cache_shard(hash);
+  cache_entry_t *ce = NULL;
+
+  pthread_mutex_lock(&shard->lock);
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) != 0)
+    ce = NULL;
 
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
-#if COLLECT_DEBUG
-  assert((a != NULL) && (b != NULL));
-#endif
-  return strcmp(a->name, b->name);
+  *ret_shard = shard;
+  return ce;
+} /* }}} cache_entry_t *cache_get */
+
+static void cache_wheel_unlink(cache_entry_t *ce) {
+  if (ce->wheel_pprev == NULL)
+    return;
+
+  *ce->wheel_pprev = ce->wheel_next;
+  if (ce->wheel_next != NULL)
+    ce->wheel_next->wheel_pprev = ce->wheel_pprev;
+  ce->wheel_next = NULL;
+  ce->wheel_pprev = NULL;
+} /* void cache_wheel_unlink */
+
+/* (Re)schedules the entry in the bucket of the tick in which it expires. The
+ * shard must be locked. */
+static void cache_wheel_schedule(cache_shard_t *shard, cache_entry_t *ce) {
+  cache_wheel_unlink(ce);
+
+  uint64_t tick = (uint64_t)(ce->last_update + ce->interval * timeout_g) >>
+                  CACHE_WHEEL_SHIFT;
+  if (tick < shard->wheel_tick)
+    tick = shard->wheel_tick;
+
+  cache_entry_t **head = shard->wheel + (tick & (CACHE_WHEEL_SIZE - 1));
+  ce->wheel_next = *head;
+  ce->wheel_pprev = head;
+  if (*head != NULL)
+    (*head)->wheel_pprev = &ce->wheel_next;
+  *head = ce;
+} /* void cache_wheel_schedule */
+
+static void cache_free(cache_entry_t *ce);
+static size_t cache_entry_memory(cache_entry_t const *ce);
+static void cache_entry_rates(cache_entry_t *ce);
+
+/* Removes the entry from its locked shard and frees it. */
+static void cache_remove(cache_shard_t *shard, cache_entry_t *ce) {
+  c_hashtable_remove(shard->table, ce->hash, ce->name, NULL, NULL);
+  cache_wheel_unlink(ce);
+  shard->memory -= cache_entry_memory(ce);
+  cache_free(ce);
+} /* void cache_remove */
+
+static int cache_compare(const void *a, const void *b) {
+  cache_snapshot_t const *s_a = a;
+  cache_snapshot_t const *s_b = b;
+
+  return strcmp(s_a->name, s_b->name);
 } /* int cache_compare */
 
-static cache_entry_t *cache_alloc(size_t values_num) {
-  cache_entry_t *ce;
+/* Cost of taking snapshots, see uc_get_snapshot_stats(). */
+static pthread_mutex_t snapshot_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t snapshot_count;
+static uint64_t snapshot_entries;
+static cdtime_t snapshot_time_total;
+static cdtime_t snapshot_lock_max;
+
+static void cache_snapshot_free(cache_snapshot_t *entries, size_t entries_num) {
+  if (entries == NULL)
+    return;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    sfree(entries[i].name);
+    sfree(entries[i].values);
+  }
+  sfree(entries);
+} /* void cache_snapshot_free */
+
+/* Copies one shard to the end of `entries', skipping missing values and
+ * entries rejected by `filter'. The shard is locked only for the duration of
+ * the copy. */
+static int cache_snapshot_shard(cache_shard_t *shard, /* {{{ */
+                                cache_snapshot_t **entries,
+                                size_t *entries_num, bool with_values,
+                                uc_iter_filter_t filter, void *filter_data,
+                                cdtime_t *ret_lock_time) {
+  int status = 0;
+
+  pthread_mutex_lock(&shard->lock);
+  cdtime_t start = cdtime();
+
+  size_t num = c_hashtable_size(shard->table);
+  cache_snapshot_t *tmp = NULL;
+  if (num > 0)
+    tmp = realloc(*entries, (*entries_num + num) * sizeof(*tmp));
+  if ((num > 0) && (tmp == NULL)) {
+    status = ENOMEM;
+  } else if (num > 0) {
+    *entries = tmp;
+
+    size_t pos = 0;
+    cache_entry_t *ce;
+    while (c_hashtable_next(shard->table, &pos, NULL, (void *)&ce) == 0) {
+      /* remove missing values when list values */
+      if (ce->state == STATE_MISSING)
+        continue;
+      if ((filter != NULL) && !filter(ce->name, filter_data))
+        continue;
+
+      cache_snapshot_t *s = *entries + *entries_num;
+      *s = (cache_snapshot_t){
+          .name = strdup(ce->name),
+          .hash = ce->hash,
+          .last_time = ce->last_time,
+          .interval = ce->interval,
+          .values_num = ce->values_num,
+      };
+      if (with_values) {
+        s->values =
+            calloc(ce->values_num, sizeof(*s->values) + sizeof(*s->rates));
+        if (s->values != NULL) {
+          s->rates = (gauge_t *)(s->values + ce->values_num);
+          memcpy(s->values, ce->values_raw,
+                 ce->values_num * sizeof(*s->values));
+          cache_entry_rates(ce);
+          memcpy(s->rates, ce->values_gauge,
+                 ce->values_num * sizeof(*s->rates));
+        }
+      }
+      if ((s->name == NULL) || (with_values && (s->values == NULL))) {
+        sfree(s->name);
+        sfree(s->values);
+        status = ENOMEM;
+        break;
+      }
+      (*entries_num)++;
+    }
+  }
 
-  ce = calloc(1, sizeof(*ce));
+  *ret_lock_time = cdtime() - start;
+  pthread_mutex_unlock(&shard->lock);
+  return status;
+} /* }}} int cache_snapshot_shard */
+
+/* Returns copies of all entries that are not missing and, if `filter' is not
+ * NULL, accepted by it, sorted by name. Only one shard is locked at a time, so
+ * the result is not an atomic snapshot of the whole cache: entries updated
+ * during the scan may or may not include the update. */
+static int cache_snapshot(cache_snapshot_t **ret_entries, /* {{{ */
+                          size_t *ret_entries_num, bool with_values,
+                          uc_iter_filter_t filter, void *filter_data) {
+  cache_snapshot_t *entries = NULL;
+  size_t entries_num = 0;
+  cdtime_t lock_max = 0;
+  cdtime_t start = cdtime();
+
+  for (size_t i = 0; i < CACHE_SHARDS_NUM; i++) {
+    cdtime_t lock_time = 0;
+    int status =
+        cache_snapshot_shard(cache_shard((uint64_t)i << 58), &entries,
+                             &entries_num, with_values, filter, filter_data,
+                             &lock_time);
+    if (status != 0) {
+      cache_snapshot_free(entries, entries_num);
+      return status;
+    }
+    if (lock_max < lock_time)
+      lock_max = lock_time;
+  }
+
+  if (entries_num > 0)
+    qsort(entries, entries_num, sizeof(*entries), cache_compare);
+
+  cdtime_t elapsed = cdtime() - start;
+  pthread_mutex_lock(&snapshot_stats_lock);
+  snapshot_count++;
+  snapshot_entries += entries_num;
+  snapshot_time_total += elapsed;
+  if (snapshot_lock_max < lock_max)
+    snapshot_lock_max = lock_max;
+  pthread_mutex_unlock(&snapshot_stats_lock);
+
+  *ret_entries = entries;
+  *ret_entries_num = entries_num;
+  return 0;
+} /* }}} int cache_snapshot */
+
+static cache_entry_t *cache_alloc(size_t values_num, char const *name) {
+  size_t name_len = strlen(name) + 1;
+  /* gauge_t and value_t are both eight bytes, so the arrays following the
+   * struct are properly aligned. */
+  cache_entry_t *ce =
+      calloc(1, sizeof(*ce) +
+                    values_num * ((3 * sizeof(gauge_t)) +
+                                  (2 * sizeof(value_t)) + sizeof(uint8_t)) +
+                    name_len);
   if (ce == NULL) {
     ERROR("utils_cache: cache_alloc: calloc failed.");
     return NULL;
   }
   ce->values_num = values_num;
 
-  ce->values_gauge = calloc(values_num, sizeof(*ce->values_gauge));
-  ce->values_raw = calloc(values_num, sizeof(*ce->values_raw));
-  if ((ce->values_gauge == NULL) || (ce->values_raw == NULL)) {
-    sfree(ce->values_gauge);
-    sfree(ce->values_raw);
-    sfree(ce);
-    ERROR("utils_cache: cache_alloc: calloc failed.");
-    return NULL;
-  }
+  ce->values_gauge = (gauge_t *)(ce + 1);
+  ce->values_raw = (value_t *)(ce->values_gauge + values_num);
+  ce->values_prev = ce->values_raw + values_num;
+  ce->values_min = (gauge_t *)(ce->values_prev + values_num);
+  ce->values_max = ce->values_min + values_num;
+  ce->values_type = (uint8_t *)(ce->values_max + values_num);
+  ce->name = (char *)(ce->values_type + values_num);
+  memcpy(ce->name, name, name_len);
 
   ce->history = NULL;
   ce->history_length = 0;
@@ -114,13 +404,23 @@ static cache_entry_t *cache_alloc(size_t values_num) {
   return ce;
 } /* cache_entry_t *cache_alloc */
 
+/* Returns the number of bytes allocated for the entry, not counting its meta
+ * data. */
+static size_t cache_entry_memory(cache_entry_t const *ce) {
+  return sizeof(*ce) +
+         ce->values_num * ((3 * sizeof(gauge_t)) + (2 * sizeof(value_t)) +
+                           sizeof(uint8_t) +
+                           ce->history_length * sizeof(*ce->history)) +
+         c_gorilla_history_memory(ce->history_compressed) + strlen(ce->name) +
+         1;
+} /* size_t cache_entry_memory */
+
 static void cache_free(cache_entry_t *ce) {
   if (ce == NULL)
     return;
 
-  sfree(ce->values_gauge);
-  sfree(ce->values_raw);
   sfree(ce->history);
+  c_gorilla_history_destroy(ce->history_compressed);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
     ce->meta = NULL;
@@ -128,35 +428,76 @@ static void cache_free(cache_entry_t *ce) {
   sfree(ce);
 } /* void cache_free */
 
-static void uc_check_range(const data_set_t *ds, cache_entry_t *ce) {
-  for (size_t i = 0; i < ds->ds_num; i++) {
+/* Copies the types and ranges of the data sources. `ds' must have as many
+ * data sources as the entry has values. */
+static void cache_entry_set_ds(cache_entry_t *ce, data_set_t const *ds) {
+  for (size_t i = 0; i < ce->values_num; i++) {
+    ce->values_min[i] = ds->ds[i].min;
+    ce->values_max[i] = ds->ds[i].max;
+    ce->values_type[i] = (uint8_t)ds->ds[i].type;
+  }
+} /* void cache_entry_set_ds */
+
+static void uc_check_range(cache_entry_t *ce) {
+  for (size_t i = 0; i < ce->values_num; i++) {
     if (isnan(ce->values_gauge[i]))
       continue;
-    else if (ce->values_gauge[i] < ds->ds[i].min)
+    else if (ce->values_gauge[i] < ce->values_min[i])
       ce->values_gauge[i] = NAN;
-    else if (ce->values_gauge[i] > ds->ds[i].max)
+    else if (ce->values_gauge[i] > ce->values_max[i])
       ce->values_gauge[i] = NAN;
   }
 } /* void uc_check_range */
 
-static int uc_insert(const data_set_t *ds, const value_list_t *vl,
-                     const char *key) {
-  /* `cache_lock' has been locked by `uc_update' */
+/* Computes the rates of the last update from the raw values, unless that has
+ * been done already. The shard of the entry must be locked. */
+static void cache_entry_rates(cache_entry_t *ce) {
+  if (!ce->rates_stale)
+    return;
 
-  char *key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("uc_insert: strdup failed.");
-    return -1;
+  double interval = CDTIME_T_TO_DOUBLE(ce->last_time - ce->prev_time);
+
+  for (size_t i = 0; i < ce->values_num; i++) {
+    value_t const *prev = ce->values_prev + i;
+    value_t const *raw = ce->values_raw + i;
+
+    switch (ce->values_type[i]) {
+    case DS_TYPE_COUNTER:
+      ce->values_gauge[i] =
+          ((double)counter_diff(prev->counter, raw->counter)) / interval;
+      break;
+    case DS_TYPE_GAUGE:
+      ce->values_gauge[i] = raw->gauge;
+      break;
+    case DS_TYPE_DERIVE:
+      ce->values_gauge[i] = ((double)(raw->derive - prev->derive)) / interval;
+      break;
+    case DS_TYPE_ABSOLUTE:
+      ce->values_gauge[i] = ((double)raw->absolute) / interval;
+      break;
+    default:
+      /* uc_insert() rejects unknown types. */
+      ce->values_gauge[i] = NAN;
+      break;
+    }
   }
 
-  cache_entry_t *ce = cache_alloc(ds->ds_num);
+  /* Prune invalid gauge data */
+  uc_check_range(ce);
+  ce->rates_stale = false;
+} /* void cache_entry_rates */
+
+static int uc_insert(const data_set_t *ds, const value_list_t *vl,
+                     const char *key, uint64_t hash, cache_shard_t *shard) {
+  /* The shard has been locked by `uc_update' */
+
+  cache_entry_t *ce = cache_alloc(ds->ds_num, key);
   if (ce == NULL) {
-    sfree(key_copy);
     ERROR("uc_insert: cache_alloc (%" PRIsz ") failed.", ds->ds_num);
     return -1;
   }
-
-  sstrncpy(ce->name, key, sizeof(ce->name));
+  ce->hash = hash;
+  cache_entry_set_ds(ce, ds);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
@@ -187,38 +528,52 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
       /* This shouldn't happen. */
       ERROR("uc_insert: Don't know how to handle data source type %i.",
             ds->ds[i].type);
-      sfree(key_copy);
       cache_free(ce);
       return -1;
     } /* switch (ds->ds[i].type) */
   }   /* for (i) */
 
   /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
+  uc_check_range(ce);
 
   ce->last_time = vl->time;
-  ce->last_update = cdtime();
+  ce->last_update = cdtime_coarse();
   ce->interval = vl->interval;
+  ce->last_passed = vl->time;
   ce->state = STATE_UNKNOWN;
 
   if (vl->meta != NULL) {
     ce->meta = meta_data_clone(vl->meta);
   }
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
-    sfree(key_copy);
-    ERROR("uc_insert: c_avl_insert failed.");
+  if (c_hashtable_insert(shard->table, hash, ce->name, ce) != 0) {
+    cache_free(ce);
+    ERROR("uc_insert: c_hashtable_insert failed.");
     return -1;
   }
+  shard->memory += cache_entry_memory(ce);
+  cache_wheel_schedule(shard, ce);
 
   DEBUG("uc_insert: Added %s to the cache.", key);
   return 0;
 } /* int uc_insert */
 
+static int cache_restore(char const *file);
+
 int uc_init(void) {
-  if (cache_tree == NULL)
-    cache_tree =
-        c_avl_create((int (*)(const void *, const void *))cache_compare);
+  pthread_once(&cache_once, cache_init_shards);
+
+  cache_compress_history = IS_TRUE(global_option_get("CompressHistory"));
+
+  char const *file = global_option_get("CacheFile");
+  if ((file != NULL) && (file[0] != 0) && (cache_file == NULL)) {
+    cache_file = strdup(file);
+    cache_file_interval =
+        DOUBLE_TO_CDTIME_T(atof(global_option_get("CacheFileInterval")));
+    cache_file_last = cdtime();
+    if (cache_file != NULL)
+      cache_restore(cache_file);
+  }
 
   return 0;
 } /* int uc_init */
@@ -226,46 +581,71 @@ int uc_init(void) {
 int uc_check_timeout(void) {
   struct {
     char *key;
+    uint64_t hash;
     cdtime_t time;
     cdtime_t interval;
     unsigned long callbacks_mask;
   } *expired = NULL;
   size_t expired_num = 0;
 
-  pthread_mutex_lock(&cache_lock);
   cdtime_t now = cdtime();
 
-  /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
-  char *key = NULL;
-  cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
-
-    void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
-    if (tmp == NULL) {
-      ERROR("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    expired = tmp;
-
-    expired[expired_num].key = strdup(key);
-    expired[expired_num].time = ce->last_time;
-    expired[expired_num].interval = ce->interval;
-    expired[expired_num].callbacks_mask = ce->callbacks_mask;
-
-    if (expired[expired_num].key == NULL) {
-      ERROR("uc_check_timeout: strdup failed.");
-      continue;
-    }
-
-    expired_num++;
-  } /* while (c_avl_iterator_next) */
-
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  /* Build a list of entries to be flushed, one shard at a time. */
+  for (size_t i = 0; i < CACHE_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shard((uint64_t)i << 58);
+
+    pthread_mutex_lock(&shard->lock);
+
+    uint64_t now_tick = (uint64_t)now >> CACHE_WHEEL_SHIFT;
+    uint64_t tick = shard->wheel_tick;
+    if ((now_tick - tick) >= CACHE_WHEEL_SIZE)
+      tick = now_tick - (CACHE_WHEEL_SIZE - 1);
+    /* Entries expiring later during the current tick are rescheduled into its
+     * bucket, so it is processed again by the next call. */
+    shard->wheel_tick = now_tick;
+
+    for (; tick <= now_tick; tick++) {
+      cache_entry_t **head = shard->wheel + (tick & (CACHE_WHEEL_SIZE - 1));
+      cache_entry_t *next = *head;
+      *head = NULL;
+
+      while (next != NULL) {
+        cache_entry_t *ce = next;
+        next = ce->wheel_next;
+        ce->wheel_next = NULL;
+        ce->wheel_pprev = NULL;
+
+        /* If the entry is fresh enough, continue. */
+        if ((now - ce->last_update) < (ce->interval * timeout_g)) {
+          cache_wheel_schedule(shard, ce);
+          continue;
+        }
+
+        void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+        if (tmp == NULL) {
+          ERROR("uc_check_timeout: realloc failed.");
+          cache_wheel_schedule(shard, ce);
+          continue;
+        }
+        expired = tmp;
+
+        expired[expired_num].key = strdup(ce->name);
+        expired[expired_num].hash = ce->hash;
+        expired[expired_num].time = ce->last_time;
+        expired[expired_num].interval = ce->interval;
+        expired[expired_num].callbacks_mask = ce->callbacks_mask;
+
+        if (expired[expired_num].key == NULL) {
+          ERROR("uc_check_timeout: strdup failed.");
+          cache_wheel_schedule(shard, ce);
+          continue;
+        }
+
+        expired_num++;
+      } /* while (next != NULL) */
+    }   /* for (tick) */
+    pthread_mutex_unlock(&shard->lock);
+  }
 
   if (expired_num == 0) {
     sfree(expired);
@@ -299,44 +679,106 @@ int uc_check_timeout(void) {
   /* Now actually remove all the values from the cache. We don't re-evaluate
    * the timestamp again, so in theory it is possible we remove a value after
    * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
   for (size_t i = 0; i < expired_num; i++) {
-    char *key = NULL;
+    cache_shard_t *shard = cache_shard(expired[i].hash);
     cache_entry_t *value = NULL;
 
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
-      ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
+    pthread_mutex_lock(&shard->lock);
+    int status = c_hashtable_remove(shard->table, expired[i].hash,
+                                    expired[i].key, NULL, (void *)&value);
+    if (status == 0) {
+      /* The entry may have been rescheduled by uc_update() meanwhile. */
+      cache_wheel_unlink(value);
+      shard->memory -= cache_entry_memory(value);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (status != 0) {
+      ERROR("uc_check_timeout: c_hashtable_remove (\"%s\") failed.",
+            expired[i].key);
       sfree(expired[i].key);
       continue;
     }
-    sfree(key);
     cache_free(value);
 
     sfree(expired[i].key);
   } /* for (i = 0; i < expired_num; i++) */
-  pthread_mutex_unlock(&cache_lock);
 
   sfree(expired);
   return 0;
 } /* int uc_check_timeout */
 
-int uc_update(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+/* Returns the cache key of `vl' and stores its hash in `ret_hash'. The name
+ * and hash computed at dispatch time are used if available; otherwise the name
+ * is formatted into `buffer'. */
+static char const *uc_name(value_list_t const *vl, char *buffer, /* {{{ */
+                           size_t buffer_size, uint64_t *ret_hash) {
+  vl_identity_t const *id = plugin_value_list_identity(vl);
+  if (id != NULL) {
+    *ret_hash = id->hash;
+    return id->name;
+  }
+
+  if (FORMAT_VL(buffer, buffer_size, vl) != 0)
+    return NULL;
+  *ret_hash = vl_identity_hash(buffer);
+  return buffer;
+} /* }}} char const *uc_name */
+
+/* Returns true if the raw values of `vl' equal those of `ce'. Absolute
+ * values are reset on every read, so they never count as unchanged. */
+static bool uc_values_unchanged(const data_set_t *ds, const value_list_t *vl,
+                                cache_entry_t const *ce) {
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    value_t const *old = ce->values_raw + i;
+    value_t const *new = vl->values + i;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      if (old->counter != new->counter)
+        return false;
+      break;
+    case DS_TYPE_GAUGE:
+      if ((old->gauge != new->gauge) &&
+          !(isnan(old->gauge) && isnan(new->gauge)))
+        return false;
+      break;
+    case DS_TYPE_DERIVE:
+      if (old->derive != new->derive)
+        return false;
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+} /* bool uc_values_unchanged */
+
+static int uc_update_internal(const data_set_t *ds, const value_list_t *vl,
+                              cdtime_t heartbeat, bool *ret_unchanged) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_update: FORMAT_VL failed.");
     return -1;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
   cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
+  int status = c_hashtable_get(shard->table, hash, name, (void *)&ce);
+  /* The cache file may have been written with a different types.db. */
+  if ((status == 0) && ce->restored && (ce->values_num != ds->ds_num)) {
+    cache_remove(shard, ce);
+    status = ENOENT;
+  }
   if (status != 0) /* entry does not yet exist */
   {
-    status = uc_insert(ds, vl, name);
-    pthread_mutex_unlock(&cache_lock);
+    status = uc_insert(ds, vl, name, hash, shard);
+    pthread_mutex_unlock(&shard->lock);
 
     if (status == 0)
       plugin_dispatch_cache_event(CE_VALUE_NEW, 0 /* mask */, name, vl);
@@ -348,7 +790,7 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   assert(ce->values_num == ds->ds_num);
 
   if (ce->last_time >= vl->time) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     NOTICE("uc_update: Value too old: name = %s; value time = %.3f; "
            "last cache update = %.3f;",
            name, CDTIME_T_TO_DOUBLE(vl->time),
@@ -356,48 +798,30 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
     return -1;
   }
 
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER: {
-      counter_t diff =
-          counter_diff(ce->values_raw[i].counter, vl->values[i].counter);
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].counter = vl->values[i].counter;
-    } break;
-
-    case DS_TYPE_GAUGE:
-      ce->values_raw[i].gauge = vl->values[i].gauge;
-      ce->values_gauge[i] = vl->values[i].gauge;
-      break;
-
-    case DS_TYPE_DERIVE: {
-      derive_t diff = vl->values[i].derive - ce->values_raw[i].derive;
-
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].derive = vl->values[i].derive;
-    } break;
-
-    case DS_TYPE_ABSOLUTE:
-      ce->values_gauge[i] = ((double)vl->values[i].absolute) /
-                            (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
-      ce->values_raw[i].absolute = vl->values[i].absolute;
-      break;
-
-    default:
-      /* This shouldn't happen. */
-      pthread_mutex_unlock(&cache_lock);
-      ERROR("uc_update: Don't know how to handle data source type %i.",
-            ds->ds[i].type);
-      return -1;
-    } /* switch (ds->ds[i].type) */
+  /* Half an interval of slack keeps jitter in the read times from pushing
+   * the next write out by one interval. */
+  if (ret_unchanged != NULL) {
+    *ret_unchanged = (vl->time - ce->last_passed + vl->interval / 2 <
+                      heartbeat) &&
+                     !ce->restored && uc_values_unchanged(ds, vl, ce);
+    if (!*ret_unchanged)
+      ce->last_passed = vl->time;
+  }
 
-    DEBUG("uc_update: %s: ds[%" PRIsz "] = %lf", name, i, ce->values_gauge[i]);
-  } /* for (i) */
+  /* Only the raw values are stored here. The rates are computed when they are
+   * first asked for, or right away if they are kept in a history. */
+  memcpy(ce->values_prev, ce->values_raw,
+         ce->values_num * sizeof(*ce->values_prev));
+  memcpy(ce->values_raw, vl->values, ce->values_num * sizeof(*ce->values_raw));
+  ce->prev_time = ce->last_time;
+  ce->last_time = vl->time;
+  cache_entry_set_ds(ce, ds);
+  ce->rates_stale = true;
 
   /* Update the history if it exists. */
   if (ce->history != NULL) {
+    cache_entry_rates(ce);
+
     assert(ce->history_index < ce->history_length);
     for (size_t i = 0; i < ce->values_num; i++) {
       size_t hist_idx = (ce->values_num * ce->history_index) + i;
@@ -406,38 +830,66 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
 
     assert(ce->history_length > 0);
     ce->history_index = (ce->history_index + 1) % ce->history_length;
+  } else if (ce->history_compressed != NULL) {
+    cache_entry_rates(ce);
+
+    size_t memory = c_gorilla_history_memory(ce->history_compressed);
+    if (c_gorilla_history_append(ce->history_compressed, ce->values_gauge) !=
+        0)
+      ERROR("uc_update: %s: Appending to the history failed.", name);
+    shard->memory += c_gorilla_history_memory(ce->history_compressed) - memory;
   }
 
-  /* Prune invalid gauge data */
-  uc_check_range(ds, ce);
+  /* The entry is rescheduled lazily when its bucket is processed, unless the
+   * shorter interval makes it expire before that. */
+  bool reschedule = (vl->interval < ce->interval);
 
-  ce->last_time = vl->time;
-  ce->last_update = cdtime();
+  ce->last_update = cdtime_coarse();
   ce->interval = vl->interval;
+  if (reschedule)
+    cache_wheel_schedule(shard, ce);
 
   /* Check if cache entry has registered callbacks */
   unsigned long callbacks_mask = ce->callbacks_mask;
+  /* Cache event callbacks have not seen restored entries yet. */
+  bool restored = ce->restored;
+  ce->restored = false;
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
-  if (callbacks_mask)
+  if (restored)
+    plugin_dispatch_cache_event(CE_VALUE_NEW, 0 /* mask */, name, vl);
+  else if (callbacks_mask)
     plugin_dispatch_cache_event(CE_VALUE_UPDATE, callbacks_mask, name, vl);
 
   return 0;
+} /* int uc_update_internal */
+
+int uc_update(const data_set_t *ds, const value_list_t *vl) {
+  return uc_update_internal(ds, vl, /* heartbeat = */ 0,
+                            /* ret_unchanged = */ NULL);
 } /* int uc_update */
 
+int uc_update_unchanged(const data_set_t *ds, const value_list_t *vl,
+                        cdtime_t heartbeat, bool *ret_unchanged) {
+  *ret_unchanged = false;
+  return uc_update_internal(ds, vl, heartbeat, ret_unchanged);
+} /* int uc_update_unchanged */
+
 int uc_set_callbacks_mask(const char *name, unsigned long mask) {
-  pthread_mutex_lock(&cache_lock);
+  uint64_t hash = vl_identity_hash(name);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
   cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
+  int status = c_hashtable_get(shard->table, hash, name, (void *)&ce);
   if (status != 0) { /* Ouch, just created entry disappeared ?! */
     ERROR("uc_set_callbacks_mask: Couldn't find %s entry!", name);
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
   DEBUG("uc_set_callbacks_mask: set mask for \"%s\" to %lu.", name, mask);
   ce->callbacks_mask = mask;
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
@@ -448,9 +900,11 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uint64_t hash = vl_identity_hash(name);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -466,6 +920,7 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
         ERROR("utils_cache: uc_get_rate_by_name: malloc failed.");
         status = -1;
       } else {
+        cache_entry_rates(ce);
         memcpy(ret, ce->values_gauge, ret_num * sizeof(gauge_t));
       }
     }
@@ -474,7 +929,7 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -485,12 +940,14 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
 } /* gauge_t *uc_get_rate_by_name */
 
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
     return NULL;
   }
@@ -519,9 +976,11 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uint64_t hash = vl_identity_hash(name);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -542,7 +1001,7 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -553,12 +1012,14 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
 } /* int uc_get_value_by_name */
 
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   value_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("utils_cache: uc_get_value: FORMAT_VL failed.");
     return (NULL);
   }
@@ -580,159 +1041,365 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
   return (ret);
 } /* value_t *uc_get_value */
 
+/* One value list of a uc_get_*_multi() call. */
+typedef struct {
+  char const *name;
+  /* Set if `name' had to be formatted. */
+  char *name_copy;
+  uint64_t hash;
+  cache_shard_t *shard;
+  size_t index;
+  /* Offset of the value list's values in the result array. */
+  size_t offset;
+} cache_lookup_t;
+
+/* Orders lookups by shard, so that each shard is locked only once. */
+static int cache_lookup_compare(const void *a, const void *b) {
+  cache_lookup_t const *l_a = a;
+  cache_lookup_t const *l_b = b;
+
+  if (l_a->shard != l_b->shard)
+    return (l_a->shard < l_b->shard) ? -1 : 1;
+  return (l_a->index < l_b->index) ? -1 : (l_a->index > l_b->index);
+} /* int cache_lookup_compare */
+
+/* How many lookups ahead the hash table slots are prefetched. */
+#define CACHE_PREFETCH_DISTANCE 4
+
+/* Implements uc_get_rate_multi() and uc_get_value_multi(). Copies either the
+ * rates or the raw values to `ret', which holds eight-byte elements. */
+static int cache_get_multi(write_batch_entry_t const *entries, /* {{{ */
+                           size_t entries_num, bool raw, void *ret,
+                           bool *ret_found) {
+  if ((entries == NULL) || (ret == NULL))
+    return -1;
+  if (entries_num == 0)
+    return 0;
+
+  cache_lookup_t *lookups = calloc(entries_num, sizeof(*lookups));
+  if (lookups == NULL) {
+    ERROR("utils_cache: cache_get_multi: calloc failed.");
+    return -1;
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < entries_num; i++) {
+    write_batch_entry_t const *e = entries + i;
+    cache_lookup_t *l = lookups + i;
+
+    l->index = i;
+    l->offset = offset;
+    offset += e->ds->ds_num;
+
+    if (e->identity != NULL) {
+      l->name = e->identity->name;
+      l->hash = e->identity->hash;
+    } else {
+      char buffer[6 * DATA_MAX_NAME_LEN];
+      char const *name = uc_name(e->vl, buffer, sizeof(buffer), &l->hash);
+      if (name == buffer)
+        name = l->name_copy = strdup(buffer);
+      l->name = name;
+    }
+    /* A lookup without a name is skipped and reported as not found. */
+    if (l->name == NULL)
+      ERROR("utils_cache: cache_get_multi: FORMAT_VL failed.");
+    l->shard = cache_shard(l->hash);
+  }
+
+  for (size_t i = 0; i < offset; i++) {
+    if (raw)
+      ((value_t *)ret)[i] = (value_t){.gauge = 0};
+    else
+      ((gauge_t *)ret)[i] = NAN;
+  }
+  if (ret_found != NULL)
+    memset(ret_found, 0, entries_num * sizeof(*ret_found));
+
+  qsort(lookups, entries_num, sizeof(*lookups), cache_lookup_compare);
+
+  int found = 0;
+  size_t i = 0;
+  while (i < entries_num) {
+    cache_shard_t *shard = lookups[i].shard;
+
+    pthread_mutex_lock(&shard->lock);
+    for (; (i < entries_num) && (lookups[i].shard == shard); i++) {
+      size_t ahead = i + CACHE_PREFETCH_DISTANCE;
+      if ((ahead < entries_num) && (lookups[ahead].shard == shard))
+        c_hashtable_prefetch(shard->table, lookups[ahead].hash);
+
+      cache_lookup_t const *l = lookups + i;
+      size_t ds_num = entries[l->index].ds->ds_num;
+      cache_entry_t *ce = NULL;
+      if ((l->name == NULL) ||
+          (c_hashtable_get(shard->table, l->hash, l->name, (void *)&ce) != 0))
+        continue;
+      if ((ce->state == STATE_MISSING) || (ce->values_num != ds_num))
+        continue;
+
+      if (raw) {
+        memcpy((value_t *)ret + l->offset, ce->values_raw,
+               ds_num * sizeof(value_t));
+      } else {
+        cache_entry_rates(ce);
+        memcpy((gauge_t *)ret + l->offset, ce->values_gauge,
+               ds_num * sizeof(gauge_t));
+      }
+      if (ret_found != NULL)
+        ret_found[l->index] = true;
+      found++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  for (size_t j = 0; j < entries_num; j++)
+    free(lookups[j].name_copy);
+  free(lookups);
+
+  return found;
+} /* }}} int cache_get_multi */
+
+int uc_get_rate_multi(write_batch_entry_t const *entries, size_t entries_num,
+                      gauge_t *ret_rates, bool *ret_found) {
+  return cache_get_multi(entries, entries_num, /* raw = */ false, ret_rates,
+                         ret_found);
+} /* int uc_get_rate_multi */
+
+int uc_get_value_multi(write_batch_entry_t const *entries, size_t entries_num,
+                       value_t *ret_values, bool *ret_found) {
+  return cache_get_multi(entries, entries_num, /* raw = */ true, ret_values,
+                         ret_found);
+} /* int uc_get_value_multi */
+
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  pthread_mutex_unlock(&cache_lock);
+  for (size_t i = 0; i < CACHE_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shard((uint64_t)i << 58);
+    pthread_mutex_lock(&shard->lock);
+    size_arrays += c_hashtable_size(shard->table);
+    pthread_mutex_unlock(&shard->lock);
+  }
 
   return size_arrays;
 }
 
+size_t uc_get_memory(void) {
+  size_t memory = 0;
+
+  for (size_t i = 0; i < CACHE_SHARDS_NUM; i++) {
+    cache_shard_t *shard = cache_shard((uint64_t)i << 58);
+    pthread_mutex_lock(&shard->lock);
+    memory += shard->memory;
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return memory;
+} /* size_t uc_get_memory */
+
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
-  c_avl_iterator_t *iter;
-  char *key;
-  cache_entry_t *value;
+  return uc_get_names_filtered(/* filter = */ NULL, /* filter_data = */ NULL,
+                               ret_names, ret_times, ret_number);
+} /* int uc_get_names */
+
+int uc_get_names_filtered(uc_iter_filter_t filter, void *filter_data,
+                          char ***ret_names, cdtime_t **ret_times,
+                          size_t *ret_number) {
+  cache_snapshot_t *entries = NULL;
+  size_t entries_num = 0;
 
   char **names = NULL;
   cdtime_t *times = NULL;
-  size_t number = 0;
-  size_t size_arrays = 0;
-
-  int status = 0;
 
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
+  int status = cache_snapshot(&entries, &entries_num, /* with_values = */ false,
+                              filter, filter_data);
+  if (status != 0) {
+    ERROR("uc_get_names: Copying the cache failed.");
+    return status;
+  }
 
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  if (size_arrays < 1) {
+  if (entries_num < 1) {
     /* Handle the "no values" case here, to avoid the error message when
      * calloc() returns NULL. */
-    pthread_mutex_unlock(&cache_lock);
     return 0;
   }
 
-  names = calloc(size_arrays, sizeof(*names));
-  times = calloc(size_arrays, sizeof(*times));
+  names = calloc(entries_num, sizeof(*names));
+  times = calloc(entries_num, sizeof(*times));
   if ((names == NULL) || (times == NULL)) {
     ERROR("uc_get_names: calloc failed.");
     sfree(names);
     sfree(times);
-    pthread_mutex_unlock(&cache_lock);
+    cache_snapshot_free(entries, entries_num);
     return ENOMEM;
   }
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
-    /* remove missing values when list values */
-    if (value->state == STATE_MISSING)
-      continue;
-
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
-    assert(number < size_arrays);
-
-    if (ret_times != NULL)
-      times[number] = value->last_time;
-
-    names[number] = strdup(key);
-    if (names[number] == NULL) {
-      status = -1;
-      break;
-    }
-
-    number++;
-  } /* while (c_avl_iterator_next) */
-
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
-
-  if (status != 0) {
-    for (size_t i = 0; i < number; i++) {
-      sfree(names[i]);
-    }
-    sfree(names);
-    sfree(times);
-
-    return -1;
+  /* The names are moved from the snapshot to the returned array. */
+  for (size_t i = 0; i < entries_num; i++) {
+    names[i] = entries[i].name;
+    times[i] = entries[i].last_time;
+    entries[i].name = NULL;
   }
+  cache_snapshot_free(entries, entries_num);
 
   *ret_names = names;
   if (ret_times != NULL)
     *ret_times = times;
   else
     sfree(times);
-  *ret_number = number;
+  *ret_number = entries_num;
 
   return 0;
-} /* int uc_get_names */
+} /* int uc_get_names_filtered */
 
 int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_get_state: FORMAT_VL failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_state */
 
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_set_state: FORMAT_VL failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
     ce->state = state;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_state */
 
+int uc_get_threshold(const value_list_t *vl, unsigned int generation,
+                     void **ret_threshold) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  cache_entry_t *ce = NULL;
+  int ret = ENOENT;
+
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_get_threshold: FORMAT_VL failed.");
+    return -1;
+  }
+
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
+    assert(ce != NULL);
+    if ((generation != 0) && (ce->threshold_generation == generation)) {
+      *ret_threshold = ce->threshold;
+      ret = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+} /* int uc_get_threshold */
+
+int uc_set_threshold(const value_list_t *vl, unsigned int generation,
+                     void *threshold) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  cache_entry_t *ce = NULL;
+  int ret = ENOENT;
+
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_set_threshold: FORMAT_VL failed.");
+    return -1;
+  }
+
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
+    assert(ce != NULL);
+    ce->threshold = threshold;
+    ce->threshold_generation = generation;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return ret;
+} /* int uc_set_threshold */
+
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds) {
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uint64_t hash = vl_identity_hash(name);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = c_hashtable_get(shard->table, hash, name, (void *)&ce);
   if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -ENOENT;
   }
 
   if (((size_t)ce->values_num) != num_ds) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -EINVAL;
   }
 
+  if (cache_compress_history) {
+    shard->memory -= cache_entry_memory(ce);
+    if (ce->history_compressed == NULL)
+      ce->history_compressed = c_gorilla_history_create(num_ds, num_steps);
+    else if (c_gorilla_history_length(ce->history_compressed) < num_steps)
+      c_gorilla_history_set_length(ce->history_compressed, num_steps);
+    shard->memory += cache_entry_memory(ce);
+
+    status = (ce->history_compressed != NULL)
+                 ? c_gorilla_history_get(ce->history_compressed, ret_history,
+                                         num_steps)
+                 : ENOMEM;
+    pthread_mutex_unlock(&shard->lock);
+    return -status;
+  }
+
   /* Check if there are enough values available. If not, increase the buffer
    * size. */
   if (ce->history_length < num_steps) {
@@ -741,7 +1408,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
     tmp =
         realloc(ce->history, sizeof(*ce->history) * num_steps * ce->values_num);
     if (tmp == NULL) {
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&shard->lock);
       return -ENOMEM;
     }
 
@@ -749,8 +1416,10 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
          i < (num_steps * ce->values_num); i++)
       tmp[i] = NAN;
 
+    shard->memory -= cache_entry_memory(ce);
     ce->history = tmp;
     ce->history_length = num_steps;
+    shard->memory += cache_entry_memory(ce);
   } /* if (ce->history_length < num_steps) */
 
   /* Copy the values to the output buffer. */
@@ -770,16 +1439,18 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
            sizeof(*ret_history) * num_ds);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* int uc_get_history_by_name */
 
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("utils_cache: uc_get_history: FORMAT_VL failed.");
     return -1;
   }
@@ -788,69 +1459,78 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 } /* int uc_get_history */
 
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_get_hits: FORMAT_VL failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_hits */
 
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_set_hits: FORMAT_VL failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_hits */
 
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
     ERROR("uc_inc_hits: FORMAT_VL failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  cache_shard_t *shard = cache_shard(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_hashtable_get(shard->table, hash, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = ret + step;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_inc_hits */
@@ -858,41 +1538,40 @@ int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
 /*
  * Iterator interface
  */
-uc_iter_t *uc_get_iterator(void) {
+uc_iter_t *uc_get_iterator_filtered(uc_iter_filter_t filter,
+                                    void *filter_data) {
   uc_iter_t *iter = calloc(1, sizeof(*iter));
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
-
-  iter->iter = c_avl_get_iterator(cache_tree);
-  if (iter->iter == NULL) {
+  if (cache_snapshot(&iter->entries, &iter->entries_num,
+                     /* with_values = */ true, filter, filter_data) != 0) {
     free(iter);
     return NULL;
   }
 
   return iter;
+} /* uc_iter_t *uc_get_iterator_filtered */
+
+uc_iter_t *uc_get_iterator(void) {
+  return uc_get_iterator_filtered(/* filter = */ NULL,
+                                  /* filter_data = */ NULL);
 } /* uc_iter_t *uc_get_iterator */
 
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
-  int status;
-
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
-    if (iter->entry->state == STATE_MISSING)
-      continue;
-
-    break;
-  }
-  if (status != 0) {
+  if (iter->index >= iter->entries_num) {
     iter->name = NULL;
     iter->entry = NULL;
     return -1;
   }
 
+  iter->entry = iter->entries + iter->index;
+  iter->name = iter->entry->name;
+  iter->index++;
+
   if (ret_name != NULL)
     *ret_name = iter->name;
 
@@ -903,8 +1582,7 @@ void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
-  pthread_mutex_unlock(&cache_lock);
+  cache_snapshot_free(iter->entries, iter->entries_num);
 
   free(iter);
 } /* void uc_iterator_destroy */
@@ -922,18 +1600,33 @@ int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
   if ((iter == NULL) || (iter->entry == NULL) || (ret_values == NULL) ||
       (ret_num == NULL))
     return -1;
-  *ret_values =
-      calloc(iter->entry->values_num, sizeof(*iter->entry->values_raw));
+  *ret_values = calloc(iter->entry->values_num, sizeof(*iter->entry->values));
   if (*ret_values == NULL)
     return -1;
   for (size_t i = 0; i < iter->entry->values_num; ++i)
-    (*ret_values)[i] = iter->entry->values_raw[i];
+    (*ret_values)[i] = iter->entry->values[i];
 
   *ret_num = iter->entry->values_num;
 
   return 0;
 } /* int uc_iterator_get_values */
 
+int uc_iterator_get_rates(uc_iter_t *iter, gauge_t **ret_rates,
+                          size_t *ret_num) {
+  if ((iter == NULL) || (iter->entry == NULL) || (ret_rates == NULL) ||
+      (ret_num == NULL))
+    return -1;
+  *ret_rates = calloc(iter->entry->values_num, sizeof(*iter->entry->rates));
+  if (*ret_rates == NULL)
+    return -1;
+  memcpy(*ret_rates, iter->entry->rates,
+         iter->entry->values_num * sizeof(*iter->entry->rates));
+
+  *ret_num = iter->entry->values_num;
+
+  return 0;
+} /* int uc_iterator_get_rates */
+
 int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval) {
   if ((iter == NULL) || (iter->entry == NULL) || (ret_interval == NULL))
     return -1;
@@ -946,42 +1639,497 @@ int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta) {
   if ((iter == NULL) || (iter->entry == NULL) || (ret_meta == NULL))
     return -1;
 
-  *ret_meta = meta_data_clone(iter->entry->meta);
+  /* Meta data is not part of the snapshot, because copying it is expensive
+   * and most callers don't need it. If the entry has been removed since the
+   * snapshot was taken, there is no meta data. */
+  cache_shard_t *shard;
+  cache_entry_t *ce = cache_get(iter->entry->name, iter->entry->hash, &shard);
+  *ret_meta = (ce != NULL) ? meta_data_clone(ce->meta) : NULL;
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* int uc_iterator_get_meta */
 
+void uc_get_snapshot_stats(uc_snapshot_stats_t *ret_stats) {
+  pthread_mutex_lock(&snapshot_stats_lock);
+  *ret_stats = (uc_snapshot_stats_t){
+      .count = snapshot_count,
+      .entries = snapshot_entries,
+      .time_total = snapshot_time_total,
+      .lock_max = snapshot_lock_max,
+  };
+  pthread_mutex_unlock(&snapshot_stats_lock);
+} /* void uc_get_snapshot_stats */
+
 /*
- * Meta data interface
+ * Persistence
  */
-/* XXX: This function will acquire `cache_lock' but will not free it! */
-static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
+/* The cache file consists of a header followed by one record per entry. All
+ * fields are in host byte order and records are padded to a multiple of eight
+ * bytes, so the file can be mapped into memory and read in place. */
+#define CACHE_FILE_MAGIC "CDCACHE1"
+#define CACHE_FILE_VERSION 1
+#define CACHE_FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  /* CACHE_FILE_BYTE_ORDER, to reject files written on other architectures. */
+  uint32_t byte_order;
+  uint64_t entries_num;
+} cache_file_header_t;
+
+/* Followed by `value_t values[values_num]', the name including the
+ * terminating null byte and `meta_size' bytes of serialized meta data. */
+typedef struct {
+  /* Size of the record, including this header and padding. */
+  uint32_t size;
+  uint16_t name_size;
+  uint16_t values_num;
+  uint32_t meta_size;
+  int32_t state;
+  uint64_t last_time;
+  uint64_t interval;
+} cache_file_record_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t len;
+} cache_buffer_t;
+
+static int cache_buffer_append(cache_buffer_t *b, void const *data, /* {{{ */
+                               size_t size) {
+  if (b->len + size > b->size) {
+    size_t new_size = (b->size > 0) ? 2 * b->size : 4096;
+    while (new_size < b->len + size)
+      new_size *= 2;
+
+    char *tmp = realloc(b->data, new_size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->data = tmp;
+    b->size = new_size;
+  }
+
+  if (data != NULL)
+    memcpy(b->data + b->len, data, size);
+  else
+    memset(b->data + b->len, 0, size);
+  b->len += size;
+  return 0;
+} /* }}} int cache_buffer_append */
+
+/* Serializes meta data as a sequence of (uint8_t type, uint16_t key size,
+ * key, value) tuples. Strings are stored with a uint32_t size prefix, all
+ * other types with their native size. */
+static int cache_meta_serialize(cache_buffer_t *b, meta_data_t *md) /* {{{ */
 {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
-  int status;
+  char **toc = NULL;
+  int toc_num = meta_data_toc(md, &toc);
+  if (toc_num < 0)
+    return -1;
 
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0) {
-    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
+  int status = 0;
+  for (int i = 0; (i < toc_num) && (status == 0); i++) {
+    uint8_t type = (uint8_t)meta_data_type(md, toc[i]);
+    uint16_t key_size = (uint16_t)(strlen(toc[i]) + 1);
+
+    status = cache_buffer_append(b, &type, sizeof(type));
+    if (status == 0)
+      status = cache_buffer_append(b, &key_size, sizeof(key_size));
+    if (status == 0)
+      status = cache_buffer_append(b, toc[i], key_size);
+    if (status != 0)
+      break;
+
+    switch (type) {
+    case MD_TYPE_STRING: {
+      char *value = NULL;
+      status = meta_data_get_string(md, toc[i], &value);
+      if (status != 0)
+        break;
+      uint32_t size = (uint32_t)(strlen(value) + 1);
+      status = cache_buffer_append(b, &size, sizeof(size));
+      if (status == 0)
+        status = cache_buffer_append(b, value, size);
+      sfree(value);
+    } break;
+    case MD_TYPE_SIGNED_INT: {
+      int64_t value = 0;
+      meta_data_get_signed_int(md, toc[i], &value);
+      status = cache_buffer_append(b, &value, sizeof(value));
+    } break;
+    case MD_TYPE_UNSIGNED_INT: {
+      uint64_t value = 0;
+      meta_data_get_unsigned_int(md, toc[i], &value);
+      status = cache_buffer_append(b, &value, sizeof(value));
+    } break;
+    case MD_TYPE_DOUBLE: {
+      double value = 0;
+      meta_data_get_double(md, toc[i], &value);
+      status = cache_buffer_append(b, &value, sizeof(value));
+    } break;
+    case MD_TYPE_BOOLEAN: {
+      bool value = false;
+      meta_data_get_boolean(md, toc[i], &value);
+      uint8_t v = value ? 1 : 0;
+      status = cache_buffer_append(b, &v, sizeof(v));
+    } break;
+    default:
+      status = -1;
+    }
+  }
+
+  strarray_free(toc, (size_t)toc_num);
+  return status;
+} /* }}} int cache_meta_serialize */
+
+static meta_data_t *cache_meta_parse(char const *data, size_t size) /* {{{ */
+{
+  meta_data_t *md = meta_data_create();
+  if (md == NULL)
     return NULL;
+
+  size_t pos = 0;
+  while (pos < size) {
+    uint8_t type;
+    uint16_t key_size;
+    if (size - pos < sizeof(type) + sizeof(key_size))
+      goto error;
+    memcpy(&type, data + pos, sizeof(type));
+    memcpy(&key_size, data + pos + sizeof(type), sizeof(key_size));
+    pos += sizeof(type) + sizeof(key_size);
+
+    if ((key_size == 0) || (size - pos < key_size) ||
+        (data[pos + key_size - 1] != 0))
+      goto error;
+    char const *key = data + pos;
+    pos += key_size;
+
+    int status;
+    if (type == MD_TYPE_STRING) {
+      uint32_t value_size;
+      if (size - pos < sizeof(value_size))
+        goto error;
+      memcpy(&value_size, data + pos, sizeof(value_size));
+      pos += sizeof(value_size);
+      if ((value_size == 0) || (size - pos < value_size) ||
+          (data[pos + value_size - 1] != 0))
+        goto error;
+      status = meta_data_add_string(md, key, data + pos);
+      pos += value_size;
+    } else if (type == MD_TYPE_BOOLEAN) {
+      if (size - pos < 1)
+        goto error;
+      status = meta_data_add_boolean(md, key, data[pos] != 0);
+      pos += 1;
+    } else {
+      uint64_t value;
+      if (size - pos < sizeof(value))
+        goto error;
+      memcpy(&value, data + pos, sizeof(value));
+      pos += sizeof(value);
+
+      if (type == MD_TYPE_SIGNED_INT) {
+        int64_t v;
+        memcpy(&v, &value, sizeof(v));
+        status = meta_data_add_signed_int(md, key, v);
+      } else if (type == MD_TYPE_UNSIGNED_INT) {
+        status = meta_data_add_unsigned_int(md, key, value);
+      } else if (type == MD_TYPE_DOUBLE) {
+        double v;
+        memcpy(&v, &value, sizeof(v));
+        status = meta_data_add_double(md, key, v);
+      } else {
+        goto error;
+      }
+    }
+    if (status != 0)
+      goto error;
+  }
+
+  return md;
+
+error:
+  meta_data_destroy(md);
+  return NULL;
+} /* }}} meta_data_t *cache_meta_parse */
+
+/* Appends the record of `ce' to `b'. The shard must be locked. */
+static int cache_record_serialize(cache_buffer_t *b, /* {{{ */
+                                  cache_entry_t const *ce) {
+  size_t start = b->len;
+  size_t name_size = strlen(ce->name) + 1;
+  if ((name_size > UINT16_MAX) || (ce->values_num > UINT16_MAX))
+    return EINVAL;
+
+  int status = cache_buffer_append(b, NULL, sizeof(cache_file_record_t));
+  if (status == 0)
+    status = cache_buffer_append(b, ce->values_raw,
+                                 ce->values_num * sizeof(*ce->values_raw));
+  if (status == 0)
+    status = cache_buffer_append(b, ce->name, name_size);
+  size_t meta_start = b->len;
+  if ((status == 0) && (ce->meta != NULL))
+    status = cache_meta_serialize(b, ce->meta);
+  size_t meta_size = b->len - meta_start;
+  if ((status == 0) && ((b->len - start) % 8 != 0))
+    status = cache_buffer_append(b, NULL, 8 - (b->len - start) % 8);
+  if (status != 0) {
+    b->len = start;
+    return status;
+  }
+
+  cache_file_record_t rec = {
+      .size = (uint32_t)(b->len - start),
+      .name_size = (uint16_t)name_size,
+      .values_num = (uint16_t)ce->values_num,
+      .meta_size = (uint32_t)meta_size,
+      .state = (int32_t)ce->state,
+      .last_time = (uint64_t)ce->last_time,
+      .interval = (uint64_t)ce->interval,
+  };
+  memcpy(b->data + start, &rec, sizeof(rec));
+  return 0;
+} /* }}} int cache_record_serialize */
+
+/* Adds the entry described by the record to the cache. */
+static int cache_record_restore(char const *data, size_t size) /* {{{ */
+{
+  cache_file_record_t rec;
+  memcpy(&rec, data, sizeof(rec));
+
+  size_t values_size = rec.values_num * sizeof(value_t);
+  if ((rec.values_num == 0) || (rec.name_size == 0) ||
+      (sizeof(rec) + values_size + rec.name_size + rec.meta_size > size))
+    return EINVAL;
+
+  char const *name = data + sizeof(rec) + values_size;
+  if (name[rec.name_size - 1] != 0)
+    return EINVAL;
+
+  meta_data_t *meta = NULL;
+  if (rec.meta_size > 0) {
+    meta = cache_meta_parse(name + rec.name_size, rec.meta_size);
+    if (meta == NULL)
+      return EINVAL;
+  }
+
+  cache_entry_t *ce = cache_alloc(rec.values_num, name);
+  if (ce == NULL) {
+    meta_data_destroy(meta);
+    return ENOMEM;
+  }
+
+  memcpy(ce->values_raw, data + sizeof(rec), values_size);
+  for (size_t i = 0; i < ce->values_num; i++)
+    ce->values_gauge[i] = NAN;
+  ce->hash = vl_identity_hash(ce->name);
+  ce->last_time = (cdtime_t)rec.last_time;
+  ce->last_update = cdtime_coarse();
+  ce->interval = (cdtime_t)rec.interval;
+  ce->state = (int)rec.state;
+  ce->meta = meta;
+  ce->restored = true;
+
+  cache_shard_t *shard = cache_shard(ce->hash);
+  pthread_mutex_lock(&shard->lock);
+  int status = c_hashtable_insert(shard->table, ce->hash, ce->name, ce);
+  if (status == 0) {
+    shard->memory += cache_entry_memory(ce);
+    cache_wheel_schedule(shard, ce);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  if (status != 0) {
+    cache_free(ce);
+    return (status > 0) ? EEXIST : ENOMEM;
+  }
+  return 0;
+} /* }}} int cache_record_restore */
+
+static int cache_restore(char const *file) /* {{{ */
+{
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL) {
+    int status = errno;
+    if (status != ENOENT)
+      WARNING("utils_cache: Opening \"%s\" failed: %s", file,
+              STRERROR(status));
+    return status;
+  }
+
+  struct stat st;
+  if ((fstat(fileno(fh), &st) != 0) ||
+      ((size_t)st.st_size < sizeof(cache_file_header_t))) {
+    WARNING("utils_cache: \"%s\" is not a cache file.", file);
+    fclose(fh);
+    return EINVAL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  char *data = malloc(size);
+  if (data == NULL) {
+    fclose(fh);
+    return ENOMEM;
+  }
+  if (fread(data, 1, size, fh) != size) {
+    WARNING("utils_cache: Reading \"%s\" failed.", file);
+    free(data);
+    fclose(fh);
+    return EIO;
+  }
+  fclose(fh);
+
+  cache_file_header_t hdr;
+  memcpy(&hdr, data, sizeof(hdr));
+  if ((memcmp(hdr.magic, CACHE_FILE_MAGIC, sizeof(hdr.magic)) != 0) ||
+      (hdr.version != CACHE_FILE_VERSION) ||
+      (hdr.byte_order != CACHE_FILE_BYTE_ORDER)) {
+    WARNING("utils_cache: \"%s\" is not a cache file of this version and "
+            "architecture, ignoring it.",
+            file);
+    free(data);
+    return EINVAL;
+  }
+
+  uint64_t restored = 0;
+  size_t pos = sizeof(hdr);
+  for (uint64_t i = 0; i < hdr.entries_num; i++) {
+    cache_file_record_t rec;
+    if (size - pos < sizeof(rec))
+      break;
+    memcpy(&rec, data + pos, sizeof(rec));
+    if ((rec.size < sizeof(rec)) || (rec.size % 8 != 0) ||
+        (rec.size > size - pos))
+      break;
+
+    if (cache_record_restore(data + pos, rec.size) == 0)
+      restored++;
+    pos += rec.size;
+  }
+
+  if (pos != size)
+    WARNING("utils_cache: \"%s\" is truncated or corrupt.", file);
+  INFO("utils_cache: Restored %" PRIu64 " of %" PRIu64 " entries from \"%s\".",
+       restored, hdr.entries_num, file);
+
+  free(data);
+  return 0;
+} /* }}} int cache_restore */
+
+int uc_persist(bool force) /* {{{ */
+{
+  if (cache_file == NULL)
+    return 0;
+
+  cdtime_t now = cdtime();
+  if (!force && ((cache_file_interval == 0) ||
+                 ((now - cache_file_last) < cache_file_interval)))
+    return 0;
+  cache_file_last = now;
+
+  char tmp_file[PATH_MAX];
+  ssnprintf(tmp_file, sizeof(tmp_file), "%s.tmp", cache_file);
+
+  FILE *fh = fopen(tmp_file, "w");
+  if (fh == NULL) {
+    ERROR("utils_cache: Opening \"%s\" failed: %s", tmp_file, STRERRNO);
+    return errno;
+  }
+
+  cache_file_header_t hdr = {
+      .version = CACHE_FILE_VERSION,
+      .byte_order = CACHE_FILE_BYTE_ORDER,
+  };
+  memcpy(hdr.magic, CACHE_FILE_MAGIC, sizeof(hdr.magic));
+
+  int status = 0;
+  if (fwrite(&hdr, sizeof(hdr), 1, fh) != 1)
+    status = EIO;
+
+  /* Each shard is serialized into the buffer while it is locked and written
+   * after unlocking it. */
+  cache_buffer_t b = {0};
+  for (size_t i = 0; (i < CACHE_SHARDS_NUM) && (status == 0); i++) {
+    cache_shard_t *shard = cache_shard((uint64_t)i << 58);
+
+    b.len = 0;
+    pthread_mutex_lock(&shard->lock);
+    size_t pos = 0;
+    cache_entry_t *ce;
+    while (c_hashtable_next(shard->table, &pos, NULL, (void *)&ce) == 0) {
+      if (ce->state == STATE_MISSING)
+        continue;
+      status = cache_record_serialize(&b, ce);
+      if (status == EINVAL) {
+        /* Too long to be stored; skip it. */
+        status = 0;
+        continue;
+      }
+      if (status != 0)
+        break;
+      hdr.entries_num++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if ((status == 0) && (b.len > 0) && (fwrite(b.data, b.len, 1, fh) != 1))
+      status = EIO;
   }
+  sfree(b.data);
 
-  pthread_mutex_lock(&cache_lock);
+  if ((status == 0) && ((fseek(fh, 0, SEEK_SET) != 0) ||
+                        (fwrite(&hdr, sizeof(hdr), 1, fh) != 1)))
+    status = EIO;
+  if ((fclose(fh) != 0) && (status == 0))
+    status = EIO;
+
+  if ((status == 0) && (rename(tmp_file, cache_file) != 0))
+    status = errno;
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
   if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+    ERROR("utils_cache: Writing the cache to \"%s\" failed: %s", cache_file,
+          STRERROR(status));
+    unlink(tmp_file);
+    return status;
+  }
+
+  DEBUG("utils_cache: Wrote %" PRIu64 " entries to \"%s\".", hdr.entries_num,
+        cache_file);
+  return 0;
+} /* }}} int uc_persist */
+
+/*
+ * Meta data interface
+ */
+/* XXX: This function will lock the entry's shard, which is returned in
+ * `ret_shard', but will not unlock it! */
+static meta_data_t *uc_get_meta(const value_list_t *vl, /* {{{ */
+                                cache_shard_t **ret_shard) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+
+  uint64_t hash;
+  char const *name = uc_name(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
+    return NULL;
+  }
+
+  cache_shard_t *shard;
+  cache_entry_t *ce = cache_get(name, hash, &shard);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&shard->lock);
     return NULL;
   }
-  assert(ce != NULL);
 
   if (ce->meta == NULL)
     ce->meta = meta_data_create();
 
   if (ce->meta == NULL)
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
 
+  *ret_shard = shard;
   return ce->meta;
 } /* }}} meta_data_t *uc_get_meta */
 
@@ -989,13 +2137,14 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
  * shorter.. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key);                                         \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
 int uc_meta_data_exists(const value_list_t *vl, const char *key)
@@ -1015,13 +2164,14 @@ int uc_meta_data_exists(const value_list_t *vl, const char *key)
  * two argumetns. */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
+    cache_shard_t *shard;                                                      \
     meta_data_t *meta;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key, value);                                  \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
         int uc_meta_data_add_string(const value_list_t *vl, const char *key,
@@ -39,7 +39,15 @@
 
 int uc_init(void);
 int uc_check_timeout(void);
+/* Writes the cache to the "CacheFile", if configured. Unless `force' is true,
+ * this only happens once per "CacheFileInterval". */
+int uc_persist(bool force);
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Like uc_update(), but also sets `*ret_unchanged' if the values equal the
+ * previous ones and less than `heartbeat' has passed since values of the
+ * entry were last reported as changed. */
+int uc_update_unchanged(const data_set_t *ds, const value_list_t *vl,
+                        cdtime_t heartbeat, bool *ret_unchanged);
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
@@ -47,7 +55,34 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num);
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl);
 
+/*
+ * NAME
+ *   uc_get_rate_multi, uc_get_value_multi
+ *
+ * DESCRIPTION
+ *   Look up the rates or raw values of many value lists at once, locking each
+ *   part of the cache only once. This is cheaper than calling uc_get_rate() or
+ *   uc_get_value() for each value list, especially from "write_batch"
+ *   callbacks, which can pass their entries directly.
+ *
+ *   The values of entries[i] are stored in `ret_rates' or `ret_values' at the
+ *   offset given by the sum of `ds_num' of all preceding entries, so the
+ *   array must hold as many elements as all entries have data sources. The
+ *   rates of value lists that are not in the cache are NAN. If `ret_found' is
+ *   not NULL, ret_found[i] is set to whether entries[i] was found.
+ *
+ * RETURN VALUE
+ *   The number of value lists found or -1 upon failure.
+ */
+int uc_get_rate_multi(write_batch_entry_t const *entries, size_t entries_num,
+                      gauge_t *ret_rates, bool *ret_found);
+int uc_get_value_multi(write_batch_entry_t const *entries, size_t entries_num,
+                       value_t *ret_values, bool *ret_found);
+
 size_t uc_get_size(void);
+/* Returns the number of bytes allocated for cache entries, not counting meta
+ * data. */
+size_t uc_get_memory(void);
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number);
 
 int uc_get_state(const data_set_t *ds, const value_list_t *vl);
@@ -58,6 +93,14 @@ int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step);
 
 int uc_set_callbacks_mask(const char *name, unsigned long callbacks_mask);
 
+/* Binds a threshold, or NULL for "no threshold", to the cache entry of `vl'.
+ * uc_get_threshold() returns ENOENT unless the binding was made with the same,
+ * non-zero, `generation'. The pointer is not dereferenced by the cache. */
+int uc_get_threshold(const value_list_t *vl, unsigned int generation,
+                     void **ret_threshold);
+int uc_set_threshold(const value_list_t *vl, unsigned int generation,
+                     void *threshold);
+
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds);
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
@@ -68,20 +111,44 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
  */
 struct uc_iter_s;
 typedef struct uc_iter_s uc_iter_t;
+typedef bool (*uc_iter_filter_t)(char const *name, void *filter_data);
+
+/* Like uc_get_names(), but only returns the names for which `filter' returns
+ * true. See uc_get_iterator_filtered() for the restrictions on `filter'. */
+int uc_get_names_filtered(uc_iter_filter_t filter, void *filter_data,
+                          char ***ret_names, cdtime_t **ret_times,
+                          size_t *ret_number);
 
 /*
  * NAME
  *   uc_get_iterator
  *
  * DESCRIPTION
- *   Create an iterator for the cache. It will hold the cache lock until it's
- *   destroyed.
+ *   Create an iterator for the cache. The iterator works on a copy of the
+ *   cache, sorted by name, and does not hold any locks between calls. Each
+ *   shard of the cache is locked only while it is being copied.
  *
  * RETURN VALUE
  *   An iterator object on success or NULL else.
  */
 uc_iter_t *uc_get_iterator(void);
 
+/*
+ * NAME
+ *   uc_get_iterator_filtered
+ *
+ * DESCRIPTION
+ *   Like uc_get_iterator(), but only copies the entries for which `filter'
+ *   returns true. The filter is called with the entry's name while the
+ *   entry's shard is locked, so it must be fast and must not call back into
+ *   the cache.
+ *
+ * RETURN VALUE
+ *   An iterator object on success or NULL else.
+ */
+uc_iter_t *uc_get_iterator_filtered(uc_iter_filter_t filter,
+                                    void *filter_data);
+
 /*
  * NAME
  *   uc_iterator_next
@@ -108,11 +175,28 @@ int uc_iterator_get_time(uc_iter_t *iter, cdtime_t *ret_time);
 /* Return the (raw) value at the current position. */
 int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
                            size_t *ret_num);
+/* Return the rates of the value at the current position. */
+int uc_iterator_get_rates(uc_iter_t *iter, gauge_t **ret_rates,
+                          size_t *ret_num);
 /* Return the interval of the value at the current position. */
 int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval);
 /* Return the metadata for the value at the current position. */
 int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta);
 
+/* Cost of the copies taken by uc_get_iterator() and uc_get_names(). */
+typedef struct {
+  /* Number of copies taken. */
+  uint64_t count;
+  /* Total number of entries copied. */
+  uint64_t entries;
+  /* Total time spent taking copies, including sorting. */
+  cdtime_t time_total;
+  /* Longest time a shard was locked while being copied. */
+  cdtime_t lock_max;
+} uc_snapshot_stats_t;
+
+void uc_get_snapshot_stats(uc_snapshot_stats_t *ret_stats);
+
 /*
  * Meta data interface
  */
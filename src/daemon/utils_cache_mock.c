@@ -29,10 +29,55 @@
 
 #include <errno.h>
 
-gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
-                     __attribute__((unused)) value_list_t const *vl) {
-  errno = ENOTSUP;
-  return NULL;
+/* Returns the values themselves as rates, so that code paths using StoreRates
+ * can be exercised without a value cache. */
+gauge_t *uc_get_rate(data_set_t const *ds, value_list_t const *vl) {
+  if ((ds == NULL) || (vl == NULL) || (ds->ds_num != vl->values_len)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  gauge_t *rates = calloc(vl->values_len, sizeof(*rates));
+  if (rates == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    switch (ds->ds[i].type) {
+    case DS_TYPE_GAUGE:
+      rates[i] = vl->values[i].gauge;
+      break;
+    case DS_TYPE_COUNTER:
+      rates[i] = (gauge_t)vl->values[i].counter;
+      break;
+    case DS_TYPE_DERIVE:
+      rates[i] = (gauge_t)vl->values[i].derive;
+      break;
+    case DS_TYPE_ABSOLUTE:
+      rates[i] = (gauge_t)vl->values[i].absolute;
+      break;
+    }
+  }
+
+  return rates;
+}
+
+int uc_get_rate_multi(write_batch_entry_t const *entries, size_t entries_num,
+                      gauge_t *ret_rates, bool *ret_found) {
+  size_t offset = 0;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    gauge_t *rates = uc_get_rate(entries[i].ds, entries[i].vl);
+    if (rates == NULL)
+      return -1;
+    memcpy(ret_rates + offset, rates, entries[i].ds->ds_num * sizeof(*rates));
+    offset += entries[i].ds->ds_num;
+    free(rates);
+
+    if (ret_found != NULL)
+      ret_found[i] = true;
+  }
+
+  return (int)entries_num;
 }
 
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
@@ -44,6 +89,12 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return ENOTSUP;
 }
 
+int uc_get_names_filtered(uc_iter_filter_t filter, void *filter_data,
+                          char ***ret_names, cdtime_t **ret_times,
+                          size_t *ret_number) {
+  return ENOTSUP;
+}
+
 int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num) {
   return ENOTSUP;
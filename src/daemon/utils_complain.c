@@ -37,7 +37,7 @@ vcomplain(int level, c_complain_t *c, const char *format, va_list ap) {
   cdtime_t now;
   char message[512];
 
-  now = cdtime();
+  now = cdtime_coarse();
 
   if (c->last + c->interval > now)
     return 0;
@@ -0,0 +1,273 @@
+/**
+ * collectd - src/daemon/utils_downsample.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
+#include "utils_downsample.h"
+#include "utils_identity.h"
+
+/* Series without values for this many windows are forgotten. */
+#define DOWNSAMPLE_EXPIRE_WINDOWS 2
+
+typedef struct {
+  /* Sum, minimum, maximum or last value, depending on the data source type
+   * and the function. */
+  value_t acc;
+  /* Number of values in `acc'; NaNs are not counted. */
+  uint32_t num;
+} downsample_value_t;
+
+typedef struct {
+  /* Holds a reference; its name is the key in the table. */
+  vl_identity_t const *id;
+  /* Index of the window, i.e. the time divided by the interval. */
+  uint64_t window;
+  size_t values_num;
+  downsample_value_t values[];
+} downsample_series_t;
+
+struct downsample_s {
+  cdtime_t interval;
+  int function;
+
+  pthread_mutex_t lock;
+  c_hashtable_t *series;
+  /* Window in which expired series were last removed. */
+  uint64_t expire_window;
+};
+
+downsample_t *downsample_create(cdtime_t interval, int function) {
+  if ((interval == 0) || (function < DOWNSAMPLE_AVERAGE) ||
+      (function > DOWNSAMPLE_LAST))
+    return NULL;
+
+  downsample_t *d = calloc(1, sizeof(*d));
+  if (d == NULL)
+    return NULL;
+
+  d->series = c_hashtable_create();
+  if (d->series == NULL) {
+    sfree(d);
+    return NULL;
+  }
+
+  d->interval = interval;
+  d->function = function;
+  pthread_mutex_init(&d->lock, /* attr = */ NULL);
+  return d;
+} /* downsample_t *downsample_create */
+
+static void series_free(downsample_series_t *s) {
+  if (s == NULL)
+    return;
+  vl_identity_release(s->id);
+  sfree(s);
+}
+
+void downsample_destroy(downsample_t *d) {
+  if (d == NULL)
+    return;
+
+  size_t pos = 0;
+  char *key = NULL;
+  void *value = NULL;
+  while (c_hashtable_next(d->series, &pos, &key, &value) == 0)
+    series_free(value);
+
+  c_hashtable_destroy(d->series);
+  pthread_mutex_destroy(&d->lock);
+  sfree(d);
+} /* void downsample_destroy */
+
+/* Removes series without values in the last DOWNSAMPLE_EXPIRE_WINDOWS
+ * windows. The table must not change while iterating, so these are collected
+ * first. */
+static void downsample_expire(downsample_t *d, uint64_t window) {
+  size_t expired_num = 0;
+  downsample_series_t *expired[64];
+
+  size_t pos = 0;
+  char *key = NULL;
+  void *value = NULL;
+  while (c_hashtable_next(d->series, &pos, &key, &value) == 0) {
+    downsample_series_t *s = value;
+    if (s->window + DOWNSAMPLE_EXPIRE_WINDOWS >= window)
+      continue;
+
+    expired[expired_num] = s;
+    expired_num++;
+    if (expired_num < STATIC_ARRAY_SIZE(expired))
+      continue;
+
+    for (size_t i = 0; i < expired_num; i++) {
+      c_hashtable_remove(d->series, expired[i]->id->hash, expired[i]->id->name,
+                         NULL, NULL);
+      series_free(expired[i]);
+    }
+    expired_num = 0;
+    pos = 0;
+  }
+
+  for (size_t i = 0; i < expired_num; i++) {
+    c_hashtable_remove(d->series, expired[i]->id->hash, expired[i]->id->name,
+                       NULL, NULL);
+    series_free(expired[i]);
+  }
+
+  d->expire_window = window;
+} /* void downsample_expire */
+
+static void series_reset(downsample_series_t *s, uint64_t window) {
+  s->window = window;
+  for (size_t i = 0; i < s->values_num; i++)
+    s->values[i] = (downsample_value_t){0};
+}
+
+static void series_add(downsample_t const *d, downsample_series_t *s,
+                       data_set_t const *ds, value_list_t const *vl) {
+  for (size_t i = 0; i < s->values_num; i++) {
+    downsample_value_t *v = s->values + i;
+    value_t const *new = vl->values + i;
+
+    switch (ds->ds[i].type) {
+    case DS_TYPE_GAUGE: {
+      gauge_t g = new->gauge;
+      if (d->function == DOWNSAMPLE_LAST) {
+        v->acc.gauge = g;
+        v->num = 1;
+        break;
+      }
+      if (isnan(g))
+        break;
+
+      if (v->num == 0)
+        v->acc.gauge = g;
+      else if (d->function == DOWNSAMPLE_AVERAGE)
+        v->acc.gauge += g;
+      else if ((d->function == DOWNSAMPLE_MINIMUM) && (g < v->acc.gauge))
+        v->acc.gauge = g;
+      else if ((d->function == DOWNSAMPLE_MAXIMUM) && (g > v->acc.gauge))
+        v->acc.gauge = g;
+      v->num++;
+    } break;
+    case DS_TYPE_ABSOLUTE:
+      v->acc.absolute += new->absolute;
+      v->num++;
+      break;
+    default:
+      v->acc = *new;
+      v->num = 1;
+    }
+  }
+} /* void series_add */
+
+static void series_reduce(downsample_t const *d, downsample_series_t const *s,
+                          data_set_t const *ds, value_list_t const *vl,
+                          value_list_t *ret_vl, value_t *ret_values) {
+  for (size_t i = 0; i < s->values_num; i++) {
+    downsample_value_t const *v = s->values + i;
+
+    ret_values[i] = v->acc;
+    if (ds->ds[i].type != DS_TYPE_GAUGE)
+      continue;
+
+    if (v->num == 0)
+      ret_values[i].gauge = NAN;
+    else if (d->function == DOWNSAMPLE_AVERAGE)
+      ret_values[i].gauge = v->acc.gauge / (gauge_t)v->num;
+  }
+
+  *ret_vl = *vl;
+  ret_vl->values = ret_values;
+  ret_vl->values_len = s->values_num;
+  ret_vl->time = (cdtime_t)(s->window + 1) * d->interval;
+  ret_vl->interval = d->interval;
+  ret_vl->meta = NULL;
+} /* void series_reduce */
+
+int downsample_add(downsample_t *d, data_set_t const *ds,
+                   value_list_t const *vl, vl_identity_t const *id,
+                   value_list_t *ret_vl, value_t *ret_values) {
+  if ((d == NULL) || (ds == NULL) || (vl == NULL) || (id == NULL) ||
+      (vl->values_len != ds->ds_num))
+    return -EINVAL;
+
+  uint64_t window = (uint64_t)(vl->time / d->interval);
+
+  pthread_mutex_lock(&d->lock);
+
+  if (window > d->expire_window + DOWNSAMPLE_EXPIRE_WINDOWS)
+    downsample_expire(d, window);
+
+  downsample_series_t *s = NULL;
+  if (c_hashtable_get(d->series, id->hash, id->name, (void *)&s) == 0) {
+    if (s->values_num != ds->ds_num) {
+      /* The data set has changed; start over. */
+      c_hashtable_remove(d->series, id->hash, id->name, NULL, NULL);
+      series_free(s);
+      s = NULL;
+    }
+  }
+
+  if (s == NULL) {
+    s = calloc(1, sizeof(*s) + ds->ds_num * sizeof(s->values[0]));
+    if (s == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      return -ENOMEM;
+    }
+    s->id = vl_identity_ref(id);
+    s->values_num = ds->ds_num;
+    s->window = window;
+
+    if (c_hashtable_insert(d->series, id->hash, id->name, s) != 0) {
+      pthread_mutex_unlock(&d->lock);
+      series_free(s);
+      return -ENOMEM;
+    }
+  }
+
+  if (window < s->window) {
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+  }
+
+  int status = 0;
+  if (window > s->window) {
+    series_reduce(d, s, ds, vl, ret_vl, ret_values);
+    series_reset(s, window);
+    status = 1;
+  }
+  series_add(d, s, ds, vl);
+
+  pthread_mutex_unlock(&d->lock);
+  return status;
+} /* int downsample_add */
+
+size_t downsample_size(downsample_t *d) {
+  pthread_mutex_lock(&d->lock);
+  size_t size = c_hashtable_size(d->series);
+  pthread_mutex_unlock(&d->lock);
+  return size;
+} /* size_t downsample_size */
@@ -0,0 +1,97 @@
+/**
+ * collectd - src/daemon/utils_downsample.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_DOWNSAMPLE_H
+#define UTILS_DOWNSAMPLE_H 1
+
+#include "plugin.h"
+
+/*
+ * Reduces the value lists of each series to one per output interval. The
+ * output intervals are aligned to multiples of the interval, so that all
+ * series are reduced over the same windows. Gauges are reduced with the
+ * configured function, ignoring NaNs; counters and derives keep their last
+ * value and absolute values are summed up. Each series keeps one accumulator
+ * per data source. A window is only reduced once the first value of a later
+ * window arrives, so the last window of a series that stops is never
+ * reported. The state is protected by a lock, so a downsample_t can be used
+ * from several threads.
+ */
+struct downsample_s;
+typedef struct downsample_s downsample_t;
+
+#define DOWNSAMPLE_AVERAGE 0
+#define DOWNSAMPLE_MINIMUM 1
+#define DOWNSAMPLE_MAXIMUM 2
+#define DOWNSAMPLE_LAST 3
+
+/*
+ * NAME
+ *   downsample_create
+ *
+ * RETURN VALUE
+ *   A new state for reducing value lists to one per `interval' with one of
+ *   the DOWNSAMPLE_* functions, or NULL upon failure.
+ */
+downsample_t *downsample_create(cdtime_t interval, int function);
+
+/*
+ * NAME
+ *   downsample_destroy
+ *
+ * DESCRIPTION
+ *   Frees the state, dropping the windows that have not been reduced yet.
+ */
+void downsample_destroy(downsample_t *d);
+
+/*
+ * NAME
+ *   downsample_add
+ *
+ * DESCRIPTION
+ *   Adds the values of `vl', whose identity is `id', to the current window of
+ *   its series. If `vl' is the first value list of a later window, the
+ *   previous window is reduced into `ret_vl' first: the identifier fields are
+ *   copied from `vl', the time is the end of the window and `ret_vl->values'
+ *   is set to `ret_values', which must have room for `ds->ds_num' values.
+ *   `ret_vl' has no meta data. Value lists older than the current window of
+ *   their series are ignored.
+ *
+ * RETURN VALUE
+ *   One if a reduced value list has been stored in `ret_vl', zero if it has
+ *   not and a negative errno value upon failure.
+ */
+int downsample_add(downsample_t *d, data_set_t const *ds,
+                   value_list_t const *vl, vl_identity_t const *id,
+                   value_list_t *ret_vl, value_t *ret_values);
+
+/*
+ * NAME
+ *   downsample_size
+ *
+ * RETURN VALUE
+ *   The number of series with state.
+ */
+size_t downsample_size(downsample_t *d);
+
+#endif /* UTILS_DOWNSAMPLE_H */
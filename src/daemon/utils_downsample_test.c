@@ -0,0 +1,161 @@
+/**
+ * collectd - src/daemon/utils_downsample_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+#include "utils/common/common.h"
+
+#include "testing.h"
+#include "utils_downsample.h"
+#include "utils_identity.h"
+
+static data_source_t dsrc[] = {
+    {"gauge", DS_TYPE_GAUGE, 0, NAN},
+    {"derive", DS_TYPE_DERIVE, 0, NAN},
+    {"absolute", DS_TYPE_ABSOLUTE, 0, NAN},
+};
+static data_set_t ds = {"test", STATIC_ARRAY_SIZE(dsrc), dsrc};
+
+#define INTERVAL TIME_T_TO_CDTIME_T(60)
+
+/* Adds a value list at `seconds' and returns what downsample_add() returns.
+ * The reduced value list is stored in `ret_vl' and `ret_values'. */
+static int add(downsample_t *d, char const *instance, double seconds,
+               gauge_t g, derive_t der, absolute_t abs, value_list_t *ret_vl,
+               value_t *ret_values) {
+  value_t values[] = {{.gauge = g}, {.derive = der}, {.absolute = abs}};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = DOUBLE_TO_CDTIME_T(seconds),
+      .interval = TIME_T_TO_CDTIME_T(1),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "test",
+  };
+  sstrncpy(vl.type_instance, instance, sizeof(vl.type_instance));
+
+  vl_identity_t const *id = vl_identity_intern(&vl);
+  int status = downsample_add(d, &ds, &vl, id, ret_vl, ret_values);
+  vl_identity_release(id);
+  return status;
+}
+
+DEF_TEST(average) {
+  downsample_t *d;
+  CHECK_NOT_NULL(d = downsample_create(INTERVAL, DOWNSAMPLE_AVERAGE));
+
+  value_list_t vl = {0};
+  value_t values[3];
+  EXPECT_EQ_INT(0, add(d, "a", 6000, 1, 100, 1, &vl, values));
+  EXPECT_EQ_INT(0, add(d, "a", 6020, NAN, 110, 2, &vl, values));
+  EXPECT_EQ_INT(0, add(d, "a", 6059, 3, 120, 3, &vl, values));
+
+  EXPECT_EQ_INT(1, add(d, "a", 6060, 10, 130, 4, &vl, values));
+  EXPECT_EQ_STR("a", vl.type_instance);
+  EXPECT_EQ_UINT64(DOUBLE_TO_CDTIME_T(6060), vl.time);
+  EXPECT_EQ_UINT64(INTERVAL, vl.interval);
+  EXPECT_EQ_INT(3, (int)vl.values_len);
+  EXPECT_EQ_PTR(values, vl.values);
+  EXPECT_EQ_DOUBLE(2, values[0].gauge);
+  EXPECT_EQ_UINT64(120, (uint64_t)values[1].derive);
+  EXPECT_EQ_UINT64(6, (uint64_t)values[2].absolute);
+
+  /* Older values are ignored; only NaNs give NaN. */
+  EXPECT_EQ_INT(0, add(d, "a", 6059, 100, 0, 100, &vl, values));
+  EXPECT_EQ_INT(0, add(d, "a", 6070, NAN, 140, 0, &vl, values));
+  EXPECT_EQ_INT(1, add(d, "a", 6120, NAN, 150, 0, &vl, values));
+  EXPECT_EQ_DOUBLE(10, values[0].gauge);
+  EXPECT_EQ_UINT64(140, (uint64_t)values[1].derive);
+  EXPECT_EQ_UINT64(4, (uint64_t)values[2].absolute);
+
+  EXPECT_EQ_INT(1, add(d, "a", 6180, 0, 160, 0, &vl, values));
+  EXPECT_EQ_DOUBLE(NAN, values[0].gauge);
+
+  downsample_destroy(d);
+  return 0;
+}
+
+DEF_TEST(functions) {
+  struct {
+    int function;
+    gauge_t want;
+  } cases[] = {
+      {DOWNSAMPLE_MINIMUM, -1},
+      {DOWNSAMPLE_MAXIMUM, 5},
+      {DOWNSAMPLE_LAST, 2},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    downsample_t *d;
+    CHECK_NOT_NULL(d = downsample_create(INTERVAL, cases[i].function));
+
+    value_list_t vl = {0};
+    value_t values[3];
+    EXPECT_EQ_INT(0, add(d, "a", 0, 3, 0, 0, &vl, values));
+    EXPECT_EQ_INT(0, add(d, "a", 10, NAN, 0, 0, &vl, values));
+    EXPECT_EQ_INT(0, add(d, "a", 20, 5, 0, 0, &vl, values));
+    EXPECT_EQ_INT(0, add(d, "a", 30, -1, 0, 0, &vl, values));
+    EXPECT_EQ_INT(0, add(d, "a", 40, 2, 0, 0, &vl, values));
+    EXPECT_EQ_INT(1, add(d, "a", 130, 7, 0, 0, &vl, values));
+    EXPECT_EQ_DOUBLE(cases[i].want, values[0].gauge);
+    EXPECT_EQ_UINT64(INTERVAL, vl.time);
+
+    downsample_destroy(d);
+  }
+
+  EXPECT_EQ_PTR(NULL, downsample_create(0, DOWNSAMPLE_AVERAGE));
+  EXPECT_EQ_PTR(NULL, downsample_create(INTERVAL, -1));
+  return 0;
+}
+
+DEF_TEST(series) {
+  downsample_t *d;
+  CHECK_NOT_NULL(d = downsample_create(INTERVAL, DOWNSAMPLE_AVERAGE));
+
+  value_list_t vl = {0};
+  value_t values[3];
+  EXPECT_EQ_INT(0, add(d, "a", 0, 1, 0, 0, &vl, values));
+  EXPECT_EQ_INT(0, add(d, "b", 0, 2, 0, 0, &vl, values));
+  EXPECT_EQ_INT(2, (int)downsample_size(d));
+
+  EXPECT_EQ_INT(1, add(d, "b", 60, 0, 0, 0, &vl, values));
+  EXPECT_EQ_STR("b", vl.type_instance);
+  EXPECT_EQ_DOUBLE(2, values[0].gauge);
+
+  /* By now, "a" has had no values for more than two windows. */
+  EXPECT_EQ_INT(1, add(d, "b", 180, 0, 0, 0, &vl, values));
+  EXPECT_EQ_INT(1, (int)downsample_size(d));
+  EXPECT_EQ_INT(0, add(d, "a", 190, 0, 0, 0, &vl, values));
+  EXPECT_EQ_INT(2, (int)downsample_size(d));
+
+  downsample_destroy(d);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(average);
+  RUN_TEST(functions);
+  RUN_TEST(series);
+
+  END_TEST;
+}
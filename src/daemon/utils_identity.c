@@ -0,0 +1,270 @@
+/**
+ * collectd - src/daemon/utils_identity.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_identity.h"
+
+/* Number of independently locked parts of the table. Must be a power of two.
+ */
+#define IDENTITY_SHARDS_NUM 64
+#define IDENTITY_BUCKETS_MIN 64
+
+struct identity_entry_s;
+typedef struct identity_entry_s identity_entry_t;
+struct identity_entry_s {
+  /* Must be the first member, so the pointer handed out can be converted
+   * back. */
+  vl_identity_t id;
+  long refcount;
+  identity_entry_t *next;
+  char data[];
+};
+
+struct identity_shard_s {
+  pthread_mutex_t lock;
+  identity_entry_t **buckets;
+  size_t buckets_num;
+  size_t entries_num;
+  uint64_t next_id;
+};
+typedef struct identity_shard_s identity_shard_t;
+
+static identity_shard_t identity_shards[IDENTITY_SHARDS_NUM];
+static pthread_once_t identity_once = PTHREAD_ONCE_INIT;
+
+static void identity_init(void) /* {{{ */
+{
+  for (size_t i = 0; i < IDENTITY_SHARDS_NUM; i++)
+    pthread_mutex_init(&identity_shards[i].lock, /* attr = */ NULL);
+} /* }}} void identity_init */
+
+/* The low bits select the bucket, so the shard is chosen by the high bits. */
+static identity_shard_t *identity_shard(uint64_t hash) /* {{{ */
+{
+  return identity_shards + ((hash >> 58) & (IDENTITY_SHARDS_NUM - 1));
+} /* }}} identity_shard_t *identity_shard */
+
+static bool identity_equal(vl_identity_t const *id, /* {{{ */
+                           value_list_t const *vl, char const *host) {
+  return (strcmp(id->host, host) == 0) &&
+         (strcmp(id->plugin, vl->plugin) == 0) &&
+         (strcmp(id->plugin_instance, vl->plugin_instance) == 0) &&
+         (strcmp(id->type, vl->type) == 0) &&
+         (strcmp(id->type_instance, vl->type_instance) == 0);
+} /* }}} bool identity_equal */
+
+/* Doubles the number of buckets. The shard's lock must be held. */
+static void identity_shard_grow(identity_shard_t *s) /* {{{ */
+{
+  size_t num = (s->buckets_num == 0) ? IDENTITY_BUCKETS_MIN
+                                     : 2 * s->buckets_num;
+  identity_entry_t **buckets = calloc(num, sizeof(*buckets));
+  if (buckets == NULL)
+    return; /* Keep using the old, longer chains. */
+
+  for (size_t i = 0; i < s->buckets_num; i++) {
+    while (s->buckets[i] != NULL) {
+      identity_entry_t *e = s->buckets[i];
+      s->buckets[i] = e->next;
+
+      size_t b = (size_t)(e->id.hash & (num - 1));
+      e->next = buckets[b];
+      buckets[b] = e;
+    }
+  }
+
+  free(s->buckets);
+  s->buckets = buckets;
+  s->buckets_num = num;
+} /* }}} void identity_shard_grow */
+
+static identity_entry_t *identity_create(value_list_t const *vl, /* {{{ */
+                                         char const *host, char const *name,
+                                         uint64_t hash) {
+  char const *fields[] = {host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance, name};
+  size_t lengths[STATIC_ARRAY_SIZE(fields)];
+  size_t size = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    lengths[i] = strlen(fields[i]) + 1;
+    size += lengths[i];
+  }
+
+  identity_entry_t *e = malloc(sizeof(*e) + size);
+  if (e == NULL)
+    return NULL;
+
+  char const **members[] = {&e->id.host, &e->id.plugin, &e->id.plugin_instance,
+                            &e->id.type, &e->id.type_instance, &e->id.name};
+  char *ptr = e->data;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    memcpy(ptr, fields[i], lengths[i]);
+    *members[i] = ptr;
+    ptr += lengths[i];
+  }
+
+  e->id.hash = hash;
+  e->refcount = 1;
+  e->next = NULL;
+  return e;
+} /* }}} identity_entry_t *identity_create */
+
+uint64_t vl_identity_hash(char const *name) /* {{{ */
+{
+  /* 64 bit FNV-1a */
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char const *c = (unsigned char const *)name; *c != 0; c++) {
+    hash ^= (uint64_t)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* }}} uint64_t vl_identity_hash */
+
+vl_identity_t const *vl_identity_intern(value_list_t const *vl) /* {{{ */
+{
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  if (vl == NULL)
+    return NULL;
+
+  pthread_once(&identity_once, identity_init);
+
+  char const *host = (vl->host[0] != 0) ? vl->host : hostname_g;
+  if (format_name(name, sizeof(name), host, vl->plugin, vl->plugin_instance,
+                  vl->type, vl->type_instance) != 0)
+    return NULL;
+
+  uint64_t hash = vl_identity_hash(name);
+  identity_shard_t *s = identity_shard(hash);
+
+  pthread_mutex_lock(&s->lock);
+  if (s->buckets_num != 0) {
+    for (identity_entry_t *e = s->buckets[hash & (s->buckets_num - 1)];
+         e != NULL; e = e->next) {
+      if ((e->id.hash == hash) && identity_equal(&e->id, vl, host)) {
+        e->refcount++;
+        pthread_mutex_unlock(&s->lock);
+        return &e->id;
+      }
+    }
+  }
+
+  identity_entry_t *e = identity_create(vl, host, name, hash);
+  if (e == NULL) {
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+  }
+
+  if (s->entries_num >= s->buckets_num)
+    identity_shard_grow(s);
+  if (s->buckets_num == 0) {
+    pthread_mutex_unlock(&s->lock);
+    free(e);
+    return NULL;
+  }
+
+  e->id.id = s->next_id * IDENTITY_SHARDS_NUM +
+             (uint64_t)(s - identity_shards);
+  s->next_id++;
+
+  size_t b = (size_t)(hash & (s->buckets_num - 1));
+  e->next = s->buckets[b];
+  s->buckets[b] = e;
+  s->entries_num++;
+  pthread_mutex_unlock(&s->lock);
+
+  return &e->id;
+} /* }}} vl_identity_t const *vl_identity_intern */
+
+vl_identity_t const *vl_identity_ref(vl_identity_t const *id) /* {{{ */
+{
+  if (id == NULL)
+    return NULL;
+
+  identity_entry_t *e = (identity_entry_t *)id;
+  identity_shard_t *s = identity_shard(id->hash);
+
+  pthread_mutex_lock(&s->lock);
+  e->refcount++;
+  pthread_mutex_unlock(&s->lock);
+
+  return id;
+} /* }}} vl_identity_t const *vl_identity_ref */
+
+void vl_identity_release(vl_identity_t const *id) /* {{{ */
+{
+  if (id == NULL)
+    return;
+
+  identity_entry_t *e = (identity_entry_t *)id;
+  identity_shard_t *s = identity_shard(id->hash);
+
+  /* The reference count is changed with the lock held, so that
+   * vl_identity_intern() never finds an entry that is about to be freed. */
+  pthread_mutex_lock(&s->lock);
+  e->refcount--;
+  if (e->refcount > 0) {
+    pthread_mutex_unlock(&s->lock);
+    return;
+  }
+
+  for (identity_entry_t **p = s->buckets + (id->hash & (s->buckets_num - 1));
+       *p != NULL; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      s->entries_num--;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  free(e);
+} /* }}} void vl_identity_release */
+
+void vl_identity_to_value_list(vl_identity_t const *id, /* {{{ */
+                               value_list_t *vl) {
+  sstrncpy(vl->host, id->host, sizeof(vl->host));
+  sstrncpy(vl->plugin, id->plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, id->plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, id->type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, id->type_instance, sizeof(vl->type_instance));
+} /* }}} void vl_identity_to_value_list */
+
+size_t vl_identity_count(void) /* {{{ */
+{
+  size_t num = 0;
+
+  pthread_once(&identity_once, identity_init);
+
+  for (size_t i = 0; i < IDENTITY_SHARDS_NUM; i++) {
+    pthread_mutex_lock(&identity_shards[i].lock);
+    num += identity_shards[i].entries_num;
+    pthread_mutex_unlock(&identity_shards[i].lock);
+  }
+
+  return num;
+} /* }}} size_t vl_identity_count */
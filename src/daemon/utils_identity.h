@@ -0,0 +1,116 @@
+/**
+ * collectd - src/daemon/utils_identity.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_IDENTITY_H
+#define UTILS_IDENTITY_H 1
+
+#include "plugin.h"
+
+/*
+ * Interned identities of value lists. For each distinct (host, plugin,
+ * plugin_instance, type, type_instance) tuple in use there is exactly one
+ * vl_identity_t, so two identities are equal if and only if the pointers are.
+ * The canonical name, as returned by FORMAT_VL(), and its hash are computed
+ * once when the identity is created. Identities are reference counted and
+ * freed when the last reference is released.
+ */
+struct vl_identity_s {
+  char const *host;
+  char const *plugin;
+  char const *plugin_instance;
+  char const *type;
+  char const *type_instance;
+
+  /* "host/plugin-plugin_instance/type-type_instance" */
+  char const *name;
+  /* Hash of `name', see vl_identity_hash(). */
+  uint64_t hash;
+  /* Unique among all identities created by this process; never reused. */
+  uint64_t id;
+};
+/* vl_identity_t is declared in plugin.h. */
+
+/*
+ * NAME
+ *   vl_identity_intern
+ *
+ * DESCRIPTION
+ *   Looks up the identity of `vl', creating it if necessary, and acquires a
+ *   reference to it. The reference must be released with
+ *   vl_identity_release().
+ *
+ * RETURN VALUE
+ *   The identity or NULL if memory is exhausted or the canonical name would
+ *   be too long.
+ */
+vl_identity_t const *vl_identity_intern(value_list_t const *vl);
+
+/*
+ * NAME
+ *   vl_identity_ref
+ *
+ * DESCRIPTION
+ *   Acquires another reference to `id'. Returns `id'.
+ */
+vl_identity_t const *vl_identity_ref(vl_identity_t const *id);
+
+/*
+ * NAME
+ *   vl_identity_release
+ *
+ * DESCRIPTION
+ *   Releases a reference acquired with vl_identity_intern() or
+ *   vl_identity_ref(). Passing NULL is a no-op.
+ */
+void vl_identity_release(vl_identity_t const *id);
+
+/*
+ * NAME
+ *   vl_identity_to_value_list
+ *
+ * DESCRIPTION
+ *   Copies the identifier fields of `id' to the character arrays of `vl', for
+ *   code that only knows about value_list_t.
+ */
+void vl_identity_to_value_list(vl_identity_t const *id, value_list_t *vl);
+
+/*
+ * NAME
+ *   vl_identity_hash
+ *
+ * DESCRIPTION
+ *   The hash function used for the `hash' member, exported so that canonical
+ *   names obtained elsewhere can be hashed the same way.
+ */
+uint64_t vl_identity_hash(char const *name);
+
+/*
+ * NAME
+ *   vl_identity_count
+ *
+ * RETURN VALUE
+ *   The number of identities currently in use.
+ */
+size_t vl_identity_count(void);
+
+#endif /* UTILS_IDENTITY_H */
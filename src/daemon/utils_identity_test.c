@@ -0,0 +1,126 @@
+/**
+ * collectd - src/daemon/utils_identity_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+#include "utils/common/common.h"
+
+#include "testing.h"
+#include "utils_identity.h"
+
+#define IDENTITIES_NUM 1000
+
+DEF_TEST(intern) {
+  value_list_t vl = {
+      .host = "host.example.com",
+      .plugin = "cpu",
+      .plugin_instance = "0",
+      .type = "cpu",
+      .type_instance = "idle",
+  };
+
+  vl_identity_t const *a = vl_identity_intern(&vl);
+  OK(a != NULL);
+  EXPECT_EQ_STR("host.example.com", a->host);
+  EXPECT_EQ_STR("cpu", a->plugin);
+  EXPECT_EQ_STR("0", a->plugin_instance);
+  EXPECT_EQ_STR("cpu", a->type);
+  EXPECT_EQ_STR("idle", a->type_instance);
+  EXPECT_EQ_STR("host.example.com/cpu-0/cpu-idle", a->name);
+  EXPECT_EQ_UINT64(vl_identity_hash(a->name), a->hash);
+  EXPECT_EQ_UINT64(1, vl_identity_count());
+
+  /* The same tuple yields the same identity. */
+  vl_identity_t const *b = vl_identity_intern(&vl);
+  OK(b != NULL);
+  OK(a == b);
+  EXPECT_EQ_UINT64(1, vl_identity_count());
+
+  /* A different tuple with the same name does not. */
+  sstrncpy(vl.plugin, "cpu-0", sizeof(vl.plugin));
+  vl.plugin_instance[0] = 0;
+  vl_identity_t const *c = vl_identity_intern(&vl);
+  OK(c != NULL);
+  OK(a != c);
+  OK(a->id != c->id);
+  EXPECT_EQ_STR(a->name, c->name);
+  EXPECT_EQ_UINT64(2, vl_identity_count());
+
+  value_list_t copy = VALUE_LIST_INIT;
+  vl_identity_to_value_list(c, &copy);
+  EXPECT_EQ_STR("host.example.com", copy.host);
+  EXPECT_EQ_STR("cpu-0", copy.plugin);
+  EXPECT_EQ_STR("", copy.plugin_instance);
+  EXPECT_EQ_STR("idle", copy.type_instance);
+
+  /* Missing hostnames default to hostname_g. */
+  vl.host[0] = 0;
+  vl_identity_t const *d = vl_identity_intern(&vl);
+  OK(d != NULL);
+  EXPECT_EQ_STR(hostname_g, d->host);
+
+  vl_identity_release(a);
+  vl_identity_release(c);
+  vl_identity_release(d);
+  EXPECT_EQ_UINT64(1, vl_identity_count());
+  vl_identity_release(vl_identity_ref(b));
+  EXPECT_EQ_UINT64(1, vl_identity_count());
+  vl_identity_release(b);
+  EXPECT_EQ_UINT64(0, vl_identity_count());
+
+  vl_identity_release(NULL);
+  return 0;
+}
+
+DEF_TEST(many) {
+  vl_identity_t const **ids = calloc(IDENTITIES_NUM, sizeof(*ids));
+  CHECK_NOT_NULL(ids);
+
+  value_list_t vl = {.plugin = "test", .type = "gauge"};
+  for (int i = 0; i < IDENTITIES_NUM; i++) {
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%d", i);
+    ids[i] = vl_identity_intern(&vl);
+    OK(ids[i] != NULL);
+  }
+  EXPECT_EQ_UINT64(IDENTITIES_NUM, vl_identity_count());
+
+  for (int i = 0; i < IDENTITIES_NUM; i++) {
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%d", i);
+    vl_identity_t const *id = vl_identity_intern(&vl);
+    OK(id == ids[i]);
+    vl_identity_release(id);
+  }
+
+  for (int i = 0; i < IDENTITIES_NUM; i++)
+    vl_identity_release(ids[i]);
+  EXPECT_EQ_UINT64(0, vl_identity_count());
+
+  free(ids);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(intern);
+  RUN_TEST(many);
+
+  END_TEST;
+}
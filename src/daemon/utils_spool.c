@@ -0,0 +1,557 @@
+/**
+ * collectd - src/daemon/utils_spool.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_spool.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+
+/* Part types of the network protocol, see src/network.h. */
+#define SPOOL_TYPE_HOST 0x0000
+#define SPOOL_TYPE_PLUGIN 0x0002
+#define SPOOL_TYPE_PLUGIN_INSTANCE 0x0003
+#define SPOOL_TYPE_TYPE 0x0004
+#define SPOOL_TYPE_TYPE_INSTANCE 0x0005
+#define SPOOL_TYPE_VALUES 0x0006
+#define SPOOL_TYPE_TIME_HR 0x0008
+#define SPOOL_TYPE_INTERVAL_HR 0x0009
+
+#define SPOOL_MAGIC "cdspool1"
+
+/* At the start of each segment. Records of a 32 bit length in host byte order
+ * followed by the parts of one value list start at `sizeof(spool_header_t)'.
+ */
+typedef struct {
+  char magic[8];
+  /* Offset of the first record that has not been committed. */
+  uint64_t committed;
+  /* Offset after the last record. */
+  uint64_t end;
+  uint64_t reserved;
+} spool_header_t;
+
+typedef struct {
+  uint64_t seq;
+  char *map;
+  spool_header_t *hdr;
+} spool_segment_t;
+
+struct spool_s {
+  /* "<dir>/<name>.spool." */
+  char *prefix;
+  uint64_t segments_max;
+  /* Segments on disk, from the one being read to the one being written. */
+  uint64_t seq_first;
+  uint64_t seq_last;
+  spool_segment_t write;
+  /* Only mapped while `seq_first' is smaller than `seq_last'. */
+  spool_segment_t read;
+  /* Read position in the segment being read. Zero if not initialized. */
+  uint64_t read_pos;
+  uint64_t bytes;
+};
+
+static void spool_segment_path(spool_t const *s, uint64_t seq, char *buffer,
+                               size_t buffer_size) {
+  ssnprintf(buffer, buffer_size, "%s%016" PRIx64, s->prefix, seq);
+}
+
+static void spool_segment_unmap(spool_segment_t *seg) {
+  if (seg->map != NULL)
+    munmap(seg->map, SPOOL_SEGMENT_SIZE);
+  seg->map = NULL;
+  seg->hdr = NULL;
+}
+
+/* Maps segment `seq', creating it if `create' is set. */
+static int spool_segment_map(spool_t const *s, uint64_t seq, bool create,
+                             spool_segment_t *seg) {
+  char path[PATH_MAX];
+  spool_segment_path(s, seq, path, sizeof(path));
+
+  int fd = open(path, O_RDWR | (create ? (O_CREAT | O_TRUNC) : 0), 0600);
+  if (fd < 0)
+    return errno;
+
+  int status = 0;
+  struct stat statbuf;
+  if (create && (ftruncate(fd, SPOOL_SEGMENT_SIZE) != 0))
+    status = errno;
+  else if (!create && (fstat(fd, &statbuf) != 0))
+    status = errno;
+  else if (!create && (statbuf.st_size != SPOOL_SEGMENT_SIZE))
+    status = EINVAL;
+
+  void *map = MAP_FAILED;
+  if (status == 0) {
+    map = mmap(NULL, SPOOL_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+    if (map == MAP_FAILED)
+      status = errno;
+  }
+  close(fd);
+
+  if (status != 0) {
+    if (create)
+      unlink(path);
+    return status;
+  }
+
+  *seg = (spool_segment_t){
+      .seq = seq,
+      .map = map,
+      .hdr = map,
+  };
+
+  if (create) {
+    memcpy(seg->hdr->magic, SPOOL_MAGIC, sizeof(seg->hdr->magic));
+    seg->hdr->committed = sizeof(spool_header_t);
+    seg->hdr->end = sizeof(spool_header_t);
+  } else if ((memcmp(seg->hdr->magic, SPOOL_MAGIC, sizeof(seg->hdr->magic)) !=
+              0) ||
+             (seg->hdr->end > SPOOL_SEGMENT_SIZE) ||
+             (seg->hdr->committed < sizeof(spool_header_t)) ||
+             (seg->hdr->committed > seg->hdr->end)) {
+    spool_segment_unmap(seg);
+    return EINVAL;
+  }
+
+  return 0;
+} /* int spool_segment_map */
+
+static void spool_segment_remove(spool_t const *s, spool_segment_t *seg) {
+  char path[PATH_MAX];
+  spool_segment_path(s, seg->seq, path, sizeof(path));
+
+  spool_segment_unmap(seg);
+  unlink(path);
+}
+
+/* Returns the segment being read, mapping it if necessary. */
+static spool_segment_t *spool_read_segment(spool_t *s) {
+  while (s->seq_first < s->seq_last) {
+    if (s->read.map != NULL)
+      return &s->read;
+
+    int status = spool_segment_map(s, s->seq_first, false, &s->read);
+    if (status == 0)
+      return &s->read;
+
+    if (status != ENOENT) {
+      char path[PATH_MAX];
+      spool_segment_path(s, s->seq_first, path, sizeof(path));
+      WARNING("spool: Skipping segment \"%s\": %s", path, STRERROR(status));
+    }
+    s->seq_first++;
+    s->read_pos = 0;
+  }
+
+  return &s->write;
+} /* spool_segment_t *spool_read_segment */
+
+/* Scans `dir' for segments of the spool. */
+static int spool_scan(spool_t *s, char const *dir) {
+  char const *base = strrchr(s->prefix, '/') + 1;
+  size_t base_len = strlen(base);
+
+  DIR *dh = opendir(dir);
+  if (dh == NULL)
+    return errno;
+
+  bool found = false;
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if ((strncmp(de->d_name, base, base_len) != 0) ||
+        (strlen(de->d_name + base_len) != 16))
+      continue;
+
+    char *endptr = NULL;
+    uint64_t seq = (uint64_t)strtoull(de->d_name + base_len, &endptr, 16);
+    if ((endptr == NULL) || (*endptr != 0))
+      continue;
+
+    if (!found || (seq < s->seq_first))
+      s->seq_first = seq;
+    if (!found || (seq > s->seq_last))
+      s->seq_last = seq;
+    found = true;
+  }
+  closedir(dh);
+
+  if (!found)
+    return ENOENT;
+  return 0;
+} /* int spool_scan */
+
+spool_t *spool_open(char const *dir, char const *name, uint64_t size_limit) {
+  spool_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->segments_max = size_limit / SPOOL_SEGMENT_SIZE;
+  if (s->segments_max < 2)
+    s->segments_max = 2;
+
+  /* Names of write callbacks may contain slashes. */
+  char safe_name[DATA_MAX_NAME_LEN];
+  sstrncpy(safe_name, name, sizeof(safe_name));
+  for (char *ptr = safe_name; *ptr != 0; ptr++)
+    if (*ptr == '/')
+      *ptr = '_';
+
+  char prefix[PATH_MAX];
+  int status =
+      ssnprintf(prefix, sizeof(prefix), "%s/%s.spool.", dir, safe_name);
+  if ((status < 0) || ((size_t)status + 16 >= sizeof(prefix))) {
+    ERROR("spool: The path of spool \"%s\" is too long.", name);
+    sfree(s);
+    return NULL;
+  }
+
+  s->prefix = strdup(prefix);
+  if ((s->prefix == NULL) || (check_create_dir(prefix) != 0)) {
+    ERROR("spool: Creating the directory \"%s\" failed.", dir);
+    spool_close(s);
+    return NULL;
+  }
+
+  if (spool_scan(s, dir) == 0) {
+    /* Pick up the contents left by an earlier run. */
+    for (uint64_t seq = s->seq_first; seq <= s->seq_last; seq++) {
+      spool_segment_t seg;
+      if (spool_segment_map(s, seq, false, &seg) != 0)
+        continue;
+      s->bytes += seg.hdr->end - seg.hdr->committed;
+      spool_segment_unmap(&seg);
+    }
+
+    if (spool_segment_map(s, s->seq_last, false, &s->write) != 0)
+      s->seq_last++;
+  }
+
+  if ((s->write.map == NULL) &&
+      ((status = spool_segment_map(s, s->seq_last, true, &s->write)) != 0)) {
+    ERROR("spool: Creating a segment of spool \"%s\" failed: %s", name,
+          STRERROR(status));
+    spool_close(s);
+    return NULL;
+  }
+
+  if (s->bytes > 0)
+    INFO("spool: Spool \"%s\" holds %" PRIu64 " bytes from an earlier run.",
+         name, s->bytes);
+  return s;
+} /* spool_t *spool_open */
+
+void spool_close(spool_t *s) {
+  if (s == NULL)
+    return;
+
+  spool_segment_unmap(&s->read);
+  spool_segment_unmap(&s->write);
+  sfree(s->prefix);
+  sfree(s);
+} /* void spool_close */
+
+static size_t spool_string_size(char const *str) {
+  return 4 + strlen(str) + 1;
+}
+
+static char *spool_put_header(char *ptr, uint16_t type, size_t size) {
+  uint16_t tmp = htons(type);
+  memcpy(ptr, &tmp, sizeof(tmp));
+  tmp = htons((uint16_t)size);
+  memcpy(ptr + 2, &tmp, sizeof(tmp));
+  return ptr + 4;
+}
+
+static char *spool_put_string(char *ptr, uint16_t type, char const *str) {
+  size_t len = strlen(str) + 1;
+  ptr = spool_put_header(ptr, type, 4 + len);
+  memcpy(ptr, str, len);
+  return ptr + len;
+}
+
+static char *spool_put_u64(char *ptr, uint16_t type, uint64_t value) {
+  ptr = spool_put_header(ptr, type, 12);
+  value = htonll(value);
+  memcpy(ptr, &value, sizeof(value));
+  return ptr + sizeof(value);
+}
+
+int spool_append(spool_t *s, data_set_t const *ds, value_list_t const *vl) {
+  if (ds->ds_num != vl->values_len)
+    return EINVAL;
+
+  size_t size = spool_string_size(vl->host) + spool_string_size(vl->plugin) +
+                spool_string_size(vl->plugin_instance) +
+                spool_string_size(vl->type) +
+                spool_string_size(vl->type_instance) + 2 * 12 + 6 +
+                9 * vl->values_len;
+  if ((size > UINT16_MAX) ||
+      (sizeof(uint32_t) + size > SPOOL_SEGMENT_SIZE - sizeof(spool_header_t)))
+    return EINVAL;
+
+  if (s->write.hdr->end + sizeof(uint32_t) + size > SPOOL_SEGMENT_SIZE) {
+    if (s->seq_last - s->seq_first + 1 >= s->segments_max)
+      return ENOSPC;
+
+    spool_segment_t seg;
+    int status = spool_segment_map(s, s->seq_last + 1, true, &seg);
+    if (status != 0)
+      return status;
+
+    /* If the full segment is also being read, it stays mapped for reading. */
+    if (s->seq_first == s->seq_last)
+      s->read = s->write;
+    else
+      spool_segment_unmap(&s->write);
+    s->write = seg;
+    s->seq_last++;
+  }
+
+  char *start = s->write.map + s->write.hdr->end;
+  uint32_t record_size = (uint32_t)size;
+  memcpy(start, &record_size, sizeof(record_size));
+
+  char *ptr = start + sizeof(record_size);
+  ptr = spool_put_string(ptr, SPOOL_TYPE_HOST, vl->host);
+  ptr = spool_put_u64(ptr, SPOOL_TYPE_TIME_HR, (uint64_t)vl->time);
+  ptr = spool_put_u64(ptr, SPOOL_TYPE_INTERVAL_HR, (uint64_t)vl->interval);
+  ptr = spool_put_string(ptr, SPOOL_TYPE_PLUGIN, vl->plugin);
+  ptr = spool_put_string(ptr, SPOOL_TYPE_PLUGIN_INSTANCE, vl->plugin_instance);
+  ptr = spool_put_string(ptr, SPOOL_TYPE_TYPE, vl->type);
+  ptr = spool_put_string(ptr, SPOOL_TYPE_TYPE_INSTANCE, vl->type_instance);
+
+  ptr = spool_put_header(ptr, SPOOL_TYPE_VALUES, 6 + 9 * vl->values_len);
+  uint16_t num = htons((uint16_t)vl->values_len);
+  memcpy(ptr, &num, sizeof(num));
+  ptr += sizeof(num);
+  for (size_t i = 0; i < vl->values_len; i++)
+    *(ptr++) = (char)ds->ds[i].type;
+  for (size_t i = 0; i < vl->values_len; i++) {
+    uint64_t value;
+    if (ds->ds[i].type == DS_TYPE_GAUGE) {
+      double d = htond(vl->values[i].gauge);
+      memcpy(&value, &d, sizeof(value));
+    } else {
+      /* All other types are 64 bit integers. */
+      memcpy(&value, vl->values + i, sizeof(value));
+      value = htonll(value);
+    }
+    memcpy(ptr, &value, sizeof(value));
+    ptr += sizeof(value);
+  }
+  assert(ptr == start + sizeof(record_size) + size);
+
+  s->write.hdr->end += sizeof(record_size) + size;
+  s->bytes += sizeof(record_size) + size;
+  return 0;
+} /* int spool_append */
+
+static int spool_get_string(char const *data, size_t size, char *buffer,
+                            size_t buffer_size) {
+  if ((size == 0) || (size > buffer_size) || (data[size - 1] != 0))
+    return EINVAL;
+  memcpy(buffer, data, size);
+  return 0;
+}
+
+static int spool_get_values(char const *data, size_t size, value_list_t *vl,
+                            size_t values_size) {
+  uint16_t num;
+  if (size < sizeof(num))
+    return EINVAL;
+  memcpy(&num, data, sizeof(num));
+  num = ntohs(num);
+  if ((num == 0) || (num > values_size) ||
+      (size != sizeof(num) + 9 * (size_t)num))
+    return EINVAL;
+
+  char const *types = data + sizeof(num);
+  char const *values = types + num;
+  for (uint16_t i = 0; i < num; i++) {
+    uint64_t value;
+    memcpy(&value, values + 8 * i, sizeof(value));
+
+    if (types[i] == DS_TYPE_GAUGE) {
+      double d;
+      memcpy(&d, &value, sizeof(d));
+      vl->values[i].gauge = ntohd(d);
+    } else if ((types[i] == DS_TYPE_COUNTER) ||
+               (types[i] == DS_TYPE_DERIVE) ||
+               (types[i] == DS_TYPE_ABSOLUTE)) {
+      value = ntohll(value);
+      memcpy(vl->values + i, &value, sizeof(value));
+    } else {
+      return EINVAL;
+    }
+  }
+
+  vl->values_len = num;
+  return 0;
+} /* int spool_get_values */
+
+static int spool_decode(char const *data, size_t size, value_list_t *vl,
+                        size_t values_size) {
+  bool have_values = false;
+
+  while (size > 0) {
+    uint16_t type;
+    uint16_t part_size;
+    if (size < 4)
+      return EINVAL;
+    memcpy(&type, data, sizeof(type));
+    memcpy(&part_size, data + 2, sizeof(part_size));
+    type = ntohs(type);
+    part_size = ntohs(part_size);
+    if ((part_size < 4) || (part_size > size))
+      return EINVAL;
+
+    char const *payload = data + 4;
+    size_t payload_size = part_size - 4;
+    uint64_t u64 = 0;
+    if ((type == SPOOL_TYPE_TIME_HR) || (type == SPOOL_TYPE_INTERVAL_HR)) {
+      if (payload_size != sizeof(u64))
+        return EINVAL;
+      memcpy(&u64, payload, sizeof(u64));
+      u64 = ntohll(u64);
+    }
+
+    int status = 0;
+    switch (type) {
+    case SPOOL_TYPE_HOST:
+      status = spool_get_string(payload, payload_size, vl->host,
+                                sizeof(vl->host));
+      break;
+    case SPOOL_TYPE_PLUGIN:
+      status = spool_get_string(payload, payload_size, vl->plugin,
+                                sizeof(vl->plugin));
+      break;
+    case SPOOL_TYPE_PLUGIN_INSTANCE:
+      status = spool_get_string(payload, payload_size, vl->plugin_instance,
+                                sizeof(vl->plugin_instance));
+      break;
+    case SPOOL_TYPE_TYPE:
+      status = spool_get_string(payload, payload_size, vl->type,
+                                sizeof(vl->type));
+      break;
+    case SPOOL_TYPE_TYPE_INSTANCE:
+      status = spool_get_string(payload, payload_size, vl->type_instance,
+                                sizeof(vl->type_instance));
+      break;
+    case SPOOL_TYPE_TIME_HR:
+      vl->time = (cdtime_t)u64;
+      break;
+    case SPOOL_TYPE_INTERVAL_HR:
+      vl->interval = (cdtime_t)u64;
+      break;
+    case SPOOL_TYPE_VALUES:
+      status = spool_get_values(payload, payload_size, vl, values_size);
+      have_values = (status == 0);
+      break;
+    default:
+      /* Unknown parts are ignored, like the network plugin does. */
+      break;
+    }
+    if (status != 0)
+      return status;
+
+    data += part_size;
+    size -= part_size;
+  }
+
+  return have_values ? 0 : EINVAL;
+} /* int spool_decode */
+
+int spool_read(spool_t *s, value_list_t *vl, value_t *values,
+               size_t values_size) {
+  while (42) {
+    spool_segment_t *seg = spool_read_segment(s);
+    if (s->read_pos == 0)
+      s->read_pos = seg->hdr->committed;
+
+    if (s->read_pos + sizeof(uint32_t) <= seg->hdr->end) {
+      uint32_t size;
+      memcpy(&size, seg->map + s->read_pos, sizeof(size));
+      char const *data = seg->map + s->read_pos + sizeof(size);
+      if ((uint64_t)size > seg->hdr->end - s->read_pos - sizeof(size)) {
+        /* A corrupted length: skip the rest of the segment. */
+        WARNING("spool: Skipping the corrupted rest of a segment.");
+        s->read_pos = seg->hdr->end;
+        continue;
+      }
+      s->read_pos += sizeof(size) + size;
+
+      *vl = (value_list_t){.values = values};
+      if (spool_decode(data, size, vl, values_size) == 0)
+        return 0;
+      continue;
+    }
+
+    /* The segment has been read completely. Unless it is also being written,
+     * the next one is read once everything has been committed. */
+    if ((seg == &s->write) || (s->read_pos != seg->hdr->committed))
+      return ENOENT;
+
+    spool_segment_remove(s, seg);
+    s->seq_first++;
+    s->read_pos = 0;
+  }
+} /* int spool_read */
+
+void spool_commit(spool_t *s) {
+  if (s->read_pos == 0)
+    return;
+
+  spool_segment_t *seg = spool_read_segment(s);
+  s->bytes -= s->read_pos - seg->hdr->committed;
+  seg->hdr->committed = s->read_pos;
+
+  if (seg->hdr->committed < seg->hdr->end)
+    return;
+
+  if (seg != &s->write) {
+    spool_segment_remove(s, seg);
+    s->seq_first++;
+    s->read_pos = 0;
+  } else {
+    /* The spool is empty, so the segment is reused from the start. */
+    seg->hdr->committed = sizeof(spool_header_t);
+    seg->hdr->end = sizeof(spool_header_t);
+    s->read_pos = 0;
+    s->bytes = 0;
+  }
+} /* void spool_commit */
+
+void spool_rewind(spool_t *s) {
+  s->read_pos = 0;
+} /* void spool_rewind */
+
+bool spool_empty(spool_t const *s) { return s->bytes == 0; }
+
+uint64_t spool_size(spool_t const *s) { return s->bytes; }
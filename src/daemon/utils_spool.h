@@ -0,0 +1,127 @@
+/**
+ * collectd - src/daemon/utils_spool.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SPOOL_H
+#define UTILS_SPOOL_H 1
+
+#include "plugin.h"
+
+/*
+ * A disk-backed FIFO of value lists. Value lists are appended to segment files
+ * of SPOOL_SEGMENT_SIZE bytes, which are mapped into memory, so only the
+ * segments currently being written and read occupy memory. Value lists are
+ * encoded like the parts of the network protocol; meta data is not kept.
+ *
+ * Reading is transactional: spool_read() returns the next value list without
+ * removing it, spool_commit() removes everything read so far and
+ * spool_rewind() makes it available again. Committed positions are stored in
+ * the segments, so the contents survive a restart. A spool does not do any
+ * locking.
+ */
+struct spool_s;
+typedef struct spool_s spool_t;
+
+#define SPOOL_SEGMENT_SIZE (4 * 1024 * 1024)
+
+/*
+ * NAME
+ *   spool_open
+ *
+ * DESCRIPTION
+ *   Opens the spool called `name' in the directory `dir', picking up segments
+ *   left by an earlier run. At most `size_limit' bytes are used on disk, but
+ *   at least two segments.
+ *
+ * RETURN VALUE
+ *   The spool or NULL upon failure.
+ */
+spool_t *spool_open(char const *dir, char const *name, uint64_t size_limit);
+
+/*
+ * NAME
+ *   spool_close
+ *
+ * DESCRIPTION
+ *   Unmaps the segments and frees the spool. Value lists that have not been
+ *   committed stay on disk.
+ */
+void spool_close(spool_t *s);
+
+/*
+ * NAME
+ *   spool_append
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOSPC if the size limit has been reached and another
+ *   errno value upon failure.
+ */
+int spool_append(spool_t *s, data_set_t const *ds, value_list_t const *vl);
+
+/*
+ * NAME
+ *   spool_read
+ *
+ * DESCRIPTION
+ *   Decodes the next value list into `vl'. `vl->values' is set to `values',
+ *   which has room for `values_size' values. The strings are copied into `vl'.
+ *   Value lists that cannot be decoded are skipped.
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOENT if no more value lists can be read before
+ *   spool_commit() is called.
+ */
+int spool_read(spool_t *s, value_list_t *vl, value_t *values,
+               size_t values_size);
+
+/*
+ * NAME
+ *   spool_commit, spool_rewind
+ *
+ * DESCRIPTION
+ *   spool_commit() removes the value lists returned by spool_read() since the
+ *   last call of either function. spool_rewind() lets spool_read() return
+ *   them again.
+ */
+void spool_commit(spool_t *s);
+void spool_rewind(spool_t *s);
+
+/*
+ * NAME
+ *   spool_empty
+ *
+ * RETURN VALUE
+ *   True if nothing has been appended that has not been committed.
+ */
+bool spool_empty(spool_t const *s);
+
+/*
+ * NAME
+ *   spool_size
+ *
+ * RETURN VALUE
+ *   The number of bytes on disk used by the value lists that have not been
+ *   committed.
+ */
+uint64_t spool_size(spool_t const *s);
+
+#endif /* UTILS_SPOOL_H */
@@ -0,0 +1,194 @@
+/**
+ * collectd - src/daemon/utils_spool_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+#include "utils/common/common.h"
+
+#include "testing.h"
+#include "utils_spool.h"
+
+static data_source_t dsrc[] = {
+    {"value", DS_TYPE_DERIVE, 0, NAN},
+    {"ratio", DS_TYPE_GAUGE, 0, NAN},
+};
+static data_set_t ds = {"test", STATIC_ARRAY_SIZE(dsrc), dsrc};
+
+static char dir[64];
+
+static void make_vl(value_list_t *vl, value_t *values, uint64_t i) {
+  *vl = (value_list_t){
+      .values = values,
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T(1500000000) + i,
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "test",
+  };
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "%" PRIu64, i);
+  values[0].derive = (derive_t)i;
+  values[1].gauge = (gauge_t)i / 2.0;
+}
+
+/* Reads the next value list and checks that it is the i-th one. */
+static int check_read(spool_t *s, uint64_t i) {
+  value_list_t vl;
+  value_t values[4];
+  EXPECT_EQ_INT(0, spool_read(s, &vl, values, STATIC_ARRAY_SIZE(values)));
+
+  value_list_t want;
+  value_t want_values[2];
+  make_vl(&want, want_values, i);
+
+  EXPECT_EQ_STR(want.host, vl.host);
+  EXPECT_EQ_STR(want.plugin, vl.plugin);
+  EXPECT_EQ_STR("", vl.plugin_instance);
+  EXPECT_EQ_STR(want.type_instance, vl.type_instance);
+  EXPECT_EQ_UINT64(want.time, vl.time);
+  EXPECT_EQ_UINT64(want.interval, vl.interval);
+  EXPECT_EQ_INT(2, (int)vl.values_len);
+  EXPECT_EQ_UINT64((uint64_t)want_values[0].derive, (uint64_t)values[0].derive);
+  EXPECT_EQ_DOUBLE(want_values[1].gauge, values[1].gauge);
+  return 0;
+}
+
+static int count_segments(void) {
+  DIR *dh = opendir(dir);
+  if (dh == NULL)
+    return -1;
+
+  int num = 0;
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL)
+    if (strncmp("test_spool.spool.", de->d_name, 17) == 0)
+      num++;
+  closedir(dh);
+  return num;
+}
+
+DEF_TEST(read_commit_rewind) {
+  spool_t *s;
+  CHECK_NOT_NULL(s = spool_open(dir, "test/spool", 0));
+  OK(spool_empty(s));
+
+  value_list_t vl;
+  value_t values[2];
+  for (uint64_t i = 0; i < 10; i++) {
+    make_vl(&vl, values, i);
+    EXPECT_EQ_INT(0, spool_append(s, &ds, &vl));
+  }
+  OK(!spool_empty(s));
+
+  for (uint64_t i = 0; i < 5; i++)
+    CHECK_ZERO(check_read(s, i));
+  spool_rewind(s);
+  for (uint64_t i = 0; i < 5; i++)
+    CHECK_ZERO(check_read(s, i));
+  spool_commit(s);
+
+  /* Value lists not matching the data set are rejected. */
+  vl.values_len = 1;
+  EXPECT_EQ_INT(EINVAL, spool_append(s, &ds, &vl));
+
+  /* Reopening keeps what has not been committed. */
+  spool_close(s);
+  CHECK_NOT_NULL(s = spool_open(dir, "test/spool", 0));
+  OK(!spool_empty(s));
+  for (uint64_t i = 5; i < 10; i++)
+    CHECK_ZERO(check_read(s, i));
+  EXPECT_EQ_INT(ENOENT, spool_read(s, &vl, values, 2));
+  spool_commit(s);
+  OK(spool_empty(s));
+  EXPECT_EQ_UINT64(0, spool_size(s));
+
+  spool_close(s);
+  return 0;
+}
+
+DEF_TEST(segments) {
+  spool_t *s;
+  CHECK_NOT_NULL(s = spool_open(dir, "test/spool", 0));
+
+  /* The size limit allows two segments. */
+  value_list_t vl;
+  value_t values[2];
+  uint64_t num = 0;
+  int status;
+  make_vl(&vl, values, num);
+  while ((status = spool_append(s, &ds, &vl)) == 0)
+    make_vl(&vl, values, ++num);
+  EXPECT_EQ_INT(ENOSPC, status);
+  EXPECT_EQ_INT(2, count_segments());
+  OK(spool_size(s) > SPOOL_SEGMENT_SIZE);
+
+  /* Reading stops at the end of the first segment until it is committed. */
+  uint64_t i = 0;
+  for (; spool_read(s, &vl, values, 2) == 0; i++)
+    ;
+  OK(i > 0);
+  OK(i < num);
+  spool_commit(s);
+  EXPECT_EQ_INT(1, count_segments());
+
+  /* New value lists go to a new segment. */
+  make_vl(&vl, values, 0);
+  EXPECT_EQ_INT(0, spool_append(s, &ds, &vl));
+  EXPECT_EQ_INT(2, count_segments());
+
+  while (spool_read(s, &vl, values, 2) == 0)
+    i++;
+  spool_commit(s);
+  while (spool_read(s, &vl, values, 2) == 0)
+    i++;
+  spool_commit(s);
+  EXPECT_EQ_UINT64(num + 1, i);
+  OK(spool_empty(s));
+  EXPECT_EQ_INT(1, count_segments());
+
+  spool_close(s);
+  return 0;
+}
+
+int main(void) {
+  sstrncpy(dir, "/tmp/utils_spool_test.XXXXXX", sizeof(dir));
+  if (mkdtemp(dir) == NULL)
+    return 1;
+
+  RUN_TEST(read_commit_rewind);
+  RUN_TEST(segments);
+
+  char path[PATH_MAX];
+  DIR *dh = opendir(dir);
+  struct dirent *de;
+  while ((dh != NULL) && ((de = readdir(dh)) != NULL)) {
+    if (de->d_name[0] == '.')
+      continue;
+    ssnprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    unlink(path);
+  }
+  if (dh != NULL)
+    closedir(dh);
+  rmdir(dir);
+
+  END_TEST;
+}
@@ -28,6 +28,7 @@
 
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils_cache.h"
 #include "utils_threshold.h"
 
 #include <pthread.h>
@@ -37,6 +38,7 @@
  * {{{ */
 c_avl_tree_t *threshold_tree = NULL;
 pthread_mutex_t threshold_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned int threshold_generation = 0;
 /* }}} */
 
 /*
@@ -111,6 +113,32 @@ threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
   return NULL;
 } /* }}} threshold_t *threshold_search */
 
+/*
+ * threshold_t *threshold_lookup
+ *
+ * Like "threshold_search", but the result, including "no threshold", is bound
+ * to the value's cache entry. Subsequent calls for the same series only look
+ * at the cache entry until "threshold_generation" changes.
+ */
+threshold_t *threshold_lookup(const value_list_t *vl) { /* {{{ */
+  unsigned int generation =
+      __atomic_load_n(&threshold_generation, __ATOMIC_ACQUIRE);
+  void *th = NULL;
+
+  if (uc_get_threshold(vl, generation, &th) == 0)
+    return th;
+
+  pthread_mutex_lock(&threshold_lock);
+  th = threshold_search(vl);
+  pthread_mutex_unlock(&threshold_lock);
+
+  /* Fails if the value is not cached, in which case it is looked up again
+   * next time. */
+  uc_set_threshold(vl, generation, th);
+
+  return th;
+} /* }}} threshold_t *threshold_lookup */
+
 int ut_search_threshold(const value_list_t *vl, /* {{{ */
                         threshold_t *ret_threshold) {
   threshold_t *t;
@@ -51,12 +51,16 @@ typedef struct threshold_s {
 
 extern c_avl_tree_t *threshold_tree;
 extern pthread_mutex_t threshold_lock;
+/* Incremented whenever a threshold is added. Thresholds bound to cache entries
+ * by threshold_lookup() are only used while the generation is unchanged. */
+extern unsigned int threshold_generation;
 
 threshold_t *threshold_get(const char *hostname, const char *plugin,
                            const char *plugin_instance, const char *type,
                            const char *type_instance);
 
 threshold_t *threshold_search(const value_list_t *vl);
+threshold_t *threshold_lookup(const value_list_t *vl);
 
 int ut_search_threshold(const value_list_t *vl, threshold_t *ret_threshold);
 
@@ -38,6 +38,7 @@
 cdtime_t cdtime_mock = (cdtime_t)MOCK_TIME;
 
 cdtime_t cdtime(void) { return cdtime_mock; }
+cdtime_t cdtime_coarse(void) { return cdtime_mock; }
 #else /* !MOCK_TIME */
 #if HAVE_CLOCK_GETTIME
 cdtime_t cdtime(void) /* {{{ */
@@ -69,6 +70,38 @@ cdtime_t cdtime(void) /* {{{ */
   return TIMEVAL_TO_CDTIME_T(&tv);
 } /* }}} cdtime_t cdtime */
 #endif
+
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_REALTIME_COARSE)
+/* The coarse clock is only used if it ticks at least this often. */
+#define COARSE_MAX_RESOLUTION_NS 10000000 /* 10 ms */
+
+static pthread_once_t coarse_once = PTHREAD_ONCE_INIT;
+static bool coarse_usable;
+
+static void coarse_init(void) /* {{{ */
+{
+  struct timespec res = {0, 0};
+
+  coarse_usable = (clock_getres(CLOCK_REALTIME_COARSE, &res) == 0) &&
+                  (res.tv_sec == 0) &&
+                  (res.tv_nsec <= COARSE_MAX_RESOLUTION_NS);
+} /* }}} void coarse_init */
+
+cdtime_t cdtime_coarse(void) /* {{{ */
+{
+  pthread_once(&coarse_once, coarse_init);
+  if (!coarse_usable)
+    return cdtime();
+
+  struct timespec ts = {0, 0};
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) != 0)
+    return cdtime();
+
+  return TIMESPEC_TO_CDTIME_T(&ts);
+} /* }}} cdtime_t cdtime_coarse */
+#else
+cdtime_t cdtime_coarse(void) { return cdtime(); }
+#endif
 #endif
 
 /**********************************************************************
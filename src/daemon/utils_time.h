@@ -110,6 +110,13 @@ extern cdtime_t cdtime_mock;
 
 cdtime_t cdtime(void);
 
+/* cdtime_coarse returns the current time like cdtime(), but only with the
+ * resolution of the kernel's timer tick (a few milliseconds). Reading it is
+ * considerably cheaper, so it is meant for timestamps that are only compared
+ * against timeouts and intervals. Where no coarse clock is available, this is
+ * the same as cdtime(). */
+cdtime_t cdtime_coarse(void);
+
 #define RFC3339_SIZE 26     /* 2006-01-02T15:04:05+00:00 */
 #define RFC3339NANO_SIZE 36 /* 2006-01-02T15:04:05.999999999+00:00 */
 
@@ -0,0 +1,83 @@
+/**
+ * collectd - src/daemon/utils_time_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Compares the cost of cdtime() and cdtime_coarse() and reports the
+ * resolution cdtime_coarse() actually has. utils_time_test.c is built with a
+ * mocked clock, so this lives in a separate program.
+ *
+ * Usage: bench_utils_time [<calls>]
+ */
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void bench(char const *name, cdtime_t (*func)(void), size_t calls_num) {
+  /* Summing the results keeps the calls from being optimized away. */
+  cdtime_t sum = 0;
+  double start = now();
+  for (size_t i = 0; i < calls_num; i++)
+    sum += func();
+  double elapsed = now() - start;
+
+  printf("%-14s %8.1f ns/call (checksum %" PRIu64 ")\n", name,
+         1e9 * elapsed / (double)calls_num, (uint64_t)(sum & 0xffff));
+}
+
+/* Returns the smallest step between two different return values. */
+static cdtime_t resolution(cdtime_t (*func)(void)) {
+  cdtime_t min = 0;
+  for (int i = 0; i < 10; i++) {
+    cdtime_t t0 = func();
+    cdtime_t t1;
+    while ((t1 = func()) == t0)
+      ;
+    if ((min == 0) || (t1 - t0 < min))
+      min = t1 - t0;
+  }
+  return min;
+}
+
+int main(int argc, char **argv) {
+  size_t calls_num =
+      (argc > 1) ? (size_t)strtoull(argv[1], NULL, 0) : 10000000;
+  if (calls_num == 0) {
+    fprintf(stderr, "Usage: %s [<calls>]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%zu calls\n", calls_num);
+  bench("cdtime", cdtime, calls_num);
+  bench("cdtime_coarse", cdtime_coarse, calls_num);
+
+  printf("resolution     %8.3f ms (cdtime_coarse)\n",
+         1000.0 * CDTIME_T_TO_DOUBLE(resolution(cdtime_coarse)));
+  return 0;
+}
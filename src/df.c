@@ -24,15 +24,24 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
 
+#include <pthread.h>
+
+#if KERNEL_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
 #if HAVE_STATVFS
 #if HAVE_SYS_STATVFS_H
 #include <sys/statvfs.h>
 #endif
 #define STATANYFS statvfs
+#define STATANYFS_T struct statvfs
 #define STATANYFS_STR "statvfs"
 #define BLOCKSIZE(s) ((s).f_frsize ? (s).f_frsize : (s).f_bsize)
 #elif HAVE_STATFS
@@ -40,6 +49,7 @@
 #include <sys/statfs.h>
 #endif
 #define STATANYFS statfs
+#define STATANYFS_T struct statfs
 #define STATANYFS_STR "statfs"
 #define BLOCKSIZE(s) (s).f_bsize
 #else
@@ -49,7 +59,8 @@
 static const char *config_keys[] = {
     "Device",         "MountPoint",       "FSType",
     "IgnoreSelected", "ReportByDevice",   "ReportInodes",
-    "ValuesAbsolute", "ValuesPercentage", "LogOnce"};
+    "ValuesAbsolute", "ValuesPercentage", "LogOnce",
+    "StatThreads",    "StatTimeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_device;
@@ -62,6 +73,50 @@ static bool report_inodes;
 static bool values_absolute = true;
 static bool values_percentage;
 static bool log_once;
+static int stat_threads = 4;
+static cdtime_t stat_timeout; /* 0: use the read interval */
+
+/* A mount point to report, after filtering and removing duplicates. The
+ * entries are kept across reads and only rebuilt when the mount table
+ * changes. */
+typedef struct df_mount_s {
+  char *dir;
+  char *dev;
+  char disk_name[256];
+  bool reused; /* used by df_mounts_refresh() only */
+
+  /* Protected by df_lock. */
+  bool busy;      /* queued or being stat'ed by a worker */
+  bool orphaned;  /* removed from df_mounts while busy; freed by the worker */
+  bool timed_out; /* the timeout has been logged */
+  uint64_t req_gen;
+  uint64_t done_gen;
+  int status;
+  int errnum;
+  STATANYFS_T statbuf;
+  struct df_mount_s *queue_next;
+} df_mount_t;
+
+static df_mount_t **df_mounts;
+static df_mount_t **df_results;
+static size_t df_mounts_num;
+static bool df_mounts_valid;
+
+#if KERNEL_LINUX
+/* The kernel signals changes of the mount table with POLLPRI on this file. */
+static int df_mounts_fd = -1;
+#endif
+
+static pthread_mutex_t df_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t df_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t df_done_cond = PTHREAD_COND_INITIALIZER;
+static df_mount_t *df_queue_head;
+static df_mount_t *df_queue_tail;
+static uint64_t df_gen;
+static size_t df_pending;
+static int df_workers_num;
+static bool df_workers_started;
+static bool df_stopping;
 
 static int df_init(void) {
   if (il_device == NULL)
@@ -135,6 +190,22 @@ static int df_config(const char *key, const char *value) {
       log_once = false;
 
     return 0;
+  } else if (strcasecmp(key, "StatThreads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("df plugin: StatThreads must be at least 1.");
+      return 1;
+    }
+    stat_threads = tmp;
+    return 0;
+  } else if (strcasecmp(key, "StatTimeout") == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR("df plugin: StatTimeout must not be negative.");
+      return 1;
+    }
+    stat_timeout = DOUBLE_TO_CDTIME_T(tmp);
+    return 0;
   }
 
   return -1;
@@ -158,30 +229,167 @@ __attribute__((nonnull(2))) static void df_submit_one(char *plugin_instance,
   plugin_dispatch_values(&vl);
 } /* void df_submit_one */
 
-static int df_read(void) {
-#if HAVE_STATVFS
-  struct statvfs statbuf;
-#elif HAVE_STATFS
-  struct statfs statbuf;
+static void df_mount_free(df_mount_t *m) /* {{{ */
+{
+  if (m == NULL)
+    return;
+
+  sfree(m->dir);
+  sfree(m->dev);
+  sfree(m);
+} /* }}} void df_mount_free */
+
+/* Releases an entry that is no longer part of df_mounts. Must be called with
+ * df_lock held. */
+static void df_mount_release(df_mount_t *m) /* {{{ */
+{
+  if (m->busy)
+    m->orphaned = true;
+  else
+    df_mount_free(m);
+} /* }}} void df_mount_release */
+
+static void *df_worker(__attribute__((unused)) void *arg) /* {{{ */
+{
+  pthread_mutex_lock(&df_lock);
+  while (!df_stopping) {
+    if (df_queue_head == NULL) {
+      pthread_cond_wait(&df_work_cond, &df_lock);
+      continue;
+    }
+
+    df_mount_t *m = df_queue_head;
+    df_queue_head = m->queue_next;
+    if (df_queue_head == NULL)
+      df_queue_tail = NULL;
+    m->queue_next = NULL;
+    pthread_mutex_unlock(&df_lock);
+
+    /* This may block for a long time, e.g. on an unresponsive NFS server. */
+    STATANYFS_T statbuf = {0};
+    int status = STATANYFS(m->dir, &statbuf);
+    int errnum = (status != 0) ? errno : 0;
+
+    pthread_mutex_lock(&df_lock);
+    m->busy = false;
+    if (m->orphaned) {
+      df_mount_free(m);
+      continue;
+    }
+
+    m->status = status;
+    m->errnum = errnum;
+    m->statbuf = statbuf;
+    m->done_gen = m->req_gen;
+
+    if ((m->req_gen == df_gen) && (df_pending > 0)) {
+      df_pending--;
+      if (df_pending == 0)
+        pthread_cond_broadcast(&df_done_cond);
+    }
+  }
+
+  df_workers_num--;
+  pthread_cond_broadcast(&df_done_cond);
+  pthread_mutex_unlock(&df_lock);
+  return NULL;
+} /* }}} void *df_worker */
+
+static int df_workers_start(void) /* {{{ */
+{
+  if (df_workers_started)
+    return 0;
+  df_workers_started = true;
+
+  for (int i = 0; i < stat_threads; i++) {
+    pthread_t tid;
+    int status = plugin_thread_create(&tid, df_worker, NULL, "df stat");
+    if (status != 0) {
+      ERROR("df plugin: plugin_thread_create failed: %s", STRERROR(status));
+      break;
+    }
+    /* Workers may be stuck in statvfs(2) forever, so they are never joined. */
+    pthread_detach(tid);
+
+    pthread_mutex_lock(&df_lock);
+    df_workers_num++;
+    pthread_mutex_unlock(&df_lock);
+  }
+
+  if (df_workers_num == 0)
+    return -1;
+
+  return 0;
+} /* }}} int df_workers_start */
+
+/* Returns true if the mount table needs to be read (again). */
+static bool df_mounts_changed(void) /* {{{ */
+{
+  if (!df_mounts_valid)
+    return true;
+
+#if KERNEL_LINUX
+  if (df_mounts_fd < 0)
+    return true;
+
+  struct pollfd pfd = {.fd = df_mounts_fd, .events = POLLPRI};
+  if (poll(&pfd, 1, /* timeout = */ 0) < 0)
+    return true;
+
+  return (pfd.revents & (POLLPRI | POLLERR)) != 0;
+#else
+  return true;
+#endif
+} /* }}} bool df_mounts_changed */
+
+static int df_mounts_refresh(void) /* {{{ */
+{
+  cu_mount_t *mnt_list = NULL;
+
+#if KERNEL_LINUX
+  /* Open the file before reading the mount table, so that no change can go
+   * unnoticed. */
+  if (df_mounts_fd < 0) {
+    df_mounts_fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+    if (df_mounts_fd < 0)
+      WARNING("df plugin: open(/proc/self/mounts) failed: %s", STRERRNO);
+  }
 #endif
-  int retval = 0;
-  /* struct STATANYFS statbuf; */
-  cu_mount_t *mnt_list;
 
-  mnt_list = NULL;
   if (cu_mount_getlist(&mnt_list) == NULL) {
     ERROR("df plugin: cu_mount_getlist failed.");
     return -1;
   }
 
+  size_t mnt_num = 0;
+  for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL; mnt_ptr = mnt_ptr->next)
+    mnt_num++;
+
+  df_mount_t **mounts = calloc(mnt_num, sizeof(*mounts));
+  df_mount_t **results = calloc(mnt_num, sizeof(*results));
+  c_avl_tree_t *old = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((mounts == NULL) || (results == NULL) || (old == NULL)) {
+    ERROR("df plugin: allocating the mount list failed.");
+    sfree(mounts);
+    sfree(results);
+    if (old != NULL)
+      c_avl_destroy(old);
+    cu_mount_freelist(mnt_list);
+    return ENOMEM;
+  }
+
+  /* Entries are reused by mount point, so that a mount which is still being
+   * stat'ed is not queued a second time. */
+  for (size_t i = 0; i < df_mounts_num; i++) {
+    df_mounts[i]->reused = false;
+    c_avl_insert(old, df_mounts[i]->dir, df_mounts[i]);
+  }
+
+  size_t num = 0;
   for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
        mnt_ptr = mnt_ptr->next) {
-    unsigned long long blocksize;
     char disk_name[256];
     cu_mount_t *dup_ptr;
-    uint64_t blk_free;
-    uint64_t blk_reserved;
-    uint64_t blk_used;
 
     char const *dev =
         (mnt_ptr->spec_device != NULL) ? mnt_ptr->spec_device : mnt_ptr->device;
@@ -214,23 +422,6 @@ static int df_read(void) {
     if (dup_ptr != NULL)
       continue;
 
-    if (STATANYFS(mnt_ptr->dir, &statbuf) < 0) {
-      if (log_once == false || ignorelist_match(il_errors, mnt_ptr->dir) == 0) {
-        if (log_once == true) {
-          ignorelist_add(il_errors, mnt_ptr->dir);
-        }
-        ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir, STRERRNO);
-      }
-      continue;
-    } else {
-      if (log_once == true) {
-        ignorelist_remove(il_errors, mnt_ptr->dir);
-      }
-    }
-
-    if (!statbuf.f_blocks)
-      continue;
-
     if (by_device) {
       /* eg, /dev/hda1  -- strip off the "/dev/" */
       if (strncmp(dev, "/dev/", strlen("/dev/")) == 0)
@@ -255,7 +446,79 @@ static int df_read(void) {
       }
     }
 
-    blocksize = BLOCKSIZE(statbuf);
+    df_mount_t *m = NULL;
+    if ((c_avl_get(old, mnt_ptr->dir, (void *)&m) == 0) &&
+        (strcmp(m->dev, dev) == 0)) {
+      c_avl_remove(old, mnt_ptr->dir, NULL, NULL);
+      m->reused = true;
+    } else {
+      m = calloc(1, sizeof(*m));
+      if (m == NULL) {
+        ERROR("df plugin: calloc failed.");
+        continue;
+      }
+      m->dir = strdup(mnt_ptr->dir);
+      m->dev = strdup(dev);
+      if ((m->dir == NULL) || (m->dev == NULL)) {
+        ERROR("df plugin: strdup failed.");
+        df_mount_free(m);
+        continue;
+      }
+    }
+
+    sstrncpy(m->disk_name, disk_name, sizeof(m->disk_name));
+    mounts[num] = m;
+    num++;
+  }
+
+  cu_mount_freelist(mnt_list);
+
+  pthread_mutex_lock(&df_lock);
+  for (size_t i = 0; i < df_mounts_num; i++)
+    if (!df_mounts[i]->reused)
+      df_mount_release(df_mounts[i]);
+  pthread_mutex_unlock(&df_lock);
+
+  c_avl_destroy(old);
+  sfree(df_mounts);
+  sfree(df_results);
+  df_mounts = mounts;
+  df_results = results;
+  df_mounts_num = num;
+  df_mounts_valid = true;
+
+  return 0;
+} /* }}} int df_mounts_refresh */
+
+/* Dispatches the metrics of one file system. Returns -1 if the percentages
+ * could not be calculated, zero otherwise. */
+static int df_submit_mount(df_mount_t *m) /* {{{ */
+{
+  STATANYFS_T statbuf = m->statbuf;
+  char *disk_name = m->disk_name;
+  unsigned long long blocksize;
+  uint64_t blk_free;
+  uint64_t blk_reserved;
+  uint64_t blk_used;
+
+  if (m->status < 0) {
+    if (log_once == false || ignorelist_match(il_errors, m->dir) == 0) {
+      if (log_once == true) {
+        ignorelist_add(il_errors, m->dir);
+      }
+      ERROR(STATANYFS_STR "(%s) failed: %s", m->dir, STRERROR(m->errnum));
+    }
+    return 0;
+  } else {
+    if (log_once == true) {
+      ignorelist_remove(il_errors, m->dir);
+    }
+  }
+
+  if (!statbuf.f_blocks)
+    return 0;
+
+  blocksize = BLOCKSIZE(statbuf);
 
 /*
  * Sanity-check for the values in the struct
@@ -264,98 +527,201 @@ static int df_read(void) {
  * report negative free space for user. Notice. blk_reserved
  * will start to diminish after this. */
 #if HAVE_STATVFS
-    /* Cast and temporary variable are needed to avoid
-     * compiler warnings.
-     * ((struct statvfs).f_bavail is unsigned (POSIX)) */
-    int64_t signed_bavail = (int64_t)statbuf.f_bavail;
-    if (signed_bavail < 0)
-      statbuf.f_bavail = 0;
+  /* Cast and temporary variable are needed to avoid
+   * compiler warnings.
+   * ((struct statvfs).f_bavail is unsigned (POSIX)) */
+  int64_t signed_bavail = (int64_t)statbuf.f_bavail;
+  if (signed_bavail < 0)
+    statbuf.f_bavail = 0;
 #elif HAVE_STATFS
-    if (statbuf.f_bavail < 0)
-      statbuf.f_bavail = 0;
+  if (statbuf.f_bavail < 0)
+    statbuf.f_bavail = 0;
 #endif
-    /* Make sure that f_blocks >= f_bfree >= f_bavail */
-    if (statbuf.f_bfree < statbuf.f_bavail)
-      statbuf.f_bfree = statbuf.f_bavail;
-    if (statbuf.f_blocks < statbuf.f_bfree)
-      statbuf.f_blocks = statbuf.f_bfree;
-
-    blk_free = (uint64_t)statbuf.f_bavail;
-    blk_reserved = (uint64_t)(statbuf.f_bfree - statbuf.f_bavail);
-    blk_used = (uint64_t)(statbuf.f_blocks - statbuf.f_bfree);
+  /* Make sure that f_blocks >= f_bfree >= f_bavail */
+  if (statbuf.f_bfree < statbuf.f_bavail)
+    statbuf.f_bfree = statbuf.f_bavail;
+  if (statbuf.f_blocks < statbuf.f_bfree)
+    statbuf.f_blocks = statbuf.f_bfree;
+
+  blk_free = (uint64_t)statbuf.f_bavail;
+  blk_reserved = (uint64_t)(statbuf.f_bfree - statbuf.f_bavail);
+  blk_used = (uint64_t)(statbuf.f_blocks - statbuf.f_bfree);
+
+  if (values_absolute) {
+    df_submit_one(disk_name, "df_complex", "free",
+                  (gauge_t)(blk_free * blocksize));
+    df_submit_one(disk_name, "df_complex", "reserved",
+                  (gauge_t)(blk_reserved * blocksize));
+    df_submit_one(disk_name, "df_complex", "used",
+                  (gauge_t)(blk_used * blocksize));
+  }
 
-    if (values_absolute) {
-      df_submit_one(disk_name, "df_complex", "free",
-                    (gauge_t)(blk_free * blocksize));
-      df_submit_one(disk_name, "df_complex", "reserved",
-                    (gauge_t)(blk_reserved * blocksize));
-      df_submit_one(disk_name, "df_complex", "used",
-                    (gauge_t)(blk_used * blocksize));
+  if (values_percentage) {
+    if (statbuf.f_blocks > 0) {
+      df_submit_one(disk_name, "percent_bytes", "free",
+                    (gauge_t)((float_t)(blk_free) / statbuf.f_blocks * 100));
+      df_submit_one(
+          disk_name, "percent_bytes", "reserved",
+          (gauge_t)((float_t)(blk_reserved) / statbuf.f_blocks * 100));
+      df_submit_one(disk_name, "percent_bytes", "used",
+                    (gauge_t)((float_t)(blk_used) / statbuf.f_blocks * 100));
+    } else {
+      return -1;
     }
+  }
+
+  /* inode handling */
+  if (report_inodes && statbuf.f_files != 0 && statbuf.f_ffree != 0) {
+    uint64_t inode_free;
+    uint64_t inode_reserved;
+    uint64_t inode_used;
+
+    /* Sanity-check for the values in the struct */
+    if (statbuf.f_ffree < statbuf.f_favail)
+      statbuf.f_ffree = statbuf.f_favail;
+    if (statbuf.f_files < statbuf.f_ffree)
+      statbuf.f_files = statbuf.f_ffree;
+
+    inode_free = (uint64_t)statbuf.f_favail;
+    inode_reserved = (uint64_t)(statbuf.f_ffree - statbuf.f_favail);
+    inode_used = (uint64_t)(statbuf.f_files - statbuf.f_ffree);
 
     if (values_percentage) {
-      if (statbuf.f_blocks > 0) {
-        df_submit_one(disk_name, "percent_bytes", "free",
-                      (gauge_t)((float_t)(blk_free) / statbuf.f_blocks * 100));
+      if (statbuf.f_files > 0) {
+        df_submit_one(disk_name, "percent_inodes", "free",
+                      (gauge_t)((float_t)(inode_free) / statbuf.f_files * 100));
         df_submit_one(
-            disk_name, "percent_bytes", "reserved",
-            (gauge_t)((float_t)(blk_reserved) / statbuf.f_blocks * 100));
-        df_submit_one(disk_name, "percent_bytes", "used",
-                      (gauge_t)((float_t)(blk_used) / statbuf.f_blocks * 100));
+            disk_name, "percent_inodes", "reserved",
+            (gauge_t)((float_t)(inode_reserved) / statbuf.f_files * 100));
+        df_submit_one(disk_name, "percent_inodes", "used",
+                      (gauge_t)((float_t)(inode_used) / statbuf.f_files * 100));
       } else {
-        retval = -1;
-        break;
+        return -1;
       }
     }
-
-    /* inode handling */
-    if (report_inodes && statbuf.f_files != 0 && statbuf.f_ffree != 0) {
-      uint64_t inode_free;
-      uint64_t inode_reserved;
-      uint64_t inode_used;
-
-      /* Sanity-check for the values in the struct */
-      if (statbuf.f_ffree < statbuf.f_favail)
-        statbuf.f_ffree = statbuf.f_favail;
-      if (statbuf.f_files < statbuf.f_ffree)
-        statbuf.f_files = statbuf.f_ffree;
-
-      inode_free = (uint64_t)statbuf.f_favail;
-      inode_reserved = (uint64_t)(statbuf.f_ffree - statbuf.f_favail);
-      inode_used = (uint64_t)(statbuf.f_files - statbuf.f_ffree);
-
-      if (values_percentage) {
-        if (statbuf.f_files > 0) {
-          df_submit_one(
-              disk_name, "percent_inodes", "free",
-              (gauge_t)((float_t)(inode_free) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "reserved",
-              (gauge_t)((float_t)(inode_reserved) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "used",
-              (gauge_t)((float_t)(inode_used) / statbuf.f_files * 100));
-        } else {
-          retval = -1;
-          break;
-        }
-      }
-      if (values_absolute) {
-        df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
-        df_submit_one(disk_name, "df_inodes", "reserved",
-                      (gauge_t)inode_reserved);
-        df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
-      }
+    if (values_absolute) {
+      df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
+      df_submit_one(disk_name, "df_inodes", "reserved",
+                    (gauge_t)inode_reserved);
+      df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
     }
   }
 
-  cu_mount_freelist(mnt_list);
+  return 0;
+} /* }}} int df_submit_mount */
+
+static int df_read(void) {
+  int retval = 0;
+
+  if (df_workers_start() != 0)
+    return -1;
+
+  if (df_mounts_changed()) {
+    int status = df_mounts_refresh();
+    if (status != 0)
+      return -1;
+  }
+
+  cdtime_t timeout = (stat_timeout != 0) ? stat_timeout : plugin_get_interval();
+  struct timespec deadline = CDTIME_T_TO_TIMESPEC(cdtime() + timeout);
+  size_t results_num = 0;
+
+  pthread_mutex_lock(&df_lock);
+  df_gen++;
+  df_pending = 0;
+
+  /* Queue all mounts that are not still busy with an earlier request. */
+  for (size_t i = 0; i < df_mounts_num; i++) {
+    df_mount_t *m = df_mounts[i];
+
+    if (m->busy)
+      continue;
+
+    m->busy = true;
+    m->req_gen = df_gen;
+    if (df_queue_tail == NULL)
+      df_queue_head = m;
+    else
+      df_queue_tail->queue_next = m;
+    df_queue_tail = m;
+    df_pending++;
+  }
+  pthread_cond_broadcast(&df_work_cond);
+
+  while (df_pending > 0) {
+    if (pthread_cond_timedwait(&df_done_cond, &df_lock, &deadline) ==
+        ETIMEDOUT)
+      break;
+  }
+
+  for (size_t i = 0; i < df_mounts_num; i++) {
+    df_mount_t *m = df_mounts[i];
+
+    if (m->busy) {
+      if (!m->timed_out)
+        WARNING("df plugin: " STATANYFS_STR "(%s) did not return within "
+                "%.3f seconds. Skipping it until it does.",
+                m->dir, CDTIME_T_TO_DOUBLE(timeout));
+      m->timed_out = true;
+      continue;
+    }
+
+    if (m->done_gen != df_gen)
+      continue;
+
+    m->timed_out = false;
+    df_results[results_num] = m;
+    results_num++;
+  }
+  pthread_mutex_unlock(&df_lock);
+
+  /* Workers don't touch entries that are not busy, so the results can be read
+   * without holding the lock. */
+  for (size_t i = 0; i < results_num; i++) {
+    if (df_submit_mount(df_results[i]) != 0) {
+      retval = -1;
+      break;
+    }
+  }
 
   return retval;
 } /* int df_read */
 
+static int df_shutdown(void) /* {{{ */
+{
+  pthread_mutex_lock(&df_lock);
+  df_stopping = true;
+  pthread_cond_broadcast(&df_work_cond);
+
+  /* Entries still in the queue are not being worked on. */
+  for (df_mount_t *m = df_queue_head; m != NULL; m = m->queue_next)
+    m->busy = false;
+  df_queue_head = NULL;
+  df_queue_tail = NULL;
+
+  /* Workers stuck in statvfs(2) free their entry once they return. */
+  for (size_t i = 0; i < df_mounts_num; i++)
+    df_mount_release(df_mounts[i]);
+  pthread_mutex_unlock(&df_lock);
+
+  sfree(df_mounts);
+  sfree(df_results);
+  df_mounts_num = 0;
+  df_mounts_valid = false;
+
+#if KERNEL_LINUX
+  if (df_mounts_fd >= 0) {
+    close(df_mounts_fd);
+    df_mounts_fd = -1;
+  }
+#endif
+
+  return 0;
+} /* }}} int df_shutdown */
+
 void module_register(void) {
   plugin_register_config("df", df_config, config_keys, config_keys_num);
   plugin_register_init("df", df_init);
   plugin_register_read("df", df_read);
+  plugin_register_shutdown("df", df_shutdown);
 } /* void module_register */
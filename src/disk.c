@@ -26,6 +26,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/proc_file/proc_file.h"
 
 #if HAVE_MACH_MACH_TYPES_H
 #include <mach/mach_types.h>
@@ -113,6 +114,7 @@ typedef struct diskstats {
 } diskstats_t;
 
 static diskstats_t *disklist;
+static proc_file_t *proc_diskstats;
 /* #endif KERNEL_LINUX */
 #elif KERNEL_FREEBSD
 static struct gmesh geom_tree;
@@ -230,6 +232,14 @@ static int disk_init(void) {
     }
   }
 #endif /* HAVE_LIBUDEV_H */
+
+  if (proc_diskstats == NULL) {
+    proc_diskstats = proc_file_create("/proc/diskstats");
+    if (proc_diskstats == NULL) {
+      ERROR("disk plugin: proc_file_create failed.");
+      return -1;
+    }
+  }
   /* #endif KERNEL_LINUX */
 
 #elif KERNEL_FREEBSD
@@ -300,6 +310,8 @@ static int disk_shutdown(void) {
   if (handle_udev != NULL)
     udev_unref(handle_udev);
 #endif /* HAVE_LIBUDEV_H */
+  proc_file_destroy(proc_diskstats);
+  proc_diskstats = NULL;
 #endif /* KERNEL_LINUX */
   return 0;
 } /* int disk_shutdown */
@@ -717,8 +729,7 @@ static int disk_read(void) {
   geom_stats_snapshot_free(snap);
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
 
   char *fields[32];
   static unsigned int poll_count = 0;
@@ -740,14 +751,14 @@ static int disk_read(void) {
 
   diskstats_t *ds, *pre_ds;
 
-  if ((fh = fopen("/proc/diskstats", "r")) == NULL) {
-    ERROR("disk plugin: fopen(\"/proc/diskstats\"): %s", STRERRNO);
+  if (proc_file_read(proc_diskstats) < 0) {
+    ERROR("disk plugin: reading /proc/diskstats failed: %s", STRERRNO);
     return -1;
   }
 
   poll_count++;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    int numfields = strsplit(buffer, fields, 32);
+  while ((buffer = proc_file_next_line(proc_diskstats)) != NULL) {
+    int numfields = (int)proc_file_split(buffer, fields, 32);
 
     /* need either 7 fields (partition) or at least 14 fields */
     if ((numfields != 7) && (numfields < 14))
@@ -778,28 +789,28 @@ static int disk_read(void) {
     is_disk = 0;
     if (numfields == 7) {
       /* Kernel 2.6, Partition */
-      read_ops = atoll(fields[3]);
-      read_sectors = atoll(fields[4]);
-      write_ops = atoll(fields[5]);
-      write_sectors = atoll(fields[6]);
+      read_ops = proc_atou64(fields[3]);
+      read_sectors = proc_atou64(fields[4]);
+      write_ops = proc_atou64(fields[5]);
+      write_sectors = proc_atou64(fields[6]);
     } else {
       assert(numfields >= 14);
-      read_ops = atoll(fields[3]);
-      write_ops = atoll(fields[7]);
+      read_ops = proc_atou64(fields[3]);
+      write_ops = proc_atou64(fields[7]);
 
-      read_sectors = atoll(fields[5]);
-      write_sectors = atoll(fields[9]);
+      read_sectors = proc_atou64(fields[5]);
+      write_sectors = proc_atou64(fields[9]);
 
       is_disk = 1;
-      read_merged = atoll(fields[4]);
-      read_time = atoll(fields[6]);
-      write_merged = atoll(fields[8]);
-      write_time = atoll(fields[10]);
+      read_merged = proc_atou64(fields[4]);
+      read_time = proc_atou64(fields[6]);
+      write_merged = proc_atou64(fields[8]);
+      write_time = proc_atou64(fields[10]);
 
       in_progress = atof(fields[11]);
 
-      io_time = atof(fields[12]);
-      weighted_time = atof(fields[13]);
+      io_time = proc_atou64(fields[12]);
+      weighted_time = proc_atou64(fields[13]);
     }
 
     {
@@ -939,7 +950,7 @@ static int disk_read(void) {
     /* release udev-based alternate name, if allocated */
     sfree(alt_name);
 #endif
-  } /* while (fgets (buffer, sizeof (buffer), fh) != NULL) */
+  } /* while (proc_file_next_line (proc_diskstats) != NULL) */
 
   /* Remove disks that have disappeared from diskstats */
   for (ds = disklist, pre_ds = disklist; ds != NULL;) {
@@ -963,7 +974,6 @@ static int disk_read(void) {
     free(missing_ds->name);
     free(missing_ds);
   }
-  fclose(fh);
   /* #endif defined(KERNEL_LINUX) */
 
 #elif HAVE_LIBKSTAT
@@ -34,6 +34,10 @@
 
 #include <pcap.h>
 
+#if KERNEL_LINUX
+#include <linux/if_packet.h>
+#endif
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
@@ -48,30 +52,50 @@ struct counter_list_s {
 };
 typedef struct counter_list_s counter_list_t;
 
+/* Query types below this value are counted in an array, the rare larger ones
+ * (e.g. TA and DLV) in a list. */
+#define QTYPE_ARRAY_SIZE 256
+/* Opcode and rcode are four bit fields of the header. */
+#define OPCODE_ARRAY_SIZE 16
+#define RCODE_ARRAY_SIZE 16
+
+/* Each capture thread counts into its own set of counters, so that the
+ * threads don't contend for locks. The lock is only shared with dns_read(),
+ * which merges the counters of all threads. */
+struct dns_thread_s {
+  pthread_t thread;
+  bool thread_started;
+  pcap_t *pcap_obj;
+  unsigned int sample_count;
+
+  pthread_mutex_t lock;
+  derive_t tr_queries;
+  derive_t tr_responses;
+  derive_t qtype[QTYPE_ARRAY_SIZE];
+  counter_list_t *qtype_list;
+  derive_t opcode[OPCODE_ARRAY_SIZE];
+  derive_t rcode[RCODE_ARRAY_SIZE];
+};
+typedef struct dns_thread_s dns_thread_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+                                    "SelectNumericQueryTypes", "Threads",
+                                    "SampleRate"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device;
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static size_t dns_threads_num = 1;
+static unsigned int dns_sample_rate = 1;
 
-static pthread_t listen_thread;
-static int listen_thread_init;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dns_thread_t *dns_threads;
+static pthread_key_t dns_thread_key;
+static bool dns_threads_init;
 
 /*
  * Private functions
@@ -127,6 +151,29 @@ static void counter_list_add(counter_list_t **list, unsigned int key,
   }
 }
 
+static void counter_list_free(counter_list_t *list) {
+  while (list != NULL) {
+    counter_list_t *next = list->next;
+    free(list);
+    list = next;
+  }
+}
+
+static int dns_config_positive(const char *key, const char *value,
+                               unsigned int *ret) {
+  int tmp = atoi(value);
+
+  if (tmp < 1) {
+    ERROR("dns plugin: The `%s' option requires a positive integer, "
+          "got \"%s\".",
+          key, value);
+    return -1;
+  }
+
+  *ret = (unsigned int)tmp;
+  return 0;
+}
+
 static int dns_config(const char *key, const char *value) {
   if (strcasecmp(key, "Interface") == 0) {
     if (pcap_device != NULL)
@@ -141,6 +188,22 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    unsigned int tmp;
+    if (dns_config_positive(key, value, &tmp) != 0)
+      return 1;
+#if !defined(PACKET_FANOUT)
+    if (tmp > 1) {
+      WARNING("dns plugin: Capturing with more than one thread requires "
+              "PACKET_FANOUT, which is not available on this system. "
+              "Using one thread.");
+      tmp = 1;
+    }
+#endif
+    dns_threads_num = (size_t)tmp;
+  } else if (strcasecmp(key, "SampleRate") == 0) {
+    if (dns_config_positive(key, value, &dns_sample_rate) != 0)
+      return 1;
   } else {
     return -1;
   }
@@ -148,43 +211,71 @@ static int dns_config(const char *key, const char *value) {
   return 0;
 }
 
+/* Called by handle_pcap() in the context of a capture thread. When sampling,
+ * every packet stands for `dns_sample_rate' packets. */
 static void dns_child_callback(const rfc1035_header_t *dns) {
+  dns_thread_t *t = pthread_getspecific(dns_thread_key);
+  derive_t weight = (derive_t)dns_sample_rate;
+
+  if (t == NULL)
+    return;
+
+  pthread_mutex_lock(&t->lock);
   if (dns->qr == 0) {
     /* This is a query */
-    int skip = 0;
-    if (!select_numeric_qtype) {
-      const char *str = qtype_str(dns->qtype);
-      if ((str == NULL) || (str[0] == '#'))
-        skip = 1;
-    }
+    t->tr_queries += weight * dns->length;
 
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+    if (dns->qtype < QTYPE_ARRAY_SIZE)
+      t->qtype[dns->qtype] += weight;
+    else
+      counter_list_add(&t->qtype_list, dns->qtype, dns_sample_rate);
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    t->tr_responses += weight * dns->length;
+    t->rcode[dns->rcode % RCODE_ARRAY_SIZE] += weight;
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  t->opcode[dns->opcode % OPCODE_ARRAY_SIZE] += weight;
+  pthread_mutex_unlock(&t->lock);
+}
+
+/* pcap callback of the capture threads. Drops all but every
+ * `dns_sample_rate'th packet before it is parsed. */
+static void dns_handle_packet(u_char *user, const struct pcap_pkthdr *hdr,
+                              const u_char *pkt) {
+  dns_thread_t *t = (dns_thread_t *)user;
+
+  if (dns_sample_rate > 1) {
+    t->sample_count++;
+    if (t->sample_count < dns_sample_rate)
+      return;
+    t->sample_count = 0;
+  }
+
+  handle_pcap((u_char *)t->pcap_obj, hdr, pkt);
+}
+
+#if defined(PACKET_FANOUT)
+/* Joins the packet socket of a capture thread to the fanout group of the
+ * plugin. The kernel then hashes every flow to one of the sockets of the
+ * group, instead of delivering each packet to all of them. */
+static int dns_join_fanout(pcap_t *pcap_obj) {
+  int fd = pcap_fileno(pcap_obj);
+  int arg = (int)(getpid() & 0xffff) |
+            ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+  if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) != 0) {
+    ERROR("dns plugin: Joining the PACKET_FANOUT group failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  return 0;
 }
+#endif
 
-static int dns_run_pcap_loop(void) {
+static int dns_run_pcap_loop(dns_thread_t *t) {
   pcap_t *pcap_obj;
   char pcap_error[PCAP_ERRBUF_SIZE];
   struct bpf_program fp = {0};
@@ -223,19 +314,27 @@ static int dns_run_pcap_loop(void) {
     return status;
   }
 
+#if defined(PACKET_FANOUT)
+  if ((dns_threads_num > 1) && (dns_join_fanout(pcap_obj) != 0)) {
+    pcap_close(pcap_obj);
+    return PCAP_ERROR;
+  }
+#endif
+
   DEBUG("dns plugin: PCAP object created.");
 
-  dnstop_set_pcap_obj(pcap_obj);
-  dnstop_set_callback(dns_child_callback);
+  t->pcap_obj = pcap_obj;
+  pthread_setspecific(dns_thread_key, t);
 
   status = pcap_loop(pcap_obj, -1 /* loop forever */,
-                     handle_pcap /* callback */, NULL /* user data */);
+                     dns_handle_packet /* callback */, (u_char *)t);
   INFO("dns plugin: pcap_loop exited with status %i.", status);
   /* We need to handle "PCAP_ERROR" specially because libpcap currently
    * doesn't return PCAP_ERROR_IFACE_NOT_UP for compatibility reasons. */
   if (status == PCAP_ERROR)
     status = PCAP_ERROR_IFACE_NOT_UP;
 
+  t->pcap_obj = NULL;
   pcap_close(pcap_obj);
   return status;
 } /* int dns_run_pcap_loop */
@@ -253,12 +352,13 @@ static int dns_sleep_one_interval(void) /* {{{ */
   return 0;
 } /* }}} int dns_sleep_one_interval */
 
-static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
+static void *dns_child_loop(void *arg) /* {{{ */
 {
+  dns_thread_t *t = arg;
   int status;
 
   while (42) {
-    status = dns_run_pcap_loop();
+    status = dns_run_pcap_loop(t);
     if (status != PCAP_ERROR_IFACE_NOT_UP)
       break;
 
@@ -268,30 +368,51 @@ static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
   if (status != PCAP_ERROR_BREAK)
     ERROR("dns plugin: PCAP returned error %s.", pcap_statustostr(status));
 
-  listen_thread_init = 0;
   return NULL;
 } /* }}} void *dns_child_loop */
 
 static int dns_init(void) {
-  /* clean up an old thread */
   int status;
 
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
-
-  if (listen_thread_init != 0)
+  if (dns_threads_init)
     return -1;
 
-  status = plugin_thread_create(&listen_thread, dns_child_loop, (void *)0,
-                                "dns listen");
+  status = pthread_key_create(&dns_thread_key, NULL);
   if (status != 0) {
-    ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+    ERROR("dns plugin: pthread_key_create failed: %s", STRERROR(status));
+    return -1;
+  }
+
+  dns_threads = calloc(dns_threads_num, sizeof(*dns_threads));
+  if (dns_threads == NULL) {
+    ERROR("dns plugin: calloc failed.");
+    pthread_key_delete(dns_thread_key);
     return -1;
   }
 
-  listen_thread_init = 1;
+  dnstop_set_callback(dns_child_callback);
+
+  for (size_t i = 0; i < dns_threads_num; i++)
+    pthread_mutex_init(&dns_threads[i].lock, /* attr = */ NULL);
+
+  /* The threads are never stopped, so the array is never freed. */
+  dns_threads_init = true;
+
+  for (size_t i = 0; i < dns_threads_num; i++) {
+    dns_thread_t *t = dns_threads + i;
+
+    status = plugin_thread_create(&t->thread, dns_child_loop, t, "dns listen");
+    if (status != 0) {
+      ERROR("dns plugin: pthread_create failed: %s", STRERROR(status));
+      if (i == 0)
+        return -1;
+      break;
+    }
+    t->thread_started = true;
+  }
+
+  if (dns_threads_num > 1)
+    INFO("dns plugin: Capturing with %" PRIsz " threads.", dns_threads_num);
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
   if (check_capability(CAP_NET_RAW) != 0) {
@@ -337,58 +458,68 @@ static void submit_octets(derive_t queries, derive_t responses) {
   plugin_dispatch_values(&vl);
 } /* void submit_octets */
 
-static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
-
-  counter_list_t *ptr;
+static void submit_qtype(unsigned int qtype, derive_t value) {
+  const char *str = qtype_str(qtype);
 
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
+  /* Unknown query types are presented as "#<number>". */
+  if (!select_numeric_qtype && ((str == NULL) || (str[0] == '#')))
+    return;
 
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
+  DEBUG("dns plugin: qtype = %u; counter = %" PRIi64 ";", qtype, value);
+  submit_derive("dns_qtype", str, value);
+} /* void submit_qtype */
 
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&qtype_mutex);
+static int dns_read(void) {
+  derive_t queries = 0;
+  derive_t responses = 0;
+  derive_t qtype[QTYPE_ARRAY_SIZE] = {0};
+  derive_t opcode[OPCODE_ARRAY_SIZE] = {0};
+  derive_t rcode[RCODE_ARRAY_SIZE] = {0};
+  counter_list_t *qtype_list = NULL;
+
+  if (!dns_threads_init)
+    return -1;
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
+  /* The counters of each thread only grow, so their sums do, too. */
+  for (size_t i = 0; i < dns_threads_num; i++) {
+    dns_thread_t *t = dns_threads + i;
+
+    pthread_mutex_lock(&t->lock);
+    queries += t->tr_queries;
+    responses += t->tr_responses;
+    for (size_t j = 0; j < QTYPE_ARRAY_SIZE; j++)
+      qtype[j] += t->qtype[j];
+    for (counter_list_t *ptr = t->qtype_list; ptr != NULL; ptr = ptr->next)
+      counter_list_add(&qtype_list, ptr->key, ptr->value);
+    for (size_t j = 0; j < OPCODE_ARRAY_SIZE; j++)
+      opcode[j] += t->opcode[j];
+    for (size_t j = 0; j < RCODE_ARRAY_SIZE; j++)
+      rcode[j] += t->rcode[j];
+    pthread_mutex_unlock(&t->lock);
   }
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&opcode_mutex);
+  if ((queries != 0) || (responses != 0))
+    submit_octets(queries, responses);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
-  }
+  for (unsigned int i = 0; i < QTYPE_ARRAY_SIZE; i++)
+    if (qtype[i] != 0)
+      submit_qtype(i, qtype[i]);
+  for (counter_list_t *ptr = qtype_list; ptr != NULL; ptr = ptr->next)
+    submit_qtype(ptr->key, (derive_t)ptr->value);
+  counter_list_free(qtype_list);
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+  for (int i = 0; i < OPCODE_ARRAY_SIZE; i++) {
+    if (opcode[i] == 0)
+      continue;
+    DEBUG("dns plugin: opcode = %i; counter = %" PRIi64 ";", i, opcode[i]);
+    submit_derive("dns_opcode", opcode_str(i), opcode[i]);
   }
-  pthread_mutex_unlock(&rcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
+  for (int i = 0; i < RCODE_ARRAY_SIZE; i++) {
+    if (rcode[i] == 0)
+      continue;
+    DEBUG("dns plugin: rcode = %i; counter = %" PRIi64 ";", i, rcode[i]);
+    submit_derive("dns_rcode", rcode_str(i), rcode[i]);
   }
 
   return 0;
@@ -52,41 +52,67 @@ struct dpdk_stats_config_s {
 typedef struct dpdk_stats_config_s dpdk_stats_config_t;
 
 #define RTE_VERSION_16_07 RTE_VERSION_NUM(16, 7, 0, 16)
+#define RTE_VERSION_17_05 RTE_VERSION_NUM(17, 5, 0, 16)
 
+/*
+ * raw_data holds, for stats_capacity counters, the cached counter names
+ * followed by two value buffers. Before 16.07 names and values share one
+ * array, so there is no separate name table to cache.
+ */
 #if RTE_VERSION < RTE_VERSION_16_07
-#define DPDK_STATS_XSTAT_GET_VALUE(ctx, index) ctx->xstats[index].value
-#define DPDK_STATS_XSTAT_GET_NAME(ctx, index) ctx->xstats[index].name
-#define DPDK_STATS_CTX_GET_XSTAT_SIZE sizeof(struct rte_eth_xstats)
-#define DPDK_STATS_CTX_INIT(ctx)                                               \
-  do {                                                                         \
-    ctx->xstats = (struct rte_eth_xstats *)&ctx->raw_data[0];                  \
-  } while (0)
+typedef struct rte_eth_xstats dpdk_stats_value_t;
+#define DPDK_STATS_NAME_SIZE 0
+#define DPDK_STATS_VALUE(v) (v).value
+#define DPDK_STATS_VALUES_GET(port, values, len)                              \
+  rte_eth_xstats_get(port, values, len)
+#elif RTE_VERSION < RTE_VERSION_17_05
+typedef struct rte_eth_xstat dpdk_stats_value_t;
+#define DPDK_STATS_NAME_SIZE sizeof(struct rte_eth_xstat_name)
+#define DPDK_STATS_VALUE(v) (v).value
+#define DPDK_STATS_VALUES_GET(port, values, len)                              \
+  rte_eth_xstats_get(port, values, len)
 #else
-#define DPDK_STATS_XSTAT_GET_VALUE(ctx, index) ctx->xstats[index].value
-#define DPDK_STATS_XSTAT_GET_NAME(ctx, index) ctx->xnames[index].name
-#define DPDK_STATS_CTX_GET_XSTAT_SIZE                                          \
-  (sizeof(struct rte_eth_xstat) + sizeof(struct rte_eth_xstat_name))
-#define DPDK_STATS_CTX_INIT(ctx)                                               \
-  do {                                                                         \
-    ctx->xstats = (struct rte_eth_xstat *)&ctx->raw_data[0];                   \
-    ctx->xnames =                                                              \
-        (struct rte_eth_xstat_name *)&ctx                                      \
-            ->raw_data[ctx->stats_count * sizeof(struct rte_eth_xstat)];       \
-  } while (0)
+typedef uint64_t dpdk_stats_value_t;
+#define DPDK_STATS_NAME_SIZE sizeof(struct rte_eth_xstat_name)
+#define DPDK_STATS_VALUE(v) (v)
+#define DPDK_STATS_VALUES_GET(port, values, len)                              \
+  rte_eth_xstats_get_by_id(port, NULL, values, len)
 #endif
 
+#define DPDK_STATS_CTX_GET_XSTAT_SIZE                                          \
+  (DPDK_STATS_NAME_SIZE + 2 * sizeof(dpdk_stats_value_t))
+#define DPDK_STATS_CTX_NAMES(ctx)                                              \
+  ((struct rte_eth_xstat_name *)&(ctx)->raw_data[0])
+#define DPDK_STATS_CTX_VALUES(ctx, buf)                                        \
+  ((dpdk_stats_value_t *)&(ctx)                                               \
+       ->raw_data[(ctx)->stats_capacity *                                      \
+                  (DPDK_STATS_NAME_SIZE +                                      \
+                   (buf) * sizeof(dpdk_stats_value_t))])
+
+/* One snapshot of the counter values. The helper fills the buffer that is
+ * not ready_buf and then publishes it, so the buffer read dispatches from is
+ * never written to, not even by a helper that completes after a timeout. */
+struct dpdk_stats_buf_s {
+  uint64_t seq;
+  cdtime_t port_read_time[RTE_MAX_ETHPORTS];
+  uint32_t port_offset[RTE_MAX_ETHPORTS];
+  uint32_t port_stats_count[RTE_MAX_ETHPORTS];
+};
+
 struct dpdk_stats_ctx_s {
   dpdk_stats_config_t config;
   uint32_t stats_count;
+  uint32_t stats_capacity;
   uint32_t ports_count;
-  cdtime_t port_read_time[RTE_MAX_ETHPORTS];
   uint32_t port_stats_count[RTE_MAX_ETHPORTS];
-#if RTE_VERSION < RTE_VERSION_16_07
-  struct rte_eth_xstats *xstats;
-#else
-  struct rte_eth_xstat *xstats;
-  struct rte_eth_xstat_name *xnames;
-#endif
+  /* Layout the cached names were fetched for; names_gen changes whenever
+   * any of them is refetched. */
+  uint32_t names_offset[RTE_MAX_ETHPORTS];
+  uint32_t names_count[RTE_MAX_ETHPORTS];
+  uint64_t names_gen;
+  uint64_t seq;
+  int ready_buf;
+  struct dpdk_stats_buf_s bufs[2];
   char raw_data[];
 };
 typedef struct dpdk_stats_ctx_s dpdk_stats_ctx_t;
@@ -102,6 +128,20 @@ dpdk_helper_ctx_t *g_hc = NULL;
 static char g_shm_name[DATA_MAX_NAME_LEN] = DPDK_STATS_NAME;
 static dpdk_stat_cfg_status g_state = DPDK_STAT_STATE_OKAY;
 
+/* Sequence number of the last snapshot that was dispatched. */
+static uint64_t g_dispatched_seq;
+
+#if RTE_VERSION >= RTE_VERSION_16_07
+/* Counter types resolved from the cached names, for names_gen g_types_gen. */
+static char (*g_types)[DATA_MAX_NAME_LEN];
+static uint32_t g_types_num;
+static uint64_t g_types_gen;
+
+/* Helper process only: the first pass of a new helper fetches all names, in
+ * case the ports were reconfigured while no helper was running. */
+static bool g_helper_names_fetched;
+#endif
+
 static int dpdk_stats_reinit_helper();
 static void dpdk_stats_default_config(void) {
   dpdk_stats_ctx_t *ec = DPDK_STATS_CTX_GET(g_hc);
@@ -199,44 +239,76 @@ static int dpdk_stats_config(oconfig_item_t *ci) {
   return 0;
 }
 
+#if RTE_VERSION >= RTE_VERSION_16_07
+static int dpdk_helper_stats_names_get(dpdk_stats_ctx_t *ctx, uint8_t port,
+                                       uint32_t offset, uint32_t len) {
+  /* Names only change when the port is reconfigured, which changes the
+   * number of counters and with it the layout. */
+  if (g_helper_names_fetched && (ctx->names_offset[port] == offset) &&
+      (ctx->names_count[port] == len))
+    return 0;
+
+  int ret =
+      rte_eth_xstats_get_names(port, &DPDK_STATS_CTX_NAMES(ctx)[offset], len);
+  if (ret < 0 || ret > len) {
+    DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
+                   ": Error reading stat names (port=%d; len=%d ret=%d)\n",
+                   port, len, ret);
+    ctx->names_count[port] = 0;
+    return -1;
+  }
+
+  ctx->names_offset[port] = offset;
+  ctx->names_count[port] = len;
+  ctx->names_gen++;
+  return 0;
+}
+#endif
+
 static int dpdk_helper_stats_get(dpdk_helper_ctx_t *phc) {
   int len = 0;
   int ret = 0;
-  int stats = 0;
+  uint32_t stats = 0;
   dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
 
+  int buf_idx = (ctx->ready_buf == 0) ? 1 : 0;
+  struct dpdk_stats_buf_s *buf = &ctx->bufs[buf_idx];
+  dpdk_stats_value_t *values = DPDK_STATS_CTX_VALUES(ctx, buf_idx);
+
   /* get stats from DPDK */
   for (uint8_t i = 0; i < ctx->ports_count; i++) {
+    buf->port_stats_count[i] = 0;
     if (!(ctx->config.enabled_port_mask & (1 << i)))
       continue;
 
-    ctx->port_read_time[i] = cdtime();
     /* Store available stats array length for port */
     len = ctx->port_stats_count[i];
 
-    ret = rte_eth_xstats_get(i, &ctx->xstats[stats], len);
+#if RTE_VERSION >= RTE_VERSION_16_07
+    if (dpdk_helper_stats_names_get(ctx, i, stats, len) != 0)
+      return -1;
+#endif
+
+    buf->port_read_time[i] = cdtime();
+    ret = DPDK_STATS_VALUES_GET(i, &values[stats], len);
     if (ret < 0 || ret > len) {
       DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
                      ": Error reading stats (port=%d; len=%d, ret=%d)\n",
                      i, len, ret);
-      ctx->port_stats_count[i] = 0;
       return -1;
     }
+    buf->port_offset[i] = stats;
+    buf->port_stats_count[i] = ret;
+    stats += len;
+  }
+
+  assert(stats <= ctx->stats_capacity);
 #if RTE_VERSION >= RTE_VERSION_16_07
-    ret = rte_eth_xstats_get_names(i, &ctx->xnames[stats], len);
-    if (ret < 0 || ret > len) {
-      DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
-                     ": Error reading stat names (port=%d; len=%d ret=%d)\n",
-                     i, len, ret);
-      ctx->port_stats_count[i] = 0;
-      return -1;
-    }
+  g_helper_names_fetched = true;
 #endif
-    ctx->port_stats_count[i] = ret;
-    stats += ctx->port_stats_count[i];
-  }
 
-  assert(stats <= ctx->stats_count);
+  buf->seq = ++ctx->seq;
+  __atomic_store_n(&ctx->ready_buf, buf_idx, __ATOMIC_RELEASE);
   return 0;
 }
 
@@ -272,10 +344,6 @@ static int dpdk_helper_stats_count_get(dpdk_helper_ctx_t *phc) {
   return stats_count;
 }
 
-static int dpdk_stats_get_size(dpdk_helper_ctx_t *phc) {
-  return dpdk_helper_data_size_get(phc) - sizeof(dpdk_stats_ctx_t);
-}
-
 int dpdk_helper_command_handler(dpdk_helper_ctx_t *phc, enum DPDK_CMD cmd) {
   /* this function is called from helper context */
 
@@ -294,14 +362,14 @@ int dpdk_helper_command_handler(dpdk_helper_ctx_t *phc, enum DPDK_CMD cmd) {
     return stats_count;
   }
 
-  DPDK_STATS_CTX_GET(phc)->stats_count = stats_count;
-  int stats_size = stats_count * DPDK_STATS_CTX_GET_XSTAT_SIZE;
+  dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+  ctx->stats_count = stats_count;
 
-  if (dpdk_stats_get_size(phc) < stats_size) {
+  if (ctx->stats_capacity < stats_count) {
     DPDK_CHILD_LOG(
         DPDK_STATS_PLUGIN
-        ":%s:%d not enough space for stats (available=%d, needed=%d)\n",
-        __FUNCTION__, __LINE__, (int)dpdk_stats_get_size(phc), stats_size);
+        ":%s:%d not enough space for stats (available=%u, needed=%d)\n",
+        __FUNCTION__, __LINE__, ctx->stats_capacity, stats_count);
     return -ENOBUFS;
   }
 
@@ -366,7 +434,8 @@ static void dpdk_stats_resolve_cnt_type(char *cnt_type, size_t cnt_type_len,
 }
 
 static void dpdk_stats_counter_submit(const char *plugin_instance,
-                                      const char *cnt_name, derive_t value,
+                                      const char *cnt_name,
+                                      const char *cnt_type, derive_t value,
                                       cdtime_t port_read_time) {
   value_list_t vl = VALUE_LIST_INIT;
   vl.values = &(value_t){.derive = value};
@@ -374,11 +443,42 @@ static void dpdk_stats_counter_submit(const char *plugin_instance,
   vl.time = port_read_time;
   sstrncpy(vl.plugin, DPDK_STATS_PLUGIN, sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
-  dpdk_stats_resolve_cnt_type(vl.type, sizeof(vl.type), cnt_name);
+  sstrncpy(vl.type, cnt_type, sizeof(vl.type));
   sstrncpy(vl.type_instance, cnt_name, sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 }
 
+#if RTE_VERSION >= RTE_VERSION_16_07
+/* Resolves the types of the cached names again if the helper refetched any
+ * of them since the last call. */
+static int dpdk_stats_types_update(dpdk_stats_ctx_t *ctx) {
+  if ((g_types != NULL) && (g_types_gen == ctx->names_gen) &&
+      (g_types_num == ctx->stats_capacity))
+    return 0;
+
+  if (g_types_num != ctx->stats_capacity) {
+    char(*tmp)[DATA_MAX_NAME_LEN] =
+        realloc(g_types, ctx->stats_capacity * sizeof(*g_types));
+    if (tmp == NULL && ctx->stats_capacity != 0) {
+      ERROR(DPDK_STATS_PLUGIN ": realloc failed.");
+      return -ENOMEM;
+    }
+    g_types = tmp;
+    g_types_num = ctx->stats_capacity;
+  }
+
+  struct rte_eth_xstat_name *names = DPDK_STATS_CTX_NAMES(ctx);
+  for (uint32_t i = 0; i < g_types_num; i++) {
+    char cnt_name[sizeof(names[i].name)];
+    sstrncpy(cnt_name, names[i].name, sizeof(cnt_name));
+    dpdk_stats_resolve_cnt_type(g_types[i], sizeof(g_types[i]), cnt_name);
+  }
+
+  g_types_gen = ctx->names_gen;
+  return 0;
+}
+#endif
+
 static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
   dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
 
@@ -387,7 +487,21 @@ static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
   DEBUG("%s:%s:%d ports=%u", DPDK_STATS_PLUGIN, __FUNCTION__, __LINE__,
         ctx->ports_count);
 
-  int stats_count = 0;
+  int buf_idx = __atomic_load_n(&ctx->ready_buf, __ATOMIC_ACQUIRE);
+  struct dpdk_stats_buf_s *buf = &ctx->bufs[buf_idx];
+  if ((buf->seq == 0) || (buf->seq == g_dispatched_seq)) {
+    DEBUG(DPDK_STATS_PLUGIN ": no new stats snapshot");
+    return 0;
+  }
+  g_dispatched_seq = buf->seq;
+
+#if RTE_VERSION >= RTE_VERSION_16_07
+  int ret = dpdk_stats_types_update(ctx);
+  if (ret != 0)
+    return ret;
+  struct rte_eth_xstat_name *names = DPDK_STATS_CTX_NAMES(ctx);
+#endif
+  dpdk_stats_value_t *values = DPDK_STATS_CTX_VALUES(ctx, buf_idx);
 
   for (int i = 0; i < ctx->ports_count; i++) {
     if (!(ctx->config.enabled_port_mask & (1 << i)))
@@ -401,20 +515,23 @@ static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
     }
 
     DEBUG(" === Dispatch stats for port %d (name=%s; stats_count=%d)", i,
-          dev_name, ctx->port_stats_count[i]);
-
-    for (int j = 0; j < ctx->port_stats_count[i]; j++) {
-      const char *cnt_name = DPDK_STATS_XSTAT_GET_NAME(ctx, stats_count);
-      if (cnt_name == NULL)
-        WARNING("dpdkstat: Invalid counter name");
-      else
-        dpdk_stats_counter_submit(
-            dev_name, cnt_name,
-            (derive_t)DPDK_STATS_XSTAT_GET_VALUE(ctx, stats_count),
-            ctx->port_read_time[i]);
-      stats_count++;
-
-      assert(stats_count <= ctx->stats_count);
+          dev_name, buf->port_stats_count[i]);
+
+    for (uint32_t j = 0; j < buf->port_stats_count[i]; j++) {
+      uint32_t idx = buf->port_offset[i] + j;
+      assert(idx < ctx->stats_capacity);
+
+#if RTE_VERSION >= RTE_VERSION_16_07
+      const char *cnt_name = names[idx].name;
+      const char *cnt_type = g_types[idx];
+#else
+      const char *cnt_name = values[idx].name;
+      char cnt_type[DATA_MAX_NAME_LEN];
+      dpdk_stats_resolve_cnt_type(cnt_type, sizeof(cnt_type), cnt_name);
+#endif
+      dpdk_stats_counter_submit(dev_name, cnt_name, cnt_type,
+                                (derive_t)DPDK_STATS_VALUE(values[idx]),
+                                buf->port_read_time[i]);
     }
   }
 
@@ -452,7 +569,11 @@ static int dpdk_stats_reinit_helper() {
 
   ctx = DPDK_STATS_CTX_GET(g_hc);
   memcpy(ctx, &tmp_ctx, sizeof(dpdk_stats_ctx_t));
-  DPDK_STATS_CTX_INIT(ctx);
+  ctx->stats_capacity = ctx->stats_count;
+  /* The new object holds neither names nor values yet. */
+  memset(ctx->names_count, 0, sizeof(ctx->names_count));
+  memset(ctx->bufs, 0, sizeof(ctx->bufs));
+  ctx->ready_buf = 0;
   dpdk_helper_eal_config_set(g_hc, &tmp_eal);
 
   return ret;
@@ -494,6 +615,11 @@ static int dpdk_stats_shutdown(void) {
   dpdk_helper_shutdown(g_hc);
   g_hc = NULL;
 
+#if RTE_VERSION >= RTE_VERSION_16_07
+  sfree(g_types);
+  g_types_num = 0;
+#endif
+
   return 0;
 }
 
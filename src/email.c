@@ -80,12 +80,27 @@ typedef struct {
   type_t *tail;
 } type_list_t;
 
+/* counters of a single collector thread, merged by email_read() */
+typedef struct {
+  /* only contended while email_read() collects the values */
+  pthread_mutex_t lock;
+
+  type_list_t count;
+  type_list_t size;
+  type_list_t check;
+
+  double score_sum;
+  int score_count;
+} email_stats_t;
+
 /* collector thread control information */
 typedef struct collector {
   pthread_t thread;
 
   /* socket descriptor of the current/last connection */
   FILE *socket;
+
+  email_stats_t stats;
 } collector_t;
 
 /* linked list of pending connections */
@@ -129,31 +144,18 @@ static pthread_cond_t conn_available = PTHREAD_COND_INITIALIZER;
 /* connections that are waiting to be processed */
 static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
 static conn_list_t conns;
+static int conns_num;
 
-/* tell the connector thread that a collector is available */
-static pthread_cond_t collector_available = PTHREAD_COND_INITIALIZER;
-
-/* collector threads */
+/* collector threads, started on demand up to max_conns; protected by
+ * conns_mutex */
 static collector_t **collectors;
+static int collectors_num;
+static int idle_collectors;
 
-static pthread_mutex_t available_mutex = PTHREAD_MUTEX_INITIALIZER;
-static int available_collectors;
-
-static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* totals reported by email_read(); only used by the read callback */
 static type_list_t list_count;
-static type_list_t list_count_copy;
-
-static pthread_mutex_t size_mutex = PTHREAD_MUTEX_INITIALIZER;
 static type_list_t list_size;
-static type_list_t list_size_copy;
-
-static pthread_mutex_t score_mutex = PTHREAD_MUTEX_INITIALIZER;
-static double score;
-static int score_count;
-
-static pthread_mutex_t check_mutex = PTHREAD_MUTEX_INITIALIZER;
 static type_list_t list_check;
-static type_list_t list_check_copy;
 
 /*
  * Private functions
@@ -234,18 +236,22 @@ static void type_list_incr(type_list_t *list, char *name, int incr) {
 
 static void *collect(void *arg) {
   collector_t *this = (collector_t *)arg;
+  email_stats_t *stats = &this->stats;
 
   while (1) {
     conn_t *connection;
 
     pthread_mutex_lock(&conns_mutex);
 
+    ++idle_collectors;
     while (conns.head == NULL) {
       pthread_cond_wait(&conn_available, &conns_mutex);
     }
+    --idle_collectors;
 
     connection = conns.head;
     conns.head = conns.head->next;
+    --conns_num;
 
     if (conns.head == NULL) {
       conns.tail = NULL;
@@ -308,33 +314,31 @@ static void *collect(void *arg) {
         *bytes_str = 0;
         bytes_str++;
 
-        pthread_mutex_lock(&count_mutex);
-        type_list_incr(&list_count, type, /* increment = */ 1);
-        pthread_mutex_unlock(&count_mutex);
-
         int bytes = atoi(bytes_str);
-        if (bytes > 0) {
-          pthread_mutex_lock(&size_mutex);
-          type_list_incr(&list_size, type, /* increment = */ bytes);
-          pthread_mutex_unlock(&size_mutex);
-        }
+
+        pthread_mutex_lock(&stats->lock);
+        type_list_incr(&stats->count, type, /* increment = */ 1);
+        if (bytes > 0)
+          type_list_incr(&stats->size, type, /* increment = */ bytes);
+        pthread_mutex_unlock(&stats->lock);
       } else if (line[0] == 's') { /* s:<value> */
-        pthread_mutex_lock(&score_mutex);
-        score = (score * (double)score_count + atof(line + 2)) /
-                (double)(score_count + 1);
-        ++score_count;
-        pthread_mutex_unlock(&score_mutex);
+        double value = atof(line + 2);
+
+        pthread_mutex_lock(&stats->lock);
+        stats->score_sum += value;
+        ++stats->score_count;
+        pthread_mutex_unlock(&stats->lock);
       } else if (line[0] == 'c') { /* c:<type1>[,<type2>,...] */
         char *dummy = line + 2;
         char *endptr = NULL;
         char *type;
 
-        pthread_mutex_lock(&check_mutex);
+        pthread_mutex_lock(&stats->lock);
         while ((type = strtok_r(dummy, ",", &endptr)) != NULL) {
           dummy = NULL;
-          type_list_incr(&list_check, type, /* increment = */ 1);
+          type_list_incr(&stats->check, type, /* increment = */ 1);
         }
-        pthread_mutex_unlock(&check_mutex);
+        pthread_mutex_unlock(&stats->lock);
       } else {
         log_err("collect: unknown type '%c'", line[0]);
       }
@@ -346,18 +350,36 @@ static void *collect(void *arg) {
     free(connection);
 
     this->socket = NULL;
-
-    pthread_mutex_lock(&available_mutex);
-    ++available_collectors;
-    pthread_mutex_unlock(&available_mutex);
-
-    pthread_cond_signal(&collector_available);
   } /* while (1) */
 
   pthread_exit((void *)0);
   return (void *)0;
 } /* static void *collect (void *) */
 
+/* Starts another collector thread. The caller has to hold conns_mutex. */
+static int collector_start(void) {
+  collector_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return ENOMEM;
+
+  pthread_mutex_init(&c->stats.lock, /* attr = */ NULL);
+
+  /* the read callback may look at the counters as soon as the collector is
+   * listed */
+  collectors[collectors_num] = c;
+  ++collectors_num;
+
+  int status = plugin_thread_create(&c->thread, collect, c, "email collector");
+  if (status != 0) {
+    log_err("plugin_thread_create() failed: %s", STRERRNO);
+    c->thread = (pthread_t)0;
+    return status;
+  }
+
+  pthread_detach(c->thread);
+  return 0;
+} /* static int collector_start (void) */
+
 static void *open_connection(void __attribute__((unused)) * arg) {
   const char *path = (NULL == sock_file) ? SOCK_PATH : sock_file;
   const char *group = (NULL == sock_group) ? COLLECTD_GRP_NAME : sock_group;
@@ -387,7 +409,7 @@ static void *open_connection(void __attribute__((unused)) * arg) {
   }
 
   errno = 0;
-  if (listen(connector_socket, 5) == -1) {
+  if (listen(connector_socket, SOMAXCONN) == -1) {
     disabled = 1;
     close(connector_socket);
     connector_socket = -1;
@@ -427,43 +449,13 @@ static void *open_connection(void __attribute__((unused)) * arg) {
     log_warn("chmod() failed: %s", STRERRNO);
   }
 
-  { /* initialize collector threads */
-    conns.head = NULL;
-    conns.tail = NULL;
-
-    available_collectors = max_conns;
-
-    collectors = smalloc(max_conns * sizeof(*collectors));
-
-    for (int i = 0; i < max_conns; ++i) {
-      collectors[i] = smalloc(sizeof(*collectors[i]));
-      collectors[i]->socket = NULL;
-
-      if (plugin_thread_create(&collectors[i]->thread, collect, collectors[i],
-                               "email collector") == 0) {
-        pthread_detach(collectors[i]->thread);
-      } else {
-        log_err("plugin_thread_create() failed: %s", STRERRNO);
-        collectors[i]->thread = (pthread_t)0;
-      }
-    }
-  }
-
+  /* Collector threads are started on demand, so connections are accepted
+   * right away instead of waiting for a collector to become idle. */
   while (1) {
     int remote = 0;
 
     conn_t *connection;
 
-    pthread_mutex_lock(&available_mutex);
-
-    while (available_collectors == 0) {
-      pthread_cond_wait(&collector_available, &available_mutex);
-    }
-
-    --available_collectors;
-
-    pthread_mutex_unlock(&available_mutex);
-
     while (42) {
       errno = 0;
 
@@ -507,6 +499,10 @@ static void *open_connection(void __attribute__((unused)) * arg) {
       conns.tail->next = connection;
       conns.tail = conns.tail->next;
     }
+    ++conns_num;
+
+    if ((conns_num > idle_collectors) && (collectors_num < max_conns))
+      collector_start();
 
     pthread_mutex_unlock(&conns_mutex);
 
@@ -518,6 +514,13 @@ static void *open_connection(void __attribute__((unused)) * arg) {
 } /* static void *open_connection (void *) */
 
 static int email_init(void) {
+  collectors = calloc(max_conns, sizeof(*collectors));
+  if (collectors == NULL) {
+    disabled = 1;
+    log_err("calloc failed.");
+    return -1;
+  }
+
   if (plugin_thread_create(&connector, open_connection, NULL,
                            "email listener") != 0) {
     disabled = 1;
@@ -559,13 +562,8 @@ static int email_shutdown(void) {
   /* don't allow any more connections to be processed */
   pthread_mutex_lock(&conns_mutex);
 
-  available_collectors = 0;
-
   if (collectors != NULL) {
-    for (int i = 0; i < max_conns; ++i) {
-      if (collectors[i] == NULL)
-        continue;
-
+    for (int i = 0; i < collectors_num; ++i) {
       if (collectors[i]->thread != ((pthread_t)0)) {
         pthread_kill(collectors[i]->thread, SIGTERM);
         collectors[i]->thread = (pthread_t)0;
@@ -576,19 +574,21 @@ static int email_shutdown(void) {
         collectors[i]->socket = NULL;
       }
 
+      type_list_free(&collectors[i]->stats.count);
+      type_list_free(&collectors[i]->stats.size);
+      type_list_free(&collectors[i]->stats.check);
+      pthread_mutex_destroy(&collectors[i]->stats.lock);
       sfree(collectors[i]);
     }
     sfree(collectors);
+    collectors_num = 0;
   } /* if (collectors != NULL) */
 
   pthread_mutex_unlock(&conns_mutex);
 
   type_list_free(&list_count);
-  type_list_free(&list_count_copy);
   type_list_free(&list_size);
-  type_list_free(&list_size_copy);
   type_list_free(&list_check);
-  type_list_free(&list_check_copy);
 
   unlink((sock_file == NULL) ? SOCK_PATH : sock_file);
 
@@ -610,89 +610,65 @@ static void email_submit(const char *type, const char *type_instance,
   plugin_dispatch_values(&vl);
 } /* void email_submit */
 
-/* Copy list l1 to list l2. l2 may partly exist already, but it is assumed
- * that neither the order nor the name of any element of either list is
- * changed and no elements are deleted. The values of l1 are reset to zero
- * after they have been copied to l2. */
-static void copy_type_list(type_list_t *l1, type_list_t *l2) {
-  type_t *last = NULL;
-
-  for (type_t *ptr1 = l1->head, *ptr2 = l2->head; ptr1 != NULL;
-       ptr1 = ptr1->next, last = ptr2, ptr2 = ptr2->next) {
-    if (ptr2 == NULL) {
-      ptr2 = smalloc(sizeof(*ptr2));
-      ptr2->name = NULL;
-      ptr2->next = NULL;
-
-      if (last == NULL) {
-        l2->head = ptr2;
-      } else {
-        last->next = ptr2;
-      }
-
-      l2->tail = ptr2;
-    }
-
-    if (ptr2->name == NULL) {
-      ptr2->name = sstrdup(ptr1->name);
-    }
-
-    ptr2->value = ptr1->value;
-    ptr1->value = 0;
+/* Add the values of list l1 to list l2 and reset them to zero. Names are
+ * never removed from either list, so a type that has been seen once is
+ * reported with a value of zero in the following intervals. */
+static void merge_type_list(type_list_t *l1, type_list_t *l2) {
+  for (type_t *ptr = l1->head; ptr != NULL; ptr = ptr->next) {
+    type_list_incr(l2, ptr->name, ptr->value);
+    ptr->value = 0;
   }
-  return;
+}
+
+static void reset_type_list(type_list_t *l) {
+  for (type_t *ptr = l->head; ptr != NULL; ptr = ptr->next)
+    ptr->value = 0;
 }
 
 static int email_read(void) {
-  double score_old;
-  int score_count_old;
+  double score_sum = 0.0;
+  int score_count = 0;
 
   if (disabled)
     return -1;
 
-  /* email count */
-  pthread_mutex_lock(&count_mutex);
+  reset_type_list(&list_count);
+  reset_type_list(&list_size);
+  reset_type_list(&list_check);
 
-  copy_type_list(&list_count, &list_count_copy);
+  /* collectors are only ever added, and the ones below collectors_num are
+   * fully initialized */
+  pthread_mutex_lock(&conns_mutex);
+  int num = collectors_num;
+  pthread_mutex_unlock(&conns_mutex);
 
-  pthread_mutex_unlock(&count_mutex);
+  for (int i = 0; i < num; ++i) {
+    email_stats_t *stats = &collectors[i]->stats;
 
-  for (type_t *ptr = list_count_copy.head; ptr != NULL; ptr = ptr->next) {
-    email_submit("email_count", ptr->name, ptr->value);
-  }
+    pthread_mutex_lock(&stats->lock);
 
-  /* email size */
-  pthread_mutex_lock(&size_mutex);
+    merge_type_list(&stats->count, &list_count);
+    merge_type_list(&stats->size, &list_size);
+    merge_type_list(&stats->check, &list_check);
 
-  copy_type_list(&list_size, &list_size_copy);
+    score_sum += stats->score_sum;
+    score_count += stats->score_count;
+    stats->score_sum = 0.0;
+    stats->score_count = 0;
 
-  pthread_mutex_unlock(&size_mutex);
-
-  for (type_t *ptr = list_size_copy.head; ptr != NULL; ptr = ptr->next) {
-    email_submit("email_size", ptr->name, ptr->value);
+    pthread_mutex_unlock(&stats->lock);
   }
 
-  /* spam score */
-  pthread_mutex_lock(&score_mutex);
-
-  score_old = score;
-  score_count_old = score_count;
-  score = 0.0;
-  score_count = 0;
-
-  pthread_mutex_unlock(&score_mutex);
-
-  if (score_count_old > 0)
-    email_submit("spam_score", "", score_old);
-
-  /* spam checks */
-  pthread_mutex_lock(&check_mutex);
+  for (type_t *ptr = list_count.head; ptr != NULL; ptr = ptr->next)
+    email_submit("email_count", ptr->name, ptr->value);
 
-  copy_type_list(&list_check, &list_check_copy);
+  for (type_t *ptr = list_size.head; ptr != NULL; ptr = ptr->next)
+    email_submit("email_size", ptr->name, ptr->value);
 
-  pthread_mutex_unlock(&check_mutex);
+  if (score_count > 0)
+    email_submit("spam_score", "", score_sum / (double)score_count);
 
-  for (type_t *ptr = list_check_copy.head; ptr != NULL; ptr = ptr->next)
+  for (type_t *ptr = list_check.head; ptr != NULL; ptr = ptr->next)
     email_submit("spam_check", ptr->name, ptr->value);
 
   return 0;
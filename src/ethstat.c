@@ -48,31 +48,47 @@ struct value_map_s {
 };
 typedef struct value_map_s value_map_t;
 
-static char **interfaces;
+/* Per-interface cache of the statistics names and their mappings. It is
+ * rebuilt whenever the driver information of the interface changes. */
+struct ethstat_interface_s {
+  char *name;
+  struct ethtool_drvinfo drvinfo;
+  size_t n_stats;
+  struct ethtool_gstrings *strings;
+  char **stat_names;
+  value_map_t const **maps;
+  struct ethtool_stats *stats;
+};
+typedef struct ethstat_interface_s ethstat_interface_t;
+
+static ethstat_interface_t *interfaces;
 static size_t interfaces_num;
 
+/* Control socket used for the SIOCETHTOOL requests. */
+static int ethstat_fd = -1;
+
 static c_avl_tree_t *value_map;
 
 static bool collect_mapped_only;
 
 static int ethstat_add_interface(const oconfig_item_t *ci) /* {{{ */
 {
-  char **tmp;
+  ethstat_interface_t *tmp;
   int status;
 
   tmp = realloc(interfaces, sizeof(*interfaces) * (interfaces_num + 1));
   if (tmp == NULL)
     return -1;
   interfaces = tmp;
-  interfaces[interfaces_num] = NULL;
+  interfaces[interfaces_num] = (ethstat_interface_t){0};
 
-  status = cf_util_get_string(ci, interfaces + interfaces_num);
+  status = cf_util_get_string(ci, &interfaces[interfaces_num].name);
   if (status != 0)
     return status;
 
   interfaces_num++;
   INFO("ethstat plugin: Registered interface %s",
-       interfaces[interfaces_num - 1]);
+       interfaces[interfaces_num - 1].name);
 
   return 0;
 } /* }}} int ethstat_add_interface */
@@ -158,24 +174,8 @@ static int ethstat_config(oconfig_item_t *ci) /* {{{ */
 } /* }}} */
 
 static void ethstat_submit_value(const char *device, const char *type_instance,
-                                 derive_t value) {
-  static c_complain_t complain_no_map = C_COMPLAIN_INIT_STATIC;
-
+                                 value_map_t const *map, derive_t value) {
   value_list_t vl = VALUE_LIST_INIT;
-  value_map_t *map = NULL;
-
-  if (value_map != NULL)
-    c_avl_get(value_map, type_instance, (void *)&map);
-
-  /* If the "MappedOnly" option is specified, ignore unmapped values. */
-  if (collect_mapped_only && (map == NULL)) {
-    if (value_map == NULL)
-      c_complain(
-          LOG_WARNING, &complain_no_map,
-          "ethstat plugin: The \"MappedOnly\" option has been set to true, "
-          "but no mapping has been configured. All values will be ignored!");
-    return;
-  }
 
   vl.values = &(value_t){.derive = value};
   vl.values_len = 1;
@@ -193,105 +193,155 @@ static void ethstat_submit_value(const char *device, const char *type_instance,
   plugin_dispatch_values(&vl);
 }
 
-static int ethstat_read_interface(char *device) {
-  int fd;
-  struct ethtool_gstrings *strings;
-  struct ethtool_stats *stats;
-  size_t n_stats;
-  size_t strings_size;
-  size_t stats_size;
-  int status;
+static void ethstat_interface_reset(ethstat_interface_t *iface) {
+  iface->n_stats = 0;
+  sfree(iface->strings);
+  sfree(iface->stat_names);
+  sfree(iface->maps);
+  sfree(iface->stats);
+}
+
+static bool ethstat_drvinfo_equal(struct ethtool_drvinfo const *a,
+                                  struct ethtool_drvinfo const *b) {
+  return (a->n_stats == b->n_stats) && (strcmp(a->driver, b->driver) == 0) &&
+         (strcmp(a->version, b->version) == 0) &&
+         (strcmp(a->fw_version, b->fw_version) == 0) &&
+         (strcmp(a->bus_info, b->bus_info) == 0);
+}
+
+/* Fetches the statistics names of the interface and looks up their mappings.
+ */
+static int ethstat_interface_load(ethstat_interface_t *iface,
+                                  struct ethtool_drvinfo const *drvinfo) {
+  ethstat_interface_reset(iface);
+
+  size_t n_stats = (size_t)drvinfo->n_stats;
+  size_t strings_size =
+      sizeof(struct ethtool_gstrings) + (n_stats * ETH_GSTRING_LEN);
+  size_t stats_size =
+      sizeof(struct ethtool_stats) + (n_stats * sizeof(uint64_t));
+
+  iface->strings = malloc(strings_size);
+  iface->stats = malloc(stats_size);
+  iface->stat_names = calloc(n_stats, sizeof(*iface->stat_names));
+  iface->maps = calloc(n_stats, sizeof(*iface->maps));
+  if ((iface->strings == NULL) || (iface->stats == NULL) ||
+      (iface->stat_names == NULL) || (iface->maps == NULL)) {
+    ERROR("ethstat plugin: malloc failed.");
+    ethstat_interface_reset(iface);
+    return -1;
+  }
+
+  iface->strings->cmd = ETHTOOL_GSTRINGS;
+  iface->strings->string_set = ETH_SS_STATS;
+  iface->strings->len = n_stats;
+
+  struct ifreq req = {.ifr_data = (void *)iface->strings};
+  sstrncpy(req.ifr_name, iface->name, sizeof(req.ifr_name));
+
+  if (ioctl(ethstat_fd, SIOCETHTOOL, &req) < 0) {
+    ERROR("ethstat plugin: Cannot get strings from %s: %s", iface->name,
+          STRERRNO);
+    ethstat_interface_reset(iface);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n_stats; i++) {
+    char *stat_name = (void *)&iface->strings->data[i * ETH_GSTRING_LEN];
+    /* Make sure the name is terminated. */
+    stat_name[ETH_GSTRING_LEN - 1] = 0;
+    /* Remove leading spaces in key name */
+    while (isspace((int)*stat_name))
+      stat_name++;
 
-  fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
-  if (fd < 0) {
-    ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
-    return 1;
+    iface->stat_names[i] = stat_name;
+    if (value_map != NULL)
+      c_avl_get(value_map, stat_name, (void *)&iface->maps[i]);
   }
 
+  iface->drvinfo = *drvinfo;
+  iface->n_stats = n_stats;
+  return 0;
+} /* }}} ethstat_interface_load */
+
+static int ethstat_read_interface(ethstat_interface_t *iface) {
+  char const *device = iface->name;
+  int status;
+
   struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
 
   struct ifreq req = {.ifr_data = (void *)&drvinfo};
 
   sstrncpy(req.ifr_name, device, sizeof(req.ifr_name));
 
-  status = ioctl(fd, SIOCETHTOOL, &req);
+  status = ioctl(ethstat_fd, SIOCETHTOOL, &req);
   if (status < 0) {
-    close(fd);
     ERROR("ethstat plugin: Failed to get driver information "
           "from %s: %s",
           device, STRERRNO);
     return -1;
   }
 
-  n_stats = (size_t)drvinfo.n_stats;
-  if (n_stats < 1) {
-    close(fd);
+  if (drvinfo.n_stats < 1) {
     ERROR("ethstat plugin: No stats available for %s", device);
+    ethstat_interface_reset(iface);
     return -1;
   }
 
-  strings_size = sizeof(struct ethtool_gstrings) + (n_stats * ETH_GSTRING_LEN);
-  stats_size = sizeof(struct ethtool_stats) + (n_stats * sizeof(uint64_t));
-
-  strings = malloc(strings_size);
-  stats = malloc(stats_size);
-  if ((strings == NULL) || (stats == NULL)) {
-    close(fd);
-    sfree(strings);
-    sfree(stats);
-    ERROR("ethstat plugin: malloc failed.");
-    return -1;
-  }
-
-  strings->cmd = ETHTOOL_GSTRINGS;
-  strings->string_set = ETH_SS_STATS;
-  strings->len = n_stats;
-  req.ifr_data = (void *)strings;
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Cannot get strings from %s: %s", device, STRERRNO);
-    return -1;
+  /* The names only have to be fetched again if the driver changed. */
+  if ((iface->n_stats == 0) ||
+      !ethstat_drvinfo_equal(&iface->drvinfo, &drvinfo)) {
+    status = ethstat_interface_load(iface, &drvinfo);
+    if (status != 0)
+      return status;
   }
 
+  struct ethtool_stats *stats = iface->stats;
   stats->cmd = ETHTOOL_GSTATS;
-  stats->n_stats = n_stats;
+  stats->n_stats = iface->n_stats;
   req.ifr_data = (void *)stats;
-  status = ioctl(fd, SIOCETHTOOL, &req);
+  status = ioctl(ethstat_fd, SIOCETHTOOL, &req);
   if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
     ERROR("ethstat plugin: Reading statistics from %s failed: %s", device,
           STRERRNO);
     return -1;
   }
 
-  for (size_t i = 0; i < n_stats; i++) {
-    char *stat_name;
-
-    stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
-    /* Remove leading spaces in key name */
-    while (isspace((int)*stat_name))
-      stat_name++;
+  for (size_t i = 0; i < iface->n_stats; i++) {
+    /* If the "MappedOnly" option is specified, ignore unmapped values. */
+    if (collect_mapped_only && (iface->maps[i] == NULL))
+      continue;
 
-    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device, stat_name,
-          (uint64_t)stats->data[i]);
-    ethstat_submit_value(device, stat_name, (derive_t)stats->data[i]);
+    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device,
+          iface->stat_names[i], (uint64_t)stats->data[i]);
+    ethstat_submit_value(device, iface->stat_names[i], iface->maps[i],
+                         (derive_t)stats->data[i]);
   }
 
-  close(fd);
-  sfree(strings);
-  sfree(stats);
-
   return 0;
 } /* }}} ethstat_read_interface */
 
 static int ethstat_read(void) {
+  static c_complain_t complain_no_map = C_COMPLAIN_INIT_STATIC;
+
+  if (collect_mapped_only && (value_map == NULL)) {
+    c_complain(
+        LOG_WARNING, &complain_no_map,
+        "ethstat plugin: The \"MappedOnly\" option has been set to true, "
+        "but no mapping has been configured. All values will be ignored!");
+    return 0;
+  }
+
+  if (ethstat_fd < 0) {
+    ethstat_fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
+    if (ethstat_fd < 0) {
+      ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
+      return -1;
+    }
+  }
+
   for (size_t i = 0; i < interfaces_num; i++)
-    ethstat_read_interface(interfaces[i]);
+    ethstat_read_interface(interfaces + i);
 
   return 0;
 }
@@ -300,6 +350,18 @@ static int ethstat_shutdown(void) {
   void *key = NULL;
   void *value = NULL;
 
+  if (ethstat_fd >= 0) {
+    close(ethstat_fd);
+    ethstat_fd = -1;
+  }
+
+  for (size_t i = 0; i < interfaces_num; i++) {
+    ethstat_interface_reset(interfaces + i);
+    sfree(interfaces[i].name);
+  }
+  sfree(interfaces);
+  interfaces_num = 0;
+
   if (value_map == NULL)
     return 0;
 
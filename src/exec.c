@@ -33,9 +33,11 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include "utils/cmds/putnotif.h"
 #include "utils/cmds/putval.h"
+#include "utils/network_parse/network_parse.h"
 
 #include <grp.h>
 #include <poll.h>
@@ -51,6 +53,8 @@ extern char **environ;
 
 #define PL_NORMAL 0x01
 #define PL_NOTIF_ACTION 0x02
+/* The program writes the binary network protocol rather than text commands. */
+#define PL_BINARY 0x04
 
 #define PL_RUNNING 0x10
 
@@ -78,6 +82,15 @@ struct program_list_s {
   program_list_t *next;
 };
 
+/* Input from a `BinaryExec' program. Parts of the network protocol are at most
+ * 64 KiB long, so `buffer' always has room for at least one complete part. */
+typedef struct {
+  char buffer[65536];
+  size_t fill;
+  network_parse_state_t state;
+  c_complain_t complaint;
+} binary_input_t;
+
 typedef struct program_list_and_notification_s {
   program_list_t *pl;
   notification_t n;
@@ -143,6 +156,8 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
 
   if (strcasecmp("NotificationExec", ci->key) == 0)
     pl->flags |= PL_NOTIF_ACTION;
+  else if (strcasecmp("BinaryExec", ci->key) == 0)
+    pl->flags |= PL_NORMAL | PL_BINARY;
   else
     pl->flags |= PL_NORMAL;
 
@@ -241,6 +256,7 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if ((strcasecmp("Exec", child->key) == 0) ||
+        (strcasecmp("BinaryExec", child->key) == 0) ||
         (strcasecmp("NotificationExec", child->key) == 0))
       exec_config_exec(child);
     else {
@@ -554,19 +570,80 @@ failed:
   return -1;
 } /* int fork_child }}} */
 
-static int parse_line(char *buffer) /* {{{ */
+/* PUTVAL commands are collected in `batch' and dispatched by the caller once
+ * all complete lines read from the program have been parsed. */
+static int parse_line(cmd_putval_batch_t *batch, char *buffer) /* {{{ */
 {
-  if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
-    return cmd_handle_putval(stdout, buffer);
-  else if (strncasecmp("PUTNOTIF", buffer, strlen("PUTNOTIF")) == 0)
+  if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0) {
+    cmd_error_handler_t err = {cmd_error_fh, stdout};
+    return cmd_putval_batch_add(batch, buffer, NULL, &err);
+  } else if (strncasecmp("PUTNOTIF", buffer, strlen("PUTNOTIF")) == 0) {
+    /* Keep values and notifications in the order they were received. */
+    cmd_putval_batch_dispatch(batch);
     return handle_putnotif(stdout, buffer);
-  else {
+  } else {
     ERROR("exec plugin: Unable to parse command, ignoring line: \"%s\"",
           buffer);
     return -1;
   }
 } /* int parse_line }}} */
 
+/* Dispatches all complete parts in the buffer of `bi'. Returns non-zero if
+ * the input is corrupt; since parts cannot be resynchronized, reading has to
+ * stop then. */
+static int exec_parse_binary(program_list_t *pl, binary_input_t *bi) /* {{{ */
+{
+  char *ptr = bi->buffer;
+  size_t len = bi->fill;
+  int status = 0;
+
+  while (len > 0) {
+    size_t part_size = network_parse_part_size(ptr, len);
+    if (part_size == 0)
+      break; /* incomplete header */
+    if (part_size < 2 * sizeof(uint16_t)) {
+      status = -1;
+      break;
+    }
+    if (part_size > len)
+      break; /* incomplete part */
+
+    void *part = ptr;
+    size_t part_len = part_size;
+    status = network_parse_part(&bi->state, &part, &part_len);
+    if (status < 0)
+      break;
+
+    if (status == NETWORK_PARSE_VALUES) {
+      value_list_t *vl = &bi->state.vl;
+      if ((vl->plugin[0] == 0) || (vl->type[0] == 0))
+        c_complain(LOG_WARNING, &bi->complaint,
+                   "exec plugin: `%s' sent values without plugin or type; "
+                   "ignoring them.",
+                   pl->exec);
+      else
+        plugin_dispatch_values(vl);
+      network_parse_state_free(&bi->state);
+    } else if (status == NETWORK_PARSE_NOTIFICATION) {
+      plugin_dispatch_notification(&bi->state.n);
+    }
+    status = 0;
+
+    ptr += part_size;
+    len -= part_size;
+  }
+
+  if (status != 0) {
+    ERROR("exec plugin: `%s' sent a malformed part of the binary protocol.",
+          pl->exec);
+    return status;
+  }
+
+  memmove(bi->buffer, ptr, len);
+  bi->fill = len;
+  return 0;
+} /* int exec_parse_binary }}} */
+
 static void *exec_read_one(void *arg) /* {{{ */
 {
   program_list_t *pl = (program_list_t *)arg;
@@ -577,9 +654,23 @@ static void *exec_read_one(void *arg) /* {{{ */
   char buffer_err[1024];
   char *pbuffer = buffer;
   char *pbuffer_err = buffer_err;
-
-  status = fork_child(pl, NULL, &fd, &fd_err);
+  cmd_putval_batch_t *batch = NULL;
+  binary_input_t *bi = NULL;
+
+  if (pl->flags & PL_BINARY) {
+    bi = calloc(1, sizeof(*bi));
+    if (bi != NULL)
+      C_COMPLAIN_INIT(&bi->complaint);
+  } else
+    batch = cmd_putval_batch_create();
+  if ((batch == NULL) && (bi == NULL)) {
+    ERROR("exec plugin: Allocating the input buffer failed.");
+    status = -1;
+  } else
+    status = fork_child(pl, NULL, &fd, &fd_err);
   if (status < 0) {
+    cmd_putval_batch_destroy(batch);
+    sfree(bi);
     /* Reset the "running" flag */
     pthread_mutex_lock(&pl_lock);
     pl->flags &= ~PL_RUNNING;
@@ -605,7 +696,25 @@ static void *exec_read_one(void *arg) /* {{{ */
       break;
     }
 
-    if (fds[0].revents & (POLLIN | POLLHUP)) {
+    if ((bi != NULL) && (fds[0].revents & (POLLIN | POLLHUP))) {
+      len = read(fd, bi->buffer + bi->fill, sizeof(bi->buffer) - bi->fill);
+
+      if (len < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+          continue;
+        break;
+      } else if (len == 0)
+        break; /* We've reached EOF */
+
+      bi->fill += (size_t)len;
+      if (exec_parse_binary(pl, bi) != 0) {
+        /* Close the pipe so the program doesn't block writing to it while we
+         * wait for it to exit. */
+        close(fd);
+        fd = -1;
+        break;
+      }
+    } else if (fds[0].revents & (POLLIN | POLLHUP)) {
       char *pnl;
 
       len = read(fd, pbuffer, sizeof(buffer) - 1 - (pbuffer - buffer));
@@ -627,10 +736,11 @@ static void *exec_read_one(void *arg) /* {{{ */
         if (*(pnl - 1) == '\r')
           *(pnl - 1) = '\0';
 
-        parse_line(pbuffer);
+        parse_line(batch, pbuffer);
 
         pbuffer = ++pnl;
       }
+      cmd_putval_batch_dispatch(batch);
       /* not completely read ? */
       if (pbuffer - buffer < len) {
         len -= pbuffer - buffer;
@@ -709,10 +819,16 @@ static void *exec_read_one(void *arg) /* {{{ */
   pl->flags &= ~PL_RUNNING;
   pthread_mutex_unlock(&pl_lock);
 
-  close(fd);
+  if (fd >= 0)
+    close(fd);
   if (fd_err >= 0)
     close(fd_err);
 
+  cmd_putval_batch_destroy(batch);
+  if (bi != NULL)
+    network_parse_state_free(&bi->state);
+  sfree(bi);
+
   pthread_exit((void *)0);
   return NULL;
 } /* void *exec_read_one }}} */
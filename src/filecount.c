@@ -24,6 +24,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <dirent.h>
@@ -31,11 +32,30 @@
 #include <fnmatch.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 #define FC_RECURSIVE 1
 #define FC_HIDDEN 2
 #define FC_REGULAR 4
 
+#define FC_DEFAULT_RESCAN_INTERVAL TIME_T_TO_CDTIME_T(3600)
+
+#if HAVE_SYS_INOTIFY_H
+/* Size changes of a file are picked up once it is closed. */
+#define FC_WATCH_MASK                                                          \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |     \
+   IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW)
+#endif
+
+/* A file counted by a watched directory. */
+struct fc_file_s {
+  uint64_t size;
+  char path[];
+};
+typedef struct fc_file_s fc_file_t;
+
 struct fc_directory_conf_s {
   char *path;
   char *plugin_name;
@@ -57,13 +77,60 @@ struct fc_directory_conf_s {
 
   /* Helper for the recursive functions */
   time_t now;
+
+  /* With "Watch" enabled, the counters are updated from inotify(7) events
+   * and the directory is only scanned once per "RescanInterval". */
+  bool watch;
+  cdtime_t rescan_interval;
+  cdtime_t next_scan;
+  int notify_fd;
+  c_avl_tree_t *watches; /* watch descriptor -> path of the directory */
+  c_avl_tree_t *files;   /* path -> fc_file_t of the counted files */
 };
 typedef struct fc_directory_conf_s fc_directory_conf_t;
 
 static fc_directory_conf_t **directories;
 static size_t directories_num;
 
+#if HAVE_SYS_INOTIFY_H
+static int fc_compare_wd(const void *a, const void *b) {
+  int wd_a = *(const int *)a;
+  int wd_b = *(const int *)b;
+  return (wd_a > wd_b) - (wd_a < wd_b);
+} /* int fc_compare_wd */
+#endif
+
+static void fc_watch_stop(fc_directory_conf_t *dir) {
+  if (dir->notify_fd >= 0) {
+    close(dir->notify_fd);
+    dir->notify_fd = -1;
+  }
+
+  if (dir->watches != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(dir->watches, &key, &value) == 0) {
+      sfree(key);
+      sfree(value);
+    }
+    c_avl_destroy(dir->watches);
+    dir->watches = NULL;
+  }
+
+  if (dir->files != NULL) {
+    void *key;
+    void *value;
+    /* The key is part of the value. */
+    while (c_avl_pick(dir->files, &key, &value) == 0)
+      sfree(value);
+    c_avl_destroy(dir->files);
+    dir->files = NULL;
+  }
+} /* void fc_watch_stop */
+
 static void fc_free_dir(fc_directory_conf_t *dir) {
+  fc_watch_stop(dir);
+
   sfree(dir->path);
   sfree(dir->plugin_name);
   sfree(dir->instance);
@@ -113,6 +180,8 @@ static void fc_submit_dir(const fc_directory_conf_t *dir) {
  *     FilesSizeType "bytes"
  *     FilesCountType "files"
  *     TypeInstance "instance"
+ *     Watch false
+ *     RescanInterval 3600
  *   </Directory>
  * </Plugin>
  *
@@ -329,6 +398,8 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
   dir->type_instance = NULL;
   dir->mtime = 0;
   dir->size = 0;
+  dir->rescan_interval = FC_DEFAULT_RESCAN_INTERVAL;
+  dir->notify_fd = -1;
 
   dir->files_size_type = strdup("bytes");
   dir->files_num_type = strdup("files");
@@ -366,6 +437,10 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &dir->files_num_type);
     else if (strcasecmp("TypeInstance", option->key) == 0)
       status = cf_util_get_string(option, &dir->type_instance);
+    else if (strcasecmp("Watch", option->key) == 0)
+      status = cf_util_get_boolean(option, &dir->watch);
+    else if (strcasecmp("RescanInterval", option->key) == 0)
+      status = cf_util_get_cdtime(option, &dir->rescan_interval);
     else {
       WARNING("filecount plugin: fc_config_add_dir: "
               "Option `%s' not allowed here.",
@@ -392,6 +467,23 @@ static int fc_config_add_dir(oconfig_item_t *ci) {
     }
   }
 
+#if !HAVE_SYS_INOTIFY_H
+  if (dir->watch) {
+    WARNING("filecount plugin: `Watch' is not supported on this system. "
+            "Counting the files of '%s' by scanning the directory.",
+            dir->path);
+    dir->watch = false;
+  }
+#endif
+
+  /* Whether a file matches "MTime" changes without any event. */
+  if (dir->watch && (dir->mtime != 0)) {
+    WARNING("filecount plugin: `Watch' can not be combined with `MTime'. "
+            "Counting the files of '%s' by scanning the directory.",
+            dir->path);
+    dir->watch = false;
+  }
+
   /* Handle disabled types */
   if (strlen(dir->instance) == 0)
     sfree(dir->instance);
@@ -449,42 +541,29 @@ static int fc_init(void) {
   return 0;
 } /* int fc_init */
 
-static int fc_read_dir_callback(const char *dirname, const char *filename,
-                                void *user_data) {
-  fc_directory_conf_t *dir = user_data;
-  char abs_path[PATH_MAX];
-  struct stat statbuf;
-
-  if (dir == NULL)
-    return -1;
-
-  snprintf(abs_path, sizeof(abs_path), "%s/%s", dirname, filename);
-
-  int status = lstat(abs_path, &statbuf);
-  if (status != 0) {
-    ERROR("filecount plugin: stat (%s) failed.", abs_path);
-    return -1;
-  }
-
-  if (S_ISDIR(statbuf.st_mode) && (dir->options & FC_RECURSIVE)) {
-    status = walk_directory(
-        abs_path, fc_read_dir_callback, dir,
-        /* include hidden = */ (dir->options & FC_HIDDEN) ? 1 : 0);
-    return status;
-  } else if ((dir->options & FC_REGULAR) && !S_ISREG(statbuf.st_mode)) {
-    return 0;
-  }
-
-  if (dir->name != NULL) {
-    status = fnmatch(dir->name, filename, /* flags = */ 0);
-    if (status != 0)
-      return 0;
-  }
-
-  if (!S_ISREG(statbuf.st_mode)) {
-    dir->files_num++;
-    return 0;
-  }
+static bool fc_name_included(const fc_directory_conf_t *dir, const char *name) {
+  if ((strcmp(".", name) == 0) || (strcmp("..", name) == 0))
+    return false;
+  if (!(dir->options & FC_HIDDEN) && (name[0] == '.'))
+    return false;
+  return true;
+} /* bool fc_name_included */
+
+static bool fc_name_matches(const fc_directory_conf_t *dir, const char *name) {
+  if (dir->name == NULL)
+    return true;
+  return fnmatch(dir->name, name, /* flags = */ 0) == 0;
+} /* bool fc_name_matches */
+
+/* Applies the selectors other than "Name" to an entry that is not descended
+ * into. */
+static bool fc_entry_matches(const fc_directory_conf_t *dir,
+                             const struct stat *statbuf) {
+  if ((dir->options & FC_REGULAR) && !S_ISREG(statbuf->st_mode))
+    return false;
+
+  if (!S_ISREG(statbuf->st_mode))
+    return true;
 
   if (dir->mtime != 0) {
     time_t mtime = dir->now;
@@ -497,9 +576,9 @@ static int fc_read_dir_callback(const char *dirname, const char *filename,
     DEBUG("filecount plugin: Only collecting files that were touched %s %u.",
           (dir->mtime < 0) ? "after" : "before", (unsigned int)mtime);
 
-    if (((dir->mtime < 0) && (statbuf.st_mtime < mtime)) ||
-        ((dir->mtime > 0) && (statbuf.st_mtime > mtime)))
-      return 0;
+    if (((dir->mtime < 0) && (statbuf->st_mtime < mtime)) ||
+        ((dir->mtime > 0) && (statbuf->st_mtime > mtime)))
+      return false;
   }
 
   if (dir->size != 0) {
@@ -510,29 +589,328 @@ static int fc_read_dir_callback(const char *dirname, const char *filename,
     else
       size = (off_t)dir->size;
 
-    if (((dir->size < 0) && (statbuf.st_size > size)) ||
-        ((dir->size > 0) && (statbuf.st_size < size)))
-      return 0;
+    if (((dir->size < 0) && (statbuf->st_size > size)) ||
+        ((dir->size > 0) && (statbuf->st_size < size)))
+      return false;
+  }
+
+  return true;
+} /* bool fc_entry_matches */
+
+/* Adds a matching file to the counters. Files of watched directories are
+ * remembered, so counting a file again only updates its size. */
+static int fc_count_file(fc_directory_conf_t *dir, const char *path,
+                         uint64_t size) {
+  if (dir->files == NULL) {
+    dir->files_num++;
+    dir->files_size += size;
+    return 0;
+  }
+
+  fc_file_t *file = NULL;
+  if (c_avl_get(dir->files, path, (void *)&file) == 0) {
+    dir->files_size = dir->files_size - file->size + size;
+    file->size = size;
+    return 0;
+  }
+
+  size_t path_len = strlen(path);
+  file = malloc(sizeof(*file) + path_len + 1);
+  if (file == NULL) {
+    ERROR("filecount plugin: malloc failed.");
+    return -1;
+  }
+  file->size = size;
+  memcpy(file->path, path, path_len + 1);
+
+  if (c_avl_insert(dir->files, file->path, file) != 0) {
+    ERROR("filecount plugin: c_avl_insert failed.");
+    sfree(file);
+    return -1;
   }
 
   dir->files_num++;
-  dir->files_size += (uint64_t)statbuf.st_size;
+  dir->files_size += size;
+  return 0;
+} /* int fc_count_file */
 
+#if HAVE_SYS_INOTIFY_H
+static int fc_watch_start(fc_directory_conf_t *dir) {
+  fc_watch_stop(dir);
+
+  dir->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (dir->notify_fd < 0) {
+    ERROR("filecount plugin: inotify_init1 failed: %s", STRERRNO);
+    return -1;
+  }
+
+  dir->watches = c_avl_create(fc_compare_wd);
+  dir->files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((dir->watches == NULL) || (dir->files == NULL)) {
+    ERROR("filecount plugin: c_avl_create failed.");
+    fc_watch_stop(dir);
+    return -1;
+  }
+
+  return 0;
+} /* int fc_watch_start */
+
+static int fc_watch_add_dir(fc_directory_conf_t *dir, const char *path) {
+  int wd = inotify_add_watch(dir->notify_fd, path, FC_WATCH_MASK);
+  if (wd < 0) {
+    WARNING("filecount plugin: Watching \"%s\" failed: %s. Counting the "
+            "files of '%s' by scanning the directory.",
+            path, STRERRNO, dir->path);
+    return -1;
+  }
+
+  char *path_copy = strdup(path);
+  if (path_copy == NULL) {
+    ERROR("filecount plugin: strdup failed.");
+    return -1;
+  }
+
+  /* The same directory may be reached twice, e.g. by being moved. */
+  char *old_path = NULL;
+  if (c_avl_get(dir->watches, &wd, (void *)&old_path) == 0) {
+    int *key = NULL;
+    c_avl_remove(dir->watches, &wd, (void *)&key, (void *)&old_path);
+    sfree(key);
+    sfree(old_path);
+  }
+
+  int *key = malloc(sizeof(*key));
+  if (key == NULL) {
+    ERROR("filecount plugin: malloc failed.");
+    sfree(path_copy);
+    return -1;
+  }
+  *key = wd;
+
+  if (c_avl_insert(dir->watches, key, path_copy) != 0) {
+    ERROR("filecount plugin: c_avl_insert failed.");
+    sfree(key);
+    sfree(path_copy);
+    return -1;
+  }
+
+  return 0;
+} /* int fc_watch_add_dir */
+
+static void fc_watch_remove_file(fc_directory_conf_t *dir, const char *path) {
+  char *key = NULL;
+  fc_file_t *file = NULL;
+
+  if (c_avl_remove(dir->files, path, (void *)&key, (void *)&file) != 0)
+    return;
+
+  dir->files_num--;
+  dir->files_size -= file->size;
+  sfree(file);
+} /* void fc_watch_remove_file */
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* Counts the entries of the directory "name" below the directory referred to
+ * by "parent_fd". "path" is the same directory as a path usable without
+ * "parent_fd", it is required for watching the directory and for messages. */
+static int fc_scan_dir(fc_directory_conf_t *dir, int parent_fd,
+                       const char *name, const char *path) {
+  int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("filecount plugin: Cannot open '%s': %s", path, STRERRNO);
+    return -1;
+  }
+
+  DIR *dh = fdopendir(fd);
+  if (dh == NULL) {
+    ERROR("filecount plugin: fdopendir (%s) failed: %s", path, STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  /* Watching before reading the entries makes sure no change is missed. */
+  if ((dir->notify_fd >= 0) && (fc_watch_add_dir(dir, path) != 0)) {
+    fc_watch_stop(dir);
+    dir->watch = false;
+  }
+#endif
+
+  int success = 0;
+  int failure = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dh)) != NULL) {
+    if (!fc_name_included(dir, ent->d_name))
+      continue;
+
+    /* The type reported by readdir(3) spares the stat(2) call for most
+     * entries that are not counted. */
+    bool name_checked = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if ((ent->d_type != DT_UNKNOWN) &&
+        !((ent->d_type == DT_DIR) && (dir->options & FC_RECURSIVE))) {
+      if ((dir->options & FC_REGULAR) && (ent->d_type != DT_REG))
+        continue;
+      if (!fc_name_matches(dir, ent->d_name))
+        continue;
+      name_checked = true;
+    }
+#endif
+
+    struct stat statbuf;
+    if (fstatat(fd, ent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+      /* Files come and go in spool directories. */
+      if (errno == ENOENT)
+        continue;
+      ERROR("filecount plugin: stat (%s/%s) failed: %s", path, ent->d_name,
+            STRERRNO);
+      failure++;
+      continue;
+    }
+
+    char abs_path[PATH_MAX];
+    int status = 0;
+    if (S_ISDIR(statbuf.st_mode) && (dir->options & FC_RECURSIVE)) {
+      snprintf(abs_path, sizeof(abs_path), "%s/%s", path, ent->d_name);
+      status = fc_scan_dir(dir, fd, ent->d_name, abs_path);
+    } else if ((name_checked || fc_name_matches(dir, ent->d_name)) &&
+               fc_entry_matches(dir, &statbuf)) {
+      uint64_t size =
+          S_ISREG(statbuf.st_mode) ? (uint64_t)statbuf.st_size : 0;
+      /* The path is only needed to remember the file. */
+      if (dir->files != NULL)
+        snprintf(abs_path, sizeof(abs_path), "%s/%s", path, ent->d_name);
+      status = fc_count_file(dir, (dir->files != NULL) ? abs_path : NULL,
+                             size);
+    }
+
+    if (status != 0)
+      failure++;
+    else
+      success++;
+  }
+
+  closedir(dh);
+
+  if ((success == 0) && (failure > 0))
+    return -1;
   return 0;
-} /* int fc_read_dir_callback */
+} /* int fc_scan_dir */
+
+#if HAVE_SYS_INOTIFY_H
+/* Updates the counters of a watched directory from the events queued since
+ * the last read. Returns non-zero if the directory needs to be scanned. */
+static int fc_watch_read(fc_directory_conf_t *dir) {
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool rescan = false;
+  ssize_t len;
+
+  while ((len = read(dir->notify_fd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      struct inotify_event *event = (struct inotify_event *)ptr;
+      ptr += sizeof(*event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        WARNING("filecount plugin: Events of '%s' have been lost. Scanning "
+                "the directory.",
+                dir->path);
+        rescan = true;
+        continue;
+      }
+
+      char *dir_path = NULL;
+      if (c_avl_get(dir->watches, &event->wd, (void *)&dir_path) != 0)
+        continue;
+
+      if (event->mask & IN_IGNORED) {
+        int *key = NULL;
+        c_avl_remove(dir->watches, &event->wd, (void *)&key,
+                     (void *)&dir_path);
+        sfree(key);
+        sfree(dir_path);
+        continue;
+      }
+
+      if ((event->len == 0) || !fc_name_included(dir, event->name))
+        continue;
+
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s/%s", dir_path, event->name);
+
+      bool subdir = (event->mask & IN_ISDIR) && (dir->options & FC_RECURSIVE);
+      if (subdir && (event->mask & IN_MOVED_FROM)) {
+        /* The files below the directory are not known individually. */
+        rescan = true;
+      } else if (subdir && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+        if (fc_scan_dir(dir, AT_FDCWD, path, path) != 0)
+          rescan = true;
+      } else if (subdir) {
+        /* The files of a deleted directory have been deleted before. */
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        fc_watch_remove_file(dir, path);
+      } else {
+        struct stat statbuf;
+        if (lstat(path, &statbuf) != 0) {
+          fc_watch_remove_file(dir, path);
+        } else if (fc_name_matches(dir, event->name) &&
+                   fc_entry_matches(dir, &statbuf)) {
+          uint64_t size =
+              S_ISREG(statbuf.st_mode) ? (uint64_t)statbuf.st_size : 0;
+          if (fc_count_file(dir, path, size) != 0)
+            rescan = true;
+        } else {
+          fc_watch_remove_file(dir, path);
+        }
+      }
+
+      /* fc_scan_dir() stops watching if adding a watch fails. */
+      if (dir->notify_fd < 0)
+        return -1;
+    }
+  }
+
+  if ((len < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+    ERROR("filecount plugin: Reading events of '%s' failed: %s", dir->path,
+          STRERRNO);
+    return -1;
+  }
+
+  return rescan ? 1 : 0;
+} /* int fc_watch_read */
+#endif /* HAVE_SYS_INOTIFY_H */
 
 static int fc_read_dir(fc_directory_conf_t *dir) {
+#if HAVE_SYS_INOTIFY_H
+  if (dir->watch) {
+    cdtime_t now = cdtime();
+
+    if ((dir->notify_fd >= 0) && (now < dir->next_scan) &&
+        (fc_watch_read(dir) == 0)) {
+      fc_submit_dir(dir);
+      return 0;
+    }
+
+    /* A full scan also corrects anything the events may have missed. */
+    if (dir->watch && (fc_watch_start(dir) != 0)) {
+      WARNING("filecount plugin: Counting the files of '%s' by scanning the "
+              "directory.",
+              dir->path);
+      dir->watch = false;
+    }
+    dir->next_scan = now + dir->rescan_interval;
+  }
+#endif
+
   dir->files_num = 0;
   dir->files_size = 0;
 
   if (dir->mtime != 0)
     dir->now = time(NULL);
 
-  int status =
-      walk_directory(dir->path, fc_read_dir_callback, dir,
-                     /* include hidden */ (dir->options & FC_HIDDEN) ? 1 : 0);
+  int status = fc_scan_dir(dir, AT_FDCWD, dir->path, dir->path);
   if (status != 0) {
-    WARNING("filecount plugin: walk_directory (%s) failed.", dir->path);
+    WARNING("filecount plugin: Scanning '%s' failed.", dir->path);
+    fc_watch_stop(dir);
     return -1;
   }
 
@@ -548,8 +926,18 @@ static int fc_read(void) {
   return 0;
 } /* int fc_read */
 
+static int fc_shutdown(void) {
+  for (size_t i = 0; i < directories_num; i++)
+    fc_free_dir(directories[i]);
+  sfree(directories);
+  directories_num = 0;
+
+  return 0;
+} /* int fc_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("filecount", fc_config);
   plugin_register_init("filecount", fc_init);
   plugin_register_read("filecount", fc_read);
+  plugin_register_shutdown("filecount", fc_shutdown);
 } /* void module_register */
@@ -24,11 +24,13 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "plugin.h"
-#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 
 #if HAVE_NETDB_H
 #include <netdb.h>
@@ -59,6 +61,21 @@
 #define BUFF_SIZE 1400
 #endif
 
+/* Number of datagrams read with one recvmmsg(2) call. */
+#define RECEIVE_BATCH_SIZE 32
+
+#define STAGING_SHARDS_NUM 16
+
+#if HAVE_RECVMMSG
+typedef struct mmsghdr receive_msg_t;
+#else
+/* Without recvmmsg(2), only one datagram is read at a time. */
+typedef struct {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+} receive_msg_t;
+#endif
+
 struct socket_entry_s {
   int fd;
   struct sockaddr_storage addr;
@@ -73,6 +90,37 @@ struct staging_entry_s {
 };
 typedef struct staging_entry_s staging_entry_t;
 
+/* The staging table is split into shards by host, so that receive threads
+ * handling different hosts don't contend for the same lock. */
+struct staging_shard_s {
+  c_hashtable_t *table;
+  pthread_mutex_t lock;
+};
+typedef struct staging_shard_s staging_shard_t;
+
+/* The parts of a received message used by this plugin, decoded by
+ * mc_decode_value_msg() and mc_decode_metadata_msg(). The strings are copied
+ * out of the packet, so decoding a message doesn't allocate memory. */
+struct mc_msg_s {
+  Ganglia_msg_formats format;
+  char host[DATA_MAX_NAME_LEN];
+  char name[DATA_MAX_NAME_LEN];
+  union {
+    int64_t i;
+    double d;
+    char str[DATA_MAX_NAME_LEN];
+  } value;
+  uint32_t tmax;
+};
+typedef struct mc_msg_s mc_msg_t;
+
+/* Read position in a packet being decoded. */
+struct mc_xdr_s {
+  const uint8_t *ptr;
+  const uint8_t *end;
+};
+typedef struct mc_xdr_s mc_xdr_t;
+
 struct metric_map_s {
   char *ganglia_name;
   char *type;
@@ -88,16 +136,17 @@ static char *mc_receive_group;
 #define MC_RECEIVE_PORT_DEFAULT "8649"
 static char *mc_receive_port;
 
-static struct pollfd *mc_receive_sockets;
+static socket_entry_t *mc_receive_sockets;
 static size_t mc_receive_sockets_num;
 
 static socket_entry_t *mc_send_sockets;
 static size_t mc_send_sockets_num;
 static pthread_mutex_t mc_send_sockets_lock = PTHREAD_MUTEX_INITIALIZER;
 
+static int mc_receive_threads_num = 1;
 static int mc_receive_thread_loop;
-static int mc_receive_thread_running;
-static pthread_t mc_receive_thread_id;
+static pthread_t *mc_receive_thread_ids;
+static size_t mc_receive_threads_running;
 
 static metric_map_t metric_map_default[] =
     {/*---------------+-------------+-----------+-------------+------+-----*
@@ -125,8 +174,7 @@ static size_t metric_map_len_default = STATIC_ARRAY_SIZE(metric_map_default);
 static metric_map_t *metric_map;
 static size_t metric_map_len;
 
-static c_avl_tree_t *staging_tree;
-static pthread_mutex_t staging_lock = PTHREAD_MUTEX_INITIALIZER;
+static staging_shard_t staging_shards[STAGING_SHARDS_NUM];
 
 static metric_map_t *metric_lookup(const char *key) /* {{{ */
 {
@@ -386,22 +434,44 @@ static int request_meta_data(const char *host, const char *name) /* {{{ */
   return 0;
 } /* }}} int request_meta_data */
 
-static staging_entry_t *staging_entry_get(const char *host, /* {{{ */
-                                          const char *name, const char *type,
+/* FNV-1a, continuing from `hash'. */
+static uint64_t staging_hash(uint64_t hash, const char *str) /* {{{ */
+{
+  for (; *str != 0; str++) {
+    hash ^= (uint64_t)(unsigned char)*str;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* }}} uint64_t staging_hash */
+
+#define STAGING_HASH_INIT 14695981039346656037ULL
+
+static staging_shard_t *staging_shard_get(const char *host) /* {{{ */
+{
+  uint64_t hash = staging_hash(STAGING_HASH_INIT, host);
+  return staging_shards + (hash % STAGING_SHARDS_NUM);
+} /* }}} staging_shard_t *staging_shard_get */
+
+/* Looks up or creates the entry of a metric. The lock of `shard' must be
+ * held. */
+static staging_entry_t *staging_entry_get(staging_shard_t *shard, /* {{{ */
+                                          const char *host, const char *type,
                                           const char *type_instance,
                                           int values_len) {
   char key[2 * DATA_MAX_NAME_LEN];
   staging_entry_t *se;
+  uint64_t hash;
   int status;
 
-  if (staging_tree == NULL)
+  if (shard->table == NULL)
     return NULL;
 
   ssnprintf(key, sizeof(key), "%s/%s/%s", host, type,
             (type_instance != NULL) ? type_instance : "");
+  hash = staging_hash(STAGING_HASH_INIT, key);
 
   se = NULL;
-  status = c_avl_get(staging_tree, key, (void *)&se);
+  status = c_hashtable_get(shard->table, hash, key, (void *)&se);
   if (status == 0)
     return se;
 
@@ -428,9 +498,9 @@ static staging_entry_t *staging_entry_get(const char *host, /* {{{ */
   if (type_instance != NULL)
     sstrncpy(se->vl.type_instance, type_instance, sizeof(se->vl.type_instance));
 
-  status = c_avl_insert(staging_tree, se->key, se);
+  status = c_hashtable_insert(shard->table, hash, se->key, se);
   if (status != 0) {
-    ERROR("gmond plugin: c_avl_insert failed.");
+    ERROR("gmond plugin: c_hashtable_insert failed.");
     sfree(se->vl.values);
     sfree(se);
     return NULL;
@@ -458,16 +528,17 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
     return -1;
   }
 
-  pthread_mutex_lock(&staging_lock);
+  staging_shard_t *shard = staging_shard_get(host);
+  pthread_mutex_lock(&shard->lock);
 
-  se = staging_entry_get(host, name, type, type_instance, ds->ds_num);
+  se = staging_entry_get(shard, host, type, type_instance, ds->ds_num);
   if (se == NULL) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     ERROR("gmond plugin: staging_entry_get failed.");
     return -1;
   }
   if (se->vl.values_len != ds->ds_num) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
@@ -486,7 +557,7 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
 
   /* Check if all data sources have been set. If not, return here. */
   if (se->flags != ((0x01 << se->vl.values_len) - 1)) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     return 0;
   }
 
@@ -495,7 +566,7 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
   if (se->vl.interval == 0) {
     /* No meta data has been received for this metric yet. */
     se->flags = 0;
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
 
     request_meta_data(host, name);
     return 0;
@@ -504,96 +575,175 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
   plugin_dispatch_values(&se->vl);
 
   se->flags = 0;
-  pthread_mutex_unlock(&staging_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* }}} int staging_entry_update */
 
-static int mc_handle_value_msg(Ganglia_value_msg *msg) /* {{{ */
+static int mc_xdr_uint32(mc_xdr_t *x, uint32_t *ret) /* {{{ */
+{
+  if ((x->end - x->ptr) < 4)
+    return -1;
+
+  *ret = ((uint32_t)x->ptr[0] << 24) | ((uint32_t)x->ptr[1] << 16) |
+         ((uint32_t)x->ptr[2] << 8) | (uint32_t)x->ptr[3];
+  x->ptr += 4;
+  return 0;
+} /* }}} int mc_xdr_uint32 */
+
+/* Copies a variable-length string to `buffer', truncating it if necessary. If
+ * `buffer' is NULL, the string is skipped. */
+static int mc_xdr_string(mc_xdr_t *x, char *buffer, /* {{{ */
+                         size_t buffer_size) {
+  uint32_t len;
+
+  if (mc_xdr_uint32(x, &len) != 0)
+    return -1;
+
+  /* The data is padded to a multiple of four bytes. */
+  size_t padded_len = ((size_t)len + 3) & ~((size_t)3);
+  if ((len > (size_t)(x->end - x->ptr)) ||
+      (padded_len > (size_t)(x->end - x->ptr)))
+    return -1;
+
+  if (buffer != NULL) {
+    size_t copy_len = (len < buffer_size) ? len : (buffer_size - 1);
+    memcpy(buffer, x->ptr, copy_len);
+    buffer[copy_len] = 0;
+  }
+
+  x->ptr += padded_len;
+  return 0;
+} /* }}} int mc_xdr_string */
+
+static int mc_decode_metric_id(mc_xdr_t *x, mc_msg_t *msg) /* {{{ */
+{
+  uint32_t spoof;
+
+  if ((mc_xdr_string(x, msg->host, sizeof(msg->host)) != 0) ||
+      (mc_xdr_string(x, msg->name, sizeof(msg->name)) != 0))
+    return -1;
+
+  return mc_xdr_uint32(x, &spoof);
+} /* }}} int mc_decode_metric_id */
+
+/* Decodes the Ganglia_gmetric_* structure following the format ID. */
+static int mc_decode_value_msg(mc_xdr_t *x, mc_msg_t *msg) /* {{{ */
+{
+  uint32_t tmp;
+
+  /* Skip the printf(3) format of the value. */
+  if ((mc_decode_metric_id(x, msg) != 0) || (mc_xdr_string(x, NULL, 0) != 0))
+    return -1;
+
+  if (msg->format == gmetric_string)
+    return mc_xdr_string(x, msg->value.str, sizeof(msg->value.str));
+
+  if (mc_xdr_uint32(x, &tmp) != 0)
+    return -1;
+
+  switch (msg->format) {
+  case gmetric_ushort:
+    msg->value.i = (int64_t)(uint16_t)tmp;
+    break;
+  case gmetric_short:
+    msg->value.i = (int64_t)(int16_t)tmp;
+    break;
+  case gmetric_int:
+    msg->value.i = (int64_t)(int32_t)tmp;
+    break;
+  case gmetric_uint:
+    msg->value.i = (int64_t)tmp;
+    break;
+  case gmetric_float: {
+    float f;
+    memcpy(&f, &tmp, sizeof(f));
+    msg->value.d = (double)f;
+    break;
+  }
+  case gmetric_double: {
+    /* The most significant word comes first. */
+    uint32_t low;
+    if (mc_xdr_uint32(x, &low) != 0)
+      return -1;
+    uint64_t bits = ((uint64_t)tmp << 32) | (uint64_t)low;
+    memcpy(&msg->value.d, &bits, sizeof(msg->value.d));
+    break;
+  }
+  default:
+    return -1;
+  }
+
+  return 0;
+} /* }}} int mc_decode_value_msg */
+
+/* Decodes a Ganglia_metadatadef structure up to `tmax'. The remaining fields
+ * are not used. */
+static int mc_decode_metadata_msg(mc_xdr_t *x, mc_msg_t *msg) /* {{{ */
+{
+  uint32_t slope;
+
+  /* Skip the type, name and units of the metric. */
+  if ((mc_decode_metric_id(x, msg) != 0) || (mc_xdr_string(x, NULL, 0) != 0) ||
+      (mc_xdr_string(x, NULL, 0) != 0) || (mc_xdr_string(x, NULL, 0) != 0) ||
+      (mc_xdr_uint32(x, &slope) != 0))
+    return -1;
+
+  return mc_xdr_uint32(x, &msg->tmax);
+} /* }}} int mc_decode_metadata_msg */
+
+static int mc_handle_value_msg(const mc_msg_t *msg) /* {{{ */
 {
-  const char *host;
-  const char *name;
   metric_map_t *map;
 
   value_t value_counter;
   value_t value_gauge;
   value_t value_derive;
 
-  /* Fill in `host', `name', `value_counter', and `value_gauge' according to
+  /* Fill in `value_counter', `value_gauge', and `value_derive' according to
    * the value type, or return with an error. */
-  switch (msg->id) /* {{{ */
+  switch (msg->format) /* {{{ */
   {
-  case gmetric_uint: {
-    Ganglia_gmetric_uint msg_uint;
-
-    msg_uint = msg->Ganglia_value_msg_u.gu_int;
-
-    host = msg_uint.metric_id.host;
-    name = msg_uint.metric_id.name;
-    value_counter.counter = (counter_t)msg_uint.ui;
-    value_gauge.gauge = (gauge_t)msg_uint.ui;
-    value_derive.derive = (derive_t)msg_uint.ui;
+  case gmetric_ushort:
+  case gmetric_short:
+  case gmetric_int:
+  case gmetric_uint:
+    value_counter.counter = (counter_t)msg->value.i;
+    value_gauge.gauge = (gauge_t)msg->value.i;
+    value_derive.derive = (derive_t)msg->value.i;
     break;
-  }
 
   case gmetric_string: {
-    Ganglia_gmetric_string msg_string;
     int status;
 
-    msg_string = msg->Ganglia_value_msg_u.gstr;
-
-    host = msg_string.metric_id.host;
-    name = msg_string.metric_id.name;
-
-    status = parse_value(msg_string.str, &value_derive, DS_TYPE_DERIVE);
+    status = parse_value(msg->value.str, &value_derive, DS_TYPE_DERIVE);
     if (status != 0)
       value_derive.derive = -1;
 
-    status = parse_value(msg_string.str, &value_gauge, DS_TYPE_GAUGE);
+    status = parse_value(msg->value.str, &value_gauge, DS_TYPE_GAUGE);
     if (status != 0)
       value_gauge.gauge = NAN;
 
-    status = parse_value(msg_string.str, &value_counter, DS_TYPE_COUNTER);
+    status = parse_value(msg->value.str, &value_counter, DS_TYPE_COUNTER);
     if (status != 0)
       value_counter.counter = 0;
 
     break;
   }
 
-  case gmetric_float: {
-    Ganglia_gmetric_float msg_float;
-
-    msg_float = msg->Ganglia_value_msg_u.gf;
-
-    host = msg_float.metric_id.host;
-    name = msg_float.metric_id.name;
-    value_counter.counter = (counter_t)msg_float.f;
-    value_gauge.gauge = (gauge_t)msg_float.f;
-    value_derive.derive = (derive_t)msg_float.f;
+  case gmetric_float:
+  case gmetric_double:
+    value_counter.counter = (counter_t)msg->value.d;
+    value_gauge.gauge = (gauge_t)msg->value.d;
+    value_derive.derive = (derive_t)msg->value.d;
     break;
-  }
 
-  case gmetric_double: {
-    Ganglia_gmetric_double msg_double;
-
-    msg_double = msg->Ganglia_value_msg_u.gd;
-
-    host = msg_double.metric_id.host;
-    name = msg_double.metric_id.name;
-    value_counter.counter = (counter_t)msg_double.d;
-    value_gauge.gauge = (gauge_t)msg_double.d;
-    value_derive.derive = (derive_t)msg_double.d;
-    break;
-  }
   default:
-    DEBUG("gmond plugin: Value type not handled: %i", msg->id);
+    DEBUG("gmond plugin: Value type not handled: %i", (int)msg->format);
     return -1;
-  } /* }}} switch (msg->id) */
-
-  assert(host != NULL);
-  assert(name != NULL);
+  } /* }}} switch (msg->format) */
 
-  map = metric_lookup(name);
+  map = metric_lookup(msg->name);
   if (map != NULL) {
     value_t val_copy;
 
@@ -606,60 +756,50 @@ static int mc_handle_value_msg(Ganglia_value_msg *msg) /* {{{ */
     else
       assert(23 == 42);
 
-    return staging_entry_update(host, name, map->type, map->type_instance,
-                                map->ds_index, map->ds_type, val_copy);
+    return staging_entry_update(msg->host, msg->name, map->type,
+                                map->type_instance, map->ds_index, map->ds_type,
+                                val_copy);
   }
 
-  DEBUG("gmond plugin: Cannot find a translation for %s.", name);
+  DEBUG("gmond plugin: Cannot find a translation for %s.", msg->name);
   return -1;
 } /* }}} int mc_handle_value_msg */
 
-static int mc_handle_metadata_msg(Ganglia_metadata_msg *msg) /* {{{ */
+static int mc_handle_metadata_msg(const mc_msg_t *msg) /* {{{ */
 {
-  switch (msg->id) {
-  case gmetadata_full: {
-    Ganglia_metadatadef msg_meta;
-    staging_entry_t *se;
-    const data_set_t *ds;
-    metric_map_t *map;
-
-    msg_meta = msg->Ganglia_metadata_msg_u.gfull;
-
-    if (msg_meta.metric.tmax == 0)
-      return -1;
-
-    map = metric_lookup(msg_meta.metric_id.name);
-    if (map == NULL) {
-      DEBUG("gmond plugin: Not handling meta data %s.",
-            msg_meta.metric_id.name);
-      return 0;
-    }
+  staging_shard_t *shard;
+  staging_entry_t *se;
+  const data_set_t *ds;
+  metric_map_t *map;
 
-    ds = plugin_get_ds(map->type);
-    if (ds == NULL) {
-      WARNING("gmond plugin: Could not find data set %s.", map->type);
-      return -1;
-    }
+  if (msg->tmax == 0)
+    return -1;
 
-    DEBUG("gmond plugin: Received meta data for %s/%s.",
-          msg_meta.metric_id.host, msg_meta.metric_id.name);
+  map = metric_lookup(msg->name);
+  if (map == NULL) {
+    DEBUG("gmond plugin: Not handling meta data %s.", msg->name);
+    return 0;
+  }
 
-    pthread_mutex_lock(&staging_lock);
-    se = staging_entry_get(msg_meta.metric_id.host, msg_meta.metric_id.name,
-                           map->type, map->type_instance, ds->ds_num);
-    if (se != NULL)
-      se->vl.interval = TIME_T_TO_CDTIME_T(msg_meta.metric.tmax);
-    pthread_mutex_unlock(&staging_lock);
+  ds = plugin_get_ds(map->type);
+  if (ds == NULL) {
+    WARNING("gmond plugin: Could not find data set %s.", map->type);
+    return -1;
+  }
 
-    if (se == NULL) {
-      ERROR("gmond plugin: staging_entry_get failed.");
-      return -1;
-    }
+  DEBUG("gmond plugin: Received meta data for %s/%s.", msg->host, msg->name);
 
-    break;
-  }
+  shard = staging_shard_get(msg->host);
+  pthread_mutex_lock(&shard->lock);
+  se = staging_entry_get(shard, msg->host, map->type, map->type_instance,
+                         ds->ds_num);
+  if (se != NULL)
+    se->vl.interval = TIME_T_TO_CDTIME_T(msg->tmax);
+  pthread_mutex_unlock(&shard->lock);
 
-  default: { return -1; }
+  if (se == NULL) {
+    ERROR("gmond plugin: staging_entry_get failed.");
+    return -1;
   }
 
   return 0;
@@ -667,13 +807,13 @@ static int mc_handle_metadata_msg(Ganglia_metadata_msg *msg) /* {{{ */
 
 static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
 {
-  XDR xdr;
-  Ganglia_msg_formats format;
-
-  xdrmem_create(&xdr, buffer, buffer_size, XDR_DECODE);
+  mc_xdr_t x = {.ptr = buffer, .end = (uint8_t *)buffer + buffer_size};
+  mc_msg_t msg;
+  uint32_t format;
 
-  xdr_Ganglia_msg_formats(&xdr, &format);
-  xdr_setpos(&xdr, 0);
+  if (mc_xdr_uint32(&x, &format) != 0)
+    return -1;
+  msg.format = (Ganglia_msg_formats)format;
 
   switch (format) {
   case gmetric_ushort:
@@ -682,87 +822,115 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
   case gmetric_uint:
   case gmetric_string:
   case gmetric_float:
-  case gmetric_double: {
-    Ganglia_value_msg msg = {0};
-
-    if (xdr_Ganglia_value_msg(&xdr, &msg))
-      mc_handle_value_msg(&msg);
+  case gmetric_double:
+    if (mc_decode_value_msg(&x, &msg) != 0) {
+      DEBUG("gmond plugin: Decoding value message failed.");
+      return -1;
+    }
+    mc_handle_value_msg(&msg);
     break;
-  }
 
   case gmetadata_full:
-  case gmetadata_request: {
-    Ganglia_metadata_msg msg = {0};
-    if (xdr_Ganglia_metadata_msg(&xdr, &msg))
-      mc_handle_metadata_msg(&msg);
+    if (mc_decode_metadata_msg(&x, &msg) != 0) {
+      DEBUG("gmond plugin: Decoding meta data message failed.");
+      return -1;
+    }
+    mc_handle_metadata_msg(&msg);
+    break;
+
+  case gmetadata_request:
+    /* Requests are answered by gmond. */
     break;
-  }
 
   default:
-    DEBUG("gmond plugin: Unknown format: %i", format);
+    DEBUG("gmond plugin: Unknown format: %" PRIu32, format);
     return -1;
   } /* switch (format) */
 
   return 0;
 } /* }}} int mc_handle_metric */
 
-static int mc_handle_socket(struct pollfd *p) /* {{{ */
+/* Reads up to RECEIVE_BATCH_SIZE datagrams into `buffers', which has room for
+ * RECEIVE_BATCH_SIZE * BUFF_SIZE bytes. */
+static int mc_handle_socket(struct pollfd *p, char *buffers) /* {{{ */
 {
-  char buffer[BUFF_SIZE];
-  ssize_t buffer_size;
+  receive_msg_t msgs[RECEIVE_BATCH_SIZE] = {0};
+  struct iovec iov[RECEIVE_BATCH_SIZE];
+  unsigned int msgs_max = RECEIVE_BATCH_SIZE;
+  int msgs_num;
 
   if ((p->revents & (POLLIN | POLLPRI)) == 0) {
     p->revents = 0;
     return -1;
   }
 
-  buffer_size = recv(p->fd, buffer, sizeof(buffer), /* flags = */ 0);
-  if (buffer_size <= 0) {
+#if !HAVE_RECVMMSG
+  msgs_max = 1;
+#endif
+
+  for (unsigned int i = 0; i < msgs_max; i++) {
+    iov[i].iov_base = buffers + (i * BUFF_SIZE);
+    iov[i].iov_len = BUFF_SIZE;
+
+    msgs[i].msg_hdr.msg_iov = iov + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  /* Other receive threads may read from the same socket, so don't block if
+   * they took the datagrams poll(2) reported. */
+#if HAVE_RECVMMSG
+  msgs_num = recvmmsg(p->fd, msgs, msgs_max, MSG_DONTWAIT, NULL);
+#else
+  ssize_t len = recvmsg(p->fd, &msgs[0].msg_hdr, MSG_DONTWAIT);
+  msgs_num = (len < 0) ? -1 : 1;
+  if (len >= 0)
+    msgs[0].msg_len = (unsigned int)len;
+#endif
+  if (msgs_num < 0) {
+    if ((errno == EINTR)
+#ifdef EWOULDBLOCK
+        || (errno == EWOULDBLOCK)
+#endif
+        || (errno == EAGAIN)) {
+      return 0;
+    }
+
     ERROR("gmond plugin: recv failed: %s", STRERRNO);
     p->revents = 0;
     return -1;
   }
 
-  mc_handle_metric(buffer, (size_t)buffer_size);
+  for (int i = 0; i < msgs_num; i++) {
+    if (msgs[i].msg_len == 0)
+      continue;
+    mc_handle_metric(iov[i].iov_base, (size_t)msgs[i].msg_len);
+  }
+
   return 0;
 } /* }}} int mc_handle_socket */
 
 static void *mc_receive_thread(void *arg) /* {{{ */
 {
-  socket_entry_t *mc_receive_socket_entries;
+  struct pollfd fds[mc_receive_sockets_num];
+  char *buffers;
   int status;
 
-  mc_receive_socket_entries = NULL;
-  status = create_sockets(
-      &mc_receive_socket_entries, &mc_receive_sockets_num,
-      (mc_receive_group != NULL) ? mc_receive_group : MC_RECEIVE_GROUP_DEFAULT,
-      (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
-      /* listen = */ 1);
-  if (status != 0) {
-    ERROR("gmond plugin: create_sockets failed.");
-    return (void *)-1;
-  }
-
-  mc_receive_sockets =
-      calloc(mc_receive_sockets_num, sizeof(*mc_receive_sockets));
-  if (mc_receive_sockets == NULL) {
-    ERROR("gmond plugin: calloc failed.");
-    for (size_t i = 0; i < mc_receive_sockets_num; i++)
-      close(mc_receive_socket_entries[i].fd);
-    free(mc_receive_socket_entries);
-    mc_receive_socket_entries = NULL;
-    mc_receive_sockets_num = 0;
+  buffers = malloc(RECEIVE_BATCH_SIZE * BUFF_SIZE);
+  if (buffers == NULL) {
+    ERROR("gmond plugin: malloc failed.");
     return (void *)-1;
   }
 
+  /* The sockets are shared by all receive threads, the pollfd structures
+   * are not. */
   for (size_t i = 0; i < mc_receive_sockets_num; i++) {
-    mc_receive_sockets[i].fd = mc_receive_socket_entries[i].fd;
-    mc_receive_sockets[i].events = POLLIN | POLLPRI;
-    mc_receive_sockets[i].revents = 0;
+    fds[i].fd = mc_receive_sockets[i].fd;
+    fds[i].events = POLLIN | POLLPRI;
+    fds[i].revents = 0;
   }
 
   while (mc_receive_thread_loop != 0) {
-    status = poll(mc_receive_sockets, mc_receive_sockets_num, -1);
+    status = poll(fds, mc_receive_sockets_num, -1);
     if (status <= 0) {
       if (errno == EINTR)
         continue;
@@ -771,49 +939,87 @@ static void *mc_receive_thread(void *arg) /* {{{ */
     }
 
     for (size_t i = 0; i < mc_receive_sockets_num; i++) {
-      if (mc_receive_sockets[i].revents != 0)
-        mc_handle_socket(mc_receive_sockets + i);
+      if (fds[i].revents != 0)
+        mc_handle_socket(fds + i, buffers);
     }
   } /* while (mc_receive_thread_loop != 0) */
 
-  free(mc_receive_socket_entries);
+  free(buffers);
   return (void *)0;
 } /* }}} void *mc_receive_thread */
 
+static void mc_receive_sockets_close(void) /* {{{ */
+{
+  for (size_t i = 0; i < mc_receive_sockets_num; i++)
+    close(mc_receive_sockets[i].fd);
+  sfree(mc_receive_sockets);
+  mc_receive_sockets_num = 0;
+} /* }}} void mc_receive_sockets_close */
+
 static int mc_receive_thread_start(void) /* {{{ */
 {
   int status;
 
-  if (mc_receive_thread_running != 0)
+  if (mc_receive_thread_ids != NULL)
     return -1;
 
+  status = create_sockets(
+      &mc_receive_sockets, &mc_receive_sockets_num,
+      (mc_receive_group != NULL) ? mc_receive_group : MC_RECEIVE_GROUP_DEFAULT,
+      (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
+      /* listen = */ 1);
+  if (status != 0) {
+    ERROR("gmond plugin: create_sockets failed.");
+    return -1;
+  }
+
+  mc_receive_thread_ids =
+      calloc((size_t)mc_receive_threads_num, sizeof(*mc_receive_thread_ids));
+  if (mc_receive_thread_ids == NULL) {
+    ERROR("gmond plugin: calloc failed.");
+    mc_receive_sockets_close();
+    return -1;
+  }
+
   mc_receive_thread_loop = 1;
 
-  status = plugin_thread_create(&mc_receive_thread_id, mc_receive_thread,
-                                /* args = */ NULL, "gmond recv");
-  if (status != 0) {
-    ERROR("gmond plugin: Starting receive thread failed.");
+  for (int i = 0; i < mc_receive_threads_num; i++) {
+    status = plugin_thread_create(
+        mc_receive_thread_ids + mc_receive_threads_running, mc_receive_thread,
+        /* args = */ NULL, "gmond recv");
+    if (status != 0) {
+      ERROR("gmond plugin: Starting receive thread failed.");
+      break;
+    }
+    mc_receive_threads_running++;
+  }
+
+  if (mc_receive_threads_running == 0) {
     mc_receive_thread_loop = 0;
+    sfree(mc_receive_thread_ids);
+    mc_receive_sockets_close();
     return -1;
   }
 
-  mc_receive_thread_running = 1;
   return 0;
 } /* }}} int start_receive_thread */
 
 static int mc_receive_thread_stop(void) /* {{{ */
 {
-  if (mc_receive_thread_running == 0)
+  if (mc_receive_thread_ids == NULL)
     return -1;
 
   mc_receive_thread_loop = 0;
 
-  INFO("gmond plugin: Stopping receive thread.");
-  pthread_kill(mc_receive_thread_id, SIGTERM);
-  pthread_join(mc_receive_thread_id, /* return value = */ NULL);
-  memset(&mc_receive_thread_id, 0, sizeof(mc_receive_thread_id));
+  INFO("gmond plugin: Stopping receive threads.");
+  for (size_t i = 0; i < mc_receive_threads_running; i++)
+    pthread_kill(mc_receive_thread_ids[i], SIGTERM);
+  for (size_t i = 0; i < mc_receive_threads_running; i++)
+    pthread_join(mc_receive_thread_ids[i], /* return value = */ NULL);
 
-  mc_receive_thread_running = 0;
+  sfree(mc_receive_thread_ids);
+  mc_receive_threads_running = 0;
+  mc_receive_sockets_close();
 
   return 0;
 } /* }}} int mc_receive_thread_stop */
@@ -823,6 +1029,7 @@ static int mc_receive_thread_stop(void) /* {{{ */
  *
  * <Plugin gmond>
  *   MCReceiveFrom "239.2.11.71" "8649"
+ *   ReceiveThreads 1
  *   <Metric "load_one">
  *     Type "load"
  *     [TypeInstance "foo"]
@@ -935,7 +1142,14 @@ static int gmond_config(oconfig_item_t *ci) /* {{{ */
       gmond_config_set_address(child, &mc_receive_group, &mc_receive_port);
     else if (strcasecmp("Metric", child->key) == 0)
       gmond_config_add_metric(child);
-    else {
+    else if (strcasecmp("ReceiveThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        ERROR("gmond plugin: \"ReceiveThreads\" requires a positive "
+              "integer.");
+      else
+        mc_receive_threads_num = tmp;
+    } else {
       WARNING("gmond plugin: Unknown configuration option `%s' ignored.",
               child->key);
     }
@@ -952,10 +1166,13 @@ static int gmond_init(void) /* {{{ */
       (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
       /* listen = */ 0);
 
-  staging_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
-  if (staging_tree == NULL) {
-    ERROR("gmond plugin: c_avl_create failed.");
-    return -1;
+  for (size_t i = 0; i < STAGING_SHARDS_NUM; i++) {
+    staging_shards[i].table = c_hashtable_create();
+    if (staging_shards[i].table == NULL) {
+      ERROR("gmond plugin: c_hashtable_create failed.");
+      return -1;
+    }
+    pthread_mutex_init(&staging_shards[i].lock, /* attr = */ NULL);
   }
 
   mc_receive_thread_start();
@@ -976,6 +1193,24 @@ static int gmond_shutdown(void) /* {{{ */
   mc_send_sockets_num = 0;
   pthread_mutex_unlock(&mc_send_sockets_lock);
 
+  for (size_t i = 0; i < STAGING_SHARDS_NUM; i++) {
+    staging_shard_t *shard = staging_shards + i;
+    size_t pos = 0;
+    char *key;
+    staging_entry_t *se;
+
+    if (shard->table == NULL)
+      continue;
+
+    while (c_hashtable_next(shard->table, &pos, &key, (void *)&se) == 0) {
+      sfree(se->vl.values);
+      sfree(se);
+    }
+    c_hashtable_destroy(shard->table);
+    shard->table = NULL;
+    pthread_mutex_destroy(&shard->lock);
+  }
+
   return 0;
 } /* }}} int gmond_shutdown */
 
@@ -24,15 +24,13 @@ SOFTWARE.
 #include "daemon/plugin.h"
 #include "utils/common/common.h"
 
+#include <limits.h>
 #include <nvml.h>
 #include <stdint.h>
 #include <stdio.h>
 
 #define PLUGIN_NAME "gpu_nvidia"
 
-static nvmlReturn_t nv_status = NVML_SUCCESS;
-static char *nv_errline = "";
-
 #define TRY_CATCH(f, catch)                                                    \
   if ((nv_status = f) != NVML_SUCCESS) {                                       \
     nv_errline = #f;                                                           \
@@ -49,6 +47,54 @@ static char *nv_errline = "";
 #define TRY(f) TRY_CATCH(f, catch)
 #define TRYOPT(f) TRY_CATCH_OPTIONAL(f, catch)
 
+// Functions using the TRY macros declare these to record the failing call.
+#define TRY_DECLARE                                                            \
+  nvmlReturn_t nv_status = NVML_SUCCESS;                                       \
+  const char *nv_errline = ""
+
+// nvmlDeviceGetFieldValues() reads several values with a single call into the
+// driver. The header defines NVML_FI_MAX since the function was added.
+#ifdef NVML_FI_MAX
+#define HAVE_NVML_FIELD_VALUES 1
+
+typedef struct {
+  unsigned int id;
+  int ds_type;
+  const char *type;
+  const char *type_instance;
+  double scale;
+} nvml_field_t;
+
+static const nvml_field_t nvml_fields[] = {
+#ifdef NVML_FI_DEV_MEMORY_TEMP
+    {NVML_FI_DEV_MEMORY_TEMP, DS_TYPE_GAUGE, "temperature", "memory", 1.0},
+#endif
+#ifdef NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_TX
+    // Summed over all links, in KiB.
+    {NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_TX, DS_TYPE_DERIVE, "total_bytes",
+     "nvlink_tx", 1024.0},
+    {NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_RX, DS_TYPE_DERIVE, "total_bytes",
+     "nvlink_rx", 1024.0},
+#endif
+};
+#define NVML_FIELDS_NUM STATIC_ARRAY_SIZE(nvml_fields)
+#endif
+
+// State of one monitored GPU. Each GPU has its own read callback, so that
+// GPUs are polled concurrently.
+typedef struct {
+  unsigned int index;
+  nvmlDevice_t handle;
+  bool have_handle;
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+
+#if HAVE_NVML_FIELD_VALUES
+  // Fields the device reported as unsupported are not queried again.
+  bool field_unsupported[NVML_FIELDS_NUM + 1];
+  bool fields_unsupported;
+#endif
+} nvml_device_t;
+
 #define KEY_GPUINDEX "GPUIndex"
 #define KEY_IGNORESELECTED "IgnoreSelected"
 #define KEY_INSTANCE_BY_GPUINDEX "InstanceByGPUIndex"
@@ -103,29 +149,69 @@ static int nvml_config(const char *key, const char *value) {
   return 0;
 }
 
+static int nvml_read_device(user_data_t *ud);
+
 static int nvml_init(void) {
+  TRY_DECLARE;
   TRY(nvmlInit());
+
+  unsigned int device_count;
+  TRY(nvmlDeviceGetCount(&device_count));
+
+  if (device_count > 64) {
+    device_count = 64;
+  }
+
+  for (unsigned int ix = 0; ix < device_count; ix++) {
+    unsigned int is_match =
+        ((1 << ix) & conf_match_mask) || (conf_match_mask == 0);
+    if (conf_mask_is_exclude == !!is_match) {
+      continue;
+    }
+
+    nvml_device_t *device = calloc(1, sizeof(*device));
+    if (device == NULL) {
+      ERROR(PLUGIN_NAME ": calloc failed.");
+      plugin_unregister_read_group(PLUGIN_NAME);
+      return -1;
+    }
+    device->index = ix;
+
+    char name[DATA_MAX_NAME_LEN];
+    snprintf(name, sizeof(name), PLUGIN_NAME "/%u", ix);
+
+    plugin_register_complex_read(/* group = */ PLUGIN_NAME, name,
+                                 nvml_read_device, /* interval = */ 0,
+                                 &(user_data_t){
+                                     .data = device,
+                                     .free_func = free,
+                                 });
+  }
+
   return 0;
 
-  catch : ERROR(PLUGIN_NAME ": NVML init failed with %d", nv_status);
+  catch : ERROR(PLUGIN_NAME ": NVML init failed (\"%s\" returned %d)",
+                nv_errline, nv_status);
   return -1;
 }
 
 static int nvml_shutdown(void) {
+  TRY_DECLARE;
   TRY(nvmlShutdown())
   return 0;
 
-  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed with %d", nv_status);
+  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed (\"%s\" returned %d)",
+                nv_errline, nv_status);
   return -1;
 }
 
-static void nvml_submit_gauge(int device_idx, const char *device_name,
-                              const char *type, const char *type_instance,
-                              gauge_t nvml) {
+static void nvml_submit(int device_idx, const char *device_name,
+                        const char *type, const char *type_instance,
+                        value_t value) {
 
   value_list_t vl = VALUE_LIST_INIT;
 
-  vl.values = &(value_t){.gauge = nvml};
+  vl.values = &value;
   vl.values_len = 1;
 
   sstrncpy(vl.plugin, PLUGIN_NAME, sizeof(vl.plugin));
@@ -149,94 +235,175 @@ static void nvml_submit_gauge(int device_idx, const char *device_name,
   plugin_dispatch_values(&vl);
 }
 
-static int nvml_read(void) {
+static void nvml_submit_gauge(int device_idx, const char *device_name,
+                              const char *type, const char *type_instance,
+                              gauge_t nvml) {
+  nvml_submit(device_idx, device_name, type, type_instance,
+              (value_t){.gauge = nvml});
+}
 
-  unsigned int device_count;
-  TRY_CATCH(nvmlDeviceGetCount(&device_count), catch_nocount);
+#if HAVE_NVML_FIELD_VALUES
+static double nvml_field_to_double(const nvmlFieldValue_t *fv) {
+  switch (fv->valueType) {
+  case NVML_VALUE_TYPE_DOUBLE:
+    return fv->value.dVal;
+  case NVML_VALUE_TYPE_UNSIGNED_INT:
+    return (double)fv->value.uiVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG:
+    return (double)fv->value.ulVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG_LONG:
+    return (double)fv->value.ullVal;
+  case NVML_VALUE_TYPE_SIGNED_LONG_LONG:
+    return (double)fv->value.sllVal;
+  default:
+    return NAN;
+  }
+}
 
-  if (device_count > 64) {
-    device_count = 64;
+// Reads all supported entries of "nvml_fields" with one call.
+static void nvml_read_fields(nvml_device_t *device) {
+  nvmlFieldValue_t values[NVML_FIELDS_NUM + 1];
+  size_t field_idx[NVML_FIELDS_NUM + 1];
+  unsigned int values_num = 0;
+
+  if (device->fields_unsupported)
+    return;
+
+  for (size_t i = 0; i < NVML_FIELDS_NUM; i++) {
+    if (device->field_unsupported[i])
+      continue;
+
+    memset(&values[values_num], 0, sizeof(values[values_num]));
+    values[values_num].fieldId = nvml_fields[i].id;
+#ifdef NVML_FI_DEV_NVLINK_THROUGHPUT_DATA_TX
+    // Aggregate over all links.
+    values[values_num].scopeId = UINT_MAX;
+#endif
+    field_idx[values_num] = i;
+    values_num++;
   }
 
-  for (unsigned int ix = 0; ix < device_count; ix++) {
+  if (values_num == 0)
+    return;
+
+  nvmlReturn_t status =
+      nvmlDeviceGetFieldValues(device->handle, (int)values_num, values);
+  if (status == NVML_ERROR_NOT_SUPPORTED ||
+      status == NVML_ERROR_FUNCTION_NOT_FOUND) {
+    device->fields_unsupported = true;
+    return;
+  } else if (status != NVML_SUCCESS) {
+    WARNING(PLUGIN_NAME ": nvmlDeviceGetFieldValues failed (%d) on dev at "
+                        "index %u!",
+            status, device->index);
+    return;
+  }
 
-    unsigned int is_match =
-        ((1 << ix) & conf_match_mask) || (conf_match_mask == 0);
-    if (conf_mask_is_exclude == !!is_match) {
+  for (unsigned int i = 0; i < values_num; i++) {
+    const nvml_field_t *field = nvml_fields + field_idx[i];
+
+    if (values[i].nvmlReturn == NVML_ERROR_NOT_SUPPORTED) {
+      device->field_unsupported[field_idx[i]] = true;
+      continue;
+    } else if (values[i].nvmlReturn != NVML_SUCCESS) {
       continue;
     }
 
-    nvmlDevice_t dev;
-    TRY(nvmlDeviceGetHandleByIndex(ix, &dev));
+    double v = field->scale * nvml_field_to_double(&values[i]);
+    if (isnan(v))
+      continue;
 
-    char dev_name[NVML_DEVICE_NAME_BUFFER_SIZE] = {0};
+    value_t value;
+    if (field->ds_type == DS_TYPE_DERIVE)
+      value.derive = (derive_t)v;
+    else
+      value.gauge = (gauge_t)v;
+
+    nvml_submit(device->index, device->name, field->type,
+                field->type_instance, value);
+  }
+}
+#endif
+
+static int nvml_read_device(user_data_t *ud) {
+  TRY_DECLARE;
+  nvml_device_t *device = ud->data;
+  unsigned int ix = device->index;
+
+  // The handle and name are looked up once and again after a failure.
+  if (!device->have_handle) {
+    TRY(nvmlDeviceGetHandleByIndex(ix, &device->handle));
     if (instance_by & INSTANCE_BY_GPUNAME) {
-      TRY(nvmlDeviceGetName(dev, dev_name, NVML_DEVICE_NAME_BUFFER_SIZE));
+      TRY(nvmlDeviceGetName(device->handle, device->name,
+                            sizeof(device->name)));
     }
+    device->have_handle = true;
+  }
 
-    // Try to be as lenient as possible with the variety of devices that are
-    // out there, ignoring any NOT_SUPPORTED errors gently.
-    nvmlMemory_t meminfo;
-    TRYOPT(nvmlDeviceGetMemoryInfo(dev, &meminfo))
-    if (nv_status == NVML_SUCCESS) {
-      nvml_submit_gauge(ix, dev_name, "memory", "used", meminfo.used);
-      nvml_submit_gauge(ix, dev_name, "memory", "free", meminfo.free);
-    }
+  nvmlDevice_t dev = device->handle;
+  const char *dev_name = device->name;
 
-    nvmlUtilization_t utilization;
-    TRYOPT(nvmlDeviceGetUtilizationRates(dev, &utilization))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "percent", "gpu_used", utilization.gpu);
-
-    unsigned int fan_speed;
-    TRYOPT(nvmlDeviceGetFanSpeed(dev, &fan_speed))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "fanspeed", NULL, fan_speed);
-
-    unsigned int core_temp;
-    TRYOPT(nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &core_temp))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "temperature", "core", core_temp);
-
-    unsigned int sm_clk_mhz;
-    TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_SM, &sm_clk_mhz))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "frequency", "multiprocessor",
-                        1e6 * sm_clk_mhz);
-
-    unsigned int mem_clk_mhz;
-    TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &mem_clk_mhz))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "frequency", "memory", 1e6 * mem_clk_mhz);
-
-    unsigned int power_mW;
-    TRYOPT(nvmlDeviceGetPowerUsage(dev, &power_mW))
-    if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "power", NULL, 1e-3 * power_mW);
-
-    continue;
-
-    // Failures here indicate transient errors or removal of GPU. In either
-    // case it will either be resolved or the GPU will no longer be enumerated
-    // the next time round.
-    catch : WARNING(PLUGIN_NAME
-                    ": NVML call \"%s\" failed (%d) on dev at index %d!",
-                    nv_errline, nv_status, ix);
-    continue;
+  // Try to be as lenient as possible with the variety of devices that are
+  // out there, ignoring any NOT_SUPPORTED errors gently.
+  nvmlMemory_t meminfo;
+  TRYOPT(nvmlDeviceGetMemoryInfo(dev, &meminfo))
+  if (nv_status == NVML_SUCCESS) {
+    nvml_submit_gauge(ix, dev_name, "memory", "used", meminfo.used);
+    nvml_submit_gauge(ix, dev_name, "memory", "free", meminfo.free);
   }
 
+  nvmlUtilization_t utilization;
+  TRYOPT(nvmlDeviceGetUtilizationRates(dev, &utilization))
+  if (nv_status == NVML_SUCCESS) {
+    nvml_submit_gauge(ix, dev_name, "percent", "gpu_used", utilization.gpu);
+    // Time the memory controller was busy, i.e. memory bandwidth use.
+    nvml_submit_gauge(ix, dev_name, "percent", "memory_controller_used",
+                      utilization.memory);
+  }
+
+  unsigned int fan_speed;
+  TRYOPT(nvmlDeviceGetFanSpeed(dev, &fan_speed))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "fanspeed", NULL, fan_speed);
+
+  unsigned int core_temp;
+  TRYOPT(nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &core_temp))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "temperature", "core", core_temp);
+
+  unsigned int sm_clk_mhz;
+  TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_SM, &sm_clk_mhz))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "frequency", "multiprocessor",
+                      1e6 * sm_clk_mhz);
+
+  unsigned int mem_clk_mhz;
+  TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &mem_clk_mhz))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "frequency", "memory", 1e6 * mem_clk_mhz);
+
+  unsigned int power_mW;
+  TRYOPT(nvmlDeviceGetPowerUsage(dev, &power_mW))
+  if (nv_status == NVML_SUCCESS)
+    nvml_submit_gauge(ix, dev_name, "power", NULL, 1e-3 * power_mW);
+
+#if HAVE_NVML_FIELD_VALUES
+  nvml_read_fields(device);
+#endif
+
   return 0;
 
-// Failures here indicate serious misconfiguration; we bail out totally.
-catch_nocount:
-  ERROR(PLUGIN_NAME ": Failed to enumerate NVIDIA GPUs (\"%s\" returned %d)",
-        nv_errline, nv_status);
+  // Failures here indicate transient errors or removal of GPU. In either
+  // case the handle is looked up again the next time round.
+  catch : WARNING(PLUGIN_NAME
+                  ": NVML call \"%s\" failed (%d) on dev at index %u!",
+                  nv_errline, nv_status, ix);
+  device->have_handle = false;
   return -1;
 }
 
 void module_register(void) {
   plugin_register_init(PLUGIN_NAME, nvml_init);
   plugin_register_config(PLUGIN_NAME, nvml_config, config_keys, n_config_keys);
-  plugin_register_read(PLUGIN_NAME, nvml_read);
   plugin_register_shutdown(PLUGIN_NAME, nvml_shutdown);
 }
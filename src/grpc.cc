@@ -29,9 +29,15 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
-#include <queue>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "collectd.grpc.pb.h"
@@ -45,6 +51,7 @@ extern "C" {
 #include "utils/common/common.h"
 
 #include "daemon/utils_cache.h"
+#include "daemon/utils_complain.h"
 }
 
 using collectd::Collectd;
@@ -72,6 +79,9 @@ struct Listener {
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
 
+/* Number of completion queues, each served by its own thread. */
+static int worker_threads = 2;
+
 /*
  * helper functions
  */
@@ -93,6 +103,16 @@ static bool ident_matches(const value_list_t *vl, const value_list_t *matcher) {
   return true;
 } /* ident_matches */
 
+/* Filter for uc_get_iterator_filtered(), so that only matching entries of the
+ * cache are copied. */
+static bool ident_filter(char const *name, void *data) {
+  value_list_t vl;
+  if (parse_identifier_vl(name, &vl) != 0)
+    return false;
+
+  return ident_matches(&vl, (value_list_t const *)data);
+} /* ident_filter */
+
 static grpc::string read_file(const char *filename) {
   std::ifstream f;
   grpc::string s, content;
@@ -395,131 +415,242 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
 
 /*
  * Collectd service
+ *
+ * The service is implemented asynchronously: each call is a small state
+ * machine, driven by the completion queue it was requested on. Waiting
+ * streams don't occupy a thread, so a few worker threads can serve a large
+ * number of agents.
  */
-class CollectdImpl : public collectd::Collectd::Service {
+static std::atomic<bool> shutting_down(false);
+
+class Call {
 public:
-  grpc::Status
-  QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
-              grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
-    auto status = unmarshal_ident(req->identifier(), &match, false);
-    if (!status.ok()) {
-      return status;
-    }
+  virtual ~Call() {}
+
+  /* Proceed is called when the operation started last has completed. */
+  virtual void Proceed(bool ok) = 0;
+};
+
+class PutValuesCall final : public Call {
+public:
+  PutValuesCall(Collectd::AsyncService *service,
+                grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), reader_(&ctx_), state_(CREATE) {
+    service_->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
+  }
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
+  void Proceed(bool ok) override {
+    if (shutting_down) {
+      delete this;
+      return;
     }
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
-      sfree(vl.values);
-      meta_data_destroy(vl.meta);
+    switch (state_) {
+    case CREATE:
+      if (!ok) {
+        delete this;
+        return;
+      }
+      new PutValuesCall(service_, cq_);
+      state_ = READ;
+      reader_.Read(&req_, this);
+      break;
+
+    case READ: {
+      if (!ok) {
+        /* The client has closed its side of the stream. */
+        state_ = FINISH;
+        reader_.Finish(res_, grpc::Status::OK, this);
+        break;
+      }
+
+      auto status = dispatch(req_);
+      if (!status.ok()) {
+        state_ = FINISH;
+        reader_.FinishWithError(status, this);
+        break;
+      }
+      reader_.Read(&req_, this);
+      break;
     }
 
-    return status;
+    case FINISH:
+      delete this;
+      break;
+    }
   }
 
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
+private:
+  static grpc::Status dispatch_one(collectd::types::ValueList const &msg) {
+    value_list_t vl = {0};
+    auto status = unmarshal_value_list(msg, &vl);
+    if (!status.ok())
+      return status;
+
+    int err = plugin_dispatch_values(&vl);
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
 
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
+    if (err != 0)
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to enqueue values for writing"));
+    return grpc::Status::OK;
+  }
+
+  /* Dispatches `value_list' followed by the batched `value_lists'. */
+  static grpc::Status dispatch(PutValuesRequest const &req) {
+    if (req.has_value_list()) {
+      auto status = dispatch_one(req.value_list());
       if (!status.ok())
         return status;
+    }
 
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
-            grpc::StatusCode::INTERNAL,
-            grpc::string("failed to enqueue values for writing"));
+    for (auto const &msg : req.value_lists()) {
+      auto status = dispatch_one(msg);
+      if (!status.ok())
+        return status;
     }
 
-    res->Clear();
     return grpc::Status::OK;
   }
 
-private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
-      return grpc::Status(
-          grpc::StatusCode::INTERNAL,
-          grpc::string("failed to query values: cannot create iterator"));
-    }
-
-    grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
-      if (parse_identifier_vl(name, &vl) != 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to parse identifier"));
-        break;
-      }
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
 
-      if (!ident_matches(&vl, match))
-        continue;
-      if (uc_iterator_get_time(iter, &vl.time) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value timestamp"));
-        break;
+  PutValuesRequest req_;
+  PutValuesResponse res_;
+
+  enum { CREATE, READ, FINISH } state_;
+}; /* class PutValuesCall */
+
+class QueryValuesCall final : public Call {
+public:
+  QueryValuesCall(Collectd::AsyncService *service,
+                  grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), writer_(&ctx_), iter_(nullptr),
+        state_(CREATE) {
+    service_->RequestQueryValues(&ctx_, &req_, &writer_, cq_, cq_, this);
+  }
+
+  ~QueryValuesCall() { uc_iterator_destroy(iter_); }
+
+  void Proceed(bool ok) override {
+    if (shutting_down) {
+      delete this;
+      return;
+    }
+
+    switch (state_) {
+    case CREATE: {
+      if (!ok) {
+        delete this;
+        return;
       }
-      if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value interval"));
+      new QueryValuesCall(service_, cq_);
+
+      value_list_t match;
+      auto status = unmarshal_ident(req_.identifier(), &match, false);
+      if (!status.ok()) {
+        finish(status);
         break;
       }
-      if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to retrieve values"));
+
+      iter_ = uc_get_iterator_filtered(ident_filter, &match);
+      if (iter_ == nullptr) {
+        finish(grpc::Status(
+            grpc::StatusCode::INTERNAL,
+            grpc::string("failed to query values: cannot create iterator")));
         break;
       }
-      if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value metadata"));
-      }
 
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+      state_ = WRITE;
+      writeNext();
+      break;
+    }
 
-    uc_iterator_destroy(iter);
-    return status;
-  }
+    case WRITE:
+      if (!ok) {
+        /* The client has gone away. */
+        delete this;
+        return;
+      }
+      writeNext();
+      break;
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+    case FINISH:
+      delete this;
+      break;
+    }
+  }
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
-      if (!status.ok()) {
-        return status;
-      }
+private:
+  void finish(grpc::Status const &status) {
+    state_ = FINISH;
+    writer_.Finish(status, this);
+  }
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
-      }
+  /* Marshals the next matching cache entry and writes it to the stream, one
+   * entry per round trip through the completion queue. */
+  void writeNext() {
+    char *name = nullptr;
+    if (uc_iterator_next(iter_, &name) != 0) {
+      finish(grpc::Status::OK);
+      return;
+    }
 
-      value_lists->pop();
+    value_list_t vl = {0};
+    if (parse_identifier_vl(name, &vl) != 0) {
+      finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to parse identifier")));
+      return;
+    }
+    if (uc_iterator_get_time(iter_, &vl.time) < 0) {
+      finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to retrieve value timestamp")));
+      return;
+    }
+    if (uc_iterator_get_interval(iter_, &vl.interval) < 0) {
+      finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to retrieve value interval")));
+      return;
+    }
+    if (uc_iterator_get_values(iter_, &vl.values, &vl.values_len) < 0) {
+      finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to retrieve values")));
+      return;
+    }
+    if (uc_iterator_get_meta(iter_, &vl.meta) < 0) {
       sfree(vl.values);
+      finish(grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to retrieve value metadata")));
+      return;
     }
 
-    return grpc::Status::OK;
+    res_.Clear();
+    auto status = marshal_value_list(&vl, res_.mutable_value_list());
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
+    if (!status.ok()) {
+      finish(status);
+      return;
+    }
+
+    writer_.Write(res_, this);
   }
-};
+
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncWriter<QueryValuesResponse> writer_;
+
+  QueryValuesRequest req_;
+  QueryValuesResponse res_;
+  uc_iter_t *iter_;
+
+  enum { CREATE, WRITE, FINISH } state_;
+}; /* class QueryValuesCall */
 
 /*
  * gRPC server implementation
@@ -550,54 +681,204 @@ public:
       }
     }
 
-    builder.RegisterService(&collectd_service_);
+    builder.RegisterService(&service_);
+    for (int i = 0; i < worker_threads; i++)
+      cqs_.push_back(builder.AddCompletionQueue());
 
     server_ = builder.BuildAndStart();
+
+    shutting_down = false;
+    for (auto &cq : cqs_)
+      threads_.emplace_back(&CollectdServer::HandleRpcs, this, cq.get());
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    shutting_down = true;
+    /* Cancel calls still in progress, such as idle PutValues streams, rather
+     * than waiting for the clients to close them. */
+    server_->Shutdown(std::chrono::system_clock::now());
+    for (auto &cq : cqs_)
+      cq->Shutdown();
+    for (auto &t : threads_)
+      t.join();
+  } /* Shutdown() */
 
 private:
-  CollectdImpl collectd_service_;
+  void HandleRpcs(grpc::ServerCompletionQueue *cq) {
+    new PutValuesCall(&service_, cq);
+    new QueryValuesCall(&service_, cq);
+
+    void *tag;
+    bool ok;
+    /* Next() returns false once the queue has been shut down and drained. */
+    while (cq->Next(&tag, &ok))
+      static_cast<Call *>(tag)->Proceed(ok);
+  } /* HandleRpcs() */
+
+  Collectd::AsyncService service_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+  std::vector<std::thread> threads_;
 
   std::unique_ptr<grpc::Server> server_;
 }; /* class CollectdServer */
 
+/* Options of a <Server> block. */
+struct ClientOptions {
+  size_t batch_size = 128;
+  size_t queue_limit = 65536;
+  cdtime_t min_backoff = TIME_T_TO_CDTIME_T_STATIC(1);
+  cdtime_t max_backoff = TIME_T_TO_CDTIME_T_STATIC(60);
+};
+
+/*
+ * The client keeps one long-lived PutValues stream to its server. Value lists
+ * are queued by the write callback and sent in batches by a separate thread,
+ * which re-opens the stream with exponential backoff if it breaks.
+ */
 class CollectdClient final {
 public:
-  CollectdClient(std::shared_ptr<grpc::ChannelInterface> channel)
-      : stub_(Collectd::NewStub(channel)) {}
+  CollectdClient(std::shared_ptr<grpc::ChannelInterface> channel,
+                 grpc::string const &addr, ClientOptions const &opts)
+      : stub_(Collectd::NewStub(channel)), addr_(addr), opts_(opts) {
+    C_COMPLAIN_INIT(&complaint_queue_);
+    C_COMPLAIN_INIT(&complaint_stream_);
+  }
 
-  int PutValues(value_list_t const *vl) {
-    grpc::ClientContext ctx;
+  ~CollectdClient() {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stopping_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable())
+      thread_.join();
+
+    if (!queue_.empty())
+      WARNING("grpc: Dropping %zu value list(s) queued for %s.", queue_.size(),
+              addr_.c_str());
+  }
 
-    PutValuesRequest req;
-    auto status = marshal_value_list(vl, req.mutable_value_list());
+  int PutValues(value_list_t const *vl) {
+    collectd::types::ValueList msg;
+    auto status = marshal_value_list(vl, &msg);
     if (!status.ok()) {
       ERROR("grpc: Marshalling value_list_t failed.");
       return -1;
     }
 
-    PutValuesResponse res;
-    auto stream = stub_->PutValues(&ctx, &res);
-    if (!stream->Write(req)) {
-      NOTICE("grpc: Broken stream.");
-      /* intentionally not returning. */
-    }
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      /* The thread is started here rather than in the constructor, because
+       * the configuration is read before the daemon forks. */
+      if (!thread_.joinable())
+        thread_ = std::thread(&CollectdClient::Run, this);
 
-    stream->WritesDone();
-    status = stream->Finish();
-    if (!status.ok()) {
-      ERROR("grpc: Error while closing stream.");
-      return -1;
+      queue_.push_back(std::move(msg));
+      trimQueueLocked();
     }
+    cond_.notify_one();
 
     return 0;
   } /* int PutValues */
 
 private:
+  /* Drops the oldest value lists if the queue is longer than allowed.
+   * Must hold lock_ when calling. */
+  void trimQueueLocked() {
+    size_t dropped = 0;
+    while ((opts_.queue_limit > 0) && (queue_.size() > opts_.queue_limit)) {
+      queue_.pop_front();
+      dropped++;
+    }
+    if (dropped > 0)
+      c_complain(LOG_WARNING, &complaint_queue_,
+                 "grpc: The queue for %s is full, dropping the oldest "
+                 "value lists.",
+                 addr_.c_str());
+    else
+      c_release(LOG_INFO, &complaint_queue_,
+                "grpc: The queue for %s is no longer full.", addr_.c_str());
+  }
+
+  /* Sends batches from the queue until the stream breaks or the client is
+   * stopped and the queue is empty. Returns false if the stream broke. */
+  bool sendBatches(grpc::ClientWriter<PutValuesRequest> *stream) {
+    while (true) {
+      PutValuesRequest req;
+      {
+        std::unique_lock<std::mutex> lock(lock_);
+        cond_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty())
+          return true;
+
+        while (!queue_.empty() &&
+               ((size_t)req.value_lists_size() < opts_.batch_size)) {
+          *req.add_value_lists() = std::move(queue_.front());
+          queue_.pop_front();
+        }
+      }
+
+      if (stream->Write(req)) {
+        c_release(LOG_INFO, &complaint_stream_,
+                  "grpc: Sending to %s succeeded again.", addr_.c_str());
+        backoff_ = opts_.min_backoff;
+        continue;
+      }
+
+      /* Not sent: put the batch back in front of the queue. */
+      std::lock_guard<std::mutex> lock(lock_);
+      auto lists = req.mutable_value_lists();
+      for (auto it = lists->rbegin(); it != lists->rend(); ++it)
+        queue_.push_front(std::move(*it));
+      trimQueueLocked();
+      return false;
+    }
+  } /* bool sendBatches */
+
+  void Run() {
+    backoff_ = opts_.min_backoff;
+
+    while (true) {
+      grpc::ClientContext ctx;
+      PutValuesResponse res;
+      auto stream = stub_->PutValues(&ctx, &res);
+
+      bool ok = sendBatches(stream.get());
+      if (ok)
+        stream->WritesDone();
+      auto status = stream->Finish();
+
+      std::unique_lock<std::mutex> lock(lock_);
+      if (!ok || !status.ok()) {
+        c_complain(LOG_ERR, &complaint_stream_,
+                   "grpc: Sending to %s failed: %s", addr_.c_str(),
+                   status.ok() ? "broken stream"
+                               : status.error_message().c_str());
+        auto delay = std::chrono::milliseconds(CDTIME_T_TO_MS(backoff_));
+        cond_.wait_for(lock, delay, [this] { return stopping_; });
+        backoff_ = std::min(2 * backoff_, opts_.max_backoff);
+      }
+
+      if (stopping_ && (!ok || queue_.empty()))
+        return;
+    }
+  } /* void Run */
+
   std::unique_ptr<Collectd::Stub> stub_;
-};
+  grpc::string addr_;
+  ClientOptions opts_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::deque<collectd::types::ValueList> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+
+  /* Only used by the sending thread. */
+  cdtime_t backoff_ = 0;
+  c_complain_t complaint_queue_;
+  c_complain_t complaint_stream_;
+}; /* class CollectdClient */
 
 static CollectdServer *server = nullptr;
 
@@ -698,6 +979,7 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
 
   grpc::SslCredentialsOptions ssl_opts;
   bool use_ssl = false;
+  ClientOptions opts;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -724,6 +1006,25 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
         return -1;
       }
       ssl_opts.pem_cert_chain = read_file(cert);
+    } else if (!strcasecmp("BatchSize", child->key) ||
+               !strcasecmp("SendQueueLimit", child->key)) {
+      int tmp = 0;
+      bool is_batch = !strcasecmp("BatchSize", child->key);
+      if (cf_util_get_int(child, &tmp) || (tmp < (is_batch ? 1 : 0))) {
+        ERROR("grpc: Option `%s` expects a %s number", child->key,
+              is_batch ? "positive" : "non-negative");
+        return -1;
+      }
+      if (is_batch)
+        opts.batch_size = (size_t)tmp;
+      else
+        opts.queue_limit = (size_t)tmp;
+    } else if (!strcasecmp("MinBackoff", child->key)) {
+      if (cf_util_get_cdtime(child, &opts.min_backoff))
+        return -1;
+    } else if (!strcasecmp("MaxBackoff", child->key)) {
+      if (cf_util_get_cdtime(child, &opts.max_backoff))
+        return -1;
     } else {
       WARNING("grpc: Option `%s` not allowed in <%s> block.", child->key,
               ci->key);
@@ -734,15 +1035,18 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
   auto service = grpc::string(ci->values[1].value.string);
   auto addr = node + ":" + service;
 
+  if (opts.max_backoff < opts.min_backoff)
+    opts.max_backoff = opts.min_backoff;
+
   CollectdClient *client;
   if (use_ssl) {
     auto channel_creds = grpc::SslCredentials(ssl_opts);
     auto channel = grpc::CreateChannel(addr, channel_creds);
-    client = new CollectdClient(channel);
+    client = new CollectdClient(channel, addr, opts);
   } else {
     auto channel =
         grpc::CreateChannel(addr, grpc::InsecureChannelCredentials());
-    client = new CollectdClient(channel);
+    client = new CollectdClient(channel, addr, opts);
   }
 
   auto callback_name = grpc::string("grpc/") + addr;
@@ -767,6 +1071,13 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("WorkerThreads", child->key)) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) || (tmp < 1)) {
+        ERROR("grpc: Option `%s` expects a positive number", child->key);
+        return -1;
+      }
+      worker_threads = tmp;
     }
 
     else {
@@ -32,6 +32,7 @@
 
 #include "plugin.h"              /* plugin_register_*, plugin_dispatch_values */
 #include "utils/common/common.h" /* auxiliary functions */
+#include "utils/proc_file/proc_file.h"
 
 static const char g_plugin_name[] = "hugepages";
 
@@ -42,22 +43,36 @@ static bool g_values_pages = true;
 static bool g_values_bytes;
 static bool g_values_percent;
 
-#define HP_HAVE_NR 0x01
-#define HP_HAVE_SURPLUS 0x02
-#define HP_HAVE_FREE 0x04
-#define HP_HAVE_ALL 0x07
+#define HP_VALUE_FILE_SIZE 64
 
 struct entry_info {
-  char *d_name;
   const char *node;
   size_t page_size_kb;
 
   gauge_t nr;
   gauge_t surplus;
   gauge_t free;
-  uint8_t flags;
 };
 
+/* One "hugepages-<size>kB" directory. Its attribute files are kept open and
+ * the directories are only scanned again when the online NUMA nodes change or
+ * reading fails. */
+typedef struct {
+  char node[DATA_MAX_NAME_LEN];
+  size_t page_size_kb;
+
+  proc_file_t *nr;
+  proc_file_t *surplus;
+  proc_file_t *free;
+} hp_entry_t;
+
+static hp_entry_t *g_entries;
+static size_t g_entries_num;
+static bool g_rescan = true;
+
+static proc_file_t *g_nodes_online;
+static char g_nodes_online_last[256];
+
 static int hp_config(oconfig_item_t *ci) {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -119,50 +134,56 @@ static void submit_hp(const struct entry_info *info) {
   }
 }
 
-static int read_hugepage_entry(const char *path, const char *entry,
-                               void *e_info) {
-  char path2[PATH_MAX];
-  struct entry_info *info = e_info;
-  double value;
-
-  snprintf(path2, sizeof(path2), "%s/%s", path, entry);
-
-  FILE *fh = fopen(path2, "rt");
-  if (fh == NULL) {
-    ERROR("%s: cannot open %s", g_plugin_name, path2);
-    return -1;
+static void hp_entries_free(void) {
+  for (size_t i = 0; i < g_entries_num; i++) {
+    proc_file_destroy(g_entries[i].nr);
+    proc_file_destroy(g_entries[i].surplus);
+    proc_file_destroy(g_entries[i].free);
   }
+  sfree(g_entries);
+  g_entries_num = 0;
+}
 
-  if (fscanf(fh, "%lf", &value) != 1) {
-    ERROR("%s: cannot parse file %s", g_plugin_name, path2);
-    fclose(fh);
-    return -1;
-  }
-  fclose(fh);
-
-  if (strcmp(entry, "nr_hugepages") == 0) {
-    info->nr = value;
-    info->flags |= HP_HAVE_NR;
-  } else if (strcmp(entry, "surplus_hugepages") == 0) {
-    info->surplus = value;
-    info->flags |= HP_HAVE_SURPLUS;
-  } else if (strcmp(entry, "free_hugepages") == 0) {
-    info->free = value;
-    info->flags |= HP_HAVE_FREE;
-  }
+static proc_file_t *hp_file_create(const char *path, const char *entry) {
+  char path2[PATH_MAX];
+  int len = snprintf(path2, sizeof(path2), "%s/%s", path, entry);
+  if ((len < 0) || ((size_t)len >= sizeof(path2)))
+    return NULL;
+  return proc_file_create_size(path2, HP_VALUE_FILE_SIZE);
+}
 
-  if (info->flags != HP_HAVE_ALL) {
-    return 0;
+static int hp_entry_add(const char *path, const char *node,
+                        size_t page_size_kb) {
+  hp_entry_t *tmp =
+      realloc(g_entries, (g_entries_num + 1) * sizeof(*g_entries));
+  if (tmp == NULL) {
+    ERROR("%s: realloc failed", g_plugin_name);
+    return ENOMEM;
+  }
+  g_entries = tmp;
+
+  hp_entry_t *e = g_entries + g_entries_num;
+  *e = (hp_entry_t){
+      .page_size_kb = page_size_kb,
+      .nr = hp_file_create(path, "nr_hugepages"),
+      .surplus = hp_file_create(path, "surplus_hugepages"),
+      .free = hp_file_create(path, "free_hugepages"),
+  };
+  sstrncpy(e->node, node, sizeof(e->node));
+
+  if ((e->nr == NULL) || (e->surplus == NULL) || (e->free == NULL)) {
+    ERROR("%s: proc_file_create failed", g_plugin_name);
+    proc_file_destroy(e->nr);
+    proc_file_destroy(e->surplus);
+    proc_file_destroy(e->free);
+    return ENOMEM;
   }
 
-  submit_hp(info);
-
-  /* Reset flags so subsequent calls don't submit again. */
-  info->flags = 0;
+  g_entries_num++;
   return 0;
 }
 
-static int read_syshugepages(const char *path, const char *node) {
+static int scan_syshugepages(const char *path, const char *node) {
   static const char hugepages_dir[] = "hugepages-";
   DIR *dir;
   struct dirent *result;
@@ -193,13 +214,7 @@ static int read_syshugepages(const char *path, const char *node) {
     /* /sys/devices/system/node/node?/hugepages/ */
     snprintf(path2, sizeof(path2), "%s/%s", path, result->d_name);
 
-    walk_directory(path2, read_hugepage_entry,
-                   &(struct entry_info){
-                       .d_name = result->d_name,
-                       .node = node,
-                       .page_size_kb = (size_t)page_size,
-                   },
-                   /* hidden = */ 0);
+    hp_entry_add(path2, node, (size_t)page_size);
     errno = 0;
   }
 
@@ -214,7 +229,7 @@ static int read_syshugepages(const char *path, const char *node) {
   return 0;
 }
 
-static int read_nodes(void) {
+static int scan_nodes(void) {
   static const char sys_node[] = "/sys/devices/system/node";
   static const char node_string[] = "node";
   static const char sys_node_hugepages[] =
@@ -237,7 +252,7 @@ static int read_nodes(void) {
     }
 
     snprintf(path, sizeof(path), sys_node_hugepages, result->d_name);
-    read_syshugepages(path, result->d_name);
+    scan_syshugepages(path, result->d_name);
     errno = 0;
   }
 
@@ -252,16 +267,18 @@ static int read_nodes(void) {
   return 0;
 }
 
-static int huge_read(void) {
+static int hp_scan(void) {
   static const char sys_mm_hugepages[] = "/sys/kernel/mm/hugepages";
 
+  hp_entries_free();
+
   if (g_flag_rpt_mm) {
-    if (read_syshugepages(sys_mm_hugepages, "mm") != 0) {
+    if (scan_syshugepages(sys_mm_hugepages, "mm") != 0) {
       return -1;
     }
   }
   if (g_flag_rpt_numa) {
-    if (read_nodes() != 0) {
+    if (scan_nodes() != 0) {
       return -1;
     }
   }
@@ -269,7 +286,87 @@ static int huge_read(void) {
   return 0;
 }
 
+/* Returns true if the set of online NUMA nodes changed since the last call. */
+static bool hp_nodes_changed(void) {
+  if (g_nodes_online == NULL) {
+    g_nodes_online = proc_file_create_size("/sys/devices/system/node/online",
+                                           sizeof(g_nodes_online_last));
+    if (g_nodes_online == NULL)
+      return false;
+  }
+
+  if (proc_file_read(g_nodes_online) < 0)
+    return false;
+
+  char const *line = proc_file_next_line(g_nodes_online);
+  if (line == NULL)
+    line = "";
+  if (strcmp(line, g_nodes_online_last) == 0)
+    return false;
+
+  sstrncpy(g_nodes_online_last, line, sizeof(g_nodes_online_last));
+  return true;
+}
+
+static int read_hugepage_file(proc_file_t *pf, gauge_t *ret) {
+  if (proc_file_read(pf) < 0) {
+    ERROR("%s: cannot read %s: %s", g_plugin_name, proc_file_path(pf),
+          STRERRNO);
+    return -1;
+  }
+
+  char const *line = proc_file_next_line(pf);
+  char *endptr = NULL;
+  double value = (line != NULL) ? strtod(line, &endptr) : 0;
+  if ((line == NULL) || (endptr == line)) {
+    ERROR("%s: cannot parse file %s", g_plugin_name, proc_file_path(pf));
+    return -1;
+  }
+
+  *ret = (gauge_t)value;
+  return 0;
+}
+
+static int huge_read(void) {
+  if (g_flag_rpt_numa && hp_nodes_changed())
+    g_rescan = true;
+
+  if (g_rescan) {
+    if (hp_scan() != 0) {
+      return -1;
+    }
+    g_rescan = false;
+  }
+
+  for (size_t i = 0; i < g_entries_num; i++) {
+    hp_entry_t *e = g_entries + i;
+    struct entry_info info = {
+        .node = e->node,
+        .page_size_kb = e->page_size_kb,
+    };
+
+    if ((read_hugepage_file(e->nr, &info.nr) != 0) ||
+        (read_hugepage_file(e->surplus, &info.surplus) != 0) ||
+        (read_hugepage_file(e->free, &info.free) != 0)) {
+      g_rescan = true;
+      continue;
+    }
+
+    submit_hp(&info);
+  }
+
+  return 0;
+}
+
+static int huge_shutdown(void) {
+  hp_entries_free();
+  proc_file_destroy(g_nodes_online);
+  g_nodes_online = NULL;
+  return 0;
+}
+
 void module_register(void) {
   plugin_register_complex_config(g_plugin_name, hp_config);
   plugin_register_read(g_plugin_name, huge_read);
+  plugin_register_shutdown(g_plugin_name, huge_shutdown);
 }
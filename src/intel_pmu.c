@@ -46,6 +46,9 @@ struct intel_pmu_entity_s {
   bool copied;
   bool all_events;
   struct eventlist *event_list;
+  /* pmu names of the events, in the order of event_list */
+  char **pmu_names;
+  size_t pmu_names_num;
   user_data_t user_data;
   struct intel_pmu_entity_s *next;
 };
@@ -358,18 +361,53 @@ static char *pmu_get_name(const struct event *e, const uint32_t *type) {
   return NULL;
 }
 
-static void pmu_dispatch_data(intel_pmu_entity_t *ent) {
+/* Looks up the pmu names of all events once, so that reading the pmu type
+ * files is not repeated on every read. */
+static int pmu_cache_names(intel_pmu_entity_t *ent) {
+  size_t num = 0;
+  for (struct event *e = ent->event_list->eventlist; e; e = e->next)
+    num++;
 
-  struct event *e;
+  ent->pmu_names = calloc(num, sizeof(*ent->pmu_names));
+  if (ent->pmu_names == NULL) {
+    ERROR(PMU_PLUGIN ": Failed to allocate pmu names.");
+    return -ENOMEM;
+  }
+  ent->pmu_names_num = num;
 
-  for (e = ent->event_list->eventlist; e; e = e->next) {
+  size_t i = 0;
+  for (struct event *e = ent->event_list->eventlist; e; e = e->next, i++) {
     const uint32_t *event_type = NULL;
     if (e->orig && !g_ctx.dispatch_cloned_pmus)
       continue;
     if ((e->extra.multi_pmu || e->orig) && g_ctx.dispatch_cloned_pmus)
       event_type = &e->attr.type;
 
-    char *pmu_name = pmu_get_name(e, event_type);
+    ent->pmu_names[i] = pmu_get_name(e, event_type);
+  }
+
+  return 0;
+}
+
+static void pmu_free_names(intel_pmu_entity_t *ent) {
+  for (size_t i = 0; i < ent->pmu_names_num; i++)
+    sfree(ent->pmu_names[i]);
+  sfree(ent->pmu_names);
+  ent->pmu_names_num = 0;
+}
+
+static void pmu_dispatch_data(intel_pmu_entity_t *ent) {
+
+  struct event *e;
+  size_t event_idx = 0;
+
+  for (e = ent->event_list->eventlist; e; e = e->next, event_idx++) {
+    if (e->orig && !g_ctx.dispatch_cloned_pmus)
+      continue;
+
+    const char *pmu_name = NULL;
+    if (event_idx < ent->pmu_names_num)
+      pmu_name = ent->pmu_names[event_idx];
 
     for (size_t i = 0; i < ent->cgroups_count; i++) {
       core_group_t *cgroup = ent->cores.cgroups + i + ent->first_cgroup;
@@ -418,10 +456,53 @@ static void pmu_dispatch_data(intel_pmu_entity_t *ent) {
                             e->extra.multi_pmu, cgroup_value, cgroup_value_raw,
                             cgroup_time_enabled, cgroup_time_running);
     }
+  }
+}
+
+/* Group leaders are opened with PERF_FORMAT_GROUP, unless jevents has
+ * replaced the read format in setup_event(). */
+static bool pmu_is_group_read(const struct event *leader) {
+  return leader != NULL && leader->group_leader &&
+         (leader->attr.read_format & PERF_FORMAT_GROUP);
+}
+
+/*
+ * Reads the counters of all members of a group with one read() of the
+ * leader. The kernel returns { nr, time_enabled, time_running, value[nr] },
+ * with one value for each member opened on the core, in the order the members
+ * have been added to the group.
+ */
+static int pmu_read_group(struct event *leader, int core) {
+  size_t nr = 0;
+
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    if (e->efd[core].fd >= 0)
+      nr++;
+    if (e->end_group)
+      break;
+  }
+
+  uint64_t buf[3 + nr];
+  ssize_t len = read(leader->efd[core].fd, buf, sizeof(buf));
+  if (len != (ssize_t)sizeof(buf) || buf[0] != nr) {
+    ERROR(PMU_PLUGIN ": Failed to read group of %s/%d event.", leader->event,
+          core);
+    return -1;
+  }
 
-    if (pmu_name)
-      sfree(pmu_name);
+  size_t i = 0;
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    if (e->efd[core].fd >= 0) {
+      e->efd[core].val[0] = buf[3 + i];
+      e->efd[core].val[1] = buf[1];
+      e->efd[core].val[2] = buf[2];
+      i++;
+    }
+    if (e->end_group)
+      break;
   }
+
+  return 0;
 }
 
 static int pmu_read(user_data_t *ud) {
@@ -435,12 +516,15 @@ static int pmu_read(user_data_t *ud) {
   }
   intel_pmu_entity_t *ent = (intel_pmu_entity_t *)ud->data;
   int ret;
-  struct event *e;
+  struct event *e, *leader = NULL;
 
   DEBUG(PMU_PLUGIN ": %s:%d", __FUNCTION__, __LINE__);
 
   /* read all events only for configured cores */
   for (e = ent->event_list->eventlist; e; e = e->next) {
+    if (e->group_leader)
+      leader = e;
+
     for (size_t i = 0; i < ent->cgroups_count; i++) {
       core_group_t *cgroup = ent->cores.cgroups + i + ent->first_cgroup;
       for (size_t j = 0; j < cgroup->num_cores; j++) {
@@ -450,7 +534,16 @@ static int pmu_read(user_data_t *ud) {
           continue;
         }
 
-        ret = read_event(e, core);
+        /* Members of a group are read together with their leader. Without
+         * the leader, they have been opened as separate events. */
+        if (e->ingroup && pmu_is_group_read(leader) &&
+            leader->efd[core].fd >= 0) {
+          if (e != leader)
+            continue;
+          ret = pmu_read_group(leader, core);
+        } else {
+          ret = read_event(e, core);
+        }
         if (ret != 0) {
           ERROR(PMU_PLUGIN ": Failed to read value of %s/%d event.", e->event,
                 core);
@@ -458,6 +551,9 @@ static int pmu_read(user_data_t *ud) {
         }
       }
     }
+
+    if (e->end_group)
+      leader = NULL;
   }
 
   pmu_dispatch_data(ent);
@@ -595,6 +691,9 @@ static int pmu_setup_events(core_groups_list_t *cores, struct eventlist *el,
   struct event *e, *leader = NULL;
   int ret = -1;
   for (e = el->eventlist; e; e = e->next) {
+    /* Read all counters of a group with one read() of the leader */
+    if (e->group_leader)
+      e->attr.read_format |= PERF_FORMAT_GROUP;
 
     for (size_t i = 0; i < cores->num_cgroups; i++) {
       core_group_t *cgroup = cores->cgroups + i;
@@ -806,6 +905,10 @@ static int pmu_init(void) {
       ret = -1;
       goto init_error;
     }
+
+    ret = pmu_cache_names(ent);
+    if (ret != 0)
+      goto init_error;
   }
 
   /* split list of cores for use in separate reading threads */
@@ -841,6 +944,7 @@ init_error:
       continue;
     }
 
+    pmu_free_names(tmp);
     pmu_free_events(tmp->event_list);
     tmp->event_list = NULL;
     for (size_t i = 0; i < tmp->hw_events_count; i++) {
@@ -871,6 +975,7 @@ static int pmu_shutdown(void) {
       continue;
     }
 
+    pmu_free_names(tmp);
     pmu_free_events(tmp->event_list);
     tmp->event_list = NULL;
     for (size_t i = 0; i < tmp->hw_events_count; i++) {
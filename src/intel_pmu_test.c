@@ -222,6 +222,76 @@ DEF_TEST(config_cores_parse__not_aggregated_groups) {
   return 0;
 }
 
+struct event *stub_event(bool group_leader, bool end_group, int fd) {
+  struct event *e = calloc(1, sizeof(*e) + sizeof(struct efd));
+
+  e->event = "event";
+  e->group_leader = group_leader;
+  e->end_group = end_group;
+  e->ingroup = 1;
+  e->efd[0].fd = fd;
+
+  return e;
+}
+
+DEF_TEST(pmu_read_group__members) {
+  // setup
+  int fds[2];
+  CHECK_ZERO(pipe(fds));
+
+  struct event *leader = stub_event(true, false, fds[0]);
+  struct event *closed = stub_event(false, false, -1);
+  struct event *last = stub_event(false, true, 42);
+  leader->next = closed;
+  closed->next = last;
+
+  /* nr, time_enabled, time_running, values of the opened members */
+  uint64_t buf[] = {2, 1000, 500, 11, 22};
+  EXPECT_EQ_INT(sizeof(buf), write(fds[1], buf, sizeof(buf)));
+
+  // check
+  EXPECT_EQ_INT(0, pmu_read_group(leader, 0));
+  EXPECT_EQ_UINT64(11, leader->efd[0].val[0]);
+  EXPECT_EQ_UINT64(1000, leader->efd[0].val[1]);
+  EXPECT_EQ_UINT64(500, leader->efd[0].val[2]);
+  EXPECT_EQ_UINT64(0, closed->efd[0].val[0]);
+  EXPECT_EQ_UINT64(22, last->efd[0].val[0]);
+  EXPECT_EQ_UINT64(1000, last->efd[0].val[1]);
+  EXPECT_EQ_UINT64(500, last->efd[0].val[2]);
+
+  // cleanup
+  close(fds[0]);
+  close(fds[1]);
+  sfree(leader);
+  sfree(closed);
+  sfree(last);
+  return 0;
+}
+
+DEF_TEST(pmu_read_group__count_mismatch) {
+  // setup
+  int fds[2];
+  CHECK_ZERO(pipe(fds));
+
+  struct event *leader = stub_event(true, false, fds[0]);
+  struct event *last = stub_event(false, true, 42);
+  leader->next = last;
+
+  /* the kernel reports a different number of members */
+  uint64_t buf[] = {1, 1000, 500, 11, 0};
+  EXPECT_EQ_INT(sizeof(buf), write(fds[1], buf, sizeof(buf)));
+
+  // check
+  EXPECT_EQ_INT(-1, pmu_read_group(leader, 0));
+
+  // cleanup
+  close(fds[0]);
+  close(fds[1]);
+  sfree(leader);
+  sfree(last);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(pmu_config_hw_events__all_events);
   RUN_TEST(pmu_config_hw_events__few_events);
@@ -229,6 +299,8 @@ int main(void) {
   RUN_TEST(config_cores_parse__empty_group);
   RUN_TEST(config_cores_parse__aggregated_groups);
   RUN_TEST(config_cores_parse__not_aggregated_groups);
+  RUN_TEST(pmu_read_group__members);
+  RUN_TEST(pmu_read_group__count_mismatch);
 
   END_TEST;
 }
@@ -85,6 +85,7 @@ struct rdt_ctx_s {
   size_t num_ngroups;
   proc_pids_t **proc_pids;
   size_t num_proc_pids;
+  proc_pids_watch_t *pids_watch;
 #endif /* LIBPQOS2 */
   const struct pqos_cpuinfo *pqos_cpu;
   const struct pqos_cap *pqos_cap;
@@ -524,6 +525,9 @@ static void rdt_free_ngroups(rdt_ctx_t *rdt) {
   if (rdt->proc_pids)
     sfree(rdt->proc_pids);
 
+  proc_pids_watch_close(rdt->pids_watch);
+  rdt->pids_watch = NULL;
+
   rdt->num_ngroups = 0;
 }
 #endif /* LIBPQOS2 */
@@ -685,10 +689,18 @@ static int rdt_refresh_ngroup(rdt_name_group_t *ngroup,
     return -1;
   }
 
+  proc_pids_t **proc_pids = ngroup->proc_pids;
+
+  /* Only touch the PQoS group if its membership changed. */
+  bool changed = false;
+  for (size_t i = 0; i < ngroup->num_names; ++i)
+    changed = changed || proc_pids[i]->changed;
+  if (!changed)
+    return 0;
+
   DEBUG(RDT_PLUGIN ": rdt_refresh_ngroup: \'%s\' process names group.",
         ngroup->desc);
 
-  proc_pids_t **proc_pids = ngroup->proc_pids;
   pids_list_t added_pids;
   pids_list_t removed_pids;
 
@@ -794,6 +806,9 @@ pqos_error_recovery:
   for (size_t i = 0; i < ngroup->num_names; ++i)
     if (ngroup->proc_pids[i]->curr)
       ngroup->proc_pids[i]->curr->size = 0;
+  /* The PIDs of the group are gone from the lists now, so they have to be
+   * found again in procfs. */
+  proc_pids_watch_resync(g_rdt->pids_watch);
 
   ngroup->monitored_pids_count = 0;
 
@@ -861,7 +876,8 @@ static int read_pids_data() {
 #endif /* COLLECT_DEBUG */
 
 groups_refresh:
-  ret = proc_pids_update(RDT_PROC_PATH, g_rdt->proc_pids, g_rdt->num_proc_pids);
+  ret = proc_pids_watch_update(g_rdt->pids_watch, RDT_PROC_PATH,
+                               g_rdt->proc_pids, g_rdt->num_proc_pids);
   if (0 != ret) {
     ERROR(RDT_PLUGIN ": Initial update of proc pids failed");
     return ret;
@@ -928,8 +944,17 @@ static void rdt_init_pids_monitoring() {
   }
 
   if (g_rdt->num_ngroups > 0) {
-    int update_result =
-        proc_pids_update(RDT_PROC_PATH, g_rdt->proc_pids, g_rdt->num_proc_pids);
+    /* Follow process events instead of scanning procfs every interval, if
+     * the kernel allows it. */
+    int watch_result = proc_pids_watch_open(&g_rdt->pids_watch);
+    if (0 != watch_result)
+      INFO(RDT_PLUGIN ": Process events are not available (%s), scanning "
+                      "%s every interval.",
+           STRERROR(watch_result), RDT_PROC_PATH);
+
+    int update_result = proc_pids_watch_update(
+        g_rdt->pids_watch, RDT_PROC_PATH, g_rdt->proc_pids,
+        g_rdt->num_proc_pids);
     if (0 != update_result)
       ERROR(RDT_PLUGIN ": Initial update of proc pids failed");
   }
@@ -27,6 +27,8 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/proc_file/proc_file.h"
+#include "utils_batch.h"
 
 #if HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -50,6 +52,12 @@
 #include <statgrab.h>
 #endif
 
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+#include "utils/avltree/avltree.h"
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
 #if HAVE_PERFSTAT
 #include <libperfstat.h>
 #include <sys/protosw.h>
@@ -89,9 +97,40 @@ static const char *config_keys[] = {
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *ignorelist;
+/* The configuration may be reloaded while the interfaces are read. */
+static pthread_mutex_t ignorelist_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static bool report_inactive = true;
 
+#if KERNEL_LINUX
+static proc_file_t *proc_net_dev;
+#endif
+
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+/* An interface seen in the RTM_GETLINK dumps. The ignorelist is only matched
+ * when an index first shows up or the interface has been renamed. */
+typedef struct {
+  int ifindex;
+  char name[IFNAMSIZ];
+  bool ignored;
+  unsigned int generation;
+} if_link_t;
+
+/* Interfaces by index. Protected by `ignorelist_lock' and cleared whenever
+ * the ignorelist is. */
+static c_avl_tree_t *if_links;
+/* Incremented for each dump, so that removed interfaces can be found. */
+static unsigned int if_links_generation;
+
+static int if_nl_sock = -1;
+static uint32_t if_nl_seq;
+/* Set if no netlink socket can be opened; /proc/net/dev is read instead. */
+static bool if_nl_unavailable;
+/* The kernel fills each recv() with as many interfaces, about 1.5 kB each,
+ * as fit. uint64_t for the alignment of the messages. */
+static uint64_t if_nl_buffer[32768 / sizeof(uint64_t)];
+#endif
+
 #ifdef HAVE_LIBKSTAT
 #if HAVE_KSTAT_H
 #include <kstat.h>
@@ -104,6 +143,9 @@ static bool unique_name;
 #endif /* HAVE_LIBKSTAT */
 
 static int interface_config(const char *key, const char *value) {
+  int status = 0;
+
+  pthread_mutex_lock(&ignorelist_lock);
   if (ignorelist == NULL)
     ignorelist = ignorelist_create(/* invert = */ 1);
 
@@ -125,12 +167,46 @@ static int interface_config(const char *key, const char *value) {
             "Solaris.");
 #endif /* HAVE_LIBKSTAT */
   } else {
-    return -1;
+    status = -1;
   }
+  pthread_mutex_unlock(&ignorelist_lock);
 
-  return 0;
+  return status;
 }
 
+/* Drops the configuration before the new one is passed to
+ * interface_config(). */
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+/* Must be called with `ignorelist_lock' held. */
+static void if_links_clear(void) {
+  if (if_links == NULL)
+    return;
+
+  void *key;
+  void *value;
+  while (c_avl_pick(if_links, &key, &value) == 0)
+    sfree(value);
+  c_avl_destroy(if_links);
+  if_links = NULL;
+} /* void if_links_clear */
+#endif
+
+static int interface_reload(void) {
+  pthread_mutex_lock(&ignorelist_lock);
+  ignorelist_free(ignorelist);
+  ignorelist = NULL;
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+  if_links_clear();
+#endif
+  report_inactive = true;
+#ifdef HAVE_LIBKSTAT
+  unique_name = false;
+#endif /* HAVE_LIBKSTAT */
+  pthread_mutex_unlock(&ignorelist_lock);
+
+  return 0;
+} /* int interface_reload */
+
 #if HAVE_LIBKSTAT
 static int interface_init(void) {
   kstat_t *ksp_chain;
@@ -158,30 +234,238 @@ static int interface_init(void) {
 } /* int interface_init */
 #endif /* HAVE_LIBKSTAT */
 
-static void if_submit(const char *dev, const char *type, derive_t rx,
-                      derive_t tx) {
+/* The value lists of one read, dispatched together at its end. */
+static vl_batch_t if_batch = VL_BATCH_INIT;
+
+static void if_submit_values(const char *dev, const char *type, derive_t rx,
+                             derive_t tx) {
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[] = {
       {.derive = rx},
       {.derive = tx},
   };
 
-  if (ignorelist_match(ignorelist, dev) != 0)
-    return;
-
   vl.values = values;
   vl.values_len = STATIC_ARRAY_SIZE(values);
   sstrncpy(vl.plugin, "interface", sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, dev, sizeof(vl.plugin_instance));
   sstrncpy(vl.type, type, sizeof(vl.type));
 
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&if_batch, &vl);
+} /* void if_submit_values */
+
+static void if_submit(const char *dev, const char *type, derive_t rx,
+                      derive_t tx) {
+  pthread_mutex_lock(&ignorelist_lock);
+  int ignored = ignorelist_match(ignorelist, dev);
+  pthread_mutex_unlock(&ignorelist_lock);
+  if (ignored != 0)
+    return;
+
+  if_submit_values(dev, type, rx, tx);
 } /* void if_submit */
 
-static int interface_read(void) {
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+static int if_link_compare(void const *a, void const *b) {
+  int ia = *(int const *)a;
+  int ib = *(int const *)b;
+  return (ia > ib) - (ia < ib);
+} /* int if_link_compare */
+
+/* Returns whether the interface is ignored, matching the ignorelist only if
+ * "ifindex" is new or had a different name in the last dump. */
+static bool if_link_ignored(int ifindex, char const *name) {
+  pthread_mutex_lock(&ignorelist_lock);
+
+  if (if_links == NULL)
+    if_links = c_avl_create(if_link_compare);
+
+  if_link_t *link = NULL;
+  if ((if_links == NULL) ||
+      (c_avl_get(if_links, &ifindex, (void *)&link) != 0)) {
+    link = calloc(1, sizeof(*link));
+    if (link == NULL) {
+      bool ignored = (ignorelist_match(ignorelist, name) != 0);
+      pthread_mutex_unlock(&ignorelist_lock);
+      return ignored;
+    }
+    link->ifindex = ifindex;
+    link->name[0] = 0;
+
+    if ((if_links == NULL) ||
+        (c_avl_insert(if_links, &link->ifindex, link) != 0)) {
+      sfree(link);
+      bool ignored = (ignorelist_match(ignorelist, name) != 0);
+      pthread_mutex_unlock(&ignorelist_lock);
+      return ignored;
+    }
+  }
+
+  if (strcmp(link->name, name) != 0) {
+    sstrncpy(link->name, name, sizeof(link->name));
+    link->ignored = (ignorelist_match(ignorelist, name) != 0);
+  }
+  link->generation = if_links_generation;
+  bool ignored = link->ignored;
+
+  pthread_mutex_unlock(&ignorelist_lock);
+  return ignored;
+} /* bool if_link_ignored */
+
+/* Forgets the interfaces that were not part of the last dump. */
+static void if_links_prune(size_t seen) {
+  pthread_mutex_lock(&ignorelist_lock);
+  if ((if_links == NULL) || ((size_t)c_avl_size(if_links) <= seen)) {
+    pthread_mutex_unlock(&ignorelist_lock);
+    return;
+  }
+
+  size_t stale_num = (size_t)c_avl_size(if_links) - seen;
+  int *stale = calloc(stale_num, sizeof(*stale));
+  if (stale == NULL) {
+    pthread_mutex_unlock(&ignorelist_lock);
+    return;
+  }
+
+  size_t n = 0;
+  c_avl_iterator_t *iter = c_avl_get_iterator(if_links);
+  void *key;
+  if_link_t *link;
+  while ((n < stale_num) &&
+         (c_avl_iterator_next(iter, &key, (void *)&link) == 0))
+    if (link->generation != if_links_generation)
+      stale[n++] = link->ifindex;
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < n; i++) {
+    if (c_avl_remove(if_links, stale + i, NULL, (void *)&link) == 0)
+      sfree(link);
+  }
+
+  pthread_mutex_unlock(&ignorelist_lock);
+  sfree(stale);
+} /* void if_links_prune */
+
+/* Dispatches the counters of one RTM_NEWLINK message. Returns true if the
+ * interface was looked up in `if_links'. */
+static bool if_nl_submit_link(struct nlmsghdr const *nlh) {
+  struct ifinfomsg const *ifi = NLMSG_DATA(nlh);
+  int len = (int)nlh->nlmsg_len - (int)NLMSG_LENGTH(sizeof(*ifi));
+  if (len < 0)
+    return false;
+
+  char const *name = NULL;
+  struct rtnl_link_stats64 st = {0};
+  bool have_stats = false;
+
+  for (struct rtattr const *rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+       rta = RTA_NEXT(rta, len)) {
+    size_t payload = RTA_PAYLOAD(rta);
+    if ((rta->rta_type == IFLA_IFNAME) && (payload > 0) &&
+        (((char const *)RTA_DATA(rta))[payload - 1] == 0)) {
+      name = RTA_DATA(rta);
+    } else if (rta->rta_type == IFLA_STATS64) {
+      /* Older kernels send a shorter struct. */
+      memcpy(&st, RTA_DATA(rta), (payload < sizeof(st)) ? payload : sizeof(st));
+      have_stats = true;
+    }
+  }
+
+  if ((name == NULL) || (name[0] == 0) || !have_stats)
+    return false;
+
+  if (!report_inactive && (st.rx_packets == 0) && (st.tx_packets == 0))
+    return false;
+
+  if (if_link_ignored(ifi->ifi_index, name))
+    return true;
+
+  /* Same as the columns of /proc/net/dev. */
+  if_submit_values(name, "if_packets", (derive_t)st.rx_packets,
+                   (derive_t)st.tx_packets);
+  if_submit_values(name, "if_octets", (derive_t)st.rx_bytes,
+                   (derive_t)st.tx_bytes);
+  if_submit_values(name, "if_errors", (derive_t)st.rx_errors,
+                   (derive_t)st.tx_errors);
+  if_submit_values(name, "if_dropped",
+                   (derive_t)(st.rx_dropped + st.rx_missed_errors),
+                   (derive_t)st.tx_dropped);
+  return true;
+} /* bool if_nl_submit_link */
+
+/* Reads the counters of all interfaces with a single RTM_GETLINK dump.
+ * Returns zero on success and an errno value otherwise. */
+static int if_nl_read(void) {
+  if (if_nl_sock < 0) {
+    if_nl_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (if_nl_sock < 0)
+      return errno;
+  }
+
+  struct {
+    struct nlmsghdr nlh;
+    struct ifinfomsg ifi;
+  } req = {
+      .nlh =
+          {
+              .nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+              .nlmsg_type = RTM_GETLINK,
+              .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+              .nlmsg_seq = ++if_nl_seq,
+          },
+      .ifi =
+          {
+              .ifi_family = AF_UNSPEC,
+          },
+  };
+  struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+
+  if (sendto(if_nl_sock, &req, req.nlh.nlmsg_len, /* flags = */ 0,
+             (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+    return errno;
+
+  if_links_generation++;
+  size_t seen = 0;
+
+  while (true) {
+    ssize_t status =
+        recv(if_nl_sock, if_nl_buffer, sizeof(if_nl_buffer), /* flags = */ 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    } else if (status == 0) {
+      return EPIPE;
+    }
+
+    int len = (int)status;
+    for (struct nlmsghdr const *nlh = (void *)if_nl_buffer; NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      if (nlh->nlmsg_seq != req.nlh.nlmsg_seq)
+        continue;
+
+      if (nlh->nlmsg_type == NLMSG_DONE) {
+        /* A dump that failed half-way ends with a negative errno. */
+        int const *err = NLMSG_DATA(nlh);
+        if ((nlh->nlmsg_len >= NLMSG_LENGTH(sizeof(*err))) && (*err < 0))
+          return -*err;
+        if_links_prune(seen);
+        return 0;
+      } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr const *err = NLMSG_DATA(nlh);
+        return (err->error != 0) ? -err->error : EPROTO;
+      } else if (nlh->nlmsg_type == RTM_NEWLINK) {
+        if (if_nl_submit_link(nlh))
+          seen++;
+      }
+    }
+  }
+} /* int if_nl_read */
+#endif /* KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H */
+
+static int interface_read_devices(void) {
 #if KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
   derive_t incoming, outgoing;
   char *device;
 
@@ -189,12 +473,43 @@ static int interface_read(void) {
   char *fields[16];
   int numfields;
 
-  if ((fh = fopen("/proc/net/dev", "r")) == NULL) {
-    WARNING("interface plugin: fopen: %s", STRERRNO);
+#if HAVE_LINUX_RTNETLINK_H
+  if (!if_nl_unavailable) {
+    bool opened = (if_nl_sock >= 0);
+    int status = if_nl_read();
+    if (status == 0)
+      return 0;
+
+    /* Values may have been added before the dump failed. */
+    vl_batch_free(&if_batch);
+    close(if_nl_sock);
+    if_nl_sock = -1;
+
+    if (!opened) {
+      NOTICE("interface plugin: Reading the interfaces via netlink failed "
+             "(%s). Reading /proc/net/dev instead.",
+             STRERROR(status));
+      if_nl_unavailable = true;
+    } else {
+      WARNING("interface plugin: netlink dump failed: %s", STRERROR(status));
+    }
+  }
+#endif
+
+  if (proc_net_dev == NULL) {
+    proc_net_dev = proc_file_create("/proc/net/dev");
+    if (proc_net_dev == NULL) {
+      ERROR("interface plugin: proc_file_create failed.");
+      return -1;
+    }
+  }
+
+  if (proc_file_read(proc_net_dev) < 0) {
+    WARNING("interface plugin: reading /proc/net/dev failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, 1024, fh) != NULL) {
+  while ((buffer = proc_file_next_line(proc_net_dev)) != NULL) {
     if (!(dummy = strchr(buffer, ':')))
       continue;
     dummy[0] = '\0';
@@ -207,32 +522,30 @@ static int interface_read(void) {
     if (device[0] == '\0')
       continue;
 
-    numfields = strsplit(dummy, fields, 16);
+    numfields = (int)proc_file_split(dummy, fields, 16);
 
     if (numfields < 11)
       continue;
 
-    incoming = atoll(fields[1]);
-    outgoing = atoll(fields[9]);
+    incoming = proc_atou64(fields[1]);
+    outgoing = proc_atou64(fields[9]);
     if (!report_inactive && incoming == 0 && outgoing == 0)
       continue;
 
     if_submit(device, "if_packets", incoming, outgoing);
 
-    incoming = atoll(fields[0]);
-    outgoing = atoll(fields[8]);
+    incoming = proc_atou64(fields[0]);
+    outgoing = proc_atou64(fields[8]);
     if_submit(device, "if_octets", incoming, outgoing);
 
-    incoming = atoll(fields[2]);
-    outgoing = atoll(fields[10]);
+    incoming = proc_atou64(fields[2]);
+    outgoing = proc_atou64(fields[10]);
     if_submit(device, "if_errors", incoming, outgoing);
 
-    incoming = atoll(fields[3]);
-    outgoing = atoll(fields[11]);
+    incoming = proc_atou64(fields[3]);
+    outgoing = proc_atou64(fields[11]);
     if_submit(device, "if_dropped", incoming, outgoing);
   }
-
-  fclose(fh);
   /* #endif KERNEL_LINUX */
 
 #elif HAVE_GETIFADDRS
@@ -387,8 +700,31 @@ static int interface_read(void) {
 #endif /* HAVE_PERFSTAT */
 
   return 0;
+} /* int interface_read_devices */
+
+static int interface_read(void) {
+  int status = interface_read_devices();
+  vl_batch_dispatch(&if_batch);
+  return status;
 } /* int interface_read */
 
+static int interface_shutdown(void) {
+  vl_batch_free(&if_batch);
+#if KERNEL_LINUX
+  proc_file_destroy(proc_net_dev);
+  proc_net_dev = NULL;
+#endif
+#if KERNEL_LINUX && HAVE_LINUX_RTNETLINK_H
+  if (if_nl_sock >= 0)
+    close(if_nl_sock);
+  if_nl_sock = -1;
+  pthread_mutex_lock(&ignorelist_lock);
+  if_links_clear();
+  pthread_mutex_unlock(&ignorelist_lock);
+#endif
+  return 0;
+} /* int interface_shutdown */
+
 void module_register(void) {
   plugin_register_config("interface", interface_config, config_keys,
                          config_keys_num);
@@ -396,4 +732,6 @@ void module_register(void) {
   plugin_register_init("interface", interface_init);
 #endif
   plugin_register_read("interface", interface_read);
+  plugin_register_reload("interface", interface_reload);
+  plugin_register_shutdown("interface", interface_shutdown);
 } /* void module_register */
@@ -62,6 +62,15 @@ struct c_ipmi_instance_s {
   char *username;
   char *password;
   unsigned int authtype;
+  bool sdr_cache;
+
+  /* Sensor reads are spread over the interval, at most "max_pending" of them
+   * are outstanding at any time and readings younger than "cache_time" are
+   * reused. The reads are issued by the instance's thread. */
+  bool read_spread;
+  int max_pending;
+  cdtime_t cache_time;
+  int pending;
 
   bool connected;
   ipmi_con_t *connection;
@@ -85,6 +94,11 @@ struct c_ipmi_sensor_list_s {
   c_ipmi_sensor_list_t *next;
   c_ipmi_instance_t *instance;
   unsigned int use;
+
+  bool read_scheduled;
+  cdtime_t read_at;
+  double value;
+  cdtime_t value_time;
 };
 
 struct c_ipmi_db_type_map_s {
@@ -98,6 +112,7 @@ typedef struct c_ipmi_db_type_map_s c_ipmi_db_type_map_t;
  */
 static os_handler_t *os_handler;
 static c_ipmi_instance_t *instances;
+static char *sdr_cache_file;
 
 /*
  * Misc private functions
@@ -173,17 +188,36 @@ static notification_t c_ipmi_notification_init(c_ipmi_instance_t const *st,
 /* Prototype for sensor_list_remove, so sensor_read_handler can call it. */
 static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor);
 
+static void sensor_dispatch(c_ipmi_sensor_list_t const *list_item,
+                            double value) {
+  c_ipmi_instance_t const *st = list_item->instance;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = value};
+  vl.values_len = 1;
+
+  if (st->host != NULL)
+    sstrncpy(vl.host, st->host, sizeof(vl.host));
+  sstrncpy(vl.plugin, "ipmi", sizeof(vl.plugin));
+  sstrncpy(vl.type, list_item->sensor_type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, list_item->type_instance,
+           sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* void sensor_dispatch */
+
 static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
                                 enum ipmi_value_present_e value_present,
                                 unsigned int __attribute__((unused)) raw_value,
                                 double value, ipmi_states_t *states,
                                 void *user_data) {
-  value_list_t vl = VALUE_LIST_INIT;
-
   c_ipmi_sensor_list_t *list_item = user_data;
   c_ipmi_instance_t *st = list_item->instance;
 
+  pthread_mutex_lock(&st->sensor_list_lock);
   list_item->use--;
+  st->pending--;
+  pthread_mutex_unlock(&st->sensor_list_lock);
 
   if (err != 0) {
     if (IPMI_IS_IPMI_ERR(err) &&
@@ -286,17 +320,10 @@ static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
     return;
   }
 
-  vl.values = &(value_t){.gauge = value};
-  vl.values_len = 1;
+  list_item->value = value;
+  list_item->value_time = cdtime();
 
-  if (st->host != NULL)
-    sstrncpy(vl.host, st->host, sizeof(vl.host));
-  sstrncpy(vl.plugin, "ipmi", sizeof(vl.plugin));
-  sstrncpy(vl.type, list_item->sensor_type, sizeof(vl.type));
-  sstrncpy(vl.type_instance, list_item->type_instance,
-           sizeof(vl.type_instance));
-
-  plugin_dispatch_values(&vl);
+  sensor_dispatch(list_item, value);
 } /* void sensor_read_handler */
 
 static void sensor_get_name(ipmi_sensor_t *sensor, char *buffer, int buf_len) {
@@ -572,21 +599,39 @@ static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor) {
   return 0;
 } /* int sensor_list_remove */
 
+/* Schedules a read of all sensors. The reads are issued by
+ * sensor_list_read_due(). */
 static int sensor_list_read_all(c_ipmi_instance_t *st) {
+  cdtime_t now = cdtime();
+  cdtime_t interval = plugin_get_interval();
+  size_t sensors_num = 0;
+  size_t i = 0;
+
   pthread_mutex_lock(&st->sensor_list_lock);
 
   for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
-       list_item = list_item->next) {
+       list_item = list_item->next)
+    sensors_num++;
+
+  for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
+       list_item = list_item->next, i++) {
     DEBUG("ipmi plugin: try read sensor `%s` of `%s`, use: %d",
           list_item->sensor_name, st->name, list_item->use);
 
     /* Reading already initiated */
-    if (list_item->use)
+    if (list_item->use || list_item->read_scheduled)
+      continue;
+
+    if ((st->cache_time > 0) && (list_item->value_time != 0) &&
+        (now - list_item->value_time < st->cache_time)) {
+      sensor_dispatch(list_item, list_item->value);
       continue;
+    }
 
-    list_item->use++;
-    ipmi_sensor_id_get_reading(list_item->sensor_id, sensor_read_handler,
-                               /* user data = */ (void *)list_item);
+    list_item->read_scheduled = true;
+    list_item->read_at = now;
+    if (st->read_spread)
+      list_item->read_at += interval * i / sensors_num;
   } /* for (list_item) */
 
   pthread_mutex_unlock(&st->sensor_list_lock);
@@ -594,6 +639,48 @@ static int sensor_list_read_all(c_ipmi_instance_t *st) {
   return 0;
 } /* int sensor_list_read_all */
 
+/* Issues the reads which are due, as long as fewer than "max_pending" reads
+ * are outstanding. The lock is not held while a read is issued because the
+ * read handler may be called right away. */
+static void sensor_list_read_due(c_ipmi_instance_t *st) {
+  while (st->active) {
+    cdtime_t now = cdtime();
+    c_ipmi_sensor_list_t *due = NULL;
+    ipmi_sensor_id_t sensor_id;
+
+    pthread_mutex_lock(&st->sensor_list_lock);
+    if ((st->max_pending <= 0) || (st->pending < st->max_pending)) {
+      for (c_ipmi_sensor_list_t *list_item = st->sensor_list;
+           list_item != NULL; list_item = list_item->next) {
+        if (list_item->read_scheduled && (list_item->read_at <= now)) {
+          due = list_item;
+          break;
+        }
+      }
+    }
+
+    if (due == NULL) {
+      pthread_mutex_unlock(&st->sensor_list_lock);
+      return;
+    }
+
+    due->read_scheduled = false;
+    due->use++;
+    st->pending++;
+    sensor_id = due->sensor_id;
+    pthread_mutex_unlock(&st->sensor_list_lock);
+
+    int status = ipmi_sensor_id_get_reading(sensor_id, sensor_read_handler,
+                                            /* user data = */ (void *)due);
+    if (status != 0) {
+      pthread_mutex_lock(&st->sensor_list_lock);
+      due->use--;
+      st->pending--;
+      pthread_mutex_unlock(&st->sensor_list_lock);
+    }
+  }
+} /* void sensor_list_read_due */
+
 static int sensor_list_remove_all(c_ipmi_instance_t *st) {
   c_ipmi_sensor_list_t *list_item;
 
@@ -948,8 +1035,9 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   ipmi_open_option_t opts[] = {
       {.option = IPMI_OPEN_OPTION_ALL, {.ival = 1}},
 #ifdef IPMI_OPEN_OPTION_USE_CACHE
-      /* OpenIPMI-2.0.17 and later: Disable SDR cache in local file */
-      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = 0}},
+      /* OpenIPMI-2.0.17 and later: SDR cache in local file. The cached SDRs
+       * are only used while the repository's timestamps are unchanged. */
+      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = st->sdr_cache ? 1 : 0}},
 #endif
   };
 
@@ -981,8 +1069,13 @@ static void *c_ipmi_thread_main(void *user_data) {
   }
 
   while (st->active) {
+    /* Scheduled reads are checked several times a second. */
     struct timeval tv = {1, 0};
+    if (st->read_spread || (st->max_pending > 0))
+      tv = (struct timeval){0, 100000};
+
     os_handler->perform_one_op(os_handler, &tv);
+    sensor_list_read_due(st);
   }
   return (void *)0;
 } /* void *c_ipmi_thread_main */
@@ -1121,6 +1214,16 @@ static int c_ipmi_config_add_instance(oconfig_item_t *ci) {
       status = cf_util_get_boolean(child, &st->sel_enabled);
     } else if (strcasecmp("SELClearEvent", child->key) == 0) {
       status = cf_util_get_boolean(child, &st->sel_clear_event);
+    } else if (strcasecmp("SensorReadSpread", child->key) == 0) {
+      status = cf_util_get_boolean(child, &st->read_spread);
+    } else if (strcasecmp("MaxPendingRequests", child->key) == 0) {
+      status = cf_util_get_int(child, &st->max_pending);
+    } else if (strcasecmp("SensorCacheTime", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &st->cache_time);
+    } else if (strcasecmp("SDRCache", child->key) == 0) {
+      status = cf_util_get_boolean(child, &st->sdr_cache);
+    } else if (strcasecmp("SDRCacheFile", child->key) == 0) {
+      status = cf_util_get_string(child, &sdr_cache_file);
     } else if (strcasecmp("Host", child->key) == 0)
       status = cf_util_get_string(child, &st->host);
     else if (strcasecmp("Address", child->key) == 0)
@@ -1174,6 +1277,11 @@ static int c_ipmi_config(oconfig_item_t *ci) {
         return status;
 
       have_instance_block = 1;
+    } else if (strcasecmp("SDRCacheFile", child->key) == 0) {
+      /* The cache file is shared by all instances. */
+      int status = cf_util_get_string(child, &sdr_cache_file);
+      if (status != 0)
+        return status;
     } else if (!have_instance_block) {
       /* Non-instance option: Assume legacy configuration (without <Instance />
        * blocks) and call c_ipmi_config_add_instance with the <Plugin /> block.
@@ -1206,6 +1314,7 @@ static int c_ipmi_read(user_data_t *user_data) {
     return 0;
 
   sensor_list_read_all(st);
+  sensor_list_read_due(st);
 
   if (st->init_in_progress > 0)
     st->init_in_progress--;
@@ -1237,6 +1346,14 @@ static int c_ipmi_init(void) {
     return -1;
   };
 
+  if (sdr_cache_file != NULL) {
+    if ((os_handler->database_set_filename == NULL) ||
+        (os_handler->database_set_filename(os_handler, sdr_cache_file) != 0))
+      WARNING("ipmi plugin: Unable to use `%s' as SDR cache file. Is "
+              "OpenIPMI built with database support?",
+              sdr_cache_file);
+  }
+
   if (instances == NULL) {
     /* No instances were configured, let's start a default instance. */
     st = c_ipmi_init_instance();
@@ -1316,6 +1433,7 @@ static int c_ipmi_shutdown(void) {
 
   os_handler->free_os_handler(os_handler);
   os_handler = NULL;
+  sfree(sdr_cache_file);
 
   return 0;
 } /* int c_ipmi_shutdown */
@@ -29,9 +29,18 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include "utils/avltree/avltree.h"
+
 #include <libiptc/libip6tc.h>
 #include <libiptc/libiptc.h>
 
+#include <endian.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
@@ -63,18 +72,24 @@ typedef struct ip6tc_handle ip6tc_handle_t;
  * Config format should be `Chain table chainname',
  * e. g. `Chain mangle incoming'
  */
-static const char *config_keys[] = {"Chain", "Chain6"};
+static const char *config_keys[] = {"Chain", "Chain6", "Backend"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 enum protocol_version_e { IPV4, IPV6 };
 typedef enum protocol_version_e protocol_version_t;
 
+/* libiptc reads the legacy x_tables; nftables dumps the counters of the rules
+ * iptables-nft creates, using nfnetlink. */
+enum backend_e { BACKEND_LIBIPTC, BACKEND_NFTABLES };
+static enum backend_e backend = BACKEND_LIBIPTC;
+
 /*
  * Each table/chain combo that will be queried goes into this list
  */
 #ifndef XT_TABLE_MAXNAMELEN
 #define XT_TABLE_MAXNAMELEN 32
 #endif
-typedef struct {
+typedef struct ip_chain_s ip_chain_t;
+struct ip_chain_s {
   protocol_version_t ip_version;
   char table[XT_TABLE_MAXNAMELEN];
   char chain[XT_TABLE_MAXNAMELEN];
@@ -84,15 +99,74 @@ typedef struct {
   } rule;
   enum { RTYPE_NUM, RTYPE_COMMENT, RTYPE_COMMENT_ALL } rule_type;
   char name[64];
-} ip_chain_t;
+  /* Next entry of the same chain with the same comment. */
+  ip_chain_t *next;
+};
 
 static ip_chain_t **chain_list;
 static int chain_num;
 
+/*
+ * The configured entries grouped by table and chain, sorted so that the
+ * groups of a table are adjacent. Each table is fetched once per read and
+ * each chain is walked once, looking rules up by position and comment.
+ */
+typedef struct {
+  protocol_version_t ip_version;
+  const char *table;
+  const char *chain;
+
+  /* RTYPE_NUM entries, sorted by rule number. */
+  ip_chain_t **by_num;
+  size_t by_num_num;
+  /* RTYPE_COMMENT entries: comment -> list of entries. */
+  c_avl_tree_t *by_comment;
+  /* RTYPE_COMMENT_ALL entries. */
+  ip_chain_t **all;
+  size_t all_num;
+
+  /* State of the current walk. */
+  int rule_num;
+  size_t num_pos;
+} chain_group_t;
+
+static chain_group_t *group_list;
+static size_t group_num;
+
+typedef struct {
+  uint64_t bytes;
+  uint64_t packets;
+} rule_counters_t;
+
+/* nfnetlink socket and receive buffer of the nftables backend. */
+#define NFT_BUFFER_SIZE 32768
+static int nft_fd = -1;
+static uint32_t nft_seq;
+static char *nft_buffer;
+static size_t nft_buffer_size;
+
+/* From <linux/netfilter/nft_compat.h>, which not all systems ship. */
+#define NFT_COMPAT_MATCH_NAME 1
+#define NFT_COMPAT_MATCH_INFO 3
+/* Rule comment in the user data of a rule, as set by libnftnl. */
+#define NFT_UDATA_RULE_COMMENT 0
+
 static int iptables_config(const char *key, const char *value) {
   /* int ip_value; */
   protocol_version_t ip_version = 0;
 
+  if (strcasecmp(key, "Backend") == 0) {
+    if (strcasecmp(value, "libiptc") == 0)
+      backend = BACKEND_LIBIPTC;
+    else if (strcasecmp(value, "nftables") == 0)
+      backend = BACKEND_NFTABLES;
+    else {
+      ERROR("iptables plugin: Unknown backend `%s'.", value);
+      return 1;
+    }
+    return 0;
+  }
+
   if (strcasecmp(key, "Chain") == 0)
     ip_version = IPV4;
   else if (strcasecmp(key, "Chain6") == 0)
@@ -201,30 +275,18 @@ static int iptables_config(const char *key, const char *value) {
   return 0;
 } /* int iptables_config */
 
-static int submit6_match(const struct ip6t_entry_match *match,
-                         const struct ip6t_entry *entry,
-                         const ip_chain_t *chain, int rule_num) {
+static void submit_counters(const ip_chain_t *chain, const char *comment,
+                            const rule_counters_t *counters) {
   int status;
   value_list_t vl = VALUE_LIST_INIT;
 
-  /* Select the rules to collect */
-  if (chain->rule_type == RTYPE_NUM) {
-    if (chain->rule.num != rule_num)
-      return 0;
-  } else {
-    if (strcmp(match->u.user.name, "comment") != 0)
-      return 0;
-    if ((chain->rule_type == RTYPE_COMMENT) &&
-        (strcmp(chain->rule.comment, (char *)match->data) != 0))
-      return 0;
-  }
-
-  sstrncpy(vl.plugin, "ip6tables", sizeof(vl.plugin));
+  sstrncpy(vl.plugin, (chain->ip_version == IPV4) ? "iptables" : "ip6tables",
+           sizeof(vl.plugin));
 
   status = ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%s-%s",
                      chain->table, chain->chain);
   if ((status < 1) || ((unsigned int)status >= sizeof(vl.plugin_instance)))
-    return 0;
+    return;
 
   if (chain->name[0] != '\0') {
     sstrncpy(vl.type_instance, chain->name, sizeof(vl.type_instance));
@@ -233,179 +295,633 @@ static int submit6_match(const struct ip6t_entry_match *match,
       ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%i",
                 chain->rule.num);
     else
-      sstrncpy(vl.type_instance, (char *)match->data, sizeof(vl.type_instance));
+      sstrncpy(vl.type_instance, comment, sizeof(vl.type_instance));
   }
 
   sstrncpy(vl.type, "ipt_bytes", sizeof(vl.type));
-  vl.values = &(value_t){.derive = (derive_t)entry->counters.bcnt};
+  vl.values = &(value_t){.derive = (derive_t)counters->bytes};
   vl.values_len = 1;
   plugin_dispatch_values(&vl);
 
   sstrncpy(vl.type, "ipt_packets", sizeof(vl.type));
-  vl.values = &(value_t){.derive = (derive_t)entry->counters.pcnt};
+  vl.values = &(value_t){.derive = (derive_t)counters->packets};
   plugin_dispatch_values(&vl);
+} /* void submit_counters */
 
-  return 0;
-} /* int submit6_match */
-
-/* This needs to return `int' for IPT_MATCH_ITERATE to work. */
-static int submit_match(const struct ipt_entry_match *match,
-                        const struct ipt_entry *entry, const ip_chain_t *chain,
-                        int rule_num) {
-  int status;
-  value_list_t vl = VALUE_LIST_INIT;
+static void group_walk_begin(chain_group_t *group) {
+  group->rule_num = 0;
+  group->num_pos = 0;
+}
 
-  /* Select the rules to collect */
-  if (chain->rule_type == RTYPE_NUM) {
-    if (chain->rule.num != rule_num)
-      return 0;
-  } else {
-    if (strcmp(match->u.user.name, "comment") != 0)
-      return 0;
-    if ((chain->rule_type == RTYPE_COMMENT) &&
-        (strcmp(chain->rule.comment, (char *)match->data) != 0))
-      return 0;
+/* Called for each rule of the chain, in order. "counters" is NULL if the rule
+ * has no counters. Returns true if none of the following rules can be selected
+ * by position. */
+static bool group_submit_rule(chain_group_t *group,
+                              const rule_counters_t *counters) {
+  group->rule_num++;
+
+  while ((group->num_pos < group->by_num_num) &&
+         (group->by_num[group->num_pos]->rule.num <= group->rule_num)) {
+    ip_chain_t *chain = group->by_num[group->num_pos];
+    if ((chain->rule.num == group->rule_num) && (counters != NULL))
+      submit_counters(chain, NULL, counters);
+    group->num_pos++;
   }
 
-  sstrncpy(vl.plugin, "iptables", sizeof(vl.plugin));
+  return group->num_pos >= group->by_num_num;
+} /* bool group_submit_rule */
 
-  status = ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%s-%s",
-                     chain->table, chain->chain);
-  if ((status < 1) || ((unsigned int)status >= sizeof(vl.plugin_instance)))
-    return 0;
+static bool group_wants_comments(const chain_group_t *group) {
+  return (group->all_num > 0) || (group->by_comment != NULL);
+}
 
-  if (chain->name[0] != '\0') {
-    sstrncpy(vl.type_instance, chain->name, sizeof(vl.type_instance));
-  } else {
-    if (chain->rule_type == RTYPE_NUM)
-      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%i",
-                chain->rule.num);
-    else
-      sstrncpy(vl.type_instance, (char *)match->data, sizeof(vl.type_instance));
-  }
+/* Called for each comment of the rule last passed to group_submit_rule(). */
+static void group_submit_comment(chain_group_t *group, const char *comment,
+                                 const rule_counters_t *counters) {
+  if (counters == NULL)
+    return;
 
-  sstrncpy(vl.type, "ipt_bytes", sizeof(vl.type));
-  vl.values = &(value_t){.derive = (derive_t)entry->counters.bcnt};
-  vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  for (size_t i = 0; i < group->all_num; i++)
+    submit_counters(group->all[i], comment, counters);
 
-  sstrncpy(vl.type, "ipt_packets", sizeof(vl.type));
-  vl.values = &(value_t){.derive = (derive_t)entry->counters.pcnt};
-  plugin_dispatch_values(&vl);
+  ip_chain_t *chain = NULL;
+  if ((group->by_comment == NULL) ||
+      (c_avl_get(group->by_comment, comment, (void *)&chain) != 0))
+    return;
+
+  for (; chain != NULL; chain = chain->next)
+    submit_counters(chain, comment, counters);
+} /* void group_submit_comment */
 
+/* This needs to return `int' for IP6T_MATCH_ITERATE to work. */
+static int submit6_match(const struct ip6t_entry_match *match,
+                         const struct ip6t_entry *entry,
+                         chain_group_t *group) {
+  if (strcmp(match->u.user.name, "comment") != 0)
+    return 0;
+
+  rule_counters_t counters = {.bytes = entry->counters.bcnt,
+                              .packets = entry->counters.pcnt};
+  group_submit_comment(group, (const char *)match->data, &counters);
+  return 0;
+} /* int submit6_match */
+
+/* This needs to return `int' for IPT_MATCH_ITERATE to work. */
+static int submit_match(const struct ipt_entry_match *match,
+                        const struct ipt_entry *entry, chain_group_t *group) {
+  if (strcmp(match->u.user.name, "comment") != 0)
+    return 0;
+
+  rule_counters_t counters = {.bytes = entry->counters.bcnt,
+                              .packets = entry->counters.pcnt};
+  group_submit_comment(group, (const char *)match->data, &counters);
   return 0;
 } /* int submit_match */
 
 /* ipv6 submit_chain */
-static void submit6_chain(ip6tc_handle_t *handle, ip_chain_t *chain) {
+static void submit6_chain(ip6tc_handle_t *handle, chain_group_t *group) {
   const struct ip6t_entry *entry;
-  int rule_num;
 
   /* Find first rule for chain and use the iterate macro */
-  entry = ip6tc_first_rule(chain->chain, handle);
+  entry = ip6tc_first_rule(group->chain, handle);
   if (entry == NULL) {
     DEBUG("ip6tc_first_rule failed: %s", ip6tc_strerror(errno));
     return;
   }
 
-  rule_num = 1;
+  group_walk_begin(group);
   while (entry) {
-    if (chain->rule_type == RTYPE_NUM) {
-      submit6_match(NULL, entry, chain, rule_num);
-    } else {
-      IP6T_MATCH_ITERATE(entry, submit6_match, entry, chain, rule_num);
-    }
+    rule_counters_t counters = {.bytes = entry->counters.bcnt,
+                                .packets = entry->counters.pcnt};
+    bool done = group_submit_rule(group, &counters);
+
+    if (group_wants_comments(group))
+      IP6T_MATCH_ITERATE(entry, submit6_match, entry, group);
+    else if (done)
+      break;
 
     entry = ip6tc_next_rule(entry, handle);
-    rule_num++;
   } /* while (entry) */
 }
 
 /* ipv4 submit_chain */
-static void submit_chain(iptc_handle_t *handle, ip_chain_t *chain) {
+static void submit_chain(iptc_handle_t *handle, chain_group_t *group) {
   const struct ipt_entry *entry;
-  int rule_num;
 
   /* Find first rule for chain and use the iterate macro */
-  entry = iptc_first_rule(chain->chain, handle);
+  entry = iptc_first_rule(group->chain, handle);
   if (entry == NULL) {
     DEBUG("iptc_first_rule failed: %s", iptc_strerror(errno));
     return;
   }
 
-  rule_num = 1;
+  group_walk_begin(group);
   while (entry) {
-    if (chain->rule_type == RTYPE_NUM) {
-      submit_match(NULL, entry, chain, rule_num);
-    } else {
-      IPT_MATCH_ITERATE(entry, submit_match, entry, chain, rule_num);
-    }
+    rule_counters_t counters = {.bytes = entry->counters.bcnt,
+                                .packets = entry->counters.pcnt};
+    bool done = group_submit_rule(group, &counters);
+
+    if (group_wants_comments(group))
+      IPT_MATCH_ITERATE(entry, submit_match, entry, group);
+    else if (done)
+      break;
 
     entry = iptc_next_rule(entry, handle);
-    rule_num++;
   } /* while (entry) */
 }
 
-static int iptables_read(void) {
-  int num_failures = 0;
-  ip_chain_t *chain;
-
-  /* Init the iptc handle structure and query the correct table */
-  for (int i = 0; i < chain_num; i++) {
-    chain = chain_list[i];
-
-    if (!chain) {
-      DEBUG("iptables plugin: chain == NULL");
-      continue;
-    }
+/* Reads the chains of one table, group_list[0 .. groups_num), with libiptc.
+ * Returns zero on success. */
+static int iptc_read_table(chain_group_t *groups, size_t groups_num) {
+  const char *table = groups[0].table;
 
-    if (chain->ip_version == IPV4) {
+  if (groups[0].ip_version == IPV4) {
 #ifdef HAVE_IPTC_HANDLE_T
-      iptc_handle_t _handle;
-      iptc_handle_t *handle = &_handle;
+    iptc_handle_t _handle;
+    iptc_handle_t *handle = &_handle;
 
-      *handle = iptc_init(chain->table);
+    *handle = iptc_init(table);
 #else
-      iptc_handle_t *handle;
-      handle = iptc_init(chain->table);
+    iptc_handle_t *handle;
+    handle = iptc_init(table);
 #endif
 
-      if (!handle) {
-        ERROR("iptables plugin: iptc_init (%s) failed: %s", chain->table,
-              iptc_strerror(errno));
-        num_failures++;
-        continue;
-      }
+    if (!handle) {
+      ERROR("iptables plugin: iptc_init (%s) failed: %s", table,
+            iptc_strerror(errno));
+      return -1;
+    }
 
-      submit_chain(handle, chain);
-      iptc_free(handle);
-    } else if (chain->ip_version == IPV6) {
+    for (size_t i = 0; i < groups_num; i++)
+      submit_chain(handle, groups + i);
+    iptc_free(handle);
+  } else {
 #ifdef HAVE_IP6TC_HANDLE_T
-      ip6tc_handle_t _handle;
-      ip6tc_handle_t *handle = &_handle;
+    ip6tc_handle_t _handle;
+    ip6tc_handle_t *handle = &_handle;
 
-      *handle = ip6tc_init(chain->table);
+    *handle = ip6tc_init(table);
 #else
-      ip6tc_handle_t *handle;
-      handle = ip6tc_init(chain->table);
+    ip6tc_handle_t *handle;
+    handle = ip6tc_init(table);
 #endif
-      if (!handle) {
-        ERROR("iptables plugin: ip6tc_init (%s) failed: %s", chain->table,
-              ip6tc_strerror(errno));
-        num_failures++;
+    if (!handle) {
+      ERROR("iptables plugin: ip6tc_init (%s) failed: %s", table,
+            ip6tc_strerror(errno));
+      return -1;
+    }
+
+    for (size_t i = 0; i < groups_num; i++)
+      submit6_chain(handle, groups + i);
+    ip6tc_free(handle);
+  }
+
+  return 0;
+} /* int iptc_read_table */
+
+/*
+ * nftables backend
+ */
+#define NFT_ATTR_DATA(nla) ((const char *)(nla) + NLA_HDRLEN)
+#define NFT_ATTR_LEN(nla) ((size_t)(nla)->nla_len - NLA_HDRLEN)
+
+/* Sets tb[type] to the last attribute of each type up to "max". */
+static void nft_parse_attrs(const char *data, size_t len,
+                            const struct nlattr **tb, int max) {
+  memset(tb, 0, (max + 1) * sizeof(*tb));
+
+  while (len >= NLA_HDRLEN) {
+    const struct nlattr *nla = (const struct nlattr *)data;
+    if ((nla->nla_len < NLA_HDRLEN) || (nla->nla_len > len))
+      break;
+
+    int type = nla->nla_type & NLA_TYPE_MASK;
+    if (type <= max)
+      tb[type] = nla;
+
+    size_t step = NLA_ALIGN(nla->nla_len);
+    if (step >= len)
+      break;
+    data += step;
+    len -= step;
+  }
+} /* void nft_parse_attrs */
+
+/* Returns the attribute's value if it is a null-terminated string. */
+static const char *nft_attr_string(const struct nlattr *nla) {
+  if ((nla == NULL) || (NFT_ATTR_LEN(nla) == 0) ||
+      (memchr(NFT_ATTR_DATA(nla), 0, NFT_ATTR_LEN(nla)) == NULL))
+    return NULL;
+  return NFT_ATTR_DATA(nla);
+}
+
+static uint64_t nft_attr_be64(const struct nlattr *nla) {
+  uint64_t value = 0;
+  if ((nla != NULL) && (NFT_ATTR_LEN(nla) >= sizeof(value)))
+    memcpy(&value, NFT_ATTR_DATA(nla), sizeof(value));
+  return be64toh(value);
+}
+
+/* Finds the counter and the comments of xt "comment" matches in the
+ * expressions of a rule. Returns the number of comments stored in
+ * "comments". */
+static size_t nft_parse_exprs(const struct nlattr *exprs,
+                              rule_counters_t *counters, bool *have_counters,
+                              const char **comments, size_t comments_max) {
+  const char *data = NFT_ATTR_DATA(exprs);
+  size_t len = NFT_ATTR_LEN(exprs);
+  size_t comments_num = 0;
+
+  while (len >= NLA_HDRLEN) {
+    const struct nlattr *elem = (const struct nlattr *)data;
+    if ((elem->nla_len < NLA_HDRLEN) || (elem->nla_len > len))
+      break;
+
+    const struct nlattr *tb[NFTA_EXPR_MAX + 1];
+    nft_parse_attrs(NFT_ATTR_DATA(elem), NFT_ATTR_LEN(elem), tb, NFTA_EXPR_MAX);
+
+    const char *name = nft_attr_string(tb[NFTA_EXPR_NAME]);
+    if ((name != NULL) && (tb[NFTA_EXPR_DATA] != NULL)) {
+      if (strcmp(name, "counter") == 0) {
+        const struct nlattr *ctb[NFTA_COUNTER_MAX + 1];
+        nft_parse_attrs(NFT_ATTR_DATA(tb[NFTA_EXPR_DATA]),
+                        NFT_ATTR_LEN(tb[NFTA_EXPR_DATA]), ctb,
+                        NFTA_COUNTER_MAX);
+        counters->bytes = nft_attr_be64(ctb[NFTA_COUNTER_BYTES]);
+        counters->packets = nft_attr_be64(ctb[NFTA_COUNTER_PACKETS]);
+        *have_counters = true;
+      } else if ((strcmp(name, "match") == 0) &&
+                 (comments_num < comments_max)) {
+        const struct nlattr *mtb[NFT_COMPAT_MATCH_INFO + 1];
+        nft_parse_attrs(NFT_ATTR_DATA(tb[NFTA_EXPR_DATA]),
+                        NFT_ATTR_LEN(tb[NFTA_EXPR_DATA]), mtb,
+                        NFT_COMPAT_MATCH_INFO);
+        const char *match = nft_attr_string(mtb[NFT_COMPAT_MATCH_NAME]);
+        const char *info = nft_attr_string(mtb[NFT_COMPAT_MATCH_INFO]);
+        if ((match != NULL) && (strcmp(match, "comment") == 0) &&
+            (info != NULL))
+          comments[comments_num++] = info;
+      }
+    }
+
+    size_t step = NLA_ALIGN(elem->nla_len);
+    if (step >= len)
+      break;
+    data += step;
+    len -= step;
+  }
+
+  return comments_num;
+} /* size_t nft_parse_exprs */
+
+/* Returns the rule comment stored in the rule's user data, if any. */
+static const char *nft_udata_comment(const struct nlattr *udata) {
+  const uint8_t *data = (const uint8_t *)NFT_ATTR_DATA(udata);
+  size_t len = NFT_ATTR_LEN(udata);
+
+  while (len >= 2) {
+    uint8_t type = data[0];
+    uint8_t value_len = data[1];
+    if ((size_t)value_len + 2 > len)
+      break;
+
+    if ((type == NFT_UDATA_RULE_COMMENT) && (value_len > 0) &&
+        (data[2 + value_len - 1] == 0))
+      return (const char *)data + 2;
+
+    data += 2 + value_len;
+    len -= 2 + value_len;
+  }
+
+  return NULL;
+} /* const char *nft_udata_comment */
+
+static void nft_handle_rule(chain_group_t *groups, size_t groups_num,
+                            const struct nlmsghdr *h) {
+  size_t hdr_len = NLMSG_LENGTH(sizeof(struct nfgenmsg));
+  if (h->nlmsg_len < hdr_len)
+    return;
+
+  const struct nlattr *tb[NFTA_RULE_MAX + 1];
+  nft_parse_attrs((const char *)h + NLMSG_ALIGN(hdr_len),
+                  h->nlmsg_len - NLMSG_ALIGN(hdr_len), tb, NFTA_RULE_MAX);
+
+  const char *table = nft_attr_string(tb[NFTA_RULE_TABLE]);
+  const char *chain = nft_attr_string(tb[NFTA_RULE_CHAIN]);
+  if ((table == NULL) || (chain == NULL) ||
+      (strcmp(table, groups[0].table) != 0))
+    return;
+
+  chain_group_t *group = NULL;
+  for (size_t i = 0; i < groups_num; i++) {
+    if (strcmp(chain, groups[i].chain) == 0) {
+      group = groups + i;
+      break;
+    }
+  }
+  if (group == NULL)
+    return;
+
+  rule_counters_t counters = {0};
+  bool have_counters = false;
+  const char *comments[4];
+  size_t comments_num = 0;
+
+  if (tb[NFTA_RULE_EXPRESSIONS] != NULL)
+    comments_num =
+        nft_parse_exprs(tb[NFTA_RULE_EXPRESSIONS], &counters, &have_counters,
+                        comments, STATIC_ARRAY_SIZE(comments) - 1);
+  if (tb[NFTA_RULE_USERDATA] != NULL) {
+    const char *comment = nft_udata_comment(tb[NFTA_RULE_USERDATA]);
+    if (comment != NULL)
+      comments[comments_num++] = comment;
+  }
+
+  const rule_counters_t *c = have_counters ? &counters : NULL;
+  group_submit_rule(group, c);
+  if (group_wants_comments(group))
+    for (size_t i = 0; i < comments_num; i++)
+      group_submit_comment(group, comments[i], c);
+} /* void nft_handle_rule */
+
+static int nft_open(void) {
+  if (nft_fd >= 0)
+    return 0;
+
+  nft_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+  if (nft_fd < 0) {
+    ERROR("iptables plugin: socket(AF_NETLINK, SOCK_RAW, NETLINK_NETFILTER) "
+          "failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  if (nft_buffer == NULL) {
+    nft_buffer = malloc(NFT_BUFFER_SIZE);
+    if (nft_buffer == NULL) {
+      ERROR("iptables plugin: malloc failed.");
+      close(nft_fd);
+      nft_fd = -1;
+      return -1;
+    }
+    nft_buffer_size = NFT_BUFFER_SIZE;
+  }
+
+  return 0;
+} /* int nft_open */
+
+static void nft_close(void) {
+  if (nft_fd >= 0)
+    close(nft_fd);
+  nft_fd = -1;
+}
+
+/* Dumps the rules of one table, groups[0 .. groups_num), and handles the
+ * chains configured for it. Returns zero on success. */
+static int nft_read_table(chain_group_t *groups, size_t groups_num) {
+  if (nft_open() != 0)
+    return -1;
+
+  const char *table = groups[0].table;
+  size_t table_len = strlen(table) + 1;
+
+  struct {
+    struct nlmsghdr nlh;
+    struct nfgenmsg nfg;
+    char attrs[NLA_HDRLEN + NLA_ALIGN(XT_TABLE_MAXNAMELEN)];
+  } req = {
+      .nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct nfgenmsg)) +
+                       NLA_HDRLEN + NLA_ALIGN(table_len),
+      .nlh.nlmsg_type = (NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_GETRULE,
+      .nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+      .nlh.nlmsg_seq = ++nft_seq,
+      .nfg.nfgen_family =
+          (groups[0].ip_version == IPV4) ? NFPROTO_IPV4 : NFPROTO_IPV6,
+      .nfg.version = NFNETLINK_V0,
+  };
+
+  /* Older kernels ignore this and dump all tables of the family. */
+  struct nlattr *nla = (struct nlattr *)req.attrs;
+  nla->nla_type = NFTA_RULE_TABLE;
+  nla->nla_len = NLA_HDRLEN + table_len;
+  memcpy(req.attrs + NLA_HDRLEN, table, table_len);
+
+  struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
+  if (sendto(nft_fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&nladdr,
+             sizeof(nladdr)) < 0) {
+    ERROR("iptables plugin: sendto(2) failed: %s", STRERRNO);
+    nft_close();
+    return -1;
+  }
+
+  for (size_t i = 0; i < groups_num; i++)
+    group_walk_begin(groups + i);
+
+  while (1) {
+    /* Peek at the size of the next message and grow the buffer if needed, so
+     * that no message is ever truncated. */
+    ssize_t status = recv(nft_fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    if ((status > 0) && ((size_t)status > nft_buffer_size)) {
+      char *tmp = realloc(nft_buffer, (size_t)status);
+      if (tmp == NULL) {
+        ERROR("iptables plugin: realloc failed.");
+        nft_close();
+        return -1;
+      }
+      nft_buffer = tmp;
+      nft_buffer_size = (size_t)status;
+    }
+    if (status >= 0)
+      status = recv(nft_fd, nft_buffer, nft_buffer_size, /* flags = */ 0);
+
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+
+      ERROR("iptables plugin: recv(2) failed: %s", STRERRNO);
+      nft_close();
+      return -1;
+    } else if (status == 0) {
+      return 0;
+    }
+
+    struct nlmsghdr *h = (struct nlmsghdr *)nft_buffer;
+    while (NLMSG_OK(h, status)) {
+      if (h->nlmsg_seq != nft_seq) {
+        h = NLMSG_NEXT(h, status);
         continue;
       }
 
-      submit6_chain(handle, chain);
-      ip6tc_free(handle);
-    } else
-      num_failures++;
-  } /* for (i = 0 .. chain_num) */
+      if (h->nlmsg_type == NLMSG_DONE) {
+        return 0;
+      } else if (h->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *msg_error = NLMSG_DATA(h);
+        if (msg_error->error == 0)
+          return 0;
+        ERROR("iptables plugin: Dumping the rules of table `%s' failed: %s",
+              table, STRERROR(-msg_error->error));
+        return -1;
+      }
+
+      if (h->nlmsg_type == ((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWRULE))
+        nft_handle_rule(groups, groups_num, h);
+
+      h = NLMSG_NEXT(h, status);
+    } /* while (NLMSG_OK) */
+  }   /* while (1) */
 
-  return (num_failures < chain_num) ? 0 : -1;
+  /* Not reached because the while() loop above handles the exit condition. */
+  return 0;
+} /* int nft_read_table */
+
+static int iptables_read(void) {
+  int num_failures = 0;
+
+  /* The groups of a table are adjacent, so each table is read once. */
+  for (size_t i = 0; i < group_num;) {
+    size_t end = i + 1;
+    while ((end < group_num) &&
+           (group_list[end].ip_version == group_list[i].ip_version) &&
+           (strcmp(group_list[end].table, group_list[i].table) == 0))
+      end++;
+
+    int status;
+    if (backend == BACKEND_NFTABLES)
+      status = nft_read_table(group_list + i, end - i);
+    else
+      status = iptc_read_table(group_list + i, end - i);
+    if (status != 0)
+      num_failures += (int)(end - i);
+
+    i = end;
+  } /* for (i = 0 .. group_num) */
+
+  return ((size_t)num_failures < group_num) ? 0 : -1;
 } /* int iptables_read */
 
+static int chain_compare(const void *a, const void *b) {
+  const ip_chain_t *c0 = *(ip_chain_t *const *)a;
+  const ip_chain_t *c1 = *(ip_chain_t *const *)b;
+
+  if (c0->ip_version != c1->ip_version)
+    return (c0->ip_version < c1->ip_version) ? -1 : 1;
+
+  int status = strcmp(c0->table, c1->table);
+  if (status == 0)
+    status = strcmp(c0->chain, c1->chain);
+  if (status != 0)
+    return status;
+
+  if ((c0->rule_type == RTYPE_NUM) && (c1->rule_type == RTYPE_NUM) &&
+      (c0->rule.num != c1->rule.num))
+    return (c0->rule.num < c1->rule.num) ? -1 : 1;
+  return 0;
+} /* int chain_compare */
+
+static void groups_free(void) {
+  for (size_t i = 0; i < group_num; i++) {
+    chain_group_t *group = group_list + i;
+    sfree(group->by_num);
+    sfree(group->all);
+    if (group->by_comment != NULL)
+      c_avl_destroy(group->by_comment);
+  }
+  sfree(group_list);
+  group_num = 0;
+}
+
+static int group_add(chain_group_t *group, ip_chain_t *chain) {
+  if (chain->rule_type == RTYPE_COMMENT) {
+    if (group->by_comment == NULL) {
+      group->by_comment =
+          c_avl_create((int (*)(const void *, const void *))strcmp);
+      if (group->by_comment == NULL)
+        return ENOMEM;
+    }
+
+    ip_chain_t *head = NULL;
+    if (c_avl_get(group->by_comment, chain->rule.comment, (void *)&head) ==
+        0) {
+      chain->next = head->next;
+      head->next = chain;
+      return 0;
+    }
+    chain->next = NULL;
+    return (c_avl_insert(group->by_comment, chain->rule.comment, chain) == 0)
+               ? 0
+               : ENOMEM;
+  }
+
+  ip_chain_t ***list;
+  size_t *list_num;
+  if (chain->rule_type == RTYPE_NUM) {
+    list = &group->by_num;
+    list_num = &group->by_num_num;
+  } else {
+    list = &group->all;
+    list_num = &group->all_num;
+  }
+
+  ip_chain_t **tmp = realloc(*list, (*list_num + 1) * sizeof(**list));
+  if (tmp == NULL)
+    return ENOMEM;
+  tmp[*list_num] = chain;
+  *list = tmp;
+  (*list_num)++;
+  return 0;
+} /* int group_add */
+
+static int groups_build(void) {
+  if (chain_num == 0)
+    return 0;
+
+  ip_chain_t **sorted = calloc(chain_num, sizeof(*sorted));
+  group_list = calloc(chain_num, sizeof(*group_list));
+  if ((sorted == NULL) || (group_list == NULL)) {
+    ERROR("iptables plugin: calloc failed.");
+    sfree(sorted);
+    sfree(group_list);
+    return -1;
+  }
+
+  memcpy(sorted, chain_list, chain_num * sizeof(*sorted));
+  qsort(sorted, chain_num, sizeof(*sorted), chain_compare);
+
+  for (int i = 0; i < chain_num; i++) {
+    ip_chain_t *chain = sorted[i];
+    chain_group_t *group =
+        (group_num > 0) ? group_list + (group_num - 1) : NULL;
+
+    if ((group == NULL) || (group->ip_version != chain->ip_version) ||
+        (strcmp(group->table, chain->table) != 0) ||
+        (strcmp(group->chain, chain->chain) != 0)) {
+      group = group_list + group_num;
+      group_num++;
+      group->ip_version = chain->ip_version;
+      group->table = chain->table;
+      group->chain = chain->chain;
+    }
+
+    if (group_add(group, chain) != 0) {
+      ERROR("iptables plugin: Out of memory.");
+      sfree(sorted);
+      groups_free();
+      return -1;
+    }
+  }
+
+  sfree(sorted);
+  DEBUG("iptables plugin: %d entries in %" PRIsz " chains.", chain_num,
+        group_num);
+  return 0;
+} /* int groups_build */
+
 static int iptables_shutdown(void) {
+  groups_free();
+  nft_close();
+  sfree(nft_buffer);
+  nft_buffer_size = 0;
+
   for (int i = 0; i < chain_num; i++) {
     if ((chain_list[i] != NULL) && (chain_list[i]->rule_type == RTYPE_COMMENT))
       sfree(chain_list[i]->rule.comment);
@@ -430,7 +946,7 @@ static int iptables_init(void) {
               "running \"setcap cap_net_admin=ep\" on the collectd binary.");
   }
 #endif
-  return 0;
+  return groups_build();
 } /* int iptables_init */
 
 void module_register(void) {
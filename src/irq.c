@@ -27,6 +27,10 @@
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 
+#if KERNEL_LINUX
+#include "utils/proc_file/proc_file.h"
+#endif
+
 #if !KERNEL_LINUX && !KERNEL_NETBSD
 #error "No applicable input method."
 #endif
@@ -42,11 +46,27 @@
 /*
  * (Module-)Global variables
  */
-static const char *config_keys[] = {"Irq", "IgnoreSelected"};
+static const char *config_keys[] = {"Irq", "IgnoreSelected", "ReportSoftIrqs",
+                                    "PerCpuIrq"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *ignorelist;
 
+#if KERNEL_LINUX
+static bool report_softirqs;
+/* Interrupts whose per-CPU counts are dispatched too. */
+static ignorelist_t *percpu_list;
+
+static proc_file_t *interrupts_file;
+static proc_file_t *softirqs_file;
+
+/* CPU numbers of the columns, from the header line, and the values of the
+ * current row. */
+static int *cpu_ids;
+static uint64_t *cpu_values;
+static size_t cpu_size;
+#endif
+
 /*
  * Private functions
  */
@@ -61,6 +81,14 @@ static int irq_config(const char *key, const char *value) {
     if (IS_TRUE(value))
       invert = 0;
     ignorelist_set_invert(ignorelist, invert);
+#if KERNEL_LINUX
+  } else if (strcasecmp(key, "ReportSoftIrqs") == 0) {
+    report_softirqs = IS_TRUE(value);
+  } else if (strcasecmp(key, "PerCpuIrq") == 0) {
+    if (percpu_list == NULL)
+      percpu_list = ignorelist_create(/* invert = */ 1);
+    ignorelist_add(percpu_list, value);
+#endif
   } else {
     return -1;
   }
@@ -68,15 +96,15 @@ static int irq_config(const char *key, const char *value) {
   return 0;
 }
 
-static void irq_submit(const char *irq_name, derive_t value) {
+static void irq_submit(const char *plugin_instance, const char *irq_name,
+                       derive_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
-  if (ignorelist_match(ignorelist, irq_name) != 0)
-    return;
-
   vl.values = &(value_t){.derive = value};
   vl.values_len = 1;
   sstrncpy(vl.plugin, "irq", sizeof(vl.plugin));
+  if (plugin_instance != NULL)
+    sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
   sstrncpy(vl.type, "irq", sizeof(vl.type));
   sstrncpy(vl.type_instance, irq_name, sizeof(vl.type_instance));
 
@@ -84,96 +112,167 @@ static void irq_submit(const char *irq_name, derive_t value) {
 } /* void irq_submit */
 
 #if KERNEL_LINUX
-static int irq_read(void) {
-  FILE *fh;
-  char buffer[1024];
-  int cpu_count;
-  char *fields[256];
-
-  /*
-   * Example content:
-   *         CPU0       CPU1       CPU2       CPU3
-   * 0:       2574          1          3          2   IO-APIC-edge      timer
-   * 1:     102553     158669     218062      70587   IO-APIC-edge      i8042
-   * 8:          0          0          0          1   IO-APIC-edge      rtc0
-   */
-  fh = fopen("/proc/interrupts", "r");
-  if (fh == NULL) {
-    ERROR("irq plugin: fopen (/proc/interrupts): %s", STRERRNO);
+static char *irq_skip_blanks(char *ptr) {
+  while ((*ptr == ' ') || (*ptr == '\t'))
+    ptr++;
+  return ptr;
+}
+
+/* Reads the "CPU<n>" column names. */
+static int irq_parse_header(char *line, size_t *ret_cpu_count) {
+  size_t cpu_count = 0;
+  char *ptr = irq_skip_blanks(line);
+
+  while (strncmp(ptr, "CPU", 3) == 0) {
+    uint64_t id;
+    char *end;
+    if (proc_parse_uint64(ptr + 3, &end, &id) != 0)
+      break;
+
+    if (cpu_count >= cpu_size) {
+      size_t size = (cpu_size == 0) ? 64 : 2 * cpu_size;
+      int *ids = realloc(cpu_ids, size * sizeof(*cpu_ids));
+      if (ids == NULL)
+        return ENOMEM;
+      cpu_ids = ids;
+
+      uint64_t *values = realloc(cpu_values, size * sizeof(*cpu_values));
+      if (values == NULL)
+        return ENOMEM;
+      cpu_values = values;
+      cpu_size = size;
+    }
+
+    cpu_ids[cpu_count++] = (int)id;
+    ptr = irq_skip_blanks(end);
+  }
+
+  *ret_cpu_count = cpu_count;
+  return 0;
+}
+
+/* Parses /proc/interrupts or /proc/softirqs. Both start with a header naming
+ * the CPU columns, followed by one row per interrupt: the name, a colon, one
+ * count per CPU and, for /proc/interrupts, a description. Rows are parsed in
+ * place, in a single pass, without copying or splitting them first.
+ *
+ * Example content:
+ *         CPU0       CPU1       CPU2       CPU3
+ * 0:       2574          1          3          2   IO-APIC-edge      timer
+ * 1:     102553     158669     218062      70587   IO-APIC-edge      i8042
+ * 8:          0          0          0          1   IO-APIC-edge      rtc0
+ */
+static int irq_read_file(proc_file_t *pf, const char *instance_prefix) {
+  if (proc_file_read(pf) < 0) {
+    ERROR("irq plugin: reading %s failed: %s", proc_file_path(pf), STRERRNO);
     return -1;
   }
 
   /* Get CPU count from the first line */
-  if (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    cpu_count = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-  } else {
+  char *line = proc_file_next_line(pf);
+  size_t cpu_count = 0;
+  if ((line == NULL) || (irq_parse_header(line, &cpu_count) != 0)) {
     ERROR("irq plugin: unable to get CPU count from first line "
-          "of /proc/interrupts");
-    fclose(fh);
+          "of %s",
+          proc_file_path(pf));
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *irq_name;
-    size_t irq_name_len;
-    derive_t irq_value;
-    int i;
-    int fields_num;
-    int irq_values_to_parse;
-
-    fields_num = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (fields_num < 2)
-      continue;
-
-    /* Parse this many numeric fields, skip the rest
-     * (+1 because first there is a name of irq in each line) */
-    if (fields_num >= cpu_count + 1)
-      irq_values_to_parse = cpu_count;
-    else
-      irq_values_to_parse = fields_num - 1;
-
+  while ((line = proc_file_next_line(pf)) != NULL) {
     /* First field is irq name and colon */
-    irq_name = fields[0];
-    irq_name_len = strlen(irq_name);
-    if (irq_name_len < 2)
-      continue;
+    char *irq_name = irq_skip_blanks(line);
+    char *ptr = irq_name;
+    while ((*ptr != 0) && (*ptr != ':') && (*ptr != ' ') && (*ptr != '\t'))
+      ptr++;
 
     /* Check if irq name ends with colon.
      * Otherwise it's a header. */
-    if (irq_name[irq_name_len - 1] != ':')
+    if ((*ptr != ':') || (ptr == irq_name))
       continue;
+    *ptr++ = 0;
 
     /* Is it the the ARM fast interrupt (FIQ)? */
-    if (irq_name_len == 4 && (strncmp(irq_name, "FIQ:", 4) == 0))
+    if (strcmp(irq_name, "FIQ") == 0)
       continue;
 
-    irq_name[irq_name_len - 1] = '\0';
-    irq_name_len--;
-
-    irq_value = 0;
-    for (i = 1; i <= irq_values_to_parse; i++) {
-      /* Per-CPU value */
-      value_t v;
-      int status;
+    if (ignorelist_match(ignorelist, irq_name) != 0)
+      continue;
 
-      status = parse_value(fields[i], &v, DS_TYPE_DERIVE);
-      if (status != 0)
+    /* Parse at most one value per CPU; the rest of the row is the
+     * description. Rows like "ERR:" have a single value. */
+    uint64_t irq_value = 0;
+    size_t values_num = 0;
+    while (values_num < cpu_count) {
+      ptr = irq_skip_blanks(ptr);
+      if (proc_parse_uint64(ptr, &ptr, cpu_values + values_num) != 0)
         break;
-
-      irq_value += v.derive;
-    } /* for (i) */
+      irq_value += cpu_values[values_num];
+      values_num++;
+    }
 
     /* No valid fields -> do not submit anything. */
-    if (i <= 1)
+    if (values_num == 0)
+      continue;
+
+    irq_submit(instance_prefix, irq_name, (derive_t)irq_value);
+
+    if ((percpu_list == NULL) || (values_num != cpu_count) ||
+        (ignorelist_match(percpu_list, irq_name) != 0))
       continue;
 
-    irq_submit(irq_name, irq_value);
+    for (size_t i = 0; i < values_num; i++) {
+      char instance[DATA_MAX_NAME_LEN];
+      if (instance_prefix != NULL)
+        snprintf(instance, sizeof(instance), "%s-cpu%d", instance_prefix,
+                 cpu_ids[i]);
+      else
+        snprintf(instance, sizeof(instance), "cpu%d", cpu_ids[i]);
+      irq_submit(instance, irq_name, (derive_t)cpu_values[i]);
+    }
   }
 
-  fclose(fh);
+  return 0;
+} /* int irq_read_file */
+
+static int irq_init(void) {
+  interrupts_file = proc_file_create("/proc/interrupts");
+  if (interrupts_file == NULL)
+    return -1;
+
+  if (report_softirqs) {
+    softirqs_file = proc_file_create("/proc/softirqs");
+    if (softirqs_file == NULL)
+      return -1;
+  }
 
   return 0;
+} /* int irq_init */
+
+static int irq_read(void) {
+  int status = irq_read_file(interrupts_file, /* instance_prefix = */ NULL);
+
+  if (softirqs_file != NULL) {
+    if (irq_read_file(softirqs_file, "softirq") != 0)
+      status = -1;
+  }
+
+  return status;
 } /* int irq_read */
+
+static int irq_shutdown(void) {
+  proc_file_destroy(interrupts_file);
+  interrupts_file = NULL;
+  proc_file_destroy(softirqs_file);
+  softirqs_file = NULL;
+
+  sfree(cpu_ids);
+  sfree(cpu_values);
+  cpu_size = 0;
+
+  ignorelist_free(percpu_list);
+  percpu_list = NULL;
+  return 0;
+} /* int irq_shutdown */
 #endif /* KERNEL_LINUX */
 
 #if KERNEL_NETBSD
@@ -214,7 +313,8 @@ static int irq_read(void) {
     snprintf(irqname, 80, "%s-%s", evs->ev_strings,
              evs->ev_strings + evs->ev_grouplen + 1);
 
-    irq_submit(irqname, evs->ev_count);
+    if (ignorelist_match(ignorelist, irqname) == 0)
+      irq_submit(NULL, irqname, evs->ev_count);
 
     buflen -= evs->ev_len;
     evs = (const void *)((const uint64_t *)evs + evs->ev_len);
@@ -226,5 +326,9 @@ static int irq_read(void) {
 
 void module_register(void) {
   plugin_register_config("irq", irq_config, config_keys, config_keys_num);
+#if KERNEL_LINUX
+  plugin_register_init("irq", irq_init);
+  plugin_register_shutdown("irq", irq_shutdown);
+#endif
   plugin_register_read("irq", irq_read);
 } /* void module_register */
@@ -25,6 +25,7 @@
 
 #include "filter_chain.h"
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <jni.h>
@@ -63,6 +64,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -95,6 +97,26 @@ static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t *config_block;
 
+/* Classes and series cache used by "writeBatch" callbacks. The cache maps the
+ * identifier of a value list to global references of the PluginData and
+ * DataSet objects passed to Java, so each series is converted only once. */
+#define CJNI_SERIES_CACHE_MAX 65536
+struct cjni_series_s /* {{{ */
+{
+  jobject identifier; /* org/collectd/api/PluginData */
+  jobject dataset;    /* org/collectd/api/DataSet */
+};
+typedef struct cjni_series_s cjni_series_t;
+/* }}} */
+
+static jclass c_batch;
+static jmethodID m_batch_constructor;
+static jclass c_batch_plugindata;
+static jmethodID m_batch_plugindata_constructor;
+static jclass c_batch_dataset;
+static c_avl_tree_t *series_cache;
+static pthread_mutex_t series_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Prototypes
  *
@@ -111,6 +133,8 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *ud);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -1337,6 +1361,91 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+/* Looks up the classes and constructors used by cjni_write_batch. This is done
+ * while registering, because FindClass uses the class loader of the Java
+ * method calling into native code. */
+static int cjni_batch_classes_init(JNIEnv *jvm_env) /* {{{ */
+{
+  jclass tmp;
+
+  if (c_batch != NULL)
+    return 0;
+
+#define LOOKUP_CLASS(var, name)                                                \
+  do {                                                                         \
+    tmp = (*jvm_env)->FindClass(jvm_env, name);                                \
+    if (tmp == NULL) {                                                         \
+      ERROR("java plugin: cjni_batch_classes_init: FindClass (%s) failed.",    \
+            name);                                                             \
+      return -1;                                                               \
+    }                                                                          \
+    var = (*jvm_env)->NewGlobalRef(jvm_env, tmp);                              \
+    (*jvm_env)->DeleteLocalRef(jvm_env, tmp);                                  \
+    if (var == NULL) {                                                         \
+      ERROR("java plugin: cjni_batch_classes_init: NewGlobalRef failed.");     \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+  LOOKUP_CLASS(c_batch_plugindata, "org/collectd/api/PluginData");
+  LOOKUP_CLASS(c_batch_dataset, "org/collectd/api/DataSet");
+  LOOKUP_CLASS(c_batch, "org/collectd/api/ValueListBatch");
+
+#undef LOOKUP_CLASS
+
+  m_batch_plugindata_constructor =
+      (*jvm_env)->GetMethodID(jvm_env, c_batch_plugindata, "<init>", "()V");
+  m_batch_constructor = (*jvm_env)->GetMethodID(
+      jvm_env, c_batch, "<init>",
+      "([Lorg/collectd/api/PluginData;[Lorg/collectd/api/DataSet;"
+      "[J[J[I[J[D)V");
+  if ((m_batch_plugindata_constructor == NULL) ||
+      (m_batch_constructor == NULL)) {
+    ERROR("java plugin: cjni_batch_classes_init: "
+          "Cannot find the PluginData or ValueListBatch constructor.");
+    (*jvm_env)->DeleteGlobalRef(jvm_env, c_batch);
+    c_batch = NULL;
+    return -1;
+  }
+
+  pthread_mutex_lock(&series_cache_lock);
+  if (series_cache == NULL)
+    series_cache = c_avl_create((int (*)(const void *, const void *))strcmp);
+  pthread_mutex_unlock(&series_cache_lock);
+  if (series_cache == NULL) {
+    ERROR("java plugin: cjni_batch_classes_init: c_avl_create failed.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cjni_batch_classes_init */
+
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write) {
+  cjni_callback_info_t *cbi;
+
+  if (cjni_batch_classes_init(jvm_env) != 0)
+    return -1;
+
+  cbi =
+      cjni_callback_info_create(jvm_env, o_name, o_write, CB_TYPE_WRITE_BATCH);
+  if (cbi == NULL)
+    return -1;
+
+  DEBUG("java plugin: Registering new write batch callback: %s", cbi->name);
+
+  plugin_register_write_batch(cbi->name, cjni_write_batch,
+                              &(user_data_t){
+                                  .data = cbi,
+                                  .free_func = cjni_callback_info_destroy,
+                              });
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1533,6 +1642,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerWriteBatch",
+         "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteBatchInterface;)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1603,6 +1716,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "writeBatch";
+    method_signature = "(Lorg/collectd/api/ValueListBatch;)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -2353,6 +2471,316 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Creates local references to the PluginData and DataSet objects of the series
+ * "vl" belongs to. */
+static int ctoj_series(JNIEnv *jvm_env, const data_set_t *ds, /* {{{ */
+                       const value_list_t *vl, cjni_series_t *series) {
+  int status;
+
+  series->identifier = (*jvm_env)->NewObject(jvm_env, c_batch_plugindata,
+                                              m_batch_plugindata_constructor);
+  if (series->identifier == NULL) {
+    ERROR("java plugin: ctoj_series: Creating a PluginData object failed.");
+    return -1;
+  }
+
+  status = ctoj_string(jvm_env, vl->host, c_batch_plugindata,
+                       series->identifier, "setHost");
+  status |= ctoj_string(jvm_env, vl->plugin, c_batch_plugindata,
+                        series->identifier, "setPlugin");
+  status |= ctoj_string(jvm_env, vl->plugin_instance, c_batch_plugindata,
+                        series->identifier, "setPluginInstance");
+  status |= ctoj_string(jvm_env, vl->type, c_batch_plugindata,
+                        series->identifier, "setType");
+  status |= ctoj_string(jvm_env, vl->type_instance, c_batch_plugindata,
+                        series->identifier, "setTypeInstance");
+  if (status != 0) {
+    ERROR("java plugin: ctoj_series: ctoj_string failed.");
+    (*jvm_env)->DeleteLocalRef(jvm_env, series->identifier);
+    return -1;
+  }
+
+  series->dataset = ctoj_data_set(jvm_env, ds);
+  if (series->dataset == NULL) {
+    ERROR("java plugin: ctoj_series: ctoj_data_set (%s) failed.", ds->type);
+    (*jvm_env)->DeleteLocalRef(jvm_env, series->identifier);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int ctoj_series */
+
+/* Returns the cached series of "vl", converting and caching it on first use.
+ * If the cache is full, "*is_local" is set and the caller has to delete the
+ * returned local references. */
+static int cjni_series_get(JNIEnv *jvm_env, const data_set_t *ds, /* {{{ */
+                           const value_list_t *vl, cjni_series_t *ret,
+                           bool *is_local) {
+  char key[6 * DATA_MAX_NAME_LEN];
+  cjni_series_t *cached;
+  cjni_series_t local;
+  int status;
+
+  *is_local = false;
+  if (FORMAT_VL(key, sizeof(key), vl) != 0)
+    return -1;
+
+  pthread_mutex_lock(&series_cache_lock);
+  status = c_avl_get(series_cache, key, (void *)&cached);
+  if (status == 0)
+    *ret = *cached;
+  pthread_mutex_unlock(&series_cache_lock);
+  if (status == 0)
+    return 0;
+
+  if (ctoj_series(jvm_env, ds, vl, &local) != 0)
+    return -1;
+
+  pthread_mutex_lock(&series_cache_lock);
+  if (c_avl_get(series_cache, key, (void *)&cached) == 0) {
+    /* Another write thread was faster. */
+    *ret = *cached;
+    pthread_mutex_unlock(&series_cache_lock);
+    (*jvm_env)->DeleteLocalRef(jvm_env, local.identifier);
+    (*jvm_env)->DeleteLocalRef(jvm_env, local.dataset);
+    return 0;
+  }
+
+  cached = NULL;
+  char *key_copy = NULL;
+  if (c_avl_size(series_cache) < CJNI_SERIES_CACHE_MAX) {
+    cached = malloc(sizeof(*cached));
+    key_copy = strdup(key);
+  }
+  if ((cached != NULL) && (key_copy != NULL)) {
+    cached->identifier = (*jvm_env)->NewGlobalRef(jvm_env, local.identifier);
+    cached->dataset = (*jvm_env)->NewGlobalRef(jvm_env, local.dataset);
+  }
+  if ((cached == NULL) || (key_copy == NULL) ||
+      (cached->identifier == NULL) || (cached->dataset == NULL) ||
+      (c_avl_insert(series_cache, key_copy, cached) != 0)) {
+    pthread_mutex_unlock(&series_cache_lock);
+    if (cached != NULL) {
+      if (cached->identifier != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cached->identifier);
+      if (cached->dataset != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cached->dataset);
+    }
+    sfree(cached);
+    sfree(key_copy);
+    *ret = local;
+    *is_local = true;
+    return 0;
+  }
+  *ret = *cached;
+  pthread_mutex_unlock(&series_cache_lock);
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, local.identifier);
+  (*jvm_env)->DeleteLocalRef(jvm_env, local.dataset);
+  return 0;
+} /* }}} int cjni_series_get */
+
+static void cjni_series_cache_destroy(JNIEnv *jvm_env) /* {{{ */
+{
+  char *key;
+  cjni_series_t *series;
+
+  if (series_cache != NULL) {
+    while (c_avl_pick(series_cache, (void *)&key, (void *)&series) == 0) {
+      (*jvm_env)->DeleteGlobalRef(jvm_env, series->identifier);
+      (*jvm_env)->DeleteGlobalRef(jvm_env, series->dataset);
+      sfree(series);
+      sfree(key);
+    }
+    c_avl_destroy(series_cache);
+    series_cache = NULL;
+  }
+
+  if (c_batch != NULL) {
+    (*jvm_env)->DeleteGlobalRef(jvm_env, c_batch);
+    (*jvm_env)->DeleteGlobalRef(jvm_env, c_batch_plugindata);
+    (*jvm_env)->DeleteGlobalRef(jvm_env, c_batch_dataset);
+    c_batch = c_batch_plugindata = c_batch_dataset = NULL;
+  }
+} /* }}} void cjni_series_cache_destroy */
+
+/* Gauges are converted with a range check, because casting NaN or an out of
+ * range double to an integer is undefined. */
+static jlong cjni_gauge_to_jlong(gauge_t g) /* {{{ */
+{
+  if (!(g > (gauge_t)INT64_MIN && g < (gauge_t)INT64_MAX))
+    return 0;
+  return (jlong)g;
+} /* }}} jlong cjni_gauge_to_jlong */
+
+/* Call the CB_TYPE_WRITE_BATCH callback pointed to by the `user_data_t'
+ * pointer. All value lists are passed in one ValueListBatch object, whose
+ * values are stored in primitive arrays. */
+static int cjni_write_batch(const write_batch_entry_t *entries, /* {{{ */
+                            size_t entries_num, user_data_t *ud) {
+  JNIEnv *jvm_env;
+  cjni_callback_info_t *cbi;
+  jobjectArray o_identifiers = NULL;
+  jobjectArray o_datasets = NULL;
+  jlongArray o_times = NULL;
+  jlongArray o_intervals = NULL;
+  jintArray o_offsets = NULL;
+  jlongArray o_longs = NULL;
+  jdoubleArray o_doubles = NULL;
+  jobject o_batch = NULL;
+  jlong *times = NULL;
+  jlong *intervals = NULL;
+  jint *offsets = NULL;
+  jlong *longs = NULL;
+  jdouble *doubles = NULL;
+  size_t values_num = 0;
+  size_t pos = 0;
+  int ret_status = -1;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  if (entries_num == 0)
+    return 0;
+
+  for (size_t i = 0; i < entries_num; i++)
+    values_num += entries[i].vl->values_len;
+
+  times = calloc(entries_num, sizeof(*times));
+  intervals = calloc(entries_num, sizeof(*intervals));
+  offsets = calloc(entries_num + 1, sizeof(*offsets));
+  longs = calloc(values_num + 1, sizeof(*longs));
+  doubles = calloc(values_num + 1, sizeof(*doubles));
+  if ((times == NULL) || (intervals == NULL) || (offsets == NULL) ||
+      (longs == NULL) || (doubles == NULL)) {
+    ERROR("java plugin: cjni_write_batch: calloc failed.");
+    goto out;
+  }
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL)
+    goto out;
+
+  cbi = (cjni_callback_info_t *)ud->data;
+
+  o_identifiers = (*jvm_env)->NewObjectArray(jvm_env, (jsize)entries_num,
+                                              c_batch_plugindata, 0);
+  o_datasets = (*jvm_env)->NewObjectArray(jvm_env, (jsize)entries_num,
+                                           c_batch_dataset, 0);
+  if ((o_identifiers == NULL) || (o_datasets == NULL)) {
+    ERROR("java plugin: cjni_write_batch: NewObjectArray failed.");
+    goto out_detach;
+  }
+
+  for (size_t i = 0; i < entries_num; i++) {
+    const data_set_t *ds = entries[i].ds;
+    const value_list_t *vl = entries[i].vl;
+    cjni_series_t series;
+    bool is_local;
+
+    if (cjni_series_get(jvm_env, ds, vl, &series, &is_local) != 0) {
+      ERROR("java plugin: cjni_write_batch: cjni_series_get failed.");
+      goto out_detach;
+    }
+    (*jvm_env)->SetObjectArrayElement(jvm_env, o_identifiers, (jsize)i,
+                                      series.identifier);
+    (*jvm_env)->SetObjectArrayElement(jvm_env, o_datasets, (jsize)i,
+                                      series.dataset);
+    if (is_local) {
+      (*jvm_env)->DeleteLocalRef(jvm_env, series.identifier);
+      (*jvm_env)->DeleteLocalRef(jvm_env, series.dataset);
+    }
+
+    /* Java stores time in milliseconds. */
+    times[i] = (jlong)CDTIME_T_TO_MS(vl->time);
+    intervals[i] = (jlong)CDTIME_T_TO_MS(vl->interval);
+    offsets[i] = (jint)pos;
+    for (size_t j = 0; j < vl->values_len; j++, pos++) {
+      switch (ds->ds[j].type) {
+      case DS_TYPE_GAUGE:
+        doubles[pos] = (jdouble)vl->values[j].gauge;
+        longs[pos] = cjni_gauge_to_jlong(vl->values[j].gauge);
+        break;
+      case DS_TYPE_COUNTER:
+        longs[pos] = (jlong)vl->values[j].counter;
+        doubles[pos] = (jdouble)vl->values[j].counter;
+        break;
+      case DS_TYPE_DERIVE:
+        longs[pos] = (jlong)vl->values[j].derive;
+        doubles[pos] = (jdouble)vl->values[j].derive;
+        break;
+      case DS_TYPE_ABSOLUTE:
+        longs[pos] = (jlong)vl->values[j].absolute;
+        doubles[pos] = (jdouble)vl->values[j].absolute;
+        break;
+      }
+    }
+  }
+  offsets[entries_num] = (jint)pos;
+
+#define NEW_ARRAY(var, kind, num, src)                                         \
+  do {                                                                         \
+    var = (*jvm_env)->New##kind##Array(jvm_env, (jsize)(num));                 \
+    if (var == NULL) {                                                         \
+      ERROR("java plugin: cjni_write_batch: New" #kind "Array failed.");       \
+      goto out_detach;                                                         \
+    }                                                                          \
+    (*jvm_env)->Set##kind##ArrayRegion(jvm_env, var, 0, (jsize)(num), src);    \
+  } while (0)
+
+  NEW_ARRAY(o_times, Long, entries_num, times);
+  NEW_ARRAY(o_intervals, Long, entries_num, intervals);
+  NEW_ARRAY(o_offsets, Int, entries_num + 1, offsets);
+  NEW_ARRAY(o_longs, Long, values_num, longs);
+  NEW_ARRAY(o_doubles, Double, values_num, doubles);
+
+#undef NEW_ARRAY
+
+  o_batch = (*jvm_env)->NewObject(jvm_env, c_batch, m_batch_constructor,
+                                  o_identifiers, o_datasets, o_times,
+                                  o_intervals, o_offsets, o_longs, o_doubles);
+  if (o_batch == NULL) {
+    ERROR("java plugin: cjni_write_batch: "
+          "Creating a ValueListBatch object failed.");
+    goto out_detach;
+  }
+
+  ret_status =
+      (*jvm_env)->CallIntMethod(jvm_env, cbi->object, cbi->method, o_batch);
+
+out_detach:
+#define DELETE_REF(o)                                                          \
+  do {                                                                         \
+    if ((o) != NULL)                                                           \
+      (*jvm_env)->DeleteLocalRef(jvm_env, (o));                                \
+  } while (0)
+  DELETE_REF(o_batch);
+  DELETE_REF(o_doubles);
+  DELETE_REF(o_longs);
+  DELETE_REF(o_offsets);
+  DELETE_REF(o_intervals);
+  DELETE_REF(o_times);
+  DELETE_REF(o_datasets);
+  DELETE_REF(o_identifiers);
+#undef DELETE_REF
+  cjni_thread_detach();
+
+out:
+  sfree(times);
+  sfree(intervals);
+  sfree(offsets);
+  sfree(longs);
+  sfree(doubles);
+  return ret_status;
+} /* }}} int cjni_write_batch */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2780,6 +3208,9 @@ static int cjni_shutdown(void) /* {{{ */
   java_callbacks_num = 0;
   sfree(java_callbacks);
 
+  /* Release the series cached for batch write callbacks. */
+  cjni_series_cache_destroy(jvm_env);
+
   /* Release all the global references to directly loaded classes. */
   for (size_t i = 0; i < java_classes_list_len; i++) {
     if (java_classes_list[i].object != NULL) {
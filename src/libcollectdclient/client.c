@@ -74,6 +74,11 @@
 #define AI_ADDRCONFIG 0
 #endif
 
+/* Maximum number of commands sent by lcc_putval_async() whose responses have
+ * not been read yet. The responses must fit into the socket buffer, or the
+ * daemon would stop reading commands while we are still writing them. */
+#define LCC_PIPELINE_MAX 512
+
 /* Secure/static macros. They work like `strcpy' and `strcat', but assure null
  * termination. They work for static buffers only, because they use `sizeof'.
  * The `SSTRCATF' combines the functionality of `snprintf' and `strcat' which
@@ -108,8 +113,17 @@
  * Types
  */
 struct lcc_connection_s {
+  /* Responses are read from `fh', commands are written to `fh_out'. */
   FILE *fh;
+  FILE *fh_out;
   char errbuf[2048];
+
+  /* Commands sent by lcc_putval_async() that have not been answered yet, and
+   * the number of those answered with an error since the last lcc_wait(). */
+  size_t pending;
+  size_t failed;
+  /* The first of these errors. */
+  char failed_errbuf[2048];
 };
 
 struct lcc_response_s {
@@ -262,28 +276,41 @@ static void lcc_response_free(lcc_response_t *res) /* {{{ */
   res->lines = NULL;
 } /* }}} void lcc_response_free */
 
-static int lcc_send(lcc_connection_t *c, const char *command) /* {{{ */
+/* lcc_write: Writes a command to the stdio buffer, without flushing it. */
+static int lcc_write(lcc_connection_t *c, const char *command) /* {{{ */
 {
   int status;
 
   lcc_tracef("send:    --> %s\n", command);
 
-  status = fprintf(c->fh, "%s\r\n", command);
+  status = fprintf(c->fh_out, "%s\r\n", command);
   if (status < 0) {
     lcc_set_errno(c, errno);
     return -1;
   }
-  fflush(c->fh);
+
+  return 0;
+} /* }}} int lcc_write */
+
+static int lcc_send(lcc_connection_t *c, const char *command) /* {{{ */
+{
+  int status;
+
+  status = lcc_write(c, command);
+  if (status != 0)
+    return status;
+  fflush(c->fh_out);
 
   return 0;
 } /* }}} int lcc_send */
 
-static int lcc_receive(lcc_connection_t *c, /* {{{ */
-                       lcc_response_t *ret_res) {
+/* lcc_receive_status: Reads the first line of a response, containing the
+ * status and a message. */
+static int lcc_receive_status(lcc_connection_t *c, /* {{{ */
+                              lcc_response_t *ret_res) {
   lcc_response_t res = {0};
   char *ptr;
   char buffer[4096];
-  size_t i;
 
   /* Read the first line, containing the status and a message */
   ptr = fgets(buffer, sizeof(buffer), c->fh);
@@ -312,6 +339,21 @@ static int lcc_receive(lcc_connection_t *c, /* {{{ */
   strncpy(res.message, ptr, sizeof(res.message));
   res.message[sizeof(res.message) - 1] = '\0';
 
+  memcpy(ret_res, &res, sizeof(res));
+  return 0;
+} /* }}} int lcc_receive_status */
+
+static int lcc_receive(lcc_connection_t *c, /* {{{ */
+                       lcc_response_t *ret_res) {
+  lcc_response_t res = {0};
+  char *ptr;
+  char buffer[4096];
+  size_t i;
+
+  int status = lcc_receive_status(c, &res);
+  if (status != 0)
+    return status;
+
   /* Error or no lines follow: We're done. */
   if (res.status <= 0) {
     memcpy(ret_res, &res, sizeof(res));
@@ -358,17 +400,66 @@ static int lcc_receive(lcc_connection_t *c, /* {{{ */
   return 0;
 } /* }}} int lcc_receive */
 
-static int lcc_sendreceive(lcc_connection_t *c, /* {{{ */
-                           const char *command, lcc_response_t *ret_res) {
+/* lcc_receive_pending: Reads the response to the oldest command sent by
+ * lcc_putval_async(). Errors are remembered for lcc_wait(). */
+static int lcc_receive_pending(lcc_connection_t *c) /* {{{ */
+{
   lcc_response_t res = {0};
   int status;
 
+  assert(c->pending > 0);
+
+  /* Make sure the daemon has received the command we're waiting for. */
+  fflush(c->fh_out);
+
+  status = lcc_receive(c, &res);
+  if (status != 0) {
+    /* The remaining responses cannot be matched anymore. */
+    if (c->failed == 0)
+      SSTRCPY(c->failed_errbuf, c->errbuf);
+    c->failed += c->pending;
+    c->pending = 0;
+    return status;
+  }
+
+  c->pending--;
+  if (res.status != 0) {
+    if (c->failed == 0)
+      snprintf(c->failed_errbuf, sizeof(c->failed_errbuf), "Server error: %s",
+               res.message);
+    c->failed++;
+  }
+
+  lcc_response_free(&res);
+  return 0;
+} /* }}} int lcc_receive_pending */
+
+/* lcc_send_sync: Sends a command whose response is read right away. */
+static int lcc_send_sync(lcc_connection_t *c, const char *command) /* {{{ */
+{
+  int status;
+
   if (c->fh == NULL) {
     lcc_set_errno(c, EBADF);
     return -1;
   }
 
-  status = lcc_send(c, command);
+  /* Responses arrive in order, so those of pipelined commands come first. */
+  while (c->pending > 0) {
+    status = lcc_receive_pending(c);
+    if (status != 0)
+      return status;
+  }
+
+  return lcc_send(c, command);
+} /* }}} int lcc_send_sync */
+
+static int lcc_sendreceive(lcc_connection_t *c, /* {{{ */
+                           const char *command, lcc_response_t *ret_res) {
+  lcc_response_t res = {0};
+  int status;
+
+  status = lcc_send_sync(c, command);
   if (status != 0)
     return status;
 
@@ -379,6 +470,42 @@ static int lcc_sendreceive(lcc_connection_t *c, /* {{{ */
   return status;
 } /* }}} int lcc_sendreceive */
 
+/* lcc_open_streams: Opens the streams of the connection on the socket `fd',
+ * which is closed on error. Separate streams are used for reading and writing,
+ * because an "r+" stream can't be written to while responses of pipelined
+ * commands are still buffered. Returns zero or an errno value. */
+static int lcc_open_streams(lcc_connection_t *c, int fd) /* {{{ */
+{
+  int fd_out;
+  int status;
+
+  fd_out = dup(fd);
+  if (fd_out < 0) {
+    status = errno;
+    close(fd);
+    return status;
+  }
+
+  c->fh = fdopen(fd, "r");
+  if (c->fh == NULL) {
+    status = errno;
+    close(fd);
+    close(fd_out);
+    return status;
+  }
+
+  c->fh_out = fdopen(fd_out, "w");
+  if (c->fh_out == NULL) {
+    status = errno;
+    fclose(c->fh); /* this closes fd as well */
+    c->fh = NULL;
+    close(fd_out);
+    return status;
+  }
+
+  return 0;
+} /* }}} int lcc_open_streams */
+
 static int lcc_open_unixsocket(lcc_connection_t *c, const char *path) /* {{{ */
 {
 #ifdef WIN32
@@ -411,10 +538,9 @@ static int lcc_open_unixsocket(lcc_connection_t *c, const char *path) /* {{{ */
     return -1;
   }
 
-  c->fh = fdopen(fd, "r+");
-  if (c->fh == NULL) {
-    lcc_set_errno(c, errno);
-    close(fd);
+  status = lcc_open_streams(c, fd);
+  if (status != 0) {
+    lcc_set_errno(c, status);
     return -1;
   }
 
@@ -497,12 +623,9 @@ static int lcc_open_netsocket(lcc_connection_t *c, /* {{{ */
       continue;
     }
 
-    c->fh = fdopen(fd, "r+");
-    if (c->fh == NULL) {
-      status = errno;
-      close(fd);
+    status = lcc_open_streams(c, fd);
+    if (status != 0)
       continue;
-    }
 
     assert(status == 0);
     break;
@@ -591,6 +714,10 @@ int lcc_disconnect(lcc_connection_t *c) /* {{{ */
     fclose(c->fh);
     c->fh = NULL;
   }
+  if (c->fh_out != NULL) {
+    fclose(c->fh_out);
+    c->fh_out = NULL;
+  }
 
   free(c);
   return 0;
@@ -717,12 +844,12 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   return 0;
 } /* }}} int lcc_getval */
 
-int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
-{
+static int lcc_format_putval(lcc_connection_t *c, /* {{{ */
+                             char *ret_command, size_t ret_command_size,
+                             const lcc_value_list_t *vl) {
   char ident_str[6 * LCC_NAME_LEN];
   char ident_esc[12 * LCC_NAME_LEN];
   char command[1024] = "";
-  lcc_response_t res;
   int status;
 
   if ((c == NULL) || (vl == NULL) || (vl->values_len < 1) ||
@@ -762,6 +889,20 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
 
   } /* for (i = 0; i < vl->values_len; i++) */
 
+  snprintf(ret_command, ret_command_size, "%s", command);
+  return 0;
+} /* }}} int lcc_format_putval */
+
+int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+{
+  char command[1024];
+  lcc_response_t res;
+  int status;
+
+  status = lcc_format_putval(c, command, sizeof(command), vl);
+  if (status != 0)
+    return status;
+
   status = lcc_sendreceive(c, command, &res);
   if (status != 0)
     return status;
@@ -776,6 +917,59 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int lcc_putval */
 
+int lcc_putval_async(lcc_connection_t *c, /* {{{ */
+                     const lcc_value_list_t *vl) {
+  char command[1024];
+  int status;
+
+  status = lcc_format_putval(c, command, sizeof(command), vl);
+  if (status != 0)
+    return status;
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  if (c->pending >= LCC_PIPELINE_MAX) {
+    status = lcc_receive_pending(c);
+    if (status != 0)
+      return status;
+  }
+
+  status = lcc_write(c, command);
+  if (status != 0)
+    return status;
+
+  c->pending++;
+  return 0;
+} /* }}} int lcc_putval_async */
+
+int lcc_wait(lcc_connection_t *c, size_t *ret_failed) /* {{{ */
+{
+  size_t failed;
+
+  if (c == NULL) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  while (c->pending > 0)
+    lcc_receive_pending(c);
+
+  failed = c->failed;
+  c->failed = 0;
+  if (ret_failed != NULL)
+    *ret_failed = failed;
+
+  if (failed > 0) {
+    SSTRCPY(c->errbuf, c->failed_errbuf);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int lcc_wait */
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
               lcc_identifier_t *ident, int timeout) {
   char command[1024] = "";
@@ -826,14 +1020,36 @@ int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
 
 /* TODO: Implement lcc_putnotif */
 
+typedef struct {
+  lcc_identifier_t *ident;
+  size_t ident_num;
+  size_t ident_size;
+} lcc_listval_array_t;
+
+static int lcc_listval_append(const lcc_identifier_t *ident, /* {{{ */
+                              double time __attribute__((unused)),
+                              void *user_data) {
+  lcc_listval_array_t *a = user_data;
+
+  if (a->ident_num == a->ident_size) {
+    size_t size = (a->ident_size == 0) ? 64 : 2 * a->ident_size;
+    lcc_identifier_t *tmp = realloc(a->ident, size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    a->ident = tmp;
+    a->ident_size = size;
+  }
+
+  a->ident[a->ident_num] = *ident;
+  a->ident_num++;
+  return 0;
+} /* }}} int lcc_listval_append */
+
 int lcc_listval(lcc_connection_t *c, /* {{{ */
                 lcc_identifier_t **ret_ident, size_t *ret_ident_num) {
-  lcc_response_t res;
+  lcc_listval_array_t a = {0};
   int status;
 
-  lcc_identifier_t *ident;
-  size_t ident_num;
-
   if (c == NULL)
     return -1;
 
@@ -842,63 +1058,93 @@ int lcc_listval(lcc_connection_t *c, /* {{{ */
     return -1;
   }
 
-  status = lcc_sendreceive(c, "LISTVAL", &res);
-  if (status != 0)
-    return status;
+  status = lcc_listval_filtered(c, /* glob = */ NULL, lcc_listval_append, &a);
+  if (status == ENOMEM)
+    lcc_set_errno(c, ENOMEM);
+  if (status != 0) {
+    free(a.ident);
+    return -1;
+  }
 
-  if (res.status != 0) {
-    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
-    lcc_response_free(&res);
+  *ret_ident = a.ident;
+  *ret_ident_num = a.ident_num;
+
+  return 0;
+} /* }}} int lcc_listval */
+
+int lcc_listval_filtered(lcc_connection_t *c, const char *glob, /* {{{ */
+                         lcc_listval_callback_t callback, void *user_data) {
+  char command[1024] = "";
+  lcc_response_t res;
+  char buffer[4096];
+  int status;
+  int ret = 0;
+
+  if (c == NULL)
+    return -1;
+
+  if (callback == NULL) {
+    lcc_set_errno(c, EINVAL);
     return -1;
   }
 
-  ident_num = res.lines_num;
-  ident = malloc(ident_num * sizeof(*ident));
-  if (ident == NULL) {
-    lcc_response_free(&res);
-    lcc_set_errno(c, ENOMEM);
+  SSTRCPY(command, "LISTVAL");
+  if (glob != NULL) {
+    char glob_esc[12 * LCC_NAME_LEN];
+    SSTRCATF(command, " glob=%s",
+             lcc_strescape(glob_esc, glob, sizeof(glob_esc)));
+  }
+
+  status = lcc_send_sync(c, command);
+  if (status != 0)
+    return status;
+
+  status = lcc_receive_status(c, &res);
+  if (status != 0)
+    return status;
+
+  if (res.status < 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
     return -1;
   }
 
-  for (size_t i = 0; i < res.lines_num; i++) {
-    char *time_str;
-    char *ident_str;
+  /* All lines are read, even after an error, so that the connection can be
+   * used for further commands. */
+  for (int i = 0; i < res.status; i++) {
+    if (fgets(buffer, sizeof(buffer), c->fh) == NULL) {
+      lcc_set_errno(c, (errno != 0) ? errno : EPIPE);
+      return -1;
+    }
+    lcc_chomp(buffer);
+    lcc_tracef("receive: <-- %s\n", buffer);
 
-    /* First field is the time. */
-    time_str = res.lines[i];
+    if (ret != 0)
+      continue;
 
-    /* Set `ident_str' to the beginning of the second field. */
-    ident_str = time_str;
-    while ((*ident_str != ' ') && (*ident_str != '\t') && (*ident_str != 0))
-      ident_str++;
-    while ((*ident_str == ' ') || (*ident_str == '\t')) {
-      *ident_str = 0;
+    /* First field is the time, the second field the identifier. */
+    char *endptr = NULL;
+    double time = strtod(buffer, &endptr);
+    char *ident_str = endptr;
+    while ((*ident_str == ' ') || (*ident_str == '\t'))
       ident_str++;
-    }
 
-    if (*ident_str == 0) {
+    if ((endptr == buffer) || (ident_str == endptr) || (*ident_str == 0)) {
       lcc_set_errno(c, EILSEQ);
-      status = -1;
-      break;
+      ret = -1;
+      continue;
     }
 
-    status = lcc_string_to_identifier(c, ident + i, ident_str);
-    if (status != 0)
-      break;
-  }
-
-  lcc_response_free(&res);
+    lcc_identifier_t ident;
+    if (lcc_string_to_identifier(c, &ident, ident_str) != 0) {
+      ret = -1;
+      continue;
+    }
 
-  if (status != 0) {
-    free(ident);
-    return -1;
+    ret = callback(&ident, time, user_data);
   }
 
-  *ret_ident = ident;
-  *ret_ident_num = ident_num;
-
-  return 0;
-} /* }}} int lcc_listval */
+  return ret;
+} /* }}} int lcc_listval_filtered */
 
 const char *lcc_strerror(lcc_connection_t *c) /* {{{ */
 {
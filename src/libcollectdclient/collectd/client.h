@@ -66,12 +66,35 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident,
 
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/* Sends a PUTVAL command like lcc_putval(), but doesn't wait for the response.
+ * Commands are buffered and several hundred of them are kept in flight. Errors
+ * reported by the daemon are collected and returned by lcc_wait(). */
+int lcc_putval_async(lcc_connection_t *c, const lcc_value_list_t *vl);
+
+/* Reads the responses to all commands sent with lcc_putval_async(). Returns
+ * zero if all of them succeeded. Otherwise returns -1, stores the number of
+ * failed commands in "ret_failed", unless it is NULL, and makes the first error
+ * available via lcc_strerror(). Other functions may be called while commands
+ * are in flight; they wait for the outstanding responses first. */
+int lcc_wait(lcc_connection_t *c, size_t *ret_failed);
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, lcc_identifier_t *ident,
               int timeout);
 
 int lcc_listval(lcc_connection_t *c, lcc_identifier_t **ret_ident,
                 size_t *ret_ident_num);
 
+/* Lists the identifiers known to the daemon which match the shell wildcard
+ * pattern "glob", or all of them if "glob" is NULL. The filter is applied by
+ * the daemon. Instead of collecting the identifiers in an array, "callback"
+ * is called for each one as it is read, in the daemon's order (sorted by
+ * name). If the callback returns non-zero, the remaining identifiers are
+ * skipped and that value is returned. */
+typedef int (*lcc_listval_callback_t)(const lcc_identifier_t *ident,
+                                      double time, void *user_data);
+int lcc_listval_filtered(lcc_connection_t *c, const char *glob,
+                         lcc_listval_callback_t callback, void *user_data);
+
 /* TODO: putnotif */
 
 const char *lcc_strerror(lcc_connection_t *c);
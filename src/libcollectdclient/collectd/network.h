@@ -67,11 +67,15 @@ int lcc_server_set_ttl(lcc_server_t *srv, uint8_t ttl);
 int lcc_server_set_interface(lcc_server_t *srv, char const *iface);
 int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
                                   const char *username, const char *password);
+int lcc_server_set_compression(lcc_server_t *srv, int enable);
 
 /*
  * Send data
  */
 int lcc_network_values_send(lcc_network_t *net, const lcc_value_list_t *vl);
+/* Sends all buffered values immediately instead of waiting for the packets to
+ * fill up. */
+int lcc_network_flush(lcc_network_t *net);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
@@ -46,6 +46,10 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb,
                                           const char *user,
                                           const char *password);
 
+/* Compresses the packet's parts with zlib when finalizing. Returns ENOTSUP if
+ * libcollectdclient has been built without zlib. */
+int lcc_network_buffer_set_compression(lcc_network_buffer_t *nb, int enable);
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb);
 int lcc_network_buffer_finalize(lcc_network_buffer_t *nb);
 
@@ -75,12 +75,25 @@ typedef struct {
   /* interface is the name of the interface to use when subscribing to a
    * multicast group. Has no effect when using unicast. */
   char *iface;
+
+  /* threads is the number of threads receiving and parsing packets. If conn
+   * is <0, each thread opens its own socket with SO_REUSEPORT, so the kernel
+   * distributes the packets among them. Otherwise all threads read from conn.
+   * Defaults to one if set to zero. */
+  int threads;
+
+  /* batch_writer, if set, is called with all value lists parsed from the
+   * packets received with one system call, instead of calling
+   * parse_options.writer for each of them. The value lists are only valid
+   * during the call. Each thread calls batch_writer independently. */
+  lcc_value_list_batch_writer_t batch_writer;
 } lcc_listener_t;
 
 /* lcc_listen_and_write listens on the provided UDP socket (or opens one using
  * srv.addr if srv.conn is less than zero), parses the received packets and
  * writes them to the provided lcc_value_list_writer_t. Returns non-zero on
- * failure and does not return otherwise. */
+ * failure and does not return otherwise. With several threads, it returns
+ * once all of them have failed. */
 int lcc_listen_and_write(lcc_listener_t srv);
 
 LCC_END_DECLS
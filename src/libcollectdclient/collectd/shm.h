@@ -0,0 +1,64 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_H
+#define LIBCOLLECTD_SHM_H 1
+
+#include "collectd/lcc_features.h"
+
+#include "collectd/shm_format.h"
+#include "collectd/types.h"
+
+#include <stddef.h>
+
+LCC_BEGIN_DECLS
+
+/* lcc_shm_t is a read-only mapping of the snapshot published by the
+ * "shm_export" plugin. Looking up values doesn't need any system calls, so it
+ * is much cheaper than lcc_getval(). A handle must not be used by several
+ * threads at once. */
+struct lcc_shm_s;
+typedef struct lcc_shm_s lcc_shm_t;
+
+/* lcc_shm_open maps the snapshot at "path". Returns zero on success and an
+ * errno value otherwise. */
+int lcc_shm_open(char const *path, lcc_shm_t **ret_shm);
+
+void lcc_shm_close(lcc_shm_t *shm);
+
+/* lcc_shm_getval looks up "ident" and returns its rates and data source names
+ * like lcc_getval(). The caller has to free the returned memory. Returns
+ * ENOENT if the identifier is not in the snapshot and EAGAIN if the snapshot
+ * could not be read because the daemon kept updating it. */
+int lcc_shm_getval(lcc_shm_t *shm, lcc_identifier_t const *ident,
+                   size_t *ret_values_num, gauge_t **ret_values,
+                   char ***ret_values_names);
+
+/* lcc_shm_time returns the time of the last update of the snapshot, in
+ * seconds since the epoch. It stops advancing when the daemon has been
+ * stopped. */
+int lcc_shm_time(lcc_shm_t *shm, double *ret_time);
+
+LCC_END_DECLS
+
+#endif /* LIBCOLLECTD_SHM_H */
@@ -0,0 +1,88 @@
+/**
+ * collectd - src/libcollectdclient/collectd/shm_format.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_FORMAT_H
+#define LIBCOLLECTD_SHM_FORMAT_H 1
+
+/*
+ * Layout of the snapshot of the value cache that the "shm_export" plugin
+ * publishes in a file, for other processes to map into memory. This header
+ * only uses fixed-size types, so the daemon can include it, too.
+ *
+ * The file starts with an lcc_shm_header_t, followed by `entries_num'
+ * lcc_shm_entry_t structures sorted by name (as compared by strcmp(3)), the
+ * lcc_shm_value_t array and a table of null-terminated strings. Integers are
+ * stored in the host's byte order. Offsets are counted in bytes from the start
+ * of the file, or from `strings_offset' for strings, and multiples of eight.
+ *
+ * The daemon updates the file in place, guarded by a sequence lock:
+ * `sequence' is odd while an update is in progress and grows by two with every
+ * update. Readers load `sequence', copy what they need, and start over if it
+ * was odd or has changed in the meantime. Data read before that check may be
+ * inconsistent, so offsets have to be checked against `size' before use. The
+ * file never shrinks; if `size' exceeds the mapped length, the reader has to
+ * map the file again.
+ */
+
+#include <stdint.h>
+
+#define LCC_SHM_MAGIC 0x63647368 /* "cdsh" */
+#define LCC_SHM_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sequence;
+  /* Number of bytes in use, including this header. */
+  uint64_t size;
+  /* Time of the snapshot, in seconds since the epoch. */
+  double time;
+  uint64_t entries_num;
+  uint64_t entries_offset;
+  uint64_t values_offset;
+  uint64_t strings_offset;
+} lcc_shm_header_t;
+
+typedef struct {
+  /* Identifier of the form "host/plugin[-instance]/type[-instance]". */
+  uint32_t name_offset;
+  uint32_t values_num;
+  /* Index of the entry's first value in the lcc_shm_value_t array. */
+  uint64_t values_index;
+  /* Time and interval of the last update, in seconds. */
+  double time;
+  double interval;
+} lcc_shm_entry_t;
+
+typedef struct {
+  /* Raw value as stored in a value_t of the daemon. */
+  uint64_t raw;
+  /* Rate of the value, or NaN if it is not known yet. */
+  double rate;
+  /* Data source name. */
+  uint32_t name_offset;
+  /* Data source type, one of the LCC_TYPE_* constants. */
+  uint32_t type;
+} lcc_shm_value_t;
+
+#endif /* LIBCOLLECTD_SHM_FORMAT_H */
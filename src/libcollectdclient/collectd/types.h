@@ -88,6 +88,11 @@ typedef struct lcc_value_list_s lcc_value_list_t;
  * dispatched. */
 typedef int (*lcc_value_list_writer_t)(lcc_value_list_t const *);
 
+/* lcc_value_list_batch_writer_t is a write callback to which arrays of value
+ * lists are dispatched. */
+typedef int (*lcc_value_list_batch_writer_t)(lcc_value_list_t const *,
+                                             size_t);
+
 /* lcc_password_lookup_t is a callback for looking up the password for a given
  * user. Must return NULL if the user is not known. */
 typedef char const *(*lcc_password_lookup_t)(char const *);
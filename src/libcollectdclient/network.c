@@ -75,6 +75,8 @@ struct lcc_server_s {
   socklen_t sa_len;
 
   lcc_network_buffer_t *buffer;
+  /* Number of values added to buffer since it was last sent. */
+  size_t buffer_values;
 
   lcc_server_t *next;
 };
@@ -219,6 +221,7 @@ static int server_send_buffer(lcc_server_t *srv) /* {{{ */
 
   status = lcc_network_buffer_get(srv->buffer, buffer, &buffer_size);
   lcc_network_buffer_initialize(srv->buffer);
+  srv->buffer_values = 0;
 
   if (status != 0)
     return status;
@@ -247,11 +250,16 @@ static int server_value_add(lcc_server_t *srv, /* {{{ */
   int status;
 
   status = lcc_network_buffer_add_value(srv->buffer, vl);
-  if (status == 0)
+  if (status == 0) {
+    srv->buffer_values++;
     return 0;
+  }
 
   server_send_buffer(srv);
-  return lcc_network_buffer_add_value(srv->buffer, vl);
+  status = lcc_network_buffer_add_value(srv->buffer, vl);
+  if (status == 0)
+    srv->buffer_values++;
+  return status;
 } /* }}} int server_value_add */
 
 /*
@@ -440,6 +448,11 @@ int lcc_server_set_security_level(lcc_server_t *srv, /* {{{ */
                                                password);
 } /* }}} int lcc_server_set_security_level */
 
+int lcc_server_set_compression(lcc_server_t *srv, int enable) /* {{{ */
+{
+  return lcc_network_buffer_set_compression(srv->buffer, enable);
+} /* }}} int lcc_server_set_compression */
+
 int lcc_network_values_send(lcc_network_t *net, /* {{{ */
                             const lcc_value_list_t *vl) {
   if ((net == NULL) || (vl == NULL))
@@ -450,3 +463,21 @@ int lcc_network_values_send(lcc_network_t *net, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_values_send */
+
+int lcc_network_flush(lcc_network_t *net) /* {{{ */
+{
+  if (net == NULL)
+    return EINVAL;
+
+  int ret = 0;
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    if (srv->buffer_values == 0)
+      continue;
+
+    int status = server_send_buffer(srv);
+    if (status != 0)
+      ret = status;
+  }
+
+  return ret;
+} /* }}} int lcc_network_flush */
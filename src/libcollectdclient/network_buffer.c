@@ -63,6 +63,10 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "collectd/network_buffer.h"
 
 #define TYPE_HOST 0x0000
@@ -83,8 +87,12 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+#define TYPE_COMPRESSED 0x0300
+#define COMPRESSION_ZLIB 0x0001
+
 #define PART_SIGNATURE_SHA256_SIZE 36
 #define PART_ENCRYPTION_AES256_SIZE 42
+#define PART_COMPRESSED_SIZE 8
 
 #define ADD_GENERIC(nb, srcptr, size)                                          \
   do {                                                                         \
@@ -111,6 +119,8 @@ struct lcc_network_buffer_s {
   char *username;
   char *password;
 
+  bool compress;
+
 #if HAVE_GCRYPT_H
   gcry_cipher_hd_t encr_cypher;
   size_t encr_header_len;
@@ -604,6 +614,53 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
 } /* }}} int nb_add_encryption */
 #endif
 
+#if HAVE_ZLIB
+/* Replaces the parts following the signature or encryption header with one
+ * compressed part, if that makes the packet smaller. */
+static int nb_add_compression(lcc_network_buffer_t *nb) /* {{{ */
+{
+  size_t header_len = 0;
+#if HAVE_GCRYPT_H
+  if (nb->seclevel == SIGN)
+    header_len = PART_SIGNATURE_SHA256_SIZE + strlen(nb->username);
+  else if (nb->seclevel == ENCRYPT)
+    header_len = nb->encr_header_len;
+#endif
+
+  char *data = nb->buffer + header_len;
+  assert(nb->size >= (nb->free + header_len));
+  size_t data_len = nb->size - (nb->free + header_len);
+  if (data_len <= PART_COMPRESSED_SIZE)
+    return 0;
+
+  char compressed[data_len];
+  uLongf compressed_len = (uLongf)(data_len - PART_COMPRESSED_SIZE);
+  int status = compress2((Bytef *)compressed, &compressed_len,
+                         (const Bytef *)data, (uLong)data_len,
+                         Z_DEFAULT_COMPRESSION);
+  if (status == Z_BUF_ERROR) /* not compressible */
+    return 0;
+  else if (status != Z_OK)
+    return -1;
+
+  uint16_t pkg_type = htons(TYPE_COMPRESSED);
+  uint16_t pkg_length =
+      htons((uint16_t)(PART_COMPRESSED_SIZE + (size_t)compressed_len));
+  uint16_t pkg_algorithm = htons(COMPRESSION_ZLIB);
+  uint16_t pkg_uncompressed_length = htons((uint16_t)data_len);
+
+  nb->ptr = data;
+  nb->free = nb->size - header_len;
+  ADD_STATIC(nb, pkg_type);
+  ADD_STATIC(nb, pkg_length);
+  ADD_STATIC(nb, pkg_algorithm);
+  ADD_STATIC(nb, pkg_uncompressed_length);
+  ADD_GENERIC(nb, compressed, (size_t)compressed_len);
+
+  return 0;
+} /* }}} int nb_add_compression */
+#endif
+
 /*
  * Public functions
  */
@@ -687,6 +744,22 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb, /* {{{ */
   return 0;
 } /* }}} int lcc_network_buffer_set_security_level */
 
+int lcc_network_buffer_set_compression(lcc_network_buffer_t *nb, /* {{{ */
+                                       int enable) {
+  if (nb == NULL)
+    return EINVAL;
+
+#if HAVE_ZLIB
+  nb->compress = (enable != 0);
+  return 0;
+#else
+  if (enable)
+    return ENOTSUP;
+  nb->compress = false;
+  return 0;
+#endif
+} /* }}} int lcc_network_buffer_set_compression */
+
 int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
 {
   if (nb == NULL)
@@ -748,6 +821,14 @@ int lcc_network_buffer_finalize(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return EINVAL;
 
+#if HAVE_ZLIB
+  if (nb->compress) {
+    int status = nb_add_compression(nb);
+    if (status != 0)
+      return status;
+  }
+#endif
+
 #if HAVE_GCRYPT_H
   if (nb->seclevel == SIGN)
     return nb_add_signature(nb);
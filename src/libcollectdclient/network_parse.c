@@ -54,8 +54,15 @@
 #include <gcrypt.h>
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include <stdio.h>
+/* The benchmark and fuzz target, which include this file, silence these. */
+#ifndef DEBUG
 #define DEBUG(...) printf(__VA_ARGS__)
+#endif
 
 #if HAVE_GCRYPT_H
 #if GCRYPT_VERSION_NUMBER < 0x010600
@@ -63,9 +70,12 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
-/* forward declaration because parse_sign_sha256()/parse_encrypt_aes256() and
- * network_parse() need to call each other. */
+/* forward declaration because parse_sign_sha256()/parse_encrypt_aes256(),
+ * parse_compressed() and network_parse() need to call each other.
+ * `compressed' is true when parsing the contents of a compressed part, in
+ * which further compressed parts are not allowed. */
 static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
+                         bool compressed,
                          lcc_network_parse_options_t const *opts);
 
 #if HAVE_GCRYPT_H
@@ -138,6 +148,9 @@ static int buffer_uint16(buffer_t *b, uint16_t *out) {
 #define TYPE_INTERVAL_HR 0x0009
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_COMPRESSED 0x0300
+
+#define COMPRESSION_ZLIB 0x0001
 
 static int parse_int(void *payload, size_t payload_size, uint64_t *out) {
   uint64_t tmp;
@@ -290,6 +303,9 @@ static double ntohd(double val) /* {{{ */
   }
 } /* }}} double ntohd */
 
+/* parse_values parses a values part into state->values and
+ * state->values_types, which must have room for at least payload_size / 9
+ * elements. */
 static int parse_values(void *payload, size_t payload_size,
                         lcc_value_list_t *state) {
   buffer_t *b = &(buffer_t){
@@ -305,11 +321,6 @@ static int parse_values(void *payload, size_t payload_size,
     return EINVAL;
 
   state->values_len = (size_t)n;
-  state->values = calloc(state->values_len, sizeof(*state->values));
-  state->values_types = calloc(state->values_len, sizeof(*state->values_types));
-  if ((state->values == NULL) || (state->values_types == NULL)) {
-    return ENOMEM;
-  }
 
   for (uint16_t i = 0; i < n; i++) {
     uint8_t tmp;
@@ -398,7 +409,7 @@ static int parse_sign_sha256(void *signature, size_t signature_len,
   if (opts->password_lookup == NULL) {
     /* The sender signed the packet but we can't verify it. Handle it as if it
      * were unsigned, i.e. security level NONE. */
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, false, opts);
   }
 
   buffer_t *b = &(buffer_t){
@@ -418,13 +429,13 @@ static int parse_sign_sha256(void *signature, size_t signature_len,
 
   char const *password = opts->password_lookup(username);
   if (!password)
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, false, opts);
 
   int status = verify_sha256(payload, payload_size, username, password, hash);
   if (status != 0)
     return status;
 
-  return network_parse(payload, payload_size, SIGN, opts);
+  return network_parse(payload, payload_size, SIGN, false, opts);
 }
 
 #if HAVE_GCRYPT_H
@@ -439,7 +450,6 @@ static int decrypt_aes256(buffer_t *b, void *iv, size_t iv_size,
   uint8_t pwhash[32] = {0};
   gcry_md_hash_buffer(GCRY_MD_SHA256, pwhash, password, strlen(password));
 
-  fprintf(stderr, "sizeof(iv) = %" PRIsz "\n", sizeof(iv));
   if (gcry_cipher_setkey(cipher, pwhash, sizeof(pwhash)) ||
       gcry_cipher_setiv(cipher, iv, iv_size) ||
       gcry_cipher_decrypt(cipher, b->data, b->len, /* in = */ NULL,
@@ -499,7 +509,7 @@ static int parse_encrypt_aes256(void *data, size_t data_size,
     return -1;
   }
 
-  return network_parse(b->data, b->len, ENCRYPT, opts);
+  return network_parse(b->data, b->len, ENCRYPT, false, opts);
 }
 #else /* !HAVE_GCRYPT_H */
 static int parse_encrypt_aes256(void *data, size_t data_size,
@@ -508,7 +518,41 @@ static int parse_encrypt_aes256(void *data, size_t data_size,
 }
 #endif
 
+#if HAVE_ZLIB
+static int parse_compressed(void *data, size_t data_size,
+                            lcc_security_level_t sl,
+                            lcc_network_parse_options_t const *opts) {
+  buffer_t *b = &(buffer_t){
+      .data = data,
+      .len = data_size,
+  };
+
+  uint16_t algorithm = 0, uncompressed_len = 0;
+  if (buffer_uint16(b, &algorithm) || buffer_uint16(b, &uncompressed_len))
+    return EINVAL;
+  if (algorithm != COMPRESSION_ZLIB)
+    return ENOTSUP;
+  if (uncompressed_len == 0)
+    return EINVAL;
+
+  uint8_t uncompressed[uncompressed_len];
+  uLongf len = (uLongf)sizeof(uncompressed);
+  if ((uncompress(uncompressed, &len, b->data, (uLong)b->len) != Z_OK) ||
+      (len != sizeof(uncompressed)))
+    return EINVAL;
+
+  return network_parse(uncompressed, sizeof(uncompressed), sl, true, opts);
+}
+#else /* !HAVE_ZLIB */
+static int parse_compressed(void *data, size_t data_size,
+                            lcc_security_level_t sl,
+                            lcc_network_parse_options_t const *opts) {
+  return ENOTSUP;
+}
+#endif
+
 static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
+                         bool compressed,
                          lcc_network_parse_options_t const *opts) {
   buffer_t *b = &(buffer_t){
       .data = data,
@@ -536,6 +580,17 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     if (buffer_next(b, payload, sizeof(payload)))
       return EINVAL;
 
+    /* Compressed parts are only ever created around data parts. Refusing
+     * anything else keeps crafted packets from recursing. */
+    if (compressed && ((type == TYPE_SIGN_SHA256) ||
+                       (type == TYPE_ENCR_AES256) ||
+                       (type == TYPE_COMPRESSED))) {
+      DEBUG("lcc_network_parse(): unexpected part type %" PRIu16
+            " in compressed part.\n",
+            type);
+      return EINVAL;
+    }
+
     switch (type) {
     case TYPE_HOST:
     case TYPE_PLUGIN:
@@ -561,10 +616,15 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     }
 
     case TYPE_VALUES: {
+      /* Each value takes nine bytes. The values are only valid during the
+       * writer's call, so they can live on the stack. */
+      value_t values[sizeof(payload) / 9 + 1];
+      int values_types[sizeof(payload) / 9 + 1];
+
       lcc_value_list_t vl = state;
+      vl.values = values;
+      vl.values_types = values_types;
       if (parse_values(payload, sizeof(payload), &vl)) {
-        free(vl.values);
-        free(vl.values_types);
         DEBUG("lcc_network_parse(): parse_values failed.\n");
         return EINVAL;
       }
@@ -575,9 +635,6 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       if (sl >= opts->security_level)
         status = opts->writer(&vl);
 
-      free(vl.values);
-      free(vl.values_types);
-
       if (status != 0)
         return status;
       break;
@@ -605,6 +662,15 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       break;
     }
 
+    case TYPE_COMPRESSED: {
+      int status = parse_compressed(payload, sizeof(payload), sl, opts);
+      if (status != 0) {
+        DEBUG("lcc_network_parse(): parse_compressed() = %d\n", status);
+        return -1;
+      }
+      break;
+    }
+
     default: {
       DEBUG("lcc_network_parse(): ignoring unknown type %" PRIu16 "\n", type);
       return EINVAL;
@@ -628,5 +694,5 @@ int lcc_network_parse(void *data, size_t data_size,
 #endif
   }
 
-  return network_parse(data, data_size, NONE, &opts);
+  return network_parse(data, data_size, NONE, false, &opts);
 }
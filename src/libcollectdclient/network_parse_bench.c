@@ -0,0 +1,246 @@
+/**
+ * collectd - src/libcollectdclient/network_parse_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Measures how many packets per second lcc_network_parse() handles. It parses
+ * the packets written by "bench_plugin_network -o <directory>", so both
+ * parsers are measured with the same input. Files are grouped into cases by
+ * their name up to the last '-', e.g. "sign-0001" belongs to "sign". Prints
+ * one line of JSON per case.
+ *
+ * Usage: bench_libcollectd_network_parse [-T <seconds>] <directory>
+ */
+
+#include "collectd/lcc_features.h"
+
+#define DEBUG(...) /* parse errors are counted */
+
+#include "network_parse.c" /* sic */
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CASES_MAX 16
+
+typedef struct {
+  char name[64];
+  char **packets;
+  size_t *packets_size;
+  size_t packets_num;
+} bench_case_t;
+
+static double conf_duration = 0.5;
+
+static bench_case_t cases[CASES_MAX];
+static size_t cases_num;
+static uint64_t values_num;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int counting_writer(__attribute__((unused)) lcc_value_list_t const *vl) {
+  values_num++;
+  return 0;
+}
+
+#if HAVE_GCRYPT_H
+static char const *password_lookup(char const *username) {
+  if (strcmp(username, "bench") == 0)
+    return "bench-secret";
+  return NULL;
+}
+#endif
+
+static bench_case_t *case_get(char const *file) {
+  char name[sizeof(cases[0].name)];
+  snprintf(name, sizeof(name), "%s", file);
+  char *dash = strrchr(name, '-');
+  if (dash != NULL)
+    *dash = 0;
+
+  for (size_t i = 0; i < cases_num; i++)
+    if (strcmp(cases[i].name, name) == 0)
+      return cases + i;
+
+  if (cases_num >= CASES_MAX)
+    return NULL;
+  bench_case_t *c = cases + cases_num;
+  cases_num++;
+  memcpy(c->name, name, sizeof(c->name));
+  return c;
+}
+
+static int read_packet(char const *dir, char const *file) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+  struct stat st;
+  if ((stat(path, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0))
+    return 0;
+
+  bench_case_t *c = case_get(file);
+  if (c == NULL)
+    return ENOMEM;
+
+  char **packets = realloc(c->packets, (c->packets_num + 1) * sizeof(*packets));
+  if (packets == NULL)
+    return ENOMEM;
+  c->packets = packets;
+  size_t *packets_size =
+      realloc(c->packets_size, (c->packets_num + 1) * sizeof(*packets_size));
+  if (packets_size == NULL)
+    return ENOMEM;
+  c->packets_size = packets_size;
+
+  char *data = malloc((size_t)st.st_size);
+  if (data == NULL)
+    return ENOMEM;
+  FILE *fh = fopen(path, "r");
+  if ((fh == NULL) || (fread(data, 1, (size_t)st.st_size, fh) !=
+                       (size_t)st.st_size)) {
+    fprintf(stderr, "Reading %s failed.\n", path);
+    if (fh != NULL)
+      fclose(fh);
+    free(data);
+    return EIO;
+  }
+  fclose(fh);
+
+  c->packets[c->packets_num] = data;
+  c->packets_size[c->packets_num] = (size_t)st.st_size;
+  c->packets_num++;
+  return 0;
+}
+
+static void run_case(bench_case_t *c) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < c->packets_num; i++)
+    bytes += c->packets_size[i];
+
+  /* Decryption works in place, so every round parses a copy. */
+  char *scratch = malloc(bytes);
+  if (scratch == NULL) {
+    fprintf(stderr, "%s: malloc failed.\n", c->name);
+    return;
+  }
+
+  lcc_network_parse_options_t opts = {
+      .writer = counting_writer,
+#if HAVE_GCRYPT_H
+      .password_lookup = password_lookup,
+#endif
+  };
+  uint64_t num = 0;
+  uint64_t failed = 0;
+  double copy = 0.0;
+  values_num = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    double copy_start = now();
+    char *ptr = scratch;
+    for (size_t i = 0; i < c->packets_num; i++) {
+      memcpy(ptr, c->packets[i], c->packets_size[i]);
+      ptr += c->packets_size[i];
+    }
+    copy += now() - copy_start;
+
+    ptr = scratch;
+    for (size_t i = 0; i < c->packets_num; i++) {
+      if (lcc_network_parse(ptr, c->packets_size[i], opts) != 0)
+        failed++;
+      ptr += c->packets_size[i];
+    }
+    num += c->packets_num;
+    elapsed = now() - start;
+  } while (elapsed < conf_duration);
+
+  printf("{\"case\":\"%s\",\"packets\":%" PRIu64 ",\"failed\":%" PRIu64
+         ",\"bytes_per_packet\":%.1f,\"values_per_packet\":%.1f,"
+         "\"ns_per_packet\":%.1f,\"packets_per_second\":%.0f}\n",
+         c->name, num, failed, (double)bytes / (double)c->packets_num,
+         (double)values_num / (double)num, 1e9 * (elapsed - copy) / (double)num,
+         (double)num / (elapsed - copy));
+  fflush(stdout);
+
+  free(scratch);
+}
+
+__attribute__((noreturn)) static void exit_usage(char const *name,
+                                                 int status) {
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr,
+          "Usage: %s [-T <seconds>] <directory>\n", name);
+  exit(status);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "T:h")) != -1) {
+    switch (opt) {
+    case 'T':
+      conf_duration = atof(optarg);
+      break;
+    case 'h':
+      exit_usage(argv[0], EXIT_SUCCESS);
+    default:
+      exit_usage(argv[0], EXIT_FAILURE);
+    }
+  }
+  if (optind + 1 != argc)
+    exit_usage(argv[0], EXIT_FAILURE);
+
+  DIR *dh = opendir(argv[optind]);
+  if (dh == NULL) {
+    fprintf(stderr, "opendir(%s) failed.\n", argv[optind]);
+    return 1;
+  }
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    if (read_packet(argv[optind], de->d_name) != 0) {
+      closedir(dh);
+      return 1;
+    }
+  }
+  closedir(dh);
+
+  for (size_t i = 0; i < cases_num; i++) {
+    run_case(cases + i);
+
+    for (size_t j = 0; j < cases[i].packets_num; j++)
+      free(cases[i].packets[j]);
+    free(cases[i].packets);
+    free(cases[i].packets_size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * collectd - src/libcollectdclient/network_parse_fuzz.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * libFuzzer entry point for lcc_network_parse(). It shares the corpus of the
+ * network plugin's fuzz target ("bench_plugin_network -o <directory>") and
+ * knows the same credentials, so that signed and encrypted packets get past
+ * the signature and decryption.
+ */
+
+#include "collectd/lcc_features.h"
+
+#define DEBUG(...) /* silence parse errors */
+
+#include "network_parse.c" /* sic */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int nop_writer(__attribute__((unused)) lcc_value_list_t const *vl) {
+  return 0;
+}
+
+#if HAVE_GCRYPT_H
+static char const *password_lookup(char const *username) {
+  if (strcmp(username, "bench") == 0)
+    return "bench-secret";
+  return NULL;
+}
+#endif
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  /* Decryption works in place, so the parser needs a writable copy. */
+  void *buffer = malloc((size > 0) ? size : 1);
+  if (buffer == NULL)
+    return 0;
+  memcpy(buffer, data, size);
+
+  lcc_network_parse(buffer, size,
+                    (lcc_network_parse_options_t){
+                        .writer = nop_writer,
+#if HAVE_GCRYPT_H
+                        .password_lookup = password_lookup,
+#endif
+                    });
+
+  free(buffer);
+  return 0;
+}
@@ -369,7 +369,11 @@ static int test_parse_values() {
       0, 0, 0, 0, 0, 0, 0xf8, 0x7f, // NaN
   };
 
+  value_t values[3];
+  int values_types[3];
   lcc_value_list_t vl = LCC_VALUE_LIST_INIT;
+  vl.values = values;
+  vl.values_types = values_types;
   int status = parse_values(testcase, sizeof(testcase), &vl);
   if (status != 0) {
     fprintf(stderr, "parse_values() = %d, want 0\n", status);
@@ -408,9 +412,6 @@ static int test_parse_values() {
     ret = -1;
   }
 
-  free(vl.values);
-  free(vl.values_types);
-
   return ret;
 }
 
@@ -488,6 +489,77 @@ static int test_decrypt_aes256() {
 }
 #endif
 
+#if HAVE_ZLIB
+static int values_num;
+static int counting_writer(lcc_value_list_t const *vl) {
+  values_num++;
+  return nop_writer(vl);
+}
+
+/* Wraps "in" into a compressed part and returns its size, or zero. */
+static size_t compress_part(uint8_t *out, size_t out_size, uint8_t const *in,
+                            size_t in_size) {
+  uLongf len = (uLongf)(out_size - 8);
+  if (compress2(out + 8, &len, in, (uLong)in_size, Z_BEST_COMPRESSION) !=
+      Z_OK)
+    return 0;
+
+  uint16_t hdr[] = {htobe16(TYPE_COMPRESSED), htobe16((uint16_t)(len + 8)),
+                    htobe16(COMPRESSION_ZLIB), htobe16((uint16_t)in_size)};
+  memcpy(out, hdr, sizeof(hdr));
+  return (size_t)len + 8;
+}
+
+static int test_parse_compressed() {
+  uint8_t raw[LCC_NETWORK_BUFFER_SIZE_DEFAULT];
+  size_t raw_size = sizeof(raw);
+  if (decode_string(raw_packet_data[0], raw, &raw_size)) {
+    fprintf(stderr, "test_parse_compressed: decode_string failed.\n");
+    return -1;
+  }
+
+  lcc_network_parse_options_t opts = {.writer = counting_writer};
+
+  values_num = 0;
+  if (lcc_network_parse(raw, raw_size, opts) != 0)
+    return -1;
+  int want = values_num;
+
+  uint8_t compressed[sizeof(raw)];
+  size_t compressed_size =
+      compress_part(compressed, sizeof(compressed), raw, raw_size);
+  if ((compressed_size == 0) || (compressed_size >= raw_size)) {
+    fprintf(stderr, "compress_part() = %" PRIsz ", want < %" PRIsz "\n",
+            compressed_size, raw_size);
+    return -1;
+  }
+
+  values_num = 0;
+  int status = lcc_network_parse(compressed, compressed_size, opts);
+  if ((status != 0) || (values_num != want)) {
+    fprintf(stderr,
+            "lcc_network_parse(compressed) = %d, %d values, want 0, %d\n",
+            status, values_num, want);
+    return -1;
+  }
+  printf("ok - lcc_network_parse(compressed)\n");
+
+  /* Compressed parts must not be nested. */
+  uint8_t nested[sizeof(raw) + 64];
+  size_t nested_size =
+      compress_part(nested, sizeof(nested), compressed, compressed_size);
+  if (nested_size == 0)
+    return -1;
+  if (lcc_network_parse(nested, nested_size, opts) == 0) {
+    fprintf(stderr, "lcc_network_parse(nested) = 0, want failure\n");
+    return -1;
+  }
+  printf("ok - lcc_network_parse(nested)\n");
+
+  return 0;
+}
+#endif
+
 int main(void) {
   int ret = 0;
 
@@ -505,6 +577,12 @@ int main(void) {
     ret = status;
   }
 
+#if HAVE_ZLIB
+  if ((status = test_parse_compressed())) {
+    ret = status;
+  }
+#endif
+
 #if HAVE_GCRYPT_H
   if ((status = test_verify_sha256())) {
     ret = status;
@@ -23,6 +23,8 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #ifdef WIN32
 #include "gnulib_config.h"
 #endif
@@ -39,7 +41,9 @@
 
 // clang-format off
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -57,6 +61,40 @@
 #define AI_ADDRCONFIG 0
 #endif
 
+#if HAVE_RECVMMSG
+/* Number of packets read with one recvmmsg(2) call. */
+#define RECEIVE_BATCH_SIZE 64
+#else
+#define RECEIVE_BATCH_SIZE 1
+#endif
+
+/* Capacity of a write batch. A single value list never has more values than
+ * fit into a packet of 65535 bytes, nine bytes each. */
+#define WRITE_BATCH_SIZE 1024
+#define WRITE_BATCH_VALUES 8192
+
+/* write_batch_t collects the value lists for lcc_listener_t.batch_writer. The
+ * parser's writer callback has no user data, so each receive thread finds its
+ * batch via write_batch_key. */
+typedef struct {
+  lcc_value_list_batch_writer_t writer;
+  lcc_value_list_t vls[WRITE_BATCH_SIZE];
+  size_t vls_num;
+  value_t values[WRITE_BATCH_VALUES];
+  int values_types[WRITE_BATCH_VALUES];
+  size_t values_num;
+} write_batch_t;
+
+static pthread_key_t write_batch_key;
+static pthread_once_t write_batch_once = PTHREAD_ONCE_INIT;
+
+typedef struct {
+  lcc_listener_t srv;
+  bool close_socket;
+  int status;
+  pthread_t thread;
+} server_thread_t;
+
 static bool is_multicast(struct addrinfo const *ai) {
   if (ai->ai_family == AF_INET) {
     struct sockaddr_in *addr = (struct sockaddr_in *)ai->ai_addr;
@@ -137,13 +175,24 @@ static int server_multicast_join(lcc_listener_t *srv,
   return 0;
 }
 
-static int server_bind_socket(lcc_listener_t *srv, struct addrinfo const *ai) {
+static int server_bind_socket(lcc_listener_t *srv, struct addrinfo const *ai,
+                              bool reuse_port) {
   /* allow multiple sockets to use the same PORT number */
   if (setsockopt(srv->conn, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) ==
       -1) {
     return errno;
   }
 
+  if (reuse_port) {
+#ifdef SO_REUSEPORT
+    if (setsockopt(srv->conn, SOL_SOCKET, SO_REUSEPORT, &(int){1},
+                   sizeof(int)) == -1)
+      return errno;
+#else
+    return ENOTSUP;
+#endif
+  }
+
   if (bind(srv->conn, ai->ai_addr, ai->ai_addrlen) == -1) {
     return -1;
   }
@@ -158,7 +207,7 @@ static int server_bind_socket(lcc_listener_t *srv, struct addrinfo const *ai) {
   return 0;
 }
 
-static int server_open(lcc_listener_t *srv) {
+static int server_open(lcc_listener_t *srv, bool reuse_port) {
   struct addrinfo *res = NULL;
   int status = getaddrinfo(srv->node ? srv->node : "::",
                            srv->service ? srv->service : LCC_DEFAULT_PORT,
@@ -176,7 +225,7 @@ static int server_open(lcc_listener_t *srv) {
     if (srv->conn == -1)
       continue;
 
-    status = server_bind_socket(srv, ai);
+    status = server_bind_socket(srv, ai, reuse_port);
     if (status != 0) {
       close(srv->conn);
       srv->conn = -1;
@@ -193,26 +242,99 @@ static int server_open(lcc_listener_t *srv) {
   return status != 0 ? status : -1;
 }
 
-int lcc_listen_and_write(lcc_listener_t srv) {
-  bool close_socket = 0;
+static void write_batch_key_create(void) {
+  pthread_key_create(&write_batch_key, /* destructor = */ NULL);
+}
+
+static int write_batch_flush(write_batch_t *wb) {
+  if (wb->vls_num == 0)
+    return 0;
+
+  int status = wb->writer(wb->vls, wb->vls_num);
+  wb->vls_num = 0;
+  wb->values_num = 0;
+  return status;
+}
+
+/* write_batch_add is used as the parser's writer when a batch writer is
+ * configured. It copies the value list into the calling thread's batch. */
+static int write_batch_add(lcc_value_list_t const *vl) {
+  write_batch_t *wb = pthread_getspecific(write_batch_key);
+  if ((wb == NULL) || (vl->values_len > WRITE_BATCH_VALUES))
+    return EINVAL;
 
-  if (srv.conn < 0) {
-    int status = server_open(&srv);
+  if ((wb->vls_num == WRITE_BATCH_SIZE) ||
+      ((wb->values_num + vl->values_len) > WRITE_BATCH_VALUES)) {
+    int status = write_batch_flush(wb);
     if (status != 0)
       return status;
-    close_socket = 1;
   }
 
-  if (srv.buffer_size == 0)
-    srv.buffer_size = LCC_NETWORK_BUFFER_SIZE;
+  lcc_value_list_t *dst = wb->vls + wb->vls_num;
+  *dst = *vl;
+  dst->values = wb->values + wb->values_num;
+  dst->values_types = wb->values_types + wb->values_num;
+  memcpy(dst->values, vl->values, vl->values_len * sizeof(*vl->values));
+  memcpy(dst->values_types, vl->values_types,
+         vl->values_len * sizeof(*vl->values_types));
 
-  if (srv.parser == NULL)
-    srv.parser = lcc_network_parse;
+  wb->vls_num++;
+  wb->values_num += vl->values_len;
+  return 0;
+}
+
+/* server_receive reads packets from srv->conn until an error occurs. The
+ * receive buffers are allocated once and reused for all packets. */
+static int server_receive(lcc_listener_t *srv) {
+  write_batch_t *wb = NULL;
+  if (srv->batch_writer != NULL) {
+    wb = calloc(1, sizeof(*wb));
+    if (wb == NULL)
+      return ENOMEM;
+    wb->writer = srv->batch_writer;
+
+    pthread_once(&write_batch_once, write_batch_key_create);
+    pthread_setspecific(write_batch_key, wb);
+    srv->parse_options.writer = write_batch_add;
+  }
+
+  char *buffers = malloc(RECEIVE_BATCH_SIZE * (size_t)srv->buffer_size);
+  if (buffers == NULL) {
+    free(wb);
+    return ENOMEM;
+  }
+
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[RECEIVE_BATCH_SIZE];
+  struct iovec iovs[RECEIVE_BATCH_SIZE];
+#endif
 
   int ret = 0;
   while (42) {
-    char buffer[srv.buffer_size];
-    ssize_t len = recv(srv.conn, buffer, sizeof(buffer), /* flags = */ 0);
+#if HAVE_RECVMMSG
+    for (size_t i = 0; i < RECEIVE_BATCH_SIZE; i++) {
+      iovs[i] = (struct iovec){
+          .iov_base = buffers + i * srv->buffer_size,
+          .iov_len = srv->buffer_size,
+      };
+      msgs[i] = (struct mmsghdr){
+          .msg_hdr = {.msg_iov = iovs + i, .msg_iovlen = 1},
+      };
+    }
+
+    /* Blocks until one packet is available, then takes what's queued. */
+    int num = recvmmsg(srv->conn, msgs, RECEIVE_BATCH_SIZE, MSG_WAITFORONE,
+                       /* timeout = */ NULL);
+    if (num == -1) {
+      ret = errno;
+      break;
+    }
+
+    for (int i = 0; i < num; i++)
+      (void)srv->parser(iovs[i].iov_base, (size_t)msgs[i].msg_len,
+                        srv->parse_options);
+#else
+    ssize_t len = recv(srv->conn, buffers, srv->buffer_size, /* flags = */ 0);
     if (len == -1) {
       ret = errno;
       break;
@@ -220,13 +342,94 @@ int lcc_listen_and_write(lcc_listener_t srv) {
       break;
     }
 
-    (void)srv.parser(buffer, (size_t)len, srv.parse_options);
+    (void)srv->parser(buffers, (size_t)len, srv->parse_options);
+#endif
+
+    if (wb != NULL)
+      (void)write_batch_flush(wb);
+  }
+
+  free(buffers);
+  if (wb != NULL) {
+    pthread_setspecific(write_batch_key, NULL);
+    free(wb);
+  }
+
+  return ret;
+}
+
+static void *server_thread(void *arg) {
+  server_thread_t *t = arg;
+  t->status = server_receive(&t->srv);
+  return NULL;
+}
+
+int lcc_listen_and_write(lcc_listener_t srv) {
+  if (srv.buffer_size == 0)
+    srv.buffer_size = LCC_NETWORK_BUFFER_SIZE;
+
+  if (srv.parser == NULL)
+    srv.parser = lcc_network_parse;
+
+  if (srv.threads <= 1) {
+    bool close_socket = 0;
+
+    if (srv.conn < 0) {
+      int status = server_open(&srv, /* reuse_port = */ false);
+      if (status != 0)
+        return status;
+      close_socket = 1;
+    }
+
+    int ret = server_receive(&srv);
+
+    if (close_socket) {
+      close(srv.conn);
+      srv.conn = -1;
+    }
+
+    return ret;
+  }
+
+  server_thread_t *threads = calloc((size_t)srv.threads, sizeof(*threads));
+  if (threads == NULL)
+    return ENOMEM;
+
+  int ret = 0;
+  int threads_num = 0;
+  for (; threads_num < srv.threads; threads_num++) {
+    server_thread_t *t = threads + threads_num;
+    t->srv = srv;
+
+    if (srv.conn < 0) {
+      ret = server_open(&t->srv, /* reuse_port = */ true);
+      if (ret != 0)
+        break;
+      t->close_socket = 1;
+    }
+
+    ret = pthread_create(&t->thread, /* attr = */ NULL, server_thread, t);
+    if (ret != 0) {
+      if (t->close_socket)
+        close(t->srv.conn);
+      break;
+    }
   }
 
-  if (close_socket) {
-    close(srv.conn);
-    srv.conn = -1;
+  /* If not all threads could be started, stop the others, too. recvmmsg(2)
+   * and recv(2) are cancellation points. */
+  for (int i = 0; (ret != 0) && (i < threads_num); i++)
+    pthread_cancel(threads[i].thread);
+
+  for (int i = 0; i < threads_num; i++) {
+    server_thread_t *t = threads + i;
+    pthread_join(t->thread, /* retval = */ NULL);
+    if (ret == 0)
+      ret = t->status;
+    if (t->close_socket)
+      close(t->srv.conn);
   }
 
+  free(threads);
   return ret;
 }
@@ -0,0 +1,335 @@
+/**
+ * collectd - src/libcollectdclient/shm.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "config.h"
+
+#include "collectd/lcc_features.h"
+#include "collectd/client.h" /* for lcc_identifier_to_string */
+#include "collectd/shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Number of times a read is started over while the daemon is updating the
+ * snapshot, before giving up. */
+#define LCC_SHM_RETRIES 1000
+
+struct lcc_shm_s {
+  int fd;
+  char const *map;
+  size_t map_size;
+};
+
+#if HAVE_ATOMIC_BUILTINS
+/* Maps the whole file again, if it has grown. */
+static int lcc_shm_map(lcc_shm_t *shm) /* {{{ */
+{
+  struct stat st;
+  if (fstat(shm->fd, &st) != 0)
+    return errno;
+
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(lcc_shm_header_t))
+    return EINVAL;
+  if (size <= shm->map_size)
+    return 0;
+
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, shm->fd, 0);
+  if (map == MAP_FAILED)
+    return errno;
+
+  if (shm->map != NULL)
+    munmap((void *)shm->map, shm->map_size);
+  shm->map = map;
+  shm->map_size = size;
+  return 0;
+} /* }}} int lcc_shm_map */
+
+static bool lcc_shm_range_ok(lcc_shm_header_t const *h, /* {{{ */
+                             uint64_t offset, uint64_t size) {
+  return (offset <= h->size) && (size <= (h->size - offset));
+} /* }}} bool lcc_shm_range_ok */
+
+/* Returns the string at `offset' in the string table, or NULL if it does not
+ * end within the snapshot. */
+static char const *lcc_shm_string(lcc_shm_t *shm, /* {{{ */
+                                  lcc_shm_header_t const *h, uint32_t offset) {
+  uint64_t start = h->strings_offset + offset;
+  if ((start < h->strings_offset) || (start >= h->size))
+    return NULL;
+
+  char const *str = shm->map + start;
+  if (memchr(str, 0, (size_t)(h->size - start)) == NULL)
+    return NULL;
+  return str;
+} /* }}} char const *lcc_shm_string */
+
+/* Looks up `name' in a snapshot that may be modified concurrently. Returns
+ * EAGAIN if the data is inconsistent, which the caller has to check for with
+ * the sequence number. */
+static int lcc_shm_lookup(lcc_shm_t *shm, /* {{{ */
+                          lcc_shm_header_t const *h, char const *name,
+                          size_t *ret_values_num, gauge_t **ret_values,
+                          char ***ret_values_names) {
+  if ((h->entries_num > (h->size / sizeof(lcc_shm_entry_t))) ||
+      !lcc_shm_range_ok(h, h->entries_offset,
+                        h->entries_num * sizeof(lcc_shm_entry_t)) ||
+      (h->values_offset > h->strings_offset) ||
+      !lcc_shm_range_ok(h, h->values_offset,
+                        h->strings_offset - h->values_offset))
+    return EAGAIN;
+
+  uint64_t values_total =
+      (h->strings_offset - h->values_offset) / sizeof(lcc_shm_value_t);
+  lcc_shm_entry_t const *entries =
+      (lcc_shm_entry_t const *)(shm->map + h->entries_offset);
+  lcc_shm_value_t const *values =
+      (lcc_shm_value_t const *)(shm->map + h->values_offset);
+
+  uint64_t lo = 0;
+  uint64_t hi = h->entries_num;
+  lcc_shm_entry_t e;
+  while (42) {
+    if (lo >= hi)
+      return ENOENT;
+
+    uint64_t mid = lo + (hi - lo) / 2;
+    memcpy(&e, entries + mid, sizeof(e));
+
+    char const *entry_name = lcc_shm_string(shm, h, e.name_offset);
+    if (entry_name == NULL)
+      return EAGAIN;
+
+    int cmp = strcmp(name, entry_name);
+    if (cmp == 0)
+      break;
+    else if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  if ((e.values_num == 0) || (e.values_index > values_total) ||
+      (e.values_num > (values_total - e.values_index)))
+    return EAGAIN;
+
+  gauge_t *rates = calloc(e.values_num, sizeof(*rates));
+  char **names = calloc(e.values_num, sizeof(*names));
+  if ((rates == NULL) || (names == NULL)) {
+    free(rates);
+    free(names);
+    return ENOMEM;
+  }
+
+  int status = 0;
+  for (uint32_t i = 0; i < e.values_num; i++) {
+    lcc_shm_value_t v;
+    memcpy(&v, values + e.values_index + i, sizeof(v));
+
+    char const *ds_name = lcc_shm_string(shm, h, v.name_offset);
+    if (ds_name == NULL) {
+      status = EAGAIN;
+      break;
+    }
+
+    rates[i] = (gauge_t)v.rate;
+    names[i] = strdup(ds_name);
+    if (names[i] == NULL) {
+      status = ENOMEM;
+      break;
+    }
+  }
+
+  if (status != 0) {
+    for (uint32_t i = 0; i < e.values_num; i++)
+      free(names[i]);
+    free(names);
+    free(rates);
+    return status;
+  }
+
+  *ret_values_num = (size_t)e.values_num;
+  *ret_values = rates;
+  if (ret_values_names != NULL) {
+    *ret_values_names = names;
+  } else {
+    for (uint32_t i = 0; i < e.values_num; i++)
+      free(names[i]);
+    free(names);
+  }
+  return 0;
+} /* }}} int lcc_shm_lookup */
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+int lcc_shm_open(char const *path, lcc_shm_t **ret_shm) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  if ((path == NULL) || (ret_shm == NULL))
+    return EINVAL;
+
+  lcc_shm_t *shm = calloc(1, sizeof(*shm));
+  if (shm == NULL)
+    return ENOMEM;
+
+  shm->fd = open(path, O_RDONLY);
+  if (shm->fd < 0) {
+    int status = errno;
+    free(shm);
+    return status;
+  }
+
+  int status = lcc_shm_map(shm);
+  if (status == 0) {
+    lcc_shm_header_t const *hdr = (lcc_shm_header_t const *)shm->map;
+    if ((hdr->magic != LCC_SHM_MAGIC) || (hdr->version != LCC_SHM_VERSION))
+      status = EPROTO;
+  }
+  if (status != 0) {
+    lcc_shm_close(shm);
+    return status;
+  }
+
+  *ret_shm = shm;
+  return 0;
+#else
+  (void)path;
+  (void)ret_shm;
+  return ENOTSUP;
+#endif
+} /* }}} int lcc_shm_open */
+
+void lcc_shm_close(lcc_shm_t *shm) /* {{{ */
+{
+  if (shm == NULL)
+    return;
+
+  if (shm->map != NULL)
+    munmap((void *)shm->map, shm->map_size);
+  if (shm->fd >= 0)
+    close(shm->fd);
+  free(shm);
+} /* }}} void lcc_shm_close */
+
+int lcc_shm_getval(lcc_shm_t *shm, lcc_identifier_t const *ident, /* {{{ */
+                   size_t *ret_values_num, gauge_t **ret_values,
+                   char ***ret_values_names) {
+#if HAVE_ATOMIC_BUILTINS
+  if ((shm == NULL) || (ident == NULL) || (ret_values_num == NULL) ||
+      (ret_values == NULL))
+    return EINVAL;
+
+  char name[6 * LCC_NAME_LEN];
+  if (lcc_identifier_to_string(NULL, name, sizeof(name), ident) != 0)
+    return EINVAL;
+
+  for (int i = 0; i < LCC_SHM_RETRIES; i++) {
+    lcc_shm_header_t *hdr = (lcc_shm_header_t *)shm->map;
+    uint64_t seq = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+
+    lcc_shm_header_t h;
+    memcpy(&h, hdr, sizeof(h));
+    if (h.size > shm->map_size) {
+      /* The daemon has grown the file. */
+      int status = lcc_shm_map(shm);
+      if (status != 0)
+        return status;
+      continue;
+    }
+
+    size_t values_num = 0;
+    gauge_t *values = NULL;
+    char **values_names = NULL;
+    int status = lcc_shm_lookup(shm, &h, name, &values_num, &values,
+                                (ret_values_names != NULL) ? &values_names
+                                                           : NULL);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) != seq) {
+      if (status == 0) {
+        for (size_t j = 0; (values_names != NULL) && (j < values_num); j++)
+          free(values_names[j]);
+        free(values_names);
+        free(values);
+      }
+      continue;
+    }
+
+    if (status == EAGAIN) /* inconsistent, but not being updated */
+      return EPROTO;
+    if (status != 0)
+      return status;
+
+    *ret_values_num = values_num;
+    *ret_values = values;
+    if (ret_values_names != NULL)
+      *ret_values_names = values_names;
+    return 0;
+  }
+
+  return EAGAIN;
+#else
+  (void)shm;
+  (void)ident;
+  (void)ret_values_num;
+  (void)ret_values;
+  (void)ret_values_names;
+  return ENOTSUP;
+#endif
+} /* }}} int lcc_shm_getval */
+
+int lcc_shm_time(lcc_shm_t *shm, double *ret_time) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  if ((shm == NULL) || (ret_time == NULL))
+    return EINVAL;
+
+  lcc_shm_header_t *hdr = (lcc_shm_header_t *)shm->map;
+  for (int i = 0; i < LCC_SHM_RETRIES; i++) {
+    uint64_t seq = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+
+    double t;
+    memcpy(&t, &hdr->time, sizeof(t));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) == seq) {
+      *ret_time = t;
+      return 0;
+    }
+  }
+  return EAGAIN;
+#else
+  (void)shm;
+  (void)ret_time;
+  return ENOTSUP;
+#endif
+} /* }}} int lcc_shm_time */
@@ -0,0 +1,283 @@
+/**
+ * collectd - src/libcollectdclient/shm_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "config.h"
+
+#include "collectd/lcc_features.h"
+#include "collectd/shm.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Image of a snapshot with the entries "example.com/cpu-0/cpu-idle" and
+ * "example.com/interface-eth0/if_octets". */
+typedef struct {
+  lcc_shm_header_t header;
+  lcc_shm_entry_t entries[2];
+  lcc_shm_value_t values[3];
+  char strings[128];
+} test_image_t;
+
+static uint32_t add_string(test_image_t *img, size_t *fill, char const *s) {
+  uint32_t offset = (uint32_t)*fill;
+  memcpy(img->strings + *fill, s, strlen(s) + 1);
+  *fill += strlen(s) + 1;
+  return offset;
+}
+
+static void test_image_init(test_image_t *img) {
+  size_t fill = 0;
+
+  memset(img, 0, sizeof(*img));
+  img->header = (lcc_shm_header_t){
+      .magic = LCC_SHM_MAGIC,
+      .version = LCC_SHM_VERSION,
+      .sequence = 42,
+      .size = sizeof(*img),
+      .time = 1439981005.5,
+      .entries_num = 2,
+      .entries_offset = offsetof(test_image_t, entries),
+      .values_offset = offsetof(test_image_t, values),
+      .strings_offset = offsetof(test_image_t, strings),
+  };
+
+  img->entries[0] = (lcc_shm_entry_t){
+      .name_offset = add_string(img, &fill, "example.com/cpu-0/cpu-idle"),
+      .values_num = 1,
+      .values_index = 0,
+      .time = 1439981005.0,
+      .interval = 10.0,
+  };
+  img->values[0] = (lcc_shm_value_t){
+      .raw = 1234,
+      .rate = 98.5,
+      .name_offset = add_string(img, &fill, "value"),
+      .type = LCC_TYPE_DERIVE,
+  };
+
+  img->entries[1] = (lcc_shm_entry_t){
+      .name_offset =
+          add_string(img, &fill, "example.com/interface-eth0/if_octets"),
+      .values_num = 2,
+      .values_index = 1,
+      .time = 1439981005.0,
+      .interval = 10.0,
+  };
+  img->values[1] = (lcc_shm_value_t){
+      .rate = 1024.0,
+      .name_offset = add_string(img, &fill, "rx"),
+      .type = LCC_TYPE_DERIVE,
+  };
+  img->values[2] = (lcc_shm_value_t){
+      .rate = 2048.0,
+      .name_offset = add_string(img, &fill, "tx"),
+      .type = LCC_TYPE_DERIVE,
+  };
+}
+
+static int test_image_write(char *path, test_image_t const *img) {
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    fprintf(stderr, "mkstemp(\"%s\") failed: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  ssize_t status = write(fd, img, sizeof(*img));
+  close(fd);
+  if (status != (ssize_t)sizeof(*img)) {
+    fprintf(stderr, "writing \"%s\" failed\n", path);
+    unlink(path);
+    return -1;
+  }
+  return 0;
+}
+
+static int test_shm_getval(void) {
+  test_image_t img;
+  test_image_init(&img);
+
+  char path[] = "/tmp/shm_test.XXXXXX";
+  if (test_image_write(path, &img) != 0)
+    return -1;
+
+  lcc_shm_t *shm = NULL;
+  int status = lcc_shm_open(path, &shm);
+  unlink(path);
+  if (status != 0) {
+    fprintf(stderr, "lcc_shm_open() = %d, want 0\n", status);
+    return -1;
+  }
+
+  int ret = 0;
+
+  struct {
+    lcc_identifier_t ident;
+    int want_status;
+    size_t want_num;
+    gauge_t want_values[2];
+    char const *want_names[2];
+  } cases[] = {
+      {{"example.com", "cpu", "0", "cpu", "idle"}, 0, 1, {98.5}, {"value"}},
+      {{"example.com", "interface", "eth0", "if_octets", ""},
+       0,
+       2,
+       {1024.0, 2048.0},
+       {"rx", "tx"}},
+      {{"example.com", "cpu", "1", "cpu", "idle"}, ENOENT},
+      {{"example.com", "interface", "eth1", "if_octets", ""}, ENOENT},
+      {{"a.example.com", "cpu", "0", "cpu", "idle"}, ENOENT},
+      {{"z.example.com", "cpu", "0", "cpu", "idle"}, ENOENT},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    size_t values_num = 0;
+    gauge_t *values = NULL;
+    char **names = NULL;
+
+    status = lcc_shm_getval(shm, &cases[i].ident, &values_num, &values, &names);
+    if (status != cases[i].want_status) {
+      fprintf(stderr, "lcc_shm_getval(%s/%s) = %d, want %d\n",
+              cases[i].ident.plugin, cases[i].ident.type, status,
+              cases[i].want_status);
+      ret = -1;
+      continue;
+    }
+    if (status != 0)
+      continue;
+
+    if (values_num != cases[i].want_num) {
+      fprintf(stderr, "lcc_shm_getval(%s/%s): got %zu values, want %zu\n",
+              cases[i].ident.plugin, cases[i].ident.type, values_num,
+              cases[i].want_num);
+      ret = -1;
+    }
+    for (size_t j = 0; (j < values_num) && (j < cases[i].want_num); j++) {
+      if ((values[j] != cases[i].want_values[j]) ||
+          (strcmp(names[j], cases[i].want_names[j]) != 0)) {
+        fprintf(stderr, "value #%zu = (%s, %g), want (%s, %g)\n", j, names[j],
+                values[j], cases[i].want_names[j], cases[i].want_values[j]);
+        ret = -1;
+      }
+    }
+
+    for (size_t j = 0; j < values_num; j++)
+      free(names[j]);
+    free(names);
+    free(values);
+  }
+
+  double t = 0;
+  status = lcc_shm_time(shm, &t);
+  if ((status != 0) || (t != img.header.time)) {
+    fprintf(stderr, "lcc_shm_time() = (%.1f, %d), want (%.1f, 0)\n", t, status,
+            img.header.time);
+    ret = -1;
+  }
+
+  lcc_shm_close(shm);
+
+  if (ret == 0)
+    printf("ok - lcc_shm_getval\n");
+  return ret;
+}
+
+static int test_shm_corrupt(void) {
+  test_image_t img;
+  test_image_init(&img);
+  /* The name of the second value points past the end of the snapshot. */
+  img.values[1].name_offset = 4096;
+
+  char path[] = "/tmp/shm_test.XXXXXX";
+  if (test_image_write(path, &img) != 0)
+    return -1;
+
+  lcc_shm_t *shm = NULL;
+  int status = lcc_shm_open(path, &shm);
+  unlink(path);
+  if (status != 0) {
+    fprintf(stderr, "lcc_shm_open() = %d, want 0\n", status);
+    return -1;
+  }
+
+  lcc_identifier_t ident = {"example.com", "interface", "eth0", "if_octets",
+                            ""};
+  size_t values_num = 0;
+  gauge_t *values = NULL;
+  status = lcc_shm_getval(shm, &ident, &values_num, &values, NULL);
+  lcc_shm_close(shm);
+
+  if (status != EPROTO) {
+    fprintf(stderr, "lcc_shm_getval(corrupt) = %d, want EPROTO\n", status);
+    free(values);
+    return -1;
+  }
+
+  printf("ok - lcc_shm_getval(corrupt)\n");
+  return 0;
+}
+
+static int test_shm_open_invalid(void) {
+  test_image_t img;
+  test_image_init(&img);
+  img.header.magic = 0;
+
+  char path[] = "/tmp/shm_test.XXXXXX";
+  if (test_image_write(path, &img) != 0)
+    return -1;
+
+  lcc_shm_t *shm = NULL;
+  int status = lcc_shm_open(path, &shm);
+  unlink(path);
+  if (status != EPROTO) {
+    fprintf(stderr, "lcc_shm_open(bad magic) = %d, want EPROTO\n", status);
+    lcc_shm_close(shm);
+    return -1;
+  }
+
+  printf("ok - lcc_shm_open(bad magic)\n");
+  return 0;
+}
+
+int main(void) {
+#if !HAVE_ATOMIC_BUILTINS
+  printf("skip - lcc_shm is not supported on this platform\n");
+  return 77;
+#endif
+  int ret = 0;
+
+  int status;
+  if ((status = test_shm_getval())) {
+    ret = status;
+  }
+  if ((status = test_shm_corrupt())) {
+    ret = status;
+  }
+  if ((status = test_shm_open_invalid())) {
+    ret = status;
+  }
+
+  return ret;
+}
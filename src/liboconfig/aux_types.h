@@ -13,4 +13,20 @@ struct argument_list_s {
 };
 typedef struct argument_list_s argument_list_t;
 
+/* State of one run of the parser. */
+struct parser_state_s {
+  const char *file;
+  oconfig_item_t *root;
+};
+typedef struct parser_state_s parser_state_t;
+
+/* State of one scanner, available as yyextra. */
+struct scanner_state_s {
+  /* multiline string buffer */
+  char *ml_buffer;
+  size_t ml_pos;
+  size_t ml_len;
+};
+typedef struct scanner_state_s scanner_state_t;
+
 #endif /* AUX_TYPES_H */
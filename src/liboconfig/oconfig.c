@@ -26,71 +26,77 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "oconfig.h"
 
-extern FILE *yyin;
-extern int yyparse(void);
+#include "aux_types.h"
 
-oconfig_item_t *ci_root;
-const char *c_file;
+/* Generated by flex and bison from scanner.l and parser.y */
+typedef void *yyscan_t;
+extern int yylex_init_extra(scanner_state_t *extra, yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern void yyset_in(FILE *fh, yyscan_t scanner);
+extern int yyparse(void *scanner, parser_state_t *state);
 
-static void yyset_in(FILE *fd) { yyin = fd; } /* void yyset_in */
-
-static oconfig_item_t *oconfig_parse_fh(FILE *fh) {
+static oconfig_item_t *oconfig_parse_fh(FILE *fh, const char *file) {
   int status;
-  oconfig_item_t *ret;
 
-  char file[10];
+  char name[10];
 
-  yyset_in(fh);
+  if (file == NULL) {
+    status = snprintf(name, sizeof(name), "<fd#%d>", fileno(fh));
 
-  if (NULL == c_file) {
-    status = snprintf(file, sizeof(file), "<fd#%d>", fileno(fh));
-
-    if ((status < 0) || (((size_t)status) >= sizeof(file))) {
-      c_file = "<unknown>";
+    if ((status < 0) || (((size_t)status) >= sizeof(name))) {
+      file = "<unknown>";
     } else {
-      file[sizeof(file) - 1] = '\0';
-      c_file = file;
+      name[sizeof(name) - 1] = '\0';
+      file = name;
     }
   }
 
-  status = yyparse();
-  if (status != 0) {
-    fprintf(stderr, "yyparse returned error #%i\n", status);
+  scanner_state_t extra = {0};
+  yyscan_t scanner;
+  if (yylex_init_extra(&extra, &scanner) != 0) {
+    fprintf(stderr, "yylex_init_extra failed: %s\n", strerror(errno));
     return NULL;
   }
+  yyset_in(fh, scanner);
 
-  c_file = NULL;
+  parser_state_t state = {
+      .file = file,
+      .root = NULL,
+  };
+  status = yyparse(scanner, &state);
+  yylex_destroy(scanner);
+  free(extra.ml_buffer);
 
-  ret = ci_root;
-  ci_root = NULL;
-  yyset_in((FILE *)0);
+  if (status != 0) {
+    fprintf(stderr, "yyparse returned error #%i\n", status);
+    oconfig_free(state.root);
+    return NULL;
+  }
 
-  return ret;
+  return state.root;
 } /* oconfig_item_t *oconfig_parse_fh */
 
 oconfig_item_t *oconfig_parse_file(const char *file) {
   FILE *fh;
   oconfig_item_t *ret;
 
-  c_file = file;
-
   fh = fopen(file, "r");
   if (fh == NULL) {
     fprintf(stderr, "fopen (%s) failed: %s\n", file, strerror(errno));
     return NULL;
   }
 
-  ret = oconfig_parse_fh(fh);
+  ret = oconfig_parse_fh(fh, file);
   fclose(fh);
 
-  c_file = NULL;
-
   return ret;
 } /* oconfig_item_t *oconfig_parse_file */
 
@@ -195,3 +201,224 @@ void oconfig_free(oconfig_item_t *ci) {
   oconfig_free_all(ci);
   free(ci);
 }
+
+/*
+ * Serialization
+ *
+ * Items are written depth-first in the byte order of the host: the key, the
+ * values and the children. Strings are prefixed with their length; a NULL key
+ * has the length UINT32_MAX.
+ */
+#define OCONFIG_SERIALIZE_MAX_DEPTH 1024
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+  int failed;
+} oconfig_writer_t;
+
+typedef struct {
+  const char *pos;
+  const char *end;
+} oconfig_reader_t;
+
+static void oconfig_write(oconfig_writer_t *w, const void *data, size_t len) {
+  if (w->failed)
+    return;
+
+  if (w->len + len > w->size) {
+    size_t size = (w->size == 0) ? 4096 : w->size;
+    while (size < w->len + len)
+      size *= 2;
+
+    char *tmp = realloc(w->data, size);
+    if (tmp == NULL) {
+      w->failed = 1;
+      return;
+    }
+    w->data = tmp;
+    w->size = size;
+  }
+
+  memcpy(w->data + w->len, data, len);
+  w->len += len;
+} /* void oconfig_write */
+
+static void oconfig_write_u32(oconfig_writer_t *w, uint32_t v) {
+  oconfig_write(w, &v, sizeof(v));
+}
+
+static void oconfig_write_string(oconfig_writer_t *w, const char *s) {
+  if (s == NULL) {
+    oconfig_write_u32(w, UINT32_MAX);
+    return;
+  }
+
+  size_t len = strlen(s);
+  if (len >= UINT32_MAX) {
+    w->failed = 1;
+    return;
+  }
+  oconfig_write_u32(w, (uint32_t)len);
+  oconfig_write(w, s, len);
+} /* void oconfig_write_string */
+
+static void oconfig_write_item(oconfig_writer_t *w, const oconfig_item_t *ci) {
+  oconfig_write_string(w, ci->key);
+
+  oconfig_write_u32(w, (uint32_t)ci->values_num);
+  for (int i = 0; i < ci->values_num; i++) {
+    const oconfig_value_t *v = ci->values + i;
+    uint8_t type = (uint8_t)v->type;
+
+    oconfig_write(w, &type, sizeof(type));
+    if (v->type == OCONFIG_TYPE_STRING)
+      oconfig_write_string(w, v->value.string);
+    else if (v->type == OCONFIG_TYPE_NUMBER)
+      oconfig_write(w, &v->value.number, sizeof(v->value.number));
+    else
+      oconfig_write_u32(w, (uint32_t)v->value.boolean);
+  }
+
+  oconfig_write_u32(w, (uint32_t)ci->children_num);
+  for (int i = 0; i < ci->children_num; i++)
+    oconfig_write_item(w, ci->children + i);
+} /* void oconfig_write_item */
+
+size_t oconfig_serialize(const oconfig_item_t *ci, char **ret) {
+  oconfig_writer_t w = {0};
+
+  if ((ci == NULL) || (ret == NULL))
+    return 0;
+
+  oconfig_write_item(&w, ci);
+  if (w.failed || (w.len == 0)) {
+    free(w.data);
+    return 0;
+  }
+
+  *ret = w.data;
+  return w.len;
+} /* size_t oconfig_serialize */
+
+static int oconfig_read(oconfig_reader_t *r, void *data, size_t len) {
+  if ((size_t)(r->end - r->pos) < len)
+    return -1;
+
+  memcpy(data, r->pos, len);
+  r->pos += len;
+  return 0;
+} /* int oconfig_read */
+
+static int oconfig_read_u32(oconfig_reader_t *r, uint32_t *v) {
+  return oconfig_read(r, v, sizeof(*v));
+}
+
+static int oconfig_read_string(oconfig_reader_t *r, char **ret) {
+  uint32_t len;
+
+  if (oconfig_read_u32(r, &len) != 0)
+    return -1;
+  if (len == UINT32_MAX) {
+    *ret = NULL;
+    return 0;
+  }
+  if ((size_t)(r->end - r->pos) < len)
+    return -1;
+
+  *ret = malloc(len + 1);
+  if (*ret == NULL)
+    return -1;
+  memcpy(*ret, r->pos, len);
+  (*ret)[len] = 0;
+  r->pos += len;
+  return 0;
+} /* int oconfig_read_string */
+
+/* Fills in `ci', which must be zeroed. On failure, `ci' may be partially
+ * filled in and has to be freed with oconfig_free_all(). */
+static int oconfig_read_item(oconfig_reader_t *r, oconfig_item_t *ci,
+                             int depth) {
+  uint32_t num;
+
+  if (depth >= OCONFIG_SERIALIZE_MAX_DEPTH)
+    return -1;
+
+  if (oconfig_read_string(r, &ci->key) != 0)
+    return -1;
+
+  /* Every value takes at least five bytes, every child at least eight. */
+  if ((oconfig_read_u32(r, &num) != 0) || (num > INT_MAX) ||
+      (num > (size_t)(r->end - r->pos) / 5))
+    return -1;
+  if (num > 0) {
+    ci->values = calloc(num, sizeof(*ci->values));
+    if (ci->values == NULL)
+      return -1;
+  }
+  for (uint32_t i = 0; i < num; i++) {
+    oconfig_value_t *v = ci->values + i;
+    uint8_t type;
+    uint32_t boolean = 0;
+
+    if (oconfig_read(r, &type, sizeof(type)) != 0)
+      return -1;
+    /* Count the value before reading it, so a string is freed on failure. */
+    ci->values_num++;
+    v->type = type;
+
+    int status;
+    if (type == OCONFIG_TYPE_STRING)
+      status = oconfig_read_string(r, &v->value.string);
+    else if (type == OCONFIG_TYPE_NUMBER)
+      status = oconfig_read(r, &v->value.number, sizeof(v->value.number));
+    else if (type == OCONFIG_TYPE_BOOLEAN) {
+      status = oconfig_read_u32(r, &boolean);
+      v->value.boolean = (int)boolean;
+    } else {
+      /* Nothing to free for an unknown type. */
+      v->type = OCONFIG_TYPE_NUMBER;
+      status = -1;
+    }
+    if (status != 0)
+      return -1;
+  }
+
+  if ((oconfig_read_u32(r, &num) != 0) || (num > INT_MAX) ||
+      (num > (size_t)(r->end - r->pos) / 8))
+    return -1;
+  if (num > 0) {
+    ci->children = calloc(num, sizeof(*ci->children));
+    if (ci->children == NULL)
+      return -1;
+  }
+  for (uint32_t i = 0; i < num; i++) {
+    ci->children_num++;
+    if (oconfig_read_item(r, ci->children + i, depth + 1) != 0)
+      return -1;
+  }
+
+  return 0;
+} /* int oconfig_read_item */
+
+oconfig_item_t *oconfig_deserialize(const char *buffer, size_t size) {
+  oconfig_reader_t r = {
+      .pos = buffer,
+      .end = buffer + size,
+  };
+
+  if (buffer == NULL)
+    return NULL;
+
+  oconfig_item_t *ci = calloc(1, sizeof(*ci));
+  if (ci == NULL)
+    return NULL;
+
+  if ((oconfig_read_item(&r, ci, 0) != 0) || (r.pos != r.end)) {
+    oconfig_free(ci);
+    return NULL;
+  }
+
+  return ci;
+} /* oconfig_item_t *oconfig_deserialize */
@@ -67,4 +67,13 @@ oconfig_item_t *oconfig_clone(const oconfig_item_t *ci);
 
 void oconfig_free(oconfig_item_t *ci);
 
+/* Serializes the tree `ci' into a buffer allocated with malloc(), which is
+ * returned in `ret'. The format depends on the host and is meant for caching
+ * parsed files only. Returns the size of the buffer or zero on failure. */
+size_t oconfig_serialize(const oconfig_item_t *ci, char **ret);
+
+/* Recreates a tree from the output of oconfig_serialize(). Returns NULL if
+ * `buffer' does not hold exactly one serialized tree. */
+oconfig_item_t *oconfig_deserialize(const char *buffer, size_t size);
+
 #endif /* OCONFIG_H */
@@ -31,17 +31,19 @@
 #include "aux_types.h"
 
 static char *unquote (const char *orig);
-static void yyerror(const char *s);
 
-/* Lexer variables */
-extern int yylineno;
-extern char *yytext;
-extern int yylex (void);
-
-extern oconfig_item_t *ci_root;
-extern char           *c_file;
+/* Lexer functions; see scanner.l */
+extern char *yyget_text(void *scanner);
+extern int yyget_lineno(void *scanner);
 %}
 
+/* The parser and the scanner keep no global state, so several files can be
+ * parsed at the same time. */
+%define api.pure
+%parse-param {void *scanner}
+%parse-param {parser_state_t *state}
+%lex-param {void *scanner}
+
 %start entire_file
 
 %union {
@@ -77,6 +79,11 @@ extern char           *c_file;
 /* pass an verbose, specific error message to yyerror() */
 %error-verbose
 
+%code {
+extern int yylex(YYSTYPE *yylval, void *scanner);
+static void yyerror(void *scanner, parser_state_t *state, const char *s);
+}
+
 %%
 string:
 	QUOTED_STRING		{$$ = unquote ($1);}
@@ -97,7 +104,7 @@ argument_list:
 	 oconfig_value_t *tmp = realloc($$.argument,
 	                                ($$.argument_num+1) * sizeof(*$$.argument));
 	 if (tmp == NULL) {
-	   yyerror("realloc failed");
+	   yyerror(scanner, state, "realloc failed");
 	   YYERROR;
 	 }
 	 $$.argument = tmp;
@@ -108,7 +115,7 @@ argument_list:
 	{
 	 $$.argument = calloc(1, sizeof(*$$.argument));
 	 if ($$.argument == NULL) {
-	   yyerror("calloc failed");
+	   yyerror(scanner, state, "calloc failed");
 	   YYERROR;
 	 }
 	 $$.argument[0] = $1;
@@ -159,7 +166,7 @@ block:
 	 if (strcmp($1.key, $3) != 0)
 	 {
 		printf("block_begin = %s; block_end = %s;\n", $1.key, $3);
-		yyerror("block not closed");
+		yyerror(scanner, state, "block not closed");
 		YYERROR;
 	 }
 	 free ($3); $3 = NULL;
@@ -172,7 +179,7 @@ block:
 	 if (strcmp($1.key, $2) != 0)
 	 {
 		printf("block_begin = %s; block_end = %s;\n", $1.key, $2);
-		yyerror("block not closed");
+		yyerror(scanner, state, "block not closed");
 		YYERROR;
 	 }
 	 free ($2); $2 = NULL;
@@ -185,7 +192,7 @@ block:
 statement:
 	option		{$$ = $1;}
 	| block		{$$ = $1;}
-	| EOL		{$$.values_num = 0;}
+	| EOL		{memset(&$$, 0, sizeof($$));}
 	;
 
 statement_list:
@@ -197,7 +204,7 @@ statement_list:
 		 oconfig_item_t *tmp = realloc($$.statement,
 		                               ($$.statement_num+1) * sizeof(*tmp));
 		 if (tmp == NULL) {
-		   yyerror("realloc failed");
+		   yyerror(scanner, state, "realloc failed");
 		   YYERROR;
 		 }
 		 $$.statement = tmp;
@@ -211,7 +218,7 @@ statement_list:
 	 {
 		 $$.statement = calloc(1, sizeof(*$$.statement));
 		 if ($$.statement == NULL) {
-		   yyerror("calloc failed");
+		   yyerror(scanner, state, "calloc failed");
 		   YYERROR;
 		 }
 		 $$.statement[0] = $1;
@@ -228,28 +235,29 @@ statement_list:
 entire_file:
 	statement_list
 	{
-	 ci_root = calloc(1, sizeof(*ci_root));
-	 if (ci_root == NULL) {
-	   yyerror("calloc failed");
+	 state->root = calloc(1, sizeof(*state->root));
+	 if (state->root == NULL) {
+	   yyerror(scanner, state, "calloc failed");
 	   YYERROR;
 	 }
-	 ci_root->children = $1.statement;
-	 ci_root->children_num = $1.statement_num;
+	 state->root->children = $1.statement;
+	 state->root->children_num = $1.statement_num;
 	}
 	| /* epsilon */
 	{
-	 ci_root = calloc(1, sizeof(*ci_root));
-	 if (ci_root == NULL) {
-	   yyerror("calloc failed");
+	 state->root = calloc(1, sizeof(*state->root));
+	 if (state->root == NULL) {
+	   yyerror(scanner, state, "calloc failed");
 	   YYERROR;
 	 }
 	}
 	;
 
 %%
-static void yyerror(const char *s)
+static void yyerror(void *scanner, parser_state_t *state, const char *s)
 {
 	const char *text;
+	const char *yytext = yyget_text(scanner);
 
 	if (yytext == NULL)
 		text = "<empty>";
@@ -259,7 +267,7 @@ static void yyerror(const char *s)
 		text = yytext;
 
 	fprintf(stderr, "Parse error in file `%s', line %i near `%s': %s\n",
-		c_file, yylineno, text, s);
+		state->file, yyget_lineno(scanner), text, s);
 } /* int yyerror */
 
 static char *unquote (const char *orig)
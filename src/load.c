@@ -30,6 +30,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/proc_file/proc_file.h"
 
 #include <unistd.h>
 
@@ -109,6 +110,16 @@ static void load_submit(gauge_t snum, gauge_t mnum, gauge_t lnum) {
   plugin_dispatch_values(&vl);
 }
 
+#if !defined(HAVE_GETLOADAVG) && defined(KERNEL_LINUX)
+static proc_file_t *proc_loadavg;
+
+static int load_shutdown(void) {
+  proc_file_destroy(proc_loadavg);
+  proc_loadavg = NULL;
+  return 0;
+}
+#endif
+
 static int load_read(void) {
 #if defined(HAVE_GETLOADAVG)
   double load[3];
@@ -122,28 +133,28 @@ static int load_read(void) {
 
 #elif defined(KERNEL_LINUX)
   gauge_t snum, mnum, lnum;
-  FILE *loadavg;
-  char buffer[16];
+  char *buffer;
 
   char *fields[8];
-  int numfields;
+  size_t numfields;
 
-  if ((loadavg = fopen("/proc/loadavg", "r")) == NULL) {
-    WARNING("load: fopen: %s", STRERRNO);
-    return -1;
+  if (proc_loadavg == NULL) {
+    proc_loadavg = proc_file_create("/proc/loadavg");
+    if (proc_loadavg == NULL) {
+      ERROR("load: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  if (fgets(buffer, 16, loadavg) == NULL) {
-    WARNING("load: fgets: %s", STRERRNO);
-    fclose(loadavg);
+  if (proc_file_read(proc_loadavg) < 0) {
+    WARNING("load: reading /proc/loadavg failed: %s", STRERRNO);
     return -1;
   }
 
-  if (fclose(loadavg)) {
-    WARNING("load: fclose: %s", STRERRNO);
-  }
+  if ((buffer = proc_file_next_line(proc_loadavg)) == NULL)
+    return -1;
 
-  numfields = strsplit(buffer, fields, 8);
+  numfields = proc_file_split(buffer, fields, STATIC_ARRAY_SIZE(fields));
 
   if (numfields < 3)
     return -1;
@@ -194,4 +205,7 @@ static int load_read(void) {
 void module_register(void) {
   plugin_register_config("load", load_config, config_keys, config_keys_num);
   plugin_register_read("load", load_read);
+#if !defined(HAVE_GETLOADAVG) && defined(KERNEL_LINUX)
+  plugin_register_shutdown("load", load_shutdown);
+#endif
 } /* void module_register */
@@ -50,6 +50,51 @@ static int log_level = LOG_INFO;
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *log_file;
+/* Kept open while the log thread has more messages queued for us. */
+static FILE *log_fh;
+
+#if HAVE_YAJL_V2
+/* Every thread reuses its generator instead of allocating one per message. */
+static pthread_key_t gen_key;
+static pthread_once_t gen_key_once = PTHREAD_ONCE_INIT;
+
+static void log_logstash_gen_destroy(void *arg) { yajl_gen_free(arg); }
+
+static void log_logstash_gen_key_create(void) {
+  pthread_key_create(&gen_key, log_logstash_gen_destroy);
+}
+#endif
+
+/* Returns an empty generator for a new message. */
+static yajl_gen log_logstash_gen_get(void) {
+#if HAVE_YAJL_V2
+  pthread_once(&gen_key_once, log_logstash_gen_key_create);
+
+  yajl_gen g = pthread_getspecific(gen_key);
+  if (g != NULL) {
+    yajl_gen_reset(g, NULL);
+    yajl_gen_clear(g);
+    return g;
+  }
+
+  g = yajl_gen_alloc(NULL);
+  if ((g != NULL) && (pthread_setspecific(gen_key, g) != 0)) {
+    yajl_gen_free(g);
+    return NULL;
+  }
+  return g;
+#else
+  yajl_gen_config conf = {0};
+  return yajl_gen_alloc(&conf, NULL);
+#endif
+} /* yajl_gen log_logstash_gen_get */
+
+static void log_logstash_gen_put(yajl_gen g) {
+#if !HAVE_YAJL_V2
+  /* yajl 1 cannot reset a generator. */
+  yajl_gen_free(g);
+#endif
+} /* void log_logstash_gen_put */
 
 static const char *config_keys[] = {"LogLevel", "File"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
@@ -64,8 +109,14 @@ static int log_logstash_config(const char *key, const char *value) {
       return 1;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
     sfree(log_file);
     log_file = strdup(value);
+    pthread_mutex_unlock(&file_lock);
   } else {
     return -1;
   }
@@ -75,7 +126,7 @@ static int log_logstash_config(const char *key, const char *value) {
 static void log_logstash_print(yajl_gen g, int severity,
                                cdtime_t timestamp_time) {
   FILE *fh;
-  bool do_close = false;
+  bool is_file = false;
   struct tm timestamp_tm;
   char timestamp_str[64];
   const unsigned char *buf;
@@ -150,32 +201,39 @@ static void log_logstash_print(yajl_gen g, int severity,
     fh = stderr;
   } else if (strcasecmp(log_file, "stdout") == 0) {
     fh = stdout;
-    do_close = false;
   } else if (strcasecmp(log_file, "stderr") == 0) {
     fh = stderr;
-    do_close = false;
   } else {
-    fh = fopen(log_file, "a");
-    do_close = true;
+    if (log_fh == NULL)
+      log_fh = fopen(log_file, "a");
+    fh = log_fh;
+    is_file = true;
   }
 
   if (fh == NULL) {
     fprintf(stderr, "log_logstash plugin: fopen (%s) failed: %s\n", log_file,
             STRERRNO);
   } else {
-    fprintf(fh, "%s\n", buf);
-    if (do_close) {
-      fclose(fh);
-    } else {
-      fflush(fh);
+    fwrite(buf, 1, len, fh);
+    fputc('\n', fh);
+
+    /* More messages are about to follow: leave the file open and buffered
+     * until the backlog has been written. */
+    if (plugin_log_backlog() == 0) {
+      if (is_file) {
+        fclose(fh);
+        log_fh = NULL;
+      } else {
+        fflush(fh);
+      }
     }
   }
   pthread_mutex_unlock(&file_lock);
-  yajl_gen_free(g);
+  log_logstash_gen_put(g);
   return;
 
 err:
-  yajl_gen_free(g);
+  log_logstash_gen_put(g);
   fprintf(stderr, "Could not correctly generate JSON message\n");
   return;
 } /* void log_logstash_print */
@@ -185,11 +243,7 @@ static void log_logstash_log(int severity, const char *msg,
   if (severity > log_level)
     return;
 
-#if HAVE_YAJL_V2
-  yajl_gen g = yajl_gen_alloc(NULL);
-#else
-  yajl_gen g = yajl_gen_alloc(&(yajl_gen_config){0}, NULL);
-#endif
+  yajl_gen g = log_logstash_gen_get();
   if (g == NULL) {
     fprintf(stderr, "Could not allocate JSON generator.\n");
     return;
@@ -206,7 +260,7 @@ static void log_logstash_log(int severity, const char *msg,
   log_logstash_print(g, severity, cdtime());
   return;
 err:
-  yajl_gen_free(g);
+  log_logstash_gen_put(g);
   fprintf(stderr, "Could not generate JSON message preamble\n");
   return;
 
@@ -215,16 +269,7 @@ err:
 static int log_logstash_notification(const notification_t *n,
                                      user_data_t __attribute__((unused)) *
                                          user_data) {
-  yajl_gen g;
-#if HAVE_YAJL_V2
-  g = yajl_gen_alloc(NULL);
-#else
-  yajl_gen_config conf = {};
-
-  conf.beautify = 0;
-  g = yajl_gen_alloc(&conf, NULL);
-#endif
-
+  yajl_gen g = log_logstash_gen_get();
   if (g == NULL) {
     fprintf(stderr, "Could not allocate JSON generator.\n");
     return 0;
@@ -317,7 +362,7 @@ static int log_logstash_notification(const notification_t *n,
   return 0;
 
 err:
-  yajl_gen_free(g);
+  log_logstash_gen_put(g);
   fprintf(stderr, "Could not correctly generate JSON notification\n");
   return 0;
 } /* int log_logstash_notification */
@@ -40,6 +40,8 @@ static int log_level = LOG_INFO;
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *log_file;
+/* Kept open while the log thread has more messages queued for us. */
+static FILE *log_fh;
 static int print_timestamp = 1;
 static int print_severity;
 
@@ -56,8 +58,14 @@ static int logfile_config(const char *key, const char *value) {
       return 0;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
     sfree(log_file);
     log_file = strdup(value);
+    pthread_mutex_unlock(&file_lock);
   } else if (0 == strcasecmp(key, "Timestamp")) {
     if (IS_FALSE(value))
       print_timestamp = 0;
@@ -77,7 +85,7 @@ static int logfile_config(const char *key, const char *value) {
 static void logfile_print(const char *msg, int severity,
                           cdtime_t timestamp_time) {
   FILE *fh;
-  bool do_close = false;
+  bool is_file = false;
   char timestamp_str[64];
   char level_str[16] = "";
 
@@ -121,8 +129,10 @@ static void logfile_print(const char *msg, int severity,
   else if (strcasecmp(log_file, "stdout") == 0)
     fh = stdout;
   else {
-    fh = fopen(log_file, "a");
-    do_close = true;
+    if (log_fh == NULL)
+      log_fh = fopen(log_file, "a");
+    fh = log_fh;
+    is_file = true;
   }
 
   if (fh == NULL) {
@@ -134,10 +144,15 @@ static void logfile_print(const char *msg, int severity,
     else
       fprintf(fh, "%s%s\n", level_str, msg);
 
-    if (do_close) {
-      fclose(fh);
-    } else {
-      fflush(fh);
+    /* More messages are about to follow: leave the file open and buffered
+     * until the backlog has been written. */
+    if (plugin_log_backlog() == 0) {
+      if (is_file) {
+        fclose(fh);
+        log_fh = NULL;
+      } else {
+        fflush(fh);
+      }
     }
   }
 
@@ -151,7 +166,7 @@ static void logfile_log(int severity, const char *msg,
   if (severity > log_level)
     return;
 
-  logfile_print(msg, severity, cdtime());
+  logfile_print(msg, severity, cdtime_coarse());
 } /* void logfile_log (int, const char *) */
 
 static int logfile_notification(const notification_t *n,
@@ -191,7 +206,7 @@ static int logfile_notification(const notification_t *n,
 
   buf[sizeof(buf) - 1] = '\0';
 
-  logfile_print(buf, LOG_INFO, (n->time != 0) ? n->time : cdtime());
+  logfile_print(buf, LOG_INFO, (n->time != 0) ? n->time : cdtime_coarse());
 
   return 0;
 } /* int logfile_notification */
@@ -93,6 +93,7 @@ typedef struct logparser_ctx_s {
 static logparser_ctx_t logparser_ctx;
 
 static int logparser_shutdown(void);
+static int logparser_read(user_data_t *ud);
 
 static void logparser_free_user_data(void *data) {
   message_item_user_data_t *user_data = (message_item_user_data_t *)data;
@@ -536,6 +537,17 @@ static int logparser_init(void) {
     }
   }
 
+  /* Each parser gets a read callback of its own, so that a busy or failing
+   * log file does not delay the others. The parsers are freed on shutdown. */
+  for (size_t i = 0; i < logparser_ctx.parsers_len; i++) {
+    char name[DATA_MAX_NAME_LEN];
+    snprintf(name, sizeof(name), PLUGIN_NAME "-%zu", i);
+
+    plugin_register_complex_read(
+        NULL, name, logparser_read, 0,
+        &(user_data_t){.data = logparser_ctx.parsers + i});
+  }
+
   return 0;
 }
 
@@ -641,21 +653,16 @@ static int logparser_parser_read(log_parser_t *parser) {
   return 0;
 }
 
-static int logparser_read(__attribute__((unused)) user_data_t *ud) {
-  int ret = 0;
+static int logparser_read(user_data_t *ud) {
+  log_parser_t *parser = ud->data;
 
-  for (size_t i = 0; i < logparser_ctx.parsers_len; i++) {
-    log_parser_t *parser = logparser_ctx.parsers + i;
-    ret = logparser_parser_read(parser);
-    if (parser->first_read)
-      parser->first_read = false;
+  int ret = logparser_parser_read(parser);
+  if (parser->first_read)
+    parser->first_read = false;
 
-    if (ret < 0) {
-      ERROR(PLUGIN_NAME ": Failed to parse %s messages from %s", parser->name,
-            parser->filename);
-      break;
-    }
-  }
+  if (ret < 0)
+    ERROR(PLUGIN_NAME ": Failed to parse %s messages from %s", parser->name,
+          parser->filename);
 
   return ret;
 }
@@ -695,6 +702,5 @@ static int logparser_shutdown(void) {
 void module_register(void) {
   plugin_register_complex_config(PLUGIN_NAME, logparser_config);
   plugin_register_init(PLUGIN_NAME, logparser_init);
-  plugin_register_complex_read(NULL, PLUGIN_NAME, logparser_read, 0, NULL);
   plugin_register_shutdown(PLUGIN_NAME, logparser_shutdown);
 }
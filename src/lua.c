@@ -32,6 +32,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils_lua.h"
+#include "utils_random.h"
 
 /* Include the Lua API header files. */
 #include <lauxlib.h>
@@ -42,20 +43,46 @@
 
 #define PLUGIN_READ 1
 #define PLUGIN_WRITE 2
+#define PLUGIN_WRITE_BATCH 3
 
-typedef struct lua_script_s {
-  lua_State *lua_state;
-  struct lua_script_s *next;
-} lua_script_t;
-
+/* One interpreter running a script. The threads of an interpreter share its
+ * global state, so only one callback may run in an interpreter at a time. */
 typedef struct {
   lua_State *lua_state;
-  char *lua_function_name;
   pthread_mutex_t lock;
+} clua_state_t;
+
+/* A callback as registered by one of the interpreters of a script. */
+typedef struct {
+  clua_state_t *state;
+  lua_State *lua_state; /* thread the callback runs in */
   int callback_id;
+} clua_callback_state_t;
+
+/* Each interpreter of a script registers the same callbacks. Write callbacks
+ * run in whichever interpreter is idle; read callbacks always run in the
+ * first one. */
+typedef struct {
+  char *lua_function_name;
+  clua_callback_state_t *states;
+  size_t states_num;
 } clua_callback_data_t;
 
+typedef struct lua_script_s {
+  clua_state_t *states;
+  size_t states_num;
+
+  /* Callbacks registered by the first interpreter, which the callbacks of
+   * the other interpreters are added to. */
+  clua_callback_data_t **callbacks;
+  size_t callbacks_num;
+  bool loaded;
+
+  struct lua_script_s *next;
+} lua_script_t;
+
 static char base_path[PATH_MAX];
+static int states_num = 1;
 static lua_script_t *scripts;
 
 static int clua_store_callback(lua_State *L, int idx) /* {{{ */
@@ -93,19 +120,36 @@ static int clua_store_thread(lua_State *L, int idx) /* {{{ */
   return 0;
 } /* }}} int clua_store_thread */
 
+/* Returns an idle interpreter of the callback with its lock held. If all of
+ * them are busy, waits for a random one. */
+static clua_callback_state_t *
+clua_callback_acquire(clua_callback_data_t *cb) /* {{{ */
+{
+  for (size_t i = 0; i < cb->states_num; i++)
+    if (pthread_mutex_trylock(&cb->states[i].state->lock) == 0)
+      return cb->states + i;
+
+  clua_callback_state_t *cs = cb->states + (cdrand_u() % cb->states_num);
+  pthread_mutex_lock(&cs->state->lock);
+  return cs;
+} /* }}} clua_callback_state_t *clua_callback_acquire */
+
 static int clua_read(user_data_t *ud) /* {{{ */
 {
   clua_callback_data_t *cb = ud->data;
+  clua_callback_state_t *cs = cb->states;
+  pthread_mutex_t *lock = &cs->state->lock;
 
-  pthread_mutex_lock(&cb->lock);
+  pthread_mutex_lock(lock);
 
-  lua_State *L = cb->lua_state;
+  lua_State *L = cs->lua_state;
+  int callback_id = cs->callback_id;
 
-  int status = clua_load_callback(L, cb->callback_id);
+  int status = clua_load_callback(L, callback_id);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+          cb->lua_function_name, callback_id);
+    pthread_mutex_unlock(lock);
     return -1;
   }
   /* +1 = 1 */
@@ -119,14 +163,14 @@ static int clua_read(user_data_t *ud) /* {{{ */
     else
       ERROR("Lua plugin: Calling a read callback failed: %s", errmsg);
     lua_pop(L, 1);
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
     ERROR("Lua plugin: Read function \"%s\" (id %i) did not return a numeric "
           "status.",
-          cb->lua_function_name, cb->callback_id);
+          cb->lua_function_name, callback_id);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
@@ -135,23 +179,24 @@ static int clua_read(user_data_t *ud) /* {{{ */
   /* pop return value and function */
   lua_pop(L, 1); /* -1 = 0 */
 
-  pthread_mutex_unlock(&cb->lock);
+  pthread_mutex_unlock(lock);
   return status;
 } /* }}} int clua_read */
 
 static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                       user_data_t *ud) {
   clua_callback_data_t *cb = ud->data;
+  clua_callback_state_t *cs = clua_callback_acquire(cb);
+  pthread_mutex_t *lock = &cs->state->lock;
 
-  pthread_mutex_lock(&cb->lock);
-
-  lua_State *L = cb->lua_state;
+  lua_State *L = cs->lua_state;
+  int callback_id = cs->callback_id;
 
-  int status = clua_load_callback(L, cb->callback_id);
+  int status = clua_load_callback(L, callback_id);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+          cb->lua_function_name, callback_id);
+    pthread_mutex_unlock(lock);
     return -1;
   }
   /* +1 = 1 */
@@ -159,7 +204,7 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   status = luaC_pushvaluelist(L, ds, vl);
   if (status != 0) {
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     ERROR("Lua plugin: luaC_pushvaluelist failed.");
     return -1;
   }
@@ -174,24 +219,82 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     else
       ERROR("Lua plugin: Calling the write callback failed:\n%s", errmsg);
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
     ERROR("Lua plugin: Write function \"%s\" (id %i) did not return a numeric "
           "value.",
-          cb->lua_function_name, cb->callback_id);
+          cb->lua_function_name, callback_id);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
   }
 
   lua_pop(L, 1); /* -1 = 0 */
-  pthread_mutex_unlock(&cb->lock);
+  pthread_mutex_unlock(lock);
   return status;
 } /* }}} int clua_write */
 
+/* Hands all value lists of a batch to the callback as one array, so that an
+ * interpreter is acquired only once per batch. */
+static int clua_write_batch(const write_batch_entry_t *entries, /* {{{ */
+                            size_t entries_num, user_data_t *ud) {
+  clua_callback_data_t *cb = ud->data;
+  clua_callback_state_t *cs = clua_callback_acquire(cb);
+  pthread_mutex_t *lock = &cs->state->lock;
+
+  lua_State *L = cs->lua_state;
+  int callback_id = cs->callback_id;
+
+  int status = clua_load_callback(L, callback_id);
+  if (status != 0) {
+    ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
+          cb->lua_function_name, callback_id);
+    pthread_mutex_unlock(lock);
+    return -1;
+  }
+  /* +1 = 1 */
+
+  lua_createtable(L, (int)entries_num, 0); /* +1 = 2 */
+  int n = 0;
+  for (size_t i = 0; i < entries_num; i++) {
+    if (luaC_pushvaluelist(L, entries[i].ds, entries[i].vl) != 0) {
+      ERROR("Lua plugin: luaC_pushvaluelist failed.");
+      continue;
+    }
+    lua_rawseti(L, -2, ++n);
+  }
+
+  status = lua_pcall(L, 1, 1, 0); /* -2+1 = 1 */
+  if (status != 0) {
+    const char *errmsg = lua_tostring(L, -1);
+    if (errmsg == NULL)
+      ERROR("Lua plugin: Calling the write batch callback failed. "
+            "In addition, retrieving the error message failed.");
+    else
+      ERROR("Lua plugin: Calling the write batch callback failed:\n%s",
+            errmsg);
+    lua_pop(L, 1); /* -1 = 0 */
+    pthread_mutex_unlock(lock);
+    return -1;
+  }
+
+  if (!lua_isnumber(L, -1)) {
+    ERROR("Lua plugin: Write batch function \"%s\" (id %i) did not return a "
+          "numeric value.",
+          cb->lua_function_name, callback_id);
+    status = -1;
+  } else {
+    status = (int)lua_tointeger(L, -1);
+  }
+
+  lua_pop(L, 1); /* -1 = 0 */
+  pthread_mutex_unlock(lock);
+  return status;
+} /* }}} int clua_write_batch */
+
 /*
  * Exported functions
  */
@@ -264,10 +367,37 @@ static int lua_cb_dispatch_values(lua_State *L) /* {{{ */
 static void lua_cb_free(void *data) {
   clua_callback_data_t *cb = data;
   free(cb->lua_function_name);
-  pthread_mutex_destroy(&cb->lock);
+  free(cb->states);
   free(cb);
 }
 
+/* Adds the callback registered by a further interpreter of `script' to the
+ * callback of the same name registered by the first one. */
+static int lua_cb_add_state(lua_State *L, lua_script_t *script, /* {{{ */
+                            char const *function_name,
+                            clua_callback_state_t cs) {
+  if (script->loaded)
+    return luaL_error(L,
+                      "Callback \"%s\" registered after loading the script. "
+                      "This is not supported with more than one state.",
+                      function_name);
+
+  for (size_t i = 0; i < script->callbacks_num; i++) {
+    clua_callback_data_t *cb = script->callbacks[i];
+    if (strcmp(cb->lua_function_name, function_name) != 0)
+      continue;
+
+    if (cb->states_num >= script->states_num)
+      break;
+    cb->states[cb->states_num] = cs;
+    cb->states_num++;
+    return 0;
+  }
+
+  return luaL_error(L, "Callback \"%s\" was not registered by the first state",
+                    function_name);
+} /* }}} int lua_cb_add_state */
+
 static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
 {
   int nargs = lua_gettop(L);
@@ -312,14 +442,47 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
   clua_store_thread(L, -1);
   lua_pop(L, 1);
 
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:script");
+  lua_script_t *script = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (script == NULL)
+    return luaL_error(L, "%s", "Unable to find the script");
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:state");
+  size_t state_index = (size_t)lua_tointeger(L, -1);
+  lua_pop(L, 1);
+
+  clua_callback_state_t cs = {
+      .state = script->states + state_index,
+      .lua_state = thread,
+      .callback_id = callback_id,
+  };
+  if (state_index > 0)
+    return lua_cb_add_state(L, script, function_name, cs);
+
+  clua_callback_data_t **callbacks =
+      realloc(script->callbacks,
+              (script->callbacks_num + 1) * sizeof(*script->callbacks));
+  if (callbacks == NULL)
+    return luaL_error(L, "%s", "realloc failed");
+  script->callbacks = callbacks;
+
   clua_callback_data_t *cb = calloc(1, sizeof(*cb));
   if (cb == NULL)
     return luaL_error(L, "%s", "calloc failed");
 
-  cb->lua_state = thread;
-  cb->callback_id = callback_id;
+  cb->states = calloc(script->states_num, sizeof(*cb->states));
+  if (cb->states == NULL) {
+    free(cb);
+    return luaL_error(L, "%s", "calloc failed");
+  }
+  cb->states[0] = cs;
+  cb->states_num = 1;
   cb->lua_function_name = strdup(function_name);
-  pthread_mutex_init(&cb->lock, NULL);
+
+  /* The daemon frees the callback if registering fails, so it is forgotten
+   * again in that case. */
+  script->callbacks[script->callbacks_num] = cb;
+  script->callbacks_num++;
 
   if (PLUGIN_READ == type) {
     int status = plugin_register_complex_read(/* group = */ "lua",
@@ -331,8 +494,10 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
                                                   .free_func = lua_cb_free,
                                               });
 
-    if (status != 0)
+    if (status != 0) {
+      script->callbacks_num--;
       return luaL_error(L, "%s", "plugin_register_complex_read failed");
+    }
     return 0;
   } else if (PLUGIN_WRITE == type) {
     int status = plugin_register_write(/* name = */ function_name,
@@ -342,8 +507,23 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
                                            .free_func = lua_cb_free,
                                        });
 
-    if (status != 0)
+    if (status != 0) {
+      script->callbacks_num--;
       return luaL_error(L, "%s", "plugin_register_write failed");
+    }
+    return 0;
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    int status = plugin_register_write_batch(/* name = */ function_name,
+                                             /* callback  = */ clua_write_batch,
+                                             &(user_data_t){
+                                                 .data = cb,
+                                                 .free_func = lua_cb_free,
+                                             });
+
+    if (status != 0) {
+      script->callbacks_num--;
+      return luaL_error(L, "%s", "plugin_register_write_batch failed");
+    }
     return 0;
   } else {
     return luaL_error(L, "%s", "lua_cb_register_generic unsupported type");
@@ -358,6 +538,10 @@ static int lua_cb_register_write(lua_State *L) {
   return lua_cb_register_generic(L, PLUGIN_WRITE);
 }
 
+static int lua_cb_register_write_batch(lua_State *L) {
+  return lua_cb_register_generic(L, PLUGIN_WRITE_BATCH);
+}
+
 static const luaL_Reg collectdlib[] = {
     {"log_debug", lua_cb_log_debug},
     {"log_error", lua_cb_log_error},
@@ -367,6 +551,7 @@ static const luaL_Reg collectdlib[] = {
     {"dispatch_values", lua_cb_dispatch_values},
     {"register_read", lua_cb_register_read},
     {"register_write", lua_cb_register_write},
+    {"register_write_batch", lua_cb_register_write_batch},
     {NULL, NULL}};
 
 static int open_collectd(lua_State *L) /* {{{ */
@@ -386,94 +571,98 @@ static void lua_script_free(lua_script_t *script) /* {{{ */
 
   lua_script_t *next = script->next;
 
-  if (script->lua_state != NULL) {
-    lua_close(script->lua_state);
-    script->lua_state = NULL;
+  for (size_t i = 0; i < script->states_num; i++) {
+    clua_state_t *st = script->states + i;
+    if (st->lua_state != NULL) {
+      lua_close(st->lua_state);
+      st->lua_state = NULL;
+      pthread_mutex_destroy(&st->lock);
+    }
   }
 
+  /* The callbacks themselves are freed by the daemon. */
+  sfree(script->callbacks);
+  sfree(script->states);
   sfree(script);
 
   lua_script_free(next);
 } /* }}} void lua_script_free */
 
-static int lua_script_init(lua_script_t *script) /* {{{ */
+static int lua_state_init(clua_state_t *st) /* {{{ */
 {
-  memset(script, 0, sizeof(*script));
-
   /* initialize the lua context */
-  script->lua_state = luaL_newstate();
-  if (script->lua_state == NULL) {
+  st->lua_state = luaL_newstate();
+  if (st->lua_state == NULL) {
     ERROR("Lua plugin: luaL_newstate() failed.");
     return -1;
   }
+  pthread_mutex_init(&st->lock, /* attr = */ NULL);
 
   /* Open up all the standard Lua libraries. */
-  luaL_openlibs(script->lua_state);
+  luaL_openlibs(st->lua_state);
 
 /* Load the 'collectd' library */
 #if LUA_VERSION_NUM < 502
-  lua_pushcfunction(script->lua_state, open_collectd);
-  lua_pushstring(script->lua_state, "collectd");
-  lua_call(script->lua_state, 1, 0);
+  lua_pushcfunction(st->lua_state, open_collectd);
+  lua_pushstring(st->lua_state, "collectd");
+  lua_call(st->lua_state, 1, 0);
 #else
-  luaL_requiref(script->lua_state, "collectd", open_collectd, 1);
-  lua_pop(script->lua_state, 1);
+  luaL_requiref(st->lua_state, "collectd", open_collectd, 1);
+  lua_pop(st->lua_state, 1);
 #endif
 
   /* Prepend BasePath to package.path */
   if (base_path[0] != '\0') {
-    lua_getglobal(script->lua_state, "package");
-    lua_getfield(script->lua_state, -1, "path");
+    lua_getglobal(st->lua_state, "package");
+    lua_getfield(st->lua_state, -1, "path");
 
-    const char *cur_path = lua_tostring(script->lua_state, -1);
+    const char *cur_path = lua_tostring(st->lua_state, -1);
     char *new_path = ssnprintf_alloc("%s/?.lua;%s", base_path, cur_path);
 
-    lua_pop(script->lua_state, 1);
-    lua_pushstring(script->lua_state, new_path);
+    lua_pop(st->lua_state, 1);
+    lua_pushstring(st->lua_state, new_path);
 
     free(new_path);
 
-    lua_setfield(script->lua_state, -2, "path");
-    lua_pop(script->lua_state, 1);
+    lua_setfield(st->lua_state, -2, "path");
+    lua_pop(st->lua_state, 1);
   }
 
   return 0;
-} /* }}} int lua_script_init */
+} /* }}} int lua_state_init */
 
-static int lua_script_load(const char *script_path) /* {{{ */
-{
-  lua_script_t *script = malloc(sizeof(*script));
-  if (script == NULL) {
-    ERROR("Lua plugin: malloc failed.");
-    return -1;
-  }
+/* Creates the `index'th interpreter of `script' and runs the script in it. */
+static int lua_script_run(lua_script_t *script, size_t index, /* {{{ */
+                          const char *script_path) {
+  clua_state_t *st = script->states + index;
 
-  int status = lua_script_init(script);
-  if (status != 0) {
-    lua_script_free(script);
+  int status = lua_state_init(st);
+  if (status != 0)
     return status;
-  }
 
-  status = luaL_loadfile(script->lua_state, script_path);
+  status = luaL_loadfile(st->lua_state, script_path);
   if (status != 0) {
     ERROR("Lua plugin: luaL_loadfile failed: %s",
-          lua_tostring(script->lua_state, -1));
-    lua_pop(script->lua_state, 1);
-    lua_script_free(script);
+          lua_tostring(st->lua_state, -1));
+    lua_pop(st->lua_state, 1);
     return -1;
   }
 
-  lua_pushstring(script->lua_state, script_path);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:script_path");
-  lua_pushinteger(script->lua_state, 0);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:callback_num");
+  lua_pushstring(st->lua_state, script_path);
+  lua_setfield(st->lua_state, LUA_REGISTRYINDEX, "collectd:script_path");
+  lua_pushinteger(st->lua_state, 0);
+  lua_setfield(st->lua_state, LUA_REGISTRYINDEX, "collectd:callback_num");
+  lua_pushlightuserdata(st->lua_state, script);
+  lua_setfield(st->lua_state, LUA_REGISTRYINDEX, "collectd:script");
+  lua_pushinteger(st->lua_state, (lua_Integer)index);
+  lua_setfield(st->lua_state, LUA_REGISTRYINDEX, "collectd:state");
 
-  status = lua_pcall(script->lua_state,
+  status = lua_pcall(st->lua_state,
                      /* nargs = */ 0,
                      /* nresults = */ LUA_MULTRET,
                      /* errfunc = */ 0);
   if (status != 0) {
-    const char *errmsg = lua_tostring(script->lua_state, -1);
+    const char *errmsg = lua_tostring(st->lua_state, -1);
 
     if (errmsg == NULL)
       ERROR("Lua plugin: lua_pcall failed with status %i. "
@@ -482,6 +671,38 @@ static int lua_script_load(const char *script_path) /* {{{ */
     else
       ERROR("Lua plugin: Executing script \"%s\" failed: %s", script_path,
             errmsg);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int lua_script_run */
+
+static int lua_script_load(const char *script_path) /* {{{ */
+{
+  lua_script_t *script = calloc(1, sizeof(*script));
+  if (script == NULL) {
+    ERROR("Lua plugin: calloc failed.");
+    return -1;
+  }
+
+  script->states = calloc((size_t)states_num, sizeof(*script->states));
+  if (script->states == NULL) {
+    ERROR("Lua plugin: calloc failed.");
+    sfree(script);
+    return -1;
+  }
+  script->states_num = (size_t)states_num;
+
+  int status = 0;
+  for (size_t i = 0; (i < script->states_num) && (status == 0); i++)
+    status = lua_script_run(script, i, script_path);
+  script->loaded = true;
+
+  /* Registered callbacks refer to the interpreters, so the script is only
+   * dropped if there are none. */
+  if ((status != 0) && (script->callbacks_num == 0)) {
+    lua_script_free(script);
+    return -1;
   }
 
   /* Append this script to the global list of scripts. */
@@ -544,9 +765,26 @@ static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int lua_config_script */
 
+static int lua_config_states(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  if (tmp < 1) {
+    ERROR("Lua plugin: \"States\" must be at least 1.");
+    return -1;
+  }
+
+  states_num = tmp;
+  return 0;
+} /* }}} int lua_config_states */
+
 /*
  * <Plugin lua>
  *   BasePath "/"
+ *   States 1
  *   Script "script1.lua"
  *   Script "script2.lua"
  * </Plugin>
@@ -559,6 +797,8 @@ static int lua_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("BasePath", child->key) == 0) {
       status = lua_config_base_path(child);
+    } else if (strcasecmp("States", child->key) == 0) {
+      status = lua_config_states(child);
     } else if (strcasecmp("Script", child->key) == 0) {
       status = lua_config_script(child);
     } else {
@@ -158,11 +158,19 @@ static int mh_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
   return FC_MATCH_NO_MATCH;
 } /* }}} int mh_match */
 
+/* The result only depends on the host name. */
+static int mh_hint(void __attribute__((unused)) * *user_data, /* {{{ */
+                   fc_match_hint_t *hint) {
+  hint->pure = true;
+  return 0;
+} /* }}} int mh_hint */
+
 void module_register(void) {
   match_proc_t mproc = {0};
 
   mproc.create = mh_create;
   mproc.destroy = mh_destroy;
   mproc.match = mh_match;
+  mproc.hint = mh_hint;
   fc_register_match("hashed", mproc);
 } /* module_register */
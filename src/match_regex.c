@@ -35,7 +35,9 @@
 
 #include "filter_chain.h"
 #include "utils/common/common.h"
+#include "utils/lru/lru.h"
 #include "utils/metadata/meta_data.h"
+#include "utils_identity.h"
 #include "utils_llist.h"
 
 #include <regex.h>
@@ -57,6 +59,14 @@ struct mr_regex_s {
   mr_regex_t *next;
 };
 
+/* A cached verdict. The name guards against hash collisions. */
+struct mr_verdict_s;
+typedef struct mr_verdict_s mr_verdict_t;
+struct mr_verdict_s {
+  char *name;
+  int verdict;
+};
+
 struct mr_match_s;
 typedef struct mr_match_s mr_match_t;
 struct mr_match_s {
@@ -67,11 +77,27 @@ struct mr_match_s {
   mr_regex_t *type_instance;
   llist_t *meta; /* Maps each meta key into mr_regex_t* */
   bool invert;
+
+  /* mr_verdict_t by identity hash, see the CacheSize option. NULL if
+   * disabled. */
+  c_lru_t *cache;
+  pthread_mutex_t cache_lock;
 };
 
 /*
  * internal helper functions
  */
+static void mr_free_verdict(void *arg) /* {{{ */
+{
+  mr_verdict_t *v = arg;
+
+  if (v == NULL)
+    return;
+
+  sfree(v->name);
+  sfree(v);
+} /* }}} void mr_free_verdict */
+
 static void mr_free_regex(mr_regex_t *r) /* {{{ */
 {
   if (r == NULL)
@@ -101,6 +127,11 @@ static void mr_free_match(mr_match_t *m) /* {{{ */
   }
   llist_destroy(m->meta);
 
+  if (m->cache != NULL) {
+    c_lru_destroy(m->cache);
+    pthread_mutex_destroy(&m->cache_lock);
+  }
+
   sfree(m);
 } /* }}} void mr_free_match */
 
@@ -237,6 +268,7 @@ static int mr_config_add_meta_regex(llist_t **meta, /* {{{ */
 static int mr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
 {
   mr_match_t *m;
+  int cache_size = 0;
   int status;
 
   m = calloc(1, sizeof(*m));
@@ -266,6 +298,8 @@ static int mr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
       status = mr_config_add_meta_regex(&m->meta, child);
     else if (strcasecmp("Invert", child->key) == 0)
       status = cf_util_get_boolean(child, &m->invert);
+    else if (strcasecmp("CacheSize", child->key) == 0)
+      status = cf_util_get_int(child, &cache_size);
     else {
       log_err("The `%s' configuration option is not understood and "
               "will be ignored.",
@@ -290,6 +324,21 @@ static int mr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+  /* Meta data is not part of the identity, so verdicts of matches that look
+   * at it cannot be cached. */
+  if ((status == 0) && (cache_size > 0) && (m->meta != NULL)) {
+    log_warn("The `CacheSize' option is ignored for matches with `MetaData' "
+             "expressions.");
+  } else if ((status == 0) && (cache_size > 0)) {
+    m->cache = c_lru_create((size_t)cache_size, mr_free_verdict);
+    if (m->cache == NULL) {
+      log_err("mr_create: c_lru_create failed.");
+      status = -ENOMEM;
+    } else {
+      pthread_mutex_init(&m->cache_lock, /* attr = */ NULL);
+    }
+  }
+
   if (status != 0) {
     mr_free_match(m);
     return status;
@@ -306,19 +355,59 @@ static int mr_destroy(void **user_data) /* {{{ */
   return 0;
 } /* }}} int mr_destroy */
 
-static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
-                    const value_list_t *vl,
-                    notification_meta_t __attribute__((unused)) * *meta,
-                    void **user_data) {
+/* Copies the string a regular expression of the form "^literal$" matches into
+ * `buffer'. Returns false for all other regular expressions. */
+static bool mr_regex_literal(char const *re_str, /* {{{ */
+                             char *buffer, size_t buffer_size) {
+  size_t len = strlen(re_str);
+
+  if ((len < 2) || (re_str[0] != '^') || (re_str[len - 1] != '$'))
+    return false;
+  if ((len - 2) >= buffer_size)
+    return false;
+
+  for (size_t i = 1; i < len - 1; i++)
+    if (strchr(".[]()*+?{}|\\^$", re_str[i]) != NULL)
+      return false;
+
+  memcpy(buffer, re_str + 1, len - 2);
+  buffer[len - 2] = 0;
+  return true;
+} /* }}} bool mr_regex_literal */
+
+static void mr_hint_field(mr_regex_t *re_head, /* {{{ */
+                          char *buffer, size_t buffer_size) {
+  /* All regular expressions have to match, so any literal one will do. */
+  for (mr_regex_t *re = re_head; re != NULL; re = re->next)
+    if (mr_regex_literal(re->re_str, buffer, buffer_size))
+      return;
+} /* }}} void mr_hint_field */
+
+static int mr_hint(void **user_data, fc_match_hint_t *hint) /* {{{ */
+{
   mr_match_t *m;
-  int match_value = FC_MATCH_MATCHES;
-  int nomatch_value = FC_MATCH_NO_MATCH;
 
   if ((user_data == NULL) || (*user_data == NULL))
     return -1;
 
   m = *user_data;
 
+  hint->pure = (m->meta == NULL);
+
+  /* An inverted match succeeds for everything else. */
+  if (m->invert)
+    return 0;
+
+  mr_hint_field(m->plugin, hint->plugin, sizeof(hint->plugin));
+  mr_hint_field(m->type, hint->type, sizeof(hint->type));
+  return 0;
+} /* }}} int mr_hint */
+
+static int mr_evaluate(mr_match_t *m, const value_list_t *vl) /* {{{ */
+{
+  int match_value = FC_MATCH_MATCHES;
+  int nomatch_value = FC_MATCH_NO_MATCH;
+
   if (m->invert) {
     match_value = FC_MATCH_NO_MATCH;
     nomatch_value = FC_MATCH_MATCHES;
@@ -355,6 +444,53 @@ static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
   }
 
   return match_value;
+} /* }}} int mr_evaluate */
+
+static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
+                    const value_list_t *vl,
+                    notification_meta_t __attribute__((unused)) * *meta,
+                    void **user_data) {
+  mr_match_t *m;
+
+  if ((user_data == NULL) || (*user_data == NULL))
+    return -1;
+
+  m = *user_data;
+
+  /* Without an identity, e.g. if a target modified the value list, the
+   * verdict is not cached. */
+  vl_identity_t const *id =
+      (m->cache != NULL) ? plugin_value_list_identity(vl) : NULL;
+  if (id == NULL)
+    return mr_evaluate(m, vl);
+
+  mr_verdict_t *v = NULL;
+  int ret = -1;
+  pthread_mutex_lock(&m->cache_lock);
+  if ((c_lru_get(m->cache, id->hash, (void *)&v) == 0) &&
+      (strcmp(v->name, id->name) == 0))
+    ret = v->verdict;
+  pthread_mutex_unlock(&m->cache_lock);
+  if (ret >= 0)
+    return ret;
+
+  ret = mr_evaluate(m, vl);
+
+  v = calloc(1, sizeof(*v));
+  if (v == NULL)
+    return ret;
+  v->name = strdup(id->name);
+  v->verdict = ret;
+  if (v->name == NULL) {
+    mr_free_verdict(v);
+    return ret;
+  }
+
+  pthread_mutex_lock(&m->cache_lock);
+  c_lru_put(m->cache, id->hash, v);
+  pthread_mutex_unlock(&m->cache_lock);
+
+  return ret;
 } /* }}} int mr_match */
 
 void module_register(void) {
@@ -363,5 +499,6 @@ void module_register(void) {
   mproc.create = mr_create;
   mproc.destroy = mr_destroy;
   mproc.match = mr_match;
+  mproc.hint = mr_hint;
   fc_register_match("regex", mproc);
 } /* module_register */
@@ -34,6 +34,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 
 #include <netdb.h>
 #include <netinet/in.h>
@@ -46,6 +47,9 @@
 #define MEMCACHED_DEF_PORT "11211"
 #define MEMCACHED_CONNECT_TIMEOUT 10000
 #define MEMCACHED_IO_TIMEOUT 5000
+#define MEMCACHED_BUFFER_SIZE 4096
+/* Reconnects are delayed by up to this many intervals. */
+#define MEMCACHED_MAX_BACKOFF 16
 
 struct prev_s {
   derive_t hits;
@@ -66,22 +70,50 @@ struct memcached_s {
   char *connport;
   int fd;
   prev_t prev;
+
+  /* State of the current poll, see memcached_read(). */
+  bool polling;
+  bool connecting;
+  struct addrinfo *ai_list;
+  struct addrinfo *ai_ptr; /* address "fd" is connecting to */
+  size_t sent;
+  char buffer[MEMCACHED_BUFFER_SIZE];
+  size_t buffer_fill;
+  cdtime_t deadline;
+
+  /* After a failure, connecting is not retried before "next_connect". The
+   * delay doubles with each failure in a row. */
+  cdtime_t next_connect;
+  cdtime_t backoff;
 };
 typedef struct memcached_s memcached_t;
 
-static bool memcached_have_instances;
-
-static void memcached_free(void *arg) {
-  memcached_t *st = arg;
-  if (st == NULL)
-    return;
+/* All instances are polled concurrently by a single read callback. */
+static memcached_t **instances;
+static size_t instances_num;
 
+static void memcached_close(memcached_t *st) {
   if (st->fd >= 0) {
     shutdown(st->fd, SHUT_RDWR);
     close(st->fd);
     st->fd = -1;
   }
 
+  if (st->ai_list != NULL) {
+    freeaddrinfo(st->ai_list);
+    st->ai_list = NULL;
+    st->ai_ptr = NULL;
+  }
+  st->connecting = false;
+}
+
+static void memcached_free(void *arg) {
+  memcached_t *st = arg;
+  if (st == NULL)
+    return;
+
+  memcached_close(st);
+
   sfree(st->name);
   sfree(st->host);
   sfree(st->socket);
@@ -123,27 +155,36 @@ static int memcached_connect_unix(memcached_t *st) {
   return fd;
 } /* int memcached_connect_unix */
 
+/* Starts a non-blocking connect to the next address of "st->ai_list". The
+ * connection is established once the socket becomes writable, see
+ * memcached_poll_connect(). Returns -1 when no address is left. */
 static int memcached_connect_inet(memcached_t *st) {
-  struct addrinfo *ai_list;
-  int fd = -1;
+  if (st->ai_list == NULL) {
+    struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                                .ai_flags = AI_ADDRCONFIG,
+                                .ai_socktype = SOCK_STREAM};
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG,
-                              .ai_socktype = SOCK_STREAM};
-
-  int status = getaddrinfo(st->connhost, st->connport, &ai_hints, &ai_list);
-  if (status != 0) {
-    ERROR("memcached plugin: memcached_connect_inet: "
-          "getaddrinfo(%s,%s) failed: %s",
-          st->connhost, st->connport,
-          (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
-    return -1;
+    int status =
+        getaddrinfo(st->connhost, st->connport, &ai_hints, &st->ai_list);
+    if (status != 0) {
+      ERROR("memcached plugin: memcached_connect_inet: "
+            "getaddrinfo(%s,%s) failed: %s",
+            st->connhost, st->connport,
+            (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
+      st->ai_list = NULL;
+      return -1;
+    }
+    st->ai_ptr = st->ai_list;
+  } else if (st->ai_ptr != NULL) {
+    st->ai_ptr = st->ai_ptr->ai_next;
   }
 
-  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
-       ai_ptr = ai_ptr->ai_next) {
+  for (; st->ai_ptr != NULL; st->ai_ptr = st->ai_ptr->ai_next) {
+    struct addrinfo *ai_ptr = st->ai_ptr;
+
     /* create our socket descriptor */
-    fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    int fd =
+        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
     if (fd < 0) {
       WARNING("memcached plugin: memcached_connect_inet: "
               "socket(2) failed: %s",
@@ -153,10 +194,9 @@ static int memcached_connect_inet(memcached_t *st) {
 
     /* switch socket to non-blocking mode */
     int flags = fcntl(fd, F_GETFL);
-    status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
     if (status != 0) {
       close(fd);
-      fd = -1;
       continue;
     }
 
@@ -165,162 +205,172 @@ static int memcached_connect_inet(memcached_t *st) {
     if (status != 0 && errno != EINPROGRESS) {
       shutdown(fd, SHUT_RDWR);
       close(fd);
-      fd = -1;
-      continue;
-    }
-
-    /* Wait until connection establishes */
-    struct pollfd pollfd = {
-        .fd = fd,
-        .events = POLLOUT,
-    };
-    do
-      status = poll(&pollfd, 1, MEMCACHED_CONNECT_TIMEOUT);
-    while (status < 0 && errno == EINTR);
-    if (status <= 0) {
-      close(fd);
-      fd = -1;
       continue;
     }
 
-    /* Check if all is good */
-    int socket_error;
-    status = getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&socket_error,
-                        &(socklen_t){sizeof(socket_error)});
-    if (status != 0 || socket_error != 0) {
-      close(fd);
-      fd = -1;
-      continue;
-    }
-    /* A socket is opened and connection succeeded. We're done. */
-    break;
+    st->fd = fd;
+    st->connecting = (status != 0);
+    return 0;
   }
 
-  freeaddrinfo(ai_list);
-  return fd;
+  freeaddrinfo(st->ai_list);
+  st->ai_list = NULL;
+  return -1;
 } /* int memcached_connect_inet */
 
-static void memcached_connect(memcached_t *st) {
-  if (st->fd >= 0)
-    return;
-
-  if (st->socket != NULL)
-    st->fd = memcached_connect_unix(st);
-  else
-    st->fd = memcached_connect_inet(st);
+static void memcached_connected(memcached_t *st) {
+  st->connecting = false;
+  if (st->ai_list != NULL) {
+    freeaddrinfo(st->ai_list);
+    st->ai_list = NULL;
+    st->ai_ptr = NULL;
+  }
 
-  if (st->fd >= 0)
-    INFO("memcached plugin: Instance \"%s\": connection established.",
-         st->name);
+  INFO("memcached plugin: Instance \"%s\": connection established.", st->name);
 }
 
-static int memcached_query_daemon(char *buffer, size_t buffer_size,
-                                  memcached_t *st) {
-  int status;
-  size_t buffer_fill;
+/* All instances share one read callback, so that a single instance may not
+ * hold it up for longer than an interval. */
+static cdtime_t memcached_timeout(int ms) {
+  cdtime_t timeout = MS_TO_CDTIME_T(ms);
+  cdtime_t interval = plugin_get_interval();
+  return (interval < timeout) ? interval : timeout;
+}
 
-  memcached_connect(st);
+/* Connects if necessary and prepares sending the "stats" command. Returns
+ * non-zero if the instance is not polled this time. */
+static int memcached_poll_start(memcached_t *st, cdtime_t now) {
   if (st->fd < 0) {
-    ERROR("memcached plugin: Instance \"%s\" could not connect to daemon.",
-          st->name);
-    return -1;
-  }
+    if (now < st->next_connect)
+      return EAGAIN;
 
-  struct pollfd pollfd = {
-      .fd = st->fd,
-      .events = POLLOUT,
-  };
+    int status;
+    if (st->socket != NULL) {
+      st->fd = memcached_connect_unix(st);
+      status = (st->fd < 0) ? -1 : 0;
+    } else
+      status = memcached_connect_inet(st);
 
-  do
-    status = poll(&pollfd, 1, MEMCACHED_IO_TIMEOUT);
-  while (status < 0 && errno == EINTR);
+    if (status != 0) {
+      ERROR("memcached plugin: Instance \"%s\" could not connect to daemon.",
+            st->name);
+      return -1;
+    }
 
-  if (status <= 0) {
-    ERROR("memcached plugin: poll() failed for write() call.");
-    close(st->fd);
-    st->fd = -1;
-    return -1;
+    if (!st->connecting)
+      memcached_connected(st);
   }
 
-  status = (int)swrite(st->fd, "stats\r\n", strlen("stats\r\n"));
-  if (status != 0) {
-    ERROR("memcached plugin: Instance \"%s\": write(2) failed: %s", st->name,
-          STRERRNO);
-    shutdown(st->fd, SHUT_RDWR);
-    close(st->fd);
-    st->fd = -1;
+  st->sent = 0;
+  st->buffer_fill = 0;
+  st->deadline = now + memcached_timeout(st->connecting
+                                             ? MEMCACHED_CONNECT_TIMEOUT
+                                             : MEMCACHED_IO_TIMEOUT);
+  return 0;
+} /* int memcached_poll_start */
+
+/* Completes a non-blocking connect. On failure, the next address is tried. */
+static int memcached_poll_connect(memcached_t *st, cdtime_t now) {
+  int socket_error = 0;
+  int status = getsockopt(st->fd, SOL_SOCKET, SO_ERROR, (void *)&socket_error,
+                          &(socklen_t){sizeof(socket_error)});
+  if ((status == 0) && (socket_error == 0)) {
+    memcached_connected(st);
+    st->deadline = now + memcached_timeout(MEMCACHED_IO_TIMEOUT);
+    return 0;
+  }
+
+  close(st->fd);
+  st->fd = -1;
+  if (memcached_connect_inet(st) != 0) {
+    ERROR("memcached plugin: Instance \"%s\" could not connect to daemon.",
+          st->name);
     return -1;
   }
 
-  /* receive data from the memcached daemon */
-  memset(buffer, 0, buffer_size);
+  if (!st->connecting) {
+    memcached_connected(st);
+    st->deadline = now + memcached_timeout(MEMCACHED_IO_TIMEOUT);
+  }
+  return 0;
+} /* int memcached_poll_connect */
+
+/* Handles the poll(2) events of an instance. Returns a positive value once
+ * the complete response has been received, zero while the request is in
+ * progress and -1 on failure. */
+static int memcached_poll_io(memcached_t *st, short revents, cdtime_t now) {
+  static char const request[] = "stats\r\n";
+  static char const end_token[5] = {'E', 'N', 'D', '\r', '\n'};
+
+  if (st->connecting) {
+    if ((revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL)) == 0)
+      return 0;
+    return memcached_poll_connect(st, now);
+  }
+
+  if (st->sent < sizeof(request) - 1) {
+    if ((revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL)) == 0)
+      return 0;
 
-  buffer_fill = 0;
-  pollfd.events = POLLIN;
-  while (1) {
+    ssize_t status;
     do
-      status = poll(&pollfd, 1, MEMCACHED_IO_TIMEOUT);
+      status = write(st->fd, request + st->sent,
+                     sizeof(request) - 1 - st->sent);
     while (status < 0 && errno == EINTR);
 
-    if (status <= 0) {
-      ERROR("memcached plugin: Instance \"%s\": Timeout reading from socket",
-            st->name);
-      close(st->fd);
-      st->fd = -1;
+    if (status < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      ERROR("memcached plugin: Instance \"%s\": write(2) failed: %s", st->name,
+            STRERRNO);
       return -1;
     }
 
-    do
-      status = (int)recv(st->fd, buffer + buffer_fill,
-                         buffer_size - buffer_fill, /* flags = */ 0);
-    while (status < 0 && errno == EINTR);
+    st->sent += (size_t)status;
+    return 0;
+  }
 
-    char const end_token[5] = {'E', 'N', 'D', '\r', '\n'};
-    if (status < 0) {
+  if ((revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)) == 0)
+    return 0;
 
-      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
-        continue;
+  ssize_t status;
+  do
+    status = recv(st->fd, st->buffer + st->buffer_fill,
+                  sizeof(st->buffer) - 1 - st->buffer_fill, /* flags = */ 0);
+  while (status < 0 && errno == EINTR);
 
-      ERROR("memcached plugin: Instance \"%s\": Error reading from socket: %s",
-            st->name, STRERRNO);
-      shutdown(st->fd, SHUT_RDWR);
-      close(st->fd);
-      st->fd = -1;
-      return -1;
-    } else if (status == 0) {
-      ERROR("memcached plugin: Instance \"%s\": Connection closed by peer",
-            st->name);
-      close(st->fd);
-      st->fd = -1;
-      return -1;
-    }
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
 
-    buffer_fill += (size_t)status;
-    if (buffer_fill > buffer_size) {
-      buffer_fill = buffer_size;
-      WARNING("memcached plugin: Instance \"%s\": Message was truncated.",
-              st->name);
-      shutdown(st->fd, SHUT_RDWR);
-      close(st->fd);
-      st->fd = -1;
-      break;
-    }
+    ERROR("memcached plugin: Instance \"%s\": Error reading from socket: %s",
+          st->name, STRERRNO);
+    return -1;
+  } else if (status == 0) {
+    ERROR("memcached plugin: Instance \"%s\": Connection closed by peer",
+          st->name);
+    return -1;
+  }
 
-    /* If buffer ends in end_token, we have all the data. */
-    if (memcmp(buffer + buffer_fill - sizeof(end_token), end_token,
-               sizeof(end_token)) == 0)
-      break;
-  } /* while (recv) */
+  st->buffer_fill += (size_t)status;
+  st->buffer[st->buffer_fill] = 0;
 
-  status = 0;
-  if (buffer_fill == 0) {
-    WARNING("memcached plugin: Instance \"%s\": No data returned by memcached.",
+  /* If buffer ends in end_token, we have all the data. */
+  if ((st->buffer_fill >= sizeof(end_token)) &&
+      (memcmp(st->buffer + st->buffer_fill - sizeof(end_token), end_token,
+              sizeof(end_token)) == 0))
+    return 1;
+
+  /* The rest of the response is dropped together with the connection. */
+  if (st->buffer_fill == sizeof(st->buffer) - 1) {
+    WARNING("memcached plugin: Instance \"%s\": Message was truncated.",
             st->name);
-    status = -1;
+    memcached_close(st);
+    return 1;
   }
 
-  return status;
-} /* int memcached_query_daemon */
+  return 0;
+} /* int memcached_poll_io */
 
 static void memcached_init_vl(value_list_t *vl, memcached_t const *st) {
   sstrncpy(vl->plugin, "memcached", sizeof(vl->plugin));
@@ -442,36 +492,141 @@ static gauge_t calculate_ratio_percent2(derive_t part1, derive_t part2,
   return 100.0 * (gauge_t)num / (gauge_t)denom;
 }
 
-static int memcached_read(user_data_t *user_data) {
-  char buf[4096];
-  char *fields[3];
-  char *line;
+/*
+ * For an explanation on these fields please refer to
+ * <https://github.com/memcached/memcached/blob/master/doc/protocol.txt>
+ *
+ * Fields with a type are dispatched as they are. Fields with a slot are kept
+ * for the metrics which are computed from several fields after the whole
+ * response has been parsed. Some fields are both.
+ */
+enum {
+  SLOT_NONE = -1,
+  SLOT_RUSAGE_USER,
+  SLOT_RUSAGE_SYSTEM,
+  SLOT_THREADS,
+  SLOT_BYTES,
+  SLOT_LIMIT_MAXBYTES,
+  SLOT_CMD_GET,
+  SLOT_GET_HITS,
+  SLOT_INCR_HITS,
+  SLOT_INCR_MISSES,
+  SLOT_DECR_HITS,
+  SLOT_DECR_MISSES,
+  SLOT_BYTES_READ,
+  SLOT_BYTES_WRITTEN,
+  SLOTS_NUM,
+};
 
-  derive_t bytes_used = 0;
-  derive_t bytes_total = 0;
-  derive_t get_hits = 0;
-  derive_t cmd_get = 0;
-  derive_t incr_hits = 0;
-  derive_t incr_misses = 0;
-  derive_t decr_hits = 0;
-  derive_t decr_misses = 0;
-  derive_t rusage_user = 0;
-  derive_t rusage_syst = 0;
-  derive_t octets_rx = 0;
-  derive_t octets_tx = 0;
-
-  memcached_t *st = user_data->data;
-  prev_t *prev = &st->prev;
+typedef struct {
+  char const *name;
+  int ds_type;
+  char const *type;
+  char const *type_instance;
+  int slot;
+} memcached_field_t;
+
+static memcached_field_t const memcached_fields[] = {
+    /* CPU time consumed by the memcached process */
+    {"rusage_user", DS_TYPE_GAUGE, NULL, NULL, SLOT_RUSAGE_USER},
+    {"rusage_system", DS_TYPE_GAUGE, NULL, NULL, SLOT_RUSAGE_SYSTEM},
+    /* Number of threads of this instance */
+    {"threads", DS_TYPE_GAUGE, NULL, NULL, SLOT_THREADS},
+    /* Number of items stored */
+    {"curr_items", DS_TYPE_GAUGE, "memcached_items", "current", SLOT_NONE},
+    /* Number of secs since the server started */
+    {"uptime", DS_TYPE_GAUGE, "uptime", NULL, SLOT_NONE},
+    /* Number of bytes used and available (total - used) */
+    {"bytes", DS_TYPE_DERIVE, NULL, NULL, SLOT_BYTES},
+    {"limit_maxbytes", DS_TYPE_DERIVE, NULL, NULL, SLOT_LIMIT_MAXBYTES},
+    /* Connections */
+    {"curr_connections", DS_TYPE_GAUGE, "memcached_connections", "current",
+     SLOT_NONE},
+    {"listen_disabled_num", DS_TYPE_DERIVE, "total_events", "listen_disabled",
+     SLOT_NONE},
+    /* Total number of connections opened since the server started running,
+     * reported as connection rate. */
+    {"total_connections", DS_TYPE_DERIVE, "connections", "opened", SLOT_NONE},
+    /* Commands; the other "cmd_" fields are handled by their prefix. */
+    {"cmd_get", DS_TYPE_DERIVE, "memcached_command", "get", SLOT_CMD_GET},
+    /* Increment/Decrement */
+    {"incr_misses", DS_TYPE_DERIVE, "memcached_ops", "incr_misses",
+     SLOT_INCR_MISSES},
+    {"incr_hits", DS_TYPE_DERIVE, "memcached_ops", "incr_hits", SLOT_INCR_HITS},
+    {"decr_misses", DS_TYPE_DERIVE, "memcached_ops", "decr_misses",
+     SLOT_DECR_MISSES},
+    {"decr_hits", DS_TYPE_DERIVE, "memcached_ops", "decr_hits", SLOT_DECR_HITS},
+    /* Operations on the cache: get hits/misses, delete hits/misses and
+     * evictions */
+    {"get_hits", DS_TYPE_DERIVE, "memcached_ops", "hits", SLOT_GET_HITS},
+    {"get_misses", DS_TYPE_DERIVE, "memcached_ops", "misses", SLOT_NONE},
+    {"evictions", DS_TYPE_DERIVE, "memcached_ops", "evictions", SLOT_NONE},
+    {"delete_hits", DS_TYPE_DERIVE, "memcached_ops", "delete_hits", SLOT_NONE},
+    {"delete_misses", DS_TYPE_DERIVE, "memcached_ops", "delete_misses",
+     SLOT_NONE},
+    /* Network traffic */
+    {"bytes_read", DS_TYPE_DERIVE, NULL, NULL, SLOT_BYTES_READ},
+    {"bytes_written", DS_TYPE_DERIVE, NULL, NULL, SLOT_BYTES_WRITTEN},
+};
 
-  /* get data from daemon */
-  if (memcached_query_daemon(buf, sizeof(buf), st) < 0) {
-    return -1;
+/* Maps the field names to their entries in memcached_fields, built once by
+ * the init callback. */
+static c_hashtable_t *fields_table;
+
+typedef struct {
+  value_t values[SLOTS_NUM];
+  bool have[SLOTS_NUM];
+} memcached_slots_t;
+
+/* 64 bit FNV-1a */
+static uint64_t memcached_hash(char const *str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *str != 0; str++) {
+    hash ^= (uint64_t)(unsigned char)*str;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static int memcached_fields_init(void) {
+  if (fields_table != NULL)
+    return 0;
+
+  fields_table = c_hashtable_create();
+  if (fields_table == NULL) {
+    ERROR("memcached plugin: c_hashtable_create failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(memcached_fields); i++) {
+    memcached_field_t const *f = memcached_fields + i;
+    int status = c_hashtable_insert(fields_table, memcached_hash(f->name),
+                                    f->name, (void *)f);
+    if (status != 0) {
+      ERROR("memcached plugin: c_hashtable_insert(%s) failed.", f->name);
+      return (status < 0) ? ENOMEM : EINVAL;
+    }
   }
 
-#define FIELD_IS(cnst)                                                         \
-  (((sizeof(cnst) - 1) == name_len) && (strcmp(cnst, fields[1]) == 0))
+  return 0;
+} /* int memcached_fields_init */
+
+static memcached_field_t const *memcached_field_get(char const *name) {
+  memcached_field_t *f = NULL;
+  if (c_hashtable_get(fields_table, memcached_hash(name), name, (void *)&f) !=
+      0)
+    return NULL;
+  return f;
+}
+
+/* Dispatches the fields of a "stats" response which can be dispatched as
+ * they are and stores the others in "slots". Modifies "buffer". */
+static void memcached_parse_stats(memcached_t *st, char *buffer,
+                                  memcached_slots_t *slots) {
+  char *fields[3];
+  char *line;
 
-  char *ptr = buf;
+  char *ptr = buffer;
   char *saveptr = NULL;
   while ((line = strtok_r(ptr, "\n\r", &saveptr)) != NULL) {
     ptr = NULL;
@@ -479,142 +634,71 @@ static int memcached_read(user_data_t *user_data) {
     if (strsplit(line, fields, 3) != 3)
       continue;
 
-    size_t name_len = strlen(fields[1]);
-    if (name_len == 0)
+    memcached_field_t const *f = memcached_field_get(fields[1]);
+    if (f == NULL) {
+      if ((strncmp(fields[1], "cmd_", 4) == 0) && (fields[1][4] != 0))
+        submit_derive("memcached_command", fields[1] + 4, atoll(fields[2]),
+                      st);
       continue;
-
-    /*
-     * For an explanation on these fields please refer to
-     * <https://github.com/memcached/memcached/blob/master/doc/protocol.txt>
-     */
-
-    /*
-     * CPU time consumed by the memcached process
-     */
-    if (FIELD_IS("rusage_user")) {
-      /* Convert to useconds */
-      rusage_user = atof(fields[2]) * 1000000;
-    } else if (FIELD_IS("rusage_system")) {
-      rusage_syst = atof(fields[2]) * 1000000;
-    }
-
-    /*
-     * Number of threads of this instance
-     */
-    else if (FIELD_IS("threads")) {
-      submit_gauge2("ps_count", NULL, NAN, atof(fields[2]), st);
-    }
-
-    /*
-     * Number of items stored
-     */
-    else if (FIELD_IS("curr_items")) {
-      submit_gauge("memcached_items", "current", atof(fields[2]), st);
     }
 
-    /*
-     * Number of secs since the server started
-     */
-    else if (FIELD_IS("uptime")) {
-      submit_gauge("uptime", NULL, atof(fields[2]), st);
+    value_t value;
+    if (f->ds_type == DS_TYPE_GAUGE)
+      value.gauge = atof(fields[2]);
+    else
+      value.derive = atoll(fields[2]);
+
+    if (f->type != NULL) {
+      if (f->ds_type == DS_TYPE_GAUGE)
+        submit_gauge(f->type, f->type_instance, value.gauge, st);
+      else
+        submit_derive(f->type, f->type_instance, value.derive, st);
     }
 
-    /*
-     * Number of bytes used and available (total - used)
-     */
-    else if (FIELD_IS("bytes")) {
-      bytes_used = atoll(fields[2]);
-    } else if (FIELD_IS("limit_maxbytes")) {
-      bytes_total = atoll(fields[2]);
-    }
-
-    /*
-     * Connections
-     */
-    else if (FIELD_IS("curr_connections")) {
-      submit_gauge("memcached_connections", "current", atof(fields[2]), st);
-    } else if (FIELD_IS("listen_disabled_num")) {
-      submit_derive("total_events", "listen_disabled", atoll(fields[2]), st);
-    }
-    /*
-     * Total number of connections opened since the server started running
-     * Report this as connection rate.
-     */
-    else if (FIELD_IS("total_connections")) {
-      submit_derive("connections", "opened", atoll(fields[2]), st);
+    if (f->slot != SLOT_NONE) {
+      slots->values[f->slot] = value;
+      slots->have[f->slot] = true;
     }
+  } /* while ((line = strtok_r (ptr, "\n\r", &saveptr)) != NULL) */
+} /* void memcached_parse_stats */
 
-    /*
-     * Commands
-     */
-    else if ((name_len > 4) && (strncmp(fields[1], "cmd_", 4) == 0)) {
-      const char *name = fields[1] + 4;
-      submit_derive("memcached_command", name, atoll(fields[2]), st);
-      if (strcmp(name, "get") == 0)
-        cmd_get = atoll(fields[2]);
-    }
+static void memcached_submit_stats(memcached_t *st) {
+  memcached_slots_t slots = {0};
+  prev_t *prev = &st->prev;
 
-    /*
-     * Increment/Decrement
-     */
-    else if (FIELD_IS("incr_misses")) {
-      incr_misses = atoll(fields[2]);
-      submit_derive("memcached_ops", "incr_misses", incr_misses, st);
-    } else if (FIELD_IS("incr_hits")) {
-      incr_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "incr_hits", incr_hits, st);
-    } else if (FIELD_IS("decr_misses")) {
-      decr_misses = atoll(fields[2]);
-      submit_derive("memcached_ops", "decr_misses", decr_misses, st);
-    } else if (FIELD_IS("decr_hits")) {
-      decr_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "decr_hits", decr_hits, st);
-    }
+  memcached_parse_stats(st, st->buffer, &slots);
 
-    /*
-     * Operations on the cache:
-     * - get hits/misses
-     * - delete hits/misses
-     * - evictions
-     */
-    else if (FIELD_IS("get_hits")) {
-      get_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "hits", get_hits, st);
-    } else if (FIELD_IS("get_misses")) {
-      submit_derive("memcached_ops", "misses", atoll(fields[2]), st);
-    } else if (FIELD_IS("evictions")) {
-      submit_derive("memcached_ops", "evictions", atoll(fields[2]), st);
-    } else if (FIELD_IS("delete_hits")) {
-      submit_derive("memcached_ops", "delete_hits", atoll(fields[2]), st);
-    } else if (FIELD_IS("delete_misses")) {
-      submit_derive("memcached_ops", "delete_misses", atoll(fields[2]), st);
-    }
+  value_t *v = slots.values;
 
-    /*
-     * Network traffic
-     */
-    else if (FIELD_IS("bytes_read")) {
-      octets_rx = atoll(fields[2]);
-    } else if (FIELD_IS("bytes_written")) {
-      octets_tx = atoll(fields[2]);
-    }
-  } /* while ((line = strtok_r (ptr, "\n\r", &saveptr)) != NULL) */
+  if (slots.have[SLOT_THREADS])
+    submit_gauge2("ps_count", NULL, NAN, v[SLOT_THREADS].gauge, st);
 
+  derive_t bytes_used = v[SLOT_BYTES].derive;
+  derive_t bytes_total = v[SLOT_LIMIT_MAXBYTES].derive;
   if ((bytes_total > 0) && (bytes_used <= bytes_total))
     submit_gauge2("df", "cache", bytes_used, bytes_total - bytes_used, st);
 
+  /* Convert to useconds */
+  derive_t rusage_user = v[SLOT_RUSAGE_USER].gauge * 1000000;
+  derive_t rusage_syst = v[SLOT_RUSAGE_SYSTEM].gauge * 1000000;
   if ((rusage_user != 0) || (rusage_syst != 0))
     submit_derive2("ps_cputime", NULL, rusage_user, rusage_syst, st);
 
+  derive_t octets_rx = v[SLOT_BYTES_READ].derive;
+  derive_t octets_tx = v[SLOT_BYTES_WRITTEN].derive;
   if ((octets_rx != 0) || (octets_tx != 0))
     submit_derive2("memcached_octets", NULL, octets_rx, octets_tx, st);
 
+  derive_t cmd_get = v[SLOT_CMD_GET].derive;
+  derive_t get_hits = v[SLOT_GET_HITS].derive;
   if ((cmd_get != 0) && (get_hits != 0)) {
     gauge_t ratio =
         calculate_ratio_percent(get_hits, cmd_get, &prev->hits, &prev->gets);
     submit_gauge("percent", "hitratio", ratio, st);
   }
 
+  derive_t incr_hits = v[SLOT_INCR_HITS].derive;
+  derive_t incr_misses = v[SLOT_INCR_MISSES].derive;
   if ((incr_hits != 0) && (incr_misses != 0)) {
     gauge_t ratio = calculate_ratio_percent2(
         incr_hits, incr_misses, &prev->incr_hits, &prev->incr_misses);
@@ -622,13 +706,117 @@ static int memcached_read(user_data_t *user_data) {
     submit_derive("memcached_ops", "incr", incr_hits + incr_misses, st);
   }
 
+  derive_t decr_hits = v[SLOT_DECR_HITS].derive;
+  derive_t decr_misses = v[SLOT_DECR_MISSES].derive;
   if ((decr_hits != 0) && (decr_misses != 0)) {
     gauge_t ratio = calculate_ratio_percent2(
         decr_hits, decr_misses, &prev->decr_hits, &prev->decr_misses);
     submit_gauge("percent", "decr_hitratio", ratio, st);
     submit_derive("memcached_ops", "decr", decr_hits + decr_misses, st);
   }
+} /* void memcached_submit_stats */
+
+static void memcached_poll_failed(memcached_t *st, cdtime_t now) {
+  memcached_close(st);
+
+  cdtime_t interval = plugin_get_interval();
+  if (st->backoff == 0)
+    st->backoff = interval;
+  else if (st->backoff < MEMCACHED_MAX_BACKOFF * interval)
+    st->backoff *= 2;
+  st->next_connect = now + st->backoff;
+}
+
+static int memcached_read(__attribute__((unused)) user_data_t *user_data) {
+  size_t polling_num = 0;
+
+  struct pollfd *fds = calloc(instances_num, sizeof(*fds));
+  memcached_t **fds_st = calloc(instances_num, sizeof(*fds_st));
+  if ((fds == NULL) || (fds_st == NULL)) {
+    ERROR("memcached plugin: calloc failed.");
+    sfree(fds);
+    sfree(fds_st);
+    return ENOMEM;
+  }
 
+  cdtime_t now = cdtime();
+  for (size_t i = 0; i < instances_num; i++) {
+    memcached_t *st = instances[i];
+
+    int status = memcached_poll_start(st, now);
+    st->polling = (status == 0);
+    if (st->polling)
+      polling_num++;
+    else if (status != EAGAIN)
+      memcached_poll_failed(st, now);
+  }
+
+  while (polling_num > 0) {
+    size_t fds_num = 0;
+    cdtime_t deadline = 0;
+
+    for (size_t i = 0; i < instances_num; i++) {
+      memcached_t *st = instances[i];
+      if (!st->polling)
+        continue;
+
+      bool want_write = st->connecting || (st->sent < strlen("stats\r\n"));
+      fds[fds_num] = (struct pollfd){
+          .fd = st->fd,
+          .events = want_write ? POLLOUT : POLLIN,
+      };
+      fds_st[fds_num] = st;
+      fds_num++;
+
+      if ((deadline == 0) || (st->deadline < deadline))
+        deadline = st->deadline;
+    }
+
+    now = cdtime();
+    int timeout = (deadline > now) ? (int)CDTIME_T_TO_MS(deadline - now) : 0;
+
+    int status = poll(fds, (nfds_t)fds_num, timeout);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("memcached plugin: poll(2) failed: %s", STRERRNO);
+      for (size_t i = 0; i < fds_num; i++) {
+        memcached_close(fds_st[i]);
+        fds_st[i]->polling = false;
+      }
+      break;
+    }
+
+    now = cdtime();
+    for (size_t i = 0; i < fds_num; i++) {
+      memcached_t *st = fds_st[i];
+
+      status = 0;
+      if (fds[i].revents != 0)
+        status = memcached_poll_io(st, fds[i].revents, now);
+
+      if (status > 0) {
+        memcached_submit_stats(st);
+        st->backoff = 0;
+      } else if (status < 0) {
+        memcached_poll_failed(st, now);
+      } else if (st->deadline <= now) {
+        ERROR("memcached plugin: Instance \"%s\": Timeout %s", st->name,
+              st->connecting ? "connecting to daemon" : "reading from socket");
+        memcached_poll_failed(st, now);
+      } else
+        continue;
+
+      st->polling = false;
+      polling_num--;
+    }
+  }
+
+  sfree(fds);
+  sfree(fds_st);
+
+  /* Failing instances back off on their own, so the read callback itself is
+   * not suspended. */
   return 0;
 } /* int memcached_read */
 
@@ -679,27 +867,25 @@ static int memcached_set_defaults(memcached_t *st) {
   return 0;
 } /* int memcached_set_defaults */
 
-static int memcached_add_read_callback(memcached_t *st) {
-  char callback_name[3 * DATA_MAX_NAME_LEN];
-
+static int memcached_add_instance(memcached_t *st) {
   if (memcached_set_defaults(st) != 0) {
     memcached_free(st);
     return -1;
   }
 
-  snprintf(callback_name, sizeof(callback_name), "memcached/%s",
-           (st->name != NULL) ? st->name : "__legacy__");
+  memcached_t **tmp =
+      realloc(instances, (instances_num + 1) * sizeof(*instances));
+  if (tmp == NULL) {
+    ERROR("memcached plugin: realloc failed.");
+    memcached_free(st);
+    return ENOMEM;
+  }
+  instances = tmp;
+  instances[instances_num] = st;
+  instances_num++;
 
-  return plugin_register_complex_read(
-      /* group = */ "memcached",
-      /* name      = */ callback_name,
-      /* callback  = */ memcached_read,
-      /* interval  = */ 0,
-      &(user_data_t){
-          .data = st,
-          .free_func = memcached_free,
-      });
-} /* int memcached_add_read_callback */
+  return 0;
+} /* int memcached_add_instance */
 
 /* Configuration handling functiions
  * <Plugin memcached>
@@ -713,9 +899,6 @@ static int memcached_add_read_callback(memcached_t *st) {
 static int config_add_instance(oconfig_item_t *ci) {
   int status = 0;
 
-  /* Disable automatic generation of default instance in the init callback. */
-  memcached_have_instances = true;
-
   memcached_t *st = calloc(1, sizeof(*st));
   if (st == NULL) {
     ERROR("memcached plugin: calloc failed.");
@@ -763,7 +946,7 @@ static int config_add_instance(oconfig_item_t *ci) {
     return -1;
   }
 
-  return memcached_add_read_callback(st);
+  return memcached_add_instance(st);
 } /* int config_add_instance */
 
 static int memcached_config(oconfig_item_t *ci) {
@@ -791,30 +974,51 @@ static int memcached_config(oconfig_item_t *ci) {
 } /* int memcached_config */
 
 static int memcached_init(void) {
+  int status = memcached_fields_init();
+  if (status != 0)
+    return status;
 
-  if (memcached_have_instances)
-    return 0;
-
-  /* No instances were configured, lets start a default instance. */
-  memcached_t *st = calloc(1, sizeof(*st));
-  if (st == NULL)
-    return ENOMEM;
-  st->name = NULL;
-  st->host = NULL;
-  st->socket = NULL;
-  st->connhost = NULL;
-  st->connport = NULL;
+  if (instances_num == 0) {
+    /* No instances were configured, lets start a default instance. */
+    memcached_t *st = calloc(1, sizeof(*st));
+    if (st == NULL)
+      return ENOMEM;
+    st->name = NULL;
+    st->host = NULL;
+    st->socket = NULL;
+    st->connhost = NULL;
+    st->connport = NULL;
 
-  st->fd = -1;
+    st->fd = -1;
 
-  int status = memcached_add_read_callback(st);
-  if (status == 0)
-    memcached_have_instances = true;
+    status = memcached_add_instance(st);
+    if (status != 0)
+      return status;
+  }
 
-  return status;
+  return plugin_register_complex_read(/* group = */ "memcached",
+                                      /* name      = */ "memcached",
+                                      /* callback  = */ memcached_read,
+                                      /* interval  = */ 0,
+                                      /* user_data = */ NULL);
 } /* int memcached_init */
 
+static int memcached_shutdown(void) {
+  for (size_t i = 0; i < instances_num; i++)
+    memcached_free(instances[i]);
+  sfree(instances);
+  instances_num = 0;
+
+  if (fields_table != NULL) {
+    c_hashtable_destroy(fields_table);
+    fields_table = NULL;
+  }
+
+  return 0;
+} /* int memcached_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("memcached", memcached_config);
   plugin_register_init("memcached", memcached_init);
+  plugin_register_shutdown("memcached", memcached_shutdown);
 }
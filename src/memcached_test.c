@@ -0,0 +1,76 @@
+/**
+ * collectd - src/memcached_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ **/
+
+#include "memcached.c" /* sic */
+#include "testing.h"
+
+DEF_TEST(field_get) {
+  CHECK_ZERO(memcached_fields_init());
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(memcached_fields); i++) {
+    memcached_field_t const *f = memcached_field_get(memcached_fields[i].name);
+    OK(f == memcached_fields + i);
+  }
+
+  OK(memcached_field_get("cmd_set") == NULL);
+  OK(memcached_field_get("byte") == NULL);
+  OK(memcached_field_get("") == NULL);
+
+  return 0;
+}
+
+DEF_TEST(parse_stats) {
+  memcached_t st = {.name = "test", .fd = -1};
+  char buffer[] = "STAT pid 4242\r\n"
+                  "STAT rusage_user 1.500000\r\n"
+                  "STAT threads 4\r\n"
+                  "STAT bytes 100\r\n"
+                  "STAT limit_maxbytes 1000\r\n"
+                  "STAT cmd_get 20\r\n"
+                  "STAT cmd_set 3\r\n"
+                  "STAT get_hits 10\r\n"
+                  "STAT bytes_written 66\r\n"
+                  "END\r\n";
+  memcached_slots_t slots = {0};
+
+  CHECK_ZERO(memcached_fields_init());
+  memcached_parse_stats(&st, buffer, &slots);
+
+  EXPECT_EQ_DOUBLE(1.5, slots.values[SLOT_RUSAGE_USER].gauge);
+  EXPECT_EQ_DOUBLE(4.0, slots.values[SLOT_THREADS].gauge);
+  EXPECT_EQ_INT(100, (int)slots.values[SLOT_BYTES].derive);
+  EXPECT_EQ_INT(1000, (int)slots.values[SLOT_LIMIT_MAXBYTES].derive);
+  EXPECT_EQ_INT(20, (int)slots.values[SLOT_CMD_GET].derive);
+  EXPECT_EQ_INT(10, (int)slots.values[SLOT_GET_HITS].derive);
+  EXPECT_EQ_INT(66, (int)slots.values[SLOT_BYTES_WRITTEN].derive);
+
+  EXPECT_EQ_INT(1, slots.have[SLOT_THREADS]);
+  EXPECT_EQ_INT(0, slots.have[SLOT_RUSAGE_SYSTEM]);
+  EXPECT_EQ_INT(0, slots.have[SLOT_BYTES_READ]);
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(field_get);
+  RUN_TEST(parse_stats);
+
+  memcached_shutdown();
+  END_TEST;
+}
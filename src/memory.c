@@ -27,6 +27,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/proc_file/proc_file.h"
 
 #if (defined(HAVE_SYS_SYSCTL_H) && defined(HAVE_SYSCTLBYNAME)) ||              \
     defined(__OpenBSD__)
@@ -78,7 +79,7 @@ static int pagesize;
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-/* no global variables */
+static proc_file_t *proc_meminfo;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKSTAT
@@ -141,7 +142,13 @@ static int memory_init(void) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif defined(KERNEL_LINUX)
-  /* no init stuff */
+  if (proc_meminfo == NULL) {
+    proc_meminfo = proc_file_create("/proc/meminfo");
+    if (proc_meminfo == NULL) {
+      ERROR("memory plugin: proc_file_create failed.");
+      return -1;
+    }
+  }
   /* #endif KERNEL_LINUX */
 
 #elif defined(HAVE_LIBKSTAT)
@@ -320,8 +327,7 @@ static int memory_read_internal(value_list_t *vl) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
 
   char *fields[8];
   int numfields;
@@ -339,12 +345,12 @@ static int memory_read_internal(value_list_t *vl) {
   gauge_t mem_slab_reclaimable = 0;
   gauge_t mem_slab_unreclaimable = 0;
 
-  if ((fh = fopen("/proc/meminfo", "r")) == NULL) {
-    WARNING("memory: fopen: %s", STRERRNO);
+  if (proc_file_read(proc_meminfo) < 0) {
+    WARNING("memory: reading /proc/meminfo failed: %s", STRERRNO);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while ((buffer = proc_file_next_line(proc_meminfo)) != NULL) {
     gauge_t *val = NULL;
 
     if (strncasecmp(buffer, "MemTotal:", 9) == 0)
@@ -369,15 +375,12 @@ static int memory_read_internal(value_list_t *vl) {
     } else
       continue;
 
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    numfields =
+        (int)proc_file_split(buffer, fields, STATIC_ARRAY_SIZE(fields));
     if (numfields < 2)
       continue;
 
-    *val = 1024.0 * atof(fields[1]);
-  }
-
-  if (fclose(fh)) {
-    WARNING("memory: fclose: %s", STRERRNO);
+    *val = 1024.0 * (gauge_t)proc_atou64(fields[1]);
   }
 
   if (mem_total < (mem_free + mem_buffered + mem_cached + mem_slab_total))
@@ -561,8 +564,19 @@ static int memory_read(void) /* {{{ */
   return memory_read_internal(&vl);
 } /* }}} int memory_read */
 
+#if KERNEL_LINUX
+static int memory_shutdown(void) {
+  proc_file_destroy(proc_meminfo);
+  proc_meminfo = NULL;
+  return 0;
+} /* int memory_shutdown */
+#endif
+
 void module_register(void) {
   plugin_register_complex_config("memory", memory_config);
   plugin_register_init("memory", memory_init);
   plugin_register_read("memory", memory_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("memory", memory_shutdown);
+#endif
 } /* void module_register */
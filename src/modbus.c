@@ -37,6 +37,11 @@
 /* Assume version 2.9.2 */
 #endif
 
+/* Largest number of registers a single read request may ask for. */
+#ifndef MODBUS_MAX_READ_REGISTERS
+#define MODBUS_MAX_READ_REGISTERS 125
+#endif
+
 #ifndef MODBUS_TCP_DEFAULT_PORT
 #ifdef MODBUS_TCP_PORT
 #define MODBUS_TCP_DEFAULT_PORT MODBUS_TCP_PORT
@@ -121,11 +126,32 @@ struct mb_data_s /* {{{ */
   mb_data_t *next;
 }; /* }}} */
 
+/* One read request covering the registers of several adjacent or overlapping
+ * "Data" blocks. */
+struct mb_request_s /* {{{ */
+{
+  mb_mreg_type_t modbus_register_type;
+  int register_base;
+  int registers_num;
+
+  /* Range of mb_slave_t.items covered by this request. */
+  size_t items_first;
+  size_t items_num;
+}; /* }}} */
+typedef struct mb_request_s mb_request_t;
+
 struct mb_slave_s /* {{{ */
 {
   int id;
   char instance[DATA_MAX_NAME_LEN];
   mb_data_t *collect;
+
+  /* The "collect" list sorted by register, and the requests reading it. Built
+   * by mb_plan_requests() on the first read. */
+  mb_data_t **items;
+  size_t items_num;
+  mb_request_t *requests;
+  size_t requests_num;
 }; /* }}} */
 typedef struct mb_slave_s mb_slave_t;
 
@@ -460,56 +486,44 @@ static int mb_init_connection(mb_host_t *host) /* {{{ */
       (vt).absolute = (((absolute_t)(raw)*scale) + shift);                     \
   } while (0)
 
-static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
-                        mb_data_t *data) {
-  uint16_t values[4] = {0};
-  int values_num;
-  const data_set_t *ds;
-  int status = 0;
-
-  if ((host == NULL) || (slave == NULL) || (data == NULL))
-    return EINVAL;
-
-  ds = plugin_get_ds(data->type);
-  if (ds == NULL) {
-    ERROR("Modbus plugin: Type \"%s\" is not defined.", data->type);
-    return -1;
-  }
-
-  if (ds->ds_num != 1) {
-    ERROR("Modbus plugin: The type \"%s\" has %" PRIsz " data sources. "
-          "I can only handle data sets with only one data source.",
-          data->type, ds->ds_num);
-    return -1;
-  }
-
-  if ((ds->ds[0].type != DS_TYPE_GAUGE) &&
-      (data->register_type != REG_TYPE_INT32) &&
-      (data->register_type != REG_TYPE_INT32_CDAB) &&
-      (data->register_type != REG_TYPE_UINT32) &&
-      (data->register_type != REG_TYPE_UINT32_CDAB) &&
-      (data->register_type != REG_TYPE_INT64) &&
-      (data->register_type != REG_TYPE_UINT64)) {
-    NOTICE(
-        "Modbus plugin: The data source of type \"%s\" is %s, not gauge. "
-        "This will most likely result in problems, because the register type "
-        "is not UINT32 or UINT64.",
-        data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
-  }
-
-  if ((data->register_type == REG_TYPE_INT32) ||
-      (data->register_type == REG_TYPE_INT32_CDAB) ||
-      (data->register_type == REG_TYPE_UINT32) ||
-      (data->register_type == REG_TYPE_UINT32_CDAB) ||
-      (data->register_type == REG_TYPE_FLOAT) ||
-      (data->register_type == REG_TYPE_FLOAT_CDAB))
-    values_num = 2;
-  else if ((data->register_type == REG_TYPE_INT64) ||
-           (data->register_type == REG_TYPE_UINT64) ||
-           (data->register_type == REG_TYPE_DOUBLE))
-    values_num = 4;
+static int mb_register_count(mb_register_type_t register_type) /* {{{ */
+{
+  if ((register_type == REG_TYPE_INT32) ||
+      (register_type == REG_TYPE_INT32_CDAB) ||
+      (register_type == REG_TYPE_UINT32) ||
+      (register_type == REG_TYPE_UINT32_CDAB) ||
+      (register_type == REG_TYPE_FLOAT) ||
+      (register_type == REG_TYPE_FLOAT_CDAB))
+    return 2;
+  else if ((register_type == REG_TYPE_INT64) ||
+           (register_type == REG_TYPE_UINT64) ||
+           (register_type == REG_TYPE_DOUBLE))
+    return 4;
   else
-    values_num = 1;
+    return 1;
+} /* }}} int mb_register_count */
+
+static void mb_close_connection(mb_host_t *host) /* {{{ */
+{
+#if LEGACY_LIBMODBUS
+  modbus_close(&host->connection);
+#else
+  if (host->connection == NULL)
+    return;
+  modbus_close(host->connection);
+  modbus_free(host->connection);
+  host->connection = NULL;
+#endif
+  host->is_connected = false;
+} /* }}} void mb_close_connection */
+
+/* Reads "values_num" registers starting at "register_base" into "values",
+ * (re)connecting if necessary. */
+static int mb_read_registers(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                             mb_mreg_type_t modbus_register_type,
+                             int register_base, int values_num,
+                             uint16_t *values) {
+  int status = 0;
 
   if (host->connection == NULL) {
     status = EBADF;
@@ -522,7 +536,10 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
       status = errno;
   }
 
-  if ((status == EBADF) || (status == ENOTSOCK) || (status == ENOTCONN)) {
+  if (status != 0) {
+    if ((status != EBADF) && (status != ENOTSOCK) && (status != ENOTCONN))
+      mb_close_connection(host);
+
     status = mb_init_connection(host);
     if (status != 0) {
       ERROR("Modbus plugin: mb_init_connection (%s/%s) failed. ", host->host,
@@ -531,13 +548,6 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
       host->connection = NULL;
       return -1;
     }
-  } else if (status != 0) {
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
-#endif
   }
 
 #if LEGACY_LIBMODBUS
@@ -554,35 +564,70 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     return -1;
   }
 #endif
-  if (data->modbus_register_type == MREG_INPUT) {
+  if (modbus_register_type == MREG_INPUT) {
     status = modbus_read_input_registers(host->connection,
-                                         /* start_addr = */ data->register_base,
+                                         /* start_addr = */ register_base,
                                          /* num_registers = */ values_num,
                                          /* buffer = */ values);
   } else {
     status = modbus_read_registers(host->connection,
-                                   /* start_addr = */ data->register_base,
+                                   /* start_addr = */ register_base,
                                    /* num_registers = */ values_num,
                                    /* buffer = */ values);
   }
   if (status != values_num) {
+    int err = errno;
     ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
           " status = %i, start_addr = %i, values_num = %i. Giving up.",
-          host->host, host->node, status, data->register_base, values_num);
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
+          host->host, host->node, status, register_base, values_num);
+#ifdef EMBXILADD
+    /* The slave rejected the address range, the connection is fine. */
+    if (err == EMBXILADD)
+      return EMBXILADD;
 #endif
-    host->connection = NULL;
-    return -1;
+    mb_close_connection(host);
+    return (err != 0) ? err : -1;
   }
 
-  DEBUG("Modbus plugin: mb_read_data: Success! "
+  DEBUG("Modbus plugin: mb_read_registers: Success! "
         "modbus_read_registers returned with status %i.",
         status);
 
+  return 0;
+} /* }}} int mb_read_registers */
+
+/* Converts the registers of "data" and dispatches the value. */
+static int mb_submit_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                          mb_data_t *data, uint16_t const *values) {
+  const data_set_t *ds;
+
+  ds = plugin_get_ds(data->type);
+  if (ds == NULL) {
+    ERROR("Modbus plugin: Type \"%s\" is not defined.", data->type);
+    return -1;
+  }
+
+  if (ds->ds_num != 1) {
+    ERROR("Modbus plugin: The type \"%s\" has %" PRIsz " data sources. "
+          "I can only handle data sets with only one data source.",
+          data->type, ds->ds_num);
+    return -1;
+  }
+
+  if ((ds->ds[0].type != DS_TYPE_GAUGE) &&
+      (data->register_type != REG_TYPE_INT32) &&
+      (data->register_type != REG_TYPE_INT32_CDAB) &&
+      (data->register_type != REG_TYPE_UINT32) &&
+      (data->register_type != REG_TYPE_UINT32_CDAB) &&
+      (data->register_type != REG_TYPE_INT64) &&
+      (data->register_type != REG_TYPE_UINT64)) {
+    NOTICE(
+        "Modbus plugin: The data source of type \"%s\" is %s, not gauge. "
+        "This will most likely result in problems, because the register type "
+        "is not UINT32 or UINT64.",
+        data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
+  }
+
   if (data->register_type == REG_TYPE_FLOAT) {
     float float_value;
     value_t vt;
@@ -722,8 +767,93 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   }
 
   return 0;
+} /* }}} int mb_submit_data */
+
+static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                        mb_data_t *data) {
+  uint16_t values[4] = {0};
+
+  if ((host == NULL) || (slave == NULL) || (data == NULL))
+    return EINVAL;
+
+  int status = mb_read_registers(host, slave, data->modbus_register_type,
+                                 data->register_base,
+                                 mb_register_count(data->register_type),
+                                 values);
+  if (status != 0)
+    return -1;
+
+  return mb_submit_data(host, slave, data, values);
 } /* }}} int mb_read_data */
 
+static int mb_item_compare(const void *a, const void *b) /* {{{ */
+{
+  const mb_data_t *da = *(mb_data_t *const *)a;
+  const mb_data_t *db = *(mb_data_t *const *)b;
+
+  if (da->modbus_register_type != db->modbus_register_type)
+    return (da->modbus_register_type < db->modbus_register_type) ? -1 : 1;
+  if (da->register_base != db->register_base)
+    return (da->register_base < db->register_base) ? -1 : 1;
+  return 0;
+} /* }}} int mb_item_compare */
+
+/* Sorts the "Data" blocks of a slave by register and merges adjacent or
+ * overlapping ones into as few requests as the size limit allows. */
+static int mb_plan_requests(mb_slave_t *slave) /* {{{ */
+{
+  size_t items_num = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    items_num++;
+
+  if (items_num == 0)
+    return 0;
+
+  slave->items = calloc(items_num, sizeof(*slave->items));
+  slave->requests = calloc(items_num, sizeof(*slave->requests));
+  if ((slave->items == NULL) || (slave->requests == NULL)) {
+    ERROR("Modbus plugin: calloc failed.");
+    sfree(slave->items);
+    sfree(slave->requests);
+    return ENOMEM;
+  }
+
+  size_t i = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    slave->items[i++] = data;
+  qsort(slave->items, items_num, sizeof(*slave->items), mb_item_compare);
+  slave->items_num = items_num;
+
+  mb_request_t *req = NULL;
+  for (i = 0; i < items_num; i++) {
+    mb_data_t *data = slave->items[i];
+    int end = data->register_base + mb_register_count(data->register_type);
+
+    if ((req != NULL) &&
+        (req->modbus_register_type == data->modbus_register_type) &&
+        (data->register_base <= req->register_base + req->registers_num) &&
+        (end - req->register_base <= MODBUS_MAX_READ_REGISTERS)) {
+      if (end > req->register_base + req->registers_num)
+        req->registers_num = end - req->register_base;
+      req->items_num++;
+      continue;
+    }
+
+    req = slave->requests + slave->requests_num;
+    slave->requests_num++;
+    req->modbus_register_type = data->modbus_register_type;
+    req->register_base = data->register_base;
+    req->registers_num = end - data->register_base;
+    req->items_first = i;
+    req->items_num = 1;
+  }
+
+  DEBUG("Modbus plugin: Slave %i: reading %" PRIsz " data blocks with %" PRIsz
+        " requests.",
+        slave->id, slave->items_num, slave->requests_num);
+  return 0;
+} /* }}} int mb_plan_requests */
+
 static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
 {
   int success;
@@ -732,11 +862,38 @@ static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
   if ((host == NULL) || (slave == NULL))
     return EINVAL;
 
+  if ((slave->requests == NULL) && (mb_plan_requests(slave) != 0))
+    return -1;
+
   success = 0;
-  for (mb_data_t *data = slave->collect; data != NULL; data = data->next) {
-    status = mb_read_data(host, slave, data);
-    if (status == 0)
-      success++;
+  for (size_t i = 0; i < slave->requests_num; i++) {
+    mb_request_t *req = slave->requests + i;
+    uint16_t values[MODBUS_MAX_READ_REGISTERS] = {0};
+
+    status = mb_read_registers(host, slave, req->modbus_register_type,
+                               req->register_base, req->registers_num, values);
+#ifdef EMBXILADD
+    /* Fall back to reading the blocks one by one, so that one bad address
+     * doesn't prevent reading the others. */
+    if ((status == EMBXILADD) && (req->items_num > 1)) {
+      for (size_t j = 0; j < req->items_num; j++) {
+        if (mb_read_data(host, slave, slave->items[req->items_first + j]) == 0)
+          success++;
+      }
+      continue;
+    }
+#endif
+    if (status != 0)
+      continue;
+
+    for (size_t j = 0; j < req->items_num; j++) {
+      mb_data_t *data = slave->items[req->items_first + j];
+      status = mb_submit_data(host, slave, data,
+                              values + (data->register_base -
+                                        req->register_base));
+      if (status == 0)
+        success++;
+    }
   }
 
   if (success == 0)
@@ -798,8 +955,11 @@ static void slaves_free_all(mb_slave_t *slaves, size_t slaves_num) /* {{{ */
   if (slaves == NULL)
     return;
 
-  for (size_t i = 0; i < slaves_num; i++)
+  for (size_t i = 0; i < slaves_num; i++) {
     data_free_all(slaves[i].collect);
+    sfree(slaves[i].items);
+    sfree(slaves[i].requests);
+  }
   sfree(slaves);
 } /* }}} void slaves_free_all */
 
@@ -32,8 +32,11 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/lru/lru.h"
 #include "utils_complain.h"
+#include "utils_identity.h"
 
 #include <mosquitto.h>
 
@@ -49,10 +52,43 @@
 #ifndef SSL_VERIFY_PEER
 #define SSL_VERIFY_PEER 1
 #endif
+/* Batched value lists are published below their common topic hierarchy,
+ * "<prefix>/<host>/<plugin>", with this last component. */
+#define MQTT_BATCH_TOPIC_SUFFIX "/_bulk"
+#define MQTT_DEFAULT_BATCH_MAX_SIZE 65536
+
+/* Since libmosquitto 1.0 publishers let the library's network thread
+ * (mosquitto_loop_start()) do the I/O and reconnect. */
+#if LIBMOSQUITTO_MAJOR != 0
+#define MQTT_THREADED_LOOP 1
+#endif
 
 /*
  * Data types
  */
+/* The value lists of one topic hierarchy waiting to be published. */
+struct mqtt_batch_s;
+typedef struct mqtt_batch_s mqtt_batch_t;
+struct mqtt_batch_s {
+  char *topic;
+  char *payload;
+  size_t fill;
+  size_t alloc;
+  int num;
+  cdtime_t first;
+
+  /* Oldest first. */
+  mqtt_batch_t *prev;
+  mqtt_batch_t *next;
+};
+
+/* Topic of a value list, cached by identity. "group_len" is the length of
+ * the topic without the last, "type-type_instance", component. */
+typedef struct {
+  size_t group_len;
+  char topic[];
+} mqtt_topic_t;
+
 struct mqtt_client_conf {
   bool publish;
   char *name;
@@ -76,6 +112,24 @@ struct mqtt_client_conf {
   char *topic_prefix;
   bool store_rates;
   bool retain;
+  int send_queue_limit;
+  c_lru_t *topic_cache;
+  int batch_size;
+  size_t batch_max_size;
+  cdtime_t batch_timeout;
+  c_avl_tree_t *batches;
+  mqtt_batch_t *batches_head;
+  mqtt_batch_t *batches_tail;
+  bool report_stats;
+  derive_t stats_values;
+  derive_t stats_messages;
+  derive_t stats_dropped;
+  derive_t stats_cache_hits;
+  derive_t stats_cache_misses;
+  /* Messages handed to libmosquitto which it has not finished sending yet.
+   * Also updated by the network thread, hence the separate lock. */
+  int outstanding;
+  pthread_mutex_t stats_lock;
 
   /* For subscribing */
   pthread_t thread;
@@ -84,6 +138,7 @@ struct mqtt_client_conf {
   bool clean_session;
 
   c_complain_t complaint_cantpublish;
+  c_complain_t complaint_queue_full;
   pthread_mutex_t lock;
 };
 typedef struct mqtt_client_conf mqtt_client_conf_t;
@@ -135,15 +190,38 @@ static char const *mosquitto_strerror(int code) {
 /* provided by libmosquitto */
 #endif
 
-static void mqtt_free(mqtt_client_conf_t *conf) {
+static void mqtt_batch_free(mqtt_batch_t *b) {
+  if (b == NULL)
+    return;
+
+  sfree(b->topic);
+  sfree(b->payload);
+  sfree(b);
+}
+
+static void mqtt_free(void *arg) {
+  mqtt_client_conf_t *conf = arg;
+
   if (conf == NULL)
     return;
 
   if (conf->connected)
     (void)mosquitto_disconnect(conf->mosq);
+#if MQTT_THREADED_LOOP
+  if (conf->publish && (conf->mosq != NULL))
+    (void)mosquitto_loop_stop(conf->mosq, /* force = */ false);
+#endif
   conf->connected = false;
   (void)mosquitto_destroy(conf->mosq);
 
+  while (conf->batches_head != NULL) {
+    mqtt_batch_t *next = conf->batches_head->next;
+    mqtt_batch_free(conf->batches_head);
+    conf->batches_head = next;
+  }
+  c_avl_destroy(conf->batches);
+  c_lru_destroy(conf->topic_cache);
+
   sfree(conf->host);
   sfree(conf->username);
   sfree(conf->password);
@@ -152,17 +230,18 @@ static void mqtt_free(mqtt_client_conf_t *conf) {
   sfree(conf);
 }
 
-static char *strip_prefix(char *topic) {
+/* Returns the last "components" components of "topic". */
+static char *strip_prefix(char *topic, size_t components) {
   size_t num = 0;
 
   for (size_t i = 0; topic[i] != 0; i++)
     if (topic[i] == '/')
       num++;
 
-  if (num < 2)
+  if (num < components - 1)
     return NULL;
 
-  while (num > 2) {
+  while (num > components - 1) {
     char *tmp = strchr(topic, '/');
     if (tmp == NULL)
       return NULL;
@@ -173,34 +252,18 @@ static char *strip_prefix(char *topic) {
   return topic;
 }
 
-static void on_message(
-#if LIBMOSQUITTO_MAJOR == 0
-#else
-    __attribute__((unused)) struct mosquitto *m,
-#endif
-    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+/* Parses "payload" as the values of the metric called "name" and dispatches
+ * them. */
+static void mqtt_dispatch(char const *name, char *payload) {
   value_list_t vl = VALUE_LIST_INIT;
   data_set_t const *ds;
-  char *topic;
-  char *name;
-  char *payload;
   int status;
 
-  if (msg->payloadlen <= 0) {
-    DEBUG("mqtt plugin: message has empty payload");
-    return;
-  }
-
-  topic = strdup(msg->topic);
-  name = strip_prefix(topic);
-
   status = parse_identifier_vl(name, &vl);
   if (status != 0) {
-    ERROR("mqtt plugin: Unable to parse topic \"%s\".", topic);
-    sfree(topic);
+    ERROR("mqtt plugin: Unable to parse topic \"%s\".", name);
     return;
   }
-  sfree(topic);
 
   ds = plugin_get_ds(vl.type);
   if (ds == NULL) {
@@ -215,27 +278,91 @@ static void on_message(
   }
   vl.values_len = ds->ds_num;
 
-  payload = malloc(msg->payloadlen + 1);
-  if (payload == NULL) {
-    ERROR("mqtt plugin: malloc for payload buffer failed.");
-    sfree(vl.values);
-    return;
-  }
-  memmove(payload, msg->payload, msg->payloadlen);
-  payload[msg->payloadlen] = 0;
-
   DEBUG("mqtt plugin: payload = \"%s\"", payload);
   status = parse_values(payload, &vl, ds);
   if (status != 0) {
     ERROR("mqtt plugin: Unable to parse payload \"%s\".", payload);
-    sfree(payload);
     sfree(vl.values);
     return;
   }
-  sfree(payload);
 
   plugin_dispatch_values(&vl);
   sfree(vl.values);
+} /* void mqtt_dispatch */
+
+/* Batched messages hold one "type-type_instance values" line per value
+ * list; "group" is "host/plugin-plugin_instance". */
+static void mqtt_dispatch_batch(char const *group, char *payload) {
+  char *saveptr = NULL;
+
+  for (char *line = strtok_r(payload, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char name[MQTT_MAX_TOPIC_SIZE];
+    char *values = strchr(line, ' ');
+
+    if (values == NULL) {
+      ERROR("mqtt plugin: Unable to parse batch line \"%s\".", line);
+      continue;
+    }
+    *values = 0;
+    values++;
+
+    int status = ssnprintf(name, sizeof(name), "%s/%s", group, line);
+    if ((status < 0) || ((size_t)status >= sizeof(name))) {
+      ERROR("mqtt plugin: Metric name \"%s/%s\" is too long.", group, line);
+      continue;
+    }
+
+    mqtt_dispatch(name, values);
+  }
+} /* void mqtt_dispatch_batch */
+
+static void on_message(
+#if LIBMOSQUITTO_MAJOR == 0
+#else
+    __attribute__((unused)) struct mosquitto *m,
+#endif
+    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
+  char *topic;
+  char *name;
+  char *payload;
+
+  if (msg->payloadlen <= 0) {
+    DEBUG("mqtt plugin: message has empty payload");
+    return;
+  }
+
+  topic = strdup(msg->topic);
+  payload = malloc(msg->payloadlen + 1);
+  if ((topic == NULL) || (payload == NULL)) {
+    ERROR("mqtt plugin: malloc for payload buffer failed.");
+    sfree(topic);
+    sfree(payload);
+    return;
+  }
+  memmove(payload, msg->payload, msg->payloadlen);
+  payload[msg->payloadlen] = 0;
+
+  size_t topic_len = strlen(topic);
+  size_t suffix_len = strlen(MQTT_BATCH_TOPIC_SUFFIX);
+  if ((topic_len > suffix_len) &&
+      (strcmp(topic + topic_len - suffix_len, MQTT_BATCH_TOPIC_SUFFIX) == 0)) {
+    topic[topic_len - suffix_len] = 0;
+    name = strip_prefix(topic, /* components = */ 2);
+    if (name == NULL)
+      ERROR("mqtt plugin: Unable to parse topic \"%s\".", msg->topic);
+    else
+      mqtt_dispatch_batch(name, payload);
+  } else {
+    name = strip_prefix(topic, /* components = */ 3);
+    if (name == NULL)
+      ERROR("mqtt plugin: Unable to parse topic \"%s\".", msg->topic);
+    else
+      mqtt_dispatch(name, payload);
+  }
+
+  sfree(topic);
+  sfree(payload);
 } /* void on_message */
 
 static int mqtt_subscribe(mqtt_client_conf_t *conf) {
@@ -251,6 +378,48 @@ static int mqtt_subscribe(mqtt_client_conf_t *conf) {
   return 0;
 }
 
+#if MQTT_THREADED_LOOP
+/* The following callbacks are called by the network thread of publishers. */
+static void on_connect(__attribute__((unused)) struct mosquitto *m, void *arg,
+                       int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  if (rc != 0)
+    return;
+
+  INFO("mqtt plugin: Connected to broker \"%s:%d\".", conf->host, conf->port);
+
+  /* Messages with QoS 0 which were not sent before the connection was lost
+   * have been discarded by the library. */
+  if (conf->qos == 0) {
+    pthread_mutex_lock(&conf->stats_lock);
+    conf->outstanding = 0;
+    pthread_mutex_unlock(&conf->stats_lock);
+  }
+}
+
+static void on_disconnect(__attribute__((unused)) struct mosquitto *m,
+                          void *arg, int rc) {
+  mqtt_client_conf_t *conf = arg;
+
+  /* rc is zero if mosquitto_disconnect() was called. */
+  if (rc != 0)
+    WARNING("mqtt plugin: Lost connection to broker \"%s:%d\". "
+            "Reconnecting.",
+            conf->host, conf->port);
+}
+
+static void on_publish(__attribute__((unused)) struct mosquitto *m,
+                       void *arg, __attribute__((unused)) int mid) {
+  mqtt_client_conf_t *conf = arg;
+
+  pthread_mutex_lock(&conf->stats_lock);
+  if (conf->outstanding > 0)
+    conf->outstanding--;
+  pthread_mutex_unlock(&conf->stats_lock);
+}
+#endif /* MQTT_THREADED_LOOP */
+
 /* must hold conf->lock when calling. */
 static int mqtt_reconnect(mqtt_client_conf_t *conf) {
   int status;
@@ -285,8 +454,14 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
   char const *client_id;
   int status;
 
-  if (conf->mosq != NULL)
+  if (conf->mosq != NULL) {
+#if MQTT_THREADED_LOOP
+    /* The network thread reconnects publishers. */
+    if (conf->publish)
+      return 0;
+#endif
     return mqtt_reconnect(conf);
+  }
 
   if (conf->client_id)
     client_id = conf->client_id;
@@ -351,6 +526,14 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
     }
   }
 
+#if MQTT_THREADED_LOOP
+  if (conf->publish) {
+    mosquitto_connect_callback_set(conf->mosq, on_connect);
+    mosquitto_disconnect_callback_set(conf->mosq, on_disconnect);
+    mosquitto_publish_callback_set(conf->mosq, on_publish);
+  }
+#endif
+
 #if LIBMOSQUITTO_MAJOR == 0
   status = mosquitto_connect(conf->mosq, conf->host, conf->port,
                              /* keepalive = */ MQTT_KEEPALIVE,
@@ -368,6 +551,20 @@ static int mqtt_connect(mqtt_client_conf_t *conf) {
     return -1;
   }
 
+#if MQTT_THREADED_LOOP
+  if (conf->publish) {
+    status = mosquitto_loop_start(conf->mosq);
+    if (status != MOSQ_ERR_SUCCESS) {
+      ERROR("mqtt plugin: mosquitto_loop_start failed: %s",
+            mosquitto_strerror(status));
+      mosquitto_disconnect(conf->mosq);
+      mosquitto_destroy(conf->mosq);
+      conf->mosq = NULL;
+      return -1;
+    }
+  }
+#endif
+
   if (!conf->publish) {
     mosquitto_message_callback_set(conf->mosq, on_message);
 
@@ -423,19 +620,38 @@ static void *subscribers_thread(void *arg) {
   pthread_exit(0);
 } /* void *subscribers_thread */
 
-static int publish(mqtt_client_conf_t *conf, char const *topic,
-                   void const *payload, size_t payload_len) {
+/* must hold conf->lock when calling. */
+static int publish_locked(mqtt_client_conf_t *conf, char const *topic,
+                          void const *payload, size_t payload_len) {
   int status;
 
-  pthread_mutex_lock(&conf->lock);
-
   status = mqtt_connect(conf);
   if (status != 0) {
-    pthread_mutex_unlock(&conf->lock);
     ERROR("mqtt plugin: unable to reconnect to broker");
     return status;
   }
 
+#if MQTT_THREADED_LOOP
+  pthread_mutex_lock(&conf->stats_lock);
+  bool queue_full = (conf->send_queue_limit > 0) &&
+                    (conf->outstanding >= conf->send_queue_limit);
+  if (!queue_full)
+    conf->outstanding++;
+  pthread_mutex_unlock(&conf->stats_lock);
+
+  if (queue_full) {
+    conf->stats_dropped++;
+    c_complain(LOG_WARNING, &conf->complaint_queue_full,
+               "mqtt plugin: %d messages to \"%s:%d\" are still being sent. "
+               "Dropping new messages.",
+               conf->send_queue_limit, conf->host, conf->port);
+    return -1;
+  }
+  c_release(LOG_INFO, &conf->complaint_queue_full,
+            "mqtt plugin: Send queue to \"%s:%d\" has room again.",
+            conf->host, conf->port);
+#endif
+
   status = mosquitto_publish(conf->mosq, /* message_id */ NULL, topic,
 #if LIBMOSQUITTO_MAJOR == 0
                              (uint32_t)payload_len, payload,
@@ -448,24 +664,25 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
                "mqtt plugin: mosquitto_publish failed: %s",
                (status == MOSQ_ERR_ERRNO) ? STRERRNO
                                           : mosquitto_strerror(status));
+    conf->stats_dropped++;
+#if MQTT_THREADED_LOOP
+    /* The network thread takes care of reconnecting. */
+    pthread_mutex_lock(&conf->stats_lock);
+    conf->outstanding--;
+    pthread_mutex_unlock(&conf->stats_lock);
+#else
     /* Mark our connection "down" regardless of the error as a safety
      * measure; we will try to reconnect the next time we have to publish a
      * message */
     conf->connected = false;
     mosquitto_disconnect(conf->mosq);
+#endif
 
-    pthread_mutex_unlock(&conf->lock);
     return -1;
   }
 
-#if LIBMOSQUITTO_MAJOR == 0
+#if !MQTT_THREADED_LOOP
   status = mosquitto_loop(conf->mosq, /* timeout = */ 1000 /* ms */);
-#else
-  status = mosquitto_loop(conf->mosq,
-                          /* timeout[ms] = */ 1000,
-                          /* max_packets = */ 1);
-#endif
-
   if (status != MOSQ_ERR_SUCCESS) {
     c_complain(LOG_ERR, &conf->complaint_cantpublish,
                "mqtt plugin: mosquitto_loop failed: %s",
@@ -477,22 +694,36 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
     conf->connected = 0;
     mosquitto_disconnect(conf->mosq);
 
-    pthread_mutex_unlock(&conf->lock);
     return -1;
   }
+#endif
 
-  pthread_mutex_unlock(&conf->lock);
+  c_release(LOG_INFO, &conf->complaint_cantpublish,
+            "mqtt plugin: Publishing to \"%s:%d\" succeeded again.",
+            conf->host, conf->port);
+  conf->stats_messages++;
   return 0;
-} /* int publish */
+} /* int publish_locked */
 
-static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
+/* Formats the topic of "vl" and stores the length of its topic hierarchy,
+ * i.e. without the last component, in "ret_group_len". */
+static int format_topic(char *buf, size_t buf_len, size_t *ret_group_len,
                         value_list_t const *vl, mqtt_client_conf_t *conf) {
   char name[MQTT_MAX_TOPIC_SIZE];
   int status;
   char *c;
 
-  if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0))
-    return FORMAT_VL(buf, buf_len, vl);
+  size_t type_len = strlen(vl->type);
+  if (vl->type_instance[0] != 0)
+    type_len += 1 + strlen(vl->type_instance);
+
+  if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0)) {
+    status = FORMAT_VL(buf, buf_len, vl);
+    if (status != 0)
+      return status;
+    *ret_group_len = strlen(buf) - type_len - 1;
+    return 0;
+  }
 
   status = FORMAT_VL(name, sizeof(name), vl);
   if (status != 0)
@@ -506,13 +737,152 @@ static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
     *c = '_';
   }
 
+  *ret_group_len = strlen(buf) - type_len - 1;
   return 0;
 } /* int format_topic */
 
+/* Like format_topic(), using the topic cache if configured.
+ * must hold conf->lock when calling. */
+static int get_topic_locked(char *buf, size_t buf_len, size_t *ret_group_len,
+                            value_list_t const *vl, mqtt_client_conf_t *conf) {
+  vl_identity_t const *id = NULL;
+  mqtt_topic_t *t = NULL;
+
+  if (conf->topic_cache != NULL)
+    id = plugin_value_list_identity(vl);
+
+  if ((id != NULL) && (c_lru_get(conf->topic_cache, id->id, (void *)&t) == 0)) {
+    conf->stats_cache_hits++;
+    sstrncpy(buf, t->topic, buf_len);
+    *ret_group_len = t->group_len;
+    return 0;
+  }
+
+  int status = format_topic(buf, buf_len, ret_group_len, vl, conf);
+  if ((status != 0) || (id == NULL))
+    return status;
+
+  conf->stats_cache_misses++;
+  size_t len = strlen(buf);
+  t = malloc(sizeof(*t) + len + 1);
+  if (t != NULL) {
+    t->group_len = *ret_group_len;
+    memcpy(t->topic, buf, len + 1);
+    c_lru_put(conf->topic_cache, id->id, t);
+  }
+
+  return 0;
+} /* int get_topic_locked */
+
+/* Publishes and frees a batch.
+ * must hold conf->lock when calling. */
+static int batch_publish_locked(mqtt_client_conf_t *conf, mqtt_batch_t *b) {
+  char topic[MQTT_MAX_TOPIC_SIZE];
+  int status = 0;
+
+  c_avl_remove(conf->batches, b->topic, /* key = */ NULL, /* value = */ NULL);
+  if (b->prev == NULL)
+    conf->batches_head = b->next;
+  else
+    b->prev->next = b->next;
+  if (b->next == NULL)
+    conf->batches_tail = b->prev;
+  else
+    b->next->prev = b->prev;
+
+  if (b->num > 0) {
+    ssnprintf(topic, sizeof(topic), "%s%s", b->topic, MQTT_BATCH_TOPIC_SUFFIX);
+    status = publish_locked(conf, topic, b->payload, b->fill);
+  }
+
+  mqtt_batch_free(b);
+  return status;
+} /* int batch_publish_locked */
+
+/* Publishes the batches that are older than BatchTimeout.
+ * must hold conf->lock when calling. */
+static void batch_publish_stale_locked(mqtt_client_conf_t *conf,
+                                       cdtime_t now) {
+  while ((conf->batches_head != NULL) &&
+         (now >= conf->batches_head->first + conf->batch_timeout))
+    batch_publish_locked(conf, conf->batches_head);
+} /* void batch_publish_stale_locked */
+
+/* Adds a "type-type_instance values" line to the batch of the topic's
+ * hierarchy.
+ * must hold conf->lock when calling. */
+static int batch_add_locked(mqtt_client_conf_t *conf, char *topic,
+                            size_t group_len, char const *values) {
+  mqtt_batch_t *b = NULL;
+
+  topic[group_len] = 0;
+  char const *name = topic + group_len + 1;
+  size_t name_len = strlen(name);
+  size_t values_len = strlen(values);
+  size_t len = name_len + 1 + values_len + 1;
+
+  if ((c_avl_get(conf->batches, topic, (void *)&b) == 0) &&
+      (b->fill + len > conf->batch_max_size)) {
+    batch_publish_locked(conf, b);
+    b = NULL;
+  }
+
+  if (b == NULL) {
+    b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+      ERROR("mqtt plugin: calloc failed.");
+      return ENOMEM;
+    }
+    b->topic = strdup(topic);
+    if ((b->topic == NULL) ||
+        (c_avl_insert(conf->batches, b->topic, b) != 0)) {
+      ERROR("mqtt plugin: Adding batch for \"%s\" failed.", topic);
+      mqtt_batch_free(b);
+      return ENOMEM;
+    }
+    b->first = cdtime();
+
+    b->prev = conf->batches_tail;
+    if (conf->batches_tail == NULL)
+      conf->batches_head = b;
+    else
+      conf->batches_tail->next = b;
+    conf->batches_tail = b;
+  }
+
+  if (b->fill + len > b->alloc) {
+    size_t alloc = conf->batch_max_size;
+    if (alloc < b->fill + len)
+      alloc = b->fill + len;
+
+    char *tmp = realloc(b->payload, alloc);
+    if (tmp == NULL) {
+      ERROR("mqtt plugin: realloc failed.");
+      return ENOMEM;
+    }
+    b->payload = tmp;
+    b->alloc = alloc;
+  }
+
+  /* Not null-terminated; MQTT payloads have an explicit length. */
+  char *line = b->payload + b->fill;
+  memcpy(line, name, name_len);
+  line[name_len] = ' ';
+  memcpy(line + name_len + 1, values, values_len);
+  line[len - 1] = '\n';
+  b->fill += len;
+  b->num++;
+
+  if (b->num >= conf->batch_size)
+    return batch_publish_locked(conf, b);
+  return 0;
+} /* int batch_add_locked */
+
 static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
   mqtt_client_conf_t *conf;
   char topic[MQTT_MAX_TOPIC_SIZE];
+  size_t group_len = 0;
   char payload[MQTT_MAX_MESSAGE_SIZE];
   int status = 0;
 
@@ -520,27 +890,99 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return EINVAL;
   conf = user_data->data;
 
-  status = format_topic(topic, sizeof(topic), ds, vl, conf);
-  if (status != 0) {
-    ERROR("mqtt plugin: format_topic failed with status %d.", status);
-    return status;
-  }
-
   status = format_values(payload, sizeof(payload), ds, vl, conf->store_rates);
   if (status != 0) {
     ERROR("mqtt plugin: format_values failed with status %d.", status);
     return status;
   }
 
-  status = publish(conf, topic, payload, strlen(payload));
+  pthread_mutex_lock(&conf->lock);
+
+  status = get_topic_locked(topic, sizeof(topic), &group_len, vl, conf);
   if (status != 0) {
-    ERROR("mqtt plugin: publish failed: %s", mosquitto_strerror(status));
+    pthread_mutex_unlock(&conf->lock);
+    ERROR("mqtt plugin: format_topic failed with status %d.", status);
     return status;
   }
+  conf->stats_values++;
+
+  if (conf->batch_size > 1) {
+    status = batch_add_locked(conf, topic, group_len, payload);
+    batch_publish_stale_locked(conf, cdtime());
+  } else {
+    status = publish_locked(conf, topic, payload, strlen(payload));
+  }
 
+  pthread_mutex_unlock(&conf->lock);
+
+  /* Failures have been reported by publish_locked(). */
   return status;
 } /* mqtt_write */
 
+static int mqtt_flush(__attribute__((unused)) cdtime_t timeout,
+                      __attribute__((unused)) const char *identifier,
+                      user_data_t *user_data) {
+  mqtt_client_conf_t *conf = user_data->data;
+
+  pthread_mutex_lock(&conf->lock);
+  while (conf->batches_head != NULL)
+    batch_publish_locked(conf, conf->batches_head);
+  pthread_mutex_unlock(&conf->lock);
+
+  return 0;
+} /* mqtt_flush */
+
+static void submit_stats(mqtt_client_conf_t const *conf, char const *type,
+                         char const *type_instance, value_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "mqtt", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, conf->name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* submit_stats */
+
+/* Publishes stale batches and reports the publisher's statistics. */
+static int mqtt_read(user_data_t *user_data) {
+  mqtt_client_conf_t *conf = user_data->data;
+
+  pthread_mutex_lock(&conf->lock);
+  if (conf->batch_size > 1)
+    batch_publish_stale_locked(conf, cdtime());
+  derive_t values = conf->stats_values;
+  derive_t messages = conf->stats_messages;
+  derive_t dropped = conf->stats_dropped;
+  derive_t cache_hits = conf->stats_cache_hits;
+  derive_t cache_misses = conf->stats_cache_misses;
+  pthread_mutex_unlock(&conf->lock);
+
+  pthread_mutex_lock(&conf->stats_lock);
+  int outstanding = conf->outstanding;
+  pthread_mutex_unlock(&conf->stats_lock);
+
+  if (!conf->report_stats)
+    return 0;
+
+  submit_stats(conf, "total_values", "written", (value_t){.derive = values});
+  submit_stats(conf, "total_objects", "published",
+               (value_t){.derive = messages});
+  submit_stats(conf, "total_objects", "dropped", (value_t){.derive = dropped});
+  submit_stats(conf, "queue_length", NULL,
+               (value_t){.gauge = (gauge_t)outstanding});
+  if (conf->topic_cache != NULL) {
+    submit_stats(conf, "cache_result", "hit", (value_t){.derive = cache_hits});
+    submit_stats(conf, "cache_result", "miss",
+                 (value_t){.derive = cache_misses});
+  }
+
+  return 0;
+} /* mqtt_read */
+
 /*
  * <Publish "name">
  *   Host "example.com"
@@ -552,6 +994,12 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
  *   StoreRates true
  *   Retain false
  *   QoS 0
+ *   SendQueueLimit 0
+ *   TopicCacheSize 0
+ *   BatchSize 1
+ *   BatchMaxSize 65536
+ *   BatchTimeout 10
+ *   ReportStats false
  *   CACert "ca.pem"                      Enables TLS if set
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
@@ -583,14 +1031,20 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   conf->qos = 0;
   conf->topic_prefix = strdup(MQTT_DEFAULT_TOPIC_PREFIX);
   conf->store_rates = true;
+  conf->batch_size = 1;
+  conf->batch_max_size = MQTT_DEFAULT_BATCH_MAX_SIZE;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
     mqtt_free(conf);
     return status;
   }
+  pthread_mutex_init(&conf->stats_lock, NULL);
 
   C_COMPLAIN_INIT(&conf->complaint_cantpublish);
+  C_COMPLAIN_INIT(&conf->complaint_queue_full);
+
+  int cache_size = 0;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -621,6 +1075,28 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &conf->store_rates);
     else if (strcasecmp("Retain", child->key) == 0)
       cf_util_get_boolean(child, &conf->retain);
+    else if (strcasecmp("SendQueueLimit", child->key) == 0)
+      cf_util_get_int(child, &conf->send_queue_limit);
+    else if (strcasecmp("TopicCacheSize", child->key) == 0)
+      cf_util_get_int(child, &cache_size);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 1))
+        ERROR("mqtt plugin: \"BatchSize\" must be a positive number.");
+      else
+        conf->batch_size = tmp;
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 1024))
+        ERROR("mqtt plugin: \"BatchMaxSize\" must be at least 1024.");
+      else
+        conf->batch_max_size = (size_t)tmp;
+    } else if (strcasecmp("BatchTimeout", child->key) == 0)
+      cf_util_get_cdtime(child, &conf->batch_timeout);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      cf_util_get_boolean(child, &conf->report_stats);
     else if (strcasecmp("CACert", child->key) == 0)
       cf_util_get_string(child, &conf->cacertificatefile);
     else if (strcasecmp("CertificateFile", child->key) == 0)
@@ -635,11 +1111,53 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
       ERROR("mqtt plugin: Unknown config option: %s", child->key);
   }
 
+#if !MQTT_THREADED_LOOP
+  if (conf->send_queue_limit > 0)
+    WARNING("mqtt plugin: \"SendQueueLimit\" requires libmosquitto 1.0 or "
+            "later and will be ignored.");
+#endif
+
+  if (cache_size > 0) {
+    conf->topic_cache = c_lru_create((size_t)cache_size, free);
+    if (conf->topic_cache == NULL) {
+      ERROR("mqtt plugin: c_lru_create failed.");
+      mqtt_free(conf);
+      return -1;
+    }
+  }
+
+  if (conf->batch_size > 1) {
+    conf->batches =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (conf->batches == NULL) {
+      ERROR("mqtt plugin: c_avl_create failed.");
+      mqtt_free(conf);
+      return -1;
+    }
+    if (conf->batch_timeout == 0)
+      conf->batch_timeout = plugin_get_interval();
+  }
+
   ssnprintf(cb_name, sizeof(cb_name), "mqtt/%s", conf->name);
-  plugin_register_write(cb_name, mqtt_write,
-                        &(user_data_t){
-                            .data = conf,
-                        });
+  status = plugin_register_write(cb_name, mqtt_write,
+                                 &(user_data_t){
+                                     .data = conf,
+                                     .free_func = mqtt_free,
+                                 });
+  if (status != 0)
+    return status;
+
+  if (conf->batch_size > 1)
+    plugin_register_flush(cb_name, mqtt_flush,
+                          &(user_data_t){
+                              .data = conf,
+                          });
+  if ((conf->batch_size > 1) || conf->report_stats)
+    plugin_register_complex_read(/* group = */ "mqtt", cb_name, mqtt_read,
+                                 /* interval = */ 0,
+                                 &(user_data_t){
+                                     .data = conf,
+                                 });
   return 0;
 } /* mqtt_config_publisher */
 
@@ -24,11 +24,16 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For struct ip_mreq */
+#define _GNU_SOURCE /* For recvmmsg(2) */
 
 #include "collectd.h"
 
 #include "plugin.h"
+#include "probes.h"
 #include "utils/common/common.h"
+#include "utils/latency/latency.h"
+#include "utils/mempool/mempool.h"
+#include "utils/network_parse/network_parse.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_fbhash.h"
@@ -50,6 +55,9 @@
 #if HAVE_NET_IF_H
 #include <net/if.h>
 #endif
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #if HAVE_GCRYPT_H
 #if defined __APPLE__
@@ -71,6 +79,9 @@
 #endif
 #if GCRYPT_VERSION_NUMBER < 0x010600
 GCRY_THREAD_OPTION_PTHREAD_IMPL;
+#else
+/* Authenticated encryption with AES-GCM is available since libgcrypt 1.6. */
+#define NETWORK_HAVE_GCM 1
 #endif
 #endif
 
@@ -108,9 +119,26 @@ struct sockent_client {
   int security_level;
   char *username;
   char *password;
+  int cypher_mode;
   gcry_cipher_hd_t cypher;
+  gcry_md_hd_t hmac;
   unsigned char password_hash[32];
 #endif
+  bool compress;
+  /* Frames not yet written to a TCP connection. */
+  char *stream_buffer;
+  size_t stream_buffer_size;
+  size_t stream_buffer_fill;
+  c_complain_t connect_complaint;
+  c_complain_t drop_complaint;
+#if HAVE_SENDMMSG
+  /* If set, datagrams are collected here instead of being sent right away. */
+  struct send_batch_s *batch;
+#endif
+  /* Sockets sending identical datagrams, see sockent_group_clients(). The
+   * first socket of a group builds the datagram for all of them. */
+  struct sockent *group_first;
+  struct sockent *group_next;
   cdtime_t next_resolve_reconnect;
   cdtime_t resolve_interval;
   struct sockaddr_storage *bind_addr;
@@ -123,7 +151,6 @@ struct sockent_server {
   int security_level;
   char *auth_file;
   fbhash_t *userdb;
-  gcry_cipher_hd_t cypher;
 #endif
 };
 
@@ -135,6 +162,8 @@ typedef struct sockent {
   char *node;
   char *service;
   int interface;
+  /* IPPROTO_UDP or IPPROTO_TCP */
+  int protocol;
 
   union {
     struct sockent_client client;
@@ -252,6 +281,60 @@ struct part_encryption_aes256_s {
 };
 typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +-------------------------------+-------------------------------+
+ * ! Username length               ! Username (variable length)    !
+ * +-------------------------------+-------------------------------+
+ * ! Nonce (Bits   0 -  31)                                        !
+ * : :                                                             :
+ * ! Nonce (Bits  64 -  95)                                        !
+ * +---------------------------------------------------------------+
+ * ! Encrypted payload (variable length)                           !
+ * +---------------------------------------------------------------+
+ * ! Authentication tag (Bits   0 -  31)                           !
+ * : :                                                             :
+ * ! Authentication tag (Bits  96 - 127)                           !
+ * +---------------------------------------------------------------+
+ *
+ * Everything in front of the payload is authenticated, but not encrypted.
+ */
+/* Minimum size */
+#define PART_ENCRYPTION_AES256_GCM_SIZE 34
+struct part_encryption_aes256_gcm_s {
+  part_header_t head;
+  uint16_t username_length;
+  char *username;
+  unsigned char nonce[12];
+  /* <encrypted payload /> */
+  unsigned char tag[16];
+};
+typedef struct part_encryption_aes256_gcm_s part_encryption_aes256_gcm_t;
+
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +-------------------------------+-------------------------------+
+ * ! Algorithm                     ! Uncompressed length           !
+ * +-------------------------------+-------------------------------+
+ * ! Compressed parts (variable length)                            !
+ * +---------------------------------------------------------------+
+ */
+/* Minimum size */
+#define PART_COMPRESSED_SIZE 8
+struct part_compressed_s {
+  part_header_t head;
+  uint16_t algorithm;
+  uint16_t uncompressed_length;
+  /* <compressed parts /> */
+};
+typedef struct part_compressed_s part_compressed_t;
+
+/* Entries are allocated from `receive_pool'; `data' points to the packet
+ * buffer following the entry in the same object. */
 struct receive_list_entry_s {
   char *data;
   int data_len;
@@ -261,62 +344,180 @@ struct receive_list_entry_s {
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Number of datagrams read from a socket with one system call. */
+#define RECEIVE_BATCH_SIZE 64
+
+#if HAVE_RECVMMSG
+typedef struct mmsghdr receive_msg_t;
+#else
+/* Without recvmmsg(2), only one datagram is read at a time. */
+typedef struct {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+} receive_msg_t;
+#endif
+
+/* Frames of a TCP connection are preceded by their length, two bytes in
+ * network byte order, like DNS messages over TCP. */
+#define STREAM_FRAME_HEADER_SIZE 2
+
+/* Default limit for the frames waiting to be written to one TCP connection. */
+#define STREAM_BUFFER_SIZE_DEFAULT 1048576
+
+/* While more packets than this wait for the dispatch threads, no more data is
+ * read from TCP connections. TCP's flow control then slows the senders down
+ * instead of us buffering without bound. */
+#define STREAM_QUEUE_LENGTH_MAX 10000
+
+/* Maximum number of accepted TCP connections. */
+#define STREAM_CONNECTIONS_MAX 1024
+
+typedef struct {
+  int fd;
+  /* The listening socket, used to find the sockent in dispatch_thread. */
+  int listen_fd;
+  struct sockaddr_storage peer;
+  /* Holds one frame, including its header, at most. */
+  char *buffer;
+  size_t buffer_fill;
+} stream_connection_t;
+
 /*
  * Private variables
  */
 static int network_config_ttl;
+/* SO_RCVBUF of the listening sockets; zero keeps the system default. */
+static int network_config_rcvbuf;
 /* Ethernet - (IPv6 + UDP) = 1500 - (40 + 8) = 1452 */
 static size_t network_config_packet_size = 1452;
 static bool network_config_forward;
 static bool network_config_stats;
+/* Forward received data to the sending sockets without decoding it. */
+static bool network_config_relay;
+static bool network_config_relay_aggregate;
 
 static sockent_t *sending_sockets;
 
-static receive_list_entry_t *receive_list_head;
-static receive_list_entry_t *receive_list_tail;
-static pthread_mutex_t receive_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t receive_list_cond = PTHREAD_COND_INITIALIZER;
-static uint64_t receive_list_length;
+static c_mempool_t *receive_pool;
+
+typedef struct {
+  receive_list_entry_t *head;
+  receive_list_entry_t *tail;
+  uint64_t length;
+} receive_list_t;
+
+/* Each dispatch thread parses the packets of one queue. Packets from one
+ * sender always go to the same queue, so they are handled in order. */
+typedef struct {
+  receive_list_t list;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  bool thread_running;
+} receive_queue_t;
+static receive_queue_t *receive_queues;
+static size_t receive_queues_num;
 
 static sockent_t *listen_sockets;
 static struct pollfd *listen_sockets_pollfd;
 static size_t listen_sockets_num;
 
+/* Listening TCP sockets, handled by the stream thread. */
+static int *stream_sockets;
+static size_t stream_sockets_num;
+static pthread_t stream_thread;
+static bool stream_thread_running;
+
+static size_t network_config_receive_threads = 1;
+static size_t network_config_dispatch_threads = 1;
+
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop;
-static int receive_thread_running;
-static pthread_t receive_thread_id;
-static int dispatch_thread_running;
-static pthread_t dispatch_thread_id;
-
-/* Buffer in which to-be-sent network packets are constructed. */
-static char *send_buffer;
-static char *send_buffer_ptr;
-static int send_buffer_fill;
-static cdtime_t send_buffer_last_update;
-static value_list_t send_buffer_vl = VALUE_LIST_INIT;
-static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
-
-/* XXX: These counters are incremented from one place only. The spot in which
- * the values are incremented is either only reachable by one thread (the
- * dispatch thread, for example) or locked by some lock (send_buffer_lock for
- * example). Only if neither is true, the stats_lock is acquired. The counters
- * are always read without holding a lock in the hope that writing 8 bytes to
- * memory is an atomic operation. */
+static pthread_t *receive_threads;
+static size_t receive_threads_num;
+
+/* Buffer in which to-be-sent network packets are constructed. Each thread
+ * calling network_write() has its own buffer, so the write threads don't
+ * contend for a lock. The lock only serializes the owner with network_flush().
+ */
+struct send_buffer_s {
+  char *buffer;
+  char *ptr;
+  int fill;
+  cdtime_t last_update;
+  value_list_t vl;
+  /* Set if the last parts in the buffer were relayed, see network_relay(). */
+  bool relayed;
+  pthread_mutex_t lock;
+  struct send_buffer_s *next;
+};
+typedef struct send_buffer_s send_buffer_t;
+
+/* All send buffers, so they can be flushed by any thread. */
+static send_buffer_t *send_buffers;
+static size_t send_buffers_num;
+/* Bytes in all send buffers, updated with network_stats_add(). */
+static derive_t send_buffers_fill;
+static pthread_mutex_t send_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t send_buffer_key;
+static pthread_once_t send_buffer_once = PTHREAD_ONCE_INIT;
+
+#if HAVE_SENDMMSG
+/* Datagrams sent to one socket with a single sendmmsg(2) call, see
+ * network_flush(). */
+#define SEND_BATCH_SIZE 64
+
+struct send_batch_s {
+  struct mmsghdr msgs[SEND_BATCH_SIZE];
+  struct iovec iovs[SEND_BATCH_SIZE];
+  /* `slots' datagrams of up to `slot_size' bytes, at most SEND_BATCH_SIZE. */
+  char *data;
+  size_t slots;
+  size_t slot_size;
+  size_t num;
+};
+typedef struct send_batch_s send_batch_t;
+#endif
+
+/* XXX: The counters are updated by several threads, see network_stats_add().
+ * The counters are always read without holding a lock in the hope
+ * that writing 8 bytes to memory is an atomic operation. */
 static derive_t stats_octets_rx;
 static derive_t stats_octets_tx;
 static derive_t stats_packets_rx;
 static derive_t stats_packets_tx;
+static derive_t stats_packets_dropped;
 static derive_t stats_values_dispatched;
 static derive_t stats_values_not_dispatched;
 static derive_t stats_values_sent;
 static derive_t stats_values_not_sent;
+#if !HAVE_ATOMIC_BUILTINS
 static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /*
  * Private functions
  */
+static void network_stats_add(derive_t *counter, derive_t n) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&stats_lock);
+  *counter += n;
+  pthread_mutex_unlock(&stats_lock);
+#endif
+} /* }}} void network_stats_add */
+
+/* Listening sockets are assigned to the receive threads round-robin. The
+ * SO_REUSEPORT sockets of one address are consecutive, so each of them is
+ * read by a different thread. */
+static size_t network_receive_thread_of(size_t socket_index) /* {{{ */
+{
+  return socket_index % network_config_receive_threads;
+} /* }}} size_t network_receive_thread_of */
+
 static bool check_receive_okay(const value_list_t *vl) /* {{{ */
 {
   uint64_t time_sent = 0;
@@ -411,13 +612,13 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
           "NOT dispatching %s.",
           name);
 #endif
-    stats_values_not_dispatched++;
+    network_stats_add(&stats_values_not_dispatched, 1);
     return 0;
   }
 
-  assert(vl->meta == NULL);
-
-  vl->meta = meta_data_create();
+  /* The parser attaches meta data for histogram parts. */
+  if (vl->meta == NULL)
+    vl->meta = meta_data_create();
   if (vl->meta == NULL) {
     ERROR("network plugin: meta_data_create failed.");
     return -ENOMEM;
@@ -463,7 +664,7 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
   }
 
   plugin_dispatch_values(vl);
-  stats_values_dispatched++;
+  network_stats_add(&stats_values_dispatched, 1);
 
   meta_data_destroy(vl->meta);
   vl->meta = NULL;
@@ -533,68 +734,182 @@ static int network_init_gcrypt(void) /* {{{ */
   return 0;
 } /* }}} int network_init_gcrypt */
 
-static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
-                                                  const void *iv,
-                                                  size_t iv_size,
-                                                  const char *username) {
+/* Opens `*cypher' with `key' on first use and resets it for subsequent
+ * packets, so the key schedule is only computed once. */
+static gcry_cipher_hd_t network_cypher_prepare(gcry_cipher_hd_t *cypher, /* {{{ */
+                                               int mode,
+                                               const unsigned char *key,
+                                               size_t key_size, const void *iv,
+                                               size_t iv_size) {
   gcry_error_t err;
-  gcry_cipher_hd_t *cyper_ptr;
-  unsigned char password_hash[32];
-
-  if (se->type == SOCKENT_TYPE_CLIENT) {
-    cyper_ptr = &se->data.client.cypher;
-    memcpy(password_hash, se->data.client.password_hash, sizeof(password_hash));
-  } else {
-    char *secret;
-
-    cyper_ptr = &se->data.server.cypher;
-
-    if (username == NULL)
-      return NULL;
 
-    secret = fbh_get(se->data.server.userdb, username);
-    if (secret == NULL)
+  if (*cypher == NULL) {
+    err = gcry_cipher_open(cypher, GCRY_CIPHER_AES256, mode, /* flags = */ 0);
+    if (err != 0) {
+      ERROR("network plugin: gcry_cipher_open returned: %s",
+            gcry_strerror(err));
+      *cypher = NULL;
       return NULL;
+    }
 
-    gcry_md_hash_buffer(GCRY_MD_SHA256, password_hash, secret, strlen(secret));
-
-    sfree(secret);
-  }
-
-  if (*cyper_ptr == NULL) {
-    err = gcry_cipher_open(cyper_ptr, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_OFB,
-                           /* flags = */ 0);
+    err = gcry_cipher_setkey(*cypher, key, key_size);
     if (err != 0) {
-      ERROR("network plugin: gcry_cipher_open returned: %s",
+      ERROR("network plugin: gcry_cipher_setkey returned: %s",
             gcry_strerror(err));
-      *cyper_ptr = NULL;
+      gcry_cipher_close(*cypher);
+      *cypher = NULL;
       return NULL;
     }
   } else {
-    gcry_cipher_reset(*cyper_ptr);
+    gcry_cipher_reset(*cypher);
   }
-  assert(*cyper_ptr != NULL);
+  assert(*cypher != NULL);
 
-  err = gcry_cipher_setkey(*cyper_ptr, password_hash, sizeof(password_hash));
+  err = gcry_cipher_setiv(*cypher, iv, iv_size);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: gcry_cipher_setiv returned: %s",
           gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
+    gcry_cipher_close(*cypher);
+    *cypher = NULL;
     return NULL;
   }
 
-  err = gcry_cipher_setiv(*cyper_ptr, iv, iv_size);
+  return *cypher;
+} /* }}} gcry_cipher_hd_t network_cypher_prepare */
+
+/* Like network_cypher_prepare() for HMAC-SHA-256. */
+static gcry_md_hd_t network_hmac_prepare(gcry_md_hd_t *hmac, /* {{{ */
+                                         const char *secret) {
+  gcry_error_t err;
+
+  if (*hmac != NULL) {
+    gcry_md_reset(*hmac);
+    return *hmac;
+  }
+
+  err = gcry_md_open(hmac, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
           gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
+    *hmac = NULL;
+    return NULL;
+  }
+
+  err = gcry_md_setkey(*hmac, secret, strlen(secret));
+  if (err != 0) {
+    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
+    gcry_md_close(*hmac);
+    *hmac = NULL;
     return NULL;
   }
 
-  return *cyper_ptr;
-} /* }}} int network_get_aes256_cypher */
+  return *hmac;
+} /* }}} gcry_md_hd_t network_hmac_prepare */
+
+/* Number of users whose keys each dispatch thread keeps ready. */
+#define NETWORK_USERS_CACHED 8
+
+/* The keys of a user sending to a listening socket. Several dispatch threads
+ * may handle packets of the same socket, so each thread has its own copy. */
+typedef struct {
+  char *username;
+  char *secret;
+  unsigned char secret_hash[32];
+  gcry_md_hd_t hmac;
+  gcry_cipher_hd_t cypher_ofb;
+  gcry_cipher_hd_t cypher_gcm;
+} network_user_t;
+
+typedef struct {
+  network_user_t users[NETWORK_USERS_CACHED];
+  /* The slot to replace next. */
+  size_t next;
+} network_user_cache_t;
+
+static pthread_key_t user_cache_key;
+static pthread_once_t user_cache_once = PTHREAD_ONCE_INIT;
+
+static void network_user_clear(network_user_t *u) /* {{{ */
+{
+  sfree(u->username);
+  if (u->secret != NULL) {
+    memset(u->secret, 0, strlen(u->secret));
+    sfree(u->secret);
+  }
+  memset(u->secret_hash, 0, sizeof(u->secret_hash));
+  if (u->hmac != NULL)
+    gcry_md_close(u->hmac);
+  if (u->cypher_ofb != NULL)
+    gcry_cipher_close(u->cypher_ofb);
+  if (u->cypher_gcm != NULL)
+    gcry_cipher_close(u->cypher_gcm);
+  *u = (network_user_t){0};
+} /* }}} void network_user_clear */
+
+static void user_cache_destroy(void *arg) /* {{{ */
+{
+  network_user_cache_t *cache = arg;
+
+  for (size_t i = 0; i < NETWORK_USERS_CACHED; i++)
+    network_user_clear(cache->users + i);
+  free(cache);
+} /* }}} void user_cache_destroy */
+
+static void user_cache_key_create(void) /* {{{ */
+{
+  pthread_key_create(&user_cache_key, user_cache_destroy);
+} /* }}} void user_cache_key_create */
+
+/* Returns the calling thread's keys for `username', or NULL if the user is
+ * unknown. The secret is looked up every time, so changes to the AuthFile
+ * replace the cached keys. */
+static network_user_t *network_user_get(sockent_t *se, /* {{{ */
+                                        const char *username) {
+  char *secret = fbh_get(se->data.server.userdb, username);
+  if (secret == NULL)
+    return NULL;
+
+  pthread_once(&user_cache_once, user_cache_key_create);
+  network_user_cache_t *cache = pthread_getspecific(user_cache_key);
+  if (cache == NULL) {
+    cache = calloc(1, sizeof(*cache));
+    if (cache == NULL) {
+      sfree(secret);
+      return NULL;
+    }
+    pthread_setspecific(user_cache_key, cache);
+  }
+
+  network_user_t *u = NULL;
+  for (size_t i = 0; i < NETWORK_USERS_CACHED; i++) {
+    if ((cache->users[i].username != NULL) &&
+        (strcmp(cache->users[i].username, username) == 0)) {
+      u = cache->users + i;
+      break;
+    }
+  }
+
+  if ((u != NULL) && (strcmp(u->secret, secret) == 0)) {
+    sfree(secret);
+    return u;
+  }
+
+  if (u == NULL) {
+    u = cache->users + cache->next;
+    cache->next = (cache->next + 1) % NETWORK_USERS_CACHED;
+  }
+  network_user_clear(u);
+
+  u->username = strdup(username);
+  if (u->username == NULL) {
+    sfree(secret);
+    return NULL;
+  }
+  u->secret = secret;
+  gcry_md_hash_buffer(GCRY_MD_SHA256, u->secret_hash, secret, strlen(secret));
+
+  return u;
+} /* }}} network_user_t *network_user_get */
 #endif /* HAVE_GCRYPT_H */
 
 static int write_part_values(char **ret_buffer, size_t *ret_buffer_len,
@@ -761,242 +1076,15 @@ static int write_part_string(char **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int write_part_string */
 
-static int parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
-                             value_t **ret_values, size_t *ret_num_values) {
-  char *buffer = *ret_buffer;
-  size_t buffer_len = *ret_buffer_len;
-
-  uint16_t tmp16;
-  size_t exp_size;
-
-  uint16_t pkg_length;
-  uint16_t pkg_type;
-  size_t pkg_numval;
-
-  uint8_t *pkg_types;
-  value_t *pkg_values;
-
-  if (buffer_len < 15) {
-    NOTICE("network plugin: packet is too short: "
-           "buffer_len = %" PRIsz,
-           buffer_len);
-    return -1;
-  }
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  pkg_type = ntohs(tmp16);
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  pkg_length = ntohs(tmp16);
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  pkg_numval = (size_t)ntohs(tmp16);
-
-  assert(pkg_type == TYPE_VALUES);
-
-  exp_size =
-      3 * sizeof(uint16_t) + pkg_numval * (sizeof(uint8_t) + sizeof(value_t));
-  if (buffer_len < exp_size) {
-    WARNING("network plugin: parse_part_values: "
-            "Packet too short: "
-            "Chunk of size %" PRIsz " expected, "
-            "but buffer has only %" PRIsz " bytes left.",
-            exp_size, buffer_len);
-    return -1;
-  }
-  assert(pkg_numval <= ((buffer_len - 6) / 9));
-
-  if (pkg_length != exp_size) {
-    WARNING("network plugin: parse_part_values: "
-            "Length and number of values "
-            "in the packet don't match.");
-    return -1;
-  }
-
-  pkg_types = calloc(pkg_numval, sizeof(*pkg_types));
-  pkg_values = calloc(pkg_numval, sizeof(*pkg_values));
-  if ((pkg_types == NULL) || (pkg_values == NULL)) {
-    sfree(pkg_types);
-    sfree(pkg_values);
-    ERROR("network plugin: parse_part_values: calloc failed.");
-    return -1;
-  }
-
-  memcpy(pkg_types, buffer, pkg_numval * sizeof(*pkg_types));
-  buffer += pkg_numval * sizeof(*pkg_types);
-  memcpy(pkg_values, buffer, pkg_numval * sizeof(*pkg_values));
-  buffer += pkg_numval * sizeof(*pkg_values);
-
-  for (size_t i = 0; i < pkg_numval; i++) {
-    switch (pkg_types[i]) {
-    case DS_TYPE_COUNTER:
-      pkg_values[i].counter = (counter_t)ntohll(pkg_values[i].counter);
-      break;
-
-    case DS_TYPE_GAUGE:
-      pkg_values[i].gauge = (gauge_t)ntohd(pkg_values[i].gauge);
-      break;
-
-    case DS_TYPE_DERIVE:
-      pkg_values[i].derive = (derive_t)ntohll(pkg_values[i].derive);
-      break;
-
-    case DS_TYPE_ABSOLUTE:
-      pkg_values[i].absolute = (absolute_t)ntohll(pkg_values[i].absolute);
-      break;
-
-    default:
-      NOTICE("network plugin: parse_part_values: "
-             "Don't know how to handle data source type %" PRIu8,
-             pkg_types[i]);
-      sfree(pkg_types);
-      sfree(pkg_values);
-      return -1;
-    } /* switch (pkg_types[i]) */
-  }
-
-  *ret_buffer = buffer;
-  *ret_buffer_len = buffer_len - pkg_length;
-  *ret_num_values = pkg_numval;
-  *ret_values = pkg_values;
-
-  sfree(pkg_types);
-
-  return 0;
-} /* int parse_part_values */
-
-static int parse_part_number(void **ret_buffer, size_t *ret_buffer_len,
-                             uint64_t *value) {
-  char *buffer = *ret_buffer;
-  size_t buffer_len = *ret_buffer_len;
-
-  uint16_t tmp16;
-  uint64_t tmp64;
-  size_t exp_size = 2 * sizeof(uint16_t) + sizeof(uint64_t);
-
-  uint16_t pkg_length;
-
-  if (buffer_len < exp_size) {
-    WARNING("network plugin: parse_part_number: "
-            "Packet too short: "
-            "Chunk of size %" PRIsz " expected, "
-            "but buffer has only %" PRIsz " bytes left.",
-            exp_size, buffer_len);
-    return -1;
-  }
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  /* pkg_type = ntohs (tmp16); */
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  pkg_length = ntohs(tmp16);
-
-  memcpy((void *)&tmp64, buffer, sizeof(tmp64));
-  buffer += sizeof(tmp64);
-  *value = ntohll(tmp64);
-
-  *ret_buffer = buffer;
-  *ret_buffer_len = buffer_len - pkg_length;
-
-  return 0;
-} /* int parse_part_number */
-
-static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
-                             char *output, size_t const output_len) {
-  char *buffer = *ret_buffer;
-  size_t buffer_len = *ret_buffer_len;
-
-  uint16_t tmp16;
-  size_t const header_size = 2 * sizeof(uint16_t);
-
-  uint16_t pkg_length;
-  size_t payload_size;
-
-  if (output_len == 0)
-    return EINVAL;
-
-  if (buffer_len < header_size) {
-    WARNING("network plugin: parse_part_string: "
-            "Packet too short: "
-            "Chunk of at least size %" PRIsz " expected, "
-            "but buffer has only %" PRIsz " bytes left.",
-            header_size, buffer_len);
-    return -1;
-  }
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  /* pkg_type = ntohs (tmp16); */
-
-  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
-  buffer += sizeof(tmp16);
-  pkg_length = ntohs(tmp16);
-  payload_size = ((size_t)pkg_length) - header_size;
-
-  /* Check that packet fits in the input buffer */
-  if (pkg_length > buffer_len) {
-    WARNING("network plugin: parse_part_string: "
-            "Packet too big: "
-            "Chunk of size %" PRIu16 " received, "
-            "but buffer has only %" PRIsz " bytes left.",
-            pkg_length, buffer_len);
-    return -1;
-  }
-
-  /* Check that pkg_length is in the valid range */
-  if (pkg_length <= header_size) {
-    WARNING("network plugin: parse_part_string: "
-            "Packet too short: "
-            "Header claims this packet is only %hu "
-            "bytes long.",
-            pkg_length);
-    return -1;
-  }
-
-  /* Check that the package data fits into the output buffer.
-   * The previous if-statement ensures that:
-   * `pkg_length > header_size' */
-  if (output_len < payload_size) {
-    WARNING("network plugin: parse_part_string: "
-            "Buffer too small: "
-            "Output buffer holds %" PRIsz " bytes, "
-            "which is too small to hold the received "
-            "%" PRIsz " byte string.",
-            output_len, payload_size);
-    return -1;
-  }
-
-  /* All sanity checks successfull, let's copy the data over */
-  memcpy((void *)output, (void *)buffer, payload_size);
-  buffer += payload_size;
-
-  /* For some very weird reason '\0' doesn't do the trick on SPARC in
-   * this statement. */
-  if (output[payload_size - 1] != 0) {
-    WARNING("network plugin: parse_part_string: "
-            "Received string does not end "
-            "with a NULL-byte.");
-    return -1;
-  }
-
-  *ret_buffer = buffer;
-  *ret_buffer_len = buffer_len - pkg_length;
-
-  return 0;
-} /* int parse_part_string */
-
-/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
- * parse_packet and vice versa. */
+/* Forward declaration: parse_part_sign_sha256, parse_part_encr_aes256 and
+ * parse_part_compressed call parse_packet and vice versa. */
 #define PP_SIGNED 0x01
 #define PP_ENCRYPTED 0x02
+#define PP_COMPRESSED 0x04
 static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
                         int flags, const char *username,
                         struct sockaddr_storage *sender);
+static void network_relay(char *buffer, size_t buffer_size);
 
 #define BUFFER_READ(p, s)                                                      \
   do {                                                                         \
@@ -1015,14 +1103,13 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   size_t buffer_offset;
 
   size_t username_len;
-  char *secret;
+  network_user_t *user;
 
   part_signature_sha256_t pss;
   uint16_t pss_head_length;
   char hash[sizeof(pss.hash)];
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash_ptr;
 
   buffer = *ret_buffer;
@@ -1073,29 +1160,16 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   assert(buffer_offset == pss_head_length);
 
   /* Query the password */
-  secret = fbh_get(se->data.server.userdb, pss.username);
-  if (secret == NULL) {
+  user = network_user_get(se, pss.username);
+  if (user == NULL) {
     ERROR("network plugin: Unknown user: %s", pss.username);
     sfree(pss.username);
     return -ENOENT;
   }
 
-  /* Create a hash device and check the HMAC */
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
-          gcry_strerror(err));
-    sfree(secret);
-    sfree(pss.username);
-    return -1;
-  }
-
-  err = gcry_md_setkey(hd, secret, strlen(secret));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    sfree(secret);
+  /* Reuse the user's hash device and check the HMAC */
+  hd = network_hmac_prepare(&user->hmac, user->secret);
+  if (hd == NULL) {
     sfree(pss.username);
     return -1;
   }
@@ -1105,17 +1179,11 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   hash_ptr = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash_ptr == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    sfree(secret);
     sfree(pss.username);
     return -1;
   }
   memcpy(hash, hash_ptr, sizeof(hash));
 
-  /* Clean up */
-  gcry_md_close(hd);
-  hd = NULL;
-
   if (memcmp(pss.hash, hash, sizeof(pss.hash)) != 0) {
     WARNING("network plugin: Verifying HMAC-SHA-256 signature failed: "
             "Hash mismatch. Username: %s",
@@ -1125,7 +1193,6 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
                  flags | PP_SIGNED, pss.username, sender);
   }
 
-  sfree(secret);
   sfree(pss.username);
 
   *ret_buffer = buffer + buffer_len;
@@ -1241,7 +1308,13 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
   assert(buffer_offset ==
          (username_len + PART_ENCRYPTION_AES256_SIZE - sizeof(pea.hash)));
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv), pea.username);
+  network_user_t *user = network_user_get(se, pea.username);
+  cypher = NULL;
+  if (user != NULL)
+    cypher = network_cypher_prepare(&user->cypher_ofb, GCRY_CIPHER_MODE_OFB,
+                                    user->secret_hash,
+                                    sizeof(user->secret_hash), pea.iv,
+                                    sizeof(pea.iv));
   if (cypher == NULL) {
     ERROR("network plugin: Failed to get cypher. Username: %s", pea.username);
     sfree(pea.username);
@@ -1288,23 +1361,131 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 
   return 0;
 } /* }}} int parse_part_encr_aes256 */
-  /* #endif HAVE_GCRYPT_H */
-
-#else  /* if !HAVE_GCRYPT_H */
-static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
-                                  void **ret_buffer, size_t *ret_buffer_size,
-                                  int flags, struct sockaddr_storage *sender) {
-  static int warning_has_been_printed;
 
-  char *buffer;
-  size_t buffer_size;
+#if NETWORK_HAVE_GCM
+static int parse_part_encr_aes256_gcm(sockent_t *se, /* {{{ */
+                                      void **ret_buffer, size_t *ret_buffer_len,
+                                      int flags,
+                                      struct sockaddr_storage *sender) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t payload_len;
+  size_t part_size;
+  size_t header_size;
   size_t buffer_offset;
+  uint16_t username_len;
+  part_encryption_aes256_gcm_t peg;
 
-  part_header_t ph;
-  size_t ph_length;
+  gcry_cipher_hd_t cypher;
+  gcry_error_t err;
+
+  /* Make sure at least the header if available. */
+  if (buffer_len <= PART_ENCRYPTION_AES256_GCM_SIZE) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding short packet.");
+    return -1;
+  }
 
-  buffer = *ret_buffer;
-  buffer_size = *ret_buffer_size;
+  buffer_offset = 0;
+
+  BUFFER_READ(&peg.head.type, sizeof(peg.head.type));
+  BUFFER_READ(&peg.head.length, sizeof(peg.head.length));
+
+  part_size = ntohs(peg.head.length);
+  if ((part_size <= PART_ENCRYPTION_AES256_GCM_SIZE) ||
+      (part_size > buffer_len)) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid size.");
+    return -1;
+  }
+
+  BUFFER_READ(&username_len, sizeof(username_len));
+  username_len = ntohs(username_len);
+
+  if ((username_len == 0) ||
+      (username_len > (part_size - (PART_ENCRYPTION_AES256_GCM_SIZE + 1)))) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid username length.");
+    return -1;
+  }
+
+  peg.username = malloc(username_len + 1);
+  if (peg.username == NULL)
+    return -ENOMEM;
+  BUFFER_READ(peg.username, username_len);
+  peg.username[username_len] = 0;
+
+  BUFFER_READ(peg.nonce, sizeof(peg.nonce));
+
+  header_size = buffer_offset;
+  assert(header_size ==
+         (username_len + PART_ENCRYPTION_AES256_GCM_SIZE - sizeof(peg.tag)));
+  payload_len = part_size - header_size - sizeof(peg.tag);
+  assert(payload_len > 0);
+
+  network_user_t *user = network_user_get(se, peg.username);
+  cypher = NULL;
+  if (user != NULL)
+    cypher = network_cypher_prepare(&user->cypher_gcm, GCRY_CIPHER_MODE_GCM,
+                                    user->secret_hash,
+                                    sizeof(user->secret_hash), peg.nonce,
+                                    sizeof(peg.nonce));
+  if (cypher == NULL) {
+    ERROR("network plugin: Failed to get cypher. Username: %s", peg.username);
+    sfree(peg.username);
+    return -1;
+  }
+
+  /* The header is authenticated along with the payload. Decrypting and
+   * checking the tag is done in one pass over the data. */
+  err = gcry_cipher_authenticate(cypher, buffer, header_size);
+  if (err == 0)
+    err = gcry_cipher_decrypt(cypher, buffer + header_size, payload_len,
+                              /* in = */ NULL, /* in len = */ 0);
+  if (err != 0) {
+    ERROR("network plugin: gcry_cipher_decrypt returned: %s. Username: %s",
+          gcry_strerror(err), peg.username);
+    sfree(peg.username);
+    return -1;
+  }
+
+  err = gcry_cipher_checktag(cypher, buffer + header_size + payload_len,
+                             sizeof(peg.tag));
+  if (err != 0) {
+    ERROR("network plugin: Authentication tag mismatch. Username: %s",
+          peg.username);
+    sfree(peg.username);
+    return -1;
+  }
+
+  parse_packet(se, buffer + header_size, payload_len, flags | PP_ENCRYPTED,
+               peg.username, sender);
+
+  *ret_buffer = buffer + part_size;
+  *ret_buffer_len = buffer_len - part_size;
+
+  sfree(peg.username);
+
+  return 0;
+} /* }}} int parse_part_encr_aes256_gcm */
+#endif /* NETWORK_HAVE_GCM */
+  /* #endif HAVE_GCRYPT_H */
+
+#else  /* if !HAVE_GCRYPT_H */
+static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
+                                  void **ret_buffer, size_t *ret_buffer_size,
+                                  int flags, struct sockaddr_storage *sender) {
+  static int warning_has_been_printed;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_offset;
+
+  part_header_t ph;
+  size_t ph_length;
+
+  buffer = *ret_buffer;
+  buffer_size = *ret_buffer_size;
   buffer_offset = 0;
 
   /* parse_packet assures this minimum size. */
@@ -1334,16 +1515,135 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 } /* }}} int parse_part_encr_aes256 */
 #endif /* !HAVE_GCRYPT_H */
 
+#if HAVE_ZLIB
+static int parse_part_compressed(sockent_t *se, /* {{{ */
+                                 void **ret_buffer, size_t *ret_buffer_len,
+                                 int flags, const char *username,
+                                 struct sockaddr_storage *sender) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t buffer_offset = 0;
+
+  part_compressed_t pc;
+  uint16_t pc_head_length;
+
+  /* Check if the buffer has enough data for this structure. */
+  if (buffer_len <= PART_COMPRESSED_SIZE)
+    return -ENOMEM;
+
+  BUFFER_READ(&pc.head.type, sizeof(pc.head.type));
+  BUFFER_READ(&pc.head.length, sizeof(pc.head.length));
+  BUFFER_READ(&pc.algorithm, sizeof(pc.algorithm));
+  BUFFER_READ(&pc.uncompressed_length, sizeof(pc.uncompressed_length));
+  pc_head_length = ntohs(pc.head.length);
+  pc.algorithm = ntohs(pc.algorithm);
+  pc.uncompressed_length = ntohs(pc.uncompressed_length);
+
+  if ((pc_head_length <= PART_COMPRESSED_SIZE) ||
+      (pc_head_length > buffer_len) || (pc.uncompressed_length == 0)) {
+    ERROR("network plugin: Compressed part with invalid length received.");
+    return -1;
+  }
+
+  /* Compressed parts within compressed parts are never generated, so don't
+   * let a crafted packet make us recurse. */
+  if (flags & PP_COMPRESSED) {
+    ERROR("network plugin: Nested compressed part received.");
+    return -1;
+  }
+
+  if (pc.algorithm != COMPRESSION_ZLIB) {
+    ERROR("network plugin: Compressed part with unknown algorithm %" PRIu16
+          " received.",
+          pc.algorithm);
+    return -1;
+  }
+
+  char uncompressed[pc.uncompressed_length];
+  uLongf uncompressed_len = (uLongf)sizeof(uncompressed);
+  int status = uncompress((Bytef *)uncompressed, &uncompressed_len,
+                          (Bytef *)buffer + buffer_offset,
+                          (uLong)(pc_head_length - buffer_offset));
+  if ((status != Z_OK) || (uncompressed_len != sizeof(uncompressed))) {
+    ERROR("network plugin: Uncompressing part failed with status %i.",
+          status);
+    return -1;
+  }
+
+  parse_packet(se, uncompressed, sizeof(uncompressed), flags | PP_COMPRESSED,
+               username, sender);
+
+  *ret_buffer = buffer + pc_head_length;
+  *ret_buffer_len = buffer_len - pc_head_length;
+
+  return 0;
+} /* }}} int parse_part_compressed */
+#endif /* HAVE_ZLIB */
+
 #undef BUFFER_READ
 
+/* Checks the framing of the parts in `buffer' without decoding them. Returns
+ * the size of the leading parts that are well-formed and may be relayed as
+ * they are. Signed, encrypted and compressed parts end the relayed data. */
+static size_t network_relay_size(const char *buffer, /* {{{ */
+                                 size_t buffer_size) {
+  size_t offset = 0;
+
+  while ((buffer_size - offset) >= sizeof(part_header_t)) {
+    const char *part = buffer + offset;
+    uint16_t pkg_type;
+    uint16_t pkg_length;
+
+    memcpy(&pkg_type, part, sizeof(pkg_type));
+    memcpy(&pkg_length, part + sizeof(pkg_type), sizeof(pkg_length));
+    pkg_type = ntohs(pkg_type);
+    pkg_length = ntohs(pkg_length);
+
+    if ((pkg_length < sizeof(part_header_t)) ||
+        (pkg_length > (buffer_size - offset)))
+      break;
+
+    if ((pkg_type == TYPE_SIGN_SHA256) || (pkg_type == TYPE_ENCR_AES256) ||
+        (pkg_type == TYPE_ENCR_AES256_GCM) || (pkg_type == TYPE_COMPRESSED))
+      break;
+
+    if (pkg_type == TYPE_VALUES) {
+      uint16_t values_num;
+      if (pkg_length < sizeof(part_header_t) + sizeof(values_num))
+        break;
+      memcpy(&values_num, part + sizeof(part_header_t), sizeof(values_num));
+      values_num = ntohs(values_num);
+      if ((values_num == 0) ||
+          (pkg_length != sizeof(part_header_t) + sizeof(values_num) +
+                             values_num * (sizeof(uint8_t) + sizeof(value_t))))
+        break;
+    } else if ((pkg_type == TYPE_TIME) || (pkg_type == TYPE_TIME_HR) ||
+               (pkg_type == TYPE_INTERVAL) || (pkg_type == TYPE_INTERVAL_HR) ||
+               (pkg_type == TYPE_SEVERITY)) {
+      if (pkg_length != sizeof(part_header_t) + sizeof(uint64_t))
+        break;
+    } else if ((pkg_type == TYPE_HOST) || (pkg_type == TYPE_PLUGIN) ||
+               (pkg_type == TYPE_PLUGIN_INSTANCE) || (pkg_type == TYPE_TYPE) ||
+               (pkg_type == TYPE_TYPE_INSTANCE) || (pkg_type == TYPE_MESSAGE) ||
+               (pkg_type == TYPE_HISTOGRAM)) {
+      /* Strings must be null-terminated, see network_parse_part_string(). */
+      if ((pkg_length == sizeof(part_header_t)) || (part[pkg_length - 1] != 0))
+        break;
+    }
+
+    offset += pkg_length;
+  }
+
+  return offset;
+} /* }}} size_t network_relay_size */
+
 static int parse_packet(sockent_t *se, /* {{{ */
                         void *buffer, size_t buffer_size, int flags,
                         const char *username,
                         struct sockaddr_storage *address) {
   int status;
 
-  value_list_t vl = VALUE_LIST_INIT;
-  notification_t n = {0};
+  network_parse_state_t state = {0};
 
 #if HAVE_GCRYPT_H
   int packet_was_signed = (flags & PP_SIGNED);
@@ -1351,7 +1651,6 @@ static int parse_packet(sockent_t *se, /* {{{ */
   int printed_ignore_warning = 0;
 #endif /* HAVE_GCRYPT_H */
 
-  memset(&vl, '\0', sizeof(vl));
   status = 0;
 
   while ((status == 0) && (0 < buffer_size) &&
@@ -1383,6 +1682,18 @@ static int parse_packet(sockent_t *se, /* {{{ */
         break;
       }
     }
+#if NETWORK_HAVE_GCM
+    else if (pkg_type == TYPE_ENCR_AES256_GCM) {
+      status = parse_part_encr_aes256_gcm(se, &buffer, &buffer_size, flags,
+                                          address);
+      if (status != 0) {
+        ERROR("network plugin: Decrypting AES256-GCM part failed "
+              "with status %i.",
+              status);
+        break;
+      }
+    }
+#endif
 #if HAVE_GCRYPT_H
     else if ((se->data.server.security_level == SECURITY_LEVEL_ENCRYPT) &&
              (packet_was_encrypted == 0)) {
@@ -1420,102 +1731,36 @@ static int parse_packet(sockent_t *se, /* {{{ */
       continue;
     }
 #endif /* HAVE_GCRYPT_H */
-    else if (pkg_type == TYPE_VALUES) {
-      status =
-          parse_part_values(&buffer, &buffer_size, &vl.values, &vl.values_len);
+#if HAVE_ZLIB
+    else if (pkg_type == TYPE_COMPRESSED) {
+      status = parse_part_compressed(se, &buffer, &buffer_size, flags,
+                                     username, address);
       if (status != 0)
         break;
+    }
+#endif
+    else if (network_config_relay &&
+             (network_relay_size(buffer, pkg_length) == pkg_length)) {
+      size_t relay_size = network_relay_size(buffer, buffer_size);
 
-      network_dispatch_values(&vl, username, address);
-
-      sfree(vl.values);
-    } else if (pkg_type == TYPE_TIME) {
-      uint64_t tmp = 0;
-      status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
-        vl.time = TIME_T_TO_CDTIME_T(tmp);
-        n.time = TIME_T_TO_CDTIME_T(tmp);
-      }
-    } else if (pkg_type == TYPE_TIME_HR) {
-      uint64_t tmp = 0;
-      status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
-        vl.time = (cdtime_t)tmp;
-        n.time = (cdtime_t)tmp;
-      }
-    } else if (pkg_type == TYPE_INTERVAL) {
-      uint64_t tmp = 0;
-      status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0)
-        vl.interval = TIME_T_TO_CDTIME_T(tmp);
-    } else if (pkg_type == TYPE_INTERVAL_HR) {
-      uint64_t tmp = 0;
-      status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0)
-        vl.interval = (cdtime_t)tmp;
-    } else if (pkg_type == TYPE_HOST) {
-      status =
-          parse_part_string(&buffer, &buffer_size, vl.host, sizeof(vl.host));
-      if (status == 0)
-        sstrncpy(n.host, vl.host, sizeof(n.host));
-    } else if (pkg_type == TYPE_PLUGIN) {
-      status = parse_part_string(&buffer, &buffer_size, vl.plugin,
-                                 sizeof(vl.plugin));
-      if (status == 0)
-        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
-    } else if (pkg_type == TYPE_PLUGIN_INSTANCE) {
-      status = parse_part_string(&buffer, &buffer_size, vl.plugin_instance,
-                                 sizeof(vl.plugin_instance));
-      if (status == 0)
-        sstrncpy(n.plugin_instance, vl.plugin_instance,
-                 sizeof(n.plugin_instance));
-    } else if (pkg_type == TYPE_TYPE) {
-      status =
-          parse_part_string(&buffer, &buffer_size, vl.type, sizeof(vl.type));
-      if (status == 0)
-        sstrncpy(n.type, vl.type, sizeof(n.type));
-    } else if (pkg_type == TYPE_TYPE_INSTANCE) {
-      status = parse_part_string(&buffer, &buffer_size, vl.type_instance,
-                                 sizeof(vl.type_instance));
-      if (status == 0)
-        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
-    } else if (pkg_type == TYPE_MESSAGE) {
-      status = parse_part_string(&buffer, &buffer_size, n.message,
-                                 sizeof(n.message));
-
-      if (status != 0) {
-        /* do nothing */
-      } else if ((n.severity != NOTIF_FAILURE) &&
-                 (n.severity != NOTIF_WARNING) && (n.severity != NOTIF_OKAY)) {
-        INFO("network plugin: "
-             "Ignoring notification with "
-             "unknown severity %i.",
-             n.severity);
-      } else if (n.time == 0) {
-        INFO("network plugin: "
-             "Ignoring notification with "
-             "time == 0.");
-      } else if (strlen(n.message) == 0) {
-        INFO("network plugin: "
-             "Ignoring notification with "
-             "an empty message.");
-      } else {
-        network_dispatch_notification(&n);
-      }
-    } else if (pkg_type == TYPE_SEVERITY) {
-      uint64_t tmp = 0;
-      status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0)
-        n.severity = (int)tmp;
+      network_relay(buffer, relay_size);
+      buffer = ((char *)buffer) + relay_size;
+      buffer_size -= relay_size;
     } else {
-      DEBUG("network plugin: parse_packet: Unknown part"
-            " type: 0x%04hx",
-            pkg_type);
-      buffer = ((char *)buffer) + pkg_length;
-      buffer_size -= (size_t)pkg_length;
+      status = network_parse_part(&state, &buffer, &buffer_size);
+      if (status == NETWORK_PARSE_VALUES) {
+        network_dispatch_values(&state.vl, username, address);
+        network_parse_state_free(&state);
+        status = 0;
+      } else if (status == NETWORK_PARSE_NOTIFICATION) {
+        network_dispatch_notification(&state.n);
+        status = 0;
+      }
     }
   } /* while (buffer_size > sizeof (part_header_t)) */
 
+  network_parse_state_free(&state);
+
   if (status == 0 && buffer_size > 0)
     WARNING("network plugin: parse_packet: Received truncated "
             "packet, try increasing `MaxPacketSize'");
@@ -1531,11 +1776,14 @@ static void free_sockent_client(struct sockent_client *sec) /* {{{ */
   }
   sfree(sec->addr);
   sfree(sec->bind_addr);
+  sfree(sec->stream_buffer);
 #if HAVE_GCRYPT_H
   sfree(sec->username);
   sfree(sec->password);
   if (sec->cypher != NULL)
     gcry_cipher_close(sec->cypher);
+  if (sec->hmac != NULL)
+    gcry_md_close(sec->hmac);
 #endif
 } /* }}} void free_sockent_client */
 
@@ -1552,8 +1800,6 @@ static void free_sockent_server(struct sockent_server *ses) /* {{{ */
 #if HAVE_GCRYPT_H
   sfree(ses->auth_file);
   fbh_destroy(ses->userdb);
-  if (ses->cypher != NULL)
-    gcry_cipher_close(ses->cypher);
 #endif
 } /* }}} void free_sockent_server */
 
@@ -1750,8 +1996,20 @@ static int network_bind_socket_to_addr(sockent_t *se,
   return 0;
 } /* int network_bind_socket_to_addr */
 
+static bool network_is_multicast(const struct addrinfo *ai) /* {{{ */
+{
+  if (ai->ai_family == AF_INET) {
+    struct sockaddr_in *addr = (struct sockaddr_in *)ai->ai_addr;
+    return IN_MULTICAST(ntohl(addr->sin_addr.s_addr));
+  } else if (ai->ai_family == AF_INET6) {
+    struct sockaddr_in6 *addr = (struct sockaddr_in6 *)ai->ai_addr;
+    return IN6_IS_ADDR_MULTICAST(&addr->sin6_addr);
+  }
+  return false;
+} /* }}} bool network_is_multicast */
+
 static int network_bind_socket(int fd, const struct addrinfo *ai,
-                               const int interface_idx) {
+                               const int interface_idx, bool reuseport) {
 #if KERNEL_SOLARIS
   char loop = 0;
 #else
@@ -1764,6 +2022,43 @@ static int network_bind_socket(int fd, const struct addrinfo *ai,
     return -1;
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel distribute datagrams among the sockets of one address */
+  if (reuseport &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) == -1)) {
+    ERROR("network plugin: setsockopt (reuseport): %s", STRERRNO);
+    return -1;
+  }
+#else
+  (void)reuseport;
+#endif
+
+  if (network_config_rcvbuf > 0) {
+    int rcvbuf = 0;
+    socklen_t rcvbuf_len = sizeof(rcvbuf);
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &network_config_rcvbuf,
+                   sizeof(network_config_rcvbuf)) == -1) {
+      ERROR("network plugin: setsockopt (rcvbuf): %s", STRERRNO);
+      return -1;
+    }
+    /* Linux silently caps the size at net.core.rmem_max and reports twice
+     * the effective value. */
+    if ((getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &rcvbuf_len) == 0) &&
+        (rcvbuf < network_config_rcvbuf))
+      WARNING("network plugin: The receive buffer of socket %i is limited to "
+              "%i bytes instead of %i bytes. You may need to raise the "
+              "system's maximum, e.g. net.core.rmem_max on Linux.",
+              fd, rcvbuf, network_config_rcvbuf);
+  }
+
+#ifdef SO_RXQ_OVFL
+  /* Have the kernel report the number of datagrams dropped by this socket
+   * with every datagram received. */
+  if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &(int){1}, sizeof(int)) == -1)
+    WARNING("network plugin: setsockopt (rxq-ovfl): %s", STRERRNO);
+#endif
+
   DEBUG("fd = %i; calling `bind'", fd);
 
   if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
@@ -1886,6 +2181,7 @@ static sockent_t *sockent_create(int type) /* {{{ */
   se->node = NULL;
   se->service = NULL;
   se->interface = 0;
+  se->protocol = IPPROTO_UDP;
   se->next = NULL;
   pthread_mutex_init(&se->lock, NULL);
 
@@ -1896,7 +2192,6 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.server.security_level = SECURITY_LEVEL_NONE;
     se->data.server.auth_file = NULL;
     se->data.server.userdb = NULL;
-    se->data.server.cypher = NULL;
 #endif
   } else {
     se->data.client.fd = -1;
@@ -1904,11 +2199,14 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.client.bind_addr = NULL;
     se->data.client.resolve_interval = 0;
     se->data.client.next_resolve_reconnect = 0;
+    se->data.client.stream_buffer_size = STREAM_BUFFER_SIZE_DEFAULT;
 #if HAVE_GCRYPT_H
     se->data.client.security_level = SECURITY_LEVEL_NONE;
     se->data.client.username = NULL;
     se->data.client.password = NULL;
+    se->data.client.cypher_mode = GCRY_CIPHER_MODE_OFB;
     se->data.client.cypher = NULL;
+    se->data.client.hmac = NULL;
 #endif
   }
 
@@ -1965,6 +2263,54 @@ static int sockent_init_crypto(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_init_crypto */
 
+/* Returns true if `a' and `b' turn a buffer into the same datagram. With the
+ * random IVs and nonces the datagram differs between calls, but any receiver
+ * knowing the credentials can decrypt and verify it. */
+static bool sockent_client_same_packet(sockent_t *a, sockent_t *b) /* {{{ */
+{
+  struct sockent_client *ca = &a->data.client;
+  struct sockent_client *cb = &b->data.client;
+
+  if (ca->compress != cb->compress)
+    return false;
+#if HAVE_GCRYPT_H
+  if (ca->security_level != cb->security_level)
+    return false;
+  if (ca->security_level == SECURITY_LEVEL_NONE)
+    return true;
+  if ((ca->security_level == SECURITY_LEVEL_ENCRYPT) &&
+      (ca->cypher_mode != cb->cypher_mode))
+    return false;
+  return (strcmp(ca->username, cb->username) == 0) &&
+         (strcmp(ca->password, cb->password) == 0);
+#else
+  return true;
+#endif
+} /* }}} bool sockent_client_same_packet */
+
+/* Groups the servers that are sent the same datagrams, so they are signed or
+ * encrypted only once per group, see network_send_buffer(). */
+static void sockent_group_clients(sockent_t *list) /* {{{ */
+{
+  for (sockent_t *se = list; se != NULL; se = se->next) {
+    se->data.client.group_first = se;
+    se->data.client.group_next = NULL;
+
+    for (sockent_t *first = list; first != se; first = first->next) {
+      if ((first->data.client.group_first != first) ||
+          !sockent_client_same_packet(first, se))
+        continue;
+
+      sockent_t *last = first;
+      while (last->data.client.group_next != NULL)
+        last = last->data.client.group_next;
+      last->data.client.group_next = se;
+      se->data.client.group_first = first;
+      break;
+    }
+  }
+} /* }}} void sockent_group_clients */
+
 static int sockent_client_disconnect(sockent_t *se) /* {{{ */
 {
   struct sockent_client *client;
@@ -1979,6 +2325,9 @@ static int sockent_client_disconnect(sockent_t *se) /* {{{ */
     client->fd = -1;
   }
 
+  /* A partially written frame would corrupt the next connection's stream. */
+  client->stream_buffer_fill = 0;
+
   DEBUG("network plugin: free (se = %p, addr = %p);", (void *)se,
         (void *)client->addr);
   sfree(client->addr);
@@ -2014,10 +2363,11 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
   if (client->fd >= 0 && !reconnect) /* already connected and not stale*/
     return 0;
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG,
+      .ai_protocol = se->protocol,
+      .ai_socktype = (se->protocol == IPPROTO_TCP) ? SOCK_STREAM : SOCK_DGRAM};
 
   status = getaddrinfo(se->node,
                        (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
@@ -2063,6 +2413,22 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
     network_set_interface(se, ai_ptr);
     network_bind_socket_to_addr(se, ai_ptr);
 
+    if (se->protocol == IPPROTO_TCP) {
+      /* Connect in the background; until the connection is established,
+       * frames are kept in the stream buffer. */
+      int flags = fcntl(client->fd, F_GETFL);
+      if ((flags == -1) ||
+          (fcntl(client->fd, F_SETFL, flags | O_NONBLOCK) == -1) ||
+          ((connect(client->fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) != 0) &&
+           (errno != EINPROGRESS))) {
+        c_complain(LOG_ERR, &client->connect_complaint,
+                   "network plugin: Connecting to \"%s\" failed: %s",
+                   se->node, STRERRNO);
+        sockent_client_disconnect(se);
+        continue;
+      }
+    }
+
     /* We don't open more than one write-socket per
      * node/service pair.. */
     break;
@@ -2101,10 +2467,11 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
   DEBUG("network plugin: sockent_server_listen: node = %s; service = %s;", node,
         service);
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
+      .ai_protocol = se->protocol,
+      .ai_socktype = (se->protocol == IPPROTO_TCP) ? SOCK_STREAM : SOCK_DGRAM};
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -2116,32 +2483,59 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    int *tmp;
+    /* With several receive threads, open one socket per thread and let the
+     * kernel pick the socket by hashing the sender's address. Every socket
+     * bound to a multicast group gets a copy of each datagram, though. */
+    size_t sockets_num = 1;
+#ifdef SO_REUSEPORT
+    if (!network_is_multicast(ai_ptr) && (se->protocol == IPPROTO_UDP))
+      sockets_num = network_config_receive_threads;
+#endif
 
-    tmp = realloc(se->data.server.fd,
-                  sizeof(*tmp) * (se->data.server.fd_num + 1));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
+    if ((se->protocol == IPPROTO_TCP) && network_is_multicast(ai_ptr)) {
+      ERROR("network plugin: Cannot listen for TCP connections on the "
+            "multicast address \"%s\".",
+            se->node);
       continue;
     }
-    se->data.server.fd = tmp;
-    tmp = se->data.server.fd + se->data.server.fd_num;
 
-    *tmp = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (*tmp < 0) {
-      ERROR("network plugin: socket(2) failed: %s", STRERRNO);
-      continue;
-    }
+    for (size_t i = 0; i < sockets_num; i++) {
+      int *tmp;
 
-    status = network_bind_socket(*tmp, ai_ptr, se->interface);
-    if (status != 0) {
-      close(*tmp);
-      *tmp = -1;
-      continue;
-    }
+      tmp = realloc(se->data.server.fd,
+                    sizeof(*tmp) * (se->data.server.fd_num + 1));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        continue;
+      }
+      se->data.server.fd = tmp;
+      tmp = se->data.server.fd + se->data.server.fd_num;
+
+      *tmp =
+          socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+      if (*tmp < 0) {
+        ERROR("network plugin: socket(2) failed: %s", STRERRNO);
+        continue;
+      }
+
+      status = network_bind_socket(*tmp, ai_ptr, se->interface,
+                                   /* reuseport = */ sockets_num > 1);
+      if ((status == 0) && (se->protocol == IPPROTO_TCP)) {
+        int flags = fcntl(*tmp, F_GETFL);
+        if ((listen(*tmp, SOMAXCONN) != 0) || (flags == -1) ||
+            (fcntl(*tmp, F_SETFL, flags | O_NONBLOCK) == -1)) {
+          ERROR("network plugin: listen(2) failed: %s", STRERRNO);
+          status = -1;
+        }
+      }
+      if (status != 0) {
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
 
-    se->data.server.fd_num++;
-    continue;
+      se->data.server.fd_num++;
+    }
   } /* for (ai_list) */
 
   freeaddrinfo(ai_list);
@@ -2159,7 +2553,24 @@ static int sockent_add(sockent_t *se) /* {{{ */
   if (se == NULL)
     return -1;
 
-  if (se->type == SOCKENT_TYPE_SERVER) {
+  if ((se->type == SOCKENT_TYPE_SERVER) && (se->protocol == IPPROTO_TCP)) {
+    int *tmp = realloc(stream_sockets, sizeof(*tmp) * (stream_sockets_num +
+                                                       se->data.server.fd_num));
+    if (tmp == NULL) {
+      ERROR("network plugin: realloc failed.");
+      return -1;
+    }
+    stream_sockets = tmp;
+    memcpy(stream_sockets + stream_sockets_num, se->data.server.fd,
+           sizeof(*tmp) * se->data.server.fd_num);
+    stream_sockets_num += se->data.server.fd_num;
+
+    if (listen_sockets == NULL) {
+      listen_sockets = se;
+      return 0;
+    }
+    last_ptr = listen_sockets;
+  } else if (se->type == SOCKENT_TYPE_SERVER) {
     struct pollfd *tmp;
 
     tmp = realloc(listen_sockets_pollfd,
@@ -2201,23 +2612,26 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
-static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
+static void *dispatch_thread(void *arg) /* {{{ */
 {
+  receive_queue_t *q = arg;
+
   while (42) {
     receive_list_entry_t *ent;
     sockent_t *se;
 
     /* Lock and wait for more data to come in */
-    pthread_mutex_lock(&receive_list_lock);
-    while ((listen_loop == 0) && (receive_list_head == NULL))
-      pthread_cond_wait(&receive_list_cond, &receive_list_lock);
+    pthread_mutex_lock(&q->lock);
+    while ((listen_loop == 0) && (q->list.head == NULL))
+      pthread_cond_wait(&q->cond, &q->lock);
 
     /* Remove the head entry and unlock */
-    ent = receive_list_head;
-    if (ent != NULL)
-      receive_list_head = ent->next;
-    receive_list_length--;
-    pthread_mutex_unlock(&receive_list_lock);
+    ent = q->list.head;
+    if (ent != NULL) {
+      q->list.head = ent->next;
+      q->list.length--;
+    }
+    pthread_mutex_unlock(&q->lock);
 
     /* Check whether we are supposed to exit. We do NOT check `listen_loop'
      * because we dispatch all missing packets before shutting down. */
@@ -2243,39 +2657,193 @@ static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
       ERROR("network plugin: Got packet from FD %i, but can't "
             "find an appropriate socket entry.",
             ent->fd);
-      sfree(ent->data);
-      sfree(ent);
+      c_mempool_free(receive_pool, ent);
       continue;
     }
 
-    parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
-                 /* username = */ NULL, &ent->sender);
-    sfree(ent->data);
-    sfree(ent);
+    COLLECTD_PROBE1(parse_packet_start, ent->data_len);
+    int status = parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
+                              /* username = */ NULL, &ent->sender);
+    COLLECTD_PROBE2(parse_packet_done, ent->data_len, status);
+    c_mempool_free(receive_pool, ent);
   } /* while (42) */
 
   return NULL;
 } /* }}} void *dispatch_thread */
 
-static int network_receive(void) /* {{{ */
-{
-  char buffer[network_config_packet_size];
-  int buffer_len;
+/* Returns the dispatch queue for packets from `sender'. The port is ignored, so
+ * all packets of one host are parsed by the same thread, in order. */
+static receive_queue_t *network_sender_queue( /* {{{ */
+    const struct sockaddr_storage *sender) {
+  const unsigned char *addr = NULL;
+  size_t addr_len = 0;
+
+  if (receive_queues_num == 1)
+    return receive_queues;
+
+  if (sender->ss_family == AF_INET) {
+    addr = (const void *)&((const struct sockaddr_in *)sender)->sin_addr;
+    addr_len = sizeof(struct in_addr);
+  } else if (sender->ss_family == AF_INET6) {
+    addr = (const void *)&((const struct sockaddr_in6 *)sender)->sin6_addr;
+    addr_len = sizeof(struct in6_addr);
+  }
 
-  int status = 0;
+  /* FNV-1a */
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < addr_len; i++) {
+    hash ^= addr[i];
+    hash *= 16777619U;
+  }
+
+  return receive_queues + (hash % receive_queues_num);
+} /* }}} receive_queue_t *network_sender_queue */
+
+/* Reads up to `ents_num' datagrams from `fd' into the entries of `ents'.
+ * `drops' is updated with the number of datagrams the kernel dropped on this
+ * socket, if it says so. Returns the number of datagrams read or -1 on
+ * error. */
+static int network_receive_batch(int fd, receive_list_entry_t **ents, /* {{{ */
+                                 size_t ents_num, uint32_t *drops) {
+  receive_msg_t msgs[RECEIVE_BATCH_SIZE];
+  struct iovec iov[RECEIVE_BATCH_SIZE];
+#ifdef SO_RXQ_OVFL
+  union {
+    char buffer[CMSG_SPACE(sizeof(uint32_t))];
+    struct cmsghdr align;
+  } control[RECEIVE_BATCH_SIZE];
+#endif
+  int msgs_num;
+
+  if (ents_num > RECEIVE_BATCH_SIZE)
+    ents_num = RECEIVE_BATCH_SIZE;
+#if !HAVE_RECVMMSG
+  ents_num = 1;
+#endif
+
+  memset(msgs, 0, sizeof(*msgs) * ents_num);
+  for (size_t i = 0; i < ents_num; i++) {
+    iov[i].iov_base = ents[i]->data;
+    iov[i].iov_len = network_config_packet_size;
+
+    msgs[i].msg_hdr.msg_name = &ents[i]->sender;
+    msgs[i].msg_hdr.msg_namelen = sizeof(ents[i]->sender);
+    msgs[i].msg_hdr.msg_iov = iov + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+#ifdef SO_RXQ_OVFL
+    msgs[i].msg_hdr.msg_control = control[i].buffer;
+    msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buffer);
+#endif
+  }
+
+#if HAVE_RECVMMSG
+  /* poll(2) said the socket is readable, so take whatever is queued without
+   * waiting for the batch to fill up. */
+  msgs_num = recvmmsg(fd, msgs, (unsigned int)ents_num, MSG_DONTWAIT, NULL);
+#else
+  ssize_t len = recvmsg(fd, &msgs[0].msg_hdr, /* flags = */ 0);
+  msgs_num = (len < 0) ? -1 : 1;
+  if (len >= 0)
+    msgs[0].msg_len = (unsigned int)len;
+#endif
+  if (msgs_num < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    return -1;
+  }
+
+  for (int i = 0; i < msgs_num; i++) {
+    ents[i]->data_len = (int)msgs[i].msg_len;
+    ents[i]->fd = fd;
+
+#ifdef SO_RXQ_OVFL
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+      /* The value is the socket's total, not a per-datagram count. */
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_RXQ_OVFL))
+        memcpy(drops, CMSG_DATA(cmsg), sizeof(*drops));
+    }
+#else
+    (void)drops;
+#endif
+  }
 
-  receive_list_entry_t *private_list_head;
-  receive_list_entry_t *private_list_tail;
-  uint64_t private_list_length;
+  return msgs_num;
+} /* }}} int network_receive_batch */
+
+static void receive_list_append(receive_list_t *l, /* {{{ */
+                                receive_list_entry_t *ent) {
+  if (l->head == NULL)
+    l->head = ent;
+  else
+    l->tail->next = ent;
+  l->tail = ent;
+  l->length++;
+} /* }}} void receive_list_append */
+
+/* Appends the receive thread's private list to the list of queue `q'. Unless
+ * `wait' is true, gives up if the lock is contended. */
+static bool network_receive_enqueue(receive_queue_t *q, /* {{{ */
+                                    receive_list_t *private_list, bool wait) {
+  if (private_list->head == NULL)
+    return true;
+
+  /* Do not block here unless asked to. Blocking here has led to
+   * insufficient performance in the past. */
+  if (wait)
+    pthread_mutex_lock(&q->lock);
+  else if (pthread_mutex_trylock(&q->lock) != 0)
+    return false;
+
+  assert(((q->list.head == NULL) && (q->list.length == 0)) ||
+         ((q->list.head != NULL) && (q->list.length != 0)));
+
+  if (q->list.head == NULL)
+    q->list.head = private_list->head;
+  else
+    q->list.tail->next = private_list->head;
+  q->list.tail = private_list->tail;
+  q->list.length += private_list->length;
+
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+
+  *private_list = (receive_list_t){NULL};
+  return true;
+} /* }}} bool network_receive_enqueue */
+
+/* Receives on the listening sockets assigned to receive thread `index', see
+ * network_receive_thread_of(). */
+static int network_receive(size_t index) /* {{{ */
+{
+  int status = 0;
 
-  assert(listen_sockets_num > 0);
+  /* Entries ready to receive into. Entries freed by the dispatch threads are
+   * returned to the pool and reused here. */
+  receive_list_entry_t *ents[RECEIVE_BATCH_SIZE] = {NULL};
+
+  struct pollfd *pollfd = calloc(listen_sockets_num, sizeof(*pollfd));
+  /* Last number of dropped datagrams reported for each socket. */
+  uint32_t *drops = calloc(listen_sockets_num, sizeof(*drops));
+  /* Entries not yet handed to the dispatch threads, one list per queue. */
+  receive_list_t *private_lists =
+      calloc(receive_queues_num, sizeof(*private_lists));
+  if ((pollfd == NULL) || (drops == NULL) || (private_lists == NULL)) {
+    ERROR("network plugin: calloc failed.");
+    free(pollfd);
+    free(drops);
+    free(private_lists);
+    return ENOMEM;
+  }
 
-  private_list_head = NULL;
-  private_list_tail = NULL;
-  private_list_length = 0;
+  size_t pollfd_num = 0;
+  for (size_t i = 0; i < listen_sockets_num; i++)
+    if (network_receive_thread_of(i) == index)
+      pollfd[pollfd_num++] = listen_sockets_pollfd[i];
+  assert(pollfd_num > 0);
 
   while (listen_loop == 0) {
-    status = poll(listen_sockets_pollfd, listen_sockets_num, -1);
+    status = poll(pollfd, pollfd_num, -1);
     if (status <= 0) {
       if (errno == EINTR)
         continue;
@@ -2283,125 +2851,453 @@ static int network_receive(void) /* {{{ */
       break;
     }
 
-    for (size_t i = 0; (i < listen_sockets_num) && (status > 0); i++) {
-      receive_list_entry_t *ent;
-
-      if ((listen_sockets_pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+    for (size_t i = 0; (i < pollfd_num) && (status > 0); i++) {
+      if ((pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
       status--;
 
-      struct sockaddr_storage address;
-      socklen_t length = sizeof(address);
-      memset(&address, 0, length);
-      buffer_len =
-          recvfrom(listen_sockets_pollfd[i].fd, buffer, sizeof(buffer),
-                   0 /* no flags */, (struct sockaddr *)&address, &length);
-      if (buffer_len < 0) {
+      for (size_t j = 0; j < RECEIVE_BATCH_SIZE; j++) {
+        if (ents[j] != NULL)
+          continue;
+        ents[j] = c_mempool_alloc(receive_pool);
+        if (ents[j] == NULL) {
+          ERROR("network plugin: c_mempool_alloc failed.");
+          status = ENOMEM;
+          break;
+        }
+        memset(ents[j], 0, sizeof(*ents[j]));
+        ents[j]->data = (char *)(ents[j] + 1);
+      }
+      if (status == ENOMEM)
+        break;
+
+      uint32_t dropped = drops[i];
+      int received = network_receive_batch(pollfd[i].fd, ents,
+                                           RECEIVE_BATCH_SIZE, &dropped);
+      if (received < 0) {
         status = (errno != 0) ? errno : -1;
         ERROR("network plugin: recv(2) failed: %s", STRERRNO);
         break;
       }
 
-      stats_octets_rx += ((uint64_t)buffer_len);
-      stats_packets_rx++;
-
-      /* TODO: Possible performance enhancement: Do not free
-       * these entries in the dispatch thread but put them in
-       * another list, so we don't have to allocate more and
-       * more of these structures. */
-      ent = calloc(1, sizeof(*ent));
-      if (ent == NULL) {
-        ERROR("network plugin: calloc failed.");
-        status = ENOMEM;
-        break;
-      }
+      /* Unsigned arithmetic takes care of the counter wrapping around. */
+      network_stats_add(&stats_packets_dropped,
+                        (derive_t)(uint32_t)(dropped - drops[i]));
+      drops[i] = dropped;
 
-      ent->data = malloc(network_config_packet_size);
-      if (ent->data == NULL) {
-        sfree(ent);
-        ERROR("network plugin: malloc failed.");
-        status = ENOMEM;
-        break;
-      }
-      ent->fd = listen_sockets_pollfd[i].fd;
-      ent->next = NULL;
-
-      memcpy(ent->data, buffer, buffer_len);
-      ent->data_len = buffer_len;
-      memcpy(&ent->sender, &address, sizeof(ent->sender));
-
-      if (private_list_head == NULL)
-        private_list_head = ent;
-      else
-        private_list_tail->next = ent;
-      private_list_tail = ent;
-      private_list_length++;
-
-      /* Do not block here. Blocking here has led to
-       * insufficient performance in the past. */
-      if (pthread_mutex_trylock(&receive_list_lock) == 0) {
-        assert(((receive_list_head == NULL) && (receive_list_length == 0)) ||
-               ((receive_list_head != NULL) && (receive_list_length != 0)));
-
-        if (receive_list_head == NULL)
-          receive_list_head = private_list_head;
-        else
-          receive_list_tail->next = private_list_head;
-        receive_list_tail = private_list_tail;
-        receive_list_length += private_list_length;
-
-        pthread_cond_signal(&receive_list_cond);
-        pthread_mutex_unlock(&receive_list_lock);
-
-        private_list_head = NULL;
-        private_list_tail = NULL;
-        private_list_length = 0;
+      derive_t octets = 0;
+      for (int j = 0; j < received; j++) {
+        receive_list_entry_t *ent = ents[j];
+        ents[j] = NULL;
+
+        octets += (derive_t)ent->data_len;
+
+        receive_list_append(private_lists + (network_sender_queue(&ent->sender) -
+                                             receive_queues),
+                            ent);
       }
+      network_stats_add(&stats_octets_rx, octets);
+      network_stats_add(&stats_packets_rx, (derive_t)received);
+
+      for (size_t j = 0; j < receive_queues_num; j++)
+        network_receive_enqueue(receive_queues + j, private_lists + j,
+                                /* wait = */ false);
 
       status = 0;
-    } /* for (listen_sockets_pollfd) */
+    } /* for (pollfd) */
 
     if (status != 0)
       break;
   } /* while (listen_loop == 0) */
 
   /* Make sure everything is dispatched before exiting. */
-  if (private_list_head != NULL) {
-    pthread_mutex_lock(&receive_list_lock);
-
-    if (receive_list_head == NULL)
-      receive_list_head = private_list_head;
-    else
-      receive_list_tail->next = private_list_head;
-    receive_list_tail = private_list_tail;
-    receive_list_length += private_list_length;
+  for (size_t j = 0; j < receive_queues_num; j++)
+    network_receive_enqueue(receive_queues + j, private_lists + j,
+                            /* wait = */ true);
 
-    pthread_cond_signal(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-  }
+  for (size_t j = 0; j < RECEIVE_BATCH_SIZE; j++)
+    c_mempool_free(receive_pool, ents[j]);
+  free(pollfd);
+  free(drops);
+  free(private_lists);
 
   return status;
 } /* }}} int network_receive */
 
-static void *receive_thread(void __attribute__((unused)) * arg) {
-  return network_receive() ? (void *)1 : (void *)0;
+static void *receive_thread(void *arg) {
+  return network_receive((size_t)(uintptr_t)arg) ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
-static void network_init_buffer(void) {
-  memset(send_buffer, 0, network_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
+/* Reads from a TCP connection and moves all complete frames to the private
+ * lists. Returns non-zero if the connection has to be closed. */
+static int network_stream_read(stream_connection_t *c, /* {{{ */
+                               receive_list_t *private_lists) {
+  size_t buffer_size = STREAM_FRAME_HEADER_SIZE + network_config_packet_size;
 
-  memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
-} /* int network_init_buffer */
+  ssize_t status = recv(c->fd, c->buffer + c->buffer_fill,
+                        buffer_size - c->buffer_fill, MSG_DONTWAIT);
+  if (status < 0) {
+    if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
+    WARNING("network plugin: recv(2) failed: %s", STRERRNO);
+    return -1;
+  } else if (status == 0) { /* closed by the peer */
+    return -1;
+  }
+  c->buffer_fill += (size_t)status;
+  network_stats_add(&stats_octets_rx, (derive_t)status);
+
+  size_t offset = 0;
+  while ((c->buffer_fill - offset) >= STREAM_FRAME_HEADER_SIZE) {
+    uint16_t frame_len;
+    memcpy(&frame_len, c->buffer + offset, sizeof(frame_len));
+    frame_len = ntohs(frame_len);
+
+    if ((frame_len == 0) || (frame_len > network_config_packet_size)) {
+      ERROR("network plugin: Received a frame of %" PRIu16 " bytes over TCP, "
+            "but MaxPacketSize is %" PRIsz ". Closing the connection.",
+            frame_len, network_config_packet_size);
+      return -1;
+    }
 
-static void network_send_buffer_plain(sockent_t *se, /* {{{ */
-                                      const char *buffer, size_t buffer_size) {
-  int status;
+    size_t frame_size = STREAM_FRAME_HEADER_SIZE + frame_len;
+    if ((c->buffer_fill - offset) < frame_size)
+      break;
 
-  while (42) {
-    status = sockent_client_connect(se);
+    receive_list_entry_t *ent = c_mempool_alloc(receive_pool);
+    if (ent == NULL) {
+      ERROR("network plugin: c_mempool_alloc failed.");
+      return -1;
+    }
+    memset(ent, 0, sizeof(*ent));
+    ent->data = (char *)(ent + 1);
+    memcpy(ent->data, c->buffer + offset + STREAM_FRAME_HEADER_SIZE,
+           frame_len);
+    ent->data_len = (int)frame_len;
+    ent->fd = c->listen_fd;
+    memcpy(&ent->sender, &c->peer, sizeof(ent->sender));
+
+    receive_list_append(private_lists +
+                            (network_sender_queue(&ent->sender) - receive_queues),
+                        ent);
+    network_stats_add(&stats_packets_rx, 1);
+
+    offset += frame_size;
+  }
+
+  c->buffer_fill -= offset;
+  memmove(c->buffer, c->buffer + offset, c->buffer_fill);
+  return 0;
+} /* }}} int network_stream_read */
+
+/* Accepts TCP connections on all listening stream sockets and reads frames
+ * from them. */
+static int network_stream_receive(void) /* {{{ */
+{
+  int status = 0;
+
+  stream_connection_t *conns = calloc(STREAM_CONNECTIONS_MAX, sizeof(*conns));
+  struct pollfd *pollfd =
+      calloc(stream_sockets_num + STREAM_CONNECTIONS_MAX, sizeof(*pollfd));
+  receive_list_t *private_lists =
+      calloc(receive_queues_num, sizeof(*private_lists));
+  if ((conns == NULL) || (pollfd == NULL) || (private_lists == NULL)) {
+    ERROR("network plugin: calloc failed.");
+    free(conns);
+    free(pollfd);
+    free(private_lists);
+    return ENOMEM;
+  }
+  size_t conns_num = 0;
+
+  while (listen_loop == 0) {
+    /* Stop reading while the dispatch threads are behind. The lengths are
+     * read without locking; an estimate is good enough here. */
+    uint64_t queue_length = 0;
+    for (size_t i = 0; i < receive_queues_num; i++)
+      queue_length += receive_queues[i].list.length;
+    bool throttle = (queue_length > STREAM_QUEUE_LENGTH_MAX);
+
+    for (size_t i = 0; i < stream_sockets_num; i++)
+      pollfd[i] = (struct pollfd){
+          .fd = stream_sockets[i],
+          .events = (conns_num < STREAM_CONNECTIONS_MAX) ? POLLIN : 0,
+      };
+    size_t polled_num = conns_num;
+    for (size_t i = 0; i < polled_num; i++)
+      pollfd[stream_sockets_num + i] = (struct pollfd){
+          .fd = conns[i].fd,
+          .events = throttle ? 0 : POLLIN,
+      };
+
+    status = poll(pollfd, stream_sockets_num + polled_num,
+                  throttle ? 100 : -1);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("network plugin: poll(2) failed: %s", STRERRNO);
+      break;
+    }
+    status = 0;
+
+    for (size_t i = 0; i < stream_sockets_num; i++) {
+      if ((pollfd[i].revents & POLLIN) == 0)
+        continue;
+
+      while (conns_num < STREAM_CONNECTIONS_MAX) {
+        stream_connection_t *c = conns + conns_num;
+        socklen_t peer_len = sizeof(c->peer);
+
+        memset(c, 0, sizeof(*c));
+        c->fd = accept(stream_sockets[i], (struct sockaddr *)&c->peer,
+                       &peer_len);
+        if (c->fd < 0) {
+          if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            WARNING("network plugin: accept(2) failed: %s", STRERRNO);
+          break;
+        }
+
+        c->listen_fd = stream_sockets[i];
+        c->buffer =
+            malloc(STREAM_FRAME_HEADER_SIZE + network_config_packet_size);
+        if (c->buffer == NULL) {
+          ERROR("network plugin: malloc failed.");
+          close(c->fd);
+          break;
+        }
+        conns_num++;
+      }
+    }
+
+    /* Go backwards, so that closed connections can be replaced by the last
+     * one, which has either been handled already or was just accepted. */
+    for (size_t i = polled_num; i > 0; i--) {
+      stream_connection_t *c = conns + i - 1;
+      if ((pollfd[stream_sockets_num + i - 1].revents &
+           (POLLIN | POLLHUP | POLLERR)) == 0)
+        continue;
+
+      if (network_stream_read(c, private_lists) != 0) {
+        close(c->fd);
+        sfree(c->buffer);
+        conns_num--;
+        *c = conns[conns_num];
+      }
+    }
+
+    for (size_t i = 0; i < receive_queues_num; i++)
+      network_receive_enqueue(receive_queues + i, private_lists + i,
+                              /* wait = */ true);
+  } /* while (listen_loop == 0) */
+
+  for (size_t i = 0; i < conns_num; i++) {
+    close(conns[i].fd);
+    sfree(conns[i].buffer);
+  }
+  free(conns);
+  free(pollfd);
+  free(private_lists);
+
+  return status;
+} /* }}} int network_stream_receive */
+
+static void *stream_receive_thread(__attribute__((unused)) void *arg) {
+  return network_stream_receive() ? (void *)1 : (void *)0;
+} /* void *stream_receive_thread */
+
+static void network_init_buffer(send_buffer_t *sb) {
+  memset(sb->buffer, 0, network_config_packet_size);
+  sb->ptr = sb->buffer;
+  sb->fill = 0;
+  sb->last_update = 0;
+
+  memset(&sb->vl, 0, sizeof(sb->vl));
+  sb->relayed = false;
+} /* int network_init_buffer */
+
+static void send_buffer_key_create(void) /* {{{ */
+{
+  /* The buffers are owned by the `send_buffers' list. */
+  pthread_key_create(&send_buffer_key, /* destructor = */ NULL);
+} /* }}} void send_buffer_key_create */
+
+/* Returns the calling thread's send buffer, creating it on first use. */
+static send_buffer_t *send_buffer_get(void) /* {{{ */
+{
+  pthread_once(&send_buffer_once, send_buffer_key_create);
+  send_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb != NULL)
+    return sb;
+
+  sb = calloc(1, sizeof(*sb));
+  if (sb == NULL)
+    return NULL;
+  sb->buffer = malloc(network_config_packet_size);
+  if (sb->buffer == NULL) {
+    sfree(sb);
+    return NULL;
+  }
+  pthread_mutex_init(&sb->lock, /* attr = */ NULL);
+  network_init_buffer(sb);
+
+  pthread_mutex_lock(&send_buffers_lock);
+  sb->next = send_buffers;
+  send_buffers = sb;
+  send_buffers_num++;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  pthread_setspecific(send_buffer_key, sb);
+  return sb;
+} /* }}} send_buffer_t *send_buffer_get */
+
+/* Writes as much of the stream buffer to the TCP connection as the socket
+ * takes without blocking. */
+static void network_stream_flush(sockent_t *se) /* {{{ */
+{
+  struct sockent_client *client = &se->data.client;
+  size_t offset = 0;
+
+  while (offset < client->stream_buffer_fill) {
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    ssize_t status = send(client->fd, client->stream_buffer + offset,
+                          client->stream_buffer_fill - offset, flags);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      /* Still connecting or the receiver is slow. */
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOTCONN))
+        break;
+
+      c_complain(LOG_ERR, &client->connect_complaint,
+                 "network plugin: send failed: %s. Closing connection to "
+                 "\"%s\".",
+                 STRERRNO, se->node);
+      sockent_client_disconnect(se);
+      return;
+    }
+    offset += (size_t)status;
+  }
+
+  if (offset > 0)
+    c_release(LOG_NOTICE, &client->connect_complaint,
+              "network plugin: Connected to \"%s\".", se->node);
+
+  if (offset > 0) {
+    client->stream_buffer_fill -= offset;
+    memmove(client->stream_buffer, client->stream_buffer + offset,
+            client->stream_buffer_fill);
+  }
+} /* }}} void network_stream_flush */
+
+/* Appends the packet to the stream buffer of a TCP client and writes the
+ * buffer. If the receiver can't keep up and the buffer is full, the packet
+ * is dropped; the network plugin must not block the write threads. */
+static void network_send_stream(sockent_t *se, /* {{{ */
+                                const char *buffer, size_t buffer_size) {
+  struct sockent_client *client = &se->data.client;
+
+  if (sockent_client_connect(se) != 0)
+    return;
+
+  if (client->stream_buffer == NULL) {
+    client->stream_buffer = malloc(client->stream_buffer_size);
+    if (client->stream_buffer == NULL) {
+      ERROR("network plugin: malloc failed.");
+      return;
+    }
+  }
+
+  /* Make room first, unless the connection is still being set up. */
+  if (client->stream_buffer_fill > 0)
+    network_stream_flush(se);
+  if (client->fd < 0)
+    return;
+
+  size_t frame_size = STREAM_FRAME_HEADER_SIZE + buffer_size;
+  if ((client->stream_buffer_fill + frame_size) > client->stream_buffer_size) {
+    c_complain(LOG_WARNING, &client->drop_complaint,
+               "network plugin: The connection to \"%s\" is too slow, "
+               "dropping packets.",
+               se->node);
+    return;
+  }
+  c_release(LOG_INFO, &client->drop_complaint,
+            "network plugin: The connection to \"%s\" caught up again.",
+            se->node);
+
+  uint16_t frame_len = htons((uint16_t)buffer_size);
+  char *ptr = client->stream_buffer + client->stream_buffer_fill;
+  memcpy(ptr, &frame_len, sizeof(frame_len));
+  memcpy(ptr + STREAM_FRAME_HEADER_SIZE, buffer, buffer_size);
+  client->stream_buffer_fill += frame_size;
+
+  network_stream_flush(se);
+} /* }}} void network_send_stream */
+
+#if HAVE_SENDMMSG
+/* Sends the datagrams collected in `b'. Must be called with se->lock held. */
+static void network_send_batch(sockent_t *se, send_batch_t *b) /* {{{ */
+{
+  size_t sent = 0;
+
+  while (sent < b->num) {
+    if (sockent_client_connect(se) != 0)
+      break;
+
+    /* The address may change when the socket is reconnected. */
+    for (size_t i = sent; i < b->num; i++) {
+      b->msgs[i].msg_hdr.msg_name = se->data.client.addr;
+      b->msgs[i].msg_hdr.msg_namelen = se->data.client.addrlen;
+    }
+
+    int status = sendmmsg(se->data.client.fd, b->msgs + sent,
+                          (unsigned int)(b->num - sent), /* flags = */ 0);
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+
+      ERROR("network plugin: sendmmsg failed: %s. Closing sending socket.",
+            STRERRNO);
+      sockent_client_disconnect(se);
+      break;
+    }
+    sent += (size_t)status;
+  }
+
+  b->num = 0;
+} /* }}} void network_send_batch */
+#endif /* HAVE_SENDMMSG */
+
+static void network_send_buffer_plain(sockent_t *se, /* {{{ */
+                                      const char *buffer, size_t buffer_size) {
+  int status;
+
+  if (se->protocol == IPPROTO_TCP) {
+    network_send_stream(se, buffer, buffer_size);
+    return;
+  }
+
+#if HAVE_SENDMMSG
+  send_batch_t *b = se->data.client.batch;
+  if ((b != NULL) && (buffer_size <= b->slot_size)) {
+    if (b->num >= b->slots)
+      network_send_batch(se, b);
+
+    char *slot = b->data + b->num * b->slot_size;
+    memcpy(slot, buffer, buffer_size);
+    b->iovs[b->num] = (struct iovec){.iov_base = slot, .iov_len = buffer_size};
+    b->msgs[b->num] = (struct mmsghdr){
+        .msg_hdr = {.msg_iov = b->iovs + b->num, .msg_iovlen = 1}};
+    b->num++;
+    return;
+  }
+#endif
+
+  while (42) {
+    status = sockent_client_connect(se);
     if (status != 0)
       return;
 
@@ -2429,37 +3325,26 @@ static void network_send_buffer_plain(sockent_t *se, /* {{{ */
     buffer_offset += (s);                                                      \
   } while (0)
 
-static void network_send_buffer_signed(sockent_t *se, /* {{{ */
-                                       const char *in_buffer,
-                                       size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+/* The functions below write the signed or encrypted datagram for `se' to
+ * `buffer', which must hold BUFF_SIG_SIZE + in_buffer_size bytes, and return
+ * its size. Zero is returned on error. */
+static size_t network_sign_buffer(sockent_t *se, char *buffer, /* {{{ */
+                                  const char *in_buffer,
+                                  size_t in_buffer_size) {
   size_t buffer_offset;
   size_t username_len;
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash;
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC object failed: %s",
-          gcry_strerror(err));
-    return;
-  }
-
-  err = gcry_md_setkey(hd, se->data.client.password,
-                       strlen(se->data.client.password));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    return;
-  }
+  hd = network_hmac_prepare(&se->data.client.hmac, se->data.client.password);
+  if (hd == NULL)
+    return 0;
 
   username_len = strlen(se->data.client.username);
   if (username_len > (BUFF_SIG_SIZE - PART_SIGNATURE_SHA256_SIZE)) {
     ERROR("network plugin: Username too long: %s", se->data.client.username);
-    return;
+    return 0;
   }
 
   memcpy(buffer + PART_SIGNATURE_SHA256_SIZE, se->data.client.username,
@@ -2478,8 +3363,7 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
   hash = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    return;
+    return 0;
   }
   memcpy(ps.hash, hash, sizeof(ps.hash));
 
@@ -2492,17 +3376,12 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == PART_SIGNATURE_SHA256_SIZE);
 
-  gcry_md_close(hd);
-  hd = NULL;
+  return PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
+} /* }}} size_t network_sign_buffer */
 
-  buffer_offset = PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
-  network_send_buffer_plain(se, buffer, buffer_offset);
-} /* }}} void network_send_buffer_signed */
-
-static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
-                                          const char *in_buffer,
-                                          size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+static size_t network_encrypt_buffer(sockent_t *se, char *buffer, /* {{{ */
+                                     const char *in_buffer,
+                                     size_t in_buffer_size) {
   size_t buffer_size;
   size_t buffer_offset;
   size_t header_size;
@@ -2517,14 +3396,13 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   username_len = strlen(pea.username);
   if ((PART_ENCRYPTION_AES256_SIZE + username_len) > BUFF_SIG_SIZE) {
     ERROR("network plugin: Username too long: %s", pea.username);
-    return;
+    return 0;
   }
 
   buffer_size = PART_ENCRYPTION_AES256_SIZE + username_len + in_buffer_size;
   header_size = PART_ENCRYPTION_AES256_SIZE + username_len - sizeof(pea.hash);
 
-  assert(buffer_size <= sizeof(buffer));
-  DEBUG("network plugin: network_send_buffer_encrypted: "
+  DEBUG("network plugin: network_encrypt_buffer: "
         "buffer_size = %" PRIsz ";",
         buffer_size);
 
@@ -2540,7 +3418,7 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   /* Initialize the buffer */
   buffer_offset = 0;
-  memset(buffer, 0, sizeof(buffer));
+  memset(buffer, 0, buffer_size);
 
   BUFFER_ADD(&pea.head.type, sizeof(pea.head.type));
   BUFFER_ADD(&pea.head.length, sizeof(pea.head.length));
@@ -2553,10 +3431,12 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == buffer_size);
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv),
-                                     se->data.client.password);
+  cypher = network_cypher_prepare(
+      &se->data.client.cypher, GCRY_CIPHER_MODE_OFB,
+      se->data.client.password_hash, sizeof(se->data.client.password_hash),
+      pea.iv, sizeof(pea.iv));
   if (cypher == NULL)
-    return;
+    return 0;
 
   /* Encrypt the buffer in-place */
   err = gcry_cipher_encrypt(cypher, buffer + header_size,
@@ -2565,31 +3445,193 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   if (err != 0) {
     ERROR("network plugin: gcry_cipher_encrypt returned: %s",
           gcry_strerror(err));
-    return;
+    return 0;
+  }
+
+  return buffer_size;
+} /* }}} size_t network_encrypt_buffer */
+
+#if NETWORK_HAVE_GCM
+static size_t network_encrypt_buffer_gcm(sockent_t *se, /* {{{ */
+                                         char *buffer, const char *in_buffer,
+                                         size_t in_buffer_size) {
+  size_t buffer_size;
+  size_t buffer_offset;
+  size_t header_size;
+  size_t username_len;
+  gcry_error_t err;
+  gcry_cipher_hd_t cypher;
+
+  part_encryption_aes256_gcm_t peg = {
+      .head.type = htons(TYPE_ENCR_AES256_GCM),
+      .username = se->data.client.username};
+
+  username_len = strlen(peg.username);
+  if ((PART_ENCRYPTION_AES256_GCM_SIZE + username_len) > BUFF_SIG_SIZE) {
+    ERROR("network plugin: Username too long: %s", peg.username);
+    return 0;
+  }
+
+  buffer_size = PART_ENCRYPTION_AES256_GCM_SIZE + username_len + in_buffer_size;
+  header_size =
+      PART_ENCRYPTION_AES256_GCM_SIZE + username_len - sizeof(peg.tag);
+
+  peg.head.length = htons((uint16_t)buffer_size);
+  peg.username_length = htons((uint16_t)username_len);
+
+  /* GCM requires the nonce to be unique for each key, not unpredictable. */
+  gcry_create_nonce(peg.nonce, sizeof(peg.nonce));
+
+  buffer_offset = 0;
+  BUFFER_ADD(&peg.head.type, sizeof(peg.head.type));
+  BUFFER_ADD(&peg.head.length, sizeof(peg.head.length));
+  BUFFER_ADD(&peg.username_length, sizeof(peg.username_length));
+  BUFFER_ADD(peg.username, username_len);
+  BUFFER_ADD(peg.nonce, sizeof(peg.nonce));
+  assert(buffer_offset == header_size);
+  BUFFER_ADD(in_buffer, in_buffer_size);
+
+  cypher = network_cypher_prepare(
+      &se->data.client.cypher, GCRY_CIPHER_MODE_GCM,
+      se->data.client.password_hash, sizeof(se->data.client.password_hash),
+      peg.nonce, sizeof(peg.nonce));
+  if (cypher == NULL)
+    return 0;
+
+  /* Encrypt the payload in-place and append the tag, which also covers the
+   * header. */
+  err = gcry_cipher_authenticate(cypher, buffer, header_size);
+  if (err == 0)
+    err = gcry_cipher_encrypt(cypher, buffer + header_size, in_buffer_size,
+                              /* in = */ NULL, /* in len = */ 0);
+  if (err == 0)
+    err = gcry_cipher_gettag(cypher, buffer + buffer_offset, sizeof(peg.tag));
+  if (err != 0) {
+    ERROR("network plugin: gcry_cipher_encrypt returned: %s",
+          gcry_strerror(err));
+    return 0;
   }
 
-  /* Send it out without further modifications */
-  network_send_buffer_plain(se, buffer, buffer_size);
-} /* }}} void network_send_buffer_encrypted */
+  return buffer_size;
+} /* }}} size_t network_encrypt_buffer_gcm */
+#endif /* NETWORK_HAVE_GCM */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
-static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
+#if HAVE_ZLIB
+/* Wraps all parts in `in_buffer' into one compressed part. Returns the size of
+ * the compressed part, or zero if compression did not make the packet
+ * smaller. */
+static size_t network_compress_buffer(char *buffer, /* {{{ */
+                                      size_t buffer_size,
+                                      const char *in_buffer,
+                                      size_t in_buffer_size) {
+  part_compressed_t pc;
+
+  if (buffer_size <= PART_COMPRESSED_SIZE)
+    return 0;
+
+  uLongf compressed_len = (uLongf)(buffer_size - PART_COMPRESSED_SIZE);
+  int status = compress2((Bytef *)buffer + PART_COMPRESSED_SIZE,
+                         &compressed_len, (const Bytef *)in_buffer,
+                         (uLong)in_buffer_size, Z_DEFAULT_COMPRESSION);
+  if (status == Z_BUF_ERROR)
+    return 0;
+  else if (status != Z_OK) {
+    ERROR("network plugin: compress2 failed with status %i.", status);
+    return 0;
+  }
+
+  size_t part_len = PART_COMPRESSED_SIZE + (size_t)compressed_len;
+  if (part_len >= in_buffer_size)
+    return 0;
+
+  pc.head.type = htons(TYPE_COMPRESSED);
+  pc.head.length = htons((uint16_t)part_len);
+  pc.algorithm = htons(COMPRESSION_ZLIB);
+  pc.uncompressed_length = htons((uint16_t)in_buffer_size);
+
+  memcpy(buffer, &pc.head.type, sizeof(pc.head.type));
+  memcpy(buffer + 2, &pc.head.length, sizeof(pc.head.length));
+  memcpy(buffer + 4, &pc.algorithm, sizeof(pc.algorithm));
+  memcpy(buffer + 6, &pc.uncompressed_length, sizeof(pc.uncompressed_length));
+
+  return part_len;
+} /* }}} size_t network_compress_buffer */
+#endif /* HAVE_ZLIB */
+
+static void network_send_buffer(char *in_buffer, size_t in_buffer_len) /* {{{ */
 {
+#if HAVE_ZLIB
+  /* Compressed lazily, once for all sockets that want it. */
+  char compressed[in_buffer_len];
+  size_t compressed_len = 0;
+  bool compressed_tried = false;
+#endif
+
+#if HAVE_GCRYPT_H
+  char packet[BUFF_SIG_SIZE + in_buffer_len];
+#endif
+
   DEBUG("network plugin: network_send_buffer: buffer_len = %" PRIsz,
-        buffer_len);
+        in_buffer_len);
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    /* Sent along with the first socket of its group. */
+    if ((se->data.client.group_first != NULL) &&
+        (se->data.client.group_first != se))
+      continue;
+
+    char *buffer = in_buffer;
+    size_t buffer_len = in_buffer_len;
+
+#if HAVE_ZLIB
+    if (se->data.client.compress) {
+      if (!compressed_tried) {
+        compressed_len = network_compress_buffer(
+            compressed, sizeof(compressed), in_buffer, in_buffer_len);
+        compressed_tried = true;
+      }
+      if (compressed_len > 0) {
+        buffer = compressed;
+        buffer_len = compressed_len;
+      }
+    }
+#endif
+
+    /* The lock of the first socket also protects the crypto handles. */
     pthread_mutex_lock(&se->lock);
 #if HAVE_GCRYPT_H
-    if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
-      network_send_buffer_encrypted(se, buffer, buffer_len);
+    size_t packet_len = 0;
+#if NETWORK_HAVE_GCM
+    if ((se->data.client.security_level == SECURITY_LEVEL_ENCRYPT) &&
+        (se->data.client.cypher_mode == GCRY_CIPHER_MODE_GCM))
+      packet_len = network_encrypt_buffer_gcm(se, packet, buffer, buffer_len);
+    else
+#endif
+        if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
+      packet_len = network_encrypt_buffer(se, packet, buffer, buffer_len);
     else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
-      network_send_buffer_signed(se, buffer, buffer_len);
-    else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
-#endif   /* HAVE_GCRYPT_H */
-      network_send_buffer_plain(se, buffer, buffer_len);
+      packet_len = network_sign_buffer(se, packet, buffer, buffer_len);
+
+    if (se->data.client.security_level != SECURITY_LEVEL_NONE) {
+      if (packet_len == 0) {
+        pthread_mutex_unlock(&se->lock);
+        continue;
+      }
+      buffer = packet;
+      buffer_len = packet_len;
+    }
+#endif /* HAVE_GCRYPT_H */
+    network_send_buffer_plain(se, buffer, buffer_len);
     pthread_mutex_unlock(&se->lock);
+
+    for (sockent_t *member = se->data.client.group_next; member != NULL;
+         member = member->data.client.group_next) {
+      pthread_mutex_lock(&member->lock);
+      network_send_buffer_plain(member, buffer, buffer_len);
+      pthread_mutex_unlock(&member->lock);
+    }
   } /* for (sending_sockets) */
 } /* }}} void network_send_buffer */
 
@@ -2650,23 +3692,168 @@ static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
              sizeof(vl_def->type_instance));
   }
 
+  /* The histogram only applies to the values part following it. */
+  char *histogram = NULL;
+  if ((vl->meta != NULL) &&
+      (meta_data_get_string(vl->meta, LATENCY_HISTOGRAM_META, &histogram) ==
+       0)) {
+    int status = write_part_string(&buffer, &buffer_size, TYPE_HISTOGRAM,
+                                   histogram, strlen(histogram));
+    sfree(histogram);
+    if (status != 0)
+      return -1;
+  }
+
   if (write_part_values(&buffer, &buffer_size, ds, vl) != 0)
     return -1;
 
   return buffer - buffer_orig;
 } /* }}} int add_to_buffer */
 
-static void flush_buffer(void) {
-  DEBUG("network plugin: flush_buffer: send_buffer_fill = %i",
-        send_buffer_fill);
+/* Sends and resets the send buffers in `sbs', whose locks must be held. With
+ * more than one buffer, the datagrams for each UDP socket are collected and
+ * sent with as few sendmmsg(2) calls as possible. */
+static void flush_buffers(send_buffer_t **sbs, size_t sbs_num) /* {{{ */
+{
+#if HAVE_SENDMMSG
+  size_t sockets_num = 0;
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+    sockets_num++;
+
+  send_batch_t *batches = NULL;
+  if ((sbs_num > 1) && (sockets_num > 0))
+    batches = calloc(sockets_num, sizeof(*batches));
+
+  size_t i = 0;
+  for (sockent_t *se = sending_sockets; (batches != NULL) && (se != NULL);
+       se = se->next, i++) {
+    send_batch_t *b = batches + i;
+    if (se->protocol != IPPROTO_UDP)
+      continue;
+
+    b->slots = (sbs_num < SEND_BATCH_SIZE) ? sbs_num : SEND_BATCH_SIZE;
+    b->slot_size = network_config_packet_size + BUFF_SIG_SIZE;
+    b->data = malloc(b->slots * b->slot_size);
+    if (b->data == NULL)
+      continue;
+
+    pthread_mutex_lock(&se->lock);
+    se->data.client.batch = b;
+    pthread_mutex_unlock(&se->lock);
+  }
+#endif
+
+  for (size_t j = 0; j < sbs_num; j++) {
+    send_buffer_t *sb = sbs[j];
+
+    DEBUG("network plugin: flush_buffers: fill = %i", sb->fill);
+    network_send_buffer(sb->buffer, (size_t)sb->fill);
+
+    network_stats_add(&stats_octets_tx, (derive_t)sb->fill);
+    network_stats_add(&stats_packets_tx, 1);
+    network_stats_add(&send_buffers_fill, -(derive_t)sb->fill);
+
+    network_init_buffer(sb);
+  }
+
+#if HAVE_SENDMMSG
+  i = 0;
+  for (sockent_t *se = sending_sockets; (batches != NULL) && (se != NULL);
+       se = se->next, i++) {
+    send_batch_t *b = batches + i;
+    if (b->data == NULL)
+      continue;
+
+    pthread_mutex_lock(&se->lock);
+    network_send_batch(se, b);
+    se->data.client.batch = NULL;
+    pthread_mutex_unlock(&se->lock);
+    sfree(b->data);
+  }
+  sfree(batches);
+#endif
+} /* }}} void flush_buffers */
+
+static void flush_buffer(send_buffer_t *sb) { flush_buffers(&sb, 1); }
+
+static int network_flush(cdtime_t timeout, const char *identifier,
+                         user_data_t *user_data);
+
+/* Flushes all send buffers once they hold a packet's worth of data together.
+ * Otherwise spreading the values over the threads' buffers would delay them
+ * by up to the number of threads. */
+static void network_flush_if_full(void) /* {{{ */
+{
+  if (send_buffers_fill >= (derive_t)network_config_packet_size)
+    network_flush(/* timeout = */ 0, /* identifier = */ NULL,
+                  /* user_data = */ NULL);
+} /* }}} void network_flush_if_full */
+
+/* Size of the parts written by network_relay_reset(). */
+#define RELAY_RESET_SIZE (5 * (sizeof(part_header_t) + 1))
+
+/* Receivers carry the identifier over from one value list to the next. Writes
+ * its parts as empty strings, so that the identifier of the data in the buffer
+ * doesn't leak into the data appended next. Must be called with sb->lock held
+ * and RELAY_RESET_SIZE bytes available. */
+static void network_relay_reset(send_buffer_t *sb) /* {{{ */
+{
+  static const int types[] = {TYPE_HOST, TYPE_PLUGIN, TYPE_PLUGIN_INSTANCE,
+                              TYPE_TYPE, TYPE_TYPE_INSTANCE};
+  size_t buffer_free = network_config_packet_size - (size_t)sb->fill;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(types); i++)
+    write_part_string(&sb->ptr, &buffer_free, types[i], "", 0);
+
+  network_stats_add(&send_buffers_fill, (derive_t)RELAY_RESET_SIZE);
+  sb->fill = (int)(network_config_packet_size - buffer_free);
+  memset(&sb->vl, 0, sizeof(sb->vl));
+  sb->relayed = false;
+} /* }}} void network_relay_reset */
+
+/* Sends parts received from the network, see network_relay_size(), to all
+ * servers. The parts are signed, encrypted and compressed according to the
+ * settings of each server. With RelayAggregate the parts are appended to the
+ * send buffer, so that several small packets become one larger one. */
+static void network_relay(char *buffer, size_t buffer_size) /* {{{ */
+{
+  size_t payload_max = network_config_packet_size - BUFF_SIG_SIZE;
+
+  if (buffer_size == 0)
+    return;
+
+  send_buffer_t *sb = NULL;
+  if (network_config_relay_aggregate && (buffer_size <= payload_max))
+    sb = send_buffer_get();
+
+  if (sb == NULL) {
+    network_send_buffer(buffer, buffer_size);
+
+    network_stats_add(&stats_octets_tx, (derive_t)buffer_size);
+    network_stats_add(&stats_packets_tx, 1);
+    return;
+  }
 
-  network_send_buffer(send_buffer, (size_t)send_buffer_fill);
+  pthread_mutex_lock(&sb->lock);
 
-  stats_octets_tx += ((uint64_t)send_buffer_fill);
-  stats_packets_tx++;
+  if ((sb->fill > 0) &&
+      (((size_t)sb->fill + RELAY_RESET_SIZE + buffer_size) > payload_max))
+    flush_buffer(sb);
 
-  network_init_buffer();
-}
+  if (sb->fill > 0)
+    network_relay_reset(sb);
+
+  memcpy(sb->ptr, buffer, buffer_size);
+  sb->ptr += buffer_size;
+  sb->fill += (int)buffer_size;
+  sb->last_update = cdtime();
+  sb->relayed = true;
+  network_stats_add(&send_buffers_fill, (derive_t)buffer_size);
+
+  pthread_mutex_unlock(&sb->lock);
+
+  network_flush_if_full();
+} /* }}} void network_relay */
 
 static int network_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
@@ -2686,53 +3873,67 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
           "NOT sending %s.",
           name);
 #endif
-    /* Counter is not protected by another lock and may be reached by
-     * multiple threads */
-    pthread_mutex_lock(&stats_lock);
-    stats_values_not_sent++;
-    pthread_mutex_unlock(&stats_lock);
+    network_stats_add(&stats_values_not_sent, 1);
     return 0;
   }
 
+  send_buffer_t *sb = send_buffer_get();
+  if (sb == NULL) {
+    ERROR("network plugin: Allocating a send buffer failed.");
+    return ENOMEM;
+  }
+
   uc_meta_data_add_unsigned_int(vl, "network:time_sent", (uint64_t)vl->time);
 
-  pthread_mutex_lock(&send_buffer_lock);
+  pthread_mutex_lock(&sb->lock);
 
-  status = add_to_buffer(send_buffer_ptr,
+  if (sb->relayed) {
+    if (((size_t)sb->fill + RELAY_RESET_SIZE + BUFF_SIG_SIZE) >
+        network_config_packet_size)
+      flush_buffer(sb);
+    else
+      network_relay_reset(sb);
+  }
+
+  status = add_to_buffer(sb->ptr,
                          network_config_packet_size -
-                             (send_buffer_fill + BUFF_SIG_SIZE),
-                         &send_buffer_vl, ds, vl);
+                             (sb->fill + BUFF_SIG_SIZE),
+                         &sb->vl, ds, vl);
   if (status >= 0) {
     /* status == bytes added to the buffer */
-    send_buffer_fill += status;
-    send_buffer_ptr += status;
-    send_buffer_last_update = cdtime();
+    sb->fill += status;
+    sb->ptr += status;
+    sb->last_update = cdtime();
 
-    stats_values_sent++;
+    network_stats_add(&send_buffers_fill, status);
+    network_stats_add(&stats_values_sent, 1);
   } else {
-    flush_buffer();
+    flush_buffer(sb);
 
-    status = add_to_buffer(send_buffer_ptr,
+    status = add_to_buffer(sb->ptr,
                            network_config_packet_size -
-                               (send_buffer_fill + BUFF_SIG_SIZE),
-                           &send_buffer_vl, ds, vl);
+                               (sb->fill + BUFF_SIG_SIZE),
+                           &sb->vl, ds, vl);
 
     if (status >= 0) {
-      send_buffer_fill += status;
-      send_buffer_ptr += status;
+      sb->fill += status;
+      sb->ptr += status;
 
-      stats_values_sent++;
+      network_stats_add(&send_buffers_fill, status);
+      network_stats_add(&stats_values_sent, 1);
     }
   }
 
   if (status < 0) {
     ERROR("network plugin: Unable to append to the "
           "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
-    flush_buffer();
+  } else if ((network_config_packet_size - sb->fill) < 15) {
+    flush_buffer(sb);
   }
 
-  pthread_mutex_unlock(&send_buffer_lock);
+  pthread_mutex_unlock(&sb->lock);
+
+  network_flush_if_full();
 
   return (status < 0) ? -1 : 0;
 } /* int network_write */
@@ -2833,6 +4034,75 @@ static int network_config_set_buffer_size(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_set_buffer_size */
 
+static int network_config_set_rcvbuf(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if (tmp >= 0)
+    network_config_rcvbuf = tmp;
+  else {
+    WARNING("network plugin: The `ReceiveBufferSize' must not be negative.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_rcvbuf */
+
+static int network_config_set_threads(const oconfig_item_t *ci, /* {{{ */
+                                      size_t *ret_threads) {
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  else if ((tmp >= 1) && (tmp <= 64))
+    *ret_threads = (size_t)tmp;
+  else {
+    WARNING("network plugin: The `%s' option must be between 1 and 64.",
+            ci->key);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_threads */
+
+static int network_config_set_protocol(const oconfig_item_t *ci, /* {{{ */
+                                       int *retval) {
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    WARNING("network plugin: The `Protocol' config option needs exactly "
+            "one string argument.");
+    return -1;
+  }
+
+  char *str = ci->values[0].value.string;
+  if (strcasecmp("UDP", str) == 0)
+    *retval = IPPROTO_UDP;
+  else if (strcasecmp("TCP", str) == 0)
+    *retval = IPPROTO_TCP;
+  else {
+    WARNING("network plugin: Unknown protocol: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_protocol */
+
+static int network_config_set_stream_buffer_size( /* {{{ */
+    const oconfig_item_t *ci, size_t *retval) {
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  if (tmp <= 0) {
+    WARNING("network plugin: The `StreamBufferSize' option must be positive.");
+    return -1;
+  }
+
+  *retval = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_stream_buffer_size */
+
 #if HAVE_GCRYPT_H
 static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
                                              int *retval) {
@@ -2857,6 +4127,29 @@ static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
 
   return 0;
 } /* }}} int network_config_set_security_level */
+
+static int network_config_set_cipher(oconfig_item_t *ci, /* {{{ */
+                                     int *retval) {
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    WARNING("network plugin: The `Cipher' config option needs exactly "
+            "one string argument.");
+    return -1;
+  }
+
+  char *str = ci->values[0].value.string;
+  if (strcasecmp("AES-256-OFB", str) == 0)
+    *retval = GCRY_CIPHER_MODE_OFB;
+#if NETWORK_HAVE_GCM
+  else if (strcasecmp("AES-256-GCM", str) == 0)
+    *retval = GCRY_CIPHER_MODE_GCM;
+#endif
+  else {
+    WARNING("network plugin: Unknown or unsupported cipher: %s.", str);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_cipher */
 #endif /* HAVE_GCRYPT_H */
 
 static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
@@ -2895,6 +4188,8 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->protocol);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2971,6 +4266,8 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &se->data.client.password);
     else if (strcasecmp("SecurityLevel", child->key) == 0)
       network_config_set_security_level(child, &se->data.client.security_level);
+    else if (strcasecmp("Cipher", child->key) == 0)
+      network_config_set_cipher(child, &se->data.client.cypher_mode);
     else
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
@@ -2979,7 +4276,19 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       network_config_set_bind_address(child, &se->data.client.bind_addr);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
-    else {
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->protocol);
+    else if (strcasecmp("StreamBufferSize", child->key) == 0)
+      network_config_set_stream_buffer_size(
+          child, &se->data.client.stream_buffer_size);
+    else if (strcasecmp("Compress", child->key) == 0) {
+#if HAVE_ZLIB
+      cf_util_get_boolean(child, &se->data.client.compress);
+#else
+      WARNING("network plugin: The `Compress' option requires zlib, which "
+              "was not available at compile time.");
+#endif
+    } else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
   }
@@ -3024,8 +4333,21 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("TimeToLive", child->key) == 0)
       network_config_set_ttl(child);
+    else if (strcasecmp("ReceiveBufferSize", child->key) == 0)
+      network_config_set_rcvbuf(child);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      network_config_set_threads(child, &network_config_receive_threads);
+    else if (strcasecmp("DispatchThreads", child->key) == 0)
+      network_config_set_threads(child, &network_config_dispatch_threads);
   }
 
+#ifndef SO_REUSEPORT
+  if (network_config_receive_threads > 1)
+    WARNING("network plugin: SO_REUSEPORT is not available, so each address "
+            "is read by one of the %" PRIsz " receive threads only.",
+            network_config_receive_threads);
+#endif
+
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -3033,10 +4355,17 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
       network_config_add_listen(child);
     else if (strcasecmp("Server", child->key) == 0)
       network_config_add_server(child);
-    else if (strcasecmp("TimeToLive", child->key) == 0) {
+    else if ((strcasecmp("TimeToLive", child->key) == 0) ||
+             (strcasecmp("ReceiveBufferSize", child->key) == 0) ||
+             (strcasecmp("ReceiveThreads", child->key) == 0) ||
+             (strcasecmp("DispatchThreads", child->key) == 0)) {
       /* Handled earlier */
     } else if (strcasecmp("MaxPacketSize", child->key) == 0)
       network_config_set_buffer_size(child);
+    else if (strcasecmp("Relay", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_relay);
+    else if (strcasecmp("RelayAggregate", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_relay_aggregate);
     else if (strcasecmp("Forward", child->key) == 0)
       cf_util_get_boolean(child, &network_config_forward);
     else if (strcasecmp("ReportStats", child->key) == 0)
@@ -3120,31 +4449,64 @@ static int network_notification(const notification_t *n,
 static int network_shutdown(void) {
   listen_loop++;
 
-  /* Kill the listening thread */
-  if (receive_thread_running != 0) {
-    INFO("network plugin: Stopping receive thread.");
-    pthread_kill(receive_thread_id, SIGTERM);
-    pthread_join(receive_thread_id, NULL /* no return value */);
-    memset(&receive_thread_id, 0, sizeof(receive_thread_id));
-    receive_thread_running = 0;
+  /* Kill the listening threads */
+  if (receive_threads_num > 0)
+    INFO("network plugin: Stopping receive thread%s.",
+         (receive_threads_num > 1) ? "s" : "");
+  for (size_t i = 0; i < receive_threads_num; i++) {
+    pthread_kill(receive_threads[i], SIGTERM);
+    pthread_join(receive_threads[i], NULL /* no return value */);
   }
-
-  /* Shutdown the dispatching thread */
-  if (dispatch_thread_running != 0) {
-    INFO("network plugin: Stopping dispatch thread.");
-    pthread_mutex_lock(&receive_list_lock);
-    pthread_cond_broadcast(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-    pthread_join(dispatch_thread_id, /* ret = */ NULL);
-    dispatch_thread_running = 0;
+  sfree(receive_threads);
+  receive_threads_num = 0;
+
+  if (stream_thread_running) {
+    INFO("network plugin: Stopping stream thread.");
+    pthread_kill(stream_thread, SIGTERM);
+    pthread_join(stream_thread, NULL);
+    stream_thread_running = false;
   }
 
-  sockent_destroy(listen_sockets);
+  /* Shutdown the dispatching threads */
+  if (receive_queues_num > 0)
+    INFO("network plugin: Stopping dispatch thread%s.",
+         (receive_queues_num > 1) ? "s" : "");
+  for (size_t i = 0; i < receive_queues_num; i++) {
+    receive_queue_t *q = receive_queues + i;
+
+    if (q->thread_running) {
+      pthread_mutex_lock(&q->lock);
+      pthread_cond_broadcast(&q->cond);
+      pthread_mutex_unlock(&q->lock);
+      pthread_join(q->thread, /* ret = */ NULL);
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+  }
+  sfree(receive_queues);
+  receive_queues_num = 0;
 
-  if (send_buffer_fill > 0)
-    flush_buffer();
+  c_mempool_destroy(receive_pool);
+  receive_pool = NULL;
 
-  sfree(send_buffer);
+  sockent_destroy(listen_sockets);
+  sfree(stream_sockets);
+  stream_sockets_num = 0;
+
+  /* The write threads are gone by now, so no buffers are added anymore. */
+  network_flush(/* timeout = */ 0, /* identifier = */ NULL,
+                /* user_data = */ NULL);
+  if (send_buffers != NULL)
+    pthread_setspecific(send_buffer_key, NULL);
+  while (send_buffers != NULL) {
+    send_buffer_t *next = send_buffers->next;
+    pthread_mutex_destroy(&send_buffers->lock);
+    sfree(send_buffers->buffer);
+    sfree(send_buffers);
+    send_buffers = next;
+  }
+  send_buffers_num = 0;
+  send_buffers_fill = 0;
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -3164,6 +4526,7 @@ static int network_stats_read(void) /* {{{ */
   derive_t copy_octets_tx;
   derive_t copy_packets_rx;
   derive_t copy_packets_tx;
+  derive_t copy_packets_dropped;
   derive_t copy_values_dispatched;
   derive_t copy_values_not_dispatched;
   derive_t copy_values_sent;
@@ -3176,11 +4539,14 @@ static int network_stats_read(void) /* {{{ */
   copy_octets_tx = stats_octets_tx;
   copy_packets_rx = stats_packets_rx;
   copy_packets_tx = stats_packets_tx;
+  copy_packets_dropped = stats_packets_dropped;
   copy_values_dispatched = stats_values_dispatched;
   copy_values_not_dispatched = stats_values_not_dispatched;
   copy_values_sent = stats_values_sent;
   copy_values_not_sent = stats_values_not_sent;
-  copy_receive_list_length = receive_list_length;
+  copy_receive_list_length = 0;
+  for (size_t i = 0; i < receive_queues_num; i++)
+    copy_receive_list_length += (derive_t)receive_queues[i].list.length;
 
   /* Initialize `vl' */
   vl.values = values;
@@ -3200,6 +4566,12 @@ static int network_stats_read(void) /* {{{ */
   sstrncpy(vl.type, "if_packets", sizeof(vl.type));
   plugin_dispatch_values(&vl);
 
+  /* Packets dropped by the kernel because the receive buffer was full */
+  vl.values_len = 1;
+  vl.values[0].derive = copy_packets_dropped;
+  sstrncpy(vl.type, "if_rx_dropped", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
   /* Values (not) dispatched and (not) send */
   sstrncpy(vl.type, "total_values", sizeof(vl.type));
   vl.values_len = 1;
@@ -3243,12 +4615,9 @@ static int network_init(void) {
 
   plugin_register_shutdown("network", network_shutdown);
 
-  send_buffer = malloc(network_config_packet_size);
-  if (send_buffer == NULL) {
-    ERROR("network plugin: malloc failed.");
-    return -1;
-  }
-  network_init_buffer();
+  if (network_config_relay && (sending_sockets == NULL))
+    WARNING("network plugin: `Relay' is enabled, but no `Server' is "
+            "configured. Received data will be dropped.");
 
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
@@ -3258,30 +4627,85 @@ static int network_init(void) {
                                  /* user_data = */ NULL);
   }
 
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    size_t min_size = STREAM_FRAME_HEADER_SIZE + network_config_packet_size;
+    if ((se->protocol == IPPROTO_TCP) &&
+        (se->data.client.stream_buffer_size < min_size)) {
+      WARNING("network plugin: StreamBufferSize of server \"%s\" is smaller "
+              "than MaxPacketSize. Using %" PRIsz " bytes.",
+              se->node, min_size);
+      se->data.client.stream_buffer_size = min_size;
+    }
+  }
+  sockent_group_clients(sending_sockets);
+
   /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
+  if (((listen_sockets_num == 0) && (stream_sockets_num == 0)) ||
+      (receive_queues != NULL))
     return 0;
 
-  if (dispatch_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&dispatch_thread_id, dispatch_thread,
-                                  NULL /* no argument */, "network disp");
+  if (receive_pool == NULL) {
+    receive_pool = c_mempool_create(
+        "network_receive",
+        sizeof(receive_list_entry_t) + network_config_packet_size);
+    if (receive_pool == NULL) {
+      ERROR("network plugin: c_mempool_create failed.");
+      return -1;
+    }
+  }
+
+  receive_queues =
+      calloc(network_config_dispatch_threads, sizeof(*receive_queues));
+  receive_threads =
+      calloc(network_config_receive_threads, sizeof(*receive_threads));
+  if ((receive_queues == NULL) || (receive_threads == NULL)) {
+    ERROR("network plugin: calloc failed.");
+    sfree(receive_queues);
+    sfree(receive_threads);
+    return -1;
+  }
+
+  for (size_t i = 0; i < network_config_dispatch_threads; i++) {
+    receive_queue_t *q = receive_queues + i;
+    char name[16];
+
+    pthread_mutex_init(&q->lock, /* attr = */ NULL);
+    pthread_cond_init(&q->cond, /* attr = */ NULL);
+    receive_queues_num++;
+
+    ssnprintf(name, sizeof(name), "network disp#%" PRIsz, i);
+    int status = plugin_thread_create(&q->thread, dispatch_thread, q, name);
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
     } else {
-      dispatch_thread_running = 1;
+      q->thread_running = true;
     }
   }
 
-  if (receive_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&receive_thread_id, receive_thread,
-                                  NULL /* no argument */, "network recv");
+  /* Threads without a socket of their own are not started. */
+  for (size_t i = 0; (i < network_config_receive_threads) &&
+                     (i < listen_sockets_num);
+       i++) {
+    char name[16];
+
+    ssnprintf(name, sizeof(name), "network recv#%" PRIsz, i);
+    int status = plugin_thread_create(receive_threads + receive_threads_num,
+                                      receive_thread, (void *)(uintptr_t)i,
+                                      name);
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
     } else {
-      receive_thread_running = 1;
+      receive_threads_num++;
+    }
+  }
+
+  if (stream_sockets_num > 0) {
+    int status = plugin_thread_create(&stream_thread, stream_receive_thread,
+                                      NULL, "network stream");
+    if (status != 0) {
+      ERROR("network: pthread_create failed: %s", STRERRNO);
+    } else {
+      stream_thread_running = true;
     }
   }
 
@@ -3298,19 +4722,29 @@ static int network_init(void) {
 static int network_flush(cdtime_t timeout,
                          __attribute__((unused)) const char *identifier,
                          __attribute__((unused)) user_data_t *user_data) {
-  pthread_mutex_lock(&send_buffer_lock);
-
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&send_buffers_lock);
+
+  send_buffer_t *due[send_buffers_num + 1];
+  size_t due_num = 0;
+  for (send_buffer_t *sb = send_buffers; sb != NULL; sb = sb->next) {
+    pthread_mutex_lock(&sb->lock);
+    if ((sb->fill > 0) &&
+        ((timeout == 0) || ((sb->last_update + timeout) <= now))) {
+      due[due_num++] = sb;
+      continue;
     }
-    flush_buffer();
+    pthread_mutex_unlock(&sb->lock);
   }
-  pthread_mutex_unlock(&send_buffer_lock);
+
+  /* Buffers are only removed by network_shutdown(), so the list lock is not
+   * needed while sending. */
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  flush_buffers(due, due_num);
+  for (size_t i = 0; i < due_num; i++)
+    pthread_mutex_unlock(&due[i]->lock);
 
   return 0;
 } /* int network_flush */
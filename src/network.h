@@ -69,6 +69,9 @@
 #define TYPE_VALUES 0x0006
 #define TYPE_INTERVAL 0x0007
 #define TYPE_INTERVAL_HR 0x0009
+/* Latency histogram belonging to the next values part, serialized with
+ * latency_counter_to_string(). */
+#define TYPE_HISTOGRAM 0x0010
 
 /* Types to transmit notifications */
 #define TYPE_MESSAGE 0x0100
@@ -76,5 +79,11 @@
 
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_ENCR_AES256_GCM 0x0211
+
+#define TYPE_COMPRESSED 0x0300
+
+/* Algorithms used in compressed parts */
+#define COMPRESSION_ZLIB 0x0001
 
 #endif /* NETWORK_H */
@@ -0,0 +1,439 @@
+/**
+ * collectd - src/network_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Measures how many packets per second parse_packet() handles. The packets are
+ * produced by the plugin's own write path from the values of a number of
+ * typical hosts, so identifiers are shared between values like on a real
+ * network, and are signed or encrypted like with the "SecurityLevel" option.
+ * Dispatching is done by the plugin mock, so this only measures parsing.
+ * Prints one line of JSON per case.
+ *
+ * With -o, the packets are also written to the given directory, one file per
+ * packet named "<case>-<number>". This is the seed corpus of the fuzz targets
+ * and the input of bench_libcollectd_network_parse.
+ *
+ * Usage: bench_plugin_network [-H <hosts>] [-T <seconds>] [-o <directory>]
+ *                             [<case> ...]
+ */
+
+#define TEST_PLUGIN_NETWORK 1
+
+#include "network.c" /* (sic) */
+
+#include <fcntl.h>
+#include <getopt.h>
+
+/* Credentials of signed and encrypted packets. The fuzz targets use the same
+ * ones, so that they get past the signature and decryption. */
+#define BENCH_USERNAME "bench"
+#define BENCH_PASSWORD "bench-secret"
+
+typedef struct {
+  char const *name;
+  int security_level;
+  int cypher_mode;
+  bool compress;
+
+  char **packets;
+  size_t *packets_size;
+  size_t packets_num;
+  size_t values_num;
+} bench_case_t;
+
+static size_t conf_hosts_num = 16;
+static double conf_duration = 0.5;
+static char const *conf_output_dir;
+
+static sockent_t *server;
+
+static bench_case_t cases[] = {
+    {"plain", SECURITY_LEVEL_NONE, 0, false},
+#if HAVE_ZLIB
+    {"compressed", SECURITY_LEVEL_NONE, 0, true},
+#endif
+#if HAVE_GCRYPT_H
+    {"sign", SECURITY_LEVEL_SIGN, 0, false},
+    {"encrypt", SECURITY_LEVEL_ENCRYPT, GCRY_CIPHER_MODE_OFB, false},
+#if NETWORK_HAVE_GCM
+    {"encrypt-gcm", SECURITY_LEVEL_ENCRYPT, GCRY_CIPHER_MODE_GCM, false},
+#endif
+#endif
+};
+
+static data_source_t ds_derive[] = {{"value", DS_TYPE_DERIVE, 0, NAN}};
+static data_source_t ds_gauge[] = {{"value", DS_TYPE_GAUGE, NAN, NAN}};
+static data_source_t ds_rx_tx[] = {{"rx", DS_TYPE_DERIVE, 0, NAN},
+                                   {"tx", DS_TYPE_DERIVE, 0, NAN}};
+static data_source_t ds_load[] = {{"shortterm", DS_TYPE_GAUGE, 0, 5000},
+                                  {"midterm", DS_TYPE_GAUGE, 0, 5000},
+                                  {"longterm", DS_TYPE_GAUGE, 0, 5000}};
+
+static data_set_t set_cpu = {"cpu", 1, ds_derive};
+static data_set_t set_memory = {"memory", 1, ds_gauge};
+static data_set_t set_df = {"df_complex", 1, ds_gauge};
+static data_set_t set_load = {"load", 3, ds_load};
+static data_set_t set_if_octets = {"if_octets", 2, ds_rx_tx};
+static data_set_t set_if_packets = {"if_packets", 2, ds_rx_tx};
+static data_set_t set_if_errors = {"if_errors", 2, ds_rx_tx};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Moves the complete frames that `fd' has to offer to the case's packets. */
+static int read_frames(int fd, bench_case_t *c) {
+  static char buffer[2 * (STREAM_FRAME_HEADER_SIZE + UINT16_MAX)];
+  static size_t fill;
+
+  while (42) {
+    ssize_t status =
+        recv(fd, buffer + fill, sizeof(buffer) - fill, MSG_DONTWAIT);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      return errno;
+    } else if (status == 0) {
+      return 0;
+    }
+    fill += (size_t)status;
+
+    while (fill >= STREAM_FRAME_HEADER_SIZE) {
+      uint16_t frame_len;
+      memcpy(&frame_len, buffer, sizeof(frame_len));
+      size_t size = ntohs(frame_len);
+      if (fill < STREAM_FRAME_HEADER_SIZE + size)
+        break;
+
+      char **packets =
+          realloc(c->packets, (c->packets_num + 1) * sizeof(*packets));
+      if (packets == NULL)
+        return ENOMEM;
+      c->packets = packets;
+      size_t *packets_size = realloc(
+          c->packets_size, (c->packets_num + 1) * sizeof(*packets_size));
+      if (packets_size == NULL)
+        return ENOMEM;
+      c->packets_size = packets_size;
+
+      c->packets[c->packets_num] = malloc(size);
+      if (c->packets[c->packets_num] == NULL)
+        return ENOMEM;
+      memcpy(c->packets[c->packets_num], buffer + STREAM_FRAME_HEADER_SIZE,
+             size);
+      c->packets_size[c->packets_num] = size;
+      c->packets_num++;
+
+      fill -= STREAM_FRAME_HEADER_SIZE + size;
+      memmove(buffer, buffer + STREAM_FRAME_HEADER_SIZE + size, fill);
+    }
+  }
+}
+
+static void write_value(data_set_t const *ds, size_t host, cdtime_t t,
+                        char const *plugin, char const *plugin_instance,
+                        char const *type_instance, double value) {
+  value_t values[ds->ds_num];
+  value_list_t vl = {
+      .values = values,
+      .values_len = ds->ds_num,
+      .time = t,
+      .interval = TIME_T_TO_CDTIME_T(10),
+  };
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    if (ds->ds[i].type == DS_TYPE_GAUGE)
+      values[i].gauge = value + (double)i;
+    else
+      values[i].derive = (derive_t)value + (derive_t)i;
+  }
+
+  ssnprintf(vl.host, sizeof(vl.host), "host%03zu.example.com", host);
+  sstrncpy(vl.plugin, plugin, sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, ds->type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  network_write(ds, &vl, NULL);
+}
+
+/* Writes one interval's worth of values of a host. */
+static void write_host(size_t host, cdtime_t t) {
+  char const *cpu_states[] = {"user", "nice",      "system",  "idle",
+                              "wait", "interrupt", "softirq", "steal"};
+  char const *memory_states[] = {"used",     "buffered",    "cached",
+                                 "free",     "slab_recl",   "slab_unrecl"};
+  char const *df_states[] = {"used", "free", "reserved"};
+  char const *mount_points[] = {"root", "boot", "var", "tmp", "home", "data"};
+  char const *interfaces[] = {"lo", "eth0", "eth1", "docker0"};
+  char instance[DATA_MAX_NAME_LEN];
+  double v = (double)(host * 1000);
+
+  for (size_t i = 0; i < 8; i++) {
+    ssnprintf(instance, sizeof(instance), "%zu", i);
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(cpu_states); j++)
+      write_value(&set_cpu, host, t, "cpu", instance, cpu_states[j], v++);
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(memory_states); i++)
+    write_value(&set_memory, host, t, "memory", "", memory_states[i], v++);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(mount_points); i++)
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(df_states); j++)
+      write_value(&set_df, host, t, "df", mount_points[i], df_states[j], v++);
+
+  write_value(&set_load, host, t, "load", "", "", 0.5);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(interfaces); i++) {
+    write_value(&set_if_octets, host, t, "interface", interfaces[i], "", v++);
+    write_value(&set_if_packets, host, t, "interface", interfaces[i], "", v++);
+    write_value(&set_if_errors, host, t, "interface", interfaces[i], "", v++);
+  }
+}
+
+/* Produces the case's packets by writing values to a TCP client socket and
+ * reading the frames from the other end of a socket pair. */
+static int generate_packets(bench_case_t *c) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    return errno;
+
+  sockent_t *se = sockent_create(SOCKENT_TYPE_CLIENT);
+  if (se == NULL) {
+    close(fds[0]);
+    close(fds[1]);
+    return ENOMEM;
+  }
+  se->protocol = IPPROTO_TCP;
+  se->data.client.fd = fds[0];
+  se->data.client.compress = c->compress;
+#if HAVE_GCRYPT_H
+  se->data.client.security_level = c->security_level;
+  se->data.client.username = sstrdup(BENCH_USERNAME);
+  se->data.client.password = sstrdup(BENCH_PASSWORD);
+  if (c->cypher_mode != 0)
+    se->data.client.cypher_mode = c->cypher_mode;
+#endif
+  int status = sockent_init_crypto(se);
+  if (status != 0) {
+    sockent_destroy(se);
+    close(fds[1]);
+    return status;
+  }
+
+  sending_sockets = se;
+  derive_t sent = stats_values_sent;
+  cdtime_t t = TIME_T_TO_CDTIME_T(1700000000);
+
+  for (size_t i = 0; (i < conf_hosts_num) && (status == 0); i++) {
+    write_host(i, t);
+    status = read_frames(fds[1], c);
+  }
+  network_flush(0, NULL, NULL);
+  if (status == 0)
+    status = read_frames(fds[1], c);
+
+  c->values_num = (size_t)(stats_values_sent - sent);
+  sending_sockets = NULL;
+  sockent_destroy(se);
+  close(fds[1]);
+
+  return status;
+}
+
+static int write_corpus(bench_case_t const *c) {
+  for (size_t i = 0; i < c->packets_num; i++) {
+    char file[PATH_MAX];
+    ssnprintf(file, sizeof(file), "%s/%s-%04zu", conf_output_dir, c->name, i);
+
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      fprintf(stderr, "open(%s): %s\n", file, STRERRNO);
+      return -1;
+    }
+    int status = swrite(fd, c->packets[i], c->packets_size[i]);
+    close(fd);
+    if (status != 0) {
+      fprintf(stderr, "write(%s) failed.\n", file);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Creates the receiving socket, which knows the credentials of the packets. */
+static int create_server(char *auth_file) {
+  int fd = mkstemp(auth_file);
+  if (fd < 0)
+    return errno;
+  char line[] = BENCH_USERNAME ": " BENCH_PASSWORD "\n";
+  int status = swrite(fd, line, strlen(line));
+  close(fd);
+  if (status != 0)
+    return EIO;
+
+  server = sockent_create(SOCKENT_TYPE_SERVER);
+  if (server == NULL)
+    return ENOMEM;
+#if HAVE_GCRYPT_H
+  server->data.server.auth_file = sstrdup(auth_file);
+#endif
+  return sockent_init_crypto(server);
+}
+
+static void run_case(bench_case_t *c) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < c->packets_num; i++)
+    bytes += c->packets_size[i];
+
+  /* Decryption works in place, so every round parses a copy. */
+  char *scratch = malloc(bytes);
+  if (scratch == NULL) {
+    fprintf(stderr, "%s: malloc failed.\n", c->name);
+    return;
+  }
+
+  uint64_t num = 0;
+  uint64_t failed = 0;
+  double copy = 0.0;
+  derive_t dispatched = stats_values_dispatched;
+
+  double start = now();
+  double elapsed;
+  do {
+    double copy_start = now();
+    char *ptr = scratch;
+    for (size_t i = 0; i < c->packets_num; i++) {
+      memcpy(ptr, c->packets[i], c->packets_size[i]);
+      ptr += c->packets_size[i];
+    }
+    copy += now() - copy_start;
+
+    ptr = scratch;
+    for (size_t i = 0; i < c->packets_num; i++) {
+      if (parse_packet(server, ptr, c->packets_size[i], 0, NULL, NULL) != 0)
+        failed++;
+      ptr += c->packets_size[i];
+    }
+    num += c->packets_num;
+    elapsed = now() - start;
+  } while (elapsed < conf_duration);
+
+  double values_per_packet =
+      (double)(stats_values_dispatched - dispatched) / (double)num;
+  printf("{\"case\":\"%s\",\"packets\":%" PRIu64 ",\"failed\":%" PRIu64
+         ",\"bytes_per_packet\":%.1f,\"values_per_packet\":%.1f,"
+         "\"ns_per_packet\":%.1f,\"packets_per_second\":%.0f}\n",
+         c->name, num, failed, (double)bytes / (double)c->packets_num,
+         values_per_packet, 1e9 * (elapsed - copy) / (double)num,
+         (double)num / (elapsed - copy));
+  fflush(stdout);
+
+  if (values_per_packet * (double)c->packets_num < (double)c->values_num)
+    fprintf(stderr, "%s: %zu values were sent, but only %.0f per round were "
+                    "parsed.\n",
+            c->name, c->values_num, values_per_packet * (double)c->packets_num);
+
+  free(scratch);
+}
+
+__attribute__((noreturn)) static void exit_usage(char const *name,
+                                                 int status) {
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr,
+          "Usage: %s [-H <hosts>] [-T <seconds>] [-o <directory>] "
+          "[<case> ...]\n"
+          "\n"
+          "Cases:",
+          name);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    fprintf((status == EXIT_SUCCESS) ? stdout : stderr, " %s", cases[i].name);
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr, "\n");
+  exit(status);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "H:T:o:h")) != -1) {
+    switch (opt) {
+    case 'H':
+      conf_hosts_num = (size_t)strtoull(optarg, NULL, 0);
+      break;
+    case 'T':
+      conf_duration = atof(optarg);
+      break;
+    case 'o':
+      conf_output_dir = optarg;
+      break;
+    case 'h':
+      exit_usage(argv[0], EXIT_SUCCESS);
+    default:
+      exit_usage(argv[0], EXIT_FAILURE);
+    }
+  }
+  if (conf_hosts_num == 0)
+    exit_usage(argv[0], EXIT_FAILURE);
+
+  char auth_file[] = "/tmp/bench_plugin_network.XXXXXX";
+  int status = create_server(auth_file);
+  if (status != 0) {
+    fprintf(stderr, "Creating the server socket failed: %s\n",
+            STRERROR(status));
+    return 1;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    bench_case_t *c = cases + i;
+    bool selected = (optind >= argc);
+    for (int j = optind; j < argc; j++)
+      if (strcmp(argv[j], c->name) == 0)
+        selected = true;
+    if (!selected)
+      continue;
+
+    status = generate_packets(c);
+    if ((status != 0) || (c->packets_num == 0)) {
+      fprintf(stderr, "%s: generating packets failed: %s\n", c->name,
+              STRERROR(status));
+      continue;
+    }
+    if ((conf_output_dir != NULL) && (write_corpus(c) != 0))
+      break;
+
+    run_case(c);
+
+    for (size_t j = 0; j < c->packets_num; j++)
+      free(c->packets[j]);
+    sfree(c->packets);
+    sfree(c->packets_size);
+    c->packets_num = 0;
+  }
+
+  sockent_destroy(server);
+  unlink(auth_file);
+  return 0;
+}
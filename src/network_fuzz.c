@@ -0,0 +1,78 @@
+/**
+ * collectd - src/network_fuzz.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * libFuzzer entry point for parse_packet(). The receiving socket knows the
+ * credentials used by bench_plugin_network, so that the signed and encrypted
+ * packets of its corpus ("bench_plugin_network -o <directory>") get past the
+ * signature and decryption.
+ */
+
+#define TEST_PLUGIN_NETWORK 1
+
+#include "network.c" /* (sic) */
+
+static sockent_t *server;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerInitialize(__attribute__((unused)) int *argc,
+                         __attribute__((unused)) char ***argv) {
+  server = sockent_create(SOCKENT_TYPE_SERVER);
+  if (server == NULL)
+    abort();
+
+#if HAVE_GCRYPT_H
+  char auth_file[] = "/tmp/fuzz_plugin_network.XXXXXX";
+  int fd = mkstemp(auth_file);
+  if (fd < 0)
+    abort();
+  char line[] = "bench: bench-secret\n";
+  if (swrite(fd, line, strlen(line)) != 0)
+    abort();
+  close(fd);
+
+  server->data.server.auth_file = sstrdup(auth_file);
+  if (sockent_init_crypto(server) != 0)
+    abort();
+  /* The user database has been read; it is reread only if the file changes. */
+  unlink(auth_file);
+#endif
+
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  /* parse_packet() decrypts in place, so it needs a writable copy. */
+  void *buffer = malloc((size > 0) ? size : 1);
+  if (buffer == NULL)
+    return 0;
+  memcpy(buffer, data, size);
+
+  parse_packet(server, buffer, size, /* flags = */ 0, /* username = */ NULL,
+               /* address = */ NULL);
+
+  free(buffer);
+  return 0;
+}
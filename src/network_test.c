@@ -239,8 +239,111 @@ DEF_TEST(parse_packet) {
   return 0;
 }
 
+DEF_TEST(stream_read) {
+  int fds[2];
+  CHECK_ZERO(socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  receive_queue_t q = {0};
+  receive_queues = &q;
+  receive_queues_num = 1;
+  CHECK_NOT_NULL(receive_pool = c_mempool_create(
+                     "network_test", sizeof(receive_list_entry_t) +
+                                         network_config_packet_size));
+
+  stream_connection_t c = {
+      .fd = fds[1],
+      .listen_fd = 42,
+  };
+  CHECK_NOT_NULL(
+      c.buffer = malloc(STREAM_FRAME_HEADER_SIZE + network_config_packet_size));
+  receive_list_t list = {0};
+
+  /* One complete frame and the first half of another one. */
+  char data[] = {0, 3, 'a', 'b', 'c', 0, 4, 'd', 'e'};
+  EXPECT_EQ_INT(9, (int)write(fds[0], data, sizeof(data)));
+  EXPECT_EQ_INT(0, network_stream_read(&c, &list));
+  EXPECT_EQ_INT(1, (int)list.length);
+  EXPECT_EQ_INT(3, list.head->data_len);
+  EXPECT_EQ_INT(42, list.head->fd);
+  OK(memcmp("abc", list.head->data, 3) == 0);
+  EXPECT_EQ_INT(4, (int)c.buffer_fill);
+
+  EXPECT_EQ_INT(2, (int)write(fds[0], "fg", 2));
+  EXPECT_EQ_INT(0, network_stream_read(&c, &list));
+  EXPECT_EQ_INT(2, (int)list.length);
+  OK(memcmp("defg", list.tail->data, 4) == 0);
+  EXPECT_EQ_INT(0, (int)c.buffer_fill);
+
+  /* Frames larger than MaxPacketSize close the connection. */
+  char huge[] = {(char)0xff, (char)0xff};
+  EXPECT_EQ_INT(2, (int)write(fds[0], huge, sizeof(huge)));
+  OK(network_stream_read(&c, &list) != 0);
+
+  /* So does closing the other end. */
+  c.buffer_fill = 0;
+  close(fds[0]);
+  OK(network_stream_read(&c, &list) != 0);
+
+  while (list.head != NULL) {
+    receive_list_entry_t *next = list.head->next;
+    c_mempool_free(receive_pool, list.head);
+    list.head = next;
+  }
+  c_mempool_destroy(receive_pool);
+  receive_pool = NULL;
+  receive_queues = NULL;
+  receive_queues_num = 0;
+  free(c.buffer);
+  close(fds[1]);
+  return 0;
+}
+
+DEF_TEST(relay) {
+  for (size_t i = 0; i < sizeof(raw_packet_data) / sizeof(raw_packet_data[0]);
+       i++) {
+    uint8_t buffer[network_config_packet_size];
+    size_t buffer_size = sizeof(buffer);
+
+    EXPECT_EQ_INT(0, decode_string(raw_packet_data[i], buffer, &buffer_size));
+    EXPECT_EQ_INT((int)buffer_size,
+                  (int)network_relay_size((char *)buffer, buffer_size));
+  }
+
+  /* A host part, a values part with the wrong length and a signature. */
+  char data[] = {0, TYPE_HOST, 0, 6, 'a', 0, 0, TYPE_VALUES, 0, 7, 0, 2, 0};
+  EXPECT_EQ_INT(6, (int)network_relay_size(data, sizeof(data)));
+  char sign[] = {0, TYPE_HOST, 0, 6, 'a', 0, 2, 0, 0, 4};
+  EXPECT_EQ_INT(6, (int)network_relay_size(sign, sizeof(sign)));
+  /* Strings must be null-terminated. */
+  char string[] = {0, TYPE_PLUGIN, 0, 6, 'a', 'b'};
+  EXPECT_EQ_INT(0, (int)network_relay_size(string, sizeof(string)));
+
+  /* Aggregated packets are separated by empty identifier parts. */
+  send_buffer_t *sb;
+  CHECK_NOT_NULL(sb = send_buffer_get());
+  network_config_relay_aggregate = true;
+  network_relay(data, 6);
+  network_relay(data, 6);
+  EXPECT_EQ_INT(12 + (int)RELAY_RESET_SIZE, sb->fill);
+  OK(memcmp(sb->buffer + 6, "\0\0\0\5\0", 5) == 0);
+  OK(memcmp(sb->buffer + 6 + RELAY_RESET_SIZE, data, 6) == 0);
+  OK(sb->relayed);
+  network_config_relay_aggregate = false;
+
+  /* Each thread has its own buffer; flushing resets all of them. */
+  OK(send_buffer_get() == sb);
+  EXPECT_EQ_INT(1, (int)send_buffers_num);
+  EXPECT_EQ_INT(0, network_flush(0, NULL, NULL));
+  EXPECT_EQ_INT(0, sb->fill);
+  EXPECT_EQ_INT(12 + (int)RELAY_RESET_SIZE, (int)stats_octets_tx);
+
+  return 0;
+}
+
 int main() {
   RUN_TEST(parse_packet);
+  RUN_TEST(stream_read);
+  RUN_TEST(relay);
 
   END_TEST;
 }
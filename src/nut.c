@@ -40,80 +40,147 @@ typedef UPSCONN collectd_upsconn_t;
 #error "Unable to determine the UPS connection type."
 #endif
 
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
 struct nut_ups_s;
 typedef struct nut_ups_s nut_ups_t;
 struct nut_ups_s {
-  collectd_upsconn_t *conn;
   char *upsname;
+  nut_ups_t *next;
+};
+
+/* A upsd server. All of its UPSes are read over a single connection: the
+ * "LIST VAR" requests for all of them are sent at once, before the first
+ * reply is read. */
+struct nut_host_s;
+typedef struct nut_host_s nut_host_t;
+struct nut_host_s {
+  collectd_upsconn_t *conn;
   char *hostname;
   NUT_PORT_TYPE port;
-  nut_ups_t *next;
+  nut_ups_t *ups;
+  char *request;
+  size_t request_len;
+  nut_host_t *next;
 };
 
-static const char *config_keys[] = {"UPS", "FORCESSL", "VERIFYPEER", "CAPATH",
-                                    "CONNECTTIMEOUT"};
+static const char *config_keys[] = {"UPS",    "FORCESSL",       "VERIFYPEER",
+                                    "CAPATH", "CONNECTTIMEOUT", "TIMEOUT"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int force_ssl;   // Initialized to default of 0 (false)
 static int verify_peer; // Initialized to default of 0 (false)
 static int ssl_flags = UPSCLI_CONN_TRYSSL;
 static int connect_timeout = -1;
+static int read_timeout = -1;
 static char *ca_path;
 
+/* Hosts configured so far. They are registered as read callbacks by
+ * nut_init(), which then hands them over to the daemon. */
+static nut_host_t *host_list;
+
 static int nut_read(user_data_t *user_data);
 
-static void free_nut_ups_t(void *arg) {
-  nut_ups_t *ups = arg;
+static void free_nut_host_t(void *arg) {
+  nut_host_t *host = arg;
+
+  if (host->conn != NULL) {
+    upscli_disconnect(host->conn);
+    sfree(host->conn);
+  }
+
+  while (host->ups != NULL) {
+    nut_ups_t *next = host->ups->next;
+    sfree(host->ups->upsname);
+    sfree(host->ups);
+    host->ups = next;
+  }
+
+  sfree(host->request);
+  sfree(host->hostname);
+  sfree(host);
+} /* void free_nut_host_t */
 
-  if (ups->conn != NULL) {
-    upscli_disconnect(ups->conn);
-    sfree(ups->conn);
+static void nut_free_host_list(void) {
+  while (host_list != NULL) {
+    nut_host_t *next = host_list->next;
+    free_nut_host_t(host_list);
+    host_list = next;
   }
-  sfree(ups->hostname);
-  sfree(ups->upsname);
-  sfree(ups);
-} /* void free_nut_ups_t */
+} /* void nut_free_host_list */
 
 static int nut_add_ups(const char *name) {
-  nut_ups_t *ups;
+  char *upsname = NULL;
+  char *hostname = NULL;
+  NUT_PORT_TYPE port;
   int status;
-  char *cb_name;
 
   DEBUG("nut plugin: nut_add_ups (name = %s);", name);
 
-  ups = calloc(1, sizeof(*ups));
-  if (ups == NULL) {
-    ERROR("nut plugin: nut_add_ups: calloc failed.");
-    return 1;
-  }
-
-  status = upscli_splitname(name, &ups->upsname, &ups->hostname, &ups->port);
+  status = upscli_splitname(name, &upsname, &hostname, &port);
   if (status != 0) {
     ERROR("nut plugin: nut_add_ups: upscli_splitname (%s) failed.", name);
-    free_nut_ups_t(ups);
+    sfree(upsname);
+    sfree(hostname);
     return 1;
   }
 
-  cb_name = ssnprintf_alloc("nut/%s", name);
-
-  status = plugin_register_complex_read(
-      /* group     = */ "nut",
-      /* name      = */ cb_name,
-      /* callback  = */ nut_read,
-      /* interval  = */ 0,
-      /* user_data = */
-      &(user_data_t){
-          .data = ups,
-          .free_func = free_nut_ups_t,
-      });
-
-  sfree(cb_name);
-
-  if (status == EINVAL) {
-    WARNING("nut plugin: UPS \"%s\" already added. "
-            "Please check your configuration.",
-            name);
-    return -1;
+  nut_host_t *host = NULL;
+  nut_host_t *last = NULL;
+  for (nut_host_t *h = host_list; h != NULL; h = h->next) {
+    if ((strcasecmp(h->hostname, hostname) == 0) && (h->port == port)) {
+      host = h;
+      break;
+    }
+    last = h;
+  }
+
+  if (host == NULL) {
+    host = calloc(1, sizeof(*host));
+    if (host == NULL) {
+      ERROR("nut plugin: nut_add_ups: calloc failed.");
+      sfree(upsname);
+      sfree(hostname);
+      return 1;
+    }
+    host->hostname = hostname;
+    host->port = port;
+    if (last == NULL)
+      host_list = host;
+    else
+      last->next = host;
+  } else {
+    sfree(hostname);
+  }
+
+  nut_ups_t *ups_last = NULL;
+  for (nut_ups_t *u = host->ups; u != NULL; u = u->next) {
+    if (strcmp(u->upsname, upsname) == 0) {
+      WARNING("nut plugin: UPS \"%s\" already added. "
+              "Please check your configuration.",
+              name);
+      sfree(upsname);
+      return -1;
+    }
+    ups_last = u;
+  }
+
+  nut_ups_t *ups = calloc(1, sizeof(*ups));
+  if (ups == NULL) {
+    ERROR("nut plugin: nut_add_ups: calloc failed.");
+    sfree(upsname);
+    return 1;
   }
+  ups->upsname = upsname;
+
+  if (ups_last == NULL)
+    host->ups = ups;
+  else
+    ups_last->next = ups;
 
   return 0;
 } /* int nut_add_ups */
@@ -171,6 +238,19 @@ static int nut_set_connect_timeout(const char *value) {
   return 0;
 } /* int nut_set_connect_timeout */
 
+static int nut_set_timeout(const char *value) {
+  long ret;
+
+  errno = 0;
+  ret = strtol(value, /* endptr = */ NULL, /* base = */ 10);
+  if ((errno == 0) && (ret > 0) && (ret <= INT_MAX))
+    read_timeout = (int)ret;
+  else
+    WARNING("nut plugin: The Timeout option requires a positive numeric "
+            "argument. Setting ignored.");
+  return 0;
+} /* int nut_set_timeout */
+
 static int nut_config(const char *key, const char *value) {
   if (strcasecmp(key, "UPS") == 0)
     return nut_add_ups(value);
@@ -182,18 +262,20 @@ static int nut_config(const char *key, const char *value) {
     return nut_ca_path(value);
   else if (strcasecmp(key, "CONNECTTIMEOUT") == 0)
     return nut_set_connect_timeout(value);
+  else if (strcasecmp(key, "TIMEOUT") == 0)
+    return nut_set_timeout(value);
   else
     return -1;
 } /* int nut_config */
 
-static void nut_submit(nut_ups_t *ups, const char *type,
+static void nut_submit(nut_host_t *host, nut_ups_t *ups, const char *type,
                        const char *type_instance, gauge_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &(value_t){.gauge = value};
   vl.values_len = 1;
-  if (strcasecmp(ups->hostname, "localhost") != 0)
-    sstrncpy(vl.host, ups->hostname, sizeof(vl.host));
+  if (strcasecmp(host->hostname, "localhost") != 0)
+    sstrncpy(vl.host, host->hostname, sizeof(vl.host));
   sstrncpy(vl.plugin, "nut", sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, ups->upsname, sizeof(vl.plugin_instance));
   sstrncpy(vl.type, type, sizeof(vl.type));
@@ -202,32 +284,106 @@ static void nut_submit(nut_ups_t *ups, const char *type,
   plugin_dispatch_values(&vl);
 } /* void nut_submit */
 
-static int nut_connect(nut_ups_t *ups) {
+static void nut_submit_var(nut_host_t *host, nut_ups_t *ups, const char *key,
+                           double value) {
+  if (strncmp("ambient.", key, 8) == 0) {
+    if (strcmp("ambient.humidity", key) == 0)
+      nut_submit(host, ups, "humidity", "ambient", value);
+    else if (strcmp("ambient.temperature", key) == 0)
+      nut_submit(host, ups, "temperature", "ambient", value);
+  } else if (strncmp("battery.", key, 8) == 0) {
+    if (strcmp("battery.charge", key) == 0)
+      nut_submit(host, ups, "percent", "charge", value);
+    else if (strcmp("battery.current", key) == 0)
+      nut_submit(host, ups, "current", "battery", value);
+    else if (strcmp("battery.runtime", key) == 0)
+      nut_submit(host, ups, "timeleft", "battery", value);
+    else if (strcmp("battery.temperature", key) == 0)
+      nut_submit(host, ups, "temperature", "battery", value);
+    else if (strcmp("battery.voltage", key) == 0)
+      nut_submit(host, ups, "voltage", "battery", value);
+  } else if (strncmp("input.", key, 6) == 0) {
+    if (strcmp("input.frequency", key) == 0)
+      nut_submit(host, ups, "frequency", "input", value);
+    else if (strcmp("input.voltage", key) == 0)
+      nut_submit(host, ups, "voltage", "input", value);
+    else if (strcmp("input.realpower", key) == 0)
+      nut_submit(host, ups, "power", "watt-input", value);
+    else if (strcmp("input.power", key) == 0)
+      nut_submit(host, ups, "power", "voltampere-input", value);
+  } else if (strncmp("output.", key, 7) == 0) {
+    if (strcmp("output.current", key) == 0)
+      nut_submit(host, ups, "current", "output", value);
+    else if (strcmp("output.frequency", key) == 0)
+      nut_submit(host, ups, "frequency", "output", value);
+    else if (strcmp("output.voltage", key) == 0)
+      nut_submit(host, ups, "voltage", "output", value);
+    else if (strcmp("output.realpower", key) == 0)
+      nut_submit(host, ups, "power", "watt-output", value);
+    else if (strcmp("output.power", key) == 0)
+      nut_submit(host, ups, "power", "voltampere-output", value);
+  } else if (strncmp("ups.", key, 4) == 0) {
+    if (strcmp("ups.load", key) == 0)
+      nut_submit(host, ups, "percent", "load", value);
+    else if (strcmp("ups.realpower", key) == 0)
+      nut_submit(host, ups, "power", "watt-ups", value);
+    else if (strcmp("ups.power", key) == 0)
+      nut_submit(host, ups, "power", "ups", value);
+    else if (strcmp("ups.temperature", key) == 0)
+      nut_submit(host, ups, "temperature", "ups", value);
+  }
+} /* void nut_submit_var */
+
+static void nut_disconnect(nut_host_t *host) {
+  upscli_disconnect(host->conn);
+  sfree(host->conn);
+} /* void nut_disconnect */
+
+/* Makes reads from and writes to the connection fail after "Timeout", so
+ * that an unresponsive upsd only blocks the read callback of its own host for
+ * that long. */
+static void nut_set_socket_timeout(nut_host_t *host) {
+  int fd = upscli_fd(host->conn);
+  if (fd < 0)
+    return;
+
+  struct timeval tv = {
+      .tv_sec = read_timeout / 1000,
+      .tv_usec = (read_timeout % 1000) * 1000,
+  };
+  if ((setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0) ||
+      (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0))
+    WARNING("nut plugin: Setting the timeout of the connection to (%s, %i) "
+            "failed: %s",
+            host->hostname, host->port, STRERRNO);
+} /* void nut_set_socket_timeout */
+
+static int nut_connect(nut_host_t *host) {
   int status, ssl_status;
 
 #if HAVE_UPSCLI_TRYCONNECT
   struct timeval tv;
   tv.tv_sec = connect_timeout / 1000;
-  tv.tv_usec = connect_timeout % 1000;
+  tv.tv_usec = (connect_timeout % 1000) * 1000;
 
   status =
-      upscli_tryconnect(ups->conn, ups->hostname, ups->port, ssl_flags, &tv);
+      upscli_tryconnect(host->conn, host->hostname, host->port, ssl_flags, &tv);
 #else /* #if HAVE_UPSCLI_TRYCONNECT */
-  status = upscli_connect(ups->conn, ups->hostname, ups->port, ssl_flags);
+  status = upscli_connect(host->conn, host->hostname, host->port, ssl_flags);
 #endif
 
   if (status != 0) {
     ERROR("nut plugin: nut_connect: upscli_connect (%s, %i) failed: %s",
-          ups->hostname, ups->port, upscli_strerror(ups->conn));
-    sfree(ups->conn);
+          host->hostname, host->port, upscli_strerror(host->conn));
+    sfree(host->conn);
     return -1;
   } /* if (status != 0) */
 
-  INFO("nut plugin: Connection to (%s, %i) established.", ups->hostname,
-       ups->port);
+  INFO("nut plugin: Connection to (%s, %i) established.", host->hostname,
+       host->port);
 
   // Output INFO or WARNING based on SSL and VERIFICATION
-  ssl_status = upscli_ssl(ups->conn); // 1 for SSL, 0 for not, -1 for error
+  ssl_status = upscli_ssl(host->conn); // 1 for SSL, 0 for not, -1 for error
   if (ssl_status == 1 && verify_peer == 1) {
     INFO("nut plugin: Connection is secured with SSL and certificate "
          "has been verified.");
@@ -238,106 +394,128 @@ static int nut_connect(nut_ups_t *ups) {
     WARNING("nut plugin: Connection is unsecured (no SSL).");
   } else {
     ERROR("nut plugin: nut_connect: upscli_ssl failed: %s",
-          upscli_strerror(ups->conn));
-    sfree(ups->conn);
+          upscli_strerror(host->conn));
+    nut_disconnect(host);
     return -1;
   } /* if (ssl_status == 1 && verify_peer == 1) */
+
+  nut_set_socket_timeout(host);
   return 0;
 }
 
+/* Builds the "LIST VAR" requests for all UPSes of "host". */
+static int nut_build_request(nut_host_t *host) {
+  size_t len = 0;
+  for (nut_ups_t *ups = host->ups; ups != NULL; ups = ups->next)
+    len += strlen("LIST VAR \n") + strlen(ups->upsname);
+
+  host->request = malloc(len + 1);
+  if (host->request == NULL)
+    return ENOMEM;
+
+  size_t offset = 0;
+  for (nut_ups_t *ups = host->ups; ups != NULL; ups = ups->next)
+    offset += (size_t)ssnprintf(host->request + offset, len + 1 - offset,
+                                "LIST VAR %s\n", ups->upsname);
+  host->request_len = offset;
+  return 0;
+} /* int nut_build_request */
+
+/* Reads the reply to "LIST VAR <ups>". Returns zero on success, a positive
+ * value if upsd reported an error for this UPS and a negative value if the
+ * connection is no longer usable. */
+static int nut_read_list(nut_host_t *host, nut_ups_t *ups) {
+  char line[1024];
+
+  if (upscli_readline(host->conn, line, sizeof(line)) != 0) {
+    ERROR("nut plugin: nut_read: Reading from (%s, %i) failed: %s",
+          host->hostname, host->port, upscli_strerror(host->conn));
+    return -1;
+  }
+
+  if (strncmp("ERR ", line, 4) == 0) {
+    ERROR("nut plugin: nut_read: Listing the variables of \"%s\" failed: %s",
+          ups->upsname, line + 4);
+    return 1;
+  } else if (strncmp("BEGIN LIST VAR ", line, 15) != 0) {
+    ERROR("nut plugin: nut_read: Unexpected reply from (%s, %i): %s",
+          host->hostname, host->port, line);
+    return -1;
+  }
+
+  while (true) {
+    if (upscli_readline(host->conn, line, sizeof(line)) != 0) {
+      ERROR("nut plugin: nut_read: Reading from (%s, %i) failed: %s",
+            host->hostname, host->port, upscli_strerror(host->conn));
+      return -1;
+    }
+
+    if (strncmp("END LIST VAR ", line, 13) == 0)
+      return 0;
+    if (strncmp("VAR ", line, 4) != 0)
+      continue;
+
+    /* VAR <upsname> <varname> "<value>" */
+    char *key = strchr(line + 4, ' ');
+    if (key == NULL)
+      continue;
+    key++;
+
+    char *value = strchr(key, ' ');
+    if (value == NULL)
+      continue;
+    *value = 0;
+    value++;
+    if (*value == '"')
+      value++;
+
+    nut_submit_var(host, ups, key, atof(value));
+  }
+} /* int nut_read_list */
+
 static int nut_read(user_data_t *user_data) {
-  nut_ups_t *ups = user_data->data;
-  const char *query[3] = {"VAR", ups->upsname, NULL};
-  unsigned int query_num = 2;
-  char **answer;
-  NUT_SIZE_TYPE answer_num;
+  nut_host_t *host = user_data->data;
   int status;
 
   /* (Re-)Connect if we have no connection */
-  if (ups->conn == NULL) {
-    ups->conn = malloc(sizeof(*ups->conn));
-    if (ups->conn == NULL) {
+  if (host->conn == NULL) {
+    host->conn = malloc(sizeof(*host->conn));
+    if (host->conn == NULL) {
       ERROR("nut plugin: malloc failed.");
       return -1;
     }
 
-    status = nut_connect(ups);
+    status = nut_connect(host);
     if (status == -1)
       return -1;
 
-  } /* if (ups->conn == NULL) */
+  } /* if (host->conn == NULL) */
 
-  /* nut plugin: nut_read_one: upscli_list_start (adpos) failed: Protocol
-   * error */
-  status = upscli_list_start(ups->conn, query_num, query);
+  /* Send the requests for all UPSes before reading the replies, so that the
+   * whole host takes a single round trip. */
+  status = upscli_sendline(host->conn, host->request, host->request_len);
   if (status != 0) {
-    ERROR("nut plugin: nut_read: upscli_list_start (%s) failed: %s",
-          ups->upsname, upscli_strerror(ups->conn));
-    upscli_disconnect(ups->conn);
-    sfree(ups->conn);
+    ERROR("nut plugin: nut_read: Writing to (%s, %i) failed: %s",
+          host->hostname, host->port, upscli_strerror(host->conn));
+    nut_disconnect(host);
     return -1;
   }
 
-  while ((status = upscli_list_next(ups->conn, query_num, query, &answer_num,
-                                    &answer)) == 1) {
-    char *key;
-    double value;
-
-    if (answer_num < 4)
-      continue;
-
-    key = answer[2];
-    value = atof(answer[3]);
-
-    if (strncmp("ambient.", key, 8) == 0) {
-      if (strcmp("ambient.humidity", key) == 0)
-        nut_submit(ups, "humidity", "ambient", value);
-      else if (strcmp("ambient.temperature", key) == 0)
-        nut_submit(ups, "temperature", "ambient", value);
-    } else if (strncmp("battery.", key, 8) == 0) {
-      if (strcmp("battery.charge", key) == 0)
-        nut_submit(ups, "percent", "charge", value);
-      else if (strcmp("battery.current", key) == 0)
-        nut_submit(ups, "current", "battery", value);
-      else if (strcmp("battery.runtime", key) == 0)
-        nut_submit(ups, "timeleft", "battery", value);
-      else if (strcmp("battery.temperature", key) == 0)
-        nut_submit(ups, "temperature", "battery", value);
-      else if (strcmp("battery.voltage", key) == 0)
-        nut_submit(ups, "voltage", "battery", value);
-    } else if (strncmp("input.", key, 6) == 0) {
-      if (strcmp("input.frequency", key) == 0)
-        nut_submit(ups, "frequency", "input", value);
-      else if (strcmp("input.voltage", key) == 0)
-        nut_submit(ups, "voltage", "input", value);
-      else if (strcmp("input.realpower", key) == 0)
-        nut_submit(ups, "power", "watt-input", value);
-      else if (strcmp("input.power", key) == 0)
-        nut_submit(ups, "power", "voltampere-input", value);
-    } else if (strncmp("output.", key, 7) == 0) {
-      if (strcmp("output.current", key) == 0)
-        nut_submit(ups, "current", "output", value);
-      else if (strcmp("output.frequency", key) == 0)
-        nut_submit(ups, "frequency", "output", value);
-      else if (strcmp("output.voltage", key) == 0)
-        nut_submit(ups, "voltage", "output", value);
-      else if (strcmp("output.realpower", key) == 0)
-        nut_submit(ups, "power", "watt-output", value);
-      else if (strcmp("output.power", key) == 0)
-        nut_submit(ups, "power", "voltampere-output", value);
-    } else if (strncmp("ups.", key, 4) == 0) {
-      if (strcmp("ups.load", key) == 0)
-        nut_submit(ups, "percent", "load", value);
-      else if (strcmp("ups.realpower", key) == 0)
-        nut_submit(ups, "power", "watt-ups", value);
-      else if (strcmp("ups.power", key) == 0)
-        nut_submit(ups, "power", "ups", value);
-      else if (strcmp("ups.temperature", key) == 0)
-        nut_submit(ups, "temperature", "ups", value);
+  size_t ups_num = 0;
+  size_t failed = 0;
+  for (nut_ups_t *ups = host->ups; ups != NULL; ups = ups->next) {
+    ups_num++;
+    status = nut_read_list(host, ups);
+    if (status < 0) {
+      nut_disconnect(host);
+      return -1;
+    } else if (status > 0) {
+      failed++;
     }
-  } /* while (upscli_list_next) */
+  }
 
-  return 0;
+  /* Only back off if none of the UPSes could be read. */
+  return (failed == ups_num) ? -1 : 0;
 } /* int nut_read */
 
 static int nut_init(void) {
@@ -351,7 +529,7 @@ static int nut_init(void) {
   if (verify_peer == 1 && ca_path == NULL) {
     ERROR("nut plugin: nut_connect: VerifyPeer true but missing "
           "CAPath value.");
-    plugin_unregister_read_group("nut");
+    nut_free_host_list();
     return -1;
   }
 
@@ -361,7 +539,7 @@ static int nut_init(void) {
     if (status != 1) {
       ERROR("nut plugin: upscli_init (%i, %s) failed", verify_peer, ca_path);
       upscli_cleanup();
-      plugin_unregister_read_group("nut");
+      nut_free_host_list();
       return -1;
     }
   } /* if (verify_peer == 1) */
@@ -385,6 +563,35 @@ static int nut_init(void) {
 
   if (connect_timeout <= 0)
     connect_timeout = (long)CDTIME_T_TO_MS(plugin_get_interval());
+  if (read_timeout <= 0)
+    read_timeout = (int)CDTIME_T_TO_MS(plugin_get_interval());
+
+  /* One read callback per host, so that the hosts are read in parallel and
+   * a slow host does not delay the others. */
+  while (host_list != NULL) {
+    nut_host_t *host = host_list;
+    host_list = host->next;
+    host->next = NULL;
+
+    if (nut_build_request(host) != 0) {
+      ERROR("nut plugin: nut_init: malloc failed.");
+      free_nut_host_t(host);
+      continue;
+    }
+
+    char *cb_name = ssnprintf_alloc("nut/%s:%i", host->hostname, host->port);
+    plugin_register_complex_read(
+        /* group     = */ "nut",
+        /* name      = */ cb_name,
+        /* callback  = */ nut_read,
+        /* interval  = */ 0,
+        /* user_data = */
+        &(user_data_t){
+            .data = host,
+            .free_func = free_nut_host_t,
+        });
+    sfree(cb_name);
+  }
 
   return 0;
 } /* int nut_init */
@@ -39,6 +39,82 @@
 #include <lber.h>
 #include <ldap.h>
 
+/* Reconnects are delayed by up to this many intervals after failures. */
+#define CLDAP_BACKOFF_MAX_INTERVALS 16
+
+/* The attribute of a monitor entry a metric is read from. */
+enum cldap_attr_e {
+  CLDAP_COUNTER,    /* monitorCounter */
+  CLDAP_OPERATIONS, /* monitorOpCompleted and monitorOpInitiated */
+  CLDAP_INFO,       /* monitoredInfo */
+};
+
+typedef struct {
+  const char *dn;
+  enum cldap_attr_e attr;
+  const char *type;
+  /* For CLDAP_OPERATIONS, the prefix of "completed" and "initiated". */
+  const char *type_instance;
+  bool derive;
+} cldap_metric_t;
+
+/* Sorted by DN in cldap_init(), so entries are looked up with bsearch(3). */
+static cldap_metric_t cldap_metrics[] = {
+    {"cn=Total,cn=Connections,cn=Monitor", CLDAP_COUNTER, "total_connections",
+     NULL, true},
+    {"cn=Current,cn=Connections,cn=Monitor", CLDAP_COUNTER,
+     "current_connections", NULL, false},
+    {"cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations", NULL, true},
+    {"cn=Bind,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations", "bind",
+     true},
+    {"cn=UnBind,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "unbind", true},
+    {"cn=Search,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "search", true},
+    {"cn=Compare,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "compare", true},
+    {"cn=Modify,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "modify", true},
+    {"cn=Modrdn,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "modrdn", true},
+    {"cn=Add,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations", "add",
+     true},
+    {"cn=Delete,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "delete", true},
+    {"cn=Abandon,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "abandon", true},
+    {"cn=Extended,cn=Operations,cn=Monitor", CLDAP_OPERATIONS, "operations",
+     "extended", true},
+    {"cn=Bytes,cn=Statistics,cn=Monitor", CLDAP_COUNTER, "derive",
+     "statistics-bytes", true},
+    {"cn=PDU,cn=Statistics,cn=Monitor", CLDAP_COUNTER, "derive",
+     "statistics-pdu", true},
+    {"cn=Entries,cn=Statistics,cn=Monitor", CLDAP_COUNTER, "derive",
+     "statistics-entries", true},
+    {"cn=Referrals,cn=Statistics,cn=Monitor", CLDAP_COUNTER, "derive",
+     "statistics-referrals", true},
+    {"cn=Open,cn=Threads,cn=Monitor", CLDAP_INFO, "threads", "threads-open",
+     false},
+    {"cn=Starting,cn=Threads,cn=Monitor", CLDAP_INFO, "threads",
+     "threads-starting", false},
+    {"cn=Active,cn=Threads,cn=Monitor", CLDAP_INFO, "threads", "threads-active",
+     false},
+    {"cn=Pending,cn=Threads,cn=Monitor", CLDAP_INFO, "threads",
+     "threads-pending", false},
+    {"cn=Backload,cn=Threads,cn=Monitor", CLDAP_INFO, "threads",
+     "threads-backload", false},
+    {"cn=Read,cn=Waiters,cn=Monitor", CLDAP_COUNTER, "derive", "waiters-read",
+     true},
+    {"cn=Write,cn=Waiters,cn=Monitor", CLDAP_COUNTER, "derive", "waiters-write",
+     true},
+};
+
+static int cldap_metric_compare(const void *a, const void *b) /* {{{ */
+{
+  return strcmp(((const cldap_metric_t *)a)->dn,
+                ((const cldap_metric_t *)b)->dn);
+} /* }}} int cldap_metric_compare */
+
 struct cldap_s /* {{{ */
 {
   char *name;
@@ -54,6 +130,9 @@ struct cldap_s /* {{{ */
   int version;
 
   LDAP *ld;
+  /* No connection is attempted before `next_connect' after a failure. */
+  cdtime_t next_connect;
+  cdtime_t connect_backoff;
 };
 typedef struct cldap_s cldap_t; /* }}} */
 
@@ -76,6 +155,38 @@ static void cldap_free(void *arg) /* {{{ */
   sfree(st);
 } /* }}} void cldap_free */
 
+static void cldap_disconnect(cldap_t *st) /* {{{ */
+{
+  if (st->ld != NULL)
+    ldap_unbind_ext_s(st->ld, NULL, NULL);
+  st->ld = NULL;
+} /* }}} void cldap_disconnect */
+
+/* Doubles the delay before the next connection attempt, starting at one
+ * interval. */
+static int cldap_connect_failed(cldap_t *st) /* {{{ */
+{
+  cdtime_t interval = plugin_get_interval();
+
+  cldap_disconnect(st);
+
+  if (st->connect_backoff == 0)
+    st->connect_backoff = interval;
+  else if (st->connect_backoff < CLDAP_BACKOFF_MAX_INTERVALS * interval)
+    st->connect_backoff *= 2;
+  st->next_connect = cdtime() + st->connect_backoff;
+
+  return -1;
+} /* }}} int cldap_connect_failed */
+
+/* Returns true if `rc' means the session is unusable and has to be set up
+ * again. Other errors leave it open. */
+static bool cldap_connection_lost(int rc) /* {{{ */
+{
+  return (rc == LDAP_SERVER_DOWN) || (rc == LDAP_CONNECT_ERROR) ||
+         (rc == LDAP_TIMEOUT) || (rc == LDAP_UNAVAILABLE);
+} /* }}} bool cldap_connection_lost */
+
 /* initialize ldap for each host */
 static int cldap_init_host(cldap_t *st) /* {{{ */
 {
@@ -86,13 +197,13 @@ static int cldap_init_host(cldap_t *st) /* {{{ */
     return 0;
   }
 
+  if (cdtime() < st->next_connect)
+    return -1;
+
   rc = ldap_initialize(&st->ld, st->url);
   if (rc != LDAP_SUCCESS) {
     ERROR("openldap plugin: ldap_initialize failed: %s", ldap_err2string(rc));
-    if (st->ld != NULL)
-      ldap_unbind_ext_s(st->ld, NULL, NULL);
-    st->ld = NULL;
-    return (-1);
+    return cldap_connect_failed(st);
   }
 
   ldap_set_option(st->ld, LDAP_OPT_PROTOCOL_VERSION, &st->version);
@@ -115,9 +226,7 @@ static int cldap_init_host(cldap_t *st) /* {{{ */
     if (rc != LDAP_SUCCESS) {
       ERROR("openldap plugin: Failed to start tls on %s: %s", st->url,
             ldap_err2string(rc));
-      ldap_unbind_ext_s(st->ld, NULL, NULL);
-      st->ld = NULL;
-      return (-1);
+      return cldap_connect_failed(st);
     }
   }
 
@@ -135,13 +244,16 @@ static int cldap_init_host(cldap_t *st) /* {{{ */
   if (rc != LDAP_SUCCESS) {
     ERROR("openldap plugin: Failed to bind to %s: %s", st->url,
           ldap_err2string(rc));
-    ldap_unbind_ext_s(st->ld, NULL, NULL);
-    st->ld = NULL;
-    return (-1);
-  } else {
-    DEBUG("openldap plugin: Successfully connected to %s", st->url);
-    return 0;
+    return cldap_connect_failed(st);
   }
+
+  if (st->connect_backoff != 0)
+    INFO("openldap plugin: Connected to %s again.", st->url);
+  else
+    DEBUG("openldap plugin: Successfully connected to %s", st->url);
+  st->connect_backoff = 0;
+  st->next_connect = 0;
+  return 0;
 } /* }}} static cldap_init_host */
 
 static void cldap_submit_value(const char *type,
@@ -178,6 +290,73 @@ static void cldap_submit_gauge(const char *type,
   cldap_submit_value(type, type_instance, (value_t){.gauge = g}, st);
 } /* }}} void cldap_submit_gauge */
 
+/* Returns the first value of `attr' as a number, or zero if the entry doesn't
+ * have it. */
+static unsigned long long cldap_get_number(cldap_t *st, /* {{{ */
+                                           LDAPMessage *e, const char *attr) {
+  unsigned long long value = 0;
+
+  struct berval **list = ldap_get_values_len(st->ld, e, attr);
+  if (list != NULL) {
+    if (list[0] != NULL)
+      value = atoll(list[0]->bv_val);
+    ldap_value_free_len(list);
+  }
+  return value;
+} /* }}} unsigned long long cldap_get_number */
+
+static void cldap_submit_metric(cldap_t *st, LDAPMessage *e, /* {{{ */
+                                const cldap_metric_t *m) {
+  if (m->attr == CLDAP_OPERATIONS) {
+    char completed[DATA_MAX_NAME_LEN] = "completed";
+    char initiated[DATA_MAX_NAME_LEN] = "initiated";
+
+    if (m->type_instance != NULL) {
+      ssnprintf(completed, sizeof(completed), "%s-completed", m->type_instance);
+      ssnprintf(initiated, sizeof(initiated), "%s-initiated", m->type_instance);
+    }
+    cldap_submit_derive(m->type, completed,
+                        cldap_get_number(st, e, "monitorOpCompleted"), st);
+    cldap_submit_derive(m->type, initiated,
+                        cldap_get_number(st, e, "monitorOpInitiated"), st);
+    return;
+  }
+
+  unsigned long long value = cldap_get_number(
+      st, e, (m->attr == CLDAP_INFO) ? "monitoredInfo" : "monitorCounter");
+  if (m->derive)
+    cldap_submit_derive(m->type, m->type_instance, value, st);
+  else
+    cldap_submit_gauge(m->type, m->type_instance, value, st);
+} /* }}} void cldap_submit_metric */
+
+static void cldap_submit_database(cldap_t *st, LDAPMessage *e) /* {{{ */
+{
+  static const char *caches[][2] = {
+      {"olmBDBEntryCache", "bdbentrycache"},
+      {"olmBDBDNCache", "bdbdncache"},
+      {"olmBDBIDLCache", "bdbidlcache"},
+  };
+
+  struct berval **nc_list = ldap_get_values_len(st->ld, e, "namingContexts");
+  if (nc_list == NULL)
+    return;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(caches); i++) {
+    struct berval **list = ldap_get_values_len(st->ld, e, caches[i][0]);
+    if (list == NULL)
+      continue;
+
+    char typeinst[DATA_MAX_NAME_LEN];
+    ssnprintf(typeinst, sizeof(typeinst), "%s-%s", caches[i][1],
+              nc_list[0]->bv_val);
+    cldap_submit_gauge("cache_size", typeinst, atoll(list[0]->bv_val), st);
+    ldap_value_free_len(list);
+  }
+
+  ldap_value_free_len(nc_list);
+} /* }}} void cldap_submit_database */
+
 static int cldap_read_host(user_data_t *ud) /* {{{ */
 {
   cldap_t *st;
@@ -209,160 +388,25 @@ static int cldap_read_host(user_data_t *ud) /* {{{ */
   if (rc != LDAP_SUCCESS) {
     ERROR("openldap plugin: Failed to execute search: %s", ldap_err2string(rc));
     ldap_msgfree(result);
-    ldap_unbind_ext_s(st->ld, NULL, NULL);
-    st->ld = NULL;
+    /* The session survives errors of the search itself. */
+    if (cldap_connection_lost(rc))
+      cldap_connect_failed(st);
     return (-1);
   }
 
   for (LDAPMessage *e = ldap_first_entry(st->ld, result); e != NULL;
        e = ldap_next_entry(st->ld, e)) {
-    if ((dn = ldap_get_dn(st->ld, e)) != NULL) {
-      unsigned long long counter = 0;
-      unsigned long long opc = 0;
-      unsigned long long opi = 0;
-      unsigned long long info = 0;
-
-      struct berval counter_data;
-      struct berval opc_data;
-      struct berval opi_data;
-      struct berval info_data;
-      struct berval olmbdb_data;
-      struct berval nc_data;
-
-      struct berval **counter_list;
-      struct berval **opc_list;
-      struct berval **opi_list;
-      struct berval **info_list;
-      struct berval **olmbdb_list;
-      struct berval **nc_list;
-
-      if ((counter_list = ldap_get_values_len(st->ld, e, "monitorCounter")) !=
-          NULL) {
-        counter_data = *counter_list[0];
-        counter = atoll(counter_data.bv_val);
-      }
-
-      if ((opc_list = ldap_get_values_len(st->ld, e, "monitorOpCompleted")) !=
-          NULL) {
-        opc_data = *opc_list[0];
-        opc = atoll(opc_data.bv_val);
-      }
-
-      if ((opi_list = ldap_get_values_len(st->ld, e, "monitorOpInitiated")) !=
-          NULL) {
-        opi_data = *opi_list[0];
-        opi = atoll(opi_data.bv_val);
-      }
-
-      if ((info_list = ldap_get_values_len(st->ld, e, "monitoredInfo")) !=
-          NULL) {
-        info_data = *info_list[0];
-        info = atoll(info_data.bv_val);
-      }
-
-      if (strcmp(dn, "cn=Total,cn=Connections,cn=Monitor") == 0) {
-        cldap_submit_derive("total_connections", NULL, counter, st);
-      } else if (strcmp(dn, "cn=Current,cn=Connections,cn=Monitor") == 0) {
-        cldap_submit_gauge("current_connections", NULL, counter, st);
-      } else if (strcmp(dn, "cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "completed", opc, st);
-        cldap_submit_derive("operations", "initiated", opi, st);
-      } else if (strcmp(dn, "cn=Bind,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "bind-completed", opc, st);
-        cldap_submit_derive("operations", "bind-initiated", opi, st);
-      } else if (strcmp(dn, "cn=UnBind,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "unbind-completed", opc, st);
-        cldap_submit_derive("operations", "unbind-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Search,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "search-completed", opc, st);
-        cldap_submit_derive("operations", "search-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Compare,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "compare-completed", opc, st);
-        cldap_submit_derive("operations", "compare-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Modify,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "modify-completed", opc, st);
-        cldap_submit_derive("operations", "modify-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Modrdn,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "modrdn-completed", opc, st);
-        cldap_submit_derive("operations", "modrdn-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Add,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "add-completed", opc, st);
-        cldap_submit_derive("operations", "add-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Delete,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "delete-completed", opc, st);
-        cldap_submit_derive("operations", "delete-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Abandon,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "abandon-completed", opc, st);
-        cldap_submit_derive("operations", "abandon-initiated", opi, st);
-      } else if (strcmp(dn, "cn=Extended,cn=Operations,cn=Monitor") == 0) {
-        cldap_submit_derive("operations", "extended-completed", opc, st);
-        cldap_submit_derive("operations", "extended-initiated", opi, st);
-      } else if ((strncmp(dn, "cn=Database", 11) == 0) &&
-                 ((nc_list = ldap_get_values_len(st->ld, e,
-                                                 "namingContexts")) != NULL)) {
-        nc_data = *nc_list[0];
-        char typeinst[DATA_MAX_NAME_LEN];
-
-        if ((olmbdb_list =
-                 ldap_get_values_len(st->ld, e, "olmBDBEntryCache")) != NULL) {
-          olmbdb_data = *olmbdb_list[0];
-          ssnprintf(typeinst, sizeof(typeinst), "bdbentrycache-%s",
-                    nc_data.bv_val);
-          cldap_submit_gauge("cache_size", typeinst, atoll(olmbdb_data.bv_val),
-                             st);
-          ldap_value_free_len(olmbdb_list);
-        }
-
-        if ((olmbdb_list = ldap_get_values_len(st->ld, e, "olmBDBDNCache")) !=
-            NULL) {
-          olmbdb_data = *olmbdb_list[0];
-          ssnprintf(typeinst, sizeof(typeinst), "bdbdncache-%s",
-                    nc_data.bv_val);
-          cldap_submit_gauge("cache_size", typeinst, atoll(olmbdb_data.bv_val),
-                             st);
-          ldap_value_free_len(olmbdb_list);
-        }
-
-        if ((olmbdb_list = ldap_get_values_len(st->ld, e, "olmBDBIDLCache")) !=
-            NULL) {
-          olmbdb_data = *olmbdb_list[0];
-          ssnprintf(typeinst, sizeof(typeinst), "bdbidlcache-%s",
-                    nc_data.bv_val);
-          cldap_submit_gauge("cache_size", typeinst, atoll(olmbdb_data.bv_val),
-                             st);
-          ldap_value_free_len(olmbdb_list);
-        }
-
-        ldap_value_free_len(nc_list);
-      } else if (strcmp(dn, "cn=Bytes,cn=Statistics,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "statistics-bytes", counter, st);
-      } else if (strcmp(dn, "cn=PDU,cn=Statistics,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "statistics-pdu", counter, st);
-      } else if (strcmp(dn, "cn=Entries,cn=Statistics,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "statistics-entries", counter, st);
-      } else if (strcmp(dn, "cn=Referrals,cn=Statistics,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "statistics-referrals", counter, st);
-      } else if (strcmp(dn, "cn=Open,cn=Threads,cn=Monitor") == 0) {
-        cldap_submit_gauge("threads", "threads-open", info, st);
-      } else if (strcmp(dn, "cn=Starting,cn=Threads,cn=Monitor") == 0) {
-        cldap_submit_gauge("threads", "threads-starting", info, st);
-      } else if (strcmp(dn, "cn=Active,cn=Threads,cn=Monitor") == 0) {
-        cldap_submit_gauge("threads", "threads-active", info, st);
-      } else if (strcmp(dn, "cn=Pending,cn=Threads,cn=Monitor") == 0) {
-        cldap_submit_gauge("threads", "threads-pending", info, st);
-      } else if (strcmp(dn, "cn=Backload,cn=Threads,cn=Monitor") == 0) {
-        cldap_submit_gauge("threads", "threads-backload", info, st);
-      } else if (strcmp(dn, "cn=Read,cn=Waiters,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "waiters-read", counter, st);
-      } else if (strcmp(dn, "cn=Write,cn=Waiters,cn=Monitor") == 0) {
-        cldap_submit_derive("derive", "waiters-write", counter, st);
-      }
-
-      ldap_value_free_len(counter_list);
-      ldap_value_free_len(opc_list);
-      ldap_value_free_len(opi_list);
-      ldap_value_free_len(info_list);
-    }
+    if ((dn = ldap_get_dn(st->ld, e)) == NULL)
+      continue;
+
+    const cldap_metric_t key = {.dn = dn};
+    const cldap_metric_t *m =
+        bsearch(&key, cldap_metrics, STATIC_ARRAY_SIZE(cldap_metrics),
+                sizeof(*cldap_metrics), cldap_metric_compare);
+    if (m != NULL)
+      cldap_submit_metric(st, e, m);
+    else if (strncmp(dn, "cn=Database", 11) == 0)
+      cldap_submit_database(st, e);
 
     ldap_memfree(dn);
   }
@@ -501,6 +545,9 @@ static int cldap_config(oconfig_item_t *ci) /* {{{ */
 
 static int cldap_init(void) /* {{{ */
 {
+  qsort(cldap_metrics, STATIC_ARRAY_SIZE(cldap_metrics),
+        sizeof(*cldap_metrics), cldap_metric_compare);
+
   /* Initialize LDAP library while still single-threaded as recommended in
    * ldap_initialize(3) */
   int debug_level;
@@ -28,6 +28,7 @@
  *   Taras Chornyi <tarasx.chornyi@intel.com>
  */
 
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include "utils/ovs/ovs.h" /* OvS helpers */
@@ -100,6 +101,8 @@ typedef struct interface_s {
   char ex_iface_id[UUID_SIZE];        /* External iface id */
   char ex_vm_id[UUID_SIZE];           /* External vm id */
   int64_t stats[IFACE_COUNTER_COUNT]; /* Statistics for interface */
+  bool changed;                       /* Updated since the last read */
+  struct port_s *port;                /* Port the interface belongs to */
   struct interface_s *next;           /* Next interface for associated port */
 } interface_list_t;
 
@@ -108,7 +111,6 @@ typedef struct port_s {
   char port_uuid[UUID_SIZE];     /* Port table _uuid */
   struct bridge_list_s *br;      /* Pointer to bridge */
   struct interface_s *iface;     /* Pointer to first interface */
-  struct port_s *next;           /* Next port */
 } port_list_t;
 
 typedef struct bridge_list_s {
@@ -178,8 +180,14 @@ static bridge_list_t *g_bridge_list_head;
 /* Entry into the list of monitored network bridges */
 static bridge_list_t *g_monitored_bridge_list_head;
 
-/* entry into the list of network bridges */
-static port_list_t *g_port_list_head;
+/* Ports, indexed by their uuid */
+static c_avl_tree_t *g_port_tree;
+
+/* Interfaces of all ports, indexed by their uuid */
+static c_avl_tree_t *g_iface_tree;
+
+/* Counter names, pointing into iface_counter_table */
+static c_avl_tree_t *g_counter_tree;
 
 /* lock for statistics cache */
 static pthread_mutex_t g_stats_lock;
@@ -203,20 +211,18 @@ static ovs_stats_config_t ovs_stats_cfg = {
 /* flag indicating whether or not to publish individual interface statistics */
 static bool interface_stats = false;
 
+/* flag indicating whether to skip interfaces which have not been updated by
+ * OvSDB since the previous read */
+static bool skip_unchanged = false;
+
 static iface_counter ovs_stats_counter_name_to_type(const char *counter) {
-  iface_counter index = not_supported;
+  const char *const *name;
 
-  if (counter == NULL)
+  if (counter == NULL ||
+      c_avl_get(g_counter_tree, counter, (void *)&name) != 0)
     return not_supported;
 
-  for (int i = 0; i < IFACE_COUNTER_COUNT; i++) {
-    if (strncmp(iface_counter_table[i], counter,
-                strlen(iface_counter_table[i])) == 0) {
-      index = i;
-      break;
-    }
-  }
-  return index;
+  return (iface_counter)(name - iface_counter_table);
 }
 
 static void ovs_stats_submit_one(const char *dev, const char *type,
@@ -270,6 +276,9 @@ static void ovs_stats_submit_interfaces(port_list_t *port) {
   bridge_list_t *bridge = port->br;
   for (interface_list_t *iface = port->iface; iface != NULL;
        iface = iface->next) {
+    if (skip_unchanged && !iface->changed)
+      continue;
+
     meta_data_t *meta = meta_data_create();
     if (meta != NULL) {
       meta_data_add_string(meta, "uuid", iface->iface_uuid);
@@ -371,12 +380,12 @@ static void ovs_stats_submit_interfaces(port_list_t *port) {
   }
 }
 
-static int ovs_stats_get_port_stat_value(port_list_t *port,
-                                         iface_counter index) {
+static int64_t ovs_stats_get_port_stat_value(port_list_t *port,
+                                             iface_counter index) {
   if (port == NULL)
     return 0;
 
-  int value = 0;
+  int64_t value = 0;
 
   for (interface_list_t *iface = port->iface; iface != NULL;
        iface = iface->next) {
@@ -525,63 +534,41 @@ static void ovs_stats_submit_port(port_list_t *port) {
 }
 
 static port_list_t *ovs_stats_get_port(const char *uuid) {
-  if (uuid == NULL)
-    return NULL;
-
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0)
-      return port;
-  }
-  return NULL;
-}
+  port_list_t *port;
 
-static port_list_t *ovs_stats_get_port_by_interface_uuid(const char *uuid) {
-  if (uuid == NULL)
+  if (uuid == NULL || c_avl_get(g_port_tree, uuid, (void *)&port) != 0)
     return NULL;
-
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return port;
-    }
-  }
-  return NULL;
-}
-
-static interface_list_t *ovs_stats_get_port_interface(port_list_t *port,
-                                                      const char *uuid) {
-  if (port == NULL || uuid == NULL)
-    return NULL;
-
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = iface->next) {
-    if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-      return iface;
-  }
-  return NULL;
+  return port;
 }
 
 static interface_list_t *ovs_stats_get_interface(const char *uuid) {
-  if (uuid == NULL)
+  interface_list_t *iface;
+
+  if (uuid == NULL || c_avl_get(g_iface_tree, uuid, (void *)&iface) != 0)
     return NULL;
+  return iface;
+}
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return iface;
+/* Remove interface from the interface list of its port */
+static void ovs_stats_unlink_interface(interface_list_t *iface) {
+  for (interface_list_t **ptr = &iface->port->iface; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    if (*ptr == iface) {
+      *ptr = iface->next;
+      break;
     }
   }
-  return NULL;
+  iface->next = NULL;
+  iface->port = NULL;
 }
 
+/* Create or get interface by uuid and attach it to the port */
 static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
                                                       const char *uuid) {
   if (uuid == NULL)
     return NULL;
 
-  interface_list_t *iface = ovs_stats_get_port_interface(port, uuid);
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
 
   if (iface == NULL) {
     iface = calloc(1, sizeof(*iface));
@@ -591,10 +578,21 @@ static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
     }
     memset(iface->stats, -1, sizeof(int64_t[IFACE_COUNTER_COUNT]));
     sstrncpy(iface->iface_uuid, uuid, sizeof(iface->iface_uuid));
-    interface_list_t *iface_head = port->iface;
-    iface->next = iface_head;
-    port->iface = iface;
+    if (c_avl_insert(g_iface_tree, iface->iface_uuid, iface) != 0) {
+      ERROR("%s: Error indexing interface", plugin_name);
+      sfree(iface);
+      return NULL;
+    }
+  } else if (iface->port == port) {
+    return iface;
+  } else {
+    /* The interface has been moved to another port */
+    ovs_stats_unlink_interface(iface);
   }
+
+  iface->port = port;
+  iface->next = port->iface;
+  port->iface = iface;
   return iface;
 }
 
@@ -613,8 +611,11 @@ static port_list_t *ovs_stats_new_port(bridge_list_t *bridge,
       return NULL;
     }
     sstrncpy(port->port_uuid, uuid, sizeof(port->port_uuid));
-    port->next = g_port_list_head;
-    g_port_list_head = port;
+    if (c_avl_insert(g_port_tree, port->port_uuid, port) != 0) {
+      ERROR("%s: Error indexing port", plugin_name);
+      sfree(port);
+      return NULL;
+    }
   }
   if (bridge != NULL) {
     port->br = bridge;
@@ -622,6 +623,18 @@ static port_list_t *ovs_stats_new_port(bridge_list_t *bridge,
   return port;
 }
 
+/* Free port and its interfaces. The port must have been removed from
+ * g_port_tree already. */
+static void ovs_stats_free_port(port_list_t *port) {
+  while (port->iface != NULL) {
+    interface_list_t *del = port->iface;
+    port->iface = del->next;
+    c_avl_remove(g_iface_tree, del->iface_uuid, NULL, NULL);
+    sfree(del);
+  }
+  sfree(port);
+}
+
 /* Get bridge by name*/
 static bridge_list_t *ovs_stats_get_bridge(bridge_list_t *head,
                                            const char *name) {
@@ -676,6 +689,17 @@ static int ovs_stats_del_bridge(yajl_val bridge) {
         g_bridge_list_head = br->next;
       else
         prev_br->next = br->next;
+
+      /* Ports of the bridge are skipped until they are added to another one */
+      c_avl_iterator_t *iter = c_avl_get_iterator(g_port_tree);
+      char *uuid;
+      port_list_t *port;
+      while (c_avl_iterator_next(iter, (void *)&uuid, (void *)&port) == 0) {
+        if (port->br == br)
+          port->br = NULL;
+      }
+      c_avl_iterator_destroy(iter);
+
       sfree(br->name);
       sfree(br);
       break;
@@ -886,26 +910,10 @@ static int ovs_stats_update_port(const char *uuid, yajl_val port) {
 
 /* Delete port from global port list */
 static int ovs_stats_del_port(const char *uuid) {
-  port_list_t *prev_port = g_port_list_head;
-  for (port_list_t *port = g_port_list_head; port != NULL;
-       prev_port = port, port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0) {
-      if (port == g_port_list_head)
-        g_port_list_head = port->next;
-      else
-        prev_port->next = port->next;
-
-      for (interface_list_t *iface = port->iface; iface != NULL;
-           iface = port->iface) {
-        interface_list_t *del = iface;
-        port->iface = iface->next;
-        sfree(del);
-      }
+  port_list_t *port;
 
-      sfree(port);
-      break;
-    }
-  }
+  if (c_avl_remove(g_port_tree, uuid, NULL, (void *)&port) == 0)
+    ovs_stats_free_port(port);
   return 0;
 }
 
@@ -973,16 +981,20 @@ static int ovs_stats_update_iface_stats(interface_list_t *iface,
 
   for (size_t i = 0; i < YAJL_GET_ARRAY(stats)->len; i++) {
     yajl_val stat = YAJL_GET_ARRAY(stats)->values[i];
-    if (!YAJL_IS_ARRAY(stat))
+    if (!YAJL_IS_ARRAY(stat) || YAJL_GET_ARRAY(stat)->len != 2)
       return -1;
 
-    char *counter_name = YAJL_GET_STRING(YAJL_GET_ARRAY(stat)->values[0]);
-    iface_counter counter_index = ovs_stats_counter_name_to_type(counter_name);
-    int64_t counter_value = YAJL_GET_INTEGER(YAJL_GET_ARRAY(stat)->values[1]);
+    yajl_val counter_name = YAJL_GET_ARRAY(stat)->values[0];
+    yajl_val counter_value = YAJL_GET_ARRAY(stat)->values[1];
+    if (!YAJL_IS_STRING(counter_name) || !YAJL_IS_INTEGER(counter_value))
+      continue;
+
+    iface_counter counter_index =
+        ovs_stats_counter_name_to_type(YAJL_GET_STRING(counter_name));
     if (counter_index == not_supported)
       continue;
 
-    iface->stats[counter_index] = counter_value;
+    iface->stats[counter_index] = YAJL_GET_INTEGER(counter_value);
   }
 
   return 0;
@@ -997,15 +1009,15 @@ static int ovs_stats_update_iface_ext_ids(interface_list_t *iface,
 
   for (size_t i = 0; i < YAJL_GET_ARRAY(ext_ids)->len; i++) {
     yajl_val ext_id = YAJL_GET_ARRAY(ext_ids)->values[i];
-    if (!YAJL_IS_ARRAY(ext_id))
+    if (!YAJL_IS_ARRAY(ext_id) || YAJL_GET_ARRAY(ext_id)->len != 2)
       return -1;
 
     char *key = YAJL_GET_STRING(YAJL_GET_ARRAY(ext_id)->values[0]);
     char *value = YAJL_GET_STRING(YAJL_GET_ARRAY(ext_id)->values[1]);
     if (key && value) {
-      if (strncmp(key, "iface-id", strlen(key)) == 0) {
+      if (strcmp(key, "iface-id") == 0) {
         sstrncpy(iface->ex_iface_id, value, sizeof(iface->ex_iface_id));
-      } else if (strncmp(key, "vm-uuid", strlen(key)) == 0) {
+      } else if (strcmp(key, "vm-uuid") == 0) {
         sstrncpy(iface->ex_vm_id, value, sizeof(iface->ex_vm_id));
       }
     }
@@ -1014,8 +1026,17 @@ static int ovs_stats_update_iface_ext_ids(interface_list_t *iface,
   return 0;
 }
 
-/* Get interface statistic and external_ids */
-static int ovs_stats_update_iface(yajl_val iface_obj) {
+/* Returns the elements of an OvSDB "map" or "set" value, i.e. the second
+ * element of ["map", [...]], or NULL. */
+static yajl_val ovs_stats_get_map(yajl_val jval) {
+  if (!jval || !YAJL_IS_ARRAY(jval) || YAJL_GET_ARRAY(jval)->len != 2)
+    return NULL;
+  return YAJL_GET_ARRAY(jval)->values[1];
+}
+
+/* Get interface statistic and external_ids. The columns of the row are
+ * handled in a single pass over the row object. */
+static int ovs_stats_update_iface(const char *uuid, yajl_val iface_obj) {
   if (!iface_obj || !YAJL_IS_OBJECT(iface_obj)) {
     ERROR("ovs_stats plugin: incorrect JSON interface data");
     return -1;
@@ -1025,30 +1046,32 @@ static int ovs_stats_update_iface(yajl_val iface_obj) {
   if (!row || !YAJL_IS_OBJECT(row))
     return 0;
 
-  yajl_val iface_name = ovs_utils_get_value_by_key(row, "name");
-  if (!iface_name || !YAJL_IS_STRING(iface_name))
-    return 0;
-
-  yajl_val iface_uuid = ovs_utils_get_value_by_key(row, "_uuid");
-  if (!iface_uuid || !YAJL_IS_ARRAY(iface_uuid) ||
-      YAJL_GET_ARRAY(iface_uuid)->len != 2)
+  /* Interfaces which are not part of a known port are ignored, so look the
+   * interface up before looking at its columns. */
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
+  if (iface == NULL)
     return 0;
 
-  char *iface_uuid_str = YAJL_GET_STRING(YAJL_GET_ARRAY(iface_uuid)->values[1]);
-  if (iface_uuid_str == NULL) {
-    ERROR("ovs_stats plugin: incorrect JSON interface data");
-    return -1;
+  yajl_val iface_name = NULL;
+  yajl_val iface_stats = NULL;
+  yajl_val iface_ext_ids = NULL;
+  for (size_t i = 0; i < YAJL_GET_OBJECT(row)->len; i++) {
+    const char *key = YAJL_GET_OBJECT(row)->keys[i];
+    yajl_val value = YAJL_GET_OBJECT(row)->values[i];
+
+    if (strcmp(key, "name") == 0)
+      iface_name = value;
+    else if (strcmp(key, "statistics") == 0)
+      iface_stats = value;
+    else if (strcmp(key, "external_ids") == 0)
+      iface_ext_ids = value;
   }
 
-  interface_list_t *iface = ovs_stats_get_interface(iface_uuid_str);
-  if (iface == NULL)
+  if (!iface_name || !YAJL_IS_STRING(iface_name))
     return 0;
 
   sstrncpy(iface->name, YAJL_GET_STRING(iface_name), sizeof(iface->name));
 
-  yajl_val iface_stats = ovs_utils_get_value_by_key(row, "statistics");
-  yajl_val iface_ext_ids = ovs_utils_get_value_by_key(row, "external_ids");
-
   /*
    * {
         "statistics": [
@@ -1066,47 +1089,23 @@ static int ovs_stats_update_iface(yajl_val iface_obj) {
           ]
         ]
       }
-   Check that statistics is an array with 2 elements
    */
-
-  if (iface_stats && YAJL_IS_ARRAY(iface_stats) &&
-      YAJL_GET_ARRAY(iface_stats)->len == 2)
-    ovs_stats_update_iface_stats(iface, YAJL_GET_ARRAY(iface_stats)->values[1]);
-
-  if (iface_ext_ids && YAJL_IS_ARRAY(iface_ext_ids))
-    ovs_stats_update_iface_ext_ids(iface,
-                                   YAJL_GET_ARRAY(iface_ext_ids)->values[1]);
+  ovs_stats_update_iface_stats(iface, ovs_stats_get_map(iface_stats));
+  ovs_stats_update_iface_ext_ids(iface, ovs_stats_get_map(iface_ext_ids));
+  iface->changed = true;
 
   return 0;
 }
 
 /* Delete interface */
 static int ovs_stats_del_interface(const char *uuid) {
-  port_list_t *port = ovs_stats_get_port_by_interface_uuid(uuid);
+  interface_list_t *iface;
 
-  if (port == NULL)
+  if (c_avl_remove(g_iface_tree, uuid, NULL, (void *)&iface) != 0)
     return 0;
 
-  interface_list_t *prev_iface = NULL;
-
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = iface->next) {
-    if (!strncmp(iface->iface_uuid, uuid, strlen(iface->iface_uuid))) {
-
-      interface_list_t *del = iface;
-
-      if (prev_iface == NULL)
-        port->iface = iface->next;
-      else
-        prev_iface->next = iface->next;
-
-      sfree(del);
-      break;
-    } else {
-      prev_iface = iface;
-    }
-  }
-
+  ovs_stats_unlink_interface(iface);
+  sfree(iface);
   return 0;
 }
 
@@ -1169,7 +1168,8 @@ static void ovs_stats_interface_table_change_cb(yajl_val jupdates) {
 
   pthread_mutex_lock(&g_stats_lock);
   for (size_t i = 0; i < YAJL_GET_OBJECT(interfaces)->len; i++) {
-    ovs_stats_update_iface(YAJL_GET_OBJECT(interfaces)->values[i]);
+    ovs_stats_update_iface(YAJL_GET_OBJECT(interfaces)->keys[i],
+                           YAJL_GET_OBJECT(interfaces)->values[i]);
   }
   pthread_mutex_unlock(&g_stats_lock);
 
@@ -1241,20 +1241,16 @@ static void ovs_stats_initialize(ovs_db_t *pdb) {
                            OVS_DB_TABLE_CB_FLAG_DELETE);
 }
 
-/* Delete all ports from port list */
-static void ovs_stats_free_port_list(port_list_t *head) {
-  for (port_list_t *i = head; i != NULL;) {
-    port_list_t *del = i;
+/* Delete all ports */
+static void ovs_stats_free_ports(void) {
+  port_list_t *port;
+  char *uuid;
 
-    for (interface_list_t *iface = i->iface; iface != NULL; iface = i->iface) {
-      interface_list_t *del2 = iface;
-      i->iface = iface->next;
-      sfree(del2);
-    }
+  if (g_port_tree == NULL)
+    return;
 
-    i = i->next;
-    sfree(del);
-  }
+  while (c_avl_pick(g_port_tree, (void *)&uuid, (void *)&port) == 0)
+    ovs_stats_free_port(port);
 }
 
 /* Delete all bridges from bridge list */
@@ -1273,8 +1269,7 @@ static void ovs_stats_conn_terminate() {
   pthread_mutex_lock(&g_stats_lock);
   ovs_stats_free_bridge_list(g_bridge_list_head);
   g_bridge_list_head = NULL;
-  ovs_stats_free_port_list(g_port_list_head);
-  g_port_list_head = NULL;
+  ovs_stats_free_ports();
   pthread_mutex_unlock(&g_stats_lock);
 }
 
@@ -1343,6 +1338,11 @@ static int ovs_stats_plugin_config(oconfig_item_t *ci) {
         ERROR("%s: parse '%s' option failed", plugin_name, child->key);
         return -1;
       }
+    } else if (strcasecmp("SkipUnchanged", child->key) == 0) {
+      if (cf_util_get_boolean(child, &skip_unchanged) != 0) {
+        ERROR("%s: parse '%s' option failed", plugin_name, child->key);
+        return -1;
+      }
     } else {
       WARNING("%s: option '%s' not allowed here", plugin_name, child->key);
       goto cleanup_fail;
@@ -1360,6 +1360,17 @@ static int ovs_stats_plugin_init(void) {
   ovs_db_callback_t cb = {.post_conn_init = ovs_stats_initialize,
                           .post_conn_terminate = ovs_stats_conn_terminate};
 
+  g_port_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  g_iface_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  g_counter_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (g_port_tree == NULL || g_iface_tree == NULL || g_counter_tree == NULL) {
+    ERROR("%s: plugin: failed to create uuid indices", plugin_name);
+    return -1;
+  }
+  for (int i = 0; i < IFACE_COUNTER_COUNT; i++)
+    c_avl_insert(g_counter_tree, (void *)iface_counter_table[i],
+                 (void *)(iface_counter_table + i));
+
   INFO("%s: Connecting to OVS DB using address=%s, service=%s, unix=%s",
        plugin_name, ovs_stats_cfg.ovs_db_node, ovs_stats_cfg.ovs_db_serv,
        ovs_stats_cfg.ovs_db_unix);
@@ -1382,7 +1393,19 @@ static int ovs_stats_plugin_init(void) {
 /* OvS stats read callback. Read bridge/port information and submit it*/
 static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
   pthread_mutex_lock(&g_stats_lock);
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
+  c_avl_iterator_t *iter = c_avl_get_iterator(g_port_tree);
+  char *uuid;
+  port_list_t *port;
+  while (c_avl_iterator_next(iter, (void *)&uuid, (void *)&port) == 0) {
+    bool changed = false;
+    for (interface_list_t *iface = port->iface; iface != NULL;
+         iface = iface->next)
+      changed |= iface->changed;
+
+    /* Ports of interfaces which have not been updated are skipped, too */
+    if (skip_unchanged && !changed)
+      continue;
+
     if (strlen(port->name) == 0)
       /* Skip port w/o name. This is possible when read callback
        * is called after Interface Table update callback but before
@@ -1397,7 +1420,12 @@ static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
 
     if (interface_stats)
       ovs_stats_submit_interfaces(port);
+
+    for (interface_list_t *iface = port->iface; iface != NULL;
+         iface = iface->next)
+      iface->changed = false;
   }
+  c_avl_iterator_destroy(iter);
   pthread_mutex_unlock(&g_stats_lock);
   return 0;
 }
@@ -1409,7 +1437,11 @@ static int ovs_stats_plugin_shutdown(void) {
   pthread_mutex_lock(&g_stats_lock);
   ovs_stats_free_bridge_list(g_bridge_list_head);
   ovs_stats_free_bridge_list(g_monitored_bridge_list_head);
-  ovs_stats_free_port_list(g_port_list_head);
+  ovs_stats_free_ports();
+  c_avl_destroy(g_port_tree);
+  c_avl_destroy(g_iface_tree);
+  c_avl_destroy(g_counter_tree);
+  g_port_tree = g_iface_tree = g_counter_tree = NULL;
   pthread_mutex_unlock(&g_stats_lock);
   pthread_mutex_destroy(&g_stats_lock);
   return 0;
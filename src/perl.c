@@ -68,8 +68,9 @@
 #define PLUGIN_NOTIF 5
 #define PLUGIN_FLUSH 6
 #define PLUGIN_FLUSH_ALL 7 /* For collectd-5.6 only */
+#define PLUGIN_WRITE_BATCH 8
 
-#define PLUGIN_TYPES 8
+#define PLUGIN_TYPES 9
 
 #define PLUGIN_CONFIG 254
 #define PLUGIN_DATASET 255
@@ -95,6 +96,7 @@ void boot_DynaLoader(PerlInterpreter *, CV *);
 
 static XS(Collectd_plugin_register_read);
 static XS(Collectd_plugin_register_write);
+static XS(Collectd_plugin_register_write_batch);
 static XS(Collectd_plugin_register_log);
 static XS(Collectd_plugin_register_notification);
 static XS(Collectd_plugin_register_flush);
@@ -117,6 +119,8 @@ static XS(Collectd_call_by_name);
 static int perl_read(user_data_t *ud);
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data);
+static int perl_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *user_data);
 static void perl_log(int level, const char *msg, user_data_t *user_data);
 static int perl_notify(const notification_t *notif, user_data_t *user_data);
 static int perl_flush(cdtime_t timeout, const char *identifier,
@@ -131,6 +135,7 @@ typedef struct c_ithread_s {
   PerlInterpreter *interp;
   bool running; /* thread is inside Perl interpreter */
   bool shutdown;
+  bool idle; /* the thread has exited, the interpreter may be reused */
   pthread_t pthread;
 
   /* double linked list of threads */
@@ -194,6 +199,8 @@ static struct {
 } api[] = {
     {"Collectd::plugin_register_read", Collectd_plugin_register_read},
     {"Collectd::plugin_register_write", Collectd_plugin_register_write},
+    {"Collectd::plugin_register_write_batch",
+     Collectd_plugin_register_write_batch},
     {"Collectd::plugin_register_log", Collectd_plugin_register_log},
     {"Collectd::plugin_register_notification",
      Collectd_plugin_register_notification},
@@ -223,6 +230,7 @@ struct {
 } constants[] = {{"Collectd::TYPE_INIT", PLUGIN_INIT},
                  {"Collectd::TYPE_READ", PLUGIN_READ},
                  {"Collectd::TYPE_WRITE", PLUGIN_WRITE},
+                 {"Collectd::TYPE_WRITE_BATCH", PLUGIN_WRITE_BATCH},
                  {"Collectd::TYPE_SHUTDOWN", PLUGIN_SHUTDOWN},
                  {"Collectd::TYPE_LOG", PLUGIN_LOG},
                  {"Collectd::TYPE_NOTIF", PLUGIN_NOTIF},
@@ -695,6 +703,78 @@ static int value_list2hv(pTHX_ value_list_t *vl, data_set_t *ds, HV *hash) {
   return 0;
 } /* static int value2av (value_list_t *, data_set_t *, HV *) */
 
+/* Converts a batch of value lists to an array of [type, data-set, value-list]
+ * arrays. Value lists of the same data-set share the type string and the
+ * data-set array, which are built only once per batch. */
+static int write_batch2av(pTHX_ const write_batch_entry_t *entries,
+                          size_t entries_num, AV *array) {
+  struct {
+    const data_set_t *ds;
+    SV *type;
+    AV *data_set;
+  } *seen = NULL;
+  size_t seen_num = 0;
+  int ret = 0;
+
+  if ((NULL == entries) || (0 == entries_num) || (NULL == array))
+    return -1;
+
+  seen = calloc(entries_num, sizeof(*seen));
+  if (NULL == seen)
+    return -1;
+
+  av_extend(array, entries_num - 1);
+
+  for (size_t i = 0; (i < entries_num) && (0 == ret); ++i) {
+    /* The conversion functions do not modify their arguments. */
+    data_set_t *ds = (data_set_t *)entries[i].ds;
+    value_list_t *vl = (value_list_t *)entries[i].vl;
+    size_t j;
+
+    for (j = 0; j < seen_num; ++j)
+      if (seen[j].ds == ds)
+        break;
+
+    if (j == seen_num) {
+      seen[j].ds = ds;
+      seen[j].type = newSVpv(ds->type, 0);
+      seen[j].data_set = newAV();
+      seen_num++;
+
+      if (-1 == data_set2av(aTHX_ ds, seen[j].data_set)) {
+        ret = -1;
+        break;
+      }
+    }
+
+    HV *values = newHV();
+    if (-1 == value_list2hv(aTHX_ vl, ds, values)) {
+      hv_undef(values);
+      SvREFCNT_dec((SV *)values);
+      ret = -1;
+      break;
+    }
+
+    AV *entry = newAV();
+    av_extend(entry, 2);
+    av_store(entry, 0, SvREFCNT_inc(seen[j].type));
+    av_store(entry, 1, newRV_inc((SV *)seen[j].data_set));
+    av_store(entry, 2, newRV_noinc((SV *)values));
+
+    if (NULL == av_store(array, i, newRV_noinc((SV *)entry)))
+      ret = -1;
+  }
+
+  /* The entries hold references of their own. */
+  for (size_t j = 0; j < seen_num; ++j) {
+    SvREFCNT_dec(seen[j].type);
+    SvREFCNT_dec((SV *)seen[j].data_set);
+  }
+  sfree(seen);
+
+  return ret;
+} /* static int write_batch2av (const write_batch_entry_t *, size_t, AV *) */
+
 static int notification_meta2av(pTHX_ notification_meta_t *meta, AV *array) {
   int meta_num = 0;
   for (notification_meta_t *m = meta; m != NULL; m = m->next) {
@@ -1070,6 +1150,34 @@ static int pplugin_call(pTHX_ int type, ...) {
     XPUSHs(sv_2mortal(newSVpv(ds->type, 0)));
     XPUSHs(sv_2mortal(newRV_noinc((SV *)pds)));
     XPUSHs(sv_2mortal(newRV_noinc((SV *)pvl)));
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    const write_batch_entry_t *entries;
+    size_t entries_num;
+
+    AV *batch = newAV();
+
+    subname = va_arg(ap, char *);
+    /*
+     * $_[0] =
+     * [
+     *   [ $type, $data_set, $value_list ],
+     *   ...
+     * ];
+     *
+     * $type, $data_set and $value_list are the same as the arguments of a
+     * write callback.
+     */
+    entries = va_arg(ap, const write_batch_entry_t *);
+    entries_num = va_arg(ap, size_t);
+
+    if (-1 == write_batch2av(aTHX_ entries, entries_num, batch)) {
+      av_clear(batch);
+      av_undef(batch);
+      batch = (AV *)&PL_sv_undef;
+      ret = -1;
+    }
+
+    XPUSHs(sv_2mortal(newRV_noinc((SV *)batch)));
   } else if (PLUGIN_LOG == type) {
     subname = va_arg(ap, char *);
     /*
@@ -1225,7 +1333,12 @@ static void c_ithread_destructor(void *arg) {
     return;
   }
 
-  c_ithread_destroy(ithread);
+  /* Cloning an interpreter is expensive, both in time and memory. Rather
+   * than destroying it, the interpreter is kept for the next thread calling
+   * into Perl, see c_ithread_create(). */
+  log_debug("Interpreter %p of exited thread is idle.", ithread->interp);
+  ithread->idle = true;
+  ithread->running = false;
 
   pthread_mutex_unlock(&perl_threads->mutex);
   return;
@@ -1238,6 +1351,21 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
 
   assert(NULL != perl_threads);
 
+  /* Reuse the interpreter of a thread that has exited, if any. */
+  for (t = perl_threads->head; NULL != t; t = t->next) {
+    if (!t->idle)
+      continue;
+
+    t->idle = false;
+    t->pthread = pthread_self();
+    t->running = false;
+    t->shutdown = false;
+
+    PERL_SET_CONTEXT(t->interp);
+    pthread_setspecific(perl_thr_key, (const void *)t);
+    return t;
+  }
+
   t = smalloc(sizeof(*t));
   memset(t, 0, sizeof(c_ithread_t));
 
@@ -1597,6 +1725,8 @@ static void _plugin_register_generic_userdata(pTHX, int type,
         &userdata);
   } else if (PLUGIN_WRITE == type) {
     ret = plugin_register_write(pluginname, perl_write, &userdata);
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    ret = plugin_register_write_batch(pluginname, perl_write_batch, &userdata);
   } else if (PLUGIN_LOG == type) {
     ret = plugin_register_log(pluginname, perl_log, &userdata);
   } else if (PLUGIN_NOTIF == type) {
@@ -1640,6 +1770,10 @@ static XS(Collectd_plugin_register_write) {
   _plugin_register_generic_userdata(aTHX, PLUGIN_WRITE, "write");
 }
 
+static XS(Collectd_plugin_register_write_batch) {
+  _plugin_register_generic_userdata(aTHX, PLUGIN_WRITE_BATCH, "write_batch");
+}
+
 static XS(Collectd_plugin_register_log) {
   _plugin_register_generic_userdata(aTHX, PLUGIN_LOG, "log");
 }
@@ -2152,6 +2286,40 @@ static int perl_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 } /* static int perl_write (const data_set_t *, const value_list_t *) */
 
+static int perl_write_batch(const write_batch_entry_t *entries,
+                            size_t entries_num, user_data_t *user_data) {
+  int status;
+  dTHX;
+
+  if (NULL == perl_threads)
+    return 0;
+
+  if (NULL == aTHX) {
+    c_ithread_t *t = NULL;
+
+    pthread_mutex_lock(&perl_threads->mutex);
+    t = c_ithread_create(perl_threads->head->interp);
+    pthread_mutex_unlock(&perl_threads->mutex);
+
+    aTHX = t->interp;
+  }
+
+  /* See perl_write(). */
+  if (aTHX == perl_threads->head->interp)
+    pthread_mutex_lock(&perl_threads->mutex);
+
+  log_debug("perl_write_batch: c_ithread: interp = %p (active threads: %i), "
+            "%zu value lists",
+            aTHX, perl_threads->number_of_threads, entries_num);
+  status = pplugin_call(aTHX_ PLUGIN_WRITE_BATCH, user_data->data, entries,
+                        entries_num);
+
+  if (aTHX == perl_threads->head->interp)
+    pthread_mutex_unlock(&perl_threads->mutex);
+
+  return status;
+} /* static int perl_write_batch (const write_batch_entry_t *, size_t) */
+
 static void perl_log(int level, const char *msg, user_data_t *user_data) {
   dTHX;
 
@@ -23,6 +23,8 @@
  *   Florian Forster <octo at collectd.org>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -57,6 +59,17 @@
 #define PINBA_MAX_SOCKETS 16
 #endif
 
+/* Number of datagrams read from a socket with one system call. */
+#ifndef PINBA_RECEIVE_BATCH_SIZE
+#define PINBA_RECEIVE_BATCH_SIZE 16
+#endif
+
+/* Size of the per-thread memory the requests are decoded into. Larger
+ * requests fall back to malloc(3). */
+#ifndef PINBA_ARENA_SIZE
+#define PINBA_ARENA_SIZE (4 * PINBA_UDP_BUFFER_SIZE)
+#endif
+
 /*
  * Private data structures
  */
@@ -74,6 +87,18 @@ struct float_counter_s {
 };
 typedef struct float_counter_s float_counter_t;
 
+struct pinba_counters_s {
+  derive_t req_count;
+
+  float_counter_t req_time;
+  float_counter_t ru_utime;
+  float_counter_t ru_stime;
+
+  derive_t doc_size;
+  gauge_t mem_peak;
+};
+typedef struct pinba_counters_s pinba_counters_t;
+
 struct pinba_statnode_s {
   /* collector name, used as plugin instance */
   char *name;
@@ -82,17 +107,37 @@ struct pinba_statnode_s {
   char *host;
   char *server;
   char *script;
+};
+typedef struct pinba_statnode_s pinba_statnode_t;
 
-  derive_t req_count;
+#if HAVE_RECVMMSG
+typedef struct mmsghdr receive_msg_t;
+#else
+/* Without recvmmsg(2), only one datagram is read at a time. */
+typedef struct {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+} receive_msg_t;
+#endif
 
-  float_counter_t req_time;
-  float_counter_t ru_utime;
-  float_counter_t ru_stime;
+/* Each receive thread has its own sockets, buffers and counters, so the
+ * threads don't contend for a lock. The read callback sums up the counters of
+ * all threads. */
+struct pinba_receiver_s {
+  pthread_t id;
 
-  derive_t doc_size;
-  gauge_t mem_peak;
+  /* Protects "counters", which has one entry per "stat_nodes" entry. */
+  pthread_mutex_t lock;
+  pinba_counters_t *counters;
+
+  uint8_t *buffers;
+
+  /* Memory the requests are decoded into. It is reused for every packet. */
+  ProtobufCAllocator allocator;
+  uint8_t *arena;
+  size_t arena_used;
 };
-typedef struct pinba_statnode_s pinba_statnode_t;
+typedef struct pinba_receiver_s pinba_receiver_t;
 /* }}} */
 
 /*
@@ -105,10 +150,11 @@ static pthread_mutex_t stat_nodes_lock;
 
 static char *conf_node;
 static char *conf_service;
+static int conf_receive_threads = 1;
 
-static bool collector_thread_running;
+static pinba_receiver_t *receivers;
+static size_t receivers_num;
 static bool collector_thread_do_shutdown;
-static pthread_t collector_thread_id;
 /* }}} */
 
 /*
@@ -134,6 +180,17 @@ static void float_counter_add(float_counter_t *fc, float val) /* {{{ */
   }
 } /* }}} void float_counter_add */
 
+static void float_counter_merge(float_counter_t *dst, /* {{{ */
+                                const float_counter_t *src) {
+  dst->i += src->i;
+  dst->n += src->n;
+
+  if (dst->n >= 1000000000) {
+    dst->i += 1;
+    dst->n -= 1000000000;
+  }
+} /* }}} void float_counter_merge */
+
 static derive_t float_counter_get(const float_counter_t *fc, /* {{{ */
                                   uint64_t factor) {
   derive_t ret;
@@ -180,8 +237,6 @@ static void service_statnode_add(const char *name, /* {{{ */
   node->server = NULL;
   node->script = NULL;
 
-  node->mem_peak = NAN;
-
   /* fill query data */
   strset(&node->name, name);
   strset(&node->host, host);
@@ -192,36 +247,34 @@ static void service_statnode_add(const char *name, /* {{{ */
   stat_nodes_num++;
 } /* }}} void service_statnode_add */
 
-/* Copy the data from the global "stat_nodes" list into the buffer pointed to
- * by "res", doing the derivation in the process. Returns the next index or
- * zero if the end of the list has been reached. */
-static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
-                                             unsigned int index) {
-  pinba_statnode_t *node;
-
-  if (stat_nodes_num == 0)
-    return 0;
-
-  /* begin collecting */
-  if (index == 0)
-    pthread_mutex_lock(&stat_nodes_lock);
-
-  /* end collecting */
-  if (index >= stat_nodes_num) {
-    pthread_mutex_unlock(&stat_nodes_lock);
-    return 0;
+/* Sums up the counters of all receive threads for the "stat_nodes" entry
+ * "index" and resets the peak memory usage. */
+static void service_statnode_collect(pinba_counters_t *res, /* {{{ */
+                                     unsigned int index) {
+  memset(res, 0, sizeof(*res));
+  res->mem_peak = NAN;
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    pthread_mutex_lock(&r->lock);
+    pinba_counters_t *c = r->counters + index;
+
+    res->req_count += c->req_count;
+    float_counter_merge(&res->req_time, &c->req_time);
+    float_counter_merge(&res->ru_utime, &c->ru_utime);
+    float_counter_merge(&res->ru_stime, &c->ru_stime);
+    res->doc_size += c->doc_size;
+    if (isnan(res->mem_peak) || (res->mem_peak < c->mem_peak))
+      res->mem_peak = c->mem_peak;
+
+    /* reset node */
+    c->mem_peak = NAN;
+    pthread_mutex_unlock(&r->lock);
   }
+} /* }}} void service_statnode_collect */
 
-  node = stat_nodes + index;
-  memcpy(res, node, sizeof(*res));
-
-  /* reset node */
-  node->mem_peak = NAN;
-
-  return index + 1;
-} /* }}} unsigned int service_statnode_collect */
-
-static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
+static void service_statnode_process(pinba_counters_t *node, /* {{{ */
                                      Pinba__Request *request) {
   node->req_count++;
 
@@ -237,10 +290,9 @@ static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
 
 } /* }}} void service_statnode_process */
 
-static void service_process_request(Pinba__Request *request) /* {{{ */
-{
-  pthread_mutex_lock(&stat_nodes_lock);
-
+/* Must be called with the receiver's lock held. */
+static void service_process_request(pinba_receiver_t *r, /* {{{ */
+                                    Pinba__Request *request) {
   for (unsigned int i = 0; i < stat_nodes_num; i++) {
     if ((stat_nodes[i].host != NULL) &&
         (strcmp(request->hostname, stat_nodes[i].host) != 0))
@@ -254,10 +306,8 @@ static void service_process_request(Pinba__Request *request) /* {{{ */
         (strcmp(request->script_name, stat_nodes[i].script) != 0))
       continue;
 
-    service_statnode_process(&stat_nodes[i], request);
+    service_statnode_process(&r->counters[i], request);
   }
-
-  pthread_mutex_unlock(&stat_nodes_lock);
 } /* }}} void service_process_request */
 
 static int pb_del_socket(pinba_socket_t *s, /* {{{ */
@@ -300,6 +350,18 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
     WARNING("pinba plugin: setsockopt(SO_REUSEADDR) failed: %s", STRERRNO);
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel distribute datagrams among the receive threads */
+  if (conf_receive_threads > 1) {
+    status = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int));
+    if (status != 0) {
+      ERROR("pinba plugin: setsockopt(SO_REUSEPORT) failed: %s", STRERRNO);
+      close(fd);
+      return 0;
+    }
+  }
+#endif
+
   status = bind(fd, ai->ai_addr, ai->ai_addrlen);
   if (status != 0) {
     ERROR("pinba plugin: bind(2) failed: %s", STRERRNO);
@@ -378,65 +440,109 @@ static void pinba_socket_free(pinba_socket_t *socket) /* {{{ */
   sfree(socket);
 } /* }}} void pinba_socket_free */
 
-static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
+/* Hands out memory from the receiver's arena. The arena is reset after each
+ * packet, so freeing is a no-op unless the arena was exhausted. */
+static void *pinba_arena_alloc(void *allocator_data, size_t size) /* {{{ */
+{
+  pinba_receiver_t *r = allocator_data;
+  size_t aligned = (size + 15) & ~((size_t)15);
+
+  if (aligned > PINBA_ARENA_SIZE - r->arena_used)
+    return malloc(size);
+
+  void *ptr = r->arena + r->arena_used;
+  r->arena_used += aligned;
+  return ptr;
+} /* }}} void *pinba_arena_alloc */
+
+static void pinba_arena_free(void *allocator_data, void *ptr) /* {{{ */
+{
+  pinba_receiver_t *r = allocator_data;
+  uint8_t *p = ptr;
+
+  if ((p >= r->arena) && (p < r->arena + PINBA_ARENA_SIZE))
+    return;
+  free(ptr);
+} /* }}} void pinba_arena_free */
+
+/* Must be called with the receiver's lock held. */
+static int pinba_process_stats_packet(pinba_receiver_t *r, /* {{{ */
+                                      const uint8_t *buffer,
                                       size_t buffer_size) {
   Pinba__Request *request;
 
-  request = pinba__request__unpack(NULL, buffer_size, buffer);
+  r->arena_used = 0;
+  request = pinba__request__unpack(&r->allocator, buffer_size, buffer);
 
   if (!request)
     return -1;
 
-  service_process_request(request);
-  pinba__request__free_unpacked(request, NULL);
+  service_process_request(r, request);
+  pinba__request__free_unpacked(request, &r->allocator);
 
   return 0;
 } /* }}} int pinba_process_stats_packet */
 
-static int pinba_udp_read_callback_fn(int sock) /* {{{ */
+/* Reads up to PINBA_RECEIVE_BATCH_SIZE datagrams from "sock" and accounts
+ * them. Returns the number of datagrams read or -1 on failure. */
+static int pinba_udp_read_callback_fn(pinba_receiver_t *r, int sock) /* {{{ */
 {
-  uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
-  size_t buffer_size;
-  int status;
+  receive_msg_t msgs[PINBA_RECEIVE_BATCH_SIZE] = {0};
+  struct iovec iov[PINBA_RECEIVE_BATCH_SIZE];
+  unsigned int msgs_max = PINBA_RECEIVE_BATCH_SIZE;
+  int msgs_num;
+
+#if !HAVE_RECVMMSG
+  msgs_max = 1;
+#endif
+
+  for (unsigned int i = 0; i < msgs_max; i++) {
+    iov[i].iov_base = r->buffers + (i * PINBA_UDP_BUFFER_SIZE);
+    iov[i].iov_len = PINBA_UDP_BUFFER_SIZE;
 
-  while (42) {
-    buffer_size = sizeof(buffer);
-    status = recvfrom(sock, buffer, buffer_size - 1, MSG_DONTWAIT,
-                      /* from = */ NULL, /* from len = */ 0);
-    if (status < 0) {
+    msgs[i].msg_hdr.msg_iov = iov + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-      if ((errno == EINTR)
+#if HAVE_RECVMMSG
+  msgs_num = recvmmsg(sock, msgs, msgs_max, MSG_DONTWAIT, NULL);
+#else
+  ssize_t len = recvmsg(sock, &msgs[0].msg_hdr, MSG_DONTWAIT);
+  msgs_num = (len < 0) ? -1 : 1;
+  if (len >= 0)
+    msgs[0].msg_len = (unsigned int)len;
+#endif
+  if (msgs_num < 0) {
+    if ((errno == EINTR)
 #ifdef EWOULDBLOCK
-          || (errno == EWOULDBLOCK)
+        || (errno == EWOULDBLOCK)
 #endif
-          || (errno == EAGAIN)) {
-        continue;
-      }
+        || (errno == EAGAIN)) {
+      return 0;
+    }
 
-      WARNING("pinba plugin: recvfrom(2) failed: %s", STRERRNO);
-      return -1;
-    } else if (status == 0) {
-      DEBUG("pinba plugin: recvfrom(2) returned unexpected status zero.");
-      return -1;
-    } else /* if (status > 0) */
-    {
-      assert(((size_t)status) < buffer_size);
-      buffer_size = (size_t)status;
-      buffer[buffer_size] = 0;
-
-      status = pinba_process_stats_packet(buffer, buffer_size);
-      if (status != 0)
-        DEBUG("pinba plugin: Parsing packet failed.");
-      return status;
+    WARNING("pinba plugin: recvmmsg(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  pthread_mutex_lock(&r->lock);
+  for (int i = 0; i < msgs_num; i++) {
+    if (msgs[i].msg_len == 0) {
+      DEBUG("pinba plugin: Received an empty datagram.");
+      continue;
     }
-  } /* while (42) */
 
-  /* not reached */
-  assert(23 == 42);
-  return -1;
-} /* }}} void pinba_udp_read_callback_fn */
+    int status = pinba_process_stats_packet(r, iov[i].iov_base,
+                                            (size_t)msgs[i].msg_len);
+    if (status != 0)
+      DEBUG("pinba plugin: Parsing packet failed.");
+  }
+  pthread_mutex_unlock(&r->lock);
 
-static int receive_loop(void) /* {{{ */
+  return msgs_num;
+} /* }}} int pinba_udp_read_callback_fn */
+
+static int receive_loop(pinba_receiver_t *r) /* {{{ */
 {
   pinba_socket_t *s;
 
@@ -470,7 +576,13 @@ static int receive_loop(void) /* {{{ */
         pb_del_socket(s, i);
         i--;
       } else if (s->fd[i].revents & (POLLIN | POLLPRI)) {
-        pinba_udp_read_callback_fn(s->fd[i].fd);
+        /* Keep reading while full batches are returned, but give the other
+         * sockets a chance eventually. */
+        for (int j = 0; j < 8; j++) {
+          if (pinba_udp_read_callback_fn(r, s->fd[i].fd) <
+              PINBA_RECEIVE_BATCH_SIZE)
+            break;
+        }
       }
     } /* for (s->fd) */
   }   /* while (!collector_thread_do_shutdown) */
@@ -483,14 +595,48 @@ static int receive_loop(void) /* {{{ */
 
 static void *collector_thread(void *arg) /* {{{ */
 {
-  receive_loop();
+  pinba_receiver_t *r = arg;
+
+  receive_loop(r);
 
-  memset(&collector_thread_id, 0, sizeof(collector_thread_id));
-  collector_thread_running = false;
   pthread_exit(NULL);
   return NULL;
 } /* }}} void *collector_thread */
 
+static void pinba_receiver_free(pinba_receiver_t *r) /* {{{ */
+{
+  pthread_mutex_destroy(&r->lock);
+  sfree(r->counters);
+  sfree(r->buffers);
+  sfree(r->arena);
+} /* }}} void pinba_receiver_free */
+
+static int pinba_receiver_init(pinba_receiver_t *r) /* {{{ */
+{
+  memset(r, 0, sizeof(*r));
+  pthread_mutex_init(&r->lock, /* attr = */ NULL);
+
+  r->counters = calloc(stat_nodes_num, sizeof(*r->counters));
+  r->buffers = malloc(PINBA_RECEIVE_BATCH_SIZE * PINBA_UDP_BUFFER_SIZE);
+  r->arena = malloc(PINBA_ARENA_SIZE);
+  if ((r->counters == NULL) || (r->buffers == NULL) || (r->arena == NULL)) {
+    ERROR("pinba plugin: malloc failed.");
+    pinba_receiver_free(r);
+    return ENOMEM;
+  }
+
+  for (unsigned int i = 0; i < stat_nodes_num; i++)
+    r->counters[i].mem_peak = NAN;
+
+  r->allocator = (ProtobufCAllocator){
+      .alloc = pinba_arena_alloc,
+      .free = pinba_arena_free,
+      .allocator_data = r,
+  };
+
+  return 0;
+} /* }}} int pinba_receiver_init */
+
 /*
  * Plugin declaration section
  */
@@ -550,12 +696,27 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_service(child, &conf_service);
     else if (strcasecmp("View", child->key) == 0)
       pinba_config_view(child);
-    else
+    else if (strcasecmp("ReceiveThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        ERROR("pinba plugin: \"ReceiveThreads\" requires a positive "
+              "integer.");
+      else
+        conf_receive_threads = tmp;
+    } else
       WARNING("pinba plugin: Unknown config option: %s", child->key);
   }
 
   pthread_mutex_unlock(&stat_nodes_lock);
 
+#ifndef SO_REUSEPORT
+  if (conf_receive_threads > 1) {
+    WARNING("pinba plugin: SO_REUSEPORT is not available, so only one receive "
+            "thread is used.");
+    conf_receive_threads = 1;
+  }
+#endif
+
   return 0;
 } /* }}} int pinba_config */
 
@@ -571,47 +732,67 @@ static int plugin_init(void) /* {{{ */
                          /* script = */ NULL);
   }
 
-  if (collector_thread_running)
+  if (receivers != NULL)
     return 0;
 
-  status = plugin_thread_create(&collector_thread_id, collector_thread,
-                                /* args = */ NULL, "pinba collector");
-  if (status != 0) {
-    ERROR("pinba plugin: pthread_create(3) failed: %s", STRERRNO);
+  receivers = calloc((size_t)conf_receive_threads, sizeof(*receivers));
+  if (receivers == NULL) {
+    ERROR("pinba plugin: calloc failed.");
+    return -1;
+  }
+
+  for (int i = 0; i < conf_receive_threads; i++) {
+    pinba_receiver_t *r = receivers + receivers_num;
+
+    status = pinba_receiver_init(r);
+    if (status != 0)
+      break;
+
+    status = plugin_thread_create(&r->id, collector_thread, r,
+                                  "pinba collector");
+    if (status != 0) {
+      ERROR("pinba plugin: pthread_create(3) failed: %s", STRERROR(status));
+      pinba_receiver_free(r);
+      break;
+    }
+    receivers_num++;
+  }
+
+  if (receivers_num == 0) {
+    sfree(receivers);
     return -1;
   }
-  collector_thread_running = true;
 
   return 0;
 } /* }}} */
 
 static int plugin_shutdown(void) /* {{{ */
 {
-  if (collector_thread_running) {
-    int status;
-
-    DEBUG("pinba plugin: Shutting down collector thread.");
-    collector_thread_do_shutdown = true;
+  DEBUG("pinba plugin: Shutting down collector threads.");
+  collector_thread_do_shutdown = true;
 
-    status = pthread_join(collector_thread_id, /* retval = */ NULL);
+  for (size_t i = 0; i < receivers_num; i++) {
+    int status = pthread_join(receivers[i].id, /* retval = */ NULL);
     if (status != 0) {
       ERROR("pinba plugin: pthread_join(3) failed: %s", STRERROR(status));
     }
+    pinba_receiver_free(receivers + i);
+  }
 
-    collector_thread_running = false;
-    collector_thread_do_shutdown = false;
-  } /* if (collector_thread_running) */
+  sfree(receivers);
+  receivers_num = 0;
+  collector_thread_do_shutdown = false;
 
   return 0;
 } /* }}} int plugin_shutdown */
 
-static int plugin_submit(const pinba_statnode_t *res) /* {{{ */
-{
+static int plugin_submit(const char *name, /* {{{ */
+                         const pinba_counters_t *res) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values_len = 1;
   sstrncpy(vl.plugin, "pinba", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, res->name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.plugin_instance, name, sizeof(vl.plugin_instance));
 
   vl.values = &(value_t){.derive = res->req_count};
   sstrncpy(vl.type, "total_requests", sizeof(vl.type));
@@ -648,11 +829,11 @@ static int plugin_submit(const pinba_statnode_t *res) /* {{{ */
 
 static int plugin_read(void) /* {{{ */
 {
-  unsigned int i = 0;
-  pinba_statnode_t data;
+  pinba_counters_t data;
 
-  while ((i = service_statnode_collect(&data, i)) != 0) {
-    plugin_submit(&data);
+  for (unsigned int i = 0; i < stat_nodes_num; i++) {
+    service_statnode_collect(&data, i);
+    plugin_submit(stat_nodes[i].name, &data);
   }
 
   return 0;
@@ -66,6 +66,20 @@ struct hostlist_s {
 };
 typedef struct hostlist_s hostlist_t;
 
+/* Each worker thread pings its share of the hosts with its own ping object.
+ * The rounds of the workers are staggered over the interval, so that the
+ * packets are not all sent at once. */
+struct ping_worker_s {
+  hostlist_t **hosts;
+  size_t hosts_num;
+
+  /* Delay of the first round relative to the start of the thread. */
+  double offset;
+
+  pthread_t thread;
+};
+typedef struct ping_worker_s ping_worker_t;
+
 /*
  * Private variables
  */
@@ -81,19 +95,22 @@ static int ping_ttl = PING_DEF_TTL;
 static double ping_interval = 1.0;
 static double ping_timeout = 0.9;
 static int ping_max_missed = -1;
+static int ping_threads_num = 1;
 
 static pthread_mutex_t ping_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t ping_cond = PTHREAD_COND_INITIALIZER;
 static int ping_thread_loop;
 static int ping_thread_error;
-static pthread_t ping_thread_id;
+static ping_worker_t *ping_workers;
+static size_t ping_workers_num;
+static size_t ping_workers_started;
 
 static const char *config_keys[] = {"Host",    "SourceAddress", "AddressFamily",
 #ifdef HAVE_OPING_1_3
                                     "Device",
 #endif
                                     "Size",    "TTL",           "Interval",
-                                    "Timeout", "MaxMissed"};
+                                    "Timeout", "MaxMissed",     "Threads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
@@ -118,6 +135,17 @@ static void time_normalize(struct timespec *ts) /* {{{ */
   }
 } /* }}} void time_normalize */
 
+/* Convert the number of seconds `t' to a timespec. */
+static void time_from_double(struct timespec *ts, double t) /* {{{ */
+{
+  double temp_sec;
+  double temp_nsec;
+
+  temp_nsec = modf(t, &temp_sec);
+  ts->tv_sec = (time_t)temp_sec;
+  ts->tv_nsec = (long)(temp_nsec * 1000000000L);
+} /* }}} void time_from_double */
+
 /* Add `ts_int' to `tv_begin' and store the result in `ts_dest'. If the result
  * is larger than `tv_end', copy `tv_end' to `ts_dest' instead. */
 static void time_calc(struct timespec *ts_dest, /* {{{ */
@@ -141,39 +169,53 @@ static void time_calc(struct timespec *ts_dest, /* {{{ */
   time_normalize(ts_dest);
 } /* }}} void time_calc */
 
-static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
+/* Returns the host list entry of `iter'. The entry is looked up by name once
+ * and then stored as the context of the iterator, so that large host lists
+ * are not searched for every reply. */
+static hostlist_t *ping_host_lookup(ping_worker_t *w, /* {{{ */
+                                    pingobj_t *pingobj, pingobj_iter_t *iter) {
+  hostlist_t *hl = ping_iterator_get_context(iter);
+  if (hl != NULL)
+    return hl;
+
+  char userhost[NI_MAXHOST];
+  size_t param_size = sizeof(userhost);
+  int status = ping_iterator_get_info(iter,
+#ifdef PING_INFO_USERNAME
+                                      PING_INFO_USERNAME,
+#else
+                                      PING_INFO_HOSTNAME,
+#endif
+                                      userhost, &param_size);
+  if (status != 0) {
+    WARNING("ping plugin: ping_iterator_get_info failed: %s",
+            ping_get_error(pingobj));
+    return NULL;
+  }
+
+  for (size_t i = 0; i < w->hosts_num; i++) {
+    if (strcmp(userhost, w->hosts[i]->host) == 0) {
+      ping_iterator_set_context(iter, w->hosts[i]);
+      return w->hosts[i];
+    }
+  }
+
+  WARNING("ping plugin: Cannot find host %s.", userhost);
+  return NULL;
+} /* }}} hostlist_t *ping_host_lookup */
+
+static int ping_dispatch_all(ping_worker_t *w, pingobj_t *pingobj) /* {{{ */
 {
-  hostlist_t *hl;
   int status;
 
   for (pingobj_iter_t *iter = ping_iterator_get(pingobj); iter != NULL;
        iter = ping_iterator_next(iter)) { /* {{{ */
-    char userhost[NI_MAXHOST];
     double latency;
     size_t param_size;
 
-    param_size = sizeof(userhost);
-    status = ping_iterator_get_info(iter,
-#ifdef PING_INFO_USERNAME
-                                    PING_INFO_USERNAME,
-#else
-                                    PING_INFO_HOSTNAME,
-#endif
-                                    userhost, &param_size);
-    if (status != 0) {
-      WARNING("ping plugin: ping_iterator_get_info failed: %s",
-              ping_get_error(pingobj));
+    hostlist_t *hl = ping_host_lookup(w, pingobj, iter);
+    if (hl == NULL)
       continue;
-    }
-
-    for (hl = hostlist_head; hl != NULL; hl = hl->next)
-      if (strcmp(userhost, hl->host) == 0)
-        break;
-
-    if (hl == NULL) {
-      WARNING("ping plugin: Cannot find host %s.", userhost);
-      continue;
-    }
 
     param_size = sizeof(latency);
     status = ping_iterator_get_info(iter, PING_INFO_LATENCY, (void *)&latency,
@@ -208,7 +250,8 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
               hl->host, ping_max_missed);
 
       /* we trigger the resolv simply be removeing and adding the host to our
-       * ping object */
+       * ping object. The context of the new iterator is set by the next call
+       * of ping_host_lookup. */
       status = ping_host_remove(pingobj, hl->host);
       if (status != 0) {
         WARNING("ping plugin: ping_host_remove (%s) failed.", hl->host);
@@ -225,6 +268,7 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
 
 static void *ping_thread(void *arg) /* {{{ */
 {
+  ping_worker_t *w = arg;
   struct timeval tv_begin;
   struct timeval tv_end;
   struct timespec ts_wait;
@@ -268,7 +312,8 @@ static void *ping_thread(void *arg) /* {{{ */
 
   /* Add all the hosts to the ping object. */
   count = 0;
-  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
+  for (size_t i = 0; i < w->hosts_num; i++) {
+    hostlist_t *hl = w->hosts[i];
     int tmp_status;
     tmp_status = ping_host_add(pingobj, hl->host);
     if (tmp_status != 0)
@@ -286,17 +331,23 @@ static void *ping_thread(void *arg) /* {{{ */
     return (void *)-1;
   }
 
-  /* Set up `ts_int' */
-  {
-    double temp_sec;
-    double temp_nsec;
+  time_from_double(&ts_int, ping_interval);
+
+  pthread_mutex_lock(&ping_lock);
+
+  /* Stagger the first round of this worker. */
+  if (w->offset > 0.0) {
+    struct timespec ts_offset;
 
-    temp_nsec = modf(ping_interval, &temp_sec);
-    ts_int.tv_sec = (time_t)temp_sec;
-    ts_int.tv_nsec = (long)(temp_nsec * 1000000000L);
+    time_from_double(&ts_offset, w->offset);
+    if (gettimeofday(&tv_begin, NULL) == 0) {
+      time_calc(&ts_wait, &ts_offset, &tv_begin, &tv_begin);
+      while ((ping_thread_loop > 0) &&
+             (pthread_cond_timedwait(&ping_cond, &ping_lock, &ts_wait) == 0))
+        ;
+    }
   }
 
-  pthread_mutex_lock(&ping_lock);
   while (ping_thread_loop > 0) {
     bool send_successful = false;
 
@@ -323,7 +374,7 @@ static void *ping_thread(void *arg) /* {{{ */
       break;
 
     if (send_successful)
-      (void)ping_dispatch_all(pingobj);
+      (void)ping_dispatch_all(w, pingobj);
 
     if (gettimeofday(&tv_end, NULL) < 0) {
       ERROR("ping plugin: gettimeofday failed: %s", STRERRNO);
@@ -346,6 +397,58 @@ static void *ping_thread(void *arg) /* {{{ */
   return (void *)0;
 } /* }}} void *ping_thread */
 
+static void ping_workers_destroy(void) /* {{{ */
+{
+  for (size_t i = 0; i < ping_workers_num; i++)
+    sfree(ping_workers[i].hosts);
+  sfree(ping_workers);
+  ping_workers_num = 0;
+  ping_workers_started = 0;
+} /* }}} void ping_workers_destroy */
+
+/* Distributes the hosts over `ping_threads_num' workers. */
+static int ping_workers_create(void) /* {{{ */
+{
+  size_t hosts_num = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+    hosts_num++;
+
+  size_t workers_num = (size_t)ping_threads_num;
+  if (workers_num > hosts_num)
+    workers_num = hosts_num;
+  if (workers_num == 0)
+    workers_num = 1;
+
+  ping_workers = calloc(workers_num, sizeof(*ping_workers));
+  if (ping_workers == NULL) {
+    ERROR("ping plugin: calloc failed.");
+    return ENOMEM;
+  }
+  ping_workers_num = workers_num;
+
+  for (size_t i = 0; i < ping_workers_num; i++) {
+    ping_worker_t *w = ping_workers + i;
+
+    w->hosts = calloc(hosts_num / workers_num + 1, sizeof(*w->hosts));
+    if (w->hosts == NULL) {
+      ERROR("ping plugin: calloc failed.");
+      ping_workers_destroy();
+      return ENOMEM;
+    }
+    w->offset = ping_interval * (double)i / (double)workers_num;
+  }
+
+  size_t i = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
+    ping_worker_t *w = ping_workers + (i % ping_workers_num);
+    w->hosts[w->hosts_num] = hl;
+    w->hosts_num++;
+    i++;
+  }
+
+  return 0;
+} /* }}} int ping_workers_create */
+
 static int start_thread(void) /* {{{ */
 {
   int status;
@@ -357,24 +460,42 @@ static int start_thread(void) /* {{{ */
     return 0;
   }
 
+  status = ping_workers_create();
+  if (status != 0) {
+    pthread_mutex_unlock(&ping_lock);
+    return -1;
+  }
+
   ping_thread_loop = 1;
   ping_thread_error = 0;
-  status = plugin_thread_create(&ping_thread_id, ping_thread,
-                                /* arg = */ (void *)0, "ping");
-  if (status != 0) {
+  for (size_t i = 0; i < ping_workers_num; i++) {
+    status = plugin_thread_create(&ping_workers[i].thread, ping_thread,
+                                  /* arg = */ ping_workers + i, "ping");
+    if (status != 0) {
+      ERROR("ping plugin: Starting thread failed.");
+      break;
+    }
+    ping_workers_started++;
+  }
+
+  if (ping_workers_started == 0) {
     ping_thread_loop = 0;
-    ERROR("ping plugin: Starting thread failed.");
+    ping_workers_destroy();
     pthread_mutex_unlock(&ping_lock);
     return -1;
   }
 
+  /* Let ping_read restart all threads, so that no host is left out. */
+  if (ping_workers_started < ping_workers_num)
+    ping_thread_error = 1;
+
   pthread_mutex_unlock(&ping_lock);
   return 0;
 } /* }}} int start_thread */
 
 static int stop_thread(void) /* {{{ */
 {
-  int status;
+  int status = 0;
 
   pthread_mutex_lock(&ping_lock);
 
@@ -387,14 +508,15 @@ static int stop_thread(void) /* {{{ */
   pthread_cond_broadcast(&ping_cond);
   pthread_mutex_unlock(&ping_lock);
 
-  status = pthread_join(ping_thread_id, /* return = */ NULL);
-  if (status != 0) {
-    ERROR("ping plugin: Stopping thread failed.");
-    status = -1;
+  for (size_t i = 0; i < ping_workers_started; i++) {
+    if (pthread_join(ping_workers[i].thread, /* return = */ NULL) != 0) {
+      ERROR("ping plugin: Stopping thread failed.");
+      status = -1;
+    }
   }
 
   pthread_mutex_lock(&ping_lock);
-  memset(&ping_thread_id, 0, sizeof(ping_thread_id));
+  ping_workers_destroy();
   ping_thread_error = 0;
   pthread_mutex_unlock(&ping_lock);
 
@@ -558,6 +680,12 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     ping_max_missed = atoi(value);
     if (ping_max_missed < 0)
       INFO("ping plugin: MaxMissed < 0, disabled re-resolving of hosts");
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp > 0)
+      ping_threads_num = tmp;
+    else
+      WARNING("ping plugin: Ignoring invalid Threads %i.", tmp);
   } else {
     return -1;
   }
@@ -103,8 +103,22 @@ typedef struct {
   char *name;
   char *statement;
   bool store_rates;
+
+  /* If set, rows are buffered and loaded with "COPY table FROM STDIN"
+   * instead of executing "statement" for each value list. */
+  char *table;
+  char *columns;
 } c_psql_writer_t;
 
+/* Rows buffered for one writer of a database, in COPY text format. */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+  size_t rows;
+  cdtime_t start;
+} c_psql_copy_t;
+
 typedef struct {
   PGconn *conn;
   c_complain_t conn_complaint;
@@ -119,9 +133,20 @@ typedef struct {
   udb_query_t **queries;
   size_t queries_num;
 
+  /* If set, one flag per query telling whether its statement has been
+   * prepared on the current connection. */
+  bool *prepared;
+  cdtime_t query_timeout;
+  bool report_query_times;
+
   c_psql_writer_t **writers;
   size_t writers_num;
 
+  /* one COPY buffer per writer */
+  c_psql_copy_t *copies;
+  int write_batch_size;
+  cdtime_t write_batch_timeout;
+
   /* make sure we don't access the database object in parallel */
   pthread_mutex_t db_lock;
 
@@ -196,6 +221,8 @@ static int c_psql_commit(c_psql_database_t *db) {
   return status;
 } /* c_psql_commit */
 
+static void c_psql_copy_flush(c_psql_database_t *db, bool force);
+
 static c_psql_database_t *c_psql_database_new(const char *name) {
   c_psql_database_t **tmp;
   c_psql_database_t *db;
@@ -230,9 +257,17 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->queries = NULL;
   db->queries_num = 0;
 
+  db->prepared = NULL;
+  db->query_timeout = 0;
+  db->report_query_times = false;
+
   db->writers = NULL;
   db->writers_num = 0;
 
+  db->copies = NULL;
+  db->write_batch_size = 1000;
+  db->write_batch_timeout = 0;
+
   pthread_mutex_init(&db->db_lock, /* attrs = */ NULL);
 
   db->commit_interval = 0;
@@ -270,6 +305,8 @@ static void c_psql_database_delete(void *data) {
   /* wait for the lock to be released by the last writer */
   pthread_mutex_lock(&db->db_lock);
 
+  c_psql_copy_flush(db, /* force = */ true);
+
   if (db->next_commit > 0)
     c_psql_commit(db);
 
@@ -284,6 +321,13 @@ static void c_psql_database_delete(void *data) {
   sfree(db->queries);
   db->queries_num = 0;
 
+  sfree(db->prepared);
+
+  if (db->copies != NULL)
+    for (size_t i = 0; i < db->writers_num; ++i)
+      sfree(db->copies[i].data);
+  sfree(db->copies);
+
   sfree(db->writers);
   db->writers_num = 0;
 
@@ -318,6 +362,7 @@ static int c_psql_connect(c_psql_database_t *db) {
   char conninfo[4096];
   char *buf = conninfo;
   int buf_len = sizeof(conninfo);
+  char options[64] = "";
   int status;
 
   if ((!db) || (!db->database))
@@ -338,6 +383,12 @@ static int c_psql_connect(c_psql_database_t *db) {
   C_PSQL_PAR_APPEND(buf, buf_len, "service", db->service);
   C_PSQL_PAR_APPEND(buf, buf_len, "application_name", "collectd_postgresql");
 
+  /* Let the server cancel statements running for longer than the timeout. */
+  if (db->query_timeout > 0)
+    ssnprintf(options, sizeof(options), "-c statement_timeout=%" PRIu64,
+              CDTIME_T_TO_MS(db->query_timeout));
+  C_PSQL_PAR_APPEND(buf, buf_len, "options", options);
+
   db->conn = PQconnectdb(conninfo);
   db->proto_version = PQprotocolVersion(db->conn);
   return 0;
@@ -359,6 +410,10 @@ static int c_psql_check_connection(c_psql_database_t *db) {
   if (CONNECTION_OK != PQstatus(db->conn)) {
     PQreset(db->conn);
 
+    /* Prepared statements are lost with the old session. */
+    if (db->prepared != NULL)
+      memset(db->prepared, 0, db->queries_num * sizeof(*db->prepared));
+
     /* trigger c_release() */
     if (0 == db->conn_complaint.interval)
       db->conn_complaint.interval = 1;
@@ -403,16 +458,11 @@ static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
   return PQexec(db->conn, udb_query_get_statement(q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
-                                          c_psql_user_data_t *data) {
-  const char *params[db->max_params_num];
-  char interval[64];
-
-  if ((data == NULL) || (data->params_num == 0))
-    return c_psql_exec_query_noparams(db, q);
-
-  assert(db->max_params_num >= data->params_num);
-
+/* Fills in the values of the query's parameters. "interval" is used as
+ * buffer for the interval parameter. */
+static void c_psql_query_params(c_psql_database_t *db,
+                                c_psql_user_data_t *data, const char **params,
+                                char *interval, size_t interval_size) {
   for (int i = 0; i < data->params_num; ++i) {
     switch (data->params[i]) {
     case C_PSQL_PARAM_HOST:
@@ -426,7 +476,7 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
       params[i] = db->user;
       break;
     case C_PSQL_PARAM_INTERVAL:
-      ssnprintf(interval, sizeof(interval), "%.3f",
+      ssnprintf(interval, interval_size, "%.3f",
                 CDTIME_T_TO_DOUBLE(plugin_get_interval()));
       params[i] = interval;
       break;
@@ -437,15 +487,85 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
       assert(0);
     }
   }
+} /* c_psql_query_params */
+
+static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
+                                          c_psql_user_data_t *data) {
+  const char *params[db->max_params_num];
+  char interval[64];
+
+  if ((data == NULL) || (data->params_num == 0))
+    return c_psql_exec_query_noparams(db, q);
+
+  assert(db->max_params_num >= data->params_num);
+
+  c_psql_query_params(db, data, params, interval, sizeof(interval));
 
   return PQexecParams(db->conn, udb_query_get_statement(q), data->params_num,
                       NULL, (const char *const *)params, NULL, NULL, 0);
 } /* c_psql_exec_query_params */
 
+/* Executes the query as prepared statement "collectd_<idx>", preparing it
+ * first if that has not been done on this connection yet. */
+static PGresult *c_psql_exec_query_prepared(c_psql_database_t *db,
+                                            udb_query_t *q, size_t idx,
+                                            c_psql_user_data_t *data) {
+  int params_num = (data != NULL) ? data->params_num : 0;
+  const char *params[params_num + 1];
+  char interval[64];
+  char name[32];
+
+  ssnprintf(name, sizeof(name), "collectd_%" PRIsz, idx);
+
+  if (!db->prepared[idx]) {
+    PGresult *res = PQprepare(db->conn, name, udb_query_get_statement(q),
+                              params_num, /* paramTypes = */ NULL);
+    if (PGRES_COMMAND_OK != PQresultStatus(res))
+      return res;
+
+    PQclear(res);
+    db->prepared[idx] = true;
+  }
+
+  if (params_num > 0)
+    c_psql_query_params(db, data, params, interval, sizeof(interval));
+
+  return PQexecPrepared(db->conn, name, params_num,
+                        (const char *const *)params, NULL, NULL, 0);
+} /* c_psql_exec_query_prepared */
+
+/* Returns the host name to use for the values read from the database. */
+static const char *c_psql_values_host(c_psql_database_t *db) {
+  if (C_PSQL_IS_UNIX_DOMAIN_SOCKET(db->host) ||
+      (0 == strcmp(db->host, "127.0.0.1")) ||
+      (0 == strcmp(db->host, "localhost")))
+    return hostname_g;
+  return db->host;
+} /* c_psql_values_host */
+
+static void c_psql_submit_query_time(c_psql_database_t *db, udb_query_t *q,
+                                     cdtime_t duration) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(duration)};
+  vl.values_len = 1;
+  sstrncpy(vl.host, c_psql_values_host(db), sizeof(vl.host));
+  sstrncpy(vl.plugin,
+           (db->plugin_name != NULL) ? db->plugin_name : "postgresql",
+           sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, db->instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, udb_query_get_name(q), sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* c_psql_submit_query_time */
+
 /* db->db_lock must be locked when calling this function */
 static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
+                             size_t idx,
                              udb_query_preparation_area_t *prep_area) {
   PGresult *res;
+  cdtime_t start = cdtime();
 
   c_psql_user_data_t *data;
 
@@ -462,7 +582,9 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   data = udb_query_get_user_data(q);
 
   /* Versions up to `3' don't know how to handle parameters. */
-  if (3 <= db->proto_version)
+  if ((3 <= db->proto_version) && (db->prepared != NULL))
+    res = c_psql_exec_query_prepared(db, q, idx, data);
+  else if (3 <= db->proto_version)
     res = c_psql_exec_query_params(db, q, data);
   else if ((NULL == data) || (0 == data->params_num))
     res = c_psql_exec_query_noparams(db, q);
@@ -489,7 +611,7 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
     if ((CONNECTION_OK != PQstatus(db->conn)) &&
         (0 == c_psql_check_connection(db))) {
       PQclear(res);
-      return c_psql_exec_query(db, q, prep_area);
+      return c_psql_exec_query(db, q, idx, prep_area);
     }
 
     log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
@@ -505,6 +627,9 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   pthread_mutex_lock(&db->db_lock);                                            \
   return status
 
+  if (db->report_query_times)
+    c_psql_submit_query_time(db, q, cdtime() - start);
+
   rows_num = PQntuples(res);
   if (1 > rows_num) {
     BAIL_OUT(0);
@@ -533,12 +658,7 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
     }
   }
 
-  if (C_PSQL_IS_UNIX_DOMAIN_SOCKET(db->host) ||
-      (0 == strcmp(db->host, "127.0.0.1")) ||
-      (0 == strcmp(db->host, "localhost")))
-    host = hostname_g;
-  else
-    host = db->host;
+  host = c_psql_values_host(db);
 
   status = udb_query_prepare_result(
       q, prep_area, host,
@@ -612,7 +732,7 @@ static int c_psql_read(user_data_t *ud) {
         (udb_query_check_version(q, db->server_version) <= 0))
       continue;
 
-    if (0 == c_psql_exec_query(db, q, prep_area))
+    if (0 == c_psql_exec_query(db, q, i, prep_area))
       success = 1;
   }
 
@@ -771,6 +891,154 @@ static char *values_to_sqlarray(const data_set_t *ds, const value_list_t *vl,
   return string;
 } /* values_to_sqlarray */
 
+/* Appends one row to the COPY buffer, using the text format: columns are
+ * separated by tabs, NULL is written as \N and backslashes and control
+ * characters are escaped. */
+static int c_psql_copy_append(c_psql_copy_t *c, const char *const *params,
+                              size_t params_num) {
+  size_t need = c->len + 1;
+  for (size_t i = 0; i < params_num; ++i)
+    need += (params[i] == NULL) ? 3 : 2 * strlen(params[i]) + 1;
+
+  if (need > c->size) {
+    size_t size = (c->size > 0) ? c->size : 4096;
+    while (size < need)
+      size *= 2;
+
+    char *tmp = realloc(c->data, size);
+    if (tmp == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+    c->data = tmp;
+    c->size = size;
+  }
+
+  for (size_t i = 0; i < params_num; ++i) {
+    if (i > 0)
+      c->data[c->len++] = '\t';
+
+    if (params[i] == NULL) {
+      memcpy(c->data + c->len, "\\N", 2);
+      c->len += 2;
+      continue;
+    }
+
+    for (const char *ptr = params[i]; *ptr != '\0'; ++ptr) {
+      char esc = 0;
+      if (*ptr == '\\')
+        esc = '\\';
+      else if (*ptr == '\t')
+        esc = 't';
+      else if (*ptr == '\n')
+        esc = 'n';
+      else if (*ptr == '\r')
+        esc = 'r';
+
+      if (esc != 0) {
+        c->data[c->len++] = '\\';
+        c->data[c->len++] = esc;
+      } else {
+        c->data[c->len++] = *ptr;
+      }
+    }
+  }
+  c->data[c->len++] = '\n';
+
+  if (c->rows == 0)
+    c->start = cdtime();
+  c->rows++;
+  return 0;
+} /* c_psql_copy_append */
+
+static int c_psql_copy_exec(c_psql_database_t *db, c_psql_writer_t *writer,
+                            c_psql_copy_t *c) {
+  char stmt[1024];
+  PGresult *res;
+  int status = 0;
+
+  ssnprintf(stmt, sizeof(stmt), "COPY %s%s FROM STDIN", writer->table,
+            (writer->columns != NULL) ? writer->columns : "");
+
+  res = PQexec(db->conn, stmt);
+  if (PGRES_COPY_IN != PQresultStatus(res)) {
+    PQclear(res);
+    return -1;
+  }
+  PQclear(res);
+
+  if (PQputCopyData(db->conn, c->data, (int)c->len) != 1)
+    status = -1;
+  if (PQputCopyEnd(db->conn, (status == 0) ? NULL : "sending rows failed") !=
+      1)
+    status = -1;
+
+  while ((res = PQgetResult(db->conn)) != NULL) {
+    if (PGRES_COMMAND_OK != PQresultStatus(res))
+      status = -1;
+    PQclear(res);
+  }
+
+  return status;
+} /* c_psql_copy_exec */
+
+/* Loads the buffered rows of one writer into the database. The rows are
+ * dropped if that fails twice. */
+static int c_psql_copy_send(c_psql_database_t *db, c_psql_writer_t *writer,
+                            c_psql_copy_t *c) {
+  int status;
+
+  if (c->rows == 0)
+    return 0;
+
+  status = c_psql_copy_exec(db, writer, c);
+  /* COPY either loads all rows or none, so it's safe to try again. */
+  if ((status != 0) && (CONNECTION_OK != PQstatus(db->conn)) &&
+      (0 == c_psql_check_connection(db)))
+    status = c_psql_copy_exec(db, writer, c);
+
+  if (status != 0) {
+    log_err("Failed to copy %" PRIsz " rows into %s: %s", c->rows,
+            writer->table, PQerrorMessage(db->conn));
+
+    /* this will abort any current transaction -> restart */
+    if (db->next_commit > 0)
+      c_psql_commit(db);
+  } else {
+    log_debug("Copied %" PRIsz " rows into %s.", c->rows, writer->table);
+  }
+
+  c->len = 0;
+  c->rows = 0;
+  return status;
+} /* c_psql_copy_send */
+
+/* Sends all buffered rows which are older than "WriteBatchTimeout", or all
+ * rows if "force" is true. You must hold "db_lock". */
+static void c_psql_copy_flush(c_psql_database_t *db, bool force) {
+  if (db->copies == NULL)
+    return;
+
+  cdtime_t now = cdtime();
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    c_psql_copy_t *c = db->copies + i;
+
+    if (c->rows == 0)
+      continue;
+    if (!force && ((now - c->start) < db->write_batch_timeout))
+      continue;
+
+    if (0 != c_psql_check_connection(db)) {
+      log_err("Dropping %" PRIsz " rows for %s.", c->rows,
+              db->writers[i]->table);
+      c->len = 0;
+      c->rows = 0;
+      continue;
+    }
+    c_psql_copy_send(db, db->writers[i], c);
+  }
+} /* c_psql_copy_flush */
+
 static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
                         user_data_t *ud) {
   c_psql_database_t *db;
@@ -853,6 +1121,20 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     params[7] = values_type_str;
     params[8] = values_str;
 
+    if (writer->table != NULL) {
+      c_psql_copy_t *c = db->copies + i;
+
+      if (c_psql_copy_append(c, params, STATIC_ARRAY_SIZE(params)) != 0) {
+        pthread_mutex_unlock(&db->db_lock);
+        return -1;
+      }
+      if (c->rows >= (size_t)db->write_batch_size)
+        c_psql_copy_send(db, writer, c);
+
+      success = 1;
+      continue;
+    }
+
     res = PQexecParams(db->conn, writer->statement, STATIC_ARRAY_SIZE(params),
                        NULL, (const char *const *)params, NULL, NULL,
                        /* return text data */ 0);
@@ -894,6 +1176,8 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     success = 1;
   }
 
+  c_psql_copy_flush(db, /* force = */ false);
+
   if ((db->next_commit > 0) && (cdtime() > db->next_commit))
     c_psql_commit(db);
 
@@ -921,11 +1205,17 @@ static int c_psql_flush(cdtime_t timeout,
   for (size_t i = 0; i < dbs_num; ++i) {
     c_psql_database_t *db = dbs[i];
 
+    pthread_mutex_lock(&db->db_lock);
+
+    c_psql_copy_flush(db, /* force = */ true);
+
     /* don't commit if the timeout is larger than the regular commit
      * interval as in that case all requested data has already been
      * committed */
     if ((db->next_commit > 0) && (db->commit_interval > timeout))
       c_psql_commit(db);
+
+    pthread_mutex_unlock(&db->db_lock);
   }
   return 0;
 } /* c_psql_flush */
@@ -1069,6 +1359,36 @@ static int config_add_writer(oconfig_item_t *ci, c_psql_writer_t *src_writers,
   return 0;
 } /* config_add_writer */
 
+/* Builds the " (col1, ..., col9)" column list of a COPY statement. */
+static int config_writer_columns(oconfig_item_t *ci, char **ret) {
+  char buffer[1024] = " (";
+
+  if (ci->values_num != 9) {
+    log_err("`Columns' expects exactly nine string arguments.");
+    return -1;
+  }
+
+  for (int i = 0; i < ci->values_num; ++i) {
+    if (ci->values[i].type != OCONFIG_TYPE_STRING) {
+      log_err("`Columns' expects exactly nine string arguments.");
+      return -1;
+    }
+    if ((strlen(buffer) + strlen(ci->values[i].value.string) + 3) >=
+        sizeof(buffer)) {
+      log_err("`Columns': Column names are too long.");
+      return -1;
+    }
+    if (i > 0)
+      strcat(buffer, ", ");
+    strcat(buffer, ci->values[i].value.string);
+  }
+  strcat(buffer, ")");
+
+  sfree(*ret);
+  *ret = sstrdup(buffer);
+  return 0;
+} /* config_writer_columns */
+
 static int c_psql_config_writer(oconfig_item_t *ci) {
   c_psql_writer_t *writer;
   c_psql_writer_t *tmp;
@@ -1101,12 +1421,29 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
       status = cf_util_get_string(c, &writer->statement);
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
+    else if (strcasecmp("Table", c->key) == 0)
+      status = cf_util_get_string(c, &writer->table);
+    else if (strcasecmp("Columns", c->key) == 0)
+      status = config_writer_columns(c, &writer->columns);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
+
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) &&
+      ((writer->statement == NULL) == (writer->table == NULL))) {
+    log_err("Writer \"%s\": Exactly one of \"Statement\" and \"Table\" "
+            "is required.",
+            writer->name);
+    status = -1;
   }
 
   if (status != 0) {
     sfree(writer->statement);
+    sfree(writer->table);
+    sfree(writer->columns);
     sfree(writer->name);
     return status;
   }
@@ -1115,12 +1452,133 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   return 0;
 } /* c_psql_config_writer */
 
+/* Allocates the query preparation areas of "db" and registers its read
+ * callback. */
+static int c_psql_setup_reader(c_psql_database_t *db, const char *cb_name,
+                               cdtime_t interval, bool prepare) {
+  db->q_prep_areas = calloc(db->queries_num, sizeof(*db->q_prep_areas));
+  if (db->q_prep_areas == NULL) {
+    log_err("Out of memory.");
+    return -1;
+  }
+
+  if (prepare) {
+    db->prepared = calloc(db->queries_num, sizeof(*db->prepared));
+    if (db->prepared == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    c_psql_user_data_t *data;
+    data = udb_query_get_user_data(db->queries[i]);
+    if ((data != NULL) && (data->params_num > db->max_params_num))
+      db->max_params_num = data->params_num;
+
+    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+
+    if (db->q_prep_areas[i] == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+
+  user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
+
+  ++db->ref_cnt;
+  plugin_register_complex_read("postgresql", cb_name, c_psql_read, interval,
+                               &ud);
+  return 0;
+} /* c_psql_setup_reader */
+
+/* Creates another connection to the database of "src", with the same
+ * settings but without queries and writers. */
+static c_psql_database_t *c_psql_database_clone(const c_psql_database_t *src) {
+  c_psql_database_t *db = c_psql_database_new(src->database);
+  if (db == NULL)
+    return NULL;
+
+  sfree(db->instance);
+  db->instance = sstrdup(src->instance);
+  db->host = sstrdup(src->host);
+  db->port = sstrdup(src->port);
+  db->user = sstrdup(src->user);
+  db->password = sstrdup(src->password);
+  db->plugin_name = sstrdup(src->plugin_name);
+  db->sslmode = sstrdup(src->sslmode);
+  db->krbsrvname = sstrdup(src->krbsrvname);
+  db->service = sstrdup(src->service);
+
+  db->query_timeout = src->query_timeout;
+  db->report_query_times = src->report_query_times;
+  return db;
+} /* c_psql_database_clone */
+
+/* Distributes the queries of "db" round-robin over "conn_num" connections,
+ * each read by its own callback, so that the queries run concurrently. */
+static int c_psql_setup_readers(c_psql_database_t *db, const char *cb_name,
+                                cdtime_t interval, bool prepare,
+                                int conn_num) {
+  udb_query_t **queries_all = db->queries;
+  size_t queries_all_num = db->queries_num;
+
+  if ((conn_num <= 1) || (queries_all_num <= 1))
+    return c_psql_setup_reader(db, cb_name, interval, prepare);
+
+  if ((size_t)conn_num > queries_all_num)
+    conn_num = (int)queries_all_num;
+
+  db->queries = calloc(queries_all_num / conn_num + 1, sizeof(*db->queries));
+  if (db->queries == NULL) {
+    log_err("Out of memory.");
+    db->queries = queries_all;
+    return -1;
+  }
+  db->queries_num = 0;
+  for (size_t i = 0; i < queries_all_num; i += conn_num)
+    db->queries[db->queries_num++] = queries_all[i];
+
+  int status = c_psql_setup_reader(db, cb_name, interval, prepare);
+
+  for (int n = 1; (status == 0) && (n < conn_num); n++) {
+    char name[DATA_MAX_NAME_LEN];
+    c_psql_database_t *conn = c_psql_database_clone(db);
+
+    if (conn == NULL) {
+      status = -1;
+      break;
+    }
+
+    conn->queries =
+        calloc(queries_all_num / conn_num + 1, sizeof(*conn->queries));
+    if (conn->queries == NULL) {
+      log_err("Out of memory.");
+      c_psql_database_delete(conn);
+      status = -1;
+      break;
+    }
+    for (size_t i = n; i < queries_all_num; i += conn_num)
+      conn->queries[conn->queries_num++] = queries_all[i];
+
+    ssnprintf(name, sizeof(name), "%s-%d", cb_name, n);
+    status = c_psql_setup_reader(conn, name, interval, prepare);
+    if (status != 0)
+      c_psql_database_delete(conn);
+  }
+
+  sfree(queries_all);
+  return status;
+} /* c_psql_setup_readers */
+
 static int c_psql_config_database(oconfig_item_t *ci) {
   c_psql_database_t *db;
 
   cdtime_t interval = 0;
   char cb_name[DATA_MAX_NAME_LEN];
   static bool have_flush;
+  int conn_num = 1;
+  bool prepare = false;
 
   if ((1 != ci->values_num) || (OCONFIG_TYPE_STRING != ci->values[0].type)) {
     log_err("<Database> expects a single string argument.");
@@ -1164,6 +1622,18 @@ static int c_psql_config_database(oconfig_item_t *ci) {
       cf_util_get_cdtime(c, &db->commit_interval);
     else if (strcasecmp("ExpireDelay", c->key) == 0)
       cf_util_get_cdtime(c, &db->expire_delay);
+    else if (strcasecmp("WriteBatchSize", c->key) == 0)
+      cf_util_get_int(c, &db->write_batch_size);
+    else if (strcasecmp("WriteBatchTimeout", c->key) == 0)
+      cf_util_get_cdtime(c, &db->write_batch_timeout);
+    else if (strcasecmp("Connections", c->key) == 0)
+      cf_util_get_int(c, &conn_num);
+    else if (strcasecmp("QueryTimeout", c->key) == 0)
+      cf_util_get_cdtime(c, &db->query_timeout);
+    else if (strcasecmp("PreparedStatements", c->key) == 0)
+      cf_util_get_boolean(c, &prepare);
+    else if (strcasecmp("ReportQueryTimes", c->key) == 0)
+      cf_util_get_boolean(c, &db->report_query_times);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
@@ -1175,38 +1645,32 @@ static int c_psql_config_database(oconfig_item_t *ci) {
                                        &db->queries, &db->queries_num);
   }
 
-  if (db->queries_num > 0) {
-    db->q_prep_areas = calloc(db->queries_num, sizeof(*db->q_prep_areas));
-    if (db->q_prep_areas == NULL) {
-      log_err("Out of memory.");
-      c_psql_database_delete(db);
-      return -1;
-    }
-  }
-
-  for (int i = 0; (size_t)i < db->queries_num; ++i) {
-    c_psql_user_data_t *data;
-    data = udb_query_get_user_data(db->queries[i]);
-    if ((data != NULL) && (data->params_num > db->max_params_num))
-      db->max_params_num = data->params_num;
-
-    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    if (db->writers[i]->table == NULL)
+      continue;
 
-    if (db->q_prep_areas[i] == NULL) {
+    db->copies = calloc(db->writers_num, sizeof(*db->copies));
+    if (db->copies == NULL) {
       log_err("Out of memory.");
       c_psql_database_delete(db);
       return -1;
     }
+    if (db->write_batch_size < 1)
+      db->write_batch_size = 1;
+    if (db->write_batch_timeout == 0)
+      db->write_batch_timeout = plugin_get_interval();
+    break;
   }
 
   ssnprintf(cb_name, sizeof(cb_name), "postgresql-%s", db->instance);
 
   user_data_t ud = {.data = db, .free_func = c_psql_database_delete};
 
-  if (db->queries_num > 0) {
-    ++db->ref_cnt;
-    plugin_register_complex_read("postgresql", cb_name, c_psql_read, interval,
-                                 &ud);
+  if ((db->queries_num > 0) &&
+      (c_psql_setup_readers(db, cb_name, interval, prepare, conn_num) != 0)) {
+    if (db->ref_cnt == 0)
+      c_psql_database_delete(db);
+    return -1;
   }
   if (db->writers_num > 0) {
     ++db->ref_cnt;
@@ -40,6 +40,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_batch.h"
 
 #if HAVE_LIBTASKSTATS
 #include "utils/taskstats/taskstats.h"
@@ -99,6 +100,11 @@
 #ifndef CONFIG_HZ
 #define CONFIG_HZ 100
 #endif
+#include "utils/avltree/avltree.h"
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -215,6 +221,11 @@ typedef struct process_entry_s {
   bool has_fd;
 
   bool has_maps;
+
+  /* Only set on Linux: start time in jiffies after boot, used to tell a
+   * reused PID from the process that had it before. */
+  unsigned long long start_time;
+  bool has_status;
 } process_entry_t;
 
 typedef struct procstat_entry_s {
@@ -314,7 +325,75 @@ static mach_msg_type_number_t pset_list_len;
 
 #elif KERNEL_LINUX
 static long pagesize_g;
-static void ps_fill_details(const procstat_t *ps, process_entry_t *entry);
+static int ps_cache_init(void);
+
+/* Per-thread state for reading the files below /proc/<pid>. Files are opened
+ * relative to the directory of the process, and the buffers are reused for
+ * every process. */
+typedef struct {
+  int pid_fd;
+  char buffer[4096];
+  char cmdline[CMDLINE_BUFFER_SIZE];
+} ps_reader_t;
+
+/* Per-PID cache used by the "IncrementalScan" option. It remembers which
+ * matches a process belongs to, so that the command line only has to be read
+ * and matched again when the process has changed. */
+typedef struct {
+  long pid;
+  unsigned long long start_time;
+  char name[PROCSTAT_NAME_LEN];
+  uint64_t seen;
+  bool stale;
+
+  procstat_t **matches;
+  size_t matches_num;
+} ps_cache_entry_t;
+
+static bool incremental_scan;
+static c_avl_tree_t *ps_cache;
+static uint64_t ps_cache_generation;
+
+/* Events received from the netlink process connector. They are queued by the
+ * listener thread and applied to the cache at the beginning of each read. */
+#define PS_EVENTS_MAX 65536
+typedef struct {
+  unsigned what;
+  long pid;
+  long parent;
+} ps_event_t;
+
+static int ps_nl_sock = -1;
+static pthread_t ps_nl_thread;
+static bool ps_nl_thread_running;
+static pthread_mutex_t ps_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static ps_event_t *ps_events;
+static size_t ps_events_num;
+static size_t ps_events_size;
+static bool ps_events_lost;
+
+/* Result of reading one process during a scan of /proc. */
+typedef struct {
+  long pid;
+  char state;
+  /* Valid cache entry providing the matches, or NULL. */
+  ps_cache_entry_t *ce;
+  /* Matches of the process if "ce" is NULL. */
+  procstat_t **matches;
+  size_t matches_num;
+  /* Only set for processes belonging to a match or to be added to the
+   * cache. */
+  process_entry_t *entry;
+} ps_result_t;
+
+#define PS_SCAN_CHUNK 64
+static size_t scan_threads = 1;
+static ps_reader_t *ps_readers;
+static ps_result_t *ps_results;
+static size_t ps_results_num;
+static size_t ps_results_size;
+static size_t ps_results_next;
+static int ps_proc_fd = -1;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -515,92 +594,94 @@ static void ps_update_delay(procstat_t *out, procstat_entry_t *prev,
 }
 #endif
 
-/* add process entry to 'instances' of process 'name' (or refresh it) */
-static void ps_list_add(const char *name, const char *cmdline,
-                        process_entry_t *entry) {
+/* add process entry to the 'instances' of a single match (or refresh it) */
+static void ps_list_add_one(procstat_t *ps, process_entry_t *entry) {
   procstat_entry_t *pse;
 
-  if (entry->id == 0)
-    return;
-
-  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
-    if ((ps_list_match(name, cmdline, ps)) == 0)
-      continue;
+  for (pse = ps->instances; pse != NULL; pse = pse->next)
+    if ((pse->id == entry->id) || (pse->next == NULL))
+      break;
 
-#if KERNEL_LINUX
-    ps_fill_details(ps, entry);
-#endif
+  if ((pse == NULL) || (pse->id != entry->id)) {
+    procstat_entry_t *new;
 
-    for (pse = ps->instances; pse != NULL; pse = pse->next)
-      if ((pse->id == entry->id) || (pse->next == NULL))
-        break;
+    new = calloc(1, sizeof(*new));
+    if (new == NULL)
+      return;
+    new->id = entry->id;
 
-    if ((pse == NULL) || (pse->id != entry->id)) {
-      procstat_entry_t *new;
+    if (pse == NULL)
+      ps->instances = new;
+    else
+      pse->next = new;
 
-      new = calloc(1, sizeof(*new));
-      if (new == NULL)
-        return;
-      new->id = entry->id;
+    pse = new;
+  }
 
-      if (pse == NULL)
-        ps->instances = new;
-      else
-        pse->next = new;
+  pse->age = 0;
 
-      pse = new;
-    }
+  ps->num_proc += entry->num_proc;
+  ps->num_lwp += entry->num_lwp;
+  ps->num_fd += entry->num_fd;
+  ps->num_maps += entry->num_maps;
+  ps->vmem_size += entry->vmem_size;
+  ps->vmem_rss += entry->vmem_rss;
+  ps->vmem_data += entry->vmem_data;
+  ps->vmem_code += entry->vmem_code;
+  ps->stack_size += entry->stack_size;
 
-    pse->age = 0;
-
-    ps->num_proc += entry->num_proc;
-    ps->num_lwp += entry->num_lwp;
-    ps->num_fd += entry->num_fd;
-    ps->num_maps += entry->num_maps;
-    ps->vmem_size += entry->vmem_size;
-    ps->vmem_rss += entry->vmem_rss;
-    ps->vmem_data += entry->vmem_data;
-    ps->vmem_code += entry->vmem_code;
-    ps->stack_size += entry->stack_size;
-
-    if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
-      ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
-      ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
-    }
+  if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
+    ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
+    ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
+  }
 
-    if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
-      ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
-      ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
-    }
+  if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
+    ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
+    ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
+  }
 
-    if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
-      ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
-      ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
-    }
+  if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
+    ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
+    ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
+  }
 
-    if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
-      ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol,
-                        entry->cswitch_vol);
-      ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
-                        entry->cswitch_invol);
-    }
+  if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
+    ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol, entry->cswitch_vol);
+    ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
+                      entry->cswitch_invol);
+  }
 
-    ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
-                      entry->vmem_minflt_counter);
-    ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
-                      entry->vmem_majflt_counter);
+  ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
+                    entry->vmem_minflt_counter);
+  ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
+                    entry->vmem_majflt_counter);
 
-    ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
-                      entry->cpu_user_counter);
-    ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
-                      entry->cpu_system_counter);
+  ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
+                    entry->cpu_user_counter);
+  ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
+                    entry->cpu_system_counter);
 
 #if HAVE_LIBTASKSTATS
-    if (entry->has_delay)
-      ps_update_delay(ps, pse, entry);
+  if (entry->has_delay)
+    ps_update_delay(ps, pse, entry);
 #endif
+}
+
+#if !KERNEL_LINUX
+/* add process entry to 'instances' of process 'name' (or refresh it) */
+static void ps_list_add(const char *name, const char *cmdline,
+                        process_entry_t *entry) {
+  if (entry->id == 0)
+    return;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if ((ps_list_match(name, cmdline, ps)) == 0)
+      continue;
+
+    ps_list_add_one(ps, entry);
   }
 }
+#endif
 
 /* remove old entries from instances of processes in list_head_g */
 static void ps_list_reset(void) {
@@ -733,6 +814,27 @@ static int ps_config(oconfig_item_t *ci) {
 #else
       WARNING("processes plugin: The plugin has been compiled without support "
               "for the \"CollectDelayAccounting\" option.");
+#endif
+    } else if (strcasecmp(c->key, "IncrementalScan") == 0) {
+#if KERNEL_LINUX
+      cf_util_get_boolean(c, &incremental_scan);
+#else
+      WARNING("processes plugin: The \"IncrementalScan\" option is only "
+              "available on Linux.");
+#endif
+    } else if (strcasecmp(c->key, "ScanThreads") == 0) {
+#if KERNEL_LINUX
+      int tmp = 0;
+      if (cf_util_get_int(c, &tmp) != 0)
+        continue;
+      if (tmp < 1) {
+        ERROR("processes plugin: \"ScanThreads\" must be at least 1.");
+        continue;
+      }
+      scan_threads = (size_t)tmp;
+#else
+      WARNING("processes plugin: The \"ScanThreads\" option is only "
+              "available on Linux.");
 #endif
     } else {
       ERROR("processes plugin: The `%s' configuration option is not "
@@ -780,6 +882,19 @@ static int ps_init(void) {
     }
   }
 #endif
+
+  if (ps_readers == NULL) {
+    ps_readers = calloc(scan_threads, sizeof(*ps_readers));
+    if (ps_readers == NULL) {
+      ERROR("processes plugin: calloc failed.");
+      return -1;
+    }
+    for (size_t i = 0; i < scan_threads; i++)
+      ps_readers[i].pid_fd = -1;
+  }
+
+  if (incremental_scan && (ps_cache_init() != 0))
+    return -1;
   /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -807,6 +922,9 @@ static int ps_init(void) {
   return 0;
 } /* int ps_init */
 
+/* The value lists of one read, dispatched together at its end. */
+static vl_batch_t ps_batch = VL_BATCH_INIT;
+
 /* submit global state (e.g.: qty of zombies, running, etc..) */
 static void ps_submit_state(const char *state, double value) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -818,7 +936,7 @@ static void ps_submit_state(const char *state, double value) {
   sstrncpy(vl.type, "ps_state", sizeof(vl.type));
   sstrncpy(vl.type_instance, state, sizeof(vl.type_instance));
 
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 }
 
 /* submit info about specific process (e.g.: memory taken, cpu usage, etc..) */
@@ -833,52 +951,52 @@ static void ps_submit_proc_list(procstat_t *ps) {
   sstrncpy(vl.type, "ps_vm", sizeof(vl.type));
   vl.values[0].gauge = ps->vmem_size;
   vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_rss", sizeof(vl.type));
   vl.values[0].gauge = ps->vmem_rss;
   vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_data", sizeof(vl.type));
   vl.values[0].gauge = ps->vmem_data;
   vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_code", sizeof(vl.type));
   vl.values[0].gauge = ps->vmem_code;
   vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_stacksize", sizeof(vl.type));
   vl.values[0].gauge = ps->stack_size;
   vl.values_len = 1;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_cputime", sizeof(vl.type));
   vl.values[0].derive = ps->cpu_user_counter;
   vl.values[1].derive = ps->cpu_system_counter;
   vl.values_len = 2;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_count", sizeof(vl.type));
   vl.values[0].gauge = ps->num_proc;
   vl.values[1].gauge = ps->num_lwp;
   vl.values_len = 2;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   sstrncpy(vl.type, "ps_pagefaults", sizeof(vl.type));
   vl.values[0].derive = ps->vmem_minflt_counter;
   vl.values[1].derive = ps->vmem_majflt_counter;
   vl.values_len = 2;
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 
   if ((ps->io_rchar != -1) && (ps->io_wchar != -1)) {
     sstrncpy(vl.type, "io_octets", sizeof(vl.type));
     vl.values[0].derive = ps->io_rchar;
     vl.values[1].derive = ps->io_wchar;
     vl.values_len = 2;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   if ((ps->io_syscr != -1) && (ps->io_syscw != -1)) {
@@ -886,7 +1004,7 @@ static void ps_submit_proc_list(procstat_t *ps) {
     vl.values[0].derive = ps->io_syscr;
     vl.values[1].derive = ps->io_syscw;
     vl.values_len = 2;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   if ((ps->io_diskr != -1) && (ps->io_diskw != -1)) {
@@ -894,14 +1012,14 @@ static void ps_submit_proc_list(procstat_t *ps) {
     vl.values[0].derive = ps->io_diskr;
     vl.values[1].derive = ps->io_diskw;
     vl.values_len = 2;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   if (ps->num_fd > 0) {
     sstrncpy(vl.type, "file_handles", sizeof(vl.type));
     vl.values[0].gauge = ps->num_fd;
     vl.values_len = 1;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   if (ps->num_maps > 0) {
@@ -909,7 +1027,7 @@ static void ps_submit_proc_list(procstat_t *ps) {
     sstrncpy(vl.type_instance, "mapped", sizeof(vl.type_instance));
     vl.values[0].gauge = ps->num_maps;
     vl.values_len = 1;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   if ((ps->cswitch_vol != -1) && (ps->cswitch_invol != -1)) {
@@ -917,13 +1035,13 @@ static void ps_submit_proc_list(procstat_t *ps) {
     sstrncpy(vl.type_instance, "voluntary", sizeof(vl.type_instance));
     vl.values[0].derive = ps->cswitch_vol;
     vl.values_len = 1;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
 
     sstrncpy(vl.type, "contextswitch", sizeof(vl.type));
     sstrncpy(vl.type_instance, "involuntary", sizeof(vl.type_instance));
     vl.values[0].derive = ps->cswitch_invol;
     vl.values_len = 1;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   /* The ps->delay_* metrics are in nanoseconds per second. Convert to seconds
@@ -948,7 +1066,7 @@ static void ps_submit_proc_list(procstat_t *ps) {
              sizeof(vl.type_instance));
     vl.values[0].gauge = delay_metrics[i].rate_ns / delay_factor;
     vl.values_len = 1;
-    plugin_dispatch_values(&vl);
+    vl_batch_add(&ps_batch, &vl);
   }
 
   DEBUG(
@@ -984,60 +1102,86 @@ static void ps_submit_fork_rate(derive_t value) {
   sstrncpy(vl.type, "fork_rate", sizeof(vl.type));
   sstrncpy(vl.type_instance, "", sizeof(vl.type_instance));
 
-  plugin_dispatch_values(&vl);
+  vl_batch_add(&ps_batch, &vl);
 }
 #endif /* KERNEL_LINUX || KERNEL_SOLARIS*/
 
 /* ------- additional functions for KERNEL_LINUX/HAVE_THREAD_INFO ------- */
 #if KERNEL_LINUX
-static int ps_read_tasks_status(process_entry_t *ps) {
-  char dirname[64];
-  DIR *dh;
+/* Reads the file "name" below "dir_fd" into "buf" with a single pread(2) and
+ * returns the number of bytes read, or -1 on error. The files below
+ * /proc/<pid> are generated in one go, so one read suffices as long as the
+ * buffer is large enough. The result is null-terminated. */
+static ssize_t ps_read_file(int dir_fd, const char *name, char *buf,
+                            size_t buf_size) {
+  ssize_t status;
+  int fd;
+
+  fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  do {
+    status = pread(fd, buf, buf_size - 1, /* offset = */ 0);
+  } while ((status < 0) && (errno == EINTR));
+  close(fd);
+
+  if (status < 0)
+    return -1;
+
+  buf[status] = 0;
+  return status;
+} /* ssize_t ps_read_file */
+
+static int ps_read_tasks_status(ps_reader_t *r, process_entry_t *ps) {
   char filename[64];
-  FILE *fh;
+  int task_fd;
+  DIR *dh;
   struct dirent *ent;
   derive_t cswitch_vol = 0;
   derive_t cswitch_invol = 0;
-  char buffer[1024];
   char *fields[8];
   int numfields;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%li/task", ps->id);
+  task_fd = openat(r->pid_fd, "task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd < 0) {
+    DEBUG("Failed to open directory `/proc/%lu/task'", ps->id);
+    return -1;
+  }
 
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  if ((dh = fdopendir(task_fd)) == NULL) {
+    DEBUG("Failed to open directory `/proc/%lu/task'", ps->id);
+    close(task_fd);
     return -1;
   }
 
   while ((ent = readdir(dh)) != NULL) {
-    char *tpid;
+    char *saveptr = NULL;
 
     if (!isdigit((int)ent->d_name[0]))
       continue;
 
-    tpid = ent->d_name;
-
-    int r = snprintf(filename, sizeof(filename), "/proc/%li/task/%s/status",
-                     ps->id, tpid);
-    if ((size_t)r >= sizeof(filename)) {
+    int r_len = snprintf(filename, sizeof(filename), "%s/status", ent->d_name);
+    if ((size_t)r_len >= sizeof(filename)) {
       DEBUG("Filename too long: `%s'", filename);
       continue;
     }
 
-    if ((fh = fopen(filename, "r")) == NULL) {
-      DEBUG("Failed to open file `%s'", filename);
+    if (ps_read_file(task_fd, filename, r->buffer, sizeof(r->buffer)) < 0) {
+      DEBUG("Failed to read file `/proc/%lu/task/%s'", ps->id, filename);
       continue;
     }
 
-    while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+    for (char *line = strtok_r(r->buffer, "\n", &saveptr); line != NULL;
+         line = strtok_r(NULL, "\n", &saveptr)) {
       derive_t tmp;
       char *endptr;
 
-      if (strncmp(buffer, "voluntary_ctxt_switches", 23) != 0 &&
-          strncmp(buffer, "nonvoluntary_ctxt_switches", 26) != 0)
+      if (strncmp(line, "voluntary_ctxt_switches", 23) != 0 &&
+          strncmp(line, "nonvoluntary_ctxt_switches", 26) != 0)
         continue;
 
-      numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+      numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
       if (numfields < 2)
         continue;
@@ -1046,17 +1190,13 @@ static int ps_read_tasks_status(process_entry_t *ps) {
       endptr = NULL;
       tmp = (derive_t)strtoll(fields[1], &endptr, /* base = */ 10);
       if ((errno == 0) && (endptr != fields[1])) {
-        if (strncmp(buffer, "voluntary_ctxt_switches", 23) == 0) {
+        if (strncmp(line, "voluntary_ctxt_switches", 23) == 0) {
           cswitch_vol += tmp;
-        } else if (strncmp(buffer, "nonvoluntary_ctxt_switches", 26) == 0) {
+        } else if (strncmp(line, "nonvoluntary_ctxt_switches", 26) == 0) {
           cswitch_invol += tmp;
         }
       }
-    } /* while (fgets) */
-
-    if (fclose(fh)) {
-      WARNING("processes: fclose: %s", STRERRNO);
-    }
+    } /* for (line) */
   }
   closedir(dh);
 
@@ -1067,29 +1207,27 @@ static int ps_read_tasks_status(process_entry_t *ps) {
 } /* int *ps_read_tasks_status */
 
 /* Read data from /proc/pid/status */
-static int ps_read_status(long pid, process_entry_t *ps) {
-  FILE *fh;
-  char buffer[1024];
-  char filename[64];
+static int ps_read_status(ps_reader_t *r, process_entry_t *ps) {
   unsigned long lib = 0;
   unsigned long exe = 0;
   unsigned long data = 0;
   unsigned long threads = 0;
   char *fields[8];
   int numfields;
+  char *saveptr = NULL;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/status", pid);
-  if ((fh = fopen(filename, "r")) == NULL)
+  if (ps_read_file(r->pid_fd, "status", r->buffer, sizeof(r->buffer)) < 0)
     return -1;
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  for (char *line = strtok_r(r->buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
     unsigned long tmp;
     char *endptr;
 
-    if (strncmp(buffer, "Vm", 2) != 0 && strncmp(buffer, "Threads", 7) != 0)
+    if (strncmp(line, "Vm", 2) != 0 && strncmp(line, "Threads", 7) != 0)
       continue;
 
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
     if (numfields < 2)
       continue;
@@ -1098,21 +1236,17 @@ static int ps_read_status(long pid, process_entry_t *ps) {
     endptr = NULL;
     tmp = strtoul(fields[1], &endptr, /* base = */ 10);
     if ((errno == 0) && (endptr != fields[1])) {
-      if (strncmp(buffer, "VmData", 6) == 0) {
+      if (strncmp(line, "VmData", 6) == 0) {
         data = tmp;
-      } else if (strncmp(buffer, "VmLib", 5) == 0) {
+      } else if (strncmp(line, "VmLib", 5) == 0) {
         lib = tmp;
-      } else if (strncmp(buffer, "VmExe", 5) == 0) {
+      } else if (strncmp(line, "VmExe", 5) == 0) {
         exe = tmp;
-      } else if (strncmp(buffer, "Threads", 7) == 0) {
+      } else if (strncmp(line, "Threads", 7) == 0) {
         threads = tmp;
       }
     }
-  } /* while (fgets) */
-
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
-  }
+  } /* for (line) */
 
   ps->vmem_data = data * 1024;
   ps->vmem_code = (exe + lib) * 1024;
@@ -1122,41 +1256,38 @@ static int ps_read_status(long pid, process_entry_t *ps) {
   return 0;
 } /* int *ps_read_status */
 
-static int ps_read_io(process_entry_t *ps) {
-  FILE *fh;
-  char buffer[1024];
-  char filename[64];
-
+static int ps_read_io(ps_reader_t *r, process_entry_t *ps) {
   char *fields[8];
   int numfields;
+  char *saveptr = NULL;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/io", ps->id);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_read_io: Failed to open file `%s'", filename);
+  if (ps_read_file(r->pid_fd, "io", r->buffer, sizeof(r->buffer)) < 0) {
+    DEBUG("ps_read_io: Failed to read file `/proc/%lu/io'", ps->id);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  for (char *line = strtok_r(r->buffer, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
     derive_t *val = NULL;
     long long tmp;
     char *endptr;
 
-    if (strncasecmp(buffer, "rchar:", 6) == 0)
+    if (strncasecmp(line, "rchar:", 6) == 0)
       val = &(ps->io_rchar);
-    else if (strncasecmp(buffer, "wchar:", 6) == 0)
+    else if (strncasecmp(line, "wchar:", 6) == 0)
       val = &(ps->io_wchar);
-    else if (strncasecmp(buffer, "syscr:", 6) == 0)
+    else if (strncasecmp(line, "syscr:", 6) == 0)
       val = &(ps->io_syscr);
-    else if (strncasecmp(buffer, "syscw:", 6) == 0)
+    else if (strncasecmp(line, "syscw:", 6) == 0)
       val = &(ps->io_syscw);
-    else if (strncasecmp(buffer, "read_bytes:", 11) == 0)
+    else if (strncasecmp(line, "read_bytes:", 11) == 0)
       val = &(ps->io_diskr);
-    else if (strncasecmp(buffer, "write_bytes:", 12) == 0)
+    else if (strncasecmp(line, "write_bytes:", 12) == 0)
       val = &(ps->io_diskw);
     else
       continue;
 
-    numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
 
     if (numfields < 2)
       continue;
@@ -1168,48 +1299,53 @@ static int ps_read_io(process_entry_t *ps) {
       *val = -1;
     else
       *val = (derive_t)tmp;
-  } /* while (fgets) */
+  } /* for (line) */
 
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
-  }
   return 0;
 } /* int ps_read_io (...) */
 
-static int ps_count_maps(pid_t pid) {
-  FILE *fh;
-  char buffer[1024];
-  char filename[64];
+/* /proc/<pid>/maps may be much larger than the buffer, so it is read in
+ * chunks, counting the lines. */
+static int ps_count_maps(ps_reader_t *r, long pid) {
   int count = 0;
+  int fd;
 
-  snprintf(filename, sizeof(filename), "/proc/%d/maps", pid);
-  if ((fh = fopen(filename, "r")) == NULL) {
-    DEBUG("ps_count_maps: Failed to open file `%s'", filename);
+  fd = openat(r->pid_fd, "maps", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    DEBUG("ps_count_maps: Failed to open file `/proc/%li/maps'", pid);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    if (strchr(buffer, '\n')) {
-      count++;
+  while (42) {
+    ssize_t status = read(fd, r->buffer, sizeof(r->buffer));
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    } else if (status == 0) {
+      break;
     }
-  } /* while (fgets) */
 
-  if (fclose(fh)) {
-    WARNING("processes: fclose: %s", STRERRNO);
+    for (ssize_t i = 0; i < status; i++)
+      if (r->buffer[i] == '\n')
+        count++;
   }
+
+  close(fd);
   return count;
 } /* int ps_count_maps (...) */
 
-static int ps_count_fd(int pid) {
-  char dirname[64];
+static int ps_count_fd(ps_reader_t *r, long pid) {
+  int fd_fd;
   DIR *dh;
   struct dirent *ent;
   int count = 0;
 
-  snprintf(dirname, sizeof(dirname), "/proc/%i/fd", pid);
-
-  if ((dh = opendir(dirname)) == NULL) {
-    DEBUG("Failed to open directory `%s'", dirname);
+  fd_fd = openat(r->pid_fd, "fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if ((fd_fd < 0) || ((dh = fdopendir(fd_fd)) == NULL)) {
+    DEBUG("Failed to open directory `/proc/%li/fd'", pid);
+    if (fd_fd >= 0)
+      close(fd_fd);
     return -1;
   }
   while ((ent = readdir(dh)) != NULL) {
@@ -1274,22 +1410,38 @@ static int ps_delay(process_entry_t *ps) {
 }
 #endif
 
-static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
+/* Reads the details "ps" reports for the process. Delay accounting is read by
+ * ps_fill_delay() instead, because the taskstats handle is shared. */
+static void ps_fill_details(ps_reader_t *r, const procstat_t *ps,
+                            process_entry_t *entry) {
+  /* /proc/<pid>/status is only needed for matched processes, so it is read
+   * here rather than in ps_read_process(). */
+  if ((entry->has_status == false) && (entry->num_proc != 0)) {
+    if (ps_read_status(r, entry) != 0) {
+      /* No VMem data */
+      entry->vmem_data = -1;
+      entry->vmem_code = -1;
+      DEBUG("ps_fill_details: did not get vmem data for pid %lu", entry->id);
+    }
+    entry->has_status = true;
+  }
+
   if (entry->has_io == false) {
-    ps_read_io(entry);
+    ps_read_io(r, entry);
     entry->has_io = true;
   }
 
   if (ps->report_ctx_switch) {
     if (entry->has_cswitch == false) {
-      ps_read_tasks_status(entry);
+      ps_read_tasks_status(r, entry);
       entry->has_cswitch = true;
     }
   }
 
   if (ps->report_maps_num) {
     int num_maps;
-    if (entry->has_maps == false && (num_maps = ps_count_maps(entry->id)) > 0) {
+    if (entry->has_maps == false &&
+        (num_maps = ps_count_maps(r, entry->id)) > 0) {
       entry->num_maps = num_maps;
     }
     entry->has_maps = true;
@@ -1297,25 +1449,28 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
 
   if (ps->report_fd_num) {
     int num_fd;
-    if (entry->has_fd == false && (num_fd = ps_count_fd(entry->id)) > 0) {
+    if (entry->has_fd == false && (num_fd = ps_count_fd(r, entry->id)) > 0) {
       entry->num_fd = num_fd;
     }
     entry->has_fd = true;
   }
 
+} /* void ps_fill_details (...) */
+
 #if HAVE_LIBTASKSTATS
+static void ps_fill_delay(const procstat_t *ps, process_entry_t *entry) {
   if (ps->report_delay && !entry->has_delay) {
     if (ps_delay(entry) == 0) {
       entry->has_delay = true;
     }
   }
+} /* void ps_fill_delay (...) */
 #endif
-} /* void ps_fill_details (...) */
 
 /* ps_read_process reads process counters on Linux. */
-static int ps_read_process(long pid, process_entry_t *ps, char *state) {
-  char filename[64];
-  char buffer[1024];
+static int ps_read_process(ps_reader_t *r, long pid, process_entry_t *ps,
+                           char *state) {
+  char *buffer = r->buffer;
 
   char *fields[64];
   char fields_len;
@@ -1335,9 +1490,7 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
 
   ssize_t status;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/stat", pid);
-
-  status = read_text_file_contents(filename, buffer, sizeof(buffer));
+  status = ps_read_file(r->pid_fd, "stat", buffer, sizeof(r->buffer));
   if (status <= 0)
     return -1;
   buffer_len = (size_t)status;
@@ -1377,24 +1530,19 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
   fields_len = strsplit(buffer_ptr, fields, STATIC_ARRAY_SIZE(fields));
   if (fields_len < 22) {
     DEBUG("processes plugin: ps_read_process (pid = %li):"
-          " `%s' has only %i fields..",
-          pid, filename, fields_len);
+          " `/proc/%li/stat' has only %i fields..",
+          pid, pid, fields_len);
     return -1;
   }
 
   *state = fields[0][0];
+  ps->start_time = strtoull(fields[19], /* endptr = */ NULL, /* base = */ 10);
 
   if (*state == 'Z') {
     ps->num_lwp = 0;
     ps->num_proc = 0;
   } else {
     ps->num_lwp = strtoul(fields[17], /* endptr = */ NULL, /* base = */ 10);
-    if ((ps_read_status(pid, ps)) != 0) {
-      /* No VMem data */
-      ps->vmem_data = -1;
-      ps->vmem_code = -1;
-      DEBUG("ps_read_process: did not get vmem data for pid %li", pid);
-    }
     if (ps->num_lwp == 0)
       ps->num_lwp = 1;
     ps->num_proc = 1;
@@ -1484,22 +1632,24 @@ static int procs_running(void) {
   return -1;
 }
 
-static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
+static char *ps_get_cmdline(ps_reader_t *r, long pid, char *name) {
+  char *buf = r->cmdline;
+  size_t buf_len = sizeof(r->cmdline);
   char *buf_ptr;
   size_t len;
 
-  char file[PATH_MAX];
+  char file[64];
   int fd;
 
   size_t n;
 
-  if ((pid < 1) || (NULL == buf) || (buf_len < 2))
+  if (pid < 1)
     return NULL;
 
   snprintf(file, sizeof(file), "/proc/%li/cmdline", pid);
 
   errno = 0;
-  fd = open(file, O_RDONLY);
+  fd = openat(r->pid_fd, "cmdline", O_RDONLY | O_CLOEXEC);
   if (fd < 0) {
     /* ENOENT means the process exited while we were handling it.
      * Don't complain about this, it only fills the logs. */
@@ -1574,6 +1724,567 @@ static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len) {
   return buf;
 } /* char *ps_get_cmdline (...) */
 
+static int ps_cache_compare(const void *a, const void *b) {
+  long pid_a = *((const long *)a);
+  long pid_b = *((const long *)b);
+
+  if (pid_a < pid_b)
+    return -1;
+  else if (pid_a > pid_b)
+    return 1;
+  return 0;
+} /* int ps_cache_compare */
+
+static void ps_cache_entry_free(ps_cache_entry_t *ce) {
+  if (ce == NULL)
+    return;
+
+  sfree(ce->matches);
+  sfree(ce);
+} /* void ps_cache_entry_free */
+
+/* Returns the list of matches a process belongs to in "ret_matches". The list
+ * is NULL when the process doesn't belong to any match. */
+static int ps_match(const char *name, const char *cmdline,
+                    procstat_t ***ret_matches, size_t *ret_matches_num) {
+  procstat_t **matches = NULL;
+  size_t num = 0;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if (ps_list_match(name, cmdline, ps) == 0)
+      continue;
+
+    procstat_t **tmp = realloc(matches, (num + 1) * sizeof(*tmp));
+    if (tmp == NULL) {
+      sfree(matches);
+      return ENOMEM;
+    }
+    matches = tmp;
+    matches[num++] = ps;
+  }
+
+  *ret_matches = matches;
+  *ret_matches_num = num;
+  return 0;
+} /* int ps_match */
+
+/* Returns the cache entry of the process described by "pse", or NULL if the
+ * process is new, was replaced by exec(2) or if its PID has been reused. This
+ * is called by the scan threads concurrently; the cache is only modified
+ * after the scan. */
+static ps_cache_entry_t *ps_cache_lookup(const process_entry_t *pse) {
+  ps_cache_entry_t *ce = NULL;
+  long pid = (long)pse->id;
+
+  if ((ps_cache == NULL) || (c_avl_get(ps_cache, &pid, (void *)&ce) != 0))
+    return NULL;
+
+  /* Entries created from a fork event don't know the start time yet. Each
+   * PID is handled by a single thread, so this doesn't race. */
+  if (ce->start_time == 0)
+    ce->start_time = pse->start_time;
+
+  if (ce->stale || (ce->start_time != pse->start_time) ||
+      (strcmp(ce->name, pse->name) != 0))
+    return NULL;
+
+  return ce;
+} /* ps_cache_entry_t *ps_cache_lookup */
+
+/* Stores the matches of a process which ps_cache_lookup() didn't find. The
+ * cache takes ownership of "*matches" on success. */
+static void ps_cache_store(const process_entry_t *pse, procstat_t ***matches,
+                           size_t matches_num) {
+  ps_cache_entry_t *ce = NULL;
+  long pid = (long)pse->id;
+
+  if (c_avl_get(ps_cache, &pid, (void *)&ce) != 0) {
+    ce = calloc(1, sizeof(*ce));
+    if (ce == NULL)
+      return;
+    ce->pid = pid;
+
+    if (c_avl_insert(ps_cache, &ce->pid, ce) != 0) {
+      ps_cache_entry_free(ce);
+      return;
+    }
+  }
+
+  ce->start_time = pse->start_time;
+  sstrncpy(ce->name, pse->name, sizeof(ce->name));
+  ce->seen = ps_cache_generation;
+  ce->stale = false;
+
+  sfree(ce->matches);
+  ce->matches = *matches;
+  ce->matches_num = matches_num;
+  *matches = NULL;
+} /* void ps_cache_store */
+
+/* Removes the entries of processes which have not been seen during the last
+ * scan of /proc. */
+static void ps_cache_expire(void) {
+  c_avl_iterator_t *iter;
+  long *pids = NULL;
+  size_t pids_num = 0;
+  size_t pids_size = 0;
+  void *key;
+  void *value;
+
+  iter = c_avl_get_iterator(ps_cache);
+  if (iter == NULL)
+    return;
+
+  while (c_avl_iterator_next(iter, &key, &value) == 0) {
+    ps_cache_entry_t *ce = value;
+
+    if (ce->seen == ps_cache_generation)
+      continue;
+
+    if (pids_num >= pids_size) {
+      size_t new_size = (pids_size == 0) ? 64 : 2 * pids_size;
+      long *tmp = realloc(pids, new_size * sizeof(*tmp));
+      if (tmp == NULL)
+        break;
+      pids = tmp;
+      pids_size = new_size;
+    }
+    pids[pids_num++] = ce->pid;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < pids_num; i++) {
+    if (c_avl_remove(ps_cache, &pids[i], &key, &value) == 0)
+      ps_cache_entry_free(value);
+  }
+  sfree(pids);
+} /* void ps_cache_expire */
+
+static void ps_cache_fork(long parent, long child) {
+  ps_cache_entry_t *pce = NULL;
+  ps_cache_entry_t *ce;
+
+  if (c_avl_get(ps_cache, &parent, (void *)&pce) != 0 || pce->stale)
+    return;
+
+  /* The child runs the same program as its parent until it calls exec(2), so
+   * the parent's matches are copied instead of reading the command line. */
+  ce = calloc(1, sizeof(*ce));
+  if (ce == NULL)
+    return;
+  ce->pid = child;
+  sstrncpy(ce->name, pce->name, sizeof(ce->name));
+
+  if (pce->matches_num != 0) {
+    ce->matches = calloc(pce->matches_num, sizeof(*ce->matches));
+    if (ce->matches == NULL) {
+      ps_cache_entry_free(ce);
+      return;
+    }
+    memcpy(ce->matches, pce->matches,
+           pce->matches_num * sizeof(*ce->matches));
+    ce->matches_num = pce->matches_num;
+  }
+
+  if (c_avl_insert(ps_cache, &ce->pid, ce) != 0)
+    ps_cache_entry_free(ce);
+} /* void ps_cache_fork */
+
+/* Applies the events received from the process connector since the last
+ * read. If events have been lost, all entries are matched again. */
+static void ps_cache_update(void) {
+  ps_event_t *events;
+  size_t events_num;
+  bool lost;
+
+  pthread_mutex_lock(&ps_events_lock);
+  events = ps_events;
+  events_num = ps_events_num;
+  lost = ps_events_lost;
+  ps_events = NULL;
+  ps_events_num = 0;
+  ps_events_size = 0;
+  ps_events_lost = false;
+  pthread_mutex_unlock(&ps_events_lock);
+
+  for (size_t i = 0; i < events_num; i++) {
+    ps_event_t *ev = events + i;
+    ps_cache_entry_t *ce = NULL;
+    void *key;
+
+    switch (ev->what) {
+    case PROC_EVENT_FORK:
+      ps_cache_fork(ev->parent, ev->pid);
+      break;
+    case PROC_EVENT_EXEC:
+      if (c_avl_get(ps_cache, &ev->pid, (void *)&ce) == 0)
+        ce->stale = true;
+      break;
+    case PROC_EVENT_EXIT:
+      if (c_avl_remove(ps_cache, &ev->pid, &key, (void *)&ce) == 0)
+        ps_cache_entry_free(ce);
+      break;
+    }
+  }
+  sfree(events);
+
+  if (lost) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(ps_cache);
+    void *key;
+    void *value;
+
+    while ((iter != NULL) && (c_avl_iterator_next(iter, &key, &value) == 0))
+      ((ps_cache_entry_t *)value)->stale = true;
+    c_avl_iterator_destroy(iter);
+  }
+} /* void ps_cache_update */
+
+static void ps_event_enqueue(unsigned what, long pid, long parent) {
+  pthread_mutex_lock(&ps_events_lock);
+  if (ps_events_num >= ps_events_size) {
+    size_t new_size = (ps_events_size == 0) ? 256 : 2 * ps_events_size;
+    ps_event_t *tmp = NULL;
+
+    if (new_size <= PS_EVENTS_MAX)
+      tmp = realloc(ps_events, new_size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ps_events_lost = true;
+      pthread_mutex_unlock(&ps_events_lock);
+      return;
+    }
+    ps_events = tmp;
+    ps_events_size = new_size;
+  }
+
+  ps_events[ps_events_num++] = (ps_event_t){
+      .what = what,
+      .pid = pid,
+      .parent = parent,
+  };
+  pthread_mutex_unlock(&ps_events_lock);
+} /* void ps_event_enqueue */
+
+static void *ps_nl_thread_main(void __attribute__((unused)) * arg) {
+  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+    struct nlmsghdr nl_hdr;
+    struct __attribute__((__packed__)) {
+      struct cn_msg cn_msg;
+      struct proc_event proc_ev;
+    };
+  } msg;
+
+  while (42) {
+    ssize_t status = recv(ps_nl_sock, &msg, sizeof(msg), /* flags = */ 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == ENOBUFS) {
+        /* The kernel dropped events because we didn't keep up. */
+        pthread_mutex_lock(&ps_events_lock);
+        ps_events_lost = true;
+        pthread_mutex_unlock(&ps_events_lock);
+        continue;
+      }
+
+      ERROR("processes plugin: Receiving process events failed: %s",
+            STRERRNO);
+      break;
+    } else if ((size_t)status < sizeof(msg.nl_hdr) + sizeof(msg.cn_msg)) {
+      continue;
+    }
+
+    struct proc_event ev = msg.proc_ev;
+    switch (ev.what) {
+    case PROC_EVENT_FORK:
+      /* Only new processes are of interest, not new threads. */
+      if (ev.event_data.fork.child_pid == ev.event_data.fork.child_tgid)
+        ps_event_enqueue(ev.what, ev.event_data.fork.child_tgid,
+                         ev.event_data.fork.parent_tgid);
+      break;
+    case PROC_EVENT_EXEC:
+      ps_event_enqueue(ev.what, ev.event_data.exec.process_tgid, 0);
+      break;
+    case PROC_EVENT_EXIT:
+      if (ev.event_data.exit.process_pid == ev.event_data.exit.process_tgid)
+        ps_event_enqueue(ev.what, ev.event_data.exit.process_tgid, 0);
+      break;
+    default:
+      break;
+    }
+  }
+
+  /* Events may have been missed, so all processes are matched again once.
+   * After that, exec(2) is only detected by a change of the process name. */
+  pthread_mutex_lock(&ps_events_lock);
+  ps_events_lost = true;
+  pthread_mutex_unlock(&ps_events_lock);
+  return NULL;
+} /* void *ps_nl_thread_main */
+
+static int ps_nl_start(void) {
+  struct sockaddr_nl sa_nl = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = CN_IDX_PROC,
+  };
+  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+    struct nlmsghdr nl_hdr;
+    struct __attribute__((__packed__)) {
+      struct cn_msg cn_msg;
+      enum proc_cn_mcast_op cn_mcast;
+    };
+  } msg = {
+      .nl_hdr =
+          {
+              .nlmsg_len = sizeof(msg),
+              .nlmsg_type = NLMSG_DONE,
+          },
+      .cn_msg =
+          {
+              .id = {.idx = CN_IDX_PROC, .val = CN_VAL_PROC},
+              .len = sizeof(enum proc_cn_mcast_op),
+          },
+      .cn_mcast = PROC_CN_MCAST_LISTEN,
+  };
+  int status;
+
+  ps_nl_sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+  if (ps_nl_sock < 0) {
+    ERROR("processes plugin: socket(NETLINK_CONNECTOR) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if ((bind(ps_nl_sock, (struct sockaddr *)&sa_nl, sizeof(sa_nl)) != 0) ||
+      (send(ps_nl_sock, &msg, sizeof(msg), /* flags = */ 0) < 0)) {
+    ERROR("processes plugin: Subscribing to the process connector failed: %s",
+          STRERRNO);
+    close(ps_nl_sock);
+    ps_nl_sock = -1;
+    return -1;
+  }
+
+  status = plugin_thread_create(&ps_nl_thread, ps_nl_thread_main,
+                                /* arg = */ NULL, "processes events");
+  if (status != 0) {
+    ERROR("processes plugin: plugin_thread_create failed: %s",
+          STRERROR(status));
+    close(ps_nl_sock);
+    ps_nl_sock = -1;
+    return -1;
+  }
+  ps_nl_thread_running = true;
+
+  return 0;
+} /* int ps_nl_start */
+
+static void ps_nl_stop(void) {
+  if (ps_nl_thread_running) {
+    pthread_cancel(ps_nl_thread);
+    pthread_join(ps_nl_thread, /* retval = */ NULL);
+    ps_nl_thread_running = false;
+  }
+
+  if (ps_nl_sock >= 0) {
+    close(ps_nl_sock);
+    ps_nl_sock = -1;
+  }
+
+  pthread_mutex_lock(&ps_events_lock);
+  sfree(ps_events);
+  ps_events_num = 0;
+  ps_events_size = 0;
+  pthread_mutex_unlock(&ps_events_lock);
+} /* void ps_nl_stop */
+
+static int ps_cache_init(void) {
+  if (ps_cache != NULL)
+    return 0;
+
+  ps_cache = c_avl_create(ps_cache_compare);
+  if (ps_cache == NULL) {
+    ERROR("processes plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  /* Without the process connector, the cache is still used, but exec(2) is
+   * only detected by a change of the process name. */
+  if (ps_nl_start() != 0)
+    WARNING("processes plugin: Processes which execute a program with the "
+            "same name will not be matched again until they exit.");
+
+  return 0;
+} /* int ps_cache_init */
+
+static void ps_scan_one(ps_reader_t *r, ps_result_t *res) {
+  process_entry_t pse = {.id = res->pid};
+  procstat_t **matches;
+  size_t matches_num;
+  char pid_str[32];
+  int status;
+
+  res->state = 0;
+
+  snprintf(pid_str, sizeof(pid_str), "%li", res->pid);
+  r->pid_fd = openat(ps_proc_fd, pid_str, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (r->pid_fd < 0)
+    return;
+
+  status = ps_read_process(r, res->pid, &pse, &res->state);
+  if (status != 0) {
+    DEBUG("ps_read_process failed: %i", status);
+    res->state = 0;
+    goto out;
+  }
+
+  res->ce = ps_cache_lookup(&pse);
+  if (res->ce != NULL) {
+    matches = res->ce->matches;
+    matches_num = res->ce->matches_num;
+  } else {
+    if (ps_match(pse.name, ps_get_cmdline(r, res->pid, pse.name),
+                 &res->matches, &res->matches_num) != 0) {
+      res->state = 0;
+      goto out;
+    }
+    matches = res->matches;
+    matches_num = res->matches_num;
+  }
+
+  /* Processes which don't belong to any match are only counted, unless they
+   * have to be added to the cache. */
+  if ((matches_num == 0) && ((ps_cache == NULL) || (res->ce != NULL)))
+    goto out;
+
+  res->entry = malloc(sizeof(*res->entry));
+  if (res->entry == NULL)
+    goto out;
+  memcpy(res->entry, &pse, sizeof(*res->entry));
+
+  for (size_t i = 0; i < matches_num; i++)
+    ps_fill_details(r, matches[i], res->entry);
+
+out:
+  close(r->pid_fd);
+  r->pid_fd = -1;
+} /* void ps_scan_one */
+
+static void *ps_scan_thread(void *arg) {
+  ps_reader_t *r = arg;
+
+  while (42) {
+    size_t start = __atomic_fetch_add(&ps_results_next, PS_SCAN_CHUNK,
+                                      __ATOMIC_RELAXED);
+    if (start >= ps_results_num)
+      break;
+
+    size_t end = start + PS_SCAN_CHUNK;
+    if (end > ps_results_num)
+      end = ps_results_num;
+
+    for (size_t i = start; i < end; i++)
+      ps_scan_one(r, ps_results + i);
+  }
+
+  return NULL;
+} /* void *ps_scan_thread */
+
+/* Reads all processes below /proc into ps_results. The list of PIDs is
+ * partitioned into chunks, which are handed out to up to "ScanThreads"
+ * threads, including the calling one. */
+static int ps_scan(void) {
+  pthread_t *threads = NULL;
+  size_t threads_num = 0;
+  struct dirent *ent;
+  DIR *proc;
+
+  if ((proc = opendir("/proc")) == NULL) {
+    ERROR("Cannot open `/proc': %s", STRERRNO);
+    return -1;
+  }
+  ps_proc_fd = dirfd(proc);
+
+  ps_results_num = 0;
+  while ((ent = readdir(proc)) != NULL) {
+    long pid;
+
+    if (!isdigit(ent->d_name[0]))
+      continue;
+
+    if ((pid = atol(ent->d_name)) < 1)
+      continue;
+
+    if (ps_results_num >= ps_results_size) {
+      size_t new_size = (ps_results_size == 0) ? 1024 : 2 * ps_results_size;
+      ps_result_t *tmp = realloc(ps_results, new_size * sizeof(*tmp));
+      if (tmp == NULL) {
+        ERROR("processes plugin: realloc failed.");
+        break;
+      }
+      ps_results = tmp;
+      ps_results_size = new_size;
+    }
+
+    ps_results[ps_results_num] = (ps_result_t){.pid = pid};
+    ps_results_num++;
+  }
+  ps_results_next = 0;
+
+  /* Don't start more threads than there are chunks. */
+  size_t wanted = (ps_results_num + PS_SCAN_CHUNK - 1) / PS_SCAN_CHUNK;
+  if (wanted > scan_threads)
+    wanted = scan_threads;
+  if (wanted > 1)
+    threads = calloc(wanted - 1, sizeof(*threads));
+
+  while ((threads != NULL) && (threads_num < wanted - 1)) {
+    int status = plugin_thread_create(&threads[threads_num], ps_scan_thread,
+                                      ps_readers + threads_num + 1,
+                                      "processes scan");
+    if (status != 0) {
+      ERROR("processes plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      break;
+    }
+    threads_num++;
+  }
+
+  ps_scan_thread(ps_readers);
+
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_join(threads[i], /* retval = */ NULL);
+  sfree(threads);
+
+  closedir(proc);
+  ps_proc_fd = -1;
+
+  return 0;
+} /* int ps_scan */
+
+/* Adds a process read by ps_scan() to its matches and updates the cache.
+ * This runs in the read thread only, after all scan threads have finished. */
+static void ps_merge_result(ps_result_t *res) {
+  procstat_t **matches = res->matches;
+  size_t matches_num = res->matches_num;
+
+  if (res->ce != NULL) {
+    res->ce->seen = ps_cache_generation;
+    matches = res->ce->matches;
+    matches_num = res->ce->matches_num;
+  }
+
+  if (res->entry == NULL)
+    return;
+
+  for (size_t i = 0; i < matches_num; i++) {
+#if HAVE_LIBTASKSTATS
+    ps_fill_delay(matches[i], res->entry);
+#endif
+    ps_list_add_one(matches[i], res->entry);
+  }
+
+  if ((ps_cache != NULL) && (res->ce == NULL))
+    ps_cache_store(res->entry, &res->matches, res->matches_num);
+} /* void ps_merge_result */
+
 static int read_fork_rate(void) {
   FILE *proc_stat;
   char buffer[1024];
@@ -1835,7 +2546,7 @@ static int mach_get_task_name(task_t t, int *pid, char *name,
 /* end of additional functions for KERNEL_LINUX/HAVE_THREAD_INFO */
 
 /* do actual readings from kernel */
-static int ps_read(void) {
+static int ps_read_processes(void) {
 #if HAVE_THREAD_INFO
   kern_return_t status;
 
@@ -2078,41 +2789,21 @@ static int ps_read(void) {
   int paging = 0;
   int blocked = 0;
 
-  struct dirent *ent;
-  DIR *proc;
-  long pid;
-
-  char cmdline[CMDLINE_BUFFER_SIZE];
-
-  int status;
-  process_entry_t pse;
-  char state;
-
   running = sleeping = zombies = stopped = paging = blocked = 0;
   ps_list_reset();
 
-  if ((proc = opendir("/proc")) == NULL) {
-    ERROR("Cannot open `/proc': %s", STRERRNO);
-    return -1;
+  if (ps_cache != NULL) {
+    ps_cache_update();
+    ps_cache_generation++;
   }
 
-  while ((ent = readdir(proc)) != NULL) {
-    if (!isdigit(ent->d_name[0]))
-      continue;
-
-    if ((pid = atol(ent->d_name)) < 1)
-      continue;
+  if (ps_scan() != 0)
+    return -1;
 
-    memset(&pse, 0, sizeof(pse));
-    pse.id = pid;
+  for (size_t i = 0; i < ps_results_num; i++) {
+    ps_result_t *res = ps_results + i;
 
-    status = ps_read_process(pid, &pse, &state);
-    if (status != 0) {
-      DEBUG("ps_read_process failed: %i", status);
-      continue;
-    }
-
-    switch (state) {
+    switch (res->state) {
     case 'R':
       running++;
       break;
@@ -2133,11 +2824,15 @@ static int ps_read(void) {
       break;
     }
 
-    ps_list_add(pse.name,
-                ps_get_cmdline(pid, pse.name, cmdline, sizeof(cmdline)), &pse);
+    if (res->state != 0)
+      ps_merge_result(res);
+
+    sfree(res->entry);
+    sfree(res->matches);
   }
 
-  closedir(proc);
+  if (ps_cache != NULL)
+    ps_cache_expire();
 
   /* get procs_running from /proc/stat
    * scanning /proc/stat AND computing other process stats takes too much time.
@@ -2883,10 +3578,42 @@ static int ps_read(void) {
   want_init = false;
 
   return 0;
+} /* int ps_read_processes */
+
+static int ps_read(void) {
+  int status = ps_read_processes();
+  vl_batch_dispatch(&ps_batch);
+  return status;
 } /* int ps_read */
 
+static int ps_shutdown(void) {
+  vl_batch_free(&ps_batch);
+
+#if KERNEL_LINUX
+  ps_nl_stop();
+
+  if (ps_cache != NULL) {
+    void *key;
+    void *value;
+
+    while (c_avl_pick(ps_cache, &key, &value) == 0)
+      ps_cache_entry_free(value);
+    c_avl_destroy(ps_cache);
+    ps_cache = NULL;
+  }
+
+  sfree(ps_readers);
+  sfree(ps_results);
+  ps_results_num = 0;
+  ps_results_size = 0;
+#endif
+
+  return 0;
+} /* int ps_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("processes", ps_config);
   plugin_register_init("processes", ps_init);
   plugin_register_read("processes", ps_read);
+  plugin_register_shutdown("processes", ps_shutdown);
 } /* void module_register */
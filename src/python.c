@@ -172,6 +172,30 @@ static char reg_write_doc[] =
     "data: The optional data parameter passed to the register function.\n"
     "    If the parameter was omitted it will be omitted here, too.";
 
+static char reg_write_batch_doc[] =
+    "register_write_batch(callback[, data][, name]) -> identifier\n"
+    "\n"
+    "Register a callback function to receive dispatched values in batches.\n"
+    "The arguments are the same as for register_write. Unregister it with\n"
+    "unregister_write.\n"
+    "\n"
+    "The callback function will be called with one or two parameters:\n"
+    "values: A list of Values objects drained from the write queue at once.\n"
+    "data: The optional data parameter passed to the register function.\n"
+    "    If the parameter was omitted it will be omitted here, too.";
+
+static char dispatch_many_doc[] =
+    "dispatch_many(iterable) -> None\n"
+    "\n"
+    "Dispatches all Values objects yielded by 'iterable'.\n"
+    "\n"
+    "This is equivalent to calling dispatch() on every item, but the values\n"
+    "are handed to the daemon in batches, releasing the GIL once per batch\n"
+    "instead of once per item. Every item is copied as soon as it has been\n"
+    "yielded, so a generator may modify and yield the same Values object\n"
+    "over and over. If an item is invalid, the items before it have been\n"
+    "dispatched and an exception is raised.";
+
 static char reg_notification_doc[] =
     "register_notification(callback[, data][, name]) -> identifier\n"
     "\n"
@@ -398,18 +422,17 @@ static int cpy_read_callback(user_data_t *data) {
   return 0;
 }
 
-static int cpy_write_callback(const data_set_t *ds,
-                              const value_list_t *value_list,
-                              user_data_t *data) {
-  cpy_callback_t *c = data->data;
-  PyObject *ret, *list, *temp, *dict = NULL;
+/* Builds a Values object from "value_list". Must be called with the GIL held.
+ * Returns a new reference, or NULL after logging the error. */
+static PyObject *cpy_build_values(const data_set_t *ds,
+                                  const value_list_t *value_list) { /* {{{ */
+  PyObject *list, *temp, *dict = NULL;
   Values *v;
 
-  CPY_LOCK_THREADS
   list = PyList_New(value_list->values_len); /* New reference. */
   if (list == NULL) {
     cpy_log_exception("write callback");
-    CPY_RETURN_FROM_THREADS 0;
+    return NULL;
   }
   for (size_t i = 0; i < value_list->values_len; ++i) {
     if (ds->ds[i].type == DS_TYPE_COUNTER) {
@@ -428,12 +451,12 @@ static int cpy_write_callback(const data_set_t *ds,
       ERROR("cpy_write_callback: Unknown value type %d.", ds->ds[i].type);
       Py_END_ALLOW_THREADS;
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
     if (PyErr_Occurred() != NULL) {
       cpy_log_exception("value building for write callback");
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
   }
   dict = PyDict_New(); /* New reference. */
@@ -495,6 +518,12 @@ static int cpy_write_callback(const data_set_t *ds,
     free(table);
   }
   v = (Values *)Values_New(); /* New reference. */
+  if (v == NULL) {
+    cpy_log_exception("write callback");
+    Py_DECREF(list);
+    Py_XDECREF(dict);
+    return NULL;
+  }
   sstrncpy(v->data.host, value_list->host, sizeof(v->data.host));
   sstrncpy(v->data.type, value_list->type, sizeof(v->data.type));
   sstrncpy(v->data.type_instance, value_list->type_instance,
@@ -508,6 +537,20 @@ static int cpy_write_callback(const data_set_t *ds,
   v->values = list;
   Py_CLEAR(v->meta);
   v->meta = dict; /* Steals a reference. */
+  return (PyObject *)v;
+} /* }}} PyObject *cpy_build_values */
+
+static int cpy_write_callback(const data_set_t *ds,
+                              const value_list_t *value_list,
+                              user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *v;
+
+  CPY_LOCK_THREADS
+  v = cpy_build_values(ds, value_list); /* New reference. */
+  if (v == NULL) {
+    CPY_RETURN_FROM_THREADS 0;
+  }
   ret = PyObject_CallFunctionObjArgs(c->callback, v, c->data,
                                      (void *)0); /* New reference. */
   Py_XDECREF(v);
@@ -520,6 +563,43 @@ static int cpy_write_callback(const data_set_t *ds,
   return 0;
 }
 
+/* Hands a whole batch of drained write queue entries to Python as one list,
+ * so the GIL is taken once per batch instead of once per value list. */
+static int cpy_write_batch_callback(const write_batch_entry_t *entries,
+                                    size_t entries_num, user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *list;
+
+  CPY_LOCK_THREADS
+  list = PyList_New(0); /* New reference. */
+  if (list == NULL) {
+    cpy_log_exception("write batch callback");
+    CPY_RETURN_FROM_THREADS 0;
+  }
+  for (size_t i = 0; i < entries_num; i++) {
+    PyObject *v = cpy_build_values(entries[i].ds, entries[i].vl);
+    if (v == NULL)
+      continue;
+    if (PyList_Append(list, v) != 0)
+      cpy_log_exception("write batch callback");
+    Py_DECREF(v);
+  }
+  if (PyList_GET_SIZE(list) == 0) {
+    Py_DECREF(list);
+    CPY_RETURN_FROM_THREADS 0;
+  }
+  ret = PyObject_CallFunctionObjArgs(c->callback, list, c->data,
+                                     (void *)0); /* New reference. */
+  Py_DECREF(list);
+  if (ret == NULL) {
+    cpy_log_exception("write batch callback");
+  } else {
+    Py_DECREF(ret);
+  }
+  CPY_RELEASE_THREADS
+  return 0;
+}
+
 static int cpy_notification_callback(const notification_t *notification,
                                      user_data_t *data) {
   cpy_callback_t *c = data->data;
@@ -729,6 +809,70 @@ static PyObject *cpy_flush(PyObject *self, PyObject *args, PyObject *kwds) {
   Py_RETURN_NONE;
 }
 
+/* Number of value lists converted before the GIL is released to dispatch
+ * them. */
+#define CPY_DISPATCH_MANY_BATCH 256
+
+static int cpy_dispatch_many_flush(value_list_t *vls, size_t num) {
+  int status;
+
+  if (num == 0)
+    return 0;
+
+  Py_BEGIN_ALLOW_THREADS;
+  status = plugin_dispatch_values_batch(vls, num);
+  Py_END_ALLOW_THREADS;
+  for (size_t i = 0; i < num; i++) {
+    meta_data_destroy(vls[i].meta);
+    free(vls[i].values);
+  }
+  return status;
+}
+
+static PyObject *cpy_dispatch_many(PyObject *self, PyObject *arg) {
+  value_list_t *vls;
+  size_t num = 0;
+  int status = 0;
+  PyObject *iter, *item;
+
+  iter = PyObject_GetIter(arg); /* New reference. */
+  if (iter == NULL)
+    return NULL;
+  vls = calloc(CPY_DISPATCH_MANY_BATCH, sizeof(*vls));
+  if (vls == NULL) {
+    Py_DECREF(iter);
+    return PyErr_NoMemory();
+  }
+
+  while ((item = PyIter_Next(iter)) != NULL) { /* New reference. */
+    vls[num] = (value_list_t)VALUE_LIST_INIT;
+    int err = Values_to_value_list(item, vls + num);
+    Py_DECREF(item);
+    if (err != 0)
+      break;
+    if (++num == CPY_DISPATCH_MANY_BATCH) {
+      if (cpy_dispatch_many_flush(vls, num) != 0)
+        status = -1;
+      num = 0;
+    }
+  }
+  Py_DECREF(iter);
+
+  /* Dispatch what has been converted even if the iteration failed, so the
+   * result is the same as calling dispatch() in a loop. */
+  if (cpy_dispatch_many_flush(vls, num) != 0)
+    status = -1;
+  free(vls);
+  if (PyErr_Occurred() != NULL)
+    return NULL;
+  if (status != 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "error dispatching values, read the logs");
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
 static PyObject *cpy_register_config(PyObject *self, PyObject *args,
                                      PyObject *kwds) {
   return cpy_register_generic(&cpy_config_callbacks, args, kwds);
@@ -838,6 +982,13 @@ static PyObject *cpy_register_write(PyObject *self, PyObject *args,
                                        (void *)cpy_write_callback, args, kwds);
 }
 
+static PyObject *cpy_register_write_batch(PyObject *self, PyObject *args,
+                                          PyObject *kwds) {
+  return cpy_register_generic_userdata((void *)plugin_register_write_batch,
+                                       (void *)cpy_write_batch_callback, args,
+                                       kwds);
+}
+
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args,
                                            PyObject *kwds) {
   return cpy_register_generic_userdata((void *)plugin_register_notification,
@@ -1035,6 +1186,7 @@ static PyMethodDef cpy_methods[] = {
     {"error", cpy_error, METH_VARARGS, log_doc},
     {"get_dataset", (PyCFunction)cpy_get_dataset, METH_VARARGS, get_ds_doc},
     {"flush", (PyCFunction)cpy_flush, METH_VARARGS | METH_KEYWORDS, flush_doc},
+    {"dispatch_many", cpy_dispatch_many, METH_O, dispatch_many_doc},
     {"register_log", (PyCFunction)cpy_register_log,
      METH_VARARGS | METH_KEYWORDS, reg_log_doc},
     {"register_init", (PyCFunction)cpy_register_init,
@@ -1045,6 +1197,8 @@ static PyMethodDef cpy_methods[] = {
      METH_VARARGS | METH_KEYWORDS, reg_read_doc},
     {"register_write", (PyCFunction)cpy_register_write,
      METH_VARARGS | METH_KEYWORDS, reg_write_doc},
+    {"register_write_batch", (PyCFunction)cpy_register_write_batch,
+     METH_VARARGS | METH_KEYWORDS, reg_write_batch_doc},
     {"register_notification", (PyCFunction)cpy_register_notification,
      METH_VARARGS | METH_KEYWORDS, reg_notification_doc},
     {"register_flush", (PyCFunction)cpy_register_flush,
@@ -586,66 +586,47 @@ static void cpy_build_notification_meta(notification_t *n, PyObject *meta) {
   cpy_build_meta_generic(meta, &cpy_plugin_notification_meta, (void *)n);
 }
 
-static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
-  int ret;
+/* Fills in the values, meta data, time and interval of "vl" and looks up its
+ * data set. The identity in "vl" must already be set. On success, the caller
+ * owns vl->values and vl->meta. On failure, a Python exception is set and -1
+ * is returned. */
+static int cpy_fill_value_list(value_list_t *vl, PyObject *values,
+                               PyObject *meta, double time,
+                               double interval) { /* {{{ */
   const data_set_t *ds;
   size_t size;
   value_t *value;
-  value_list_t value_list = VALUE_LIST_INIT;
-  PyObject *values = self->values, *meta = self->meta;
-  double time = self->data.time, interval = self->interval;
-  char *host = NULL, *plugin = NULL, *plugin_instance = NULL, *type = NULL,
-       *type_instance = NULL;
 
-  static char *kwlist[] = {
-      "type", "values", "plugin_instance", "type_instance", "plugin",
-      "host", "time",   "interval",        "meta",          NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|etOetetetetddO", kwlist, NULL,
-                                   &type, &values, NULL, &plugin_instance, NULL,
-                                   &type_instance, NULL, &plugin, NULL, &host,
-                                   &time, &interval, &meta))
-    return NULL;
-
-  sstrncpy(value_list.host, host ? host : self->data.host,
-           sizeof(value_list.host));
-  sstrncpy(value_list.plugin, plugin ? plugin : self->data.plugin,
-           sizeof(value_list.plugin));
-  sstrncpy(value_list.plugin_instance,
-           plugin_instance ? plugin_instance : self->data.plugin_instance,
-           sizeof(value_list.plugin_instance));
-  sstrncpy(value_list.type, type ? type : self->data.type,
-           sizeof(value_list.type));
-  sstrncpy(value_list.type_instance,
-           type_instance ? type_instance : self->data.type_instance,
-           sizeof(value_list.type_instance));
-  FreeAll();
-  if (value_list.type[0] == 0) {
+  if (vl->type[0] == 0) {
     PyErr_SetString(PyExc_RuntimeError, "type not set");
-    FreeAll();
-    return NULL;
+    return -1;
   }
-  ds = plugin_get_ds(value_list.type);
+  ds = plugin_get_ds(vl->type);
   if (ds == NULL) {
-    PyErr_Format(PyExc_TypeError, "Dataset %s not found", value_list.type);
-    return NULL;
+    PyErr_Format(PyExc_TypeError, "Dataset %s not found", vl->type);
+    return -1;
   }
   if (values == NULL ||
       (PyTuple_Check(values) == 0 && PyList_Check(values) == 0)) {
     PyErr_Format(PyExc_TypeError, "values must be list or tuple");
-    return NULL;
+    return -1;
   }
   if (meta != NULL && meta != Py_None && !PyDict_Check(meta)) {
     PyErr_Format(PyExc_TypeError, "meta must be a dict");
-    return NULL;
+    return -1;
   }
   size = (size_t)PySequence_Length(values);
   if (size != ds->ds_num) {
     PyErr_Format(PyExc_RuntimeError,
-                 "type %s needs %" PRIsz " values, got %" PRIsz,
-                 value_list.type, ds->ds_num, size);
-    return NULL;
+                 "type %s needs %" PRIsz " values, got %" PRIsz, vl->type,
+                 ds->ds_num, size);
+    return -1;
   }
   value = calloc(size, sizeof(*value));
+  if (value == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
   for (size_t i = 0; i < size; ++i) {
     PyObject *item, *num;
     item = PySequence_Fast_GET_ITEM(values, (int)i); /* Borrowed reference. */
@@ -685,28 +666,83 @@ static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
     default:
       free(value);
       PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
-                   ds->ds[i].type, value_list.type);
-      return NULL;
+                   ds->ds[i].type, vl->type);
+      return -1;
     }
     if (PyErr_Occurred() != NULL) {
       free(value);
-      return NULL;
+      return -1;
     }
   }
-  value_list.values = value;
-  value_list.meta = cpy_build_meta(meta);
-  value_list.values_len = size;
-  value_list.time = DOUBLE_TO_CDTIME_T(time);
-  value_list.interval = DOUBLE_TO_CDTIME_T(interval);
-  if (value_list.host[0] == 0)
-    sstrncpy(value_list.host, hostname_g, sizeof(value_list.host));
-  if (value_list.plugin[0] == 0)
-    sstrncpy(value_list.plugin, "python", sizeof(value_list.plugin));
+  vl->values = value;
+  vl->meta = cpy_build_meta(meta);
+  vl->values_len = size;
+  vl->time = DOUBLE_TO_CDTIME_T(time);
+  vl->interval = DOUBLE_TO_CDTIME_T(interval);
+  if (vl->host[0] == 0)
+    sstrncpy(vl->host, hostname_g, sizeof(vl->host));
+  if (vl->plugin[0] == 0)
+    sstrncpy(vl->plugin, "python", sizeof(vl->plugin));
+  return 0;
+} /* }}} int cpy_fill_value_list */
+
+int Values_to_value_list(PyObject *s, value_list_t *vl) { /* {{{ */
+  Values *self = (Values *)s;
+
+  if (!PyObject_TypeCheck(s, &ValuesType)) {
+    PyErr_Format(PyExc_TypeError, "expected a Values object, got %s",
+                 Py_TYPE(s)->tp_name);
+    return -1;
+  }
+
+  sstrncpy(vl->host, self->data.host, sizeof(vl->host));
+  sstrncpy(vl->plugin, self->data.plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, self->data.plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, self->data.type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, self->data.type_instance,
+           sizeof(vl->type_instance));
+  return cpy_fill_value_list(vl, self->values, self->meta, self->data.time,
+                             self->interval);
+} /* }}} int Values_to_value_list */
+
+static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
+  int ret;
+  value_list_t value_list = VALUE_LIST_INIT;
+  PyObject *values = self->values, *meta = self->meta;
+  double time = self->data.time, interval = self->interval;
+  char *host = NULL, *plugin = NULL, *plugin_instance = NULL, *type = NULL,
+       *type_instance = NULL;
+
+  static char *kwlist[] = {
+      "type", "values", "plugin_instance", "type_instance", "plugin",
+      "host", "time",   "interval",        "meta",          NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|etOetetetetddO", kwlist, NULL,
+                                   &type, &values, NULL, &plugin_instance, NULL,
+                                   &type_instance, NULL, &plugin, NULL, &host,
+                                   &time, &interval, &meta))
+    return NULL;
+
+  sstrncpy(value_list.host, host ? host : self->data.host,
+           sizeof(value_list.host));
+  sstrncpy(value_list.plugin, plugin ? plugin : self->data.plugin,
+           sizeof(value_list.plugin));
+  sstrncpy(value_list.plugin_instance,
+           plugin_instance ? plugin_instance : self->data.plugin_instance,
+           sizeof(value_list.plugin_instance));
+  sstrncpy(value_list.type, type ? type : self->data.type,
+           sizeof(value_list.type));
+  sstrncpy(value_list.type_instance,
+           type_instance ? type_instance : self->data.type_instance,
+           sizeof(value_list.type_instance));
+  FreeAll();
+  if (cpy_fill_value_list(&value_list, values, meta, time, interval) != 0)
+    return NULL;
   Py_BEGIN_ALLOW_THREADS;
   ret = plugin_dispatch_values(&value_list);
   Py_END_ALLOW_THREADS;
   meta_data_destroy(value_list.meta);
-  free(value);
+  free(value_list.values);
   if (ret != 0) {
     PyErr_SetString(PyExc_RuntimeError,
                     "error dispatching values, read the logs");
@@ -26,6 +26,8 @@
 #include "utils/common/common.h"
 
 #include <hiredis/hiredis.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 
 #define REDIS_DEF_HOST "localhost"
@@ -39,6 +41,7 @@
 /* Redis plugin configuration example:
  *
  * <Plugin redis>
+ *   Async false
  *   <Node "mynode">
  *     Host "localhost"
  *     Port "6379"
@@ -65,6 +68,21 @@ struct prev_s {
 };
 typedef struct prev_s prev_t;
 
+/* All commands of a read are pipelined. The replies arrive in the order of
+ * the commands, so "cmds" records what each reply belongs to. */
+typedef enum {
+  REDIS_CMD_AUTH,
+  REDIS_CMD_INFO,
+  REDIS_CMD_COMMAND_STATS,
+  REDIS_CMD_SELECT,
+  REDIS_CMD_QUERY,
+} redis_cmd_type_t;
+
+typedef struct {
+  redis_cmd_type_t type;
+  redis_query_t *query;
+} redis_cmd_t;
+
 struct redis_node_s;
 typedef struct redis_node_s redis_node_t;
 struct redis_node_s {
@@ -80,11 +98,29 @@ struct redis_node_s {
   redis_query_t *queries;
   prev_t prev;
 
+  redis_cmd_t *cmds;
+  size_t cmds_num;
+  size_t replies_num;
+  int database; /* selected on the connection, -1 if unknown */
+  bool authenticated;
+  bool auth_failed;
+  bool select_failed;
+
+  /* State of non-blocking reads, see redis_read_async(). */
+  bool connecting;
+  bool writing;
+  bool polling;
+  cdtime_t deadline;
+
   redis_node_t *next;
 };
 
-static bool redis_have_instances;
+static redis_node_t *nodes_head;
+static size_t nodes_num;
+static bool async_read;
+
 static int redis_read(user_data_t *user_data);
+static int redis_read_async(user_data_t *user_data);
 
 static void redis_node_free(void *arg) {
   redis_node_t *rn = arg;
@@ -100,6 +136,7 @@ static void redis_node_free(void *arg) {
 
   if (rn->redisContext)
     redisFree(rn->redisContext);
+  sfree(rn->cmds);
   sfree(rn->name);
   sfree(rn->host);
   sfree(rn->socket);
@@ -107,13 +144,19 @@ static void redis_node_free(void *arg) {
   sfree(rn);
 } /* void redis_node_free */
 
+static void redis_nodes_free(void *arg) {
+  redis_node_t *rn = arg;
+  while (rn != NULL) {
+    redis_node_t *next = rn->next;
+    redis_node_free(rn);
+    rn = next;
+  }
+} /* void redis_nodes_free */
+
 static int redis_node_add(redis_node_t *rn) /* {{{ */
 {
   DEBUG("redis plugin: Adding node \"%s\".", rn->name);
 
-  /* Disable automatic generation of default instance in the init callback. */
-  redis_have_instances = true;
-
   char cb_name[sizeof("redis/") + DATA_MAX_NAME_LEN];
   ssnprintf(cb_name, sizeof(cb_name), "redis/%s", rn->name);
 
@@ -254,7 +297,12 @@ static int redis_config_node(oconfig_item_t *ci) /* {{{ */
     return status;
   }
 
-  return redis_node_add(rn);
+  /* The read callbacks are registered in the init callback, once it is
+   * known whether the nodes are read one by one or all at once. */
+  rn->next = nodes_head;
+  nodes_head = rn;
+  nodes_num++;
+  return 0;
 } /* }}} int redis_config_node */
 
 static int redis_config(oconfig_item_t *ci) /* {{{ */
@@ -264,6 +312,8 @@ static int redis_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("Node", option->key) == 0)
       redis_config_node(option);
+    else if (strcasecmp("Async", option->key) == 0)
+      cf_util_get_boolean(option, &async_read);
     else
       WARNING("redis plugin: Option `%s' not allowed in redis"
               " configuration. It will be ignored.",
@@ -316,48 +366,52 @@ redis_submit2(const char *plugin_instance, const char *type,
 
 static int redis_init(void) /* {{{ */
 {
-  if (redis_have_instances)
-    return 0;
-
-  redis_node_t *rn = calloc(1, sizeof(*rn));
-  if (rn == NULL)
-    return ENOMEM;
-
-  rn->port = REDIS_DEF_PORT;
-  rn->timeout.tv_sec = REDIS_DEF_TIMEOUT_SEC;
-
-  rn->name = strdup("default");
-  rn->host = strdup(REDIS_DEF_HOST);
+  if (nodes_head == NULL) {
+    redis_node_t *rn = calloc(1, sizeof(*rn));
+    if (rn == NULL)
+      return ENOMEM;
+
+    rn->port = REDIS_DEF_PORT;
+    rn->timeout.tv_sec = REDIS_DEF_TIMEOUT_SEC;
+
+    rn->name = strdup("default");
+    rn->host = strdup(REDIS_DEF_HOST);
+
+    if (rn->name == NULL || rn->host == NULL) {
+      sfree(rn->name);
+      sfree(rn->host);
+      sfree(rn);
+      return ENOMEM;
+    }
 
-  if (rn->name == NULL || rn->host == NULL) {
-    sfree(rn->name);
-    sfree(rn->host);
-    sfree(rn);
-    return ENOMEM;
+    nodes_head = rn;
+    nodes_num = 1;
   }
 
-  return redis_node_add(rn);
-} /* }}} int redis_init */
-
-static void *c_redisCommand(redis_node_t *rn, const char *format, ...) {
-  redisContext *c = rn->redisContext;
-
-  if (c == NULL)
-    return NULL;
-
-  va_list ap;
-  va_start(ap, format);
-  void *reply = redisvCommand(c, format, ap);
-  va_end(ap);
-
-  if (reply == NULL) {
-    ERROR("redis plugin: Connection error: %s", c->errstr);
-    redisFree(rn->redisContext);
-    rn->redisContext = NULL;
+  if (async_read)
+    return plugin_register_complex_read(
+        /* group = */ "redis",
+        /* name      = */ "redis",
+        /* callback  = */ redis_read_async,
+        /* interval  = */ 0,
+        &(user_data_t){
+            .data = nodes_head,
+            .free_func = redis_nodes_free,
+        });
+
+  while (nodes_head != NULL) {
+    redis_node_t *rn = nodes_head;
+    nodes_head = rn->next;
+    rn->next = NULL;
+    nodes_num--;
+
+    int status = redis_node_add(rn);
+    if (status != 0)
+      return status;
   }
 
-  return reply;
-} /* void c_redisCommand */
+  return 0;
+} /* }}} int redis_init */
 
 static int redis_get_info_value(char const *info_line, char const *field_name,
                                 int ds_type, value_t *val) {
@@ -394,35 +448,32 @@ static int redis_handle_info(char *node, char const *info_line,
   return 0;
 } /* }}} int redis_handle_info */
 
-static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
+static const data_set_t *redis_query_ds(redis_query_t *rq) /* {{{ */
 {
-  redisReply *rr;
-  const data_set_t *ds;
-  value_t val;
-
-  ds = plugin_get_ds(rq->type);
+  const data_set_t *ds = plugin_get_ds(rq->type);
   if (!ds) {
     ERROR("redis plugin: DS type `%s' not defined.", rq->type);
-    return -1;
+    return NULL;
   }
 
   if (ds->ds_num != 1) {
     ERROR("redis plugin: DS type `%s' has too many datasources. This is not "
           "supported currently.",
           rq->type);
-    return -1;
+    return NULL;
   }
 
-  if ((rr = c_redisCommand(rn, "SELECT %d", rq->database)) == NULL) {
-    WARNING("redis plugin: unable to switch to database `%d' on node `%s'.",
-            rq->database, rn->name);
-    return -1;
-  }
+  return ds;
+} /* }}} const data_set_t *redis_query_ds */
+
+static int redis_handle_query(redis_node_t *rn, redis_query_t *rq,
+                              redisReply *rr) /* {{{ */
+{
+  const data_set_t *ds;
+  value_t val;
 
-  if ((rr = c_redisCommand(rn, rq->query)) == NULL) {
-    WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
+  if ((ds = redis_query_ds(rq)) == NULL)
     return -1;
-  }
 
   switch (rr->type) {
   case REDIS_REPLY_INTEGER:
@@ -444,30 +495,25 @@ static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
   case REDIS_REPLY_STRING:
     if (parse_value(rr->str, &val, ds->ds[0].type) == -1) {
       WARNING("redis plugin: Query `%s': Unable to parse value.", rq->query);
-      freeReplyObject(rr);
       return -1;
     }
     break;
   case REDIS_REPLY_ERROR:
     WARNING("redis plugin: Query `%s' failed: %s.", rq->query, rr->str);
-    freeReplyObject(rr);
     return -1;
   case REDIS_REPLY_ARRAY:
     WARNING("redis plugin: Query `%s' should return string or integer. Arrays "
             "are not supported.",
             rq->query);
-    freeReplyObject(rr);
     return -1;
   default:
     WARNING("redis plugin: Query `%s': Cannot coerce redis type (%i).",
             rq->query, rr->type);
-    freeReplyObject(rr);
     return -1;
   }
 
   redis_submit(rn->name, rq->type,
                (strlen(rq->instance) > 0) ? rq->instance : NULL, val);
-  freeReplyObject(rr);
   return 0;
 } /* }}} int redis_handle_query */
 
@@ -592,61 +638,8 @@ static void redis_keyspace_usage(redis_node_t *rn, char const *info_line) {
 
 } /* void redis_keyspace_usage */
 
-static void redis_check_connection(redis_node_t *rn) {
-  if (rn->redisContext)
-    return;
-
-  redisContext *rh;
-  if (rn->socket != NULL)
-    rh = redisConnectUnixWithTimeout(rn->socket, rn->timeout);
-  else
-    rh = redisConnectWithTimeout(rn->host, rn->port, rn->timeout);
-
-  if (rh == NULL) {
-    ERROR("redis plugin: can't allocate redis context");
-    return;
-  }
-  if (rh->err) {
-    if (rn->socket)
-      ERROR("redis plugin: unable to connect to node `%s' (%s): %s.", rn->name,
-            rn->socket, rh->errstr);
-    else
-      ERROR("redis plugin: unable to connect to node `%s' (%s:%d): %s.",
-            rn->name, rn->host, rn->port, rh->errstr);
-    redisFree(rh);
-    return;
-  }
-
-  rn->redisContext = rh;
-
-  if (rn->passwd) {
-    redisReply *rr;
-
-    DEBUG("redis plugin: authenticating node `%s' passwd(%s).", rn->name,
-          rn->passwd);
-
-    if ((rr = c_redisCommand(rn, "AUTH %s", rn->passwd)) == NULL) {
-      WARNING("redis plugin: unable to authenticate on node `%s'.", rn->name);
-      return;
-    }
-
-    if (rr->type != REDIS_REPLY_STATUS) {
-      WARNING("redis plugin: invalid authentication on node `%s'.", rn->name);
-      freeReplyObject(rr);
-      redisFree(rn->redisContext);
-      rn->redisContext = NULL;
-      return;
-    }
-
-    freeReplyObject(rr);
-  }
-  return;
-} /* void redis_check_connection */
-
-static void redis_read_server_info(redis_node_t *rn) {
-  redisReply *rr;
-
-  if ((rr = c_redisCommand(rn, "INFO")) == NULL) {
+static void redis_handle_server_info(redis_node_t *rn, redisReply *rr) {
+  if (rr->type != REDIS_REPLY_STRING) {
     WARNING("redis plugin: unable to get INFO from node `%s'.", rn->name);
     return;
   }
@@ -689,24 +682,13 @@ static void redis_read_server_info(redis_node_t *rn) {
 
   if (rn->report_cpu_usage)
     redis_cpu_usage(rn->name, rr->str);
+} /* void redis_handle_server_info */
 
-  freeReplyObject(rr);
-} /* void redis_read_server_info */
-
-static void redis_read_command_stats(redis_node_t *rn) {
-  redisReply *rr;
-
-  if ((rr = c_redisCommand(rn, "INFO commandstats")) == NULL) {
-    WARNING("redis plugin: node `%s': unable to get `INFO commandstats'.",
-            rn->name);
-    return;
-  }
-
+static void redis_handle_command_stats(redis_node_t *rn, redisReply *rr) {
   if (rr->type != REDIS_REPLY_STRING) {
     WARNING("redis plugin: node `%s' `INFO commandstats' returned unsupported "
             "redis type %i.",
             rn->name, rr->type);
-    freeReplyObject(rr);
     return;
   }
 
@@ -766,8 +748,174 @@ static void redis_read_command_stats(redis_node_t *rn) {
       redis_submit(rn->name, type, command, (value_t){.derive = value});
     }
   }
-  freeReplyObject(rr);
-} /* void redis_read_command_stats */
+} /* void redis_handle_command_stats */
+
+static void redis_disconnect(redis_node_t *rn) {
+  if (rn->redisContext != NULL) {
+    redisFree(rn->redisContext);
+    rn->redisContext = NULL;
+  }
+  rn->database = -1;
+  rn->authenticated = false;
+  rn->connecting = false;
+} /* void redis_disconnect */
+
+/* With "nonblock" set, the connection is only initiated: it is established
+ * once the socket becomes writable, see redis_async_io(). */
+static int redis_connect(redis_node_t *rn, bool nonblock) {
+  redisContext *rh;
+  if (rn->socket != NULL)
+    rh = nonblock ? redisConnectUnixNonBlock(rn->socket)
+                  : redisConnectUnixWithTimeout(rn->socket, rn->timeout);
+  else
+    rh = nonblock ? redisConnectNonBlock(rn->host, rn->port)
+                  : redisConnectWithTimeout(rn->host, rn->port, rn->timeout);
+
+  if (rh == NULL) {
+    ERROR("redis plugin: can't allocate redis context");
+    return -1;
+  }
+  if (rh->err) {
+    if (rn->socket)
+      ERROR("redis plugin: unable to connect to node `%s' (%s): %s.", rn->name,
+            rn->socket, rh->errstr);
+    else
+      ERROR("redis plugin: unable to connect to node `%s' (%s:%d): %s.",
+            rn->name, rn->host, rn->port, rh->errstr);
+    redisFree(rh);
+    return -1;
+  }
+
+  rn->redisContext = rh;
+  rn->database = -1;
+  rn->authenticated = false;
+  rn->connecting = nonblock;
+  return 0;
+} /* int redis_connect */
+
+static int redis_append(redis_node_t *rn, redis_cmd_type_t type,
+                        redis_query_t *rq, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  int status = redisvAppendCommand(rn->redisContext, format, ap);
+  va_end(ap);
+
+  if (status != REDIS_OK) {
+    ERROR("redis plugin: node `%s': appending command `%s' failed: %s",
+          rn->name, format, rn->redisContext->errstr);
+    return -1;
+  }
+
+  rn->cmds[rn->cmds_num] = (redis_cmd_t){.type = type, .query = rq};
+  rn->cmds_num++;
+  return 0;
+} /* int redis_append */
+
+/* Appends all commands of one read to the output buffer of the connection.
+ * Nothing is sent until the replies are read. */
+static int redis_pipeline_start(redis_node_t *rn) {
+  if (rn->cmds == NULL) {
+    /* AUTH, INFO and INFO commandstats plus SELECT and the query itself for
+     * each query. */
+    size_t cmds_max = 3;
+    for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next)
+      cmds_max += 2;
+
+    rn->cmds = calloc(cmds_max, sizeof(*rn->cmds));
+    if (rn->cmds == NULL) {
+      ERROR("redis plugin: calloc failed.");
+      return ENOMEM;
+    }
+  }
+
+  rn->cmds_num = 0;
+  rn->replies_num = 0;
+  rn->auth_failed = false;
+  rn->select_failed = false;
+
+  int status = 0;
+  if ((rn->passwd != NULL) && !rn->authenticated)
+    status = redis_append(rn, REDIS_CMD_AUTH, NULL, "AUTH %s", rn->passwd);
+
+  if (status == 0)
+    status = redis_append(rn, REDIS_CMD_INFO, NULL, "INFO");
+
+  if ((status == 0) && rn->report_command_stats)
+    status = redis_append(rn, REDIS_CMD_COMMAND_STATS, NULL,
+                          "INFO commandstats");
+
+  /* The selected database sticks to the connection, so SELECT is only sent
+   * when a query needs another one. */
+  int database = rn->database;
+  for (redis_query_t *rq = rn->queries; (rq != NULL) && (status == 0);
+       rq = rq->next) {
+    if (redis_query_ds(rq) == NULL)
+      continue;
+
+    if (rq->database != database) {
+      status = redis_append(rn, REDIS_CMD_SELECT, rq, "SELECT %d",
+                            rq->database);
+      database = rq->database;
+    }
+
+    if (status == 0)
+      status = redis_append(rn, REDIS_CMD_QUERY, rq, rq->query);
+  }
+
+  return status;
+} /* int redis_pipeline_start */
+
+/* Handles the reply to the next command of the pipeline. */
+static void redis_handle_reply(redis_node_t *rn, redisReply *rr) {
+  redis_cmd_t *cmd = rn->cmds + rn->replies_num;
+  rn->replies_num++;
+
+  /* Without authentication all other commands fail, too. */
+  if (rn->auth_failed)
+    return;
+
+  switch (cmd->type) {
+  case REDIS_CMD_AUTH:
+    if (rr->type != REDIS_REPLY_STATUS) {
+      WARNING("redis plugin: invalid authentication on node `%s'.", rn->name);
+      rn->auth_failed = true;
+    } else
+      rn->authenticated = true;
+    break;
+  case REDIS_CMD_INFO:
+    redis_handle_server_info(rn, rr);
+    break;
+  case REDIS_CMD_COMMAND_STATS:
+    redis_handle_command_stats(rn, rr);
+    break;
+  case REDIS_CMD_SELECT:
+    /* The queries up to the next SELECT would run against the wrong
+     * database, so they are skipped. */
+    if (rr->type == REDIS_REPLY_ERROR) {
+      WARNING("redis plugin: unable to switch to database `%d' on node `%s': "
+              "%s.",
+              cmd->query->database, rn->name, rr->str);
+      rn->database = -1;
+      rn->select_failed = true;
+    } else {
+      rn->database = cmd->query->database;
+      rn->select_failed = false;
+    }
+    break;
+  case REDIS_CMD_QUERY:
+    if (!rn->select_failed)
+      redis_handle_query(rn, cmd->query, rr);
+    break;
+  }
+} /* void redis_handle_reply */
+
+static int redis_pipeline_finish(redis_node_t *rn) {
+  if (rn->auth_failed) {
+    redis_disconnect(rn);
+    return -1;
+  }
+  return 0;
+} /* int redis_pipeline_finish */
 
 static int redis_read(user_data_t *user_data) /* {{{ */
 {
@@ -782,30 +930,195 @@ static int redis_read(user_data_t *user_data) /* {{{ */
           rn->host, rn->port);
 #endif
 
-  redis_check_connection(rn);
+  if ((rn->redisContext == NULL) && (redis_connect(rn, false) != 0))
+    return -1;
 
-  if (!rn->redisContext) /* no connection */
+  if (redis_pipeline_start(rn) != 0) {
+    redis_disconnect(rn);
     return -1;
+  }
+
+  /* The first redisGetReply() sends all commands in one go. */
+  while (rn->replies_num < rn->cmds_num) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(rn->redisContext, (void **)&rr) != REDIS_OK) {
+      ERROR("redis plugin: node `%s': Connection error: %s", rn->name,
+            rn->redisContext->errstr);
+      redis_disconnect(rn);
+      return -1;
+    }
+
+    redis_handle_reply(rn, rr);
+    freeReplyObject(rr);
+  }
+
+  return redis_pipeline_finish(rn);
+}
+/* }}} */
 
-  redis_read_server_info(rn);
+/* Handles the poll(2) events of a node's connection: completes the connect,
+ * sends the pipeline and handles the replies received so far. Returns zero
+ * unless the connection failed. */
+static int redis_async_io(redis_node_t *rn, short revents) /* {{{ */
+{
+  redisContext *c = rn->redisContext;
 
-  if (!rn->redisContext) /* connection lost */
+  if (revents & POLLNVAL) {
+    ERROR("redis plugin: node `%s': invalid file descriptor.", rn->name);
     return -1;
+  }
 
-  if (rn->report_command_stats) {
-    redis_read_command_stats(rn);
+  if (rn->connecting) {
+    if ((revents & (POLLOUT | POLLERR | POLLHUP)) == 0)
+      return 0;
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0)
+      err = errno;
+    if (err != 0) {
+      ERROR("redis plugin: unable to connect to node `%s': %s.", rn->name,
+            STRERROR(err));
+      return -1;
+    }
+    rn->connecting = false;
+  }
 
-    if (!rn->redisContext) /* connection lost */
+  if (rn->writing && (revents & POLLOUT)) {
+    int done = 0;
+    if (redisBufferWrite(c, &done) != REDIS_OK) {
+      ERROR("redis plugin: node `%s': Connection error: %s", rn->name,
+            c->errstr);
       return -1;
+    }
+    rn->writing = !done;
   }
 
-  for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
-    redis_handle_query(rn, rq);
-    if (!rn->redisContext) /* connection lost */
+  if ((revents & (POLLIN | POLLERR | POLLHUP)) == 0)
+    return 0;
+
+  if (redisBufferRead(c) != REDIS_OK) {
+    ERROR("redis plugin: node `%s': Connection error: %s", rn->name,
+          c->errstr);
+    return -1;
+  }
+
+  /* On a non-blocking connection, redisGetReply() only parses what has been
+   * read already and returns no reply if that is incomplete. */
+  while (rn->replies_num < rn->cmds_num) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(c, (void **)&rr) != REDIS_OK) {
+      ERROR("redis plugin: node `%s': Protocol error: %s", rn->name,
+            c->errstr);
       return -1;
+    }
+    if (rr == NULL)
+      break;
+
+    redis_handle_reply(rn, rr);
+    freeReplyObject(rr);
   }
 
   return 0;
+} /* }}} int redis_async_io */
+
+/* Reads all nodes at once: the commands of every node are pipelined on a
+ * non-blocking connection and a single poll(2) loop waits for the replies of
+ * all nodes. Each node's "Timeout" applies to its whole pipeline. */
+static int redis_read_async(user_data_t *user_data) /* {{{ */
+{
+  redis_node_t *nodes = user_data->data;
+  size_t polling_num = 0;
+  int success = 0;
+
+  struct pollfd *fds = calloc(nodes_num, sizeof(*fds));
+  redis_node_t **fds_nodes = calloc(nodes_num, sizeof(*fds_nodes));
+  if ((fds == NULL) || (fds_nodes == NULL)) {
+    ERROR("redis plugin: calloc failed.");
+    sfree(fds);
+    sfree(fds_nodes);
+    return ENOMEM;
+  }
+
+  cdtime_t now = cdtime();
+  for (redis_node_t *rn = nodes; rn != NULL; rn = rn->next) {
+    rn->polling = false;
+
+    if ((rn->redisContext == NULL) && (redis_connect(rn, true) != 0))
+      continue;
+
+    if (redis_pipeline_start(rn) != 0) {
+      redis_disconnect(rn);
+      continue;
+    }
+
+    rn->writing = true;
+    rn->polling = true;
+    rn->deadline = now + TIMEVAL_TO_CDTIME_T(&rn->timeout);
+    polling_num++;
+  }
+
+  while (polling_num > 0) {
+    size_t fds_num = 0;
+    cdtime_t deadline = 0;
+
+    for (redis_node_t *rn = nodes; rn != NULL; rn = rn->next) {
+      if (!rn->polling)
+        continue;
+
+      fds[fds_num] = (struct pollfd){
+          .fd = rn->redisContext->fd,
+          .events = POLLIN | ((rn->connecting || rn->writing) ? POLLOUT : 0),
+      };
+      fds_nodes[fds_num] = rn;
+      fds_num++;
+
+      if ((deadline == 0) || (rn->deadline < deadline))
+        deadline = rn->deadline;
+    }
+
+    now = cdtime();
+    int timeout = (deadline > now) ? (int)CDTIME_T_TO_MS(deadline - now) : 0;
+
+    int status = poll(fds, (nfds_t)fds_num, timeout);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("redis plugin: poll failed: %s", STRERRNO);
+      for (size_t i = 0; i < fds_num; i++) {
+        redis_disconnect(fds_nodes[i]);
+        fds_nodes[i]->polling = false;
+      }
+      break;
+    }
+
+    now = cdtime();
+    for (size_t i = 0; i < fds_num; i++) {
+      redis_node_t *rn = fds_nodes[i];
+
+      if ((fds[i].revents != 0) && (redis_async_io(rn, fds[i].revents) != 0))
+        redis_disconnect(rn);
+      else if (rn->replies_num == rn->cmds_num) {
+        if (redis_pipeline_finish(rn) == 0)
+          success++;
+      } else if (rn->deadline <= now) {
+        ERROR("redis plugin: node `%s': Timeout waiting for replies.",
+              rn->name);
+        redis_disconnect(rn);
+      } else
+        continue;
+
+      rn->polling = false;
+      polling_num--;
+    }
+  }
+
+  sfree(fds);
+  sfree(fds_nodes);
+
+  return (success > 0) ? 0 : -1;
 }
 /* }}} */
 
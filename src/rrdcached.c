@@ -30,6 +30,10 @@
 #include "utils/common/common.h"
 #include "utils/rrdcreate/rrdcreate.h"
 
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #undef HAVE_CONFIG_H
 #include <rrd.h>
 #include <rrd_client.h>
@@ -49,7 +53,34 @@ static rrdcreate_config_t rrdcreate_config = {.stepsize = 0,
                                               .timespans_num = 0,
                                               .consolidation_functions = NULL,
                                               .consolidation_functions_num = 0,
-                                              .async = 0};
+                                              .async = 0,
+                                              .async_threads = 0};
+
+#define RC_DEFAULT_PORT "42217"
+
+/* With "BatchSize" > 1, updates are sent using the daemon's BATCH command on
+ * connections of their own, because the RRD client library neither exposes
+ * BATCH nor supports more than one connection. Files are assigned to a
+ * connection by a hash of their name, keeping the updates of one file in
+ * order. */
+typedef struct {
+  pthread_mutex_t lock;
+  int fd;
+
+  char *buffer;
+  size_t buffer_len;
+  size_t buffer_size;
+  size_t updates_num;
+  cdtime_t batch_start;
+
+  char response[1024];
+  size_t response_len;
+} rc_batch_t;
+
+static int batch_size = 1;
+static cdtime_t batch_timeout;
+static int connections_num = 1;
+static rc_batch_t *batches;
 
 /*
  * Prototypes.
@@ -211,6 +242,9 @@ static int rc_config(oconfig_item_t *ci) {
       status = cf_util_get_boolean(child, &config_create_files);
     else if (strcasecmp("CreateFilesAsync", key) == 0)
       status = cf_util_get_boolean(child, &rrdcreate_config.async);
+    else if (strcasecmp("CreateThreads", key) == 0)
+      status =
+          rc_config_get_int_positive(child, &rrdcreate_config.async_threads);
     else if (strcasecmp("CollectStatistics", key) == 0)
       status = cf_util_get_boolean(child, &config_collect_stats);
     else if (strcasecmp("StepSize", key) == 0) {
@@ -230,7 +264,15 @@ static int rc_config(oconfig_item_t *ci) {
         status = rc_config_add_timespan(tmp);
     } else if (strcasecmp("XFF", key) == 0)
       status = rc_config_get_xff(child, &rrdcreate_config.xff);
-    else {
+    else if (strcasecmp("BatchSize", key) == 0)
+      status = rc_config_get_int_positive(child, &batch_size);
+    else if (strcasecmp("BatchTimeout", key) == 0)
+      status = cf_util_get_cdtime(child, &batch_timeout);
+    else if (strcasecmp("Connections", key) == 0) {
+      status = rc_config_get_int_positive(child, &connections_num);
+      if ((status == 0) && (connections_num < 1))
+        connections_num = 1;
+    } else {
       WARNING("rrdcached plugin: Ignoring invalid option %s.", key);
       continue;
     }
@@ -246,6 +288,315 @@ static int rc_config(oconfig_item_t *ci) {
   return 0;
 } /* int rc_config */
 
+/* 32 bit FNV-1a */
+static rc_batch_t *rc_batch_get(char const *filename) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+  for (char const *ptr = filename; *ptr != 0; ptr++) {
+    hash ^= (uint8_t)*ptr;
+    hash *= 16777619u;
+  }
+  return batches + (hash % (uint32_t)connections_num);
+} /* }}} rc_batch_t *rc_batch_get */
+
+static void rc_batch_disconnect_nolock(rc_batch_t *b) /* {{{ */
+{
+  if (b->fd >= 0)
+    close(b->fd);
+  b->fd = -1;
+  b->response_len = 0;
+} /* }}} void rc_batch_disconnect_nolock */
+
+static int rc_batch_connect_unix(char const *path) /* {{{ */
+{
+  struct sockaddr_un sa = {.sun_family = AF_UNIX};
+
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    ERROR("rrdcached plugin: Socket path too long: %s", path);
+    return -1;
+  }
+  sstrncpy(sa.sun_path, path, sizeof(sa.sun_path));
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    ERROR("rrdcached plugin: socket failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    ERROR("rrdcached plugin: Connecting to %s failed: %s", path, STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+} /* }}} int rc_batch_connect_unix */
+
+/* Accepts "host", "host:port", "[address]" and "[address]:port", like the RRD
+ * client library does. */
+static int rc_batch_connect_inet(char const *address) /* {{{ */
+{
+  char node[NI_MAXHOST];
+  char const *service = RC_DEFAULT_PORT;
+
+  if (address[0] == '[') {
+    char const *end = strchr(address, ']');
+    if ((end == NULL) || ((size_t)(end - address) > sizeof(node))) {
+      ERROR("rrdcached plugin: Invalid address: %s", address);
+      return -1;
+    }
+    sstrncpy(node, address + 1, (size_t)(end - address));
+    if (end[1] == ':')
+      service = end + 2;
+  } else {
+    sstrncpy(node, address, sizeof(node));
+    char *colon = strrchr(node, ':');
+    /* More than one colon is a bare IPv6 address. */
+    if ((colon != NULL) && (strchr(node, ':') == colon)) {
+      *colon = 0;
+      service = colon + 1;
+    }
+  }
+
+  struct addrinfo *ai_list;
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_socktype = SOCK_STREAM,
+      .ai_flags = AI_ADDRCONFIG,
+  };
+
+  int status = getaddrinfo(node, service, &ai_hints, &ai_list);
+  if (status != 0) {
+    ERROR("rrdcached plugin: getaddrinfo (%s, %s) failed: %s", node, service,
+          gai_strerror(status));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(ai_list);
+
+  if (fd < 0)
+    ERROR("rrdcached plugin: Connecting to %s failed.", address);
+  return fd;
+} /* }}} int rc_batch_connect_inet */
+
+static int rc_batch_connect_nolock(rc_batch_t *b) /* {{{ */
+{
+  if (b->fd >= 0)
+    return 0;
+
+  if (strncmp("unix:", daemon_address, strlen("unix:")) == 0)
+    b->fd = rc_batch_connect_unix(daemon_address + strlen("unix:"));
+  else if (daemon_address[0] == '/')
+    b->fd = rc_batch_connect_unix(daemon_address);
+  else
+    b->fd = rc_batch_connect_inet(daemon_address);
+
+  b->response_len = 0;
+  return (b->fd < 0) ? -1 : 0;
+} /* }}} int rc_batch_connect_nolock */
+
+/* Reads one line of the daemon's response into "buffer", without the newline.
+ * Overly long lines are truncated. */
+static int rc_batch_read_line(rc_batch_t *b, char *buffer, /* {{{ */
+                              size_t buffer_size) {
+  while (42) {
+    char *newline = memchr(b->response, '\n', b->response_len);
+    if (newline != NULL) {
+      size_t len = (size_t)(newline - b->response);
+
+      *newline = 0;
+      sstrncpy(buffer, b->response, buffer_size);
+      memmove(b->response, newline + 1, b->response_len - (len + 1));
+      b->response_len -= len + 1;
+      return 0;
+    }
+
+    /* Line too long: drop what we have so far. */
+    if (b->response_len == sizeof(b->response))
+      b->response_len = 0;
+
+    ssize_t status = read(b->fd, b->response + b->response_len,
+                          sizeof(b->response) - b->response_len);
+    if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+      continue;
+    if (status <= 0) {
+      ERROR("rrdcached plugin: Reading the response failed: %s",
+            (status == 0) ? "Connection closed" : STRERRNO);
+      return -1;
+    }
+    b->response_len += (size_t)status;
+  }
+} /* }}} int rc_batch_read_line */
+
+/* Sends the pending updates of "b" as one BATCH command and reads the daemon's
+ * acknowledgement. */
+static int rc_batch_send_nolock(rc_batch_t *b) /* {{{ */
+{
+  char line[1024];
+  bool retried = false;
+  int status;
+
+  if (b->updates_num == 0)
+    return 0;
+
+  memcpy(b->buffer + b->buffer_len, ".\n", 2);
+  b->buffer_len += 2;
+
+  while (42) {
+    status = rc_batch_connect_nolock(b);
+    if (status == 0)
+      status = swrite(b->fd, b->buffer, b->buffer_len);
+    /* The first line acknowledges the BATCH command itself: "0 Go ahead." */
+    if (status == 0)
+      status = rc_batch_read_line(b, line, sizeof(line));
+    if ((status == 0) && (atoi(line) < 0)) {
+      ERROR("rrdcached plugin: BATCH failed: %s", line);
+      status = -1;
+    }
+    if (status == 0)
+      break;
+
+    rc_batch_disconnect_nolock(b);
+    if (retried)
+      break;
+    retried = true;
+  }
+
+  /* The second line is "<num> errors", followed by one line per failed
+   * update: "<command number> <message>". */
+  if (status == 0)
+    status = rc_batch_read_line(b, line, sizeof(line));
+  if (status == 0) {
+    int errors_num = atoi(line);
+
+    for (int i = 0; (status == 0) && (i < errors_num); i++) {
+      char error[sizeof(line)];
+
+      status = rc_batch_read_line(b, error, sizeof(error));
+      if ((status == 0) && (i == 0))
+        WARNING("rrdcached plugin: %d of %" PRIsz " updates failed. "
+                "First error: %s",
+                errors_num, b->updates_num, error);
+    }
+  }
+
+  if (status != 0) {
+    rc_batch_disconnect_nolock(b);
+    ERROR("rrdcached plugin: Sending %" PRIsz " updates to %s failed.",
+          b->updates_num, daemon_address);
+  }
+
+  b->buffer_len = 0;
+  b->updates_num = 0;
+  return status;
+} /* }}} int rc_batch_send_nolock */
+
+/* Appends "src" to the batch buffer, escaping spaces and backslashes the way
+ * the daemon expects them. */
+static int rc_batch_append(rc_batch_t *b, char const *src) /* {{{ */
+{
+  size_t len = strlen(src);
+
+  /* Worst case: every byte is escaped, plus separator and ".\n". */
+  size_t need = b->buffer_len + 2 * len + 3;
+  if (need > b->buffer_size) {
+    size_t size = (b->buffer_size > 0) ? b->buffer_size : 4096;
+    while (size < need)
+      size *= 2;
+
+    char *tmp = realloc(b->buffer, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->buffer = tmp;
+    b->buffer_size = size;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if ((src[i] == ' ') || (src[i] == '\\'))
+      b->buffer[b->buffer_len++] = '\\';
+    b->buffer[b->buffer_len++] = src[i];
+  }
+  return 0;
+} /* }}} int rc_batch_append */
+
+static int rc_batch_add(char const *filename, char const *values) /* {{{ */
+{
+  rc_batch_t *b = rc_batch_get(filename);
+  int status = 0;
+
+  pthread_mutex_lock(&b->lock);
+
+  size_t old_len = b->buffer_len;
+  if (b->updates_num == 0) {
+    status = rc_batch_append(b, "BATCH");
+    if (status == 0) {
+      b->buffer[b->buffer_len++] = '\n';
+      b->batch_start = cdtime();
+    }
+  }
+  if (status == 0)
+    status = rc_batch_append(b, "UPDATE");
+  if (status == 0) {
+    b->buffer[b->buffer_len++] = ' ';
+    status = rc_batch_append(b, filename);
+  }
+  if (status == 0) {
+    b->buffer[b->buffer_len++] = ' ';
+    status = rc_batch_append(b, values);
+  }
+  if (status != 0) {
+    b->buffer_len = old_len;
+    pthread_mutex_unlock(&b->lock);
+    ERROR("rrdcached plugin: Allocating the batch buffer failed.");
+    return status;
+  }
+  b->buffer[b->buffer_len++] = '\n';
+  b->updates_num++;
+
+  if ((b->updates_num >= (size_t)batch_size) ||
+      ((cdtime() - b->batch_start) >= batch_timeout))
+    status = rc_batch_send_nolock(b);
+
+  pthread_mutex_unlock(&b->lock);
+  return status;
+} /* }}} int rc_batch_add */
+
+/* Sends the pending updates of all connections, or only of the connection
+ * "filename" belongs to. */
+static int rc_batch_flush(char const *filename) /* {{{ */
+{
+  int status = 0;
+
+  if (batches == NULL)
+    return 0;
+
+  for (int i = 0; i < connections_num; i++) {
+    rc_batch_t *b = batches + i;
+
+    if ((filename != NULL) && (b != rc_batch_get(filename)))
+      continue;
+
+    pthread_mutex_lock(&b->lock);
+    if (rc_batch_send_nolock(b) != 0)
+      status = -1;
+    pthread_mutex_unlock(&b->lock);
+  }
+
+  return status;
+} /* }}} int rc_batch_flush */
+
 static int try_reconnect(void) {
   rrdc_disconnect();
 
@@ -366,6 +717,22 @@ static int rc_init(void) {
   if (config_collect_stats)
     plugin_register_read("rrdcached", rc_read);
 
+  if ((daemon_address == NULL) || (batch_size <= 1))
+    return 0;
+
+  if (batch_timeout == 0)
+    batch_timeout = plugin_get_interval();
+
+  batches = calloc((size_t)connections_num, sizeof(*batches));
+  if (batches == NULL) {
+    ERROR("rrdcached plugin: calloc failed.");
+    return ENOMEM;
+  }
+  for (int i = 0; i < connections_num; i++) {
+    pthread_mutex_init(&batches[i].lock, /* attr = */ NULL);
+    batches[i].fd = -1;
+  }
+
   return 0;
 } /* int rc_init */
 
@@ -407,15 +774,22 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
         return -1;
       }
 
-      status = cu_rrd_create_file(filename, ds, vl, &rrdcreate_config);
-      if (status != 0) {
+      status =
+          cu_rrd_create_file(filename, ds, vl, &rrdcreate_config, values);
+      if (status == EEXIST) {
+        /* Created concurrently; update it as usual. */
+      } else if (status != 0) {
         ERROR("rrdcached plugin: cu_rrd_create_file (%s) failed.", filename);
         return -1;
       } else if (rrdcreate_config.async)
+        /* The value is written once the file has been created. */
         return 0;
     }
   }
 
+  if (batches != NULL)
+    return rc_batch_add(filename, values);
+
   rrd_clear_error();
   status = rrdc_connect(daemon_address);
   if (status != 0) {
@@ -456,8 +830,11 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
 static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
                     const char *identifier,
                     __attribute__((unused)) user_data_t *ud) {
-  if (identifier == NULL)
-    return EINVAL;
+  if (identifier == NULL) {
+    if (batches == NULL)
+      return EINVAL;
+    return rc_batch_flush(/* filename = */ NULL);
+  }
 
   char filename[PATH_MAX + 1];
 
@@ -466,6 +843,9 @@ static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
   else
     ssnprintf(filename, sizeof(filename), "%s.rrd", identifier);
 
+  /* The daemon can only flush updates it has received. */
+  rc_batch_flush(filename);
+
   rrd_clear_error();
   int status = rrdc_connect(daemon_address);
   if (status != 0) {
@@ -502,6 +882,16 @@ static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
 } /* }}} int rc_flush */
 
 static int rc_shutdown(void) {
+  rc_batch_flush(/* filename = */ NULL);
+  if (batches != NULL) {
+    for (int i = 0; i < connections_num; i++) {
+      rc_batch_disconnect_nolock(batches + i);
+      sfree(batches[i].buffer);
+      pthread_mutex_destroy(&batches[i].lock);
+    }
+    sfree(batches);
+  }
+
   rrdc_disconnect();
   return 0;
 } /* int rc_shutdown */
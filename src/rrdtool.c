@@ -54,13 +54,44 @@ struct rrd_queue_s {
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+struct rrd_batch_s {
+  rrd_queue_t *entry;
+  char **values;
+  int values_num;
+  bool found;
+};
+typedef struct rrd_batch_s rrd_batch_t;
+
+/* Each update worker owns the files whose name hashes to its index, so all
+ * updates of one file are serialized by that worker's queue. */
+struct rrd_worker_s {
+  rrd_queue_t *queue_head;
+  rrd_queue_t *queue_tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+  size_t queue_length;
+
+  cdtime_t latency_sum;
+  uint64_t latency_num;
+
+  pthread_t thread;
+  bool thread_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Entries taken off the queue at once, sorted by filename. */
+  rrd_batch_t *batch;
+};
+typedef struct rrd_worker_s rrd_worker_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
     "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
     "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "XFF",          "WritesPerSecond", "RandomTimeout",    "UpdateThreads",
+    "ReportStats", "UpdateBatchSize", "CreateThreads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -80,10 +111,11 @@ static rrdcreate_config_t rrdcreate_config = {
     /* consolidation_functions = */ NULL,
     /* consolidation_functions_num = */ 0,
 
-    /* async = */ 0};
+    /* async = */ 0,
+    /* async_threads = */ 0};
 
-/* XXX: If you need to lock both, cache_lock and queue_lock, at the same time,
- * ALWAYS lock `cache_lock' first! */
+/* XXX: If you need to lock both, cache_lock and a worker's lock, at the same
+ * time, ALWAYS lock `cache_lock' first! */
 static cdtime_t cache_timeout;
 static cdtime_t cache_flush_timeout;
 static cdtime_t random_timeout;
@@ -91,14 +123,10 @@ static cdtime_t cache_flush_last;
 static c_avl_tree_t *cache;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head;
-static rrd_queue_t *queue_tail;
-static rrd_queue_t *flushq_head;
-static rrd_queue_t *flushq_tail;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
-static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static rrd_worker_t *workers;
+static size_t workers_num = 1;
+static size_t update_batch_size = 1;
+static bool report_stats;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -279,36 +307,52 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
+/* 32 bit FNV-1a */
+static rrd_worker_t *rrd_worker_get(char const *filename) {
+  uint32_t hash = 2166136261u;
+  for (char const *ptr = filename; *ptr != 0; ptr++) {
+    hash ^= (uint8_t)*ptr;
+    hash *= 16777619u;
+  }
+  return workers + (hash % workers_num);
+} /* rrd_worker_t *rrd_worker_get */
+
+static int rrd_batch_compare(void const *a, void const *b) {
+  rrd_batch_t const *ba = a;
+  rrd_batch_t const *bb = b;
+
+  return strcmp(ba->entry->filename, bb->entry->filename);
+} /* int rrd_batch_compare */
+
+static void *rrd_queue_thread(void *data) {
+  rrd_worker_t *w = data;
   struct timeval tv_next_update;
   struct timeval tv_now;
 
+  /* "WritesPerSecond" is the limit for all workers together. */
+  double worker_rate = write_rate * (double)workers_num;
+
+  rrd_batch_t *batch = w->batch;
+
   gettimeofday(&tv_next_update, /* timezone = */ NULL);
 
   while (42) {
-    rrd_queue_t *queue_entry;
-    rrd_cache_t *cache_entry;
-    char **values;
-    int values_num;
     int status;
 
-    values = NULL;
-    values_num = 0;
-
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&w->lock);
     /* Wait for values to arrive */
     while (42) {
       struct timespec ts_wait;
 
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
+      while ((w->flushq_head == NULL) && (w->queue_head == NULL) &&
              (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+        pthread_cond_wait(&w->cond, &w->lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((w->flushq_head == NULL) && (w->queue_head == NULL))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (w->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
@@ -316,7 +360,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
         break;
 
       /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
+      if (worker_rate <= 0.0)
         break;
 
       gettimeofday(&tv_now, /* timezone = */ NULL);
@@ -331,49 +375,59 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
       ts_wait.tv_sec = tv_next_update.tv_sec;
       ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
 
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      status = pthread_cond_timedwait(&w->cond, &w->lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
 
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a worker's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
 
     /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
-      pthread_mutex_unlock(&queue_lock);
+    if ((w->flushq_head == NULL) && (w->queue_head == NULL)) {
+      pthread_mutex_unlock(&w->lock);
       break;
     }
 
-    if (flushq_head != NULL) {
-      /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
-      else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
-    {
-      /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
-      else
-        queue_head = queue_head->next;
+    /* Flush entries are written first. Regular entries are written one at a
+     * time when "WritesPerSecond" is in effect. */
+    bool flushing = (w->flushq_head != NULL);
+    size_t batch_max = update_batch_size;
+    if (!flushing && (worker_rate > 0.0) && (do_shutdown == 0))
+      batch_max = 1;
+
+    rrd_queue_t **head = flushing ? &w->flushq_head : &w->queue_head;
+    rrd_queue_t **tail = flushing ? &w->flushq_tail : &w->queue_tail;
+    size_t batch_num = 0;
+    while ((*head != NULL) && (batch_num < batch_max)) {
+      rrd_queue_t *queue_entry = *head;
+
+      *head = queue_entry->next;
+      if (*head == NULL)
+        *tail = NULL;
+      w->queue_length--;
+
+      batch[batch_num] = (rrd_batch_t){.entry = queue_entry};
+      batch_num++;
     }
 
     /* Unlock the queue again */
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&w->lock);
 
-    /* We now need the cache lock so the entry isn't updated while
-     * we make a copy of its values */
+    /* We now need the cache lock so the entries aren't updated while
+     * we make a copy of their values */
     pthread_mutex_lock(&cache_lock);
 
-    status = c_avl_get(cache, queue_entry->filename, (void *)&cache_entry);
+    for (size_t i = 0; i < batch_num; i++) {
+      rrd_cache_t *cache_entry;
+
+      if (c_avl_get(cache, batch[i].entry->filename, (void *)&cache_entry) !=
+          0)
+        continue;
 
-    if (status == 0) {
-      values = cache_entry->values;
-      values_num = cache_entry->values_num;
+      batch[i].values = cache_entry->values;
+      batch[i].values_num = cache_entry->values_num;
+      batch[i].found = true;
 
       cache_entry->values = NULL;
       cache_entry->values_num = 0;
@@ -382,43 +436,60 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
 
     pthread_mutex_unlock(&cache_lock);
 
-    if (status != 0) {
-      sfree(queue_entry->filename);
-      sfree(queue_entry);
-      continue;
-    }
+    /* Files of the same host / plugin share a directory, so writing them in
+     * path order keeps directory and inode lookups local. */
+    if (batch_num > 1)
+      qsort(batch, batch_num, sizeof(*batch), rrd_batch_compare);
 
     /* Update `tv_next_update' */
-    if (write_rate > 0.0) {
+    if (worker_rate > 0.0) {
       gettimeofday(&tv_now, /* timezone = */ NULL);
       tv_next_update.tv_sec = tv_now.tv_sec;
       tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
+          tv_now.tv_usec + ((suseconds_t)(1000000 * worker_rate));
       while (tv_next_update.tv_usec > 1000000) {
         tv_next_update.tv_sec++;
         tv_next_update.tv_usec -= 1000000;
       }
     }
 
-    /* Write the values to the RRD-file */
-    srrd_update(queue_entry->filename, NULL, values_num, (const char **)values);
-    DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
-          (values_num == 1) ? "" : "s", queue_entry->filename);
+    cdtime_t latency_sum = 0;
+    uint64_t latency_num = 0;
+    for (size_t i = 0; i < batch_num; i++) {
+      rrd_batch_t *b = batch + i;
+
+      if (b->found) {
+        /* Write the values to the RRD-file */
+        cdtime_t start = cdtime();
+        srrd_update(b->entry->filename, NULL, b->values_num,
+                    (const char **)b->values);
+        latency_sum += cdtime() - start;
+        latency_num++;
+        DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s",
+              b->values_num, (b->values_num == 1) ? "" : "s",
+              b->entry->filename);
+      }
 
-    for (int i = 0; i < values_num; i++) {
-      sfree(values[i]);
+      for (int j = 0; j < b->values_num; j++) {
+        sfree(b->values[j]);
+      }
+      sfree(b->values);
+      sfree(b->entry->filename);
+      sfree(b->entry);
     }
-    sfree(values);
-    sfree(queue_entry->filename);
-    sfree(queue_entry);
+
+    pthread_mutex_lock(&w->lock);
+    w->latency_sum += latency_sum;
+    w->latency_num += latency_num;
+    pthread_mutex_unlock(&w->lock);
   } /* while (42) */
 
   pthread_exit((void *)0);
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_enqueue(const char *filename, bool flush) {
+  rrd_worker_t *w = rrd_worker_get(filename);
   rrd_queue_t *queue_entry;
 
   queue_entry = malloc(sizeof(*queue_entry));
@@ -433,29 +504,34 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
 
   queue_entry->next = NULL;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&w->lock);
+
+  rrd_queue_t **head = flush ? &w->flushq_head : &w->queue_head;
+  rrd_queue_t **tail = flush ? &w->flushq_tail : &w->queue_tail;
 
   if (*tail == NULL)
     *head = queue_entry;
   else
     (*tail)->next = queue_entry;
   *tail = queue_entry;
+  w->queue_length++;
 
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* Removes "filename" from the regular (non-flush) queue. */
+static int rrd_queue_dequeue(const char *filename) {
+  rrd_worker_t *w = rrd_worker_get(filename);
   rrd_queue_t *this;
   rrd_queue_t *prev;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&w->lock);
 
   prev = NULL;
-  this = *head;
+  this = w->queue_head;
 
   while (this != NULL) {
     if (strcmp(this->filename, filename) == 0)
@@ -466,19 +542,20 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (this == NULL) {
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&w->lock);
     return -1;
   }
 
   if (prev == NULL)
-    *head = this->next;
+    w->queue_head = this->next;
   else
     prev->next = this->next;
 
   if (this->next == NULL)
-    *tail = prev;
+    w->queue_tail = prev;
+  w->queue_length--;
 
-  pthread_mutex_unlock(&queue_lock);
+  pthread_mutex_unlock(&w->lock);
 
   sfree(this->filename);
   sfree(this);
@@ -513,7 +590,7 @@ static void rrd_cache_flush(cdtime_t timeout) {
     else if (rc->values_num > 0) {
       int status;
 
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(key, /* flush = */ false);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
     } else /* ancient and no values -> waste of memory */
@@ -582,14 +659,14 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(key);
+    status = rrd_queue_enqueue(key, /* flush = */ true);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
   } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    status = rrd_queue_enqueue(key, /* flush = */ true);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   }
@@ -696,12 +773,12 @@ static int rrd_cache_insert(const char *filename, const char *value,
 
   if ((rc->last_value - rc->first_value) >=
       (cache_timeout + rc->random_variation)) {
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a worker's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
     if (rc->flags == FLAG_NONE) {
       int status;
 
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(filename, /* flush = */ false);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
 
@@ -805,10 +882,15 @@ static int rrd_write(const data_set_t *ds, const value_list_t *vl,
   struct stat statbuf = {0};
   if (stat(filename, &statbuf) == -1) {
     if (errno == ENOENT) {
-      if (cu_rrd_create_file(filename, ds, vl, &rrdcreate_config) != 0) {
+      int status =
+          cu_rrd_create_file(filename, ds, vl, &rrdcreate_config, values);
+      if (status == EEXIST) {
+        /* Created concurrently; update it as usual. */
+      } else if (status != 0) {
         ERROR("rrdtool plugin: cu_rrd_create_file (%s) failed.", filename);
         return -1;
       } else if (rrdcreate_config.async) {
+        /* The value is written once the file has been created. */
         return 0;
       }
     } else {
@@ -978,36 +1060,128 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       random_timeout = DOUBLE_TO_CDTIME_T(tmp);
     }
+  } else if (strcasecmp("UpdateThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `UpdateThreads' must "
+                      "be greater than 0.\n");
+      ERROR("rrdtool: `UpdateThreads' must "
+            "be greater than 0.");
+      return 1;
+    }
+    workers_num = (size_t)tmp;
+  } else if (strcasecmp("UpdateBatchSize", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `UpdateBatchSize' must "
+                      "be greater than 0.\n");
+      ERROR("rrdtool: `UpdateBatchSize' must "
+            "be greater than 0.");
+      return 1;
+    }
+    update_batch_size = (size_t)tmp;
+  } else if (strcasecmp("CreateThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `CreateThreads' must "
+                      "be greater than 0.\n");
+      ERROR("rrdtool: `CreateThreads' must "
+            "be greater than 0.");
+      return 1;
+    }
+    rrdcreate_config.async_threads = tmp;
+  } else if (strcasecmp("ReportStats", key) == 0) {
+    report_stats = IS_TRUE(value);
   } else {
     return -1;
   }
   return 0;
 } /* int rrd_config */
 
+static void rrd_stats_submit(char const *type, char const *type_instance,
+                             gauge_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = value};
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "rrdtool", sizeof(vl.plugin));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* void rrd_stats_submit */
+
+static int rrd_stats_read(void) {
+  size_t queue_length = 0;
+  cdtime_t latency_sum = 0;
+  uint64_t latency_num = 0;
+
+  for (size_t i = 0; i < workers_num; i++) {
+    rrd_worker_t *w = workers + i;
+
+    pthread_mutex_lock(&w->lock);
+    queue_length += w->queue_length;
+    latency_sum += w->latency_sum;
+    latency_num += w->latency_num;
+    w->latency_sum = 0;
+    w->latency_num = 0;
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  rrd_stats_submit("queue_length", NULL, (gauge_t)queue_length);
+  /* Files waiting to be created with CreateFilesAsync. */
+  rrd_stats_submit("queue_length", "create", (gauge_t)cu_rrd_create_pending());
+  /* Average time spent in a single rrd_update call. */
+  rrd_stats_submit("latency", "update",
+                   (latency_num > 0)
+                       ? CDTIME_T_TO_DOUBLE(latency_sum) / (double)latency_num
+                       : NAN);
+
+  return 0;
+} /* int rrd_stats_read */
+
 static int rrd_shutdown(void) {
   pthread_mutex_lock(&cache_lock);
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
-  pthread_mutex_lock(&queue_lock);
-  do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
-
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
-    INFO("rrdtool plugin: Shutting down the queue thread. "
-         "This may take a while.");
-  } else if (queue_thread_running != 0) {
-    INFO("rrdtool plugin: Shutting down the queue thread.");
+  if (workers == NULL) {
+    rrd_cache_destroy();
+    return 0;
+  }
+
+  bool busy = false;
+  for (size_t i = 0; i < workers_num; i++) {
+    rrd_worker_t *w = workers + i;
+
+    pthread_mutex_lock(&w->lock);
+    do_shutdown = 1;
+    if ((w->queue_head != NULL) || (w->flushq_head != NULL))
+      busy = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  if (busy) {
+    INFO("rrdtool plugin: Shutting down the queue %s. "
+         "This may take a while.",
+         (workers_num == 1) ? "thread" : "threads");
+  } else {
+    INFO("rrdtool plugin: Shutting down the queue %s.",
+         (workers_num == 1) ? "thread" : "threads");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; i < workers_num; i++) {
+    rrd_worker_t *w = workers + i;
+
+    if (!w->thread_running)
+      continue;
+
+    pthread_join(w->thread, NULL);
+    w->thread_running = false;
+    DEBUG("rrdtool plugin: queue thread #%" PRIsz " exited.", i);
   }
 
   rrd_cache_destroy();
@@ -1025,6 +1199,31 @@ static int rrd_init(void) {
   if (rrdcreate_config.heartbeat <= 0)
     rrdcreate_config.heartbeat = 2 * rrdcreate_config.stepsize;
 
+#if !HAVE_THREADSAFE_LIBRRD
+  if (workers_num > 1)
+    WARNING("rrdtool plugin: librrd is not thread-safe, updates of the %" PRIsz
+            " update threads will be serialized.",
+            workers_num);
+#endif
+
+  workers = calloc(workers_num, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
+    return -1;
+  }
+  for (size_t i = 0; i < workers_num; i++) {
+    workers[i].batch = calloc(update_batch_size, sizeof(*workers[i].batch));
+    if (workers[i].batch == NULL) {
+      ERROR("rrdtool plugin: calloc failed.");
+      for (size_t j = 0; j < i; j++)
+        sfree(workers[j].batch);
+      sfree(workers);
+      return -1;
+    }
+    pthread_mutex_init(&workers[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&workers[i].cond, /* attr = */ NULL);
+  }
+
   /* Set the cache up */
   pthread_mutex_lock(&cache_lock);
 
@@ -1057,13 +1256,18 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  int status = plugin_thread_create(&queue_thread, rrd_queue_thread,
-                                    /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
-    return -1;
+  for (size_t i = 0; i < workers_num; i++) {
+    int status = plugin_thread_create(&workers[i].thread, rrd_queue_thread,
+                                      workers + i, "rrdtool queue");
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      return -1;
+    }
+    workers[i].thread_running = true;
   }
-  queue_thread_running = 1;
+
+  if (report_stats)
+    plugin_register_read("rrdtool", rrd_stats_read);
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
         " heartbeat = %i; rrarows = %i; xff = %lf;",
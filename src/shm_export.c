@@ -0,0 +1,403 @@
+/**
+ * collectd - src/shm_export.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils_cache.h"
+
+#include "collectd/shm_format.h"
+
+#include <sys/mman.h>
+
+#define SE_DEFAULT_FILE LOCALSTATEDIR "/run/" PACKAGE_NAME "-cache"
+
+/*
+ * Private data types
+ */
+/* The snapshot is assembled in these buffers and copied into the mapping in
+ * one go, so the sequence lock is only held for the copy. */
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+} se_buffer_t;
+
+/*
+ * Private variables
+ */
+static const char *config_keys[] = {"File"};
+static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
+
+static char *se_file;
+
+static int se_fd = -1;
+static char *se_map;
+static size_t se_map_size;
+static uint64_t se_sequence;
+
+static se_buffer_t se_entries;
+static se_buffer_t se_values;
+static se_buffer_t se_strings;
+/* Maps a type to the offset of its first data source name in se_strings. The
+ * names of a type are stored consecutively. Rebuilt by every se_read(); the
+ * keys are copies, because plugins can replace and free data sets. */
+static c_avl_tree_t *se_ds_names;
+
+/*
+ * Functions
+ */
+static const char *se_path(void) {
+  return (se_file != NULL) ? se_file : SE_DEFAULT_FILE;
+} /* se_path */
+
+static int se_buffer_append(se_buffer_t *b, void const *data, size_t len) {
+  if ((b->fill + len) > b->size) {
+    size_t size = (b->size > 0) ? (2 * b->size) : 4096;
+    while (size < (b->fill + len))
+      size *= 2;
+    char *tmp = realloc(b->data, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    b->data = tmp;
+    b->size = size;
+  }
+
+  memcpy(b->data + b->fill, data, len);
+  b->fill += len;
+  return 0;
+} /* se_buffer_append */
+
+/* Appends a null-terminated string to the string table and returns its
+ * offset, or zero on error. Offset zero is the empty string, which is never
+ * looked up. */
+static uint32_t se_string_add(char const *str) {
+  size_t offset = se_strings.fill;
+  if ((offset + strlen(str) + 1) > UINT32_MAX)
+    return 0;
+  if (se_buffer_append(&se_strings, str, strlen(str) + 1) != 0)
+    return 0;
+  return (uint32_t)offset;
+} /* se_string_add */
+
+static uint32_t se_ds_names_add(data_set_t const *ds) {
+  void *value = NULL;
+  if (c_avl_get(se_ds_names, ds->type, &value) == 0)
+    return (uint32_t)(uintptr_t)value;
+
+  uint32_t first = 0;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    uint32_t offset = se_string_add(ds->ds[i].name);
+    if (offset == 0)
+      return 0;
+    if (i == 0)
+      first = offset;
+  }
+
+  char *type = strdup(ds->type);
+  if (type == NULL)
+    return 0;
+  if (c_avl_insert(se_ds_names, type, (void *)(uintptr_t)first) != 0) {
+    sfree(type);
+    return 0;
+  }
+  return first;
+} /* se_ds_names_add */
+
+static void se_reset(void) {
+  void *key;
+  void *value;
+
+  se_entries.fill = 0;
+  se_values.fill = 0;
+  se_strings.fill = 0;
+  se_buffer_append(&se_strings, "", 1);
+
+  while (c_avl_pick(se_ds_names, &key, &value) == 0)
+    sfree(key);
+} /* se_reset */
+
+static int se_add_entry(uc_iter_t *iter, char const *name) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char *host;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+
+  sstrncpy(buffer, name, sizeof(buffer));
+  if (parse_identifier(buffer, &host, &plugin, &plugin_instance, &type,
+                       &type_instance, NULL) != 0)
+    return EINVAL;
+
+  data_set_t const *ds = plugin_get_ds(type);
+  if (ds == NULL)
+    return ENOENT;
+
+  value_t *values = NULL;
+  gauge_t *rates = NULL;
+  size_t values_num = 0;
+  size_t rates_num = 0;
+  cdtime_t time = 0;
+  cdtime_t interval = 0;
+  if ((uc_iterator_get_values(iter, &values, &values_num) != 0) ||
+      (uc_iterator_get_rates(iter, &rates, &rates_num) != 0) ||
+      (uc_iterator_get_time(iter, &time) != 0) ||
+      (uc_iterator_get_interval(iter, &interval) != 0)) {
+    sfree(values);
+    sfree(rates);
+    return ENOMEM;
+  }
+
+  if ((values_num != ds->ds_num) || (rates_num != ds->ds_num)) {
+    sfree(values);
+    sfree(rates);
+    return EINVAL;
+  }
+
+  int status = 0;
+  lcc_shm_entry_t e = {
+      .name_offset = se_string_add(name),
+      .values_num = (uint32_t)values_num,
+      .values_index = se_values.fill / sizeof(lcc_shm_value_t),
+      .time = CDTIME_T_TO_DOUBLE(time),
+      .interval = CDTIME_T_TO_DOUBLE(interval),
+  };
+  uint32_t ds_name = se_ds_names_add(ds);
+  if ((e.name_offset == 0) || (ds_name == 0))
+    status = ENOMEM;
+
+  for (size_t i = 0; (status == 0) && (i < values_num); i++) {
+    lcc_shm_value_t v = {
+        .rate = rates[i],
+        .name_offset = ds_name,
+        .type = (uint32_t)ds->ds[i].type,
+    };
+    memcpy(&v.raw, &values[i], sizeof(v.raw));
+    ds_name += (uint32_t)strlen(ds->ds[i].name) + 1;
+
+    status = se_buffer_append(&se_values, &v, sizeof(v));
+  }
+  sfree(values);
+  sfree(rates);
+
+  if (status == 0)
+    status = se_buffer_append(&se_entries, &e, sizeof(e));
+  return status;
+} /* se_add_entry */
+
+/* Grows the file and the mapping to at least `size' bytes. The file never
+ * shrinks, so readers only have to map it again when it has grown. */
+static int se_map_grow(size_t size) {
+  if (size <= se_map_size)
+    return 0;
+
+  size_t new_size = (se_map_size > 0) ? (2 * se_map_size) : 4096;
+  while (new_size < size)
+    new_size *= 2;
+
+  if (ftruncate(se_fd, (off_t)new_size) != 0) {
+    ERROR("shm_export plugin: ftruncate(\"%s\") failed: %s", se_path(),
+          STRERRNO);
+    return -1;
+  }
+
+  void *map =
+      mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, se_fd, 0);
+  if (map == MAP_FAILED) {
+    ERROR("shm_export plugin: mmap(\"%s\") failed: %s", se_path(), STRERRNO);
+    return -1;
+  }
+
+  if (se_map != NULL)
+    munmap(se_map, se_map_size);
+  se_map = map;
+  se_map_size = new_size;
+  return 0;
+} /* se_map_grow */
+
+/* Copies the assembled snapshot into the mapping. The sequence number is odd
+ * while the copy is in progress, see shm_format.h. */
+static int se_publish(cdtime_t now) {
+  uint64_t entries_offset = sizeof(lcc_shm_header_t);
+  uint64_t values_offset = entries_offset + se_entries.fill;
+  uint64_t strings_offset = values_offset + se_values.fill;
+  uint64_t size = strings_offset + se_strings.fill;
+
+  if (se_map_grow((size_t)size) != 0)
+    return -1;
+
+  lcc_shm_header_t *hdr = (lcc_shm_header_t *)se_map;
+  __atomic_store_n(&hdr->sequence, se_sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(se_map + entries_offset, se_entries.data, se_entries.fill);
+  memcpy(se_map + values_offset, se_values.data, se_values.fill);
+  memcpy(se_map + strings_offset, se_strings.data, se_strings.fill);
+  hdr->size = size;
+  hdr->time = CDTIME_T_TO_DOUBLE(now);
+  hdr->entries_num = se_entries.fill / sizeof(lcc_shm_entry_t);
+  hdr->entries_offset = entries_offset;
+  hdr->values_offset = values_offset;
+  hdr->strings_offset = strings_offset;
+
+  se_sequence += 2;
+  __atomic_store_n(&hdr->sequence, se_sequence, __ATOMIC_RELEASE);
+  return 0;
+} /* se_publish */
+
+static int se_read(void) {
+  uc_iter_t *iter = uc_get_iterator();
+  if (iter == NULL) {
+    ERROR("shm_export plugin: uc_get_iterator failed.");
+    return -1;
+  }
+
+  se_reset();
+
+  char *name;
+  int status = 0;
+  while (uc_iterator_next(iter, &name) == 0) {
+    int r = se_add_entry(iter, name);
+    if (r == ENOMEM) {
+      status = r;
+      break;
+    } else if (r != 0) {
+      DEBUG("shm_export plugin: Skipping \"%s\".", name);
+    }
+  }
+  uc_iterator_destroy(iter);
+
+  if (status != 0) {
+    ERROR("shm_export plugin: Assembling the snapshot failed.");
+    return -1;
+  }
+
+  return se_publish(cdtime());
+} /* se_read */
+
+static int se_config(const char *key, const char *val) {
+  if (strcasecmp(key, "File") == 0) {
+    char *new_file = strdup(val);
+    if (new_file == NULL)
+      return 1;
+
+    sfree(se_file);
+    se_file = new_file;
+  } else {
+    return -1;
+  }
+
+  return 0;
+} /* se_config */
+
+/* Creates the file under a temporary name and renames it into place, so
+ * readers never see it without a valid header. */
+static int se_init(void) {
+  if (se_fd >= 0)
+    return 0;
+
+  se_ds_names = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (se_ds_names == NULL) {
+    ERROR("shm_export plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  char tmp[PATH_MAX];
+  ssnprintf(tmp, sizeof(tmp), "%s.tmp", se_path());
+
+  se_fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (se_fd < 0) {
+    ERROR("shm_export plugin: open(\"%s\") failed: %s", tmp, STRERRNO);
+    return -1;
+  }
+
+  if (se_map_grow(sizeof(lcc_shm_header_t)) != 0) {
+    close(se_fd);
+    se_fd = -1;
+    unlink(tmp);
+    return -1;
+  }
+
+  lcc_shm_header_t *hdr = (lcc_shm_header_t *)se_map;
+  *hdr = (lcc_shm_header_t){
+      .magic = LCC_SHM_MAGIC,
+      .version = LCC_SHM_VERSION,
+      .size = sizeof(*hdr),
+      .entries_offset = sizeof(*hdr),
+      .values_offset = sizeof(*hdr),
+      .strings_offset = sizeof(*hdr),
+  };
+
+  if (rename(tmp, se_path()) != 0) {
+    ERROR("shm_export plugin: rename(\"%s\", \"%s\") failed: %s", tmp,
+          se_path(), STRERRNO);
+    munmap(se_map, se_map_size);
+    se_map = NULL;
+    se_map_size = 0;
+    close(se_fd);
+    se_fd = -1;
+    unlink(tmp);
+    return -1;
+  }
+
+  return 0;
+} /* se_init */
+
+static int se_shutdown(void) {
+  if (se_fd >= 0) {
+    if (unlink(se_path()) != 0)
+      NOTICE("shm_export plugin: unlink(\"%s\") failed: %s", se_path(),
+             STRERRNO);
+    close(se_fd);
+    se_fd = -1;
+  }
+
+  if (se_map != NULL)
+    munmap(se_map, se_map_size);
+  se_map = NULL;
+  se_map_size = 0;
+
+  if (se_ds_names != NULL) {
+    se_reset();
+    c_avl_destroy(se_ds_names);
+    se_ds_names = NULL;
+  }
+
+  sfree(se_entries.data);
+  sfree(se_values.data);
+  sfree(se_strings.data);
+  se_entries = se_values = se_strings = (se_buffer_t){0};
+  sfree(se_file);
+  return 0;
+} /* se_shutdown */
+
+void module_register(void) {
+  plugin_register_config("shm_export", se_config, config_keys,
+                         config_keys_num);
+  plugin_register_init("shm_export", se_init);
+  plugin_register_read("shm_export", se_read);
+  plugin_register_shutdown("shm_export", se_shutdown);
+} /* void module_register */
@@ -63,8 +63,9 @@ struct nvme_admin_cmd {
 
 #define NVME_IOCTL_ADMIN_CMD _IOWR('N', 0x41, struct nvme_admin_cmd)
 
-static const char *config_keys[] = {"Disk", "IgnoreSelected", "IgnoreSleepMode",
-                                    "UseSerial"};
+static const char *config_keys[] = {
+    "Disk",    "IgnoreSelected", "IgnoreSleepMode", "UseSerial",
+    "Threads", "PollInterval",   "Timeout"};
 
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -72,6 +73,65 @@ static ignorelist_t *ignorelist, *ignorelist_by_serial;
 static int ignore_sleep_mode;
 static int use_serial;
 static int invert_ignorelist;
+static int smart_threads_num;
+static cdtime_t smart_poll_interval;
+static cdtime_t smart_timeout;
+
+/* One value list read from a disk. */
+typedef struct {
+  char type[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+  gauge_t values[4];
+  size_t values_num;
+} smart_value_t;
+
+typedef struct {
+  smart_value_t *values;
+  size_t values_num;
+  size_t values_size;
+} smart_cache_t;
+
+/* Per-disk state. The values read by the last poll are dispatched again by
+ * every read until the disk is due to be polled again. While "queued" or
+ * "busy" is set, "dev" and "name" are used by a worker thread and must not be
+ * changed. */
+typedef struct smart_disk_s {
+  char *dev;
+  char *name;
+  smart_cache_t cache;
+  cdtime_t next_poll;
+  bool queued;
+  bool busy;
+  bool stalled;
+  bool seen;
+  struct smart_disk_s *next;
+} smart_disk_t;
+
+static smart_disk_t *disks;
+static pthread_mutex_t disks_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *workers;
+static size_t workers_num;
+static bool workers_shutdown;
+
+/* While a disk is polled, the values are stored in the smart_cache_t this key
+ * points to instead of being dispatched. */
+static pthread_key_t smart_cache_key;
+static bool smart_cache_key_created;
+
+static int smart_config_time(const char *key, const char *value,
+                             cdtime_t *ret) {
+  char *endptr = NULL;
+  errno = 0;
+  double d = strtod(value, &endptr);
+  if ((errno != 0) || (endptr == value) || (d < 0.0)) {
+    ERROR(PLUGIN_NAME ": Invalid value for %s: \"%s\"", key, value);
+    return -1;
+  }
+  *ret = DOUBLE_TO_CDTIME_T(d);
+  return 0;
+}
 
 static int smart_config(const char *key, const char *value) {
   if (ignorelist == NULL)
@@ -92,6 +152,17 @@ static int smart_config(const char *key, const char *value) {
   } else if (strcasecmp("UseSerial", key) == 0) {
     if (IS_TRUE(value))
       use_serial = 1;
+  } else if (strcasecmp("Threads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR(PLUGIN_NAME ": Invalid value for Threads: \"%s\"", value);
+      return -1;
+    }
+    smart_threads_num = tmp;
+  } else if (strcasecmp("PollInterval", key) == 0) {
+    return smart_config_time(key, value, &smart_poll_interval);
+  } else if (strcasecmp("Timeout", key) == 0) {
+    return smart_config_time(key, value, &smart_timeout);
   } else {
     return -1;
   }
@@ -162,8 +233,62 @@ static int create_ignorelist_by_serial(ignorelist_t *il) {
   return 0;
 }
 
+/* Stores a value list in the cache of the disk this thread is polling.
+ * Returns false if the values have to be dispatched right away. */
+static bool smart_store(const char *type, const char *type_inst,
+                        gauge_t const *values, size_t values_num) {
+  if (!smart_cache_key_created)
+    return false;
+
+  smart_cache_t *c = pthread_getspecific(smart_cache_key);
+  if (c == NULL)
+    return false;
+
+  if (c->values_num == c->values_size) {
+    size_t size = (c->values_size == 0) ? 32 : 2 * c->values_size;
+    smart_value_t *tmp = realloc(c->values, size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR(PLUGIN_NAME ": realloc failed.");
+      return true;
+    }
+    c->values = tmp;
+    c->values_size = size;
+  }
+
+  smart_value_t *v = c->values + c->values_num;
+  sstrncpy(v->type, type, sizeof(v->type));
+  sstrncpy(v->type_instance, type_inst, sizeof(v->type_instance));
+  memcpy(v->values, values, values_num * sizeof(*values));
+  v->values_num = values_num;
+  c->values_num++;
+  return true;
+}
+
+static void smart_cache_dispatch(smart_cache_t const *c, char const *name) {
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[STATIC_ARRAY_SIZE(((smart_value_t *)0)->values)];
+
+  vl.values = values;
+  sstrncpy(vl.plugin, "smart", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, name, sizeof(vl.plugin_instance));
+
+  for (size_t i = 0; i < c->values_num; i++) {
+    smart_value_t const *v = c->values + i;
+
+    for (size_t j = 0; j < v->values_num; j++)
+      values[j].gauge = v->values[j];
+    vl.values_len = v->values_num;
+    sstrncpy(vl.type, v->type, sizeof(vl.type));
+    sstrncpy(vl.type_instance, v->type_instance, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+}
+
 static void smart_submit(const char *dev, const char *type,
                          const char *type_inst, double value) {
+  if (smart_store(type, type_inst, &(gauge_t){value}, 1))
+    return;
+
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &(value_t){.gauge = value};
@@ -182,22 +307,29 @@ static void handle_attribute(SkDisk *d, const SkSmartAttributeParsedData *a,
   if (!a->current_value_valid || !a->worst_value_valid)
     return;
 
-  value_list_t vl = VALUE_LIST_INIT;
-  value_t values[] = {
-      {.gauge = a->current_value},
-      {.gauge = a->worst_value},
-      {.gauge = a->threshold_valid ? a->threshold : 0},
-      {.gauge = a->pretty_value},
+  gauge_t const gauges[] = {
+      a->current_value,
+      a->worst_value,
+      a->threshold_valid ? a->threshold : 0,
+      a->pretty_value,
   };
 
-  vl.values = values;
-  vl.values_len = STATIC_ARRAY_SIZE(values);
-  sstrncpy(vl.plugin, "smart", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, name, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, "smart_attribute", sizeof(vl.type));
-  sstrncpy(vl.type_instance, a->name, sizeof(vl.type_instance));
-
-  plugin_dispatch_values(&vl);
+  if (!smart_store("smart_attribute", a->name, gauges,
+                   STATIC_ARRAY_SIZE(gauges))) {
+    value_list_t vl = VALUE_LIST_INIT;
+    value_t values[STATIC_ARRAY_SIZE(gauges)];
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(gauges); i++)
+      values[i].gauge = gauges[i];
+
+    vl.values = values;
+    vl.values_len = STATIC_ARRAY_SIZE(values);
+    sstrncpy(vl.plugin, "smart", sizeof(vl.plugin));
+    sstrncpy(vl.plugin_instance, name, sizeof(vl.plugin_instance));
+    sstrncpy(vl.type, "smart_attribute", sizeof(vl.type));
+    sstrncpy(vl.type_instance, a->name, sizeof(vl.type_instance));
+
+    plugin_dispatch_values(&vl);
+  }
 
   if (a->threshold_valid && a->current_value <= a->threshold) {
     notification_t notif = {NOTIF_WARNING,     cdtime(), "",  "", "smart", "",
@@ -543,32 +675,38 @@ static void smart_read_sata_disk(SkDisk *d, char const *name) {
   }
 }
 
-static void smart_handle_disk(const char *dev, const char *serial) {
-  SkDisk *d = NULL;
+/* Returns the name the disk is reported as, or NULL if it is ignored. */
+static const char *smart_disk_name(const char *dev, const char *serial) {
   const char *name;
-  int err;
 
   if (use_serial && serial) {
     name = serial;
   } else {
     name = strrchr(dev, '/');
     if (!name)
-      return;
+      return NULL;
     name++;
   }
 
   if (use_serial) {
     if (ignorelist_match(ignorelist_by_serial, name) != 0) {
       DEBUG(PLUGIN_NAME ": ignoring %s. Name = %s", dev, name);
-      return;
+      return NULL;
     }
   } else {
     if (ignorelist_match(ignorelist, name) != 0) {
       DEBUG(PLUGIN_NAME ": ignoring %s. Name = %s", dev, name);
-      return;
+      return NULL;
     }
   }
 
+  return name;
+}
+
+static void smart_handle_disk(const char *dev, const char *name) {
+  SkDisk *d = NULL;
+  int err;
+
   DEBUG(PLUGIN_NAME ": checking SMART status of %s.", dev);
 
   if (strstr(dev, "nvme")) {
@@ -601,11 +739,152 @@ static void smart_handle_disk(const char *dev, const char *serial) {
   }
 }
 
+static void smart_disk_free(smart_disk_t *disk) {
+  if (disk == NULL)
+    return;
+
+  sfree(disk->cache.values);
+  sfree(disk->dev);
+  sfree(disk->name);
+  sfree(disk);
+}
+
+/* Polls a disk and replaces its cached values. Must be called without holding
+ * "disks_lock". */
+static void smart_disk_poll(smart_disk_t *disk) {
+  smart_cache_t cache = {0};
+
+  pthread_setspecific(smart_cache_key, &cache);
+  smart_handle_disk(disk->dev, disk->name);
+  pthread_setspecific(smart_cache_key, NULL);
+
+  pthread_mutex_lock(&disks_lock);
+  if (disk->stalled)
+    INFO(PLUGIN_NAME ": polling %s completed.", disk->name);
+  sfree(disk->cache.values);
+  disk->cache = cache;
+  disk->busy = false;
+  disk->stalled = false;
+  pthread_cond_broadcast(&done_cond);
+  pthread_mutex_unlock(&disks_lock);
+}
+
+static void *smart_worker(void *arg) {
+  pthread_mutex_lock(&disks_lock);
+  while (!workers_shutdown) {
+    smart_disk_t *disk = disks;
+    while ((disk != NULL) && !disk->queued)
+      disk = disk->next;
+
+    if (disk == NULL) {
+      pthread_cond_wait(&work_cond, &disks_lock);
+      continue;
+    }
+
+    disk->queued = false;
+    disk->busy = true;
+    pthread_mutex_unlock(&disks_lock);
+
+    smart_disk_poll(disk);
+
+    pthread_mutex_lock(&disks_lock);
+  }
+  pthread_mutex_unlock(&disks_lock);
+
+  return NULL;
+}
+
+/* Adds the disk to the list of disks if necessary and marks it as present.
+ * Must be called with "disks_lock" held. */
+static void smart_disk_update(const char *dev, const char *name) {
+  smart_disk_t *disk = disks;
+  while ((disk != NULL) && (strcmp(disk->name, name) != 0))
+    disk = disk->next;
+
+  if (disk == NULL) {
+    disk = calloc(1, sizeof(*disk));
+    if (disk == NULL) {
+      ERROR(PLUGIN_NAME ": calloc failed.");
+      return;
+    }
+    disk->dev = strdup(dev);
+    disk->name = strdup(name);
+    if ((disk->dev == NULL) || (disk->name == NULL)) {
+      ERROR(PLUGIN_NAME ": strdup failed.");
+      smart_disk_free(disk);
+      return;
+    }
+    disk->next = disks;
+    disks = disk;
+  } else if (!disk->queued && !disk->busy && (strcmp(disk->dev, dev) != 0)) {
+    char *tmp = strdup(dev);
+    if (tmp != NULL) {
+      sfree(disk->dev);
+      disk->dev = tmp;
+    }
+  }
+
+  disk->seen = true;
+}
+
+/* Removes the disks that have disappeared. Must be called with "disks_lock"
+ * held. */
+static void smart_disk_prune(void) {
+  smart_disk_t **prev = &disks;
+  while (*prev != NULL) {
+    smart_disk_t *disk = *prev;
+    if (disk->seen || disk->queued || disk->busy) {
+      disk->seen = false;
+      prev = &disk->next;
+      continue;
+    }
+
+    *prev = disk->next;
+    smart_disk_free(disk);
+  }
+}
+
+/* Waits for the polls started by the current read to finish, for at most
+ * "smart_timeout". Must be called with "disks_lock" held. */
+static void smart_wait(cdtime_t start) {
+  cdtime_t timeout = smart_timeout;
+  if (timeout == 0)
+    timeout = plugin_get_interval();
+  struct timespec deadline = CDTIME_T_TO_TIMESPEC(start + timeout);
+
+  while (true) {
+    bool pending = false;
+    for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+      if ((disk->queued || disk->busy) && !disk->stalled) {
+        pending = true;
+        break;
+      }
+    }
+    if (!pending)
+      break;
+
+    if (pthread_cond_timedwait(&done_cond, &disks_lock, &deadline) ==
+        ETIMEDOUT)
+      break;
+  }
+
+  for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+    if ((disk->busy || disk->queued) && !disk->stalled) {
+      WARNING(PLUGIN_NAME ": polling %s did not complete within %.3f "
+                          "seconds. Its values are not dispatched until it "
+                          "does.",
+              disk->name, CDTIME_T_TO_DOUBLE(timeout));
+      disk->stalled = true;
+    }
+  }
+}
+
 static int smart_read(void) {
   struct udev *handle_udev;
   struct udev_enumerate *enumerate;
   struct udev_list_entry *devices, *dev_list_entry;
   struct udev_device *dev;
+  cdtime_t now = cdtime();
 
   /* Use udev to get a list of disks */
   handle_udev = udev_new();
@@ -631,17 +910,54 @@ static int smart_read(void) {
     ERROR(PLUGIN_NAME ": udev returned an empty list devices");
     return -1;
   }
+
+  pthread_mutex_lock(&disks_lock);
   udev_list_entry_foreach(dev_list_entry, devices) {
-    const char *path, *devpath, *serial;
+    const char *path, *devpath, *serial, *name;
     path = udev_list_entry_get_name(dev_list_entry);
     dev = udev_device_new_from_syspath(handle_udev, path);
     devpath = udev_device_get_devnode(dev);
     serial = udev_device_get_property_value(dev, "ID_SERIAL_SHORT");
 
-    /* Query status with libatasmart */
-    smart_handle_disk(devpath, serial);
+    name = smart_disk_name(devpath, serial);
+    if (name != NULL)
+      smart_disk_update(devpath, name);
     udev_device_unref(dev);
   }
+  smart_disk_prune();
+
+  bool queued = false;
+  for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+    if (disk->queued || disk->busy || (now < disk->next_poll))
+      continue;
+
+    disk->next_poll = now + smart_poll_interval;
+    disk->queued = true;
+    queued = true;
+  }
+
+  if (workers_num == 0) {
+    /* Poll the disks one after the other in the read thread. */
+    for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+      if (!disk->queued)
+        continue;
+
+      disk->queued = false;
+      disk->busy = true;
+      pthread_mutex_unlock(&disks_lock);
+      smart_disk_poll(disk);
+      pthread_mutex_lock(&disks_lock);
+    }
+  } else if (queued) {
+    pthread_cond_broadcast(&work_cond);
+    smart_wait(now);
+  }
+
+  for (smart_disk_t *disk = disks; disk != NULL; disk = disk->next) {
+    if (!disk->stalled)
+      smart_cache_dispatch(&disk->cache, disk->name);
+  }
+  pthread_mutex_unlock(&disks_lock);
 
   udev_enumerate_unref(enumerate);
   udev_unref(handle_udev);
@@ -674,11 +990,62 @@ static int smart_init(void) {
               "running \"setcap cap_sys_rawio=ep\" on the collectd binary.");
   }
 #endif
+
+  err = pthread_key_create(&smart_cache_key, NULL);
+  if (err != 0) {
+    ERROR(PLUGIN_NAME ": pthread_key_create failed: %s", STRERROR(err));
+    return -1;
+  }
+  smart_cache_key_created = true;
+
+  if (smart_threads_num > 0) {
+    workers = calloc((size_t)smart_threads_num, sizeof(*workers));
+    if (workers == NULL) {
+      ERROR(PLUGIN_NAME ": calloc failed.");
+      return -1;
+    }
+  }
+  for (int i = 0; i < smart_threads_num; i++) {
+    err = plugin_thread_create(&workers[workers_num], smart_worker, NULL,
+                               "smart");
+    if (err != 0) {
+      ERROR(PLUGIN_NAME ": plugin_thread_create failed: %s", STRERROR(err));
+      break;
+    }
+    workers_num++;
+  }
+
   return 0;
 } /* int smart_init */
 
+static int smart_shutdown(void) {
+  pthread_mutex_lock(&disks_lock);
+  workers_shutdown = true;
+  pthread_cond_broadcast(&work_cond);
+  pthread_mutex_unlock(&disks_lock);
+
+  for (size_t i = 0; i < workers_num; i++)
+    pthread_join(workers[i], NULL);
+  sfree(workers);
+  workers_num = 0;
+
+  while (disks != NULL) {
+    smart_disk_t *next = disks->next;
+    smart_disk_free(disks);
+    disks = next;
+  }
+
+  if (smart_cache_key_created) {
+    pthread_key_delete(smart_cache_key);
+    smart_cache_key_created = false;
+  }
+
+  return 0;
+} /* int smart_shutdown */
+
 void module_register(void) {
   plugin_register_config("smart", smart_config, config_keys, config_keys_num);
   plugin_register_init("smart", smart_init);
   plugin_register_read("smart", smart_read);
+  plugin_register_shutdown("smart", smart_shutdown);
 } /* void module_register */
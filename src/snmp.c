@@ -29,12 +29,14 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils_batch.h"
 #include "utils_complain.h"
 
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
 
 #include <fnmatch.h>
+#include <pthread.h>
 
 /* SHA512 plus a trailing nul */
 #define MAX_DIGEST_NAME_LEN 7
@@ -75,6 +77,7 @@ struct data_definition_s {
   size_t ignores_len;
   bool invert_match;
   bool count;
+  cdtime_t instance_cache_timeout;
 };
 typedef struct data_definition_s data_definition_t;
 
@@ -102,8 +105,28 @@ struct host_definition_s {
   void *sess_handle;
   c_complain_t complaint;
   data_definition_t **data_list;
+  /* One entry per element of data_list. */
+  struct csnmp_data_state_s *data_state;
   int data_list_len;
   int bulk_size;
+  cdtime_t interval;
+
+  /* Requests sent and timed out, reported with `ReportPollStats'. */
+  uint64_t stats_requests;
+  uint64_t stats_timeouts;
+
+  /* State of the asynchronous engine. Only used by the engine thread the host
+   * has been assigned to. */
+  int max_in_flight;
+  cdtime_t next_poll;
+  cdtime_t poll_start;
+  bool polling;
+  bool reopen;
+  bool closing;
+  int data_next;
+  int in_flight;
+  int poll_success;
+  struct csnmp_walk_s *walks;
 };
 typedef struct host_definition_s host_definition_t;
 
@@ -123,6 +146,18 @@ struct csnmp_cell_value_s {
 };
 typedef struct csnmp_cell_value_s csnmp_cell_value_t;
 
+/* State of one data definition of one host, kept across polls: the GETBULK
+ * size adapted to the agent's responses and the instance columns cached with
+ * `InstanceCacheTimeout'. */
+struct csnmp_data_state_s {
+  int bulk_size;
+  cdtime_t instances_time;
+  csnmp_cell_char_t *type_instance_cells;
+  csnmp_cell_char_t *plugin_instance_cells;
+  csnmp_cell_char_t *hostname_cells;
+};
+typedef struct csnmp_data_state_s csnmp_data_state_t;
+
 typedef enum {
   OID_TYPE_SKIP = 0,
   OID_TYPE_VARIABLE,
@@ -132,15 +167,71 @@ typedef enum {
   OID_TYPE_FILTER,
 } csnmp_oid_type_t;
 
+/* State of reading one data definition from one host. */
+struct csnmp_walk_s {
+  host_definition_t *host;
+  data_definition_t *data;
+  const data_set_t *ds;
+  csnmp_data_state_t *state;
+  bool done;
+
+  /* Table walks only. The instance columns are not requested if
+   * `instances_cached' is set. `max_repetitions' is zero for GETNEXT. */
+  bool instances_cached;
+  long max_repetitions;
+  oid_t *oid_list;
+  csnmp_oid_type_t *oid_list_todo;
+  size_t oid_list_len;
+  size_t *var_idx;
+  size_t oid_list_todo_num;
+
+  /* `value_list_head' and `value_cells_tail' implement a linked list for each
+   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_cell_char_t *type_instance_cells_head;
+  csnmp_cell_char_t *type_instance_cells_tail;
+  csnmp_cell_char_t *plugin_instance_cells_head;
+  csnmp_cell_char_t *plugin_instance_cells_tail;
+  csnmp_cell_char_t *hostname_cells_head;
+  csnmp_cell_char_t *hostname_cells_tail;
+  csnmp_cell_char_t *filter_cells_head;
+  csnmp_cell_char_t *filter_cells_tail;
+  csnmp_cell_value_t **value_cells_head;
+  csnmp_cell_value_t **value_cells_tail;
+
+  struct csnmp_walk_s *next;
+};
+typedef struct csnmp_walk_s csnmp_walk_t;
+
+struct csnmp_engine_s {
+  pthread_t thread;
+  bool thread_started;
+  host_definition_t **hosts;
+  size_t hosts_num;
+};
+typedef struct csnmp_engine_s csnmp_engine_t;
+
 /*
  * Private variables
  */
 static data_definition_t *data_head;
 
+static int async_threads;
+static bool report_poll_stats;
+
+/* Hosts polled by the asynchronous engine, i.e. when `AsyncThreads' is set. */
+static host_definition_t **async_hosts;
+static size_t async_hosts_num;
+static csnmp_engine_t *engines;
+static size_t engines_num;
+static bool engine_stop;
+
 /*
  * Prototypes
  */
 static int csnmp_read_host(user_data_t *ud);
+static void csnmp_walk_destroy(csnmp_walk_t *w);
+static void csnmp_cells_char_free(csnmp_cell_char_t *cell);
 
 /*
  * Private functions
@@ -216,6 +307,14 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
   sfree(hd->context);
   sfree(hd->data_list);
 
+  for (int i = 0; (hd->data_state != NULL) && (i < hd->data_list_len); i++) {
+    csnmp_data_state_t *state = hd->data_state + i;
+    csnmp_cells_char_free(state->type_instance_cells);
+    csnmp_cells_char_free(state->plugin_instance_cells);
+    csnmp_cells_char_free(state->hostname_cells);
+  }
+  sfree(hd->data_state);
+
   sfree(hd);
 } /* }}} void csnmp_host_definition_destroy */
 
@@ -479,6 +578,8 @@ static int csnmp_config_add_data(oconfig_item_t *ci) {
         ignorelist_set_invert(dd->ignorelist, /* invert = */ !t);
     } else if (strcasecmp("Count", option->key) == 0)
       status = cf_util_get_boolean(option, &dd->count);
+    else if (strcasecmp("InstanceCacheTimeout", option->key) == 0)
+      status = cf_util_get_cdtime(option, &dd->instance_cache_timeout);
     else {
       WARNING("snmp plugin: data %s: Option `%s' not allowed here.", dd->name,
               option->key);
@@ -524,6 +625,11 @@ static int csnmp_config_add_data(oconfig_item_t *ci) {
                 "set to `false'.",
                 dd->name);
       }
+      if (dd->instance_cache_timeout > 0) {
+        WARNING("snmp plugin: data %s: Option `InstanceCacheTimeout' is "
+                "ignored when `Table' set to `false'.",
+                dd->name);
+      }
     }
     if (!dd->is_table || dd->count) {
       if (dd->plugin_instance.oid.oid_len > 0) {
@@ -627,6 +733,7 @@ static int csnmp_config_add_host_collect(host_definition_t *host,
                                          oconfig_item_t *ci) {
   data_definition_t *data;
   data_definition_t **data_list;
+  csnmp_data_state_t *data_state;
   int data_list_len;
 
   if (ci->values_num < 1) {
@@ -647,6 +754,11 @@ static int csnmp_config_add_host_collect(host_definition_t *host,
     return -1;
   host->data_list = data_list;
 
+  data_state = realloc(host->data_state, sizeof(*data_state) * data_list_len);
+  if (data_state == NULL)
+    return -1;
+  host->data_state = data_state;
+
   for (int i = 0; i < ci->values_num; i++) {
     for (data = data_head; data != NULL; data = data->next)
       if (strcasecmp(ci->values[i].value.string, data->name) == 0)
@@ -662,6 +774,8 @@ static int csnmp_config_add_host_collect(host_definition_t *host,
           host->data_list_len, data->name);
 
     host->data_list[host->data_list_len] = data;
+    memset(host->data_state + host->data_list_len, 0,
+           sizeof(*host->data_state));
     host->data_list_len++;
   } /* for (values_num) */
 
@@ -846,6 +960,7 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
   hd->timeout = 0;
   hd->retries = -1;
   hd->bulk_size = 0;
+  hd->max_in_flight = 1;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *option = ci->children + i;
@@ -880,6 +995,8 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &hd->context);
     else if (strcasecmp("BulkSize", option->key) == 0)
       status = cf_util_get_int(option, &hd->bulk_size);
+    else if (strcasecmp("MaxInFlight", option->key) == 0)
+      status = cf_util_get_int(option, &hd->max_in_flight);
     else {
       WARNING(
           "snmp plugin: csnmp_config_add_host: Option `%s' not allowed here.",
@@ -902,6 +1019,12 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = -1;
       break;
     }
+    if (hd->max_in_flight < 1) {
+      WARNING("snmp plugin: `MaxInFlight' must be at least 1 for host `%s'",
+              hd->name);
+      status = -1;
+      break;
+    }
     if (hd->bulk_size > 0 && hd->version < 2) {
       WARNING("snmp plugin: Bulk transfers is only available for SNMP v2 and "
               "later, host '%s' is configured as version '%d'",
@@ -962,6 +1085,22 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
         "= %i }",
         hd->name, hd->address, hd->community, hd->version);
 
+  hd->interval = interval;
+
+  if (async_threads > 0) {
+    host_definition_t **tmp =
+        realloc(async_hosts, (async_hosts_num + 1) * sizeof(*async_hosts));
+    if (tmp == NULL) {
+      ERROR("snmp plugin: realloc failed.");
+      csnmp_host_definition_destroy(hd);
+      return -1;
+    }
+    async_hosts = tmp;
+    async_hosts[async_hosts_num] = hd;
+    async_hosts_num++;
+    return 0;
+  }
+
   ssnprintf(cb_name, sizeof(cb_name), "snmp-%s", hd->name);
 
   status = plugin_register_complex_read(
@@ -981,9 +1120,26 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
 static int csnmp_config(oconfig_item_t *ci) {
   call_snmp_init_once();
 
+  /* The global options decide how the hosts are registered, so handle them
+   * first. */
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    if (strcasecmp("AsyncThreads", child->key) == 0) {
+      if ((cf_util_get_int(child, &async_threads) != 0) ||
+          (async_threads < 0)) {
+        WARNING("snmp plugin: `AsyncThreads' must be a non-negative number.");
+        async_threads = 0;
+      }
+    } else if (strcasecmp("ReportPollStats", child->key) == 0)
+      cf_util_get_boolean(child, &report_poll_stats);
+  }
+
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
-    if (strcasecmp("Data", child->key) == 0)
+    if ((strcasecmp("AsyncThreads", child->key) == 0) ||
+        (strcasecmp("ReportPollStats", child->key) == 0))
+      continue;
+    else if (strcasecmp("Data", child->key) == 0)
       csnmp_config_add_data(child);
     else if (strcasecmp("Host", child->key) == 0)
       csnmp_config_add_host(child);
@@ -1381,6 +1537,8 @@ static int csnmp_dispatch_table(host_definition_t *host,
                                 bool count_values) {
   const data_set_t *ds;
   value_list_t vl = VALUE_LIST_INIT;
+  /* The rows of the table are dispatched together after the loop. */
+  vl_batch_t batch = VL_BATCH_INIT;
 
   csnmp_cell_char_t *type_instance_cell_ptr = type_instance_cells;
   csnmp_cell_char_t *plugin_instance_cell_ptr = plugin_instance_cells;
@@ -1628,7 +1786,7 @@ static int csnmp_dispatch_table(host_definition_t *host,
       for (i = 0; i < data->values_len; i++)
         vl.values[i] = value_cell_ptr[i]->value;
 
-      plugin_dispatch_values(&vl);
+      vl_batch_add(&batch, &vl);
 
       /* prevent leakage of pointer to local variable. */
       vl.values_len = 0;
@@ -1641,6 +1799,9 @@ static int csnmp_dispatch_table(host_definition_t *host,
       value_cell_ptr[0] = value_cell_ptr[0]->next;
   } /* while (have_more) */
 
+  vl_batch_dispatch(&batch);
+  vl_batch_free(&batch);
+
   if (count_values) {
     /* the first `ds' means `data set', the second means `data source' */
     int type = ds->ds[0].type;
@@ -1682,71 +1843,42 @@ static int csnmp_dispatch_table(host_definition_t *host,
   return 0;
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
-
+/* Reading one data definition from a host takes one request for simple
+ * values and a series of GETNEXT / GETBULK requests for tables. The state of
+ * such a walk is kept in a csnmp_walk_t, so that the synchronous read
+ * callbacks and the asynchronous engine can share the code:
+ *
+ *  csnmp_walk_create
+ *  +-> csnmp_walk_request   (repeat until it returns no request)
+ *  !   csnmp_walk_response
+ *  +-> csnmp_walk_finish
+ *  +-> csnmp_walk_destroy
+ */
+static csnmp_walk_t *csnmp_walk_create(host_definition_t *host, /* {{{ */
+                                       data_definition_t *data) {
   const data_set_t *ds;
-
-  size_t oid_list_len = data->values_len;
-
-  if (data->type_instance.oid.oid_len > 0)
-    oid_list_len++;
-
-  if (data->plugin_instance.oid.oid_len > 0)
-    oid_list_len++;
-
-  if (data->host.oid.oid_len > 0)
-    oid_list_len++;
-
-  if (data->filter_oid.oid_len > 0)
-    oid_list_len++;
-
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  csnmp_oid_type_t oid_list_todo[oid_list_len];
-
-  int status;
   size_t i;
 
-  /* `value_list_head' and `value_cells_tail' implement a linked list for each
-   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
-   * list of instance names. This is used to jump gaps in the table. */
-  csnmp_cell_char_t *type_instance_cells_head = NULL;
-  csnmp_cell_char_t *type_instance_cells_tail = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_head = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_tail = NULL;
-  csnmp_cell_char_t *hostname_cells_head = NULL;
-  csnmp_cell_char_t *hostname_cells_tail = NULL;
-  csnmp_cell_char_t *filter_cells_head = NULL;
-  csnmp_cell_char_t *filter_cells_tail = NULL;
-  csnmp_cell_value_t **value_cells_head;
-  csnmp_cell_value_t **value_cells_tail;
-
-  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
+  DEBUG("snmp plugin: csnmp_walk_create (host = %s, data = %s)", host->name,
         data->name);
 
   if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return -1;
+    DEBUG("snmp plugin: csnmp_walk_create: host->sess_handle == NULL");
+    return NULL;
   }
 
   ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
+    return NULL;
   }
 
-  if (data->count) {
+  if (data->is_table && data->count) {
     if (ds->ds_num != 1) {
       ERROR("snmp plugin: DataSet `%s' requires %" PRIsz
             " values, but `Count' option only delivers one",
             data->type, ds->ds_num);
-      return -1;
+      return NULL;
     }
   } else {
     if (ds->ds_num != data->values_len) {
@@ -1754,98 +1886,619 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
             " values, but config talks "
             "about %" PRIsz,
             data->type, ds->ds_num, data->values_len);
-      return -1;
+      return NULL;
     }
   }
   assert(data->values_len > 0);
 
+  csnmp_walk_t *w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    ERROR("snmp plugin: csnmp_walk_create: calloc failed.");
+    return NULL;
+  }
+  w->host = host;
+  w->data = data;
+  w->ds = ds;
+
+  for (i = 0; i < (size_t)host->data_list_len; i++)
+    if (host->data_list[i] == data)
+      w->state = host->data_state + i;
+  assert(w->state != NULL);
+
+  if (!data->is_table)
+    return w;
+
+  /* Use the cached instance columns, if they are recent enough. */
+  if ((data->instance_cache_timeout > 0) && (w->state->instances_time > 0) &&
+      ((cdtime() - w->state->instances_time) < data->instance_cache_timeout))
+    w->instances_cached = true;
+
+  w->oid_list_len = data->values_len;
+
+  if (!w->instances_cached) {
+    if (data->type_instance.oid.oid_len > 0)
+      w->oid_list_len++;
+
+    if (data->plugin_instance.oid.oid_len > 0)
+      w->oid_list_len++;
+
+    if (data->host.oid.oid_len > 0)
+      w->oid_list_len++;
+  }
+
+  if (data->filter_oid.oid_len > 0)
+    w->oid_list_len++;
+
+  /* oid_list holds the last OID returned by the device. We use this in the
+   * GETNEXT request to proceed. oid_list_todo is set to false when an OID has
+   * left its subtree so we don't re-request it again. */
+  w->oid_list = calloc(w->oid_list_len, sizeof(*w->oid_list));
+  w->oid_list_todo = calloc(w->oid_list_len, sizeof(*w->oid_list_todo));
+  w->var_idx = calloc(w->oid_list_len, sizeof(*w->var_idx));
+
+  /* We're going to construct n linked lists, one for each "value".
+   * value_cells_head will contain pointers to the heads of these linked lists,
+   * value_cells_tail will contain pointers to the tail of the lists. */
+  w->value_cells_head = calloc(data->values_len, sizeof(*w->value_cells_head));
+  w->value_cells_tail = calloc(data->values_len, sizeof(*w->value_cells_tail));
+  if ((w->oid_list == NULL) || (w->oid_list_todo == NULL) ||
+      (w->var_idx == NULL) || (w->value_cells_head == NULL) ||
+      (w->value_cells_tail == NULL)) {
+    ERROR("snmp plugin: csnmp_walk_create: calloc failed.");
+    csnmp_walk_destroy(w);
+    return NULL;
+  }
+
   for (i = 0; i < data->values_len; i++)
-    oid_list_todo[i] = OID_TYPE_VARIABLE;
+    w->oid_list_todo[i] = OID_TYPE_VARIABLE;
 
   /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy(oid_list, data->values, data->values_len * sizeof(oid_t));
+  memcpy(w->oid_list, data->values, data->values_len * sizeof(oid_t));
 
-  if (data->type_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->type_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
+  if ((data->type_instance.oid.oid_len > 0) && !w->instances_cached) {
+    memcpy(w->oid_list + i, &data->type_instance.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
     i++;
   }
 
-  if (data->plugin_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
+  if ((data->plugin_instance.oid.oid_len > 0) && !w->instances_cached) {
+    memcpy(w->oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
     i++;
   }
 
-  if (data->host.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->host.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_HOST;
+  if ((data->host.oid.oid_len > 0) && !w->instances_cached) {
+    memcpy(w->oid_list + i, &data->host.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_HOST;
     i++;
   }
 
   if (data->filter_oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->filter_oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_FILTER;
+    memcpy(w->oid_list + i, &data->filter_oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_FILTER;
     i++;
   }
 
-  /* We're going to construct n linked lists, one for each "value".
-   * value_cells_head will contain pointers to the heads of these linked lists,
-   * value_cells_tail will contain pointers to the tail of the lists. */
-  value_cells_head = calloc(data->values_len, sizeof(*value_cells_head));
-  value_cells_tail = calloc(data->values_len, sizeof(*value_cells_tail));
-  if ((value_cells_head == NULL) || (value_cells_tail == NULL)) {
-    ERROR("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree(value_cells_head);
-    sfree(value_cells_tail);
-    return -1;
+  return w;
+} /* }}} csnmp_walk_t *csnmp_walk_create */
+
+static void csnmp_cells_char_free(csnmp_cell_char_t *cell) /* {{{ */
+{
+  while (cell != NULL) {
+    csnmp_cell_char_t *next = cell->next;
+    sfree(cell);
+    cell = next;
   }
+} /* }}} void csnmp_cells_char_free */
 
-  status = 0;
-  while (status == 0) {
-    /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
-    if (host->version > 1 && host->bulk_size > 0) {
-      req = snmp_pdu_create(SNMP_MSG_GETBULK);
-      req->non_repeaters = 0;
-      req->max_repetitions = host->bulk_size;
-    } else {
-      req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+static void csnmp_walk_destroy(csnmp_walk_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return;
+
+  /* Free all allocated variables here */
+  csnmp_cells_char_free(w->type_instance_cells_head);
+  csnmp_cells_char_free(w->plugin_instance_cells_head);
+  csnmp_cells_char_free(w->hostname_cells_head);
+  csnmp_cells_char_free(w->filter_cells_head);
+
+  if (w->value_cells_head != NULL) {
+    for (size_t i = 0; i < w->data->values_len; i++) {
+      while (w->value_cells_head[i] != NULL) {
+        csnmp_cell_value_t *next = w->value_cells_head[i]->next;
+        sfree(w->value_cells_head[i]);
+        w->value_cells_head[i] = next;
+      }
     }
+  }
+
+  sfree(w->value_cells_head);
+  sfree(w->value_cells_tail);
+  sfree(w->oid_list);
+  sfree(w->oid_list_todo);
+  sfree(w->var_idx);
+  sfree(w);
+} /* }}} void csnmp_walk_destroy */
+
+/* Creates the next request of the walk in *ret_req. Sets *ret_req to NULL if
+ * the walk is complete. Returns zero on success, -1 on error. */
+static int csnmp_walk_request(csnmp_walk_t *w, /* {{{ */
+                              struct snmp_pdu **ret_req) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  struct snmp_pdu *req;
+
+  *ret_req = NULL;
+
+  if (!data->is_table) {
+    if (w->done)
+      return 0;
+
+    req = snmp_pdu_create(SNMP_MSG_GET);
     if (req == NULL) {
       ERROR("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
+      return -1;
     }
 
-    size_t oid_list_todo_num = 0;
-    size_t var_idx[oid_list_len];
-    memset(var_idx, 0, sizeof(var_idx));
+    for (size_t i = 0; i < data->values_len; i++)
+      snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
 
-    for (i = 0; i < oid_list_len; i++) {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
-        continue;
-      snmp_add_null_var(req, oid_list[i].oid, oid_list[i].oid_len);
-      var_idx[oid_list_todo_num] = i;
-      oid_list_todo_num++;
+    *ret_req = req;
+    return 0;
+  }
+
+  /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
+  if (host->version > 1 && host->bulk_size > 0) {
+    req = snmp_pdu_create(SNMP_MSG_GETBULK);
+    if (req != NULL)
+      req->non_repeaters = 0;
+  } else {
+    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+  }
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return -1;
+  }
+
+  w->oid_list_todo_num = 0;
+  memset(w->var_idx, 0, w->oid_list_len * sizeof(*w->var_idx));
+
+  for (size_t i = 0; i < w->oid_list_len; i++) {
+    /* Do not rerequest already finished OIDs */
+    if (!w->oid_list_todo[i])
+      continue;
+    snmp_add_null_var(req, w->oid_list[i].oid, w->oid_list[i].oid_len);
+    w->var_idx[w->oid_list_todo_num] = i;
+    w->oid_list_todo_num++;
+  }
+
+  if (w->oid_list_todo_num == 0) {
+    /* The request is still empty - so we are finished */
+    DEBUG("snmp plugin: all variables have left their subtree");
+    snmp_free_pdu(req);
+    w->done = true;
+    return 0;
+  }
+
+  w->max_repetitions = 0;
+  if (req->command == SNMP_MSG_GETBULK) {
+    /* In bulk mode the host will send 'max_repetitions' values per
+       requested variable, so we need to split it per number of variable
+       to stay 'in budget'. The budget starts at `BulkSize' and is adapted
+       by csnmp_walk_bulk_adapt. */
+    if (w->state->bulk_size <= 0)
+      w->state->bulk_size = host->bulk_size;
+    w->max_repetitions = w->state->bulk_size / (long)w->oid_list_todo_num;
+    if (w->max_repetitions < 1)
+      w->max_repetitions = 1;
+    req->max_repetitions = w->max_repetitions;
+  }
+
+  *ret_req = req;
+  return 0;
+} /* }}} int csnmp_walk_request */
+
+/* Handles the response to a simple GET request: dispatches the values. */
+static int csnmp_walk_response_value(csnmp_walk_t *w, /* {{{ */
+                                     struct snmp_pdu *res) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  const data_set_t *ds = w->ds;
+  value_list_t vl = VALUE_LIST_INIT;
+  struct variable_list *vb;
+  size_t i;
+
+  w->done = true;
+
+  vl.values_len = ds->ds_num;
+  vl.values = malloc(sizeof(*vl.values) * vl.values_len);
+  if (vl.values == NULL)
+    return -1;
+  for (i = 0; i < vl.values_len; i++) {
+    if (ds->ds[i].type == DS_TYPE_COUNTER)
+      vl.values[i].counter = 0;
+    else
+      vl.values[i].gauge = NAN;
+  }
+
+  sstrncpy(vl.host, host->name, sizeof(vl.host));
+  sstrncpy(vl.plugin, data->plugin_name, sizeof(vl.plugin));
+  sstrncpy(vl.type, data->type, sizeof(vl.type));
+  if (data->type_instance.value)
+    sstrncpy(vl.type_instance, data->type_instance.value,
+             sizeof(vl.type_instance));
+  if (data->plugin_instance.value)
+    sstrncpy(vl.plugin_instance, data->plugin_instance.value,
+             sizeof(vl.plugin_instance));
+
+  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
+#if COLLECT_DEBUG
+    char buffer[1024];
+    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
+    DEBUG("snmp plugin: Got this variable: %s", buffer);
+#endif /* COLLECT_DEBUG */
+
+    for (i = 0; i < data->values_len; i++)
+      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
+                           vb->name, vb->name_length) == 0)
+        vl.values[i] =
+            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
+                                      data->shift, host->name, data->name);
+  } /* for (res->variables) */
+
+  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
+  plugin_dispatch_values(&vl);
+  sfree(vl.values);
+
+  return 0;
+} /* }}} int csnmp_walk_response_value */
+
+/* Adapts the GETBULK budget of a data definition to the response of the
+ * agent: a response with fewer variables than requested has been truncated to
+ * fit the agent's message size, so the next request asks for no more than
+ * that. After a complete response the budget grows again, up to `BulkSize'.
+ */
+static void csnmp_walk_bulk_adapt(csnmp_walk_t *w, /* {{{ */
+                                  size_t vars_num, bool end_of_mib) {
+  csnmp_data_state_t *state = w->state;
+  int limit = w->host->bulk_size;
+  int todo_num = (int)w->oid_list_todo_num;
+
+  if (w->max_repetitions == 0)
+    return;
+
+  if (vars_num < (size_t)w->max_repetitions * w->oid_list_todo_num) {
+    /* Agents may stop early at the end of the MIB view, too. */
+    if (end_of_mib)
+      return;
+
+    int repetitions = (int)(vars_num / w->oid_list_todo_num);
+    if (repetitions < 1)
+      repetitions = 1;
+    state->bulk_size = repetitions * todo_num;
+    DEBUG("snmp plugin: host %s; data %s: Response truncated, reducing the "
+          "bulk size to %d.",
+          w->host->name, w->data->name, state->bulk_size);
+  } else if (state->bulk_size < limit) {
+    state->bulk_size += state->bulk_size / 4 + todo_num;
+    if (state->bulk_size > limit)
+      state->bulk_size = limit;
+  }
+} /* }}} void csnmp_walk_bulk_adapt */
+
+/* Handles the response to one GETNEXT / GETBULK request of a table walk. The
+ * response is not freed. Returns zero if the walk can continue, -1 on
+ * error. */
+static int csnmp_walk_response(csnmp_walk_t *w, /* {{{ */
+                               struct snmp_pdu *res) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  const data_set_t *ds = w->ds;
+  struct variable_list *vb;
+  size_t i;
+
+  if (!data->is_table)
+    return csnmp_walk_response_value(w, res);
+
+  /* The response would not fit into the agent's message size: repeat the
+   * request with half the repetitions. */
+  if ((res->errstat == SNMP_ERR_TOOBIG) && (w->max_repetitions > 1)) {
+    w->state->bulk_size =
+        (int)(w->max_repetitions / 2 * (long)w->oid_list_todo_num);
+    DEBUG("snmp plugin: host %s; data %s: Response too big, reducing the "
+          "bulk size to %d.",
+          host->name, data->name, w->state->bulk_size);
+    return 0;
+  }
+
+  vb = res->variables;
+  if (vb == NULL)
+    return -1;
+
+  if (res->errstat != SNMP_ERR_NOERROR) {
+    if (res->errindex != 0) {
+      /* Find the OID which caused error */
+      for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
+           vb = vb->next_variable, i++)
+        /* do nothing */;
     }
 
-    if (oid_list_todo_num == 0) {
-      /* The request is still empty - so we are finished */
-      DEBUG("snmp plugin: all variables have left their subtree");
-      snmp_free_pdu(req);
-      status = 0;
-      break;
+    if ((res->errindex == 0) || (vb == NULL)) {
+      ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
+            host->name, data->name, snmp_errstring(res->errstat),
+            res->errstat);
+      return -1;
     }
 
-    if (req->command == SNMP_MSG_GETBULK) {
-      /* In bulk mode the host will send 'max_repetitions' values per
-         requested variable, so we need to split it per number of variable
-         to stay 'in budget' */
-      req->max_repetitions = floor(host->bulk_size / oid_list_todo_num);
+    char oid_buffer[1024] = {0};
+    snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
+                  vb->name_length);
+    NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
+           data->name, oid_buffer, snmp_errstring(res->errstat));
+
+    /* Get value index from todo list and skip OID found */
+    assert(res->errindex <= w->oid_list_todo_num);
+    i = w->var_idx[res->errindex - 1];
+    assert(i < w->oid_list_len);
+    w->oid_list_todo[i] = 0;
+
+    return 0;
+  }
+
+  size_t j;
+  bool end_of_mib = false;
+  for (vb = res->variables, j = 0; (vb != NULL); vb = vb->next_variable, j++) {
+    /* The variables are in the order of the request, repeated once per
+     * GETBULK repetition. Skip the OIDs which have left their subtree. */
+    i = w->var_idx[j % w->oid_list_todo_num];
+    if (!w->oid_list_todo[i])
+      continue;
+
+    if (vb->type == SNMP_ENDOFMIBVIEW)
+      end_of_mib = true;
+
+    /* An instance is configured and the res variable we process is the
+     * instance value */
+    if (w->oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(
+               data->type_instance.oid.oid, data->type_instance.oid.oid_len,
+               vb->name, vb->name_length, data->type_instance.oid.oid_len) !=
+           0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
+      }
+
+      if (csnmp_ignore_instance(cell, data)) {
+        sfree(cell);
+      } else {
+        csnmp_cell_replace_reserved_chars(cell);
+
+        DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
+        csnmp_cells_append(&w->type_instance_cells_head,
+                           &w->type_instance_cells_tail, cell);
+      }
+    } else if (w->oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->plugin_instance.oid.oid,
+                             data->plugin_instance.oid.oid_len, vb->name,
+                             vb->name_length,
+                             data->plugin_instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
+      }
+
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
+      csnmp_cells_append(&w->plugin_instance_cells_head,
+                         &w->plugin_instance_cells_tail, cell);
+    } else if (w->oid_list_todo[i] == OID_TYPE_HOST) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->host.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->host.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
+      }
+
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
+      csnmp_cells_append(&w->hostname_cells_head, &w->hostname_cells_tail,
+                         cell);
+    } else if (w->oid_list_todo[i] == OID_TYPE_FILTER) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->filter_oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->filter_oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
+      }
+
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->filter = `%s';", cell->value);
+      csnmp_cells_append(&w->filter_cells_head, &w->filter_cells_tail, cell);
+    } else /* The variable we are processing is a normal value */
+    {
+      assert(w->oid_list_todo[i] == OID_TYPE_VARIABLE);
+
+      csnmp_cell_value_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      csnmp_oid_init(&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
+      if (ret != 0) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Value probably left its subtree.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise
+       * our table matching algorithm will get confused. */
+      if ((w->value_cells_tail[i] != NULL) &&
+          (csnmp_oid_compare(&suffix, &w->value_cells_tail[i]->suffix) <= 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Suffix is not increasing.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      vt = calloc(1, sizeof(*vt));
+      if (vt == NULL) {
+        ERROR("snmp plugin: calloc failed.");
+        return -1;
+      }
+
+      vt->value = csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
+                                            data->shift, host->name,
+                                            data->name);
+      memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
+      vt->next = NULL;
+
+      if (w->value_cells_tail[i] == NULL)
+        w->value_cells_head[i] = vt;
+      else
+        w->value_cells_tail[i]->next = vt;
+      w->value_cells_tail[i] = vt;
     }
 
-    res = NULL;
+    /* Copy OID to oid_list[i] */
+    memcpy(w->oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
+    w->oid_list[i].oid_len = vb->name_length;
+
+  } /* for (vb = res->variables ...) */
+
+  csnmp_walk_bulk_adapt(w, j, end_of_mib);
+  return 0;
+} /* }}} int csnmp_walk_response */
+
+/* Moves the instance columns of a completed walk into the cache of the data
+ * definition. Incomplete columns are not cached. */
+static void csnmp_walk_cache_instances(csnmp_walk_t *w) /* {{{ */
+{
+  data_definition_t *data = w->data;
+  csnmp_data_state_t *state = w->state;
+
+  if (((data->type_instance.oid.oid_len > 0) &&
+       (w->type_instance_cells_head == NULL)) ||
+      ((data->plugin_instance.oid.oid_len > 0) &&
+       (w->plugin_instance_cells_head == NULL)) ||
+      ((data->host.oid.oid_len > 0) && (w->hostname_cells_head == NULL)))
+    return;
+
+  csnmp_cells_char_free(state->type_instance_cells);
+  csnmp_cells_char_free(state->plugin_instance_cells);
+  csnmp_cells_char_free(state->hostname_cells);
+
+  state->type_instance_cells = w->type_instance_cells_head;
+  state->plugin_instance_cells = w->plugin_instance_cells_head;
+  state->hostname_cells = w->hostname_cells_head;
+  w->type_instance_cells_head = w->type_instance_cells_tail = NULL;
+  w->plugin_instance_cells_head = w->plugin_instance_cells_tail = NULL;
+  w->hostname_cells_head = w->hostname_cells_tail = NULL;
+
+  state->instances_time = cdtime();
+  w->instances_cached = true;
+} /* }}} void csnmp_walk_cache_instances */
+
+/* Dispatches the result of a successful table walk. */
+static void csnmp_walk_finish(csnmp_walk_t *w) /* {{{ */
+{
+  if (!w->data->is_table)
+    return;
+
+  if ((w->data->instance_cache_timeout > 0) && !w->instances_cached)
+    csnmp_walk_cache_instances(w);
+
+  if (w->instances_cached)
+    csnmp_dispatch_table(w->host, w->data, w->state->type_instance_cells,
+                         w->state->plugin_instance_cells,
+                         w->state->hostname_cells, w->filter_cells_head,
+                         w->value_cells_head, w->data->count);
+  else
+    csnmp_dispatch_table(w->host, w->data, w->type_instance_cells_head,
+                         w->plugin_instance_cells_head, w->hostname_cells_head,
+                         w->filter_cells_head, w->value_cells_head,
+                         w->data->count);
+} /* }}} void csnmp_walk_finish */
+
+/* Reads one data definition using the synchronous API. */
+static int csnmp_read_data(host_definition_t *host, /* {{{ */
+                           data_definition_t *data) {
+  csnmp_walk_t *w = csnmp_walk_create(host, data);
+  if (w == NULL)
+    return -1;
+
+  int status = 0;
+  while (status == 0) {
+    struct snmp_pdu *req = NULL;
+    struct snmp_pdu *res = NULL;
+
+    status = csnmp_walk_request(w, &req);
+    if ((status != 0) || (req == NULL))
+      break;
+
+    host->stats_requests++;
     status = snmp_sess_synch_response(host->sess_handle, req, &res);
 
     /* snmp_sess_synch_response always frees our req PDU */
@@ -1854,6 +2507,9 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
     if ((status != STAT_SUCCESS) || (res == NULL)) {
       char *errstr = NULL;
 
+      if (status == STAT_TIMEOUT)
+        host->stats_timeouts++;
+
       snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
 
       c_complain(LOG_ERR, &host->complaint,
@@ -1862,7 +2518,6 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
 
       if (res != NULL)
         snmp_free_pdu(res);
-      res = NULL;
 
       sfree(errstr);
       csnmp_host_close_session(host);
@@ -1871,440 +2526,431 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
       break;
     }
 
-    status = 0;
-    assert(res != NULL);
     c_release(LOG_INFO, &host->complaint,
               "snmp plugin: host %s: snmp_sess_synch_response successful.",
               host->name);
 
-    vb = res->variables;
-    if (vb == NULL) {
-      status = -1;
-      break;
-    }
+    status = csnmp_walk_response(w, res);
+    snmp_free_pdu(res);
+  }
 
-    if (res->errstat != SNMP_ERR_NOERROR) {
-      if (res->errindex != 0) {
-        /* Find the OID which caused error */
-        for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
-             vb = vb->next_variable, i++)
-          /* do nothing */;
-      }
+  if (status == 0)
+    csnmp_walk_finish(w);
 
-      if ((res->errindex == 0) || (vb == NULL)) {
-        ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
-              host->name, data->name, snmp_errstring(res->errstat),
-              res->errstat);
-        status = -1;
-        break;
-      }
+  csnmp_walk_destroy(w);
+  return status;
+} /* }}} int csnmp_read_data */
 
-      char oid_buffer[1024] = {0};
-      snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
-                    vb->name_length);
-      NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
-             data->name, oid_buffer, snmp_errstring(res->errstat));
+/* Dispatches the timing of the last poll and the request counters of a
+ * host, if enabled with the `ReportPollStats' option. */
+static void csnmp_host_submit_stats(host_definition_t *host, /* {{{ */
+                                    cdtime_t duration) {
+  value_list_t vl = VALUE_LIST_INIT;
 
-      /* Get value index from todo list and skip OID found */
-      assert(res->errindex <= oid_list_todo_num);
-      i = var_idx[res->errindex - 1];
-      assert(i < oid_list_len);
-      oid_list_todo[i] = 0;
+  if (!report_poll_stats)
+    return;
 
-      snmp_free_pdu(res);
-      res = NULL;
-      continue;
-    }
+  sstrncpy(vl.host, host->name, sizeof(vl.host));
+  sstrncpy(vl.plugin, "snmp", sizeof(vl.plugin));
+  vl.values_len = 1;
 
-    size_t j;
-    for (vb = res->variables, j = 0; (vb != NULL);
-         vb = vb->next_variable, j++) {
-      i = j;
-      /* If bulk request is active convert value index of the extra value */
-      if (host->version > 1 && host->bulk_size > 0) {
-        i %= oid_list_todo_num;
-      }
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i]) {
-        i++;
-        j++;
-      }
-      if (i >= oid_list_len) {
-        break;
-      }
+  vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(duration)};
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "poll", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
 
-      /* An instance is configured and the res variable we process is the
-       * instance value */
-      if (oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->type_instance.oid.oid,
-                               data->type_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->type_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  vl.values = &(value_t){.derive = (derive_t)host->stats_requests};
+  sstrncpy(vl.type, "total_requests", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "sent", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  vl.values = &(value_t){.derive = (derive_t)host->stats_timeouts};
+  sstrncpy(vl.type_instance, "timeout", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+} /* }}} void csnmp_host_submit_stats */
 
-        if (csnmp_ignore_instance(cell, data)) {
-          sfree(cell);
-        } else {
-          csnmp_cell_replace_reserved_chars(cell);
+static int csnmp_read_host(user_data_t *ud) {
+  host_definition_t *host;
+  int status;
+  int success;
+  int i;
 
-          DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
-          csnmp_cells_append(&type_instance_cells_head,
-                             &type_instance_cells_tail, cell);
-        }
-      } else if (oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->plugin_instance.oid.oid,
-                               data->plugin_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->plugin_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  host = ud->data;
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  if (host->sess_handle == NULL)
+    csnmp_host_open_session(host);
 
-        csnmp_cell_replace_reserved_chars(cell);
+  if (host->sess_handle == NULL)
+    return -1;
 
-        DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
-        csnmp_cells_append(&plugin_instance_cells_head,
-                           &plugin_instance_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_HOST) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->host.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  cdtime_t start = cdtime();
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->host.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  success = 0;
+  for (i = 0; i < host->data_list_len; i++) {
+    data_definition_t *data = host->data_list[i];
 
-        csnmp_cell_replace_reserved_chars(cell);
+    status = csnmp_read_data(host, data);
+    if (status == 0)
+      success++;
+  }
 
-        DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
-        csnmp_cells_append(&hostname_cells_head, &hostname_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_FILTER) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->filter_oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  csnmp_host_submit_stats(host, cdtime() - start);
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->filter_oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  if (success == 0)
+    return -1;
 
-        csnmp_cell_replace_reserved_chars(cell);
+  return 0;
+} /* int csnmp_read_host */
 
-        DEBUG("snmp plugin: il->filter = `%s';", cell->value);
-        csnmp_cells_append(&filter_cells_head, &filter_cells_tail, cell);
-      } else /* The variable we are processing is a normal value */
-      {
-        assert(oid_list_todo[i] == OID_TYPE_VARIABLE);
-
-        csnmp_cell_value_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init(&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
-        if (ret != 0) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Value probably left its subtree.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+/* The asynchronous engine. Instead of one read callback per host, the hosts
+ * are distributed over `AsyncThreads' threads. Each thread keeps the requests
+ * of all its hosts outstanding at the same time and waits for the responses
+ * with select(2). Callgraph:
+ *
+ *  csnmp_engine_thread
+ *  +-> csnmp_poll_start
+ *  !   +-> csnmp_poll_fill   (start up to `MaxInFlight' walks)
+ *  +-> snmp_sess_read2 / snmp_sess_timeout
+ *      +-> csnmp_async_callback
+ *          +-> csnmp_walk_send   (next request of the walk)
+ *          +-> csnmp_walk_done
+ *              +-> csnmp_poll_fill
+ *                  +-> csnmp_poll_finish
+ * {{{ */
+static void csnmp_poll_fill(host_definition_t *host);
+
+static void csnmp_host_set_ctx(host_definition_t *host) /* {{{ */
+{
+  plugin_ctx_t ctx = plugin_get_ctx();
+  ctx.interval = host->interval;
+  plugin_set_ctx(ctx);
+} /* }}} void csnmp_host_set_ctx */
 
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise
-         * our table matching algorithm will get confused. */
-        if ((value_cells_tail[i] != NULL) &&
-            (csnmp_oid_compare(&suffix, &value_cells_tail[i]->suffix) <= 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Suffix is not increasing.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+static void csnmp_poll_finish(host_definition_t *host) /* {{{ */
+{
+  host->polling = false;
+  csnmp_host_submit_stats(host, cdtime() - host->poll_start);
+} /* }}} void csnmp_poll_finish */
 
-        vt = calloc(1, sizeof(*vt));
-        if (vt == NULL) {
-          ERROR("snmp plugin: calloc failed.");
-          status = -1;
-          break;
-        }
+/* Called when a walk has completed (status > 0) or failed (status < 0). */
+static void csnmp_walk_done(csnmp_walk_t *w, int status) /* {{{ */
+{
+  host_definition_t *host = w->host;
 
-        vt->value =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-        memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
-        vt->next = NULL;
+  if (status > 0) {
+    csnmp_walk_finish(w);
+    host->poll_success++;
+  }
 
-        if (value_cells_tail[i] == NULL)
-          value_cells_head[i] = vt;
-        else
-          value_cells_tail[i]->next = vt;
-        value_cells_tail[i] = vt;
-      }
+  for (csnmp_walk_t **ptr = &host->walks; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    if (*ptr == w) {
+      *ptr = w->next;
+      break;
+    }
+  }
+  csnmp_walk_destroy(w);
+  host->in_flight--;
 
-      /* Copy OID to oid_list[i] */
-      memcpy(oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
+  csnmp_poll_fill(host);
+} /* }}} void csnmp_walk_done */
 
-    } /* for (vb = res->variables ...) */
+static int csnmp_async_callback(int operation, netsnmp_session *sess,
+                                int reqid, netsnmp_pdu *pdu, void *magic);
 
-    if (res != NULL)
-      snmp_free_pdu(res);
-    res = NULL;
-  } /* while (status == 0) */
+/* Sends the next request of a walk. Returns zero if a request has been sent,
+ * a positive value if the walk is complete and -1 on error. */
+static int csnmp_walk_send(csnmp_walk_t *w) /* {{{ */
+{
+  host_definition_t *host = w->host;
+  struct snmp_pdu *req = NULL;
 
-  if (res != NULL)
-    snmp_free_pdu(res);
-  res = NULL;
+  if (csnmp_walk_request(w, &req) != 0)
+    return -1;
+  if (req == NULL)
+    return 1;
 
-  if (status == 0)
-    csnmp_dispatch_table(host, data, type_instance_cells_head,
-                         plugin_instance_cells_head, hostname_cells_head,
-                         filter_cells_head, value_cells_head, data->count);
+  /* snmp_sess_async_send frees the PDU on success only. */
+  if (snmp_sess_async_send(host->sess_handle, req, csnmp_async_callback, w) ==
+      0) {
+    char *errstr = NULL;
 
-  /* Free all allocated variables here */
-  while (type_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = type_instance_cells_head->next;
-    sfree(type_instance_cells_head);
-    type_instance_cells_head = next;
-  }
+    snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: snmp_sess_async_send failed: %s",
+               host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+    sfree(errstr);
 
-  while (plugin_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = plugin_instance_cells_head->next;
-    sfree(plugin_instance_cells_head);
-    plugin_instance_cells_head = next;
+    snmp_free_pdu(req);
+    host->reopen = true;
+    return -1;
   }
 
-  while (hostname_cells_head != NULL) {
-    csnmp_cell_char_t *next = hostname_cells_head->next;
-    sfree(hostname_cells_head);
-    hostname_cells_head = next;
-  }
+  host->stats_requests++;
+  return 0;
+} /* }}} int csnmp_walk_send */
+
+static int csnmp_async_callback(int operation, /* {{{ */
+                                __attribute__((unused)) netsnmp_session *sess,
+                                __attribute__((unused)) int reqid,
+                                netsnmp_pdu *pdu, void *magic) {
+  csnmp_walk_t *w = magic;
+  host_definition_t *host = w->host;
+  int status;
 
-  while (filter_cells_head != NULL) {
-    csnmp_cell_char_t *next = filter_cells_head->next;
-    sfree(filter_cells_head);
-    filter_cells_head = next;
-  }
+  /* The session is being closed; the walks are freed by the caller. */
+  if (host->closing)
+    return 1;
 
-  for (i = 0; i < data->values_len; i++) {
-    while (value_cells_head[i] != NULL) {
-      csnmp_cell_value_t *next = value_cells_head[i]->next;
-      sfree(value_cells_head[i]);
-      value_cells_head[i] = next;
-    }
-  }
+  csnmp_host_set_ctx(host);
 
-  sfree(value_cells_head);
-  sfree(value_cells_tail);
+  if ((operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) && (pdu != NULL)) {
+    c_release(LOG_INFO, &host->complaint,
+              "snmp plugin: host %s: snmp_sess_async_send successful.",
+              host->name);
 
-  return 0;
-} /* int csnmp_read_table */
+    /* The response PDU is freed by net-snmp once we return. */
+    status = csnmp_walk_response(w, pdu);
+    if (status == 0)
+      status = csnmp_walk_send(w);
+  } else {
+    if (operation == NETSNMP_CALLBACK_OP_TIMED_OUT)
+      host->stats_timeouts++;
 
-static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: Request for data `%s' failed: %s",
+               host->name, w->data->name,
+               (operation == NETSNMP_CALLBACK_OP_TIMED_OUT)
+                   ? "Timeout"
+                   : "Transport error");
 
-  const data_set_t *ds;
-  value_list_t vl = VALUE_LIST_INIT;
+    /* Like the synchronous code, re-open the session before the next poll. */
+    host->reopen = true;
+    status = -1;
+  }
 
-  int status;
-  size_t i;
+  if (status != 0)
+    csnmp_walk_done(w, status);
 
-  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
-        data->name);
+  return 1;
+} /* }}} int csnmp_async_callback */
 
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
-    return -1;
-  }
+/* Starts walks until the host's in-flight limit is reached. Finishes the poll
+ * once all data definitions have been read. */
+static void csnmp_poll_fill(host_definition_t *host) /* {{{ */
+{
+  while ((host->in_flight < host->max_in_flight) &&
+         (host->data_next < host->data_list_len)) {
+    data_definition_t *data = host->data_list[host->data_next];
+    host->data_next++;
 
-  ds = plugin_get_ds(data->type);
-  if (!ds) {
-    ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
-  }
+    csnmp_walk_t *w = csnmp_walk_create(host, data);
+    if (w == NULL)
+      continue;
 
-  if (ds->ds_num != data->values_len) {
-    ERROR("snmp plugin: DataSet `%s' requires %" PRIsz
-          " values, but config talks "
-          "about %" PRIsz,
-          data->type, ds->ds_num, data->values_len);
-    return -1;
-  }
+    int status = csnmp_walk_send(w);
+    if (status != 0) {
+      if (status > 0) {
+        csnmp_walk_finish(w);
+        host->poll_success++;
+      }
+      csnmp_walk_destroy(w);
+      continue;
+    }
 
-  vl.values_len = ds->ds_num;
-  vl.values = malloc(sizeof(*vl.values) * vl.values_len);
-  if (vl.values == NULL)
-    return -1;
-  for (i = 0; i < vl.values_len; i++) {
-    if (ds->ds[i].type == DS_TYPE_COUNTER)
-      vl.values[i].counter = 0;
-    else
-      vl.values[i].gauge = NAN;
+    w->next = host->walks;
+    host->walks = w;
+    host->in_flight++;
   }
 
-  sstrncpy(vl.host, host->name, sizeof(vl.host));
-  sstrncpy(vl.plugin, data->plugin_name, sizeof(vl.plugin));
-  sstrncpy(vl.type, data->type, sizeof(vl.type));
-  if (data->type_instance.value)
-    sstrncpy(vl.type_instance, data->type_instance.value,
-             sizeof(vl.type_instance));
-  if (data->plugin_instance.value)
-    sstrncpy(vl.plugin_instance, data->plugin_instance.value,
-             sizeof(vl.plugin_instance));
+  if (host->polling && (host->in_flight == 0) &&
+      (host->data_next >= host->data_list_len))
+    csnmp_poll_finish(host);
+} /* }}} void csnmp_poll_fill */
 
-  req = snmp_pdu_create(SNMP_MSG_GET);
-  if (req == NULL) {
-    ERROR("snmp plugin: snmp_pdu_create failed.");
-    sfree(vl.values);
-    return -1;
+static void csnmp_poll_start(host_definition_t *host, cdtime_t now) /* {{{ */
+{
+  host->next_poll += host->interval;
+  if (host->next_poll <= now)
+    host->next_poll = now + host->interval;
+
+  /* No walks are in flight between polls, so the session can be closed. */
+  if (host->reopen) {
+    csnmp_host_close_session(host);
+    host->reopen = false;
   }
 
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+  if (host->sess_handle == NULL)
+    csnmp_host_open_session(host);
+  if (host->sess_handle == NULL)
+    return;
 
-  status = snmp_sess_synch_response(host->sess_handle, req, &res);
+  host->polling = true;
+  host->poll_start = now;
+  host->poll_success = 0;
+  host->data_next = 0;
 
-  if ((status != STAT_SUCCESS) || (res == NULL)) {
-    char *errstr = NULL;
+  csnmp_poll_fill(host);
+} /* }}} void csnmp_poll_start */
 
-    snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
-    ERROR("snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-          host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+static void *csnmp_engine_thread(void *arg) /* {{{ */
+{
+  csnmp_engine_t *engine = arg;
+  netsnmp_large_fd_set fdset;
 
-    if (res != NULL)
-      snmp_free_pdu(res);
+  netsnmp_large_fd_set_init(&fdset, FD_SETSIZE);
 
-    sfree(errstr);
-    sfree(vl.values);
-    csnmp_host_close_session(host);
+  while (!engine_stop) {
+    cdtime_t now = cdtime();
+    /* Wake up regularly to check engine_stop. */
+    cdtime_t wakeup = now + MS_TO_CDTIME_T(500);
 
-    return -1;
-  }
+    for (size_t i = 0; i < engine->hosts_num; i++) {
+      host_definition_t *host = engine->hosts[i];
 
-  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
-#if COLLECT_DEBUG
-    char buffer[1024];
-    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
-    DEBUG("snmp plugin: Got this variable: %s", buffer);
-#endif /* COLLECT_DEBUG */
+      if (!host->polling && (host->next_poll <= now)) {
+        csnmp_host_set_ctx(host);
+        csnmp_poll_start(host, now);
+      }
 
-    for (i = 0; i < data->values_len; i++)
-      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
-                           vb->name, vb->name_length) == 0)
-        vl.values[i] =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-  } /* for (res->variables) */
+      if (!host->polling && (host->next_poll < wakeup))
+        wakeup = host->next_poll;
+    }
 
-  snmp_free_pdu(res);
+    struct timeval timeout =
+        CDTIME_T_TO_TIMEVAL((wakeup > now) ? (wakeup - now) : 0);
+    int numfds = 0;
+    int block = 0;
+
+    /* Each session adds its socket and lowers the timeout to its next
+     * retransmission, if that is sooner. */
+    NETSNMP_LARGE_FD_ZERO(&fdset);
+    for (size_t i = 0; i < engine->hosts_num; i++) {
+      host_definition_t *host = engine->hosts[i];
+      if (host->polling && (host->sess_handle != NULL))
+        snmp_sess_select_info2(host->sess_handle, &numfds, &fdset, &timeout,
+                               &block);
+    }
 
-  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
+    int status = netsnmp_large_fd_set_select(numfds, &fdset, NULL, NULL,
+                                             &timeout);
+    if (status < 0) {
+      if (errno != EINTR) {
+        ERROR("snmp plugin: select failed: %s", STRERRNO);
+        nanosleep(&CDTIME_T_TO_TIMESPEC(MS_TO_CDTIME_T(100)), NULL);
+      }
+      continue;
+    }
 
-  return 0;
-} /* int csnmp_read_value */
+    for (size_t i = 0; i < engine->hosts_num; i++) {
+      host_definition_t *host = engine->hosts[i];
+      if (!host->polling || (host->sess_handle == NULL))
+        continue;
 
-static int csnmp_read_host(user_data_t *ud) {
-  host_definition_t *host;
-  int status;
-  int success;
-  int i;
+      csnmp_host_set_ctx(host);
+      if (status > 0)
+        snmp_sess_read2(host->sess_handle, &fdset);
+      /* Retransmits or times out requests that are due. */
+      if (host->polling)
+        snmp_sess_timeout(host->sess_handle);
+    }
+  }
 
-  host = ud->data;
+  netsnmp_large_fd_set_cleanup(&fdset);
+  return NULL;
+} /* }}} void *csnmp_engine_thread */
 
-  if (host->sess_handle == NULL)
-    csnmp_host_open_session(host);
+static int csnmp_engine_start(void) /* {{{ */
+{
+  if (async_hosts_num == 0)
+    return 0;
 
-  if (host->sess_handle == NULL)
-    return -1;
+  engines_num = (size_t)async_threads;
+  if (engines_num > async_hosts_num)
+    engines_num = async_hosts_num;
 
-  success = 0;
-  for (i = 0; i < host->data_list_len; i++) {
-    data_definition_t *data = host->data_list[i];
+  engines = calloc(engines_num, sizeof(*engines));
+  if (engines == NULL) {
+    ERROR("snmp plugin: calloc failed.");
+    engines_num = 0;
+    return ENOMEM;
+  }
 
-    if (data->is_table)
-      status = csnmp_read_table(host, data);
-    else
-      status = csnmp_read_value(host, data);
+  for (size_t i = 0; i < engines_num; i++) {
+    engines[i].hosts = calloc(async_hosts_num / engines_num + 1,
+                              sizeof(*engines[i].hosts));
+    if (engines[i].hosts == NULL) {
+      ERROR("snmp plugin: calloc failed.");
+      return ENOMEM;
+    }
+  }
 
-    if (status == 0)
-      success++;
+  /* Spread the first polls over the interval, so that not all hosts are
+   * queried at the same time. */
+  cdtime_t now = cdtime();
+  for (size_t i = 0; i < async_hosts_num; i++) {
+    host_definition_t *host = async_hosts[i];
+    csnmp_engine_t *engine = engines + (i % engines_num);
+
+    if (host->interval == 0)
+      host->interval = plugin_get_interval();
+    host->next_poll =
+        now + (cdtime_t)((double)host->interval * i / async_hosts_num);
+
+    engine->hosts[engine->hosts_num] = host;
+    engine->hosts_num++;
   }
 
-  if (success == 0)
-    return -1;
+  engine_stop = false;
+  for (size_t i = 0; i < engines_num; i++) {
+    int status = plugin_thread_create(&engines[i].thread, csnmp_engine_thread,
+                                      engines + i, "snmp engine");
+    if (status != 0) {
+      ERROR("snmp plugin: plugin_thread_create failed: %s", STRERROR(status));
+      return status;
+    }
+    engines[i].thread_started = true;
+  }
 
+  INFO("snmp plugin: Polling %" PRIsz " hosts with %" PRIsz " threads.",
+       async_hosts_num, engines_num);
   return 0;
-} /* int csnmp_read_host */
+} /* }}} int csnmp_engine_start */
+
+static void csnmp_engine_stop(void) /* {{{ */
+{
+  engine_stop = true;
+  for (size_t i = 0; i < engines_num; i++) {
+    if (engines[i].thread_started)
+      pthread_join(engines[i].thread, NULL);
+    sfree(engines[i].hosts);
+  }
+  sfree(engines);
+  engines_num = 0;
+
+  for (size_t i = 0; i < async_hosts_num; i++) {
+    host_definition_t *host = async_hosts[i];
+
+    /* Closing the session may call the callbacks of outstanding requests. */
+    host->closing = true;
+    csnmp_host_close_session(host);
+    while (host->walks != NULL) {
+      csnmp_walk_t *next = host->walks->next;
+      csnmp_walk_destroy(host->walks);
+      host->walks = next;
+    }
+
+    csnmp_host_definition_destroy(host);
+  }
+  sfree(async_hosts);
+  async_hosts_num = 0;
+} /* }}} void csnmp_engine_stop */
+/* }}} End of the asynchronous engine */
 
 static int csnmp_init(void) {
   call_snmp_init_once();
 
-  return 0;
+  return csnmp_engine_start();
 } /* int csnmp_init */
 
 static int csnmp_shutdown(void) {
@@ -2312,7 +2958,10 @@ static int csnmp_shutdown(void) {
   data_definition_t *data_next;
 
   /* When we get here, the read threads have been stopped and all the
-   * `host_definition_t' will be freed. */
+   * `host_definition_t' will be freed. The hosts of the asynchronous engine
+   * are freed here. */
+  csnmp_engine_stop();
+
   DEBUG("snmp plugin: Destroying all data definitions.");
 
   data_this = data_head;
@@ -118,9 +118,20 @@ struct data_definition_s {
   size_t oids_len;
   double scale;
   double shift;
+  c_avl_tree_t *rows; /* Latest values of a table column by index OID */
 };
 typedef struct data_definition_s data_definition_t;
 
+/* The values of a table column for one instance, stored by the write callback
+ * so that GET requests do not have to look them up in the value cache. */
+struct row_values_s {
+  oid_t index_oid;
+  const data_set_t *ds;
+  size_t values_num;
+  value_t values[];
+};
+typedef struct row_values_s row_values_t;
+
 struct snmp_agent_ctx_s {
   pthread_t thread;
   pthread_mutex_t lock;
@@ -153,6 +164,7 @@ static int snmp_agent_unregister_oid_index(oid_t *oid, int index);
 static int snmp_agent_update_instance_oids(c_avl_tree_t *tree, oid_t *index_oid,
                                            int value);
 static int num_compare(const int *a, const int *b);
+static int oid_compare(const oid_t *a, const oid_t *b);
 
 static u_char snmp_agent_get_asn_type(oid *oid, size_t oid_len) {
   struct tree *node = get_tree(oid, oid_len, g_agent->tp);
@@ -681,6 +693,11 @@ static void snmp_agent_table_data_remove(data_definition_t *dd,
   int *index = NULL;
   oid_t *ind_oid = NULL;
 
+  row_values_t *row = NULL;
+  if ((dd->rows != NULL) &&
+      (c_avl_remove(dd->rows, index_oid, NULL, (void **)&row) == 0))
+    sfree(row);
+
   if (td->index_oid.oid_len) {
     if ((c_avl_get(td->instance_index, index_oid, (void **)&index) != 0) ||
         (c_avl_get(td->index_instance, index, NULL) != 0))
@@ -766,8 +783,7 @@ static void snmp_agent_table_data_remove(data_definition_t *dd,
   }
 }
 
-static int snmp_agent_clear_missing(const value_list_t *vl,
-                                    __attribute__((unused)) user_data_t *ud) {
+static int snmp_agent_remove_missing(const value_list_t *vl) {
   if (vl == NULL)
     return -EINVAL;
 
@@ -802,6 +818,17 @@ static int snmp_agent_clear_missing(const value_list_t *vl,
   return 0;
 }
 
+/* Takes the lock, since the stored table rows are read by the request
+ * handlers. */
+static int snmp_agent_clear_missing(const value_list_t *vl,
+                                    __attribute__((unused)) user_data_t *ud) {
+  pthread_mutex_lock(&g_agent->lock);
+  int ret = snmp_agent_remove_missing(vl);
+  pthread_mutex_unlock(&g_agent->lock);
+
+  return ret;
+}
+
 static void snmp_agent_free_data(data_definition_t **dd) {
 
   if (dd == NULL || *dd == NULL)
@@ -820,6 +847,14 @@ static void snmp_agent_free_data(data_definition_t **dd) {
   sfree((*dd)->type_instance);
   sfree((*dd)->oids);
 
+  if ((*dd)->rows != NULL) {
+    void *key;
+    void *row;
+    while (c_avl_pick((*dd)->rows, &key, &row) == 0)
+      sfree(row);
+    c_avl_destroy((*dd)->rows);
+  }
+
   sfree(*dd);
 
   return;
@@ -1043,6 +1078,30 @@ static int snmp_agent_format_name(char *name, int name_len,
   return 0;
 }
 
+/* Converts the value of the `oid_index'th data source and sets it as the
+ * reply. `name' is only used for error messages. */
+static int snmp_agent_set_reply(struct netsnmp_request_info_s *requests,
+                                data_definition_t const *dd, int oid_index,
+                                const data_set_t *ds, value_t const *values,
+                                char const *name) {
+  char data[DATA_MAX_NAME_LEN];
+  size_t data_len = sizeof(data);
+  int ret = snmp_agent_set_vardata(
+      data, &data_len, dd->oids[oid_index].type, dd->scale, dd->shift,
+      &values[oid_index], sizeof(values[oid_index]), ds->ds[oid_index].type);
+
+  if (ret != 0) {
+    ERROR(PLUGIN_NAME ": Failed to convert '%s' value to snmp data", name);
+    return SNMP_NOSUCHINSTANCE;
+  }
+
+  requests->requestvb->type = dd->oids[oid_index].type;
+  snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
+                           (const u_char *)data, data_len);
+
+  return SNMP_ERR_NOERROR;
+}
+
 static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
                                  data_definition_t *dd, oid_t *index_oid,
                                  int oid_index) {
@@ -1087,6 +1146,18 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
     return SNMP_ERR_NOERROR;
   }
 
+  /* Table rows are usually served from the values stored by the write
+   * callback. Walking a large table would otherwise format a name and take
+   * the cache lock for every single cell. */
+  row_values_t *row = NULL;
+  if ((index_oid != NULL) && (dd->rows != NULL) &&
+      (c_avl_get(dd->rows, index_oid, (void **)&row) == 0)) {
+    if (oid_index >= (int)row->values_num)
+      return SNMP_NOSUCHINSTANCE;
+    return snmp_agent_set_reply(requests, dd, oid_index, row->ds, row->values,
+                                dd->name);
+  }
+
   char name[DATA_MAX_NAME_LEN];
 
   ret = snmp_agent_format_name(name, sizeof(name), dd, index_oid);
@@ -1113,24 +1184,10 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
   assert(ds->ds_num == values_num);
   assert(oid_index < (int)values_num);
 
-  char data[DATA_MAX_NAME_LEN];
-  size_t data_len = sizeof(data);
-  ret = snmp_agent_set_vardata(
-      data, &data_len, dd->oids[oid_index].type, dd->scale, dd->shift,
-      &values[oid_index], sizeof(values[oid_index]), ds->ds[oid_index].type);
-
+  ret = snmp_agent_set_reply(requests, dd, oid_index, ds, values, name);
   sfree(values);
 
-  if (ret != 0) {
-    ERROR(PLUGIN_NAME ": Failed to convert '%s' value to snmp data", name);
-    return SNMP_NOSUCHINSTANCE;
-  }
-
-  requests->requestvb->type = dd->oids[oid_index].type;
-  snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                           (const u_char *)data, data_len);
-
-  return SNMP_ERR_NOERROR;
+  return ret;
 }
 
 static int
@@ -2029,7 +2086,48 @@ error:
   return ret;
 }
 
-static int snmp_agent_write(value_list_t const *vl) {
+/* Stores the values of `vl' as the row `index_oid' of the column `dd'. */
+static int snmp_agent_update_row(data_definition_t *dd, const data_set_t *ds,
+                                 value_list_t const *vl,
+                                 oid_t const *index_oid) {
+  if (dd->rows == NULL) {
+    dd->rows = c_avl_create((int (*)(const void *, const void *))oid_compare);
+    if (dd->rows == NULL)
+      return -ENOMEM;
+  }
+
+  row_values_t *row = NULL;
+  if ((c_avl_get(dd->rows, index_oid, (void **)&row) == 0) &&
+      (row->values_num == vl->values_len)) {
+    memcpy(row->values, vl->values, vl->values_len * sizeof(*vl->values));
+    row->ds = ds;
+    return 0;
+  }
+
+  row_values_t *new_row =
+      calloc(1, sizeof(*new_row) + vl->values_len * sizeof(*vl->values));
+  if (new_row == NULL) {
+    ERROR(PLUGIN_NAME ": Failed to allocate memory");
+    return -ENOMEM;
+  }
+  memcpy(&new_row->index_oid, index_oid, sizeof(*index_oid));
+  new_row->ds = ds;
+  new_row->values_num = vl->values_len;
+  memcpy(new_row->values, vl->values, vl->values_len * sizeof(*vl->values));
+
+  if (row != NULL) {
+    c_avl_remove(dd->rows, index_oid, NULL, NULL);
+    sfree(row);
+  }
+
+  if (c_avl_insert(dd->rows, &new_row->index_oid, new_row) != 0) {
+    sfree(new_row);
+    return -1;
+  }
+  return 0;
+}
+
+static int snmp_agent_write(const data_set_t *ds, value_list_t const *vl) {
   if (vl == NULL)
     return -EINVAL;
 
@@ -2054,6 +2152,8 @@ static int snmp_agent_write(value_list_t const *vl) {
 
           if (ret == 0)
             ret = snmp_agent_update_index(dd, td, index_oid, &free_index_oid);
+          if (ret == 0)
+            ret = snmp_agent_update_row(dd, ds, vl, index_oid);
 
           /* Index exists or update failed */
           if (free_index_oid)
@@ -2073,7 +2173,7 @@ static int snmp_agent_collect(const data_set_t *ds, const value_list_t *vl,
 
   pthread_mutex_lock(&g_agent->lock);
 
-  snmp_agent_write(vl);
+  snmp_agent_write(ds, vl);
 
   pthread_mutex_unlock(&g_agent->lock);
 
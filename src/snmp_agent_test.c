@@ -784,6 +784,36 @@ DEF_TEST(build_name) {
   return 0;
 }
 
+DEF_TEST(update_row) {
+  data_definition_t *dd = calloc(1, sizeof(*dd));
+  data_source_t dsrc[] = {{"rx", DS_TYPE_DERIVE, 0, NAN},
+                          {"tx", DS_TYPE_DERIVE, 0, NAN}};
+  data_set_t ds = {TEST_TYPE, STATIC_ARRAY_SIZE(dsrc), dsrc};
+  value_t values[] = {{.derive = 1}, {.derive = 2}};
+  value_list_t vl = {.values = values, .values_len = STATIC_ARRAY_SIZE(values)};
+  oid_t index_oid = {.oid = {1, 2, 3}, .oid_len = 3};
+  oid_t other_oid = {.oid = {1, 2, 4}, .oid_len = 3};
+  row_values_t *row = NULL;
+
+  assert(dd != NULL);
+
+  EXPECT_EQ_INT(0, snmp_agent_update_row(dd, &ds, &vl, &index_oid));
+  values[0].derive = 3;
+  EXPECT_EQ_INT(0, snmp_agent_update_row(dd, &ds, &vl, &index_oid));
+  EXPECT_EQ_INT(0, snmp_agent_update_row(dd, &ds, &vl, &other_oid));
+  EXPECT_EQ_INT(2, c_avl_size(dd->rows));
+
+  EXPECT_EQ_INT(0, c_avl_get(dd->rows, &index_oid, (void **)&row));
+  EXPECT_EQ_PTR(&ds, row->ds);
+  EXPECT_EQ_INT(2, (int)row->values_num);
+  EXPECT_EQ_INT(3, (int)row->values[0].derive);
+  EXPECT_EQ_INT(2, (int)row->values[1].derive);
+
+  snmp_agent_free_data(&dd);
+  EXPECT_EQ_PTR(NULL, dd);
+  return 0;
+}
+
 int main(void) {
   /* snmp_agent_oid_to_string */
   RUN_TEST(oid_to_string);
@@ -827,5 +857,8 @@ int main(void) {
   /* snmp_agent_build_name */
   RUN_TEST(build_name);
 
+  /* snmp_agent_update_row */
+  RUN_TEST(update_row);
+
   END_TEST;
 }
@@ -24,15 +24,20 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/latency/latency.h"
+#include "utils_identity.h"
 
 #include <netdb.h>
 #include <poll.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 /* AIX doesn't have MSG_DONTWAIT */
@@ -48,12 +53,32 @@
 #define STATSD_DEFAULT_SERVICE "8125"
 #endif
 
+/* Number of datagrams read from a socket with one system call. */
+#define STATSD_RECEIVE_BATCH 32
+#define STATSD_PACKET_SIZE 4096
+
+#if HAVE_RECVMMSG
+typedef struct mmsghdr statsd_msg_t;
+#else
+/* Without recvmmsg(2), only one datagram is read at a time. */
+typedef struct {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+} statsd_msg_t;
+#endif
+
 enum metric_type_e { STATSD_COUNTER, STATSD_TIMER, STATSD_GAUGE, STATSD_SET };
 typedef enum metric_type_e metric_type_t;
 
 struct statsd_metric_s {
+  /* The statsd type and name, e.g. "c:name", see statsd_metric_key(). */
+  char *key;
+  uint64_t hash;
   metric_type_t type;
   double value;
+  /* Only used by receive threads: whether the gauge was set, rather than
+   * changed relatively, since the last merge. */
+  bool gauge_set;
   derive_t counter;
   latency_counter_t *latency;
   c_avl_tree_t *set;
@@ -61,15 +86,28 @@ struct statsd_metric_s {
 };
 typedef struct statsd_metric_s statsd_metric_t;
 
-static c_avl_tree_t *metrics_tree;
+/* Every receive thread accumulates the metrics it parses in its own table, so
+ * the threads never contend for a lock with each other. statsd_read() swaps
+ * each table for an empty one and merges it into the global "metrics"
+ * table. */
+struct statsd_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+  pthread_mutex_t lock;
+  c_hashtable_t *metrics;
+};
+typedef struct statsd_receiver_s statsd_receiver_t;
+
+static c_hashtable_t *metrics;
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_t network_thread;
-static bool network_thread_running;
+static statsd_receiver_t *receivers;
+static size_t receivers_num;
 static bool network_thread_shutdown;
 
 static char *conf_node;
 static char *conf_service;
+static size_t conf_receive_threads = 1;
 
 static bool conf_delete_counters;
 static bool conf_delete_timers;
@@ -85,15 +123,12 @@ static bool conf_timer_lower;
 static bool conf_timer_upper;
 static bool conf_timer_sum;
 static bool conf_timer_count;
+static bool conf_timer_histogram;
 
-/* Must hold metrics_lock when calling this function. */
-static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
-                                                    metric_type_t type) {
-  char key[DATA_MAX_NAME_LEN + 2];
-  char *key_copy;
-  statsd_metric_t *metric;
-  int status;
-
+/* Writes the table key of a metric, the type's letter followed by a colon
+ * and the name, for example "c:name". */
+static int statsd_metric_key(char *key, size_t key_size, /* {{{ */
+                             char const *name, metric_type_t type) {
   switch (type) {
   case STATSD_COUNTER:
     key[0] = 'c';
@@ -108,37 +143,52 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
     key[0] = 's';
     break;
   default:
-    return NULL;
+    return -1;
   }
 
   key[1] = ':';
-  sstrncpy(&key[2], name, sizeof(key) - 2);
+  sstrncpy(&key[2], name, key_size - 2);
+  return 0;
+} /* }}} int statsd_metric_key */
 
-  status = c_avl_get(metrics_tree, key, (void *)&metric);
-  if (status == 0)
-    return metric;
+/* Must hold the lock protecting "table" when calling this function. */
+static statsd_metric_t *statsd_metric_lookup_unsafe(c_hashtable_t *table,
+                                                    char const *name, /* {{{ */
+                                                    metric_type_t type) {
+  char key[DATA_MAX_NAME_LEN + 2];
+  statsd_metric_t *metric;
+  uint64_t hash;
+  int status;
 
-  key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("statsd plugin: strdup failed.");
+  if (statsd_metric_key(key, sizeof(key), name, type) != 0)
     return NULL;
-  }
+  hash = vl_identity_hash(key);
+
+  status = c_hashtable_get(table, hash, key, (void *)&metric);
+  if (status == 0)
+    return metric;
 
   metric = calloc(1, sizeof(*metric));
   if (metric == NULL) {
     ERROR("statsd plugin: calloc failed.");
-    sfree(key_copy);
     return NULL;
   }
 
+  metric->key = strdup(key);
+  if (metric->key == NULL) {
+    ERROR("statsd plugin: strdup failed.");
+    sfree(metric);
+    return NULL;
+  }
+  metric->hash = hash;
   metric->type = type;
   metric->latency = NULL;
   metric->set = NULL;
 
-  status = c_avl_insert(metrics_tree, key_copy, metric);
+  status = c_hashtable_insert(table, hash, metric->key, metric);
   if (status != 0) {
-    ERROR("statsd plugin: c_avl_insert failed.");
-    sfree(key_copy);
+    ERROR("statsd plugin: c_hashtable_insert failed.");
+    sfree(metric->key);
     sfree(metric);
     return NULL;
   }
@@ -146,43 +196,34 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   return metric;
 } /* }}} statsd_metric_lookup_unsafe */
 
-static int statsd_metric_set(char const *name, double value, /* {{{ */
-                             metric_type_t type) {
+/* The statsd_metric_* and statsd_handle_* functions are called by the
+ * receive threads with the lock protecting "table" held. */
+static int statsd_metric_set(c_hashtable_t *table, char const *name, /* {{{ */
+                             double value, metric_type_t type) {
   statsd_metric_t *metric;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  metric = statsd_metric_lookup_unsafe(table, name, type);
+  if (metric == NULL)
     return -1;
-  }
 
   metric->value = value;
+  metric->gauge_set = true;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
-
   return 0;
 } /* }}} int statsd_metric_set */
 
-static int statsd_metric_add(char const *name, double delta, /* {{{ */
-                             metric_type_t type) {
+static int statsd_metric_add(c_hashtable_t *table, char const *name, /* {{{ */
+                             double delta, metric_type_t type) {
   statsd_metric_t *metric;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  metric = statsd_metric_lookup_unsafe(table, name, type);
+  if (metric == NULL)
     return -1;
-  }
 
   metric->value += delta;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
-
   return 0;
 } /* }}} int statsd_metric_add */
 
@@ -209,9 +250,24 @@ static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
     metric->set = NULL;
   }
 
+  sfree(metric->key);
   sfree(metric);
 } /* }}} void statsd_metric_free */
 
+/* Frees a table and all metrics in it. */
+static void statsd_metrics_destroy(c_hashtable_t *table) /* {{{ */
+{
+  statsd_metric_t *metric;
+  size_t pos = 0;
+
+  if (table == NULL)
+    return;
+
+  while (c_hashtable_next(table, &pos, NULL, (void *)&metric) == 0)
+    statsd_metric_free(metric);
+  c_hashtable_destroy(table);
+} /* }}} void statsd_metrics_destroy */
+
 static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
 {
   char *endptr = NULL;
@@ -223,8 +279,9 @@ static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
   return 0;
 } /* }}} int statsd_parse_value */
 
-static int statsd_handle_counter(char const *name, /* {{{ */
-                                 char const *value_str, char const *extra) {
+static int statsd_handle_counter(c_hashtable_t *table, /* {{{ */
+                                 char const *name, char const *value_str,
+                                 char const *extra) {
   value_t value;
   value_t scale;
   int status;
@@ -249,12 +306,12 @@ static int statsd_handle_counter(char const *name, /* {{{ */
 
   /* Changes to the counter are added to (statsd_metric_t*)->value. ->counter is
    * only updated in statsd_metric_submit_unsafe(). */
-  return statsd_metric_add(name, (double)(value.gauge / scale.gauge),
+  return statsd_metric_add(table, name, (double)(value.gauge / scale.gauge),
                            STATSD_COUNTER);
 } /* }}} int statsd_handle_counter */
 
-static int statsd_handle_gauge(char const *name, /* {{{ */
-                               char const *value_str) {
+static int statsd_handle_gauge(c_hashtable_t *table, /* {{{ */
+                               char const *name, char const *value_str) {
   value_t value;
   int status;
 
@@ -264,13 +321,14 @@ static int statsd_handle_gauge(char const *name, /* {{{ */
     return status;
 
   if ((value_str[0] == '+') || (value_str[0] == '-'))
-    return statsd_metric_add(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_add(table, name, (double)value.gauge, STATSD_GAUGE);
   else
-    return statsd_metric_set(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_set(table, name, (double)value.gauge, STATSD_GAUGE);
 } /* }}} int statsd_handle_gauge */
 
-static int statsd_handle_timer(char const *name, /* {{{ */
-                               char const *value_str, char const *extra) {
+static int statsd_handle_timer(c_hashtable_t *table, /* {{{ */
+                               char const *name, char const *value_str,
+                               char const *extra) {
   statsd_metric_t *metric;
   value_t value_ms;
   value_t scale;
@@ -297,62 +355,38 @@ static int statsd_handle_timer(char const *name, /* {{{ */
 
   value = MS_TO_CDTIME_T(value_ms.gauge / scale.gauge);
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_TIMER);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  metric = statsd_metric_lookup_unsafe(table, name, STATSD_TIMER);
+  if (metric == NULL)
     return -1;
-  }
 
   if (metric->latency == NULL)
     metric->latency = latency_counter_create();
-  if (metric->latency == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (metric->latency == NULL)
     return -1;
-  }
 
   latency_counter_add(metric->latency, value);
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_timer */
 
-static int statsd_handle_set(char const *name, /* {{{ */
-                             char const *set_key_orig) {
-  statsd_metric_t *metric = NULL;
-  char *set_key;
+/* Adds "set_key" to the set of "metric", taking ownership of it. */
+static int statsd_set_insert(statsd_metric_t *metric, char *set_key) /* {{{ */
+{
   int status;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_SET);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    return -1;
-  }
-
   /* Make sure metric->set exists. */
   if (metric->set == NULL)
     metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
 
   if (metric->set == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: c_avl_create failed.");
-    return -1;
-  }
-
-  set_key = strdup(set_key_orig);
-  if (set_key == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    ERROR("statsd plugin: strdup failed.");
+    sfree(set_key);
     return -1;
   }
 
   status = c_avl_insert(metric->set, set_key, /* value = */ NULL);
   if (status < 0) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
           set_key, status);
     sfree(set_key);
@@ -362,13 +396,32 @@ static int statsd_handle_set(char const *name, /* {{{ */
     sfree(set_key);
   }
 
-  metric->updates_num++;
+  return 0;
+} /* }}} int statsd_set_insert */
 
-  pthread_mutex_unlock(&metrics_lock);
+static int statsd_handle_set(c_hashtable_t *table, /* {{{ */
+                             char const *name, char const *set_key_orig) {
+  statsd_metric_t *metric = NULL;
+  char *set_key;
+
+  metric = statsd_metric_lookup_unsafe(table, name, STATSD_SET);
+  if (metric == NULL)
+    return -1;
+
+  set_key = strdup(set_key_orig);
+  if (set_key == NULL) {
+    ERROR("statsd plugin: strdup failed.");
+    return -1;
+  }
+
+  if (statsd_set_insert(metric, set_key) != 0)
+    return -1;
+
+  metric->updates_num++;
   return 0;
 } /* }}} int statsd_handle_set */
 
-static int statsd_parse_line(char *buffer) /* {{{ */
+static int statsd_parse_line(c_hashtable_t *table, char *buffer) /* {{{ */
 {
   char *name = buffer;
   char *value;
@@ -394,23 +447,23 @@ static int statsd_parse_line(char *buffer) /* {{{ */
   }
 
   if (strcmp("c", type) == 0)
-    return statsd_handle_counter(name, value, extra);
+    return statsd_handle_counter(table, name, value, extra);
   else if (strcmp("ms", type) == 0)
-    return statsd_handle_timer(name, value, extra);
+    return statsd_handle_timer(table, name, value, extra);
 
   /* extra is only valid for counters and timers */
   if (extra != NULL)
     return -1;
 
   if (strcmp("g", type) == 0)
-    return statsd_handle_gauge(name, value);
+    return statsd_handle_gauge(table, name, value);
   else if (strcmp("s", type) == 0)
-    return statsd_handle_set(name, value);
+    return statsd_handle_set(table, name, value);
   else
     return -1;
 } /* }}} void statsd_parse_line */
 
-static void statsd_parse_buffer(char *buffer) /* {{{ */
+static void statsd_parse_buffer(c_hashtable_t *table, char *buffer) /* {{{ */
 {
   while (buffer != NULL) {
     char orig[64];
@@ -430,7 +483,7 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
 
     sstrncpy(orig, buffer, sizeof(orig));
 
-    status = statsd_parse_line(buffer);
+    status = statsd_parse_line(table, buffer);
     if (status != 0)
       ERROR("statsd plugin: Unable to parse line: \"%s\"", orig);
 
@@ -438,32 +491,48 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
   }
 } /* }}} void statsd_parse_buffer */
 
-static void statsd_network_read(int fd) /* {{{ */
-{
-  char buffer[4096];
-  size_t buffer_size;
-  ssize_t status;
-
-  status = recv(fd, buffer, sizeof(buffer), /* flags = */ MSG_DONTWAIT);
-  if (status < 0) {
+/* Reads up to STATSD_RECEIVE_BATCH datagrams from "fd" and parses them into
+ * the table of "r", taking its lock once for the whole batch. */
+static void statsd_network_read(statsd_receiver_t *r, int fd, /* {{{ */
+                                char (*buffers)[STATSD_PACKET_SIZE]) {
+  statsd_msg_t msgs[STATSD_RECEIVE_BATCH] = {0};
+  struct iovec iov[STATSD_RECEIVE_BATCH];
+  int msgs_num;
+
+  for (size_t i = 0; i < STATSD_RECEIVE_BATCH; i++) {
+    /* Leave room for the terminating null byte. */
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = STATSD_PACKET_SIZE - 1;
+    msgs[i].msg_hdr.msg_iov = iov + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+#if HAVE_RECVMMSG
+  msgs_num = recvmmsg(fd, msgs, STATSD_RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+#else
+  ssize_t len = recvmsg(fd, &msgs[0].msg_hdr, /* flags = */ MSG_DONTWAIT);
+  msgs_num = (len < 0) ? -1 : 1;
+  if (len >= 0)
+    msgs[0].msg_len = (unsigned int)len;
+#endif
+  if (msgs_num < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
       return;
 
-    ERROR("statsd plugin: recv(2) failed: %s", STRERRNO);
+    ERROR("statsd plugin: recvmmsg(2) failed: %s", STRERRNO);
     return;
   }
 
-  buffer_size = (size_t)status;
-  if (buffer_size >= sizeof(buffer))
-    buffer_size = sizeof(buffer) - 1;
-  buffer[buffer_size] = 0;
-
-  statsd_parse_buffer(buffer);
+  pthread_mutex_lock(&r->lock);
+  for (int i = 0; i < msgs_num; i++) {
+    buffers[i][msgs[i].msg_len] = 0;
+    statsd_parse_buffer(r->metrics, buffers[i]);
+  }
+  pthread_mutex_unlock(&r->lock);
 } /* }}} void statsd_network_read */
 
 static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
-                               size_t *ret_fds_num) {
+                               size_t *ret_fds_num, bool reuseport) {
   struct pollfd *fds = NULL;
   size_t fds_num = 0;
 
@@ -507,6 +576,18 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
       continue;
     }
 
+#ifdef SO_REUSEPORT
+    /* let the kernel distribute datagrams among the receive threads */
+    if (reuseport &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)) {
+      ERROR("statsd plugin: setsockopt (reuseport): %s", STRERRNO);
+      close(fd);
+      continue;
+    }
+#else
+    (void)reuseport;
+#endif
+
     getnameinfo(ai_ptr->ai_addr, ai_ptr->ai_addrlen, str_node, sizeof(str_node),
                 str_service, sizeof(str_service),
                 NI_DGRAM | NI_NUMERICHOST | NI_NUMERICSERV);
@@ -552,13 +633,23 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
 
 static void *statsd_network_thread(void *args) /* {{{ */
 {
+  statsd_receiver_t *r = args;
   struct pollfd *fds = NULL;
   size_t fds_num = 0;
+  char(*buffers)[STATSD_PACKET_SIZE];
   int status;
 
-  status = statsd_network_init(&fds, &fds_num);
+  buffers = malloc(STATSD_RECEIVE_BATCH * sizeof(*buffers));
+  if (buffers == NULL) {
+    ERROR("statsd plugin: malloc failed.");
+    pthread_exit((void *)0);
+  }
+
+  /* Every receive thread binds its own sockets. */
+  status = statsd_network_init(&fds, &fds_num, receivers_num > 1);
   if (status != 0) {
     ERROR("statsd plugin: Unable to open listening sockets.");
+    sfree(buffers);
     pthread_exit((void *)0);
   }
 
@@ -577,7 +668,7 @@ static void *statsd_network_thread(void *args) /* {{{ */
       if ((fds[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
 
-      statsd_network_read(fds[i].fd);
+      statsd_network_read(r, fds[i].fd, buffers);
       fds[i].revents = 0;
     }
   } /* while (!network_thread_shutdown) */
@@ -586,6 +677,7 @@ static void *statsd_network_thread(void *args) /* {{{ */
   for (size_t i = 0; i < fds_num; i++)
     close(fds[i].fd);
   sfree(fds);
+  sfree(buffers);
 
   return (void *)0;
 } /* }}} void *statsd_network_thread */
@@ -629,7 +721,14 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
-    else if (strcasecmp("DeleteCounters", child->key) == 0)
+    else if (strcasecmp("ReceiveThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        ERROR("statsd plugin: \"ReceiveThreads\" must be a positive "
+              "integer.");
+      else
+        conf_receive_threads = (size_t)tmp;
+    } else if (strcasecmp("DeleteCounters", child->key) == 0)
       cf_util_get_boolean(child, &conf_delete_counters);
     else if (strcasecmp("DeleteTimers", child->key) == 0)
       cf_util_get_boolean(child, &conf_delete_timers);
@@ -649,6 +748,8 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &conf_timer_sum);
     else if (strcasecmp("TimerCount", child->key) == 0)
       cf_util_get_boolean(child, &conf_timer_count);
+    else if (strcasecmp("TimerHistogram", child->key) == 0)
+      cf_util_get_boolean(child, &conf_timer_histogram);
     else if (strcasecmp("TimerPercentile", child->key) == 0)
       statsd_config_timer_percentile(child);
     else
@@ -662,28 +763,153 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
 static int statsd_init(void) /* {{{ */
 {
   pthread_mutex_lock(&metrics_lock);
-  if (metrics_tree == NULL)
-    metrics_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (metrics == NULL)
+    metrics = c_hashtable_create();
+  if (metrics == NULL) {
+    pthread_mutex_unlock(&metrics_lock);
+    ERROR("statsd plugin: c_hashtable_create failed.");
+    return -1;
+  }
+
+  if (receivers == NULL) {
+    size_t num = conf_receive_threads;
+
+#ifndef SO_REUSEPORT
+    if (num > 1) {
+      WARNING("statsd plugin: SO_REUSEPORT is not available, so only one "
+              "receive thread is started.");
+      num = 1;
+    }
+#endif
+
+    receivers = calloc(num, sizeof(*receivers));
+    if (receivers == NULL) {
+      pthread_mutex_unlock(&metrics_lock);
+      ERROR("statsd plugin: calloc failed.");
+      return -1;
+    }
+    receivers_num = num;
+
+    for (size_t i = 0; i < receivers_num; i++) {
+      pthread_mutex_init(&receivers[i].lock, NULL);
+      receivers[i].metrics = c_hashtable_create();
+      if (receivers[i].metrics == NULL) {
+        pthread_mutex_unlock(&metrics_lock);
+        ERROR("statsd plugin: c_hashtable_create failed.");
+        return -1;
+      }
+    }
+  }
 
-  if (!network_thread_running) {
+  for (size_t i = 0; i < receivers_num; i++) {
+    char name[16];
     int status;
 
-    status = pthread_create(&network_thread,
-                            /* attr = */ NULL, statsd_network_thread,
-                            /* args = */ NULL);
+    if (receivers[i].thread_running)
+      continue;
+
+    ssnprintf(name, sizeof(name), "statsd recv#%" PRIsz, i);
+    status = plugin_thread_create(&receivers[i].thread, statsd_network_thread,
+                                  receivers + i, name);
     if (status != 0) {
       pthread_mutex_unlock(&metrics_lock);
       ERROR("statsd plugin: pthread_create failed: %s", STRERRNO);
       return status;
     }
+    receivers[i].thread_running = true;
   }
-  network_thread_running = true;
 
   pthread_mutex_unlock(&metrics_lock);
 
   return 0;
 } /* }}} int statsd_init */
 
+/* Adds what a receive thread has accumulated in "src" since the last merge to
+ * "dst". Takes ownership of the set keys. */
+static void statsd_metric_merge(statsd_metric_t *dst, /* {{{ */
+                                statsd_metric_t *src) {
+  switch (src->type) {
+  case STATSD_COUNTER:
+    dst->value += src->value;
+    break;
+  case STATSD_GAUGE:
+    /* The order of updates received by different threads is unknown, so a
+     * gauge set by several threads ends up with any one of the values. */
+    if (src->gauge_set)
+      dst->value = src->value;
+    else
+      dst->value += src->value;
+    break;
+  case STATSD_TIMER:
+    if (src->latency == NULL)
+      break;
+    if (dst->latency == NULL) {
+      dst->latency = src->latency;
+      src->latency = NULL;
+    } else {
+      latency_counter_merge(dst->latency, src->latency);
+    }
+    break;
+  case STATSD_SET:
+    if (src->set != NULL) {
+      void *key;
+      void *value;
+      while (c_avl_pick(src->set, &key, &value) == 0)
+        statsd_set_insert(dst, key);
+    }
+    break;
+  }
+
+  dst->updates_num += src->updates_num;
+} /* }}} void statsd_metric_merge */
+
+/* Swaps the table of every receive thread for an empty one and merges the
+ * metrics into the global table. Must hold metrics_lock when calling this
+ * function. */
+static void statsd_merge_receivers_unsafe(void) /* {{{ */
+{
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+    c_hashtable_t *table;
+    statsd_metric_t *metric;
+    size_t pos = 0;
+
+    table = c_hashtable_create();
+    if (table == NULL) {
+      ERROR("statsd plugin: c_hashtable_create failed.");
+      continue;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    c_hashtable_t *tmp = r->metrics;
+    r->metrics = table;
+    table = tmp;
+    pthread_mutex_unlock(&r->lock);
+
+    /* The keys stored in "table" are freed along with the metrics, which is
+     * fine since the table is only iterated and destroyed afterwards. */
+    while (c_hashtable_next(table, &pos, NULL, (void *)&metric) == 0) {
+      statsd_metric_t *global;
+
+      if (c_hashtable_get(metrics, metric->hash, metric->key,
+                          (void *)&global) == 0) {
+        statsd_metric_merge(global, metric);
+        statsd_metric_free(metric);
+        continue;
+      }
+
+      /* First update of this metric: move it to the global table. */
+      metric->gauge_set = false;
+      if (c_hashtable_insert(metrics, metric->hash, metric->key, metric) !=
+          0) {
+        ERROR("statsd plugin: c_hashtable_insert failed.");
+        statsd_metric_free(metric);
+      }
+    }
+    c_hashtable_destroy(table);
+  }
+} /* }}} void statsd_merge_receivers_unsafe */
+
 /* Must hold metrics_lock when calling this function. */
 static int statsd_metric_clear_set_unsafe(statsd_metric_t *metric) /* {{{ */
 {
@@ -777,6 +1003,11 @@ static int statsd_metric_submit_unsafe(char const *name,
       plugin_dispatch_values(&vl);
     }
 
+    if (conf_timer_histogram && (metric->latency != NULL)) {
+      sstrncpy(vl.type_instance, name, sizeof(vl.type_instance));
+      latency_counter_dispatch(metric->latency, &vl);
+    }
+
     /* Keep this at the end, since vl.type is set to "gauge" here. The
      * vl.type's above are implicitly set to "latency". */
     if (conf_timer_count) {
@@ -859,85 +1090,87 @@ static int statsd_metric_submit_unsafe(char const *name,
 
 static int statsd_read(void) /* {{{ */
 {
-  c_avl_iterator_t *iter;
-  char *name;
   statsd_metric_t *metric;
+  size_t pos = 0;
 
-  char **to_be_deleted = NULL;
+  statsd_metric_t **to_be_deleted = NULL;
   size_t to_be_deleted_num = 0;
 
   pthread_mutex_lock(&metrics_lock);
 
-  if (metrics_tree == NULL) {
+  if (metrics == NULL) {
     pthread_mutex_unlock(&metrics_lock);
     return 0;
   }
 
-  iter = c_avl_get_iterator(metrics_tree);
-  while (c_avl_iterator_next(iter, (void *)&name, (void *)&metric) == 0) {
+  statsd_merge_receivers_unsafe();
+
+  while (c_hashtable_next(metrics, &pos, NULL, (void *)&metric) == 0) {
     if ((metric->updates_num == 0) &&
         ((conf_delete_counters && (metric->type == STATSD_COUNTER)) ||
          (conf_delete_timers && (metric->type == STATSD_TIMER)) ||
          (conf_delete_gauges && (metric->type == STATSD_GAUGE)) ||
          (conf_delete_sets && (metric->type == STATSD_SET)))) {
-      DEBUG("statsd plugin: Deleting metric \"%s\".", name);
-      strarray_add(&to_be_deleted, &to_be_deleted_num, name);
+      statsd_metric_t **tmp;
+
+      DEBUG("statsd plugin: Deleting metric \"%s\".", metric->key);
+      tmp = realloc(to_be_deleted,
+                    sizeof(*to_be_deleted) * (to_be_deleted_num + 1));
+      if (tmp == NULL) {
+        ERROR("statsd plugin: realloc failed.");
+        continue;
+      }
+      to_be_deleted = tmp;
+      to_be_deleted[to_be_deleted_num] = metric;
+      to_be_deleted_num++;
       continue;
     }
 
     /* Names have a prefix, e.g. "c:", which determines the (statsd) type.
      * Remove this here. */
-    statsd_metric_submit_unsafe(name + 2, metric);
+    statsd_metric_submit_unsafe(metric->key + 2, metric);
 
     /* Reset the metric. */
     metric->updates_num = 0;
     if (metric->type == STATSD_SET)
       statsd_metric_clear_set_unsafe(metric);
   }
-  c_avl_iterator_destroy(iter);
 
   for (size_t i = 0; i < to_be_deleted_num; i++) {
-    int status;
-
-    status = c_avl_remove(metrics_tree, to_be_deleted[i], (void *)&name,
-                          (void *)&metric);
-    if (status != 0) {
-      ERROR("stats plugin: c_avl_remove (\"%s\") failed with status %i.",
-            to_be_deleted[i], status);
-      continue;
-    }
-
-    sfree(name);
+    metric = to_be_deleted[i];
+    c_hashtable_remove(metrics, metric->hash, metric->key, NULL, NULL);
     statsd_metric_free(metric);
   }
 
   pthread_mutex_unlock(&metrics_lock);
 
-  strarray_free(to_be_deleted, to_be_deleted_num);
+  sfree(to_be_deleted);
 
   return 0;
 } /* }}} int statsd_read */
 
 static int statsd_shutdown(void) /* {{{ */
 {
-  void *key;
-  void *value;
-
-  if (network_thread_running) {
-    network_thread_shutdown = true;
-    pthread_kill(network_thread, SIGTERM);
-    pthread_join(network_thread, /* retval = */ NULL);
+  network_thread_shutdown = true;
+  for (size_t i = 0; i < receivers_num; i++) {
+    if (!receivers[i].thread_running)
+      continue;
+    pthread_kill(receivers[i].thread, SIGTERM);
+    pthread_join(receivers[i].thread, /* retval = */ NULL);
+    receivers[i].thread_running = false;
   }
-  network_thread_running = false;
 
   pthread_mutex_lock(&metrics_lock);
 
-  while (c_avl_pick(metrics_tree, &key, &value) == 0) {
-    sfree(key);
-    statsd_metric_free(value);
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_metrics_destroy(receivers[i].metrics);
+    pthread_mutex_destroy(&receivers[i].lock);
   }
-  c_avl_destroy(metrics_tree);
-  metrics_tree = NULL;
+  sfree(receivers);
+  receivers_num = 0;
+
+  statsd_metrics_destroy(metrics);
+  metrics = NULL;
 
   sfree(conf_node);
   sfree(conf_service);
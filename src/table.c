@@ -34,6 +34,10 @@
 
 #include "plugin.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #define log_err(...) ERROR("table plugin: " __VA_ARGS__)
 #define log_warn(...) WARNING("table plugin: " __VA_ARGS__)
 
@@ -52,16 +56,52 @@ typedef struct {
   const data_set_t *ds;
 } tbl_result_t;
 
+/* A column of a line. Points into the file's contents and is not
+ * null-terminated. */
+typedef struct {
+  const char *ptr;
+  size_t len;
+} tbl_field_t;
+
+/* A value list dispatched from a regular file. Its values are at
+ * `values_offset' in the table's `values'. */
+typedef struct {
+  size_t result;
+  char type_instance[DATA_MAX_NAME_LEN];
+  size_t values_offset;
+} tbl_row_t;
+
 typedef struct {
   char *file;
   char *sep;
   char *plugin_name;
   char *instance;
+  bool use_mmap;
 
   tbl_result_t *results;
   size_t results_num;
 
   size_t max_colnum;
+  /* Characters of `sep'. */
+  bool is_sep[UCHAR_MAX + 1];
+
+  /* Contents of the last read if the file was not mapped. */
+  char *buffer;
+  size_t buffer_size;
+
+  /* The regular file as it was when the rows were parsed. While it doesn't
+   * change, the rows are dispatched again instead of parsing the file. */
+  bool cached;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  tbl_row_t *rows;
+  size_t rows_num;
+  size_t rows_size;
+  value_t *values;
+  size_t values_num;
+  size_t values_size;
 } tbl_t;
 
 static void tbl_result_setup(tbl_result_t *res) {
@@ -100,10 +140,22 @@ static void tbl_setup(tbl_t *tbl, char *file) {
   tbl->plugin_name = NULL;
   tbl->instance = NULL;
 
+  tbl->use_mmap = false;
+
   tbl->results = NULL;
   tbl->results_num = 0;
 
   tbl->max_colnum = 0;
+  memset(tbl->is_sep, 0, sizeof(tbl->is_sep));
+
+  tbl->buffer = NULL;
+  tbl->buffer_size = 0;
+
+  tbl->cached = false;
+  tbl->rows = NULL;
+  tbl->rows_num = tbl->rows_size = 0;
+  tbl->values = NULL;
+  tbl->values_num = tbl->values_size = 0;
 } /* tbl_setup */
 
 static void tbl_clear(tbl_t *tbl) {
@@ -124,6 +176,15 @@ static void tbl_clear(tbl_t *tbl) {
   tbl->results_num = 0;
 
   tbl->max_colnum = 0;
+
+  sfree(tbl->buffer);
+  tbl->buffer_size = 0;
+
+  tbl->cached = false;
+  sfree(tbl->rows);
+  tbl->rows_num = tbl->rows_size = 0;
+  sfree(tbl->values);
+  tbl->values_num = tbl->values_size = 0;
 } /* tbl_clear */
 
 static tbl_t *tables;
@@ -246,6 +307,8 @@ static int tbl_config_table(oconfig_item_t *ci) {
       cf_util_get_string(c, &tbl->plugin_name);
     else if (strcasecmp(c->key, "Instance") == 0)
       cf_util_get_string(c, &tbl->instance);
+    else if (strcasecmp(c->key, "MMap") == 0)
+      cf_util_get_boolean(c, &tbl->use_mmap);
     else if (strcasecmp(c->key, "Result") == 0)
       tbl_config_result(tbl, c);
     else
@@ -260,6 +323,8 @@ static int tbl_config_table(oconfig_item_t *ci) {
     status = 1;
   } else {
     strunescape(tbl->sep, strlen(tbl->sep) + 1);
+    for (const char *c = tbl->sep; *c != 0; c++)
+      tbl->is_sep[(unsigned char)*c] = true;
   }
 
   if (tbl->instance == NULL) {
@@ -337,8 +402,62 @@ static int tbl_finish(tbl_t *tbl) {
   return 0;
 } /* tbl_finish */
 
-static int tbl_result_dispatch(tbl_t *tbl, tbl_result_t *res, char **fields,
-                               size_t fields_num) {
+/* Copies the field to `buffer' as a null-terminated string, truncating it if
+ * necessary. */
+static char *tbl_field_copy(char *buffer, size_t buffer_size,
+                            const tbl_field_t *f) {
+  size_t len = (f->len < buffer_size) ? f->len : (buffer_size - 1);
+  memcpy(buffer, f->ptr, len);
+  buffer[len] = 0;
+  return buffer;
+} /* tbl_field_copy */
+
+/* Remembers a dispatched value list, so it can be dispatched again while the
+ * file is unchanged. */
+static int tbl_row_add(tbl_t *tbl, size_t result, const value_list_t *vl) {
+  if (tbl->rows_num >= tbl->rows_size) {
+    size_t size = (tbl->rows_size > 0) ? (2 * tbl->rows_size) : 16;
+    tbl_row_t *tmp = realloc(tbl->rows, size * sizeof(*tbl->rows));
+    if (tmp == NULL)
+      return ENOMEM;
+    tbl->rows = tmp;
+    tbl->rows_size = size;
+  }
+
+  if ((tbl->values_num + vl->values_len) > tbl->values_size) {
+    size_t size = (tbl->values_size > 0) ? (2 * tbl->values_size) : 16;
+    while (size < (tbl->values_num + vl->values_len))
+      size *= 2;
+    value_t *tmp = realloc(tbl->values, size * sizeof(*tbl->values));
+    if (tmp == NULL)
+      return ENOMEM;
+    tbl->values = tmp;
+    tbl->values_size = size;
+  }
+
+  tbl_row_t *row = tbl->rows + tbl->rows_num;
+  row->result = result;
+  sstrncpy(row->type_instance, vl->type_instance, sizeof(row->type_instance));
+  row->values_offset = tbl->values_num;
+  memcpy(tbl->values + tbl->values_num, vl->values,
+         vl->values_len * sizeof(*vl->values));
+
+  tbl->rows_num++;
+  tbl->values_num += vl->values_len;
+  return 0;
+} /* tbl_row_add */
+
+static void tbl_vl_init(tbl_t *tbl, tbl_result_t *res, value_list_t *vl) {
+  sstrncpy(vl->plugin, (tbl->plugin_name != NULL) ? tbl->plugin_name : "table",
+           sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, tbl->instance, sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, res->type, sizeof(vl->type));
+} /* tbl_vl_init */
+
+static int tbl_result_dispatch(tbl_t *tbl, size_t result,
+                               const tbl_field_t *fields, size_t fields_num,
+                               bool record) {
+  tbl_result_t *res = tbl->results + result;
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[res->values_num];
 
@@ -346,31 +465,32 @@ static int tbl_result_dispatch(tbl_t *tbl, tbl_result_t *res, char **fields,
   assert(res->values_num == res->ds->ds_num);
 
   for (size_t i = 0; i < res->values_num; ++i) {
+    char value[DATA_MAX_NAME_LEN];
+
     assert(res->values[i] < fields_num);
-    char *value = fields[res->values[i]];
+    tbl_field_copy(value, sizeof(value), fields + res->values[i]);
     if (parse_value(value, &values[i], res->ds->ds[i].type) != 0)
       return -1;
   }
 
   vl.values = values;
   vl.values_len = STATIC_ARRAY_SIZE(values);
-
-  sstrncpy(vl.plugin, (tbl->plugin_name != NULL) ? tbl->plugin_name : "table",
-           sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, tbl->instance, sizeof(vl.plugin_instance));
-  sstrncpy(vl.type, res->type, sizeof(vl.type));
+  tbl_vl_init(tbl, res, &vl);
 
   if (res->instances_num == 0) {
     if (res->instance_prefix)
       sstrncpy(vl.type_instance, res->instance_prefix,
                sizeof(vl.type_instance));
   } else {
+    char instances_buffer[res->instances_num][DATA_MAX_NAME_LEN];
     char *instances[res->instances_num];
     char instances_str[DATA_MAX_NAME_LEN];
 
     for (size_t i = 0; i < res->instances_num; ++i) {
       assert(res->instances[i] < fields_num);
-      instances[i] = fields[res->instances[i]];
+      instances[i] =
+          tbl_field_copy(instances_buffer[i], sizeof(instances_buffer[i]),
+                         fields + res->instances[i]);
     }
 
     strjoin(instances_str, sizeof(instances_str), instances,
@@ -388,22 +508,35 @@ static int tbl_result_dispatch(tbl_t *tbl, tbl_result_t *res, char **fields,
       log_warn("Truncated type instance: %s.", vl.type_instance);
   }
 
+  if (record && (tbl_row_add(tbl, result, &vl) != 0)) {
+    log_err("Table %s: Failed to remember the values.", tbl->file);
+    return ENOMEM;
+  }
+
   plugin_dispatch_values(&vl);
   return 0;
 } /* tbl_result_dispatch */
 
-static int tbl_parse_line(tbl_t *tbl, char *line, size_t len) {
-  char *fields[tbl->max_colnum + 1];
+/* Splits the line into the columns up to `max_colnum' and dispatches the
+ * results. The fields point into `line', which isn't modified. */
+static int tbl_parse_line(tbl_t *tbl, const char *line, size_t len,
+                          bool record) {
+  tbl_field_t fields[tbl->max_colnum + 1];
   size_t i = 0;
 
-  char *ptr = line;
-  char *saveptr = NULL;
-  while ((fields[i] = strtok_r(ptr, tbl->sep, &saveptr)) != NULL) {
-    ptr = NULL;
-    i++;
-
-    if (i > tbl->max_colnum)
+  const char *ptr = line;
+  const char *end = line + len;
+  while (i <= tbl->max_colnum) {
+    while ((ptr < end) && tbl->is_sep[(unsigned char)*ptr])
+      ptr++;
+    if (ptr == end)
       break;
+
+    fields[i].ptr = ptr;
+    while ((ptr < end) && !tbl->is_sep[(unsigned char)*ptr])
+      ptr++;
+    fields[i].len = (size_t)(ptr - fields[i].ptr);
+    i++;
   }
 
   if (i <= tbl->max_colnum) {
@@ -413,44 +546,176 @@ static int tbl_parse_line(tbl_t *tbl, char *line, size_t len) {
     return -1;
   }
 
-  for (i = 0; i < tbl->results_num; ++i)
-    if (tbl_result_dispatch(tbl, tbl->results + i, fields,
-                            STATIC_ARRAY_SIZE(fields)) != 0) {
+  int status = 0;
+  for (i = 0; i < tbl->results_num; ++i) {
+    int r = tbl_result_dispatch(tbl, i, fields, STATIC_ARRAY_SIZE(fields),
+                                record);
+    if (r == ENOMEM)
+      status = r;
+    else if (r != 0)
       log_err("Failed to dispatch result.");
-      continue;
+  }
+  return status;
+} /* tbl_parse_line */
+
+/* Parses all lines of `data'. Returns ENOMEM if the dispatched values could
+ * not all be remembered. */
+static int tbl_parse_buffer(tbl_t *tbl, const char *data, size_t size,
+                            bool record) {
+  int status = 0;
+  const char *ptr = data;
+  const char *end = data + size;
+
+  while (ptr < end) {
+    const char *eol = memchr(ptr, '\n', (size_t)(end - ptr));
+    if (eol == NULL)
+      eol = end;
+
+    size_t len = (size_t)(eol - ptr);
+    if ((len > 0) && (ptr[len - 1] == '\r'))
+      len--;
+
+    int r = tbl_parse_line(tbl, ptr, len, record);
+    if (r == ENOMEM)
+      status = r;
+    else if (r != 0)
+      log_warn("Table %s: Failed to parse line: %.*s", tbl->file, (int)len,
+               ptr);
+
+    ptr = eol + 1;
+  }
+
+  return status;
+} /* tbl_parse_buffer */
+
+/* Reads the whole file into tbl->buffer. Used for the files in /proc and
+ * /sys, whose size is not known in advance. */
+static int tbl_read_fd(tbl_t *tbl, int fd, size_t *ret_size) {
+  size_t size = 0;
+
+  while (42) {
+    if (size == tbl->buffer_size) {
+      size_t new_size = (tbl->buffer_size > 0) ? (2 * tbl->buffer_size) : 4096;
+      char *tmp = realloc(tbl->buffer, new_size);
+      if (tmp == NULL) {
+        log_err("realloc failed: %s.", STRERRNO);
+        return -1;
+      }
+      tbl->buffer = tmp;
+      tbl->buffer_size = new_size;
     }
+
+    ssize_t status = read(fd, tbl->buffer + size, tbl->buffer_size - size);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      log_err("Failed to read from file \"%s\": %s.", tbl->file, STRERRNO);
+      return -1;
+    } else if (status == 0) {
+      break;
+    }
+    size += (size_t)status;
+  }
+
+  *ret_size = size;
   return 0;
-} /* tbl_parse_line */
+} /* tbl_read_fd */
+
+static void tbl_stat_mtime(const struct stat *st, struct timespec *ret) {
+#if HAVE_STRUCT_STAT_ST_MTIM
+  *ret = st->st_mtim;
+#else
+  *ret = (struct timespec){.tv_sec = st->st_mtime};
+#endif
+} /* tbl_stat_mtime */
+
+static bool tbl_file_unchanged(const tbl_t *tbl, const struct stat *st) {
+  struct timespec mtime;
+  tbl_stat_mtime(st, &mtime);
+
+  return tbl->cached && (tbl->dev == st->st_dev) && (tbl->ino == st->st_ino) &&
+         (tbl->size == st->st_size) && (tbl->mtime.tv_sec == mtime.tv_sec) &&
+         (tbl->mtime.tv_nsec == mtime.tv_nsec);
+} /* tbl_file_unchanged */
+
+static int tbl_dispatch_rows(tbl_t *tbl) {
+  for (size_t i = 0; i < tbl->rows_num; i++) {
+    tbl_row_t *row = tbl->rows + i;
+    tbl_result_t *res = tbl->results + row->result;
+    value_list_t vl = VALUE_LIST_INIT;
+
+    vl.values = tbl->values + row->values_offset;
+    vl.values_len = res->values_num;
+    tbl_vl_init(tbl, res, &vl);
+    sstrncpy(vl.type_instance, row->type_instance, sizeof(vl.type_instance));
+
+    plugin_dispatch_values(&vl);
+  }
+  return 0;
+} /* tbl_dispatch_rows */
 
 static int tbl_read_table(tbl_t *tbl) {
-  char buf[4096];
-
-  FILE *fh = fopen(tbl->file, "r");
-  if (fh == NULL) {
+  int fd = open(tbl->file, O_RDONLY);
+  if (fd < 0) {
     log_err("Failed to open file \"%s\": %s.", tbl->file, STRERRNO);
+    tbl->cached = false;
     return -1;
   }
 
-  buf[sizeof(buf) - 1] = '\0';
-  while (fgets(buf, sizeof(buf), fh) != NULL) {
-    if (buf[sizeof(buf) - 1] != '\0') {
-      buf[sizeof(buf) - 1] = '\0';
-      log_warn("Table %s: Truncated line: %s", tbl->file, buf);
-    }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    log_err("Failed to stat file \"%s\": %s.", tbl->file, STRERRNO);
+    close(fd);
+    tbl->cached = false;
+    return -1;
+  }
 
-    if (tbl_parse_line(tbl, buf, sizeof(buf)) != 0) {
-      log_warn("Table %s: Failed to parse line: %s", tbl->file, buf);
-      continue;
+  /* Files in /proc and /sys report a size of zero. */
+  bool regular = S_ISREG(st.st_mode) && (st.st_size > 0);
+  if (regular && tbl_file_unchanged(tbl, &st)) {
+    close(fd);
+    return tbl_dispatch_rows(tbl);
+  }
+
+  tbl->cached = false;
+  tbl->rows_num = 0;
+  tbl->values_num = 0;
+
+  const char *data = NULL;
+  size_t size = 0;
+  void *map = MAP_FAILED;
+  if (regular && tbl->use_mmap) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+      log_warn("Table %s: mmap failed: %s. Reading the file instead.",
+               tbl->file, STRERRNO);
+  }
+
+  if (map != MAP_FAILED) {
+    data = map;
+    size = (size_t)st.st_size;
+  } else {
+    if (tbl_read_fd(tbl, fd, &size) != 0) {
+      close(fd);
+      return -1;
     }
+    data = tbl->buffer;
   }
+  close(fd);
 
-  if (ferror(fh) != 0) {
-    log_err("Failed to read from file \"%s\": %s.", tbl->file, STRERRNO);
-    fclose(fh);
-    return -1;
+  int status = tbl_parse_buffer(tbl, data, size, /* record = */ regular);
+
+  if (map != MAP_FAILED)
+    munmap(map, (size_t)st.st_size);
+
+  if (regular && (status == 0)) {
+    tbl->cached = true;
+    tbl->dev = st.st_dev;
+    tbl->ino = st.st_ino;
+    tbl->size = st.st_size;
+    tbl_stat_mtime(&st, &tbl->mtime);
   }
 
-  fclose(fh);
   return 0;
 } /* tbl_read_table */
 
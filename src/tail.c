@@ -37,6 +37,7 @@
  *      Plugin "mail"
  *      Instance "exim"
  *      Interval 60
+ *      Follow false
  *	<Match>
  *	  Regex "S=([1-9][0-9]*)"
  *	  ExcludeRegex "U=root.*S="
@@ -241,7 +242,12 @@ static int ctail_config_add_file(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &plugin_instance);
     else if (strcasecmp("Interval", option->key) == 0)
       cf_util_get_cdtime(option, &interval);
-    else if (strcasecmp("Match", option->key) == 0) {
+    else if (strcasecmp("Follow", option->key) == 0) {
+      bool follow = false;
+      status = cf_util_get_boolean(option, &follow);
+      if ((status == 0) && follow)
+        status = tail_match_follow(tm);
+    }    else if (strcasecmp("Match", option->key) == 0) {
       status = ctail_config_add_match(tm, plugin_name, plugin_instance, option);
       if (status == 0)
         num_matches++;
@@ -33,6 +33,9 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+/* Size of the chunks read from the file, see cu_tail_read(). */
+#define TCSV_BUFFER_SIZE 65536
+
 struct metric_definition_s {
   char *name;
   char *type;
@@ -52,6 +55,11 @@ struct instance_definition_s {
   metric_definition_t **metric_list;
   size_t metric_list_len;
   ssize_t time_from;
+  /* Each line is split once into the first `fields_num' fields, which are
+   * all the metrics and the time refer to. */
+  char **fields;
+  size_t fields_num;
+  char *buffer;
   struct instance_definition_s *next;
 };
 typedef struct instance_definition_s instance_definition_t;
@@ -94,9 +102,8 @@ static cdtime_t parse_time(char const *tbuf) {
 }
 
 static int tcsv_read_metric(instance_definition_t *id, metric_definition_t *md,
-                            char **fields, size_t fields_num) {
+                            char **fields, size_t fields_num, cdtime_t t) {
   value_t v;
-  cdtime_t t = 0;
   int status;
 
   if (md->data_source_type == -1)
@@ -110,12 +117,6 @@ static int tcsv_read_metric(instance_definition_t *id, metric_definition_t *md,
   if (status != 0)
     return status;
 
-  if (id->time_from >= 0) {
-    if (((size_t)id->time_from) >= fields_num)
-      return EINVAL;
-    t = parse_time(fields[id->time_from]);
-  }
-
   return tcsv_submit(id, md, v, t);
 }
 
@@ -134,11 +135,8 @@ static bool tcsv_check_index(ssize_t index, size_t fields_num,
 
 static int tcsv_read_buffer(instance_definition_t *id, char *buffer,
                             size_t buffer_size) {
-  char **metrics;
-  size_t metrics_num;
-
-  char *ptr;
-  size_t i;
+  char **fields = id->fields;
+  size_t fields_num;
 
   /* Remove newlines at the end of line. */
   while (buffer_size > 0) {
@@ -155,53 +153,52 @@ static int tcsv_read_buffer(instance_definition_t *id, char *buffer,
   if ((buffer_size == 0) || (buffer[0] == '#'))
     return 0;
 
-  /* Count the number of fields. */
-  metrics_num = 1;
-  for (i = 0; i < buffer_size; i++) {
-    if (buffer[i] == id->field_separator)
-      metrics_num++;
-  }
-
-  if (metrics_num == 1) {
+  if (memchr(buffer, id->field_separator, buffer_size) == NULL) {
     ERROR("tail_csv plugin: last line of `%s' does not contain "
           "enough values.",
           id->path);
     return -1;
   }
 
-  /* Create a list of all values */
-  metrics = calloc(metrics_num, sizeof(*metrics));
-  if (metrics == NULL) {
-    ERROR("tail_csv plugin: calloc failed.");
-    return ENOMEM;
+  /* Split the line in place. Fields after the last one used are not
+   * looked at. */
+  char *ptr = buffer;
+  char *end = buffer + buffer_size;
+  fields_num = 0;
+  while (fields_num < id->fields_num) {
+    fields[fields_num] = ptr;
+    fields_num++;
+
+    char *sep = memchr(ptr, id->field_separator, (size_t)(end - ptr));
+    if (sep == NULL)
+      break;
+    *sep = 0;
+    ptr = sep + 1;
   }
 
-  ptr = buffer;
-  metrics[0] = ptr;
-  i = 1;
-  for (ptr = buffer; *ptr != 0; ptr++) {
-    if (*ptr != id->field_separator)
-      continue;
-
-    *ptr = 0;
-    metrics[i] = ptr + 1;
-    i++;
-  }
-  assert(i == metrics_num);
+  cdtime_t t = 0;
+  if ((id->time_from >= 0) && (((size_t)id->time_from) < fields_num))
+    t = parse_time(fields[id->time_from]);
 
   /* Register values */
-  for (i = 0; i < id->metric_list_len; ++i) {
+  for (size_t i = 0; i < id->metric_list_len; ++i) {
     metric_definition_t *md = id->metric_list[i];
 
-    if (!tcsv_check_index(md->value_from, metrics_num, md->name) ||
-        !tcsv_check_index(id->time_from, metrics_num, md->name))
+    if (!tcsv_check_index(md->value_from, fields_num, md->name) ||
+        !tcsv_check_index(id->time_from, fields_num, md->name))
       continue;
 
-    tcsv_read_metric(id, md, metrics, metrics_num);
+    tcsv_read_metric(id, md, fields, fields_num, t);
   }
 
-  /* Free up resources */
-  sfree(metrics);
+  return 0;
+}
+
+static int tcsv_read_line(void *data, char *buffer,
+                          int __attribute__((unused)) buffer_len) {
+  instance_definition_t *id = data;
+
+  tcsv_read_buffer(id, buffer, strlen(buffer));
   return 0;
 }
 
@@ -217,24 +214,13 @@ static int tcsv_read(user_data_t *ud) {
     }
   }
 
-  while (42) {
-    char buffer[1024];
-    size_t buffer_len;
-    int status;
-
-    status = cu_tail_readline(id->tail, buffer, (int)sizeof(buffer), 0);
-    if (status != 0) {
-      ERROR("tail_csv plugin: File \"%s\": cu_tail_readline failed "
-            "with status %i.",
-            id->path, status);
-      return -1;
-    }
-
-    buffer_len = strlen(buffer);
-    if (buffer_len == 0)
-      break;
-
-    tcsv_read_buffer(id, buffer, buffer_len);
+  int status = cu_tail_read(id->tail, id->buffer, TCSV_BUFFER_SIZE,
+                            tcsv_read_line, id, /* force_rewind = */ false);
+  if (status != 0) {
+    ERROR("tail_csv plugin: File \"%s\": cu_tail_read failed "
+          "with status %i.",
+          id->path, status);
+    return -1;
   }
 
   return 0;
@@ -385,6 +371,8 @@ static void tcsv_instance_definition_destroy(void *arg) {
   sfree(id->instance);
   sfree(id->path);
   sfree(id->metric_list);
+  sfree(id->fields);
+  sfree(id->buffer);
   sfree(id);
 }
 
@@ -503,6 +491,20 @@ static int tcsv_config_add_file(oconfig_item_t *ci) {
     return -1;
   }
 
+  /* The fields needed by all metrics of this file. */
+  id->fields_num = (id->time_from >= 0) ? (size_t)(id->time_from + 1) : 1;
+  for (size_t i = 0; i < id->metric_list_len; i++)
+    if ((size_t)(id->metric_list[i]->value_from + 1) > id->fields_num)
+      id->fields_num = (size_t)(id->metric_list[i]->value_from + 1);
+
+  id->fields = calloc(id->fields_num, sizeof(*id->fields));
+  id->buffer = malloc(TCSV_BUFFER_SIZE);
+  if ((id->fields == NULL) || (id->buffer == NULL)) {
+    ERROR("tail_csv plugin: malloc failed.");
+    tcsv_instance_definition_destroy(id);
+    return -1;
+  }
+
   snprintf(cb_name, sizeof(cb_name), "tail_csv/%s", id->path);
 
   status = plugin_register_complex_read(
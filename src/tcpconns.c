@@ -77,6 +77,7 @@
 
 #if KERNEL_LINUX
 #include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #if HAVE_LINUX_INET_DIAG_H
 #include <linux/inet_diag.h>
 #endif
@@ -264,6 +265,9 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int port_collect_listening;
 static int port_collect_total;
 static port_entry_t *port_list_head;
+/* Direct index into the list above, so that looking up the ports of a
+ * connection takes constant time regardless of how many ports are watched. */
+static port_entry_t *port_table[UINT16_MAX + 1];
 static uint32_t count_total[TCP_STATE_MAX + 1];
 
 #if KERNEL_LINUX
@@ -272,6 +276,23 @@ static uint32_t count_total[TCP_STATE_MAX + 1];
  * sequence_number is useless and we get a compilation warning.
  */
 static uint32_t sequence_number;
+
+/* The kernel fills dump messages up to the size of the largest buffer passed
+ * to recv(2), so a large buffer means fewer system calls. */
+#define NETLINK_BUFFER_SIZE 32768
+#define NETLINK_RCVBUF_SIZE (1024 * 1024)
+#define NETLINK_FILTER_MAX 32768
+#define TCP_STATES_ALL 0xfff
+
+static char *nl_buffer;
+static size_t nl_buffer_size;
+
+/* inet_diag bytecode matching the configured ports, see
+ * conn_build_port_filter(). */
+static char *port_filter;
+static size_t port_filter_len;
+static size_t port_filter_size;
+static bool port_filter_failed;
 #endif
 
 static enum { SRC_DUNNO, SRC_NETLINK, SRC_PROC } linux_source = SRC_DUNNO;
@@ -344,14 +365,7 @@ static void conn_submit_all(void) {
 } /* void conn_submit_all */
 
 static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
-  port_entry_t *ret;
-
-  ret = port_list_head;
-  while (ret != NULL) {
-    if (ret->port == port)
-      break;
-    ret = ret->next;
-  }
+  port_entry_t *ret = port_table[port];
 
   if ((ret == NULL) && (create != 0)) {
     ret = calloc(1, sizeof(*ret));
@@ -361,6 +375,7 @@ static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
     ret->port = port;
     ret->next = port_list_head;
     port_list_head = ret;
+    port_table[port] = ret;
   }
 
   return ret;
@@ -390,6 +405,7 @@ static void conn_reset_port_entry(void) {
       else
         prev->next = next;
 
+      port_table[pe->port] = NULL;
       sfree(pe);
       pe = next;
 
@@ -444,24 +460,90 @@ static int conn_handle_ports(uint16_t port_local, uint16_t port_remote,
 } /* int conn_handle_ports */
 
 #if KERNEL_LINUX
-/* Returns zero on success, less than zero on socket error and greater than
- * zero on other errors. */
-static int conn_read_netlink(void) {
 #if HAVE_STRUCT_LINUX_INET_DIAG_REQ
-  int fd;
-  struct inet_diag_msg *r;
-  char buf[8192];
+static void conn_filter_append(char *filter, size_t filter_len, size_t *offset,
+                               uint8_t code, uint16_t port) {
+  size_t cond_len =
+      sizeof(struct inet_diag_bc_op) + sizeof(struct inet_diag_hostcond);
+
+  /* Jump to the next condition if the port doesn't match. After the last
+   * condition, this jumps past the end of the program, rejecting the socket.
+   * The address family AF_UNSPEC with a prefix length of zero matches any
+   * address. */
+  struct inet_diag_bc_op *op = (void *)(filter + *offset);
+  op->code = code;
+  op->yes = (uint8_t)cond_len;
+  op->no = (uint16_t)(cond_len + sizeof(*op));
+
+  struct inet_diag_hostcond *cond = (void *)(op + 1);
+  cond->family = AF_UNSPEC;
+  cond->prefix_len = 0;
+  cond->port = port;
+  *offset += cond_len;
+
+  /* A match falls through to this jump to the end of the program, accepting
+   * the socket. */
+  if (*offset < filter_len) {
+    struct inet_diag_bc_op *jmp = (void *)(filter + *offset);
+    jmp->code = INET_DIAG_BC_JMP;
+    jmp->yes = sizeof(*jmp);
+    jmp->no = (uint16_t)(filter_len - *offset);
+    *offset += sizeof(*jmp);
+  }
+} /* void conn_filter_append */
+
+/* Builds the inet_diag bytecode accepting the sockets whose local port is
+ * configured with "LocalPort" or is listening, or whose remote port is
+ * configured with "RemotePort", so that the kernel doesn't send the other
+ * sockets at all. The conditions are joined like ss(8) joins "or"
+ * expressions. */
+static int conn_build_port_filter(void) {
+  size_t conds_num = 0;
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING))
+      conds_num++;
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      conds_num++;
+  }
 
-  /* If this fails, it's likely a permission problem. We'll fall back to
-   * reading this information from files below. */
-  fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
-  if (fd < 0) {
-    ERROR("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
-          "NETLINK_INET_DIAG) failed: %s",
-          STRERRNO);
-    return -1;
+  port_filter_len = 0;
+  if (conds_num == 0)
+    return 0;
+
+  size_t len = conds_num * (2 * sizeof(struct inet_diag_bc_op) +
+                            sizeof(struct inet_diag_hostcond)) -
+               sizeof(struct inet_diag_bc_op);
+  /* Jump offsets are 16 bit wide. */
+  if (len > NETLINK_FILTER_MAX)
+    return E2BIG;
+
+  if (len > port_filter_size) {
+    char *tmp = realloc(port_filter, len);
+    if (tmp == NULL)
+      return ENOMEM;
+    port_filter = tmp;
+    port_filter_size = len;
+  }
+  memset(port_filter, 0, len);
+
+  size_t offset = 0;
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & (PORT_COLLECT_LOCAL | PORT_IS_LISTENING))
+      conn_filter_append(port_filter, len, &offset, INET_DIAG_BC_S_COND,
+                         pe->port);
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      conn_filter_append(port_filter, len, &offset, INET_DIAG_BC_D_COND,
+                         pe->port);
   }
+  port_filter_len = len;
+
+  return 0;
+} /* int conn_build_port_filter */
 
+/* Requests the sockets in "states", optionally restricted by the port filter,
+ * and handles all of them. Returns zero on success, less than zero on socket
+ * error and greater than zero on other errors. */
+static int conn_netlink_dump(int fd, uint32_t states, bool use_filter) {
   struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
 
   struct nlreq req = {
@@ -477,52 +559,65 @@ static int conn_read_netlink(void) {
        * message in case the system is/was out of memory. */
       .nlh.nlmsg_seq = ++sequence_number,
       .r.idiag_family = AF_INET,
-      .r.idiag_states = 0xfff,
+      .r.idiag_states = states,
       .r.idiag_ext = 0};
 
-  struct iovec iov = {.iov_base = &req, .iov_len = sizeof(req)};
+  struct rtattr rta = {.rta_type = INET_DIAG_REQ_BYTECODE};
+  struct iovec iov[3] = {{.iov_base = &req, .iov_len = sizeof(req)}};
+  size_t iov_num = 1;
+
+  if (use_filter) {
+    rta.rta_len = RTA_LENGTH(port_filter_len);
+    iov[1] = (struct iovec){.iov_base = &rta, .iov_len = sizeof(rta)};
+    iov[2] = (struct iovec){.iov_base = port_filter,
+                            .iov_len = port_filter_len};
+    iov_num = 3;
+    req.nlh.nlmsg_len += RTA_SPACE(port_filter_len);
+  }
 
   struct msghdr msg = {.msg_name = (void *)&nladdr,
                        .msg_namelen = sizeof(nladdr),
-                       .msg_iov = &iov,
-                       .msg_iovlen = 1};
+                       .msg_iov = iov,
+                       .msg_iovlen = iov_num};
 
   if (sendmsg(fd, &msg, 0) < 0) {
     ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
           STRERRNO);
-    close(fd);
     return -1;
   }
 
-  iov.iov_base = buf;
-  iov.iov_len = sizeof(buf);
-
   while (1) {
     struct nlmsghdr *h;
 
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (void *)&nladdr;
-    msg.msg_namelen = sizeof(nladdr);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
+    /* Peek at the size of the next message and grow the buffer if needed, so
+     * that no message is ever truncated. */
+    ssize_t status = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    if ((status > 0) && ((size_t)status > nl_buffer_size)) {
+      char *tmp = realloc(nl_buffer, (size_t)status);
+      if (tmp == NULL) {
+        ERROR("tcpconns plugin: conn_read_netlink: realloc failed.");
+        return -1;
+      }
+      nl_buffer = tmp;
+      nl_buffer_size = (size_t)status;
+    }
+    if (status >= 0)
+      status = recv(fd, nl_buffer, nl_buffer_size, /* flags = */ 0);
 
-    ssize_t status = recvmsg(fd, (void *)&msg, /* flags = */ 0);
     if (status < 0) {
       if ((errno == EINTR) || (errno == EAGAIN))
         continue;
 
-      ERROR("tcpconns plugin: conn_read_netlink: recvmsg(2) failed: %s",
+      ERROR("tcpconns plugin: conn_read_netlink: recv(2) failed: %s",
             STRERRNO);
-      close(fd);
       return -1;
     } else if (status == 0) {
-      close(fd);
       DEBUG("tcpconns plugin: conn_read_netlink: Unexpected zero-sized "
             "reply from netlink socket.");
       return 0;
     }
 
-    h = (struct nlmsghdr *)buf;
+    h = (struct nlmsghdr *)nl_buffer;
     while (NLMSG_OK(h, status)) {
       if (h->nlmsg_seq != sequence_number) {
         h = NLMSG_NEXT(h, status);
@@ -530,7 +625,6 @@ static int conn_read_netlink(void) {
       }
 
       if (h->nlmsg_type == NLMSG_DONE) {
-        close(fd);
         return 0;
       } else if (h->nlmsg_type == NLMSG_ERROR) {
         struct nlmsgerr *msg_error;
@@ -539,11 +633,10 @@ static int conn_read_netlink(void) {
         WARNING("tcpconns plugin: conn_read_netlink: Received error %i.",
                 msg_error->error);
 
-        close(fd);
         return 1;
       }
 
-      r = NLMSG_DATA(h);
+      struct inet_diag_msg *r = NLMSG_DATA(h);
 
       /* This code does not (need to) distinguish between IPv4 and IPv6. */
       conn_handle_ports(ntohs(r->id.idiag_sport), ntohs(r->id.idiag_dport),
@@ -555,6 +648,80 @@ static int conn_read_netlink(void) {
 
   /* Not reached because the while() loop above handles the exit condition. */
   return 0;
+} /* int conn_netlink_dump */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
+
+/* Returns zero on success, less than zero on socket error and greater than
+ * zero on other errors. */
+static int conn_read_netlink(void) {
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  int fd;
+
+  /* If this fails, it's likely a permission problem. We'll fall back to
+   * reading this information from files below. */
+  fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_INET_DIAG);
+  if (fd < 0) {
+    ERROR("tcpconns plugin: conn_read_netlink: socket(AF_NETLINK, SOCK_RAW, "
+          "NETLINK_INET_DIAG) failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  /* Let the kernel queue more dump messages while we are busy parsing. This is
+   * a hint only, so failure is not an error. */
+  int rcvbuf = NETLINK_RCVBUF_SIZE;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  if (nl_buffer == NULL) {
+    nl_buffer = malloc(NETLINK_BUFFER_SIZE);
+    if (nl_buffer == NULL) {
+      ERROR("tcpconns plugin: conn_read_netlink: malloc failed.");
+      close(fd);
+      return -1;
+    }
+    nl_buffer_size = NETLINK_BUFFER_SIZE;
+  }
+
+  int status;
+  if (port_collect_total || port_filter_failed) {
+    /* The summary needs to see every socket. */
+    status = conn_netlink_dump(fd, TCP_STATES_ALL, /* use_filter = */ false);
+  } else {
+    /* Listening sockets are few, so they are all read first. That way, the
+     * filter for the other sockets can include the ports found listening. */
+    uint32_t states = TCP_STATES_ALL;
+    status = 0;
+    if (port_collect_listening) {
+      status = conn_netlink_dump(fd, 1 << TCP_STATE_LISTEN,
+                                 /* use_filter = */ false);
+      states &= ~(1 << TCP_STATE_LISTEN);
+    }
+
+    if (status == 0) {
+      status = conn_build_port_filter();
+      if (status != 0) {
+        WARNING("tcpconns plugin: Building the socket filter failed: %s. "
+                "Will read all sockets from now on.",
+                STRERROR(status));
+        status = 1;
+      } else if (port_filter_len > 0) {
+        status = conn_netlink_dump(fd, states, /* use_filter = */ true);
+        if (status > 0)
+          WARNING("tcpconns plugin: The kernel rejected the socket filter. "
+                  "Will read all sockets from now on.");
+      }
+
+      if (status > 0) {
+        port_filter_failed = true;
+        conn_reset_port_entry();
+        status =
+            conn_netlink_dump(fd, TCP_STATES_ALL, /* use_filter = */ false);
+      }
+    }
+  }
+
+  close(fd);
+  return status;
 #else
   return 1;
 #endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
@@ -684,6 +851,18 @@ static int conn_init(void) {
   return 0;
 } /* int conn_init */
 
+static int conn_shutdown(void) {
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  sfree(nl_buffer);
+  nl_buffer_size = 0;
+  sfree(port_filter);
+  port_filter_len = 0;
+  port_filter_size = 0;
+#endif
+
+  return 0;
+} /* int conn_shutdown */
+
 static int conn_read(void) {
   int status;
 
@@ -1025,6 +1204,7 @@ void module_register(void) {
   plugin_register_config("tcpconns", conn_config, config_keys, config_keys_num);
 #if KERNEL_LINUX
   plugin_register_init("tcpconns", conn_init);
+  plugin_register_shutdown("tcpconns", conn_shutdown);
 #elif HAVE_SYSCTLBYNAME
   /* no initialization */
 #elif HAVE_LIBKVM_NLIST
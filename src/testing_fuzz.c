@@ -0,0 +1,136 @@
+/**
+ * collectd - src/testing_fuzz.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Stand-in for a fuzzing engine: calls LLVMFuzzerTestOneInput() once for each
+ * file given on the command line, or for each file in a given directory. The
+ * fuzz targets are linked with this unless LIB_FUZZING_ENGINE is set, so that
+ * a corpus, or the input of a crash, can be replayed with any compiler, e.g.
+ * under valgrind.
+ *
+ * Usage: fuzz_<target> <file or directory> ...
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+static size_t inputs_num;
+
+static int run_file(char const *file) {
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL) {
+    fprintf(stderr, "fopen(%s): %s\n", file, strerror(errno));
+    return -1;
+  }
+
+  uint8_t *data = NULL;
+  size_t size = 0;
+  size_t alloc = 0;
+  while (!feof(fh) && !ferror(fh)) {
+    if (size == alloc) {
+      alloc = (alloc == 0) ? 4096 : 2 * alloc;
+      uint8_t *tmp = realloc(data, alloc);
+      if (tmp == NULL) {
+        free(data);
+        fclose(fh);
+        return ENOMEM;
+      }
+      data = tmp;
+    }
+    size += fread(data + size, 1, alloc - size, fh);
+  }
+  int status = ferror(fh) ? EIO : 0;
+  fclose(fh);
+
+  if (status == 0) {
+    /* Copy the input to a buffer of the exact size, so that reading past its
+     * end is caught by AddressSanitizer or valgrind. */
+    uint8_t *input = malloc((size > 0) ? size : 1);
+    if (input == NULL) {
+      free(data);
+      return ENOMEM;
+    }
+    memcpy(input, data, size);
+    LLVMFuzzerTestOneInput(input, size);
+    free(input);
+    inputs_num++;
+  }
+
+  free(data);
+  return status;
+}
+
+static int run_path(char const *path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "stat(%s): %s\n", path, strerror(errno));
+    return -1;
+  }
+  if (!S_ISDIR(st.st_mode))
+    return run_file(path);
+
+  DIR *dh = opendir(path);
+  if (dh == NULL) {
+    fprintf(stderr, "opendir(%s): %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  int status = 0;
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+
+    char file[4096];
+    snprintf(file, sizeof(file), "%s/%s", path, de->d_name);
+    if ((stat(file, &st) != 0) || !S_ISREG(st.st_mode))
+      continue;
+    if (run_file(file) != 0)
+      status = -1;
+  }
+
+  closedir(dh);
+  return status;
+}
+
+int main(int argc, char **argv) {
+  if (LLVMFuzzerInitialize != NULL)
+    LLVMFuzzerInitialize(&argc, &argv);
+
+  int status = 0;
+  for (int i = 1; i < argc; i++)
+    if (run_path(argv[i]) != 0)
+      status = 1;
+
+  printf("Ran %zu inputs.\n", inputs_num);
+  return status;
+}
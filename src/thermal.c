@@ -24,6 +24,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
+#include "utils/proc_file/proc_file.h"
 
 #if !KERNEL_LINUX
 #error "This module is for Linux only."
@@ -40,6 +41,23 @@ static ignorelist_t *device_list;
 
 enum dev_type { TEMP = 0, COOLING_DEV };
 
+#define THERMAL_VALUE_FILE_SIZE 64
+/* Devices are looked up again after this many reads, to notice zones and
+ * cooling devices registered after startup. */
+#define THERMAL_RESCAN_READS 60
+
+/* A zone or cooling device. Its attribute files are kept open. */
+typedef struct {
+  char name[DATA_MAX_NAME_LEN];
+  proc_file_t *temp;      /* "temp" in sysfs, "temperature" in procfs */
+  proc_file_t *cur_state; /* sysfs only */
+} thermal_device_t;
+
+static thermal_device_t *devices;
+static size_t devices_num;
+static bool rescan = true;
+static int reads_since_scan;
+
 static void thermal_submit(const char *plugin_instance, enum dev_type dt,
                            value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -55,56 +73,123 @@ static void thermal_submit(const char *plugin_instance, enum dev_type dt,
   plugin_dispatch_values(&vl);
 }
 
-static int thermal_sysfs_device_read(const char __attribute__((unused)) * dir,
-                                     const char *name,
-                                     void __attribute__((unused)) * user_data) {
+static void thermal_devices_free(void) {
+  for (size_t i = 0; i < devices_num; i++) {
+    proc_file_destroy(devices[i].temp);
+    proc_file_destroy(devices[i].cur_state);
+  }
+  sfree(devices);
+  devices_num = 0;
+}
+
+/* Returns a handle for `dir'/`name'/`file', or NULL if the file doesn't
+ * exist. */
+static proc_file_t *thermal_file_create(const char *dir, const char *name,
+                                        const char *file) {
   char filename[PATH_MAX];
-  bool success = false;
-  value_t value;
+  int len = snprintf(filename, sizeof(filename), "%s/%s/%s", dir, name, file);
+  if ((len < 0) || ((size_t)len >= sizeof(filename)))
+    return NULL;
+  if (access(filename, R_OK) != 0)
+    return NULL;
+  return proc_file_create_size(filename, THERMAL_VALUE_FILE_SIZE);
+}
+
+static int thermal_device_add(const char *dir, const char *name,
+                              void *user_data) {
+  bool is_procfs = (user_data != NULL);
 
   if (device_list && ignorelist_match(device_list, name))
+    return 0;
+
+  thermal_device_t dev = {
+      .temp = thermal_file_create(dir, name,
+                                  is_procfs ? "temperature" : "temp"),
+      .cur_state =
+          is_procfs ? NULL : thermal_file_create(dir, name, "cur_state"),
+  };
+  if ((dev.temp == NULL) && (dev.cur_state == NULL))
+    return 0;
+  sstrncpy(dev.name, name, sizeof(dev.name));
+
+  thermal_device_t *tmp =
+      realloc(devices, (devices_num + 1) * sizeof(*devices));
+  if (tmp == NULL) {
+    ERROR("thermal plugin: realloc failed.");
+    proc_file_destroy(dev.temp);
+    proc_file_destroy(dev.cur_state);
+    return ENOMEM;
+  }
+  devices = tmp;
+  devices[devices_num++] = dev;
+  return 0;
+}
+
+static int thermal_scan(const char *dir, bool is_procfs) {
+  if (!rescan && (reads_since_scan < THERMAL_RESCAN_READS)) {
+    reads_since_scan++;
+    return 0;
+  }
+
+  thermal_devices_free();
+  int status = walk_directory(dir, thermal_device_add,
+                              is_procfs ? (void *)dir : NULL, 0);
+  if (status != 0)
+    return status;
+
+  rescan = false;
+  reads_since_scan = 0;
+  return 0;
+}
+
+static int thermal_read_value(proc_file_t *pf, value_t *value) {
+  if (proc_file_read(pf) < 0)
+    return -1;
+
+  char const *line = proc_file_next_line(pf);
+  if (line == NULL)
     return -1;
 
-  snprintf(filename, sizeof(filename), "%s/%s/temp", dirname_sysfs, name);
-  if (parse_value_file(filename, &value, DS_TYPE_GAUGE) == 0) {
+  return parse_value(line, value, DS_TYPE_GAUGE);
+}
+
+static int thermal_sysfs_device_read(thermal_device_t *dev) {
+  bool success = false;
+  value_t value;
+
+  if ((dev->temp != NULL) && (thermal_read_value(dev->temp, &value) == 0)) {
     value.gauge /= 1000.0;
-    thermal_submit(name, TEMP, value);
+    thermal_submit(dev->name, TEMP, value);
     success = true;
   }
 
-  snprintf(filename, sizeof(filename), "%s/%s/cur_state", dirname_sysfs, name);
-  if (parse_value_file(filename, &value, DS_TYPE_GAUGE) == 0) {
-    thermal_submit(name, COOLING_DEV, value);
+  if ((dev->cur_state != NULL) &&
+      (thermal_read_value(dev->cur_state, &value) == 0)) {
+    thermal_submit(dev->name, COOLING_DEV, value);
     success = true;
   }
 
   return success ? 0 : -1;
 }
 
-static int thermal_procfs_device_read(const char __attribute__((unused)) * dir,
-                                      const char *name,
-                                      void __attribute__((unused)) *
-                                          user_data) {
+static int thermal_procfs_device_read(thermal_device_t *dev) {
   const char str_temp[] = "temperature:";
-  char filename[256];
-  char data[1024];
-  int len;
-
-  if (device_list && ignorelist_match(device_list, name))
-    return -1;
 
   /**
    * rechot ~ # cat /proc/acpi/thermal_zone/THRM/temperature
    * temperature:             55 C
    */
 
-  len = snprintf(filename, sizeof(filename), "%s/%s/temperature",
-                 dirname_procfs, name);
-  if ((len < 0) || ((size_t)len >= sizeof(filename)))
+  if (proc_file_read(dev->temp) < 0)
+    return -1;
+
+  /* The line is modified in place below. */
+  char *data = proc_file_next_line(dev->temp);
+  if (data == NULL)
     return -1;
+  size_t len = strlen(data);
 
-  len = (ssize_t)read_text_file_contents(filename, data, sizeof(data));
-  if ((len > 0) && ((size_t)len > sizeof(str_temp)) && (data[--len] == '\n') &&
+  if ((len >= sizeof(str_temp)) &&
       (!strncmp(data, str_temp, sizeof(str_temp) - 1))) {
     char *endptr = NULL;
     double temp;
@@ -134,7 +219,7 @@ static int thermal_procfs_device_read(const char __attribute__((unused)) * dir,
     temp = (strtod(data + len, &endptr) + add) * factor;
 
     if (endptr != data + len && errno == 0) {
-      thermal_submit(name, TEMP, (value_t){.gauge = temp});
+      thermal_submit(dev->name, TEMP, (value_t){.gauge = temp});
       return 0;
     }
   }
@@ -167,12 +252,38 @@ static int thermal_config(const char *key, const char *value) {
   return 0;
 }
 
+static int thermal_read(const char *dir, bool is_procfs) {
+  int success = 0;
+  int failure = 0;
+
+  int status = thermal_scan(dir, is_procfs);
+  if (status != 0)
+    return status;
+
+  for (size_t i = 0; i < devices_num; i++) {
+    thermal_device_t *dev = devices + i;
+
+    status = is_procfs ? thermal_procfs_device_read(dev)
+                       : thermal_sysfs_device_read(dev);
+    if (status != 0) {
+      failure++;
+      /* The device may have been removed. */
+      rescan = true;
+    } else
+      success++;
+  }
+
+  if ((success == 0) && (failure > 0))
+    return -1;
+  return 0;
+}
+
 static int thermal_sysfs_read(void) {
-  return walk_directory(dirname_sysfs, thermal_sysfs_device_read, NULL, 0);
+  return thermal_read(dirname_sysfs, /* is_procfs = */ false);
 }
 
 static int thermal_procfs_read(void) {
-  return walk_directory(dirname_procfs, thermal_procfs_device_read, NULL, 0);
+  return thermal_read(dirname_procfs, /* is_procfs = */ true);
 }
 
 static int thermal_init(void) {
@@ -188,6 +299,7 @@ static int thermal_init(void) {
 }
 
 static int thermal_shutdown(void) {
+  thermal_devices_free();
   ignorelist_free(device_list);
 
   return 0;
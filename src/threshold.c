@@ -92,6 +92,10 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
     sfree(name_copy);
   }
 
+  /* Thresholds bound to cache entries may not be the best match anymore. */
+  if (status == 0)
+    __atomic_add_fetch(&threshold_generation, 1, __ATOMIC_RELEASE);
+
   pthread_mutex_unlock(&threshold_lock);
 
   if (status != 0) {
@@ -620,11 +624,9 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
   if (threshold_tree == NULL)
     return 0;
 
-  /* Is this lock really necessary? So far, thresholds are only inserted at
-   * startup. -octo */
-  pthread_mutex_lock(&threshold_lock);
-  th = threshold_search(vl);
-  pthread_mutex_unlock(&threshold_lock);
+  /* The matching threshold is looked up once per series and stored in the
+   * value's cache entry. */
+  th = threshold_lookup(vl);
   if (th == NULL)
     return 0;
 
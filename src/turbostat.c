@@ -57,6 +57,12 @@ typedef enum affinity_policy_enum {
 /* the default is to set cpu affinity to all cpus */
 static affinity_policy_t affinity_policy = policy_allcpus_affinity;
 
+/*
+ * If set, the counters of each package are read by a dedicated thread, which
+ * migrates itself to the CPUs of its package instead of the read thread.
+ */
+static bool config_package_threads;
+
 /*
  * This tool uses the Model-Specific Registers (MSRs) present on Intel
  * processors.
@@ -170,6 +176,10 @@ static cpu_set_t *cpu_present_set, *cpu_affinity_set, *cpu_saved_affinity_set;
 static size_t cpu_present_setsize, cpu_affinity_setsize,
     cpu_saved_affinity_setsize;
 
+/* MSR devices, indexed by cpu id and kept open between reads */
+static int *msr_fds;
+static unsigned int msr_fds_num;
+
 static struct thread_data {
   unsigned long long tsc;
   unsigned long long aperf;
@@ -253,6 +263,7 @@ static const char *config_keys[] = {
     "RunningAveragePowerLimit",
     "LogicalCoreNames",
     "RestoreAffinityPolicy",
+    "PackageThreads",
 };
 static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -261,33 +272,44 @@ static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
  *****************************/
 
 /*
- * Open a MSR device for reading
- * Can change the scheduling affinity of the current process if multiple_read is
- * true
+ * Migrate the calling thread to a CPU, so that the MSR reads of the CPU are
+ * not executed by inter-processor interrupts
+ *
+ * If we are not yet initialized (cpu_affinity_setsize = 0),
+ * we need to skip this optimisation.
  */
 static int __attribute__((warn_unused_result))
-open_msr(unsigned int cpu, bool multiple_read) {
-  char pathname[32];
-  int fd;
+migrate_to_cpu(unsigned int cpu) {
+  if (!cpu_affinity_setsize)
+    return 0;
 
-  /*
-   * If we need to do multiple read, let's migrate to the CPU
-   * Otherwise, we would lose time calling functions on another CPU
-   *
-   * If we are not yet initialized (cpu_affinity_setsize = 0),
-   * we need to skip this optimisation.
-   */
-  if (multiple_read && cpu_affinity_setsize) {
-    CPU_ZERO_S(cpu_affinity_setsize, cpu_affinity_set);
-    CPU_SET_S(cpu, cpu_affinity_setsize, cpu_affinity_set);
-    if (sched_setaffinity(0, cpu_affinity_setsize, cpu_affinity_set) == -1) {
-      ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
-      return -1;
-    }
+  /* The package threads read concurrently, so they need their own set */
+  cpu_set_t *set = CPU_ALLOC(topology.max_cpu_id + 1);
+  if (set == NULL) {
+    ERROR("turbostat plugin: Unable to allocate CPU set");
+    return -1;
   }
 
+  CPU_ZERO_S(cpu_affinity_setsize, set);
+  CPU_SET_S(cpu, cpu_affinity_setsize, set);
+  int status = sched_setaffinity(0, cpu_affinity_setsize, set);
+  CPU_FREE(set);
+  if (status == -1) {
+    ERROR("turbostat plugin: Could not migrate to CPU %d", cpu);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Open a MSR device for reading
+ */
+static int __attribute__((warn_unused_result)) open_msr(unsigned int cpu) {
+  char pathname[32];
+  int fd;
+
   snprintf(pathname, sizeof(pathname), "/dev/cpu/%d/msr", cpu);
-  fd = open(pathname, O_RDONLY);
+  fd = open(pathname, O_RDONLY | O_CLOEXEC);
   if (fd < 0) {
     ERROR("turbostat plugin: failed to open %s", pathname);
     return -1;
@@ -295,6 +317,28 @@ open_msr(unsigned int cpu, bool multiple_read) {
   return fd;
 }
 
+/*
+ * Return the MSR device of a CPU, opening it on first use
+ * Returns -1 if the devices have not been allocated by setup_all_buffers yet
+ */
+static int get_msr_fd(unsigned int cpu) {
+  if (cpu >= msr_fds_num)
+    return -1;
+
+  if (msr_fds[cpu] < 0)
+    msr_fds[cpu] = open_msr(cpu);
+  return msr_fds[cpu];
+}
+
+static void close_msr_fds(void) {
+  for (unsigned int cpu = 0; cpu < msr_fds_num; ++cpu) {
+    if (msr_fds[cpu] >= 0)
+      close(msr_fds[cpu]);
+  }
+  sfree(msr_fds);
+  msr_fds_num = 0;
+}
+
 /*
  * Read a single MSR from an open file descriptor
  */
@@ -313,7 +357,8 @@ read_msr(int fd, off_t offset, unsigned long long *msr) {
 }
 
 /*
- * Open a MSR device for reading, read the value asked for and close it.
+ * Read the value asked for from the MSR device of a CPU. Before the devices
+ * are allocated, the device is opened for this read only.
  * This call will not affect the scheduling affinity of this thread.
  */
 static ssize_t __attribute__((warn_unused_result))
@@ -321,7 +366,11 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   ssize_t retval;
   int fd;
 
-  fd = open_msr(cpu, 0);
+  fd = get_msr_fd(cpu);
+  if (fd >= 0)
+    return read_msr(fd, offset, msr);
+
+  fd = open_msr(cpu);
   if (fd < 0)
     return fd;
   retval = read_msr(fd, offset, msr);
@@ -350,7 +399,14 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   int msr_fd;
   int retval = 0;
 
-  msr_fd = open_msr(cpu, 1);
+  /*
+   * We need to do multiple reads, so let's migrate to the CPU
+   * Otherwise, we would lose time calling functions on another CPU
+   */
+  if (migrate_to_cpu(cpu) != 0)
+    return -1;
+
+  msr_fd = get_msr_fd(cpu);
   if (msr_fd < 0)
     return msr_fd;
 
@@ -448,7 +504,6 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   }
 
 out:
-  close(msr_fd);
   return retval;
 }
 
@@ -714,6 +769,36 @@ static int cpu_is_not_present(unsigned int cpu) {
  * Skip non-present cpus
  * Return the error code at the first error or 0
  */
+static int __attribute__((warn_unused_result))
+for_package_cpus(int(func)(struct thread_data *, struct core_data *,
+                           struct pkg_data *),
+                 struct thread_data *thread_base, struct core_data *core_base,
+                 struct pkg_data *pkg_base, unsigned int pkg_no) {
+  int retval;
+
+  for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
+    for (unsigned int thread_no = 0; thread_no < topology.num_threads;
+         ++thread_no) {
+      struct thread_data *t;
+      struct core_data *c;
+      struct pkg_data *p;
+
+      t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
+
+      if (cpu_is_not_present(t->cpu_id))
+        continue;
+
+      c = GET_CORE(core_base, core_no, pkg_no);
+      p = GET_PKG(pkg_base, pkg_no);
+
+      retval = func(t, c, p);
+      if (retval)
+        return retval;
+    }
+  }
+  return 0;
+}
+
 static int __attribute__((warn_unused_result))
 for_all_cpus(int(func)(struct thread_data *, struct core_data *,
                        struct pkg_data *),
@@ -722,28 +807,75 @@ for_all_cpus(int(func)(struct thread_data *, struct core_data *,
   int retval;
 
   for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
-    for (unsigned int core_no = 0; core_no < topology.num_cores; ++core_no) {
-      for (unsigned int thread_no = 0; thread_no < topology.num_threads;
-           ++thread_no) {
-        struct thread_data *t;
-        struct core_data *c;
-        struct pkg_data *p;
+    retval = for_package_cpus(func, thread_base, core_base, pkg_base, pkg_no);
+    if (retval)
+      return retval;
+  }
+  return 0;
+}
 
-        t = GET_THREAD(thread_base, thread_no, core_no, pkg_no);
+struct package_reader {
+  pthread_t thread;
+  struct thread_data *thread_base;
+  struct core_data *core_base;
+  struct pkg_data *pkg_base;
+  unsigned int pkg_no;
+  int retval;
+};
 
-        if (cpu_is_not_present(t->cpu_id))
-          continue;
+static void *package_reader_thread(void *arg) {
+  struct package_reader *r = arg;
 
-        c = GET_CORE(core_base, core_no, pkg_no);
-        p = GET_PKG(pkg_base, pkg_no);
+  r->retval = for_package_cpus(get_counters, r->thread_base, r->core_base,
+                               r->pkg_base, r->pkg_no);
+  return NULL;
+}
 
-        retval = func(t, c, p);
-        if (retval)
-          return retval;
-      }
+/*
+ * Read the counters of all CPUs, with one thread per package if
+ * PackageThreads is enabled
+ *
+ * The threads change their own scheduling affinity only, the affinity of the
+ * calling thread is left alone.
+ */
+static int __attribute__((warn_unused_result))
+get_all_counters(struct thread_data *thread_base, struct core_data *core_base,
+                 struct pkg_data *pkg_base) {
+  if (!config_package_threads || topology.num_packages < 2)
+    return for_all_cpus(get_counters, thread_base, core_base, pkg_base);
+
+  struct package_reader readers[topology.num_packages];
+  int retval = 0;
+
+  for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
+    struct package_reader *r = readers + pkg_no;
+
+    *r = (struct package_reader){
+        .thread_base = thread_base,
+        .core_base = core_base,
+        .pkg_base = pkg_base,
+        .pkg_no = pkg_no,
+    };
+    int status = plugin_thread_create(&r->thread, package_reader_thread, r,
+                                      "turbostat pkg");
+    if (status != 0) {
+      ERROR("turbostat plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      /* Read this package from the calling thread instead */
+      r->thread = pthread_self();
+      package_reader_thread(r);
     }
   }
-  return 0;
+
+  for (unsigned int pkg_no = 0; pkg_no < topology.num_packages; ++pkg_no) {
+    struct package_reader *r = readers + pkg_no;
+
+    if (!pthread_equal(r->thread, pthread_self()))
+      pthread_join(r->thread, NULL);
+    if (r->retval && !retval)
+      retval = r->retval;
+  }
+  return retval;
 }
 
 /*
@@ -1461,6 +1593,8 @@ static void free_all_buffers(void) {
   thread_delta = NULL;
   core_delta = NULL;
   package_delta = NULL;
+
+  close_msr_fds();
 }
 
   /**********************
@@ -1474,10 +1608,25 @@ static void free_all_buffers(void) {
       goto err;                                                                \
   } while (0)
 
+static int allocate_msr_fds(void) {
+  msr_fds_num = topology.max_cpu_id + 1;
+  msr_fds = calloc(msr_fds_num, sizeof(*msr_fds));
+  if (msr_fds == NULL) {
+    ERROR("turbostat plugin: calloc failed");
+    msr_fds_num = 0;
+    return -1;
+  }
+
+  for (unsigned int cpu = 0; cpu < msr_fds_num; ++cpu)
+    msr_fds[cpu] = -1;
+  return 0;
+}
+
 static int setup_all_buffers(void) {
   int ret;
 
   DO_OR_GOTO_ERR(topology_probe());
+  DO_OR_GOTO_ERR(allocate_msr_fds());
   DO_OR_GOTO_ERR(allocate_counters(&thread_even, &core_even, &package_even));
   DO_OR_GOTO_ERR(allocate_counters(&thread_odd, &core_odd, &package_odd));
   DO_OR_GOTO_ERR(allocate_counters(&thread_delta, &core_delta, &package_delta));
@@ -1542,7 +1691,7 @@ static int turbostat_read(void) {
   }
 
   if (!initialized) {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = get_all_counters(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = true;
@@ -1552,7 +1701,7 @@ static int turbostat_read(void) {
   }
 
   if (is_even) {
-    if ((ret = for_all_cpus(get_counters, ODD_COUNTERS)) < 0)
+    if ((ret = get_all_counters(ODD_COUNTERS)) < 0)
       goto out;
     time_odd = cdtime();
     is_even = false;
@@ -1562,7 +1711,7 @@ static int turbostat_read(void) {
     if ((ret = for_all_cpus(submit_counters, DELTA_COUNTERS)) < 0)
       goto out;
   } else {
-    if ((ret = for_all_cpus(get_counters, EVEN_COUNTERS)) < 0)
+    if ((ret = get_all_counters(EVEN_COUNTERS)) < 0)
       goto out;
     time_even = cdtime();
     is_even = true;
@@ -1692,6 +1841,8 @@ static int turbostat_config(const char *key, const char *value) {
       return -1;
     }
     tcc_activation_temp = (unsigned int)tmp_val;
+  } else if (strcasecmp("PackageThreads", key) == 0) {
+    config_package_threads = IS_TRUE(value);
   } else if (strcasecmp("RestoreAffinityPolicy", key) == 0) {
     if (strcasecmp("Restore", value) == 0)
       affinity_policy = policy_restore_affinity;
@@ -28,6 +28,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include "utils/cmds/flush.h"
 #include "utils/cmds/getthreshold.h"
@@ -40,6 +41,7 @@
 #include <sys/un.h>
 
 #include <grp.h>
+#include <poll.h>
 
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
@@ -47,12 +49,36 @@
 
 #define US_DEFAULT_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
+/* Maximum length of a command, including the newline. */
+#define US_LINE_SIZE 1024
+#define US_DEFAULT_THREADS 2
+#define US_DEFAULT_MAX_CONNECTIONS 128
+
+/*
+ * Private data types
+ */
+/* Connections are watched by the listening thread with poll(2). Once a
+ * complete command has been read, the connection is handed to a worker thread
+ * which runs all complete commands in its buffer and hands it back. A
+ * connection is not polled while a worker owns it, so its commands are run in
+ * order. */
+typedef struct us_client_s {
+  int fd;
+  FILE *fhout;
+  char buffer[US_LINE_SIZE];
+  size_t fill;
+  /* The client has closed its side or an error occurred. */
+  bool eof;
+  struct us_client_s *next;
+} us_client_t;
+
 /*
  * Private variables
  */
 /* valid configuration file keys */
-static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+static const char *config_keys[] = {"SocketFile",   "SocketGroup",
+                                    "SocketPerms",  "DeleteSocket",
+                                    "Threads",      "MaxConnections"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop;
@@ -66,6 +92,29 @@ static bool delete_socket;
 
 static pthread_t listen_thread = (pthread_t)0;
 
+static size_t threads_num = US_DEFAULT_THREADS;
+static size_t max_connections = US_DEFAULT_MAX_CONNECTIONS;
+
+/* Connections, owned by the listening thread. */
+static us_client_t **clients;
+static size_t clients_num;
+
+/* Connections waiting for or returned by a worker, protected by queue_lock.
+ */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static us_client_t *queue_head;
+static us_client_t *queue_tail;
+static us_client_t *done_head;
+static bool workers_stop;
+static pthread_t *workers;
+static size_t workers_num;
+
+/* Written to by the workers and us_shutdown() to wake up poll(2). */
+static int wakeup_pipe[2] = {-1, -1};
+
+static c_complain_t complaint_connections = C_COMPLAIN_INIT_STATIC;
+
 /*
  * Functions
  */
@@ -158,162 +207,381 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
-static void *us_handle_client(void *arg) {
-  int fdin;
-  int fdout;
-  FILE *fhin, *fhout;
+/* Runs one command. PUTVAL commands are acknowledged right away, but their
+ * value lists are only collected in `batch'; all other commands dispatch the
+ * batch first so that the order of commands is kept. Returns non-zero if the
+ * connection should be closed. */
+static int us_handle_command(FILE *fhout, cmd_putval_batch_t *batch,
+                             char *buffer) {
+  char buffer_copy[US_LINE_SIZE];
+  char *fields[128];
+  int fields_num;
+
+  size_t len = strlen(buffer);
+  while ((len > 0) && ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
+    buffer[--len] = '\0';
+
+  if (len == 0)
+    return 0;
 
-  fdin = *((int *)arg);
-  free(arg);
-  arg = NULL;
+  sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
 
-  DEBUG("unixsock plugin: us_handle_client: Reading from fd #%i", fdin);
+  fields_num =
+      strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
+  if (fields_num < 1) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
 
-  fdout = dup(fdin);
-  if (fdout < 0) {
-    ERROR("unixsock plugin: dup failed: %s", STRERRNO);
-    close(fdin);
-    pthread_exit((void *)1);
+  bool putval = (strcasecmp(fields[0], "putval") == 0);
+  if (!putval)
+    cmd_putval_batch_dispatch(batch);
+
+  if (putval && (batch == NULL)) {
+    cmd_handle_putval(fhout, buffer);
+  } else if (putval) {
+    cmd_error_handler_t err = {cmd_error_fh, fhout};
+    size_t vl_num = batch->vl_num;
+    if (cmd_putval_batch_add(batch, buffer, NULL, &err) == CMD_OK) {
+      vl_num = batch->vl_num - vl_num;
+      cmd_error(CMD_OK, &err, "Success: %i %s been dispatched.", (int)vl_num,
+                (vl_num == 1) ? "value has" : "values have");
+    }
+  } else if (strcasecmp(fields[0], "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+  } else if (strcasecmp(fields[0], "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+  } else if (strcasecmp(fields[0], "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+  } else {
+    if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
+      WARNING("unixsock plugin: failed to write to socket #%i: %s",
+              fileno(fhout), STRERRNO);
+      return -1;
+    }
   }
 
-  fhin = fdopen(fdin, "r");
-  if (fhin == NULL) {
-    ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
-    close(fdin);
-    close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+  if (ferror(fhout)) {
+    WARNING("unixsock plugin: failed to write to socket #%i: %s",
+            fileno(fhout), STRERRNO);
+    return -1;
   }
 
-  fhout = fdopen(fdout, "w");
-  if (fhout == NULL) {
+  return 0;
+} /* int us_handle_command */
+
+/* Runs all complete commands in the client's buffer. If the client has closed
+ * the connection, a trailing incomplete command is run as well. */
+static void us_handle_client(us_client_t *c, cmd_putval_batch_t *batch) {
+  size_t pos = 0;
+
+  while (pos < c->fill) {
+    char *line = c->buffer + pos;
+    char *end = memchr(line, '\n', c->fill - pos);
+    if ((end == NULL) && !c->eof)
+      break;
+
+    size_t len = (end != NULL) ? (size_t)(end - line) + 1 : c->fill - pos;
+    char command[US_LINE_SIZE];
+    memcpy(command, line, len);
+    command[len] = 0;
+    pos += len;
+
+    if (us_handle_command(c->fhout, batch, command) != 0) {
+      c->eof = true;
+      pos = c->fill;
+      break;
+    }
+  }
+  cmd_putval_batch_dispatch(batch);
+
+  memmove(c->buffer, c->buffer + pos, c->fill - pos);
+  c->fill -= pos;
+} /* void us_handle_client */
+
+static void us_wakeup(void) {
+  char c = 0;
+  if ((write(wakeup_pipe[1], &c, sizeof(c)) < 0) && (errno != EAGAIN))
+    ERROR("unixsock plugin: write to wakeup pipe failed: %s", STRERRNO);
+} /* void us_wakeup */
+
+static void *us_worker_thread(void __attribute__((unused)) * arg) {
+  /* Without a batch, PUTVAL commands are dispatched one by one. */
+  cmd_putval_batch_t *batch = cmd_putval_batch_create();
+  if (batch == NULL)
+    ERROR("unixsock plugin: cmd_putval_batch_create failed.");
+
+  pthread_mutex_lock(&queue_lock);
+  while (!workers_stop) {
+    us_client_t *c = queue_head;
+    if (c == NULL) {
+      pthread_cond_wait(&queue_cond, &queue_lock);
+      continue;
+    }
+
+    queue_head = c->next;
+    if (queue_head == NULL)
+      queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    us_handle_client(c, batch);
+
+    pthread_mutex_lock(&queue_lock);
+    c->next = done_head;
+    done_head = c;
+    us_wakeup();
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  cmd_putval_batch_destroy(batch);
+  return NULL;
+} /* void *us_worker_thread */
+
+static void us_client_destroy(us_client_t *c) {
+  if (c == NULL)
+    return;
+
+  DEBUG("unixsock plugin: Closing connection on fd #%i", c->fd);
+  if (c->fhout != NULL)
+    fclose(c->fhout);
+  close(c->fd);
+  sfree(c);
+} /* void us_client_destroy */
+
+/* Removes and closes the client at position `i'. */
+static void us_client_remove(size_t i) {
+  us_client_destroy(clients[i]);
+  clients[i] = clients[clients_num - 1];
+  clients_num--;
+} /* void us_client_remove */
+
+static void us_client_enqueue(us_client_t *c) {
+  pthread_mutex_lock(&queue_lock);
+  c->next = NULL;
+  if (queue_tail == NULL)
+    queue_head = c;
+  else
+    queue_tail->next = c;
+  queue_tail = c;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+} /* void us_client_enqueue */
+
+static void us_accept(void) {
+  int fd = accept(sock_fd, NULL, NULL);
+  if (fd < 0) {
+    if ((errno != EINTR) && (errno != EAGAIN) && (errno != ECONNABORTED))
+      ERROR("unixsock plugin: accept failed: %s", STRERRNO);
+    return;
+  }
+
+  if ((max_connections > 0) && (clients_num >= max_connections)) {
+    c_complain(LOG_WARNING, &complaint_connections,
+               "unixsock plugin: Rejecting connection: %zu clients are "
+               "already connected.",
+               clients_num);
+    static char const msg[] = "-1 Too many connections\n";
+    (void)swrite(fd, msg, sizeof(msg) - 1);
+    close(fd);
+    return;
+  }
+
+  us_client_t *c = calloc(1, sizeof(*c));
+  us_client_t **tmp = realloc(clients, (clients_num + 1) * sizeof(*clients));
+  if ((c == NULL) || (tmp == NULL)) {
+    ERROR("unixsock plugin: Allocating memory for a client failed.");
+    sfree(c);
+    close(fd);
+    return;
+  }
+  clients = tmp;
+  c->fd = fd;
+
+  int fdout = dup(fd);
+  if (fdout < 0) {
+    ERROR("unixsock plugin: dup failed: %s", STRERRNO);
+    us_client_destroy(c);
+    return;
+  }
+
+  c->fhout = fdopen(fdout, "w");
+  if (c->fhout == NULL) {
     ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
-    fclose(fhin); /* this closes fdin as well */
     close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+    us_client_destroy(c);
+    return;
   }
 
   /* change output buffer to line buffered mode */
-  if (setvbuf(fhout, NULL, _IOLBF, 0) != 0) {
+  if (setvbuf(c->fhout, NULL, _IOLBF, 0) != 0) {
     ERROR("unixsock plugin: setvbuf failed: %s", STRERRNO);
-    fclose(fhin);
-    fclose(fhout);
-    pthread_exit((void *)1);
-    return (void *)0;
+    us_client_destroy(c);
+    return;
   }
 
-  while (42) {
-    char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
-
-    errno = 0;
-    if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
-      if ((errno == EINTR) || (errno == EAGAIN))
-        continue;
+  DEBUG("unixsock plugin: Accepted connection on fd #%i", fd);
+  clients[clients_num++] = c;
+} /* void us_accept */
+
+/* Reads from the client at position `i', which poll(2) reported as readable,
+ * so read(2) does not block. Hands the client to a worker once a complete
+ * command has arrived. Returns true if the client is now owned by a worker or
+ * has been removed. */
+static bool us_read(size_t i) {
+  us_client_t *c = clients[i];
+
+  ssize_t status = read(c->fd, c->buffer + c->fill, sizeof(c->buffer) - 1 -
+                                                       c->fill);
+  if (status < 0) {
+    if ((errno == EINTR) || (errno == EAGAIN))
+      return false;
+    WARNING("unixsock plugin: failed to read from socket #%i: %s", c->fd,
+            STRERRNO);
+    us_client_remove(i);
+    return true;
+  }
 
-      if (errno != 0) {
-        WARNING("unixsock plugin: failed to read from socket #%i: %s",
-                fileno(fhin), STRERRNO);
-      }
-      break;
+  if (status == 0) {
+    c->eof = true;
+    if (c->fill == 0) {
+      us_client_remove(i);
+      return true;
     }
+  }
+  c->fill += (size_t)status;
 
-    size_t len = strlen(buffer);
-    while ((len > 0) &&
-           ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
-      buffer[--len] = '\0';
-
-    if (len == 0)
-      continue;
+  if (!c->eof && (memchr(c->buffer, '\n', c->fill) == NULL)) {
+    if (c->fill < sizeof(c->buffer) - 1)
+      return false;
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+    fprintf(c->fhout, "-1 Command too long\n");
+    us_client_remove(i);
+    return true;
+  }
 
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
+  clients[i] = clients[clients_num - 1];
+  clients_num--;
+  us_client_enqueue(c);
+  return true;
+} /* bool us_read */
+
+/* Puts clients returned by the workers back into the poll set. */
+static void us_collect_done(void) {
+  char drain[64];
+  while (read(wakeup_pipe[0], drain, sizeof(drain)) > 0)
+    ;
+
+  pthread_mutex_lock(&queue_lock);
+  us_client_t *done = done_head;
+  done_head = NULL;
+  pthread_mutex_unlock(&queue_lock);
+
+  while (done != NULL) {
+    us_client_t *c = done;
+    done = c->next;
+    c->next = NULL;
+
+    if (c->eof) {
+      us_client_destroy(c);
+      continue;
     }
 
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), STRERRNO);
-        break;
-      }
+    us_client_t **tmp = realloc(clients, (clients_num + 1) * sizeof(*clients));
+    if (tmp == NULL) {
+      ERROR("unixsock plugin: realloc failed.");
+      us_client_destroy(c);
+      continue;
     }
-  } /* while (fgets) */
-
-  DEBUG("unixsock plugin: us_handle_client: Exiting..");
-  fclose(fhin);
-  fclose(fhout);
-
-  pthread_exit((void *)0);
-  return (void *)0;
-} /* void *us_handle_client */
+    clients = tmp;
+    clients[clients_num++] = c;
+  }
+} /* void us_collect_done */
+
+static void us_stop_workers(void) {
+  pthread_mutex_lock(&queue_lock);
+  workers_stop = true;
+  pthread_cond_broadcast(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+
+  for (size_t i = 0; i < workers_num; i++)
+    pthread_join(workers[i], NULL);
+  sfree(workers);
+  workers_num = 0;
+
+  /* Clients still queued were never handed to a worker. */
+  while (queue_head != NULL) {
+    us_client_t *c = queue_head;
+    queue_head = c->next;
+    us_client_destroy(c);
+  }
+  queue_tail = NULL;
+  while (done_head != NULL) {
+    us_client_t *c = done_head;
+    done_head = c->next;
+    us_client_destroy(c);
+  }
+  for (size_t i = 0; i < clients_num; i++)
+    us_client_destroy(clients[i]);
+  sfree(clients);
+  clients_num = 0;
+} /* void us_stop_workers */
 
 static void *us_server_thread(void __attribute__((unused)) * arg) {
+  struct pollfd *fds = NULL;
+  size_t fds_size = 0;
   int status;
-  int *remote_fd;
-  pthread_t th;
 
   if (us_open_socket() != 0)
     pthread_exit((void *)1);
 
   while (loop != 0) {
-    DEBUG("unixsock plugin: Calling accept..");
-    status = accept(sock_fd, NULL, NULL);
-    if (status < 0) {
+    if (fds_size < clients_num + 2) {
+      struct pollfd *tmp = realloc(fds, (clients_num + 2) * sizeof(*fds));
+      if (tmp == NULL) {
+        ERROR("unixsock plugin: realloc failed.");
+        break;
+      }
+      fds = tmp;
+      fds_size = clients_num + 2;
+    }
+
+    fds[0] = (struct pollfd){.fd = sock_fd, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = wakeup_pipe[0], .events = POLLIN};
+    /* Clients are polled in the order of the `clients' array. */
+    size_t fds_num = 2;
+    for (size_t i = 0; i < clients_num; i++)
+      fds[fds_num++] = (struct pollfd){.fd = clients[i]->fd, .events = POLLIN};
 
+    status = poll(fds, (nfds_t)fds_num, /* timeout = */ -1);
+    if (status < 0) {
       if (errno == EINTR)
         continue;
-
-      ERROR("unixsock plugin: accept failed: %s", STRERRNO);
-      close(sock_fd);
-      sock_fd = -1;
-      pthread_exit((void *)1);
+      ERROR("unixsock plugin: poll failed: %s", STRERRNO);
+      break;
     }
 
-    remote_fd = malloc(sizeof(*remote_fd));
-    if (remote_fd == NULL) {
-      WARNING("unixsock plugin: malloc failed: %s", STRERRNO);
-      close(status);
-      continue;
-    }
-    *remote_fd = status;
-
-    DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
-
-    status = plugin_thread_create(&th, us_handle_client, (void *)remote_fd,
-                                  "unixsock conn");
-    if (status == 0) {
-      pthread_detach(th);
-    } else {
-      WARNING("unixsock plugin: pthread_create failed: %s", STRERRNO);
-      close(*remote_fd);
-      free(remote_fd);
-      continue;
+    /* Walk backwards: us_read() moves the last client into the removed
+     * client's slot, which has already been looked at. */
+    size_t polled = fds_num - 2;
+    for (size_t i = polled; i > 0; i--) {
+      if (fds[i + 1].revents == 0)
+        continue;
+      us_read(i - 1);
     }
+
+    if (fds[1].revents != 0)
+      us_collect_done();
+    if (fds[0].revents != 0)
+      us_accept();
   } /* while (loop) */
 
+  sfree(fds);
+  us_stop_workers();
+
   close(sock_fd);
   sock_fd = -1;
 
@@ -348,6 +616,20 @@ static int us_config(const char *key, const char *val) {
       delete_socket = true;
     else
       delete_socket = false;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 1) {
+      ERROR("unixsock plugin: \"Threads\" must be a positive number.");
+      return 1;
+    }
+    threads_num = (size_t)tmp;
+  } else if (strcasecmp(key, "MaxConnections") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 0) {
+      ERROR("unixsock plugin: \"MaxConnections\" must not be negative.");
+      return 1;
+    }
+    max_connections = (size_t)tmp;
   } else {
     return -1;
   }
@@ -367,10 +649,40 @@ static int us_init(void) {
 
   loop = 1;
 
+  if (pipe(wakeup_pipe) != 0) {
+    ERROR("unixsock plugin: pipe failed: %s", STRERRNO);
+    return -1;
+  }
+  for (size_t i = 0; i < 2; i++) {
+    int flags = fcntl(wakeup_pipe[i], F_GETFL);
+    fcntl(wakeup_pipe[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
+  workers = calloc(threads_num, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    return -1;
+  }
+  workers_stop = false;
+  for (size_t i = 0; i < threads_num; i++) {
+    status = plugin_thread_create(&workers[workers_num], us_worker_thread,
+                                  NULL, "unixsock conn");
+    if (status != 0) {
+      ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
+      break;
+    }
+    workers_num++;
+  }
+  if (workers_num == 0) {
+    sfree(workers);
+    return -1;
+  }
+
   status = plugin_thread_create(&listen_thread, us_server_thread, NULL,
                                 "unixsock listen");
   if (status != 0) {
     ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
+    us_stop_workers();
     return -1;
   }
 
@@ -383,11 +695,17 @@ static int us_shutdown(void) {
   loop = 0;
 
   if (listen_thread != (pthread_t)0) {
-    pthread_kill(listen_thread, SIGTERM);
+    us_wakeup();
     pthread_join(listen_thread, &ret);
     listen_thread = (pthread_t)0;
   }
 
+  for (size_t i = 0; i < 2; i++) {
+    if (wakeup_pipe[i] >= 0)
+      close(wakeup_pipe[i]);
+    wakeup_pipe[i] = -1;
+  }
+
   plugin_unregister_init("unixsock");
   plugin_unregister_shutdown("unixsock");
 
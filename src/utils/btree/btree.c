@@ -0,0 +1,583 @@
+/**
+ * collectd - src/utils/btree/btree.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/btree/btree.h"
+#include "utils/mempool/mempool.h"
+
+/*
+ * Every node holds up to BTREE_MAX keys and, except for the root, at least
+ * BTREE_MIN. Leaves hold the entries and are linked in order for iterating.
+ * An inner node with `num' keys has `num + 1' children, and keys[i] is the
+ * smallest key stored below children[i + 1]. Since keys are pointers owned by
+ * the caller, separators are always keys that are currently stored in a leaf;
+ * c_btree_remove() replaces a separator whose key it removes.
+ */
+#define BTREE_MAX 32
+#define BTREE_MIN (BTREE_MAX / 2)
+/* With at least BTREE_MIN + 1 children per inner node, this is more than
+ * enough for INT_MAX entries. */
+#define BTREE_HEIGHT_MAX 16
+
+typedef struct btree_node_s btree_node_t;
+struct btree_node_s {
+  int num;
+  bool leaf;
+  /* One more than BTREE_MAX, so that a node may overflow until it is split. */
+  void *keys[BTREE_MAX + 1];
+  union {
+    void *values[BTREE_MAX + 1];
+    btree_node_t *children[BTREE_MAX + 2];
+  } u;
+  /* Neighboring leaves. */
+  btree_node_t *prev;
+  btree_node_t *next;
+};
+
+struct c_btree_s {
+  int (*compare)(const void *, const void *);
+  btree_node_t *root; /* NULL if the tree is empty */
+  int height;
+  int size;
+};
+
+struct c_btree_iterator_s {
+  c_btree_t *tree;
+  /* NULL until the first call of c_btree_iterator_next() or _prev(). */
+  btree_node_t *leaf;
+  int index;
+};
+
+/* All trees share one pool of nodes. */
+static pthread_once_t btree_once = PTHREAD_ONCE_INIT;
+static c_mempool_t *btree_pool;
+
+static void btree_init_pool(void) /* {{{ */
+{
+  btree_pool = c_mempool_create("btree", sizeof(btree_node_t));
+} /* }}} void btree_init_pool */
+
+static btree_node_t *node_alloc(bool leaf) /* {{{ */
+{
+  btree_node_t *n = c_mempool_alloc(btree_pool);
+  if (n == NULL)
+    return NULL;
+
+  n->num = 0;
+  n->leaf = leaf;
+  n->prev = NULL;
+  n->next = NULL;
+  return n;
+} /* }}} btree_node_t *node_alloc */
+
+static void node_free(btree_node_t *n) /* {{{ */
+{
+  c_mempool_free(btree_pool, n);
+} /* }}} void node_free */
+
+static void node_free_recursive(btree_node_t *n) /* {{{ */
+{
+  if (n == NULL)
+    return;
+
+  if (!n->leaf)
+    for (int i = 0; i <= n->num; i++)
+      node_free_recursive(n->u.children[i]);
+  node_free(n);
+} /* }}} void node_free_recursive */
+
+/* Returns the index of the first key greater than `key', i.e. the child of an
+ * inner node to descend into. */
+static int node_upper_bound(c_btree_t const *t, /* {{{ */
+                            btree_node_t const *n, const void *key) {
+  int lo = 0;
+  int hi = n->num;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (t->compare(key, n->keys[mid]) < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+} /* }}} int node_upper_bound */
+
+/* Returns the index of the first key greater than or equal to `key'. */
+static int node_lower_bound(c_btree_t const *t, /* {{{ */
+                            btree_node_t const *n, const void *key) {
+  int lo = 0;
+  int hi = n->num;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (t->compare(key, n->keys[mid]) > 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+} /* }}} int node_lower_bound */
+
+/* Moves the upper half of the overflowing node `left' to the new node
+ * `right' and returns the separator to insert into the parent. */
+static void *node_split(btree_node_t *left, btree_node_t *right) /* {{{ */
+{
+  right->leaf = left->leaf;
+
+  if (left->leaf) {
+    int keep = left->num / 2;
+
+    right->num = left->num - keep;
+    memcpy(right->keys, left->keys + keep, right->num * sizeof(void *));
+    memcpy(right->u.values, left->u.values + keep,
+           right->num * sizeof(void *));
+    left->num = keep;
+
+    right->prev = left;
+    right->next = left->next;
+    if (right->next != NULL)
+      right->next->prev = right;
+    left->next = right;
+
+    return right->keys[0];
+  }
+
+  /* The middle key moves up into the parent. */
+  int mid = left->num / 2;
+  void *separator = left->keys[mid];
+
+  right->num = left->num - mid - 1;
+  memcpy(right->keys, left->keys + mid + 1, right->num * sizeof(void *));
+  memcpy(right->u.children, left->u.children + mid + 1,
+         (right->num + 1) * sizeof(btree_node_t *));
+  left->num = mid;
+
+  return separator;
+} /* }}} void *node_split */
+
+/* Moves the last entry of children[i - 1] to the front of children[i]. */
+static void node_borrow_left(btree_node_t *parent, int i) /* {{{ */
+{
+  btree_node_t *left = parent->u.children[i - 1];
+  btree_node_t *n = parent->u.children[i];
+
+  memmove(n->keys + 1, n->keys, n->num * sizeof(void *));
+  if (n->leaf) {
+    memmove(n->u.values + 1, n->u.values, n->num * sizeof(void *));
+    n->keys[0] = left->keys[left->num - 1];
+    n->u.values[0] = left->u.values[left->num - 1];
+    parent->keys[i - 1] = n->keys[0];
+  } else {
+    memmove(n->u.children + 1, n->u.children,
+            (n->num + 1) * sizeof(btree_node_t *));
+    n->keys[0] = parent->keys[i - 1];
+    n->u.children[0] = left->u.children[left->num];
+    parent->keys[i - 1] = left->keys[left->num - 1];
+  }
+
+  left->num--;
+  n->num++;
+} /* }}} void node_borrow_left */
+
+/* Moves the first entry of children[i + 1] to the end of children[i]. */
+static void node_borrow_right(btree_node_t *parent, int i) /* {{{ */
+{
+  btree_node_t *n = parent->u.children[i];
+  btree_node_t *right = parent->u.children[i + 1];
+
+  if (n->leaf) {
+    n->keys[n->num] = right->keys[0];
+    n->u.values[n->num] = right->u.values[0];
+    memmove(right->u.values, right->u.values + 1,
+            (right->num - 1) * sizeof(void *));
+    memmove(right->keys, right->keys + 1, (right->num - 1) * sizeof(void *));
+    parent->keys[i] = right->keys[0];
+  } else {
+    n->keys[n->num] = parent->keys[i];
+    n->u.children[n->num + 1] = right->u.children[0];
+    parent->keys[i] = right->keys[0];
+    memmove(right->keys, right->keys + 1, (right->num - 1) * sizeof(void *));
+    memmove(right->u.children, right->u.children + 1,
+            right->num * sizeof(btree_node_t *));
+  }
+
+  right->num--;
+  n->num++;
+} /* }}} void node_borrow_right */
+
+/* Merges children[i + 1] into children[i] and frees it. */
+static void node_merge(btree_node_t *parent, int i) /* {{{ */
+{
+  btree_node_t *left = parent->u.children[i];
+  btree_node_t *right = parent->u.children[i + 1];
+
+  if (left->leaf) {
+    memcpy(left->keys + left->num, right->keys, right->num * sizeof(void *));
+    memcpy(left->u.values + left->num, right->u.values,
+           right->num * sizeof(void *));
+    left->num += right->num;
+
+    left->next = right->next;
+    if (left->next != NULL)
+      left->next->prev = left;
+  } else {
+    left->keys[left->num] = parent->keys[i];
+    left->num++;
+    memcpy(left->keys + left->num, right->keys, right->num * sizeof(void *));
+    memcpy(left->u.children + left->num, right->u.children,
+           (right->num + 1) * sizeof(btree_node_t *));
+    left->num += right->num;
+  }
+  assert(left->num <= BTREE_MAX);
+
+  memmove(parent->keys + i, parent->keys + i + 1,
+          (parent->num - i - 1) * sizeof(void *));
+  memmove(parent->u.children + i + 1, parent->u.children + i + 2,
+          (parent->num - i - 1) * sizeof(btree_node_t *));
+  parent->num--;
+
+  node_free(right);
+} /* }}} void node_merge */
+
+/*
+ * Public functions
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *)) /* {{{ */
+{
+  if (compare == NULL)
+    return NULL;
+
+  pthread_once(&btree_once, btree_init_pool);
+  if (btree_pool == NULL)
+    return NULL;
+
+  c_btree_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->compare = compare;
+  return t;
+} /* }}} c_btree_t *c_btree_create */
+
+void c_btree_destroy(c_btree_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  node_free_recursive(t->root);
+  free(t);
+} /* }}} void c_btree_destroy */
+
+int c_btree_insert(c_btree_t *t, void *key, void *value) /* {{{ */
+{
+  btree_node_t *path[BTREE_HEIGHT_MAX];
+  int path_index[BTREE_HEIGHT_MAX];
+  int depth = 0;
+
+  if (t == NULL)
+    return -1;
+
+  if (t->root == NULL) {
+    t->root = node_alloc(/* leaf = */ true);
+    if (t->root == NULL)
+      return -1;
+    t->height = 1;
+  }
+
+  btree_node_t *n = t->root;
+  while (!n->leaf) {
+    int i = node_upper_bound(t, n, key);
+    path[depth] = n;
+    path_index[depth] = i;
+    depth++;
+    n = n->u.children[i];
+  }
+
+  int pos = node_lower_bound(t, n, key);
+  if ((pos < n->num) && (t->compare(key, n->keys[pos]) == 0))
+    return 1;
+
+  /* The nodes needed for splitting are allocated before anything is
+   * modified, so that the tree stays intact if memory is exhausted. Full
+   * nodes are split from the leaf upwards; if the root is split, too, a new
+   * root is needed. */
+  btree_node_t *spare[BTREE_HEIGHT_MAX + 1];
+  int spare_num = 0;
+  if (n->num == BTREE_MAX) {
+    int d = depth - 1;
+    int needed = 1;
+    while ((d >= 0) && (path[d]->num == BTREE_MAX)) {
+      needed++;
+      d--;
+    }
+    if (d < 0)
+      needed++;
+
+    for (; spare_num < needed; spare_num++) {
+      spare[spare_num] = node_alloc(/* leaf = */ false);
+      if (spare[spare_num] == NULL) {
+        while (spare_num > 0)
+          node_free(spare[--spare_num]);
+        return -1;
+      }
+    }
+  }
+
+  memmove(n->keys + pos + 1, n->keys + pos, (n->num - pos) * sizeof(void *));
+  memmove(n->u.values + pos + 1, n->u.values + pos,
+          (n->num - pos) * sizeof(void *));
+  n->keys[pos] = key;
+  n->u.values[pos] = value;
+  n->num++;
+  t->size++;
+
+  while (n->num > BTREE_MAX) {
+    btree_node_t *right = spare[--spare_num];
+    void *separator = node_split(n, right);
+
+    if (depth == 0) {
+      btree_node_t *root = spare[--spare_num];
+      root->leaf = false;
+      root->num = 1;
+      root->keys[0] = separator;
+      root->u.children[0] = n;
+      root->u.children[1] = right;
+      t->root = root;
+      t->height++;
+      break;
+    }
+
+    depth--;
+    btree_node_t *parent = path[depth];
+    int i = path_index[depth];
+
+    memmove(parent->keys + i + 1, parent->keys + i,
+            (parent->num - i) * sizeof(void *));
+    memmove(parent->u.children + i + 2, parent->u.children + i + 1,
+            (parent->num - i) * sizeof(btree_node_t *));
+    parent->keys[i] = separator;
+    parent->u.children[i + 1] = right;
+    parent->num++;
+
+    n = parent;
+  }
+  assert(spare_num == 0);
+
+  return 0;
+} /* }}} int c_btree_insert */
+
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, /* {{{ */
+                   void **rvalue) {
+  btree_node_t *path[BTREE_HEIGHT_MAX];
+  int path_index[BTREE_HEIGHT_MAX];
+  int depth = 0;
+
+  if ((t == NULL) || (t->root == NULL))
+    return -1;
+
+  btree_node_t *n = t->root;
+  while (!n->leaf) {
+    int i = node_upper_bound(t, n, key);
+    path[depth] = n;
+    path_index[depth] = i;
+    depth++;
+    n = n->u.children[i];
+  }
+
+  int pos = node_lower_bound(t, n, key);
+  if ((pos >= n->num) || (t->compare(key, n->keys[pos]) != 0))
+    return -1;
+
+  if (rkey != NULL)
+    *rkey = n->keys[pos];
+  if (rvalue != NULL)
+    *rvalue = n->u.values[pos];
+
+  memmove(n->keys + pos, n->keys + pos + 1,
+          (n->num - pos - 1) * sizeof(void *));
+  memmove(n->u.values + pos, n->u.values + pos + 1,
+          (n->num - pos - 1) * sizeof(void *));
+  n->num--;
+  t->size--;
+
+  /* If the smallest key of the leaf was removed, it may be the separator of
+   * the nearest ancestor in which the path doesn't take the first child. */
+  if (pos == 0) {
+    for (int d = depth - 1; d >= 0; d--) {
+      if (path_index[d] == 0)
+        continue;
+      assert(n->num > 0);
+      path[d]->keys[path_index[d] - 1] = n->keys[0];
+      break;
+    }
+  }
+
+  while ((depth > 0) && (n->num < BTREE_MIN)) {
+    depth--;
+    btree_node_t *parent = path[depth];
+    int i = path_index[depth];
+
+    if ((i > 0) && (parent->u.children[i - 1]->num > BTREE_MIN))
+      node_borrow_left(parent, i);
+    else if ((i < parent->num) &&
+             (parent->u.children[i + 1]->num > BTREE_MIN))
+      node_borrow_right(parent, i);
+    else if (i > 0)
+      node_merge(parent, i - 1);
+    else
+      node_merge(parent, i);
+
+    n = parent;
+  }
+
+  if (t->root->num == 0) {
+    btree_node_t *root = t->root;
+    t->root = root->leaf ? NULL : root->u.children[0];
+    t->height--;
+    node_free(root);
+  }
+
+  return 0;
+} /* }}} int c_btree_remove */
+
+int c_btree_get(c_btree_t *t, const void *key, void **value) /* {{{ */
+{
+  if ((t == NULL) || (t->root == NULL))
+    return -1;
+
+  btree_node_t *n = t->root;
+  while (!n->leaf)
+    n = n->u.children[node_upper_bound(t, n, key)];
+
+  int pos = node_lower_bound(t, n, key);
+  if ((pos >= n->num) || (t->compare(key, n->keys[pos]) != 0))
+    return -1;
+
+  if (value != NULL)
+    *value = n->u.values[pos];
+  return 0;
+} /* }}} int c_btree_get */
+
+int c_btree_pick(c_btree_t *t, void **key, void **value) /* {{{ */
+{
+  if ((t == NULL) || (key == NULL) || (value == NULL) || (t->root == NULL))
+    return -1;
+
+  /* Removing the largest key rarely requires rebalancing nodes other than
+   * the last leaf. */
+  btree_node_t *n = t->root;
+  while (!n->leaf)
+    n = n->u.children[n->num];
+
+  return c_btree_remove(t, n->keys[n->num - 1], key, value);
+} /* }}} int c_btree_pick */
+
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return NULL;
+
+  c_btree_iterator_t *iter = calloc(1, sizeof(*iter));
+  if (iter == NULL)
+    return NULL;
+  iter->tree = t;
+
+  return iter;
+} /* }}} c_btree_iterator_t *c_btree_get_iterator */
+
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, /* {{{ */
+                          void **value) {
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  btree_node_t *n = iter->leaf;
+  int i = iter->index + 1;
+  if (n == NULL) {
+    n = iter->tree->root;
+    if (n == NULL)
+      return -1;
+    while (!n->leaf)
+      n = n->u.children[0];
+    i = 0;
+  }
+
+  while ((n != NULL) && (i >= n->num)) {
+    n = n->next;
+    i = 0;
+  }
+  if (n == NULL)
+    return -1;
+
+  iter->leaf = n;
+  iter->index = i;
+  *key = n->keys[i];
+  *value = n->u.values[i];
+  return 0;
+} /* }}} int c_btree_iterator_next */
+
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, /* {{{ */
+                          void **value) {
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  btree_node_t *n = iter->leaf;
+  int i = iter->index - 1;
+  if (n == NULL) {
+    n = iter->tree->root;
+    if (n == NULL)
+      return -1;
+    while (!n->leaf)
+      n = n->u.children[n->num];
+    i = n->num - 1;
+  }
+
+  while ((n != NULL) && (i < 0)) {
+    n = n->prev;
+    if (n != NULL)
+      i = n->num - 1;
+  }
+  if (n == NULL)
+    return -1;
+
+  iter->leaf = n;
+  iter->index = i;
+  *key = n->keys[i];
+  *value = n->u.values[i];
+  return 0;
+} /* }}} int c_btree_iterator_prev */
+
+void c_btree_iterator_destroy(c_btree_iterator_t *iter) /* {{{ */
+{
+  free(iter);
+} /* }}} void c_btree_iterator_destroy */
+
+int c_btree_size(c_btree_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return 0;
+  return t->size;
+} /* }}} int c_btree_size */
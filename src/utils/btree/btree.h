@@ -0,0 +1,134 @@
+/**
+ * collectd - src/utils/btree/btree.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_BTREE_H
+#define UTILS_BTREE_H 1
+
+/*
+ * An ordered map with the same interface as the AVL tree (see avltree.h),
+ * implemented as a B+-tree. Each node holds dozens of keys in one
+ * contiguous array, so a lookup touches a few nodes instead of one per
+ * comparison, and nodes come from a memory pool rather than one malloc(3) per
+ * entry. Keys and values are pointers owned by the caller, like with the AVL
+ * tree. The tree does not do any locking.
+ */
+struct c_btree_s;
+typedef struct c_btree_s c_btree_t;
+
+struct c_btree_iterator_s;
+typedef struct c_btree_iterator_s c_btree_iterator_t;
+
+/*
+ * NAME
+ *   c_btree_create
+ *
+ * DESCRIPTION
+ *   Allocates a new tree. `compare' is used like with c_avl_create().
+ *
+ * RETURN VALUE
+ *   A c_btree_t-pointer upon success or NULL upon failure.
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *));
+
+/*
+ * NAME
+ *   c_btree_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates the tree. Stored key- and value-pointers are not freed.
+ */
+void c_btree_destroy(c_btree_t *t);
+
+/*
+ * NAME
+ *   c_btree_insert
+ *
+ * DESCRIPTION
+ *   Stores the key-value-pair in the tree. The key is _not_ copied, so the
+ *   memory pointed to may not be freed before the entry is removed.
+ *
+ * RETURN VALUE
+ *   Zero upon success, a positive value if the key already exists and a
+ *   negative value upon failure.
+ */
+int c_btree_insert(c_btree_t *t, void *key, void *value);
+
+/*
+ * NAME
+ *   c_btree_remove
+ *
+ * DESCRIPTION
+ *   Removes `key' from the tree. The stored key- and value-pointers are
+ *   returned in `rkey' and `rvalue', unless they are NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, void **rvalue);
+
+/*
+ * NAME
+ *   c_btree_get
+ *
+ * DESCRIPTION
+ *   Looks up `key' and stores its value in `value', unless `value' is NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_get(c_btree_t *t, const void *key, void **value);
+
+/*
+ * NAME
+ *   c_btree_pick
+ *
+ * DESCRIPTION
+ *   Removes an arbitrary entry from the tree and returns its `key' and
+ *   `value', like c_avl_pick().
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the tree is empty or key or value is
+ *   NULL.
+ */
+int c_btree_pick(c_btree_t *t, void **key, void **value);
+
+/*
+ * Iterators visit the entries in order, starting with the smallest key for
+ * c_btree_iterator_next() or with the largest key for
+ * c_btree_iterator_prev(). The tree must not be modified while iterating.
+ */
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t);
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, void **value);
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, void **value);
+void c_btree_iterator_destroy(c_btree_iterator_t *iter);
+
+/*
+ * NAME
+ *   c_btree_size
+ *
+ * RETURN VALUE
+ *   Number of entries in the tree, 0 if the tree is empty or NULL.
+ */
+int c_btree_size(c_btree_t *t);
+
+#endif /* UTILS_BTREE_H */
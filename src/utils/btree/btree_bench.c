@@ -0,0 +1,207 @@
+/**
+ * collectd - src/utils/btree/btree_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Compares c_avl_tree_t and c_btree_t with the same string keys: inserting
+ * them in random order, looking all of them up in another random order and
+ * iterating over the whole tree.
+ *
+ * Usage: bench_utils_btree [<keys> [<rounds>]]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/avltree/avltree.h"
+#include "utils/btree/btree.h"
+
+static char **names;
+static size_t names_num;
+static size_t rounds_num;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t *shuffled(unsigned int seed) {
+  size_t *order = calloc(names_num, sizeof(*order));
+  if (order == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < names_num; i++)
+    order[i] = i;
+  for (size_t i = names_num - 1; i > 0; i--) {
+    size_t j = (size_t)rand_r(&seed) % (i + 1);
+    size_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  return order;
+}
+
+static int compare(const void *a, const void *b) { return strcmp(a, b); }
+
+static void report(char const *name, char const *op, double elapsed,
+                   size_t ops) {
+  printf("%-6s %-8s %8.3f s %12.0f ops/s\n", name, op, elapsed,
+         (double)ops / elapsed);
+}
+
+/* Returns the total time spent by the AVL tree. */
+static double bench_avl(size_t const *insert_order, size_t const *get_order) {
+  c_avl_tree_t *t = c_avl_create(compare);
+  if (t == NULL)
+    return -1;
+
+  double start = now();
+  for (size_t i = 0; i < names_num; i++)
+    c_avl_insert(t, names[insert_order[i]], names[insert_order[i]]);
+  double insert = now() - start;
+
+  start = now();
+  size_t found = 0;
+  for (size_t r = 0; r < rounds_num; r++)
+    for (size_t i = 0; i < names_num; i++) {
+      void *value;
+      if (c_avl_get(t, names[get_order[i]], &value) == 0)
+        found++;
+    }
+  double get = now() - start;
+
+  start = now();
+  size_t visited = 0;
+  for (size_t r = 0; r < rounds_num; r++) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(t);
+    void *key;
+    void *value;
+    while (c_avl_iterator_next(iter, &key, &value) == 0)
+      visited++;
+    c_avl_iterator_destroy(iter);
+  }
+  double iterate = now() - start;
+
+  if ((found != names_num * rounds_num) ||
+      (visited != names_num * rounds_num))
+    fprintf(stderr, "avl: unexpected number of keys.\n");
+
+  report("avl", "insert", insert, names_num);
+  report("avl", "get", get, names_num * rounds_num);
+  report("avl", "iterate", iterate, names_num * rounds_num);
+
+  c_avl_destroy(t);
+  return insert + get + iterate;
+}
+
+/* Returns the total time spent by the B-tree. */
+static double bench_btree(size_t const *insert_order,
+                          size_t const *get_order) {
+  c_btree_t *t = c_btree_create(compare);
+  if (t == NULL)
+    return -1;
+
+  double start = now();
+  for (size_t i = 0; i < names_num; i++)
+    c_btree_insert(t, names[insert_order[i]], names[insert_order[i]]);
+  double insert = now() - start;
+
+  start = now();
+  size_t found = 0;
+  for (size_t r = 0; r < rounds_num; r++)
+    for (size_t i = 0; i < names_num; i++) {
+      void *value;
+      if (c_btree_get(t, names[get_order[i]], &value) == 0)
+        found++;
+    }
+  double get = now() - start;
+
+  start = now();
+  size_t visited = 0;
+  for (size_t r = 0; r < rounds_num; r++) {
+    c_btree_iterator_t *iter = c_btree_get_iterator(t);
+    void *key;
+    void *value;
+    while (c_btree_iterator_next(iter, &key, &value) == 0)
+      visited++;
+    c_btree_iterator_destroy(iter);
+  }
+  double iterate = now() - start;
+
+  if ((found != names_num * rounds_num) ||
+      (visited != names_num * rounds_num))
+    fprintf(stderr, "btree: unexpected number of keys.\n");
+
+  report("btree", "insert", insert, names_num);
+  report("btree", "get", get, names_num * rounds_num);
+  report("btree", "iterate", iterate, names_num * rounds_num);
+
+  c_btree_destroy(t);
+  return insert + get + iterate;
+}
+
+int main(int argc, char **argv) {
+  names_num = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 0) : 1000000;
+  rounds_num = (argc > 2) ? (size_t)strtoull(argv[2], NULL, 0) : 3;
+  if ((names_num == 0) || (rounds_num == 0)) {
+    fprintf(stderr, "Usage: %s [<keys> [<rounds>]]\n", argv[0]);
+    return 1;
+  }
+
+  names = calloc(names_num, sizeof(*names));
+  if (names == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+  }
+
+  /* Names look like the cache's keys: host/plugin-instance/type-instance */
+  for (size_t i = 0; i < names_num; i++) {
+    char name[128];
+    snprintf(name, sizeof(name), "host%03zu.example.com/cpu-%zu/cpu-%zu",
+             i % 1000, (i / 1000) % 64, i / 64000);
+    names[i] = strdup(name);
+    if (names[i] == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      return 1;
+    }
+  }
+
+  size_t *insert_order = shuffled(1);
+  size_t *get_order = shuffled(2);
+  if ((insert_order == NULL) || (get_order == NULL)) {
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+  }
+
+  printf("%zu keys, %zu rounds\n", names_num, rounds_num);
+  double avl = bench_avl(insert_order, get_order);
+  double btree = bench_btree(insert_order, get_order);
+  if ((avl > 0) && (btree > 0))
+    printf("speedup         %8.2fx\n", avl / btree);
+
+  return 0;
+}
@@ -0,0 +1,304 @@
+/**
+ * collectd - src/utils/btree/btree_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "collectd.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
+
+#include "testing.h"
+#include "utils/btree/btree.h"
+
+/* Enough keys for a tree of three levels. */
+#define KEYS_NUM 5000
+
+static int compare_callback(void const *v0, void const *v1) {
+  assert(v0 != NULL);
+  assert(v1 != NULL);
+
+  return strcmp(v0, v1);
+}
+
+static int compare_int(void const *v0, void const *v1) {
+  int a = *(int const *)v0;
+  int b = *(int const *)v1;
+  return (a > b) - (a < b);
+}
+
+struct kv_t {
+  char *key;
+  char *value;
+};
+
+static int kv_compare(const void *a_ptr, const void *b_ptr) {
+  return strcmp(((struct kv_t *)a_ptr)->key, ((struct kv_t *)b_ptr)->key);
+}
+
+DEF_TEST(success) {
+  struct kv_t cases[] = {
+      {"Eeph7chu", "vai1reiV"}, {"igh3Paiz", "teegh1Ee"},
+      {"caip6Uu8", "ooteQu8n"}, {"Aech6vah", "AijeeT0l"},
+      {"Xah0et2L", "gah8Taep"}, {"BocaeB8n", "oGaig8io"},
+      {"thai8AhM", "ohjeFo3f"}, {"ohth6ieC", "hoo8ieWo"},
+      {"aej7Woow", "phahuC2s"}, {"Hai8ier2", "Yie6eimi"},
+      {"phuXi3Li", "JaiF7ieb"}, {"Shaig5ef", "aihi5Zai"},
+      {"voh6Aith", "Oozaeto0"}, {"zaiP5kie", "seep5veM"},
+      {"pae7ba7D", "chie8Ojo"}, {"Gou2ril3", "ouVoo0ha"},
+      {"lo3Thee3", "ahDu4Zuj"}, {"Rah8kohv", "ieShoc7E"},
+      {"ieN5engi", "Aevou1ah"}, {"ooTe4OhP", "aingai5Y"},
+  };
+
+  struct kv_t sorted_cases[STATIC_ARRAY_SIZE(cases)];
+  memcpy(sorted_cases, cases, sizeof(cases));
+  qsort(sorted_cases, STATIC_ARRAY_SIZE(cases), sizeof(struct kv_t),
+        kv_compare);
+
+  c_btree_t *t;
+
+  CHECK_NOT_NULL(t = c_btree_create(compare_callback));
+
+  /* insert */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *key;
+    char *value;
+
+    CHECK_NOT_NULL(key = strdup(cases[i].key));
+    CHECK_NOT_NULL(value = strdup(cases[i].value));
+
+    CHECK_ZERO(c_btree_insert(t, key, value));
+    EXPECT_EQ_INT((int)(i + 1), c_btree_size(t));
+  }
+
+  /* Key already exists. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    EXPECT_EQ_INT(1, c_btree_insert(t, cases[i].key, cases[i].value));
+
+  /* get */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *value_ret = NULL;
+
+    CHECK_ZERO(c_btree_get(t, cases[i].key, (void *)&value_ret));
+    EXPECT_EQ_STR(cases[i].value, value_ret);
+  }
+  EXPECT_EQ_INT(-1, c_btree_get(t, "does not exist", NULL));
+
+  /* iterate forward */
+  {
+    c_btree_iterator_t *iter = c_btree_get_iterator(t);
+    char *key;
+    char *value;
+    size_t i = 0;
+    while (c_btree_iterator_next(iter, (void **)&key, (void **)&value) == 0) {
+      EXPECT_EQ_STR(sorted_cases[i].key, key);
+      EXPECT_EQ_STR(sorted_cases[i].value, value);
+      i++;
+    }
+    c_btree_iterator_destroy(iter);
+    EXPECT_EQ_INT(i, STATIC_ARRAY_SIZE(cases));
+  }
+
+  /* iterate backward */
+  {
+    c_btree_iterator_t *iter = c_btree_get_iterator(t);
+    char *key;
+    char *value;
+    size_t i = 0;
+    while (c_btree_iterator_prev(iter, (void **)&key, (void **)&value) == 0) {
+      EXPECT_EQ_STR(sorted_cases[STATIC_ARRAY_SIZE(cases) - 1 - i].key, key);
+      EXPECT_EQ_STR(sorted_cases[STATIC_ARRAY_SIZE(cases) - 1 - i].value,
+                    value);
+      i++;
+    }
+    c_btree_iterator_destroy(iter);
+    EXPECT_EQ_INT(i, STATIC_ARRAY_SIZE(cases));
+  }
+
+  /* remove half */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases) / 2; i++) {
+    char *key = NULL;
+    char *value = NULL;
+
+    int expected_size = (int)(STATIC_ARRAY_SIZE(cases) - (i + 1));
+
+    CHECK_ZERO(
+        c_btree_remove(t, cases[i].key, (void *)&key, (void *)&value));
+
+    EXPECT_EQ_STR(cases[i].key, key);
+    EXPECT_EQ_STR(cases[i].value, value);
+
+    free(key);
+    free(value);
+
+    EXPECT_EQ_INT(expected_size, c_btree_size(t));
+  }
+
+  /* pick the other half */
+  for (size_t i = STATIC_ARRAY_SIZE(cases) / 2; i < STATIC_ARRAY_SIZE(cases);
+       i++) {
+    char *key = NULL;
+    char *value = NULL;
+
+    int expected_size = (int)(STATIC_ARRAY_SIZE(cases) - (i + 1));
+
+    EXPECT_EQ_INT(expected_size + 1, c_btree_size(t));
+    EXPECT_EQ_INT(0, c_btree_pick(t, (void *)&key, (void *)&value));
+
+    free(key);
+    free(value);
+
+    EXPECT_EQ_INT(expected_size, c_btree_size(t));
+  }
+  EXPECT_EQ_INT(-1, c_btree_pick(t, &(void *){NULL}, &(void *){NULL}));
+
+  c_btree_destroy(t);
+
+  return 0;
+}
+
+/* Checks the tree against "present" by iterating in both directions. */
+static int check_contents(c_btree_t *t, int *keys, bool const *present) {
+  c_btree_iterator_t *iter;
+  int *key;
+  void *value;
+  int want = 0;
+  int size = 0;
+
+  CHECK_NOT_NULL(iter = c_btree_get_iterator(t));
+  while (c_btree_iterator_next(iter, (void **)&key, &value) == 0) {
+    while ((want < KEYS_NUM) && !present[want])
+      want++;
+    EXPECT_EQ_INT(want, *key);
+    EXPECT_EQ_PTR(keys + want, key);
+    EXPECT_EQ_PTR(keys + want, value);
+    want++;
+    size++;
+  }
+  c_btree_iterator_destroy(iter);
+  EXPECT_EQ_INT(size, c_btree_size(t));
+
+  want = KEYS_NUM - 1;
+  CHECK_NOT_NULL(iter = c_btree_get_iterator(t));
+  while (c_btree_iterator_prev(iter, (void **)&key, &value) == 0) {
+    while ((want >= 0) && !present[want])
+      want--;
+    EXPECT_EQ_INT(want, *key);
+    want--;
+    size--;
+  }
+  c_btree_iterator_destroy(iter);
+  EXPECT_EQ_INT(0, size);
+
+  return 0;
+}
+
+/* Inserts and removes keys in random order, so that nodes are split, merged
+ * and rebalanced on all levels. */
+DEF_TEST(random) {
+  static int keys[KEYS_NUM];
+  static bool present[KEYS_NUM];
+  unsigned int seed = 42;
+  int size = 0;
+
+  for (int i = 0; i < KEYS_NUM; i++)
+    keys[i] = i;
+
+  c_btree_t *t;
+  CHECK_NOT_NULL(t = c_btree_create(compare_int));
+
+  for (int round = 0; round < 4; round++) {
+    /* Grow to about three quarters of the keys, then shrink again. */
+    for (int i = 0; i < 4 * KEYS_NUM; i++) {
+      int k = rand_r(&seed) % KEYS_NUM;
+      bool grow = (i < 2 * KEYS_NUM);
+
+      if (grow) {
+        EXPECT_EQ_INT(present[k] ? 1 : 0,
+                      c_btree_insert(t, keys + k, keys + k));
+        if (!present[k])
+          size++;
+        present[k] = true;
+      } else {
+        void *rkey = NULL;
+        void *rvalue = NULL;
+        EXPECT_EQ_INT(present[k] ? 0 : -1,
+                      c_btree_remove(t, keys + k, &rkey, &rvalue));
+        if (present[k]) {
+          EXPECT_EQ_PTR(keys + k, rkey);
+          EXPECT_EQ_PTR(keys + k, rvalue);
+          size--;
+        }
+        present[k] = false;
+      }
+      EXPECT_EQ_INT(size, c_btree_size(t));
+
+      if ((i % 4000) == 0)
+        CHECK_ZERO(check_contents(t, keys, present));
+    }
+
+    for (int k = 0; k < KEYS_NUM; k++) {
+      void *value = NULL;
+      EXPECT_EQ_INT(present[k] ? 0 : -1, c_btree_get(t, keys + k, &value));
+      if (present[k])
+        EXPECT_EQ_PTR(keys + k, value);
+    }
+    CHECK_ZERO(check_contents(t, keys, present));
+  }
+
+  /* Empty the tree completely. */
+  for (int k = 0; k < KEYS_NUM; k++) {
+    if (!present[k])
+      continue;
+    CHECK_ZERO(c_btree_remove(t, keys + k, NULL, NULL));
+    present[k] = false;
+    size--;
+    if ((k % 1000) == 0)
+      CHECK_ZERO(check_contents(t, keys, present));
+  }
+  EXPECT_EQ_INT(0, size);
+  EXPECT_EQ_INT(0, c_btree_size(t));
+  CHECK_ZERO(check_contents(t, keys, present));
+
+  /* Ascending inserts, the typical pattern of time-ordered keys. */
+  for (int k = 0; k < KEYS_NUM; k++) {
+    CHECK_ZERO(c_btree_insert(t, keys + k, keys + k));
+    present[k] = true;
+  }
+  CHECK_ZERO(check_contents(t, keys, present));
+
+  for (int k = KEYS_NUM - 1; k >= 0; k--) {
+    int *key = NULL;
+    void *value = NULL;
+    CHECK_ZERO(c_btree_pick(t, (void **)&key, &value));
+    EXPECT_EQ_INT(k, *key);
+  }
+  EXPECT_EQ_INT(0, c_btree_size(t));
+
+  c_btree_destroy(t);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(success);
+  RUN_TEST(random);
+
+  END_TEST;
+}
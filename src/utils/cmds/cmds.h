@@ -49,6 +49,8 @@ typedef enum {
 
 typedef struct {
   double timeout;
+  /* Report the completion of each plugin's flush as it happens. */
+  bool async;
 
   char **plugins;
   size_t plugins_num;
@@ -61,6 +63,13 @@ typedef struct {
   identifier_t identifier;
 } cmd_getval_t;
 
+typedef struct {
+  /* Only list the identifiers matching this shell wildcard pattern, see
+   * fnmatch(3), or this extended regular expression. At most one is set. */
+  char *glob;
+  char *regex;
+} cmd_listval_t;
+
 typedef struct {
   /* The raw identifier as provided by the user. */
   char *raw_identifier;
@@ -83,6 +92,7 @@ typedef struct {
   union {
     cmd_flush_t flush;
     cmd_getval_t getval;
+    cmd_listval_t listval;
     cmd_putval_t putval;
   } cmd;
 } cmd_t;
@@ -32,6 +32,7 @@
 #include "utils/common/common.h"
 #include "testing.h"
 #include "utils/cmds/cmds.h"
+#include "utils/cmds/putval.h"
 // clang-format on
 
 static void error_cb(void *ud, cmd_status_t status, const char *format,
@@ -80,6 +81,12 @@ static struct {
         CMD_OK,
         CMD_FLUSH,
     },
+    {
+        "FLUSH async=true plugin=A",
+        NULL,
+        CMD_OK,
+        CMD_FLUSH,
+    },
     /* Invalid FLUSH commands. */
     {
         /* Missing hostname; no default. */
@@ -102,6 +109,13 @@ static struct {
         CMD_PARSE_ERROR,
         CMD_UNKNOWN,
     },
+    {
+        /* Invalid async flag. */
+        "FLUSH async=maybe",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
     {
         /* Invalid identifier. */
         "FLUSH identifier=invalid",
@@ -159,6 +173,19 @@ static struct {
         CMD_LISTVAL,
     },
 
+    {
+        "LISTVAL glob=myhost/cpu-*/*",
+        NULL,
+        CMD_OK,
+        CMD_LISTVAL,
+    },
+    {
+        "LISTVAL regex=\"^myhost/(cpu|memory)\"",
+        NULL,
+        CMD_OK,
+        CMD_LISTVAL,
+    },
+
     /* Invalid LISTVAL commands. */
     {
         "LISTVAL invalid",
@@ -166,6 +193,19 @@ static struct {
         CMD_PARSE_ERROR,
         CMD_UNKNOWN,
     },
+    {
+        "LISTVAL invalid=option",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        /* Only one filter is allowed. */
+        "LISTVAL glob=* regex=.",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
 
     /* Valid PUTVAL commands. */
     {
@@ -330,7 +370,123 @@ DEF_TEST(parse) {
   return test_result;
 }
 
+DEF_TEST(listval_filter) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  char input[] = "LISTVAL glob=\"my host/*\"";
+  cmd_t cmd = {0};
+
+  EXPECT_EQ_INT(CMD_OK, cmd_parse(input, &cmd, NULL, &err));
+  EXPECT_EQ_INT(CMD_LISTVAL, cmd.type);
+  EXPECT_EQ_STR("my host/*", cmd.cmd.listval.glob);
+  OK(cmd.cmd.listval.regex == NULL);
+
+  cmd_destroy(&cmd);
+  return 0;
+}
+
+static struct {
+  char *input;
+  cmd_options_t *opts;
+  /* Whether the line is handled without falling back to cmd_parse(), which
+   * modifies it. */
+  bool fast;
+} putval_batch_data[] = {
+    {"PUTVAL myhost/magic/MAGIC 1234:42", NULL, true},
+    {"putval  myhost/magic-inst/MAGIC-ti  1234.5:-42 ", NULL, true},
+    {"PUTVAL magic/MAGIC 1234:42", &default_host_opts, true},
+    {"PUTVAL myhost/magic/MAGIC 1234:42 2345:0x17", NULL, true},
+    {"PUTVAL myhost/magic/MAGIC interval=2 1234:42 interval=5 2345:23", NULL,
+     true},
+    {"PUTVAL myhost/magic/MAGIC interval=-1 1234:42", NULL, true},
+    {"PUTVAL \"myhost/magic/MAGIC\" 1234:42", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC meta:KEY=\"string_value\" 1234:42", NULL,
+     false},
+    {"PUTVAL magic/MAGIC N:42", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC 1234:A", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC 1234:42:23", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC 0:42", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC 1234:", NULL, false},
+    {"PUTVAL myhost/magic/UNKNOWN 1234:42", NULL, false},
+    {"PUTVAL myhost/magic/MAGIC invalid=2 1234:42", NULL, false},
+    {"GETVAL myhost/magic/MAGIC", NULL, false},
+};
+
+DEF_TEST(putval_batch) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  cmd_putval_batch_t *batch;
+
+  CHECK_NOT_NULL(batch = cmd_putval_batch_create());
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(putval_batch_data); i++) {
+    char *input = strdup(putval_batch_data[i].input);
+    char *copy = strdup(putval_batch_data[i].input);
+    cmd_t cmd = {0};
+
+    printf("## Case %zu: %s\n", i, putval_batch_data[i].input);
+
+    cmd_status_t want = cmd_parse(copy, &cmd, putval_batch_data[i].opts, &err);
+    if ((want == CMD_OK) && (cmd.type != CMD_PUTVAL))
+      want = CMD_UNKNOWN_COMMAND;
+
+    size_t vl_num = batch->vl_num;
+    EXPECT_EQ_INT(want, cmd_putval_batch_add(batch, input,
+                                             putval_batch_data[i].opts, &err));
+    if (putval_batch_data[i].fast)
+      EXPECT_EQ_STR(putval_batch_data[i].input, input);
+
+    size_t want_num = (want == CMD_OK) ? cmd.cmd.putval.vl_num : 0;
+    EXPECT_EQ_INT((int)want_num, (int)(batch->vl_num - vl_num));
+
+    for (size_t j = 0; j < want_num; j++) {
+      value_list_t const *want_vl = cmd.cmd.putval.vl + j;
+      value_list_t const *got = batch->vl + vl_num + j;
+
+      EXPECT_EQ_STR(want_vl->host, got->host);
+      EXPECT_EQ_STR(want_vl->plugin, got->plugin);
+      EXPECT_EQ_STR(want_vl->plugin_instance, got->plugin_instance);
+      EXPECT_EQ_STR(want_vl->type, got->type);
+      EXPECT_EQ_STR(want_vl->type_instance, got->type_instance);
+      EXPECT_EQ_UINT64(want_vl->time, got->time);
+      EXPECT_EQ_UINT64(want_vl->interval, got->interval);
+      EXPECT_EQ_INT((int)want_vl->values_len, (int)got->values_len);
+      EXPECT_EQ_UINT64((uint64_t)want_vl->values[0].derive,
+                       (uint64_t)got->values[0].derive);
+      OK((want_vl->meta == NULL) == (got->meta == NULL));
+    }
+
+    cmd_destroy(&cmd);
+    free(copy);
+    free(input);
+  }
+
+  /* The values of earlier value lists have to survive the batch growing. */
+  cmd_putval_batch_reset(batch);
+  EXPECT_EQ_INT(0, (int)batch->vl_num);
+  for (int i = 0; i < 1000; i++) {
+    char line[128];
+    ssnprintf(line, sizeof(line), "PUTVAL host/magic-%d/MAGIC 1234:%d", i, i);
+    EXPECT_EQ_INT(CMD_OK, cmd_putval_batch_add(batch, line, NULL, &err));
+  }
+  EXPECT_EQ_INT(1000, (int)batch->vl_num);
+  for (int i = 0; i < 1000; i++) {
+    char want[16];
+    ssnprintf(want, sizeof(want), "%d", i);
+    EXPECT_EQ_STR(want, batch->vl[i].plugin_instance);
+    EXPECT_EQ_UINT64((uint64_t)i, (uint64_t)batch->vl[i].values[0].derive);
+  }
+
+  /* The mock dispatches value lists one by one, which is not supported. */
+  EXPECT_EQ_INT(ENOTSUP, cmd_putval_batch_dispatch(batch));
+  EXPECT_EQ_INT(0, (int)batch->vl_num);
+
+  cmd_putval_batch_destroy(batch);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(parse);
+  RUN_TEST(listval_filter);
+  RUN_TEST(putval_batch);
   END_TEST;
 }
@@ -95,6 +95,17 @@ cmd_status_t cmd_parse_flush(size_t argc, char **argv, cmd_flush_t *ret_flush,
       } else if (ret_flush->timeout < 0.0) {
         ret_flush->timeout = 0.0;
       }
+    } else if (strcasecmp("async", opt_key) == 0) {
+      if (IS_TRUE(opt_value))
+        ret_flush->async = true;
+      else if (IS_FALSE(opt_value))
+        ret_flush->async = false;
+      else {
+        cmd_error(CMD_PARSE_ERROR, err,
+                  "Invalid value for option `async': %s", opt_value);
+        cmd_destroy_flush(ret_flush);
+        return CMD_PARSE_ERROR;
+      }
     } else {
       cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
       cmd_destroy_flush(ret_flush);
@@ -105,6 +116,43 @@ cmd_status_t cmd_parse_flush(size_t argc, char **argv, cmd_flush_t *ret_flush,
   return CMD_OK;
 } /* cmd_status_t cmd_parse_flush */
 
+/* With "async=true", the status line announces the number of plugins and
+ * a line is sent for each plugin as soon as its flush has finished. Flushes
+ * finishing before the status line has been sent are reported after it. */
+typedef struct {
+  FILE *fh;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool started;
+  char **pending;
+  size_t pending_num;
+  size_t done;
+} cmd_flush_report_t;
+
+static void cmd_flush_report(char const *plugin, int status, cdtime_t duration,
+                             void *ud) {
+  cmd_flush_report_t *r = ud;
+  char line[DATA_MAX_NAME_LEN + 64];
+
+  if (status == 0)
+    ssnprintf(line, sizeof(line), "%s: Done in %.3f seconds", plugin,
+              CDTIME_T_TO_DOUBLE(duration));
+  else
+    ssnprintf(line, sizeof(line),
+              "%s: Failed with status %i after %.3f seconds", plugin, status,
+              CDTIME_T_TO_DOUBLE(duration));
+
+  pthread_mutex_lock(&r->lock);
+  if (r->started) {
+    fprintf(r->fh, "%s\n", line);
+    fflush(r->fh);
+  } else
+    strarray_add(&r->pending, &r->pending_num, line);
+  r->done++;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+} /* void cmd_flush_report */
+
 cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_t cmd;
@@ -128,6 +176,13 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
     return CMD_UNKNOWN_COMMAND;
   }
 
+  cmd_flush_report_t report = {
+      .fh = fh,
+      .lock = PTHREAD_MUTEX_INITIALIZER,
+      .cond = PTHREAD_COND_INITIALIZER,
+  };
+  size_t flushes_num = 0;
+
   for (size_t i = 0; (i == 0) || (i < cmd.cmd.flush.plugins_num); i++) {
     char *plugin = NULL;
 
@@ -149,6 +204,13 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
         identifier = buf;
       }
 
+      if (cmd.cmd.flush.async) {
+        flushes_num += (size_t)plugin_flush_async(
+            plugin, DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout), identifier,
+            cmd_flush_report, &report);
+        continue;
+      }
+
       if (plugin_flush(plugin, DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout),
                        identifier) == 0)
         success++;
@@ -157,7 +219,24 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
     }
   }
 
-  cmd_error(CMD_OK, &err, "Done: %i successful, %i errors", success, error);
+  if (cmd.cmd.flush.async) {
+    pthread_mutex_lock(&report.lock);
+    fprintf(fh, "%" PRIsz " Flushing %" PRIsz " plugin%s\n", flushes_num,
+            flushes_num, (flushes_num == 1) ? "" : "s");
+    for (size_t i = 0; i < report.pending_num; i++)
+      fprintf(fh, "%s\n", report.pending[i]);
+    fflush(fh);
+    report.started = true;
+
+    while (report.done < flushes_num)
+      pthread_cond_wait(&report.cond, &report.lock);
+    pthread_mutex_unlock(&report.lock);
+
+    strarray_free(report.pending, report.pending_num);
+    pthread_mutex_destroy(&report.lock);
+    pthread_cond_destroy(&report.cond);
+  } else
+    cmd_error(CMD_OK, &err, "Done: %i successful, %i errors", success, error);
 
   cmd_destroy(&cmd);
   return 0;
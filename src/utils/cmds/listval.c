@@ -33,19 +33,74 @@
 #include "utils/cmds/parse_option.h"
 #include "utils_cache.h"
 
+#include <fnmatch.h>
+#include <regex.h>
+
 cmd_status_t cmd_parse_listval(size_t argc, char **argv,
+                               cmd_listval_t *ret_listval,
                                const cmd_options_t *opts
                                __attribute__((unused)),
                                cmd_error_handler_t *err) {
-  if (argc != 0) {
-    cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
-              argv[0]);
-    return CMD_PARSE_ERROR;
+  if (ret_listval == NULL) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_parse_listval.");
+    return CMD_ERROR;
+  }
+
+  for (size_t i = 0; i < argc; i++) {
+    char *opt_key = NULL;
+    char *opt_value = NULL;
+
+    if (cmd_parse_option(argv[i], &opt_key, &opt_value, err) != CMD_OK) {
+      cmd_error(CMD_PARSE_ERROR, err, "Garbage after end of command: `%s'.",
+                argv[i]);
+      cmd_destroy_listval(ret_listval);
+      return CMD_PARSE_ERROR;
+    }
+
+    char **dest;
+    if (strcasecmp("glob", opt_key) == 0) {
+      dest = &ret_listval->glob;
+    } else if (strcasecmp("regex", opt_key) == 0) {
+      dest = &ret_listval->regex;
+    } else {
+      cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
+      cmd_destroy_listval(ret_listval);
+      return CMD_PARSE_ERROR;
+    }
+
+    if ((ret_listval->glob != NULL) || (ret_listval->regex != NULL)) {
+      cmd_error(CMD_PARSE_ERROR, err,
+                "Only one of `glob' and `regex' may be given.");
+      cmd_destroy_listval(ret_listval);
+      return CMD_PARSE_ERROR;
+    }
+
+    *dest = strdup(opt_value);
+    if (*dest == NULL) {
+      cmd_error(CMD_ERROR, err, "strdup failed.");
+      cmd_destroy_listval(ret_listval);
+      return CMD_ERROR;
+    }
   }
 
   return CMD_OK;
 } /* cmd_status_t cmd_parse_listval */
 
+typedef struct {
+  char const *glob;
+  regex_t *regex;
+} listval_filter_t;
+
+static bool listval_filter(char const *name, void *data) {
+  listval_filter_t *f = data;
+
+  if (f->glob != NULL)
+    return fnmatch(f->glob, name, /* flags = */ 0) == 0;
+  return regexec(f->regex, name, /* nmatch = */ 0, NULL, /* eflags = */ 0) ==
+         0;
+} /* bool listval_filter */
+
 #define free_everything_and_return(status)                                     \
   do {                                                                         \
     for (size_t j = 0; j < number; j++) {                                      \
@@ -54,9 +109,13 @@ cmd_status_t cmd_parse_listval(size_t argc, char **argv,
     }                                                                          \
     sfree(names);                                                              \
     sfree(times);                                                              \
+    if (filter.regex != NULL)                                                  \
+      regfree(filter.regex);                                                   \
+    cmd_destroy(&cmd);                                                         \
     return status;                                                             \
   } while (0)
 
+/* The lines are only flushed once the whole response has been written. */
 #define print_to_socket(fh, ...)                                               \
   do {                                                                         \
     if (fprintf(fh, __VA_ARGS__) < 0) {                                        \
@@ -64,7 +123,6 @@ cmd_status_t cmd_parse_listval(size_t argc, char **argv,
               STRERRNO);                                                       \
       free_everything_and_return(CMD_ERROR);                                   \
     }                                                                          \
-    fflush(fh);                                                                \
   } while (0)
 
 cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
@@ -76,6 +134,9 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
   cdtime_t *times = NULL;
   size_t number = 0;
 
+  listval_filter_t filter = {0};
+  regex_t regex;
+
   DEBUG("utils_cmd_listval: handle_listval (fh = %p, buffer = %s);", (void *)fh,
         buffer);
 
@@ -87,7 +148,24 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
     free_everything_and_return(CMD_UNKNOWN_COMMAND);
   }
 
-  status = uc_get_names(&names, &times, &number);
+  if (cmd.cmd.listval.regex != NULL) {
+    int rc = regcomp(&regex, cmd.cmd.listval.regex, REG_EXTENDED | REG_NOSUB);
+    if (rc != 0) {
+      char errbuf[256];
+      regerror(rc, &regex, errbuf, sizeof(errbuf));
+      cmd_error(CMD_PARSE_ERROR, &err, "Compiling the regex `%s' failed: %s",
+                cmd.cmd.listval.regex, errbuf);
+      free_everything_and_return(CMD_PARSE_ERROR);
+    }
+    filter.regex = &regex;
+  }
+  filter.glob = cmd.cmd.listval.glob;
+
+  if ((filter.glob != NULL) || (filter.regex != NULL))
+    status = uc_get_names_filtered(listval_filter, &filter, &names, &times,
+                                   &number);
+  else
+    status = uc_get_names(&names, &times, &number);
   if (status != 0) {
     DEBUG("command listval: uc_get_names failed with status %i", status);
     cmd_error(CMD_ERROR, &err, "uc_get_names failed.");
@@ -99,5 +177,19 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
   for (size_t i = 0; i < number; i++)
     print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(times[i]), names[i]);
 
+  if (fflush(fh) != 0) {
+    WARNING("handle_listval: failed to write to socket #%i: %s", fileno(fh),
+            STRERRNO);
+    free_everything_and_return(CMD_ERROR);
+  }
+
   free_everything_and_return(CMD_OK);
 } /* cmd_status_t cmd_handle_listval */
+
+void cmd_destroy_listval(cmd_listval_t *listval) {
+  if (listval == NULL)
+    return;
+
+  sfree(listval->glob);
+  sfree(listval->regex);
+} /* void cmd_destroy_listval */
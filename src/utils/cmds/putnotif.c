@@ -60,7 +60,7 @@ static int set_option_time(notification_t *n, const char *value) {
   double tmp;
 
   errno = 0;
-  tmp = strtod(value, &endptr);
+  tmp = c_strtod(value, &endptr);
   if ((errno != 0)         /* Overflow */
       || (endptr == value) /* Invalid string */
       || (endptr == NULL)  /* This should not happen */
@@ -54,7 +54,7 @@ static int set_option(value_list_t *vl, const char *key, const char *value,
 
     endptr = NULL;
     errno = 0;
-    tmp = strtod(value, &endptr);
+    tmp = c_strtod(value, &endptr);
 
     if ((errno == 0) && (endptr != NULL) && (endptr != value) && (tmp > 0.0))
       vl->interval = DOUBLE_TO_CDTIME_T(tmp);
@@ -91,6 +91,298 @@ static int set_option(value_list_t *vl, const char *key, const char *value,
   return CMD_OK;
 } /* int set_option */
 
+/*
+ * PUTVAL batches
+ */
+
+static data_set_t const *putval_batch_get_ds(cmd_putval_batch_t *b, /* {{{ */
+                                             char const *type) {
+  uint32_t hash = 5381;
+  for (char const *c = type; *c != 0; c++)
+    hash = ((hash << 5) + hash) + (uint32_t)(unsigned char)*c;
+
+  size_t idx = hash & (CMD_PUTVAL_DS_CACHE_SIZE - 1);
+  if ((b->ds_cache[idx].ds != NULL) &&
+      (strcmp(b->ds_cache[idx].type, type) == 0))
+    return b->ds_cache[idx].ds;
+
+  data_set_t const *ds = plugin_get_ds(type);
+  if (ds == NULL)
+    return NULL;
+
+  sstrncpy(b->ds_cache[idx].type, type, sizeof(b->ds_cache[idx].type));
+  b->ds_cache[idx].ds = ds;
+  return ds;
+} /* }}} data_set_t const *putval_batch_get_ds */
+
+/* Appends a copy of `vl' with room for `values_num' values, which are left
+ * uninitialized. `ds' is the data set of `vl' or NULL. Returns NULL if memory
+ * runs out. */
+static value_list_t *putval_batch_append(cmd_putval_batch_t *b, /* {{{ */
+                                         value_list_t const *vl,
+                                         data_set_t const *ds,
+                                         size_t values_num) {
+  if (b->vl_num >= b->vl_size) {
+    size_t size = (b->vl_size == 0) ? 16 : 2 * b->vl_size;
+
+    value_list_t *tmp = realloc(b->vl, size * sizeof(*b->vl));
+    if (tmp == NULL)
+      return NULL;
+    b->vl = tmp;
+
+    size_t *off = realloc(b->values_off, size * sizeof(*b->values_off));
+    if (off == NULL)
+      return NULL;
+    b->values_off = off;
+
+    data_set_t const **dss = realloc(b->ds, size * sizeof(*b->ds));
+    if (dss == NULL)
+      return NULL;
+    b->ds = dss;
+    b->vl_size = size;
+  }
+
+  if (b->values_num + values_num > b->values_size) {
+    size_t size = (b->values_size == 0) ? 64 : b->values_size;
+    while (size < b->values_num + values_num)
+      size *= 2;
+
+    value_t *tmp = realloc(b->values, size * sizeof(*b->values));
+    if (tmp == NULL)
+      return NULL;
+    b->values = tmp;
+    b->values_size = size;
+
+    for (size_t i = 0; i < b->vl_num; i++)
+      b->vl[i].values = b->values + b->values_off[i];
+  }
+
+  value_list_t *ret = b->vl + b->vl_num;
+  *ret = *vl;
+  ret->values = b->values + b->values_num;
+  ret->values_len = values_num;
+  b->values_off[b->vl_num] = b->values_num;
+  b->ds[b->vl_num] = ds;
+
+  b->vl_num++;
+  b->values_num += values_num;
+  return ret;
+} /* }}} value_list_t *putval_batch_append */
+
+static void putval_batch_truncate(cmd_putval_batch_t *b, /* {{{ */
+                                  size_t vl_num) {
+  for (size_t i = vl_num; i < b->vl_num; i++) {
+    meta_data_destroy(b->vl[i].meta);
+    b->vl[i].meta = NULL;
+  }
+
+  if (vl_num < b->vl_num) {
+    b->values_num = b->values_off[vl_num];
+    b->vl_num = vl_num;
+  }
+} /* }}} void putval_batch_truncate */
+
+/* Copies the `len' bytes at `src' to `dst', which is `dst_size' bytes long.
+ * Returns false if they don't fit. */
+static bool putval_copy_field(char *dst, size_t dst_size, /* {{{ */
+                              char const *src, size_t len) {
+  if (len >= dst_size)
+    return false;
+  memcpy(dst, src, len);
+  dst[len] = 0;
+  return true;
+} /* }}} bool putval_copy_field */
+
+/* Splits an identifier of the form "[host/]plugin[-instance]/type[-instance]"
+ * into `vl' without modifying it. */
+static bool putval_parse_identifier(value_list_t *vl, /* {{{ */
+                                    char const *ident, size_t len,
+                                    char const *default_host) {
+  char const *end = ident + len;
+  char const *slash1 = memchr(ident, '/', len);
+  if (slash1 == NULL)
+    return false;
+  char const *slash2 = memchr(slash1 + 1, '/', end - (slash1 + 1));
+
+  char const *plugin = ident;
+  char const *type = slash1 + 1;
+  if (slash2 != NULL) {
+    if (!putval_copy_field(vl->host, sizeof(vl->host), ident, slash1 - ident))
+      return false;
+    plugin = slash1 + 1;
+    type = slash2 + 1;
+  } else if (default_host != NULL) {
+    sstrncpy(vl->host, default_host, sizeof(vl->host));
+  } else {
+    return false;
+  }
+
+  /* Like parse_identifier(), this treats any further slashes as part of the
+   * type (instance). */
+  char const *plugin_end = type - 1;
+  char const *dash = memchr(plugin, '-', plugin_end - plugin);
+  if (dash != NULL) {
+    if (!putval_copy_field(vl->plugin_instance, sizeof(vl->plugin_instance),
+                           dash + 1, plugin_end - (dash + 1)))
+      return false;
+    plugin_end = dash;
+  }
+  if (!putval_copy_field(vl->plugin, sizeof(vl->plugin), plugin,
+                         plugin_end - plugin))
+    return false;
+
+  char const *type_end = end;
+  dash = memchr(type, '-', end - type);
+  if (dash != NULL) {
+    if (!putval_copy_field(vl->type_instance, sizeof(vl->type_instance),
+                           dash + 1, end - (dash + 1)))
+      return false;
+    type_end = dash;
+  }
+  return putval_copy_field(vl->type, sizeof(vl->type), type, type_end - type);
+} /* }}} bool putval_parse_identifier */
+
+/* Parses "<time>:<value>[:<value>...]" within [str, end) into `vl'. Only
+ * succeeds if exactly `ds->ds_num' values are given. */
+static bool putval_parse_values(value_list_t *vl, /* {{{ */
+                                data_set_t const *ds, char const *str,
+                                char const *end) {
+  char *endptr = NULL;
+
+  if ((str < end) && (str[0] == 'N') && (str + 1 < end) && (str[1] == ':')) {
+    vl->time = cdtime();
+    str += 1;
+  } else {
+    /* The strto* functions skip leading white space, which would make them
+     * read past the end of the field. */
+    if ((str >= end) || !(isdigit((int)str[0]) || (str[0] == '.')))
+      return false;
+    errno = 0;
+    double tmp = c_strtod(str, &endptr);
+    if ((errno != 0) || (endptr >= end) || (*endptr != ':'))
+      return false;
+    vl->time = DOUBLE_TO_CDTIME_T(tmp);
+    /* parse_values() would read the next field as the time, too. */
+    if (vl->time == 0)
+      return false;
+    str = endptr;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    /* str points to the colon before the next value. */
+    str++;
+    if ((str >= end) || (*str == ':') || isspace((int)*str))
+      return false;
+
+    int type = ds->ds[i].type;
+    if ((str[0] == 'U') && (type == DS_TYPE_GAUGE) &&
+        ((str + 1 == end) || (str[1] == ':'))) {
+      vl->values[i].gauge = NAN;
+      str++;
+      continue;
+    }
+
+    switch (type) {
+    case DS_TYPE_COUNTER:
+      vl->values[i].counter = (counter_t)c_strtoull(str, &endptr, 0);
+      break;
+    case DS_TYPE_GAUGE:
+      vl->values[i].gauge = (gauge_t)c_strtod(str, &endptr);
+      break;
+    case DS_TYPE_DERIVE:
+      vl->values[i].derive = (derive_t)c_strtoll(str, &endptr, 0);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      vl->values[i].absolute = (absolute_t)c_strtoull(str, &endptr, 0);
+      break;
+    default:
+      return false;
+    }
+
+    if ((endptr == str) || (endptr > end) ||
+        ((endptr < end) && (*endptr != ':')))
+      return false;
+    str = endptr;
+  }
+
+  return str == end;
+} /* }}} bool putval_parse_values */
+
+/* Parses `line' without modifying it. Returns false, with `b' unchanged, if
+ * the line needs the generic parser: because it uses quotes, escapes or meta
+ * data, or because it is invalid and an error has to be reported. */
+static bool putval_parse_fast(cmd_putval_batch_t *b, /* {{{ */
+                              char const *line, const cmd_options_t *opts) {
+  char const *ptr = line;
+  while (isspace((int)*ptr))
+    ptr++;
+  if ((strncasecmp("PUTVAL", ptr, strlen("PUTVAL")) != 0) ||
+      !isspace((int)ptr[strlen("PUTVAL")]))
+    return false;
+  ptr += strlen("PUTVAL");
+
+  size_t vl_num = b->vl_num;
+  value_list_t vl = VALUE_LIST_INIT;
+  data_set_t const *ds = NULL;
+
+  while (42) {
+    while (isspace((int)*ptr))
+      ptr++;
+    if (*ptr == 0)
+      break;
+
+    char const *field = ptr;
+    while ((*ptr != 0) && !isspace((int)*ptr)) {
+      if ((*ptr == '"') || (*ptr == '\\'))
+        goto fallback;
+      ptr++;
+    }
+    size_t len = (size_t)(ptr - field);
+
+    if (ds == NULL) {
+      if (!putval_parse_identifier(&vl, field, len,
+                                   opts->identifier_default_host))
+        goto fallback;
+      ds = putval_batch_get_ds(b, vl.type);
+      if (ds == NULL)
+        goto fallback;
+      continue;
+    }
+
+    /* Options are recognized like cmd_parse_option() does. */
+    char const *value = field;
+    while (isalnum((int)*value) || (*value == '_') || (*value == ':'))
+      value++;
+    if ((*value == '=') && (value != field)) {
+      if (((size_t)(value - field) != strlen("interval")) ||
+          (strncasecmp("interval", field, strlen("interval")) != 0) ||
+          (value + 1 == ptr))
+        goto fallback;
+
+      char *endptr = NULL;
+      errno = 0;
+      double tmp = c_strtod(value + 1, &endptr);
+      if ((errno == 0) && (endptr != value + 1) && (tmp > 0.0))
+        vl.interval = DOUBLE_TO_CDTIME_T(tmp);
+      continue;
+    }
+
+    value_list_t *new_vl = putval_batch_append(b, &vl, ds, ds->ds_num);
+    if (new_vl == NULL)
+      goto fallback;
+    if (!putval_parse_values(new_vl, ds, field, ptr))
+      goto fallback;
+  }
+
+  /* Without values, let cmd_parse() report the error. */
+  if (b->vl_num != vl_num)
+    return true;
+
+fallback:
+  putval_batch_truncate(b, vl_num);
+  return false;
+} /* }}} bool putval_parse_fast */
+
 /*
  * public API
  */
@@ -273,33 +565,118 @@ void cmd_destroy_putval(cmd_putval_t *putval) {
 
 cmd_status_t cmd_handle_putval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
-  cmd_t cmd;
-
-  int status;
 
   DEBUG("utils_cmd_putval: cmd_handle_putval (fh = %p, buffer = %s);",
         (void *)fh, buffer);
 
-  if ((status = cmd_parse(buffer, &cmd, NULL, &err)) != CMD_OK)
+  cmd_putval_batch_t *batch = cmd_putval_batch_create();
+  if (batch == NULL) {
+    cmd_error(CMD_ERROR, &err, "malloc failed.");
+    return CMD_ERROR;
+  }
+
+  cmd_status_t status = cmd_putval_batch_add(batch, buffer, NULL, &err);
+  if (status != CMD_OK) {
+    cmd_putval_batch_destroy(batch);
+    return status;
+  }
+
+  size_t vl_num = batch->vl_num;
+  cmd_putval_batch_dispatch(batch);
+
+  if (fh != stdout)
+    cmd_error(CMD_OK, &err, "Success: %i %s been dispatched.", (int)vl_num,
+              (vl_num == 1) ? "value has" : "values have");
+
+  cmd_putval_batch_destroy(batch);
+  return CMD_OK;
+} /* int cmd_handle_putval */
+
+cmd_putval_batch_t *cmd_putval_batch_create(void) /* {{{ */
+{
+  return calloc(1, sizeof(cmd_putval_batch_t));
+} /* }}} cmd_putval_batch_t *cmd_putval_batch_create */
+
+cmd_status_t cmd_putval_batch_add(cmd_putval_batch_t *batch, /* {{{ */
+                                  char *line, const cmd_options_t *opts,
+                                  cmd_error_handler_t *err) {
+  static const cmd_options_t default_opts = {
+      /* identifier_default_host = */ NULL,
+  };
+
+  if ((batch == NULL) || (line == NULL)) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_putval_batch_add.");
+    return CMD_ERROR;
+  }
+
+  if (putval_parse_fast(batch, line, (opts != NULL) ? opts : &default_opts))
+    return CMD_OK;
+
+  cmd_t cmd;
+  cmd_status_t status = cmd_parse(line, &cmd, opts, err);
+  if (status != CMD_OK)
     return status;
   if (cmd.type != CMD_PUTVAL) {
-    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+    cmd_error(CMD_UNKNOWN_COMMAND, err, "Unexpected command: `%s'.",
               CMD_TO_STRING(cmd.type));
     cmd_destroy(&cmd);
     return CMD_UNKNOWN_COMMAND;
   }
 
-  for (size_t i = 0; i < cmd.cmd.putval.vl_num; ++i)
-    plugin_dispatch_values(&cmd.cmd.putval.vl[i]);
-
-  if (fh != stdout)
-    cmd_error(CMD_OK, &err, "Success: %i %s been dispatched.",
-              (int)cmd.cmd.putval.vl_num,
-              (cmd.cmd.putval.vl_num == 1) ? "value has" : "values have");
+  size_t vl_num = batch->vl_num;
+  for (size_t i = 0; i < cmd.cmd.putval.vl_num; i++) {
+    value_list_t *src = cmd.cmd.putval.vl + i;
+    value_list_t *dst =
+        putval_batch_append(batch, src, putval_batch_get_ds(batch, src->type),
+                            src->values_len);
+    if (dst == NULL) {
+      cmd_error(CMD_ERROR, err, "realloc failed.");
+      putval_batch_truncate(batch, vl_num);
+      cmd_destroy(&cmd);
+      return CMD_ERROR;
+    }
+    memcpy(dst->values, src->values, src->values_len * sizeof(*src->values));
+    /* The meta data is now owned by the batch. */
+    src->meta = NULL;
+  }
 
   cmd_destroy(&cmd);
   return CMD_OK;
-} /* int cmd_handle_putval */
+} /* }}} cmd_status_t cmd_putval_batch_add */
+
+int cmd_putval_batch_dispatch(cmd_putval_batch_t *batch) /* {{{ */
+{
+  if (batch == NULL)
+    return EINVAL;
+  if (batch->vl_num == 0)
+    return 0;
+
+  int status =
+      plugin_dispatch_values_batch_ds(batch->vl, batch->ds, batch->vl_num);
+  cmd_putval_batch_reset(batch);
+  return status;
+} /* }}} int cmd_putval_batch_dispatch */
+
+void cmd_putval_batch_reset(cmd_putval_batch_t *batch) /* {{{ */
+{
+  if (batch == NULL)
+    return;
+  putval_batch_truncate(batch, 0);
+} /* }}} void cmd_putval_batch_reset */
+
+void cmd_putval_batch_destroy(cmd_putval_batch_t *batch) /* {{{ */
+{
+  if (batch == NULL)
+    return;
+
+  cmd_putval_batch_reset(batch);
+  sfree(batch->vl);
+  sfree(batch->values_off);
+  sfree(batch->ds);
+  sfree(batch->values);
+  sfree(batch);
+} /* }}} void cmd_putval_batch_destroy */
 
 int cmd_create_putval(char *ret, size_t ret_len, /* {{{ */
                       const data_set_t *ds, const value_list_t *vl) {
@@ -39,6 +39,54 @@ cmd_status_t cmd_parse_putval(size_t argc, char **argv,
 
 cmd_status_t cmd_handle_putval(FILE *fh, char *buffer);
 
+/* Number of data sets cached by a cmd_putval_batch_t. Must be a power of two.
+ */
+#define CMD_PUTVAL_DS_CACHE_SIZE 16
+
+/* Collects the value lists of several PUTVAL commands so they can be handed to
+ * the daemon with one call to plugin_dispatch_values_batch_ds(). Simple
+ * commands (no quotes, escapes or meta data) are parsed in a single pass that
+ * does not modify or copy the input line, and the data sets of recently seen
+ * types are cached. Everything else goes through cmd_parse(). A batch must not
+ * be kept across calls to plugin_unregister_data_set(). */
+typedef struct {
+  value_list_t *vl;
+  size_t vl_num;
+
+  /* private */
+  size_t vl_size;
+  /* Data sets of the value lists, handed on to the daemon. */
+  data_set_t const **ds;
+  /* Values of all value lists; vl[i].values points to values + values_off[i].
+   */
+  value_t *values;
+  size_t *values_off;
+  size_t values_num;
+  size_t values_size;
+  struct {
+    char type[DATA_MAX_NAME_LEN];
+    data_set_t const *ds;
+  } ds_cache[CMD_PUTVAL_DS_CACHE_SIZE];
+} cmd_putval_batch_t;
+
+cmd_putval_batch_t *cmd_putval_batch_create(void);
+
+/* Parses the PUTVAL command in `line' and appends its value lists to `batch'.
+ * `line' may be modified. On failure, nothing is appended and the error is
+ * reported through `err'. */
+cmd_status_t cmd_putval_batch_add(cmd_putval_batch_t *batch, char *line,
+                                  const cmd_options_t *opts,
+                                  cmd_error_handler_t *err);
+
+/* Dispatches all value lists in `batch' and resets it. Returns zero on
+ * success or an errno value. */
+int cmd_putval_batch_dispatch(cmd_putval_batch_t *batch);
+
+/* Removes all value lists from `batch' without dispatching them. */
+void cmd_putval_batch_reset(cmd_putval_batch_t *batch);
+
+void cmd_putval_batch_destroy(cmd_putval_batch_t *batch);
+
 void cmd_destroy_putval(cmd_putval_t *putval);
 
 int cmd_create_putval(char *ret, size_t ret_len, const data_set_t *ds,
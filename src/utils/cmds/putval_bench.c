@@ -0,0 +1,204 @@
+/**
+ * collectd - src/utils/cmds/putval_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Measures the time per line needed to parse PUTVAL commands, using the
+ * generic command parser, cmd_handle_putval() and PUTVAL batches. Prints one
+ * line of JSON per case. Dispatching is done by the plugin mock, so this only
+ * measures parsing.
+ *
+ * Usage: bench_utils_putval [-n <lines>] [-T <seconds>] [<case> ...]
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/cmds/cmds.h"
+#include "utils/cmds/putval.h"
+#include "utils/common/common.h"
+
+#include <getopt.h>
+
+#define LINE_SIZE 256
+
+typedef struct bench_case_s bench_case_t;
+struct bench_case_s {
+  char const *name;
+  /* Parses the `num' lines at `lines', each `LINE_SIZE' bytes long. Returns
+   * the number of lines that failed. */
+  size_t (*parse)(char *lines, size_t num);
+};
+
+static size_t conf_lines_num = 1000;
+static double conf_duration = 0.5;
+
+static char *lines;
+static char *scratch;
+static cmd_putval_batch_t *batch;
+static cmd_error_handler_t err = {cmd_error_fh, NULL};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t bench_generic(char *lines, size_t num) {
+  size_t failed = 0;
+  for (size_t i = 0; i < num; i++) {
+    cmd_t cmd;
+    if (cmd_parse(lines + i * LINE_SIZE, &cmd, NULL, &err) != CMD_OK) {
+      failed++;
+      continue;
+    }
+    cmd_destroy(&cmd);
+  }
+  return failed;
+}
+
+static size_t bench_handle(char *lines, size_t num) {
+  size_t failed = 0;
+  for (size_t i = 0; i < num; i++)
+    if (cmd_handle_putval(stdout, lines + i * LINE_SIZE) != CMD_OK)
+      failed++;
+  return failed;
+}
+
+static size_t bench_batch(char *lines, size_t num) {
+  size_t failed = 0;
+  for (size_t i = 0; i < num; i++)
+    if (cmd_putval_batch_add(batch, lines + i * LINE_SIZE, NULL, &err) !=
+        CMD_OK)
+      failed++;
+  /* The mock does not support dispatching; only the reset is measured. */
+  cmd_putval_batch_dispatch(batch);
+  return failed;
+}
+
+static bench_case_t cases[] = {
+    {"generic", bench_generic},
+    {"handle", bench_handle},
+    {"batch", bench_batch},
+};
+
+static int create_lines(void) {
+  lines = calloc(conf_lines_num, LINE_SIZE);
+  scratch = calloc(conf_lines_num, LINE_SIZE);
+  batch = cmd_putval_batch_create();
+  if ((lines == NULL) || (scratch == NULL) || (batch == NULL))
+    return ENOMEM;
+
+  for (size_t i = 0; i < conf_lines_num; i++)
+    ssnprintf(lines + i * LINE_SIZE, LINE_SIZE,
+              "PUTVAL host%03zu.example.com/magic-%zu/MAGIC-value interval=10 "
+              "1700000000.123:%zu",
+              i / 16, i % 16, 1000 * i);
+
+  return 0;
+}
+
+static void run_case(bench_case_t const *c) {
+  /* Warm up, and check that the parser works at all. */
+  memcpy(scratch, lines, conf_lines_num * LINE_SIZE);
+  if (c->parse(scratch, conf_lines_num) != 0) {
+    fprintf(stderr, "%s: parsing failed.\n", c->name);
+    return;
+  }
+
+  uint64_t num = 0;
+  uint64_t failed = 0;
+  double copy = 0.0;
+
+  double start = now();
+  double elapsed;
+  do {
+    /* Parsing may modify the lines. Copying them is timed separately and
+     * subtracted. */
+    double copy_start = now();
+    memcpy(scratch, lines, conf_lines_num * LINE_SIZE);
+    copy += now() - copy_start;
+
+    failed += c->parse(scratch, conf_lines_num);
+    num += conf_lines_num;
+    elapsed = now() - start;
+  } while (elapsed < conf_duration);
+
+  printf("{\"case\":\"%s\",\"lines\":%" PRIu64 ",\"failed\":%" PRIu64
+         ",\"ns_per_line\":%.1f}\n",
+         c->name, num, failed, 1e9 * (elapsed - copy) / (double)num);
+  fflush(stdout);
+}
+
+__attribute__((noreturn)) static void exit_usage(char const *name,
+                                                 int status) {
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr,
+          "Usage: %s [-n <lines>] [-T <seconds>] [<case> ...]\n"
+          "\n"
+          "Cases:",
+          name);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    fprintf((status == EXIT_SUCCESS) ? stdout : stderr, " %s", cases[i].name);
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr, "\n");
+  exit(status);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:T:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      conf_lines_num = (size_t)strtoull(optarg, NULL, 0);
+      break;
+    case 'T':
+      conf_duration = atof(optarg);
+      break;
+    case 'h':
+      exit_usage(argv[0], EXIT_SUCCESS);
+    default:
+      exit_usage(argv[0], EXIT_FAILURE);
+    }
+  }
+  if (conf_lines_num == 0)
+    exit_usage(argv[0], EXIT_FAILURE);
+
+  err.ud = stderr;
+  if (create_lines() != 0) {
+    fprintf(stderr, "Creating the lines failed.\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    bool selected = (optind >= argc);
+    for (int j = optind; j < argc; j++)
+      if (strcmp(argv[j], cases[i].name) == 0)
+        selected = true;
+    if (selected)
+      run_case(cases + i);
+  }
+
+  cmd_putval_batch_destroy(batch);
+  free(scratch);
+  free(lines);
+  return 0;
+}
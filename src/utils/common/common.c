@@ -913,6 +913,200 @@ int format_name(char *ret, int ret_len, const char *hostname,
   return 0;
 } /* int format_name */
 
+/* Powers of ten that are exactly representable as double. */
+static double const pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* Writes the decimal digits of `value' to `str' and returns their number. */
+static size_t format_digits(char *str, uint64_t value) /* {{{ */
+{
+  char digits[20];
+  size_t i = sizeof(digits);
+
+  do {
+    digits[--i] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value != 0);
+
+  memcpy(str, digits + i, sizeof(digits) - i);
+  return sizeof(digits) - i;
+} /* }}} size_t format_digits */
+
+/* Copies `str' to `buf' with the truncation and return value of snprintf. */
+static int format_copy(char *buf, size_t size, char const *str, /* {{{ */
+                       size_t len) {
+  if (size > 0) {
+    size_t n = (len < size) ? len : size - 1;
+    memcpy(buf, str, n);
+    buf[n] = 0;
+  }
+  return (int)len;
+} /* }}} int format_copy */
+
+/* Rounds the positive value `v' to an integer after scaling it by 10^k. The
+ * scaling is a single, correctly rounded operation, so for results below
+ * 2^50 the scaled value is off by at most 1/16. Returns false if that is too
+ * close to half-way between two integers to round reliably. */
+static bool format_scale_round(double v, int k, uint64_t *ret) /* {{{ */
+{
+  if ((k < -22) || (k > 22))
+    return false;
+
+  double s = (k >= 0) ? v * pow10_exact[k] : v / pow10_exact[-k];
+  if (!(s < 1125899906842624.0)) /* 2^50 */
+    return false;
+
+  uint64_t n = (uint64_t)s;
+  double f = s - (double)n;
+  if ((f > 0.375) && (f < 0.625))
+    return false;
+
+  *ret = n + ((f > 0.5) ? 1 : 0);
+  return true;
+} /* }}} bool format_scale_round */
+
+/* Formats `v' like "%.15g" into `str', which must hold at least 32 bytes.
+ * Returns the length or -1 if `v' has to be formatted by snprintf. */
+static int format_gauge_fast(char *str, double v) /* {{{ */
+{
+  size_t len = 0;
+
+  if (!isfinite(v))
+    return -1;
+
+  if (signbit(v)) {
+    str[len++] = '-';
+    v = -v;
+  }
+
+  /* Integers with at most 15 digits are printed as such. */
+  if ((v < 1e15) && (v == (double)(uint64_t)v))
+    return (int)(len + format_digits(str + len, (uint64_t)v));
+
+  /* Round to 15 significant digits: 1e14 <= n < 1e15 and v ~= n * 10^(x-14).
+   * The decimal exponent `x' is estimated from the binary exponent, which
+   * may be one too small. 1233 / 4096 is slightly less than log10(2). */
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  int x2 = (int)((bits >> 52) & 0x7ff) - 1023;
+  int x = (x2 >= 0) ? (x2 * 1233) / 4096 : -((-x2 * 1233 + 4095) / 4096);
+  uint64_t n = 0;
+  for (int i = 0;; i++) {
+    if ((i > 2) || !format_scale_round(v, 14 - x, &n))
+      return -1;
+    if (n < 100000000000000ULL)
+      x--;
+    else if (n > 1000000000000000ULL)
+      x++;
+    else
+      break;
+  }
+  if (n == 1000000000000000ULL) {
+    n /= 10;
+    x++;
+  }
+
+  char digits[15];
+  format_digits(digits, n);
+  size_t digits_num = sizeof(digits);
+  while ((digits_num > 1) && (digits[digits_num - 1] == '0'))
+    digits_num--;
+
+  if ((x < -4) || (x >= 15)) {
+    str[len++] = digits[0];
+    if (digits_num > 1) {
+      str[len++] = '.';
+      memcpy(str + len, digits + 1, digits_num - 1);
+      len += digits_num - 1;
+    }
+    str[len++] = 'e';
+    str[len++] = (x < 0) ? '-' : '+';
+    if (x < 0)
+      x = -x;
+    if (x < 10)
+      str[len++] = '0';
+    len += format_digits(str + len, (uint64_t)x);
+  } else if (x >= 0) {
+    memcpy(str + len, digits, (size_t)x + 1);
+    len += (size_t)x + 1;
+    if (digits_num > (size_t)x + 1) {
+      str[len++] = '.';
+      memcpy(str + len, digits + x + 1, digits_num - (size_t)x - 1);
+      len += digits_num - (size_t)x - 1;
+    }
+  } else {
+    str[len++] = '0';
+    str[len++] = '.';
+    for (int i = -1; i > x; i--)
+      str[len++] = '0';
+    memcpy(str + len, digits, digits_num);
+    len += digits_num;
+  }
+
+  return (int)len;
+} /* }}} int format_gauge_fast */
+
+int format_gauge(char *buf, size_t size, gauge_t value) /* {{{ */
+{
+  char str[32];
+  int len = -1;
+
+  /* GAUGE_FORMAT may be overridden at build time. */
+  if (strcmp(GAUGE_FORMAT, "%.15g") == 0)
+    len = format_gauge_fast(str, value);
+  if (len < 0)
+    return snprintf(buf, size, GAUGE_FORMAT, value);
+
+  return format_copy(buf, size, str, (size_t)len);
+} /* }}} int format_gauge */
+
+int format_fixed(char *buf, size_t size, double value, /* {{{ */
+                 int precision) {
+  char str[32];
+  size_t len = 0;
+  uint64_t n;
+
+  if (!isfinite(value) || (precision < 0) || (precision > 9) ||
+      !format_scale_round(signbit(value) ? -value : value, precision, &n))
+    return snprintf(buf, size, "%.*f", precision, value);
+
+  if (signbit(value))
+    str[len++] = '-';
+
+  uint64_t scale = (uint64_t)pow10_exact[precision];
+  len += format_digits(str + len, n / scale);
+  if (precision > 0) {
+    uint64_t frac = n % scale;
+    str[len++] = '.';
+    for (int i = precision - 1; i >= 0; i--) {
+      str[len + (size_t)i] = (char)('0' + (frac % 10));
+      frac /= 10;
+    }
+    len += (size_t)precision;
+  }
+
+  return format_copy(buf, size, str, len);
+} /* }}} int format_fixed */
+
+int format_uint64(char *buf, size_t size, uint64_t value) /* {{{ */
+{
+  char str[20];
+  return format_copy(buf, size, str, format_digits(str, value));
+} /* }}} int format_uint64 */
+
+int format_int64(char *buf, size_t size, int64_t value) /* {{{ */
+{
+  char str[21];
+  if (value >= 0)
+    return format_copy(buf, size, str, format_digits(str, (uint64_t)value));
+
+  str[0] = '-';
+  size_t len = 1 + format_digits(str + 1, ((uint64_t)(-(value + 1))) + 1);
+  return format_copy(buf, size, str, len);
+} /* }}} int format_int64 */
+
 int format_values(char *ret, size_t ret_len, /* {{{ */
                   const data_set_t *ds, const value_list_t *vl,
                   bool store_rates) {
@@ -924,9 +1118,11 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
 
   memset(ret, 0, ret_len);
 
-#define BUFFER_ADD(...)                                                        \
+/* Appends the output of one of the format_* functions above, which behave
+ * like snprintf(). */
+#define BUFFER_ADD(func, ...)                                                  \
   do {                                                                         \
-    status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
+    status = func(ret + offset, ret_len - offset, __VA_ARGS__);                \
     if (status < 1) {                                                          \
       sfree(rates);                                                            \
       return -1;                                                               \
@@ -936,12 +1132,21 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
     } else                                                                     \
       offset += ((size_t)status);                                              \
   } while (0)
+#define BUFFER_ADD_SEPARATOR()                                                 \
+  do {                                                                         \
+    if ((ret_len - offset) < 2) {                                              \
+      sfree(rates);                                                            \
+      return -1;                                                               \
+    }                                                                          \
+    ret[offset++] = ':';                                                       \
+  } while (0)
 
-  BUFFER_ADD("%.3f", CDTIME_T_TO_DOUBLE(vl->time));
+  BUFFER_ADD(format_fixed, CDTIME_T_TO_DOUBLE(vl->time), 3);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
+    BUFFER_ADD_SEPARATOR();
     if (ds->ds[i].type == DS_TYPE_GAUGE)
-      BUFFER_ADD(":" GAUGE_FORMAT, vl->values[i].gauge);
+      BUFFER_ADD(format_gauge, vl->values[i].gauge);
     else if (store_rates) {
       if (rates == NULL)
         rates = uc_get_rate(ds, vl);
@@ -949,13 +1154,13 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
         WARNING("format_values: uc_get_rate failed.");
         return -1;
       }
-      BUFFER_ADD(":" GAUGE_FORMAT, rates[i]);
+      BUFFER_ADD(format_gauge, rates[i]);
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD(":%" PRIu64, (uint64_t)vl->values[i].counter);
+      BUFFER_ADD(format_uint64, (uint64_t)vl->values[i].counter);
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD(":%" PRIi64, vl->values[i].derive);
+      BUFFER_ADD(format_int64, vl->values[i].derive);
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD(":%" PRIu64, vl->values[i].absolute);
+      BUFFER_ADD(format_uint64, vl->values[i].absolute);
     else {
       ERROR("format_values: Unknown data source type: %i", ds->ds[i].type);
       sfree(rates);
@@ -964,6 +1169,7 @@ int format_values(char *ret, size_t ret_len, /* {{{ */
   } /* for ds->ds_num */
 
 #undef BUFFER_ADD
+#undef BUFFER_ADD_SEPARATOR
 
   sfree(rates);
   return 0;
@@ -1074,19 +1280,19 @@ int parse_value(const char *value_orig, value_t *ret_value, int ds_type) {
 
   switch (ds_type) {
   case DS_TYPE_COUNTER:
-    ret_value->counter = (counter_t)strtoull(value, &endptr, 0);
+    ret_value->counter = (counter_t)c_strtoull(value, &endptr, 0);
     break;
 
   case DS_TYPE_GAUGE:
-    ret_value->gauge = (gauge_t)strtod(value, &endptr);
+    ret_value->gauge = (gauge_t)c_strtod(value, &endptr);
     break;
 
   case DS_TYPE_DERIVE:
-    ret_value->derive = (derive_t)strtoll(value, &endptr, 0);
+    ret_value->derive = (derive_t)c_strtoll(value, &endptr, 0);
     break;
 
   case DS_TYPE_ABSOLUTE:
-    ret_value->absolute = (absolute_t)strtoull(value, &endptr, 0);
+    ret_value->absolute = (absolute_t)c_strtoull(value, &endptr, 0);
     break;
 
   default:
@@ -1139,7 +1345,7 @@ int parse_values(char *buffer, value_list_t *vl, const data_set_t *ds) {
         double tmp;
 
         errno = 0;
-        tmp = strtod(ptr, &endptr);
+        tmp = c_strtod(ptr, &endptr);
         if ((errno != 0)        /* Overflow */
             || (endptr == ptr)  /* Invalid string */
             || (endptr == NULL) /* This should not happen */
@@ -1559,7 +1765,7 @@ int strtoderive(const char *string, derive_t *ret_value) /* {{{ */
 
   errno = 0;
   endptr = NULL;
-  tmp = (derive_t)strtoll(string, &endptr, /* base = */ 0);
+  tmp = (derive_t)c_strtoll(string, &endptr, /* base = */ 0);
   if ((endptr == string) || (errno != 0))
     return -1;
 
@@ -1577,7 +1783,7 @@ int strtogauge(const char *string, gauge_t *ret_value) /* {{{ */
 
   errno = 0;
   endptr = NULL;
-  tmp = (gauge_t)strtod(string, &endptr);
+  tmp = (gauge_t)c_strtod(string, &endptr);
   if (errno != 0)
     return errno;
   else if ((endptr == NULL) || (*endptr != 0))
@@ -1587,6 +1793,155 @@ int strtogauge(const char *string, gauge_t *ret_value) /* {{{ */
   return 0;
 } /* }}} int strtogauge */
 
+static bool is_digit(char c) { return (c >= '0') && (c <= '9'); }
+
+/* Skips the white space skipped by strtod(3) and friends in the "C" locale. */
+static char const *skip_space(char const *str) /* {{{ */
+{
+  while ((*str == ' ') || ((*str >= '\t') && (*str <= '\r')))
+    str++;
+  return str;
+} /* }}} char const *skip_space */
+
+/* Parses up to `digits_max' decimal digits. Returns false if the number has to
+ * be handed to the libc, because it's not decimal or has too many digits. */
+static bool parse_decimal(char const **str, int base, /* {{{ */
+                          int digits_max, uint64_t *ret) {
+  char const *ptr = *str;
+
+  if (((base != 0) && (base != 10)) || !is_digit(*ptr))
+    return false;
+  /* With base zero, a leading zero starts an octal or hexadecimal number. */
+  if ((base == 0) && (ptr[0] == '0') &&
+      (is_digit(ptr[1]) || (ptr[1] == 'x') || (ptr[1] == 'X')))
+    return false;
+
+  uint64_t value = 0;
+  for (int i = 0; is_digit(*ptr); i++, ptr++) {
+    if (i >= digits_max)
+      return false;
+    value = (10 * value) + (uint64_t)(*ptr - '0');
+  }
+
+  *str = ptr;
+  *ret = value;
+  return true;
+} /* }}} bool parse_decimal */
+
+unsigned long long c_strtoull(const char *nptr, char **endptr, /* {{{ */
+                              int base) {
+  char const *ptr = skip_space(nptr);
+  uint64_t value;
+
+  if (*ptr == '+')
+    ptr++;
+  /* 19 digits always fit into 64 bits. */
+  if (!parse_decimal(&ptr, base, 19, &value))
+    return strtoull(nptr, endptr, base);
+
+  if (endptr != NULL)
+    *endptr = (char *)ptr;
+  return (unsigned long long)value;
+} /* }}} unsigned long long c_strtoull */
+
+long long c_strtoll(const char *nptr, char **endptr, int base) /* {{{ */
+{
+  char const *ptr = skip_space(nptr);
+  bool negative = false;
+  uint64_t value;
+
+  if ((*ptr == '+') || (*ptr == '-')) {
+    negative = (*ptr == '-');
+    ptr++;
+  }
+  if (!parse_decimal(&ptr, base, 18, &value))
+    return strtoll(nptr, endptr, base);
+
+  if (endptr != NULL)
+    *endptr = (char *)ptr;
+  return negative ? -(long long)value : (long long)value;
+} /* }}} long long c_strtoll */
+
+/* Decimal numbers with at most 19 significant digits, a mantissa of at most
+ * 2^53 and a power of ten of at most 22 are converted with a single
+ * multiplication or division of two exactly representable values. That is
+ * correctly rounded, i.e. the same result strtod(3) returns. */
+double c_strtod(const char *nptr, char **endptr) /* {{{ */
+{
+  char const *ptr = skip_space(nptr);
+  bool negative = false;
+
+  if ((*ptr == '+') || (*ptr == '-')) {
+    negative = (*ptr == '-');
+    ptr++;
+  }
+  if ((ptr[0] == '0') && ((ptr[1] == 'x') || (ptr[1] == 'X')))
+    return strtod(nptr, endptr);
+
+  uint64_t mantissa = 0;
+  int digits_num = 0;
+  int exponent = 0;
+  bool have_digits = false;
+
+  for (; is_digit(*ptr); ptr++) {
+    have_digits = true;
+    if ((mantissa == 0) && (*ptr == '0'))
+      continue;
+    if (digits_num >= 19)
+      return strtod(nptr, endptr);
+    mantissa = (10 * mantissa) + (uint64_t)(*ptr - '0');
+    digits_num++;
+  }
+  if (*ptr == '.') {
+    for (ptr++; is_digit(*ptr); ptr++) {
+      have_digits = true;
+      exponent--;
+      if ((mantissa == 0) && (*ptr == '0'))
+        continue;
+      if (digits_num >= 19)
+        return strtod(nptr, endptr);
+      mantissa = (10 * mantissa) + (uint64_t)(*ptr - '0');
+      digits_num++;
+    }
+  }
+  /* "inf", "nan" and strings that aren't numbers at all. */
+  if (!have_digits)
+    return strtod(nptr, endptr);
+
+  /* The exponent is only part of the number if it has digits. */
+  if ((*ptr == 'e') || (*ptr == 'E')) {
+    char const *exp_ptr = ptr + 1;
+    bool exp_negative = false;
+    if ((*exp_ptr == '+') || (*exp_ptr == '-')) {
+      exp_negative = (*exp_ptr == '-');
+      exp_ptr++;
+    }
+    if (is_digit(*exp_ptr)) {
+      int value = 0;
+      for (; is_digit(*exp_ptr); exp_ptr++) {
+        if (value > 1000)
+          return strtod(nptr, endptr);
+        value = (10 * value) + (*exp_ptr - '0');
+      }
+      exponent += exp_negative ? -value : value;
+      ptr = exp_ptr;
+    }
+  }
+
+  double value = (double)mantissa;
+  if (mantissa != 0) {
+    if ((mantissa > (UINT64_C(1) << 53)) || (exponent < -22) ||
+        (exponent > 22))
+      return strtod(nptr, endptr);
+    value = (exponent < 0) ? value / pow10_exact[-exponent]
+                           : value * pow10_exact[exponent];
+  }
+
+  if (endptr != NULL)
+    *endptr = (char *)ptr;
+  return negative ? -value : value;
+} /* }}} double c_strtod */
+
 int strarray_add(char ***ret_array, size_t *ret_array_len,
                  char const *str) /* {{{ */
 {
@@ -327,6 +327,15 @@ int format_name(char *ret, int ret_len, const char *hostname,
 int format_values(char *ret, size_t ret_len, const data_set_t *ds,
                   const value_list_t *vl, bool store_rates);
 
+/* Replacements for snprintf(3) with GAUGE_FORMAT, "%.*f", PRIu64 and PRIi64
+ * respectively. Output, truncation and return value are identical to the
+ * snprintf(3) call they replace, but common values are formatted without
+ * going through printf's format parser. */
+int format_gauge(char *buf, size_t size, gauge_t value);
+int format_fixed(char *buf, size_t size, double value, int precision);
+int format_uint64(char *buf, size_t size, uint64_t value);
+int format_int64(char *buf, size_t size, int64_t value);
+
 int parse_identifier(char *str, char **ret_host, char **ret_plugin,
                      char **ret_plugin_instance, char **ret_type,
                      char **ret_type_instance, char *default_host);
@@ -394,6 +403,15 @@ int strtoderive(const char *string, derive_t *ret_value);
  * failure. If failure is returned, ret_value is not touched. */
 int strtogauge(const char *string, gauge_t *ret_value);
 
+/* Replacements for strtod(3), strtoll(3) and strtoull(3). Plain decimal
+ * numbers are converted directly, independent of the locale; anything else,
+ * such as hexadecimal numbers, "inf", "nan" or more than 19 significant
+ * digits, is handed to the libc function. Results, `endptr' and errno are the
+ * same as with the libc functions in the "C" locale. */
+double c_strtod(const char *nptr, char **endptr);
+long long c_strtoll(const char *nptr, char **endptr, int base);
+unsigned long long c_strtoull(const char *nptr, char **endptr, int base);
+
 int strarray_add(char ***ret_array, size_t *ret_array_len, char const *str);
 void strarray_free(char **array, size_t array_len);
 
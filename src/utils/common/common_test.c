@@ -322,6 +322,146 @@ DEF_TEST(parse_values) {
   return 0;
 }
 
+/* Random doubles: arbitrary bit patterns, plus values with few significant
+ * digits as they are typical for metrics. */
+static double random_double(unsigned int *seed, int i) {
+  if ((i % 2) == 0) {
+    uint64_t bits = ((uint64_t)rand_r(seed) << 62) ^
+                    ((uint64_t)rand_r(seed) << 31) ^ (uint64_t)rand_r(seed);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+
+  double d = (double)(rand_r(seed) % 2000000) - 1000000.0;
+  for (int scale = rand_r(seed) % 12; scale > 0; scale--)
+    d /= 10.0;
+  return d;
+}
+
+DEF_TEST(format_numbers) {
+  double cases[] = {
+      0.0,     -0.0,    1.0,        -1.0,     0.1,
+      0.5,     1.5,     2.5,        1e15,     1e-5,
+      1e-4,    123456789012345.0,   1234567890123456.0,
+      0.1 + 0.2,        1e100,      5e-324,   1.7976931348623157e308,
+      NAN,     -NAN,    INFINITY,   -INFINITY, 999999999999999.5,
+      0.000123456789012345678,      12.3,     1435044576.123,
+  };
+  unsigned int seed = 42;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases) + 200000; i++) {
+    double v = (i < STATIC_ARRAY_SIZE(cases)) ? cases[i]
+                                              : random_double(&seed, (int)i);
+    char want[64];
+    char got[64];
+
+    int want_len = snprintf(want, sizeof(want), GAUGE_FORMAT, v);
+    int got_len = format_gauge(got, sizeof(got), v);
+    if ((want_len != got_len) || (strcmp(want, got) != 0)) {
+      EXPECT_EQ_STR(want, got);
+      EXPECT_EQ_INT(want_len, got_len);
+      break;
+    }
+
+    for (int precision = 0; precision <= 6; precision += 3) {
+      want_len = snprintf(want, sizeof(want), "%.*f", precision, v);
+      if (want_len >= (int)sizeof(want))
+        continue;
+      got_len = format_fixed(got, sizeof(got), v, precision);
+      if ((want_len != got_len) || (strcmp(want, got) != 0)) {
+        EXPECT_EQ_STR(want, got);
+        EXPECT_EQ_INT(want_len, got_len);
+        return -1;
+      }
+    }
+  }
+
+  char buffer[8];
+  EXPECT_EQ_INT(20, format_uint64(buffer, sizeof(buffer), UINT64_MAX));
+  EXPECT_EQ_STR("1844674", buffer);
+  EXPECT_EQ_INT(20, format_int64(buffer, sizeof(buffer), INT64_MIN));
+  EXPECT_EQ_STR("-922337", buffer);
+  EXPECT_EQ_INT(1, format_int64(buffer, sizeof(buffer), 0));
+  EXPECT_EQ_STR("0", buffer);
+  EXPECT_EQ_INT(5, format_gauge(buffer, 4, 12.25));
+  EXPECT_EQ_STR("12.", buffer);
+  EXPECT_EQ_INT(4, format_gauge(NULL, 0, 1234.0));
+
+  return 0;
+}
+
+DEF_TEST(parse_numbers) {
+  char const *cases[] = {
+      "0",        "-0",         "42",        "+42",       " \t42",
+      "-17",      "042",        "0x2a",      "0X2A",      "1.5",
+      ".5",       "5.",         ".",         "-.5e1",     "1e",
+      "1e+",      "1e5x",       "1E-5",      "inf",       "-nan",
+      "",         "abc",        "12.3:4",    "0.1",       "3.14159",
+      "9007199254740993",       "9007199254740993.0",     "1e22",
+      "1e23",     "123456789012345678901234567890",       "1e-400",
+      "18446744073709551615",   "18446744073709551616",   "-1",
+      "9223372036854775807",    "-9223372036854775808",   "1435044576.123",
+      "0.000000000000000000000000001",                    "00000123.4500",
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *want_end;
+    char *got_end;
+
+    errno = 0;
+    double want_d = strtod(cases[i], &want_end);
+    int want_errno = errno;
+    errno = 0;
+    double got_d = c_strtod(cases[i], &got_end);
+    EXPECT_EQ_INT(want_errno, errno);
+    OK1(memcmp(&want_d, &got_d, sizeof(want_d)) == 0 ||
+            (isnan(want_d) && isnan(got_d)),
+        cases[i]);
+    EXPECT_EQ_PTR(want_end, got_end);
+
+    for (int base = 0; base <= 16; base += 10) {
+      errno = 0;
+      unsigned long long want_u = strtoull(cases[i], &want_end, base);
+      want_errno = errno;
+      errno = 0;
+      unsigned long long got_u = c_strtoull(cases[i], &got_end, base);
+      EXPECT_EQ_INT(want_errno, errno);
+      EXPECT_EQ_UINT64(want_u, got_u);
+      EXPECT_EQ_PTR(want_end, got_end);
+
+      errno = 0;
+      long long want_i = strtoll(cases[i], &want_end, base);
+      want_errno = errno;
+      errno = 0;
+      long long got_i = c_strtoll(cases[i], &got_end, base);
+      EXPECT_EQ_INT(want_errno, errno);
+      EXPECT_EQ_UINT64((uint64_t)want_i, (uint64_t)got_i);
+      EXPECT_EQ_PTR(want_end, got_end);
+    }
+  }
+
+  /* Round trips of random values, printed with up to 17 digits. */
+  unsigned int seed = 23;
+  for (int i = 0; i < 200000; i++) {
+    double v = random_double(&seed, i);
+    char str[64];
+    snprintf(str, sizeof(str), "%.*g", 1 + (i % 17), v);
+
+    char *want_end;
+    char *got_end;
+    double want = strtod(str, &want_end);
+    double got = c_strtod(str, &got_end);
+    if ((memcmp(&want, &got, sizeof(want)) != 0 && !isnan(want)) ||
+        (want_end != got_end)) {
+      EXPECT_EQ_STR(str, "parsed identically");
+      break;
+    }
+  }
+
+  return 0;
+}
+
 DEF_TEST(value_to_rate) {
   struct {
     time_t t0;
@@ -385,6 +525,8 @@ int main(void) {
   RUN_TEST(strunescape);
   RUN_TEST(parse_values);
   RUN_TEST(value_to_rate);
+  RUN_TEST(format_numbers);
+  RUN_TEST(parse_numbers);
 
   END_TEST;
 }
@@ -0,0 +1,270 @@
+/**
+ * collectd - src/utils/compress/compress.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/compress/compress.h"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+/* Free space made available before each call into the compressor. */
+#define COMPRESS_MIN_FREE 4096
+
+struct compress_stream_s {
+  compress_method_t method;
+#if HAVE_ZLIB
+  z_stream z;
+#endif
+#if HAVE_LIBZSTD
+  ZSTD_CCtx *zstd;
+#endif
+};
+
+int compress_method_parse(char const *name, compress_method_t *ret_method) {
+  if ((name == NULL) || (ret_method == NULL))
+    return EINVAL;
+
+  if (strcasecmp("none", name) == 0) {
+    *ret_method = COMPRESS_NONE;
+    return 0;
+  } else if (strcasecmp("gzip", name) == 0) {
+#if HAVE_ZLIB
+    *ret_method = COMPRESS_GZIP;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  } else if (strcasecmp("zstd", name) == 0) {
+#if HAVE_LIBZSTD
+    *ret_method = COMPRESS_ZSTD;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  }
+
+  return EINVAL;
+} /* int compress_method_parse */
+
+char const *compress_method_encoding(compress_method_t method) {
+  switch (method) {
+  case COMPRESS_GZIP:
+    return "gzip";
+  case COMPRESS_ZSTD:
+    return "zstd";
+  default:
+    return NULL;
+  }
+} /* char const *compress_method_encoding */
+
+/* Makes sure at least COMPRESS_MIN_FREE bytes are free in `out'. */
+static int compress_buffer_reserve(compress_buffer_t *out) {
+  if ((out->size - out->len) >= COMPRESS_MIN_FREE)
+    return 0;
+
+  size_t size = (out->size > 0) ? 2 * out->size : 2 * COMPRESS_MIN_FREE;
+  while ((size - out->len) < COMPRESS_MIN_FREE)
+    size *= 2;
+
+  char *data = realloc(out->data, size);
+  if (data == NULL)
+    return ENOMEM;
+
+  out->data = data;
+  out->size = size;
+  return 0;
+} /* int compress_buffer_reserve */
+
+compress_stream_t *compress_stream_create(compress_method_t method,
+                                          int level) {
+  compress_stream_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  s->method = method;
+
+  switch (method) {
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    /* 15 window bits, plus 16 for a gzip header and trailer. */
+    if (deflateInit2(&s->z, (level == 0) ? Z_DEFAULT_COMPRESSION : level,
+                     Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      free(s);
+      return NULL;
+    }
+    return s;
+#endif
+#if HAVE_LIBZSTD
+  case COMPRESS_ZSTD:
+    s->zstd = ZSTD_createCCtx();
+    if (s->zstd == NULL) {
+      free(s);
+      return NULL;
+    }
+    if ((level != 0) &&
+        ZSTD_isError(ZSTD_CCtx_setParameter(s->zstd, ZSTD_c_compressionLevel,
+                                            level))) {
+      ZSTD_freeCCtx(s->zstd);
+      free(s);
+      return NULL;
+    }
+    return s;
+#endif
+  default:
+    free(s);
+    return NULL;
+  }
+} /* compress_stream_t *compress_stream_create */
+
+void compress_stream_destroy(compress_stream_t *s) {
+  if (s == NULL)
+    return;
+
+#if HAVE_ZLIB
+  if (s->method == COMPRESS_GZIP)
+    deflateEnd(&s->z);
+#endif
+#if HAVE_LIBZSTD
+  if (s->method == COMPRESS_ZSTD)
+    ZSTD_freeCCtx(s->zstd);
+#endif
+  free(s);
+} /* void compress_stream_destroy */
+
+#if HAVE_ZLIB
+static int compress_gzip(compress_stream_t *s, char const *data, size_t len,
+                         compress_buffer_t *out, int flush) {
+  s->z.next_in = (Bytef *)data;
+  s->z.avail_in = (uInt)len;
+
+  while (42) {
+    int status = compress_buffer_reserve(out);
+    if (status != 0)
+      return status;
+
+    s->z.next_out = (Bytef *)(out->data + out->len);
+    s->z.avail_out = (uInt)(out->size - out->len);
+
+    status = deflate(&s->z, flush);
+    out->len = out->size - s->z.avail_out;
+    if (status == Z_STREAM_END)
+      return 0;
+    else if ((status != Z_OK) && (status != Z_BUF_ERROR))
+      return EIO;
+
+    /* Without Z_FINISH, deflate() is done once it has consumed all input and
+     * did not run out of output space. */
+    if ((flush != Z_FINISH) && (s->z.avail_in == 0) && (s->z.avail_out != 0))
+      return 0;
+  }
+} /* int compress_gzip */
+#endif
+
+#if HAVE_LIBZSTD
+static int compress_zstd(compress_stream_t *s, char const *data, size_t len,
+                         compress_buffer_t *out, ZSTD_EndDirective end) {
+  ZSTD_inBuffer in = {.src = data, .size = len, .pos = 0};
+
+  while (42) {
+    int status = compress_buffer_reserve(out);
+    if (status != 0)
+      return status;
+
+    ZSTD_outBuffer o = {
+        .dst = out->data + out->len,
+        .size = out->size - out->len,
+        .pos = 0,
+    };
+    size_t remaining = ZSTD_compressStream2(s->zstd, &o, &in, end);
+    out->len += o.pos;
+    if (ZSTD_isError(remaining))
+      return EIO;
+
+    if ((end == ZSTD_e_end) ? (remaining == 0) : (in.pos == in.size))
+      return 0;
+  }
+} /* int compress_zstd */
+#endif
+
+int compress_stream_append(compress_stream_t *s, char const *data, size_t len,
+                           compress_buffer_t *out) {
+  if ((s == NULL) || ((data == NULL) && (len > 0)) || (out == NULL))
+    return EINVAL;
+  if (len == 0)
+    return 0;
+
+  switch (s->method) {
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    return compress_gzip(s, data, len, out, Z_NO_FLUSH);
+#endif
+#if HAVE_LIBZSTD
+  case COMPRESS_ZSTD:
+    return compress_zstd(s, data, len, out, ZSTD_e_continue);
+#endif
+  default:
+    return EINVAL;
+  }
+} /* int compress_stream_append */
+
+int compress_stream_finish(compress_stream_t *s, compress_buffer_t *out) {
+  if ((s == NULL) || (out == NULL))
+    return EINVAL;
+
+  int status = EINVAL;
+  switch (s->method) {
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    status = compress_gzip(s, NULL, 0, out, Z_FINISH);
+    break;
+#endif
+#if HAVE_LIBZSTD
+  case COMPRESS_ZSTD:
+    status = compress_zstd(s, NULL, 0, out, ZSTD_e_end);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  compress_stream_reset(s);
+  return status;
+} /* int compress_stream_finish */
+
+void compress_stream_reset(compress_stream_t *s) {
+  if (s == NULL)
+    return;
+
+#if HAVE_ZLIB
+  if (s->method == COMPRESS_GZIP)
+    deflateReset(&s->z);
+#endif
+#if HAVE_LIBZSTD
+  if (s->method == COMPRESS_ZSTD)
+    ZSTD_CCtx_reset(s->zstd, ZSTD_reset_session_only);
+#endif
+} /* void compress_stream_reset */
@@ -0,0 +1,131 @@
+/**
+ * collectd - src/utils/compress/compress.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_COMPRESS_H
+#define UTILS_COMPRESS_H 1
+
+#include <stddef.h>
+
+/*
+ * Streaming compression of HTTP request bodies and the like. The compressed
+ * data is appended to a buffer that is grown as needed, so the uncompressed
+ * data never has to be kept in memory as a whole. Support for each method
+ * depends on the libraries found at build time.
+ */
+typedef enum {
+  COMPRESS_NONE = 0,
+  COMPRESS_GZIP,
+  COMPRESS_ZSTD,
+} compress_method_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t len;
+} compress_buffer_t;
+
+struct compress_stream_s;
+typedef struct compress_stream_s compress_stream_t;
+
+/*
+ * NAME
+ *   compress_method_parse
+ *
+ * DESCRIPTION
+ *   Parses "none", "gzip" or "zstd", ignoring case.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOTSUP if the method is known but not supported by
+ *   this build, EINVAL if it is unknown.
+ */
+int compress_method_parse(char const *name, compress_method_t *ret_method);
+
+/*
+ * NAME
+ *   compress_method_encoding
+ *
+ * RETURN VALUE
+ *   The name of the method as used in the HTTP "Content-Encoding" header, or
+ *   NULL for COMPRESS_NONE.
+ */
+char const *compress_method_encoding(compress_method_t method);
+
+/*
+ * NAME
+ *   compress_stream_create
+ *
+ * DESCRIPTION
+ *   Creates a compressor. A `level' of zero selects the default level of the
+ *   method.
+ *
+ * RETURN VALUE
+ *   The new stream or NULL upon failure, including COMPRESS_NONE and methods
+ *   not supported by this build.
+ */
+compress_stream_t *compress_stream_create(compress_method_t method, int level);
+
+/*
+ * NAME
+ *   compress_stream_destroy
+ */
+void compress_stream_destroy(compress_stream_t *s);
+
+/*
+ * NAME
+ *   compress_stream_append
+ *
+ * DESCRIPTION
+ *   Compresses `data' and appends the output that is available so far to
+ *   `out'. The compressor may hold back some of it until the stream is
+ *   finished.
+ *
+ * RETURN VALUE
+ *   Zero upon success, an errno value otherwise. After a failure, the stream
+ *   must be reset with compress_stream_reset().
+ */
+int compress_stream_append(compress_stream_t *s, char const *data, size_t len,
+                           compress_buffer_t *out);
+
+/*
+ * NAME
+ *   compress_stream_finish
+ *
+ * DESCRIPTION
+ *   Appends the remaining output and the trailer to `out'. Afterwards, the
+ *   stream may be used for the next body.
+ *
+ * RETURN VALUE
+ *   Zero upon success, an errno value otherwise.
+ */
+int compress_stream_finish(compress_stream_t *s, compress_buffer_t *out);
+
+/*
+ * NAME
+ *   compress_stream_reset
+ *
+ * DESCRIPTION
+ *   Discards the state of the current body.
+ */
+void compress_stream_reset(compress_stream_t *s);
+
+#endif /* UTILS_COMPRESS_H */
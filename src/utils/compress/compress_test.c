@@ -0,0 +1,171 @@
+/**
+ * collectd - src/utils/compress/compress_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/compress/compress.h"
+
+#include <zlib.h>
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+/* Line protocol like input, which compresses well but not trivially. */
+static char *make_input(size_t *ret_len) {
+  size_t size = 200000;
+  char *input = malloc(size);
+  size_t len = 0;
+
+  for (size_t i = 0; len + 128 < size; i++)
+    len += (size_t)snprintf(input + len, size - len,
+                            "cpu,host=host%03zu.example.com,instance=%zu "
+                            "value=%zu %zu\n",
+                            i % 50, i % 8, (i * 2654435761u) % 100000,
+                            1700000000000 + i);
+  *ret_len = len;
+  return input;
+}
+
+/* Compresses `input' in chunks of `chunk' bytes. */
+static int compress_chunked(compress_stream_t *s, char const *input,
+                            size_t len, size_t chunk, compress_buffer_t *out) {
+  for (size_t pos = 0; pos < len; pos += chunk) {
+    size_t n = (len - pos < chunk) ? len - pos : chunk;
+    int status = compress_stream_append(s, input + pos, n, out);
+    if (status != 0)
+      return status;
+  }
+  return compress_stream_finish(s, out);
+}
+
+static int gunzip(compress_buffer_t const *in, char *out, size_t *out_len) {
+  z_stream z = {0};
+  if (inflateInit2(&z, 15 + 16) != Z_OK)
+    return -1;
+
+  z.next_in = (Bytef *)in->data;
+  z.avail_in = (uInt)in->len;
+  z.next_out = (Bytef *)out;
+  z.avail_out = (uInt)*out_len;
+  int status = inflate(&z, Z_FINISH);
+  *out_len = *out_len - z.avail_out;
+  inflateEnd(&z);
+
+  return (status == Z_STREAM_END) ? 0 : -1;
+}
+
+DEF_TEST(parse) {
+  compress_method_t m = COMPRESS_GZIP;
+
+  EXPECT_EQ_INT(0, compress_method_parse("None", &m));
+  EXPECT_EQ_INT(COMPRESS_NONE, m);
+  EXPECT_EQ_INT(0, compress_method_parse("GZIP", &m));
+  EXPECT_EQ_INT(COMPRESS_GZIP, m);
+  EXPECT_EQ_STR("gzip", compress_method_encoding(m));
+#if HAVE_LIBZSTD
+  EXPECT_EQ_INT(0, compress_method_parse("zstd", &m));
+  EXPECT_EQ_INT(COMPRESS_ZSTD, m);
+#else
+  EXPECT_EQ_INT(ENOTSUP, compress_method_parse("zstd", &m));
+#endif
+  EXPECT_EQ_INT(EINVAL, compress_method_parse("lzma", &m));
+  OK(compress_method_encoding(COMPRESS_NONE) == NULL);
+  EXPECT_EQ_PTR(NULL, compress_stream_create(COMPRESS_NONE, 0));
+
+  return 0;
+}
+
+DEF_TEST(gzip) {
+  size_t len;
+  char *input = make_input(&len);
+  char *output = malloc(len + 1);
+  compress_stream_t *s = compress_stream_create(COMPRESS_GZIP, 0);
+  OK(s != NULL);
+
+  size_t chunks[] = {1, 97, 4096, 1 << 20};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(chunks); i++) {
+    compress_buffer_t out = {0};
+
+    /* The stream is reused for every body. */
+    EXPECT_EQ_INT(0, compress_chunked(s, input, len, chunks[i], &out));
+    OK(out.len < len / 5);
+
+    size_t output_len = len + 1;
+    EXPECT_EQ_INT(0, gunzip(&out, output, &output_len));
+    EXPECT_EQ_UINT64(len, output_len);
+    OK(memcmp(input, output, len) == 0);
+    free(out.data);
+  }
+
+  /* An empty body is still a valid gzip stream. */
+  compress_buffer_t out = {0};
+  EXPECT_EQ_INT(0, compress_stream_finish(s, &out));
+  size_t output_len = len;
+  EXPECT_EQ_INT(0, gunzip(&out, output, &output_len));
+  EXPECT_EQ_UINT64(0, output_len);
+  free(out.data);
+
+  compress_stream_destroy(s);
+  free(output);
+  free(input);
+  return 0;
+}
+
+#if HAVE_LIBZSTD
+DEF_TEST(zstd) {
+  size_t len;
+  char *input = make_input(&len);
+  char *output = malloc(len);
+  compress_stream_t *s = compress_stream_create(COMPRESS_ZSTD, 0);
+  OK(s != NULL);
+
+  for (int i = 0; i < 2; i++) {
+    compress_buffer_t out = {0};
+    EXPECT_EQ_INT(0, compress_chunked(s, input, len, 4096, &out));
+    OK(out.len < len / 5);
+
+    size_t output_len = ZSTD_decompress(output, len, out.data, out.len);
+    OK(!ZSTD_isError(output_len));
+    EXPECT_EQ_UINT64(len, output_len);
+    OK(memcmp(input, output, len) == 0);
+    free(out.data);
+  }
+
+  compress_stream_destroy(s);
+  free(output);
+  free(input);
+  return 0;
+}
+#endif
+
+int main(void) {
+  RUN_TEST(parse);
+  RUN_TEST(gzip);
+#if HAVE_LIBZSTD
+  RUN_TEST(zstd);
+#endif
+
+  END_TEST;
+}
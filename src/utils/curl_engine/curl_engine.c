@@ -0,0 +1,392 @@
+/**
+ * collectd - src/utils/curl_engine/curl_engine.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/curl_engine/curl_engine.h"
+
+/* curl_multi_wakeup() is available since libcurl 7.68.0. Without it, the
+ * engine notices new requests only when curl_multi_wait() times out. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define CURL_ENGINE_HAVE_MULTI_WAKEUP 1
+#define CURL_ENGINE_POLL_INTERVAL_MS 1000
+#else
+#define CURL_ENGINE_HAVE_MULTI_WAKEUP 0
+#define CURL_ENGINE_POLL_INTERVAL_MS 10
+#endif
+
+struct curl_engine_req_s;
+typedef struct curl_engine_req_s curl_engine_req_t;
+struct curl_engine_req_s {
+  CURL *curl;
+  curl_engine_callback_t callback;
+  void *user_data;
+  plugin_ctx_t ctx;
+
+  bool added;  /* added to the multi handle by the engine thread */
+  bool cancel; /* set by curl_engine_cancel() */
+  curl_engine_req_t *next;
+};
+
+struct curl_engine_s {
+  /* Only used by the engine thread. Connections are shared by all handles of
+   * a multi handle; DNS and TLS sessions are shared with "share", which also
+   * covers the handles while they are not in the multi handle. */
+  CURLM *multi;
+  CURLSH *share;
+  pthread_mutex_t share_lock[CURL_LOCK_DATA_LAST];
+
+  pthread_t thread;
+  bool thread_running;
+  size_t refs;
+
+  /* "lock" protects the following members. */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool stop;
+  /* Requests which have been submitted and not completed yet. */
+  curl_engine_req_t *reqs;
+  /* The handle of the callback running at the moment, if any. */
+  CURL *callback_curl;
+};
+
+static pthread_mutex_t engine_lock = PTHREAD_MUTEX_INITIALIZER;
+static curl_engine_t *engine;
+
+static void curl_engine_share_lock(__attribute__((unused)) CURL *curl,
+                                   curl_lock_data data,
+                                   __attribute__((unused))
+                                   curl_lock_access access,
+                                   void *user_data) {
+  curl_engine_t *e = user_data;
+  if ((data >= 0) && (data < CURL_LOCK_DATA_LAST))
+    pthread_mutex_lock(&e->share_lock[data]);
+}
+
+static void curl_engine_share_unlock(__attribute__((unused)) CURL *curl,
+                                     curl_lock_data data, void *user_data) {
+  curl_engine_t *e = user_data;
+  if ((data >= 0) && (data < CURL_LOCK_DATA_LAST))
+    pthread_mutex_unlock(&e->share_lock[data]);
+}
+
+static void curl_engine_wakeup(__attribute__((unused)) curl_engine_t *e) {
+#if CURL_ENGINE_HAVE_MULTI_WAKEUP
+  curl_multi_wakeup(e->multi);
+#endif
+}
+
+/* Unlinks the request of "curl" from the list. e->lock must be held. */
+static curl_engine_req_t *curl_engine_unlink(curl_engine_t *e, CURL *curl) {
+  for (curl_engine_req_t **ptr = &e->reqs; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    curl_engine_req_t *req = *ptr;
+    if (req->curl == curl) {
+      *ptr = req->next;
+      req->next = NULL;
+      return req;
+    }
+  }
+  return NULL;
+}
+
+static curl_engine_req_t *curl_engine_find(curl_engine_t *e, CURL *curl) {
+  for (curl_engine_req_t *req = e->reqs; req != NULL; req = req->next)
+    if (req->curl == curl)
+      return req;
+  return NULL;
+}
+
+/* Calls the callback of an unlinked request and frees it. e->lock must be
+ * held; it is released while the callback runs. */
+static void curl_engine_complete(curl_engine_t *e, curl_engine_req_t *req,
+                                 CURLcode status) {
+  if (!req->cancel) {
+    e->callback_curl = req->curl;
+    pthread_mutex_unlock(&e->lock);
+
+    plugin_set_ctx(req->ctx);
+    req->callback(req->curl, status, req->user_data);
+
+    pthread_mutex_lock(&e->lock);
+    e->callback_curl = NULL;
+  }
+
+  pthread_cond_broadcast(&e->cond);
+  sfree(req);
+}
+
+/* Adds new requests to the multi handle and removes the cancelled ones.
+ * e->lock must be held. */
+static void curl_engine_update(curl_engine_t *e) {
+  curl_engine_req_t *failed = NULL;
+
+  curl_engine_req_t **ptr = &e->reqs;
+  while (*ptr != NULL) {
+    curl_engine_req_t *req = *ptr;
+
+    if (req->cancel) {
+      if (req->added)
+        curl_multi_remove_handle(e->multi, req->curl);
+      *ptr = req->next;
+      sfree(req);
+      pthread_cond_broadcast(&e->cond);
+      continue;
+    }
+
+    if (!req->added) {
+      CURLMcode status = curl_multi_add_handle(e->multi, req->curl);
+      if (status != CURLM_OK) {
+        ERROR("curl engine: curl_multi_add_handle failed: %s",
+              curl_multi_strerror(status));
+        *ptr = req->next;
+        req->next = failed;
+        failed = req;
+        continue;
+      }
+      req->added = true;
+    }
+
+    ptr = &req->next;
+  }
+
+  while (failed != NULL) {
+    curl_engine_req_t *req = failed;
+    failed = req->next;
+    curl_engine_complete(e, req, CURLE_OUT_OF_MEMORY);
+  }
+}
+
+static void *curl_engine_thread(void *arg) {
+  curl_engine_t *e = arg;
+
+  pthread_mutex_lock(&e->lock);
+  while (!e->stop) {
+    curl_engine_update(e);
+    pthread_mutex_unlock(&e->lock);
+
+    int running = 0;
+    curl_multi_perform(e->multi, &running);
+
+    CURLMsg *msg;
+    int msgs_left;
+    while ((msg = curl_multi_info_read(e->multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      /* "msg" is invalid once the handle has been removed. */
+      CURL *curl = msg->easy_handle;
+      CURLcode status = msg->data.result;
+      curl_multi_remove_handle(e->multi, curl);
+
+      pthread_mutex_lock(&e->lock);
+      curl_engine_req_t *req = curl_engine_unlink(e, curl);
+      if (req != NULL)
+        curl_engine_complete(e, req, status);
+      pthread_mutex_unlock(&e->lock);
+    }
+
+#if CURL_ENGINE_HAVE_MULTI_WAKEUP
+    curl_multi_poll(e->multi, NULL, 0, CURL_ENGINE_POLL_INTERVAL_MS, NULL);
+#else
+    curl_multi_wait(e->multi, NULL, 0, CURL_ENGINE_POLL_INTERVAL_MS, NULL);
+#endif
+
+    pthread_mutex_lock(&e->lock);
+  }
+  pthread_mutex_unlock(&e->lock);
+
+  return NULL;
+}
+
+static void curl_engine_destroy(curl_engine_t *e) {
+  if (e == NULL)
+    return;
+
+  if (e->thread_running) {
+    pthread_mutex_lock(&e->lock);
+    e->stop = true;
+    pthread_mutex_unlock(&e->lock);
+    curl_engine_wakeup(e);
+    pthread_join(e->thread, NULL);
+  }
+
+  while (e->reqs != NULL) {
+    curl_engine_req_t *req = e->reqs;
+    e->reqs = req->next;
+    if (req->added)
+      curl_multi_remove_handle(e->multi, req->curl);
+    sfree(req);
+  }
+
+  if (e->multi != NULL)
+    curl_multi_cleanup(e->multi);
+  if (e->share != NULL)
+    curl_share_cleanup(e->share);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(e->share_lock); i++)
+    pthread_mutex_destroy(&e->share_lock[i]);
+  pthread_cond_destroy(&e->cond);
+  pthread_mutex_destroy(&e->lock);
+  sfree(e);
+}
+
+static curl_engine_t *curl_engine_create(void) {
+  curl_engine_t *e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    ERROR("curl engine: calloc failed.");
+    return NULL;
+  }
+
+  pthread_mutex_init(&e->lock, NULL);
+  pthread_cond_init(&e->cond, NULL);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(e->share_lock); i++)
+    pthread_mutex_init(&e->share_lock[i], NULL);
+
+  e->multi = curl_multi_init();
+  e->share = curl_share_init();
+  if ((e->multi == NULL) || (e->share == NULL)) {
+    ERROR("curl engine: Initializing cURL failed.");
+    curl_engine_destroy(e);
+    return NULL;
+  }
+
+  curl_share_setopt(e->share, CURLSHOPT_LOCKFUNC, curl_engine_share_lock);
+  curl_share_setopt(e->share, CURLSHOPT_UNLOCKFUNC, curl_engine_share_unlock);
+  curl_share_setopt(e->share, CURLSHOPT_USERDATA, e);
+  curl_share_setopt(e->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(e->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  return e;
+}
+
+curl_engine_t *curl_engine_acquire(void) {
+  pthread_mutex_lock(&engine_lock);
+  if (engine == NULL)
+    engine = curl_engine_create();
+  if (engine != NULL)
+    engine->refs++;
+  curl_engine_t *e = engine;
+  pthread_mutex_unlock(&engine_lock);
+
+  return e;
+}
+
+void curl_engine_release(curl_engine_t *e) {
+  if (e == NULL)
+    return;
+
+  pthread_mutex_lock(&engine_lock);
+  assert(e == engine);
+  assert(e->refs > 0);
+  e->refs--;
+  if (e->refs > 0) {
+    pthread_mutex_unlock(&engine_lock);
+    return;
+  }
+  engine = NULL;
+  pthread_mutex_unlock(&engine_lock);
+
+  curl_engine_destroy(e);
+}
+
+int curl_engine_perform(curl_engine_t *e, CURL *curl,
+                        curl_engine_callback_t callback, void *user_data) {
+  if ((e == NULL) || (curl == NULL) || (callback == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&e->lock);
+
+  /* A callback may re-submit its own handle. */
+  if ((curl_engine_find(e, curl) != NULL) ||
+      ((e->callback_curl == curl) &&
+       !pthread_equal(pthread_self(), e->thread))) {
+    pthread_mutex_unlock(&e->lock);
+    return EBUSY;
+  }
+
+  /* The thread is started with the first request, i.e. after the daemon has
+   * forked. */
+  if (!e->thread_running) {
+    int status = plugin_thread_create(&e->thread, curl_engine_thread, e,
+                                      "curl engine");
+    if (status != 0) {
+      pthread_mutex_unlock(&e->lock);
+      ERROR("curl engine: plugin_thread_create failed: %s", STRERROR(status));
+      return status;
+    }
+    e->thread_running = true;
+  }
+
+  curl_engine_req_t *req = calloc(1, sizeof(*req));
+  if (req == NULL) {
+    pthread_mutex_unlock(&e->lock);
+    ERROR("curl engine: calloc failed.");
+    return ENOMEM;
+  }
+  req->curl = curl;
+  req->callback = callback;
+  req->user_data = user_data;
+  req->ctx = plugin_get_ctx();
+
+  curl_easy_setopt(curl, CURLOPT_SHARE, e->share);
+
+  req->next = e->reqs;
+  e->reqs = req;
+  pthread_mutex_unlock(&e->lock);
+
+  curl_engine_wakeup(e);
+  return 0;
+}
+
+bool curl_engine_in_flight(curl_engine_t *e, CURL *curl) {
+  if ((e == NULL) || (curl == NULL))
+    return false;
+
+  pthread_mutex_lock(&e->lock);
+  bool in_flight =
+      (curl_engine_find(e, curl) != NULL) || (e->callback_curl == curl);
+  pthread_mutex_unlock(&e->lock);
+
+  return in_flight;
+}
+
+void curl_engine_cancel(curl_engine_t *e, CURL *curl) {
+  if ((e == NULL) || (curl == NULL))
+    return;
+
+  pthread_mutex_lock(&e->lock);
+  while (true) {
+    curl_engine_req_t *req = curl_engine_find(e, curl);
+    if ((req == NULL) && (e->callback_curl != curl))
+      break;
+
+    if (req != NULL)
+      req->cancel = true;
+    curl_engine_wakeup(e);
+    pthread_cond_wait(&e->cond, &e->lock);
+  }
+  pthread_mutex_unlock(&e->lock);
+}
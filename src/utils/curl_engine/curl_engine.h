@@ -0,0 +1,92 @@
+/**
+ * collectd - src/utils/curl_engine/curl_engine.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_CURL_ENGINE_H
+#define UTILS_CURL_ENGINE_H 1
+
+#include <stdbool.h>
+
+#include <curl/curl.h>
+
+/*
+ * Asynchronous HTTP requests for polling plugins. The engine runs one thread
+ * per plugin which drives all transfers of the plugin with a cURL multi
+ * handle, so that a read callback starts its request and returns instead of
+ * blocking in curl_easy_perform(). All easy handles of the engine share the
+ * DNS cache, TLS sessions and connections.
+ *
+ * The engine is reference counted: each user calls curl_engine_acquire()
+ * once, e.g. when configuring a URL, and curl_engine_release() when it is
+ * done, i.e. in the free function of its user data.
+ */
+struct curl_engine_s;
+typedef struct curl_engine_s curl_engine_t;
+
+/*
+ * Called from the engine thread when the transfer of "curl" has completed.
+ * "status" is the result of the transfer, as curl_easy_perform() would have
+ * returned it. The plugin context of the curl_engine_perform() caller is
+ * active, so the callback may dispatch values. The handle is idle again and
+ * may be re-submitted from within the callback.
+ */
+typedef void (*curl_engine_callback_t)(CURL *curl, CURLcode status,
+                                       void *user_data);
+
+/*
+ * Returns the engine of the calling plugin, starting it on first use.
+ * Returns NULL on error.
+ */
+curl_engine_t *curl_engine_acquire(void);
+
+/*
+ * Drops a reference. The engine is stopped when the last one is released.
+ * Transfers still in flight at that point are aborted without calling their
+ * callbacks.
+ */
+void curl_engine_release(curl_engine_t *e);
+
+/*
+ * Starts the transfer of a configured easy handle. Returns EBUSY if the
+ * previous transfer of the handle has not completed yet, i.e. if it is in
+ * flight or its callback is running, and zero on success.
+ * The handle must not be used by the caller until the callback is called.
+ */
+int curl_engine_perform(curl_engine_t *e, CURL *curl,
+                        curl_engine_callback_t callback, void *user_data);
+
+/*
+ * Returns true if a transfer of "curl" has been started and its callback has
+ * not returned yet. Plugins which prepare state for the response before
+ * calling curl_engine_perform() use this to skip the preparation while the
+ * previous transfer is still in flight.
+ */
+bool curl_engine_in_flight(curl_engine_t *e, CURL *curl);
+
+/*
+ * Aborts the transfer of "curl" if it is in flight. Waits for a running
+ * callback of the handle to return, so that the handle and its user data may
+ * be freed afterwards. The callback is not called for an aborted transfer.
+ */
+void curl_engine_cancel(curl_engine_t *e, CURL *curl);
+
+#endif /* UTILS_CURL_ENGINE_H */
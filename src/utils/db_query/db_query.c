@@ -84,6 +84,10 @@ struct udb_query_preparation_area_s /* {{{ */
   char *plugin;
   char *db_name;
 
+  /* Copy of the column names the area has been prepared for. The column
+   * positions are kept across results with the same columns. */
+  char **column_names;
+
   udb_result_preparation_area_t *result_prep_areas;
 }; /* }}} */
 
@@ -820,14 +824,19 @@ int udb_query_check_version(udb_query_t *q, unsigned int version) /* {{{ */
   return 1;
 } /* }}} int udb_query_check_version */
 
-void udb_query_finish_result(udb_query_t const *q, /* {{{ */
-                             udb_query_preparation_area_t *prep_area) {
+static void udb_query_clear_result(udb_query_t const *q, /* {{{ */
+                                   udb_query_preparation_area_t *prep_area) {
   udb_result_preparation_area_t *r_area;
   udb_result_t *r;
 
   if ((q == NULL) || (prep_area == NULL))
     return;
 
+  if (prep_area->column_names != NULL)
+    for (size_t i = 0; i < prep_area->column_num; i++)
+      sfree(prep_area->column_names[i]);
+  sfree(prep_area->column_names);
+
   prep_area->column_num = 0;
   sfree(prep_area->host);
   sfree(prep_area->plugin);
@@ -840,6 +849,39 @@ void udb_query_finish_result(udb_query_t const *q, /* {{{ */
       break;
     udb_result_finish_result(r, r_area);
   }
+} /* }}} void udb_query_clear_result */
+
+/* Returns true if "prep_area" has been prepared for exactly these
+ * arguments, i.e. the column positions found before are still valid. */
+static bool udb_query_is_prepared(udb_query_preparation_area_t *prep_area,
+                                  const char *host, const char *plugin,
+                                  const char *db_name, char **column_names,
+                                  size_t column_num) {
+  if ((prep_area->column_names == NULL) ||
+      (prep_area->column_num != column_num))
+    return false;
+
+  if ((strcmp(prep_area->host, host) != 0) ||
+      (strcmp(prep_area->plugin, plugin) != 0) ||
+      (strcmp(prep_area->db_name, db_name) != 0))
+    return false;
+
+  for (size_t i = 0; i < column_num; i++)
+    if (strcmp(prep_area->column_names[i], column_names[i]) != 0)
+      return false;
+
+  return true;
+} /* }}} bool udb_query_is_prepared */
+
+void udb_query_finish_result(udb_query_t const *q, /* {{{ */
+                             udb_query_preparation_area_t *prep_area) {
+  if ((q == NULL) || (prep_area == NULL))
+    return;
+
+  /* Keep the column positions for the next result unless the area has not
+   * been prepared completely. */
+  if (prep_area->column_names == NULL)
+    udb_query_clear_result(q, prep_area);
 } /* }}} void udb_query_finish_result */
 
 int udb_query_handle_result(udb_query_t const *q, /* {{{ */
@@ -901,12 +943,11 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return -EINVAL;
 
-#if COLLECT_DEBUG
-  assert(prep_area->column_num == 0);
-  assert(prep_area->host == NULL);
-  assert(prep_area->plugin == NULL);
-  assert(prep_area->db_name == NULL);
-#endif
+  if (udb_query_is_prepared(prep_area, host, plugin, db_name, column_names,
+                            column_num))
+    return 0;
+
+  udb_query_clear_result(q, prep_area);
 
   prep_area->column_num = column_num;
   prep_area->host = strdup(host);
@@ -916,7 +957,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
   if ((prep_area->host == NULL) || (prep_area->plugin == NULL) ||
       (prep_area->db_name == NULL)) {
     P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
-    udb_query_finish_result(q, prep_area);
+    udb_query_clear_result(q, prep_area);
     return -ENOMEM;
   }
 
@@ -945,7 +986,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       P_ERROR("udb_query_prepare_result: "
               "Column `%s' from `PluginInstanceFrom' could not be found.",
               q->plugin_instance_from);
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_result(q, prep_area);
       return -ENOENT;
     }
   }
@@ -957,17 +998,32 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       P_ERROR("Query `%s': Invalid number of result "
               "preparation areas.",
               q->name);
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_result(q, prep_area);
       return -EINVAL;
     }
 
     status = udb_result_prepare_result(r, r_area, column_names, column_num);
     if (status != 0) {
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_result(q, prep_area);
       return status;
     }
   }
 
+  prep_area->column_names = calloc(column_num, sizeof(char *));
+  if (prep_area->column_names == NULL) {
+    P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
+    udb_query_clear_result(q, prep_area);
+    return -ENOMEM;
+  }
+  for (size_t i = 0; i < column_num; i++) {
+    prep_area->column_names[i] = strdup(column_names[i]);
+    if (prep_area->column_names[i] == NULL) {
+      P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
+      udb_query_clear_result(q, prep_area);
+      return -ENOMEM;
+    }
+  }
+
   return 0;
 } /* }}} int udb_query_prepare_result */
 
@@ -1023,11 +1079,18 @@ void udb_query_delete_preparation_area(
 
     sfree(area->instances_pos);
     sfree(area->values_pos);
+    sfree(area->metadata_pos);
     sfree(area->instances_buffer);
     sfree(area->values_buffer);
+    sfree(area->metadata_buffer);
     free(area);
   }
 
+  if (q_area->column_names != NULL)
+    for (size_t i = 0; i < q_area->column_num; i++)
+      sfree(q_area->column_names[i]);
+  sfree(q_area->column_names);
+
   sfree(q_area->host);
   sfree(q_area->plugin);
   sfree(q_area->db_name);
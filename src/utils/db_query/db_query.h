@@ -67,6 +67,13 @@ void *udb_query_get_user_data(udb_query_t *q);
  */
 int udb_query_check_version(udb_query_t *q, unsigned int version);
 
+/*
+ * udb_query_prepare_result
+ *
+ * Looks up the columns used by the query's results. The positions are kept
+ * in `prep_area' by udb_query_finish_result(), so that preparing the next
+ * result with the same columns is cheap.
+ */
 int udb_query_prepare_result(udb_query_t const *q,
                              udb_query_preparation_area_t *prep_area,
                              const char *host, const char *plugin,
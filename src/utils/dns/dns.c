@@ -609,12 +609,14 @@ static int handle_linux_sll(const u_char *pkt, int len) {
 /* public function */
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt) {
+  /* Callers capturing with several handles pass the handle as user data. */
+  pcap_t *po = (udata != NULL) ? (pcap_t *)udata : pcap_obj;
   int status;
 
   if (hdr->caplen < ETHER_HDR_LEN)
     return;
 
-  switch (pcap_datalink(pcap_obj)) {
+  switch (pcap_datalink(po)) {
   case DLT_EN10MB:
     status = handle_ether(pkt, hdr->caplen);
     break;
@@ -643,11 +645,10 @@ void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
     break;
 
   default:
-    ERROR("handle_pcap: unsupported data link type %d",
-          pcap_datalink(pcap_obj));
+    ERROR("handle_pcap: unsupported data link type %d", pcap_datalink(po));
     status = 0;
     break;
-  } /* switch (pcap_datalink(pcap_obj)) */
+  } /* switch (pcap_datalink(po)) */
 
   if (0 == status)
     return;
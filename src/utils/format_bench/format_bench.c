@@ -0,0 +1,506 @@
+/**
+ * collectd - src/utils/format_bench/format_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Measures the time and the memory allocated per value list for each of the
+ * format_* libraries, with and without StoreRates and meta data. Prints one
+ * line of JSON per case.
+ *
+ * Usage: bench_utils_format [-n <value lists>] [-T <seconds>] [<case> ...]
+ */
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/format_graphite/format_graphite.h"
+#include "utils/format_influxdb/format_influxdb.h"
+#include "utils/format_json/format_json.h"
+#include "utils/format_kairosdb/format_kairosdb.h"
+#include "utils/metadata/meta_data.h"
+#include "utils_identity.h"
+#if BENCH_FORMAT_STACKDRIVER
+#include "utils/format_stackdriver/format_stackdriver.h"
+#endif
+
+#include <getopt.h>
+
+#define BUFFER_SIZE 65536
+
+/* Allocation counting only works where malloc() can be interposed. The
+ * counters are only updated while `counting' is set. */
+#if defined(__GLIBC__)
+#define HAVE_ALLOC_COUNTING 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static bool counting;
+static uint64_t alloc_num;
+static uint64_t alloc_bytes;
+
+void *malloc(size_t size) {
+  if (counting) {
+    alloc_num++;
+    alloc_bytes += size;
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  if (counting) {
+    alloc_num++;
+    alloc_bytes += nmemb * size;
+  }
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (counting) {
+    alloc_num++;
+    alloc_bytes += size;
+  }
+  return __libc_realloc(ptr, size);
+}
+#else
+#define HAVE_ALLOC_COUNTING 0
+static bool counting;
+static uint64_t alloc_num;
+static uint64_t alloc_bytes;
+#endif
+
+typedef struct {
+  value_list_t vl;
+  data_set_t const *ds;
+  value_t values[3];
+  vl_identity_t const *identity;
+} bench_vl_t;
+
+typedef struct bench_case_s bench_case_t;
+struct bench_case_s {
+  char const *name;
+  /* Formats one value list into buffer, which is `BUFFER_SIZE' bytes long and
+   * may hold the output of previous calls. Returns the number of bytes
+   * written, or less than zero on failure. */
+  int (*format)(bench_case_t const *c, char *buffer, bench_vl_t const *bvl);
+  unsigned int flags;
+  bool store_rates;
+  bool meta;
+};
+
+static size_t conf_vls_num = 1000;
+static double conf_duration = 0.5;
+
+static data_source_t ds_cpu[] = {
+    {"value", DS_TYPE_DERIVE, 0, NAN},
+};
+static data_source_t ds_if_octets[] = {
+    {"rx", DS_TYPE_DERIVE, 0, NAN},
+    {"tx", DS_TYPE_DERIVE, 0, NAN},
+};
+static data_source_t ds_load[] = {
+    {"shortterm", DS_TYPE_GAUGE, 0, 5000},
+    {"midterm", DS_TYPE_GAUGE, 0, 5000},
+    {"longterm", DS_TYPE_GAUGE, 0, 5000},
+};
+static data_source_t ds_memory[] = {
+    {"value", DS_TYPE_GAUGE, 0, 281474976710656},
+};
+
+static data_set_t data_sets[] = {
+    {"cpu", STATIC_ARRAY_SIZE(ds_cpu), ds_cpu},
+    {"if_octets", STATIC_ARRAY_SIZE(ds_if_octets), ds_if_octets},
+    {"load", STATIC_ARRAY_SIZE(ds_load), ds_load},
+    {"memory", STATIC_ARRAY_SIZE(ds_memory), ds_memory},
+};
+
+/* Plugin, plugin instance and type instance for each of data_sets. */
+static char const *const names[][3] = {
+    {"cpu", "0", "idle"},
+    {"interface", "eth0", ""},
+    {"load", "", ""},
+    {"memory", "", "used"},
+};
+
+static bench_vl_t *vls;
+static meta_data_t *meta;
+/* Large enough for all value lists. */
+static format_graphite_cache_t *graphite_cache;
+static format_influxdb_cache_t *influxdb_cache;
+
+/* The batch formatters collect this many value lists and format them with one
+ * call, like the write threads hand them to "write_batch" callbacks. */
+#define BATCH_SIZE 64
+#define BENCH_INFLUXDB_CACHE 0x01
+#define BENCH_INFLUXDB_MERGE 0x02
+static write_batch_entry_t batch[BATCH_SIZE];
+static size_t batch_num;
+
+/* Stateful formatters fill the buffer with several value lists. When it is
+ * full, they are finalized and started over. */
+static size_t buffer_fill;
+static size_t buffer_free;
+static bool buffer_initialized;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int bench_graphite(bench_case_t const *c, char *buffer,
+                          bench_vl_t const *bvl) {
+  int status = format_graphite(buffer, BUFFER_SIZE, bvl->ds, &bvl->vl,
+                               "collectd.", NULL, '_', c->flags);
+  if (status != 0)
+    return -1;
+  return (int)strlen(buffer);
+}
+
+static int bench_graphite_cached(bench_case_t const *c, char *buffer,
+                                 bench_vl_t const *bvl) {
+  int status = format_graphite_cached(graphite_cache, bvl->identity, buffer,
+                                      BUFFER_SIZE, bvl->ds, &bvl->vl,
+                                      "collectd.", NULL, '_', c->flags);
+  if (status != 0)
+    return -1;
+  return (int)strlen(buffer);
+}
+
+static int bench_influxdb(bench_case_t const *c, char *buffer,
+                          bench_vl_t const *bvl) {
+  return format_influxdb_value_list(buffer, BUFFER_SIZE, bvl->ds, &bvl->vl,
+                                    c->store_rates, MS);
+}
+
+static int bench_influxdb_batch(bench_case_t const *c, char *buffer,
+                                bench_vl_t const *bvl) {
+  batch[batch_num++] = (write_batch_entry_t){
+      .ds = bvl->ds,
+      .vl = &bvl->vl,
+      .identity = bvl->identity,
+  };
+  if (batch_num < BATCH_SIZE)
+    return 0;
+
+  format_influxdb_options_t opts = {
+      .store_rates = c->store_rates,
+      .time_precision = MS,
+      .merge_type_instances = (c->flags & BENCH_INFLUXDB_MERGE) != 0,
+      .cache = (c->flags & BENCH_INFLUXDB_CACHE) ? influxdb_cache : NULL,
+  };
+  size_t done = 0;
+  int status = format_influxdb_value_lists(buffer, BUFFER_SIZE, batch,
+                                           batch_num, &opts, &done);
+  size_t num = batch_num;
+  batch_num = 0;
+  if ((status < 0) || (done != num))
+    return -1;
+  return status;
+}
+
+static int bench_json(bench_case_t const *c, char *buffer,
+                      bench_vl_t const *bvl) {
+  size_t fill = buffer_fill;
+
+  if (!buffer_initialized) {
+    buffer_fill = 0;
+    buffer_free = BUFFER_SIZE;
+    format_json_initialize(buffer, &buffer_fill, &buffer_free);
+    buffer_initialized = true;
+    fill = 0;
+  }
+
+  int status = format_json_value_list(buffer, &buffer_fill, &buffer_free,
+                                      bvl->ds, &bvl->vl, c->store_rates);
+  if (status == -ENOMEM) {
+    format_json_finalize(buffer, &buffer_fill, &buffer_free);
+    format_json_initialize(buffer, &buffer_fill, &buffer_free);
+    fill = 0;
+    status = format_json_value_list(buffer, &buffer_fill, &buffer_free,
+                                    bvl->ds, &bvl->vl, c->store_rates);
+  }
+  if (status != 0)
+    return -1;
+  return (int)(buffer_fill - fill);
+}
+
+static int bench_kairosdb(bench_case_t const *c, char *buffer,
+                          bench_vl_t const *bvl) {
+  size_t fill = buffer_fill;
+
+  if (!buffer_initialized) {
+    buffer_fill = 0;
+    buffer_free = BUFFER_SIZE;
+    format_kairosdb_initialize(buffer, &buffer_fill, &buffer_free);
+    buffer_initialized = true;
+    fill = 0;
+  }
+
+  int status = format_kairosdb_value_list(
+      buffer, &buffer_fill, &buffer_free, bvl->ds, &bvl->vl, c->store_rates,
+      NULL, 0, /* data_ttl = */ 0, /* metrics_prefix = */ NULL);
+  if (status == -ENOMEM) {
+    format_kairosdb_finalize(buffer, &buffer_fill, &buffer_free);
+    format_kairosdb_initialize(buffer, &buffer_fill, &buffer_free);
+    fill = 0;
+    status = format_kairosdb_value_list(
+        buffer, &buffer_fill, &buffer_free, bvl->ds, &bvl->vl, c->store_rates,
+        NULL, 0, /* data_ttl = */ 0, /* metrics_prefix = */ NULL);
+  }
+  if (status != 0)
+    return -1;
+  return (int)(buffer_fill - fill);
+}
+
+#if BENCH_FORMAT_STACKDRIVER
+static sd_output_t *sd_out;
+
+static int bench_stackdriver(__attribute__((unused)) bench_case_t const *c,
+                             __attribute__((unused)) char *buffer,
+                             bench_vl_t const *bvl) {
+  if (sd_out == NULL) {
+    sd_resource_t *res = sd_resource_create("global");
+    if (res == NULL)
+      return -1;
+    sd_resource_add_label(res, "project_id", "example");
+    sd_out = sd_output_create(res);
+    if (sd_out == NULL)
+      return -1;
+  }
+
+  int status = sd_output_add(sd_out, bvl->ds, &bvl->vl);
+  if (status == ENOENT) {
+    sd_output_register_metric(sd_out, bvl->ds, &bvl->vl);
+    status = sd_output_add(sd_out, bvl->ds, &bvl->vl);
+  }
+  if ((status == EEXIST) || (status == ENOBUFS)) {
+    char *payload = sd_output_reset(sd_out);
+    size_t len = (payload != NULL) ? strlen(payload) : 0;
+    free(payload);
+    if (status == EEXIST)
+      status = sd_output_add(sd_out, bvl->ds, &bvl->vl);
+    else
+      status = 0;
+    /* The output size is only known when the buffer is flushed. */
+    return (status == 0) ? (int)len : -1;
+  }
+  return (status == 0) ? 0 : -1;
+}
+#endif
+
+static bench_case_t cases[] = {
+    {"graphite", bench_graphite, 0, false, false},
+    {"graphite_rates", bench_graphite, GRAPHITE_STORE_RATES, true, false},
+    {"graphite_tags", bench_graphite, GRAPHITE_USE_TAGS, false, false},
+    {"graphite_cached", bench_graphite_cached, 0, false, false},
+    {"influxdb", bench_influxdb, 0, false, false},
+    {"influxdb_rates", bench_influxdb, 0, true, false},
+    {"influxdb_meta", bench_influxdb, 0, false, true},
+    {"influxdb_batch", bench_influxdb_batch, 0, false, false},
+    {"influxdb_cached", bench_influxdb_batch, BENCH_INFLUXDB_CACHE, false,
+     false},
+    {"influxdb_merged", bench_influxdb_batch,
+     BENCH_INFLUXDB_CACHE | BENCH_INFLUXDB_MERGE, false, false},
+    {"json", bench_json, 0, false, false},
+    {"json_rates", bench_json, 0, true, false},
+    {"json_meta", bench_json, 0, false, true},
+    {"kairosdb", bench_kairosdb, 0, false, false},
+    {"kairosdb_rates", bench_kairosdb, 0, true, false},
+#if BENCH_FORMAT_STACKDRIVER
+    {"stackdriver", bench_stackdriver, 0, false, false},
+#endif
+};
+
+static int create_value_lists(void) {
+  vls = calloc(conf_vls_num, sizeof(*vls));
+  if (vls == NULL)
+    return ENOMEM;
+
+  /* Meta data as used for tags, for example by the influxdb formatter. */
+  meta = meta_data_create();
+  if (meta == NULL)
+    return ENOMEM;
+  meta_data_add_string(meta, "region", "eu-west-1");
+  meta_data_add_string(meta, "rack", "r42");
+  meta_data_add_string(meta, "service", "frontend");
+  meta_data_add_string(meta, "environment", "production");
+
+  graphite_cache = format_graphite_cache_create(conf_vls_num);
+  if (graphite_cache == NULL)
+    return ENOMEM;
+  influxdb_cache = format_influxdb_cache_create(conf_vls_num);
+  if (influxdb_cache == NULL)
+    return ENOMEM;
+
+  cdtime_t t = cdtime();
+  for (size_t i = 0; i < conf_vls_num; i++) {
+    bench_vl_t *bvl = vls + i;
+    size_t type = i % STATIC_ARRAY_SIZE(data_sets);
+
+    bvl->ds = data_sets + type;
+    bvl->vl = (value_list_t){
+        .values = bvl->values,
+        .values_len = bvl->ds->ds_num,
+        .time = t,
+        .interval = TIME_T_TO_CDTIME_T(10),
+    };
+    for (size_t j = 0; j < bvl->ds->ds_num; j++) {
+      if (bvl->ds->ds[j].type == DS_TYPE_GAUGE)
+        bvl->values[j].gauge = 0.01 * (double)(i + j);
+      else
+        bvl->values[j].derive = (derive_t)(1000 * i + j);
+    }
+
+    ssnprintf(bvl->vl.host, sizeof(bvl->vl.host), "host%03zu.example.com",
+              i / STATIC_ARRAY_SIZE(data_sets));
+    sstrncpy(bvl->vl.plugin, names[type][0], sizeof(bvl->vl.plugin));
+    sstrncpy(bvl->vl.plugin_instance, names[type][1],
+             sizeof(bvl->vl.plugin_instance));
+    sstrncpy(bvl->vl.type, bvl->ds->type, sizeof(bvl->vl.type));
+    sstrncpy(bvl->vl.type_instance, names[type][2],
+             sizeof(bvl->vl.type_instance));
+
+    bvl->identity = vl_identity_intern(&bvl->vl);
+    if (bvl->identity == NULL)
+      return ENOMEM;
+  }
+
+  return 0;
+}
+
+static void run_case(bench_case_t const *c, char *buffer) {
+  for (size_t i = 0; i < conf_vls_num; i++)
+    vls[i].vl.meta = c->meta ? meta : NULL;
+
+  buffer_fill = 0;
+  buffer_free = 0;
+  buffer_initialized = false;
+  batch_num = 0;
+
+  /* Warm up, and check that the formatter works at all. */
+  for (size_t i = 0; i < conf_vls_num; i++) {
+    if (c->format(c, buffer, vls + i) < 0) {
+      fprintf(stderr, "%s: formatting failed.\n", c->name);
+      return;
+    }
+  }
+
+  uint64_t num = 0;
+  uint64_t bytes_out = 0;
+  uint64_t failed = 0;
+  alloc_num = 0;
+  alloc_bytes = 0;
+
+  double start = now();
+  double elapsed;
+  counting = true;
+  do {
+    for (size_t i = 0; i < conf_vls_num; i++) {
+      int status = c->format(c, buffer, vls + i);
+      if (status < 0)
+        failed++;
+      else
+        bytes_out += (uint64_t)status;
+      /* Like the write plugins, format newer values on every pass. */
+      vls[i].vl.time += vls[i].vl.interval;
+    }
+    num += conf_vls_num;
+    elapsed = now() - start;
+  } while (elapsed < conf_duration);
+  counting = false;
+
+  printf("{\"case\":\"%s\",\"value_lists\":%" PRIu64 ",\"failed\":%" PRIu64
+         ",\"ns_per_value_list\":%.1f,\"bytes_out_per_value_list\":%.1f",
+         c->name, num, failed, 1e9 * elapsed / (double)num,
+         (double)bytes_out / (double)num);
+  if (HAVE_ALLOC_COUNTING)
+    printf(",\"allocs_per_value_list\":%.2f,"
+           "\"bytes_allocated_per_value_list\":%.1f",
+           (double)alloc_num / (double)num, (double)alloc_bytes / (double)num);
+  printf("}\n");
+  fflush(stdout);
+}
+
+__attribute__((noreturn)) static void exit_usage(char const *name,
+                                                 int status) {
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr,
+          "Usage: %s [-n <value lists>] [-T <seconds>] [<case> ...]\n"
+          "\n"
+          "Cases:",
+          name);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    fprintf((status == EXIT_SUCCESS) ? stdout : stderr, " %s", cases[i].name);
+  fprintf((status == EXIT_SUCCESS) ? stdout : stderr, "\n");
+  exit(status);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:T:h")) != -1) {
+    switch (opt) {
+    case 'n':
+      conf_vls_num = (size_t)strtoull(optarg, NULL, 0);
+      break;
+    case 'T':
+      conf_duration = atof(optarg);
+      break;
+    case 'h':
+      exit_usage(argv[0], EXIT_SUCCESS);
+    default:
+      exit_usage(argv[0], EXIT_FAILURE);
+    }
+  }
+  if (conf_vls_num == 0)
+    exit_usage(argv[0], EXIT_FAILURE);
+
+  if (create_value_lists() != 0) {
+    fprintf(stderr, "Creating the value lists failed.\n");
+    return 1;
+  }
+
+  char *buffer = calloc(1, BUFFER_SIZE);
+  if (buffer == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    bool selected = (optind >= argc);
+    for (int j = optind; j < argc; j++)
+      if (strcmp(argv[j], cases[i].name) == 0)
+        selected = true;
+    if (selected)
+      run_case(cases + i, buffer);
+  }
+
+  free(buffer);
+  format_graphite_cache_destroy(graphite_cache);
+  format_influxdb_cache_destroy(influxdb_cache);
+  meta_data_destroy(meta);
+  for (size_t i = 0; i < conf_vls_num; i++)
+    vl_identity_release(vls[i].identity);
+  free(vls);
+  return 0;
+}
@@ -27,7 +27,9 @@
 #include "utils/common/common.h"
 
 #include "utils/format_graphite/format_graphite.h"
+#include "utils/lru/lru.h"
 #include "utils_cache.h"
+#include "utils_identity.h"
 
 #define GRAPHITE_FORBIDDEN " \t\"\\:!,/()\n\r"
 
@@ -71,11 +73,9 @@ static int gr_format_values(char *ret, size_t ret_len, int ds_num,
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
-#define BUFFER_ADD(...)                                                        \
+#define BUFFER_ADD(func, ...)                                                  \
   do {                                                                         \
-    status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
+    status = func(ret + offset, ret_len - offset, __VA_ARGS__);                \
     if (status < 1) {                                                          \
       return -1;                                                               \
     } else if (((size_t)status) >= (ret_len - offset)) {                       \
@@ -85,15 +85,15 @@ static int gr_format_values(char *ret, size_t ret_len, int ds_num,
   } while (0)
 
   if (ds->ds[ds_num].type == DS_TYPE_GAUGE)
-    BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
+    BUFFER_ADD(format_gauge, vl->values[ds_num].gauge);
   else if (rates != NULL)
-    BUFFER_ADD("%f", rates[ds_num]);
+    BUFFER_ADD(format_fixed, rates[ds_num], 6);
   else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
-    BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[ds_num].counter);
+    BUFFER_ADD(format_uint64, (uint64_t)vl->values[ds_num].counter);
   else if (ds->ds[ds_num].type == DS_TYPE_DERIVE)
-    BUFFER_ADD("%" PRIi64, vl->values[ds_num].derive);
+    BUFFER_ADD(format_int64, vl->values[ds_num].derive);
   else if (ds->ds[ds_num].type == DS_TYPE_ABSOLUTE)
-    BUFFER_ADD("%" PRIu64, vl->values[ds_num].absolute);
+    BUFFER_ADD(format_uint64, vl->values[ds_num].absolute);
   else {
     P_ERROR("gr_format_values: Unknown data source type: %i",
             ds->ds[ds_num].type);
@@ -294,12 +294,185 @@ static void escape_graphite_string(char *buffer, char escape_char) {
     *head = escape_char;
 }
 
-int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
-                    value_list_t const *vl, char const *prefix,
-                    char const *postfix, char const escape_char,
-                    unsigned int flags) {
+/* Formats the metric path of the `ds_index'th data source of `vl'. */
+static int gr_format_path(char *ret, size_t ret_len, /* {{{ */
+                          data_set_t const *ds, value_list_t const *vl,
+                          size_t ds_index, char const *prefix,
+                          char const *postfix, char const escape_char,
+                          unsigned int flags) {
+  char const *ds_name = NULL;
+  int status;
+
+  if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
+    ds_name = ds->ds[ds_index].name;
+
+  /* Copy the identifier to `ret' and escape it. */
+  if (flags & GRAPHITE_USE_TAGS) {
+    status = gr_format_name_tagged(ret, ret_len, vl, ds_name, prefix, postfix,
+                                   escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name_tagged");
+      return status;
+    }
+  } else {
+    status = gr_format_name(ret, ret_len, vl, ds_name, prefix, postfix,
+                            escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name");
+      return status;
+    }
+  }
+
+  escape_graphite_string(ret, escape_char);
+  return 0;
+} /* }}} int gr_format_path */
+
+/* Appends the line of one data source to `buffer'. */
+static int gr_format_line(char *buffer, size_t buffer_size, /* {{{ */
+                          size_t *buffer_pos, char const *path,
+                          data_set_t const *ds, value_list_t const *vl,
+                          size_t ds_index, gauge_t const *rates) {
+  char values[512];
+
+  /* Convert the values to an ASCII representation and put that into
+   * `values'. */
+  int status =
+      gr_format_values(values, sizeof(values), ds_index, ds, vl, rates);
+  if (status != 0) {
+    P_ERROR("format_graphite: error with gr_format_values");
+    return status;
+  }
+
+  size_t path_len = strlen(path);
+  size_t pos = *buffer_pos;
+  if ((pos + path_len) >= buffer_size) {
+    P_ERROR("format_graphite: target buffer too small");
+    return -ENOMEM;
+  }
+  memcpy(buffer + pos, path, path_len);
+
+  /* Compute the graphite command */
+  size_t avail = buffer_size - (pos + path_len);
+  int len = snprintf(buffer + pos + path_len, avail, " %s %u\r\n", values,
+                     (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
+  if ((len < 0) || ((size_t)len >= avail)) {
+    P_ERROR("format_graphite: target buffer too small");
+    buffer[pos] = '\0';
+    return -ENOMEM;
+  }
+
+  *buffer_pos = pos + path_len + (size_t)len;
+  return 0;
+} /* }}} int gr_format_line */
+
+/* The metric paths of one value list. */
+typedef struct {
+  uint64_t id;
+  size_t paths_num;
+  char *paths[];
+} gr_cache_entry_t;
+
+struct format_graphite_cache_s {
+  c_lru_t *lru;
+  pthread_mutex_t lock;
+};
+
+static void gr_cache_entry_free(void *arg) /* {{{ */
+{
+  gr_cache_entry_t *e = arg;
+
+  if (e == NULL)
+    return;
+
+  for (size_t i = 0; i < e->paths_num; i++)
+    sfree(e->paths[i]);
+  free(e);
+} /* }}} void gr_cache_entry_free */
+
+format_graphite_cache_t *format_graphite_cache_create(size_t size) /* {{{ */
+{
+  format_graphite_cache_t *cache = calloc(1, sizeof(*cache));
+  if (cache == NULL)
+    return NULL;
+
+  cache->lru = c_lru_create(size, gr_cache_entry_free);
+  if (cache->lru == NULL) {
+    free(cache);
+    return NULL;
+  }
+  pthread_mutex_init(&cache->lock, /* attr = */ NULL);
+
+  return cache;
+} /* }}} format_graphite_cache_t *format_graphite_cache_create */
+
+void format_graphite_cache_destroy(format_graphite_cache_t *cache) /* {{{ */
+{
+  if (cache == NULL)
+    return;
+
+  c_lru_destroy(cache->lru);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+} /* }}} void format_graphite_cache_destroy */
+
+/* Looks up the paths of `id' and, if they are cached, formats all lines with
+ * the cache locked. Returns ENOENT if the paths are not cached. */
+static int gr_format_lines_cached(format_graphite_cache_t *cache, /* {{{ */
+                                  vl_identity_t const *id, char *buffer,
+                                  size_t buffer_size, data_set_t const *ds,
+                                  value_list_t const *vl,
+                                  gauge_t const *rates) {
+  gr_cache_entry_t *e = NULL;
+  int status = ENOENT;
+
+  pthread_mutex_lock(&cache->lock);
+  if ((c_lru_get(cache->lru, id->id, (void *)&e) == 0) &&
+      (e->paths_num == ds->ds_num)) {
+    size_t buffer_pos = 0;
+    status = 0;
+    for (size_t i = 0; (status == 0) && (i < ds->ds_num); i++)
+      status = gr_format_line(buffer, buffer_size, &buffer_pos, e->paths[i],
+                              ds, vl, i, rates);
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return status;
+} /* }}} int gr_format_lines_cached */
+
+/* Formats the paths of all data sources and adds them to the cache. */
+static gr_cache_entry_t *gr_cache_entry_create( /* {{{ */
+    data_set_t const *ds, value_list_t const *vl, vl_identity_t const *id,
+    char const *prefix, char const *postfix, char const escape_char,
+    unsigned int flags) {
+  gr_cache_entry_t *e =
+      calloc(1, sizeof(*e) + ds->ds_num * sizeof(e->paths[0]));
+  if (e == NULL)
+    return NULL;
+  e->id = id->id;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char path[10 * DATA_MAX_NAME_LEN];
+
+    if ((gr_format_path(path, sizeof(path), ds, vl, i, prefix, postfix,
+                        escape_char, flags) != 0) ||
+        ((e->paths[i] = strdup(path)) == NULL)) {
+      gr_cache_entry_free(e);
+      return NULL;
+    }
+    e->paths_num++;
+  }
+
+  return e;
+} /* }}} gr_cache_entry_t *gr_cache_entry_create */
+
+int format_graphite_cached(format_graphite_cache_t *cache, /* {{{ */
+                           vl_identity_t const *id, char *buffer,
+                           size_t buffer_size, data_set_t const *ds,
+                           value_list_t const *vl, char const *prefix,
+                           char const *postfix, char const escape_char,
+                           unsigned int flags) {
   int status = 0;
-  int buffer_pos = 0;
+  size_t buffer_pos = 0;
 
   gauge_t *rates = NULL;
   if (flags & GRAPHITE_STORE_RATES) {
@@ -310,68 +483,56 @@ int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
     }
   }
 
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    char const *ds_name = NULL;
-    char key[10 * DATA_MAX_NAME_LEN];
-    char values[512];
-    size_t message_len;
-    char message[1024];
-
-    if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
-      ds_name = ds->ds[i].name;
-
-    /* Copy the identifier to `key' and escape it. */
-    if (flags & GRAPHITE_USE_TAGS) {
-      status = gr_format_name_tagged(key, sizeof(key), vl, ds_name, prefix,
-                                     postfix, escape_char, flags);
-      if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name_tagged");
-        sfree(rates);
-        return status;
-      }
-    } else {
-      status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
-                              escape_char, flags);
-      if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name");
-        sfree(rates);
-        return status;
-      }
+  if ((cache != NULL) && (id != NULL)) {
+    status = gr_format_lines_cached(cache, id, buffer, buffer_size, ds, vl,
+                                    rates);
+    if (status != ENOENT) {
+      sfree(rates);
+      return status;
     }
 
-    escape_graphite_string(key, escape_char);
+    gr_cache_entry_t *e = gr_cache_entry_create(ds, vl, id, prefix, postfix,
+                                                escape_char, flags);
+    if (e != NULL) {
+      status = 0;
+      for (size_t i = 0; (status == 0) && (i < ds->ds_num); i++)
+        status = gr_format_line(buffer, buffer_size, &buffer_pos, e->paths[i],
+                                ds, vl, i, rates);
+
+      pthread_mutex_lock(&cache->lock);
+      c_lru_put(cache->lru, id->id, e);
+      pthread_mutex_unlock(&cache->lock);
 
-    /* Convert the values to an ASCII representation and put that into
-     * `values'. */
-    status = gr_format_values(values, sizeof(values), i, ds, vl, rates);
-    if (status != 0) {
-      P_ERROR("format_graphite: error with gr_format_values");
       sfree(rates);
       return status;
     }
+    /* Fall back to formatting the paths without caching them. */
+  }
 
-    /* Compute the graphite command */
-    message_len =
-        (size_t)snprintf(message, sizeof(message), "%s %s %u\r\n", key, values,
-                         (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
-    if (message_len >= sizeof(message)) {
-      P_ERROR("format_graphite: message buffer too small: "
-              "Need %" PRIsz " bytes.",
-              message_len + 1);
-      sfree(rates);
-      return -ENOMEM;
-    }
+  status = 0;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char key[10 * DATA_MAX_NAME_LEN];
 
-    /* Append it in case we got multiple data set */
-    if ((buffer_pos + message_len) >= buffer_size) {
-      P_ERROR("format_graphite: target buffer too small");
-      sfree(rates);
-      return -ENOMEM;
-    }
-    memcpy((void *)(buffer + buffer_pos), message, message_len);
-    buffer_pos += message_len;
-    buffer[buffer_pos] = '\0';
+    status = gr_format_path(key, sizeof(key), ds, vl, i, prefix, postfix,
+                            escape_char, flags);
+    if (status != 0)
+      break;
+
+    status = gr_format_line(buffer, buffer_size, &buffer_pos, key, ds, vl, i,
+                            rates);
+    if (status != 0)
+      break;
   }
+
   sfree(rates);
   return status;
+} /* }}} int format_graphite_cached */
+
+int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
+                    value_list_t const *vl, char const *prefix,
+                    char const *postfix, char const escape_char,
+                    unsigned int flags) {
+  return format_graphite_cached(/* cache = */ NULL, /* id = */ NULL, buffer,
+                                buffer_size, ds, vl, prefix, postfix,
+                                escape_char, flags);
 } /* int format_graphite */
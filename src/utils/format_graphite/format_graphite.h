@@ -39,4 +39,23 @@ int format_graphite(char *buffer, size_t buffer_size, const data_set_t *ds,
                     const char *postfix, const char escape_char,
                     unsigned int flags);
 
+/* Remembers the metric paths of the most recently written value lists, so
+ * that only their values and times have to be formatted. The paths depend on
+ * the prefix, postfix, escape character and flags, so a cache must always be
+ * used with the same ones. The cache is locked internally. */
+struct format_graphite_cache_s;
+typedef struct format_graphite_cache_s format_graphite_cache_t;
+
+format_graphite_cache_t *format_graphite_cache_create(size_t size);
+void format_graphite_cache_destroy(format_graphite_cache_t *cache);
+
+/* Like format_graphite(), using `cache' for value lists whose identity `id'
+ * is known, see plugin_value_list_identity(). Either may be NULL. */
+int format_graphite_cached(format_graphite_cache_t *cache,
+                           const vl_identity_t *id, char *buffer,
+                           size_t buffer_size, const data_set_t *ds,
+                           const value_list_t *vl, const char *prefix,
+                           const char *postfix, const char escape_char,
+                           unsigned int flags);
+
 #endif /* UTILS_FORMAT_GRAPHITE_H */
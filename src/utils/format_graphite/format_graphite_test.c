@@ -29,6 +29,7 @@
 #include "testing.h"
 #include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
 #include "utils/format_graphite/format_graphite.h"
+#include "utils_identity.h"
 
 static data_set_t ds_single = {
     .type = "single",
@@ -205,9 +206,60 @@ DEF_TEST(null_termination) {
   return 0;
 }
 
+DEF_TEST(cache) {
+  value_list_t vl = {
+      .values = &(value_t){.gauge = 42},
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .plugin_instance = "foo",
+      .type = "single",
+  };
+  value_list_t other = vl;
+  sstrncpy(other.plugin_instance, "bar", sizeof(other.plugin_instance));
+
+  format_graphite_cache_t *cache;
+  CHECK_NOT_NULL(cache = format_graphite_cache_create(1));
+  vl_identity_t const *vl_id = vl_identity_intern(&vl);
+  OK(vl_id != NULL);
+  vl_identity_t const *other_id = vl_identity_intern(&other);
+  OK(other_id != NULL);
+
+  struct {
+    value_list_t *vl;
+    vl_identity_t const *id;
+    gauge_t value;
+    char const *want;
+  } cases[] = {
+      {&vl, vl_id, 42, "pre.example_com.test.foo.single 42 1480063672\r\n"},
+      {&vl, vl_id, 23, "pre.example_com.test.foo.single 23 1480063672\r\n"},
+      {&other, other_id, 1, "pre.example_com.test.bar.single 1 1480063672\r\n"},
+      {&vl, vl_id, 2, "pre.example_com.test.foo.single 2 1480063672\r\n"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    cases[i].vl->values[0].gauge = cases[i].value;
+
+    char got[1024];
+    EXPECT_EQ_INT(0, format_graphite_cached(cache, cases[i].id, got,
+                                            sizeof(got), &ds_single,
+                                            cases[i].vl, "pre.", NULL, '_',
+                                            GRAPHITE_SEPARATE_INSTANCES));
+    EXPECT_EQ_STR(cases[i].want, got);
+  }
+
+  vl_identity_release(vl_id);
+  vl_identity_release(other_id);
+  format_graphite_cache_destroy(cache);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(metric_name);
   RUN_TEST(null_termination);
+  RUN_TEST(cache);
 
   END_TEST;
 }
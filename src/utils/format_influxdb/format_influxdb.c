@@ -29,8 +29,10 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/lru/lru.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
+#include "utils_identity.h"
 
 #include "utils/format_influxdb/format_influxdb.h"
 
@@ -72,140 +74,446 @@ static int format_influxdb_escape_string(char *buffer, size_t buffer_size,
   return dst_pos;
 } /* int format_influxdb_escape_string */
 
-int format_influxdb_value_list(
-    char *buffer, int buffer_len, const data_set_t *ds, const value_list_t *vl,
-    bool store_rates, format_influxdb_time_precision_t time_precision) {
-  int status;
-  int offset = 0;
-  gauge_t *rates = NULL;
-  bool have_values = false;
+/* Output of format_influxdb_value_lists(). One byte is always left for the
+ * terminating null byte. */
+typedef struct {
+  char *buffer;
+  size_t size;
+  size_t pos;
+} influxdb_out_t;
 
-  assert(0 == strcmp(ds->type, vl->type));
+static int influxdb_add(influxdb_out_t *out, char const *str, size_t len) {
+  if (len >= (out->size - out->pos))
+    return -ENOMEM;
 
-#define BUFFER_ADD_ESCAPE(...)                                                 \
-  do {                                                                         \
-    status = format_influxdb_escape_string(buffer + offset,                    \
-                                           buffer_len - offset, __VA_ARGS__);  \
-    if (status < 0)                                                            \
-      return status;                                                           \
-    offset += status;                                                          \
-  } while (0)
+  memcpy(out->buffer + out->pos, str, len);
+  out->pos += len;
+  return 0;
+} /* int influxdb_add */
+
+#define INFLUXDB_ADD_LITERAL(out, str) influxdb_add((out), (str), sizeof(str) - 1)
+
+/* Accounts for `status' bytes written by one of the format_* functions, which
+ * return what snprintf() would. */
+static int influxdb_add_formatted(influxdb_out_t *out, int status) {
+  if ((status < 0) || ((size_t)status >= (out->size - out->pos)))
+    return -ENOMEM;
+
+  out->pos += (size_t)status;
+  return 0;
+} /* int influxdb_add_formatted */
+
+#define INFLUXDB_ADD_FORMATTED(out, func, ...)                                 \
+  influxdb_add_formatted(                                                      \
+      (out), func((out)->buffer + (out)->pos, (out)->size - (out)->pos,        \
+                  __VA_ARGS__))
 
-#define BUFFER_ADD(...)                                                        \
+static int influxdb_add_escaped(influxdb_out_t *out, char const *str) {
+  int status = format_influxdb_escape_string(out->buffer + out->pos,
+                                             out->size - out->pos, str);
+  if (status < 0)
+    return status;
+
+  out->pos += (size_t)status;
+  return 0;
+} /* int influxdb_add_escaped */
+
+#define INFLUXDB_CHECKED(cmd)                                                  \
   do {                                                                         \
-    status = snprintf(buffer + offset, buffer_len - offset, __VA_ARGS__);      \
-    if ((status < 0) || (status >= (buffer_len - offset))) {                   \
-      sfree(rates);                                                            \
-      return -ENOMEM;                                                          \
-    }                                                                          \
-    offset += status;                                                          \
+    int status_ = (cmd);                                                       \
+    if (status_ != 0)                                                          \
+      return status_;                                                          \
   } while (0)
 
-  BUFFER_ADD_ESCAPE(vl->plugin);
-  BUFFER_ADD(",host=");
-  BUFFER_ADD_ESCAPE(vl->host);
+/* The measurement and the tags taken from the identifier. */
+static int influxdb_add_series_key(influxdb_out_t *out, value_list_t const *vl,
+                                   bool with_type_instance) {
+  INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->plugin));
+  INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ",host="));
+  INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->host));
   if (strcmp(vl->plugin_instance, "") != 0) {
-    BUFFER_ADD(",instance=");
-    BUFFER_ADD_ESCAPE(vl->plugin_instance);
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ",instance="));
+    INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->plugin_instance));
   }
   if (strcmp(vl->type, "") != 0) {
-    BUFFER_ADD(",type=");
-    BUFFER_ADD_ESCAPE(vl->type);
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ",type="));
+    INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->type));
   }
-  if (strcmp(vl->type_instance, "") != 0) {
-    BUFFER_ADD(",type_instance=");
-    BUFFER_ADD_ESCAPE(vl->type_instance);
+  if (with_type_instance && (strcmp(vl->type_instance, "") != 0)) {
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ",type_instance="));
+    INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->type_instance));
   }
-  if (vl->meta) {
-    for (meta_entry_t *it = meta_data_iter(vl->meta); it != NULL;
-         it = meta_data_iter_next(it)) {
-      const char *key = meta_data_iter_key(it);
-      char *value;
-
-      if (meta_data_iter_type(it) != MD_TYPE_STRING ||
-          meta_data_iter_get_string(vl->meta, it, &value) != 0)
-        continue;
+  return 0;
+} /* int influxdb_add_series_key */
 
-      BUFFER_ADD(",");
-      BUFFER_ADD_ESCAPE(key);
-      BUFFER_ADD("=");
-      BUFFER_ADD_ESCAPE(value);
-      free(value);
-    }
+typedef struct {
+  char *key;
+  size_t key_len;
+} influxdb_cache_entry_t;
+
+struct format_influxdb_cache_s {
+  c_lru_t *lru;
+  pthread_mutex_t lock;
+};
+
+static void influxdb_cache_entry_free(void *arg) {
+  influxdb_cache_entry_t *e = arg;
+
+  if (e == NULL)
+    return;
+
+  sfree(e->key);
+  free(e);
+} /* void influxdb_cache_entry_free */
+
+format_influxdb_cache_t *format_influxdb_cache_create(size_t size) {
+  format_influxdb_cache_t *cache = calloc(1, sizeof(*cache));
+  if (cache == NULL)
+    return NULL;
+
+  cache->lru = c_lru_create(size, influxdb_cache_entry_free);
+  if (cache->lru == NULL) {
+    free(cache);
+    return NULL;
   }
+  pthread_mutex_init(&cache->lock, /* attr = */ NULL);
+
+  return cache;
+} /* format_influxdb_cache_t *format_influxdb_cache_create */
 
-  BUFFER_ADD(" ");
+void format_influxdb_cache_destroy(format_influxdb_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+  c_lru_destroy(cache->lru);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+} /* void format_influxdb_cache_destroy */
+
+static int influxdb_add_series_key_cached(influxdb_out_t *out,
+                                          write_batch_entry_t const *entry,
+                                          format_influxdb_options_t const *opts,
+                                          bool with_type_instance) {
+  format_influxdb_cache_t *cache = opts->cache;
+  vl_identity_t const *id = entry->identity;
+
+  if ((cache == NULL) || (id == NULL))
+    return influxdb_add_series_key(out, entry->vl, with_type_instance);
+
+  influxdb_cache_entry_t *e = NULL;
+  pthread_mutex_lock(&cache->lock);
+  if (c_lru_get(cache->lru, id->id, (void *)&e) == 0) {
+    int status = influxdb_add(out, e->key, e->key_len);
+    pthread_mutex_unlock(&cache->lock);
+    return status;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  size_t start = out->pos;
+  INFLUXDB_CHECKED(influxdb_add_series_key(out, entry->vl, with_type_instance));
+
+  /* Not caching the key is fine if memory is short. */
+  e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return 0;
+  e->key_len = out->pos - start;
+  e->key = malloc(e->key_len);
+  if (e->key == NULL) {
+    free(e);
+    return 0;
+  }
+  memcpy(e->key, out->buffer + start, e->key_len);
+
+  pthread_mutex_lock(&cache->lock);
+  c_lru_put(cache->lru, id->id, e);
+  pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+} /* int influxdb_add_series_key_cached */
+
+static int influxdb_add_meta_tags(influxdb_out_t *out, meta_data_t *meta) {
+  for (meta_entry_t *it = meta_data_iter(meta); it != NULL;
+       it = meta_data_iter_next(it)) {
+    if (meta_data_iter_type(it) != MD_TYPE_STRING)
+      continue;
+
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ","));
+    INFLUXDB_CHECKED(influxdb_add_escaped(out, meta_data_iter_key(it)));
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+    INFLUXDB_CHECKED(influxdb_add_escaped(out, meta_data_iter_string(it)));
+  }
+  return 0;
+} /* int influxdb_add_meta_tags */
+
+static int influxdb_add_field_key(influxdb_out_t *out, data_set_t const *ds,
+                                  value_list_t const *vl, size_t i,
+                                  bool *have_values,
+                                  bool named_by_type_instance) {
+  if (*have_values)
+    INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, ","));
+  *have_values = true;
+
+  if (!named_by_type_instance || (strcmp(vl->type_instance, "") == 0))
+    return influxdb_add(out, ds->ds[i].name, strlen(ds->ds[i].name));
+
+  INFLUXDB_CHECKED(influxdb_add_escaped(out, vl->type_instance));
+  if (ds->ds_num == 1)
+    return 0;
+  INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "_"));
+  return influxdb_add(out, ds->ds[i].name, strlen(ds->ds[i].name));
+} /* int influxdb_add_field_key */
+
+/* `rates' is only used for data sources that aren't gauges and may only be
+ * NULL if `store_rates' is false. */
+static int influxdb_add_fields(influxdb_out_t *out, data_set_t const *ds,
+                               value_list_t const *vl, gauge_t const *rates,
+                               bool named_by_type_instance,
+                               bool *have_values) {
   for (size_t i = 0; i < ds->ds_num; i++) {
     if ((ds->ds[i].type != DS_TYPE_COUNTER) &&
         (ds->ds[i].type != DS_TYPE_GAUGE) &&
         (ds->ds[i].type != DS_TYPE_DERIVE) &&
-        (ds->ds[i].type != DS_TYPE_ABSOLUTE)) {
-      sfree(rates);
+        (ds->ds[i].type != DS_TYPE_ABSOLUTE))
       return -EINVAL;
-    }
 
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
       if (isnan(vl->values[i].gauge))
         continue;
-      if (have_values)
-        BUFFER_ADD(",");
-      BUFFER_ADD("%s=%lf", ds->ds[i].name, vl->values[i].gauge);
-      have_values = true;
-    } else if (store_rates) {
-      if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
-      if (rates == NULL) {
-        WARNING("format_influxdb: "
-                "uc_get_rate failed.");
-        return -EINVAL;
-      }
+      INFLUXDB_CHECKED(influxdb_add_field_key(out, ds, vl, i, have_values,
+                                              named_by_type_instance));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+      INFLUXDB_CHECKED(
+          INFLUXDB_ADD_FORMATTED(out, format_fixed, vl->values[i].gauge, 6));
+    } else if (rates != NULL) {
       if (isnan(rates[i]))
         continue;
-      if (have_values)
-        BUFFER_ADD(",");
-      BUFFER_ADD("%s=%lf", ds->ds[i].name, rates[i]);
-      have_values = true;
+      INFLUXDB_CHECKED(influxdb_add_field_key(out, ds, vl, i, have_values,
+                                              named_by_type_instance));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_FORMATTED(out, format_fixed, rates[i], 6));
     } else if (ds->ds[i].type == DS_TYPE_COUNTER) {
-      if (have_values)
-        BUFFER_ADD(",");
-      BUFFER_ADD("%s=%" PRIu64 "i", ds->ds[i].name,
-                 (uint64_t)vl->values[i].counter);
-      have_values = true;
+      INFLUXDB_CHECKED(influxdb_add_field_key(out, ds, vl, i, have_values,
+                                              named_by_type_instance));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_FORMATTED(
+          out, format_uint64, (uint64_t)vl->values[i].counter));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "i"));
     } else if (ds->ds[i].type == DS_TYPE_DERIVE) {
-      if (have_values)
-        BUFFER_ADD(",");
-      BUFFER_ADD("%s=%" PRIi64 "i", ds->ds[i].name, vl->values[i].derive);
-      have_values = true;
+      INFLUXDB_CHECKED(influxdb_add_field_key(out, ds, vl, i, have_values,
+                                              named_by_type_instance));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+      INFLUXDB_CHECKED(
+          INFLUXDB_ADD_FORMATTED(out, format_int64, vl->values[i].derive));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "i"));
     } else if (ds->ds[i].type == DS_TYPE_ABSOLUTE) {
-      if (have_values)
-        BUFFER_ADD(",");
-      BUFFER_ADD("%s=%" PRIu64 "i", ds->ds[i].name, vl->values[i].absolute);
-      have_values = true;
+      INFLUXDB_CHECKED(influxdb_add_field_key(out, ds, vl, i, have_values,
+                                              named_by_type_instance));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "="));
+      INFLUXDB_CHECKED(
+          INFLUXDB_ADD_FORMATTED(out, format_uint64, vl->values[i].absolute));
+      INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, "i"));
     }
-
   } /* for ds->ds_num */
-  sfree(rates);
 
-  if (!have_values)
-    return 0;
+  return 0;
+} /* int influxdb_add_fields */
 
-  uint64_t influxdb_time = 0;
-  switch (time_precision) {
+static uint64_t influxdb_time(cdtime_t t,
+                              format_influxdb_time_precision_t precision) {
+  switch (precision) {
   case NS:
-    influxdb_time = CDTIME_T_TO_NS(vl->time);
-    break;
+    return CDTIME_T_TO_NS(t);
   case US:
-    influxdb_time = CDTIME_T_TO_US(vl->time);
-    break;
+    return CDTIME_T_TO_US(t);
   case MS:
-    influxdb_time = CDTIME_T_TO_MS(vl->time);
-    break;
+    return CDTIME_T_TO_MS(t);
   }
+  return 0;
+} /* uint64_t influxdb_time */
 
-  BUFFER_ADD(" %" PRIu64 "\n", influxdb_time);
+static bool influxdb_mergeable(value_list_t const *first,
+                               value_list_t const *vl, uint64_t time,
+                               format_influxdb_time_precision_t precision) {
+  return (vl->meta == NULL) && (strcmp(first->plugin, vl->plugin) == 0) &&
+         (strcmp(first->host, vl->host) == 0) &&
+         (strcmp(first->plugin_instance, vl->plugin_instance) == 0) &&
+         (strcmp(first->type, vl->type) == 0) &&
+         (influxdb_time(vl->time, precision) == time);
+} /* bool influxdb_mergeable */
 
-#undef BUFFER_ADD_ESCAPE
-#undef BUFFER_ADD
+static bool influxdb_needs_rates(data_set_t const *ds) {
+  for (size_t i = 0; i < ds->ds_num; i++)
+    if (ds->ds[i].type != DS_TYPE_GAUGE)
+      return true;
+  return false;
+} /* bool influxdb_needs_rates */
+
+/* Formats the line of entries[0], including the entries merged into it, and
+ * stores the number of entries used in `ret_used'. `rates' holds the rates of
+ * all entries one after the other, as returned by uc_get_rate_multi(). */
+static int influxdb_format_line(influxdb_out_t *out,
+                                write_batch_entry_t const *entries,
+                                size_t entries_num, gauge_t const *rates,
+                                format_influxdb_options_t const *opts,
+                                size_t *ret_used) {
+  value_list_t const *vl = entries[0].vl;
+  bool merge = opts->merge_type_instances && (vl->meta == NULL);
+  size_t line_start = out->pos;
+
+  assert(0 == strcmp(entries[0].ds->type, vl->type));
+
+  INFLUXDB_CHECKED(
+      influxdb_add_series_key_cached(out, entries, opts, /* with_type_instance = */ !merge));
+  if (vl->meta != NULL)
+    INFLUXDB_CHECKED(influxdb_add_meta_tags(out, vl->meta));
+  INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, " "));
+
+  uint64_t time = influxdb_time(vl->time, opts->time_precision);
+  bool have_values = false;
+  size_t used = 0;
+  do {
+    write_batch_entry_t const *e = entries + used;
+
+    INFLUXDB_CHECKED(influxdb_add_fields(out, e->ds, e->vl, rates, merge,
+                                         &have_values));
+    if (rates != NULL)
+      rates += e->ds->ds_num;
+    used++;
+  } while (merge && (used < entries_num) &&
+           influxdb_mergeable(vl, entries[used].vl, time,
+                              opts->time_precision));
+  *ret_used = used;
+
+  /* Nothing but NaNs. */
+  if (!have_values) {
+    out->pos = line_start;
+    return 0;
+  }
+
+  INFLUXDB_CHECKED(INFLUXDB_ADD_LITERAL(out, " "));
+  INFLUXDB_CHECKED(INFLUXDB_ADD_FORMATTED(out, format_uint64, time));
+  return INFLUXDB_ADD_LITERAL(out, "\n");
+} /* int influxdb_format_line */
+
+static int influxdb_format_lines(influxdb_out_t *out,
+                                 write_batch_entry_t const *entries,
+                                 size_t entries_num, gauge_t const *rates,
+                                 format_influxdb_options_t const *opts,
+                                 size_t *ret_entries_num) {
+  size_t done = 0;
+  int status = 0;
+
+  while (done < entries_num) {
+    size_t line_start = out->pos;
+    size_t used = 0;
+
+    status = influxdb_format_line(out, entries + done, entries_num - done,
+                                  rates, opts, &used);
+    if (status != 0) {
+      out->pos = line_start;
+      break;
+    }
+
+    if (rates != NULL)
+      for (size_t i = done; i < done + used; i++)
+        rates += entries[i].ds->ds_num;
+    done += used;
+  }
+  out->buffer[out->pos] = 0;
+
+  /* Stop at the first line that doesn't fit. */
+  if ((status == -ENOMEM) && (done > 0))
+    status = 0;
+
+  *ret_entries_num = done;
+  return status;
+} /* int influxdb_format_lines */
+
+#undef INFLUXDB_CHECKED
+
+int format_influxdb_value_lists(char *buffer, size_t buffer_size,
+                                write_batch_entry_t const *entries,
+                                size_t entries_num,
+                                format_influxdb_options_t const *opts,
+                                size_t *ret_entries_num) {
+  if ((buffer == NULL) || (entries == NULL) || (opts == NULL) ||
+      (ret_entries_num == NULL))
+    return -EINVAL;
+
+  *ret_entries_num = 0;
+  if (buffer_size == 0)
+    return -ENOMEM;
+
+  /* The rates of the whole batch are looked up at once. */
+  gauge_t *rates = NULL;
+  if (opts->store_rates) {
+    size_t rates_num = 0;
+    bool needed = false;
+    for (size_t i = 0; i < entries_num; i++) {
+      rates_num += entries[i].ds->ds_num;
+      needed = needed || influxdb_needs_rates(entries[i].ds);
+    }
+
+    if (needed) {
+      rates = calloc(rates_num, sizeof(*rates));
+      if (rates == NULL)
+        return -ENOMEM;
+      if (uc_get_rate_multi(entries, entries_num, rates, NULL) < 0) {
+        WARNING("format_influxdb: uc_get_rate_multi failed.");
+        free(rates);
+        return -EINVAL;
+      }
+    }
+  }
+
+  influxdb_out_t out = {
+      .buffer = buffer,
+      .size = buffer_size,
+  };
+  int status = influxdb_format_lines(&out, entries, entries_num, rates, opts,
+                                     ret_entries_num);
+  free(rates);
+  if (status != 0)
+    return status;
+
+  return (int)out.pos;
+} /* int format_influxdb_value_lists */
+
+int format_influxdb_value_list(
+    char *buffer, int buffer_len, const data_set_t *ds, const value_list_t *vl,
+    bool store_rates, format_influxdb_time_precision_t time_precision) {
+  if (buffer_len <= 0)
+    return -ENOMEM;
+
+  gauge_t *rates = NULL;
+  if (store_rates && influxdb_needs_rates(ds)) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      WARNING("format_influxdb: "
+              "uc_get_rate failed.");
+      return -EINVAL;
+    }
+  }
+
+  write_batch_entry_t entry = {
+      .ds = ds,
+      .vl = vl,
+  };
+  format_influxdb_options_t opts = {
+      .store_rates = store_rates,
+      .time_precision = time_precision,
+  };
+  influxdb_out_t out = {
+      .buffer = buffer,
+      .size = (size_t)buffer_len,
+  };
+  size_t entries_num = 0;
+
+  int status =
+      influxdb_format_lines(&out, &entry, 1, rates, &opts, &entries_num);
+  sfree(rates);
+  if (status != 0)
+    return status;
 
-  return offset;
+  return (int)out.pos;
 } /* int format_influxdb_value_list */
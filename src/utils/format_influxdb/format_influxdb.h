@@ -43,4 +43,45 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
                                bool store_rates,
                                format_influxdb_time_precision_t time_precision);
 
+/* Remembers the series keys, i.e. the measurement and the tags taken from the
+ * identifier, of the most recently written value lists. A cache must always
+ * be used with the same options. The cache is locked internally. */
+struct format_influxdb_cache_s;
+typedef struct format_influxdb_cache_s format_influxdb_cache_t;
+
+format_influxdb_cache_t *format_influxdb_cache_create(size_t size);
+void format_influxdb_cache_destroy(format_influxdb_cache_t *cache);
+
+typedef struct {
+  bool store_rates;
+  format_influxdb_time_precision_t time_precision;
+  /* Writes value lists that only differ in their type instance, have no meta
+   * data and follow each other with the same time as one line. Fields are
+   * named after the type instance instead of the data source, or
+   * "<type instance>_<data source>" if there is more than one. */
+  bool merge_type_instances;
+  /* May be NULL. */
+  format_influxdb_cache_t *cache;
+} format_influxdb_options_t;
+
+/*
+ * NAME
+ *   format_influxdb_value_lists
+ *
+ * DESCRIPTION
+ *   Formats as many of `entries' as fit into `buffer', which is null
+ *   terminated afterwards, and stores their number in `ret_entries_num'. All
+ *   value lists of a line fit or none does. Value lists without any values
+ *   that can be written produce no output but are counted.
+ *
+ * RETURN VALUE
+ *   The number of bytes written, -ENOMEM if not even the first line fits, or
+ *   another negative errno value upon failure.
+ */
+int format_influxdb_value_lists(char *buffer, size_t buffer_size,
+                                const write_batch_entry_t *entries,
+                                size_t entries_num,
+                                const format_influxdb_options_t *opts,
+                                size_t *ret_entries_num);
+
 #endif /* UTILS_FORMAT_INFLUXDB_H */
@@ -0,0 +1,214 @@
+/**
+ * collectd - src/utils/format_influxdb/format_influxdb_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
+#include "utils/format_influxdb/format_influxdb.h"
+#include "utils_identity.h"
+
+static data_source_t dsrc_single[] = {{"value", DS_TYPE_GAUGE, NAN, NAN}};
+static data_set_t ds_single = {"single", 1, dsrc_single};
+
+static data_source_t dsrc_double[] = {
+    {"rx", DS_TYPE_DERIVE, 0, NAN},
+    {"tx", DS_TYPE_DERIVE, 0, NAN},
+};
+static data_set_t ds_double = {"double", 2, dsrc_double};
+
+/* 1480063672 s */
+#define TEST_TIME TIME_T_TO_CDTIME_T_STATIC(1480063672)
+
+static value_list_t make_vl(value_t *values, data_set_t const *ds,
+                            char const *type_instance, cdtime_t t) {
+  value_list_t vl = {
+      .values = values,
+      .values_len = ds->ds_num,
+      .time = t,
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .plugin_instance = "0",
+  };
+  sstrncpy(vl.type, ds->type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+  return vl;
+}
+
+DEF_TEST(value_list) {
+  value_list_t vl =
+      make_vl(&(value_t){.gauge = 42}, &ds_single, "a b", TEST_TIME);
+  char const *want = "test,host=example.com,instance=0,type=single,"
+                     "type_instance=a\\ b value=42.000000 1480063672000\n";
+
+  char got[1024];
+  EXPECT_EQ_INT((int)strlen(want),
+                format_influxdb_value_list(got, sizeof(got), &ds_single, &vl,
+                                           false, MS));
+  EXPECT_EQ_STR(want, got);
+
+  /* Only NaNs: no line at all. */
+  vl.values[0].gauge = NAN;
+  EXPECT_EQ_INT(0, format_influxdb_value_list(got, sizeof(got), &ds_single,
+                                              &vl, false, MS));
+
+  vl.values[0].gauge = 42;
+  EXPECT_EQ_INT(-ENOMEM, format_influxdb_value_list(got, (int)strlen(want),
+                                                    &ds_single, &vl, false,
+                                                    MS));
+
+  return 0;
+}
+
+DEF_TEST(value_lists) {
+  value_t values[][2] = {
+      {{.gauge = 1}}, {{.gauge = 2}}, {{.derive = 3}, {.derive = 4}},
+      {{.gauge = 5}}, {{.gauge = NAN}},
+  };
+  value_list_t vls[] = {
+      make_vl(values[0], &ds_single, "a", TEST_TIME),
+      make_vl(values[1], &ds_single, "b", TEST_TIME),
+      make_vl(values[2], &ds_double, "c", TEST_TIME),
+      make_vl(values[3], &ds_single, "d", TEST_TIME + MS_TO_CDTIME_T(1)),
+      make_vl(values[4], &ds_single, "e", TEST_TIME),
+  };
+  write_batch_entry_t entries[] = {
+      {.ds = &ds_single, .vl = vls + 0}, {.ds = &ds_single, .vl = vls + 1},
+      {.ds = &ds_double, .vl = vls + 2}, {.ds = &ds_single, .vl = vls + 3},
+      {.ds = &ds_single, .vl = vls + 4},
+  };
+
+  struct {
+    bool merge;
+    size_t buffer_size;
+    size_t want_entries_num;
+    char const *want;
+  } cases[] = {
+      {
+          .merge = false,
+          .buffer_size = 1024,
+          .want_entries_num = 5,
+          .want = "test,host=example.com,instance=0,type=single,"
+                  "type_instance=a value=1.000000 1480063672000\n"
+                  "test,host=example.com,instance=0,type=single,"
+                  "type_instance=b value=2.000000 1480063672000\n"
+                  "test,host=example.com,instance=0,type=double,"
+                  "type_instance=c rx=3i,tx=4i 1480063672000\n"
+                  "test,host=example.com,instance=0,type=single,"
+                  "type_instance=d value=5.000000 1480063672001\n",
+      },
+      {
+          .merge = true,
+          .buffer_size = 1024,
+          .want_entries_num = 5,
+          .want = "test,host=example.com,instance=0,type=single "
+                  "a=1.000000,b=2.000000 1480063672000\n"
+                  "test,host=example.com,instance=0,type=double "
+                  "c_rx=3i,c_tx=4i 1480063672000\n"
+                  "test,host=example.com,instance=0,type=single "
+                  "d=5.000000 1480063672001\n",
+      },
+      {
+          /* Only the first line fits. It has value lists of both entries. */
+          .merge = true,
+          .buffer_size = 100,
+          .want_entries_num = 2,
+          .want = "test,host=example.com,instance=0,type=single "
+                  "a=1.000000,b=2.000000 1480063672000\n",
+      },
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    format_influxdb_options_t opts = {
+        .time_precision = MS,
+        .merge_type_instances = cases[i].merge,
+    };
+
+    char got[1024];
+    size_t entries_num = 0;
+    EXPECT_EQ_INT((int)strlen(cases[i].want),
+                  format_influxdb_value_lists(got, cases[i].buffer_size,
+                                              entries,
+                                              STATIC_ARRAY_SIZE(entries),
+                                              &opts, &entries_num));
+    EXPECT_EQ_INT(cases[i].want_entries_num, entries_num);
+    EXPECT_EQ_STR(cases[i].want, got);
+  }
+
+  /* Not even the first line fits. */
+  format_influxdb_options_t opts = {.time_precision = MS};
+  char got[16];
+  size_t entries_num = 1;
+  EXPECT_EQ_INT(-ENOMEM,
+                format_influxdb_value_lists(got, sizeof(got), entries,
+                                            STATIC_ARRAY_SIZE(entries), &opts,
+                                            &entries_num));
+  EXPECT_EQ_INT(0, entries_num);
+
+  return 0;
+}
+
+DEF_TEST(cache) {
+  value_t value = {.gauge = 1};
+  value_list_t vl = make_vl(&value, &ds_single, "a", TEST_TIME);
+  vl_identity_t const *id = vl_identity_intern(&vl);
+  OK(id != NULL);
+
+  format_influxdb_cache_t *cache = format_influxdb_cache_create(1);
+  OK(cache != NULL);
+  format_influxdb_options_t opts = {
+      .time_precision = MS,
+      .cache = cache,
+  };
+  write_batch_entry_t entry = {.ds = &ds_single, .vl = &vl, .identity = id};
+
+  for (int i = 0; i < 2; i++) {
+    value.gauge = (gauge_t)i;
+
+    char want[256];
+    ssnprintf(want, sizeof(want),
+              "test,host=example.com,instance=0,type=single,"
+              "type_instance=a value=%d.000000 1480063672000\n",
+              i);
+
+    char got[256];
+    size_t entries_num = 0;
+    EXPECT_EQ_INT((int)strlen(want),
+                  format_influxdb_value_lists(got, sizeof(got), &entry, 1,
+                                              &opts, &entries_num));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  format_influxdb_cache_destroy(cache);
+  vl_identity_release(id);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(value_list);
+  RUN_TEST(value_lists);
+  RUN_TEST(cache);
+
+  END_TEST;
+}
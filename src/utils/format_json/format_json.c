@@ -31,6 +31,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
+#include "utils_identity.h"
 
 #if HAVE_LIBYAJL
 #include <yajl/yajl_common.h>
@@ -43,359 +44,366 @@
 #endif
 #endif
 
-static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
-                              const char *string) {
-  size_t dst_pos;
+/* Position in the caller's buffer while formatting a value list. Output is
+ * written in place; `end' is where the value list must end at the latest, so
+ * that the terminating null byte and the closing bracket added by
+ * format_json_finalize() still fit. */
+typedef struct {
+  char *pos;
+  char *end;
+} json_out_t;
 
-  if ((buffer == NULL) || (string == NULL))
-    return -EINVAL;
-
-  if (buffer_size < 3)
+static int json_add(json_out_t *out, char const *str, size_t len) /* {{{ */
+{
+  if (len > (size_t)(out->end - out->pos))
     return -ENOMEM;
 
-  dst_pos = 0;
+  memcpy(out->pos, str, len);
+  out->pos += len;
+  return 0;
+} /* }}} int json_add */
 
-#define BUFFER_ADD(c)                                                          \
-  do {                                                                         \
-    if (dst_pos >= (buffer_size - 1)) {                                        \
-      buffer[buffer_size - 1] = '\0';                                          \
-      return -ENOMEM;                                                          \
-    }                                                                          \
-    buffer[dst_pos] = (c);                                                     \
-    dst_pos++;                                                                 \
-  } while (0)
+#define JSON_ADD_LITERAL(out, str) json_add((out), (str), sizeof(str) - 1)
 
-  /* Escape special characters */
-  BUFFER_ADD('"');
-  for (size_t src_pos = 0; string[src_pos] != 0; src_pos++) {
-    if ((string[src_pos] == '"') || (string[src_pos] == '\\')) {
-      BUFFER_ADD('\\');
-      BUFFER_ADD(string[src_pos]);
-    } else if (string[src_pos] <= 0x001F)
-      BUFFER_ADD('?');
-    else
-      BUFFER_ADD(string[src_pos]);
-  } /* for */
-  BUFFER_ADD('"');
-  buffer[dst_pos] = 0;
+static int json_add_uint(json_out_t *out, uint64_t value) /* {{{ */
+{
+  char digits[20];
+  size_t i = sizeof(digits);
 
-#undef BUFFER_ADD
+  do {
+    digits[--i] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value != 0);
 
+  return json_add(out, digits + i, sizeof(digits) - i);
+} /* }}} int json_add_uint */
+
+/* Accounts for `status' bytes written to `out->pos' by one of the format_*
+ * functions, which return what snprintf() would. */
+static int json_add_formatted(json_out_t *out, int status) /* {{{ */
+{
+  if (status < 1)
+    return -1;
+  else if ((size_t)status > (size_t)(out->end - out->pos))
+    return -ENOMEM;
+
+  out->pos += status;
   return 0;
-} /* }}} int json_escape_string */
+} /* }}} int json_add_formatted */
 
-static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                          const data_set_t *ds, const value_list_t *vl,
-                          int store_rates) {
-  size_t offset = 0;
-  gauge_t *rates = NULL;
+static int json_add_gauge(json_out_t *out, gauge_t value) /* {{{ */
+{
+  size_t avail = (size_t)(out->end - out->pos);
+  return json_add_formatted(out, format_gauge(out->pos, avail + 1, value));
+} /* }}} int json_add_gauge */
+
+static int json_add_fixed(json_out_t *out, double value, /* {{{ */
+                          int precision) {
+  size_t avail = (size_t)(out->end - out->pos);
+  return json_add_formatted(
+      out, format_fixed(out->pos, avail + 1, value, precision));
+} /* }}} int json_add_fixed */
+
+static int json_add_int(json_out_t *out, int64_t value) /* {{{ */
+{
+  if (value >= 0)
+    return json_add_uint(out, (uint64_t)value);
+
+  int status = JSON_ADD_LITERAL(out, "-");
+  if (status != 0)
+    return status;
+  return json_add_uint(out, ((uint64_t)(-(value + 1))) + 1);
+} /* }}} int json_add_int */
 
-  memset(buffer, 0, buffer_size);
+/* Characters that need escaping are rare, so strings are checked eight bytes
+ * at a time and copied in runs. Control characters are replaced with '?', as
+ * are bytes that are negative as plain char. The latter has always been the
+ * case on platforms where char is signed and is kept that way. */
+#define JSON_BYTES(c) (UINT64_C(0x0101010101010101) * (uint8_t)(c))
+#define JSON_HAS_ZERO(w) ((((w)-JSON_BYTES(1)) & ~(w)) & JSON_BYTES(0x80))
 
-#define BUFFER_ADD(...)                                                        \
+static inline bool json_needs_escape(char c) /* {{{ */
+{
+  return (c == '"') || (c == '\\') || (c <= 0x1F);
+} /* }}} bool json_needs_escape */
+
+static inline bool json_word_needs_escape(uint64_t w) /* {{{ */
+{
+  uint64_t special = ((w - JSON_BYTES(0x20)) & ~w & JSON_BYTES(0x80)) |
+                     JSON_HAS_ZERO(w ^ JSON_BYTES('"')) |
+                     JSON_HAS_ZERO(w ^ JSON_BYTES('\\'));
+#if CHAR_MIN < 0
+  special |= w & JSON_BYTES(0x80);
+#endif
+  return special != 0;
+} /* }}} bool json_word_needs_escape */
+
+static int json_add_escaped(json_out_t *out, char const *str) /* {{{ */
+{
+  char const *end = str + strlen(str);
+  int status = JSON_ADD_LITERAL(out, "\"");
+
+  while ((status == 0) && (str < end)) {
+    char const *run = str;
+    uint64_t w;
+
+    while ((end - str) >= (ptrdiff_t)sizeof(w)) {
+      memcpy(&w, str, sizeof(w));
+      if (json_word_needs_escape(w))
+        break;
+      str += sizeof(w);
+    }
+    while ((str < end) && !json_needs_escape(*str))
+      str++;
+
+    status = json_add(out, run, (size_t)(str - run));
+    if ((status != 0) || (str == end))
+      break;
+
+    if ((*str == '"') || (*str == '\\')) {
+      char escaped[2] = {'\\', *str};
+      status = json_add(out, escaped, sizeof(escaped));
+    } else {
+      status = JSON_ADD_LITERAL(out, "?");
+    }
+    str++;
+  }
+
+  if (status != 0)
+    return status;
+  return JSON_ADD_LITERAL(out, "\"");
+} /* }}} int json_add_escaped */
+
+#define JSON_ADD_CHECKED(cmd)                                                  \
   do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
-      sfree(rates);                                                            \
-      return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
+    int status_ = (cmd);                                                       \
+    if (status_ != 0)                                                          \
+      return status_;                                                          \
   } while (0)
 
-  BUFFER_ADD("[");
-  for (size_t i = 0; i < ds->ds_num; i++) {
-    if (i > 0)
-      BUFFER_ADD(",");
+static int values_to_json(json_out_t *out, /* {{{ */
+                          const data_set_t *ds, const value_list_t *vl,
+                          int store_rates) {
+  gauge_t *rates = NULL;
+  int status = JSON_ADD_LITERAL(out, "[");
+
+  for (size_t i = 0; (status == 0) && (i < ds->ds_num); i++) {
+    if (i > 0) {
+      status = JSON_ADD_LITERAL(out, ",");
+      if (status != 0)
+        break;
+    }
 
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
       if (isfinite(vl->values[i].gauge))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[i].gauge);
+        status = json_add_gauge(out, vl->values[i].gauge);
       else
-        BUFFER_ADD("null");
+        status = JSON_ADD_LITERAL(out, "null");
     } else if (store_rates) {
       if (rates == NULL)
         rates = uc_get_rate(ds, vl);
       if (rates == NULL) {
         WARNING("utils_format_json: uc_get_rate failed.");
-        sfree(rates);
         return -1;
       }
 
       if (isfinite(rates[i]))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, rates[i]);
+        status = json_add_gauge(out, rates[i]);
       else
-        BUFFER_ADD("null");
+        status = JSON_ADD_LITERAL(out, "null");
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[i].counter);
+      status = json_add_uint(out, (uint64_t)vl->values[i].counter);
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD("%" PRIi64, vl->values[i].derive);
+      status = json_add_int(out, vl->values[i].derive);
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD("%" PRIu64, vl->values[i].absolute);
+      status = json_add_uint(out, vl->values[i].absolute);
     else {
       ERROR("format_json: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
-      return -1;
+      status = -1;
     }
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
 
   sfree(rates);
-  return 0;
+  if (status != 0)
+    return status;
+  return JSON_ADD_LITERAL(out, "]");
 } /* }}} int values_to_json */
 
-static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  BUFFER_ADD("[");
+static int dstypes_to_json(json_out_t *out, const data_set_t *ds) /* {{{ */
+{
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "["));
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ","));
 
-    BUFFER_ADD("\"%s\"", DS_TYPE_TO_STRING(ds->ds[i].type));
+    char const *type = DS_TYPE_TO_STRING(ds->ds[i].type);
+    JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "\""));
+    JSON_ADD_CHECKED(json_add(out, type, strlen(type)));
+    JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "\""));
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
-
-  return 0;
+  return JSON_ADD_LITERAL(out, "]");
 } /* }}} int dstypes_to_json */
 
-static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  BUFFER_ADD("[");
+static int dsnames_to_json(json_out_t *out, const data_set_t *ds) /* {{{ */
+{
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "["));
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ","));
 
-    BUFFER_ADD("\"%s\"", ds->ds[i].name);
+    JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "\""));
+    JSON_ADD_CHECKED(json_add(out, ds->ds[i].name, strlen(ds->ds[i].name)));
+    JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, "\""));
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
-
-  return 0;
+  return JSON_ADD_LITERAL(out, "]");
 } /* }}} int dsnames_to_json */
 
-static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                                  meta_data_t *meta, char **keys,
-                                  size_t keys_num) {
-  size_t offset = 0;
-  int status;
-
-  buffer[0] = 0;
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  for (size_t i = 0; i < keys_num; ++i) {
-    int type;
-    char *key = keys[i];
-
-    type = meta_data_type(meta, key);
-    if (type == MD_TYPE_STRING) {
-      char *value = NULL;
-      if (meta_data_get_string(meta, key, &value) == 0) {
-        char temp[512] = "";
-
-        status = json_escape_string(temp, sizeof(temp), value);
-        sfree(value);
-        if (status != 0)
-          return status;
-
-        BUFFER_ADD(",\"%s\":%s", key, temp);
-      }
-    } else if (type == MD_TYPE_SIGNED_INT) {
-      int64_t value = 0;
-      if (meta_data_get_signed_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIi64, key, value);
-    } else if (type == MD_TYPE_UNSIGNED_INT) {
-      uint64_t value = 0;
-      if (meta_data_get_unsigned_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIu64, key, value);
-    } else if (type == MD_TYPE_DOUBLE) {
-      double value = 0.0;
-      if (meta_data_get_double(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%f", key, value);
-    } else if (type == MD_TYPE_BOOLEAN) {
-      bool value = false;
-      if (meta_data_get_boolean(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%s", key, value ? "true" : "false");
-    }
-  } /* for (keys) */
-
-  if (offset == 0)
-    return ENOENT;
+static int meta_data_to_json(json_out_t *out, meta_data_t *meta) /* {{{ */
+{
+  char *start = out->pos;
+
+  for (meta_entry_t *it = meta_data_iter(meta); it != NULL;
+       it = meta_data_iter_next(it)) {
+    int type = meta_data_iter_type(it);
+    if ((type != MD_TYPE_STRING) && (type != MD_TYPE_SIGNED_INT) &&
+        (type != MD_TYPE_UNSIGNED_INT) && (type != MD_TYPE_DOUBLE) &&
+        (type != MD_TYPE_BOOLEAN))
+      continue;
+
+    JSON_ADD_CHECKED((out->pos == start) ? JSON_ADD_LITERAL(out, ",\"meta\":{")
+                                         : JSON_ADD_LITERAL(out, ","));
+    JSON_ADD_CHECKED(json_add_escaped(out, meta_data_iter_key(it)));
+    JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ":"));
+
+    if (type == MD_TYPE_STRING)
+      JSON_ADD_CHECKED(json_add_escaped(out, meta_data_iter_string(it)));
+    else if (type == MD_TYPE_SIGNED_INT)
+      JSON_ADD_CHECKED(json_add_int(out, meta_data_iter_signed_int(it)));
+    else if (type == MD_TYPE_UNSIGNED_INT)
+      JSON_ADD_CHECKED(json_add_uint(out, meta_data_iter_unsigned_int(it)));
+    else if (type == MD_TYPE_DOUBLE)
+      JSON_ADD_CHECKED(json_add_fixed(out, meta_data_iter_double(it), 6));
+    else
+      JSON_ADD_CHECKED(meta_data_iter_boolean(it)
+                           ? JSON_ADD_LITERAL(out, "true")
+                           : JSON_ADD_LITERAL(out, "false"));
+  } /* for (meta) */
 
-  buffer[0] = '{'; /* replace leading ',' */
-  BUFFER_ADD("}");
+  /* Leave out "meta" altogether if there is nothing to put in it. */
+  if (out->pos == start)
+    return 0;
+  return JSON_ADD_LITERAL(out, "}");
+} /* }}} int meta_data_to_json */
 
-#undef BUFFER_ADD
+static int identifier_to_json(json_out_t *out, /* {{{ */
+                              const value_list_t *vl) {
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"host\":"));
+  JSON_ADD_CHECKED(json_add_escaped(out, vl->host));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"plugin\":"));
+  JSON_ADD_CHECKED(json_add_escaped(out, vl->plugin));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"plugin_instance\":"));
+  JSON_ADD_CHECKED(json_add_escaped(out, vl->plugin_instance));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"type\":"));
+  JSON_ADD_CHECKED(json_add_escaped(out, vl->type));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"type_instance\":"));
+  return json_add_escaped(out, vl->type_instance);
+} /* }}} int identifier_to_json */
+
+/* Number of identifiers each thread keeps in their JSON form. Identities are
+ * interned and their IDs are never reused, so an entry can't go stale. */
+#define JSON_IDENTIFIERS_CACHED 256
+
+typedef struct {
+  uint64_t id;
+  /* NULL if the slot is unused. */
+  char *json;
+  size_t json_len;
+  size_t json_size;
+} json_identifier_t;
+
+static pthread_key_t identifier_cache_key;
+static pthread_once_t identifier_cache_once = PTHREAD_ONCE_INIT;
+
+static void identifier_cache_destroy(void *arg) /* {{{ */
+{
+  json_identifier_t *cache = arg;
 
-  return 0;
-} /* }}} int meta_data_keys_to_json */
+  for (size_t i = 0; i < JSON_IDENTIFIERS_CACHED; i++)
+    sfree(cache[i].json);
+  free(cache);
+} /* }}} void identifier_cache_destroy */
 
-static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                             meta_data_t *meta) {
-  char **keys = NULL;
-  size_t keys_num;
-  int status;
+static void identifier_cache_key_create(void) /* {{{ */
+{
+  pthread_key_create(&identifier_cache_key, identifier_cache_destroy);
+} /* }}} void identifier_cache_key_create */
+
+/* Adds the identifier of `vl'. The value lists handled by write callbacks
+ * usually have an identity, which is used to look up the identifier formatted
+ * the last time this thread saw the value list. */
+static int identifier_to_json_cached(json_out_t *out, /* {{{ */
+                                     const value_list_t *vl) {
+  vl_identity_t const *identity = plugin_value_list_identity(vl);
+  if (identity == NULL)
+    return identifier_to_json(out, vl);
+
+  pthread_once(&identifier_cache_once, identifier_cache_key_create);
+  json_identifier_t *cache = pthread_getspecific(identifier_cache_key);
+  if (cache == NULL) {
+    cache = calloc(JSON_IDENTIFIERS_CACHED, sizeof(*cache));
+    if (cache == NULL)
+      return identifier_to_json(out, vl);
+    pthread_setspecific(identifier_cache_key, cache);
+  }
 
-  if ((buffer == NULL) || (buffer_size == 0) || (meta == NULL))
-    return EINVAL;
+  json_identifier_t *e = cache + (identity->id % JSON_IDENTIFIERS_CACHED);
+  if ((e->json != NULL) && (e->id == identity->id))
+    return json_add(out, e->json, e->json_len);
 
-  status = meta_data_toc(meta, &keys);
-  if (status <= 0)
+  char *start = out->pos;
+  int status = identifier_to_json(out, vl);
+  if (status != 0)
     return status;
-  keys_num = (size_t)status;
 
-  status = meta_data_keys_to_json(buffer, buffer_size, meta, keys, keys_num);
-
-  for (size_t i = 0; i < keys_num; ++i)
-    sfree(keys[i]);
-  sfree(keys);
+  size_t len = (size_t)(out->pos - start);
+  if (len > e->json_size) {
+    char *json = realloc(e->json, len);
+    if (json == NULL) /* Not caching it is fine. */
+      return 0;
+    e->json = json;
+    e->json_size = len;
+  }
+  memcpy(e->json, start, len);
+  e->json_len = len;
+  e->id = identity->id;
 
-  return status;
-} /* }}} int meta_data_to_json */
+  return 0;
+} /* }}} int identifier_to_json_cached */
 
-static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int value_list_to_json(json_out_t *out, /* {{{ */
                               const data_set_t *ds, const value_list_t *vl,
                               int store_rates) {
-  char temp[512];
-  size_t offset = 0;
-  int status;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
   /* All value lists have a leading comma. The first one will be replaced with
    * a square bracket in `format_json_finalize'. */
-  BUFFER_ADD(",{");
-
-  status = values_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
-    return status;
-  BUFFER_ADD("\"values\":%s", temp);
-
-  status = dstypes_to_json(temp, sizeof(temp), ds);
-  if (status != 0)
-    return status;
-  BUFFER_ADD(",\"dstypes\":%s", temp);
-
-  status = dsnames_to_json(temp, sizeof(temp), ds);
-  if (status != 0)
-    return status;
-  BUFFER_ADD(",\"dsnames\":%s", temp);
-
-  BUFFER_ADD(",\"time\":%.3f", CDTIME_T_TO_DOUBLE(vl->time));
-  BUFFER_ADD(",\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->interval));
-
-#define BUFFER_ADD_KEYVAL(key, value)                                          \
-  do {                                                                         \
-    status = json_escape_string(temp, sizeof(temp), (value));                  \
-    if (status != 0)                                                           \
-      return status;                                                           \
-    BUFFER_ADD(",\"%s\":%s", (key), temp);                                     \
-  } while (0)
-
-  BUFFER_ADD_KEYVAL("host", vl->host);
-  BUFFER_ADD_KEYVAL("plugin", vl->plugin);
-  BUFFER_ADD_KEYVAL("plugin_instance", vl->plugin_instance);
-  BUFFER_ADD_KEYVAL("type", vl->type);
-  BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
-
-  if (vl->meta != NULL) {
-    char meta_buffer[buffer_size];
-    memset(meta_buffer, 0, sizeof(meta_buffer));
-    status = meta_data_to_json(meta_buffer, sizeof(meta_buffer), vl->meta);
-    if (status != 0)
-      return status;
-
-    BUFFER_ADD(",\"meta\":%s", meta_buffer);
-  } /* if (vl->meta != NULL) */
-
-  BUFFER_ADD("}");
-
-#undef BUFFER_ADD_KEYVAL
-#undef BUFFER_ADD
-
-  return 0;
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",{\"values\":"));
+  JSON_ADD_CHECKED(values_to_json(out, ds, vl, store_rates));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"dstypes\":"));
+  JSON_ADD_CHECKED(dstypes_to_json(out, ds));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"dsnames\":"));
+  JSON_ADD_CHECKED(dsnames_to_json(out, ds));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"time\":"));
+  JSON_ADD_CHECKED(json_add_fixed(out, CDTIME_T_TO_DOUBLE(vl->time), 3));
+  JSON_ADD_CHECKED(JSON_ADD_LITERAL(out, ",\"interval\":"));
+  JSON_ADD_CHECKED(json_add_fixed(out, CDTIME_T_TO_DOUBLE(vl->interval), 3));
+  JSON_ADD_CHECKED(identifier_to_json_cached(out, vl));
+
+  if (vl->meta != NULL)
+    JSON_ADD_CHECKED(meta_data_to_json(out, vl->meta));
+
+  return JSON_ADD_LITERAL(out, "}");
 } /* }}} int value_list_to_json */
 
-static int format_json_value_list_nocheck(char *buffer, /* {{{ */
-                                          size_t *ret_buffer_fill,
-                                          size_t *ret_buffer_free,
-                                          const data_set_t *ds,
-                                          const value_list_t *vl,
-                                          int store_rates, size_t temp_size) {
-  char temp[temp_size];
-  int status;
-
-  status = value_list_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
-    return status;
-  temp_size = strlen(temp);
-
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
-
-  return 0;
-} /* }}} int format_json_value_list_nocheck */
+#undef JSON_ADD_CHECKED
 
 int format_json_initialize(char *buffer, /* {{{ */
                            size_t *ret_buffer_fill, size_t *ret_buffer_free) {
@@ -415,7 +423,7 @@ int format_json_initialize(char *buffer, /* {{{ */
   if (buffer_free < 3)
     return -ENOMEM;
 
-  memset(buffer, 0, buffer_free);
+  buffer[0] = 0;
   *ret_buffer_fill = buffer_fill;
   *ret_buffer_free = buffer_free;
 
@@ -460,9 +468,25 @@ int format_json_value_list(char *buffer, /* {{{ */
   if (*ret_buffer_free < 3)
     return -ENOMEM;
 
-  return format_json_value_list_nocheck(buffer, ret_buffer_fill,
-                                        ret_buffer_free, ds, vl, store_rates,
-                                        (*ret_buffer_free) - 2);
+  char *start = buffer + *ret_buffer_fill;
+  json_out_t out = {
+      .pos = start,
+      .end = start + *ret_buffer_free - 3,
+  };
+
+  int status = value_list_to_json(&out, ds, vl, store_rates);
+  if (status != 0) {
+    /* Drop the part of the value list that did fit. */
+    *start = 0;
+    return status;
+  }
+  *out.pos = 0;
+
+  size_t len = (size_t)(out.pos - start);
+  (*ret_buffer_fill) += len;
+  (*ret_buffer_free) -= len;
+
+  return 0;
 } /* }}} int format_json_value_list */
 
 #if HAVE_LIBYAJL
@@ -177,8 +177,64 @@ DEF_TEST(notification) {
   return expect_json_labels(got, labels, STATIC_ARRAY_SIZE(labels));
 }
 
+DEF_TEST(value_list) {
+  value_t values[] = {{.gauge = 42.5}, {.derive = -1}};
+  data_source_t dsrc[] = {
+      {"value", DS_TYPE_GAUGE, 0, NAN},
+      {"rx", DS_TYPE_DERIVE, 0, NAN},
+  };
+  data_set_t ds = {"test", STATIC_ARRAY_SIZE(dsrc), dsrc};
+  value_list_t vl = {
+      .values = values,
+      .values_len = STATIC_ARRAY_SIZE(values),
+      .time = TIME_T_TO_CDTIME_T(1448284606),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "unit",
+      .plugin_instance = "with \"quotes\" and \\",
+      .type = "test",
+      .type_instance = "ctrl\tchar",
+  };
+  CHECK_NOT_NULL(vl.meta = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(vl.meta, "key", "value"));
+  CHECK_ZERO(meta_data_add_signed_int(vl.meta, "int", -23));
+  CHECK_ZERO(meta_data_add_boolean(vl.meta, "bool", true));
+
+  char want[] = "[{\"values\":[42.5,-1],\"dstypes\":[\"gauge\",\"derive\"],"
+                "\"dsnames\":[\"value\",\"rx\"],\"time\":1448284606.000,"
+                "\"interval\":10.000,\"host\":\"example.com\",\"plugin\":"
+                "\"unit\",\"plugin_instance\":\"with \\\"quotes\\\" and "
+                "\\\\\",\"type\":\"test\",\"type_instance\":\"ctrl?char\","
+                "\"meta\":{\"key\":\"value\",\"int\":-23,\"bool\":true}}]";
+
+  char got[1024];
+  size_t fill = 0;
+  size_t avail = sizeof(got);
+  CHECK_ZERO(format_json_initialize(got, &fill, &avail));
+  CHECK_ZERO(format_json_value_list(got, &fill, &avail, &ds, &vl, 0));
+  CHECK_ZERO(format_json_finalize(got, &fill, &avail));
+  EXPECT_EQ_STR(want, got);
+  EXPECT_EQ_INT(strlen(want), fill);
+  EXPECT_EQ_INT(sizeof(got) - strlen(want), avail);
+
+  /* A value list that doesn't fit leaves the buffer as it was. */
+  char small[128];
+  fill = 0;
+  avail = sizeof(small);
+  CHECK_ZERO(format_json_initialize(small, &fill, &avail));
+  EXPECT_EQ_INT(-ENOMEM,
+                format_json_value_list(small, &fill, &avail, &ds, &vl, 0));
+  EXPECT_EQ_INT(0, fill);
+  EXPECT_EQ_INT(sizeof(small), avail);
+  EXPECT_EQ_STR("", small);
+
+  meta_data_destroy(vl.meta);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(notification);
+  RUN_TEST(value_list);
 
   END_TEST;
 }
@@ -100,10 +100,10 @@ static int values_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
 
   memset(buffer, 0, buffer_size);
 
-#define BUFFER_ADD(...)                                                        \
+#define BUFFER_ADD(func, ...)                                                  \
   do {                                                                         \
     int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
+    status = func(buffer + offset, buffer_size - offset, __VA_ARGS__);         \
     if (status < 1) {                                                          \
       sfree(rates);                                                            \
       return -1;                                                               \
@@ -116,10 +116,10 @@ static int values_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
 
   if (ds->ds[ds_idx].type == DS_TYPE_GAUGE) {
     if (isfinite(vl->values[ds_idx].gauge)) {
-      BUFFER_ADD("[[");
-      BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-      BUFFER_ADD(",");
-      BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[ds_idx].gauge);
+      BUFFER_ADD(snprintf, "[[");
+      BUFFER_ADD(format_uint64, CDTIME_T_TO_MS(vl->time));
+      BUFFER_ADD(snprintf, ",");
+      BUFFER_ADD(format_gauge, vl->values[ds_idx].gauge);
     } else {
       DEBUG("utils_format_kairosdb: invalid vl->values[ds_idx].gauge for "
             "%s|%s|%s|%s|%s",
@@ -139,10 +139,10 @@ static int values_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
     }
 
     if (isfinite(rates[ds_idx])) {
-      BUFFER_ADD("[[");
-      BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-      BUFFER_ADD(",");
-      BUFFER_ADD(JSON_GAUGE_FORMAT, rates[ds_idx]);
+      BUFFER_ADD(snprintf, "[[");
+      BUFFER_ADD(format_uint64, CDTIME_T_TO_MS(vl->time));
+      BUFFER_ADD(snprintf, ",");
+      BUFFER_ADD(format_gauge, rates[ds_idx]);
     } else {
       WARNING("utils_format_kairosdb: invalid rates[ds_idx] for %s|%s|%s|%s|%s",
               vl->plugin, vl->plugin_instance, vl->type, vl->type_instance,
@@ -151,26 +151,26 @@ static int values_to_kairosdb(char *buffer, size_t buffer_size, /* {{{ */
       return -1;
     }
   } else if (ds->ds[ds_idx].type == DS_TYPE_COUNTER) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[ds_idx].counter);
+    BUFFER_ADD(snprintf, "[[");
+    BUFFER_ADD(format_uint64, CDTIME_T_TO_MS(vl->time));
+    BUFFER_ADD(snprintf, ",");
+    BUFFER_ADD(format_uint64, (uint64_t)vl->values[ds_idx].counter);
   } else if (ds->ds[ds_idx].type == DS_TYPE_DERIVE) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIi64, vl->values[ds_idx].derive);
+    BUFFER_ADD(snprintf, "[[");
+    BUFFER_ADD(format_uint64, CDTIME_T_TO_MS(vl->time));
+    BUFFER_ADD(snprintf, ",");
+    BUFFER_ADD(format_int64, vl->values[ds_idx].derive);
   } else if (ds->ds[ds_idx].type == DS_TYPE_ABSOLUTE) {
-    BUFFER_ADD("[[");
-    BUFFER_ADD("%" PRIu64, CDTIME_T_TO_MS(vl->time));
-    BUFFER_ADD(",");
-    BUFFER_ADD("%" PRIu64, vl->values[ds_idx].absolute);
+    BUFFER_ADD(snprintf, "[[");
+    BUFFER_ADD(format_uint64, CDTIME_T_TO_MS(vl->time));
+    BUFFER_ADD(snprintf, ",");
+    BUFFER_ADD(format_uint64, vl->values[ds_idx].absolute);
   } else {
     ERROR("format_kairosdb: Unknown data source type: %i", ds->ds[ds_idx].type);
     sfree(rates);
     return -1;
   }
-  BUFFER_ADD("]]");
+  BUFFER_ADD(snprintf, "]]");
 
 #undef BUFFER_ADD
 
@@ -42,6 +42,7 @@ struct sd_output_s {
   yajl_gen gen;
   c_avl_tree_t *staged;
   c_avl_tree_t *metric_descriptors;
+  size_t max_size;
 };
 
 struct sd_label_s {
@@ -486,6 +487,7 @@ sd_output_t *sd_output_create(sd_resource_t *res) /* {{{ */
     return NULL;
 
   out->res = res;
+  out->max_size = SD_OUTPUT_DEFAULT_MAX_SIZE;
 
   out->gen = yajl_gen_alloc(/* funcs = */ NULL);
   if (out->gen == NULL) {
@@ -587,7 +589,7 @@ int sd_output_add(sd_output_t *out, data_set_t const *ds,
 
   size_t json_buffer_size = 0;
   yajl_gen_get_buf(out->gen, &(unsigned char const *){NULL}, &json_buffer_size);
-  if (json_buffer_size > 65535)
+  if (json_buffer_size > out->max_size)
     return ENOBUFS;
 
   return 0;
@@ -611,6 +613,26 @@ int sd_output_register_metric(sd_output_t *out, data_set_t const *ds,
   return 0;
 } /* }}} int sd_output_register_metric */
 
+int sd_output_unregister_metric(sd_output_t *out, data_set_t const *ds,
+                                value_list_t const *vl) {
+  /* {{{ */
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char buffer[4 * DATA_MAX_NAME_LEN];
+    metric_type(buffer, sizeof(buffer), ds, vl, i);
+
+    char *key = NULL;
+    if (c_avl_remove(out->metric_descriptors, buffer, (void *)&key, NULL) == 0)
+      sfree(key);
+  }
+
+  return 0;
+} /* }}} int sd_output_unregister_metric */
+
+void sd_output_set_max_size(sd_output_t *out, size_t max_size) /* {{{ */
+{
+  out->max_size = max_size;
+} /* }}} void sd_output_set_max_size */
+
 char *sd_output_reset(sd_output_t *out) /* {{{ */
 {
   sd_output_finalize(out);
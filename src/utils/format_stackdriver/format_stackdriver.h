@@ -35,6 +35,8 @@ typedef struct sd_output_s sd_output_t;
 struct sd_resource_s;
 typedef struct sd_resource_s sd_resource_t;
 
+#define SD_OUTPUT_DEFAULT_MAX_SIZE 65535
+
 sd_output_t *sd_output_create(sd_resource_t *res);
 
 /* sd_output_destroy frees all memory used by out, including the
@@ -45,7 +47,8 @@ void sd_output_destroy(sd_output_t *out);
  *
  * Return values:
  *   - 0        Success
- *   - ENOBUFS  Success, but the buffer should be flushed soon.
+ *   - ENOBUFS  Success, but the buffer should be flushed soon, i.e. it is
+ *              larger than the size set with sd_output_set_max_size.
  *   - EEXIST   The value list is already encoded in the buffer.
  *              Flush the buffer, then call sd_output_add again.
  *   - ENOENT   First time we encounter this metric. Create a metric descriptor
@@ -60,6 +63,16 @@ int sd_output_add(sd_output_t *out, data_set_t const *ds,
 int sd_output_register_metric(sd_output_t *out, data_set_t const *ds,
                               value_list_t const *vl);
 
+/* sd_output_unregister_metric removes the metric descriptors which vl maps to
+ * from the list of known metric descriptors, e.g. because creating them failed.
+ * The next sd_output_add for this metric returns ENOENT again. */
+int sd_output_unregister_metric(sd_output_t *out, data_set_t const *ds,
+                                value_list_t const *vl);
+
+/* sd_output_set_max_size sets the buffer size in bytes above which
+ * sd_output_add returns ENOBUFS. Defaults to SD_OUTPUT_DEFAULT_MAX_SIZE. */
+void sd_output_set_max_size(sd_output_t *out, size_t max_size);
+
 /* sd_output_reset resets the output and returns the previous content of the
  * buffer. It is the caller's responsibility to call free() with the returned
  * pointer. */
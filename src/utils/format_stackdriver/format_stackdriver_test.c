@@ -22,6 +22,8 @@
 
 #include "collectd.h"
 
+#include "utils/common/common.h"
+
 #include "testing.h"
 #include "utils/format_stackdriver/format_stackdriver.h"
 
@@ -75,8 +77,52 @@ DEF_TEST(sd_format_metric_descriptor) {
   return 0;
 }
 
+DEF_TEST(sd_output_register_metric) {
+  value_list_t vl = {
+      .values = &(value_t){.gauge = 42},
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1542046800),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "unit-test",
+      .type = "example",
+  };
+  data_set_t ds = {
+      .type = "example",
+      .ds_num = 1,
+      .ds =
+          &(data_source_t){
+              .name = "value",
+              .type = DS_TYPE_GAUGE,
+              .min = NAN,
+              .max = NAN,
+          },
+  };
+
+  sd_output_t *out;
+  CHECK_NOT_NULL(out = sd_output_create(sd_resource_create("global")));
+
+  EXPECT_EQ_INT(ENOENT, sd_output_add(out, &ds, &vl));
+  EXPECT_EQ_INT(0, sd_output_register_metric(out, &ds, &vl));
+  EXPECT_EQ_INT(0, sd_output_add(out, &ds, &vl));
+  EXPECT_EQ_INT(EEXIST, sd_output_add(out, &ds, &vl));
+
+  EXPECT_EQ_INT(0, sd_output_unregister_metric(out, &ds, &vl));
+  sstrncpy(vl.type_instance, "other", sizeof(vl.type_instance));
+  EXPECT_EQ_INT(ENOENT, sd_output_add(out, &ds, &vl));
+
+  EXPECT_EQ_INT(0, sd_output_register_metric(out, &ds, &vl));
+  sd_output_set_max_size(out, 1);
+  EXPECT_EQ_INT(ENOBUFS, sd_output_add(out, &ds, &vl));
+
+  free(sd_output_reset(out));
+  sd_output_destroy(out);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(sd_format_metric_descriptor);
+  RUN_TEST(sd_output_register_metric);
 
   END_TEST;
 }
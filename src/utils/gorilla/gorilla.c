@@ -0,0 +1,387 @@
+/**
+ * collectd - src/utils/gorilla/gorilla.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/gorilla/gorilla.h"
+
+/* Number of steps per chunk. Old values are discarded a chunk at a time, so
+ * this is a trade-off between the number of surplus steps kept and the
+ * per-chunk overhead. */
+#define GORILLA_CHUNK_STEPS 32
+
+/* The XOR-encoded values of one data source within a chunk. */
+typedef struct {
+  uint8_t *data;
+  /* Bytes allocated for `data'. */
+  size_t data_size;
+  /* Bits used in `data'. */
+  size_t bits;
+
+  /* Encoder state: the previous value and the number of leading and trailing
+   * zero bits of the last block written. */
+  uint64_t prev;
+  int leading;
+  int trailing;
+} gorilla_stream_t;
+
+typedef struct gorilla_chunk_s {
+  /* The next newer chunk. */
+  struct gorilla_chunk_s *next;
+  size_t steps;
+  gorilla_stream_t streams[];
+} gorilla_chunk_t;
+
+struct c_gorilla_history_s {
+  size_t values_num;
+  size_t length;
+  /* Total number of steps in all chunks. */
+  size_t steps;
+
+  gorilla_chunk_t *oldest;
+  gorilla_chunk_t *newest;
+};
+
+/* Decoder state of one stream. */
+typedef struct {
+  gorilla_stream_t const *stream;
+  size_t pos;
+  uint64_t prev;
+  int leading;
+  int trailing;
+} gorilla_reader_t;
+
+static int count_leading_zeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  for (uint64_t mask = UINT64_C(1) << 63; (x & mask) == 0; mask >>= 1)
+    n++;
+  return n;
+#endif
+} /* int count_leading_zeros */
+
+static int count_trailing_zeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  for (uint64_t mask = 1; (x & mask) == 0; mask <<= 1)
+    n++;
+  return n;
+#endif
+} /* int count_trailing_zeros */
+
+/* The most bits a single value may take: "11", five bits for the leading
+ * zeros, six bits for the length and up to 64 meaningful bits. */
+#define GORILLA_VALUE_BITS_MAX (2 + 5 + 6 + 64)
+
+/* Makes sure that `bits_num' more bits can be written to the stream. */
+static int stream_reserve(gorilla_stream_t *s, size_t bits_num) /* {{{ */
+{
+  size_t need = (s->bits + bits_num + 7) / 8;
+  if (need > s->data_size) {
+    size_t size = (s->data_size > 0) ? 2 * s->data_size : 16;
+    while (size < need)
+      size *= 2;
+
+    uint8_t *tmp = realloc(s->data, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    memset(tmp + s->data_size, 0, size - s->data_size);
+    s->data = tmp;
+    s->data_size = size;
+  }
+
+  return 0;
+} /* }}} int stream_reserve */
+
+/* Appends the `bits_num' least significant bits of `value', most significant
+ * bit first. Space must have been reserved with stream_reserve(). */
+static void stream_write(gorilla_stream_t *s, uint64_t value, int bits_num) {
+  while (bits_num > 0) {
+    int free_bits = 8 - (int)(s->bits % 8);
+    int n = (bits_num < free_bits) ? bits_num : free_bits;
+    uint8_t part = (uint8_t)((value >> (bits_num - n)) & ((1u << n) - 1));
+
+    s->data[s->bits / 8] |= (uint8_t)(part << (free_bits - n));
+    s->bits += (size_t)n;
+    bits_num -= n;
+  }
+} /* void stream_write */
+
+static uint64_t reader_read(gorilla_reader_t *r, int bits_num) /* {{{ */
+{
+  uint64_t value = 0;
+
+  while (bits_num > 0) {
+    int avail_bits = 8 - (int)(r->pos % 8);
+    int n = (bits_num < avail_bits) ? bits_num : avail_bits;
+    uint8_t byte = r->stream->data[r->pos / 8];
+
+    value = (value << n) | ((byte >> (avail_bits - n)) & ((1u << n) - 1));
+    r->pos += (size_t)n;
+    bits_num -= n;
+  }
+
+  return value;
+} /* }}} uint64_t reader_read */
+
+/* Writes `value' to the stream. `first' is true for the first value of the
+ * stream, which is stored verbatim. Space for GORILLA_VALUE_BITS_MAX bits must
+ * have been reserved. */
+static void stream_append(gorilla_stream_t *s, double value, /* {{{ */
+                          bool first) {
+  uint64_t v;
+  memcpy(&v, &value, sizeof(v));
+
+  if (first) {
+    stream_write(s, v, 64);
+    s->prev = v;
+    s->leading = -1;
+    return;
+  }
+
+  uint64_t x = v ^ s->prev;
+  s->prev = v;
+  if (x == 0) {
+    stream_write(s, 0, 1);
+    return;
+  }
+
+  /* Five bits are used to store the number of leading zeros. */
+  int leading = count_leading_zeros(x);
+  if (leading > 31)
+    leading = 31;
+  int trailing = count_trailing_zeros(x);
+
+  if ((s->leading >= 0) && (leading >= s->leading) &&
+      (trailing >= s->trailing)) {
+    /* The meaningful bits fit into the previous block: "10" */
+    stream_write(s, 2, 2);
+    stream_write(s, x >> s->trailing, 64 - s->leading - s->trailing);
+    return;
+  }
+
+  /* "11", then the position and length of the new block. A length of 64 is
+   * stored as zero. */
+  int length = 64 - leading - trailing;
+  stream_write(s, 3, 2);
+  stream_write(s, (uint64_t)leading, 5);
+  stream_write(s, (uint64_t)(length & 63), 6);
+  stream_write(s, x >> trailing, length);
+  s->leading = leading;
+  s->trailing = trailing;
+} /* }}} void stream_append */
+
+static double reader_next(gorilla_reader_t *r, bool first) /* {{{ */
+{
+  if (first) {
+    r->prev = reader_read(r, 64);
+  } else if (reader_read(r, 1) != 0) {
+    if (reader_read(r, 1) != 0) {
+      r->leading = (int)reader_read(r, 5);
+      int length = (int)reader_read(r, 6);
+      if (length == 0)
+        length = 64;
+      r->trailing = 64 - r->leading - length;
+    }
+    int length = 64 - r->leading - r->trailing;
+    r->prev ^= reader_read(r, length) << r->trailing;
+  }
+
+  double value;
+  memcpy(&value, &r->prev, sizeof(value));
+  return value;
+} /* }}} double reader_next */
+
+static void chunk_destroy(gorilla_chunk_t *c, size_t values_num) {
+  if (c == NULL)
+    return;
+
+  for (size_t i = 0; i < values_num; i++)
+    free(c->streams[i].data);
+  free(c);
+} /* void chunk_destroy */
+
+/* Gives back the memory not used by a chunk that won't grow any more. */
+static void chunk_shrink(gorilla_chunk_t *c, size_t values_num) {
+  for (size_t i = 0; i < values_num; i++) {
+    gorilla_stream_t *s = c->streams + i;
+    size_t size = (s->bits + 7) / 8;
+    if ((size == 0) || (size == s->data_size))
+      continue;
+
+    uint8_t *tmp = realloc(s->data, size);
+    if (tmp == NULL)
+      continue;
+    s->data = tmp;
+    s->data_size = size;
+  }
+} /* void chunk_shrink */
+
+c_gorilla_history_t *c_gorilla_history_create(size_t values_num, /* {{{ */
+                                              size_t length) {
+  if (values_num == 0)
+    return NULL;
+
+  c_gorilla_history_t *h = calloc(1, sizeof(*h));
+  if (h == NULL)
+    return NULL;
+
+  h->values_num = values_num;
+  h->length = length;
+  return h;
+} /* }}} c_gorilla_history_t *c_gorilla_history_create */
+
+void c_gorilla_history_destroy(c_gorilla_history_t *h) /* {{{ */
+{
+  if (h == NULL)
+    return;
+
+  while (h->oldest != NULL) {
+    gorilla_chunk_t *next = h->oldest->next;
+    chunk_destroy(h->oldest, h->values_num);
+    h->oldest = next;
+  }
+  free(h);
+} /* }}} void c_gorilla_history_destroy */
+
+void c_gorilla_history_set_length(c_gorilla_history_t *h, size_t length) {
+  if (h != NULL)
+    h->length = length;
+} /* void c_gorilla_history_set_length */
+
+size_t c_gorilla_history_length(c_gorilla_history_t const *h) {
+  return (h != NULL) ? h->length : 0;
+} /* size_t c_gorilla_history_length */
+
+int c_gorilla_history_append(c_gorilla_history_t *h, /* {{{ */
+                             double const *values) {
+  if ((h == NULL) || (values == NULL))
+    return EINVAL;
+
+  if ((h->newest == NULL) || (h->newest->steps >= GORILLA_CHUNK_STEPS)) {
+    gorilla_chunk_t *c =
+        calloc(1, sizeof(*c) + h->values_num * sizeof(c->streams[0]));
+    if (c == NULL)
+      return ENOMEM;
+
+    if (h->newest != NULL) {
+      chunk_shrink(h->newest, h->values_num);
+      h->newest->next = c;
+    } else {
+      h->oldest = c;
+    }
+    h->newest = c;
+  }
+
+  /* Reserve space in all streams first, so they stay in step. */
+  gorilla_chunk_t *c = h->newest;
+  for (size_t i = 0; i < h->values_num; i++) {
+    if (stream_reserve(c->streams + i, GORILLA_VALUE_BITS_MAX) != 0)
+      return ENOMEM;
+  }
+  for (size_t i = 0; i < h->values_num; i++)
+    stream_append(c->streams + i, values[i], c->steps == 0);
+  c->steps++;
+  h->steps++;
+
+  /* Discard chunks that are no longer needed. */
+  while ((h->oldest != h->newest) &&
+         (h->steps - h->oldest->steps >= h->length)) {
+    gorilla_chunk_t *old = h->oldest;
+    h->oldest = old->next;
+    h->steps -= old->steps;
+    chunk_destroy(old, h->values_num);
+  }
+
+  return 0;
+} /* }}} int c_gorilla_history_append */
+
+int c_gorilla_history_get(c_gorilla_history_t const *h, /* {{{ */
+                          double *ret_values, size_t steps_num) {
+  if ((h == NULL) || (ret_values == NULL))
+    return EINVAL;
+
+  size_t values_num = h->values_num;
+  for (size_t i = 0; i < steps_num * values_num; i++)
+    ret_values[i] = NAN;
+
+  size_t wanted = (steps_num < h->steps) ? steps_num : h->steps;
+  if (wanted == 0)
+    return 0;
+
+  /* Skip chunks holding only steps older than the ones requested. */
+  gorilla_chunk_t const *c = h->oldest;
+  size_t remaining = h->steps;
+  while (remaining - c->steps >= wanted) {
+    remaining -= c->steps;
+    c = c->next;
+  }
+
+  gorilla_reader_t *readers = calloc(values_num, sizeof(*readers));
+  if (readers == NULL)
+    return ENOMEM;
+
+  /* `remaining' is the number of steps from the start of `c' up to and
+   * including the most recent one. The step `remaining - 1' steps back is
+   * stored first. */
+  for (; c != NULL; c = c->next) {
+    for (size_t i = 0; i < values_num; i++)
+      readers[i] = (gorilla_reader_t){.stream = c->streams + i};
+
+    for (size_t step = 0; step < c->steps; step++) {
+      size_t age = remaining - 1 - step;
+      for (size_t i = 0; i < values_num; i++) {
+        double value = reader_next(readers + i, step == 0);
+        if (age < wanted)
+          ret_values[age * values_num + i] = value;
+      }
+    }
+    remaining -= c->steps;
+  }
+
+  free(readers);
+  return 0;
+} /* }}} int c_gorilla_history_get */
+
+size_t c_gorilla_history_memory(c_gorilla_history_t const *h) /* {{{ */
+{
+  if (h == NULL)
+    return 0;
+
+  size_t memory = sizeof(*h);
+  for (gorilla_chunk_t const *c = h->oldest; c != NULL; c = c->next) {
+    memory += sizeof(*c) + h->values_num * sizeof(c->streams[0]);
+    for (size_t i = 0; i < h->values_num; i++)
+      memory += c->streams[i].data_size;
+  }
+  return memory;
+} /* }}} size_t c_gorilla_history_memory */
@@ -0,0 +1,120 @@
+/**
+ * collectd - src/utils/gorilla/gorilla.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_GORILLA_H
+#define UTILS_GORILLA_H 1
+
+#include <stddef.h>
+
+/*
+ * A history of the last values of one or more data sources, compressed with
+ * the XOR encoding described in "Gorilla: A Fast, Scalable, In-Memory Time
+ * Series Database" (Pelkonen et al., 2015). Consecutive values that are equal
+ * take a single bit, values that differ only in a few bits take a few more.
+ * Timestamps are not stored.
+ *
+ * Values are stored in chunks of a fixed number of steps, so old values can
+ * be discarded a chunk at a time. Like the other containers, the history does
+ * not do any locking.
+ */
+struct c_gorilla_history_s;
+typedef struct c_gorilla_history_s c_gorilla_history_t;
+
+/*
+ * NAME
+ *   c_gorilla_history_create
+ *
+ * DESCRIPTION
+ *   Allocates a history of `values_num' data sources that keeps at least the
+ *   last `length' steps.
+ *
+ * RETURN VALUE
+ *   A new, empty history or NULL upon failure.
+ */
+c_gorilla_history_t *c_gorilla_history_create(size_t values_num,
+                                              size_t length);
+
+/*
+ * NAME
+ *   c_gorilla_history_destroy
+ */
+void c_gorilla_history_destroy(c_gorilla_history_t *h);
+
+/*
+ * NAME
+ *   c_gorilla_history_set_length
+ *
+ * DESCRIPTION
+ *   Changes the number of steps kept. Shortening the history discards old
+ *   values when the next value is appended.
+ */
+void c_gorilla_history_set_length(c_gorilla_history_t *h, size_t length);
+
+/*
+ * NAME
+ *   c_gorilla_history_length
+ *
+ * RETURN VALUE
+ *   The number of steps kept, as set by c_gorilla_history_create() or
+ *   c_gorilla_history_set_length().
+ */
+size_t c_gorilla_history_length(c_gorilla_history_t const *h);
+
+/*
+ * NAME
+ *   c_gorilla_history_append
+ *
+ * DESCRIPTION
+ *   Appends one step, i.e. one value for each data source.
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOMEM if memory is exhausted, in which case the
+ *   step is lost.
+ */
+int c_gorilla_history_append(c_gorilla_history_t *h, double const *values);
+
+/*
+ * NAME
+ *   c_gorilla_history_get
+ *
+ * DESCRIPTION
+ *   Decompresses the last `steps_num' steps into `ret_values', which must
+ *   hold `steps_num * values_num' values. The most recent step is stored
+ *   first. Steps that are not available are filled with NAN.
+ *
+ * RETURN VALUE
+ *   Zero upon success or ENOMEM if memory is exhausted.
+ */
+int c_gorilla_history_get(c_gorilla_history_t const *h, double *ret_values,
+                          size_t steps_num);
+
+/*
+ * NAME
+ *   c_gorilla_history_memory
+ *
+ * RETURN VALUE
+ *   The number of bytes allocated for the history.
+ */
+size_t c_gorilla_history_memory(c_gorilla_history_t const *h);
+
+#endif /* UTILS_GORILLA_H */
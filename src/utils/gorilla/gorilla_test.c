@@ -0,0 +1,141 @@
+/**
+ * collectd - src/utils/gorilla/gorilla_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/gorilla/gorilla.h"
+
+#define STEPS_NUM 200
+
+static double value_at(size_t step, size_t ds) {
+  switch (ds) {
+  case 0: /* constant */
+    return 42.0;
+  case 1: /* slowly growing counter rate */
+    return 1000.0 + (double)(step / 3);
+  case 2: /* noisy */
+    return (double)((step * 2654435761u) % 1000) / 7.0;
+  default: /* special values */
+    return (step % 5 == 0) ? NAN : -(double)step * 1e300;
+  }
+}
+
+static int check_history(c_gorilla_history_t *h, size_t appended,
+                         size_t steps_num, size_t values_num) {
+  double *values = calloc(steps_num * values_num, sizeof(*values));
+  CHECK_NOT_NULL(values);
+  CHECK_ZERO(c_gorilla_history_get(h, values, steps_num));
+
+  for (size_t i = 0; i < steps_num; i++) {
+    for (size_t ds = 0; ds < values_num; ds++) {
+      double got = values[i * values_num + ds];
+      if (i >= appended) {
+        OK(isnan(got));
+        continue;
+      }
+      double want = value_at(appended - 1 - i, ds);
+      if (isnan(want))
+        OK(isnan(got));
+      else
+        EXPECT_EQ_DOUBLE(want, got);
+    }
+  }
+
+  free(values);
+  return 0;
+}
+
+DEF_TEST(roundtrip) {
+  c_gorilla_history_t *h;
+  CHECK_NOT_NULL(h = c_gorilla_history_create(4, STEPS_NUM));
+
+  /* Not enough data yet: the missing steps are NAN. */
+  CHECK_ZERO(check_history(h, 0, 3, 4));
+
+  double values[4];
+  for (size_t step = 0; step < STEPS_NUM; step++) {
+    for (size_t ds = 0; ds < 4; ds++)
+      values[ds] = value_at(step, ds);
+    CHECK_ZERO(c_gorilla_history_append(h, values));
+
+    if ((step == 0) || (step == 31) || (step == 32) || (step == 100))
+      CHECK_ZERO(check_history(h, step + 1, STEPS_NUM, 4));
+  }
+  CHECK_ZERO(check_history(h, STEPS_NUM, STEPS_NUM, 4));
+  CHECK_ZERO(check_history(h, STEPS_NUM, 10, 4));
+
+  c_gorilla_history_destroy(h);
+  return 0;
+}
+
+DEF_TEST(length) {
+  c_gorilla_history_t *h;
+  CHECK_NOT_NULL(h = c_gorilla_history_create(3, 10));
+  EXPECT_EQ_INT(10, (int)c_gorilla_history_length(h));
+
+  for (size_t step = 0; step < 1000; step++) {
+    double values[3];
+    for (size_t ds = 0; ds < 3; ds++)
+      values[ds] = value_at(step, ds);
+    CHECK_ZERO(c_gorilla_history_append(h, values));
+  }
+
+  /* The last ten steps are available, older ones are discarded. */
+  CHECK_ZERO(check_history(h, 1000, 10, 3));
+  OK(c_gorilla_history_memory(h) < 1000 * sizeof(double));
+
+  /* Growing the history does not bring back discarded values. */
+  c_gorilla_history_set_length(h, 100);
+  double values[3 * 100];
+  CHECK_ZERO(c_gorilla_history_get(h, values, 100));
+  OK(isnan(values[3 * 99]));
+
+  c_gorilla_history_destroy(h);
+  return 0;
+}
+
+DEF_TEST(compression) {
+  c_gorilla_history_t *h;
+  CHECK_NOT_NULL(h = c_gorilla_history_create(1, 64));
+
+  double value = 42.0;
+  for (size_t step = 0; step < 64; step++)
+    CHECK_ZERO(c_gorilla_history_append(h, &value));
+
+  /* A constant series takes one bit per step after the first. */
+  size_t raw = 64 * sizeof(double);
+  OK(c_gorilla_history_memory(h) < raw);
+
+  c_gorilla_history_destroy(h);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(roundtrip);
+  RUN_TEST(length);
+  RUN_TEST(compression);
+
+  END_TEST;
+}
@@ -0,0 +1,216 @@
+/**
+ * collectd - src/utils/hashtable/hashtable.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/hashtable/hashtable.h"
+
+/* Must be a power of two. */
+#define HASHTABLE_SIZE_MIN 16
+
+/* An empty slot has a NULL key. */
+struct hashtable_slot_s {
+  uint64_t hash;
+  char *key;
+  void *value;
+};
+typedef struct hashtable_slot_s hashtable_slot_t;
+
+struct c_hashtable_s {
+  hashtable_slot_t *slots;
+  /* Number of slots, a power of two. */
+  size_t size;
+  size_t num;
+};
+
+/* Returns the slot holding `key' or, if the key does not exist, the empty
+ * slot where it would be stored. Relies on the table never being full. */
+static hashtable_slot_t *hashtable_find(hashtable_slot_t *slots, /* {{{ */
+                                        size_t size, uint64_t hash,
+                                        const char *key) {
+  size_t mask = size - 1;
+
+  for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+    hashtable_slot_t *s = slots + i;
+    if (s->key == NULL)
+      return s;
+    if ((s->hash == hash) && (strcmp(s->key, key) == 0))
+      return s;
+  }
+} /* }}} hashtable_slot_t *hashtable_find */
+
+static int hashtable_resize(c_hashtable_t *t, size_t size) /* {{{ */
+{
+  hashtable_slot_t *slots = calloc(size, sizeof(*slots));
+  if (slots == NULL)
+    return -1;
+
+  for (size_t i = 0; i < t->size; i++) {
+    hashtable_slot_t *s = t->slots + i;
+    if (s->key == NULL)
+      continue;
+    *hashtable_find(slots, size, s->hash, s->key) = *s;
+  }
+
+  free(t->slots);
+  t->slots = slots;
+  t->size = size;
+  return 0;
+} /* }}} int hashtable_resize */
+
+c_hashtable_t *c_hashtable_create(void) /* {{{ */
+{
+  c_hashtable_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->slots = calloc(HASHTABLE_SIZE_MIN, sizeof(*t->slots));
+  if (t->slots == NULL) {
+    free(t);
+    return NULL;
+  }
+  t->size = HASHTABLE_SIZE_MIN;
+
+  return t;
+} /* }}} c_hashtable_t *c_hashtable_create */
+
+void c_hashtable_destroy(c_hashtable_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  free(t->slots);
+  free(t);
+} /* }}} void c_hashtable_destroy */
+
+int c_hashtable_insert(c_hashtable_t *t, uint64_t hash, /* {{{ */
+                       const char *key, void *value) {
+  if ((t == NULL) || (key == NULL))
+    return -1;
+
+  /* Keep the load factor at or below 3/4, so probe sequences stay short. */
+  if (4 * (t->num + 1) > 3 * t->size) {
+    if (hashtable_resize(t, 2 * t->size) != 0)
+      return -1;
+  }
+
+  hashtable_slot_t *s = hashtable_find(t->slots, t->size, hash, key);
+  if (s->key != NULL)
+    return 1;
+
+  *s = (hashtable_slot_t){
+      .hash = hash,
+      .key = (char *)key,
+      .value = value,
+  };
+  t->num++;
+  return 0;
+} /* }}} int c_hashtable_insert */
+
+int c_hashtable_get(c_hashtable_t *t, uint64_t hash, /* {{{ */
+                    const char *key, void **value) {
+  if ((t == NULL) || (key == NULL))
+    return -1;
+
+  hashtable_slot_t *s = hashtable_find(t->slots, t->size, hash, key);
+  if (s->key == NULL)
+    return -1;
+
+  if (value != NULL)
+    *value = s->value;
+  return 0;
+} /* }}} int c_hashtable_get */
+
+int c_hashtable_remove(c_hashtable_t *t, uint64_t hash, /* {{{ */
+                       const char *key, char **rkey, void **rvalue) {
+  if ((t == NULL) || (key == NULL))
+    return -1;
+
+  hashtable_slot_t *s = hashtable_find(t->slots, t->size, hash, key);
+  if (s->key == NULL)
+    return -1;
+
+  if (rkey != NULL)
+    *rkey = s->key;
+  if (rvalue != NULL)
+    *rvalue = s->value;
+
+  /* Backward shift deletion: move following entries of the probe sequence
+   * into the gap, so lookups don't need tombstones. */
+  size_t mask = t->size - 1;
+  size_t gap = (size_t)(s - t->slots);
+  for (size_t i = (gap + 1) & mask; t->slots[i].key != NULL;
+       i = (i + 1) & mask) {
+    size_t home = (size_t)t->slots[i].hash & mask;
+    /* The entry at `i' may only move to `gap' if `gap' lies between its home
+     * slot and `i', cyclically. */
+    if (((i - home) & mask) >= ((i - gap) & mask)) {
+      t->slots[gap] = t->slots[i];
+      gap = i;
+    }
+  }
+  t->slots[gap] = (hashtable_slot_t){.key = NULL};
+  t->num--;
+
+  return 0;
+} /* }}} int c_hashtable_remove */
+
+void c_hashtable_prefetch(c_hashtable_t *t, uint64_t hash) /* {{{ */
+{
+#if defined(__GNUC__)
+  if (t != NULL)
+    __builtin_prefetch(t->slots + ((size_t)hash & (t->size - 1)));
+#else
+  (void)t;
+  (void)hash;
+#endif
+} /* }}} void c_hashtable_prefetch */
+
+size_t c_hashtable_size(c_hashtable_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return 0;
+  return t->num;
+} /* }}} size_t c_hashtable_size */
+
+int c_hashtable_next(c_hashtable_t *t, size_t *pos, /* {{{ */
+                     char **key, void **value) {
+  if ((t == NULL) || (pos == NULL))
+    return -1;
+
+  while (*pos < t->size) {
+    hashtable_slot_t *s = t->slots + *pos;
+    (*pos)++;
+    if (s->key == NULL)
+      continue;
+
+    if (key != NULL)
+      *key = s->key;
+    if (value != NULL)
+      *value = s->value;
+    return 0;
+  }
+
+  return -1;
+} /* }}} int c_hashtable_next */
@@ -0,0 +1,132 @@
+/**
+ * collectd - src/utils/hashtable/hashtable.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_HASHTABLE_H
+#define UTILS_HASHTABLE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A hash table with string keys using open addressing. The caller computes
+ * the hash of each key, so a hash that is already known does not have to be
+ * computed again. Like the AVL tree, the table does not do any locking.
+ */
+struct c_hashtable_s;
+typedef struct c_hashtable_s c_hashtable_t;
+
+/*
+ * NAME
+ *   c_hashtable_create
+ *
+ * RETURN VALUE
+ *   A new, empty table or NULL upon failure.
+ */
+c_hashtable_t *c_hashtable_create(void);
+
+/*
+ * NAME
+ *   c_hashtable_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates the table. Stored key- and value-pointers are not freed.
+ */
+void c_hashtable_destroy(c_hashtable_t *t);
+
+/*
+ * NAME
+ *   c_hashtable_insert
+ *
+ * DESCRIPTION
+ *   Stores the key-value-pair in the table. The key is _not_ copied, so the
+ *   memory pointed to may not be freed before the entry is removed.
+ *
+ * RETURN VALUE
+ *   Zero upon success, a positive value if the key already exists and a
+ *   negative value upon failure.
+ */
+int c_hashtable_insert(c_hashtable_t *t, uint64_t hash, const char *key,
+                       void *value);
+
+/*
+ * NAME
+ *   c_hashtable_get
+ *
+ * DESCRIPTION
+ *   Looks up `key' and stores its value in `value', unless `value' is NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key does not exist.
+ */
+int c_hashtable_get(c_hashtable_t *t, uint64_t hash, const char *key,
+                    void **value);
+
+/*
+ * NAME
+ *   c_hashtable_remove
+ *
+ * DESCRIPTION
+ *   Removes `key' from the table. The stored key- and value-pointers are
+ *   returned in `rkey' and `rvalue', unless they are NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key does not exist.
+ */
+int c_hashtable_remove(c_hashtable_t *t, uint64_t hash, const char *key,
+                       char **rkey, void **rvalue);
+
+/*
+ * NAME
+ *   c_hashtable_prefetch
+ *
+ * DESCRIPTION
+ *   Hints that `hash' will be looked up soon, so the memory where the lookup
+ *   starts can be loaded in the meantime. Does not modify the table.
+ */
+void c_hashtable_prefetch(c_hashtable_t *t, uint64_t hash);
+
+/*
+ * NAME
+ *   c_hashtable_size
+ *
+ * RETURN VALUE
+ *   The number of entries in the table.
+ */
+size_t c_hashtable_size(c_hashtable_t *t);
+
+/*
+ * NAME
+ *   c_hashtable_next
+ *
+ * DESCRIPTION
+ *   Iterates over all entries in no particular order. `pos' has to be set to
+ *   zero before the first call. The table must not be modified while
+ *   iterating.
+ *
+ * RETURN VALUE
+ *   Zero if the next entry has been stored in `key' and `value', or non-zero
+ *   if there are no more entries.
+ */
+int c_hashtable_next(c_hashtable_t *t, size_t *pos, char **key, void **value);
+
+#endif /* UTILS_HASHTABLE_H */
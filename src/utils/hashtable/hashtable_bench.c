@@ -0,0 +1,204 @@
+/**
+ * collectd - src/utils/hashtable/hashtable_bench.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Compares the two ways of organizing the value cache: one AVL tree guarded
+ * by a single mutex, as utils_cache.c used to do, and sharded hash tables with
+ * one mutex per shard. Each thread looks up and updates all keys in random
+ * order, like the write threads do for incoming values.
+ *
+ * Usage: bench_utils_hashtable [<keys> [<threads> [<rounds>]]]
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/avltree/avltree.h"
+#include "utils/hashtable/hashtable.h"
+
+#define SHARDS_NUM 64
+
+typedef struct {
+  char *name;
+  uint64_t hash;
+  uint64_t counter;
+} entry_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  c_hashtable_t *table;
+} shard_t;
+
+static entry_t *entries;
+static size_t entries_num;
+static size_t rounds_num;
+
+static c_avl_tree_t *tree;
+static pthread_mutex_t tree_lock = PTHREAD_MUTEX_INITIALIZER;
+static shard_t shards[SHARDS_NUM];
+
+static uint64_t fnv1a(char const *s) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *s != 0; s++) {
+    hash ^= (uint64_t)(unsigned char)*s;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Returns a random permutation of the entries, different for each thread. */
+static size_t *shuffled(unsigned int seed) {
+  size_t *order = calloc(entries_num, sizeof(*order));
+  if (order == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < entries_num; i++)
+    order[i] = i;
+  for (size_t i = entries_num - 1; i > 0; i--) {
+    size_t j = (size_t)rand_r(&seed) % (i + 1);
+    size_t tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  return order;
+}
+
+static void *avl_thread(void *arg) {
+  size_t *order = shuffled((unsigned int)(uintptr_t)arg);
+  if (order == NULL)
+    return NULL;
+
+  for (size_t r = 0; r < rounds_num; r++) {
+    for (size_t i = 0; i < entries_num; i++) {
+      entry_t *e = NULL;
+      pthread_mutex_lock(&tree_lock);
+      if (c_avl_get(tree, entries[order[i]].name, (void *)&e) == 0)
+        e->counter++;
+      pthread_mutex_unlock(&tree_lock);
+    }
+  }
+
+  free(order);
+  return NULL;
+}
+
+static void *hashtable_thread(void *arg) {
+  size_t *order = shuffled((unsigned int)(uintptr_t)arg);
+  if (order == NULL)
+    return NULL;
+
+  for (size_t r = 0; r < rounds_num; r++) {
+    for (size_t i = 0; i < entries_num; i++) {
+      entry_t const *key = entries + order[i];
+      shard_t *s = shards + (key->hash >> 58) % SHARDS_NUM;
+      entry_t *e = NULL;
+
+      pthread_mutex_lock(&s->lock);
+      if (c_hashtable_get(s->table, key->hash, key->name, (void *)&e) == 0)
+        e->counter++;
+      pthread_mutex_unlock(&s->lock);
+    }
+  }
+
+  free(order);
+  return NULL;
+}
+
+static double run(char const *name, void *(*func)(void *),
+                  size_t threads_num) {
+  pthread_t *threads = calloc(threads_num, sizeof(*threads));
+  if (threads == NULL)
+    return -1;
+
+  double start = now();
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_create(threads + i, NULL, func, (void *)(uintptr_t)(i + 1));
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_join(threads[i], NULL);
+  double elapsed = now() - start;
+
+  double ops = (double)(entries_num * rounds_num * threads_num);
+  printf("%-10s %8.3f s %12.0f updates/s\n", name, elapsed, ops / elapsed);
+
+  free(threads);
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  entries_num = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 0) : 1000000;
+  size_t threads_num = (argc > 2) ? (size_t)strtoull(argv[2], NULL, 0) : 4;
+  rounds_num = (argc > 3) ? (size_t)strtoull(argv[3], NULL, 0) : 3;
+  if ((entries_num == 0) || (threads_num == 0) || (rounds_num == 0)) {
+    fprintf(stderr, "Usage: %s [<keys> [<threads> [<rounds>]]]\n", argv[0]);
+    return 1;
+  }
+
+  entries = calloc(entries_num, sizeof(*entries));
+  tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((entries == NULL) || (tree == NULL)) {
+    fprintf(stderr, "Out of memory.\n");
+    return 1;
+  }
+  for (size_t i = 0; i < SHARDS_NUM; i++) {
+    pthread_mutex_init(&shards[i].lock, NULL);
+    shards[i].table = c_hashtable_create();
+  }
+
+  /* Names look like the cache's keys: host/plugin-instance/type-instance */
+  for (size_t i = 0; i < entries_num; i++) {
+    char name[128];
+    snprintf(name, sizeof(name), "host%03zu.example.com/cpu-%zu/cpu-%zu",
+             i % 1000, (i / 1000) % 64, i / 64000);
+    entries[i].name = strdup(name);
+    entries[i].hash = fnv1a(name);
+
+    shard_t *s = shards + (entries[i].hash >> 58) % SHARDS_NUM;
+    if ((entries[i].name == NULL) ||
+        (c_avl_insert(tree, entries[i].name, entries + i) != 0) ||
+        (c_hashtable_insert(s->table, entries[i].hash, entries[i].name,
+                            entries + i) != 0)) {
+      fprintf(stderr, "Inserting %s failed.\n", name);
+      return 1;
+    }
+  }
+
+  printf("%zu keys, %zu threads, %zu rounds\n", entries_num, threads_num,
+         rounds_num);
+  double avl = run("avl", avl_thread, threads_num);
+  double hash = run("hashtable", hashtable_thread, threads_num);
+  if ((avl > 0) && (hash > 0))
+    printf("speedup    %8.2fx\n", avl / hash);
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * collectd - src/utils/hashtable/hashtable_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
+
+#define KEYS_NUM 1000
+
+/* A deliberately bad hash, so that probe sequences collide and wrap. */
+static uint64_t bad_hash(int i) { return (uint64_t)(i % 7) * 3; }
+
+DEF_TEST(simple) {
+  c_hashtable_t *t;
+  CHECK_NOT_NULL(t = c_hashtable_create());
+
+  char *keys[] = {"one", "two", "three"};
+  for (int i = 0; i < 3; i++)
+    CHECK_ZERO(c_hashtable_insert(t, (uint64_t)i, keys[i], keys[i]));
+  EXPECT_EQ_INT(3, (int)c_hashtable_size(t));
+
+  /* Duplicate keys are rejected. */
+  OK(c_hashtable_insert(t, 1, "two", NULL) > 0);
+
+  void *value = NULL;
+  CHECK_ZERO(c_hashtable_get(t, 2, "three", &value));
+  EXPECT_EQ_STR("three", value);
+  /* Same key, but a different hash. */
+  OK(c_hashtable_get(t, 3, "three", NULL) != 0);
+  OK(c_hashtable_get(t, 2, "four", NULL) != 0);
+
+  char *rkey = NULL;
+  CHECK_ZERO(c_hashtable_remove(t, 0, "one", &rkey, &value));
+  OK(rkey == keys[0]);
+  OK(value == keys[0]);
+  OK(c_hashtable_remove(t, 0, "one", NULL, NULL) != 0);
+  EXPECT_EQ_INT(2, (int)c_hashtable_size(t));
+
+  c_hashtable_destroy(t);
+  return 0;
+}
+
+DEF_TEST(collisions) {
+  c_hashtable_t *t;
+  CHECK_NOT_NULL(t = c_hashtable_create());
+
+  char **keys = calloc(KEYS_NUM, sizeof(*keys));
+  CHECK_NOT_NULL(keys);
+  for (int i = 0; i < KEYS_NUM; i++) {
+    char buffer[16];
+    ssnprintf(buffer, sizeof(buffer), "key%d", i);
+    CHECK_NOT_NULL(keys[i] = strdup(buffer));
+    CHECK_ZERO(c_hashtable_insert(t, bad_hash(i), keys[i], keys[i]));
+  }
+  EXPECT_EQ_INT(KEYS_NUM, (int)c_hashtable_size(t));
+
+  /* Removing every other key must not break the probe sequences of the
+   * remaining ones. */
+  for (int i = 0; i < KEYS_NUM; i += 2)
+    CHECK_ZERO(c_hashtable_remove(t, bad_hash(i), keys[i], NULL, NULL));
+  for (int i = 0; i < KEYS_NUM; i++) {
+    void *value = NULL;
+    int status = c_hashtable_get(t, bad_hash(i), keys[i], &value);
+    if (i % 2 == 0) {
+      OK(status != 0);
+    } else {
+      CHECK_ZERO(status);
+      OK(value == keys[i]);
+    }
+  }
+
+  size_t pos = 0;
+  int count = 0;
+  char *key;
+  void *value;
+  while (c_hashtable_next(t, &pos, &key, &value) == 0) {
+    OK(key == value);
+    count++;
+  }
+  EXPECT_EQ_INT(KEYS_NUM / 2, count);
+
+  c_hashtable_destroy(t);
+  for (int i = 0; i < KEYS_NUM; i++)
+    free(keys[i]);
+  free(keys);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(collisions);
+
+  END_TEST;
+}
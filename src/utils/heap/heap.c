@@ -24,6 +24,7 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+
 #include "collectd.h"
 
 #include <assert.h>
@@ -33,69 +34,132 @@
 
 #include "utils/heap/heap.h"
 
+/* Number of children per node. With four children, the heap is half as deep
+ * as a binary heap and all children of a node share one cache line. */
+#define HEAP_ARITY 4
+
 struct c_heap_s {
   pthread_mutex_t lock;
+  bool locked;
   int (*compare)(const void *, const void *);
 
+  /* Indexed heaps store the position of each element plus one at this offset
+   * into the element, see c_heap_create_indexed(). */
+  bool indexed;
+  size_t index_offset;
+
   void **list;
   size_t list_len;  /* # entries used */
   size_t list_size; /* # entries allocated */
 };
 
-enum reheap_direction { DIR_UP, DIR_DOWN };
+static void heap_lock(c_heap_t *h) {
+  if (h->locked)
+    pthread_mutex_lock(&h->lock);
+}
 
-static void reheap(c_heap_t *h, size_t root, enum reheap_direction dir) {
-  size_t left;
-  size_t right;
-  size_t min;
-  int status;
+static void heap_unlock(c_heap_t *h) {
+  if (h->locked)
+    pthread_mutex_unlock(&h->lock);
+}
+
+static size_t *heap_index(c_heap_t const *h, void *ptr) {
+  return (size_t *)((char *)ptr + h->index_offset);
+}
+
+static void heap_set(c_heap_t *h, size_t pos, void *ptr) {
+  h->list[pos] = ptr;
+  if (h->indexed)
+    *heap_index(h, ptr) = pos + 1;
+}
+
+/* Moves the element at `pos' towards the root until its parent is not
+ * bigger. Returns the new position. */
+static size_t sift_up(c_heap_t *h, size_t pos) {
+  void *ptr = h->list[pos];
+
+  while (pos > 0) {
+    size_t parent = (pos - 1) / HEAP_ARITY;
+    if (h->compare(h->list[parent], ptr) <= 0)
+      break;
+    heap_set(h, pos, h->list[parent]);
+    pos = parent;
+  }
 
-  /* Calculate the positions of the children */
-  left = (2 * root) + 1;
-  if (left >= h->list_len)
-    left = 0;
+  heap_set(h, pos, ptr);
+  return pos;
+} /* size_t sift_up */
+
+/* Moves the element at `pos' towards the leaves until none of its children is
+ * smaller. */
+static void sift_down(c_heap_t *h, size_t pos) {
+  void *ptr = h->list[pos];
+
+  while (42) {
+    size_t first = (HEAP_ARITY * pos) + 1;
+    if (first >= h->list_len)
+      break;
+
+    size_t last = first + HEAP_ARITY;
+    if (last > h->list_len)
+      last = h->list_len;
+
+    size_t min = first;
+    for (size_t i = first + 1; i < last; i++)
+      if (h->compare(h->list[i], h->list[min]) < 0)
+        min = i;
+
+    if (h->compare(ptr, h->list[min]) <= 0)
+      break;
+    heap_set(h, pos, h->list[min]);
+    pos = min;
+  }
 
-  right = (2 * root) + 2;
-  if (right >= h->list_len)
-    right = 0;
+  heap_set(h, pos, ptr);
+} /* void sift_down */
 
-  /* Check which one of the children is smaller. */
-  if ((left == 0) && (right == 0))
-    return;
-  else if (left == 0)
-    min = right;
-  else if (right == 0)
-    min = left;
-  else {
-    status = h->compare(h->list[left], h->list[right]);
-    if (status > 0)
-      min = right;
-    else
-      min = left;
+/* Restores the heap property after the element at `pos' has changed. */
+static void reheap(c_heap_t *h, size_t pos) {
+  if (sift_up(h, pos) == pos)
+    sift_down(h, pos);
+} /* void reheap */
+
+/* Removes the element at `pos'. Must not be called on an empty heap. */
+static void *heap_remove_at(c_heap_t *h, size_t pos) {
+  void *ret = h->list[pos];
+
+  h->list_len--;
+  if (pos < h->list_len) {
+    h->list[pos] = h->list[h->list_len];
+    reheap(h, pos);
   }
+  h->list[h->list_len] = NULL;
 
-  status = h->compare(h->list[root], h->list[min]);
-  if (status <= 0) {
-    /* We didn't need to change anything, so the rest of the tree should be
-     * okay now. */
-    return;
-  } else /* if (status > 0) */
-  {
-    void *tmp;
+  if (h->indexed)
+    *heap_index(h, ret) = 0;
+
+  /* free some memory */
+  if ((h->list_len + 32) < h->list_size) {
+    void **tmp;
 
-    tmp = h->list[root];
-    h->list[root] = h->list[min];
-    h->list[min] = tmp;
+    tmp = realloc(h->list, (h->list_len + 16) * sizeof(*h->list));
+    if (tmp != NULL) {
+      h->list = tmp;
+      h->list_size = h->list_len + 16;
+    }
   }
 
-  if ((dir == DIR_UP) && (root == 0))
-    return;
+  return ret;
+} /* void *heap_remove_at */
 
-  if (dir == DIR_UP)
-    reheap(h, (root - 1) / 2, dir);
-  else if (dir == DIR_DOWN)
-    reheap(h, min, dir);
-} /* void reheap */
+/* Returns the position of `ptr' in an indexed heap or -1 if it's not stored
+ * in the heap. */
+static ssize_t heap_find(c_heap_t *h, void *ptr) {
+  size_t index = *heap_index(h, ptr);
+  if ((index == 0) || (index > h->list_len) || (h->list[index - 1] != ptr))
+    return -1;
+  return (ssize_t)(index - 1);
+} /* ssize_t heap_find */
 
 c_heap_t *c_heap_create(int (*compare)(const void *, const void *)) {
   c_heap_t *h;
@@ -108,6 +172,7 @@ c_heap_t *c_heap_create(int (*compare)(const void *, const void *)) {
     return NULL;
 
   pthread_mutex_init(&h->lock, /* attr = */ NULL);
+  h->locked = true;
   h->compare = compare;
 
   h->list = NULL;
@@ -117,10 +182,27 @@ c_heap_t *c_heap_create(int (*compare)(const void *, const void *)) {
   return h;
 } /* c_heap_t *c_heap_create */
 
+c_heap_t *c_heap_create_indexed(int (*compare)(const void *, const void *),
+                                size_t index_offset) {
+  c_heap_t *h = c_heap_create(compare);
+  if (h == NULL)
+    return NULL;
+
+  h->locked = false;
+  h->indexed = true;
+  h->index_offset = index_offset;
+
+  return h;
+} /* c_heap_t *c_heap_create_indexed */
+
 void c_heap_destroy(c_heap_t *h) {
   if (h == NULL)
     return;
 
+  if (h->indexed)
+    for (size_t i = 0; i < h->list_len; i++)
+      *heap_index(h, h->list[i]) = 0;
+
   h->list_len = 0;
   h->list_size = 0;
   free(h->list);
@@ -132,12 +214,15 @@ void c_heap_destroy(c_heap_t *h) {
 } /* void c_heap_destroy */
 
 int c_heap_insert(c_heap_t *h, void *ptr) {
-  size_t index;
-
   if ((h == NULL) || (ptr == NULL))
     return -EINVAL;
 
-  pthread_mutex_lock(&h->lock);
+  heap_lock(h);
+
+  if (h->indexed && (heap_find(h, ptr) >= 0)) {
+    heap_unlock(h);
+    return EEXIST;
+  }
 
   assert(h->list_len <= h->list_size);
   if (h->list_len == h->list_size) {
@@ -145,7 +230,7 @@ int c_heap_insert(c_heap_t *h, void *ptr) {
 
     tmp = realloc(h->list, (h->list_size + 16) * sizeof(*h->list));
     if (tmp == NULL) {
-      pthread_mutex_unlock(&h->lock);
+      heap_unlock(h);
       return -ENOMEM;
     }
 
@@ -153,15 +238,12 @@ int c_heap_insert(c_heap_t *h, void *ptr) {
     h->list_size += 16;
   }
 
-  /* Insert the new node as a leaf. */
-  index = h->list_len;
-  h->list[index] = ptr;
+  /* Insert the new node as a leaf and reorganize the heap from bottom up. */
+  h->list[h->list_len] = ptr;
   h->list_len++;
+  sift_up(h, h->list_len - 1);
 
-  /* Reorganize the heap from bottom up. */
-  reheap(h, /* parent of this node = */ (index - 1) / 2, DIR_UP);
-
-  pthread_mutex_unlock(&h->lock);
+  heap_unlock(h);
   return 0;
 } /* int c_heap_insert */
 
@@ -171,37 +253,72 @@ void *c_heap_get_root(c_heap_t *h) {
   if (h == NULL)
     return NULL;
 
-  pthread_mutex_lock(&h->lock);
+  heap_lock(h);
+  if (h->list_len > 0)
+    ret = heap_remove_at(h, /* pos = */ 0);
+  heap_unlock(h);
 
-  if (h->list_len == 0) {
-    pthread_mutex_unlock(&h->lock);
+  return ret;
+} /* void *c_heap_get_root */
+
+void *c_heap_peek_root(c_heap_t *h) {
+  void *ret = NULL;
+
+  if (h == NULL)
     return NULL;
-  } else if (h->list_len == 1) {
-    ret = h->list[0];
-    h->list[0] = NULL;
-    h->list_len = 0;
-  } else /* if (h->list_len > 1) */
-  {
+
+  heap_lock(h);
+  if (h->list_len > 0)
     ret = h->list[0];
-    h->list[0] = h->list[h->list_len - 1];
-    h->list[h->list_len - 1] = NULL;
-    h->list_len--;
+  heap_unlock(h);
 
-    reheap(h, /* root = */ 0, DIR_DOWN);
-  }
+  return ret;
+} /* void *c_heap_peek_root */
 
-  /* free some memory */
-  if ((h->list_len + 32) < h->list_size) {
-    void **tmp;
+int c_heap_update(c_heap_t *h, void *ptr) {
+  if ((h == NULL) || (ptr == NULL) || !h->indexed)
+    return -EINVAL;
 
-    tmp = realloc(h->list, (h->list_len + 16) * sizeof(*h->list));
-    if (tmp != NULL) {
-      h->list = tmp;
-      h->list_size = h->list_len + 16;
-    }
-  }
+  heap_lock(h);
+  ssize_t pos = heap_find(h, ptr);
+  if (pos >= 0)
+    reheap(h, (size_t)pos);
+  heap_unlock(h);
+
+  return (pos >= 0) ? 0 : -ENOENT;
+} /* int c_heap_update */
+
+int c_heap_remove(c_heap_t *h, void *ptr) {
+  if ((h == NULL) || (ptr == NULL) || !h->indexed)
+    return -EINVAL;
+
+  heap_lock(h);
+  ssize_t pos = heap_find(h, ptr);
+  if (pos >= 0)
+    heap_remove_at(h, (size_t)pos);
+  heap_unlock(h);
 
-  pthread_mutex_unlock(&h->lock);
+  return (pos >= 0) ? 0 : -ENOENT;
+} /* int c_heap_remove */
+
+bool c_heap_contains(c_heap_t *h, void *ptr) {
+  if ((h == NULL) || (ptr == NULL) || !h->indexed)
+    return false;
+
+  heap_lock(h);
+  bool ret = (heap_find(h, ptr) >= 0);
+  heap_unlock(h);
 
   return ret;
-} /* void *c_heap_get_root */
+} /* bool c_heap_contains */
+
+size_t c_heap_size(c_heap_t *h) {
+  if (h == NULL)
+    return 0;
+
+  heap_lock(h);
+  size_t ret = h->list_len;
+  heap_unlock(h);
+
+  return ret;
+} /* size_t c_heap_size */
@@ -27,6 +27,14 @@
 #ifndef UTILS_HEAP_H
 #define UTILS_HEAP_H 1
 
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A 4-ary min-heap of pointers. Heaps created with c_heap_create() lock
+ * internally. Heaps created with c_heap_create_indexed() don't, and they can
+ * update and remove elements in O(log n).
+ */
 struct c_heap_s;
 typedef struct c_heap_s c_heap_t;
 
@@ -50,6 +58,31 @@ typedef struct c_heap_s c_heap_t;
  */
 c_heap_t *c_heap_create(int (*compare)(const void *, const void *));
 
+/*
+ * NAME
+ *   c_heap_create_indexed
+ *
+ * DESCRIPTION
+ *   Allocates a new indexed heap. Each element has a `size_t' member at offset
+ *   `index_offset' in which the heap keeps the element's position. The member
+ *   must be zero before the element is inserted for the first time; it is
+ *   zero again after the element has been removed. With the position known,
+ *   c_heap_update() and c_heap_remove() don't need to search.
+ *
+ *   Indexed heaps don't lock. The owner has to serialize all accesses, for
+ *   example by using the heap from one thread only.
+ *
+ * PARAMETERS
+ *   `compare'       See c_heap_create().
+ *   `index_offset'  Offset of the position member, as returned by
+ *                   `offsetof'.
+ *
+ * RETURN VALUE
+ *   A c_heap_t-pointer upon success or NULL upon failure.
+ */
+c_heap_t *c_heap_create_indexed(int (*compare)(const void *, const void *),
+                                size_t index_offset);
+
 /*
  * NAME
  *   c_heap_destroy
@@ -96,4 +129,61 @@ int c_heap_insert(c_heap_t *h, void *ptr);
  */
 void *c_heap_get_root(c_heap_t *h);
 
+/*
+ * NAME
+ *   c_heap_peek_root
+ *
+ * DESCRIPTION
+ *   Returns the value at the root of the heap without removing it.
+ *
+ * RETURN VALUE
+ *   The smallest element or NULL if the heap is empty.
+ */
+void *c_heap_peek_root(c_heap_t *h);
+
+/*
+ * NAME
+ *   c_heap_update
+ *
+ * DESCRIPTION
+ *   Restores the order of the heap after the key of `ptr' has changed. Only
+ *   available for indexed heaps.
+ *
+ * RETURN VALUE
+ *   Zero upon success, -ENOENT if `ptr' is not stored in the heap and -EINVAL
+ *   if the heap is not indexed.
+ */
+int c_heap_update(c_heap_t *h, void *ptr);
+
+/*
+ * NAME
+ *   c_heap_remove
+ *
+ * DESCRIPTION
+ *   Removes `ptr' from the heap. Only available for indexed heaps.
+ *
+ * RETURN VALUE
+ *   Zero upon success, -ENOENT if `ptr' is not stored in the heap and -EINVAL
+ *   if the heap is not indexed.
+ */
+int c_heap_remove(c_heap_t *h, void *ptr);
+
+/*
+ * NAME
+ *   c_heap_contains
+ *
+ * DESCRIPTION
+ *   Returns true if `ptr' is stored in the indexed heap `h'.
+ */
+bool c_heap_contains(c_heap_t *h, void *ptr);
+
+/*
+ * NAME
+ *   c_heap_size
+ *
+ * DESCRIPTION
+ *   Returns the number of elements stored in the heap.
+ */
+size_t c_heap_size(c_heap_t *h);
+
 #endif /* UTILS_HEAP_H */
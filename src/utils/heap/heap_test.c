@@ -27,6 +27,7 @@
 #include "collectd.h"
 
 #include "testing.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
 #include "utils/heap/heap.h"
 
 static int compare(void const *v0, void const *v1) {
@@ -71,8 +72,98 @@ DEF_TEST(simple) {
   return 0;
 }
 
+typedef struct {
+  int key;
+  size_t heap_index;
+} item_t;
+
+static int compare_item(void const *v0, void const *v1) {
+  item_t const *i0 = v0;
+  item_t const *i1 = v1;
+  return compare(&i0->key, &i1->key);
+}
+
+/* Pops all items and checks that they come out in order. */
+static int check_order(c_heap_t *h, size_t expected_num) {
+  item_t *prev = NULL;
+  item_t *ret;
+  size_t num = 0;
+
+  while ((ret = c_heap_get_root(h)) != NULL) {
+    EXPECT_EQ_UINT64(0, ret->heap_index);
+    if (prev != NULL)
+      OK(prev->key <= ret->key);
+    prev = ret;
+    num++;
+  }
+  EXPECT_EQ_UINT64(expected_num, num);
+
+  return 0;
+}
+
+DEF_TEST(indexed) {
+  item_t items[100] = {{0}};
+  unsigned int seed = 23;
+  c_heap_t *h;
+
+  CHECK_NOT_NULL(h = c_heap_create_indexed(compare_item,
+                                           offsetof(item_t, heap_index)));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(items); i++) {
+    items[i].key = rand_r(&seed) % 1000;
+    CHECK_ZERO(c_heap_insert(h, items + i));
+  }
+  EXPECT_EQ_UINT64(STATIC_ARRAY_SIZE(items), c_heap_size(h));
+  EXPECT_EQ_INT(EEXIST, c_heap_insert(h, items));
+
+  /* Move half of the items, in both directions. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(items); i += 2) {
+    items[i].key = rand_r(&seed) % 1000;
+    CHECK_ZERO(c_heap_update(h, items + i));
+  }
+
+  /* The smallest item is at the root. */
+  item_t *min = items;
+  for (size_t i = 1; i < STATIC_ARRAY_SIZE(items); i++)
+    if (items[i].key < min->key)
+      min = items + i;
+  item_t *root = c_heap_peek_root(h);
+  CHECK_NOT_NULL(root);
+  EXPECT_EQ_INT(min->key, root->key);
+
+  /* Remove every third item, including the root. */
+  size_t removed = 0;
+  root->key = -1;
+  CHECK_ZERO(c_heap_update(h, root));
+  EXPECT_EQ_PTR(root, c_heap_peek_root(h));
+  CHECK_ZERO(c_heap_remove(h, root));
+  removed++;
+  OK(!c_heap_contains(h, root));
+  EXPECT_EQ_INT(-ENOENT, c_heap_remove(h, root));
+  EXPECT_EQ_INT(-ENOENT, c_heap_update(h, root));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(items); i += 3) {
+    if (!c_heap_contains(h, items + i))
+      continue;
+    CHECK_ZERO(c_heap_remove(h, items + i));
+    removed++;
+  }
+  EXPECT_EQ_UINT64(STATIC_ARRAY_SIZE(items) - removed, c_heap_size(h));
+
+  CHECK_ZERO(check_order(h, STATIC_ARRAY_SIZE(items) - removed));
+
+  /* Items can be inserted again after they were removed. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(items); i++)
+    CHECK_ZERO(c_heap_insert(h, items + i));
+  CHECK_ZERO(check_order(h, STATIC_ARRAY_SIZE(items)));
+
+  c_heap_destroy(h);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(simple);
+  RUN_TEST(indexed);
 
   END_TEST;
 }
@@ -54,14 +54,20 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/ignorelist/ignorelist.h"
 
+/* Number of remembered results after which the memo is cleared. Names that
+ * are seen once, e.g. of short-lived interfaces, don't accumulate. */
+#define IGNORELIST_MEMO_MAX 65536
+
 /*
  * private prototypes
  */
 struct ignorelist_item_s {
 #if HAVE_REGEX_H
   regex_t *rmatch; /* regular expression entry identification */
+  char *rstr;      /* source of `rmatch' */
 #endif
   char *smatch; /* string entry identification */
   struct ignorelist_item_s *next;
@@ -71,6 +77,17 @@ typedef struct ignorelist_item_s ignorelist_item_t;
 struct ignorelist_s {
   int ignore;              /* ignore entries */
   ignorelist_item_t *head; /* pointer to the first entry */
+
+  /* The list above is indexed when it is matched for the first time after
+   * it has been changed, see ignorelist_build_index(). */
+  pthread_mutex_t lock;
+  bool indexed;
+  c_hashtable_t *strings; /* string entries */
+#if HAVE_REGEX_H
+  regex_t *regex; /* all regex entries in one, or NULL */
+#endif
+  /* Maps entries to whether they matched any item of the list. */
+  c_hashtable_t *memo;
 };
 
 /* *** *** *** ********************************************* *** *** *** */
@@ -117,6 +134,14 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
     return ENOMEM;
   }
   entry->rmatch = re;
+  entry->rstr = strdup(re_str);
+  if (entry->rstr == NULL) {
+    ERROR("ignorelist_append_regex: strdup failed.");
+    regfree(re);
+    sfree(re);
+    sfree(entry);
+    return ENOMEM;
+  }
 
   ignorelist_append(il, entry);
   return 0;
@@ -170,6 +195,155 @@ static int ignorelist_match_string(ignorelist_item_t *item, const char *entry) {
   return 0;
 } /* int ignorelist_match_string (ignorelist_item_t *item, const char *entry) */
 
+/* FNV-1a */
+static uint64_t ignorelist_hash(const char *entry) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *c = entry; *c != 0; c++) {
+    hash ^= (uint64_t)(unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* uint64_t ignorelist_hash */
+
+static void ignorelist_memo_clear(ignorelist_t *il) {
+  char *key;
+  void *value;
+  size_t pos = 0;
+
+  while (c_hashtable_next(il->memo, &pos, &key, &value) == 0)
+    free(key);
+  c_hashtable_destroy(il->memo);
+  il->memo = NULL;
+} /* void ignorelist_memo_clear */
+
+static void ignorelist_clear_index(ignorelist_t *il) {
+  c_hashtable_destroy(il->strings);
+  il->strings = NULL;
+#if HAVE_REGEX_H
+  if (il->regex != NULL) {
+    regfree(il->regex);
+    sfree(il->regex);
+  }
+#endif
+  ignorelist_memo_clear(il);
+  il->indexed = false;
+} /* void ignorelist_clear_index */
+
+#if HAVE_REGEX_H
+/* Compiles all regex entries into one extended regular expression of the
+ * form "(re0)|(re1)|...", which matches if any of the entries does. Entries
+ * with back references are matched one by one, because the additional
+ * groups would renumber them. */
+static regex_t *ignorelist_combine_regex(ignorelist_t *il) {
+  size_t len = 0;
+  size_t num = 0;
+
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    if (item->rmatch == NULL)
+      continue;
+    for (const char *c = item->rstr; *c != 0; c++)
+      if ((c[0] == '\\') && (c[1] >= '1') && (c[1] <= '9'))
+        return NULL;
+    len += strlen(item->rstr) + strlen("()|");
+    num++;
+  }
+  if (num < 2)
+    return NULL;
+
+  char *str = malloc(len + 1);
+  regex_t *re = calloc(1, sizeof(*re));
+  if ((str == NULL) || (re == NULL)) {
+    sfree(str);
+    sfree(re);
+    return NULL;
+  }
+
+  size_t fill = 0;
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    if (item->rmatch == NULL)
+      continue;
+    fill += (size_t)snprintf(str + fill, len + 1 - fill, "%s(%s)",
+                             (fill == 0) ? "" : "|", item->rstr);
+  }
+
+  int status = regcomp(re, str, REG_EXTENDED | REG_NOSUB);
+  sfree(str);
+  if (status != 0) {
+    sfree(re);
+    return NULL;
+  }
+
+  return re;
+} /* regex_t *ignorelist_combine_regex */
+#endif
+
+/* Puts all string entries into a hash table and combines the regex entries.
+ * Returns zero upon success. Upon failure, the list is matched item by item,
+ * as without an index. */
+static int ignorelist_build_index(ignorelist_t *il) {
+  il->strings = c_hashtable_create();
+  il->memo = c_hashtable_create();
+  if ((il->strings == NULL) || (il->memo == NULL)) {
+    ignorelist_clear_index(il);
+    return ENOMEM;
+  }
+
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next) {
+    if (item->smatch == NULL)
+      continue;
+    /* Duplicates are fine; a positive status means the entry exists. */
+    if (c_hashtable_insert(il->strings, ignorelist_hash(item->smatch),
+                           item->smatch, item) < 0) {
+      ignorelist_clear_index(il);
+      return ENOMEM;
+    }
+  }
+
+#if HAVE_REGEX_H
+  il->regex = ignorelist_combine_regex(il);
+#endif
+
+  il->indexed = true;
+  return 0;
+} /* int ignorelist_build_index */
+
+/* Returns true if `entry' matches any item of the list. */
+static bool ignorelist_match_list(ignorelist_t *il, const char *entry) {
+  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
+       traverse = traverse->next) {
+#if HAVE_REGEX_H
+    if (traverse->rmatch != NULL) {
+      if (ignorelist_match_regex(traverse, entry))
+        return true;
+    } else
+#endif
+    {
+      if (ignorelist_match_string(traverse, entry))
+        return true;
+    }
+  } /* for traverse */
+
+  return false;
+} /* bool ignorelist_match_list */
+
+/* Like ignorelist_match_list(), using the index. */
+static bool ignorelist_match_index(ignorelist_t *il, uint64_t hash,
+                                   const char *entry) {
+  if (c_hashtable_get(il->strings, hash, entry, NULL) == 0)
+    return true;
+
+#if HAVE_REGEX_H
+  if (il->regex != NULL)
+    return regexec(il->regex, entry, 0, NULL, 0) == 0;
+
+  for (ignorelist_item_t *item = il->head; item != NULL; item = item->next)
+    if ((item->rmatch != NULL) && ignorelist_match_regex(item, entry))
+      return true;
+#endif
+
+  return false;
+} /* bool ignorelist_match_index */
+
 /* *** *** *** ******************************************** *** *** *** */
 /* *** *** *** *** *** ***   public functions   *** *** *** *** *** *** */
 /* *** *** *** ******************************************** *** *** *** */
@@ -185,6 +359,8 @@ ignorelist_t *ignorelist_create(int invert) {
   if (il == NULL)
     return NULL;
 
+  pthread_mutex_init(&il->lock, /* attr = */ NULL);
+
   /*
    * ->ignore == 0  =>  collect
    * ->ignore == 1  =>  ignore
@@ -212,6 +388,7 @@ void ignorelist_free(ignorelist_t *il) {
       sfree(this->rmatch);
       this->rmatch = NULL;
     }
+    sfree(this->rstr);
 #endif
     if (this->smatch != NULL) {
       sfree(this->smatch);
@@ -220,6 +397,8 @@ void ignorelist_free(ignorelist_t *il) {
     sfree(this);
   }
 
+  ignorelist_clear_index(il);
+  pthread_mutex_destroy(&il->lock);
   sfree(il);
 } /* void ignorelist_destroy (ignorelist_t *il) */
 
@@ -249,6 +428,10 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
 
   len = strlen(entry);
 
+  pthread_mutex_lock(&il->lock);
+  ignorelist_clear_index(il);
+  pthread_mutex_unlock(&il->lock);
+
   /* append nothing */
   if (len == 0) {
     DEBUG("not appending: empty entry");
@@ -290,6 +473,10 @@ int ignorelist_remove(ignorelist_t *il, const char *entry) {
   if ((entry == NULL) || (strlen(entry) == 0))
     return 1;
 
+  pthread_mutex_lock(&il->lock);
+  ignorelist_clear_index(il);
+  pthread_mutex_unlock(&il->lock);
+
   /* traverse list and check entries */
   for (ignorelist_item_t *prev = NULL, *traverse = il->head; traverse != NULL;
        prev = traverse, traverse = traverse->next) {
@@ -321,20 +508,36 @@ int ignorelist_match(ignorelist_t *il, const char *entry) {
   if ((entry == NULL) || (strlen(entry) == 0))
     return 0;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
-       traverse = traverse->next) {
-#if HAVE_REGEX_H
-    if (traverse->rmatch != NULL) {
-      if (ignorelist_match_regex(traverse, entry))
-        return il->ignore;
-    } else
-#endif
-    {
-      if (ignorelist_match_string(traverse, entry))
-        return il->ignore;
+  /* The same names are matched in every interval, so the result is
+   * remembered per name. */
+  pthread_mutex_lock(&il->lock);
+
+  if (!il->indexed && (ignorelist_build_index(il) != 0)) {
+    bool found = ignorelist_match_list(il, entry);
+    pthread_mutex_unlock(&il->lock);
+    return found ? il->ignore : 1 - il->ignore;
+  }
+
+  uint64_t hash = ignorelist_hash(entry);
+  void *value = NULL;
+  bool found;
+  if (c_hashtable_get(il->memo, hash, entry, &value) == 0) {
+    found = (value != NULL);
+  } else {
+    found = ignorelist_match_index(il, hash, entry);
+
+    if (c_hashtable_size(il->memo) >= IGNORELIST_MEMO_MAX) {
+      ignorelist_memo_clear(il);
+      il->memo = c_hashtable_create();
     }
-  } /* for traverse */
 
-  return 1 - il->ignore;
+    /* Only whether the value is NULL matters. */
+    char *key = strdup(entry);
+    if ((key != NULL) &&
+        (c_hashtable_insert(il->memo, hash, key, found ? il : NULL) != 0))
+      free(key);
+  }
+
+  pthread_mutex_unlock(&il->lock);
+  return found ? il->ignore : 1 - il->ignore;
 } /* int ignorelist_match (ignorelist_t *il, const char *entry) */
@@ -0,0 +1,143 @@
+/**
+ * collectd - src/utils/ignorelist/ignorelist_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "collectd.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
+
+#include "testing.h"
+#include "utils/ignorelist/ignorelist.h"
+
+DEF_TEST(match) {
+  char const *entries[] = {
+      "eth0", "lo", "/^veth/", "/^docker[0-9]+$/", "/br-.*-int/", "eth0",
+  };
+  struct {
+    char const *name;
+    int ignored; /* without InvertMatch */
+  } cases[] = {
+      {"eth0", 1},          {"eth1", 0},        {"lo", 1},
+      {"lo0", 0},           {"veth1234", 1},    {"myveth", 0},
+      {"docker0", 1},       {"docker0a", 0},    {"br-1234-int", 1},
+      {"br-int", 0},        {"", 0},
+  };
+
+  for (int invert = 0; invert <= 1; invert++) {
+    ignorelist_t *il;
+    CHECK_NOT_NULL(il = ignorelist_create(invert));
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(entries); i++)
+      CHECK_ZERO(ignorelist_add(il, entries[i]));
+
+    /* Twice, so that the second round uses remembered results. */
+    for (int round = 0; round < 2; round++) {
+      for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+        int want = cases[i].ignored;
+        if (invert && (cases[i].name[0] != 0))
+          want = !want;
+        EXPECT_EQ_INT(want, ignorelist_match(il, cases[i].name));
+      }
+    }
+
+    ignorelist_free(il);
+  }
+
+  return 0;
+}
+
+DEF_TEST(modify) {
+  ignorelist_t *il;
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+
+  /* An empty list collects everything. */
+  EXPECT_EQ_INT(0, ignorelist_match(il, "sda"));
+
+  CHECK_ZERO(ignorelist_add(il, "sda"));
+  CHECK_ZERO(ignorelist_add(il, "sda"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sda"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "sdb"));
+
+  /* Changes are seen by names that have been matched before. */
+  CHECK_ZERO(ignorelist_add(il, "/^sd[b-z]$/"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sdb"));
+
+  /* One of the duplicates is left. */
+  CHECK_ZERO(ignorelist_remove(il, "sda"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sda"));
+  CHECK_ZERO(ignorelist_remove(il, "sda"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "sda"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sdc"));
+
+  ignorelist_set_invert(il, 1);
+  EXPECT_EQ_INT(0, ignorelist_match(il, "sdc"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sda"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(back_reference) {
+  ignorelist_t *il;
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+
+  /* The back reference must keep referring to the first group. */
+  CHECK_ZERO(ignorelist_add(il, "/^(a+)-\\1$/"));
+  CHECK_ZERO(ignorelist_add(il, "/^b/"));
+
+  EXPECT_EQ_INT(1, ignorelist_match(il, "aa-aa"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "aa-a"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "bz"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(many_names) {
+  ignorelist_t *il;
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+  CHECK_ZERO(ignorelist_add(il, "/^veth[0-9]*7$/"));
+
+  /* More names than results are remembered. */
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 70000; i++) {
+      char name[32];
+      snprintf(name, sizeof(name), "veth%d", i);
+      int want = ((i % 10) == 7) ? 1 : 0;
+      if (ignorelist_match(il, name) != want) {
+        EXPECT_EQ_INT(want, ignorelist_match(il, name));
+        break;
+      }
+    }
+  }
+
+  ignorelist_free(il);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(match);
+  RUN_TEST(modify);
+  RUN_TEST(back_reference);
+  RUN_TEST(many_names);
+
+  END_TEST;
+}
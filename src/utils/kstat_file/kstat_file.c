@@ -0,0 +1,176 @@
+/**
+ * collectd - src/utils/kstat_file/kstat_file.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/hashtable/hashtable.h"
+#include "utils/kstat_file/kstat_file.h"
+#include "utils/proc_file/proc_file.h"
+
+struct kstat_file_s {
+  proc_file_t *pf;
+
+  char **keys;
+  size_t keys_num;
+  bool *seen;
+  /* Maps each key to its entry in "keys". */
+  c_hashtable_t *table;
+};
+
+/* 64 bit FNV-1a over the "len" bytes at "str". */
+static uint64_t kstat_file_hash(char const *str, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint64_t)(unsigned char)str[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool kstat_file_isspace(char c) { return (c == ' ') || (c == '\t'); }
+
+void kstat_file_destroy(kstat_file_t *kf) /* {{{ */
+{
+  if (kf == NULL)
+    return;
+
+  c_hashtable_destroy(kf->table);
+  for (size_t i = 0; (kf->keys != NULL) && (i < kf->keys_num); i++)
+    free(kf->keys[i]);
+  free(kf->keys);
+  free(kf->seen);
+  proc_file_destroy(kf->pf);
+  free(kf);
+} /* }}} void kstat_file_destroy */
+
+kstat_file_t *kstat_file_create(char const *path, /* {{{ */
+                                char const *const *keys, size_t keys_num) {
+  kstat_file_t *kf = calloc(1, sizeof(*kf));
+  if (kf == NULL)
+    return NULL;
+
+  kf->pf = proc_file_create(path);
+  kf->keys = calloc(keys_num + 1, sizeof(*kf->keys));
+  kf->seen = calloc(keys_num + 1, sizeof(*kf->seen));
+  kf->table = c_hashtable_create();
+  if ((kf->pf == NULL) || (kf->keys == NULL) || (kf->seen == NULL) ||
+      (kf->table == NULL)) {
+    kstat_file_destroy(kf);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < keys_num; i++) {
+    kf->keys[i] = strdup(keys[i]);
+    if (kf->keys[i] == NULL) {
+      kstat_file_destroy(kf);
+      return NULL;
+    }
+    kf->keys_num = i + 1;
+
+    uint64_t hash = kstat_file_hash(kf->keys[i], strlen(kf->keys[i]));
+    if (c_hashtable_insert(kf->table, hash, kf->keys[i], &kf->keys[i]) != 0) {
+      kstat_file_destroy(kf);
+      return NULL;
+    }
+  }
+
+  return kf;
+} /* }}} kstat_file_t *kstat_file_create */
+
+char const *kstat_file_path(kstat_file_t const *kf) /* {{{ */
+{
+  return proc_file_path(kf->pf);
+} /* }}} char const *kstat_file_path */
+
+/* Parses an optionally negative decimal number that makes up all of "str". */
+static int kstat_file_parse_value(char const *str, int64_t *ret_value) {
+  bool negative = (str[0] == '-');
+  char *endptr = NULL;
+  uint64_t value;
+
+  int status = proc_parse_uint64(negative ? str + 1 : str, &endptr, &value);
+  if (status != 0)
+    return status;
+  if (*endptr != 0)
+    return EINVAL;
+
+  *ret_value = negative ? (int64_t)(0 - value) : (int64_t)value;
+  return 0;
+}
+
+ssize_t kstat_file_read(kstat_file_t *kf, int64_t *values, /* {{{ */
+                        bool *found) {
+  memset(kf->seen, 0, kf->keys_num * sizeof(*kf->seen));
+  if (found != NULL)
+    memset(found, 0, kf->keys_num * sizeof(*found));
+
+  if (proc_file_read(kf->pf) < 0)
+    return -1;
+
+  size_t found_num = 0;
+  char *line;
+  while ((found_num < kf->keys_num) &&
+         ((line = proc_file_next_line(kf->pf)) != NULL)) {
+    while (kstat_file_isspace(*line))
+      line++;
+
+    char *name_end = line;
+    while ((*name_end != 0) && !kstat_file_isspace(*name_end))
+      name_end++;
+    if ((name_end == line) || (*name_end == 0))
+      continue;
+
+    /* The value is the last field. */
+    char *value = name_end + strlen(name_end);
+    while ((value > name_end) && kstat_file_isspace(value[-1]))
+      value--;
+    *value = 0;
+    while ((value > name_end) && !kstat_file_isspace(value[-1]))
+      value--;
+    if (value == name_end)
+      continue;
+
+    *name_end = 0;
+    char **key = NULL;
+    if (c_hashtable_get(kf->table,
+                        kstat_file_hash(line, (size_t)(name_end - line)), line,
+                        (void *)&key) != 0)
+      continue;
+
+    size_t index = (size_t)(key - kf->keys);
+    int64_t v;
+    if (kstat_file_parse_value(value, &v) != 0)
+      continue;
+
+    if (!kf->seen[index]) {
+      kf->seen[index] = true;
+      found_num++;
+    }
+    values[index] = v;
+  }
+
+  if (found != NULL)
+    memcpy(found, kf->seen, kf->keys_num * sizeof(*found));
+
+  return (ssize_t)found_num;
+} /* }}} ssize_t kstat_file_read */
@@ -0,0 +1,92 @@
+/**
+ * collectd - src/utils/kstat_file/kstat_file.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_KSTAT_FILE_H
+#define UTILS_KSTAT_FILE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Reader for files listing one named counter per line, with the name in the
+ * first and the value in the last field, such as the kstat files below
+ * /proc/spl/kstat ("name type data") or /proc/vmstat ("name value"). The
+ * names of interest are loaded into a hash table once, so each read is a
+ * single pass over the file with one lookup per line. Lines whose first
+ * field is not one of the keys, such as kstat headers, are skipped.
+ *
+ * A kstat_file_t is not thread-safe.
+ */
+struct kstat_file_s;
+typedef struct kstat_file_s kstat_file_t;
+
+/*
+ * NAME
+ *   kstat_file_create
+ *
+ * DESCRIPTION
+ *   Creates a reader for the file at `path' which looks for the `keys_num'
+ *   names in `keys'. The value of keys[i] is stored in slot i by
+ *   kstat_file_read(). The keys are copied. The file is opened by the first
+ *   read, so it doesn't need to exist yet.
+ *
+ * RETURN VALUE
+ *   The new reader or NULL upon failure, for example if a key is given
+ *   twice.
+ */
+kstat_file_t *kstat_file_create(char const *path, char const *const *keys,
+                                size_t keys_num);
+
+/*
+ * NAME
+ *   kstat_file_destroy
+ */
+void kstat_file_destroy(kstat_file_t *kf);
+
+/*
+ * NAME
+ *   kstat_file_path
+ */
+char const *kstat_file_path(kstat_file_t const *kf);
+
+/*
+ * NAME
+ *   kstat_file_read
+ *
+ * DESCRIPTION
+ *   Reads the file and stores the value of each key found in the
+ *   corresponding slot of `values', which must have room for `keys_num'
+ *   entries. Values are parsed as signed 64 bit integers; unsigned values
+ *   above INT64_MAX wrap around like derive_t does. If `found' is not NULL,
+ *   found[i] is set to whether keys[i] has been seen. Slots of keys that have
+ *   not been seen are not modified. Reading stops as soon as all keys have
+ *   been seen.
+ *
+ * RETURN VALUE
+ *   The number of keys found or -1 if the file could not be read, with errno
+ *   set.
+ */
+ssize_t kstat_file_read(kstat_file_t *kf, int64_t *values, bool *found);
+
+#endif /* UTILS_KSTAT_FILE_H */
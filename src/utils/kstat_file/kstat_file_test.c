@@ -0,0 +1,136 @@
+/**
+ * collectd - src/utils/kstat_file/kstat_file_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/kstat_file/kstat_file.h"
+
+static char *write_temp_file(char const *content) {
+  static char path[64];
+  sstrncpy(path, "/tmp/kstat_file_test.XXXXXX", sizeof(path));
+
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return NULL;
+  size_t len = strlen(content);
+  if (write(fd, content, len) != (ssize_t)len) {
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  return path;
+}
+
+DEF_TEST(arcstats) {
+  char const content[] = "13 1 0x01 4 1088 4937730191 31178287747373\n"
+                         "name                            type data\n"
+                         "hits                            4    1234\n"
+                         "misses                          4    56\n"
+                         "c_min                           4    33554432\n"
+                         "memory_available_bytes          3    -81920\n"
+                         "l2_hits                         4    garbage\n"
+                         "size                            4    987654321  \n";
+  char const *keys[] = {"size",    "hits",     "misses",
+                        "l2_hits", "not_there", "memory_available_bytes"};
+  char *path;
+  CHECK_NOT_NULL(path = write_temp_file(content));
+
+  kstat_file_t *kf;
+  CHECK_NOT_NULL(kf = kstat_file_create(path, keys, STATIC_ARRAY_SIZE(keys)));
+  EXPECT_EQ_STR(path, kstat_file_path(kf));
+
+  /* Read twice to make sure the results don't depend on earlier reads. */
+  for (int i = 0; i < 2; i++) {
+    int64_t values[STATIC_ARRAY_SIZE(keys)];
+    bool found[STATIC_ARRAY_SIZE(keys)];
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(values); j++)
+      values[j] = 42;
+
+    EXPECT_EQ_INT(4, (int)kstat_file_read(kf, values, found));
+    EXPECT_EQ_INT(1, found[0]);
+    EXPECT_EQ_UINT64(987654321, (uint64_t)values[0]);
+    EXPECT_EQ_INT(1, found[1]);
+    EXPECT_EQ_UINT64(1234, (uint64_t)values[1]);
+    EXPECT_EQ_INT(1, found[2]);
+    EXPECT_EQ_UINT64(56, (uint64_t)values[2]);
+    EXPECT_EQ_INT(0, found[3]);
+    EXPECT_EQ_UINT64(42, (uint64_t)values[3]);
+    EXPECT_EQ_INT(0, found[4]);
+    EXPECT_EQ_INT(1, found[5]);
+    EXPECT_EQ_INT(1, values[5] == -81920);
+  }
+
+  kstat_file_destroy(kf);
+  unlink(path);
+  END_TEST;
+}
+
+DEF_TEST(name_value) {
+  char const content[] = "nr_free_pages 12345\n"
+                         "pgpgin 99\n"
+                         "pgpgout 100\n"
+                         "pgpgin 1\n";
+  char const *keys[] = {"pgpgin", "pgpgout"};
+  char *path;
+  CHECK_NOT_NULL(path = write_temp_file(content));
+
+  kstat_file_t *kf;
+  CHECK_NOT_NULL(kf = kstat_file_create(path, keys, STATIC_ARRAY_SIZE(keys)));
+
+  /* "found" is optional and reading stops once all keys have been seen, so
+   * the second "pgpgin" line is never looked at. */
+  int64_t values[2] = {0, 0};
+  EXPECT_EQ_INT(2, (int)kstat_file_read(kf, values, NULL));
+  EXPECT_EQ_UINT64(99, (uint64_t)values[0]);
+  EXPECT_EQ_UINT64(100, (uint64_t)values[1]);
+
+  kstat_file_destroy(kf);
+  unlink(path);
+  END_TEST;
+}
+
+DEF_TEST(errors) {
+  char const *keys[] = {"a", "b", "a"};
+
+  /* Duplicate keys are rejected. */
+  EXPECT_EQ_PTR(NULL, kstat_file_create("/dev/null", keys, 3));
+
+  kstat_file_t *kf;
+  CHECK_NOT_NULL(kf = kstat_file_create("/nonexistent/kstat", keys, 2));
+  int64_t values[2];
+  EXPECT_EQ_INT(-1, (int)kstat_file_read(kf, values, NULL));
+  EXPECT_EQ_INT(ENOENT, errno);
+  kstat_file_destroy(kf);
+
+  END_TEST;
+}
+
+int main(void) {
+  RUN_TEST(arcstats);
+  RUN_TEST(name_value);
+  RUN_TEST(errors);
+
+  END_TEST;
+}
@@ -24,11 +24,13 @@
  *   Florian Forster <ff at octo.it>
  **/
 
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/latency/latency.h"
+#include "utils/metadata/meta_data.h"
 
 #include <limits.h>
 #include <math.h>
@@ -37,10 +39,27 @@
 #define LLONG_MAX 9223372036854775807LL
 #endif
 
-#ifndef HISTOGRAM_DEFAULT_BIN_WIDTH
-/* 1048576 = 2^20 ^= 1/1024 s */
-#define HISTOGRAM_DEFAULT_BIN_WIDTH 1048576
-#endif
+/*
+ * Latencies are counted in a log-linear histogram, similar to HdrHistogram:
+ * values below 2^LATENCY_SUB_BITS each get their own bucket. Every further
+ * power of two is split into LATENCY_SUB_NUM linear buckets, so the width of
+ * a bucket is at most 1/LATENCY_SUB_NUM of its lower bound, which bounds the
+ * relative error of percentiles and rates independently of the range of the
+ * recorded values. With six bits the error is below 1.6%.
+ *
+ * The buckets of one power of two form a "group". Groups are allocated the
+ * first time a value falls into them, so a counter only uses memory for the
+ * orders of magnitude actually observed. Since the bucket boundaries are
+ * fixed, histograms never need to be rescaled and two counters can be merged
+ * exactly by adding up their buckets.
+ *
+ * Buckets have an exclusive lower bound and an inclusive upper bound, i.e.
+ * bucket 0 represents (0-1]. A value is stored in the bucket of (value - 1).
+ */
+#define LATENCY_SUB_BITS 6
+#define LATENCY_SUB_NUM (1 << LATENCY_SUB_BITS)
+/* Values are at most LLONG_MAX, i.e. below 2^63. */
+#define LATENCY_GROUPS_NUM (63 - LATENCY_SUB_BITS + 1)
 
 struct latency_counter_s {
   cdtime_t start_time;
@@ -51,67 +70,39 @@ struct latency_counter_s {
   cdtime_t min;
   cdtime_t max;
 
-  cdtime_t bin_width;
-  int histogram[HISTOGRAM_NUM_BINS];
+  uint64_t *groups[LATENCY_GROUPS_NUM];
 };
 
-/*
- * Histogram represents the distribution of data, it has a list of "bins".
- * Each bin represents an interval and has a count (frequency) of
- * number of values fall within its interval.
- *
- * Histogram's range is determined by the number of bins and the bin width,
- * There are 1000 bins and all bins have the same width of default 1
- * millisecond. When a value above this range is added, Histogram's range is
- * increased by increasing the bin width (note that number of bins remains
- * always at 1000). This operation of increasing bin width is little expensive
- * as each bin need to be visited to update its count. To reduce frequent change
- * of bin width, new bin width will be the next nearest power of 2. Example: 2,
- * 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 5086, ...
- *
- * So, if the required bin width is 300, then new bin width will be 512 as it is
- * the next nearest power of 2.
- */
-static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
+static size_t bucket_group(cdtime_t v) /* {{{ */
 {
-  /* This function is called because the new value is above histogram's range.
-   * First find the required bin width:
-   *           requiredBinWidth = (value + 1) / numBins
-   * then get the next nearest power of 2
-   *           newBinWidth = 2^(ceil(log2(requiredBinWidth)))
-   */
-  double required_bin_width =
-      ((double)(latency + 1)) / ((double)HISTOGRAM_NUM_BINS);
-  double required_bin_width_logbase2 = log(required_bin_width) / log(2.0);
-  cdtime_t new_bin_width =
-      (cdtime_t)(pow(2.0, ceil(required_bin_width_logbase2)) + .5);
-  cdtime_t old_bin_width = lc->bin_width;
-
-  lc->bin_width = new_bin_width;
-
-  /* bin_width has been increased, now iterate through all bins and move the
-   * old bin's count to new bin. */
-  if (lc->num > 0) // if the histogram has data then iterate else skip
-  {
-    double width_change_ratio =
-        ((double)old_bin_width) / ((double)new_bin_width);
-
-    for (size_t i = 0; i < HISTOGRAM_NUM_BINS; i++) {
-      size_t new_bin = (size_t)(((double)i) * width_change_ratio);
-      if (i == new_bin)
-        continue;
-      assert(new_bin < i);
+  if (v < LATENCY_SUB_NUM)
+    return 0;
 
-      lc->histogram[new_bin] += lc->histogram[i];
-      lc->histogram[i] = 0;
-    }
-  }
+  int exp = 63 - __builtin_clzll((unsigned long long)v);
+  return (size_t)(exp - LATENCY_SUB_BITS + 1);
+} /* }}} size_t bucket_group */
+
+static size_t bucket_sub(cdtime_t v, size_t group) /* {{{ */
+{
+  if (group == 0)
+    return (size_t)v;
+  return (size_t)(v >> (group - 1)) - LATENCY_SUB_NUM;
+} /* }}} size_t bucket_sub */
+
+/* bucket_lower returns the exclusive lower bound of a bucket. */
+static cdtime_t bucket_lower(size_t group, size_t sub) /* {{{ */
+{
+  if (group == 0)
+    return (cdtime_t)sub;
+  return ((cdtime_t)(LATENCY_SUB_NUM + sub)) << (group - 1);
+} /* }}} cdtime_t bucket_lower */
 
-  DEBUG("utils_latency: change_bin_width: latency = %.3f; "
-        "old_bin_width = %.3f; new_bin_width = %.3f;",
-        CDTIME_T_TO_DOUBLE(latency), CDTIME_T_TO_DOUBLE(old_bin_width),
-        CDTIME_T_TO_DOUBLE(new_bin_width));
-} /* }}} void change_bin_width */
+static cdtime_t bucket_width(size_t group) /* {{{ */
+{
+  if (group == 0)
+    return 1;
+  return ((cdtime_t)1) << (group - 1);
+} /* }}} cdtime_t bucket_width */
 
 latency_counter_t *latency_counter_create(void) /* {{{ */
 {
@@ -121,23 +112,35 @@ latency_counter_t *latency_counter_create(void) /* {{{ */
   if (lc == NULL)
     return NULL;
 
-  lc->bin_width = HISTOGRAM_DEFAULT_BIN_WIDTH;
   latency_counter_reset(lc);
   return lc;
 } /* }}} latency_counter_t *latency_counter_create */
 
 void latency_counter_destroy(latency_counter_t *lc) /* {{{ */
 {
+  if (lc == NULL)
+    return;
+
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++)
+    sfree(lc->groups[i]);
   sfree(lc);
 } /* }}} void latency_counter_destroy */
 
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
 {
-  cdtime_t bin;
-
   if ((lc == NULL) || (latency == 0) || (latency > ((cdtime_t)LLONG_MAX)))
     return;
 
+  size_t group = bucket_group(latency - 1);
+  if (lc->groups[group] == NULL) {
+    lc->groups[group] = calloc(LATENCY_SUB_NUM, sizeof(*lc->groups[group]));
+    if (lc->groups[group] == NULL) {
+      P_ERROR("latency_counter_add: calloc failed.");
+      return;
+    }
+  }
+  lc->groups[group][bucket_sub(latency - 1, group)]++;
+
   lc->sum += latency;
   lc->num++;
 
@@ -147,51 +150,54 @@ void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
     lc->min = latency;
   if (lc->max < latency)
     lc->max = latency;
+} /* }}} void latency_counter_add */
 
-  /* A latency of _exactly_ 1.0 ms is stored in the buffer 0, so
-   * subtract one from the cdtime_t value so that exactly 1.0 ms get sorted
-   * accordingly. */
-  bin = (latency - 1) / lc->bin_width;
-  if (bin >= HISTOGRAM_NUM_BINS) {
-    change_bin_width(lc, latency);
-    bin = (latency - 1) / lc->bin_width;
-    if (bin >= HISTOGRAM_NUM_BINS) {
-      P_ERROR("latency_counter_add: Invalid bin: %" PRIu64, bin);
-      return;
+void latency_counter_merge(latency_counter_t *dst, /* {{{ */
+                           const latency_counter_t *src) {
+  if ((dst == NULL) || (src == NULL) || (src->num == 0))
+    return;
+
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (src->groups[i] == NULL)
+      continue;
+
+    if (dst->groups[i] == NULL) {
+      dst->groups[i] = calloc(LATENCY_SUB_NUM, sizeof(*dst->groups[i]));
+      if (dst->groups[i] == NULL) {
+        P_ERROR("latency_counter_merge: calloc failed.");
+        return;
+      }
     }
+
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++)
+      dst->groups[i][j] += src->groups[i][j];
   }
-  lc->histogram[bin]++;
-} /* }}} void latency_counter_add */
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if ((dst->num == 0) || (dst->max < src->max))
+    dst->max = src->max;
+  dst->sum += src->sum;
+  dst->num += src->num;
+  if (dst->start_time > src->start_time)
+    dst->start_time = src->start_time;
+} /* }}} void latency_counter_merge */
 
 void latency_counter_reset(latency_counter_t *lc) /* {{{ */
 {
   if (lc == NULL)
     return;
 
-  cdtime_t bin_width = lc->bin_width;
-  cdtime_t max_bin = (lc->max - 1) / lc->bin_width;
-
-/*
-  If max latency is REDUCE_THRESHOLD times less than histogram's range,
-  then cut it in half. REDUCE_THRESHOLD must be >= 2.
-  Value of 4 is selected to reduce frequent changes of bin width.
-*/
-#define REDUCE_THRESHOLD 4
-  if ((lc->num > 0) && (lc->bin_width >= HISTOGRAM_DEFAULT_BIN_WIDTH * 2) &&
-      (max_bin < HISTOGRAM_NUM_BINS / REDUCE_THRESHOLD)) {
-    /* new bin width will be the previous power of 2 */
-    bin_width = bin_width / 2;
-
-    DEBUG("utils_latency: latency_counter_reset: max_latency = %.3f; "
-          "max_bin = %" PRIu64 "; old_bin_width = %.3f; new_bin_width = %.3f;",
-          CDTIME_T_TO_DOUBLE(lc->max), max_bin,
-          CDTIME_T_TO_DOUBLE(lc->bin_width), CDTIME_T_TO_DOUBLE(bin_width));
-  }
-
-  memset(lc, 0, sizeof(*lc));
+  /* Groups stay allocated: the next interval is likely to see latencies of
+   * the same order of magnitude. */
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++)
+    if (lc->groups[i] != NULL)
+      memset(lc->groups[i], 0, LATENCY_SUB_NUM * sizeof(*lc->groups[i]));
 
-  /* preserve bin width */
-  lc->bin_width = bin_width;
+  lc->sum = 0;
+  lc->num = 0;
+  lc->min = 0;
+  lc->max = 0;
   lc->start_time = cdtime();
 } /* }}} void latency_counter_reset */
 
@@ -236,51 +242,45 @@ cdtime_t latency_counter_get_average(latency_counter_t *lc) /* {{{ */
 
 cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
                                         double percent) {
-  double percent_upper;
-  double percent_lower;
-  double p;
-  cdtime_t latency_lower;
-  cdtime_t latency_interpolated;
-  int sum;
-  size_t i;
-
   if ((lc == NULL) || (lc->num == 0) || !((percent > 0.0) && (percent < 100.0)))
     return 0;
 
-  /* Find index i so that at least "percent" events are within i+1 ms. */
-  percent_upper = 0.0;
-  percent_lower = 0.0;
-  sum = 0;
-  for (i = 0; i < HISTOGRAM_NUM_BINS; i++) {
-    percent_lower = percent_upper;
-    sum += lc->histogram[i];
-    if (sum == 0)
-      percent_upper = 0.0;
-    else
-      percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
-
-    if (percent_upper >= percent)
-      break;
-  }
+  /* Find the bucket in which the cumulative share of events reaches
+   * "percent" and interpolate linearly within that bucket. */
+  double percent_upper = 0.0;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (lc->groups[i] == NULL)
+      continue;
 
-  if (i >= HISTOGRAM_NUM_BINS)
-    return 0;
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++) {
+      if (lc->groups[i][j] == 0)
+        continue;
 
-  assert(percent_upper >= percent);
-  assert(percent_lower < percent);
+      double percent_lower = percent_upper;
+      sum += lc->groups[i][j];
+      percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
+      if (percent_upper < percent)
+        continue;
 
-  if (i == 0)
-    return lc->bin_width;
+      double p = (percent - percent_lower) / (percent_upper - percent_lower);
+      cdtime_t latency_interpolated =
+          bucket_lower(i, j) +
+          DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(bucket_width(i)));
 
-  latency_lower = ((cdtime_t)i) * lc->bin_width;
-  p = (percent - percent_lower) / (percent_upper - percent_lower);
+      /* The bucket may extend beyond the observed extremes. */
+      if (latency_interpolated < lc->min)
+        latency_interpolated = lc->min;
+      if (latency_interpolated > lc->max)
+        latency_interpolated = lc->max;
 
-  latency_interpolated =
-      latency_lower + DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(lc->bin_width));
+      DEBUG("latency_counter_get_percentile: latency_interpolated = %.3f",
+            CDTIME_T_TO_DOUBLE(latency_interpolated));
+      return latency_interpolated;
+    }
+  }
 
-  DEBUG("latency_counter_get_percentile: latency_interpolated = %.3f",
-        CDTIME_T_TO_DOUBLE(latency_interpolated));
-  return latency_interpolated;
+  return 0;
 } /* }}} cdtime_t latency_counter_get_percentile */
 
 double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
@@ -294,51 +294,228 @@ double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
   if (lower == upper)
     return 0;
 
-  /* Buckets have an exclusive lower bound and an inclusive upper bound. That
-   * means that the first bucket, index 0, represents (0-bin_width]. That means
-   * that latency==bin_width needs to result in bin=0, that's why we need to
-   * subtract one before dividing by bin_width. */
-  cdtime_t lower_bin = 0;
-  if (lower)
-    /* lower is *exclusive* => determine bucket for lower+1 */
-    lower_bin = ((lower + 1) - 1) / lc->bin_width;
-
-  /* lower is greater than the longest latency observed => rate is zero. */
-  if (lower_bin >= HISTOGRAM_NUM_BINS)
-    return 0;
+  double sum = 0;
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (lc->groups[i] == NULL)
+      continue;
+
+    if (upper && (bucket_lower(i, 0) >= upper))
+      break;
 
-  cdtime_t upper_bin = HISTOGRAM_NUM_BINS - 1;
-  if (upper)
-    upper_bin = (upper - 1) / lc->bin_width;
+    cdtime_t width = bucket_width(i);
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++) {
+      if (lc->groups[i][j] == 0)
+        continue;
 
-  if (upper_bin >= HISTOGRAM_NUM_BINS) {
-    upper_bin = HISTOGRAM_NUM_BINS - 1;
-    upper = 0;
+      /* The bucket represents (bucket_lower-bucket_upper]. */
+      cdtime_t bucket_lower_bound = bucket_lower(i, j);
+      cdtime_t bucket_upper_bound = bucket_lower_bound + width;
+      if (bucket_upper_bound <= lower)
+        continue;
+      if (upper && (bucket_lower_bound >= upper))
+        break;
+
+      /* Buckets only partially covered by the interval contribute the
+       * approximate ratio of requests that fall into the interval. */
+      cdtime_t from = (lower > bucket_lower_bound) ? lower : bucket_lower_bound;
+      cdtime_t to =
+          (upper && (upper < bucket_upper_bound)) ? upper : bucket_upper_bound;
+      sum += ((double)(to - from)) / ((double)width) *
+             ((double)lc->groups[i][j]);
+    }
   }
 
-  double sum = 0;
-  for (size_t i = lower_bin; i <= upper_bin; i++)
-    sum += lc->histogram[i];
-
-  if (lower) {
-    /* Approximate ratio of requests in lower_bin, that fall between
-     * lower_bin_boundary and lower. This ratio is then subtracted from sum to
-     * increase accuracy. */
-    cdtime_t lower_bin_boundary = lower_bin * lc->bin_width;
-    assert(lower >= lower_bin_boundary);
-    double lower_ratio =
-        (double)(lower - lower_bin_boundary) / ((double)lc->bin_width);
-    sum -= lower_ratio * lc->histogram[lower_bin];
+  return sum / (CDTIME_T_TO_DOUBLE(now - lc->start_time));
+} /* }}} double latency_counter_get_rate */
+
+int latency_counter_foreach_bucket(const latency_counter_t *lc, /* {{{ */
+                                   latency_bucket_callback_t callback,
+                                   void *user_data) {
+  if ((lc == NULL) || (callback == NULL))
+    return EINVAL;
+
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (lc->groups[i] == NULL)
+      continue;
+
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++) {
+      if (lc->groups[i][j] == 0)
+        continue;
+
+      cdtime_t lower = bucket_lower(i, j);
+      int status =
+          callback(lower, lower + bucket_width(i), lc->groups[i][j], user_data);
+      if (status != 0)
+        return status;
+    }
+  }
+
+  return 0;
+} /* }}} int latency_counter_foreach_bucket */
+
+/* The string representation is
+ *
+ *   <sub bits> <num> <sum> <min> <max>[ <skip>:<count>]...
+ *
+ * with one "<skip>:<count>" pair for each non-empty bucket, in increasing
+ * order. "skip" is the number of empty buckets since the previous non-empty
+ * one, i.e. the index of the first non-empty bucket. */
+char *latency_counter_to_string(const latency_counter_t *lc) /* {{{ */
+{
+  if (lc == NULL)
+    return NULL;
+
+  size_t buckets_num = 0;
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (lc->groups[i] == NULL)
+      continue;
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++)
+      if (lc->groups[i][j] != 0)
+        buckets_num++;
   }
 
-  if (upper) {
-    /* As above: approximate ratio of requests in upper_bin, that fall between
-     * upper and upper_bin_boundary. */
-    cdtime_t upper_bin_boundary = (upper_bin + 1) * lc->bin_width;
-    assert(upper <= upper_bin_boundary);
-    double ratio = (double)(upper_bin_boundary - upper) / (double)lc->bin_width;
-    sum -= ratio * lc->histogram[upper_bin];
+  /* 20 digits per number and one separator each. */
+  size_t size = 5 * 21 + buckets_num * 2 * 21 + 1;
+  char *buffer = malloc(size);
+  if (buffer == NULL)
+    return NULL;
+
+  int len = snprintf(buffer, size, "%d %" PRIu64 " %" PRIu64 " %" PRIu64
+                                   " %" PRIu64,
+                     LATENCY_SUB_BITS, (uint64_t)lc->num, lc->sum, lc->min,
+                     lc->max);
+  size_t next = 0;
+  for (size_t i = 0; i < LATENCY_GROUPS_NUM; i++) {
+    if (lc->groups[i] == NULL)
+      continue;
+
+    for (size_t j = 0; j < LATENCY_SUB_NUM; j++) {
+      if (lc->groups[i][j] == 0)
+        continue;
+
+      size_t index = i * LATENCY_SUB_NUM + j;
+      len += snprintf(buffer + len, size - (size_t)len, " %" PRIsz ":%" PRIu64,
+                      index - next, lc->groups[i][j]);
+      next = index + 1;
+    }
   }
 
-  return sum / (CDTIME_T_TO_DOUBLE(now - lc->start_time));
-} /* }}} double latency_counter_get_rate */
+  assert((size_t)len < size);
+  return buffer;
+} /* }}} char *latency_counter_to_string */
+
+static int parse_number(char const **ptr, uint64_t *ret) /* {{{ */
+{
+  char *end = NULL;
+
+  if (!isdigit((unsigned char)**ptr))
+    return EINVAL;
+
+  errno = 0;
+  unsigned long long tmp = strtoull(*ptr, &end, 10);
+  if ((errno != 0) || (end == *ptr))
+    return EINVAL;
+
+  *ptr = end;
+  *ret = (uint64_t)tmp;
+  return 0;
+} /* }}} int parse_number */
+
+int latency_counter_merge_string(latency_counter_t *lc, /* {{{ */
+                                 char const *str) {
+  if ((lc == NULL) || (str == NULL))
+    return EINVAL;
+
+  uint64_t header[5];
+  char const *ptr = str;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(header); i++) {
+    if ((i > 0) && (*(ptr++) != ' '))
+      return EINVAL;
+    if (parse_number(&ptr, header + i) != 0)
+      return EINVAL;
+  }
+
+  /* Histograms with a different resolution can't be merged exactly. */
+  if (header[0] != LATENCY_SUB_BITS)
+    return ENOTSUP;
+
+  latency_counter_t *tmp = latency_counter_create();
+  if (tmp == NULL)
+    return ENOMEM;
+
+  tmp->num = (size_t)header[1];
+  tmp->sum = (cdtime_t)header[2];
+  tmp->min = (cdtime_t)header[3];
+  tmp->max = (cdtime_t)header[4];
+
+  int status = 0;
+  uint64_t next = 0;
+  uint64_t total = 0;
+  while ((status == 0) && (*ptr != 0)) {
+    uint64_t skip = 0;
+    uint64_t count = 0;
+
+    if ((*(ptr++) != ' ') || (parse_number(&ptr, &skip) != 0) ||
+        (*(ptr++) != ':') || (parse_number(&ptr, &count) != 0) ||
+        (count == 0) ||
+        (skip >= (LATENCY_GROUPS_NUM * LATENCY_SUB_NUM) - next)) {
+      status = EINVAL;
+      break;
+    }
+
+    uint64_t index = next + skip;
+    size_t group = (size_t)(index / LATENCY_SUB_NUM);
+    if (tmp->groups[group] == NULL) {
+      tmp->groups[group] = calloc(LATENCY_SUB_NUM, sizeof(*tmp->groups[group]));
+      if (tmp->groups[group] == NULL) {
+        status = ENOMEM;
+        break;
+      }
+    }
+    tmp->groups[group][index % LATENCY_SUB_NUM] = count;
+
+    total += count;
+    next = index + 1;
+  }
+
+  if ((status == 0) && (total != tmp->num))
+    status = EINVAL;
+
+  if (status == 0)
+    latency_counter_merge(lc, tmp);
+
+  latency_counter_destroy(tmp);
+  return status;
+} /* }}} int latency_counter_merge_string */
+
+int latency_counter_dispatch(const latency_counter_t *lc, /* {{{ */
+                             const value_list_t *vl_template) {
+  if ((lc == NULL) || (vl_template == NULL))
+    return EINVAL;
+
+  char *histogram = latency_counter_to_string(lc);
+  if (histogram == NULL)
+    return ENOMEM;
+
+  value_list_t vl = *vl_template;
+  vl.values = &(value_t){.gauge = (gauge_t)lc->num};
+  vl.values_len = 1;
+  sstrncpy(vl.type, "histogram", sizeof(vl.type));
+
+  if (vl_template->meta != NULL)
+    vl.meta = meta_data_clone(vl_template->meta);
+  else
+    vl.meta = meta_data_create();
+  if (vl.meta == NULL) {
+    sfree(histogram);
+    return ENOMEM;
+  }
+
+  int status = meta_data_add_string(vl.meta, LATENCY_HISTOGRAM_META, histogram);
+  if (status == 0)
+    status = plugin_dispatch_values(&vl);
+
+  meta_data_destroy(vl.meta);
+  sfree(histogram);
+  return status;
+} /* }}} int latency_counter_dispatch */
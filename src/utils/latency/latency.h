@@ -29,12 +29,19 @@
 
 #include "collectd.h"
 
+#include "plugin.h"
 #include "utils_time.h"
 
-#ifndef HISTOGRAM_NUM_BINS
-#define HISTOGRAM_NUM_BINS 1000
-#endif
+/* Meta data key of value lists carrying a whole latency_counter_t, see
+ * latency_counter_dispatch(). */
+#define LATENCY_HISTOGRAM_META "latency:histogram"
 
+/*
+ * latency_counter_t records latencies in a log-linear histogram with a bounded
+ * relative error (see latency.c). A counter is not thread-safe: threads
+ * should record into counters of their own and combine them with
+ * latency_counter_merge().
+ */
 struct latency_counter_s;
 typedef struct latency_counter_s latency_counter_t;
 
@@ -44,6 +51,18 @@ void latency_counter_destroy(latency_counter_t *lc);
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency);
 void latency_counter_reset(latency_counter_t *lc);
 
+/*
+ * NAME
+ *  latency_counter_merge(dst,src)
+ *
+ * DESCRIPTION
+ *   Adds all latencies recorded in "src" to "dst", as if they had been added
+ *   with latency_counter_add(). Since all counters share the same bucket
+ *   boundaries, the result is exact. "src" is not modified.
+ */
+void latency_counter_merge(latency_counter_t *dst,
+                           const latency_counter_t *src);
+
 cdtime_t latency_counter_get_min(latency_counter_t *lc);
 cdtime_t latency_counter_get_max(latency_counter_t *lc);
 cdtime_t latency_counter_get_sum(latency_counter_t *lc);
@@ -65,4 +84,54 @@ cdtime_t latency_counter_get_percentile(latency_counter_t *lc, double percent);
 double latency_counter_get_rate(const latency_counter_t *lc, cdtime_t lower,
                                 cdtime_t upper, const cdtime_t now);
 
+/*
+ * NAME
+ *  latency_counter_foreach_bucket(counter,callback,user_data)
+ *
+ * DESCRIPTION
+ *   Calls "callback" for each non-empty bucket of the histogram, in
+ *   increasing order. Buckets represent the interval (lower,upper]. Stops and
+ *   returns the status of "callback" if it returns non-zero.
+ */
+typedef int (*latency_bucket_callback_t)(cdtime_t lower, cdtime_t upper,
+                                         uint64_t count, void *user_data);
+int latency_counter_foreach_bucket(const latency_counter_t *lc,
+                                   latency_bucket_callback_t callback,
+                                   void *user_data);
+
+/*
+ * NAME
+ *  latency_counter_to_string(counter)
+ *
+ * DESCRIPTION
+ *   Serializes the counter, including all non-empty buckets, into a compact
+ *   string. The returned string must be freed by the caller.
+ */
+char *latency_counter_to_string(const latency_counter_t *lc);
+
+/*
+ * NAME
+ *  latency_counter_merge_string(counter,str)
+ *
+ * DESCRIPTION
+ *   Merges a counter serialized with latency_counter_to_string() into
+ *   "counter". Returns EINVAL if "str" is malformed; "counter" is unchanged
+ *   in that case.
+ */
+int latency_counter_merge_string(latency_counter_t *lc, char const *str);
+
+/*
+ * NAME
+ *  latency_counter_dispatch(counter,vl)
+ *
+ * DESCRIPTION
+ *   Dispatches the whole counter as a single value list of type "histogram".
+ *   Its value is the number of recorded latencies and the serialized counter
+ *   is attached as LATENCY_HISTOGRAM_META meta data, so that writers can
+ *   export the full distribution. Host, plugin, instances, time and interval
+ *   are taken from "vl".
+ */
+int latency_counter_dispatch(const latency_counter_t *lc,
+                             const value_list_t *vl);
+
 #endif /* UTILS_LATENCY_LATENCY_H */
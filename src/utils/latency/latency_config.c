@@ -103,6 +103,8 @@ int latency_config(latency_config_t *conf, oconfig_item_t *ci) {
       status = latency_config_add_bucket(conf, child);
     else if (strcasecmp("BucketType", child->key) == 0)
       status = cf_util_get_string(child, &conf->bucket_type);
+    else if (strcasecmp("Histogram", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf->histogram);
     else
       P_WARNING("\"%s\" is not a valid option within a \"%s\" block.",
                 child->key, ci->key);
@@ -112,9 +114,9 @@ int latency_config(latency_config_t *conf, oconfig_item_t *ci) {
   }
 
   if ((status == 0) && (conf->percentile_num == 0) &&
-      (conf->buckets_num == 0)) {
+      (conf->buckets_num == 0) && !conf->histogram) {
     P_ERROR("The \"%s\" block must contain at least one "
-            "\"Percentile\" or \"Bucket\" option.",
+            "\"Percentile\", \"Bucket\" or \"Histogram\" option.",
             ci->key);
     return EINVAL;
   }
@@ -126,6 +128,7 @@ int latency_config_copy(latency_config_t *dst, const latency_config_t src) {
   *dst = (latency_config_t){
       .percentile_num = src.percentile_num,
       .buckets_num = src.buckets_num,
+      .histogram = src.histogram,
   };
 
   dst->percentile = calloc(dst->percentile_num, sizeof(*dst->percentile));
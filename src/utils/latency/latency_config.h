@@ -46,6 +46,9 @@ typedef struct {
   size_t buckets_num;
   char *bucket_type;
 
+  /* Dispatch the whole histogram, see latency_counter_dispatch(). */
+  bool histogram;
+
   /*
   bool lower;
   bool upper;
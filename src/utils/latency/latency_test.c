@@ -101,16 +101,132 @@ DEF_TEST(percentile) {
   return 0;
 }
 
+DEF_TEST(merge) {
+  latency_counter_t *all, *a, *b;
+
+  CHECK_NOT_NULL(all = latency_counter_create());
+  CHECK_NOT_NULL(a = latency_counter_create());
+  CHECK_NOT_NULL(b = latency_counter_create());
+
+  /* "b" gets values of larger orders of magnitude, so "a" and "b" allocate
+   * different bucket groups. */
+  for (size_t i = 0; i < 100; i++) {
+    cdtime_t v = TIME_T_TO_CDTIME_T(((time_t)i) + 1);
+    if (i >= 50)
+      v *= 100;
+    latency_counter_add(all, v);
+    latency_counter_add((i % 2) ? a : b, v);
+  }
+
+  latency_counter_merge(a, b);
+  EXPECT_EQ_UINT64(latency_counter_get_num(all), latency_counter_get_num(a));
+  EXPECT_EQ_UINT64(latency_counter_get_min(all), latency_counter_get_min(a));
+  EXPECT_EQ_UINT64(latency_counter_get_max(all), latency_counter_get_max(a));
+  EXPECT_EQ_UINT64(latency_counter_get_sum(all), latency_counter_get_sum(a));
+  for (double p = 10.0; p < 100.0; p += 10.0)
+    EXPECT_EQ_UINT64(latency_counter_get_percentile(all, p),
+                     latency_counter_get_percentile(a, p));
+
+  /* Merging an empty counter changes nothing. */
+  latency_counter_reset(b);
+  latency_counter_merge(a, b);
+  EXPECT_EQ_UINT64(latency_counter_get_num(all), latency_counter_get_num(a));
+
+  /* Merging into an empty counter copies the source. */
+  latency_counter_merge(b, all);
+  EXPECT_EQ_UINT64(latency_counter_get_min(all), latency_counter_get_min(b));
+  EXPECT_EQ_UINT64(latency_counter_get_percentile(all, 50.0),
+                   latency_counter_get_percentile(b, 50.0));
+
+  latency_counter_destroy(all);
+  latency_counter_destroy(a);
+  latency_counter_destroy(b);
+  return 0;
+}
+
+DEF_TEST(relative_error) {
+  latency_counter_t *l;
+  cdtime_t values[1000];
+
+  CHECK_NOT_NULL(l = latency_counter_create());
+
+  /* Latencies between 1us and 100s, spread evenly on a logarithmic scale.
+   * Percentiles must be within the histogram's relative error of 1/64. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(values); i++) {
+    double v = 1e-6 * pow(1e8, ((double)i) / 999.0);
+    values[i] = DOUBLE_TO_CDTIME_T(v);
+    latency_counter_add(l, values[i]);
+  }
+
+  for (double p = 1.0; p < 100.0; p += 1.0) {
+    size_t rank = (size_t)ceil(p * 10.0) - 1;
+    double want = CDTIME_T_TO_DOUBLE(values[rank]);
+    double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, p));
+    printf("# p%g: want %g, got %g\n", p, want, got);
+    OK(fabs(got - want) <= want / 64.0);
+  }
+
+  latency_counter_destroy(l);
+  return 0;
+}
+
+DEF_TEST(to_string) {
+  latency_counter_t *l, *copy;
+
+  CHECK_NOT_NULL(l = latency_counter_create());
+  CHECK_NOT_NULL(copy = latency_counter_create());
+
+  char *str;
+  CHECK_NOT_NULL(str = latency_counter_to_string(l));
+  EXPECT_EQ_STR("6 0 0 0 0", str);
+  sfree(str);
+
+  latency_counter_add(l, 3);
+  latency_counter_add(l, 5);
+  latency_counter_add(l, 5);
+  latency_counter_add(l, 100);
+  CHECK_NOT_NULL(str = latency_counter_to_string(l));
+  /* Values are stored in the bucket of (value - 1), i.e. 2, 4 and 99. */
+  EXPECT_EQ_STR("6 4 113 3 100 2:1 1:2 94:1", str);
+
+  CHECK_ZERO(latency_counter_merge_string(copy, str));
+  CHECK_ZERO(latency_counter_merge_string(copy, str));
+  sfree(str);
+
+  EXPECT_EQ_UINT64(8, latency_counter_get_num(copy));
+  EXPECT_EQ_UINT64(226, latency_counter_get_sum(copy));
+  EXPECT_EQ_UINT64(3, latency_counter_get_min(copy));
+  EXPECT_EQ_UINT64(100, latency_counter_get_max(copy));
+  for (double p = 10.0; p < 100.0; p += 10.0)
+    EXPECT_EQ_UINT64(latency_counter_get_percentile(l, p),
+                     latency_counter_get_percentile(copy, p));
+
+  char const *invalid[] = {
+      "",
+      "6 1 3 3",                    /* header too short */
+      "7 1 3 3 3 2:1",              /* different resolution */
+      "6 2 3 3 3 2:1",              /* count mismatch */
+      "6 1 3 3 3 2:0",              /* empty bucket */
+      "6 1 3 3 3 2",                /* missing count */
+      "6 1 3 3 3 3712:1",           /* index out of range */
+      "6 1 3 3 3 2:1 ",             /* trailing garbage */
+      "6 1 3 3 3 -2:1",             /* negative skip */
+  };
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(invalid); i++) {
+    printf("# invalid[%" PRIsz "] = \"%s\"\n", i, invalid[i]);
+    OK(latency_counter_merge_string(copy, invalid[i]) != 0);
+  }
+  EXPECT_EQ_UINT64(8, latency_counter_get_num(copy));
+
+  latency_counter_destroy(l);
+  latency_counter_destroy(copy);
+  return 0;
+}
+
 DEF_TEST(get_rate) {
-  /* We re-declare the struct here so we can inspect its content. */
+  /* We re-declare the start of the struct so we can inspect its start time. */
   struct {
     cdtime_t start_time;
-    cdtime_t sum;
-    size_t num;
-    cdtime_t min;
-    cdtime_t max;
-    cdtime_t bin_width;
-    int histogram[HISTOGRAM_NUM_BINS];
   } * peek;
   latency_counter_t *l;
 
@@ -121,77 +237,49 @@ DEF_TEST(get_rate) {
     latency_counter_add(l, TIME_T_TO_CDTIME_T(i));
   }
 
-  /* We expect a bucket width of 125ms. */
-  EXPECT_EQ_UINT64(DOUBLE_TO_CDTIME_T(0.125), peek->bin_width);
-
-  struct {
-    size_t index;
-    int want;
-  } bucket_cases[] = {
-      {0, 0},  /* (0.000-0.125] */
-      {1, 0},  /* (0.125-0.250] */
-      {2, 0},  /* (0.250-0.375] */
-      {3, 0},  /* (0.375-0.500] */
-      {4, 0},  /* (0.500-0.625] */
-      {5, 0},  /* (0.625-0.750] */
-      {6, 0},  /* (0.750-0.875] */
-      {7, 1},  /* (0.875-1.000] */
-      {8, 0},  /* (1.000-1.125] */
-      {9, 0},  /* (1.125-1.250] */
-      {10, 0}, /* (1.250-1.375] */
-      {11, 0}, /* (1.375-1.500] */
-      {12, 0}, /* (1.500-1.625] */
-      {13, 0}, /* (1.625-1.750] */
-      {14, 0}, /* (1.750-1.875] */
-      {15, 1}, /* (1.875-2.000] */
-      {16, 0}, /* (2.000-2.125] */
-  };
-
-  for (size_t i = 0; i < STATIC_ARRAY_SIZE(bucket_cases); i++) {
-    size_t index = bucket_cases[i].index;
-    EXPECT_EQ_INT(bucket_cases[i].want, peek->histogram[index]);
-  }
-
+  /* Between one and two seconds, buckets are 1/128 s wide: the t=1 update is
+   * in (0.9921875-1.000]. Between two and four seconds buckets are 1/64 s
+   * wide: the t=2 update is in (1.984375-2.000]. */
   struct {
     cdtime_t lower_bound;
     cdtime_t upper_bound;
     double want;
   } cases[] = {
       {
-          // bucket 6 is zero
+          // no updates in this range
           DOUBLE_TO_CDTIME_T_STATIC(0.750),
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           0.00,
       },
       {
-          // bucket 7 contains the t=1 update
+          // contains the t=1 update
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           DOUBLE_TO_CDTIME_T_STATIC(1.000),
           1.00,
       },
       {
-          // range: bucket 7 - bucket 15; contains the t=1 and t=2 updates
+          // contains the t=1 and t=2 updates
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
           DOUBLE_TO_CDTIME_T_STATIC(2.000),
           2.00,
       },
       {
           // lower bucket is only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
+          DOUBLE_TO_CDTIME_T_STATIC(1.000 - (1.0 / 512)),
           DOUBLE_TO_CDTIME_T_STATIC(2.000),
-          1.75,
+          1.25,
       },
       {
           // upper bucket is only partially applied
           DOUBLE_TO_CDTIME_T_STATIC(0.875),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)),
+          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (1.0 / 256)),
           1.75,
       },
       {
           // both buckets are only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)),
-          1.50,
+          DOUBLE_TO_CDTIME_T_STATIC(1.000 - (1.0 / 512)),
+          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (1.0 / 256)),
+          1.00,
       },
       {
           // lower bound is unspecified
@@ -201,7 +289,7 @@ DEF_TEST(get_rate) {
       },
       {
           // upper bound is unspecified
-          DOUBLE_TO_CDTIME_T_STATIC(125.000 - 0.125),
+          DOUBLE_TO_CDTIME_T_STATIC(124.000),
           0,
           1.00,
       },
@@ -245,6 +333,9 @@ DEF_TEST(get_rate) {
 int main(void) {
   RUN_TEST(simple);
   RUN_TEST(percentile);
+  RUN_TEST(merge);
+  RUN_TEST(relative_error);
+  RUN_TEST(to_string);
   RUN_TEST(get_rate);
 
   END_TEST;
@@ -29,9 +29,10 @@
 #include <pthread.h>
 #include <regex.h>
 
-#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/lookup/vl_lookup.h"
+#include "utils_identity.h"
 
 #if HAVE_KSTAT_H
 #include <kstat.h>
@@ -72,8 +73,47 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
+/* The results of lookup_search() are memoized per identifier, so that the
+ * user classes are only matched against the first value of each series. The
+ * memo is split into shards, each with its own lock, by the hash of the
+ * identifier. A shard is emptied when it grows beyond LU_MEMO_SHARD_SIZE
+ * entries, so that series which disappeared don't accumulate. */
+#define LU_MEMO_SHARDS_NUM 16
+#define LU_MEMO_SHARD_SIZE 65536
+/* Series matching more user classes than this are not memoized. */
+#define LU_MEMO_MATCHES_MAX 16
+
+struct user_class_s;
+struct user_obj_s;
+
+typedef struct {
+  struct user_class_s *user_class;
+  struct user_obj_s *user_obj;
+} lu_match_t;
+
+/* The user objects a series has been handled with. */
+typedef struct {
+  /* One more than LU_MEMO_MATCHES_MAX if there were too many matches. */
+  size_t matches_num;
+  lu_match_t matches[LU_MEMO_MATCHES_MAX];
+} lu_matches_t;
+
+/* Allocated as one block, followed by the matches and the name, which is the
+ * key of the memo in its shard's table. */
+typedef struct {
+  char *name;
+  size_t matches_num;
+  lu_match_t *matches;
+} lu_memo_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  c_hashtable_t *table; /* identifier -> lu_memo_t */
+} lu_memo_shard_t;
+
 struct lookup_s {
-  c_avl_tree_t *by_type_tree;
+  c_hashtable_t *by_type_table; /* type -> by_type_entry_t */
+  lu_memo_shard_t memo[LU_MEMO_SHARDS_NUM];
 
   lookup_class_callback_t cb_user_class;
   lookup_obj_callback_t cb_user_obj;
@@ -106,7 +146,10 @@ struct user_class_list_s {
 };
 
 struct by_type_entry_s {
-  c_avl_tree_t *by_plugin_tree; /* plugin -> user_class_list_t */
+  char *type;
+  /* plugin -> user_class_list_t, keyed by the plugin of the list's first
+   * entry. */
+  c_hashtable_t *by_plugin_table;
   user_class_list_t *wildcard_plugin_list;
 };
 typedef struct by_type_entry_s by_type_entry_t;
@@ -114,6 +157,17 @@ typedef struct by_type_entry_s by_type_entry_t;
 /*
  * Private functions
  */
+static uint64_t lu_hash(char const *str) /* {{{ */
+{
+  /* 64 bit FNV-1a, like vl_identity_hash() */
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char const *c = (unsigned char const *)str; *c != 0; c++) {
+    hash ^= (uint64_t)*c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* }}} uint64_t lu_hash */
+
 static bool lu_part_matches(part_match_t const *match, /* {{{ */
                             char const *str) {
   if (match->is_regex) {
@@ -269,11 +323,33 @@ static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
   return NULL;
 } /* }}} user_obj_t *lu_find_user_obj */
 
+/* Calls the user object callback. Returns zero on success, a negative value
+ * if the search is to be aborted and a positive value otherwise. */
+static int lu_call_user_obj(lookup_t *obj, /* {{{ */
+                            data_set_t const *ds, value_list_t const *vl,
+                            user_class_t *user_class, user_obj_t *user_obj) {
+  int status =
+      obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
+  if (status != 0) {
+    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
+          status);
+    /* Returning a negative value means: abort! */
+    if (status < 0)
+      return status;
+    else
+      return 1;
+  }
+
+  return 0;
+} /* }}} int lu_call_user_obj */
+
+/* Handles the value list if it matches the user class. Matches are recorded
+ * in "matches", which may be NULL. */
 static int lu_handle_user_class(lookup_t *obj, /* {{{ */
                                 data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
+                                user_class_t *user_class,
+                                lu_matches_t *matches) {
   user_obj_t *user_obj;
-  int status;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
@@ -299,31 +375,31 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
-  if (status != 0) {
-    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
-          status);
-    /* Returning a negative value means: abort! */
-    if (status < 0)
-      return status;
-    else
-      return 1;
+  if (matches != NULL) {
+    if (matches->matches_num < LU_MEMO_MATCHES_MAX)
+      matches->matches[matches->matches_num] = (lu_match_t){
+          .user_class = user_class,
+          .user_obj = user_obj,
+      };
+    if (matches->matches_num <= LU_MEMO_MATCHES_MAX)
+      matches->matches_num++;
   }
 
-  return 0;
+  return lu_call_user_obj(obj, ds, vl, user_class, user_obj);
 } /* }}} int lu_handle_user_class */
 
 static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
                                      data_set_t const *ds,
                                      value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
+                                     user_class_list_t *user_class_list,
+                                     lu_matches_t *matches) {
   user_class_list_t *ptr;
   int retval = 0;
 
   for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
     int status;
 
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
+    status = lu_handle_user_class(obj, ds, vl, &ptr->entry, matches);
     if (status < 0)
       return status;
     else if (status == 0)
@@ -337,47 +413,46 @@ static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
                                           bool allocate_if_missing) {
   by_type_entry_t *by_type;
-  char *type_copy;
+  uint64_t hash = lu_hash(type);
   int status;
 
-  status = c_avl_get(obj->by_type_tree, type, (void *)&by_type);
+  status = c_hashtable_get(obj->by_type_table, hash, type, (void *)&by_type);
   if (status == 0)
     return by_type;
 
   if (!allocate_if_missing)
     return NULL;
 
-  type_copy = strdup(type);
-  if (type_copy == NULL) {
-    ERROR("utils_vl_lookup: strdup failed.");
-    return NULL;
-  }
-
   by_type = calloc(1, sizeof(*by_type));
   if (by_type == NULL) {
     ERROR("utils_vl_lookup: calloc failed.");
-    sfree(type_copy);
     return NULL;
   }
   by_type->wildcard_plugin_list = NULL;
 
-  by_type->by_plugin_tree =
-      c_avl_create((int (*)(const void *, const void *))strcmp);
-  if (by_type->by_plugin_tree == NULL) {
-    ERROR("utils_vl_lookup: c_avl_create failed.");
+  by_type->type = strdup(type);
+  if (by_type->type == NULL) {
+    ERROR("utils_vl_lookup: strdup failed.");
+    sfree(by_type);
+    return NULL;
+  }
+
+  by_type->by_plugin_table = c_hashtable_create();
+  if (by_type->by_plugin_table == NULL) {
+    ERROR("utils_vl_lookup: c_hashtable_create failed.");
+    sfree(by_type->type);
     sfree(by_type);
-    sfree(type_copy);
     return NULL;
   }
 
-  status = c_avl_insert(obj->by_type_tree,
-                        /* key = */ type_copy, /* value = */ by_type);
+  status = c_hashtable_insert(obj->by_type_table, hash,
+                              /* key = */ by_type->type, /* value = */ by_type);
   assert(status <= 0); /* >0 => entry exists => race condition. */
   if (status != 0) {
-    ERROR("utils_vl_lookup: c_avl_insert failed.");
-    c_avl_destroy(by_type->by_plugin_tree);
+    ERROR("utils_vl_lookup: c_hashtable_insert failed.");
+    c_hashtable_destroy(by_type->by_plugin_table);
+    sfree(by_type->type);
     sfree(by_type);
-    sfree(type_copy);
     return NULL;
   }
 
@@ -402,33 +477,28 @@ static int lu_add_by_plugin(by_type_entry_t *by_type, /* {{{ */
   }    /* if (plugin is wildcard) */
   else /* (plugin is not wildcard) */
   {
+    uint64_t hash = lu_hash(match->plugin.str);
     int status;
 
-    status =
-        c_avl_get(by_type->by_plugin_tree, match->plugin.str, (void *)&ptr);
+    status = c_hashtable_get(by_type->by_plugin_table, hash, match->plugin.str,
+                             (void *)&ptr);
 
-    if (status != 0) /* plugin not yet in tree */
+    if (status != 0) /* plugin not yet in table */
     {
-      char *plugin_copy = strdup(match->plugin.str);
-
-      if (plugin_copy == NULL) {
-        ERROR("utils_vl_lookup: strdup failed.");
-        sfree(user_class_list);
-        return ENOMEM;
-      }
-
-      status =
-          c_avl_insert(by_type->by_plugin_tree, plugin_copy, user_class_list);
+      /* The key is owned by the first entry of the list, which is only freed
+       * together with the table. */
+      status = c_hashtable_insert(by_type->by_plugin_table, hash,
+                                  match->plugin.str, user_class_list);
       if (status != 0) {
-        ERROR("utils_vl_lookup: c_avl_insert(\"%s\") failed with status %i.",
-              plugin_copy, status);
-        sfree(plugin_copy);
+        ERROR("utils_vl_lookup: c_hashtable_insert(\"%s\") failed with "
+              "status %i.",
+              match->plugin.str, status);
         sfree(user_class_list);
         return status;
       } else {
         return 0;
       }
-    } /* if (plugin not yet in tree) */
+    } /* if (plugin not yet in table) */
   }   /* if (plugin is not wildcard) */
 
   assert(ptr != NULL);
@@ -490,32 +560,134 @@ static void lu_destroy_user_class_list(lookup_t *obj, /* {{{ */
 
 static void lu_destroy_by_type(lookup_t *obj, /* {{{ */
                                by_type_entry_t *by_type) {
-
-  while (42) {
-    char *plugin = NULL;
-    user_class_list_t *user_class_list = NULL;
-    int status;
-
-    status = c_avl_pick(by_type->by_plugin_tree, (void *)&plugin,
-                        (void *)&user_class_list);
-    if (status != 0)
-      break;
-
+  char *plugin = NULL;
+  user_class_list_t *user_class_list = NULL;
+  size_t pos = 0;
+
+  /* The table's keys are owned by the lists, so it's destroyed first. */
+  user_class_list_t **lists = calloc(
+      c_hashtable_size(by_type->by_plugin_table) + 1, sizeof(*lists));
+  size_t lists_num = 0;
+  while (c_hashtable_next(by_type->by_plugin_table, &pos, &plugin,
+                          (void *)&user_class_list) == 0) {
     DEBUG("utils_vl_lookup: lu_destroy_by_type: Destroying plugin \"%s\".",
           plugin);
-    sfree(plugin);
-    lu_destroy_user_class_list(obj, user_class_list);
+    if (lists != NULL)
+      lists[lists_num++] = user_class_list;
   }
 
-  c_avl_destroy(by_type->by_plugin_tree);
-  by_type->by_plugin_tree = NULL;
+  c_hashtable_destroy(by_type->by_plugin_table);
+  by_type->by_plugin_table = NULL;
+
+  if (lists == NULL)
+    ERROR("utils_vl_lookup: calloc failed.");
+  for (size_t i = 0; i < lists_num; i++)
+    lu_destroy_user_class_list(obj, lists[i]);
+  sfree(lists);
 
   lu_destroy_user_class_list(obj, by_type->wildcard_plugin_list);
   by_type->wildcard_plugin_list = NULL;
 
+  sfree(by_type->type);
   sfree(by_type);
 } /* }}} int lu_destroy_by_type */
 
+static lu_memo_t *lu_memo_create(char const *name, /* {{{ */
+                                 lu_matches_t const *matches) {
+  size_t name_len = strlen(name) + 1;
+  lu_memo_t *memo = malloc(sizeof(*memo) +
+                           matches->matches_num * sizeof(*memo->matches) +
+                           name_len);
+  if (memo == NULL)
+    return NULL;
+
+  memo->matches_num = matches->matches_num;
+  memo->matches = (lu_match_t *)(memo + 1);
+  memo->name = (char *)(memo->matches + memo->matches_num);
+  memcpy(memo->matches, matches->matches,
+         matches->matches_num * sizeof(*memo->matches));
+  memcpy(memo->name, name, name_len);
+
+  return memo;
+} /* }}} lu_memo_t *lu_memo_create */
+
+/* Frees all memoized results of the shard. shard->lock must be held when
+ * calling this function. The table is recreated rather than emptied, so that
+ * its memory shrinks, too. */
+static int lu_memo_clear(lu_memo_shard_t *shard) /* {{{ */
+{
+  if ((shard->table != NULL) && (c_hashtable_size(shard->table) == 0))
+    return 0;
+
+  if (shard->table != NULL) {
+    char *name = NULL;
+    lu_memo_t *memo = NULL;
+    size_t pos = 0;
+
+    while (c_hashtable_next(shard->table, &pos, &name, (void *)&memo) == 0)
+      free(memo);
+    c_hashtable_destroy(shard->table);
+  }
+
+  shard->table = c_hashtable_create();
+  if (shard->table == NULL) {
+    ERROR("utils_vl_lookup: c_hashtable_create failed.");
+    return ENOMEM;
+  }
+
+  return 0;
+} /* }}} int lu_memo_clear */
+
+/* Forgets all search results, e.g. because a user class has been added. */
+static int lu_memo_reset(lookup_t *obj) /* {{{ */
+{
+  int status = 0;
+
+  for (size_t i = 0; i < LU_MEMO_SHARDS_NUM; i++) {
+    lu_memo_shard_t *shard = obj->memo + i;
+
+    pthread_mutex_lock(&shard->lock);
+    if (lu_memo_clear(shard) != 0)
+      status = ENOMEM;
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return status;
+} /* }}} int lu_memo_reset */
+
+/* Handles the value list with all matching user classes without using the
+ * memo. Matches are recorded in "matches", which may be NULL. */
+static int lu_search(lookup_t *obj, data_set_t const *ds, /* {{{ */
+                     value_list_t const *vl, lu_matches_t *matches) {
+  by_type_entry_t *by_type = NULL;
+  user_class_list_t *user_class_list = NULL;
+  int retval = 0;
+  int status;
+
+  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ false);
+  if (by_type == NULL)
+    return 0;
+
+  status = c_hashtable_get(by_type->by_plugin_table, lu_hash(vl->plugin),
+                           vl->plugin, (void *)&user_class_list);
+  if (status == 0) {
+    status = lu_handle_user_class_list(obj, ds, vl, user_class_list, matches);
+    if (status < 0)
+      return status;
+    retval += status;
+  }
+
+  if (by_type->wildcard_plugin_list != NULL) {
+    status = lu_handle_user_class_list(obj, ds, vl,
+                                       by_type->wildcard_plugin_list, matches);
+    if (status < 0)
+      return status;
+    retval += status;
+  }
+
+  return retval;
+} /* }}} int lu_search */
+
 /*
  * Public functions
  */
@@ -529,13 +701,20 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
     return NULL;
   }
 
-  obj->by_type_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
-  if (obj->by_type_tree == NULL) {
-    ERROR("utils_vl_lookup: c_avl_create failed.");
+  obj->by_type_table = c_hashtable_create();
+  if (obj->by_type_table == NULL) {
+    ERROR("utils_vl_lookup: c_hashtable_create failed.");
     sfree(obj);
     return NULL;
   }
 
+  for (size_t i = 0; i < LU_MEMO_SHARDS_NUM; i++)
+    pthread_mutex_init(&obj->memo[i].lock, /* attr = */ NULL);
+  if (lu_memo_reset(obj) != 0) {
+    lookup_destroy(obj);
+    return NULL;
+  }
+
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
   obj->cb_free_class = cb_free_class;
@@ -546,26 +725,42 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
 
 void lookup_destroy(lookup_t *obj) /* {{{ */
 {
-  int status;
+  char *type = NULL;
+  by_type_entry_t *by_type = NULL;
+  size_t pos = 0;
 
   if (obj == NULL)
     return;
 
-  while (42) {
-    char *type = NULL;
-    by_type_entry_t *by_type = NULL;
+  /* The memo points to user objects, so it goes first. */
+  for (size_t i = 0; i < LU_MEMO_SHARDS_NUM; i++) {
+    lu_memo_shard_t *shard = obj->memo + i;
 
-    status = c_avl_pick(obj->by_type_tree, (void *)&type, (void *)&by_type);
-    if (status != 0)
-      break;
+    lu_memo_clear(shard);
+    c_hashtable_destroy(shard->table);
+    shard->table = NULL;
+    pthread_mutex_destroy(&shard->lock);
+  }
 
+  /* Keys are owned by the entries, which are freed after the table. */
+  by_type_entry_t **entries =
+      calloc(c_hashtable_size(obj->by_type_table) + 1, sizeof(*entries));
+  size_t entries_num = 0;
+  while (c_hashtable_next(obj->by_type_table, &pos, &type,
+                          (void *)&by_type) == 0) {
     DEBUG("utils_vl_lookup: lookup_destroy: Destroying type \"%s\".", type);
-    sfree(type);
-    lu_destroy_by_type(obj, by_type);
+    if (entries != NULL)
+      entries[entries_num++] = by_type;
   }
 
-  c_avl_destroy(obj->by_type_tree);
-  obj->by_type_tree = NULL;
+  c_hashtable_destroy(obj->by_type_table);
+  obj->by_type_table = NULL;
+
+  if (entries == NULL)
+    ERROR("utils_vl_lookup: calloc failed.");
+  for (size_t i = 0; i < entries_num; i++)
+    lu_destroy_by_type(obj, entries[i]);
+  sfree(entries);
 
   sfree(obj);
 } /* }}} void lookup_destroy */
@@ -591,40 +786,84 @@ int lookup_add(lookup_t *obj, /* {{{ */
   user_class_obj->entry.user_obj_list = NULL;
   user_class_obj->next = NULL;
 
-  return lu_add_by_plugin(by_type, user_class_obj);
+  int status = lu_add_by_plugin(by_type, user_class_obj);
+  if (status != 0)
+    return status;
+
+  /* Series seen so far may match the new user class, too. */
+  return lu_memo_reset(obj);
 } /* }}} int lookup_add */
 
 /* returns the number of successful calls to the callback function */
 int lookup_search(lookup_t *obj, /* {{{ */
                   data_set_t const *ds, value_list_t const *vl) {
-  by_type_entry_t *by_type = NULL;
-  user_class_list_t *user_class_list = NULL;
-  int retval = 0;
-  int status;
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint64_t hash;
 
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
 
-  by_type = lu_search_by_type(obj, vl->type, /* allocate = */ false);
-  if (by_type == NULL)
-    return 0;
-
-  status =
-      c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
-  if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  vl_identity_t const *id = plugin_value_list_identity(vl);
+  if (id != NULL) {
+    name = id->name;
+    hash = id->hash;
+  } else if (FORMAT_VL(buffer, sizeof(buffer), vl) == 0) {
+    name = buffer;
+    hash = lu_hash(buffer);
+  } else
+    return lu_search(obj, ds, vl, /* matches = */ NULL);
+
+  /* The table uses the low bits of the hash, so the shard is chosen by the
+   * high bits. */
+  lu_memo_shard_t *shard = obj->memo + ((hash >> 60) % LU_MEMO_SHARDS_NUM);
+  lu_matches_t matches = {0};
+  bool found = false;
+
+  /* The matches are copied, because the memo may be freed by another thread
+   * while the callbacks run. */
+  pthread_mutex_lock(&shard->lock);
+  lu_memo_t *memo = NULL;
+  if (c_hashtable_get(shard->table, hash, name, (void *)&memo) == 0) {
+    matches.matches_num = memo->matches_num;
+    memcpy(matches.matches, memo->matches,
+           memo->matches_num * sizeof(*memo->matches));
+    found = true;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  if (found) {
+    int retval = 0;
+    for (size_t i = 0; i < matches.matches_num; i++) {
+      int status = lu_call_user_obj(obj, ds, vl, matches.matches[i].user_class,
+                                    matches.matches[i].user_obj);
+      if (status < 0)
+        return status;
+      else if (status == 0)
+        retval++;
+    }
+    return retval;
   }
 
-  if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  int retval = lu_search(obj, ds, vl, &matches);
+  /* Results of aborted searches are incomplete. */
+  if ((retval < 0) || (matches.matches_num > LU_MEMO_MATCHES_MAX))
+    return retval;
+
+  memo = lu_memo_create(name, &matches);
+  if (memo == NULL) {
+    ERROR("utils_vl_lookup: malloc failed.");
+    return retval;
   }
 
+  pthread_mutex_lock(&shard->lock);
+  if (c_hashtable_size(shard->table) >= LU_MEMO_SHARD_SIZE)
+    lu_memo_clear(shard);
+  /* Another thread may have memoized the same series in the meantime. */
+  if ((shard->table == NULL) ||
+      (c_hashtable_insert(shard->table, hash, memo->name, memo) != 0))
+    free(memo);
+  pthread_mutex_unlock(&shard->lock);
+
   return retval;
 } /* }}} lookup_search */
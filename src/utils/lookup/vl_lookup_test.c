@@ -231,12 +231,48 @@ DEF_TEST(regex) {
   return 0;
 }
 
+DEF_TEST(memoized_search) {
+  lookup_t *obj;
+  int status;
+
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "plugin0", "", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  /* Repeated searches for the same series are answered from the memo and
+   * still reach the callback. */
+  for (int i = 0; i < 3; i++) {
+    status = checked_lookup_search(obj, "host0", "plugin0", "", "test", "ti0",
+                                   /* expect new = */ i == 0);
+    EXPECT_EQ_INT(1, status);
+    EXPECT_EQ_STR("host0", last_obj_ident.host);
+  }
+  status = checked_lookup_search(obj, "host0", "plugin1", "", "test", "ti0",
+                                 /* expect new = */ 0);
+  EXPECT_EQ_INT(0, status);
+
+  /* Adding a class invalidates the memoized results. */
+  checked_lookup_add(obj, "/.*/", "/.*/", "", "test", "ti0", LU_GROUP_BY_HOST);
+  status = checked_lookup_search(obj, "host0", "plugin1", "", "test", "ti0",
+                                 /* expect new = */ 1);
+  EXPECT_EQ_INT(1, status);
+  status = checked_lookup_search(obj, "host0", "plugin0", "", "test", "ti0",
+                                 /* expect new = */ 0);
+  EXPECT_EQ_INT(2, status);
+
+  lookup_destroy(obj);
+  return 0;
+}
+
 int main(int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(memoized_search);
 
   END_TEST;
 } /* }}} int main */
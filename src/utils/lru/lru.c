@@ -0,0 +1,223 @@
+/**
+ * collectd - src/utils/lru/lru.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include <stdlib.h>
+
+#include "utils/lru/lru.h"
+
+/* Marks the end of the recency list and empty hash slots. */
+#define LRU_NONE SIZE_MAX
+
+struct lru_node_s {
+  uint64_t key;
+  void *value;
+  /* Recency list, most recently used first. */
+  size_t prev;
+  size_t next;
+};
+typedef struct lru_node_s lru_node_t;
+
+struct c_lru_s {
+  lru_node_t *nodes;
+  size_t size;
+  size_t num;
+
+  /* Open addressing table of node indices, at most half full. */
+  size_t *slots;
+  size_t slots_mask;
+
+  size_t head;
+  size_t tail;
+
+  void (*free_value)(void *);
+};
+
+/* Keys may be sequential numbers rather than hashes, so mix the bits before
+ * using them as a hash. */
+static size_t lru_home(c_lru_t const *c, uint64_t key) /* {{{ */
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (size_t)key & c->slots_mask;
+} /* }}} size_t lru_home */
+
+/* Returns the slot holding `key' or the empty slot where it would be stored. */
+static size_t lru_find(c_lru_t const *c, uint64_t key) /* {{{ */
+{
+  for (size_t i = lru_home(c, key);; i = (i + 1) & c->slots_mask) {
+    size_t n = c->slots[i];
+    if ((n == LRU_NONE) || (c->nodes[n].key == key))
+      return i;
+  }
+} /* }}} size_t lru_find */
+
+/* Backward shift deletion, see c_hashtable_remove(). */
+static void lru_slot_remove(c_lru_t *c, size_t gap) /* {{{ */
+{
+  size_t mask = c->slots_mask;
+
+  for (size_t i = (gap + 1) & mask; c->slots[i] != LRU_NONE;
+       i = (i + 1) & mask) {
+    size_t home = lru_home(c, c->nodes[c->slots[i]].key);
+    if (((i - home) & mask) >= ((i - gap) & mask)) {
+      c->slots[gap] = c->slots[i];
+      gap = i;
+    }
+  }
+  c->slots[gap] = LRU_NONE;
+} /* }}} void lru_slot_remove */
+
+static void lru_unlink(c_lru_t *c, size_t n) /* {{{ */
+{
+  lru_node_t *node = c->nodes + n;
+
+  if (node->prev != LRU_NONE)
+    c->nodes[node->prev].next = node->next;
+  else
+    c->head = node->next;
+
+  if (node->next != LRU_NONE)
+    c->nodes[node->next].prev = node->prev;
+  else
+    c->tail = node->prev;
+} /* }}} void lru_unlink */
+
+static void lru_push_front(c_lru_t *c, size_t n) /* {{{ */
+{
+  lru_node_t *node = c->nodes + n;
+
+  node->prev = LRU_NONE;
+  node->next = c->head;
+  if (c->head != LRU_NONE)
+    c->nodes[c->head].prev = n;
+  else
+    c->tail = n;
+  c->head = n;
+} /* }}} void lru_push_front */
+
+c_lru_t *c_lru_create(size_t size, void (*free_value)(void *)) /* {{{ */
+{
+  if (size == 0)
+    return NULL;
+
+  c_lru_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+
+  size_t slots_num = 2;
+  while (slots_num < 2 * size)
+    slots_num *= 2;
+
+  c->nodes = calloc(size, sizeof(*c->nodes));
+  c->slots = calloc(slots_num, sizeof(*c->slots));
+  if ((c->nodes == NULL) || (c->slots == NULL)) {
+    free(c->nodes);
+    free(c->slots);
+    free(c);
+    return NULL;
+  }
+  for (size_t i = 0; i < slots_num; i++)
+    c->slots[i] = LRU_NONE;
+
+  c->size = size;
+  c->slots_mask = slots_num - 1;
+  c->head = LRU_NONE;
+  c->tail = LRU_NONE;
+  c->free_value = free_value;
+
+  return c;
+} /* }}} c_lru_t *c_lru_create */
+
+void c_lru_destroy(c_lru_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  if (c->free_value != NULL)
+    for (size_t i = 0; i < c->num; i++)
+      c->free_value(c->nodes[i].value);
+
+  free(c->nodes);
+  free(c->slots);
+  free(c);
+} /* }}} void c_lru_destroy */
+
+int c_lru_get(c_lru_t *c, uint64_t key, void **value) /* {{{ */
+{
+  if (c == NULL)
+    return -1;
+
+  size_t n = c->slots[lru_find(c, key)];
+  if (n == LRU_NONE)
+    return -1;
+
+  if (c->head != n) {
+    lru_unlink(c, n);
+    lru_push_front(c, n);
+  }
+
+  if (value != NULL)
+    *value = c->nodes[n].value;
+  return 0;
+} /* }}} int c_lru_get */
+
+int c_lru_put(c_lru_t *c, uint64_t key, void *value) /* {{{ */
+{
+  if (c == NULL)
+    return -1;
+
+  size_t slot = lru_find(c, key);
+  size_t n = c->slots[slot];
+
+  if (n != LRU_NONE) {
+    if (c->free_value != NULL)
+      c->free_value(c->nodes[n].value);
+    lru_unlink(c, n);
+  } else if (c->num < c->size) {
+    n = c->num;
+    c->num++;
+    c->slots[slot] = n;
+  } else {
+    /* Reuse the least recently used node. */
+    n = c->tail;
+    lru_unlink(c, n);
+    lru_slot_remove(c, lru_find(c, c->nodes[n].key));
+    if (c->free_value != NULL)
+      c->free_value(c->nodes[n].value);
+    /* Removing may have moved the empty slot for `key'. */
+    c->slots[lru_find(c, key)] = n;
+  }
+
+  c->nodes[n].key = key;
+  c->nodes[n].value = value;
+  lru_push_front(c, n);
+  return 0;
+} /* }}} int c_lru_put */
+
+size_t c_lru_size(c_lru_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return 0;
+  return c->num;
+} /* }}} size_t c_lru_size */
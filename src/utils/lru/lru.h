@@ -0,0 +1,97 @@
+/**
+ * collectd - src/utils/lru/lru.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_LRU_H
+#define UTILS_LRU_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A cache of a fixed number of entries with integer keys, such as the hashes
+ * of value list identities. When the cache is full, inserting a new key
+ * evicts the least recently used entry. Like the hash table, the cache does
+ * not do any locking.
+ */
+struct c_lru_s;
+typedef struct c_lru_s c_lru_t;
+
+/*
+ * NAME
+ *   c_lru_create
+ *
+ * DESCRIPTION
+ *   Creates a cache holding at most `size' entries. `free_value', if not
+ *   NULL, is called for values that are evicted, replaced or still stored
+ *   when the cache is destroyed.
+ *
+ * RETURN VALUE
+ *   A new, empty cache or NULL upon failure.
+ */
+c_lru_t *c_lru_create(size_t size, void (*free_value)(void *));
+
+/*
+ * NAME
+ *   c_lru_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates the cache and, using `free_value', all stored values.
+ */
+void c_lru_destroy(c_lru_t *c);
+
+/*
+ * NAME
+ *   c_lru_get
+ *
+ * DESCRIPTION
+ *   Looks up `key', stores its value in `value', unless `value' is NULL, and
+ *   marks the entry as most recently used.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key does not exist.
+ */
+int c_lru_get(c_lru_t *c, uint64_t key, void **value);
+
+/*
+ * NAME
+ *   c_lru_put
+ *
+ * DESCRIPTION
+ *   Stores `value' under `key', replacing any previous value, and marks the
+ *   entry as most recently used.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if `c' is NULL.
+ */
+int c_lru_put(c_lru_t *c, uint64_t key, void *value);
+
+/*
+ * NAME
+ *   c_lru_size
+ *
+ * RETURN VALUE
+ *   The number of entries in the cache.
+ */
+size_t c_lru_size(c_lru_t *c);
+
+#endif /* UTILS_LRU_H */
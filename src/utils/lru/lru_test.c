@@ -0,0 +1,102 @@
+/**
+ * collectd - src/utils/lru/lru_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/lru/lru.h"
+
+static int freed;
+
+static void count_free(void *value) {
+  (void)value;
+  freed++;
+}
+
+DEF_TEST(simple) {
+  c_lru_t *c;
+  CHECK_NOT_NULL(c = c_lru_create(3, count_free));
+
+  for (uintptr_t i = 1; i <= 3; i++)
+    CHECK_ZERO(c_lru_put(c, i, (void *)i));
+  EXPECT_EQ_INT(3, (int)c_lru_size(c));
+
+  /* Make 1 the most recently used key, so 2 is evicted by 4. */
+  void *value = NULL;
+  CHECK_ZERO(c_lru_get(c, 1, &value));
+  OK(value == (void *)1);
+
+  freed = 0;
+  CHECK_ZERO(c_lru_put(c, 4, (void *)4));
+  EXPECT_EQ_INT(1, freed);
+  EXPECT_EQ_INT(3, (int)c_lru_size(c));
+  OK(c_lru_get(c, 2, NULL) != 0);
+  CHECK_ZERO(c_lru_get(c, 1, NULL));
+  CHECK_ZERO(c_lru_get(c, 3, NULL));
+  CHECK_ZERO(c_lru_get(c, 4, NULL));
+
+  /* Replacing a value frees the old one. */
+  CHECK_ZERO(c_lru_put(c, 3, (void *)33));
+  EXPECT_EQ_INT(2, freed);
+  CHECK_ZERO(c_lru_get(c, 3, &value));
+  OK(value == (void *)33);
+
+  c_lru_destroy(c);
+  EXPECT_EQ_INT(5, freed);
+  return 0;
+}
+
+DEF_TEST(eviction) {
+  c_lru_t *c;
+  CHECK_NOT_NULL(c = c_lru_create(100, NULL));
+
+  /* Sequential keys, as with identity ids. Only the last 100 remain. */
+  for (uintptr_t i = 0; i < 10000; i++) {
+    CHECK_ZERO(c_lru_put(c, i, (void *)i));
+    /* Keep key 0 alive by using it. */
+    CHECK_ZERO(c_lru_get(c, 0, NULL));
+  }
+  EXPECT_EQ_INT(100, (int)c_lru_size(c));
+
+  CHECK_ZERO(c_lru_get(c, 0, NULL));
+  for (uintptr_t i = 1; i < 10000; i++) {
+    void *value = NULL;
+    int status = c_lru_get(c, i, &value);
+    if (i >= 10000 - 99) {
+      CHECK_ZERO(status);
+      OK(value == (void *)i);
+    } else {
+      OK(status != 0);
+    }
+  }
+
+  c_lru_destroy(c);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(eviction);
+
+  END_TEST;
+}
@@ -37,6 +37,7 @@
 #define UTILS_MATCH_FLAGS_REGEX 0x04
 
 struct cu_match_s {
+  char *regex_str;
   regex_t regex;
   regex_t excluderegex;
   int flags;
@@ -229,9 +230,16 @@ match_create_callback(const char *regex, const char *excluderegex,
   if (obj == NULL)
     return NULL;
 
+  obj->regex_str = strdup(regex);
+  if (obj->regex_str == NULL) {
+    sfree(obj);
+    return NULL;
+  }
+
   status = regcomp(&obj->regex, regex, REG_EXTENDED | REG_NEWLINE);
   if (status != 0) {
     ERROR("Compiling the regular expression \"%s\" failed.", regex);
+    sfree(obj->regex_str);
     sfree(obj);
     return NULL;
   }
@@ -242,6 +250,8 @@ match_create_callback(const char *regex, const char *excluderegex,
     if (status != 0) {
       ERROR("Compiling the excluding regular expression \"%s\" failed.",
             excluderegex);
+      regfree(&obj->regex);
+      sfree(obj->regex_str);
       sfree(obj);
       return NULL;
     }
@@ -310,6 +320,7 @@ void match_destroy(cu_match_t *obj) {
   if ((obj->user_data != NULL) && (obj->free != NULL))
     (*obj->free)(obj->user_data);
 
+  sfree(obj->regex_str);
   sfree(obj);
 } /* void match_destroy */
 
@@ -374,3 +385,9 @@ void *match_get_user_data(cu_match_t *obj) {
     return NULL;
   return obj->user_data;
 } /* void *match_get_user_data */
+
+const char *match_get_regex(cu_match_t *obj) {
+  if (obj == NULL)
+    return NULL;
+  return obj->regex_str;
+} /* const char *match_get_regex */
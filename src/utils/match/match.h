@@ -176,4 +176,13 @@ int match_apply(cu_match_t *obj, const char *str);
  */
 void *match_get_user_data(cu_match_t *obj);
 
+/*
+ * NAME
+ *  match_get_regex
+ *
+ * DESCRIPTION
+ *  Returns the regular expression `obj' has been created with.
+ */
+const char *match_get_regex(cu_match_t *obj);
+
 #endif /* UTILS_MATCH_H */
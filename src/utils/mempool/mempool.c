@@ -0,0 +1,377 @@
+/**
+ * collectd - src/utils/mempool/mempool.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "utils/mempool/mempool.h"
+#include "utils/memtrack/memtrack.h"
+
+/* Objects are aligned like malloc(3) would align them on common platforms. */
+#define MEMPOOL_ALIGN 16
+/* Number of objects allocated at once when the pool runs empty. */
+#define MEMPOOL_SLAB_OBJECTS 64
+/* Number of free objects a thread may hold. Once reached, half of them are
+ * returned to the pool. */
+#define MEMPOOL_CACHE_SIZE 128
+
+#define MEMPOOL_ROUND_UP(n)                                                    \
+  (((n) + MEMPOOL_ALIGN - 1) & ~((size_t)MEMPOOL_ALIGN - 1))
+
+struct mempool_object_s;
+typedef struct mempool_object_s mempool_object_t;
+struct mempool_object_s {
+  mempool_object_t *next;
+};
+
+struct mempool_slab_s;
+typedef struct mempool_slab_s mempool_slab_t;
+struct mempool_slab_s {
+  mempool_slab_t *next;
+};
+
+struct mempool_cache_s;
+typedef struct mempool_cache_s mempool_cache_t;
+struct mempool_cache_s {
+  c_mempool_t *pool;
+
+  mempool_object_t *head;
+  size_t num;
+
+  /* Not yet added to the pool's totals. */
+  uint64_t hits;
+
+  mempool_cache_t *prev;
+  mempool_cache_t *next;
+};
+
+struct c_mempool_s {
+  char *name;
+  size_t object_size;
+  /* Slabs are charged to the tag named like the pool. */
+  memtrack_t *memtrack;
+
+  /* Per thread mempool_cache_t. */
+  pthread_key_t cache_key;
+
+  /* Protects everything below. */
+  pthread_mutex_t lock;
+  mempool_object_t *head;
+  size_t num;
+  mempool_slab_t *slabs;
+  mempool_cache_t *caches;
+  uint64_t hits;
+  uint64_t misses;
+
+  c_mempool_t *next;
+};
+
+static pthread_mutex_t mempool_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static c_mempool_t *mempool_list;
+
+/* Allocates a new slab and returns its objects as a list. The pool's lock must
+ * be held. */
+static size_t mempool_slab_size(c_mempool_t const *pool) /* {{{ */
+{
+  return MEMPOOL_ROUND_UP(sizeof(mempool_slab_t)) +
+         MEMPOOL_SLAB_OBJECTS * pool->object_size;
+} /* }}} size_t mempool_slab_size */
+
+static mempool_object_t *mempool_slab_alloc(c_mempool_t *pool) /* {{{ */
+{
+  size_t header_size = MEMPOOL_ROUND_UP(sizeof(mempool_slab_t));
+  char *mem = malloc(mempool_slab_size(pool));
+  if (mem == NULL)
+    return NULL;
+  memtrack_add(pool->memtrack, (int64_t)mempool_slab_size(pool));
+
+  mempool_slab_t *slab = (mempool_slab_t *)(void *)mem;
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  mempool_object_t *head = NULL;
+  for (size_t i = MEMPOOL_SLAB_OBJECTS; i > 0; i--) {
+    mempool_object_t *obj =
+        (mempool_object_t *)(void *)(mem + header_size +
+                                     (i - 1) * pool->object_size);
+    obj->next = head;
+    head = obj;
+  }
+
+  return head;
+} /* }}} mempool_object_t *mempool_slab_alloc */
+
+/* Moves up to `num' objects from `*head' to the list `*dest'. Returns the
+ * number of objects moved. */
+static size_t mempool_move(mempool_object_t **dest, /* {{{ */
+                           mempool_object_t **head, size_t num) {
+  size_t moved = 0;
+
+  while ((moved < num) && (*head != NULL)) {
+    mempool_object_t *obj = *head;
+    *head = obj->next;
+    obj->next = *dest;
+    *dest = obj;
+    moved++;
+  }
+
+  return moved;
+} /* }}} size_t mempool_move */
+
+/* Returns all objects held by the cache to the pool and unlinks it. The
+ * pool's lock must be held. */
+static void mempool_cache_release(c_mempool_t *pool, /* {{{ */
+                                  mempool_cache_t *c) {
+  pool->num += mempool_move(&pool->head, &c->head, c->num);
+  c->num = 0;
+  pool->hits += c->hits;
+  c->hits = 0;
+
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    pool->caches = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+} /* }}} void mempool_cache_release */
+
+static void mempool_cache_destroy(void *arg) /* {{{ */
+{
+  mempool_cache_t *c = arg;
+  c_mempool_t *pool = c->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  mempool_cache_release(pool, c);
+  pthread_mutex_unlock(&pool->lock);
+
+  free(c);
+} /* }}} void mempool_cache_destroy */
+
+static mempool_cache_t *mempool_cache_get(c_mempool_t *pool) /* {{{ */
+{
+  mempool_cache_t *c = pthread_getspecific(pool->cache_key);
+  if (c != NULL)
+    return c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  c->pool = pool;
+
+  if (pthread_setspecific(pool->cache_key, c) != 0) {
+    free(c);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  c->next = pool->caches;
+  if (c->next != NULL)
+    c->next->prev = c;
+  pool->caches = c;
+  pthread_mutex_unlock(&pool->lock);
+
+  return c;
+} /* }}} mempool_cache_t *mempool_cache_get */
+
+c_mempool_t *c_mempool_create(const char *name, size_t object_size) /* {{{ */
+{
+  if ((name == NULL) || (object_size == 0))
+    return NULL;
+
+  c_mempool_t *pool = calloc(1, sizeof(*pool));
+  if (pool == NULL)
+    return NULL;
+
+  pool->name = strdup(name);
+  if (pool->name == NULL) {
+    free(pool);
+    return NULL;
+  }
+
+  if (object_size < sizeof(mempool_object_t))
+    object_size = sizeof(mempool_object_t);
+  pool->object_size = MEMPOOL_ROUND_UP(object_size);
+  pool->memtrack = memtrack_get(name);
+
+  if (pthread_key_create(&pool->cache_key, mempool_cache_destroy) != 0) {
+    free(pool->name);
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, /* attr = */ NULL);
+
+  pthread_mutex_lock(&mempool_list_lock);
+  pool->next = mempool_list;
+  mempool_list = pool;
+  pthread_mutex_unlock(&mempool_list_lock);
+
+  return pool;
+} /* }}} c_mempool_t *c_mempool_create */
+
+void c_mempool_destroy(c_mempool_t *pool) /* {{{ */
+{
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&mempool_list_lock);
+  for (c_mempool_t **p = &mempool_list; *p != NULL; p = &(*p)->next) {
+    if (*p == pool) {
+      *p = pool->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mempool_list_lock);
+
+  /* Thread caches are not freed by pthread_key_delete(). */
+  pthread_key_delete(pool->cache_key);
+  while (pool->caches != NULL) {
+    mempool_cache_t *c = pool->caches;
+    pool->caches = c->next;
+    free(c);
+  }
+
+  while (pool->slabs != NULL) {
+    mempool_slab_t *slab = pool->slabs;
+    pool->slabs = slab->next;
+    free(slab);
+    memtrack_add(pool->memtrack, -(int64_t)mempool_slab_size(pool));
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->name);
+  free(pool);
+} /* }}} void c_mempool_destroy */
+
+void *c_mempool_alloc(c_mempool_t *pool) /* {{{ */
+{
+  if (pool == NULL)
+    return NULL;
+
+  mempool_cache_t *c = mempool_cache_get(pool);
+  if ((c != NULL) && (c->head != NULL)) {
+    mempool_object_t *obj = c->head;
+    c->head = obj->next;
+    c->num--;
+    c->hits++;
+    return obj;
+  }
+
+  /* The thread's cache is empty: refill it from the pool or a new slab. */
+  mempool_object_t *obj = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->head != NULL) {
+    obj = pool->head;
+    pool->head = obj->next;
+    pool->num--;
+    pool->hits++;
+  } else {
+    obj = mempool_slab_alloc(pool);
+    if (obj != NULL) {
+      pool->head = obj->next;
+      pool->num += MEMPOOL_SLAB_OBJECTS - 1;
+    }
+    pool->misses++;
+  }
+
+  if (c != NULL) {
+    size_t moved = mempool_move(&c->head, &pool->head, MEMPOOL_CACHE_SIZE / 2);
+    c->num += moved;
+    pool->num -= moved;
+    pool->hits += c->hits;
+    c->hits = 0;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return obj;
+} /* }}} void *c_mempool_alloc */
+
+void c_mempool_free(c_mempool_t *pool, void *ptr) /* {{{ */
+{
+  if ((pool == NULL) || (ptr == NULL))
+    return;
+
+  mempool_object_t *obj = ptr;
+
+  mempool_cache_t *c = mempool_cache_get(pool);
+  if (c == NULL) {
+    pthread_mutex_lock(&pool->lock);
+    obj->next = pool->head;
+    pool->head = obj;
+    pool->num++;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+
+  obj->next = c->head;
+  c->head = obj;
+  c->num++;
+
+  if (c->num < MEMPOOL_CACHE_SIZE)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  size_t moved = mempool_move(&pool->head, &c->head, MEMPOOL_CACHE_SIZE / 2);
+  c->num -= moved;
+  pool->num += moved;
+  pool->hits += c->hits;
+  c->hits = 0;
+  pthread_mutex_unlock(&pool->lock);
+} /* }}} void c_mempool_free */
+
+void c_mempool_stats(c_mempool_t *pool, uint64_t *hits, /* {{{ */
+                     uint64_t *misses) {
+  if (pool == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  if (hits != NULL)
+    *hits = pool->hits;
+  if (misses != NULL)
+    *misses = pool->misses;
+  pthread_mutex_unlock(&pool->lock);
+} /* }}} void c_mempool_stats */
+
+const char *c_mempool_name(c_mempool_t *pool) /* {{{ */
+{
+  if (pool == NULL)
+    return NULL;
+  return pool->name;
+} /* }}} const char *c_mempool_name */
+
+int c_mempool_foreach(int (*callback)(c_mempool_t *, void *), /* {{{ */
+                      void *user_data) {
+  int status = 0;
+
+  pthread_mutex_lock(&mempool_list_lock);
+  for (c_mempool_t *pool = mempool_list; pool != NULL; pool = pool->next) {
+    status = (*callback)(pool, user_data);
+    if (status != 0)
+      break;
+  }
+  pthread_mutex_unlock(&mempool_list_lock);
+
+  return status;
+} /* }}} int c_mempool_foreach */
@@ -0,0 +1,122 @@
+/**
+ * collectd - src/utils/mempool/mempool.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_MEMPOOL_H
+#define UTILS_MEMPOOL_H 1
+
+#include <stdint.h>
+
+/*
+ * A pool of fixed-size objects. Objects are carved out of larger slabs and
+ * are never returned to the system while the pool exists, which keeps
+ * short-lived objects that are allocated on one thread and freed on another
+ * from fragmenting the malloc(3) arenas. Each thread keeps a small cache of
+ * free objects, so most allocations don't take the pool's lock.
+ */
+struct c_mempool_s;
+typedef struct c_mempool_s c_mempool_t;
+
+/*
+ * NAME
+ *   c_mempool_create
+ *
+ * DESCRIPTION
+ *   Allocates a new pool handing out objects of `object_size' bytes. The pool
+ *   is registered under `name', see c_mempool_foreach() below. The memory of
+ *   the pool is charged to the memtrack_t tag of the same name.
+ *
+ * RETURN VALUE
+ *   A c_mempool_t-pointer upon success or NULL upon failure.
+ */
+c_mempool_t *c_mempool_create(const char *name, size_t object_size);
+
+/*
+ * NAME
+ *   c_mempool_destroy
+ *
+ * DESCRIPTION
+ *   Frees the pool and all objects allocated from it. No thread may use the
+ *   pool or any of its objects afterwards.
+ */
+void c_mempool_destroy(c_mempool_t *pool);
+
+/*
+ * NAME
+ *   c_mempool_alloc
+ *
+ * DESCRIPTION
+ *   Returns an object from the pool. Like malloc(3), the memory is not
+ *   initialized.
+ *
+ * RETURN VALUE
+ *   A pointer to the object or NULL if `pool' is NULL or memory is exhausted.
+ */
+void *c_mempool_alloc(c_mempool_t *pool);
+
+/*
+ * NAME
+ *   c_mempool_free
+ *
+ * DESCRIPTION
+ *   Returns an object obtained from c_mempool_alloc() on the same pool. Any
+ *   thread may free the object. Passing NULL is a no-op.
+ */
+void c_mempool_free(c_mempool_t *pool, void *ptr);
+
+/*
+ * NAME
+ *   c_mempool_stats
+ *
+ * DESCRIPTION
+ *   Returns the number of allocations served from free objects (`hits') and
+ *   the number of allocations that required a new slab (`misses'). The
+ *   counters of a thread are added to the pool's totals whenever the thread
+ *   exchanges objects with the pool, so they may lag slightly behind.
+ */
+void c_mempool_stats(c_mempool_t *pool, uint64_t *hits, uint64_t *misses);
+
+/*
+ * NAME
+ *   c_mempool_name
+ *
+ * RETURN VALUE
+ *   The name the pool has been created with.
+ */
+const char *c_mempool_name(c_mempool_t *pool);
+
+/*
+ * NAME
+ *   c_mempool_foreach
+ *
+ * DESCRIPTION
+ *   Calls `callback' for each existing pool, e.g. to report statistics. Pools
+ *   must not be created or destroyed from within the callback.
+ *
+ * RETURN VALUE
+ *   Zero if the callback returned zero for all pools. Otherwise, the iteration
+ *   is stopped and the callback's return value is returned.
+ */
+int c_mempool_foreach(int (*callback)(c_mempool_t *pool, void *user_data),
+                      void *user_data);
+
+#endif /* UTILS_MEMPOOL_H */
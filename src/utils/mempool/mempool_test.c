@@ -0,0 +1,151 @@
+/**
+ * collectd - src/utils/mempool/mempool_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include <pthread.h>
+
+#include "testing.h"
+#include "utils/mempool/mempool.h"
+#include "utils/memtrack/memtrack.h"
+
+#define OBJECTS_NUM 1000
+
+static int count_pool(c_mempool_t *pool, void *user_data) {
+  int *count = user_data;
+  if (strcmp("test", c_mempool_name(pool)) == 0)
+    (*count)++;
+  return 0;
+}
+
+DEF_TEST(simple) {
+  c_mempool_t *pool;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+
+  CHECK_NOT_NULL(pool = c_mempool_create("test", 3 * sizeof(int)));
+  EXPECT_EQ_STR("test", c_mempool_name(pool));
+
+  int count = 0;
+  CHECK_ZERO(c_mempool_foreach(count_pool, &count));
+  EXPECT_EQ_INT(1, count);
+
+  int **objects = calloc(OBJECTS_NUM, sizeof(*objects));
+  CHECK_NOT_NULL(objects);
+
+  for (int i = 0; i < OBJECTS_NUM; i++) {
+    CHECK_NOT_NULL(objects[i] = c_mempool_alloc(pool));
+    for (int j = 0; j < 3; j++)
+      objects[i][j] = i;
+  }
+
+  /* Objects must not overlap. */
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    for (int j = 0; j < 3; j++)
+      EXPECT_EQ_INT(i, objects[i][j]);
+
+  c_mempool_stats(pool, &hits, &misses);
+  OK(misses > 0);
+  OK(misses < OBJECTS_NUM);
+  uint64_t misses_before = misses;
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    c_mempool_free(pool, objects[i]);
+  c_mempool_free(pool, NULL);
+
+  /* Freed objects are reused, so no new slab is needed. */
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    CHECK_NOT_NULL(objects[i] = c_mempool_alloc(pool));
+
+  c_mempool_stats(pool, &hits, &misses);
+  EXPECT_EQ_UINT64(misses_before, misses);
+  OK(hits > 0);
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    c_mempool_free(pool, objects[i]);
+
+  /* Free objects are kept, so the slabs stay charged until the pool is
+   * destroyed. */
+  OK(memtrack_bytes(memtrack_get("test")) >= OBJECTS_NUM * 3 * sizeof(int));
+  c_mempool_destroy(pool);
+  EXPECT_EQ_INT(0, memtrack_bytes(memtrack_get("test")));
+
+  count = 0;
+  CHECK_ZERO(c_mempool_foreach(count_pool, &count));
+  EXPECT_EQ_INT(0, count);
+
+  free(objects);
+  return 0;
+}
+
+static void *free_objects(void *arg) {
+  void **args = arg;
+  c_mempool_t *pool = args[0];
+  void **objects = args[1];
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    c_mempool_free(pool, objects[i]);
+
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  c_mempool_t *pool;
+  uint64_t misses = 0;
+
+  CHECK_NOT_NULL(pool = c_mempool_create("test", sizeof(double)));
+
+  void **objects = calloc(OBJECTS_NUM, sizeof(*objects));
+  CHECK_NOT_NULL(objects);
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    CHECK_NOT_NULL(objects[i] = c_mempool_alloc(pool));
+  c_mempool_stats(pool, NULL, &misses);
+  uint64_t misses_before = misses;
+
+  /* Objects freed by another thread are returned to the pool once that
+   * thread exits. */
+  pthread_t thread;
+  void *args[] = {pool, objects};
+  CHECK_ZERO(pthread_create(&thread, NULL, free_objects, args));
+  CHECK_ZERO(pthread_join(thread, NULL));
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    CHECK_NOT_NULL(objects[i] = c_mempool_alloc(pool));
+  c_mempool_stats(pool, NULL, &misses);
+  EXPECT_EQ_UINT64(misses_before, misses);
+
+  for (int i = 0; i < OBJECTS_NUM; i++)
+    c_mempool_free(pool, objects[i]);
+
+  c_mempool_destroy(pool);
+  free(objects);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
@@ -0,0 +1,221 @@
+/**
+ * collectd - src/utils/memtrack/memtrack.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "utils/memtrack/memtrack.h"
+
+/* The header keeps the memory following it aligned like malloc(3) would. */
+#define MEMTRACK_ALIGN 16
+#define MEMTRACK_HEADER_SIZE                                                   \
+  ((sizeof(memtrack_header_t) + MEMTRACK_ALIGN - 1) &                          \
+   ~((size_t)MEMTRACK_ALIGN - 1))
+
+struct memtrack_header_s {
+  memtrack_t *tag;
+  size_t size;
+};
+typedef struct memtrack_header_s memtrack_header_t;
+
+struct memtrack_s {
+  char *name;
+  int64_t bytes;
+  /* Set once memory has been charged to the tag. */
+  bool used;
+
+  memtrack_t *next;
+};
+
+/* Protects the list of tags and, without atomic builtins, their counters. */
+static pthread_mutex_t memtrack_lock = PTHREAD_MUTEX_INITIALIZER;
+static memtrack_t *memtrack_list;
+
+static memtrack_header_t *memtrack_header(void *ptr) /* {{{ */
+{
+  return (memtrack_header_t *)(void *)((char *)ptr - MEMTRACK_HEADER_SIZE);
+} /* }}} memtrack_header_t *memtrack_header */
+
+memtrack_t *memtrack_get(char const *name) /* {{{ */
+{
+  if (name == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&memtrack_lock);
+  memtrack_t *tag;
+  for (tag = memtrack_list; tag != NULL; tag = tag->next)
+    if (strcmp(name, tag->name) == 0)
+      break;
+
+  if (tag == NULL) {
+    tag = calloc(1, sizeof(*tag));
+    if ((tag != NULL) && ((tag->name = strdup(name)) == NULL)) {
+      free(tag);
+      tag = NULL;
+    }
+    if (tag != NULL) {
+      tag->next = memtrack_list;
+      memtrack_list = tag;
+    }
+  }
+  pthread_mutex_unlock(&memtrack_lock);
+
+  return tag;
+} /* }}} memtrack_t *memtrack_get */
+
+void memtrack_add(memtrack_t *tag, int64_t bytes) /* {{{ */
+{
+  if (tag == NULL)
+    return;
+
+#if HAVE_ATOMIC_BUILTINS
+  __atomic_add_fetch(&tag->bytes, bytes, __ATOMIC_RELAXED);
+  if (!__atomic_load_n(&tag->used, __ATOMIC_RELAXED))
+    __atomic_store_n(&tag->used, true, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&memtrack_lock);
+  tag->bytes += bytes;
+  tag->used = true;
+  pthread_mutex_unlock(&memtrack_lock);
+#endif
+} /* }}} void memtrack_add */
+
+void *memtrack_malloc(memtrack_t *tag, size_t size) /* {{{ */
+{
+  if (size > SIZE_MAX - MEMTRACK_HEADER_SIZE)
+    return NULL;
+
+  memtrack_header_t *h = malloc(MEMTRACK_HEADER_SIZE + size);
+  if (h == NULL)
+    return NULL;
+
+  h->tag = tag;
+  h->size = size;
+  memtrack_add(tag, (int64_t)size);
+
+  return (char *)h + MEMTRACK_HEADER_SIZE;
+} /* }}} void *memtrack_malloc */
+
+void *memtrack_calloc(memtrack_t *tag, size_t nmemb, size_t size) /* {{{ */
+{
+  if ((size != 0) && (nmemb > SIZE_MAX / size))
+    return NULL;
+
+  void *ptr = memtrack_malloc(tag, nmemb * size);
+  if (ptr != NULL)
+    memset(ptr, 0, nmemb * size);
+  return ptr;
+} /* }}} void *memtrack_calloc */
+
+char *memtrack_strdup(memtrack_t *tag, char const *s) /* {{{ */
+{
+  if (s == NULL)
+    return NULL;
+
+  size_t size = strlen(s) + 1;
+  char *ret = memtrack_malloc(tag, size);
+  if (ret != NULL)
+    memcpy(ret, s, size);
+  return ret;
+} /* }}} char *memtrack_strdup */
+
+void *memtrack_realloc(memtrack_t *tag, void *ptr, size_t size) /* {{{ */
+{
+  if (ptr == NULL)
+    return memtrack_malloc(tag, size);
+  if (size > SIZE_MAX - MEMTRACK_HEADER_SIZE)
+    return NULL;
+
+  memtrack_header_t *h = memtrack_header(ptr);
+  size_t old_size = h->size;
+
+  h = realloc(h, MEMTRACK_HEADER_SIZE + size);
+  if (h == NULL)
+    return NULL;
+
+  h->size = size;
+  memtrack_add(h->tag, (int64_t)size - (int64_t)old_size);
+
+  return (char *)h + MEMTRACK_HEADER_SIZE;
+} /* }}} void *memtrack_realloc */
+
+void memtrack_free(void *ptr) /* {{{ */
+{
+  if (ptr == NULL)
+    return;
+
+  memtrack_header_t *h = memtrack_header(ptr);
+  memtrack_add(h->tag, -(int64_t)h->size);
+  free(h);
+} /* }}} void memtrack_free */
+
+char const *memtrack_name(memtrack_t const *tag) /* {{{ */
+{
+  if (tag == NULL)
+    return NULL;
+  return tag->name;
+} /* }}} char const *memtrack_name */
+
+int64_t memtrack_bytes(memtrack_t *tag) /* {{{ */
+{
+  if (tag == NULL)
+    return 0;
+
+#if HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(&tag->bytes, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&memtrack_lock);
+  int64_t bytes = tag->bytes;
+  pthread_mutex_unlock(&memtrack_lock);
+  return bytes;
+#endif
+} /* }}} int64_t memtrack_bytes */
+
+int memtrack_foreach(int (*callback)(memtrack_t *, void *), /* {{{ */
+                     void *user_data) {
+  /* Tags are never removed, so the list can be walked without the lock once
+   * its head has been read. */
+  pthread_mutex_lock(&memtrack_lock);
+  memtrack_t *head = memtrack_list;
+  pthread_mutex_unlock(&memtrack_lock);
+
+  for (memtrack_t *tag = head; tag != NULL; tag = tag->next) {
+#if HAVE_ATOMIC_BUILTINS
+    bool used = __atomic_load_n(&tag->used, __ATOMIC_RELAXED);
+#else
+    pthread_mutex_lock(&memtrack_lock);
+    bool used = tag->used;
+    pthread_mutex_unlock(&memtrack_lock);
+#endif
+    if (!used)
+      continue;
+
+    int status = (*callback)(tag, user_data);
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int memtrack_foreach */
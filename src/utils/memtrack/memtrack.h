@@ -0,0 +1,133 @@
+/**
+ * collectd - src/utils/memtrack/memtrack.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_MEMTRACK_H
+#define UTILS_MEMTRACK_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Byte counters ("tags") that memory is charged to, so that the memory held
+ * by the daemon's major structures and by plugins can be reported. Tags are
+ * looked up by name and live until the process exits, so pointers to them
+ * may be stored anywhere.
+ *
+ * Memory allocated with memtrack_malloc() and friends records the tag it has
+ * been charged to, so it may be freed from any thread or context with
+ * memtrack_free(). It must not be passed to free(3) or realloc(3).
+ */
+struct memtrack_s;
+typedef struct memtrack_s memtrack_t;
+
+/*
+ * NAME
+ *   memtrack_get
+ *
+ * DESCRIPTION
+ *   Returns the tag called `name', creating it on first use.
+ *
+ * RETURN VALUE
+ *   A pointer to the tag or NULL if `name' is NULL or memory is exhausted.
+ */
+memtrack_t *memtrack_get(char const *name);
+
+/*
+ * NAME
+ *   memtrack_add
+ *
+ * DESCRIPTION
+ *   Charges `bytes' to the tag, or returns them if `bytes' is negative. This is
+ *   meant for memory that is allocated by other means, e.g. the slabs of a
+ *   memory pool. Passing a NULL tag is a no-op.
+ */
+void memtrack_add(memtrack_t *tag, int64_t bytes);
+
+/*
+ * NAME
+ *   memtrack_malloc, memtrack_calloc, memtrack_strdup
+ *
+ * DESCRIPTION
+ *   Like malloc(3), calloc(3) and strdup(3), but charge the requested size to
+ *   `tag'. If `tag' is NULL, the memory is not charged to any tag but must
+ *   still be freed with memtrack_free().
+ */
+void *memtrack_malloc(memtrack_t *tag, size_t size);
+void *memtrack_calloc(memtrack_t *tag, size_t nmemb, size_t size);
+char *memtrack_strdup(memtrack_t *tag, char const *s);
+
+/*
+ * NAME
+ *   memtrack_realloc
+ *
+ * DESCRIPTION
+ *   Like realloc(3). The memory stays charged to the tag it has been
+ *   allocated with; if `ptr' is NULL, it is charged to `tag'.
+ */
+void *memtrack_realloc(memtrack_t *tag, void *ptr, size_t size);
+
+/*
+ * NAME
+ *   memtrack_free
+ *
+ * DESCRIPTION
+ *   Frees memory allocated with one of the functions above and returns its
+ *   size to the tag it has been charged to. Passing NULL is a no-op.
+ */
+void memtrack_free(void *ptr);
+
+/*
+ * NAME
+ *   memtrack_name
+ *
+ * RETURN VALUE
+ *   The name the tag has been created with.
+ */
+char const *memtrack_name(memtrack_t const *tag);
+
+/*
+ * NAME
+ *   memtrack_bytes
+ *
+ * RETURN VALUE
+ *   The number of bytes currently charged to the tag.
+ */
+int64_t memtrack_bytes(memtrack_t *tag);
+
+/*
+ * NAME
+ *   memtrack_foreach
+ *
+ * DESCRIPTION
+ *   Calls `callback' for each tag that memory has ever been charged to, e.g.
+ *   to report statistics. Tags that have only been looked up are skipped.
+ *
+ * RETURN VALUE
+ *   Zero if the callback returned zero for all tags. Otherwise, the iteration
+ *   is stopped and the callback's return value is returned.
+ */
+int memtrack_foreach(int (*callback)(memtrack_t *tag, void *user_data),
+                     void *user_data);
+
+#endif /* UTILS_MEMTRACK_H */
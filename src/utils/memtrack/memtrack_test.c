@@ -0,0 +1,102 @@
+/**
+ * collectd - src/utils/memtrack/memtrack_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/memtrack/memtrack.h"
+
+static int find_tag(memtrack_t *tag, void *user_data) {
+  memtrack_t **found = user_data;
+  if (strcmp("test", memtrack_name(tag)) == 0)
+    *found = tag;
+  return 0;
+}
+
+DEF_TEST(get) {
+  memtrack_t *tag;
+
+  CHECK_NOT_NULL(tag = memtrack_get("test"));
+  EXPECT_EQ_STR("test", memtrack_name(tag));
+  OK(tag == memtrack_get("test"));
+  OK(tag != memtrack_get("other"));
+  OK(memtrack_get(NULL) == NULL);
+
+  /* Tags that have not been charged yet are not reported. */
+  memtrack_t *found = NULL;
+  CHECK_ZERO(memtrack_foreach(find_tag, &found));
+  OK(found == NULL);
+
+  memtrack_add(tag, 100);
+  EXPECT_EQ_INT(100, memtrack_bytes(tag));
+  CHECK_ZERO(memtrack_foreach(find_tag, &found));
+  OK(found == tag);
+
+  memtrack_add(tag, -100);
+  EXPECT_EQ_INT(0, memtrack_bytes(tag));
+  memtrack_add(NULL, 100);
+
+  return 0;
+}
+
+DEF_TEST(alloc) {
+  memtrack_t *tag;
+  CHECK_NOT_NULL(tag = memtrack_get("alloc"));
+
+  char *s;
+  CHECK_NOT_NULL(s = memtrack_strdup(tag, "hello"));
+  EXPECT_EQ_STR("hello", s);
+  EXPECT_EQ_INT(6, memtrack_bytes(tag));
+
+  long *l;
+  CHECK_NOT_NULL(l = memtrack_calloc(tag, 4, sizeof(*l)));
+  for (size_t i = 0; i < 4; i++)
+    EXPECT_EQ_INT(0, l[i]);
+  EXPECT_EQ_INT(6 + 4 * sizeof(*l), memtrack_bytes(tag));
+
+  /* Memory stays charged to the tag it has been allocated with. */
+  CHECK_NOT_NULL(s = memtrack_realloc(memtrack_get("other"), s, 1000));
+  EXPECT_EQ_STR("hello", s);
+  EXPECT_EQ_INT(1000 + 4 * sizeof(*l), memtrack_bytes(tag));
+
+  memtrack_free(s);
+  memtrack_free(l);
+  memtrack_free(NULL);
+  EXPECT_EQ_INT(0, memtrack_bytes(tag));
+
+  /* Untracked memory. */
+  CHECK_NOT_NULL(s = memtrack_malloc(NULL, 10));
+  memtrack_free(s);
+
+  OK(memtrack_calloc(tag, SIZE_MAX, 2) == NULL);
+  EXPECT_EQ_INT(0, memtrack_bytes(tag));
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(get);
+  RUN_TEST(alloc);
+
+  END_TEST;
+}
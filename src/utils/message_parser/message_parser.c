@@ -87,12 +87,16 @@ static int start_message_assembly(parser_job_data_t *self) {
   } else
     ++(self->message_idx);
 
-  /* Resize messages buffer if needed */
+  /* Resize messages buffer if needed. The buffer grows geometrically, so
+   * that busy files don't cause a reallocation every few messages. */
   if (self->message_idx >= self->messages_max_len) {
+    size_t step = (self->messages_max_len > MSG_STOR_INC_STEP)
+                      ? self->messages_max_len
+                      : MSG_STOR_INC_STEP;
     INFO(UTIL_NAME ": Exceeded message buffer size: %zu",
          self->messages_max_len);
-    if (self->resize_message_buffer(self, self->messages_max_len +
-                                              MSG_STOR_INC_STEP) != 0) {
+    if (self->resize_message_buffer(self, self->messages_max_len + step) !=
+        0) {
       ERROR(UTIL_NAME ": Insufficient message buffer size: %zu. Remaining "
                       "messages for this read will be skipped",
             self->messages_max_len);
@@ -299,22 +303,24 @@ int message_parser_read(parser_job_data_t *parser_job,
       !(parser_job->messages_storage[parser_job->message_idx].completed)) {
     INFO(UTIL_NAME ": Found incomplete message from previous read.");
     incomplete_msg_found = true;
-    message_t tmp_message =
-        parser_job->messages_storage[parser_job->message_idx];
-    int tmp_message_item_idx = parser_job->message_item_idx;
-    memset(parser_job->messages_storage, 0,
-           parser_job->messages_max_len *
-               sizeof(*parser_job->messages_storage));
-    memcpy(parser_job->messages_storage, &tmp_message,
-           sizeof(*parser_job->messages_storage));
-    parser_job->message_item_idx = tmp_message_item_idx;
+    /* Only the messages of the last read are cleared, the rest of the
+     * buffer has not been used since it was zeroed. */
+    if (parser_job->message_idx > 0) {
+      memcpy(parser_job->messages_storage,
+             parser_job->messages_storage + parser_job->message_idx,
+             sizeof(*parser_job->messages_storage));
+      memset(parser_job->messages_storage + 1, 0,
+             parser_job->message_idx * sizeof(*parser_job->messages_storage));
+    }
     parser_job->message_idx = 0;
   }
   /* Reset message buffer after non empty read */
   else if (parser_job->message_idx >= 0) {
+    size_t used = (size_t)parser_job->message_idx + 1;
+    if (used > parser_job->messages_max_len)
+      used = parser_job->messages_max_len;
     memset(parser_job->messages_storage, 0,
-           parser_job->messages_max_len *
-               sizeof(*parser_job->messages_storage));
+           used * sizeof(*parser_job->messages_storage));
     parser_job->message_item_idx = 0;
     parser_job->message_idx = -1;
   }
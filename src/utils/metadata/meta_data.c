@@ -28,9 +28,16 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/mempool/mempool.h"
+#include "utils/memtrack/memtrack.h"
 #include "utils/metadata/meta_data.h"
 
 #define MD_MAX_NONSTRING_CHARS 128
+/* Bodies with up to this many entries are taken from a pool. */
+#define MD_POOL_ENTRIES 4
+/* Number of slots of the key table, a power of two. At most half of them are
+ * used; keys beyond that are copied into each entry instead of interned. */
+#define MD_KEYS_SLOTS 2048
 
 /*
  * Data types
@@ -45,20 +52,71 @@ union meta_value_u {
 typedef union meta_value_u meta_value_t;
 
 struct meta_entry_s {
+  /* Interned, unless `key_owned' is set. */
   char *key;
   meta_value_t value;
   int type;
-  meta_entry_t *next;
+  bool key_owned;
+};
+
+/* The entries of one or more meta_data_t, followed by an entry with a NULL
+ * key, so that iterators know where to stop. Cloning a meta_data_t only adds
+ * a reference to its body; bodies with more than one reference are read-only
+ * and copied before they are modified. */
+struct md_body_s;
+typedef struct md_body_s md_body_t;
+struct md_body_s {
+  long refcount;
+  size_t num;
+  /* Number of entries allocated, including the terminating one. */
+  size_t size;
+  meta_entry_t entries[];
 };
 
 struct meta_data_s {
-  meta_entry_t *head;
+  /* NULL if there are no entries yet. */
+  md_body_t *body;
   pthread_mutex_t lock;
 };
 
+/*
+ * Private variables
+ */
+/* Meta data is copied for every dispatched value list, so small bodies and
+ * meta_data_t structures are taken from pools. */
+static pthread_once_t md_pool_once = PTHREAD_ONCE_INIT;
+static c_mempool_t *md_body_pool;
+static c_mempool_t *md_pool;
+/* Bodies too large for the pool are charged to the pool's tag, strings owned
+ * by entries to the one of "md_pool". */
+static memtrack_t *md_body_memtrack;
+static memtrack_t *md_memtrack;
+
+/* Interned keys. Slots are filled once and never cleared, so with atomic
+ * builtins they are read without a lock. */
+static char *md_keys[MD_KEYS_SLOTS];
+static long md_keys_num;
+#if !HAVE_ATOMIC_BUILTINS
+static pthread_mutex_t md_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t md_refcount_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
  * Private functions
  */
+static void md_pool_init(void) /* {{{ */
+{
+  md_body_pool = c_mempool_create(
+      "meta_body",
+      sizeof(md_body_t) + (MD_POOL_ENTRIES + 1) * sizeof(meta_entry_t));
+  md_pool = c_mempool_create("meta_data", sizeof(meta_data_t));
+  if ((md_body_pool == NULL) || (md_pool == NULL))
+    ERROR("meta_data: c_mempool_create failed.");
+
+  md_body_memtrack = memtrack_get("meta_body");
+  md_memtrack = memtrack_get("meta_data");
+} /* }}} void md_pool_init */
+
 static char *md_strdup(const char *orig) /* {{{ */
 {
   size_t sz;
@@ -77,199 +135,317 @@ static char *md_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *md_strdup */
 
-static meta_entry_t *md_entry_alloc(const char *key) /* {{{ */
+/* Copies a key or string value owned by an entry. The copy must be freed with
+ * memtrack_free(). */
+static char *md_entry_strdup(const char *orig) /* {{{ */
 {
-  meta_entry_t *e;
+  pthread_once(&md_pool_once, md_pool_init);
+  return memtrack_strdup(md_memtrack, orig);
+} /* }}} char *md_entry_strdup */
 
-  e = calloc(1, sizeof(*e));
-  if (e == NULL) {
-    ERROR("md_entry_alloc: calloc failed.");
-    return NULL;
-  }
+static size_t md_key_hash(const char *key) /* {{{ */
+{
+  uint32_t hash = 2166136261U;
 
-  e->key = md_strdup(key);
-  if (e->key == NULL) {
-    free(e);
-    ERROR("md_entry_alloc: md_strdup failed.");
-    return NULL;
+  for (; *key != 0; key++) {
+    hash ^= (uint32_t)(unsigned char)*key;
+    hash *= 16777619U;
   }
 
-  e->type = 0;
-  e->next = NULL;
-
-  return e;
-} /* }}} meta_entry_t *md_entry_alloc */
+  return (size_t)hash;
+} /* }}} size_t md_key_hash */
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_clone_contents(const meta_entry_t *orig) /* {{{ */
+/* Returns the interned copy of `key', or NULL if the table is full or memory
+ * is exhausted. */
+static char *md_key_intern(const char *key) /* {{{ */
 {
-  meta_entry_t *copy;
+  size_t mask = MD_KEYS_SLOTS - 1;
+  size_t i = md_key_hash(key) & mask;
+
+#if HAVE_ATOMIC_BUILTINS
+  for (;; i = (i + 1) & mask) {
+    char *k = __atomic_load_n(&md_keys[i], __ATOMIC_ACQUIRE);
+
+    if (k == NULL) {
+      /* Concurrent insertions may overshoot the limit by a few keys, which
+       * still leaves plenty of empty slots to end the probe sequences. */
+      if (__atomic_load_n(&md_keys_num, __ATOMIC_RELAXED) >=
+          MD_KEYS_SLOTS / 2)
+        return NULL;
+
+      char *copy = md_entry_strdup(key);
+      if (copy == NULL)
+        return NULL;
+
+      if (__atomic_compare_exchange_n(&md_keys[i], &k, copy,
+                                      /* weak = */ false, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        __atomic_add_fetch(&md_keys_num, 1, __ATOMIC_RELAXED);
+        return copy;
+      }
+
+      /* Another thread filled the slot first; `k' now holds its key. */
+      memtrack_free(copy);
+    }
 
-  /* WARNINGS :
-   *  - we do not check that orig != NULL here. You should have done it before.
-   *  - we do not set copy->next. DO NOT FORGET TO SET copy->next IN YOUR
-   * FUNCTION
-   */
+    if (strcmp(k, key) == 0)
+      return k;
+  }
+#else
+  char *ret = NULL;
+
+  pthread_mutex_lock(&md_keys_lock);
+  for (;; i = (i + 1) & mask) {
+    if (md_keys[i] == NULL) {
+      if (md_keys_num >= MD_KEYS_SLOTS / 2)
+        break;
+      md_keys[i] = md_entry_strdup(key);
+      if (md_keys[i] != NULL)
+        md_keys_num++;
+      ret = md_keys[i];
+      break;
+    }
 
-  copy = md_entry_alloc(orig->key);
-  if (copy == NULL)
-    return NULL;
-  copy->type = orig->type;
-  if (copy->type == MD_TYPE_STRING)
-    copy->value.mv_string = strdup(orig->value.mv_string);
-  else
-    copy->value = orig->value;
+    if (strcmp(md_keys[i], key) == 0) {
+      ret = md_keys[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&md_keys_lock);
 
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone_contents */
+  return ret;
+#endif
+} /* }}} char *md_key_intern */
 
-static meta_entry_t *md_entry_clone(const meta_entry_t *orig) /* {{{ */
+static int md_entry_set_key(meta_entry_t *e, const char *key) /* {{{ */
 {
-  meta_entry_t *copy;
-
-  if (orig == NULL)
-    return NULL;
-
-  copy = md_entry_clone_contents(orig);
+  e->key = md_key_intern(key);
+  e->key_owned = false;
+  if (e->key != NULL)
+    return 0;
 
-  copy->next = md_entry_clone(orig->next);
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone */
+  e->key = md_entry_strdup(key);
+  if (e->key == NULL) {
+    ERROR("md_entry_set_key: md_entry_strdup failed.");
+    return ENOMEM;
+  }
+  e->key_owned = true;
+  return 0;
+} /* }}} int md_entry_set_key */
 
-static void md_entry_free(meta_entry_t *e) /* {{{ */
+/* Frees the memory owned by the entry, but not the entry itself. */
+static void md_entry_clear(meta_entry_t *e) /* {{{ */
 {
-  if (e == NULL)
-    return;
-
-  free(e->key);
-
+  if (e->key_owned)
+    memtrack_free(e->key);
   if (e->type == MD_TYPE_STRING)
-    free(e->value.mv_string);
-
-  if (e->next != NULL)
-    md_entry_free(e->next);
-
-  free(e);
-} /* }}} void md_entry_free */
-
-static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
-{
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
-  if ((md == NULL) || (e == NULL))
-    return -EINVAL;
+    memtrack_free(e->value.mv_string);
 
-  pthread_mutex_lock(&md->lock);
+  e->key = NULL;
+  e->key_owned = false;
+  e->type = 0;
+} /* }}} void md_entry_clear */
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
+static int md_entry_copy(meta_entry_t *dest, /* {{{ */
+                         const meta_entry_t *src) {
+  *dest = *src;
 
-    prev = this;
-    this = this->next;
+  if (src->key_owned) {
+    dest->key = md_entry_strdup(src->key);
+    if (dest->key == NULL)
+      return ENOMEM;
   }
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
+  if (src->type == MD_TYPE_STRING) {
+    dest->value.mv_string = md_entry_strdup(src->value.mv_string);
+    if (dest->value.mv_string == NULL) {
+      if (dest->key_owned)
+        memtrack_free(dest->key);
+      return ENOMEM;
     }
+  }
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+  return 0;
+} /* }}} int md_entry_copy */
 
-    e->next = this->next;
+static md_body_t *md_body_alloc(size_t size) /* {{{ */
+{
+  md_body_t *b;
+
+  pthread_once(&md_pool_once, md_pool_init);
+  if (size <= MD_POOL_ENTRIES + 1) {
+    size = MD_POOL_ENTRIES + 1;
+    b = c_mempool_alloc(md_body_pool);
+  } else {
+    b = memtrack_malloc(md_body_memtrack,
+                        sizeof(*b) + size * sizeof(*b->entries));
+  }
+  if (b == NULL) {
+    ERROR("md_body_alloc: Allocating %" PRIsz " entries failed.", size);
+    return NULL;
   }
 
-  pthread_mutex_unlock(&md->lock);
+  b->refcount = 1;
+  b->num = 0;
+  b->size = size;
+  b->entries[0] = (meta_entry_t){.key = NULL};
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
-  }
+  return b;
+} /* }}} md_body_t *md_body_alloc */
 
-  return 0;
-} /* }}} int md_entry_insert */
+/* Frees the body's memory, but not the memory owned by its entries. */
+static void md_body_free(md_body_t *b) /* {{{ */
+{
+  if (b->size <= MD_POOL_ENTRIES + 1)
+    c_mempool_free(md_body_pool, b);
+  else
+    memtrack_free(b);
+} /* }}} void md_body_free */
 
-/* XXX: The lock on md must be held while calling this function! */
-static int md_entry_insert_clone(meta_data_t *md, meta_entry_t *orig) /* {{{ */
+static md_body_t *md_body_ref(md_body_t *b) /* {{{ */
 {
-  meta_entry_t *e;
-  meta_entry_t *this;
-  meta_entry_t *prev;
+  if (b == NULL)
+    return NULL;
 
-  /* WARNINGS :
-   *  - we do not check that md and e != NULL here. You should have done it
-   * before.
-   *  - we do not use the lock. You should have set it before.
-   */
+#if HAVE_ATOMIC_BUILTINS
+  __atomic_add_fetch(&b->refcount, 1, __ATOMIC_RELAXED);
+#else
+  pthread_mutex_lock(&md_refcount_lock);
+  b->refcount++;
+  pthread_mutex_unlock(&md_refcount_lock);
+#endif
 
-  e = md_entry_clone_contents(orig);
+  return b;
+} /* }}} md_body_t *md_body_ref */
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
+static bool md_body_shared(md_body_t *b) /* {{{ */
+{
+#if HAVE_ATOMIC_BUILTINS
+  return __atomic_load_n(&b->refcount, __ATOMIC_ACQUIRE) > 1;
+#else
+  pthread_mutex_lock(&md_refcount_lock);
+  bool shared = (b->refcount > 1);
+  pthread_mutex_unlock(&md_refcount_lock);
+  return shared;
+#endif
+} /* }}} bool md_body_shared */
+
+static void md_body_release(md_body_t *b) /* {{{ */
+{
+  if (b == NULL)
+    return;
 
-    prev = this;
-    this = this->next;
-  }
+#if HAVE_ATOMIC_BUILTINS
+  if (__atomic_sub_fetch(&b->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+#else
+  pthread_mutex_lock(&md_refcount_lock);
+  long refcount = --b->refcount;
+  pthread_mutex_unlock(&md_refcount_lock);
+  if (refcount > 0)
+    return;
+#endif
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+  for (size_t i = 0; i < b->num; i++)
+    md_entry_clear(b->entries + i);
+  md_body_free(b);
+} /* }}} void md_body_release */
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+/* Makes sure md->body is not shared and has room for `extra' more entries.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_body_prepare(meta_data_t *md, size_t extra) /* {{{ */
+{
+  md_body_t *old = md->body;
+  size_t num = (old != NULL) ? old->num : 0;
+  bool shared = (old != NULL) && md_body_shared(old);
 
-    e->next = this->next;
-  }
+  if ((old != NULL) && !shared && (num + extra + 1 <= old->size))
+    return 0;
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  size_t size = num + extra + 1;
+  if ((old != NULL) && !shared && (size < 2 * old->size))
+    size = 2 * old->size;
+
+  md_body_t *b = md_body_alloc(size);
+  if (b == NULL)
+    return ENOMEM;
+
+  if (shared) {
+    for (size_t i = 0; i < num; i++) {
+      if (md_entry_copy(b->entries + i, old->entries + i) != 0) {
+        ERROR("md_body_prepare: Copying the entries failed.");
+        b->num = i;
+        md_body_release(b);
+        return ENOMEM;
+      }
+    }
+    md_body_release(old);
+  } else if (old != NULL) {
+    /* The entries move, including the memory they own. */
+    memcpy(b->entries, old->entries, num * sizeof(*b->entries));
+    md_body_free(old);
   }
 
+  b->num = num;
+  b->entries[num] = (meta_entry_t){.key = NULL};
+  md->body = b;
   return 0;
-} /* }}} int md_entry_insert_clone */
+} /* }}} int md_body_prepare */
 
 /* XXX: The lock on md must be held while calling this function! */
 static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
                                      const char *key) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
+  if ((md == NULL) || (md->body == NULL) || (key == NULL))
     return NULL;
 
-  for (e = md->head; e != NULL; e = e->next)
+  for (size_t i = 0; i < md->body->num; i++) {
+    meta_entry_t *e = md->body->entries + i;
     if (strcasecmp(key, e->key) == 0)
-      break;
+      return e;
+  }
 
-  return e;
+  return NULL;
 } /* }}} meta_entry_t *md_entry_lookup */
 
+/* Adds `e', replacing any entry with the same key. On success, the memory
+ * owned by `e' belongs to md, otherwise it is freed.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_entry_insert_locked(meta_data_t *md, /* {{{ */
+                                  meta_entry_t *e) {
+  meta_entry_t *this = md_entry_lookup(md, e->key);
+  size_t pos = (this != NULL) ? (size_t)(this - md->body->entries) : 0;
+
+  /* Preparing may move the entries. */
+  if (md_body_prepare(md, (this == NULL) ? 1 : 0) != 0) {
+    md_entry_clear(e);
+    return -ENOMEM;
+  }
+
+  md_body_t *b = md->body;
+  if (this != NULL) {
+    md_entry_clear(b->entries + pos);
+    b->entries[pos] = *e;
+  } else {
+    b->entries[b->num] = *e;
+    b->num++;
+    b->entries[b->num] = (meta_entry_t){.key = NULL};
+  }
+
+  return 0;
+} /* }}} int md_entry_insert_locked */
+
+static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
+{
+  if ((md == NULL) || (e == NULL))
+    return -EINVAL;
+
+  pthread_mutex_lock(&md->lock);
+  int status = md_entry_insert_locked(md, e);
+  pthread_mutex_unlock(&md->lock);
+
+  return status;
+} /* }}} int md_entry_insert */
+
 /*
  * Each value_list_t*, as it is going through the system, is handled by exactly
  * one thread. Plugins which pass a value_list_t* to another thread, e.g. the
@@ -279,6 +455,9 @@ static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
  * The meta data associated with cache entries are a different story. There, we
  * need to ensure exclusive locking to prevent leaks and other funky business.
  * This is ensured by the uc_meta_data_get_*() functions.
+ *
+ * Copies share their entries until either of them is modified, so bodies are
+ * reference counted with atomic operations.
  */
 
 /*
@@ -288,11 +467,13 @@ meta_data_t *meta_data_create(void) /* {{{ */
 {
   meta_data_t *md;
 
-  md = calloc(1, sizeof(*md));
+  pthread_once(&md_pool_once, md_pool_init);
+  md = c_mempool_alloc(md_pool);
   if (md == NULL) {
-    ERROR("meta_data_create: calloc failed.");
+    ERROR("meta_data_create: c_mempool_alloc failed.");
     return NULL;
   }
+  memset(md, 0, sizeof(*md));
 
   pthread_mutex_init(&md->lock, /* attr = */ NULL);
 
@@ -311,7 +492,7 @@ meta_data_t *meta_data_clone(meta_data_t *orig) /* {{{ */
     return NULL;
 
   pthread_mutex_lock(&orig->lock);
-  copy->head = md_entry_clone(orig->head);
+  copy->body = md_body_ref(orig->body);
   pthread_mutex_unlock(&orig->lock);
 
   return copy;
@@ -328,8 +509,16 @@ int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig) /* {{{ */
   }
 
   pthread_mutex_lock(&orig->lock);
-  for (meta_entry_t *e = orig->head; e != NULL; e = e->next) {
-    md_entry_insert_clone((*dest), e);
+  if (((*dest)->body == NULL) || ((*dest)->body->num == 0)) {
+    md_body_release((*dest)->body);
+    (*dest)->body = md_body_ref(orig->body);
+  } else if (orig->body != NULL) {
+    for (size_t i = 0; i < orig->body->num; i++) {
+      meta_entry_t e;
+      if (md_entry_copy(&e, orig->body->entries + i) != 0)
+        continue;
+      md_entry_insert_locked(*dest, &e);
+    }
   }
   pthread_mutex_unlock(&orig->lock);
 
@@ -341,9 +530,9 @@ void meta_data_destroy(meta_data_t *md) /* {{{ */
   if (md == NULL)
     return;
 
-  md_entry_free(md->head);
+  md_body_release(md->body);
   pthread_mutex_destroy(&md->lock);
-  free(md);
+  c_mempool_free(md_pool, md);
 } /* }}} void meta_data_destroy */
 
 int meta_data_exists(meta_data_t *md, const char *key) /* {{{ */
@@ -352,16 +541,10 @@ int meta_data_exists(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return 1;
-    }
-  }
-
+  int exists = (md_entry_lookup(md, key) != NULL);
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return exists;
 } /* }}} int meta_data_exists */
 
 int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
@@ -370,29 +553,24 @@ int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return e->type;
-    }
-  }
-
+  meta_entry_t *e = md_entry_lookup(md, key);
+  int type = (e != NULL) ? e->type : 0;
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return type;
 } /* }}} int meta_data_type */
 
 int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 {
-  int i = 0, count = 0;
+  int count = 0;
 
   if ((md == NULL) || (toc == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    ++count;
+  if (md->body != NULL)
+    count = (int)md->body->num;
 
   if (count == 0) {
     pthread_mutex_unlock(&md->lock);
@@ -400,8 +578,8 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
   }
 
   *toc = calloc(count, sizeof(**toc));
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    (*toc)[i++] = strdup(e->key);
+  for (int i = 0; i < count; i++)
+    (*toc)[i] = strdup(md->body->entries[i].key);
 
   pthread_mutex_unlock(&md->lock);
   return count;
@@ -409,39 +587,31 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 
 int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
-  }
-
+  meta_entry_t *this = md_entry_lookup(md, key);
   if (this == NULL) {
     pthread_mutex_unlock(&md->lock);
     return -ENOENT;
   }
 
-  if (prev == NULL)
-    md->head = this->next;
-  else
-    prev->next = this->next;
-
-  pthread_mutex_unlock(&md->lock);
+  size_t pos = (size_t)(this - md->body->entries);
+  if (md_body_prepare(md, 0) != 0) {
+    pthread_mutex_unlock(&md->lock);
+    return -ENOMEM;
+  }
 
-  this->next = NULL;
-  md_entry_free(this);
+  md_body_t *b = md->body;
+  md_entry_clear(b->entries + pos);
+  /* Moves the terminating entry, too. */
+  memmove(b->entries + pos, b->entries + pos + 1,
+          (b->num - pos) * sizeof(*b->entries));
+  b->num--;
 
+  pthread_mutex_unlock(&md->lock);
   return 0;
 } /* }}} int meta_data_delete */
 
@@ -450,92 +620,75 @@ int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
  */
 int meta_data_add_string(meta_data_t *md, /* {{{ */
                          const char *key, const char *value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_STRING};
 
   if ((md == NULL) || (key == NULL) || (value == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  if (md_entry_set_key(&e, key) != 0)
     return -ENOMEM;
 
-  e->value.mv_string = md_strdup(value);
-  if (e->value.mv_string == NULL) {
-    ERROR("meta_data_add_string: md_strdup failed.");
-    md_entry_free(e);
+  e.value.mv_string = md_entry_strdup(value);
+  if (e.value.mv_string == NULL) {
+    ERROR("meta_data_add_string: md_entry_strdup failed.");
+    md_entry_clear(&e);
     return -ENOMEM;
   }
-  e->type = MD_TYPE_STRING;
 
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_string */
 
 int meta_data_add_signed_int(meta_data_t *md, /* {{{ */
                              const char *key, int64_t value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_SIGNED_INT, .value.mv_signed_int = value};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  if (md_entry_set_key(&e, key) != 0)
     return -ENOMEM;
 
-  e->value.mv_signed_int = value;
-  e->type = MD_TYPE_SIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_signed_int */
 
 int meta_data_add_unsigned_int(meta_data_t *md, /* {{{ */
                                const char *key, uint64_t value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_UNSIGNED_INT,
+                    .value.mv_unsigned_int = value};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  if (md_entry_set_key(&e, key) != 0)
     return -ENOMEM;
 
-  e->value.mv_unsigned_int = value;
-  e->type = MD_TYPE_UNSIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_unsigned_int */
 
 int meta_data_add_double(meta_data_t *md, /* {{{ */
                          const char *key, double value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_DOUBLE, .value.mv_double = value};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  if (md_entry_set_key(&e, key) != 0)
     return -ENOMEM;
 
-  e->value.mv_double = value;
-  e->type = MD_TYPE_DOUBLE;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_double */
 
 int meta_data_add_boolean(meta_data_t *md, /* {{{ */
                           const char *key, bool value) {
-  meta_entry_t *e;
+  meta_entry_t e = {.type = MD_TYPE_BOOLEAN, .value.mv_boolean = value};
 
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
+  if (md_entry_set_key(&e, key) != 0)
     return -ENOMEM;
 
-  e->value.mv_boolean = value;
-  e->type = MD_TYPE_BOOLEAN;
-
-  return md_entry_insert(md, e);
+  return md_entry_insert(md, &e);
 } /* }}} int meta_data_add_boolean */
 
 /*
@@ -749,14 +902,45 @@ int meta_data_as_string(meta_data_t *md, /* {{{ */
   return 0;
 } /* }}} int meta_data_as_string */
 
-meta_entry_t *meta_data_iter(meta_data_t *md) { return md->head; }
+meta_entry_t *meta_data_iter(meta_data_t *md) {
+  if ((md == NULL) || (md->body == NULL) || (md->body->num == 0))
+    return NULL;
+  return md->body->entries;
+}
 
-meta_entry_t *meta_data_iter_next(meta_entry_t *iter) { return iter->next; }
+/* The entries are followed by one with a NULL key. */
+meta_entry_t *meta_data_iter_next(meta_entry_t *iter) {
+  iter++;
+  return (iter->key != NULL) ? iter : NULL;
+}
 
 int meta_data_iter_type(meta_entry_t *iter) { return iter->type; }
 
 const char *meta_data_iter_key(meta_entry_t *iter) { return iter->key; }
 
+/* The values of entries, without copying them. The caller checks the type
+ * with meta_data_iter_type() first. Like the key, a string is only valid until
+ * the meta data is modified. */
+const char *meta_data_iter_string(meta_entry_t *iter) {
+  return (iter->type == MD_TYPE_STRING) ? iter->value.mv_string : NULL;
+}
+
+int64_t meta_data_iter_signed_int(meta_entry_t *iter) {
+  return iter->value.mv_signed_int;
+}
+
+uint64_t meta_data_iter_unsigned_int(meta_entry_t *iter) {
+  return iter->value.mv_unsigned_int;
+}
+
+double meta_data_iter_double(meta_entry_t *iter) {
+  return iter->value.mv_double;
+}
+
+bool meta_data_iter_boolean(meta_entry_t *iter) {
+  return iter->value.mv_boolean;
+}
+
 int meta_data_iter_get_string(meta_data_t *md, meta_entry_t *iter,
                               char **value) {
   int res = 0;
@@ -77,5 +77,10 @@ int meta_data_iter_type(meta_entry_t *iter);
 const char *meta_data_iter_key(meta_entry_t *iter);
 int meta_data_iter_get_string(meta_data_t *md, meta_entry_t *iter,
                               char **value);
+const char *meta_data_iter_string(meta_entry_t *iter);
+int64_t meta_data_iter_signed_int(meta_entry_t *iter);
+uint64_t meta_data_iter_unsigned_int(meta_entry_t *iter);
+double meta_data_iter_double(meta_entry_t *iter);
+bool meta_data_iter_boolean(meta_entry_t *iter);
 
 #endif /* META_DATA_H */
@@ -110,8 +110,96 @@ DEF_TEST(base) {
   return 0;
 }
 
+DEF_TEST(clone) {
+  meta_data_t *m;
+  meta_data_t *copy;
+  char *s;
+  int64_t si;
+
+  CHECK_NOT_NULL(m = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(m, "string", "foobar"));
+  CHECK_ZERO(meta_data_add_signed_int(m, "signed_int", 42));
+
+  /* Copies share the entries until one of them is modified. */
+  CHECK_NOT_NULL(copy = meta_data_clone(m));
+  CHECK_ZERO(meta_data_add_string(copy, "string", "changed"));
+  CHECK_ZERO(meta_data_delete(copy, "signed_int"));
+
+  CHECK_ZERO(meta_data_get_string(m, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_signed_int(m, "signed_int", &si));
+  EXPECT_EQ_INT(42, (int)si);
+
+  CHECK_ZERO(meta_data_get_string(copy, "string", &s));
+  EXPECT_EQ_STR("changed", s);
+  sfree(s);
+  OK(meta_data_exists(copy, "signed_int") == 0);
+
+  /* The original may be destroyed first. */
+  meta_data_destroy(m);
+  CHECK_ZERO(meta_data_get_string(copy, "STRING", &s));
+  EXPECT_EQ_STR("changed", s);
+  sfree(s);
+
+  meta_data_destroy(copy);
+  return 0;
+}
+
+DEF_TEST(many) {
+  meta_data_t *m;
+  char key[32];
+
+  CHECK_NOT_NULL(m = meta_data_create());
+  for (int i = 0; i < 100; i++) {
+    ssnprintf(key, sizeof(key), "key%d", i);
+    CHECK_ZERO(meta_data_add_signed_int(m, key, i));
+  }
+
+  /* Merging into a copy replaces existing keys and keeps the order. */
+  meta_data_t *merged;
+  CHECK_NOT_NULL(merged = meta_data_create());
+  CHECK_ZERO(meta_data_add_signed_int(merged, "key50", -1));
+  CHECK_ZERO(meta_data_add_boolean(merged, "extra", true));
+  CHECK_ZERO(meta_data_clone_merge(&merged, m));
+
+  int count = 0;
+  for (meta_entry_t *e = meta_data_iter(merged); e != NULL;
+       e = meta_data_iter_next(e))
+    count++;
+  EXPECT_EQ_INT(101, count);
+
+  char **toc = NULL;
+  EXPECT_EQ_INT(101, meta_data_toc(merged, &toc));
+  EXPECT_EQ_STR("key50", toc[0]);
+  EXPECT_EQ_STR("extra", toc[1]);
+  EXPECT_EQ_STR("key0", toc[2]);
+  for (int i = 0; i < 101; i++)
+    sfree(toc[i]);
+  sfree(toc);
+
+  int64_t si;
+  CHECK_ZERO(meta_data_get_signed_int(merged, "key50", &si));
+  EXPECT_EQ_INT(50, (int)si);
+
+  for (int i = 0; i < 100; i += 2) {
+    ssnprintf(key, sizeof(key), "key%d", i);
+    CHECK_ZERO(meta_data_delete(m, key));
+  }
+  for (int i = 0; i < 100; i++) {
+    ssnprintf(key, sizeof(key), "key%d", i);
+    EXPECT_EQ_INT(i % 2, meta_data_exists(m, key));
+  }
+
+  meta_data_destroy(merged);
+  meta_data_destroy(m);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(base);
+  RUN_TEST(clone);
+  RUN_TEST(many);
 
   END_TEST;
 }
@@ -0,0 +1,422 @@
+/**
+ * collectd - src/utils/network_parse/network_parse.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/latency/latency.h"
+#include "utils/metadata/meta_data.h"
+#include "utils/network_parse/network_parse.h"
+
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+int network_parse_part_values(void **ret_buffer, /* {{{ */
+                              size_t *ret_buffer_len, value_t **ret_values,
+                              size_t *ret_num_values) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+
+  uint16_t tmp16;
+  size_t exp_size;
+
+  uint16_t pkg_length;
+  uint16_t pkg_type;
+  size_t pkg_numval;
+
+  uint8_t *pkg_types;
+  value_t *pkg_values;
+
+  if (buffer_len < 15) {
+    NOTICE("network_parse: packet is too short: "
+           "buffer_len = %" PRIsz,
+           buffer_len);
+    return -1;
+  }
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  pkg_type = ntohs(tmp16);
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  pkg_length = ntohs(tmp16);
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  pkg_numval = (size_t)ntohs(tmp16);
+
+  assert(pkg_type == TYPE_VALUES);
+
+  exp_size =
+      3 * sizeof(uint16_t) + pkg_numval * (sizeof(uint8_t) + sizeof(value_t));
+  if (buffer_len < exp_size) {
+    WARNING("network_parse: network_parse_part_values: "
+            "Packet too short: "
+            "Chunk of size %" PRIsz " expected, "
+            "but buffer has only %" PRIsz " bytes left.",
+            exp_size, buffer_len);
+    return -1;
+  }
+  assert(pkg_numval <= ((buffer_len - 6) / 9));
+
+  if (pkg_length != exp_size) {
+    WARNING("network_parse: network_parse_part_values: "
+            "Length and number of values "
+            "in the packet don't match.");
+    return -1;
+  }
+
+  pkg_types = calloc(pkg_numval, sizeof(*pkg_types));
+  pkg_values = calloc(pkg_numval, sizeof(*pkg_values));
+  if ((pkg_types == NULL) || (pkg_values == NULL)) {
+    sfree(pkg_types);
+    sfree(pkg_values);
+    ERROR("network_parse: network_parse_part_values: calloc failed.");
+    return -1;
+  }
+
+  memcpy(pkg_types, buffer, pkg_numval * sizeof(*pkg_types));
+  buffer += pkg_numval * sizeof(*pkg_types);
+  memcpy(pkg_values, buffer, pkg_numval * sizeof(*pkg_values));
+  buffer += pkg_numval * sizeof(*pkg_values);
+
+  for (size_t i = 0; i < pkg_numval; i++) {
+    switch (pkg_types[i]) {
+    case DS_TYPE_COUNTER:
+      pkg_values[i].counter = (counter_t)ntohll(pkg_values[i].counter);
+      break;
+
+    case DS_TYPE_GAUGE:
+      pkg_values[i].gauge = (gauge_t)ntohd(pkg_values[i].gauge);
+      break;
+
+    case DS_TYPE_DERIVE:
+      pkg_values[i].derive = (derive_t)ntohll(pkg_values[i].derive);
+      break;
+
+    case DS_TYPE_ABSOLUTE:
+      pkg_values[i].absolute = (absolute_t)ntohll(pkg_values[i].absolute);
+      break;
+
+    default:
+      NOTICE("network_parse: network_parse_part_values: "
+             "Don't know how to handle data source type %" PRIu8,
+             pkg_types[i]);
+      sfree(pkg_types);
+      sfree(pkg_values);
+      return -1;
+    } /* switch (pkg_types[i]) */
+  }
+
+  *ret_buffer = buffer;
+  *ret_buffer_len = buffer_len - pkg_length;
+  *ret_num_values = pkg_numval;
+  *ret_values = pkg_values;
+
+  sfree(pkg_types);
+
+  return 0;
+} /* }}} int network_parse_part_values */
+
+int network_parse_part_number(void **ret_buffer, /* {{{ */
+                              size_t *ret_buffer_len, uint64_t *value) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+
+  uint16_t tmp16;
+  uint64_t tmp64;
+  size_t exp_size = 2 * sizeof(uint16_t) + sizeof(uint64_t);
+
+  uint16_t pkg_length;
+
+  if (buffer_len < exp_size) {
+    WARNING("network_parse: network_parse_part_number: "
+            "Packet too short: "
+            "Chunk of size %" PRIsz " expected, "
+            "but buffer has only %" PRIsz " bytes left.",
+            exp_size, buffer_len);
+    return -1;
+  }
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  /* pkg_type = ntohs (tmp16); */
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  pkg_length = ntohs(tmp16);
+
+  memcpy((void *)&tmp64, buffer, sizeof(tmp64));
+  buffer += sizeof(tmp64);
+  *value = ntohll(tmp64);
+
+  *ret_buffer = buffer;
+  *ret_buffer_len = buffer_len - pkg_length;
+
+  return 0;
+} /* }}} int network_parse_part_number */
+
+int network_parse_part_string(void **ret_buffer, /* {{{ */
+                              size_t *ret_buffer_len, char *output,
+                              size_t const output_len) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+
+  uint16_t tmp16;
+  size_t const header_size = 2 * sizeof(uint16_t);
+
+  uint16_t pkg_length;
+  size_t payload_size;
+
+  if (output_len == 0)
+    return EINVAL;
+
+  if (buffer_len < header_size) {
+    WARNING("network_parse: network_parse_part_string: "
+            "Packet too short: "
+            "Chunk of at least size %" PRIsz " expected, "
+            "but buffer has only %" PRIsz " bytes left.",
+            header_size, buffer_len);
+    return -1;
+  }
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  /* pkg_type = ntohs (tmp16); */
+
+  memcpy((void *)&tmp16, buffer, sizeof(tmp16));
+  buffer += sizeof(tmp16);
+  pkg_length = ntohs(tmp16);
+  payload_size = ((size_t)pkg_length) - header_size;
+
+  /* Check that packet fits in the input buffer */
+  if (pkg_length > buffer_len) {
+    WARNING("network_parse: network_parse_part_string: "
+            "Packet too big: "
+            "Chunk of size %" PRIu16 " received, "
+            "but buffer has only %" PRIsz " bytes left.",
+            pkg_length, buffer_len);
+    return -1;
+  }
+
+  /* Check that pkg_length is in the valid range */
+  if (pkg_length <= header_size) {
+    WARNING("network_parse: network_parse_part_string: "
+            "Packet too short: "
+            "Header claims this packet is only %hu "
+            "bytes long.",
+            pkg_length);
+    return -1;
+  }
+
+  /* Check that the package data fits into the output buffer.
+   * The previous if-statement ensures that:
+   * `pkg_length > header_size' */
+  if (output_len < payload_size) {
+    WARNING("network_parse: network_parse_part_string: "
+            "Buffer too small: "
+            "Output buffer holds %" PRIsz " bytes, "
+            "which is too small to hold the received "
+            "%" PRIsz " byte string.",
+            output_len, payload_size);
+    return -1;
+  }
+
+  /* All sanity checks successfull, let's copy the data over */
+  memcpy((void *)output, (void *)buffer, payload_size);
+  buffer += payload_size;
+
+  /* For some very weird reason '\0' doesn't do the trick on SPARC in
+   * this statement. */
+  if (output[payload_size - 1] != 0) {
+    WARNING("network_parse: network_parse_part_string: "
+            "Received string does not end "
+            "with a NULL-byte.");
+    return -1;
+  }
+
+  *ret_buffer = buffer;
+  *ret_buffer_len = buffer_len - pkg_length;
+
+  return 0;
+} /* }}} int network_parse_part_string */
+
+size_t network_parse_part_size(void const *buffer, /* {{{ */
+                               size_t buffer_len) {
+  uint16_t pkg_length;
+
+  if (buffer_len < 2 * sizeof(uint16_t))
+    return 0;
+
+  memcpy(&pkg_length, (char const *)buffer + sizeof(uint16_t),
+         sizeof(pkg_length));
+  return (size_t)ntohs(pkg_length);
+} /* }}} size_t network_parse_part_size */
+
+int network_parse_part(network_parse_state_t *state, /* {{{ */
+                       void **ret_buffer, size_t *ret_buffer_len) {
+  value_list_t *vl = &state->vl;
+  notification_t *n = &state->n;
+  uint16_t pkg_type;
+  uint16_t pkg_length;
+  int status = 0;
+
+  if (*ret_buffer_len < 2 * sizeof(uint16_t))
+    return -1;
+
+  memcpy(&pkg_type, *ret_buffer, sizeof(pkg_type));
+  pkg_type = ntohs(pkg_type);
+  pkg_length = (uint16_t)network_parse_part_size(*ret_buffer, *ret_buffer_len);
+  if ((pkg_length > *ret_buffer_len) || (pkg_length < 2 * sizeof(uint16_t)))
+    return -1;
+
+  if (pkg_type == TYPE_VALUES) {
+    status = network_parse_part_values(ret_buffer, ret_buffer_len,
+                                       &vl->values, &vl->values_len);
+    if (status != 0)
+      return status;
+
+    meta_data_destroy(vl->meta);
+    vl->meta = NULL;
+    if (state->histogram != NULL) {
+      vl->meta = meta_data_create();
+      if ((vl->meta == NULL) ||
+          (meta_data_add_string(vl->meta, LATENCY_HISTOGRAM_META,
+                                state->histogram) != 0)) {
+        ERROR("network_parse: Attaching the histogram failed.");
+        meta_data_destroy(vl->meta);
+        vl->meta = NULL;
+      }
+      sfree(state->histogram);
+    }
+    return NETWORK_PARSE_VALUES;
+  } else if (pkg_type == TYPE_HISTOGRAM) {
+    char *histogram = malloc(pkg_length);
+    if (histogram == NULL)
+      return -ENOMEM;
+
+    status = network_parse_part_string(ret_buffer, ret_buffer_len, histogram,
+                                       pkg_length);
+    if (status == 0) {
+      sfree(state->histogram);
+      state->histogram = histogram;
+    } else {
+      sfree(histogram);
+    }
+  } else if (pkg_type == TYPE_TIME) {
+    uint64_t tmp = 0;
+    status = network_parse_part_number(ret_buffer, ret_buffer_len, &tmp);
+    if (status == 0) {
+      vl->time = TIME_T_TO_CDTIME_T(tmp);
+      n->time = TIME_T_TO_CDTIME_T(tmp);
+    }
+  } else if (pkg_type == TYPE_TIME_HR) {
+    uint64_t tmp = 0;
+    status = network_parse_part_number(ret_buffer, ret_buffer_len, &tmp);
+    if (status == 0) {
+      vl->time = (cdtime_t)tmp;
+      n->time = (cdtime_t)tmp;
+    }
+  } else if (pkg_type == TYPE_INTERVAL) {
+    uint64_t tmp = 0;
+    status = network_parse_part_number(ret_buffer, ret_buffer_len, &tmp);
+    if (status == 0)
+      vl->interval = TIME_T_TO_CDTIME_T(tmp);
+  } else if (pkg_type == TYPE_INTERVAL_HR) {
+    uint64_t tmp = 0;
+    status = network_parse_part_number(ret_buffer, ret_buffer_len, &tmp);
+    if (status == 0)
+      vl->interval = (cdtime_t)tmp;
+  } else if (pkg_type == TYPE_HOST) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len, vl->host,
+                                       sizeof(vl->host));
+    if (status == 0)
+      sstrncpy(n->host, vl->host, sizeof(n->host));
+  } else if (pkg_type == TYPE_PLUGIN) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len, vl->plugin,
+                                       sizeof(vl->plugin));
+    if (status == 0)
+      sstrncpy(n->plugin, vl->plugin, sizeof(n->plugin));
+  } else if (pkg_type == TYPE_PLUGIN_INSTANCE) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len,
+                                       vl->plugin_instance,
+                                       sizeof(vl->plugin_instance));
+    if (status == 0)
+      sstrncpy(n->plugin_instance, vl->plugin_instance,
+               sizeof(n->plugin_instance));
+  } else if (pkg_type == TYPE_TYPE) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len, vl->type,
+                                       sizeof(vl->type));
+    if (status == 0)
+      sstrncpy(n->type, vl->type, sizeof(n->type));
+  } else if (pkg_type == TYPE_TYPE_INSTANCE) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len,
+                                       vl->type_instance,
+                                       sizeof(vl->type_instance));
+    if (status == 0)
+      sstrncpy(n->type_instance, vl->type_instance, sizeof(n->type_instance));
+  } else if (pkg_type == TYPE_MESSAGE) {
+    status = network_parse_part_string(ret_buffer, ret_buffer_len, n->message,
+                                       sizeof(n->message));
+
+    if (status != 0) {
+      /* do nothing */
+    } else if ((n->severity != NOTIF_FAILURE) &&
+               (n->severity != NOTIF_WARNING) && (n->severity != NOTIF_OKAY)) {
+      INFO("network_parse: Ignoring notification with unknown severity %i.",
+           n->severity);
+    } else if (n->time == 0) {
+      INFO("network_parse: Ignoring notification with time == 0.");
+    } else if (strlen(n->message) == 0) {
+      INFO("network_parse: Ignoring notification with an empty message.");
+    } else {
+      return NETWORK_PARSE_NOTIFICATION;
+    }
+  } else if (pkg_type == TYPE_SEVERITY) {
+    uint64_t tmp = 0;
+    status = network_parse_part_number(ret_buffer, ret_buffer_len, &tmp);
+    if (status == 0)
+      n->severity = (int)tmp;
+  } else {
+    DEBUG("network_parse: network_parse_part: Unknown part type: 0x%04hx",
+          pkg_type);
+    *ret_buffer = ((char *)*ret_buffer) + pkg_length;
+    *ret_buffer_len -= (size_t)pkg_length;
+  }
+
+  return status;
+} /* }}} int network_parse_part */
+
+void network_parse_state_free(network_parse_state_t *state) /* {{{ */
+{
+  sfree(state->vl.values);
+  state->vl.values_len = 0;
+  meta_data_destroy(state->vl.meta);
+  state->vl.meta = NULL;
+  sfree(state->histogram);
+} /* }}} void network_parse_state_free */
@@ -0,0 +1,74 @@
+/**
+ * collectd - src/utils/network_parse/network_parse.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_NETWORK_PARSE_H
+#define UTILS_NETWORK_PARSE_H 1
+
+#include "collectd.h"
+
+#include "network.h"
+#include "plugin.h"
+
+/* Decoding of the parts of the binary network protocol that don't involve
+ * signatures, encryption or compression. Parts are self-delimiting, so this
+ * works on datagrams as well as on streams. */
+
+/* Value lists and notifications are built up from consecutive parts; the
+ * state holds the fields seen so far. Initialize with all zeros. */
+typedef struct {
+  value_list_t vl;
+  notification_t n;
+  /* Histogram part waiting for the next values part. */
+  char *histogram;
+} network_parse_state_t;
+
+/* Returned by network_parse_part() for values and notification parts. */
+#define NETWORK_PARSE_VALUES 1
+#define NETWORK_PARSE_NOTIFICATION 2
+
+/* Returns the total size of the part at `buffer', or zero if `buffer_len'
+ * bytes are not enough to tell. */
+size_t network_parse_part_size(void const *buffer, size_t buffer_len);
+
+int network_parse_part_values(void **ret_buffer, size_t *ret_buffer_len,
+                              value_t **ret_values, size_t *ret_num_values);
+int network_parse_part_number(void **ret_buffer, size_t *ret_buffer_len,
+                              uint64_t *value);
+int network_parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
+                              char *output, size_t const output_len);
+
+/* Parses the part at `*ret_buffer' into `state' and advances the buffer past
+ * it. Unknown parts are skipped. Returns NETWORK_PARSE_VALUES if a value list
+ * is complete: `state->vl' may then be dispatched, after which its values
+ * and meta data must be freed with network_parse_state_free(). Returns
+ * NETWORK_PARSE_NOTIFICATION if a valid
+ * notification is complete in `state->n'. Returns zero if more parts are
+ * needed and less than zero on error. */
+int network_parse_part(network_parse_state_t *state, void **ret_buffer,
+                       size_t *ret_buffer_len);
+
+/* Frees the values and meta data of `state->vl' and any pending parts. The
+ * other fields are preserved, so parsing may continue with the next part. */
+void network_parse_state_free(network_parse_state_t *state);
+
+#endif /* UTILS_NETWORK_PARSE_H */
@@ -27,6 +27,7 @@
 #include "utils/oauth/oauth.h"
 
 #include <curl/curl.h>
+#include <pthread.h>
 
 #include <yajl/yajl_tree.h>
 #include <yajl/yajl_version.h>
@@ -55,8 +56,11 @@ struct oauth_s {
 
   EVP_PKEY *key;
 
+  /* token, valid_until and refreshing are protected by lock. */
+  pthread_mutex_t lock;
   char *token;
   cdtime_t valid_until;
+  bool refreshing;
 };
 
 struct memory_s {
@@ -325,13 +329,14 @@ int oauth_parse_json_token(char const *json, /* {{{ */
   return 0;
 } /* }}} int oauth_parse_json_token */
 
-static int new_token(oauth_t *auth) /* {{{ */
-{
+/* fetch_token requests a new access token from the token endpoint. It does
+ * not modify "auth" and may be called without holding auth->lock. */
+static int fetch_token(oauth_t *auth, char *access_token, /* {{{ */
+                       size_t access_token_size, cdtime_t *valid_until) {
   CURL *curl;
   char assertion[1024];
   char post_data[1024];
   memory_t data;
-  char access_token[GOOGLE_OAUTH_ACCESS_TOKEN_SIZE];
   cdtime_t expires_in;
   cdtime_t now;
   char curl_errbuf[CURL_ERROR_SIZE];
@@ -392,8 +397,8 @@ static int new_token(oauth_t *auth) /* {{{ */
     }
   }
 
-  status = oauth_parse_json_token(data.memory, access_token,
-                                  sizeof(access_token), &expires_in);
+  status = oauth_parse_json_token(data.memory, access_token, access_token_size,
+                                  &expires_in);
   if (status != 0) {
     sfree(data.memory);
     curl_easy_cleanup(curl);
@@ -401,27 +406,32 @@ static int new_token(oauth_t *auth) /* {{{ */
     return -1;
   }
 
-  sfree(auth->token);
-  auth->token = strdup(access_token);
-  if (auth->token == NULL) {
-    ERROR("utils_oauth: strdup failed");
-    auth->valid_until = 0;
-
-    sfree(data.memory);
-    curl_easy_cleanup(curl);
-    return -1;
-  }
-
   INFO("utils_oauth: OAuth2 access token is valid for %.3fs",
        CDTIME_T_TO_DOUBLE(expires_in));
-  auth->valid_until = now + expires_in;
+  *valid_until = now + expires_in;
 
   sfree(data.memory);
   curl_easy_cleanup(curl);
 
   return 0;
-} /* }}} int new_token */
+} /* }}} int fetch_token */
+
+/* store_token must be called with auth->lock held. */
+static int store_token(oauth_t *auth, char const *access_token, /* {{{ */
+                       cdtime_t valid_until) {
+  char *token = strdup(access_token);
+  if (token == NULL) {
+    ERROR("utils_oauth: strdup failed");
+    return -1;
+  }
+
+  sfree(auth->token);
+  auth->token = token;
+  auth->valid_until = valid_until;
+  return 0;
+} /* }}} int store_token */
 
+/* renew_token must be called with auth->lock held. */
 static int renew_token(oauth_t *auth) /* {{{ */
 {
   /* Renew OAuth token 30 seconds *before* it expires. */
@@ -430,7 +440,14 @@ static int renew_token(oauth_t *auth) /* {{{ */
   if (auth->valid_until > (cdtime() + slack))
     return 0;
 
-  return new_token(auth);
+  char access_token[GOOGLE_OAUTH_ACCESS_TOKEN_SIZE];
+  cdtime_t valid_until = 0;
+  int status =
+      fetch_token(auth, access_token, sizeof(access_token), &valid_until);
+  if (status != 0)
+    return status;
+
+  return store_token(auth, access_token, valid_until);
 } /* }}} int renew_token */
 
 static oauth_t *oauth_create(char const *url, char const *iss,
@@ -447,6 +464,7 @@ static oauth_t *oauth_create(char const *url, char const *iss,
   if (auth == NULL)
     return NULL;
   memset(auth, 0, sizeof(*auth));
+  pthread_mutex_init(&auth->lock, /* attr = */ NULL);
 
   auth->url = strdup(url);
   auth->iss = strdup(iss);
@@ -616,6 +634,8 @@ void oauth_destroy(oauth_t *auth) /* {{{ */
     auth->key = NULL;
   }
 
+  sfree(auth->token);
+  pthread_mutex_destroy(&auth->lock);
   sfree(auth);
 } /* }}} void oauth_destroy */
 
@@ -627,11 +647,44 @@ int oauth_access_token(oauth_t *auth, char *buffer,
   if (auth == NULL)
     return EINVAL;
 
+  pthread_mutex_lock(&auth->lock);
   status = renew_token(auth);
-  if (status != 0)
+  if (status != 0) {
+    pthread_mutex_unlock(&auth->lock);
     return status;
+  }
   assert(auth->token != NULL);
 
   sstrncpy(buffer, auth->token, buffer_size);
+  pthread_mutex_unlock(&auth->lock);
   return 0;
 } /* }}} int oauth_access_token */
+
+int oauth_refresh_token(oauth_t *auth, cdtime_t slack) /* {{{ */
+{
+  if (auth == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&auth->lock);
+  if (auth->refreshing || (auth->valid_until > (cdtime() + slack))) {
+    pthread_mutex_unlock(&auth->lock);
+    return 0;
+  }
+  auth->refreshing = true;
+  pthread_mutex_unlock(&auth->lock);
+
+  /* Don't hold the lock while talking to the token endpoint: the current
+   * token is still valid and oauth_access_token() may keep handing it out. */
+  char access_token[GOOGLE_OAUTH_ACCESS_TOKEN_SIZE];
+  cdtime_t valid_until = 0;
+  int status =
+      fetch_token(auth, access_token, sizeof(access_token), &valid_until);
+
+  pthread_mutex_lock(&auth->lock);
+  if (status == 0)
+    status = store_token(auth, access_token, valid_until);
+  auth->refreshing = false;
+  pthread_mutex_unlock(&auth->lock);
+
+  return status;
+} /* }}} int oauth_refresh_token */
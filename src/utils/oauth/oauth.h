@@ -65,6 +65,15 @@ oauth_google_t oauth_create_google_default(char const *scope);
 /* oauth_destroy frees all resources associated with an OAuth object. */
 void oauth_destroy(oauth_t *auth);
 
+/* oauth_access_token copies a valid access token to buffer, requesting a new
+ * token first if the current one expires within the next 30 seconds. This
+ * function is thread-safe. */
 int oauth_access_token(oauth_t *auth, char *buffer, size_t buffer_size);
 
+/* oauth_refresh_token requests a new access token if the current one expires
+ * within "slack". Other threads may continue to use the current token while
+ * the request is in progress. Intended to be called periodically from a
+ * background thread, so that oauth_access_token rarely has to block. */
+int oauth_refresh_token(oauth_t *auth, cdtime_t slack);
+
 #endif
@@ -0,0 +1,197 @@
+/**
+ * collectd - src/utils/proc_file/proc_file.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/proc_file/proc_file.h"
+
+#define PROC_FILE_INITIAL_SIZE 4096
+/* Upper bound for the buffer, in case a file keeps growing while reading. */
+#define PROC_FILE_MAX_SIZE (16 * 1024 * 1024)
+
+struct proc_file_s {
+  char *path;
+  int fd;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t len;
+  size_t pos;
+};
+
+proc_file_t *proc_file_create_size(char const *path, size_t size) /* {{{ */
+{
+  if (size < 2)
+    size = 2;
+
+  proc_file_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
+    return NULL;
+
+  pf->path = strdup(path);
+  pf->buffer = malloc(size);
+  if ((pf->path == NULL) || (pf->buffer == NULL)) {
+    free(pf->path);
+    free(pf->buffer);
+    free(pf);
+    return NULL;
+  }
+  pf->buffer_size = size;
+  pf->buffer[0] = 0;
+  pf->fd = -1;
+
+  return pf;
+} /* }}} proc_file_t *proc_file_create_size */
+
+proc_file_t *proc_file_create(char const *path) /* {{{ */
+{
+  return proc_file_create_size(path, PROC_FILE_INITIAL_SIZE);
+} /* }}} proc_file_t *proc_file_create */
+
+void proc_file_destroy(proc_file_t *pf) /* {{{ */
+{
+  if (pf == NULL)
+    return;
+
+  if (pf->fd >= 0)
+    close(pf->fd);
+  free(pf->path);
+  free(pf->buffer);
+  free(pf);
+} /* }}} void proc_file_destroy */
+
+char const *proc_file_path(proc_file_t const *pf) { return pf->path; }
+
+ssize_t proc_file_read(proc_file_t *pf) /* {{{ */
+{
+  pf->len = 0;
+  pf->pos = 0;
+  pf->buffer[0] = 0;
+
+  if (pf->fd < 0) {
+    pf->fd = open(pf->path, O_RDONLY | O_CLOEXEC);
+    if (pf->fd < 0)
+      return -1;
+  }
+
+  while (42) {
+    ssize_t status = pread(pf->fd, pf->buffer, pf->buffer_size - 1, 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      int saved_errno = errno;
+      close(pf->fd);
+      pf->fd = -1;
+      errno = saved_errno;
+      return -1;
+    }
+
+    /* A short read means we got the whole file. Otherwise, grow the buffer
+     * and read again from the beginning, so the contents are consistent. */
+    if (((size_t)status < pf->buffer_size - 1) ||
+        (pf->buffer_size >= PROC_FILE_MAX_SIZE)) {
+      pf->len = (size_t)status;
+      pf->buffer[pf->len] = 0;
+      return status;
+    }
+
+    char *tmp = realloc(pf->buffer, 2 * pf->buffer_size);
+    if (tmp == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+    pf->buffer = tmp;
+    pf->buffer_size *= 2;
+  }
+} /* }}} ssize_t proc_file_read */
+
+char *proc_file_next_line(proc_file_t *pf) /* {{{ */
+{
+  if (pf->pos >= pf->len)
+    return NULL;
+
+  char *line = pf->buffer + pf->pos;
+  char *end = memchr(line, '\n', pf->len - pf->pos);
+  if (end == NULL) {
+    pf->pos = pf->len;
+  } else {
+    *end = 0;
+    pf->pos = (size_t)(end - pf->buffer) + 1;
+  }
+
+  return line;
+} /* }}} char *proc_file_next_line */
+
+size_t proc_file_split(char *line, char **fields, size_t size) /* {{{ */
+{
+  size_t num = 0;
+  char *ptr = line;
+
+  while (num < size) {
+    while ((*ptr == ' ') || (*ptr == '\t'))
+      ptr++;
+    if (*ptr == 0)
+      break;
+
+    fields[num++] = ptr;
+    while ((*ptr != 0) && (*ptr != ' ') && (*ptr != '\t'))
+      ptr++;
+    if (*ptr == 0)
+      break;
+    *ptr++ = 0;
+  }
+
+  return num;
+} /* }}} size_t proc_file_split */
+
+int proc_parse_uint64(char const *str, char **endptr, /* {{{ */
+                      uint64_t *ret_value) {
+  uint64_t value = 0;
+  char const *ptr = str;
+
+  if ((*ptr < '0') || (*ptr > '9'))
+    return EINVAL;
+
+  while ((*ptr >= '0') && (*ptr <= '9')) {
+    uint64_t digit = (uint64_t)(*ptr - '0');
+    if (value > (UINT64_MAX - digit) / 10)
+      return ERANGE;
+    value = 10 * value + digit;
+    ptr++;
+  }
+
+  if (endptr != NULL)
+    *endptr = (char *)ptr;
+  *ret_value = value;
+  return 0;
+} /* }}} int proc_parse_uint64 */
+
+uint64_t proc_atou64(char const *str) /* {{{ */
+{
+  uint64_t value = 0;
+
+  if (proc_parse_uint64(str, NULL, &value) != 0)
+    return 0;
+  return value;
+} /* }}} uint64_t proc_atou64 */
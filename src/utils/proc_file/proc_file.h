@@ -0,0 +1,147 @@
+/**
+ * collectd - src/utils/proc_file/proc_file.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_PROC_FILE_H
+#define UTILS_PROC_FILE_H 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Repeated reading of small files below /proc and /sys. The file is kept open
+ * and its contents are read with a single pread(2) into a buffer that is
+ * reused for every read. Lines and fields are tokenized in place, so reading
+ * a file copies its contents exactly once.
+ *
+ * A proc_file_t is not thread-safe.
+ */
+struct proc_file_s;
+typedef struct proc_file_s proc_file_t;
+
+/*
+ * NAME
+ *   proc_file_create
+ *
+ * DESCRIPTION
+ *   Creates a handle for the file at `path'. The file is opened by the first
+ *   call to proc_file_read(), so the file doesn't need to exist yet.
+ *
+ * RETURN VALUE
+ *   The new handle or NULL if memory could not be allocated.
+ */
+proc_file_t *proc_file_create(char const *path);
+
+/*
+ * NAME
+ *   proc_file_create_size
+ *
+ * DESCRIPTION
+ *   Like proc_file_create(), but starts with a buffer of `size' bytes. Useful
+ *   when keeping many small files open, such as single-value attributes in
+ *   /sys. The buffer still grows as needed.
+ */
+proc_file_t *proc_file_create_size(char const *path, size_t size);
+
+/*
+ * NAME
+ *   proc_file_destroy
+ */
+void proc_file_destroy(proc_file_t *pf);
+
+/*
+ * NAME
+ *   proc_file_path
+ */
+char const *proc_file_path(proc_file_t const *pf);
+
+/*
+ * NAME
+ *   proc_file_read
+ *
+ * DESCRIPTION
+ *   Reads the current contents of the file from the beginning and rewinds
+ *   the line cursor. The buffer is grown until it holds the whole file. If
+ *   reading fails, the file is closed and opened again by the next call.
+ *
+ * RETURN VALUE
+ *   The number of bytes read or -1 upon failure, with errno set.
+ */
+ssize_t proc_file_read(proc_file_t *pf);
+
+/*
+ * NAME
+ *   proc_file_next_line
+ *
+ * DESCRIPTION
+ *   Returns the next line of the contents read last, with the newline
+ *   replaced by a null byte. The line may be modified by the caller, for
+ *   example by strsplit(), until the next call to proc_file_read().
+ *
+ * RETURN VALUE
+ *   The next line or NULL if all lines have been returned.
+ */
+char *proc_file_next_line(proc_file_t *pf);
+
+/*
+ * NAME
+ *   proc_file_split
+ *
+ * DESCRIPTION
+ *   Splits `line' at spaces and tabs in place, storing up to `size' fields in
+ *   `fields'. Like with strsplit(), consecutive separators are treated as
+ *   one, but the line is scanned once, without strtok_r().
+ *
+ * RETURN VALUE
+ *   The number of fields stored.
+ */
+size_t proc_file_split(char *line, char **fields, size_t size);
+
+/*
+ * NAME
+ *   proc_parse_uint64
+ *
+ * DESCRIPTION
+ *   Parses the decimal number at the beginning of `str'. Parsing stops at the
+ *   first character that isn't a digit; if `endptr' is not NULL, a pointer to
+ *   that character is stored there.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EINVAL if `str' doesn't start with a digit and ERANGE
+ *   if the number doesn't fit into 64 bits.
+ */
+int proc_parse_uint64(char const *str, char **endptr, uint64_t *ret_value);
+
+/*
+ * NAME
+ *   proc_atou64
+ *
+ * DESCRIPTION
+ *   Drop-in replacement for atoll(3) on the unsigned counters found in /proc.
+ *
+ * RETURN VALUE
+ *   The number at the beginning of `str' or zero if there is none or it is
+ *   out of range.
+ */
+uint64_t proc_atou64(char const *str);
+
+#endif /* UTILS_PROC_FILE_H */
@@ -0,0 +1,182 @@
+/**
+ * collectd - src/utils/proc_file/proc_file_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/proc_file/proc_file.h"
+
+static char *write_temp_file(char const *content, size_t len) {
+  static char path[64];
+  sstrncpy(path, "/tmp/proc_file_test.XXXXXX", sizeof(path));
+
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return NULL;
+  if (write(fd, content, len) != (ssize_t)len) {
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+  return path;
+}
+
+DEF_TEST(lines) {
+  char const content[] = "cpu  1 2 3\ncpu0 4\t5  6\n\nintr 7";
+  char *path;
+  CHECK_NOT_NULL(path = write_temp_file(content, strlen(content)));
+
+  proc_file_t *pf;
+  CHECK_NOT_NULL(pf = proc_file_create(path));
+  EXPECT_EQ_STR(path, proc_file_path(pf));
+
+  /* Read twice to make sure the cursor is rewound. */
+  for (int i = 0; i < 2; i++) {
+    char *fields[8];
+
+    EXPECT_EQ_INT((int)strlen(content), (int)proc_file_read(pf));
+
+    char *line = proc_file_next_line(pf);
+    EXPECT_EQ_STR("cpu  1 2 3", line);
+    EXPECT_EQ_INT(4, (int)proc_file_split(line, fields, 8));
+    EXPECT_EQ_STR("cpu", fields[0]);
+    EXPECT_EQ_STR("3", fields[3]);
+
+    line = proc_file_next_line(pf);
+    EXPECT_EQ_INT(2, (int)proc_file_split(line, fields, 2));
+    EXPECT_EQ_STR("cpu0", fields[0]);
+    EXPECT_EQ_STR("4", fields[1]);
+
+    EXPECT_EQ_STR("", proc_file_next_line(pf));
+    EXPECT_EQ_STR("intr 7", proc_file_next_line(pf));
+    EXPECT_EQ_PTR(NULL, proc_file_next_line(pf));
+  }
+
+  proc_file_destroy(pf);
+  unlink(path);
+  return 0;
+}
+
+DEF_TEST(grow) {
+  size_t len = 3 * 4096 + 17;
+  char *content = malloc(len);
+  for (size_t i = 0; i < len; i++)
+    content[i] = ((i % 64) == 63) ? '\n' : 'a' + (i % 26);
+
+  char *path;
+  CHECK_NOT_NULL(path = write_temp_file(content, len));
+
+  proc_file_t *pf;
+  CHECK_NOT_NULL(pf = proc_file_create(path));
+  EXPECT_EQ_INT((int)len, (int)proc_file_read(pf));
+
+  size_t lines = 0;
+  while (proc_file_next_line(pf) != NULL)
+    lines++;
+  EXPECT_EQ_INT((int)((len + 63) / 64), (int)lines);
+
+  proc_file_destroy(pf);
+  unlink(path);
+  free(content);
+  return 0;
+}
+
+DEF_TEST(small_buffer) {
+  char const content[] = "1800000\n";
+
+  char *path;
+  CHECK_NOT_NULL(path = write_temp_file(content, strlen(content)));
+
+  proc_file_t *pf;
+  CHECK_NOT_NULL(pf = proc_file_create_size(path, 4));
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ_INT((int)strlen(content), (int)proc_file_read(pf));
+    EXPECT_EQ_STR("1800000", proc_file_next_line(pf));
+  }
+
+  proc_file_destroy(pf);
+  unlink(path);
+  return 0;
+}
+
+DEF_TEST(missing) {
+  proc_file_t *pf;
+  CHECK_NOT_NULL(pf = proc_file_create("/nonexistent/proc_file_test"));
+
+  EXPECT_EQ_INT(-1, (int)proc_file_read(pf));
+  EXPECT_EQ_INT(ENOENT, errno);
+  EXPECT_EQ_PTR(NULL, proc_file_next_line(pf));
+
+  proc_file_destroy(pf);
+  return 0;
+}
+
+DEF_TEST(parse_uint64) {
+  struct {
+    char const *str;
+    int want_status;
+    uint64_t want;
+    char const *want_rest;
+  } cases[] = {
+      {"0", 0, 0, ""},
+      {"12345 kB", 0, 12345, " kB"},
+      {"18446744073709551615", 0, UINT64_MAX, ""},
+      {"18446744073709551616", ERANGE, 0, NULL},
+      {"-1", EINVAL, 0, NULL},
+      {"", EINVAL, 0, NULL},
+      {" 1", EINVAL, 0, NULL},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    uint64_t value = 0;
+    char *rest = NULL;
+
+    printf("## case %zu: \"%s\"\n", i, cases[i].str);
+    EXPECT_EQ_INT(cases[i].want_status,
+                  proc_parse_uint64(cases[i].str, &rest, &value));
+    if (cases[i].want_status != 0)
+      continue;
+    EXPECT_EQ_UINT64(cases[i].want, value);
+    EXPECT_EQ_STR(cases[i].want_rest, rest);
+  }
+
+  EXPECT_EQ_UINT64(42, proc_atou64("42"));
+  EXPECT_EQ_UINT64(0, proc_atou64("abc"));
+  EXPECT_EQ_UINT64(0, proc_atou64("99999999999999999999"));
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(lines);
+  RUN_TEST(grow);
+  RUN_TEST(small_buffer);
+  RUN_TEST(missing);
+  RUN_TEST(parse_uint64);
+
+  END_TEST;
+}
@@ -29,10 +29,50 @@
 
 #include "collectd.h"
 #include "utils/common/common.h"
+#include "utils/hashtable/hashtable.h"
 #include "utils/proc_pids/proc_pids.h"
 
+#if HAVE_LINUX_CN_PROC_H
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#endif
+
 #define UTIL_NAME "utils_proc_pids"
 
+/* Process event, as reported by the proc connector. New processes inherit the
+ * name of their parent, "exec" and "comm" events change it. */
+typedef enum {
+  PROC_PIDS_EVENT_FORK,
+  PROC_PIDS_EVENT_EXEC,
+  PROC_PIDS_EVENT_COMM,
+  PROC_PIDS_EVENT_EXIT,
+} proc_pids_event_type_t;
+
+typedef struct {
+  proc_pids_event_type_t type;
+  pid_t pid;
+  pid_t parent; /* FORK only */
+  proc_comm_t comm; /* COMM only */
+} proc_pids_event_t;
+
+struct proc_pids_watch_s {
+  int fd;
+  /* Cleared when events may have been lost, so that the next update scans
+   * procfs. */
+  bool synced;
+  proc_pids_event_t *events;
+  size_t events_num;
+  size_t events_size;
+};
+
+/* Maps process names to the first proc_pids index with that name. Further
+ * indices with the same name are chained through `next'. */
+typedef struct {
+  c_hashtable_t *table;
+  size_t *next;
+} proc_pids_index_t;
+
 void pids_list_free(pids_list_t *list) {
   assert(list);
 
@@ -123,6 +163,86 @@ int pids_list_contains_pid(pids_list_t *list, const pid_t pid) {
   return 0;
 }
 
+/* Removes `pid' from the list, not preserving the order. */
+static void pids_list_remove_pid(pids_list_t *list, const pid_t pid) {
+  for (size_t i = 0; i < list->size; i++)
+    if (list->pids[i] == pid) {
+      list->pids[i] = list->pids[list->size - 1];
+      list->size--;
+      return;
+    }
+}
+
+static int pid_compare(const void *a, const void *b) {
+  pid_t pa = *(const pid_t *)a;
+  pid_t pb = *(const pid_t *)b;
+  return (pa > pb) - (pa < pb);
+}
+
+/* 64 bit FNV-1a */
+static uint64_t proc_name_hash(char const *str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *str != 0; str++) {
+    hash ^= (uint64_t)(unsigned char)*str;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void proc_pids_index_free(proc_pids_index_t *index) {
+  if (index->table != NULL)
+    c_hashtable_destroy(index->table);
+  index->table = NULL;
+  sfree(index->next);
+}
+
+static int proc_pids_index_init(proc_pids_index_t *index,
+                                proc_pids_t **proc_pids,
+                                size_t proc_pids_num) {
+  index->table = c_hashtable_create();
+  index->next = calloc(proc_pids_num, sizeof(*index->next));
+  if ((index->table == NULL) || (index->next == NULL)) {
+    ERROR(UTIL_NAME ": Alloc error\n");
+    proc_pids_index_free(index);
+    return -1;
+  }
+
+  for (size_t i = 0; i < proc_pids_num; i++) {
+    char const *name = proc_pids[i]->process_name;
+    uint64_t hash = proc_name_hash(name);
+    void *head;
+
+    index->next[i] = proc_pids_num;
+    if (c_hashtable_get(index->table, hash, name, &head) == 0) {
+      /* Name configured more than once: append to its chain. */
+      size_t last = (size_t)(uintptr_t)head;
+      while (index->next[last] < proc_pids_num)
+        last = index->next[last];
+      index->next[last] = i;
+    } else if (c_hashtable_insert(index->table, hash, name,
+                                  (void *)(uintptr_t)i) != 0) {
+      ERROR(UTIL_NAME ": Alloc error\n");
+      proc_pids_index_free(index);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Adds `pid' to the lists of all processes named `comm'. */
+static void proc_pids_index_add(proc_pids_index_t *index,
+                                proc_pids_t **proc_pids, size_t proc_pids_num,
+                                char const *comm, pid_t pid) {
+  void *head;
+  if (c_hashtable_get(index->table, proc_name_hash(comm), comm, &head) != 0)
+    return;
+
+  for (size_t i = (size_t)(uintptr_t)head; i < proc_pids_num;
+       i = index->next[i])
+    if (!pids_list_contains_pid(proc_pids[i]->curr, pid))
+      pids_list_add_pid(proc_pids[i]->curr, pid);
+}
+
 /*
  * NAME
  *   read_proc_name
@@ -141,37 +261,41 @@ int pids_list_contains_pid(pids_list_t *list, const pid_t pid) {
  *   On success, the number of read bytes (includes stripped \n).
  *   -1 on file open error
  */
-static int read_proc_name(const char *procfs_path,
-                          const struct dirent *pid_entry, char *name,
-                          const size_t out_size) {
-  assert(pid_entry);
+static int read_pid_name(const char *procfs_path, const char *pid_name,
+                         char *name, const size_t out_size) {
   assert(name);
   assert(out_size);
   memset(name, 0, out_size);
 
-  const char *comm_file_name = "comm";
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s/comm", procfs_path, pid_name);
 
-  char *path = ssnprintf_alloc("%s/%s/%s", procfs_path, pid_entry->d_name,
-                               comm_file_name);
-  if (path == NULL)
-    return -1;
-  FILE *f = fopen(path, "r");
-  if (f == NULL) {
-    ERROR(UTIL_NAME ": Failed to open comm file, error: %d\n", errno);
-    sfree(path);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    /* Short-lived processes regularly exit before their name is read. */
+    if (errno != ENOENT)
+      ERROR(UTIL_NAME ": Failed to open comm file, error: %d\n", errno);
     return -1;
   }
-  size_t read_length = fread(name, sizeof(char), out_size, f);
+  ssize_t read_length = read(fd, name, out_size);
+  close(fd);
+  if (read_length < 0)
+    return -1;
   name[out_size - 1] = '\0';
-  fclose(f);
-  sfree(path);
   /* strip new line ending */
   char *newline = strchr(name, '\n');
   if (newline) {
     *newline = '\0';
   }
 
-  return read_length;
+  return (int)read_length;
+}
+
+static int read_proc_name(const char *procfs_path,
+                          const struct dirent *pid_entry, char *name,
+                          const size_t out_size) {
+  assert(pid_entry);
+  return read_pid_name(procfs_path, pid_entry->d_name, name, out_size);
 }
 
 /*
@@ -253,30 +377,65 @@ static void swap_proc_pids(proc_pids_t **proc_pids, size_t proc_pids_num) {
   }
 }
 
+/* Swaps the lists and makes sure the new `curr' list exists and is empty. */
+static int start_update(proc_pids_t **proc_pids, size_t proc_pids_num) {
+  swap_proc_pids(proc_pids, proc_pids_num);
+
+  for (size_t i = 0; i < proc_pids_num; i++) {
+    if (NULL == proc_pids[i]->curr)
+      proc_pids[i]->curr = calloc(1, sizeof(*(proc_pids[i]->curr)));
+
+    if (NULL == proc_pids[i]->curr) {
+      ERROR(UTIL_NAME ": Alloc error\n");
+      swap_proc_pids(proc_pids, proc_pids_num);
+      return -1;
+    }
+
+    proc_pids[i]->curr->size = 0;
+  }
+  return 0;
+}
+
+/* Sorts the `curr' lists and sets the `changed' flags. Since the `prev' lists
+ * were sorted by the previous update, they can be compared directly. */
+static void finish_update(proc_pids_t **proc_pids, size_t proc_pids_num) {
+  for (size_t i = 0; i < proc_pids_num; i++) {
+    pids_list_t *curr = proc_pids[i]->curr;
+    pids_list_t *prev = proc_pids[i]->prev;
+
+    if (curr->size > 1)
+      qsort(curr->pids, curr->size, sizeof(*curr->pids), pid_compare);
+
+    if ((prev == NULL) || (prev->size != curr->size))
+      proc_pids[i]->changed = (prev != NULL) || (curr->size > 0);
+    else
+      proc_pids[i]->changed =
+          (curr->size > 0) &&
+          (memcmp(prev->pids, curr->pids, curr->size * sizeof(pid_t)) != 0);
+  }
+}
+
 int proc_pids_update(const char *procfs_path, proc_pids_t **proc_pids,
                      size_t proc_pids_num) {
   assert(procfs_path);
   assert(proc_pids);
 
+  proc_pids_index_t index = {0};
+  if (proc_pids_index_init(&index, proc_pids, proc_pids_num) != 0)
+    return -1;
+
   DIR *proc_dir = opendir(procfs_path);
   if (proc_dir == NULL) {
     ERROR(UTIL_NAME ": Could not open %s directory, error: %d", procfs_path,
           errno);
+    proc_pids_index_free(&index);
     return -1;
   }
 
-  swap_proc_pids(proc_pids, proc_pids_num);
-
-  for (size_t i = 0; i < proc_pids_num; i++) {
-    if (NULL == proc_pids[i]->curr)
-      proc_pids[i]->curr = calloc(1, sizeof(*(proc_pids[i]->curr)));
-
-    if (NULL == proc_pids[i]->curr) {
-      ERROR(UTIL_NAME ": Alloc error\n");
-      goto update_error;
-    }
-
-    proc_pids[i]->curr->size = 0;
+  if (start_update(proc_pids, proc_pids_num) != 0) {
+    closedir(proc_dir);
+    proc_pids_index_free(&index);
+    return -1;
   }
 
   /* Go through procfs and find PIDS and their comms */
@@ -294,23 +453,294 @@ int proc_pids_update(const char *procfs_path, proc_pids_t **proc_pids,
       continue;
 
     /* Try to find comm in input procs array */
-    for (size_t i = 0; i < proc_pids_num; ++i) {
-      if (0 ==
-          strncmp(comm, proc_pids[i]->process_name, STATIC_ARRAY_SIZE(comm)))
-        pids_list_add_pid(proc_pids[i]->curr, pid);
-    }
+    proc_pids_index_add(&index, proc_pids, proc_pids_num, comm, pid);
   }
+  proc_pids_index_free(&index);
 
   int close_result = closedir(proc_dir);
   if (0 != close_result) {
     ERROR(UTIL_NAME ": failed to close /proc directory, error: %d", errno);
-    goto update_error;
+    swap_proc_pids(proc_pids, proc_pids_num);
+    return -1;
   }
+
+  finish_update(proc_pids, proc_pids_num);
   return 0;
+}
 
-update_error:
-  swap_proc_pids(proc_pids, proc_pids_num);
-  return -1;
+/* Applies one process event to the `curr' lists. */
+static void apply_event(const char *procfs_path, proc_pids_index_t *index,
+                        proc_pids_t **proc_pids, size_t proc_pids_num,
+                        proc_pids_event_t const *ev) {
+  proc_comm_t comm;
+
+  switch (ev->type) {
+  case PROC_PIDS_EVENT_FORK:
+    for (size_t i = 0; i < proc_pids_num; i++) {
+      pids_list_t *curr = proc_pids[i]->curr;
+      if (pids_list_contains_pid(curr, ev->parent) &&
+          !pids_list_contains_pid(curr, ev->pid))
+        pids_list_add_pid(curr, ev->pid);
+    }
+    break;
+
+  case PROC_PIDS_EVENT_EXEC:
+  case PROC_PIDS_EVENT_COMM:
+  case PROC_PIDS_EVENT_EXIT:
+    for (size_t i = 0; i < proc_pids_num; i++)
+      pids_list_remove_pid(proc_pids[i]->curr, ev->pid);
+
+    if (ev->type == PROC_PIDS_EVENT_EXIT)
+      break;
+
+    if (ev->type == PROC_PIDS_EVENT_COMM) {
+      sstrncpy(comm, ev->comm, sizeof(comm));
+    } else {
+      char pid_name[32];
+      snprintf(pid_name, sizeof(pid_name), "%ld", (long)ev->pid);
+      if (read_pid_name(procfs_path, pid_name, comm, sizeof(comm)) <= 0)
+        break;
+    }
+    proc_pids_index_add(index, proc_pids, proc_pids_num, comm, ev->pid);
+    break;
+  }
+}
+
+/* Updates the lists from the events queued in `watch', starting from the
+ * previous state instead of an empty list. */
+static int apply_events(proc_pids_watch_t *watch, const char *procfs_path,
+                        proc_pids_t **proc_pids, size_t proc_pids_num) {
+  proc_pids_index_t index = {0};
+  if (proc_pids_index_init(&index, proc_pids, proc_pids_num) != 0)
+    return -1;
+
+  if (start_update(proc_pids, proc_pids_num) != 0) {
+    proc_pids_index_free(&index);
+    return -1;
+  }
+
+  for (size_t i = 0; i < proc_pids_num; i++) {
+    if ((proc_pids[i]->prev == NULL) ||
+        (pids_list_add_list(proc_pids[i]->curr, proc_pids[i]->prev) == 0))
+      continue;
+
+    swap_proc_pids(proc_pids, proc_pids_num);
+    proc_pids_index_free(&index);
+    return -1;
+  }
+
+  for (size_t i = 0; i < watch->events_num; i++)
+    apply_event(procfs_path, &index, proc_pids, proc_pids_num,
+                watch->events + i);
+  watch->events_num = 0;
+
+  proc_pids_index_free(&index);
+  finish_update(proc_pids, proc_pids_num);
+  return 0;
+}
+
+#if HAVE_LINUX_CN_PROC_H
+static int watch_send_op(int fd, enum proc_cn_mcast_op op) {
+  union {
+    struct nlmsghdr hdr;
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+  } req;
+  memset(&req, 0, sizeof(req));
+
+  req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+  req.hdr.nlmsg_type = NLMSG_DONE;
+
+  struct cn_msg *msg = NLMSG_DATA(&req.hdr);
+  msg->id.idx = CN_IDX_PROC;
+  msg->id.val = CN_VAL_PROC;
+  msg->len = sizeof(op);
+  memcpy(msg->data, &op, sizeof(op));
+
+  if (send(fd, &req, req.hdr.nlmsg_len, 0) < 0)
+    return errno;
+  return 0;
+}
+
+static int watch_queue_event(proc_pids_watch_t *watch,
+                             proc_pids_event_t const *ev) {
+  if (watch->events_num == watch->events_size) {
+    size_t size = (watch->events_size == 0) ? 64 : 2 * watch->events_size;
+    proc_pids_event_t *events = realloc(watch->events, size * sizeof(*events));
+    if (events == NULL)
+      return ENOMEM;
+    watch->events = events;
+    watch->events_size = size;
+  }
+  watch->events[watch->events_num++] = *ev;
+  return 0;
+}
+
+/* Reads all pending events from the socket. Only events of processes, not of
+ * their threads, are kept, because procfs lists processes only. Returns
+ * ENOBUFS if events were lost. */
+static int watch_receive(proc_pids_watch_t *watch) {
+  union {
+    struct nlmsghdr hdr;
+    char buf[8192];
+  } resp;
+
+  while (true) {
+    ssize_t len = recv(watch->fd, &resp, sizeof(resp), MSG_DONTWAIT);
+    if (len < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+
+    for (struct nlmsghdr *hdr = &resp.hdr; NLMSG_OK(hdr, (size_t)len);
+         hdr = NLMSG_NEXT(hdr, len)) {
+      if (hdr->nlmsg_type == NLMSG_OVERRUN)
+        return ENOBUFS;
+      if ((hdr->nlmsg_type == NLMSG_ERROR) || (hdr->nlmsg_type == NLMSG_NOOP))
+        continue;
+
+      struct cn_msg *msg = NLMSG_DATA(hdr);
+      if ((msg->id.idx != CN_IDX_PROC) || (msg->id.val != CN_VAL_PROC))
+        continue;
+
+      struct proc_event *pe = (struct proc_event *)msg->data;
+      proc_pids_event_t ev = {0};
+      switch (pe->what) {
+      case PROC_EVENT_FORK:
+        if (pe->event_data.fork.child_pid != pe->event_data.fork.child_tgid)
+          continue;
+        ev.type = PROC_PIDS_EVENT_FORK;
+        ev.pid = pe->event_data.fork.child_tgid;
+        ev.parent = pe->event_data.fork.parent_tgid;
+        break;
+      case PROC_EVENT_EXEC:
+        ev.type = PROC_PIDS_EVENT_EXEC;
+        ev.pid = pe->event_data.exec.process_tgid;
+        break;
+      case PROC_EVENT_COMM:
+        if (pe->event_data.comm.process_pid !=
+            pe->event_data.comm.process_tgid)
+          continue;
+        ev.type = PROC_PIDS_EVENT_COMM;
+        ev.pid = pe->event_data.comm.process_tgid;
+        sstrncpy(ev.comm, pe->event_data.comm.comm, sizeof(ev.comm));
+        break;
+      case PROC_EVENT_EXIT:
+        if (pe->event_data.exit.process_pid !=
+            pe->event_data.exit.process_tgid)
+          continue;
+        ev.type = PROC_PIDS_EVENT_EXIT;
+        ev.pid = pe->event_data.exit.process_tgid;
+        break;
+      default:
+        continue;
+      }
+
+      int status = watch_queue_event(watch, &ev);
+      if (status != 0)
+        return status;
+    }
+  }
+}
+
+int proc_pids_watch_open(proc_pids_watch_t **watch) {
+  assert(watch);
+
+  int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+  if (fd < 0)
+    return errno;
+
+  /* Bursts of process creation must not overflow the socket between two
+   * updates; events are lost otherwise and procfs has to be scanned. */
+  int rcvbuf = 4 * 1024 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  struct sockaddr_nl addr = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = CN_IDX_PROC,
+  };
+  int status = 0;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    status = errno;
+  if (status == 0)
+    status = watch_send_op(fd, PROC_CN_MCAST_LISTEN);
+  if (status != 0) {
+    close(fd);
+    return status;
+  }
+
+  proc_pids_watch_t *w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    close(fd);
+    return ENOMEM;
+  }
+  w->fd = fd;
+  w->synced = false;
+
+  *watch = w;
+  return 0;
+}
+
+void proc_pids_watch_close(proc_pids_watch_t *watch) {
+  if (watch == NULL)
+    return;
+
+  watch_send_op(watch->fd, PROC_CN_MCAST_IGNORE);
+  close(watch->fd);
+  sfree(watch->events);
+  sfree(watch);
+}
+#else /* !HAVE_LINUX_CN_PROC_H */
+static int watch_receive(__attribute__((unused)) proc_pids_watch_t *watch) {
+  return 0;
+}
+
+int proc_pids_watch_open(__attribute__((unused)) proc_pids_watch_t **watch) {
+  return ENOTSUP;
+}
+
+void proc_pids_watch_close(proc_pids_watch_t *watch) {
+  if (watch == NULL)
+    return;
+
+  sfree(watch->events);
+  sfree(watch);
+}
+#endif /* HAVE_LINUX_CN_PROC_H */
+
+int proc_pids_watch_update(proc_pids_watch_t *watch, const char *procfs_path,
+                           proc_pids_t *proc_pids[], size_t proc_pids_num) {
+  if (watch == NULL)
+    return proc_pids_update(procfs_path, proc_pids, proc_pids_num);
+
+  int status = watch_receive(watch);
+  if (status != 0) {
+    if (status == ENOBUFS)
+      DEBUG(UTIL_NAME ": Process events were lost, scanning %s.",
+            procfs_path);
+    else
+      ERROR(UTIL_NAME ": Receiving process events failed, error: %d", status);
+    watch->synced = false;
+  }
+
+  if (!watch->synced) {
+    /* Events received before the scan are covered by it. Applying the ones
+     * received during the scan again later does no harm. */
+    watch->events_num = 0;
+    status = proc_pids_update(procfs_path, proc_pids, proc_pids_num);
+    if (status == 0)
+      watch->synced = true;
+    return status;
+  }
+
+  return apply_events(watch, procfs_path, proc_pids, proc_pids_num);
+}
+
+void proc_pids_watch_resync(proc_pids_watch_t *watch) {
+  if (watch != NULL)
+    watch->synced = false;
 }
 
 int pids_list_diff(proc_pids_t *proc, pids_list_t *added,
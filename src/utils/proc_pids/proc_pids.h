@@ -31,6 +31,7 @@
 #define UTILS_PROC_PIDS_PROC_PIDS_H 1
 
 #include <dirent.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 /*
@@ -56,8 +57,14 @@ typedef struct proc_pids_s {
   proc_comm_t process_name;
   pids_list_t *prev;
   pids_list_t *curr;
+  /* Set by the last update if `curr' differs from `prev'. */
+  bool changed;
 } proc_pids_t;
 
+/* Tracks processes through the Linux proc connector, see
+ * proc_pids_watch_open. */
+typedef struct proc_pids_watch_s proc_pids_watch_t;
+
 /*
  * NAME
  *   pids_list_free
@@ -200,6 +207,8 @@ int proc_pids_init(const char **procs_names_array,
  * DESCRIPTION
  *   Updates PIDs matching processes's names.
  *   Searches all PID directories in /proc fs and updates current pids_list.
+ *   The lists are sorted afterwards and `changed' is set for every process
+ *   name whose PIDs changed.
  *
  * PARAMETERS
  *   `procfs_path'     Path to systems proc directory (e.g. /proc)
@@ -212,6 +221,64 @@ int proc_pids_init(const char **procs_names_array,
 int proc_pids_update(const char *procfs_path, proc_pids_t *proc_pids[],
                      size_t proc_pids_num);
 
+/*
+ * NAME
+ *   proc_pids_watch_open
+ *
+ * DESCRIPTION
+ *   Subscribes to fork, exec, comm and exit events of the Linux proc
+ *   connector, so that proc_pids_watch_update does not have to scan procfs.
+ *   Needs the CAP_NET_ADMIN capability.
+ *
+ * PARAMETERS
+ *   `watch'           Address of pointer set to the new watch.
+ *
+ * RETURN VALUE
+ *   0 on success. ENOTSUP if the proc connector is not supported, another
+ *   errno value on error.
+ */
+int proc_pids_watch_open(proc_pids_watch_t **watch);
+
+/*
+ * NAME
+ *   proc_pids_watch_update
+ *
+ * DESCRIPTION
+ *   Like proc_pids_update, but updates the PIDs from the process events
+ *   received since the last call. Procfs is scanned on the first call and
+ *   after events were lost. If `watch' is NULL, procfs is always scanned.
+ *
+ * PARAMETERS
+ *   `watch'           Watch created by proc_pids_watch_open or NULL.
+ *   `procfs_path'     Path to systems proc directory (e.g. /proc)
+ *   `proc_pids'       Array of proc_pids pointers to be updated.
+ *   `proc_pids_num'   proc_pids element count
+ *
+ * RETURN VALUE
+ *   0 on success. -1 on error.
+ */
+int proc_pids_watch_update(proc_pids_watch_t *watch, const char *procfs_path,
+                           proc_pids_t *proc_pids[], size_t proc_pids_num);
+
+/*
+ * NAME
+ *   proc_pids_watch_resync
+ *
+ * DESCRIPTION
+ *   Makes the next proc_pids_watch_update scan procfs, e.g. after the caller
+ *   modified the `curr' lists.
+ */
+void proc_pids_watch_resync(proc_pids_watch_t *watch);
+
+/*
+ * NAME
+ *   proc_pids_watch_close
+ *
+ * DESCRIPTION
+ *   Unsubscribes from process events and frees `watch'.
+ */
+void proc_pids_watch_close(proc_pids_watch_t *watch);
+
 /*
  * NAME
  *   proc_pids_free
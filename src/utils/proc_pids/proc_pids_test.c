@@ -6,6 +6,7 @@
 #include "utils/proc_pids/proc_pids.c" /* sic */
 #include "testing.h"
 // clang-format on
+#include <sys/socket.h>
 #include <sys/stat.h>
 
 /***************************************************************************
@@ -348,6 +349,125 @@ DEF_TEST(proc_pids_update__many_proc_many_pid) {
   return 0;
 }
 
+DEF_TEST(proc_pids_update__duplicate_names) {
+  /* setup */
+  const char *proc_names[] = {"proc1", "proc2", "proc1"};
+  stub_proc_pid_t pp_stubs[] = {{"proc1", 1007}, {"proc2", 2007}};
+  proc_pids_t **proc_pids = NULL;
+  stub_procfs_setup(pp_stubs, STATIC_ARRAY_SIZE(pp_stubs));
+  EXPECT_EQ_INT(0, proc_pids_init(proc_names, STATIC_ARRAY_SIZE(proc_names),
+                                  &proc_pids));
+
+  /* check */
+  EXPECT_EQ_INT(
+      0, proc_pids_update(proc_fs, proc_pids, STATIC_ARRAY_SIZE(proc_names)));
+  EXPECT_EQ_INT(1, pids_list_contains_pid(proc_pids[0]->curr, 1007));
+  EXPECT_EQ_INT(1, pids_list_contains_pid(proc_pids[1]->curr, 2007));
+  EXPECT_EQ_INT(1, pids_list_contains_pid(proc_pids[2]->curr, 1007));
+  EXPECT_EQ_INT(1, proc_pids[2]->curr->size);
+
+  /* cleanup */
+  proc_pids_free(proc_pids, STATIC_ARRAY_SIZE(proc_names));
+  stub_procfs_teardown();
+  return 0;
+}
+
+DEF_TEST(proc_pids_update__changed) {
+  /* setup */
+  const char *proc_names[] = {"proc1", "proc2"};
+  stub_proc_pid_t pp_stubs[] = {{"proc1", 1007}, {"proc1", 1008}};
+  proc_pids_t **proc_pids = NULL;
+  stub_procfs_setup(pp_stubs, STATIC_ARRAY_SIZE(pp_stubs));
+  EXPECT_EQ_INT(0, proc_pids_init(proc_names, STATIC_ARRAY_SIZE(proc_names),
+                                  &proc_pids));
+
+  /* check: first update finds the PIDs */
+  EXPECT_EQ_INT(0, proc_pids_update(proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(1, proc_pids[0]->changed);
+  EXPECT_EQ_INT(0, proc_pids[1]->changed);
+
+  /* nothing changed */
+  EXPECT_EQ_INT(0, proc_pids_update(proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(0, proc_pids[0]->changed);
+  EXPECT_EQ_INT(0, proc_pids[1]->changed);
+
+  /* a process disappears */
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s/1008", proc_fs);
+  EXPECT_EQ_INT(0, system(cmd));
+  EXPECT_EQ_INT(0, proc_pids_update(proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(1, proc_pids[0]->changed);
+  EXPECT_EQ_INT(0, proc_pids[1]->changed);
+  EXPECT_EQ_INT(1, proc_pids[0]->curr->size);
+
+  /* cleanup */
+  proc_pids_free(proc_pids, STATIC_ARRAY_SIZE(proc_names));
+  stub_procfs_teardown();
+  return 0;
+}
+
+DEF_TEST(proc_pids_watch_update__events) {
+  /* setup */
+  const char *proc_names[] = {"proc1", "proc2"};
+  stub_proc_pid_t pp_stubs[] = {{"proc1", 1007}, {"proc2", 2007}};
+  proc_pids_t **proc_pids = NULL;
+  stub_procfs_setup(pp_stubs, STATIC_ARRAY_SIZE(pp_stubs));
+  EXPECT_EQ_INT(0, proc_pids_init(proc_names, STATIC_ARRAY_SIZE(proc_names),
+                                  &proc_pids));
+  /* No events arrive on the socket; they are queued by hand below. */
+  int fds[2];
+  EXPECT_EQ_INT(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, fds));
+  proc_pids_watch_t watch = {.fd = fds[0]};
+
+  /* first update scans procfs */
+  EXPECT_EQ_INT(0, proc_pids_watch_update(&watch, proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(1, watch.synced);
+  EXPECT_EQ_INT(1, proc_pids[0]->curr->size);
+  EXPECT_EQ_INT(1, proc_pids[1]->curr->size);
+
+  /* 2007 executed "proc1", its fork 2008 renamed itself to "proc2" and 1007
+   * exited. */
+  stub_proc_pid_t exec_stubs[] = {{"proc1", 2007}};
+  char path[256];
+  snprintf(path, sizeof(path), "%s/2007/comm", proc_fs);
+  FILE *fh = fopen(path, "w");
+  CHECK_NOT_NULL(fh);
+  fputs(exec_stubs[0].comm, fh);
+  fclose(fh);
+
+  proc_pids_event_t events[] = {
+      {.type = PROC_PIDS_EVENT_EXEC, .pid = 2007},
+      {.type = PROC_PIDS_EVENT_FORK, .pid = 2008, .parent = 2007},
+      {.type = PROC_PIDS_EVENT_COMM, .pid = 2008, .comm = "proc2"},
+      {.type = PROC_PIDS_EVENT_EXIT, .pid = 1007},
+  };
+  watch.events = events;
+  watch.events_num = STATIC_ARRAY_SIZE(events);
+
+  /* check */
+  EXPECT_EQ_INT(0, proc_pids_watch_update(&watch, proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(0, watch.events_num);
+  EXPECT_EQ_INT(1, proc_pids[0]->changed);
+  EXPECT_EQ_INT(1, proc_pids[0]->curr->size);
+  EXPECT_EQ_INT(2007, proc_pids[0]->curr->pids[0]);
+  EXPECT_EQ_INT(1, proc_pids[1]->changed);
+  EXPECT_EQ_INT(1, proc_pids[1]->curr->size);
+  EXPECT_EQ_INT(2008, proc_pids[1]->curr->pids[0]);
+
+  /* no events: nothing changed */
+  EXPECT_EQ_INT(0, proc_pids_watch_update(&watch, proc_fs, proc_pids, 2));
+  EXPECT_EQ_INT(0, proc_pids[0]->changed);
+  EXPECT_EQ_INT(0, proc_pids[1]->changed);
+  EXPECT_EQ_INT(1, proc_pids[1]->curr->size);
+
+  /* cleanup */
+  close(fds[0]);
+  close(fds[1]);
+  proc_pids_free(proc_pids, STATIC_ARRAY_SIZE(proc_names));
+  stub_procfs_teardown();
+  return 0;
+}
+
 DEF_TEST(pids_list_diff__all_changed) {
   /* setup */
   pid_t pids_array_before[] = {1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007};
@@ -502,6 +622,9 @@ int main(void) {
   RUN_TEST(read_proc_name__invalid_name);
   RUN_TEST(proc_pids_update__one_proc_many_pid);
   RUN_TEST(proc_pids_update__many_proc_many_pid);
+  RUN_TEST(proc_pids_update__duplicate_names);
+  RUN_TEST(proc_pids_update__changed);
+  RUN_TEST(proc_pids_watch_update__events);
   RUN_TEST(pids_list_diff__all_changed);
   RUN_TEST(pids_list_diff__nothing_changed);
   RUN_TEST(pids_list_diff__one_added);
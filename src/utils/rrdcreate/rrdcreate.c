@@ -27,6 +27,7 @@
 #include "collectd.h"
 
 #include "utils/common/common.h"
+#include "utils/avltree/avltree.h"
 #include "utils/rrdcreate/rrdcreate.h"
 
 #include <pthread.h>
@@ -41,13 +42,32 @@ struct srrd_create_args_s {
 };
 typedef struct srrd_create_args_s srrd_create_args_t;
 
+/* A file that is being created. "args" is NULL for synchronous creation.
+ * Values written before the file exists are buffered in "values" and written
+ * to the file before it is moved into place. */
 struct async_create_file_s;
 typedef struct async_create_file_s async_create_file_t;
 struct async_create_file_s {
   char *filename;
+  srrd_create_args_t *args;
+  char **values;
+  size_t values_num;
+  bool values_dropped;
+  /* Next file of the same directory batch. */
   async_create_file_t *next;
 };
 
+/* Files queued for creation are batched by directory, so a worker creates all
+ * files of a directory in one go. */
+struct async_create_dir_s;
+typedef struct async_create_dir_s async_create_dir_t;
+struct async_create_dir_s {
+  char *dirname;
+  async_create_file_t *head;
+  async_create_file_t *tail;
+  async_create_dir_t *next;
+};
+
 /*
  * Private variables
  */
@@ -61,8 +81,20 @@ static int rra_types_num = STATIC_ARRAY_SIZE(rra_types);
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-static async_create_file_t *async_creation_list;
+/* Maximum number of values buffered for a file that is being created. */
+#define RRD_CREATE_VALUES_MAX 128
+/* Number of creation threads if rrdcreate_config_t.async_threads is zero. */
+#define RRD_CREATE_DEFAULT_THREADS 4
+
+/* filename -> async_create_file_t of all files being created. */
+static c_avl_tree_t *async_creation_tree;
+/* dirname -> async_create_dir_t of the batches still in the queue. */
+static c_avl_tree_t *async_creation_dirs;
+static async_create_dir_t *async_queue_head;
+static async_create_dir_t *async_queue_tail;
+static size_t async_threads_num;
 static pthread_mutex_t async_creation_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_creation_cond = PTHREAD_COND_INITIALIZER;
 
 /*
  * Private functions
@@ -398,21 +430,137 @@ static int srrd_create(const char *filename, /* {{{ */
 } /* }}} int srrd_create */
 #endif /* !HAVE_THREADSAFE_LIBRRD */
 
-static int lock_file(char const *filename) /* {{{ */
+#if HAVE_THREADSAFE_LIBRRD
+static int srrd_update(const char *filename, int argc, char **argv) /* {{{ */
+{
+  char *filename_copy = strdup(filename);
+  if (filename_copy == NULL) {
+    P_ERROR("srrd_update: strdup failed.");
+    return -ENOMEM;
+  }
+
+  optind = 0; /* bug in librrd? */
+  rrd_clear_error();
+
+  int status = rrd_update_r(filename_copy, NULL, argc, (void *)argv);
+  if (status != 0)
+    P_WARNING("srrd_update: rrd_update_r (%s) failed: %s", filename,
+              rrd_get_error());
+
+  sfree(filename_copy);
+  return status;
+} /* }}} int srrd_update */
+  /* #endif HAVE_THREADSAFE_LIBRRD */
+
+#else  /* !HAVE_THREADSAFE_LIBRRD */
+static int srrd_update(const char *filename, int argc, char **argv) /* {{{ */
 {
-  async_create_file_t *ptr;
+  int new_argc = 2 + argc;
+  char **new_argv = malloc((new_argc + 1) * sizeof(*new_argv));
+  if (new_argv == NULL) {
+    P_ERROR("srrd_update: malloc failed.");
+    return -1;
+  }
+
+  new_argv[0] = "update";
+  new_argv[1] = (void *)filename;
+  memcpy(new_argv + 2, argv, argc * sizeof(char *));
+  new_argv[new_argc] = NULL;
+
+  pthread_mutex_lock(&librrd_lock);
+  optind = 0; /* bug in librrd? */
+  rrd_clear_error();
+
+  int status = rrd_update(new_argc, new_argv);
+  pthread_mutex_unlock(&librrd_lock);
+
+  if (status != 0)
+    P_WARNING("srrd_update: rrd_update (%s) failed: %s", filename,
+              rrd_get_error());
+
+  sfree(new_argv);
+  return status;
+} /* }}} int srrd_update */
+#endif /* !HAVE_THREADSAFE_LIBRRD */
+
+static void async_create_file_destroy(async_create_file_t *f) /* {{{ */
+{
+  if (f == NULL)
+    return;
+
+  for (size_t i = 0; i < f->values_num; i++)
+    sfree(f->values[i]);
+  sfree(f->values);
+  srrd_create_args_destroy(f->args);
+  sfree(f->filename);
+  sfree(f);
+} /* }}} void async_create_file_destroy */
+
+/* Must be called with async_creation_lock held. */
+static int async_creation_tree_init(void) /* {{{ */
+{
+  if (async_creation_tree == NULL) {
+    async_creation_tree =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (async_creation_tree == NULL)
+      return ENOMEM;
+  }
+  if (async_creation_dirs == NULL) {
+    async_creation_dirs =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (async_creation_dirs == NULL)
+      return ENOMEM;
+  }
+  return 0;
+} /* }}} int async_creation_tree_init */
+
+/* Buffers "values" for the file. Must be called with async_creation_lock
+ * held. */
+static void async_create_file_add_value(async_create_file_t *f, /* {{{ */
+                                        const char *values) {
+  if (values == NULL)
+    return;
+
+  if (f->values_num >= RRD_CREATE_VALUES_MAX) {
+    if (!f->values_dropped)
+      P_WARNING("Too many values for \"%s\" while it is being created. "
+                "Dropping values until it has been created.",
+                f->filename);
+    f->values_dropped = true;
+    return;
+  }
+
+  char **tmp = realloc(f->values, (f->values_num + 1) * sizeof(*f->values));
+  if (tmp == NULL)
+    return;
+  f->values = tmp;
+
+  f->values[f->values_num] = strdup(values);
+  if (f->values[f->values_num] != NULL)
+    f->values_num++;
+} /* }}} void async_create_file_add_value */
+
+/* Registers "filename" as being created. Returns EEXIST if the file exists
+ * and EBUSY if it is already being created, in which case "values" is buffered
+ * for it. On success, the new entry is returned in "ret" if it is not NULL. */
+static int lock_file(char const *filename, const char *values, /* {{{ */
+                     async_create_file_t **ret) {
+  async_create_file_t *ptr = NULL;
   struct stat sb;
   int status;
 
   pthread_mutex_lock(&async_creation_lock);
 
-  for (ptr = async_creation_list; ptr != NULL; ptr = ptr->next)
-    if (strcmp(filename, ptr->filename) == 0)
-      break;
+  status = async_creation_tree_init();
+  if (status != 0) {
+    pthread_mutex_unlock(&async_creation_lock);
+    return status;
+  }
 
-  if (ptr != NULL) {
+  if (c_avl_get(async_creation_tree, filename, (void *)&ptr) == 0) {
+    async_create_file_add_value(ptr, values);
     pthread_mutex_unlock(&async_creation_lock);
-    return EEXIST;
+    return EBUSY;
   }
 
   status = stat(filename, &sb);
@@ -421,7 +569,7 @@ static int lock_file(char const *filename) /* {{{ */
     return EEXIST;
   }
 
-  ptr = malloc(sizeof(*ptr));
+  ptr = calloc(1, sizeof(*ptr));
   if (ptr == NULL) {
     pthread_mutex_unlock(&async_creation_lock);
     return ENOMEM;
@@ -434,137 +582,224 @@ static int lock_file(char const *filename) /* {{{ */
     return ENOMEM;
   }
 
-  ptr->next = async_creation_list;
-  async_creation_list = ptr;
+  if (c_avl_insert(async_creation_tree, ptr->filename, ptr) != 0) {
+    pthread_mutex_unlock(&async_creation_lock);
+    async_create_file_destroy(ptr);
+    return ENOMEM;
+  }
+  async_create_file_add_value(ptr, values);
 
   pthread_mutex_unlock(&async_creation_lock);
 
+  if (ret != NULL)
+    *ret = ptr;
   return 0;
 } /* }}} int lock_file */
 
-static int unlock_file(char const *filename) /* {{{ */
+/* Must be called with async_creation_lock held. */
+static void unlock_file_locked(char const *filename) /* {{{ */
 {
-  async_create_file_t *this;
-  async_create_file_t *prev;
-
-  pthread_mutex_lock(&async_creation_lock);
-
-  prev = NULL;
-  for (this = async_creation_list; this != NULL; this = this->next) {
-    if (strcmp(filename, this->filename) == 0)
-      break;
-    prev = this;
-  }
+  async_create_file_t *this = NULL;
 
-  if (this == NULL) {
-    pthread_mutex_unlock(&async_creation_lock);
-    return ENOENT;
-  }
+  if ((async_creation_tree == NULL) ||
+      (c_avl_remove(async_creation_tree, filename, NULL, (void *)&this) != 0))
+    return;
 
-  if (prev == NULL) {
-    assert(this == async_creation_list);
-    async_creation_list = this->next;
-  } else {
-    assert(this == prev->next);
-    prev->next = this->next;
-  }
-  this->next = NULL;
+  async_create_file_destroy(this);
+} /* }}} void unlock_file_locked */
 
+static void unlock_file(char const *filename) /* {{{ */
+{
+  pthread_mutex_lock(&async_creation_lock);
+  unlock_file_locked(filename);
   pthread_mutex_unlock(&async_creation_lock);
+} /* }}} void unlock_file */
 
-  sfree(this->filename);
-  sfree(this);
-
-  return 0;
-} /* }}} int unlock_file */
-
-static void *srrd_create_thread(void *targs) /* {{{ */
+/* Creates the file under a temporary name, writes the buffered values to it
+ * and moves it into place. Values arriving in the meantime are buffered until
+ * the rename, which is done with async_creation_lock held so that writers
+ * either find the file or still find it being created. */
+static void srrd_create_pending(async_create_file_t *f) /* {{{ */
 {
-  srrd_create_args_t *args = targs;
+  srrd_create_args_t *args = f->args;
   char tmpfile[PATH_MAX];
   int status;
 
-  status = lock_file(args->filename);
-  if (status != 0) {
-    if (status == EEXIST)
-      P_NOTICE("srrd_create_thread: File \"%s\" is already being created.",
-               args->filename);
-    else
-      P_ERROR("srrd_create_thread: Unable to lock file \"%s\".",
-              args->filename);
-    srrd_create_args_destroy(args);
-    return 0;
-  }
-
   ssnprintf(tmpfile, sizeof(tmpfile), "%s.async", args->filename);
 
   status = srrd_create(tmpfile, args->pdp_step, args->last_up, args->argc,
                        (void *)args->argv);
   if (status != 0) {
-    P_WARNING("srrd_create_thread: srrd_create (%s) returned status %i.",
+    P_WARNING("srrd_create_pending: srrd_create (%s) returned status %i.",
               args->filename, status);
     unlink(tmpfile);
     unlock_file(args->filename);
-    srrd_create_args_destroy(args);
-    return 0;
+    return;
   }
 
-  status = rename(tmpfile, args->filename);
+  pthread_mutex_lock(&async_creation_lock);
+  while (f->values_num > 0) {
+    char **values = f->values;
+    size_t values_num = f->values_num;
+    f->values = NULL;
+    f->values_num = 0;
+    pthread_mutex_unlock(&async_creation_lock);
+
+    srrd_update(tmpfile, (int)values_num, values);
+    for (size_t i = 0; i < values_num; i++)
+      sfree(values[i]);
+    sfree(values);
+
+    pthread_mutex_lock(&async_creation_lock);
+  }
+
+  status = rename(tmpfile, f->filename);
   if (status != 0) {
-    P_ERROR("srrd_create_thread: rename (\"%s\", \"%s\") failed: %s", tmpfile,
-            args->filename, STRERRNO);
+    P_ERROR("srrd_create_pending: rename (\"%s\", \"%s\") failed: %s", tmpfile,
+            f->filename, STRERRNO);
     unlink(tmpfile);
-    unlock_file(args->filename);
-    srrd_create_args_destroy(args);
+  } else {
+    DEBUG("srrd_create_pending: Successfully created RRD file \"%s\".",
+          f->filename);
+  }
+
+  /* This frees "f". */
+  unlock_file_locked(args->filename);
+  pthread_mutex_unlock(&async_creation_lock);
+} /* }}} void srrd_create_pending */
+
+static void *srrd_create_worker(__attribute__((unused)) void *arg) /* {{{ */
+{
+  pthread_mutex_lock(&async_creation_lock);
+  while (42) {
+    while (async_queue_head == NULL)
+      pthread_cond_wait(&async_creation_cond, &async_creation_lock);
+
+    async_create_dir_t *dir = async_queue_head;
+    async_queue_head = dir->next;
+    if (async_queue_head == NULL)
+      async_queue_tail = NULL;
+    c_avl_remove(async_creation_dirs, dir->dirname, NULL, NULL);
+    pthread_mutex_unlock(&async_creation_lock);
+
+    /* The directory is checked once for the whole batch. */
+    int status = check_create_dir(dir->head->filename);
+
+    async_create_file_t *f = dir->head;
+    while (f != NULL) {
+      async_create_file_t *next = f->next;
+      if (status == 0)
+        srrd_create_pending(f);
+      else
+        unlock_file(f->filename);
+      f = next;
+    }
+
+    sfree(dir->dirname);
+    sfree(dir);
+
+    pthread_mutex_lock(&async_creation_lock);
+  }
+
+  /* Not reached. */
+  pthread_mutex_unlock(&async_creation_lock);
+  return NULL;
+} /* }}} void *srrd_create_worker */
+
+/* Starts worker threads until there are "threads_num" of them. Must be called
+ * with async_creation_lock held. */
+static int srrd_create_workers_start(size_t threads_num) /* {{{ */
+{
+  while (async_threads_num < threads_num) {
+    pthread_t thread;
+    int status = plugin_thread_create(&thread, srrd_create_worker, NULL,
+                                      "rrd create");
+    if (status != 0) {
+      P_ERROR("srrd_create_workers_start: plugin_thread_create failed: %s",
+              STRERROR(status));
+      return (async_threads_num > 0) ? 0 : status;
+    }
+    pthread_detach(thread);
+    async_threads_num++;
+  }
+  return 0;
+} /* }}} int srrd_create_workers_start */
+
+/* Adds the file to the batch of its directory. Must be called with
+ * async_creation_lock held. */
+static int srrd_create_enqueue(async_create_file_t *f) /* {{{ */
+{
+  char dirname[PATH_MAX];
+  sstrncpy(dirname, f->filename, sizeof(dirname));
+  char *slash = strrchr(dirname, '/');
+  if (slash != NULL)
+    *slash = 0;
+  else
+    sstrncpy(dirname, ".", sizeof(dirname));
+
+  async_create_dir_t *dir = NULL;
+  if (c_avl_get(async_creation_dirs, dirname, (void *)&dir) == 0) {
+    dir->tail->next = f;
+    dir->tail = f;
     return 0;
   }
 
-  DEBUG("srrd_create_thread: Successfully created RRD file \"%s\".",
-        args->filename);
+  dir = calloc(1, sizeof(*dir));
+  if (dir == NULL)
+    return ENOMEM;
+  dir->dirname = strdup(dirname);
+  if ((dir->dirname == NULL) ||
+      (c_avl_insert(async_creation_dirs, dir->dirname, dir) != 0)) {
+    sfree(dir->dirname);
+    sfree(dir);
+    return ENOMEM;
+  }
+  dir->head = dir->tail = f;
 
-  unlock_file(args->filename);
-  srrd_create_args_destroy(args);
+  if (async_queue_tail == NULL)
+    async_queue_head = dir;
+  else
+    async_queue_tail->next = dir;
+  async_queue_tail = dir;
 
+  pthread_cond_signal(&async_creation_cond);
   return 0;
-} /* }}} void *srrd_create_thread */
+} /* }}} int srrd_create_enqueue */
 
 static int srrd_create_async(const char *filename, /* {{{ */
                              unsigned long pdp_step, time_t last_up, int argc,
-                             const char **argv) {
-  srrd_create_args_t *args;
-  pthread_t thread;
-  pthread_attr_t attr;
+                             const char **argv, const char *values,
+                             size_t threads_num) {
+  async_create_file_t *f = NULL;
   int status;
 
   DEBUG("srrd_create_async: Creating \"%s\" in the background.", filename);
 
-  args = srrd_create_args_create(filename, pdp_step, last_up, argc, argv);
-  if (args == NULL)
-    return -1;
+  status = lock_file(filename, values, &f);
+  if (status != 0)
+    return status;
 
-  status = pthread_attr_init(&attr);
-  if (status != 0) {
-    srrd_create_args_destroy(args);
+  srrd_create_args_t *args =
+      srrd_create_args_create(filename, pdp_step, last_up, argc, argv);
+  if (args == NULL) {
+    unlock_file(filename);
     return -1;
   }
 
-  status = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  if (status != 0) {
-    pthread_attr_destroy(&attr);
-    srrd_create_args_destroy(args);
-    return -1;
-  }
+  pthread_mutex_lock(&async_creation_lock);
+  f->args = args;
 
-  status = pthread_create(&thread, &attr, srrd_create_thread, args);
+  status = srrd_create_workers_start(threads_num);
+  if (status == 0)
+    status = srrd_create_enqueue(f);
   if (status != 0) {
-    P_ERROR("srrd_create_async: pthread_create failed: %s", STRERROR(status));
-    pthread_attr_destroy(&attr);
-    srrd_create_args_destroy(args);
+    unlock_file_locked(filename);
+    pthread_mutex_unlock(&async_creation_lock);
     return status;
   }
 
-  pthread_attr_destroy(&attr);
-  /* args is freed in srrd_create_thread(). */
+  pthread_mutex_unlock(&async_creation_lock);
+  /* f is freed by the worker thread. */
   return 0;
 } /* }}} int srrd_create_async */
 
@@ -573,7 +808,7 @@ static int srrd_create_async(const char *filename, /* {{{ */
  */
 int cu_rrd_create_file(const char *filename, /* {{{ */
                        const data_set_t *ds, const value_list_t *vl,
-                       const rrdcreate_config_t *cfg) {
+                       const rrdcreate_config_t *cfg, const char *values) {
   char **argv;
   int argc;
   char **rra_def = NULL;
@@ -584,7 +819,18 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
   time_t last_up;
   unsigned long stepsize;
 
-  if (check_create_dir(filename))
+  if (cfg->async) {
+    /* Only buffer the values if the file is already being created. */
+    async_create_file_t *f = NULL;
+    pthread_mutex_lock(&async_creation_lock);
+    if ((async_creation_tree != NULL) &&
+        (c_avl_get(async_creation_tree, filename, (void *)&f) == 0)) {
+      async_create_file_add_value(f, values);
+      pthread_mutex_unlock(&async_creation_lock);
+      return 0;
+    }
+    pthread_mutex_unlock(&async_creation_lock);
+  } else if (check_create_dir(filename))
     return -1;
 
   if ((rra_num = rra_get(&rra_def, vl, cfg)) < 1) {
@@ -622,17 +868,23 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
     stepsize = (unsigned long)CDTIME_T_TO_TIME_T(vl->interval);
 
   if (cfg->async) {
+    size_t threads_num = (cfg->async_threads > 0)
+                             ? (size_t)cfg->async_threads
+                             : RRD_CREATE_DEFAULT_THREADS;
     status = srrd_create_async(filename, stepsize, last_up, argc,
-                               (const char **)argv);
-    if (status != 0)
+                               (const char **)argv, values, threads_num);
+    if (status == EBUSY) {
+      /* Another writer got there first; the values have been buffered. */
+      status = 0;
+    } else if ((status != 0) && (status != EEXIST))
       P_WARNING("cu_rrd_create_file: srrd_create_async (%s) "
                 "returned status %i.",
                 filename, status);
   } else /* synchronous */
   {
-    status = lock_file(filename);
+    status = lock_file(filename, /* values = */ NULL, /* ret = */ NULL);
     if (status != 0) {
-      if (status == EEXIST)
+      if ((status == EBUSY) || (status == EEXIST))
         P_NOTICE("cu_rrd_create_file: File \"%s\" is already being created.",
                  filename);
       else
@@ -658,3 +910,13 @@ int cu_rrd_create_file(const char *filename, /* {{{ */
 
   return status;
 } /* }}} int cu_rrd_create_file */
+
+size_t cu_rrd_create_pending(void) /* {{{ */
+{
+  pthread_mutex_lock(&async_creation_lock);
+  size_t num = (async_creation_tree != NULL)
+                   ? (size_t)c_avl_size(async_creation_tree)
+                   : 0;
+  pthread_mutex_unlock(&async_creation_lock);
+  return num;
+} /* }}} size_t cu_rrd_create_pending */
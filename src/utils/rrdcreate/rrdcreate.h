@@ -44,10 +44,21 @@ struct rrdcreate_config_s {
   size_t consolidation_functions_num;
 
   bool async;
+  /* Number of threads creating files when "async" is set; 0 means default. */
+  int async_threads;
 };
 typedef struct rrdcreate_config_s rrdcreate_config_t;
 
+/* Creates the RRD file for "vl". In asynchronous mode the file is queued for
+ * creation and "values", the update for "vl" in rrd_update(1) format, is
+ * written to it once it has been created. Further values for a file that is
+ * being created are buffered the same way. Returns EEXIST if the file turned
+ * out to exist already, in which case "values" has not been handled. */
 int cu_rrd_create_file(const char *filename, const data_set_t *ds,
-                       const value_list_t *vl, const rrdcreate_config_t *cfg);
+                       const value_list_t *vl, const rrdcreate_config_t *cfg,
+                       const char *values);
+
+/* Returns the number of files waiting to be created or being created. */
+size_t cu_rrd_create_pending(void);
 
 #endif /* UTILS_RRDCREATE_H */
@@ -0,0 +1,152 @@
+/**
+ * collectd - src/utils/snappy/snappy.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "utils/snappy/snappy.h"
+
+/* Copies may refer back at most this far, so that offsets fit two bytes.
+ * Positions within a block also fit the uint16_t hash table entries. */
+#define SNAPPY_BLOCK_SIZE 65536
+#define SNAPPY_HASH_BITS 14
+
+#define SNAPPY_TAG_LITERAL 0
+#define SNAPPY_TAG_COPY_1 1
+#define SNAPPY_TAG_COPY_2 2
+
+static uint32_t load32(char const *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+  return (v * 0x1e35a7bd) >> (32 - SNAPPY_HASH_BITS);
+}
+
+static char *emit_varint(char *op, uint64_t v) {
+  while (v >= 0x80) {
+    *(op++) = (char)((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  *(op++) = (char)v;
+  return op;
+}
+
+static char *emit_literal(char *op, char const *lit, size_t len) {
+  if (len == 0)
+    return op;
+
+  size_t n = len - 1;
+  if (n < 60) {
+    *(op++) = (char)((n << 2) | SNAPPY_TAG_LITERAL);
+  } else {
+    /* Tags 60 to 63 are followed by 1 to 4 little-endian length bytes. */
+    char *tag = op++;
+    int bytes = 0;
+    while (n > 0) {
+      *(op++) = (char)(n & 0xff);
+      n >>= 8;
+      bytes++;
+    }
+    *tag = (char)(((59 + bytes) << 2) | SNAPPY_TAG_LITERAL);
+  }
+
+  memcpy(op, lit, len);
+  return op + len;
+}
+
+/* emit_copy_short emits a copy of at most 64 bytes. */
+static char *emit_copy_short(char *op, size_t offset, size_t len) {
+  if ((len >= 4) && (len < 12) && (offset < 2048)) {
+    *(op++) =
+        (char)(((offset >> 8) << 5) | ((len - 4) << 2) | SNAPPY_TAG_COPY_1);
+    *(op++) = (char)(offset & 0xff);
+  } else {
+    *(op++) = (char)(((len - 1) << 2) | SNAPPY_TAG_COPY_2);
+    *(op++) = (char)(offset & 0xff);
+    *(op++) = (char)(offset >> 8);
+  }
+  return op;
+}
+
+static char *emit_copy(char *op, size_t offset, size_t len) {
+  /* Split long matches so that the last copy is at least four bytes, which
+   * is the shortest copy that can use the one-byte offset form. */
+  while (len >= 68) {
+    op = emit_copy_short(op, offset, 64);
+    len -= 64;
+  }
+  if (len > 64) {
+    op = emit_copy_short(op, offset, 60);
+    len -= 60;
+  }
+  return emit_copy_short(op, offset, len);
+}
+
+static char *encode_block(char const *in, size_t len, char *op,
+                          uint16_t *table) {
+  memset(table, 0, sizeof(*table) << SNAPPY_HASH_BITS);
+
+  size_t literal = 0;
+  size_t i = 0;
+  while (i + 4 <= len) {
+    uint32_t v = load32(in + i);
+    uint32_t h = hash32(v);
+    size_t candidate = table[h];
+    table[h] = (uint16_t)i;
+
+    if ((candidate >= i) || (load32(in + candidate) != v)) {
+      i++;
+      continue;
+    }
+
+    size_t match = 4;
+    while ((i + match < len) && (in[candidate + match] == in[i + match]))
+      match++;
+
+    op = emit_literal(op, in + literal, i - literal);
+    op = emit_copy(op, i - candidate, match);
+    i += match;
+    literal = i;
+  }
+
+  return emit_literal(op, in + literal, len - literal);
+}
+
+size_t snappy_encode_bound(size_t len) { return 32 + len + len / 6; }
+
+size_t snappy_encode(char const *in, size_t len, char *out) {
+  uint16_t table[1 << SNAPPY_HASH_BITS];
+
+  char *op = emit_varint(out, (uint64_t)len);
+  for (size_t offset = 0; offset < len; offset += SNAPPY_BLOCK_SIZE) {
+    size_t block_len = len - offset;
+    if (block_len > SNAPPY_BLOCK_SIZE)
+      block_len = SNAPPY_BLOCK_SIZE;
+
+    op = encode_block(in + offset, block_len, op, table);
+  }
+
+  return (size_t)(op - out);
+}
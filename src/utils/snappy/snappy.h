@@ -0,0 +1,58 @@
+/**
+ * collectd - src/utils/snappy/snappy.h
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_SNAPPY_H
+#define UTILS_SNAPPY_H 1
+
+#include <stddef.h>
+
+/*
+ * An encoder for the Snappy block format, as used by the Prometheus
+ * remote_write protocol. It trades some compression for simplicity: matches
+ * are found with a single hash probe and searched for within 64 KiB blocks of
+ * the input only. The output can be decoded by any Snappy implementation.
+ */
+
+/*
+ * NAME
+ *   snappy_encode_bound
+ *
+ * RETURN VALUE
+ *   The maximum size of the encoding of `len' bytes of input.
+ */
+size_t snappy_encode_bound(size_t len);
+
+/*
+ * NAME
+ *   snappy_encode
+ *
+ * DESCRIPTION
+ *   Encodes `len' bytes of `in' into `out', which must have room for
+ *   snappy_encode_bound(len) bytes.
+ *
+ * RETURN VALUE
+ *   The number of bytes written to `out'.
+ */
+size_t snappy_encode(char const *in, size_t len, char *out);
+
+#endif /* UTILS_SNAPPY_H */
@@ -0,0 +1,167 @@
+/**
+ * collectd - src/utils/snappy/snappy_test.c
+ * Copyright (C) 2026       The collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/snappy/snappy.h"
+
+/* A straightforward decoder of the Snappy block format. Returns the decoded
+ * length or -1 if the input is malformed. */
+static ssize_t decode(unsigned char const *in, size_t in_len, char *out,
+                      size_t out_size) {
+  size_t ip = 0;
+  uint64_t want = 0;
+  for (int shift = 0; ip < in_len; shift += 7) {
+    want |= (uint64_t)(in[ip] & 0x7f) << shift;
+    if ((in[ip++] & 0x80) == 0)
+      break;
+  }
+  if (want > out_size)
+    return -1;
+
+  size_t op = 0;
+  while (ip < in_len) {
+    unsigned char tag = in[ip++];
+    size_t len, offset;
+
+    switch (tag & 3) {
+    case 0: /* literal */
+      len = tag >> 2;
+      if (len >= 60) {
+        size_t bytes = len - 59;
+        len = 0;
+        for (size_t i = 0; i < bytes; i++)
+          len |= (size_t)in[ip++] << (8 * i);
+      }
+      len++;
+      if ((ip + len > in_len) || (op + len > want))
+        return -1;
+      memcpy(out + op, in + ip, len);
+      ip += len;
+      op += len;
+      continue;
+    case 1:
+      len = ((tag >> 2) & 7) + 4;
+      offset = ((size_t)(tag >> 5) << 8) | in[ip++];
+      break;
+    case 2:
+      len = (tag >> 2) + 1;
+      offset = in[ip] | ((size_t)in[ip + 1] << 8);
+      ip += 2;
+      break;
+    default:
+      return -1;
+    }
+
+    if ((offset == 0) || (offset > op) || (op + len > want))
+      return -1;
+    for (size_t i = 0; i < len; i++, op++)
+      out[op] = out[op - offset];
+  }
+
+  return (op == want) ? (ssize_t)op : -1;
+}
+
+static int round_trip(char const *in, size_t len, size_t *ret_encoded) {
+  char *enc = malloc(snappy_encode_bound(len));
+  char *dec = malloc(len + 1);
+  CHECK_NOT_NULL(enc);
+  CHECK_NOT_NULL(dec);
+
+  size_t enc_len = snappy_encode(in, len, enc);
+  OK(enc_len <= snappy_encode_bound(len));
+  EXPECT_EQ_INT((int)len, (int)decode((unsigned char *)enc, enc_len, dec, len));
+  OK(memcmp(in, dec, len) == 0);
+
+  if (ret_encoded != NULL)
+    *ret_encoded = enc_len;
+  free(enc);
+  free(dec);
+  return 0;
+}
+
+DEF_TEST(empty) {
+  char out[32];
+  EXPECT_EQ_INT(1, (int)snappy_encode("", 0, out));
+  EXPECT_EQ_INT(0, out[0]);
+
+  CHECK_ZERO(round_trip("x", 1, NULL));
+  CHECK_ZERO(round_trip("abc", 3, NULL));
+  return 0;
+}
+
+DEF_TEST(repetitive) {
+  /* Exposition-like text, which must shrink considerably. It spans several
+   * blocks and contains matches longer than 64 bytes. */
+  size_t size = 300000;
+  char *in = malloc(size);
+  CHECK_NOT_NULL(in);
+  size_t len = 0;
+  for (int i = 0; len + 128 < size; i++)
+    len += (size_t)snprintf(in + len, size - len,
+                            "collectd_cpu_total{cpu=\"%d\",type=\"idle\","
+                            "instance=\"host.example.com\"} %d\n",
+                            i % 64, i);
+
+  size_t enc_len = 0;
+  CHECK_ZERO(round_trip(in, len, &enc_len));
+  OK(enc_len < len / 3);
+
+  memset(in, 'a', 5000);
+  CHECK_ZERO(round_trip(in, 5000, &enc_len));
+  OK(enc_len < 300);
+
+  free(in);
+  return 0;
+}
+
+DEF_TEST(incompressible) {
+  /* Pseudo-random data requires long literals, including ones whose length
+   * takes several bytes. */
+  size_t len = 200000;
+  char *in = malloc(len);
+  CHECK_NOT_NULL(in);
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < len; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    in[i] = (char)x;
+  }
+
+  size_t sizes[] = {59, 60, 61, 255, 256, 257, 65535, 65536, 65537, len};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    CHECK_ZERO(round_trip(in, sizes[i], NULL));
+
+  free(in);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(empty);
+  RUN_TEST(repetitive);
+  RUN_TEST(incompressible);
+
+  END_TEST;
+}
@@ -188,38 +188,101 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind) {
 
 int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
                  void *data, bool force_rewind) {
+  /* Bytes at the beginning of `buf' which belong to an unterminated line. */
+  size_t fill = 0;
+  bool reopened = false;
   int status;
 
+  if (buflen < 2) {
+    ERROR("utils_tail: cu_tail_read: buflen too small: %i bytes.", buflen);
+    return -1;
+  }
+
   while (42) {
-    size_t len;
+    if (obj->fh == NULL) {
+      status = cu_tail_reopen(obj, force_rewind);
+      if (status < 0)
+        return status;
+    }
+    assert(obj->fh != NULL);
+
+    /* Read as much as fits into the buffer and split it into lines in
+     * place, instead of reading it line by line. */
+    clearerr(obj->fh);
+    size_t len = fread(buf + fill, 1, (size_t)buflen - 1 - fill, obj->fh);
+    if (len == 0) {
+      /* Like fgets(3), hand out the last line even without a newline. */
+      if (fill > 0) {
+        buf[fill] = 0;
+        fill = 0;
+        status = callback(data, buf, buflen);
+        if (status != 0) {
+          ERROR("utils_tail: cu_tail_read: callback returned "
+                "status %i.",
+                status);
+          return status;
+        }
+      }
 
-    status = cu_tail_readline(obj, buf, buflen, force_rewind);
-    if (status != 0) {
-      ERROR("utils_tail: cu_tail_read: cu_tail_readline "
-            "failed.");
-      break;
+      /* Jupp, error. Force `cu_tail_reopen' to reopen the file, but only
+       * once. */
+      if (ferror(obj->fh) != 0) {
+        WARNING("utils_tail: fread (%s) returned an error: %s", obj->file,
+                STRERRNO);
+        fclose(obj->fh);
+        obj->fh = NULL;
+        if (reopened)
+          return -1;
+        reopened = true;
+      }
+
+      /* eof -> check if the file was moved away and reopen the new file if
+       * so.. */
+      status = cu_tail_reopen(obj, force_rewind);
+      if (status < 0)
+        return status;
+      /* file end reached and file not reopened -> nothing more to read */
+      else if (status > 0)
+        return 0;
+
+      continue;
     }
+    fill += len;
 
-    /* check for EOF */
-    if (buf[0] == 0)
-      break;
+    char *line = buf;
+    char *end = buf + fill;
+    char *newline;
+    while ((newline = memchr(line, '\n', (size_t)(end - line))) != NULL) {
+      *newline = 0;
 
-    len = strlen(buf);
-    while (len > 0) {
-      if (buf[len - 1] != '\n')
-        break;
-      buf[len - 1] = '\0';
-      len--;
+      status = callback(data, line, buflen);
+      if (status != 0) {
+        ERROR("utils_tail: cu_tail_read: callback returned "
+              "status %i.",
+              status);
+        return status;
+      }
+
+      line = newline + 1;
     }
 
-    status = callback(data, buf, buflen);
-    if (status != 0) {
-      ERROR("utils_tail: cu_tail_read: callback returned "
-            "status %i.",
-            status);
-      break;
+    fill = (size_t)(end - line);
+    if (fill == (size_t)buflen - 1) {
+      /* Lines which don't fit into the buffer are split, as fgets(3) did. */
+      buf[fill] = 0;
+      fill = 0;
+
+      status = callback(data, buf, buflen);
+      if (status != 0) {
+        ERROR("utils_tail: cu_tail_read: callback returned "
+              "status %i.",
+              status);
+        return status;
+      }
+    } else if (fill > 0 && line != buf) {
+      memmove(buf, line, fill);
     }
   }
 
-  return status;
+  return 0;
 } /* int cu_tail_read */
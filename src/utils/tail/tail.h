@@ -76,9 +76,13 @@ int cu_tail_destroy(cu_tail_t *obj);
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind);
 
 /*
- * cu_tail_readline
+ * cu_tail_read
  *
- * Reads from the file until eof condition or an error is encountered.
+ * Reads from the file until eof condition or an error is encountered and
+ * calls `callback' for each line, without the trailing newline. `buf' is used
+ * to read large chunks of the file, which are split into lines in place, so
+ * `buflen' should be well above the expected line length. Lines longer than
+ * `buflen - 1' characters are split.
  *
  * Returns 0 when successful and non-zero otherwise.
  */
@@ -31,9 +31,13 @@
 #include "utils/avltree/avltree.h"
 #include "utils_fbhash.h"
 
+/* Minimum time between two checks whether the file has changed. */
+#define FBH_CHECK_INTERVAL TIME_T_TO_CDTIME_T(1)
+
 struct fbhash_s {
   char *filename;
   time_t mtime;
+  cdtime_t last_check;
 
   pthread_mutex_t lock;
   c_avl_tree_t *tree;
@@ -214,6 +218,7 @@ fbhash_t *fbh_create(const char *file) /* {{{ */
     free(h);
     return NULL;
   }
+  h->last_check = cdtime();
 
   return h;
 } /* }}} fbhash_t *fbh_create */
@@ -242,8 +247,13 @@ char *fbh_get(fbhash_t *h, const char *key) /* {{{ */
 
   pthread_mutex_lock(&h->lock);
 
-  /* TODO: Checking this every time may be a bit much..? */
-  fbh_check_file(h);
+  /* The network plugin looks up a secret for every packet, so don't stat(2)
+   * the file every time. */
+  cdtime_t now = cdtime();
+  if ((now - h->last_check) >= FBH_CHECK_INTERVAL) {
+    fbh_check_file(h);
+    h->last_check = now;
+  }
 
   status = c_avl_get(h->tree, key, (void *)&value);
   if (status == 0) {
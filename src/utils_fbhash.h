@@ -34,7 +34,7 @@
  *   key: value
  * into a hash, which can then be queried. The file is given to `fbh_create',
  * the hash is queried using `fbh_get'. If the file is changed during runtime,
- * it will automatically be re-read.
+ * it will automatically be re-read; changes are noticed within a second.
  */
 
 struct fbhash_s;
@@ -38,6 +38,16 @@
 #include "utils/tail/tail.h"
 #include "utils_tail_match.h"
 
+#include <poll.h>
+#include <regex.h>
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/* Size of the buffer the file is read into. Longer lines are split. */
+#define TAIL_MATCH_BUFFER_SIZE 65536
+
 struct cu_tail_match_simple_s {
   char plugin[DATA_MAX_NAME_LEN];
   char plugin_instance[DATA_MAX_NAME_LEN];
@@ -56,9 +66,26 @@ struct cu_tail_match_match_s {
 typedef struct cu_tail_match_match_s cu_tail_match_match_t;
 
 struct cu_tail_match_s {
+  char *filename;
   cu_tail_t *tail;
+  char *buffer;
   cu_tail_match_match_t *matches;
   size_t matches_num;
+
+  /* All regular expressions combined into one, which rules out most lines
+   * that none of the matches is interested in with a single regexec(3). */
+  regex_t prefilter;
+  bool have_prefilter;
+  bool prefilter_valid;
+
+  /* Follow mode: a thread reads the file as soon as it grows. `lock'
+   * protects the matches against the read callback. */
+  bool follow;
+  bool thread_running;
+  bool thread_stop;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int wakeup_pipe[2];
 };
 
 /*
@@ -160,6 +187,17 @@ static int latency_submit_match(cu_match_t *match, void *user_data) {
     plugin_dispatch_values(&vl);
   }
 
+  /* Submit the whole histogram */
+  if (data->latency_config.histogram) {
+    if (strlen(data->type_instance) != 0)
+      snprintf(vl.type_instance, sizeof(vl.type_instance), "%.50s-%.50s",
+               data->type, data->type_instance);
+    else
+      sstrncpy(vl.type_instance, data->type, sizeof(vl.type_instance));
+
+    latency_counter_dispatch(match_value->latency, &vl);
+  }
+
   match_value->value.gauge = NAN;
   match_value->values_num = 0;
   latency_counter_reset(match_value->latency);
@@ -171,6 +209,11 @@ static int tail_callback(void *data, char *buf,
                          int __attribute__((unused)) buflen) {
   cu_tail_match_t *obj = (cu_tail_match_t *)data;
 
+  if (obj->have_prefilter &&
+      (regexec(&obj->prefilter, buf, /* nmatch = */ 0, NULL,
+               /* eflags = */ 0) != 0))
+    return 0;
+
   for (size_t i = 0; i < obj->matches_num; i++)
     match_apply(obj->matches[i].match, buf);
 
@@ -183,6 +226,206 @@ static void tail_match_simple_free(void *data) {
   sfree(user_data);
 } /* void tail_match_simple_free */
 
+/* Combines the regular expressions of all matches into "(re0)|(re1)|...". A
+ * line not matching this cannot match any of them. */
+static void tail_match_update_prefilter(cu_tail_match_t *obj) {
+  if (obj->have_prefilter)
+    regfree(&obj->prefilter);
+  obj->have_prefilter = false;
+  obj->prefilter_valid = true;
+
+  /* With a single match the prefilter would only add work. */
+  if (obj->matches_num < 2)
+    return;
+
+  size_t len = 1;
+  for (size_t i = 0; i < obj->matches_num; i++) {
+    const char *regex = match_get_regex(obj->matches[i].match);
+    if (regex == NULL)
+      return;
+
+    /* Back-references are numbered by group and would change their meaning
+     * in the combined expression. */
+    for (const char *c = strchr(regex, '\\'); c != NULL;
+         c = strchr(c + 2, '\\')) {
+      if (isdigit((unsigned char)c[1]))
+        return;
+      if (c[1] == 0)
+        break;
+    }
+
+    len += strlen(regex) + strlen("|()");
+  }
+
+  char *combined = malloc(len);
+  if (combined == NULL)
+    return;
+
+  size_t pos = 0;
+  for (size_t i = 0; i < obj->matches_num; i++)
+    pos += snprintf(combined + pos, len - pos, "%s(%s)", (i != 0) ? "|" : "",
+                    match_get_regex(obj->matches[i].match));
+
+  int status = regcomp(&obj->prefilter, combined,
+                       REG_EXTENDED | REG_NEWLINE | REG_NOSUB);
+  if (status == 0) {
+    obj->have_prefilter = true;
+  } else {
+    DEBUG("tail_match: Combining the regular expressions into \"%s\" "
+          "failed, matching them one by one.",
+          combined);
+  }
+
+  sfree(combined);
+} /* void tail_match_update_prefilter */
+
+static int tail_match_read_file(cu_tail_match_t *obj, bool force_rewind) {
+  if (!obj->prefilter_valid)
+    tail_match_update_prefilter(obj);
+
+  int status = cu_tail_read(obj->tail, obj->buffer, TAIL_MATCH_BUFFER_SIZE,
+                            tail_callback, (void *)obj, force_rewind);
+  if (status != 0)
+    ERROR("tail_match: cu_tail_read failed.");
+
+  return status;
+} /* int tail_match_read_file */
+
+/* Waits until the file has been written to, created or renamed, or until
+ * `timeout' has passed if inotify(7) is not available. Returns false if the
+ * thread has been asked to stop. */
+static bool tail_match_wait(cu_tail_match_t *obj, int notify_fd,
+                            const char *basename, int timeout) {
+  struct pollfd fds[2] = {
+      {.fd = obj->wakeup_pipe[0], .events = POLLIN},
+      {.fd = notify_fd, .events = POLLIN},
+  };
+  nfds_t fds_num = (notify_fd >= 0) ? 2 : 1;
+
+  while (42) {
+    int status = poll(fds, fds_num, (notify_fd >= 0) ? -1 : timeout);
+    if ((status < 0) && (errno != EINTR)) {
+      ERROR("tail_match: poll failed: %s", STRERRNO);
+      return false;
+    }
+    if (fds[0].revents != 0)
+      return false;
+    if (status == 0)
+      return true;
+    if ((status < 0) || (fds_num < 2) || (fds[1].revents == 0))
+      continue;
+
+#if HAVE_SYS_INOTIFY_H
+    /* Events of other files in the same directory are ignored. */
+    char buffer[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool relevant = false;
+    ssize_t len;
+    while ((len = read(notify_fd, buffer, sizeof(buffer))) > 0) {
+      for (char *ptr = buffer; ptr < buffer + len;) {
+        struct inotify_event *event = (struct inotify_event *)ptr;
+        if ((event->mask & IN_Q_OVERFLOW) ||
+            ((event->len > 0) && (strcmp(event->name, basename) == 0)))
+          relevant = true;
+        ptr += sizeof(*event) + event->len;
+      }
+    }
+    if (relevant)
+      return true;
+#endif
+  }
+} /* bool tail_match_wait */
+
+static void *tail_match_thread(void *arg) {
+  cu_tail_match_t *obj = arg;
+  int timeout = (int)CDTIME_T_TO_MS(plugin_get_interval());
+  int notify_fd = -1;
+
+  char dirname[PATH_MAX];
+  const char *basename = strrchr(obj->filename, '/');
+  if (basename != NULL) {
+    /* Includes the slash for files in the root directory. */
+    size_t len = (size_t)(basename - obj->filename) + 1;
+    if (len == 1)
+      len = 2;
+    sstrncpy(dirname, obj->filename,
+             (len < sizeof(dirname)) ? len : sizeof(dirname));
+    basename++;
+  } else {
+    sstrncpy(dirname, ".", sizeof(dirname));
+    basename = obj->filename;
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  /* Watching the directory also catches the file being rotated. */
+  notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if ((notify_fd >= 0) &&
+      (inotify_add_watch(notify_fd, dirname,
+                         IN_MODIFY | IN_CREATE | IN_MOVED_TO) < 0)) {
+    WARNING("tail_match: Watching \"%s\" failed: %s. Reading the file "
+            "once per interval.",
+            dirname, STRERRNO);
+    close(notify_fd);
+    notify_fd = -1;
+  }
+#endif
+
+  pthread_mutex_lock(&obj->lock);
+  while (!obj->thread_stop) {
+    tail_match_read_file(obj, /* force_rewind = */ false);
+    pthread_mutex_unlock(&obj->lock);
+
+    bool keep_going = tail_match_wait(obj, notify_fd, basename, timeout);
+
+    pthread_mutex_lock(&obj->lock);
+    if (!keep_going)
+      break;
+  }
+  pthread_mutex_unlock(&obj->lock);
+
+  if (notify_fd >= 0)
+    close(notify_fd);
+  return NULL;
+} /* void *tail_match_thread */
+
+static int tail_match_start_thread(cu_tail_match_t *obj) {
+  if (pipe(obj->wakeup_pipe) != 0) {
+    ERROR("tail_match: pipe failed: %s", STRERRNO);
+    return -1;
+  }
+
+  obj->thread_stop = false;
+  int status =
+      plugin_thread_create(&obj->thread, tail_match_thread, obj, "tail match");
+  if (status != 0) {
+    ERROR("tail_match: plugin_thread_create failed: %s", STRERROR(status));
+    close(obj->wakeup_pipe[0]);
+    close(obj->wakeup_pipe[1]);
+    return -1;
+  }
+
+  obj->thread_running = true;
+  return 0;
+} /* int tail_match_start_thread */
+
+static void tail_match_stop_thread(cu_tail_match_t *obj) {
+  if (!obj->thread_running)
+    return;
+
+  pthread_mutex_lock(&obj->lock);
+  obj->thread_stop = true;
+  pthread_mutex_unlock(&obj->lock);
+
+  /* The thread sleeps in poll(2) */
+  if (write(obj->wakeup_pipe[1], "", 1) < 0)
+    ERROR("tail_match: write failed: %s", STRERRNO);
+
+  pthread_join(obj->thread, NULL);
+  close(obj->wakeup_pipe[0]);
+  close(obj->wakeup_pipe[1]);
+  obj->thread_running = false;
+} /* void tail_match_stop_thread */
+
 /*
  * Public functions
  */
@@ -193,12 +436,24 @@ cu_tail_match_t *tail_match_create(const char *filename) {
   if (obj == NULL)
     return NULL;
 
+  obj->filename = strdup(filename);
+  obj->buffer = malloc(TAIL_MATCH_BUFFER_SIZE);
+  if ((obj->filename == NULL) || (obj->buffer == NULL)) {
+    sfree(obj->filename);
+    sfree(obj->buffer);
+    sfree(obj);
+    return NULL;
+  }
+
   obj->tail = cu_tail_create(filename);
   if (obj->tail == NULL) {
+    sfree(obj->filename);
+    sfree(obj->buffer);
     sfree(obj);
     return NULL;
   }
 
+  pthread_mutex_init(&obj->lock, NULL);
   return obj;
 } /* cu_tail_match_t *tail_match_create */
 
@@ -206,6 +461,8 @@ void tail_match_destroy(cu_tail_match_t *obj) {
   if (obj == NULL)
     return;
 
+  tail_match_stop_thread(obj);
+
   if (obj->tail != NULL) {
     cu_tail_destroy(obj->tail);
     obj->tail = NULL;
@@ -223,7 +480,13 @@ void tail_match_destroy(cu_tail_match_t *obj) {
     match->user_data = NULL;
   }
 
+  if (obj->have_prefilter)
+    regfree(&obj->prefilter);
+
   sfree(obj->matches);
+  sfree(obj->buffer);
+  sfree(obj->filename);
+  pthread_mutex_destroy(&obj->lock);
   sfree(obj);
 } /* void tail_match_destroy */
 
@@ -249,6 +512,7 @@ int tail_match_add_match(cu_tail_match_t *obj, cu_match_t *match,
   temp->submit = submit_match;
   temp->free = free_user_data;
 
+  obj->prefilter_valid = false;
   return 0;
 } /* int tail_match_add_match */
 
@@ -306,25 +570,40 @@ out:
   return status;
 } /* int tail_match_add_match_simple */
 
+int tail_match_follow(cu_tail_match_t *obj) {
+  if (obj == NULL)
+    return EINVAL;
+
+  obj->follow = true;
+  return 0;
+} /* int tail_match_follow */
+
 int tail_match_read(cu_tail_match_t *obj, bool force_rewind) {
-  char buffer[4096];
-  int status;
+  int status = 0;
 
-  status = cu_tail_read(obj->tail, buffer, sizeof(buffer), tail_callback,
-                        (void *)obj, force_rewind);
-  if (status != 0) {
-    ERROR("tail_match: cu_tail_read failed.");
-    return status;
+  /* The thread is started from the read callback, i.e. after the daemon has
+   * forked. */
+  if (obj->follow && !obj->thread_running) {
+    if (tail_match_start_thread(obj) != 0)
+      return -1;
   }
 
-  for (size_t i = 0; i < obj->matches_num; i++) {
-    cu_tail_match_match_t *lt_match = obj->matches + i;
+  pthread_mutex_lock(&obj->lock);
 
-    if (lt_match->submit == NULL)
-      continue;
+  if (!obj->thread_running)
+    status = tail_match_read_file(obj, force_rewind);
+
+  if (status == 0) {
+    for (size_t i = 0; i < obj->matches_num; i++) {
+      cu_tail_match_match_t *lt_match = obj->matches + i;
 
-    (*lt_match->submit)(lt_match->match, lt_match->user_data);
+      if (lt_match->submit == NULL)
+        continue;
+
+      (*lt_match->submit)(lt_match->match, lt_match->user_data);
+    }
   }
 
-  return 0;
+  pthread_mutex_unlock(&obj->lock);
+  return status;
 } /* int tail_match_read */
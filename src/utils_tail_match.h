@@ -120,6 +120,25 @@ int tail_match_add_match_simple(cu_tail_match_t *obj, const char *regex,
                                 const char *type, const char *type_instance,
                                 const latency_config_t latency_cfg);
 
+/*
+ * NAME
+ *   tail_match_follow
+ *
+ * DESCRIPTION
+ *   Reads the file from a thread as soon as it is written to, rather than in
+ *   tail_match_read. The thread is started by the next call of
+ *   `tail_match_read', which then only calls the submit_match callbacks. The
+ *   thread uses inotify(7) where available and reads the file once per
+ *   interval otherwise.
+ *   The match callbacks are called from the thread, while the submit_match
+ *   callbacks are called from tail_match_read; both never run at the same
+ *   time.
+ *
+ * RETURN VALUE
+ *   Zero on success, nonzero on failure.
+ */
+int tail_match_follow(cu_tail_match_t *obj);
+
 /*
  * NAME
  *   tail_match_read
@@ -46,9 +46,56 @@ typedef struct VSC_C_main c_varnish_stats_t;
 typedef struct varnish_stats c_varnish_stats_t;
 #endif
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+/* A counter resolved to its location in the shared memory, together with the
+ * identity it is dispatched with. */
+struct varnish_point_s {
+  const volatile uint64_t *ptr;
+  int ds_type;
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+};
+typedef struct varnish_point_s varnish_point_t;
+
+/* The shared memory stays attached between reads. The counters are resolved
+ * by running varnish_monitor() once on all of them, recording every value it
+ * dispatches. Later reads only load the recorded counters, until the segments
+ * change or the instance is restarted. */
+struct varnish_state_s {
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+  struct VSM_data *vd;
+#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  struct vsm *vd;
+  struct vsc *vsc;
+#endif
+
+  varnish_point_t *points;
+  size_t points_num;
+  size_t points_size;
+
+  /* The counter being looked at while resolving. */
+  const volatile uint64_t *current;
+};
+typedef struct varnish_state_s varnish_state_t;
+
+/* Set to the state of the instance being resolved by the reading thread, so
+ * varnish_submit() can record the values varnish_monitor() dispatches. */
+static pthread_key_t varnish_resolving_key;
+static pthread_once_t varnish_resolving_once = PTHREAD_ONCE_INIT;
+
+static void varnish_resolving_key_create(void) /* {{{ */
+{
+  pthread_key_create(&varnish_resolving_key, NULL);
+} /* }}} void varnish_resolving_key_create */
+#endif
+
 /* {{{ user_config_s */
 struct user_config_s {
   char *instance;
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  varnish_state_t *state;
+#endif
 
   bool collect_cache;
   bool collect_connections;
@@ -100,10 +147,35 @@ typedef struct user_config_s user_config_t; /* }}} */
 
 static bool have_instance;
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+static void varnish_point_add(varnish_state_t *st, /* {{{ */
+                              const value_list_t *vl, int ds_type) {
+  if (st->points_num == st->points_size) {
+    size_t size = (st->points_size == 0) ? 64 : 2 * st->points_size;
+    varnish_point_t *tmp = realloc(st->points, size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("varnish plugin: realloc failed.");
+      return;
+    }
+    st->points = tmp;
+    st->points_size = size;
+  }
+
+  varnish_point_t *p = st->points + st->points_num;
+  p->ptr = st->current;
+  p->ds_type = ds_type;
+  sstrncpy(p->plugin_instance, vl->plugin_instance,
+           sizeof(p->plugin_instance));
+  sstrncpy(p->type, vl->type, sizeof(p->type));
+  sstrncpy(p->type_instance, vl->type_instance, sizeof(p->type_instance));
+  st->points_num++;
+} /* }}} void varnish_point_add */
+#endif
+
 static int varnish_submit(const char *plugin_instance, /* {{{ */
                           const char *category, const char *target,
                           const char *type, const char *type_instance,
-                          value_t value) {
+                          int ds_type, value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &value;
@@ -127,6 +199,12 @@ static int varnish_submit(const char *plugin_instance, /* {{{ */
   if (type_instance != NULL)
     sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  varnish_state_t *st = pthread_getspecific(varnish_resolving_key);
+  if (st != NULL)
+    varnish_point_add(st, &vl, ds_type);
+#endif
+
   return plugin_dispatch_values(&vl);
 } /* }}} int varnish_submit */
 
@@ -135,6 +213,7 @@ static int varnish_submit_gauge(const char *plugin_instance, /* {{{ */
                                 const char *type_instance,
                                 uint64_t gauge_value) {
   return varnish_submit(plugin_instance, category, NULL, type, type_instance,
+                        DS_TYPE_GAUGE,
                         (value_t){
                             .gauge = (gauge_t)gauge_value,
                         });
@@ -148,6 +227,7 @@ varnish_submit_gauge_with_target(const char *plugin_instance, /* {{{ */
                                  uint64_t gauge_value) {
 
   return varnish_submit(plugin_instance, category, target, type, type_instance,
+                        DS_TYPE_GAUGE,
                         (value_t){
                             .gauge = (gauge_t)gauge_value,
                         });
@@ -159,6 +239,7 @@ static int varnish_submit_derive(const char *plugin_instance, /* {{{ */
                                  const char *type_instance,
                                  uint64_t derive_value) {
   return varnish_submit(plugin_instance, category, NULL, type, type_instance,
+                        DS_TYPE_DERIVE,
                         (value_t){
                             .derive = (derive_t)derive_value,
                         });
@@ -171,6 +252,7 @@ varnish_submit_derive_with_target(const char *plugin_instance, /* {{{ */
                                   const char *type, const char *type_instance,
                                   uint64_t derive_value) {
   return varnish_submit(plugin_instance, category, target, type, type_instance,
+                        DS_TYPE_DERIVE,
                         (value_t){
                             .derive = (derive_t)derive_value,
                         });
@@ -1502,51 +1584,53 @@ static void varnish_monitor(const user_config_t *conf, /* {{{ */
 #endif
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-static int varnish_read(user_data_t *ud) /* {{{ */
+static void varnish_detach(varnish_state_t *st) /* {{{ */
 {
+  st->points_num = 0;
+
+  if (st->vd == NULL)
+    return;
+
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+  VSM_Delete(st->vd);
+#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  VSC_Destroy(&st->vsc, st->vd);
+  VSM_Destroy(&st->vd);
+#endif
+  st->vd = NULL;
+} /* }}} void varnish_detach */
+
+static int varnish_attach(const user_config_t *conf) /* {{{ */
+{
+  varnish_state_t *st = conf->state;
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-  struct VSM_data *vd;
   bool ok;
   const c_varnish_stats_t *stats;
 #elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  struct vsm *vd;
-  struct vsc *vsc;
   int vsm_status;
 #endif
 
-  user_config_t *conf;
-
-  if ((ud == NULL) || (ud->data == NULL))
-    return EINVAL;
-
-  conf = ud->data;
-
-  vd = VSM_New();
+  st->vd = VSM_New();
 
 #if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  vsc = VSC_New();
+  st->vsc = VSC_New();
 #endif
 
 #if HAVE_VARNISH_V3
-  VSC_Setup(vd);
+  VSC_Setup(st->vd);
 #endif
 
   if (conf->instance != NULL) {
     int status;
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-    status = VSM_n_Arg(vd, conf->instance);
+    status = VSM_n_Arg(st->vd, conf->instance);
 #elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-    status = VSM_Arg(vd, 'n', conf->instance);
+    status = VSM_Arg(st->vd, 'n', conf->instance);
 #endif
 
     if (status < 0) {
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-      VSM_Delete(vd);
-#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-      VSC_Destroy(&vsc, vd);
-      VSM_Destroy(&vd);
-#endif
+      varnish_detach(st);
       ERROR("varnish plugin: VSM_Arg (\"%s\") failed "
             "with status %i.",
             conf->instance, status);
@@ -1555,62 +1639,176 @@ static int varnish_read(user_data_t *ud) /* {{{ */
   }
 
 #if HAVE_VARNISH_V3
-  ok = (VSC_Open(vd, /* diag = */ 1) == 0);
+  ok = (VSC_Open(st->vd, /* diag = */ 1) == 0);
 #elif HAVE_VARNISH_V4
-  ok = (VSM_Open(vd) == 0);
+  ok = (VSM_Open(st->vd) == 0);
 #endif
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!ok) {
-    VSM_Delete(vd);
+    varnish_detach(st);
     ERROR("varnish plugin: Unable to open connection.");
     return -1;
   }
 #endif
 
 #if HAVE_VARNISH_V3
-  stats = VSC_Main(vd);
+  stats = VSC_Main(st->vd);
 #elif HAVE_VARNISH_V4
-  stats = VSC_Main(vd, NULL);
+  stats = VSC_Main(st->vd, NULL);
 #endif
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   if (!stats) {
-    VSM_Delete(vd);
+    varnish_detach(st);
     ERROR("varnish plugin: Unable to get statistics.");
     return -1;
   }
 #endif
 
 #if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  if (VSM_Attach(vd, STDERR_FILENO)) {
-    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(vd));
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+  if (VSM_Attach(st->vd, STDERR_FILENO)) {
+    ERROR("varnish plugin: Cannot attach to varnish. %s", VSM_Error(st->vd));
+    varnish_detach(st);
     return -1;
   }
 
-  vsm_status = VSM_Status(vd);
+  vsm_status = VSM_Status(st->vd);
   if (vsm_status & ~(VSM_MGT_RUNNING | VSM_WRK_RUNNING)) {
     ERROR("varnish plugin: Unable to get statistics.");
-    VSC_Destroy(&vsc, vd);
-    VSM_Destroy(&vd);
+    varnish_detach(st);
     return -1;
   }
 #endif
 
+  return 0;
+} /* }}} int varnish_attach */
+
+/* Checks whether the attached shared memory is still current. Returns zero if
+ * the resolved counters can be used, a positive value if they have to be
+ * resolved again and a negative value if the instance has to be attached
+ * again. */
+static int varnish_check(varnish_state_t *st) /* {{{ */
+{
 #if HAVE_VARNISH_V3
-  VSC_Iter(vd, varnish_monitor, conf);
+  /* Returns one if the segment was remapped, e.g. after a restart. */
+  int status = VSM_ReOpen(st->vd, /* diag = */ 0);
+  if (status < 0)
+    return -1;
+  return status;
 #elif HAVE_VARNISH_V4
-  VSC_Iter(vd, NULL, varnish_monitor, conf);
+  if (VSM_Abandoned(st->vd))
+    return -1;
+  return 0;
 #elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  VSC_Iter(vsc, vd, varnish_monitor, conf);
+  unsigned vsm_status = VSM_Status(st->vd);
+  if ((vsm_status & (VSM_MGT_RUNNING | VSM_WRK_RUNNING)) == 0)
+    return -1;
+  if (vsm_status & (VSM_MGT_CHANGED | VSM_MGT_RESTARTED | VSM_WRK_CHANGED |
+                    VSM_WRK_RESTARTED))
+    return 1;
+  return 0;
 #endif
+} /* }}} int varnish_check */
 
-#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
-  VSM_Delete(vd);
+static int varnish_resolve_point(void *priv,
+                                 const struct VSC_point *const pt) /* {{{ */
+{
+  const user_config_t *conf = priv;
+
+  if (pt != NULL)
+    conf->state->current = (const volatile uint64_t *)pt->ptr;
+
+  return varnish_monitor(priv, pt);
+} /* }}} int varnish_resolve_point */
+
+/* Iterates over all counters, dispatching and recording the wanted ones. */
+static void varnish_resolve(const user_config_t *conf) /* {{{ */
+{
+  varnish_state_t *st = conf->state;
+
+  st->points_num = 0;
+  pthread_once(&varnish_resolving_once, varnish_resolving_key_create);
+  pthread_setspecific(varnish_resolving_key, st);
+#if HAVE_VARNISH_V3
+  VSC_Iter(st->vd, varnish_resolve_point, (void *)conf);
+#elif HAVE_VARNISH_V4
+  VSC_Iter(st->vd, NULL, varnish_resolve_point, (void *)conf);
 #elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-  VSC_Destroy(&vsc, vd);
-  VSM_Destroy(&vd);
+  VSC_Iter(st->vsc, st->vd, varnish_resolve_point, (void *)conf);
 #endif
+  pthread_setspecific(varnish_resolving_key, NULL);
+  st->current = NULL;
+
+  DEBUG("varnish plugin: Resolved %" PRIsz " counters.", st->points_num);
+} /* }}} void varnish_resolve */
+
+static void varnish_dispatch_points(const varnish_state_t *st) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t value;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "varnish", sizeof(vl.plugin));
+
+  for (size_t i = 0; i < st->points_num; i++) {
+    const varnish_point_t *p = st->points + i;
+    uint64_t val = *p->ptr;
+
+    if (p->ds_type == DS_TYPE_GAUGE)
+      value.gauge = (gauge_t)val;
+    else
+      value.derive = (derive_t)val;
+
+    sstrncpy(vl.plugin_instance, p->plugin_instance,
+             sizeof(vl.plugin_instance));
+    sstrncpy(vl.type, p->type, sizeof(vl.type));
+    sstrncpy(vl.type_instance, p->type_instance, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+} /* }}} void varnish_dispatch_points */
+
+static int varnish_read(user_data_t *ud) /* {{{ */
+{
+  user_config_t *conf;
+  varnish_state_t *st;
+  int status;
+
+  if ((ud == NULL) || (ud->data == NULL))
+    return EINVAL;
+
+  conf = ud->data;
+
+  if (conf->state == NULL) {
+    conf->state = calloc(1, sizeof(*conf->state));
+    if (conf->state == NULL) {
+      ERROR("varnish plugin: calloc failed.");
+      return ENOMEM;
+    }
+  }
+  st = conf->state;
+
+  status = 0;
+  if (st->vd != NULL) {
+    status = varnish_check(st);
+    if (status < 0) {
+      INFO("varnish plugin: Lost the shared memory of instance \"%s\", "
+           "attaching again.",
+           (conf->instance != NULL) ? conf->instance : "localhost");
+      varnish_detach(st);
+    }
+  }
+
+  if (st->vd == NULL) {
+    if (varnish_attach(conf) != 0)
+      return -1;
+    status = 1;
+  }
+
+  /* varnish_resolve() dispatches the values, too. */
+  if (status > 0)
+    varnish_resolve(conf);
+  else
+    varnish_dispatch_points(st);
 
   return 0;
 } /* }}} */
@@ -1646,6 +1844,14 @@ static void varnish_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  if (conf->state != NULL) {
+    varnish_detach(conf->state);
+    sfree(conf->state->points);
+    sfree(conf->state);
+  }
+#endif
+
   sfree(conf->instance);
   sfree(conf);
 } /* }}} */
@@ -87,6 +87,10 @@
 #define HAVE_DOM_REASON_PAUSED_CRASHED 1
 #endif
 
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+#define HAVE_BULK_STATS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
 #define HAVE_JOB_STATS 1
 #endif
@@ -127,6 +131,9 @@ static bool persistent_notification = false;
 static bool report_block_devices = true;
 static bool report_network_interfaces = true;
 
+/* BulkStats is false by default */
+static bool bulk_stats = false;
+
 /* Thread used for handling libvirt notifications events */
 static virt_notif_thread_t notif_thread;
 
@@ -1452,6 +1459,18 @@ static int lv_config(oconfig_item_t *ci) {
       if (cf_util_get_boolean(c, &report_network_interfaces) != 0)
         return -1;
 
+      continue;
+    } else if (strcasecmp(c->key, "BulkStats") == 0) {
+      if (cf_util_get_boolean(c, &bulk_stats) != 0)
+        return -1;
+
+#ifndef HAVE_BULK_STATS
+      if (bulk_stats) {
+        WARNING(PLUGIN_NAME " plugin: BulkStats requires libvirt 1.2.8 or "
+                            "later and has been disabled.");
+        bulk_stats = false;
+      }
+#endif
       continue;
     } else {
       /* Unrecognised option. */
@@ -1544,18 +1563,23 @@ static int lv_domain_block_stats(virDomainPtr dom, const char *path,
 }
 
 #ifdef HAVE_PERF_STATS
-static void perf_submit(virDomainStatsRecordPtr stats) {
-  for (int i = 0; i < stats->nparams; ++i) {
+static void perf_params_submit(virDomainPtr dom, virTypedParameterPtr params,
+                               int nparams) {
+  for (int i = 0; i < nparams; ++i) {
     /* Replace '.' with '_' in event field to match other metrics' naming
      * convention */
-    char *c = strchr(stats->params[i].field, '.');
+    char *c = strchr(params[i].field, '.');
     if (c)
       *c = '_';
-    submit(stats->dom, "perf", stats->params[i].field,
-           &(value_t){.derive = stats->params[i].value.ul}, 1);
+    submit(dom, "perf", params[i].field,
+           &(value_t){.derive = params[i].value.ul}, 1);
   }
 }
 
+static void perf_submit(virDomainStatsRecordPtr stats) {
+  perf_params_submit(stats->dom, stats->params, stats->nparams);
+}
+
 static int get_perf_events(virDomainPtr domain) {
   virDomainStatsRecordPtr *stats = NULL;
   /* virDomainListGetStats requires a NULL terminated list of domains */
@@ -1745,31 +1769,9 @@ static int get_domain_state_notify(virDomainPtr domain) {
 #endif /* HAVE_LIST_ALL_DOMAINS */
 #endif /* HAVE_DOM_REASON */
 
-static int get_memory_stats(virDomainPtr domain) {
-  virDomainMemoryStatPtr minfo =
-      calloc(VIR_DOMAIN_MEMORY_STAT_NR, sizeof(*minfo));
-  if (minfo == NULL) {
-    ERROR(PLUGIN_NAME " plugin: calloc failed.");
-    return -1;
-  }
-
-  int mem_stats =
-      virDomainMemoryStats(domain, minfo, VIR_DOMAIN_MEMORY_STAT_NR, 0);
-  if (mem_stats < 0) {
-    ERROR(PLUGIN_NAME " plugin: virDomainMemoryStats failed with mem_stats %i.",
-          mem_stats);
-    sfree(minfo);
-
-    virErrorPtr err = virGetLastError();
-    if (err->code == VIR_ERR_NO_SUPPORT) {
-      ERROR(PLUGIN_NAME
-            " plugin: Disabled unsupported ExtraStats selector: memory");
-      extra_stats &= ~(ex_stats_memory);
-    }
-
-    return -1;
-  }
-
+static void memory_stats_submit_all(virDomainPtr domain,
+                                    virDomainMemoryStatPtr minfo,
+                                    int mem_stats) {
   derive_t swap_in = -1;
   derive_t swap_out = -1;
   derive_t min_flt = -1;
@@ -1807,6 +1809,34 @@ static int get_memory_stats(virDomainPtr domain) {
     };
     submit(domain, "ps_pagefaults", NULL, values, STATIC_ARRAY_SIZE(values));
   }
+}
+
+static int get_memory_stats(virDomainPtr domain) {
+  virDomainMemoryStatPtr minfo =
+      calloc(VIR_DOMAIN_MEMORY_STAT_NR, sizeof(*minfo));
+  if (minfo == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return -1;
+  }
+
+  int mem_stats =
+      virDomainMemoryStats(domain, minfo, VIR_DOMAIN_MEMORY_STAT_NR, 0);
+  if (mem_stats < 0) {
+    ERROR(PLUGIN_NAME " plugin: virDomainMemoryStats failed with mem_stats %i.",
+          mem_stats);
+    sfree(minfo);
+
+    virErrorPtr err = virGetLastError();
+    if (err->code == VIR_ERR_NO_SUPPORT) {
+      ERROR(PLUGIN_NAME
+            " plugin: Disabled unsupported ExtraStats selector: memory");
+      extra_stats &= ~(ex_stats_memory);
+    }
+
+    return -1;
+  }
+
+  memory_stats_submit_all(domain, minfo, mem_stats);
 
   sfree(minfo);
   return 0;
@@ -2148,15 +2178,10 @@ static int get_domain_metrics(domain_t *domain) {
   return 0;
 }
 
-static int get_if_dev_stats(struct interface_device *if_dev) {
-  virDomainInterfaceStatsStruct stats = {0};
+static void if_dev_stats_submit(struct interface_device *if_dev,
+                                virDomainInterfaceStatsPtr stats) {
   char *display_name = NULL;
 
-  if (!if_dev) {
-    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
-    return -1;
-  }
-
   switch (interface_format) {
   case if_address:
     display_name = if_dev->address;
@@ -2169,30 +2194,506 @@ static int get_if_dev_stats(struct interface_device *if_dev) {
     display_name = if_dev->path;
   }
 
+  if ((stats->rx_bytes != -1) && (stats->tx_bytes != -1))
+    submit_derive2("if_octets", (derive_t)stats->rx_bytes,
+                   (derive_t)stats->tx_bytes, if_dev->dom, display_name);
+
+  if ((stats->rx_packets != -1) && (stats->tx_packets != -1))
+    submit_derive2("if_packets", (derive_t)stats->rx_packets,
+                   (derive_t)stats->tx_packets, if_dev->dom, display_name);
+
+  if ((stats->rx_errs != -1) && (stats->tx_errs != -1))
+    submit_derive2("if_errors", (derive_t)stats->rx_errs,
+                   (derive_t)stats->tx_errs, if_dev->dom, display_name);
+
+  if ((stats->rx_drop != -1) && (stats->tx_drop != -1))
+    submit_derive2("if_dropped", (derive_t)stats->rx_drop,
+                   (derive_t)stats->tx_drop, if_dev->dom, display_name);
+}
+
+static int get_if_dev_stats(struct interface_device *if_dev) {
+  virDomainInterfaceStatsStruct stats = {0};
+
+  if (!if_dev) {
+    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
+    return -1;
+  }
+
   if (virDomainInterfaceStats(if_dev->dom, if_dev->path, &stats,
                               sizeof(stats)) != 0) {
     ERROR(PLUGIN_NAME " plugin: virDomainInterfaceStats failed");
     return -1;
   }
 
-  if ((stats.rx_bytes != -1) && (stats.tx_bytes != -1))
-    submit_derive2("if_octets", (derive_t)stats.rx_bytes,
-                   (derive_t)stats.tx_bytes, if_dev->dom, display_name);
+  if_dev_stats_submit(if_dev, &stats);
+  return 0;
+}
 
-  if ((stats.rx_packets != -1) && (stats.tx_packets != -1))
-    submit_derive2("if_packets", (derive_t)stats.rx_packets,
-                   (derive_t)stats.tx_packets, if_dev->dom, display_name);
+#ifdef HAVE_BULK_STATS
+/* Bulk mode: instead of several RPCs per domain and device, all stat groups
+ * of all running domains of an instance are fetched with a single
+ * virDomainListGetStats() call and the typed parameters of the returned
+ * records are mapped to the values the other code paths submit. */
 
-  if ((stats.rx_errs != -1) && (stats.tx_errs != -1))
-    submit_derive2("if_errors", (derive_t)stats.rx_errs,
-                   (derive_t)stats.tx_errs, if_dev->dom, display_name);
+/* Per-record state of the interfaces and block devices, indexed by the
+ * number in the "net.<n>." and "block.<n>." parameter names. */
+struct lv_bulk_if {
+  const char *name;
+  virDomainInterfaceStatsStruct stats;
+};
 
-  if ((stats.rx_drop != -1) && (stats.tx_drop != -1))
-    submit_derive2("if_dropped", (derive_t)stats.rx_drop,
-                   (derive_t)stats.tx_drop, if_dev->dom, display_name);
+struct lv_bulk_block {
+  const char *name;
+  const char *path;
+  struct lv_block_stats bstats;
+  virDomainBlockInfo binfo;
+};
+
+/* Memory stats reported in the "balloon." group, with the tag used by
+ * virDomainMemoryStats() and memory_stats_submit(). */
+static const struct {
+  const char *field;
+  int tag;
+} lv_bulk_balloon_tags[] = {
+    {"swap_in", VIR_DOMAIN_MEMORY_STAT_SWAP_IN},
+    {"swap_out", VIR_DOMAIN_MEMORY_STAT_SWAP_OUT},
+    {"major_fault", VIR_DOMAIN_MEMORY_STAT_MAJOR_FAULT},
+    {"minor_fault", VIR_DOMAIN_MEMORY_STAT_MINOR_FAULT},
+    {"unused", VIR_DOMAIN_MEMORY_STAT_UNUSED},
+    {"available", VIR_DOMAIN_MEMORY_STAT_AVAILABLE},
+    {"current", VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON},
+    {"rss", VIR_DOMAIN_MEMORY_STAT_RSS},
+    /* Tags of newer libvirt versions. "last-update" is a timestamp and not
+     * reported. */
+    {"usable", 8},
+    {"disk_caches", 10},
+    {"hugetlb_pgalloc", 11},
+    {"hugetlb_pgfail", 12},
+};
+
+static void init_if_stats(virDomainInterfaceStatsPtr stats) {
+  stats->rx_bytes = -1;
+  stats->rx_packets = -1;
+  stats->rx_errs = -1;
+  stats->rx_drop = -1;
+  stats->tx_bytes = -1;
+  stats->tx_packets = -1;
+  stats->tx_errs = -1;
+  stats->tx_drop = -1;
+}
+
+static bool lv_param_value(const virTypedParameter *param, long long *ret) {
+  switch (param->type) {
+  case VIR_TYPED_PARAM_INT:
+    *ret = param->value.i;
+    return true;
+  case VIR_TYPED_PARAM_UINT:
+    *ret = param->value.ui;
+    return true;
+  case VIR_TYPED_PARAM_LLONG:
+    *ret = param->value.l;
+    return true;
+  case VIR_TYPED_PARAM_ULLONG:
+    *ret = (long long)param->value.ul;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* If "field" is "<prefix><n>.<name>", stores n in "idx" and returns name.
+ * Returns NULL otherwise. */
+static const char *lv_bulk_indexed_field(const char *field,
+                                         const char *prefix, size_t *idx) {
+  size_t prefix_len = strlen(prefix);
+  char *endptr = NULL;
+
+  if (strncmp(field, prefix, prefix_len) != 0)
+    return NULL;
+
+  field += prefix_len;
+  if (!isdigit((unsigned char)*field))
+    return NULL;
+
+  *idx = (size_t)strtoul(field, &endptr, 10);
+  if (*endptr != '.')
+    return NULL;
+
+  return endptr + 1;
+}
+
+static void lv_bulk_if_value(struct lv_bulk_if *ifs, const char *name,
+                             const virTypedParameter *param) {
+  long long value;
+
+  if (strcmp(name, "name") == 0) {
+    if (param->type == VIR_TYPED_PARAM_STRING)
+      ifs->name = param->value.s;
+    return;
+  }
+
+  if (!lv_param_value(param, &value))
+    return;
+
+  if (strcmp(name, "rx.bytes") == 0)
+    ifs->stats.rx_bytes = value;
+  else if (strcmp(name, "rx.pkts") == 0)
+    ifs->stats.rx_packets = value;
+  else if (strcmp(name, "rx.errs") == 0)
+    ifs->stats.rx_errs = value;
+  else if (strcmp(name, "rx.drop") == 0)
+    ifs->stats.rx_drop = value;
+  else if (strcmp(name, "tx.bytes") == 0)
+    ifs->stats.tx_bytes = value;
+  else if (strcmp(name, "tx.pkts") == 0)
+    ifs->stats.tx_packets = value;
+  else if (strcmp(name, "tx.errs") == 0)
+    ifs->stats.tx_errs = value;
+  else if (strcmp(name, "tx.drop") == 0)
+    ifs->stats.tx_drop = value;
+}
+
+static void lv_bulk_block_value(struct lv_bulk_block *blk, const char *name,
+                                const virTypedParameter *param) {
+  long long value;
+
+  if (param->type == VIR_TYPED_PARAM_STRING) {
+    if (strcmp(name, "name") == 0)
+      blk->name = param->value.s;
+    else if (strcmp(name, "path") == 0)
+      blk->path = param->value.s;
+    return;
+  }
+
+  if (!lv_param_value(param, &value))
+    return;
+
+  if (strcmp(name, "rd.reqs") == 0)
+    blk->bstats.bi.rd_req = value;
+  else if (strcmp(name, "rd.bytes") == 0)
+    blk->bstats.bi.rd_bytes = value;
+  else if (strcmp(name, "rd.times") == 0)
+    blk->bstats.rd_total_times = value;
+  else if (strcmp(name, "wr.reqs") == 0)
+    blk->bstats.bi.wr_req = value;
+  else if (strcmp(name, "wr.bytes") == 0)
+    blk->bstats.bi.wr_bytes = value;
+  else if (strcmp(name, "wr.times") == 0)
+    blk->bstats.wr_total_times = value;
+  else if (strcmp(name, "fl.reqs") == 0)
+    blk->bstats.fl_req = value;
+  else if (strcmp(name, "fl.times") == 0)
+    blk->bstats.fl_total_times = value;
+  else if (strcmp(name, "allocation") == 0)
+    blk->binfo.allocation = (unsigned long long)value;
+  else if (strcmp(name, "capacity") == 0)
+    blk->binfo.capacity = (unsigned long long)value;
+  else if (strcmp(name, "physical") == 0)
+    blk->binfo.physical = (unsigned long long)value;
+}
+
+static bool lv_bulk_balloon_value(virDomainMemoryStatPtr minfo,
+                                  const char *name, long long value) {
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(lv_bulk_balloon_tags); i++) {
+    if (strcmp(name, lv_bulk_balloon_tags[i].field) == 0) {
+      minfo->tag = lv_bulk_balloon_tags[i].tag;
+      minfo->val = (unsigned long long)value;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void lv_bulk_submit_devices(struct lv_read_state *state,
+                                   virDomainPtr dom, struct lv_bulk_if *ifs,
+                                   size_t ifs_num, struct lv_bulk_block *blks,
+                                   size_t blks_num) {
+  for (int i = 0; i < state->nr_interface_devices; ++i) {
+    struct interface_device *if_dev = &state->interface_devices[i];
+    if (if_dev->dom != dom)
+      continue;
+
+    for (size_t j = 0; j < ifs_num; j++) {
+      if ((ifs[j].name != NULL) && (strcmp(ifs[j].name, if_dev->path) == 0)) {
+        if_dev_stats_submit(if_dev, &ifs[j].stats);
+        break;
+      }
+    }
+  }
+
+  for (int i = 0; i < state->nr_block_devices; ++i) {
+    struct block_device *block_dev = &state->block_devices[i];
+    if (block_dev->dom != dom)
+      continue;
+
+    for (size_t j = 0; j < blks_num; j++) {
+      const char *path =
+          (blockdevice_format == source) ? blks[j].path : blks[j].name;
+      if ((path == NULL) || (strcmp(path, block_dev->path) != 0))
+        continue;
+
+      /* Like virDomainGetBlockInfo(), only report the block info of
+       * devices with a source. */
+      if (!block_dev->has_source)
+        init_block_info(&blks[j].binfo);
+
+      disk_block_stats_submit(&blks[j].bstats, dom, block_dev->path,
+                              &blks[j].binfo);
+      break;
+    }
+  }
+}
+
+static int lv_bulk_submit_record(struct lv_read_state *state, domain_t *domain,
+                                 virDomainStatsRecordPtr rec) {
+  virDomainPtr dom = domain->ptr;
+  long long state_state = -1, state_reason = 0;
+  long long cpu_time = -1, cpu_user = 0, cpu_system = 0;
+  long long balloon_current = -1;
+  long long vcpu_current = 0;
+  size_t ifs_num = 0, blks_num = 0;
+  virDomainMemoryStatStruct minfo[STATIC_ARRAY_SIZE(lv_bulk_balloon_tags)];
+  int minfo_num = 0;
+
+  /* The counts precede the per-device parameters, but don't rely on it. */
+  for (int i = 0; i < rec->nparams; ++i) {
+    long long value;
+    if (!lv_param_value(&rec->params[i], &value) || (value < 0))
+      continue;
+    if (strcmp(rec->params[i].field, "net.count") == 0)
+      ifs_num = (size_t)value;
+    else if (strcmp(rec->params[i].field, "block.count") == 0)
+      blks_num = (size_t)value;
+  }
+
+  struct lv_bulk_if *ifs = calloc(ifs_num + 1, sizeof(*ifs));
+  struct lv_bulk_block *blks = calloc(blks_num + 1, sizeof(*blks));
+  if ((ifs == NULL) || (blks == NULL)) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    sfree(ifs);
+    sfree(blks);
+    return -1;
+  }
+
+  for (size_t i = 0; i < ifs_num; i++)
+    init_if_stats(&ifs[i].stats);
+  for (size_t i = 0; i < blks_num; i++) {
+    init_block_stats(&blks[i].bstats);
+    init_block_info(&blks[i].binfo);
+  }
+
+  for (int i = 0; i < rec->nparams; ++i) {
+    virTypedParameterPtr param = &rec->params[i];
+    const char *field = param->field;
+    const char *name;
+    size_t idx;
+    long long value;
+
+    if ((name = lv_bulk_indexed_field(field, "net.", &idx)) != NULL) {
+      if (idx < ifs_num)
+        lv_bulk_if_value(&ifs[idx], name, param);
+      continue;
+    }
+    if ((name = lv_bulk_indexed_field(field, "block.", &idx)) != NULL) {
+      if (idx < blks_num)
+        lv_bulk_block_value(&blks[idx], name, param);
+      continue;
+    }
+#ifdef HAVE_PERF_STATS
+    if (strncmp(field, "perf.", strlen("perf.")) == 0) {
+      if (extra_stats & ex_stats_perf)
+        perf_params_submit(dom, param, 1);
+      continue;
+    }
+#endif
+
+    if (!lv_param_value(param, &value))
+      continue;
+
+    if ((name = lv_bulk_indexed_field(field, "vcpu.", &idx)) != NULL) {
+      /* With vcpupin, get_vcpu_stats() reports the vcpu times, too. */
+      if ((extra_stats & ex_stats_vcpu) && !(extra_stats & ex_stats_vcpupin) &&
+          (strcmp(name, "time") == 0))
+        vcpu_submit((derive_t)value, dom, (int)idx, "virt_vcpu");
+    } else if (strcmp(field, "state.state") == 0)
+      state_state = value;
+    else if (strcmp(field, "state.reason") == 0)
+      state_reason = value;
+    else if (strcmp(field, "cpu.time") == 0)
+      cpu_time = value;
+    else if (strcmp(field, "cpu.user") == 0)
+      cpu_user = value;
+    else if (strcmp(field, "cpu.system") == 0)
+      cpu_system = value;
+    else if (strcmp(field, "vcpu.current") == 0)
+      vcpu_current = value;
+    else if (strncmp(field, "balloon.", strlen("balloon.")) == 0) {
+      const char *tag = field + strlen("balloon.");
+      if (strcmp(tag, "current") == 0)
+        balloon_current = value;
+      if ((minfo_num < (int)STATIC_ARRAY_SIZE(minfo)) &&
+          lv_bulk_balloon_value(&minfo[minfo_num], tag, value))
+        minfo_num++;
+    }
+  }
+
+#ifdef HAVE_DOM_REASON
+  if ((extra_stats & ex_stats_domain_state) && (state_state != -1)) {
+    value_t values[] = {
+        {.gauge = (gauge_t)state_state},
+        {.gauge = (gauge_t)state_reason},
+    };
+    submit(dom, "domain_state", NULL, values, STATIC_ARRAY_SIZE(values));
+  }
+#endif
+
+  /* Like get_domain_metrics(), only report running domains. */
+  if (state_state != VIR_DOMAIN_RUNNING)
+    goto out;
+
+#ifdef HAVE_CPU_STATS
+  if ((extra_stats & ex_stats_pcpu) && ((cpu_user > 0) || (cpu_system > 0)))
+    submit_derive2("ps_cputime", cpu_user, cpu_system, dom, NULL);
+#endif
+
+  if (cpu_time != -1) {
+    cpu_submit(domain, (unsigned long long)cpu_time);
+    domain->info.cpuTime = (unsigned long long)cpu_time;
+  }
+
+  if (balloon_current != -1)
+    memory_submit(dom, (gauge_t)balloon_current * 1024);
+
+  int status;
+
+  /* The pinning of the vcpus is not part of any stats group. */
+  if ((extra_stats & ex_stats_vcpupin) && (vcpu_current > 0))
+    GET_STATS(get_vcpu_stats, "vcpu stats", dom,
+              (unsigned short)vcpu_current);
+  if ((extra_stats & ex_stats_memory) && (minfo_num > 0))
+    memory_stats_submit_all(dom, minfo, minfo_num);
+
+  /* These have no stats group either. */
+#ifdef HAVE_FS_INFO
+  if (extra_stats & ex_stats_fs_info)
+    GET_STATS(get_fs_info, "file system info", dom);
+#endif
+
+#ifdef HAVE_DISK_ERR
+  if (extra_stats & ex_stats_disk_err)
+    GET_STATS(get_disk_err, "disk errors", dom);
+#endif
+
+#ifdef HAVE_JOB_STATS
+  if (extra_stats &
+      (ex_stats_job_stats_completed | ex_stats_job_stats_background))
+    GET_STATS(get_job_stats, "job stats", dom);
+#endif
+
+  lv_bulk_submit_devices(state, dom, ifs, ifs_num, blks, blks_num);
+
+out:
+  sfree(ifs);
+  sfree(blks);
   return 0;
 }
 
+/* Returns the domain of "state" the record belongs to. Records are returned
+ * in the order the domains have been passed, so "*hint" is tried first. */
+static domain_t *lv_bulk_find_domain(domain_t **doms, int doms_num,
+                                     int *hint, virDomainStatsRecordPtr rec) {
+  const char *name = virDomainGetName(rec->dom);
+
+  if (name == NULL)
+    return NULL;
+
+  for (int i = 0; i < doms_num; i++) {
+    int j = (*hint + i) % doms_num;
+    const char *dom_name = virDomainGetName(doms[j]->ptr);
+    if ((dom_name != NULL) && (strcmp(dom_name, name) == 0)) {
+      *hint = j + 1;
+      return doms[j];
+    }
+  }
+
+  return NULL;
+}
+
+/* Reads and submits the metrics of all running domains of "state". Returns
+ * zero on success; otherwise the caller falls back to per-domain calls. */
+static int lv_bulk_read(struct lv_read_state *state) {
+  unsigned int stats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL |
+                       VIR_DOMAIN_STATS_BALLOON;
+  virDomainStatsRecordPtr *records = NULL;
+  int status = 0;
+
+  if (extra_stats & (ex_stats_vcpu | ex_stats_vcpupin))
+    stats |= VIR_DOMAIN_STATS_VCPU;
+  if (state->nr_interface_devices > 0)
+    stats |= VIR_DOMAIN_STATS_INTERFACE;
+  if (state->nr_block_devices > 0)
+    stats |= VIR_DOMAIN_STATS_BLOCK;
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    stats |= VIR_DOMAIN_STATS_PERF;
+#endif
+
+  /* virDomainListGetStats requires a NULL terminated list of domains */
+  virDomainPtr *dom_array = calloc(state->nr_domains + 1, sizeof(*dom_array));
+  domain_t **doms = calloc(state->nr_domains + 1, sizeof(*doms));
+  if ((dom_array == NULL) || (doms == NULL)) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    sfree(dom_array);
+    sfree(doms);
+    return -1;
+  }
+
+  int doms_num = 0;
+  for (int i = 0; i < state->nr_domains; ++i) {
+    if (!state->domains[i].active)
+      continue;
+    dom_array[doms_num] = state->domains[i].ptr;
+    doms[doms_num] = &state->domains[i];
+    doms_num++;
+  }
+
+  if (doms_num == 0)
+    goto out;
+
+  int records_num = virDomainListGetStats(dom_array, stats, &records, 0);
+  if (records_num < 0) {
+    VIRT_ERROR(conn, "virDomainListGetStats");
+
+    virErrorPtr err = virGetLastError();
+    if ((err != NULL) && (err->code == VIR_ERR_NO_SUPPORT)) {
+      ERROR(PLUGIN_NAME " plugin: Disabled unsupported option: BulkStats");
+      bulk_stats = false;
+    }
+    status = -1;
+    goto out;
+  }
+
+  int hint = 0;
+  for (int i = 0; i < records_num; ++i) {
+    domain_t *domain =
+        lv_bulk_find_domain(doms, doms_num, &hint, records[i]);
+    if (domain == NULL)
+      continue;
+
+    if (lv_bulk_submit_record(state, domain, records[i]) != 0)
+      ERROR(PLUGIN_NAME " plugin: failed to get metrics for domain=%s",
+            virDomainGetName(domain->ptr));
+  }
+
+  virDomainStatsRecordListFree(records);
+
+out:
+  sfree(dom_array);
+  sfree(doms);
+  return status;
+}
+#endif /* HAVE_BULK_STATS */
+
 static int domain_lifecycle_event_cb(__attribute__((unused)) virConnectPtr con_,
                                      virDomainPtr dom, int event, int detail,
                                      __attribute__((unused)) void *opaque) {
@@ -2476,11 +2977,22 @@ static int lv_read(user_data_t *ud) {
           state->interface_devices[i].path);
 #endif
 
+  /* In bulk mode, the metrics of the running domains and their devices are
+   * read with a single call. If that fails, fall back to the calls per
+   * domain and device. */
+  bool bulk_done = false;
+#ifdef HAVE_BULK_STATS
+  if (bulk_stats)
+    bulk_done = (lv_bulk_read(state) == 0);
+#endif
+
   /* Get domains' metrics */
   for (int i = 0; i < state->nr_domains; ++i) {
     domain_t *dom = &state->domains[i];
     int status = 0;
-    if (dom->active)
+    if (dom->active && bulk_done)
+      continue;
+    else if (dom->active)
       status = get_domain_metrics(dom);
 #ifdef HAVE_DOM_REASON
     else if (extra_stats & ex_stats_domain_state)
@@ -2492,6 +3004,9 @@ static int lv_read(user_data_t *ud) {
             virDomainGetName(dom->ptr));
   }
 
+  if (bulk_done)
+    return 0;
+
   /* Get block device stats for each domain. */
   for (int i = 0; i < state->nr_block_devices; ++i) {
     int status = get_block_device_stats(&state->block_devices[i]);
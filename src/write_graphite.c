@@ -41,6 +41,10 @@
  *     UseTags true
  *     ReverseHost false
  *   </Carbon>
+ *   <NodeGroup "carbon">
+ *     Server "carbon1" "2003"
+ *     Server "carbon2" "2003"
+ *   </NodeGroup>
  * </Plugin>
  */
 
@@ -53,6 +57,8 @@
 #include "utils_complain.h"
 
 #include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #ifndef WG_DEFAULT_NODE
 #define WG_DEFAULT_NODE "localhost"
@@ -83,139 +89,207 @@
 #define WG_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T(1)
 #endif
 
+#ifndef WG_CONNECT_TIMEOUT
+#define WG_CONNECT_TIMEOUT TIME_T_TO_CDTIME_T(5)
+#endif
+
+/* Time the IO thread is given to send the pending buffers on shutdown. */
+#ifndef WG_SHUTDOWN_TIMEOUT
+#define WG_SHUTDOWN_TIMEOUT TIME_T_TO_CDTIME_T(2)
+#endif
+
+#ifndef WG_DEFAULT_MAX_PENDING_BUFFERS
+#define WG_DEFAULT_MAX_PENDING_BUFFERS 256
+#endif
+
+/* Number of buffers passed to one writev(2) call. */
+#define WG_IOV_MAX 64
+
+/* Granularity in milliseconds with which the IO thread notices a shutdown
+ * while waiting for the socket. */
+#define WG_POLL_INTERVAL_MS 100
+
+/* Points on the hash ring per server of a node group. */
+#define WG_RING_REPLICAS 100
+
 /*
  * Private variables
  */
-struct wg_callback {
-  int sock_fd;
+typedef struct {
+  size_t len;
+  char data[WG_SEND_BUF_SIZE];
+} wg_buffer_t;
 
-  char *name;
+struct wg_callback;
+
+/* One connection to a Carbon server, with its own IO thread. */
+typedef struct {
+  struct wg_callback *cb;
+
+  /* Only used by the IO thread, or after it has been joined. */
+  int sock_fd;
 
   char *node;
   char *service;
-  char *protocol;
-  bool log_send_errors;
-  char *prefix;
-  char *postfix;
-  char escape_char;
-
-  unsigned int format_flags;
 
-  char send_buf[WG_SEND_BUF_SIZE];
-  size_t send_buf_free;
-  size_t send_buf_fill;
+  /* Ring of send buffers. The `queue_num' buffers starting at `queue_head'
+   * are full and owned by the IO thread, which has already sent the first
+   * `queue_head_offset' bytes of the head. The buffer following them is the
+   * one write threads currently fill. */
+  wg_buffer_t *queue;
+  size_t queue_size;
+  size_t queue_head;
+  size_t queue_head_offset;
+  size_t queue_num;
   cdtime_t send_buf_init_time;
+  uint64_t queue_dropped;
 
   pthread_mutex_t send_lock;
+  pthread_cond_t io_cond;
+  pthread_t io_thread;
+  bool io_thread_running;
+  bool io_shutdown;
+  cdtime_t io_deadline;
+
+  /* Cleared by the IO thread while the server is not reachable, so that node
+   * groups send to another server. Accessed atomically. */
+  bool available;
+
   c_complain_t init_complaint;
+  c_complain_t queue_complaint;
   cdtime_t last_connect_time;
 
   /* Force reconnect useful for load balanced environments */
   cdtime_t last_reconnect_time;
+} wg_connection_t;
+
+typedef struct {
+  uint32_t hash;
+  size_t conn;
+} wg_ring_point_t;
+
+struct wg_callback {
+  char *name;
+
+  char *protocol;
+  bool log_send_errors;
+  char *prefix;
+  char *postfix;
+  char escape_char;
   cdtime_t reconnect_interval;
-  bool reconnect_interval_reached;
+
+  unsigned int format_flags;
+  format_graphite_cache_t *cache;
+
+  /* A <Node> has exactly one connection. The metrics of a <NodeGroup> are
+   * distributed over its connections by consistent hashing of the metric
+   * path. */
+  wg_connection_t *conns;
+  size_t conns_num;
+  wg_ring_point_t *ring;
+  size_t ring_num;
 };
 
-/* wg_force_reconnect_check closes cb->sock_fd when it was open for longer
- * than cb->reconnect_interval. Must hold cb->send_lock when calling. */
-static void wg_force_reconnect_check(struct wg_callback *cb) {
+/* wg_force_reconnect_check closes conn->sock_fd when it was open for longer
+ * than the reconnect interval. Must only be called by the IO thread. */
+static void wg_force_reconnect_check(wg_connection_t *conn) {
   cdtime_t now;
 
-  if (cb->reconnect_interval == 0)
+  if ((conn->cb->reconnect_interval == 0) || (conn->sock_fd < 0))
     return;
 
   /* check if address changes if addr_timeout */
   now = cdtime();
-  if ((now - cb->last_reconnect_time) < cb->reconnect_interval)
+  if ((now - conn->last_reconnect_time) < conn->cb->reconnect_interval)
     return;
 
   /* here we should close connection on next */
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
-  cb->last_reconnect_time = now;
-  cb->reconnect_interval_reached = true;
+  close(conn->sock_fd);
+  conn->sock_fd = -1;
 
   INFO("write_graphite plugin: Connection closed after %.3f seconds.",
-       CDTIME_T_TO_DOUBLE(now - cb->last_reconnect_time));
+       CDTIME_T_TO_DOUBLE(now - conn->last_reconnect_time));
+  conn->last_reconnect_time = now;
 }
 
 /*
  * Functions
  */
-static void wg_reset_buffer(struct wg_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
+/* NOTE: You must hold conn->send_lock when calling this function! */
+static wg_buffer_t *wg_fill_buffer(wg_connection_t *conn) {
+  return conn->queue +
+         ((conn->queue_head + conn->queue_num) % conn->queue_size);
 }
 
-static int wg_send_buffer(struct wg_callback *cb) {
-  ssize_t status;
-
-  if (cb->sock_fd < 0)
-    return -1;
-
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    if (cb->log_send_errors) {
-      ERROR("write_graphite plugin: send to %s:%s (%s) failed with status %zi "
-            "(%s)",
-            cb->node, cb->service, cb->protocol, status, STRERRNO);
-    }
+/* Hands the buffer being filled over to the IO thread. If all buffers are
+ * pending, e.g. because the Carbon relay is not reachable, its content is
+ * dropped instead.
+ * NOTE: You must hold conn->send_lock when calling this function! */
+static void wg_publish_nolock(wg_connection_t *conn) {
+  if (conn->queue == NULL)
+    return;
 
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
+  wg_buffer_t *buf = wg_fill_buffer(conn);
+  if (buf->len == 0)
+    return;
 
-    return -1;
+  if (conn->queue_num >= conn->queue_size - 1) {
+    conn->queue_dropped++;
+    c_complain(LOG_WARNING, &conn->queue_complaint,
+               "write_graphite plugin: All %" PRIsz " buffers for %s:%s are "
+               "pending. Dropping metrics (%" PRIu64 " buffers so far).",
+               conn->queue_size - 1, conn->node, conn->service,
+               conn->queue_dropped);
+    buf->len = 0;
+    conn->send_buf_init_time = cdtime();
+    return;
   }
 
-  return 0;
-}
-
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wg_flush_nolock(cdtime_t timeout, struct wg_callback *cb) {
-  int status;
+  c_release(LOG_INFO, &conn->queue_complaint,
+            "write_graphite plugin: Buffers for %s:%s are available again.",
+            conn->node, conn->service);
 
-  DEBUG("write_graphite plugin: wg_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %" PRIsz ";",
-        (double)timeout, cb->send_buf_fill);
+  conn->queue_num++;
+  wg_fill_buffer(conn)->len = 0;
+  conn->send_buf_init_time = cdtime();
+  pthread_cond_signal(&conn->io_cond);
+}
 
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
+/* Waits up to `timeout' (forever if zero) for `events' on conn->sock_fd.
+ * Returns ECANCELED if the plugin is shutting down and the shutdown timeout
+ * has passed. */
+static int wg_poll(wg_connection_t *conn, short events, cdtime_t timeout) {
+  cdtime_t end = cdtime() + timeout;
 
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
+  while (42) {
+    struct pollfd pfd = {.fd = conn->sock_fd, .events = events};
+    int status = poll(&pfd, 1, WG_POLL_INTERVAL_MS);
+    if (status > 0)
       return 0;
+    else if ((status < 0) && (errno != EINTR))
+      return errno;
+
+    cdtime_t now = cdtime();
+    pthread_mutex_lock(&conn->send_lock);
+    bool cancel = conn->io_shutdown && (now >= conn->io_deadline);
+    pthread_mutex_unlock(&conn->send_lock);
+    if (cancel)
+      return ECANCELED;
+    if ((timeout != 0) && (now >= end))
+      return ETIMEDOUT;
   }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wg_send_buffer(cb);
-  wg_reset_buffer(cb);
-
-  return status;
 }
 
-static int wg_callback_init(struct wg_callback *cb) {
+/* Connects conn->sock_fd using a non-blocking socket. Must only be called by
+ * the IO thread. */
+static int wg_connect(wg_connection_t *conn) {
+  struct wg_callback *cb = conn->cb;
   struct addrinfo *ai_list;
-  cdtime_t now;
   int status;
 
   char connerr[1024] = "";
 
-  if (cb->sock_fd > 0)
-    return 0;
-
-  /* Don't try to reconnect too often. By default, one reconnection attempt
-   * is made per second. */
-  now = cdtime();
-  if ((now - cb->last_connect_time) < WG_MIN_RECONNECT_INTERVAL)
-    return EAGAIN;
-  cb->last_connect_time = now;
+  conn->last_connect_time = cdtime();
 
   struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
                               .ai_flags = AI_ADDRCONFIG};
@@ -225,31 +299,52 @@ static int wg_callback_init(struct wg_callback *cb) {
   else
     ai_hints.ai_socktype = SOCK_DGRAM;
 
-  status = getaddrinfo(cb->node, cb->service, &ai_hints, &ai_list);
+  status = getaddrinfo(conn->node, conn->service, &ai_hints, &ai_list);
   if (status != 0) {
-    ERROR("write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
-          cb->node, cb->service, cb->protocol, gai_strerror(status));
+    c_complain(LOG_ERR, &conn->init_complaint,
+               "write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
+               conn->node, conn->service, cb->protocol, gai_strerror(status));
     return -1;
   }
 
   assert(ai_list != NULL);
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    cb->sock_fd =
+    conn->sock_fd =
         socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (cb->sock_fd < 0) {
+    if (conn->sock_fd < 0) {
       snprintf(connerr, sizeof(connerr), "failed to open socket: %s", STRERRNO);
       continue;
     }
 
-    set_sock_opts(cb->sock_fd);
+    set_sock_opts(conn->sock_fd);
+
+    int flags = fcntl(conn->sock_fd, F_GETFL);
+    if ((flags == -1) ||
+        (fcntl(conn->sock_fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+      snprintf(connerr, sizeof(connerr), "fcntl(O_NONBLOCK) failed: %s",
+               STRERRNO);
+      close(conn->sock_fd);
+      conn->sock_fd = -1;
+      continue;
+    }
 
-    status = connect(cb->sock_fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+    status = connect(conn->sock_fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+    if ((status != 0) && (errno == EINPROGRESS)) {
+      status = wg_poll(conn, POLLOUT, WG_CONNECT_TIMEOUT);
+      if (status == 0) {
+        socklen_t status_len = sizeof(status);
+        if (getsockopt(conn->sock_fd, SOL_SOCKET, SO_ERROR, &status,
+                       &status_len) != 0)
+          status = errno;
+      }
+      errno = status;
+    }
     if (status != 0) {
       snprintf(connerr, sizeof(connerr), "failed to connect to remote host: %s",
                STRERRNO);
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
+      close(conn->sock_fd);
+      conn->sock_fd = -1;
       continue;
     }
 
@@ -258,29 +353,235 @@ static int wg_callback_init(struct wg_callback *cb) {
 
   freeaddrinfo(ai_list);
 
-  if (cb->sock_fd < 0) {
-    c_complain(LOG_ERR, &cb->init_complaint,
+  if (conn->sock_fd < 0) {
+    c_complain(LOG_ERR, &conn->init_complaint,
                "write_graphite plugin: Connecting to %s:%s via %s failed. "
                "The last error was: %s",
-               cb->node, cb->service, cb->protocol, connerr);
+               conn->node, conn->service, cb->protocol, connerr);
     return -1;
   } else {
-    c_release(LOG_INFO, &cb->init_complaint,
+    c_release(LOG_INFO, &conn->init_complaint,
               "write_graphite plugin: Successfully connected to %s:%s via %s.",
-              cb->node, cb->service, cb->protocol);
+              conn->node, conn->service, cb->protocol);
   }
 
-  /* wg_force_reconnect_check does not flush the buffer before closing a
-   * sending socket, so only call wg_reset_buffer() if the socket was closed
-   * for a different reason (tracked in cb->reconnect_interval_reached). */
-  if (!cb->reconnect_interval_reached || (cb->send_buf_free == 0))
-    wg_reset_buffer(cb);
-  else
-    cb->reconnect_interval_reached = false;
+  conn->last_reconnect_time = cdtime();
+  return 0;
+}
+
+/* Removes `len' sent bytes from the head of the queue.
+ * NOTE: You must hold conn->send_lock when calling this function! */
+static void wg_consume_nolock(wg_connection_t *conn, size_t len) {
+  while ((len > 0) && (conn->queue_num > 0)) {
+    wg_buffer_t *buf = conn->queue + conn->queue_head;
+    size_t remaining = buf->len - conn->queue_head_offset;
+
+    if (len < remaining) {
+      conn->queue_head_offset += len;
+      return;
+    }
+
+    len -= remaining;
+    buf->len = 0;
+    conn->queue_head = (conn->queue_head + 1) % conn->queue_size;
+    conn->queue_head_offset = 0;
+    conn->queue_num--;
+  }
+}
+
+/* Sends pending buffers, at most WG_IOV_MAX at a time. The pending buffers
+ * are not modified by write threads, so they are sent without holding the
+ * lock. Must only be called by the IO thread. */
+static int wg_send_pending(wg_connection_t *conn) {
+  struct wg_callback *cb = conn->cb;
+  struct iovec iov[WG_IOV_MAX];
+  size_t iov_num = 0;
+  bool stream = (strcasecmp("tcp", cb->protocol) == 0);
+
+  pthread_mutex_lock(&conn->send_lock);
+  for (size_t i = 0; (i < conn->queue_num) && (i < WG_IOV_MAX); i++) {
+    wg_buffer_t *buf =
+        conn->queue + ((conn->queue_head + i) % conn->queue_size);
+    size_t offset = (i == 0) ? conn->queue_head_offset : 0;
+
+    iov[i] = (struct iovec){
+        .iov_base = buf->data + offset,
+        .iov_len = buf->len - offset,
+    };
+    iov_num++;
+  }
+  pthread_mutex_unlock(&conn->send_lock);
+
+  /* Every buffer is a datagram of its own when using UDP. */
+  size_t i = 0;
+  while (i < iov_num) {
+    ssize_t status;
+    if (stream)
+      status = writev(conn->sock_fd, iov + i, (int)(iov_num - i));
+    else
+      status = send(conn->sock_fd, iov[i].iov_base, iov[i].iov_len, 0);
+
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        int err = wg_poll(conn, POLLOUT, /* timeout = */ 0);
+        if (err == 0)
+          continue;
+        errno = err;
+      }
+      if (cb->log_send_errors)
+        ERROR("write_graphite plugin: send to %s:%s (%s) failed: %s",
+              conn->node, conn->service, cb->protocol, STRERRNO);
+      return -1;
+    }
+
+    size_t sent = (size_t)status;
+    if (!stream)
+      sent = iov[i].iov_len;
+
+    pthread_mutex_lock(&conn->send_lock);
+    wg_consume_nolock(conn, sent);
+    pthread_mutex_unlock(&conn->send_lock);
+
+    /* Skip what has been written, a partially written buffer is adjusted. */
+    while ((i < iov_num) && (sent >= iov[i].iov_len)) {
+      sent -= iov[i].iov_len;
+      i++;
+    }
+    if (i < iov_num) {
+      iov[i].iov_base = (char *)iov[i].iov_base + sent;
+      iov[i].iov_len -= sent;
+    }
+  }
 
   return 0;
 }
 
+/* Connects to the Carbon server and sends the pending buffers, so that write
+ * threads never block on the network. While the server is not available,
+ * reconnects are attempted even if nothing is pending, so that node groups
+ * can use it again. */
+static void *wg_io_thread(void *arg) {
+  wg_connection_t *conn = arg;
+
+  while (42) {
+    pthread_mutex_lock(&conn->send_lock);
+    while (!conn->io_shutdown && (conn->queue_num == 0) &&
+           __atomic_load_n(&conn->available, __ATOMIC_RELAXED))
+      pthread_cond_wait(&conn->io_cond, &conn->send_lock);
+    bool shutdown = conn->io_shutdown;
+    bool idle = (conn->queue_num == 0);
+    pthread_mutex_unlock(&conn->send_lock);
+
+    if (shutdown && idle)
+      break;
+
+    wg_force_reconnect_check(conn);
+
+    if (conn->sock_fd < 0) {
+      if (wg_connect(conn) != 0) {
+        __atomic_store_n(&conn->available, false, __ATOMIC_RELAXED);
+        if (shutdown)
+          break;
+
+        /* Don't try to reconnect too often. By default, one reconnection
+         * attempt is made per second. */
+        struct timespec ts = CDTIME_T_TO_TIMESPEC(conn->last_connect_time +
+                                                  WG_MIN_RECONNECT_INTERVAL);
+        pthread_mutex_lock(&conn->send_lock);
+        if (!conn->io_shutdown)
+          pthread_cond_timedwait(&conn->io_cond, &conn->send_lock, &ts);
+        pthread_mutex_unlock(&conn->send_lock);
+        continue;
+      }
+      __atomic_store_n(&conn->available, true, __ATOMIC_RELAXED);
+    }
+
+    if (idle)
+      continue;
+
+    if (wg_send_pending(conn) != 0) {
+      close(conn->sock_fd);
+      conn->sock_fd = -1;
+      __atomic_store_n(&conn->available, false, __ATOMIC_RELAXED);
+      if (shutdown)
+        break;
+    }
+  }
+
+  return NULL;
+}
+
+/* NOTE: You must hold conn->send_lock when calling this function! */
+static int wg_start_io_thread_nolock(wg_connection_t *conn) {
+  if (conn->io_thread_running)
+    return 0;
+
+  int status = plugin_thread_create(&conn->io_thread, wg_io_thread, conn,
+                                    "write_graphite");
+  if (status != 0) {
+    ERROR("write_graphite plugin: plugin_thread_create failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+
+  conn->io_thread_running = true;
+  return 0;
+}
+
+static int wg_connection_init(wg_connection_t *conn, struct wg_callback *cb,
+                              char const *node, char const *service) {
+  *conn = (wg_connection_t){
+      .cb = cb,
+      .sock_fd = -1,
+      .node = strdup(node),
+      .service = strdup(service),
+      .available = true,
+      .last_reconnect_time = cdtime(),
+  };
+  pthread_mutex_init(&conn->send_lock, /* attr = */ NULL);
+  pthread_cond_init(&conn->io_cond, /* attr = */ NULL);
+  C_COMPLAIN_INIT(&conn->init_complaint);
+  C_COMPLAIN_INIT(&conn->queue_complaint);
+
+  if ((conn->node == NULL) || (conn->service == NULL))
+    return ENOMEM;
+  return 0;
+}
+
+/* Asks the IO thread to send what is left and to exit. */
+static void wg_connection_shutdown(wg_connection_t *conn) {
+  pthread_mutex_lock(&conn->send_lock);
+  wg_publish_nolock(conn);
+  conn->io_shutdown = true;
+  conn->io_deadline = cdtime() + WG_SHUTDOWN_TIMEOUT;
+  pthread_cond_broadcast(&conn->io_cond);
+  pthread_mutex_unlock(&conn->send_lock);
+}
+
+static void wg_connection_destroy(wg_connection_t *conn) {
+  if (conn->io_thread_running)
+    pthread_join(conn->io_thread, NULL);
+
+  if (conn->sock_fd >= 0) {
+    close(conn->sock_fd);
+    conn->sock_fd = -1;
+  }
+
+  if (conn->queue_num > 0)
+    WARNING("write_graphite plugin: Dropping %" PRIsz " unsent buffers for "
+            "%s:%s.",
+            conn->queue_num, conn->node, conn->service);
+
+  sfree(conn->node);
+  sfree(conn->service);
+  sfree(conn->queue);
+
+  pthread_cond_destroy(&conn->io_cond);
+  pthread_mutex_destroy(&conn->send_lock);
+}
+
 static void wg_callback_free(void *data) {
   struct wg_callback *cb;
 
@@ -289,100 +590,158 @@ static void wg_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_flush_nolock(/* timeout = */ 0, cb);
-
-  if (cb->sock_fd >= 0) {
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
-  }
+  /* Shut all IO threads down first, so they drain in parallel. */
+  for (size_t i = 0; i < cb->conns_num; i++)
+    wg_connection_shutdown(cb->conns + i);
+  for (size_t i = 0; i < cb->conns_num; i++)
+    wg_connection_destroy(cb->conns + i);
 
+  sfree(cb->conns);
+  sfree(cb->ring);
   sfree(cb->name);
-  sfree(cb->node);
   sfree(cb->protocol);
-  sfree(cb->service);
   sfree(cb->prefix);
   sfree(cb->postfix);
-
-  pthread_mutex_unlock(&cb->send_lock);
-  pthread_mutex_destroy(&cb->send_lock);
+  format_graphite_cache_destroy(cb->cache);
 
   sfree(cb);
 }
 
+/* 32 bit FNV-1a */
+static uint32_t wg_hash(char const *data, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static int wg_ring_point_compare(void const *a, void const *b) {
+  wg_ring_point_t const *pa = a;
+  wg_ring_point_t const *pb = b;
+
+  if (pa->hash != pb->hash)
+    return (pa->hash < pb->hash) ? -1 : 1;
+  /* Make the order independent of qsort's stability. */
+  return (pa->conn < pb->conn) ? -1 : (pa->conn > pb->conn);
+}
+
+/* The points of a server only depend on its host and port, so adding or
+ * removing a server only moves the metrics it is responsible for. */
+static int wg_ring_build(struct wg_callback *cb) {
+  cb->ring_num = cb->conns_num * WG_RING_REPLICAS;
+  cb->ring = calloc(cb->ring_num, sizeof(*cb->ring));
+  if (cb->ring == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < cb->conns_num; i++) {
+    for (size_t j = 0; j < WG_RING_REPLICAS; j++) {
+      char key[2 * NI_MAXHOST];
+      int len = ssnprintf(key, sizeof(key), "%s:%s-%" PRIsz,
+                          cb->conns[i].node, cb->conns[i].service, j);
+      if ((len < 0) || ((size_t)len >= sizeof(key)))
+        len = (int)strlen(key);
+
+      cb->ring[i * WG_RING_REPLICAS + j] = (wg_ring_point_t){
+          .hash = wg_hash(key, (size_t)len),
+          .conn = i,
+      };
+    }
+  }
+
+  qsort(cb->ring, cb->ring_num, sizeof(*cb->ring), wg_ring_point_compare);
+  return 0;
+}
+
+/* Returns the connection responsible for metric `path'. If its server is not
+ * available, the next available server on the ring is used instead. */
+static wg_connection_t *wg_route(struct wg_callback *cb, char const *path,
+                                 size_t path_len) {
+  if (cb->conns_num == 1)
+    return cb->conns;
+
+  uint32_t hash = wg_hash(path, path_len);
+
+  /* First point with a hash of at least `hash', wrapping around. */
+  size_t lo = 0;
+  size_t hi = cb->ring_num;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cb->ring[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  size_t first = (lo == cb->ring_num) ? 0 : lo;
+
+  for (size_t i = 0; i < cb->ring_num; i++) {
+    wg_connection_t *conn =
+        cb->conns + cb->ring[(first + i) % cb->ring_num].conn;
+    if (__atomic_load_n(&conn->available, __ATOMIC_RELAXED))
+      return conn;
+  }
+
+  /* No server is available; queue for the responsible one. */
+  return cb->conns + cb->ring[first].conn;
+}
+
 static int wg_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct wg_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
+  DEBUG("write_graphite plugin: wg_flush: timeout = %.3f;",
+        CDTIME_T_TO_DOUBLE(timeout));
 
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
+  for (size_t i = 0; i < cb->conns_num; i++) {
+    wg_connection_t *conn = cb->conns + i;
 
-  status = wg_flush_nolock(timeout, cb);
-  pthread_mutex_unlock(&cb->send_lock);
+    pthread_mutex_lock(&conn->send_lock);
+    /* timeout == 0  => flush unconditionally */
+    if ((timeout == 0) || ((conn->send_buf_init_time + timeout) <= cdtime()))
+      wg_publish_nolock(conn);
+    pthread_mutex_unlock(&conn->send_lock);
+  }
 
-  return status;
+  return 0;
 }
 
-static int wg_send_message(char const *message, struct wg_callback *cb) {
-  int status;
-  size_t message_len;
-
-  message_len = strlen(message);
-
-  pthread_mutex_lock(&cb->send_lock);
+static int wg_send_message(char const *message, size_t message_len,
+                           wg_connection_t *conn) {
+  if (message_len > WG_SEND_BUF_SIZE)
+    return -1;
 
-  wg_force_reconnect_check(cb);
+  pthread_mutex_lock(&conn->send_lock);
 
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
+  if (wg_start_io_thread_nolock(conn) != 0) {
+    pthread_mutex_unlock(&conn->send_lock);
+    return -1;
   }
 
-  if (message_len >= cb->send_buf_free) {
-    status = wg_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
+  wg_buffer_t *buf = wg_fill_buffer(conn);
+  if (message_len > sizeof(buf->data) - buf->len) {
+    wg_publish_nolock(conn);
+    buf = wg_fill_buffer(conn);
   }
 
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
-
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
+  /* The buffers are not null terminated. */
+  memcpy(buf->data + buf->len, message, message_len);
+  buf->len += message_len;
 
   DEBUG("write_graphite plugin: [%s]:%s (%s) buf %" PRIsz "/%" PRIsz
-        " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->protocol, cb->send_buf_fill,
-        sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
+        " (%.1f %%) \"%.*s\"",
+        conn->node, conn->service, conn->cb->protocol, buf->len,
+        sizeof(buf->data),
+        100.0 * ((double)buf->len) / ((double)sizeof(buf->data)),
+        (int)message_len, message);
 
-  pthread_mutex_unlock(&cb->send_lock);
+  pthread_mutex_unlock(&conn->send_lock);
 
   return 0;
 }
@@ -398,15 +757,32 @@ static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = format_graphite(buffer, sizeof(buffer), ds, vl, cb->prefix,
-                           cb->postfix, cb->escape_char, cb->format_flags);
+  status = format_graphite_cached(cb->cache, plugin_value_list_identity(vl),
+                                  buffer, sizeof(buffer), ds, vl, cb->prefix,
+                                  cb->postfix, cb->escape_char,
+                                  cb->format_flags);
   if (status != 0) /* error message has been printed already. */
     return status;
 
   /* Send the message to graphite */
-  status = wg_send_message(buffer, cb);
-  if (status != 0) /* error message has been printed already. */
-    return status;
+  if (cb->conns_num == 1)
+    return wg_send_message(buffer, strlen(buffer), cb->conns);
+
+  /* Node groups route every line, i.e. every data source, by its path. */
+  char const *line = buffer;
+  while (*line != 0) {
+    char const *end = strchr(line, '\n');
+    size_t line_len = (end != NULL) ? (size_t)(end - line) + 1 : strlen(line);
+    char const *path_end = memchr(line, ' ', line_len);
+    size_t path_len =
+        (path_end != NULL) ? (size_t)(path_end - line) : line_len;
+
+    status = wg_send_message(line, line_len, wg_route(cb, line, path_len));
+    if (status != 0) /* error message has been printed already. */
+      return status;
+
+    line += line_len;
+  }
 
   return 0;
 } /* int wg_write_messages */
@@ -451,9 +827,56 @@ static int config_set_char(char *dest, oconfig_item_t *ci) {
   return 0;
 }
 
-static int wg_config_node(oconfig_item_t *ci) {
+/* Adds a connection to the server given by `Server "host" ["port"]'. */
+static int wg_config_add_server(struct wg_callback *cb, oconfig_item_t *ci) {
+  char service[32] = WG_DEFAULT_SERVICE;
+
+  if ((ci->values_num < 1) || (ci->values_num > 2) ||
+      (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    ERROR("write_graphite plugin: The \"Server\" option needs a host and an "
+          "optional port.");
+    return -1;
+  }
+  if (ci->values_num == 2) {
+    if (ci->values[1].type == OCONFIG_TYPE_STRING)
+      sstrncpy(service, ci->values[1].value.string, sizeof(service));
+    else if (ci->values[1].type == OCONFIG_TYPE_NUMBER)
+      ssnprintf(service, sizeof(service), "%d",
+                (int)ci->values[1].value.number);
+    else {
+      ERROR("write_graphite plugin: The port of the \"Server\" option must "
+            "be a string or a number.");
+      return -1;
+    }
+  }
+
+  wg_connection_t *conns =
+      realloc(cb->conns, (cb->conns_num + 1) * sizeof(*cb->conns));
+  if (conns == NULL) {
+    ERROR("write_graphite plugin: realloc failed.");
+    return -1;
+  }
+  cb->conns = conns;
+
+  int status = wg_connection_init(cb->conns + cb->conns_num, cb,
+                                  ci->values[0].value.string, service);
+  cb->conns_num++;
+  if (status != 0) {
+    ERROR("write_graphite plugin: wg_connection_init failed.");
+    return -1;
+  }
+  return 0;
+}
+
+/* Configures a <Node>, `group' is false, or a <NodeGroup>, which lists its
+ * servers using the "Server" option instead of "Host" and "Port". */
+static int wg_config_node(oconfig_item_t *ci, bool group) {
   struct wg_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
+  char *node = NULL;
+  char *service = NULL;
+  int cache_size = 0;
+  int max_pending = WG_DEFAULT_MAX_PENDING_BUFFERS;
   int status = 0;
 
   cb = calloc(1, sizeof(*cb));
@@ -461,14 +884,9 @@ static int wg_config_node(oconfig_item_t *ci) {
     ERROR("write_graphite plugin: calloc failed.");
     return -1;
   }
-  cb->sock_fd = -1;
   cb->name = NULL;
-  cb->node = strdup(WG_DEFAULT_NODE);
-  cb->service = strdup(WG_DEFAULT_SERVICE);
   cb->protocol = strdup(WG_DEFAULT_PROTOCOL);
-  cb->last_reconnect_time = cdtime();
   cb->reconnect_interval = 0;
-  cb->reconnect_interval_reached = false;
   cb->log_send_errors = WG_DEFAULT_LOG_SEND_ERRORS;
   cb->prefix = NULL;
   cb->postfix = NULL;
@@ -484,16 +902,20 @@ static int wg_config_node(oconfig_item_t *ci) {
     }
   }
 
-  pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
-  C_COMPLAIN_INIT(&cb->init_complaint);
+  if (!group) {
+    node = strdup(WG_DEFAULT_NODE);
+    service = strdup(WG_DEFAULT_SERVICE);
+  }
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
-    if (strcasecmp("Host", child->key) == 0)
-      cf_util_get_string(child, &cb->node);
-    else if (strcasecmp("Port", child->key) == 0)
-      cf_util_get_service(child, &cb->service);
+    if (!group && (strcasecmp("Host", child->key) == 0))
+      cf_util_get_string(child, &node);
+    else if (!group && (strcasecmp("Port", child->key) == 0))
+      cf_util_get_service(child, &service);
+    else if (group && (strcasecmp("Server", child->key) == 0))
+      status = wg_config_add_server(cb, child);
     else if (strcasecmp("Protocol", child->key) == 0) {
       cf_util_get_string(child, &cb->protocol);
 
@@ -526,7 +948,16 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_flag(child, &cb->format_flags, GRAPHITE_REVERSE_HOST);
     else if (strcasecmp("EscapeCharacter", child->key) == 0)
       config_set_char(&cb->escape_char, child);
-    else {
+    else if (strcasecmp("CacheSize", child->key) == 0)
+      status = cf_util_get_int(child, &cache_size);
+    else if (strcasecmp("MaxPendingBuffers", child->key) == 0) {
+      status = cf_util_get_int(child, &max_pending);
+      if ((status == 0) && (max_pending < 1)) {
+        ERROR("write_graphite plugin: \"MaxPendingBuffers\" must be at "
+              "least 1.");
+        status = -1;
+      }
+    } else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
             child->key);
@@ -537,6 +968,53 @@ static int wg_config_node(oconfig_item_t *ci) {
       break;
   }
 
+  if ((status == 0) && !group) {
+    cb->conns = calloc(1, sizeof(*cb->conns));
+    if (cb->conns == NULL) {
+      ERROR("write_graphite plugin: calloc failed.");
+      status = -1;
+    } else {
+      cb->conns_num = 1;
+      status = wg_connection_init(cb->conns, cb, node, service);
+      if (status != 0)
+        ERROR("write_graphite plugin: wg_connection_init failed.");
+    }
+  }
+  sfree(node);
+  sfree(service);
+
+  if ((status == 0) && (cb->conns_num == 0)) {
+    ERROR("write_graphite plugin: The node group \"%s\" has no \"Server\".",
+          cb->name);
+    status = -1;
+  }
+
+  if ((status == 0) && (cache_size > 0)) {
+    cb->cache = format_graphite_cache_create((size_t)cache_size);
+    if (cb->cache == NULL) {
+      ERROR("write_graphite plugin: format_graphite_cache_create failed.");
+      status = -1;
+    }
+  }
+
+  for (size_t i = 0; (status == 0) && (i < cb->conns_num); i++) {
+    wg_connection_t *conn = cb->conns + i;
+
+    /* One more for the buffer being filled. */
+    conn->queue_size = (size_t)max_pending + 1;
+    conn->queue = calloc(conn->queue_size, sizeof(*conn->queue));
+    if (conn->queue == NULL) {
+      ERROR("write_graphite plugin: calloc failed.");
+      status = -1;
+    }
+    conn->send_buf_init_time = cdtime();
+  }
+
+  if ((status == 0) && (cb->conns_num > 1) && (wg_ring_build(cb) != 0)) {
+    ERROR("write_graphite plugin: Building the hash ring failed.");
+    status = -1;
+  }
+
   if (status != 0) {
     wg_callback_free(cb);
     return status;
@@ -545,7 +1023,7 @@ static int wg_config_node(oconfig_item_t *ci) {
   /* FIXME: Legacy configuration syntax. */
   if (cb->name == NULL)
     snprintf(callback_name, sizeof(callback_name), "write_graphite/%s/%s/%s",
-             cb->node, cb->service, cb->protocol);
+             cb->conns[0].node, cb->conns[0].service, cb->protocol);
   else
     snprintf(callback_name, sizeof(callback_name), "write_graphite/%s",
              cb->name);
@@ -566,10 +1044,12 @@ static int wg_config(oconfig_item_t *ci) {
     oconfig_item_t *child = ci->children + i;
 
     if (strcasecmp("Node", child->key) == 0)
-      wg_config_node(child);
+      wg_config_node(child, /* group = */ false);
+    else if (strcasecmp("NodeGroup", child->key) == 0)
+      wg_config_node(child, /* group = */ true);
     /* FIXME: Remove this legacy mode in version 6. */
     else if (strcasecmp("Carbon", child->key) == 0)
-      wg_config_node(child);
+      wg_config_node(child, /* group = */ false);
     else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
@@ -27,10 +27,12 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils/format_influxdb/format_influxdb.h"
 #include "utils/format_json/format_json.h"
 #include "utils/format_kairosdb/format_kairosdb.h"
+#include "utils_complain.h"
 
 #include <curl/curl.h>
 
@@ -46,9 +48,52 @@
 #define WRITE_HTTP_RESPONSE_BUFFER_SIZE 1024
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_MAX_BODY_SIZE
+#define WRITE_HTTP_DEFAULT_MAX_BODY_SIZE 262144
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_MAX_REQUESTS
+#define WRITE_HTTP_DEFAULT_MAX_REQUESTS 4
+#endif
+
+/* Time the IO thread is given to finish the requests in flight on shutdown. */
+#ifndef WRITE_HTTP_SHUTDOWN_TIMEOUT
+#define WRITE_HTTP_SHUTDOWN_TIMEOUT TIME_T_TO_CDTIME_T(5)
+#endif
+
+/* curl_multi_wakeup() is available since libcurl 7.68.0. Without it, the IO
+ * thread notices new requests only when curl_multi_wait() times out. */
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define WRITE_HTTP_HAVE_MULTI_WAKEUP 1
+#define WRITE_HTTP_POLL_INTERVAL_MS 1000
+#else
+#define WRITE_HTTP_HAVE_MULTI_WAKEUP 0
+#define WRITE_HTTP_POLL_INTERVAL_MS 10
+#endif
+
 /*
  * Private variables
  */
+typedef struct {
+  char buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
+  unsigned int pos;
+} wh_response_t;
+
+#define WH_REQUEST_FREE 0
+#define WH_REQUEST_QUEUED 1
+#define WH_REQUEST_ACTIVE 2
+typedef struct {
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  wh_response_t response;
+
+  /* Swapped with the send buffer or, with compression, the body. */
+  char *buffer;
+  size_t buffer_size;
+  size_t size;
+  int state;
+} wh_request_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -65,6 +110,9 @@ struct wh_callback_s {
   char *clientkeypass;
   long sslversion;
   bool store_rates;
+  bool influxdb_merge_type_instances;
+  int influxdb_cache_size;
+  format_influxdb_cache_t *influxdb_cache;
   bool log_http_error;
   int low_speed_limit;
   time_t low_speed_time;
@@ -91,8 +139,32 @@ struct wh_callback_s {
 
   pthread_mutex_t send_lock;
 
-  char response_buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
-  unsigned int response_buffer_pos;
+  wh_response_t response;
+
+  /* Compression: each full send buffer is fed to `compressor', which appends
+   * to `body'. The body is sent once it reaches `body_max_size' bytes or
+   * `body_max_age', or when the node is flushed. */
+  compress_method_t compression;
+  int compression_level;
+  compress_stream_t *compressor;
+  compress_buffer_t body;
+  size_t body_max_size;
+  cdtime_t body_max_age;
+  bool body_started;
+  cdtime_t body_init_time;
+
+  /* Asynchronous mode: full send buffers are swapped into one of the
+   * `requests_num' requests, which the IO thread performs using `multi'. */
+  bool async;
+  int requests_num;
+  wh_request_t *requests;
+  CURLM *multi;
+  pthread_t io_thread;
+  bool io_thread_running;
+  bool io_shutdown;
+  cdtime_t io_deadline;
+  uint64_t requests_dropped;
+  c_complain_t requests_complaint;
 
   int data_ttl;
   char *metrics_prefix;
@@ -110,21 +182,21 @@ static size_t http_attrs_num;
 static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
                                      void *userdata) {
 
-  wh_callback_t *cb = (wh_callback_t *)userdata;
+  wh_response_t *response = userdata;
   unsigned int len = 0;
 
-  if ((cb->response_buffer_pos + nmemb) > sizeof(cb->response_buffer))
-    len = sizeof(cb->response_buffer) - cb->response_buffer_pos;
+  if ((response->pos + nmemb) > sizeof(response->buffer))
+    len = sizeof(response->buffer) - response->pos;
   else
     len = nmemb;
 
   DEBUG(
       "write_http plugin: curl callback nmemb=%zu buffer_pos=%u write_len=%u ",
-      nmemb, cb->response_buffer_pos, len);
+      nmemb, response->pos, len);
 
-  memcpy(cb->response_buffer + cb->response_buffer_pos, ptr, len);
-  cb->response_buffer_pos += len;
-  cb->response_buffer[sizeof(cb->response_buffer) - 1] = '\0';
+  memcpy(response->buffer + response->pos, ptr, len);
+  response->pos += len;
+  response->buffer[sizeof(response->buffer) - 1] = '\0';
 
   /* Always return nmemb even if we write less so libcurl won't throw an error
    */
@@ -132,13 +204,18 @@ static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
 
 } /* }}} wh_curl_write_callback */
 
-static void wh_log_http_error(wh_callback_t *cb) {
+static void wh_reset_response(wh_response_t *response) {
+  memset(response->buffer, 0, sizeof(response->buffer));
+  response->pos = 0;
+}
+
+static void wh_log_http_error(wh_callback_t *cb, CURL *curl) {
   if (!cb->log_http_error)
     return;
 
   long http_code = 0;
 
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
   if (http_code != 200)
     INFO("write_http plugin: HTTP Error code: %lu", http_code);
@@ -152,36 +229,26 @@ static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
   memset(cb->send_buffer, 0, cb->send_buffer_size);
   cb->send_buffer_free = cb->send_buffer_size;
   cb->send_buffer_fill = 0;
-  cb->send_buffer_init_time = cdtime();
+  cb->send_buffer_init_time = cdtime_coarse();
 
   if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
     format_json_initialize(cb->send_buffer, &cb->send_buffer_fill,
                            &cb->send_buffer_free);
   }
 
-  memset(cb->response_buffer, 0, sizeof(cb->response_buffer));
-  cb->response_buffer_pos = 0;
+  wh_reset_response(&cb->response);
 
 } /* }}} wh_reset_buffer */
 
-/* must hold cb->send_lock when calling */
-static int wh_post_nolock(wh_callback_t *cb, char const *data,
-                          long size) /* {{{ */
-{
-  int status = 0;
-
-  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDSIZE, size);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, &wh_curl_write_callback);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, (void *)cb);
-  status = curl_easy_perform(cb->curl);
-
-  wh_log_http_error(cb);
+/* Logs the outcome of a request and dispatches its statistics. */
+static void wh_request_done(wh_callback_t *cb, CURL *curl, /* {{{ */
+                            CURLcode status, char const *errbuf,
+                            wh_response_t const *response) {
+  wh_log_http_error(cb, curl);
 
   if (cb->curl_stats != NULL) {
-    int rc = curl_stats_dispatch(cb->curl_stats, cb->curl, NULL, "write_http",
-                                 cb->name);
+    int rc =
+        curl_stats_dispatch(cb->curl_stats, curl, NULL, "write_http", cb->name);
     if (rc != 0) {
       ERROR("write_http plugin: curl_stats_dispatch failed with "
             "status %i",
@@ -192,108 +259,427 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data,
   if (status != CURLE_OK) {
     ERROR("write_http plugin: curl_easy_perform failed with "
           "status %i: %s",
-          status, cb->curl_errbuf);
-    if (strlen(cb->response_buffer) > 0) {
-      ERROR("write_http plugin: curl_response=%s", cb->response_buffer);
+          status, errbuf);
+    if (strlen(response->buffer) > 0) {
+      ERROR("write_http plugin: curl_response=%s", response->buffer);
     }
   } else {
-    DEBUG("write_http plugin: curl_response=%s", cb->response_buffer);
+    DEBUG("write_http plugin: curl_response=%s", response->buffer);
   }
-  return status;
-} /* }}} wh_post_nolock */
+} /* }}} wh_request_done */
 
-static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+/* must hold cb->send_lock when calling */
+static int wh_post_nolock(wh_callback_t *cb, char const *data,
+                          long size) /* {{{ */
 {
-  if (cb->curl != NULL)
-    return 0;
+  int status = 0;
 
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
-    ERROR("curl plugin: curl_easy_init failed.");
-    return -1;
-  }
+  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDSIZE, size);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
+  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, &wh_curl_write_callback);
+  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, (void *)&cb->response);
+  status = curl_easy_perform(cb->curl);
+
+  wh_request_done(cb, cb->curl, status, cb->curl_errbuf, &cb->response);
+  return status;
+} /* }}} wh_post_nolock */
 
+/* Sets the options shared by all handles of a node. */
+static int wh_curl_setup(wh_callback_t *cb, CURL *curl, /* {{{ */
+                         char *errbuf) {
   if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
                      (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
-                     (long)cb->low_speed_time);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)cb->low_speed_time);
   }
 
 #ifdef HAVE_CURLOPT_TIMEOUT_MS
   if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
 #endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
-
-  cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
-  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
-    cb->headers =
-        curl_slist_append(cb->headers, "Content-Type: application/json");
-  else
-    cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
-  cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, cb->headers);
 
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
 
   if (cb->user != NULL) {
 #ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
+    curl_easy_setopt(curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD,
                      (cb->pass == NULL) ? "" : cb->pass);
 #else
-    size_t credentials_size;
+    if (cb->credentials == NULL) {
+      size_t credentials_size;
 
-    credentials_size = strlen(cb->user) + 2;
-    if (cb->pass != NULL)
-      credentials_size += strlen(cb->pass);
+      credentials_size = strlen(cb->user) + 2;
+      if (cb->pass != NULL)
+        credentials_size += strlen(cb->pass);
 
-    cb->credentials = malloc(credentials_size);
-    if (cb->credentials == NULL) {
-      ERROR("curl plugin: malloc failed.");
-      return -1;
-    }
+      cb->credentials = malloc(credentials_size);
+      if (cb->credentials == NULL) {
+        ERROR("curl plugin: malloc failed.");
+        return -1;
+      }
 
-    snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
-             (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
+      snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
+               (cb->pass == NULL) ? "" : cb->pass);
+    }
+    curl_easy_setopt(curl, CURLOPT_USERPWD, cb->credentials);
 #endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
   }
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, cb->sslversion);
   if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cb->cacert);
   if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
+    curl_easy_setopt(curl, CURLOPT_CAPATH, cb->capath);
 
   if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, cb->clientcert);
 
     if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+      curl_easy_setopt(curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
   }
 #ifdef CURL_VERSION_UNIX_SOCKETS
   if (cb->unix_socket_path) {
-    curl_easy_setopt(cb->curl, CURLOPT_UNIX_SOCKET_PATH, cb->unix_socket_path);
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, cb->unix_socket_path);
   }
 #endif // CURL_VERSION_UNIX_SOCKETS
 
+  if (cb->async) {
+#ifdef CURL_HTTP_VERSION_2TLS
+    /* Requests are multiplexed over one connection if the server supports
+     * HTTP/2. */
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+#endif
+#ifdef CURLOPT_PIPEWAIT
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+  }
+
+  return 0;
+} /* }}} int wh_curl_setup */
+
+/* Adds a queued request to the multi handle.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wh_request_start_nolock(wh_callback_t *cb, /* {{{ */
+                                   wh_request_t *req) {
+  if (req->curl == NULL) {
+    req->curl = curl_easy_init();
+    if ((req->curl == NULL) ||
+        (wh_curl_setup(cb, req->curl, req->curl_errbuf) != 0)) {
+      ERROR("write_http plugin: curl_easy_init failed.");
+      if (req->curl != NULL)
+        curl_easy_cleanup(req->curl);
+      req->curl = NULL;
+      return -1;
+    }
+    curl_easy_setopt(req->curl, CURLOPT_PRIVATE, (void *)req);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION,
+                     &wh_curl_write_callback);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, (void *)&req->response);
+  }
+
+  curl_easy_setopt(req->curl, CURLOPT_URL, cb->location);
+  curl_easy_setopt(req->curl, CURLOPT_POSTFIELDSIZE, (long)req->size);
+  curl_easy_setopt(req->curl, CURLOPT_POSTFIELDS, req->buffer);
+  wh_reset_response(&req->response);
+  req->curl_errbuf[0] = 0;
+
+  CURLMcode status = curl_multi_add_handle(cb->multi, req->curl);
+  if (status != CURLM_OK) {
+    ERROR("write_http plugin: curl_multi_add_handle failed: %s",
+          curl_multi_strerror(status));
+    return -1;
+  }
+
+  req->state = WH_REQUEST_ACTIVE;
+  return 0;
+} /* }}} int wh_request_start_nolock */
+
+/* Handles the requests that have been completed. */
+static void wh_requests_collect(wh_callback_t *cb) /* {{{ */
+{
+  CURLMsg *msg;
+  int msgs_left;
+
+  while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    CURL *curl = msg->easy_handle;
+    CURLcode status = msg->data.result;
+    wh_request_t *req = NULL;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&req);
+
+    wh_request_done(cb, curl, status, req->curl_errbuf, &req->response);
+    curl_multi_remove_handle(cb->multi, curl);
+
+    pthread_mutex_lock(&cb->send_lock);
+    req->state = WH_REQUEST_FREE;
+    req->size = 0;
+    pthread_mutex_unlock(&cb->send_lock);
+  }
+} /* }}} wh_requests_collect */
+
+/* Performs the requests of a node in asynchronous mode, so that write threads
+ * only fill the send buffer and never wait for the server. */
+static void *wh_io_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+
+  while (42) {
+    int active = 0;
+
+    pthread_mutex_lock(&cb->send_lock);
+    for (int i = 0; i < cb->requests_num; i++) {
+      wh_request_t *req = cb->requests + i;
+
+      if ((req->state == WH_REQUEST_QUEUED) &&
+          (wh_request_start_nolock(cb, req) != 0)) {
+        /* Drop the data rather than retrying forever. */
+        req->state = WH_REQUEST_FREE;
+        req->size = 0;
+      }
+      if (req->state == WH_REQUEST_ACTIVE)
+        active++;
+    }
+    bool shutdown = cb->io_shutdown;
+    cdtime_t deadline = cb->io_deadline;
+    pthread_mutex_unlock(&cb->send_lock);
+
+    if (shutdown && (active == 0))
+      break;
+    if (shutdown && (cdtime() >= deadline)) {
+      WARNING("write_http plugin: Aborting %i requests to \"%s\" on shutdown.",
+              active, cb->location);
+      break;
+    }
+
+    int running = 0;
+    curl_multi_perform(cb->multi, &running);
+    wh_requests_collect(cb);
+
+#if WRITE_HTTP_HAVE_MULTI_WAKEUP
+    curl_multi_poll(cb->multi, NULL, 0, WRITE_HTTP_POLL_INTERVAL_MS, NULL);
+#else
+    curl_multi_wait(cb->multi, NULL, 0, WRITE_HTTP_POLL_INTERVAL_MS, NULL);
+#endif
+  }
+
+  return NULL;
+} /* }}} void *wh_io_thread */
+
+/* Hands `*buffer' over to the IO thread by swapping it with the buffer of a
+ * free request. If all requests are in flight, the data is dropped.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wh_submit_nolock(wh_callback_t *cb, char **buffer, /* {{{ */
+                            size_t *buffer_size, size_t len) {
+  wh_request_t *req = NULL;
+  for (int i = 0; i < cb->requests_num; i++) {
+    if (cb->requests[i].state == WH_REQUEST_FREE) {
+      req = cb->requests + i;
+      break;
+    }
+  }
+
+  if (req == NULL) {
+    cb->requests_dropped++;
+    c_complain(LOG_WARNING, &cb->requests_complaint,
+               "write_http plugin: All %i requests to \"%s\" are in flight. "
+               "Dropping %" PRIsz " bytes (%" PRIu64 " buffers so far).",
+               cb->requests_num, cb->location, len, cb->requests_dropped);
+    return -1;
+  }
+  c_release(LOG_INFO, &cb->requests_complaint,
+            "write_http plugin: Requests to \"%s\" are available again.",
+            cb->location);
+
+  char *tmp = req->buffer;
+  size_t tmp_size = req->buffer_size;
+  req->buffer = *buffer;
+  req->buffer_size = *buffer_size;
+  req->size = len;
+  req->state = WH_REQUEST_QUEUED;
+  *buffer = tmp;
+  *buffer_size = tmp_size;
+
+#if WRITE_HTTP_HAVE_MULTI_WAKEUP
+  curl_multi_wakeup(cb->multi);
+#endif
+  return 0;
+} /* }}} int wh_submit_nolock */
+
+/* Sends the content of the send buffer and resets it.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wh_send_buffer_nolock(wh_callback_t *cb) /* {{{ */
+{
+  int status;
+
+  if (cb->async)
+    status = wh_submit_nolock(cb, &cb->send_buffer, &cb->send_buffer_size,
+                              cb->send_buffer_fill);
+  else
+    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
+  wh_reset_buffer(cb);
+
+  return status;
+} /* }}} int wh_send_buffer_nolock */
+
+/* Discards the compressed body, e.g. after a compression error. */
+static void wh_reset_body(wh_callback_t *cb) /* {{{ */
+{
+  compress_stream_reset(cb->compressor);
+  cb->body.len = 0;
+  cb->body_started = false;
+} /* }}} wh_reset_body */
+
+/* Finishes the compressed body, sends it and starts the next one.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wh_send_body_nolock(wh_callback_t *cb) /* {{{ */
+{
+  int status;
+
+  if (!cb->body_started)
+    return 0;
+
+  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
+    status = compress_stream_append(cb->compressor, "]", 1, &cb->body);
+  else
+    status = 0;
+  if (status == 0)
+    status = compress_stream_finish(cb->compressor, &cb->body);
+  if (status != 0) {
+    ERROR("write_http plugin: Compressing the request body failed: %s",
+          STRERROR(status));
+    wh_reset_body(cb);
+    return status;
+  }
+
+  if (cb->async)
+    status = wh_submit_nolock(cb, &cb->body.data, &cb->body.size, cb->body.len);
+  else
+    status = wh_post_nolock(cb, cb->body.data, (long)cb->body.len);
+  cb->body.len = 0;
+  cb->body_started = false;
+
+  return status;
+} /* }}} int wh_send_body_nolock */
+
+/* Compresses the content of the send buffer into the body and resets the send
+ * buffer. The body is sent if it is full or old enough, or if `force' is set.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wh_compress_buffer_nolock(wh_callback_t *cb, /* {{{ */
+                                     bool force) {
+  char const *data = cb->send_buffer;
+  size_t len = cb->send_buffer_fill;
+
+  if (len > 0) {
+    if (!cb->body_started) {
+      cb->body_init_time = cb->send_buffer_init_time;
+      /* JSON value lists are prefixed with a comma, which opens the array
+       * instead in the first chunk. */
+      if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
+        data++;
+        len--;
+        int status = compress_stream_append(cb->compressor, "[", 1, &cb->body);
+        if (status != 0) {
+          ERROR("write_http plugin: Compressing the request body failed: %s",
+                STRERROR(status));
+          wh_reset_body(cb);
+          wh_reset_buffer(cb);
+          return status;
+        }
+      }
+      cb->body_started = true;
+    }
+
+    int status = compress_stream_append(cb->compressor, data, len, &cb->body);
+    wh_reset_buffer(cb);
+    if (status != 0) {
+      ERROR("write_http plugin: Compressing the request body failed: %s",
+            STRERROR(status));
+      wh_reset_body(cb);
+      return status;
+    }
+  }
+
+  if (!force && (cb->body.len < cb->body_max_size) &&
+      ((cb->body_init_time + cb->body_max_age) > cdtime()))
+    return 0;
+
+  return wh_send_body_nolock(cb);
+} /* }}} int wh_compress_buffer_nolock */
+
+static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->curl != NULL)
+    return 0;
+
+  cb->curl = curl_easy_init();
+  if (cb->curl == NULL) {
+    ERROR("curl plugin: curl_easy_init failed.");
+    return -1;
+  }
+
+  cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
+  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
+    cb->headers =
+        curl_slist_append(cb->headers, "Content-Type: application/json");
+  else
+    cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
+  if (cb->compressor != NULL) {
+    char header[64];
+    snprintf(header, sizeof(header), "Content-Encoding: %s",
+             compress_method_encoding(cb->compression));
+    cb->headers = curl_slist_append(cb->headers, header);
+  }
+  cb->headers = curl_slist_append(cb->headers, "Expect:");
+
+  if (wh_curl_setup(cb, cb->curl, cb->curl_errbuf) != 0)
+    return -1;
+
+  if (cb->async) {
+    cb->multi = curl_multi_init();
+    if (cb->multi == NULL) {
+      ERROR("write_http plugin: curl_multi_init failed.");
+      return -1;
+    }
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(cb->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+    int status =
+        plugin_thread_create(&cb->io_thread, wh_io_thread, cb, "write_http");
+    if (status != 0) {
+      ERROR("write_http plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      curl_multi_cleanup(cb->multi);
+      cb->multi = NULL;
+      return -1;
+    }
+    cb->io_thread_running = true;
+  }
+
   wh_reset_buffer(cb);
 
   return 0;
 } /* }}} int wh_callback_init */
 
-static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
-{
+/* Sends the send buffer if it is older than `timeout' (zero meaning
+ * unconditionally). With compression, the buffer is only added to the body,
+ * which is sent once it is full or old enough, or if `force' is set. */
+static int wh_flush_buffer_nolock(cdtime_t timeout, /* {{{ */
+                                  wh_callback_t *cb, bool force) {
   int status;
 
   DEBUG("write_http plugin: wh_flush_nolock: timeout = %.3f; "
@@ -303,26 +689,32 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
   /* timeout == 0  => flush unconditionally */
   if (timeout > 0) {
     cdtime_t now;
+    cdtime_t init_time =
+        cb->body_started ? cb->body_init_time : cb->send_buffer_init_time;
 
     now = cdtime();
-    if ((cb->send_buffer_init_time + timeout) > now)
+    if ((init_time + timeout) > now)
       return 0;
   }
 
   if (cb->format == WH_FORMAT_COMMAND) {
-    if (cb->send_buffer_fill == 0) {
-      cb->send_buffer_init_time = cdtime();
+    if ((cb->send_buffer_fill == 0) && !cb->body_started) {
+      cb->send_buffer_init_time = cdtime_coarse();
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    if (cb->compressor != NULL)
+      return wh_compress_buffer_nolock(cb, force);
+    status = wh_send_buffer_nolock(cb);
   } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
-    if (cb->send_buffer_fill <= 2) {
-      cb->send_buffer_init_time = cdtime();
+    if ((cb->send_buffer_fill <= 2) && !cb->body_started) {
+      cb->send_buffer_init_time = cdtime_coarse();
       return 0;
     }
 
+    if (cb->compressor != NULL)
+      return wh_compress_buffer_nolock(cb, force);
+
     status = format_json_finalize(cb->send_buffer, &cb->send_buffer_fill,
                                   &cb->send_buffer_free);
     if (status != 0) {
@@ -332,16 +724,16 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return status;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    status = wh_send_buffer_nolock(cb);
   } else if (cb->format == WH_FORMAT_INFLUXDB) {
-    if (cb->send_buffer_fill == 0) {
-      cb->send_buffer_init_time = cdtime();
+    if ((cb->send_buffer_fill == 0) && !cb->body_started) {
+      cb->send_buffer_init_time = cdtime_coarse();
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    if (cb->compressor != NULL)
+      return wh_compress_buffer_nolock(cb, force);
+    status = wh_send_buffer_nolock(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -350,6 +742,11 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
   }
 
   return status;
+} /* }}} wh_flush_buffer_nolock */
+
+static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
+{
+  return wh_flush_buffer_nolock(timeout, cb, /* force = */ true);
 } /* }}} wh_flush_nolock */
 
 static int wh_flush(cdtime_t timeout, /* {{{ */
@@ -386,9 +783,44 @@ static void wh_callback_free(void *data) /* {{{ */
 
   cb = data;
 
+  pthread_mutex_lock(&cb->send_lock);
   if (cb->send_buffer != NULL)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
+  if (cb->io_thread_running) {
+    cb->io_shutdown = true;
+    cb->io_deadline = cdtime() + WRITE_HTTP_SHUTDOWN_TIMEOUT;
+#if WRITE_HTTP_HAVE_MULTI_WAKEUP
+    curl_multi_wakeup(cb->multi);
+#endif
+    pthread_mutex_unlock(&cb->send_lock);
+    pthread_join(cb->io_thread, NULL);
+    cb->io_thread_running = false;
+  } else {
+    pthread_mutex_unlock(&cb->send_lock);
+  }
+
+  for (int i = 0; (cb->requests != NULL) && (i < cb->requests_num); i++) {
+    wh_request_t *req = cb->requests + i;
+
+    if (req->curl != NULL) {
+      if (req->state == WH_REQUEST_ACTIVE)
+        curl_multi_remove_handle(cb->multi, req->curl);
+      curl_easy_cleanup(req->curl);
+    }
+    sfree(req->buffer);
+  }
+  sfree(cb->requests);
+
+  compress_stream_destroy(cb->compressor);
+  cb->compressor = NULL;
+  sfree(cb->body.data);
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+  }
+
   if (cb->curl != NULL) {
     curl_easy_cleanup(cb->curl);
     cb->curl = NULL;
@@ -414,6 +846,7 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb->clientkeypass);
   sfree(cb->send_buffer);
   sfree(cb->metrics_prefix);
+  format_influxdb_cache_destroy(cb->influxdb_cache);
 
   sfree(cb);
 } /* }}} void wh_callback_free */
@@ -473,7 +906,8 @@ static int wh_write_command(const data_set_t *ds,
   }
 
   if (command_len >= cb->send_buffer_free) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
+    status =
+        wh_flush_buffer_nolock(/* timeout = */ 0, cb, /* force = */ false);
     if (status != 0) {
       pthread_mutex_unlock(&cb->send_lock);
       return status;
@@ -516,7 +950,8 @@ static int wh_write_json(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
                              &cb->send_buffer_free, ds, vl, cb->store_rates);
   if (status == -ENOMEM) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
+    status =
+        wh_flush_buffer_nolock(/* timeout = */ 0, cb, /* force = */ false);
     if (status != 0) {
       wh_reset_buffer(cb);
       pthread_mutex_unlock(&cb->send_lock);
@@ -564,7 +999,8 @@ static int wh_write_kairosdb(const data_set_t *ds,
       cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
       cb->data_ttl, cb->metrics_prefix);
   if (status == -ENOMEM) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
+    status =
+        wh_flush_buffer_nolock(/* timeout = */ 0, cb, /* force = */ false);
     if (status != 0) {
       wh_reset_buffer(cb);
       pthread_mutex_unlock(&cb->send_lock);
@@ -592,10 +1028,20 @@ static int wh_write_kairosdb(const data_set_t *ds,
   return 0;
 } /* }}} int wh_write_kairosdb */
 
-static int wh_write_influxdb(const data_set_t *ds,
-                             const value_list_t *vl, /* {{{ */
-                             wh_callback_t *cb) {
-  int status;
+static int wh_write_influxdb(const write_batch_entry_t *entries, /* {{{ */
+                             size_t entries_num, user_data_t *user_data) {
+  if (user_data == NULL)
+    return -EINVAL;
+
+  wh_callback_t *cb = user_data->data;
+  assert(cb->send_metrics);
+
+  format_influxdb_options_t opts = {
+      .store_rates = cb->store_rates,
+      .time_precision = NS,
+      .merge_type_instances = cb->influxdb_merge_type_instances,
+      .cache = cb->influxdb_cache,
+  };
 
   pthread_mutex_lock(&cb->send_lock);
   if (wh_callback_init(cb) != 0) {
@@ -604,30 +1050,43 @@ static int wh_write_influxdb(const data_set_t *ds,
     return -1;
   }
 
-  status = format_influxdb_value_list(cb->send_buffer + cb->send_buffer_fill,
-                                      cb->send_buffer_free, ds, vl,
-                                      cb->store_rates, NS);
-  if (status == -ENOMEM) {
-    status = wh_flush_nolock(/* timeout = */ 0, cb);
+  while (entries_num > 0) {
+    size_t done = 0;
+    int status = format_influxdb_value_lists(
+        cb->send_buffer + cb->send_buffer_fill, cb->send_buffer_free, entries,
+        entries_num, &opts, &done);
+    if ((status == -ENOMEM) && (cb->send_buffer_fill == 0)) {
+      ERROR("write_http plugin: A line for \"%s\" does not fit into the "
+            "send buffer. Consider increasing \"BufferSize\".",
+            entries->vl->plugin);
+      /* Skip the line so the remainder of the batch can be written. */
+      entries++;
+      entries_num--;
+      continue;
+    } else if ((status < 0) && (status != -ENOMEM)) {
+      pthread_mutex_unlock(&cb->send_lock);
+      return status;
+    }
+
+    if (status > 0) {
+      cb->send_buffer_fill += (size_t)status;
+      cb->send_buffer_free -= (size_t)status;
+    }
+    entries += done;
+    entries_num -= done;
+    if (entries_num == 0)
+      break;
+
+    /* The buffer is full. */
+    status =
+        wh_flush_buffer_nolock(/* timeout = */ 0, cb, /* force = */ false);
     if (status != 0) {
       wh_reset_buffer(cb);
       pthread_mutex_unlock(&cb->send_lock);
       return status;
     }
-
-    status = format_influxdb_value_list(cb->send_buffer + cb->send_buffer_fill,
-                                        cb->send_buffer_free, ds, vl,
-                                        cb->store_rates, NS);
-  }
-  if (status < 0) {
-    pthread_mutex_unlock(&cb->send_lock);
-    return status;
   }
 
-  cb->send_buffer_fill += status;
-  cb->send_buffer_free -= status;
-
-  /* Check if we have enough space for this command. */
   pthread_mutex_unlock(&cb->send_lock);
 
   return 0;
@@ -651,9 +1110,6 @@ static int wh_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   case WH_FORMAT_KAIROSDB:
     status = wh_write_kairosdb(ds, vl, cb);
     break;
-  case WH_FORMAT_INFLUXDB:
-    status = wh_write_influxdb(ds, vl, cb);
-    break;
   default:
     status = wh_write_command(ds, vl, cb);
     break;
@@ -686,9 +1142,33 @@ static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
     return -1;
   }
 
-  status = wh_post_nolock(cb, alert, -1);
+  if (cb->compressor == NULL) {
+    status = wh_post_nolock(cb, alert, -1);
+    pthread_mutex_unlock(&cb->send_lock);
+    return status;
+  }
+
+  /* The node's compressor may be in the middle of a body, so notifications,
+   * which are rare, use a stream of their own. */
+  compress_buffer_t body = {0};
+  compress_stream_t *s =
+      compress_stream_create(cb->compression, cb->compression_level);
+  if (s == NULL)
+    status = ENOMEM;
+  else
+    status = compress_stream_append(s, alert, strlen(alert), &body);
+  if (status == 0)
+    status = compress_stream_finish(s, &body);
+
+  if (status == 0)
+    status = wh_post_nolock(cb, body.data, (long)body.len);
+  else
+    ERROR("write_http plugin: Compressing the notification failed: %s",
+          STRERROR(status));
   pthread_mutex_unlock(&cb->send_lock);
 
+  compress_stream_destroy(s);
+  sfree(body.data);
   return status;
 } /* }}} int wh_notify */
 
@@ -720,6 +1200,30 @@ static int config_set_format(wh_callback_t *cb, /* {{{ */
   return 0;
 } /* }}} int config_set_format */
 
+static int config_set_compression(wh_callback_t *cb, /* {{{ */
+                                  oconfig_item_t *ci) {
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    WARNING("write_http plugin: The `%s' config option "
+            "needs exactly one string argument.",
+            ci->key);
+    return -1;
+  }
+
+  char const *string = ci->values[0].value.string;
+  int status = compress_method_parse(string, &cb->compression);
+  if (status == ENOTSUP) {
+    ERROR("write_http plugin: Compression \"%s\" is not supported by this "
+          "build.",
+          string);
+    return -1;
+  } else if (status != 0) {
+    ERROR("write_http plugin: Invalid compression: %s", string);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int config_set_compression */
+
 static int wh_config_append_string(const char *name,
                                    struct curl_slist **dest, /* {{{ */
                                    oconfig_item_t *ci) {
@@ -742,6 +1246,7 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
 {
   wh_callback_t *cb;
   int buffer_size = 0;
+  int max_body_size = 0;
   char callback_name[DATA_MAX_NAME_LEN];
   int status = 0;
 
@@ -764,6 +1269,8 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   cb->metrics_prefix = strdup(WRITE_HTTP_DEFAULT_PREFIX);
   cb->curl_stats = NULL;
   cb->unix_socket_path = NULL;
+  cb->requests_num = WRITE_HTTP_DEFAULT_MAX_REQUESTS;
+  C_COMPLAIN_INIT(&cb->requests_complaint);
 
   if (cb->metrics_prefix == NULL) {
     ERROR("write_http plugin: strdup failed.");
@@ -848,6 +1355,31 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &cb->store_rates);
     else if (strcasecmp("BufferSize", child->key) == 0)
       status = cf_util_get_int(child, &buffer_size);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->async);
+    else if (strcasecmp("MaxRequests", child->key) == 0) {
+      status = cf_util_get_int(child, &cb->requests_num);
+      if ((status == 0) && (cb->requests_num < 1)) {
+        ERROR("write_http plugin: \"MaxRequests\" must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("Compression", child->key) == 0)
+      status = config_set_compression(cb, child);
+    else if (strcasecmp("CompressionLevel", child->key) == 0)
+      status = cf_util_get_int(child, &cb->compression_level);
+    else if (strcasecmp("MaxBodySize", child->key) == 0) {
+      status = cf_util_get_int(child, &max_body_size);
+      if ((status == 0) && (max_body_size < 1024)) {
+        ERROR("write_http plugin: \"MaxBodySize\" must be at least 1024.");
+        status = -1;
+      }
+    } else if (strcasecmp("MaxBodyAge", child->key) == 0)
+      status = cf_util_get_cdtime(child, &cb->body_max_age);
+    else if (strcasecmp("MergeTypeInstances", child->key) == 0)
+      status =
+          cf_util_get_boolean(child, &cb->influxdb_merge_type_instances);
+    else if (strcasecmp("CacheSize", child->key) == 0)
+      status = cf_util_get_int(child, &cb->influxdb_cache_size);
     else if (strcasecmp("LowSpeedLimit", child->key) == 0)
       status = cf_util_get_int(child, &cb->low_speed_limit);
     else if (strcasecmp("Timeout", child->key) == 0)
@@ -937,6 +1469,30 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     ERROR("write_http plugin: Ignoring invalid BufferSize setting (%d).",
           buffer_size);
 
+  if ((cb->format == WH_FORMAT_INFLUXDB) && (cb->influxdb_cache_size > 0)) {
+    cb->influxdb_cache =
+        format_influxdb_cache_create((size_t)cb->influxdb_cache_size);
+    if (cb->influxdb_cache == NULL) {
+      ERROR("write_http plugin: format_influxdb_cache_create failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  }
+
+  if (cb->compression != COMPRESS_NONE) {
+    cb->compressor =
+        compress_stream_create(cb->compression, cb->compression_level);
+    if (cb->compressor == NULL) {
+      ERROR("write_http plugin: compress_stream_create failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+    cb->body_max_size = (max_body_size > 0) ? (size_t)max_body_size
+                                            : WRITE_HTTP_DEFAULT_MAX_BODY_SIZE;
+    if (cb->body_max_age == 0)
+      cb->body_max_age = plugin_get_interval();
+  }
+
   /* Allocate the buffer. */
   cb->send_buffer = malloc(cb->send_buffer_size);
   if (cb->send_buffer == NULL) {
@@ -946,6 +1502,25 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (cb->async) {
+    cb->requests = calloc((size_t)cb->requests_num, sizeof(*cb->requests));
+    if (cb->requests == NULL) {
+      ERROR("write_http plugin: calloc failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+    for (int i = 0; i < cb->requests_num; i++) {
+      cb->requests[i].buffer = malloc(cb->send_buffer_size);
+      cb->requests[i].buffer_size = cb->send_buffer_size;
+      if (cb->requests[i].buffer == NULL) {
+        ERROR("write_http plugin: malloc(%" PRIsz ") failed.",
+              cb->send_buffer_size);
+        wh_callback_free(cb);
+        return -1;
+      }
+    }
+  }
+
   /* Nulls the buffer and sets ..._free and ..._fill. */
   wh_reset_buffer(cb);
 
@@ -959,7 +1534,11 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   };
 
   if (cb->send_metrics) {
-    plugin_register_write(callback_name, wh_write, &user_data);
+    if (cb->format == WH_FORMAT_INFLUXDB)
+      plugin_register_write_batch(callback_name, wh_write_influxdb,
+                                  &user_data);
+    else
+      plugin_register_write(callback_name, wh_write, &user_data);
     user_data.free_func = NULL;
 
     plugin_register_flush(callback_name, wh_flush, &user_data);
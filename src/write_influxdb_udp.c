@@ -80,6 +80,9 @@ static int wifxudp_config_ttl;
 static size_t wifxudp_config_packet_size = NET_DEFAULT_PACKET_SIZE;
 static bool wifxudp_config_store_rates;
 static format_influxdb_time_precision_t wifxudp_config_time_precision = MS;
+static bool wifxudp_config_merge_type_instances;
+static int wifxudp_config_cache_size;
+static format_influxdb_cache_t *wifxudp_cache;
 
 static sockent_t *sending_sockets;
 
@@ -350,35 +353,50 @@ static void flush_buffer(void) {
 }
 
 static int
-write_influxdb_udp_write(const data_set_t *ds, const value_list_t *vl,
+write_influxdb_udp_write(const write_batch_entry_t *entries, size_t entries_num,
                          user_data_t __attribute__((unused)) * user_data) {
-  char buffer[NET_DEFAULT_PACKET_SIZE];
-
-  int status = format_influxdb_value_list(buffer, NET_DEFAULT_PACKET_SIZE, ds,
-                                          vl, wifxudp_config_store_rates,
-                                          wifxudp_config_time_precision);
-
-  if (status < 0) {
-    ERROR("write_influxdb_udp plugin: write_influxdb_udp_write failed.");
-    return -1;
-  }
-  if (status == 0) /* no real values to send (nan) */
-    return 0;
+  format_influxdb_options_t opts = {
+      .store_rates = wifxudp_config_store_rates,
+      .time_precision = wifxudp_config_time_precision,
+      .merge_type_instances = wifxudp_config_merge_type_instances,
+      .cache = wifxudp_cache,
+  };
 
   pthread_mutex_lock(&send_buffer_lock);
-  if (wifxudp_config_packet_size - send_buffer_fill < status)
-    flush_buffer();
-  memcpy(send_buffer_ptr, buffer, status);
-
-  send_buffer_fill += status;
-  send_buffer_ptr += status;
-  send_buffer_last_update = cdtime();
+  while (entries_num > 0) {
+    size_t done = 0;
+    int status = format_influxdb_value_lists(
+        send_buffer_ptr, wifxudp_config_packet_size - send_buffer_fill,
+        entries, entries_num, &opts, &done);
+    if ((status == -ENOMEM) && (send_buffer_fill == 0)) {
+      ERROR("write_influxdb_udp plugin: A line for \"%s\" does not fit into "
+            "a packet of %" PRIsz " bytes.",
+            entries->vl->plugin, wifxudp_config_packet_size);
+      entries++;
+      entries_num--;
+      continue;
+    } else if ((status < 0) && (status != -ENOMEM)) {
+      ERROR("write_influxdb_udp plugin: write_influxdb_udp_write failed.");
+      pthread_mutex_unlock(&send_buffer_lock);
+      return -1;
+    }
 
-  if (wifxudp_config_packet_size - send_buffer_fill < 120)
-    /* No room for a new point of average size in buffer,
-       the probability of fail for the new point is bigger than
-       the probability of success */
-    flush_buffer();
+    if (status > 0) {
+      send_buffer_fill += status;
+      send_buffer_ptr += status;
+      send_buffer_last_update = cdtime();
+    }
+    entries += done;
+    entries_num -= done;
+
+    /* Either the packet is full or there is no room for a new point of
+       average size in buffer, the probability of fail for the new point is
+       bigger than the probability of success */
+    if ((send_buffer_fill > 0) &&
+        ((entries_num > 0) ||
+         (wifxudp_config_packet_size - send_buffer_fill < 120)))
+      flush_buffer();
+  }
 
   pthread_mutex_unlock(&send_buffer_lock);
   return 0;
@@ -509,6 +527,10 @@ static int write_influxdb_udp_config(oconfig_item_t *ci) {
       wifxudp_config_set_time_precision(child);
     else if (strcasecmp("StoreRates", child->key) == 0)
       cf_util_get_boolean(child, &wifxudp_config_store_rates);
+    else if (strcasecmp("MergeTypeInstances", child->key) == 0)
+      cf_util_get_boolean(child, &wifxudp_config_merge_type_instances);
+    else if (strcasecmp("CacheSize", child->key) == 0)
+      cf_util_get_int(child, &wifxudp_config_cache_size);
     else {
       WARNING("write_influxdb_udp plugin: "
               "Option `%s' is not allowed here.",
@@ -524,6 +546,8 @@ static int write_influxdb_udp_shutdown(void) {
     flush_buffer();
 
   sfree(send_buffer);
+  format_influxdb_cache_destroy(wifxudp_cache);
+  wifxudp_cache = NULL;
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -555,10 +579,19 @@ static int write_influxdb_udp_init(void) {
   }
   write_influxdb_udp_init_buffer();
 
+  if (wifxudp_config_cache_size > 0) {
+    wifxudp_cache =
+        format_influxdb_cache_create((size_t)wifxudp_config_cache_size);
+    if (wifxudp_cache == NULL) {
+      ERROR("write_influxdb_udp plugin: format_influxdb_cache_create failed.");
+      return -1;
+    }
+  }
+
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
-    plugin_register_write("write_influxdb_udp", write_influxdb_udp_write,
-                          /* user_data = */ NULL);
+    plugin_register_write_batch("write_influxdb_udp", write_influxdb_udp_write,
+                                /* user_data = */ NULL);
   }
 
   return 0;
@@ -33,6 +33,7 @@
 #include "utils/format_json/format_json.h"
 #include "utils_random.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <librdkafka/rdkafka.h>
 #include <stdint.h>
@@ -54,6 +55,22 @@ struct kafka_topic_context {
   char escape_char;
   char *topic_name;
   pthread_mutex_t lock;
+
+  /* Value lists are packed into one message of up to "batch_size" bytes,
+   * which is produced once full or "batch_timeout" after the first value list
+   * was added. A "batch_size" of zero disables batching. */
+  size_t batch_size;
+  cdtime_t batch_timeout;
+  char *batch;
+  size_t batch_fill;
+  size_t batch_free;
+  cdtime_t batch_start;
+
+  /* Delivery latency accumulated by kafka_delivery() between two statistics
+   * callbacks. */
+  cdtime_t stats_interval;
+  double latency_sum;
+  uint64_t latency_num;
 };
 
 static int kafka_handle(struct kafka_topic_context *);
@@ -170,11 +187,133 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 
 } /* }}} int kafka_handle */
 
+static int kafka_produce(struct kafka_topic_context *ctx, /* {{{ */
+                         void *payload, size_t len, int msgflags) {
+  char const *key =
+      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+
+  if (rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, msgflags, payload,
+                       len, key, strlen(key), NULL) != 0) {
+    ERROR("write_kafka plugin: cannot produce message to topic \"%s\": %s",
+          ctx->topic_name, rd_kafka_err2str(kafka_error()));
+    return -1;
+  }
+
+  return 0;
+} /* }}} int kafka_produce */
+
+/* Hands the pending batch over to librdkafka, which takes ownership of the
+ * buffer. The next value list allocates a fresh one. */
+static int kafka_batch_send_nolock(struct kafka_topic_context *ctx) /* {{{ */
+{
+  int status = 0;
+
+  if ((ctx->batch == NULL) || (ctx->batch_fill == 0))
+    return 0;
+
+  if (ctx->format == KAFKA_FORMAT_JSON)
+    status = format_json_finalize(ctx->batch, &ctx->batch_fill,
+                                  &ctx->batch_free);
+
+  char *payload = ctx->batch;
+  size_t len = ctx->batch_fill;
+
+  ctx->batch = NULL;
+  ctx->batch_fill = 0;
+  ctx->batch_free = 0;
+
+  if (status == 0)
+    status = kafka_produce(ctx, payload, len, RD_KAFKA_MSG_F_FREE);
+  else
+    ERROR("write_kafka plugin: format_json_finalize failed with status %i.",
+          status);
+
+  if (status != 0)
+    sfree(payload);
+  return status;
+} /* }}} int kafka_batch_send_nolock */
+
+static int kafka_batch_start_nolock(struct kafka_topic_context *ctx) /* {{{ */
+{
+  if (ctx->batch != NULL)
+    return 0;
+
+  ctx->batch = malloc(ctx->batch_size);
+  if (ctx->batch == NULL) {
+    ERROR("write_kafka plugin: malloc failed.");
+    return ENOMEM;
+  }
+  ctx->batch[0] = 0;
+  ctx->batch_fill = 0;
+  ctx->batch_free = ctx->batch_size;
+  ctx->batch_start = cdtime();
+
+  if (ctx->format == KAFKA_FORMAT_JSON)
+    format_json_initialize(ctx->batch, &ctx->batch_fill, &ctx->batch_free);
+
+  return 0;
+} /* }}} int kafka_batch_start_nolock */
+
+/* JSON value lists are formatted straight into the batch buffer; the other
+ * formats arrive pre-formatted in "line" and are separated by newlines. */
+static int kafka_batch_add(struct kafka_topic_context *ctx, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl,
+                           char const *line, size_t line_len) {
+  int status;
+
+  pthread_mutex_lock(&ctx->lock);
+
+  if (ctx->format == KAFKA_FORMAT_JSON) {
+    status = kafka_batch_start_nolock(ctx);
+    if (status == 0) {
+      status = format_json_value_list(ctx->batch, &ctx->batch_fill,
+                                      &ctx->batch_free, ds, vl,
+                                      ctx->store_rates);
+      if ((status == -ENOMEM) && (ctx->batch_fill > 0)) {
+        kafka_batch_send_nolock(ctx);
+        status = kafka_batch_start_nolock(ctx);
+        if (status == 0)
+          status = format_json_value_list(ctx->batch, &ctx->batch_fill,
+                                          &ctx->batch_free, ds, vl,
+                                          ctx->store_rates);
+      }
+      if (status == -ENOMEM)
+        ERROR("write_kafka plugin: A single value list does not fit into "
+              "BatchSize (%" PRIsz " bytes).",
+              ctx->batch_size);
+    }
+  } else {
+    size_t need = line_len;
+    if (ctx->format == KAFKA_FORMAT_COMMAND)
+      need++; /* newline */
+
+    if ((ctx->batch != NULL) && (need >= ctx->batch_free))
+      kafka_batch_send_nolock(ctx);
+
+    if (need >= ctx->batch_size) {
+      /* Too large to share a message; send it on its own. */
+      status = kafka_produce(ctx, (void *)line, line_len, RD_KAFKA_MSG_F_COPY);
+    } else if ((status = kafka_batch_start_nolock(ctx)) == 0) {
+      memcpy(ctx->batch + ctx->batch_fill, line, line_len);
+      if (ctx->format == KAFKA_FORMAT_COMMAND)
+        ctx->batch[ctx->batch_fill + line_len] = '\n';
+      ctx->batch_fill += need;
+      ctx->batch_free -= need;
+      ctx->batch[ctx->batch_fill] = 0;
+    }
+  }
+
+  if ((ctx->batch != NULL) && (ctx->batch_timeout > 0) &&
+      ((cdtime() - ctx->batch_start) >= ctx->batch_timeout))
+    kafka_batch_send_nolock(ctx);
+
+  pthread_mutex_unlock(&ctx->lock);
+  return status;
+} /* }}} int kafka_batch_add */
+
 static int kafka_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
-  void *key;
-  size_t keylen = 0;
   char buffer[8192];
   size_t bfree = sizeof(buffer);
   size_t bfill = 0;
@@ -190,7 +329,11 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
   if (status != 0)
     return status;
 
-  bzero(buffer, sizeof(buffer));
+  /* Serve delivery reports and statistics callbacks. */
+  rd_kafka_poll(ctx->kafka, 0);
+
+  if ((ctx->batch_size > 0) && (ctx->format == KAFKA_FORMAT_JSON))
+    return kafka_batch_add(ctx, ds, vl, NULL, 0);
 
   switch (ctx->format) {
   case KAFKA_FORMAT_COMMAND:
@@ -224,15 +367,156 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
-  keylen = strlen(key);
+  if (ctx->batch_size > 0)
+    return kafka_batch_add(ctx, ds, vl, buffer, blen);
+
+  return kafka_produce(ctx, buffer, blen, RD_KAFKA_MSG_F_COPY);
+} /* }}} int kafka_write */
 
-  rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
-                   buffer, blen, key, keylen, NULL);
+static int kafka_flush(cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+  int status = 0;
+
+  if (ctx == NULL)
+    return EINVAL;
+
+  pthread_mutex_lock(&ctx->lock);
+  if ((ctx->batch != NULL) &&
+      ((timeout == 0) || ((cdtime() - ctx->batch_start) >= timeout)))
+    status = kafka_batch_send_nolock(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+
+  if (ctx->kafka != NULL)
+    rd_kafka_poll(ctx->kafka, 0);
 
   return status;
-} /* }}} int kafka_write */
+} /* }}} int kafka_flush */
+
+/* Looks up an integer member of the top-level object of a librdkafka
+ * statistics document. Nested objects are skipped, so broker and topic
+ * counters of the same name do not shadow the client-wide ones. */
+static int kafka_stats_get(char const *json, size_t json_len, /* {{{ */
+                           char const *name, int64_t *ret_value) {
+  size_t name_len = strlen(name);
+  int depth = 0;
+
+  for (size_t i = 0; i < json_len; i++) {
+    if ((json[i] == '{') || (json[i] == '[')) {
+      depth++;
+      continue;
+    } else if ((json[i] == '}') || (json[i] == ']')) {
+      depth--;
+      continue;
+    } else if (json[i] != '"') {
+      continue;
+    }
+
+    size_t begin = i + 1;
+    size_t end = begin;
+    while ((end < json_len) && (json[end] != '"'))
+      end += (json[end] == '\\') ? 2 : 1;
+    if (end >= json_len)
+      return EINVAL;
+    i = end;
+
+    if ((depth != 1) || ((end - begin) != name_len) ||
+        (memcmp(json + begin, name, name_len) != 0))
+      continue;
+
+    size_t pos = end + 1;
+    while ((pos < json_len) && isspace((unsigned char)json[pos]))
+      pos++;
+    if ((pos >= json_len) || (json[pos] != ':'))
+      continue;
+    pos++;
+    while ((pos < json_len) && isspace((unsigned char)json[pos]))
+      pos++;
+
+    bool negative = false;
+    if ((pos < json_len) && (json[pos] == '-')) {
+      negative = true;
+      pos++;
+    }
+    if ((pos >= json_len) || !isdigit((unsigned char)json[pos]))
+      return EINVAL;
+
+    int64_t value = 0;
+    while ((pos < json_len) && isdigit((unsigned char)json[pos])) {
+      value = 10 * value + (json[pos] - '0');
+      pos++;
+    }
+    *ret_value = negative ? -value : value;
+    return 0;
+  }
+
+  return ENOENT;
+} /* }}} int kafka_stats_get */
+
+static void kafka_stats_submit(struct kafka_topic_context *ctx, /* {{{ */
+                               char const *type, char const *type_instance,
+                               gauge_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = value};
+  vl.values_len = 1;
+  vl.interval = ctx->stats_interval;
+  sstrncpy(vl.plugin, "write_kafka", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, ctx->topic_name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void kafka_stats_submit */
+
+static int kafka_stats(__attribute__((unused)) rd_kafka_t *rk, /* {{{ */
+                       char *json, size_t json_len, void *opaque) {
+  struct kafka_topic_context *ctx = opaque;
+  int64_t value;
+
+  if (kafka_stats_get(json, json_len, "msg_cnt", &value) == 0)
+    kafka_stats_submit(ctx, "queue_length", NULL, (gauge_t)value);
+  if (kafka_stats_get(json, json_len, "msg_size", &value) == 0)
+    kafka_stats_submit(ctx, "bytes", "queue", (gauge_t)value);
+
+  pthread_mutex_lock(&ctx->lock);
+  double latency_sum = ctx->latency_sum;
+  uint64_t latency_num = ctx->latency_num;
+  ctx->latency_sum = 0;
+  ctx->latency_num = 0;
+  pthread_mutex_unlock(&ctx->lock);
+
+  if (latency_num > 0)
+    kafka_stats_submit(ctx, "latency", "delivery",
+                       latency_sum / (double)latency_num);
+
+  /* librdkafka frees the document. */
+  return 0;
+} /* }}} int kafka_stats */
+
+static void kafka_delivery(__attribute__((unused)) rd_kafka_t *rk, /* {{{ */
+                           const rd_kafka_message_t *msg, void *opaque) {
+  struct kafka_topic_context *ctx = opaque;
+
+  if (msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    ERROR("write_kafka plugin: delivery to topic \"%s\" failed: %s",
+          ctx->topic_name, rd_kafka_err2str(msg->err));
+    return;
+  }
+
+#if RD_KAFKA_VERSION >= 0x000b0000
+  int64_t latency_us = rd_kafka_message_latency(msg);
+  if (latency_us < 0)
+    return;
+
+  pthread_mutex_lock(&ctx->lock);
+  ctx->latency_sum += ((double)latency_us) / 1000000.0;
+  ctx->latency_num++;
+  pthread_mutex_unlock(&ctx->lock);
+#endif
+} /* }}} void kafka_delivery */
 
 static void kafka_topic_context_free(void *p) /* {{{ */
 {
@@ -241,6 +525,14 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx == NULL)
     return;
 
+  if (ctx->topic != NULL)
+    kafka_batch_send_nolock(ctx);
+  sfree(ctx->batch);
+#if RD_KAFKA_VERSION >= 0x00090200
+  if (ctx->kafka != NULL)
+    rd_kafka_flush(ctx->kafka, /* timeout_ms = */ 1000);
+#endif
+
   if (ctx->topic_name != NULL)
     sfree(ctx->topic_name);
   if (ctx->topic != NULL)
@@ -286,6 +578,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
 #ifdef HAVE_LIBRDKAFKA_LOG_CB
   rd_kafka_conf_set_log_cb(tctx->kafka_conf, kafka_log);
 #endif
+  rd_kafka_conf_set_opaque(tctx->kafka_conf, tctx);
+  rd_kafka_conf_set_dr_msg_cb(tctx->kafka_conf, kafka_delivery);
+  rd_kafka_conf_set_stats_cb(tctx->kafka_conf, kafka_stats);
 
   if ((tctx->conf = rd_kafka_topic_conf_new()) == NULL) {
     rd_kafka_conf_destroy(tctx->kafka_conf);
@@ -399,6 +694,34 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
                 "only one character. Others will be ignored.");
       tctx->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        WARNING("write_kafka plugin: BatchSize must not be negative.");
+        status = EINVAL;
+      } else if ((status == 0) && (tmp > 0) && (tmp < 1024)) {
+        WARNING("write_kafka plugin: BatchSize %i is too small, using 1024.",
+                tmp);
+        tmp = 1024;
+      }
+      tctx->batch_size = (size_t)tmp;
+    } else if (strcasecmp("BatchTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &tctx->batch_timeout);
+    } else if (strcasecmp("StatisticsInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &tctx->stats_interval);
+      if (status == 0) {
+        char interval_ms[32];
+        ssnprintf(interval_ms, sizeof(interval_ms), "%" PRIu64,
+                  CDTIME_T_TO_MS(tctx->stats_interval));
+        if (rd_kafka_conf_set(tctx->kafka_conf, "statistics.interval.ms",
+                              interval_ms, errbuf,
+                              sizeof(errbuf)) != RD_KAFKA_CONF_OK) {
+          WARNING("write_kafka plugin: cannot set statistics.interval.ms: %s",
+                  errbuf);
+          status = EINVAL;
+        }
+      }
     } else {
       WARNING("write_kafka plugin: Invalid directive: %s.", child->key);
     }
@@ -410,9 +733,14 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   rd_kafka_topic_conf_set_partitioner_cb(tctx->conf, kafka_partition);
   rd_kafka_topic_conf_set_opaque(tctx->conf, tctx);
 
+  if ((tctx->batch_size > 0) && (tctx->batch_timeout == 0))
+    tctx->batch_timeout = plugin_get_interval();
+
   ssnprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
             tctx->topic_name);
 
+  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+
   status = plugin_register_write(callback_name, kafka_write,
                                  &(user_data_t){
                                      .data = tctx,
@@ -425,7 +753,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
     goto errout;
   }
 
-  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+  if (tctx->batch_size > 0)
+    plugin_register_flush(callback_name, kafka_flush,
+                          &(user_data_t){.data = tctx});
 
   return;
 errout:
@@ -33,6 +33,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
@@ -53,33 +54,51 @@ struct wm_node_s {
   bool store_rates;
   bool connected;
 
+  /* Write concern used for inserts, built from "WriteConcern",
+   * "WriteConcernTimeout" and "Journal". */
+  mongoc_write_concern_t *write_concern;
+
+  /* With "batch_size" greater than one, documents are queued in one
+   * unordered bulk operation per collection (wm_batch_t, keyed by plugin
+   * name) and executed once "batch_size" documents are pending or the oldest
+   * is "batch_timeout" old. */
+  int batch_size;
+  cdtime_t batch_timeout;
+  c_avl_tree_t *batches;
+  int batch_count;
+  cdtime_t batch_start;
+
+  /* Reused for every value list; inserts copy the document. */
+  bson_t *doc;
+
   mongoc_client_t *client;
   mongoc_database_t *database;
   pthread_mutex_t lock;
 };
 typedef struct wm_node_s wm_node_t;
 
+struct wm_batch_s {
+  char *plugin;
+  mongoc_collection_t *collection;
+  mongoc_bulk_operation_t *bulk;
+};
+typedef struct wm_batch_s wm_batch_t;
+
 /*
  * Functions
  */
-static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
-                              const value_list_t *vl, bool store_rates) {
-  bson_t *ret;
+static int wm_create_bson(bson_t *ret, const data_set_t *ds, /* {{{ */
+                          const value_list_t *vl, bool store_rates) {
   bson_t subarray;
   gauge_t *rates;
 
-  ret = bson_new();
-  if (!ret) {
-    ERROR("write_mongodb plugin: bson_new failed.");
-    return NULL;
-  }
+  bson_reinit(ret);
 
   if (store_rates) {
     rates = uc_get_rate(ds, vl);
     if (rates == NULL) {
       ERROR("write_mongodb plugin: uc_get_rate() failed.");
-      bson_destroy(ret);
-      return NULL;
+      return -1;
     }
   } else {
     rates = NULL;
@@ -111,8 +130,8 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     else {
       ERROR("write_mongodb plugin: Unknown ds_type %d for index %" PRIsz,
             ds->ds[i].type, i);
-      bson_destroy(ret);
-      return NULL;
+      sfree(rates);
+      return -1;
     }
   }
   bson_append_array_end(ret, &subarray); /* }}} values */
@@ -146,12 +165,11 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     ERROR("write_mongodb plugin: Error in generated BSON document "
           "at byte %" PRIsz,
           error_location);
-    bson_destroy(ret);
-    return NULL;
+    return -1;
   }
 
-  return ret;
-} /* }}} bson *wm_create_bson */
+  return 0;
+} /* }}} int wm_create_bson */
 
 static int wm_initialize(wm_node_t *node) /* {{{ */
 {
@@ -218,68 +236,188 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
-static int wm_write(const data_set_t *ds, /* {{{ */
-                    const value_list_t *vl, user_data_t *ud) {
-  wm_node_t *node = ud->data;
+static void wm_disconnect(wm_node_t *node) /* {{{ */
+{
+  wm_batch_t *batch;
+  void *key;
+
+  /* Collections and bulk operations belong to the client. */
+  while ((node->batches != NULL) &&
+         (c_avl_pick(node->batches, &key, (void *)&batch) == 0)) {
+    if (batch->bulk != NULL)
+      mongoc_bulk_operation_destroy(batch->bulk);
+    mongoc_collection_destroy(batch->collection);
+    sfree(batch->plugin);
+    sfree(batch);
+  }
+  node->batch_count = 0;
+
+  mongoc_database_destroy(node->database);
+  mongoc_client_destroy(node->client);
+  node->database = NULL;
+  node->client = NULL;
+  node->connected = false;
+} /* }}} void wm_disconnect */
+
+static int wm_write_single(wm_node_t *node, /* {{{ */
+                           const value_list_t *vl) {
   mongoc_collection_t *collection = NULL;
-  bson_t *bson_record;
   bson_error_t error;
   int status;
 
-  bson_record = wm_create_bson(ds, vl, node->store_rates);
-  if (!bson_record) {
-    ERROR("write_mongodb plugin: error making insert bson");
-    return -1;
-  }
-
-  pthread_mutex_lock(&node->lock);
-  if (wm_initialize(node) < 0) {
-    ERROR("write_mongodb plugin: error making connection to server");
-    pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
-    return -1;
-  }
-
   collection =
       mongoc_client_get_collection(node->client, "collectd", vl->plugin);
   if (!collection) {
     ERROR("write_mongodb plugin: error creating/getting collection");
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
-    pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
+    wm_disconnect(node);
     return -1;
   }
 
-  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, bson_record,
-                                    NULL, &error);
+  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, node->doc,
+                                    node->write_concern, &error);
+
+  /* free our resource as not to leak memory */
+  mongoc_collection_destroy(collection);
 
   if (!status) {
     ERROR("write_mongodb plugin: error inserting record: %s", error.message);
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
-    pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
-    mongoc_collection_destroy(collection);
+    wm_disconnect(node);
     return -1;
   }
 
-  /* free our resource as not to leak memory */
-  mongoc_collection_destroy(collection);
+  return 0;
+} /* }}} int wm_write_single */
 
-  pthread_mutex_unlock(&node->lock);
+/* Executes all pending bulk operations. */
+static int wm_flush_nolock(wm_node_t *node) /* {{{ */
+{
+  c_avl_iterator_t *iter;
+  wm_batch_t *batch;
+  void *key;
+  int status = 0;
+
+  if ((node->batches == NULL) || (node->batch_count == 0))
+    return 0;
+
+  iter = c_avl_get_iterator(node->batches);
+  while (c_avl_iterator_next(iter, &key, (void *)&batch) == 0) {
+    bson_t reply;
+    bson_error_t error;
 
-  bson_destroy(bson_record);
+    if (batch->bulk == NULL)
+      continue;
+
+    if (!mongoc_bulk_operation_execute(batch->bulk, &reply, &error)) {
+      ERROR("write_mongodb plugin: bulk insert into collection \"%s\" "
+            "failed: %s",
+            batch->plugin, error.message);
+      status = -1;
+    }
+    bson_destroy(&reply);
+
+    mongoc_bulk_operation_destroy(batch->bulk);
+    batch->bulk = NULL;
+  }
+  c_avl_iterator_destroy(iter);
+
+  node->batch_count = 0;
+
+  if (status != 0)
+    wm_disconnect(node);
+
+  return status;
+} /* }}} int wm_flush_nolock */
+
+static int wm_write_batch(wm_node_t *node, /* {{{ */
+                          const value_list_t *vl) {
+  wm_batch_t *batch = NULL;
+
+  if (c_avl_get(node->batches, vl->plugin, (void *)&batch) != 0) {
+    batch = calloc(1, sizeof(*batch));
+    if (batch == NULL) {
+      ERROR("write_mongodb plugin: calloc failed.");
+      return ENOMEM;
+    }
+    batch->plugin = strdup(vl->plugin);
+    batch->collection =
+        mongoc_client_get_collection(node->client, "collectd", vl->plugin);
+    if ((batch->plugin == NULL) || (batch->collection == NULL) ||
+        (c_avl_insert(node->batches, batch->plugin, batch) != 0)) {
+      ERROR("write_mongodb plugin: error creating/getting collection");
+      if (batch->collection != NULL)
+        mongoc_collection_destroy(batch->collection);
+      sfree(batch->plugin);
+      sfree(batch);
+      return -1;
+    }
+  }
+
+  if (batch->bulk == NULL) {
+    batch->bulk = mongoc_collection_create_bulk_operation(
+        batch->collection, /* ordered = */ false, node->write_concern);
+    if (batch->bulk == NULL) {
+      ERROR("write_mongodb plugin: creating bulk operation failed.");
+      return -1;
+    }
+  }
+
+  if (node->batch_count == 0)
+    node->batch_start = cdtime();
+
+  mongoc_bulk_operation_insert(batch->bulk, node->doc);
+  node->batch_count++;
+
+  if ((node->batch_count >= node->batch_size) ||
+      ((cdtime() - node->batch_start) >= node->batch_timeout))
+    return wm_flush_nolock(node);
 
   return 0;
+} /* }}} int wm_write_batch */
+
+static int wm_write(const data_set_t *ds, /* {{{ */
+                    const value_list_t *vl, user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+
+  if (wm_create_bson(node->doc, ds, vl, node->store_rates) != 0) {
+    ERROR("write_mongodb plugin: error making insert bson");
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
+
+  if (wm_initialize(node) < 0) {
+    ERROR("write_mongodb plugin: error making connection to server");
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
+
+  if (node->batch_size > 1)
+    status = wm_write_batch(node, vl);
+  else
+    status = wm_write_single(node, vl);
+
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->batch_count > 0) &&
+      ((timeout == 0) || ((cdtime() - node->batch_start) >= timeout)))
+    status = wm_flush_nolock(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -287,11 +425,14 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  mongoc_database_destroy(node->database);
-  mongoc_client_destroy(node->client);
-  node->database = NULL;
-  node->client = NULL;
-  node->connected = false;
+  wm_flush_nolock(node);
+  wm_disconnect(node);
+  if (node->batches != NULL)
+    c_avl_destroy(node->batches);
+  if (node->write_concern != NULL)
+    mongoc_write_concern_destroy(node->write_concern);
+  if (node->doc != NULL)
+    bson_destroy(node->doc);
 
   sfree(node->host);
   sfree(node);
@@ -300,6 +441,10 @@ static void wm_config_free(void *ptr) /* {{{ */
 static int wm_config_node(oconfig_item_t *ci) /* {{{ */
 {
   wm_node_t *node;
+  int write_concern_w = MONGOC_WRITE_CONCERN_W_DEFAULT;
+  int write_concern_timeout = 0;
+  bool write_concern_majority = false;
+  bool journal = false;
   int status;
 
   node = calloc(1, sizeof(*node));
@@ -313,6 +458,7 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   }
   node->port = MONGOC_DEFAULT_PORT;
   node->store_rates = true;
+  node->batch_size = 1;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -344,6 +490,31 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_mongodb plugin: BatchSize must be at least 1.");
+        status = EINVAL;
+      }
+    } else if (strcasecmp("BatchTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->batch_timeout);
+    else if (strcasecmp("WriteConcern", child->key) == 0) {
+      if ((child->values_num == 1) &&
+          (child->values[0].type == OCONFIG_TYPE_STRING) &&
+          (strcasecmp("majority", child->values[0].value.string) == 0)) {
+        write_concern_majority = true;
+      } else {
+        status = cf_util_get_int(child, &write_concern_w);
+        if ((status == 0) && (write_concern_w < 0)) {
+          WARNING("write_mongodb plugin: WriteConcern must be \"majority\" "
+                  "or a non-negative number.");
+          status = EINVAL;
+        }
+      }
+    } else if (strcasecmp("WriteConcernTimeout", child->key) == 0)
+      status = cf_util_get_int(child, &write_concern_timeout);
+    else if (strcasecmp("Journal", child->key) == 0)
+      status = cf_util_get_boolean(child, &journal);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -365,6 +536,34 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
     }
   }
 
+  if (status == 0) {
+    node->doc = bson_new();
+    node->batches = c_avl_create((int (*)(const void *, const void *))strcmp);
+    node->write_concern = mongoc_write_concern_new();
+    if ((node->doc == NULL) || (node->batches == NULL) ||
+        (node->write_concern == NULL)) {
+      ERROR("write_mongodb plugin: allocating node state failed.");
+      status = ENOMEM;
+    }
+  }
+
+  if (status == 0) {
+    if (write_concern_majority)
+      mongoc_write_concern_set_wmajority(node->write_concern,
+                                         write_concern_timeout);
+    else {
+      mongoc_write_concern_set_w(node->write_concern, write_concern_w);
+      if (write_concern_timeout > 0)
+        mongoc_write_concern_set_wtimeout(node->write_concern,
+                                          write_concern_timeout);
+    }
+    if (journal)
+      mongoc_write_concern_set_journal(node->write_concern, true);
+
+    if (node->batch_timeout == 0)
+      node->batch_timeout = plugin_get_interval();
+  }
+
   if (status == 0) {
     char cb_name[sizeof("write_mongodb/") + DATA_MAX_NAME_LEN];
 
@@ -377,6 +576,8 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                                    });
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
+    if ((status == 0) && (node->batch_size > 1))
+      plugin_register_flush(cb_name, wm_flush, &(user_data_t){.data = node});
   }
 
   if (status != 0)
@@ -29,6 +29,8 @@
 #include "plugin.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
+#include "utils/latency/latency.h"
 #include "utils_complain.h"
 #include "utils_time.h"
 
@@ -36,6 +38,11 @@
 
 #include <microhttpd.h>
 
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+#include "utils/snappy/snappy.h"
+#include <curl/curl.h>
+#endif
+
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -64,7 +71,62 @@ static char *httpd_host = NULL;
 static unsigned short httpd_port = 9103;
 static struct MHD_Daemon *httpd;
 
+static int httpd_threads = 0;
+
 static cdtime_t staleness_delta = PROMETHEUS_DEFAULT_STALENESS_DELTA;
+static bool compression = true;
+
+/* Responses are cached per format and encoding for "ResponseCacheTime".
+ * libmicrohttpd reference counts responses, so a cached response may be queued
+ * on several connections at once and outlives its replacement as long as it is
+ * being sent. */
+typedef struct {
+  struct MHD_Response *res;
+  cdtime_t time;
+} prom_response_t;
+
+static cdtime_t response_cache_time = 0;
+static prom_response_t responses[2][2]; /* [want_proto][want_gzip] */
+static pthread_mutex_t responses_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A metric family serialized in one of the exposition formats. Fragments are
+ * immutable and reference counted, so that a scrape can copy them into the
+ * response after releasing "metrics_lock", even if a writer has replaced them
+ * in the meantime. */
+typedef struct {
+  uint64_t refs;
+  size_t len;
+  uint8_t data[];
+} prom_fragment_t;
+
+/* prom_family_t adds the serialized fragments, which are dropped whenever the
+ * family is updated, and an index of its metrics to a metric family. "fam"
+ * must be the first member: the "metrics" tree holds pointers to it. */
+typedef struct {
+  Io__Prometheus__Client__MetricFamily fam;
+  prom_fragment_t *text;
+  prom_fragment_t *proto;
+
+  /* Maps the metrics to their position in "fam.metric", which has room for
+   * "metric_alloc" elements and is not sorted. */
+  c_avl_tree_t *index;
+  size_t metric_alloc;
+} prom_family_t;
+
+/* prom_metric_t remembers the position of a metric in its family's array, so
+ * it can be removed without searching. "m" must be the first member. Metrics
+ * of histogram families accumulate the received histograms in "latency", as
+ * Prometheus expects cumulative buckets. */
+typedef struct {
+  Io__Prometheus__Client__Metric m;
+  size_t position;
+  latency_counter_t *latency;
+} prom_metric_t;
+
+/* Histograms are exported with four buckets per power of two, i.e. with
+ * upper bounds of 2^n * {1.25, 1.5, 1.75, 2}. These bounds coincide with
+ * bucket boundaries of latency_counter_t, so the counts are exact. */
+#define HISTOGRAM_BUCKETS_PER_OCTAVE_BITS 2
 
 /* Unfortunately, protoc-c doesn't export its implementation of varint, so we
  * need to implement our own. */
@@ -83,30 +145,47 @@ static size_t varint(uint8_t buffer[static VARINT_UINT32_BYTES],
   return 0;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in ProtoBuf format. It prefixes each protobuf with its encoded
- * size, the so called "delimited" format. */
-static void format_protobuf(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+static prom_fragment_t *fragment_create(size_t len) {
+  prom_fragment_t *f = malloc(sizeof(*f) + len);
+  if (f == NULL)
+    return NULL;
 
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    /* Prometheus uses a message length prefix to determine where one
-     * MetricFamily ends and the next begins. This delimiter is encoded as a
-     * "varint", which is common in Protobufs. */
-    uint8_t delim[VARINT_UINT32_BYTES] = {0};
-    size_t delim_len = varint(
-        delim,
-        (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
-    buffer->append(buffer, delim_len, delim);
-
-    io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
-  }
-  c_avl_iterator_destroy(iter);
+  f->refs = 1;
+  f->len = len;
+  return f;
+}
 
-  pthread_mutex_unlock(&metrics_lock);
+static prom_fragment_t *fragment_ref(prom_fragment_t *f) {
+  __atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+  return f;
+}
+
+static void fragment_unref(prom_fragment_t *f) {
+  if (f == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    free(f);
+}
+
+/* format_protobuf serializes a metric family in ProtoBuf format. It prefixes
+ * the protobuf with its encoded size, the so called "delimited" format. */
+static prom_fragment_t *
+format_protobuf(Io__Prometheus__Client__MetricFamily const *fam) {
+  /* Prometheus uses a message length prefix to determine where one
+   * MetricFamily ends and the next begins. This delimiter is encoded as a
+   * "varint", which is common in Protobufs. */
+  size_t size = io__prometheus__client__metric_family__get_packed_size(fam);
+  uint8_t delim[VARINT_UINT32_BYTES] = {0};
+  size_t delim_len = varint(delim, (uint32_t)size);
+
+  prom_fragment_t *f = fragment_create(delim_len + size);
+  if (f == NULL)
+    return NULL;
+
+  memcpy(f->data, delim, delim_len);
+  io__prometheus__client__metric_family__pack(fam, f->data + delim_len);
+  return f;
 }
 
 static char const *escape_label_value(char *buffer, size_t buffer_size,
@@ -179,56 +258,244 @@ static char *format_labels(char *buffer, size_t buffer_size,
   return buffer;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in plain text format. */
-static void format_text(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+/* format_text serializes a metric family in plain text format. */
+/* format_text_histogram appends the "_bucket", "_sum" and "_count" samples
+ * of a histogram metric to buffer. */
+static void format_text_histogram(ProtobufCBuffer *buffer, char const *name,
+                                  char const *labels,
+                                  Io__Prometheus__Client__Histogram const *h,
+                                  char const *timestamp_ms) {
+  char line[1024];
 
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
+  for (size_t i = 0; i < h->n_bucket; i++) {
+    Io__Prometheus__Client__Bucket const *b = h->bucket[i];
 
-    ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
+    char le[32] = "+Inf";
+    if (isfinite(b->upper_bound))
+      ssnprintf(le, sizeof(le), GAUGE_FORMAT, b->upper_bound);
+
+    ssnprintf(line, sizeof(line), "%s_bucket{%s,le=\"%s\"} %" PRIu64 "%s\n",
+              name, labels, le, b->cumulative_count, timestamp_ms);
     buffer->append(buffer, strlen(line), (uint8_t *)line);
+  }
+
+  ssnprintf(line, sizeof(line), "%s_sum{%s} " GAUGE_FORMAT "%s\n", name,
+            labels, h->sample_sum, timestamp_ms);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+
+  ssnprintf(line, sizeof(line), "%s_count{%s} %" PRIu64 "%s\n", name, labels,
+            h->sample_count, timestamp_ms);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+}
+
+static prom_fragment_t *
+format_text(Io__Prometheus__Client__MetricFamily const *fam) {
+  uint8_t scratch[4096];
+  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
+  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+
+  char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
+
+  ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+
+  char const *type = "counter";
+  if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+    type = "gauge";
+  else if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__HISTOGRAM)
+    type = "histogram";
+  ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name, type);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+
+  for (size_t i = 0; i < fam->n_metric; i++) {
+    Io__Prometheus__Client__Metric *m = fam->metric[i];
+
+    char labels[1024];
+
+    char timestamp_ms[24] = "";
+    if (m->has_timestamp_ms)
+      ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
+                m->timestamp_ms);
+
+    if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__HISTOGRAM) {
+      format_text_histogram(buffer, fam->name,
+                            format_labels(labels, sizeof(labels), m),
+                            m->histogram, timestamp_ms);
+      continue;
+    }
+
+    if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+      ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->gauge->value,
+                timestamp_ms);
+    else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
+      ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->counter->value,
+                timestamp_ms);
 
-    ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
-              (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-                  ? "gauge"
-                  : "counter");
     buffer->append(buffer, strlen(line), (uint8_t *)line);
+  }
+
+  prom_fragment_t *f = fragment_create(simple.len);
+  if (f != NULL)
+    memcpy(f->data, simple.data, simple.len);
+
+  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+  return f;
+}
+
+/* family_fragment returns the family's serialization in the requested format,
+ * creating it if the family has been updated since the last scrape.
+ * NOTE: You must hold "metrics_lock" when calling this function! */
+static prom_fragment_t *family_fragment(prom_family_t *pf, bool want_proto) {
+  prom_fragment_t **f = want_proto ? &pf->proto : &pf->text;
 
-    for (size_t i = 0; i < fam->n_metric; i++) {
-      Io__Prometheus__Client__Metric *m = fam->metric[i];
+  if (*f == NULL)
+    *f = want_proto ? format_protobuf(&pf->fam) : format_text(&pf->fam);
 
-      char labels[1024];
+  return *f;
+}
 
-      char timestamp_ms[24] = "";
-      if (m->has_timestamp_ms)
-        ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
-                  m->timestamp_ms);
+/* family_invalidate drops the serializations of a family after an update.
+ * Scrapes still using them keep their own references.
+ * NOTE: You must hold "metrics_lock" when calling this function! */
+static void family_invalidate(Io__Prometheus__Client__MetricFamily *fam) {
+  prom_family_t *pf = (prom_family_t *)fam;
 
-      if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-        ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->gauge->value,
-                  timestamp_ms);
-      else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
-        ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->counter->value,
-                  timestamp_ms);
+  fragment_unref(pf->text);
+  pf->text = NULL;
+  fragment_unref(pf->proto);
+  pf->proto = NULL;
+}
 
-      buffer->append(buffer, strlen(line), (uint8_t *)line);
+/* format_exposition creates the response body for a scrape. Only the families
+ * that changed since the last scrape are serialized while holding
+ * "metrics_lock"; the fragments are concatenated after releasing it. The
+ * returned buffer must be freed with free(3). */
+static uint8_t *format_exposition(bool want_proto, size_t *ret_len) {
+  pthread_mutex_lock(&metrics_lock);
+
+  int fams_num = c_avl_size(metrics);
+  prom_fragment_t **frags =
+      calloc((fams_num > 0) ? (size_t)fams_num : 1, sizeof(*frags));
+  if (frags == NULL) {
+    pthread_mutex_unlock(&metrics_lock);
+    ERROR("write_prometheus plugin: calloc failed.");
+    return NULL;
+  }
+
+  size_t frags_num = 0;
+  char *unused_name;
+  prom_family_t *pf;
+  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
+  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&pf) == 0) {
+    prom_fragment_t *f = family_fragment(pf, want_proto);
+    if (f == NULL) {
+      ERROR("write_prometheus plugin: Serializing metric family \"%s\" "
+            "failed.",
+            pf->fam.name);
+      continue;
     }
+    frags[frags_num] = fragment_ref(f);
+    frags_num++;
   }
   c_avl_iterator_destroy(iter);
 
-  char server[1024];
-  ssnprintf(server, sizeof(server), "\n# collectd/write_prometheus %s at %s\n",
-            PACKAGE_VERSION, hostname_g);
-  buffer->append(buffer, strlen(server), (uint8_t *)server);
-
   pthread_mutex_unlock(&metrics_lock);
+
+  char server[1024] = "";
+  if (!want_proto)
+    ssnprintf(server, sizeof(server),
+              "\n# collectd/write_prometheus %s at %s\n", PACKAGE_VERSION,
+              hostname_g);
+  size_t server_len = strlen(server);
+
+  size_t len = server_len;
+  for (size_t i = 0; i < frags_num; i++)
+    len += frags[i]->len;
+
+  /* Allocate at least one byte, an empty ProtoBuf response is valid. */
+  uint8_t *data = malloc((len > 0) ? len : 1);
+  if (data != NULL) {
+    size_t offset = 0;
+    for (size_t i = 0; i < frags_num; i++) {
+      memcpy(data + offset, frags[i]->data, frags[i]->len);
+      offset += frags[i]->len;
+    }
+    memcpy(data + offset, server, server_len);
+    *ret_len = len;
+  } else {
+    ERROR("write_prometheus plugin: malloc(%" PRIsz ") failed.", len);
+  }
+
+  for (size_t i = 0; i < frags_num; i++)
+    fragment_unref(frags[i]);
+  sfree(frags);
+
+  return data;
+}
+
+/* compress_body replaces "data" with its gzip compressed version. */
+static int compress_body(uint8_t **data, size_t *len) {
+  compress_stream_t *s = compress_stream_create(COMPRESS_GZIP, 0);
+  if (s == NULL)
+    return ENOTSUP;
+
+  compress_buffer_t out = {0};
+  int status = compress_stream_append(s, (char *)*data, *len, &out);
+  if (status == 0)
+    status = compress_stream_finish(s, &out);
+  compress_stream_destroy(s);
+
+  if (status != 0) {
+    sfree(out.data);
+    return status;
+  }
+
+  free(*data);
+  *data = (uint8_t *)out.data;
+  *len = out.len;
+  return 0;
+}
+
+/* create_response creates a response holding the current exposition. */
+static struct MHD_Response *create_response(bool want_proto, bool want_gzip) {
+  size_t len = 0;
+  uint8_t *data = format_exposition(want_proto, &len);
+  if (data == NULL)
+    return NULL;
+
+  if (want_gzip && (compress_body(&data, &len) != 0)) {
+    static c_complain_t compress_complaint = C_COMPLAIN_INIT_STATIC;
+    c_complain(LOG_WARNING, &compress_complaint,
+               "write_prometheus plugin: Compressing the response failed. "
+               "Sending it uncompressed.");
+    want_gzip = false;
+  }
+
+  /* The response takes ownership of "data" and frees it once it is
+   * destroyed. */
+#if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
+  struct MHD_Response *res =
+      MHD_create_response_from_buffer(len, data, MHD_RESPMEM_MUST_FREE);
+#else
+  struct MHD_Response *res = MHD_create_response_from_data(
+      len, data, /* must_free = */ 1, /* must_copy = */ 0);
+#endif
+  if (res == NULL) {
+    free(data);
+    return NULL;
+  }
+
+  MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
+                          want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+  if (want_gzip)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+  if (compression)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_VARY,
+                            MHD_HTTP_HEADER_ACCEPT_ENCODING);
+
+  return res;
 }
 
 /* http_handler is the callback called by the microhttpd library. It essentially
@@ -256,29 +523,41 @@ static MHD_RESULT http_handler(void *cls, struct MHD_Connection *connection,
   bool want_proto = (accept != NULL) &&
                     (strstr(accept, "application/vnd.google.protobuf") != NULL);
 
-  uint8_t scratch[4096] = {0};
-  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
-  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+  char const *accept_encoding = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  bool want_gzip = compression && (accept_encoding != NULL) &&
+                   (strstr(accept_encoding, "gzip") != NULL);
 
-  if (want_proto)
-    format_protobuf(buffer);
-  else
-    format_text(buffer);
+  if (response_cache_time == 0) {
+    struct MHD_Response *res = create_response(want_proto, want_gzip);
+    if (res == NULL)
+      return MHD_NO;
 
-#if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
-  struct MHD_Response *res = MHD_create_response_from_buffer(
-      simple.len, simple.data, MHD_RESPMEM_MUST_COPY);
-#else
-  struct MHD_Response *res = MHD_create_response_from_data(
-      simple.len, simple.data, /* must_free = */ 0, /* must_copy = */ 1);
-#endif
-  MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
-                          want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+    MHD_RESULT status = MHD_queue_response(connection, MHD_HTTP_OK, res);
+    MHD_destroy_response(res);
+    return status;
+  }
+
+  /* Concurrent scrapes wait for the one that renews the response and then
+   * reuse it. */
+  pthread_mutex_lock(&responses_lock);
+  prom_response_t *r = &responses[want_proto][want_gzip];
+  cdtime_t now = cdtime();
+  if ((r->res == NULL) || ((r->time + response_cache_time) <= now)) {
+    struct MHD_Response *res = create_response(want_proto, want_gzip);
+    if (res == NULL) {
+      pthread_mutex_unlock(&responses_lock);
+      return MHD_NO;
+    }
 
-  MHD_RESULT status = MHD_queue_response(connection, MHD_HTTP_OK, res);
+    if (r->res != NULL)
+      MHD_destroy_response(r->res);
+    r->res = res;
+    r->time = now;
+  }
 
-  MHD_destroy_response(res);
-  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+  MHD_RESULT status = MHD_queue_response(connection, MHD_HTTP_OK, r->res);
+  pthread_mutex_unlock(&responses_lock);
   return status;
 }
 
@@ -327,6 +606,18 @@ label_pair_clone(Io__Prometheus__Client__LabelPair const *orig) {
   return copy;
 }
 
+/* histogram_destroy frees a histogram created by histogram_create(). */
+static void histogram_destroy(Io__Prometheus__Client__Histogram *h) {
+  if (h == NULL)
+    return;
+
+  /* All buckets are allocated in one block. */
+  if (h->n_bucket > 0)
+    sfree(h->bucket[0]);
+  sfree(h->bucket);
+  sfree(h);
+}
+
 /* metric_destroy frees the memory used by a metric. */
 static void metric_destroy(Io__Prometheus__Client__Metric *msg) {
   if (msg == NULL)
@@ -339,12 +630,15 @@ static void metric_destroy(Io__Prometheus__Client__Metric *msg) {
 
   sfree(msg->gauge);
   sfree(msg->counter);
+  histogram_destroy(msg->histogram);
+  latency_counter_destroy(((prom_metric_t *)msg)->latency);
 
   sfree(msg);
 }
 
 /* metric_cmp compares two metrics. It's prototype makes it easy to use with
- * qsort(3) and bsearch(3). */
+ * qsort(3) and bsearch(3); metric_index_cmp is the variant for the family
+ * index. */
 static int metric_cmp(void const *a, void const *b) {
   Io__Prometheus__Client__Metric const *m_a =
       *((Io__Prometheus__Client__Metric **)a);
@@ -393,6 +687,10 @@ static int metric_cmp(void const *a, void const *b) {
   return 0;
 }
 
+static int metric_index_cmp(void const *a, void const *b) {
+  return metric_cmp(&a, &b);
+}
+
 #define METRIC_INIT                                                            \
   &(Io__Prometheus__Client__Metric) {                                          \
     .label =                                                                   \
@@ -434,9 +732,11 @@ static int metric_cmp(void const *a, void const *b) {
 /* metric_clone allocates and initializes a new metric based on orig. */
 static Io__Prometheus__Client__Metric *
 metric_clone(Io__Prometheus__Client__Metric const *orig) {
-  Io__Prometheus__Client__Metric *copy = calloc(1, sizeof(*copy));
-  if (copy == NULL)
+  prom_metric_t *pm = calloc(1, sizeof(*pm));
+  if (pm == NULL)
     return NULL;
+
+  Io__Prometheus__Client__Metric *copy = &pm->m;
   io__prometheus__client__metric__init(copy);
 
   copy->n_label = orig->n_label;
@@ -517,56 +817,220 @@ static int metric_update(Io__Prometheus__Client__Metric *m, value_t value,
   return 0;
 }
 
-/* metric_family_add_metric adds m to the metric list of fam. */
-static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
-                                    Io__Prometheus__Client__Metric *m) {
+typedef struct {
+  Io__Prometheus__Client__Bucket *buckets;
+  size_t num;
+  size_t alloc;
+  cdtime_t bound;
+  uint64_t cumulative;
+} histogram_buckets_t;
+
+/* histogram_bound returns the smallest exported bucket bound that is greater
+ * than or equal to upper. */
+static cdtime_t histogram_bound(cdtime_t upper) {
+  int exp = 63 - __builtin_clzll((unsigned long long)upper);
+  cdtime_t step = ((cdtime_t)1) << exp;
+  if (exp >= HISTOGRAM_BUCKETS_PER_OCTAVE_BITS)
+    step >>= HISTOGRAM_BUCKETS_PER_OCTAVE_BITS;
+  return ((upper + step - 1) / step) * step;
+}
+
+static int histogram_add_bucket(__attribute__((unused)) cdtime_t lower,
+                                cdtime_t upper, uint64_t count, void *ud) {
+  histogram_buckets_t *hb = ud;
+  cdtime_t bound = histogram_bound(upper);
+
+  /* The last slot is reserved for the "+Inf" bucket. */
+  if ((hb->num == 0) || (hb->bound != bound)) {
+    if (hb->num + 1 >= hb->alloc) {
+      size_t alloc = (hb->alloc > 0) ? 2 * hb->alloc : 16;
+      Io__Prometheus__Client__Bucket *tmp =
+          realloc(hb->buckets, alloc * sizeof(*hb->buckets));
+      if (tmp == NULL)
+        return ENOMEM;
+      hb->buckets = tmp;
+      hb->alloc = alloc;
+    }
+
+    Io__Prometheus__Client__Bucket *b = hb->buckets + hb->num;
+    io__prometheus__client__bucket__init(b);
+    b->upper_bound = CDTIME_T_TO_DOUBLE(bound);
+    b->has_upper_bound = 1;
+    hb->num++;
+    hb->bound = bound;
+  }
+
+  hb->cumulative += count;
+  hb->buckets[hb->num - 1].cumulative_count = hb->cumulative;
+  hb->buckets[hb->num - 1].has_cumulative_count = 1;
+  return 0;
+}
+
+/* histogram_create converts a latency counter to a Prometheus histogram. */
+static Io__Prometheus__Client__Histogram *
+histogram_create(latency_counter_t *lc) {
+  histogram_buckets_t hb = {0};
+
+  int status = latency_counter_foreach_bucket(lc, histogram_add_bucket, &hb);
+  if ((status == 0) && (hb.alloc == 0)) {
+    hb.buckets = calloc(1, sizeof(*hb.buckets));
+    hb.alloc = 1;
+  }
+  if ((status != 0) || (hb.buckets == NULL)) {
+    sfree(hb.buckets);
+    return NULL;
+  }
+
+  Io__Prometheus__Client__Bucket *inf = hb.buckets + hb.num;
+  io__prometheus__client__bucket__init(inf);
+  inf->upper_bound = INFINITY;
+  inf->has_upper_bound = 1;
+  inf->cumulative_count = hb.cumulative;
+  inf->has_cumulative_count = 1;
+  hb.num++;
+
+  Io__Prometheus__Client__Histogram *h = calloc(1, sizeof(*h));
+  if (h == NULL) {
+    sfree(hb.buckets);
+    return NULL;
+  }
+  io__prometheus__client__histogram__init(h);
+
+  h->bucket = calloc(hb.num, sizeof(*h->bucket));
+  if (h->bucket == NULL) {
+    sfree(hb.buckets);
+    sfree(h);
+    return NULL;
+  }
+  for (size_t i = 0; i < hb.num; i++)
+    h->bucket[i] = hb.buckets + i;
+  h->n_bucket = hb.num;
+
+  h->sample_count = (uint64_t)latency_counter_get_num(lc);
+  h->has_sample_count = 1;
+  h->sample_sum = CDTIME_T_TO_DOUBLE(latency_counter_get_sum(lc));
+  h->has_sample_sum = 1;
+
+  return h;
+}
+
+/* metric_update_histogram adds the histogram received with vl to m. */
+static int metric_update_histogram(Io__Prometheus__Client__Metric *m,
+                                   value_list_t const *vl) {
+  prom_metric_t *pm = (prom_metric_t *)m;
+
+  char *str = NULL;
+  if ((vl->meta == NULL) ||
+      (meta_data_get_string(vl->meta, LATENCY_HISTOGRAM_META, &str) != 0))
+    return EINVAL;
+
+  if (pm->latency == NULL)
+    pm->latency = latency_counter_create();
+  if (pm->latency == NULL) {
+    sfree(str);
+    return ENOMEM;
+  }
+
+  int status = latency_counter_merge_string(pm->latency, str);
+  sfree(str);
+  if (status != 0)
+    return status;
+
+  Io__Prometheus__Client__Histogram *h = histogram_create(pm->latency);
+  if (h == NULL)
+    return ENOMEM;
+
+  histogram_destroy(m->histogram);
+  m->histogram = h;
+
+  /* See metric_update() for the timestamp handling. */
+  if (vl->interval <= staleness_delta) {
+    m->timestamp_ms = CDTIME_T_TO_MS(vl->time);
+    m->has_timestamp_ms = 1;
+  } else {
+    m->timestamp_ms = 0;
+    m->has_timestamp_ms = 0;
+  }
+
+  return 0;
+}
+
+/* metric_family_resize changes the capacity of the metric list of fam. */
+static int metric_family_resize(prom_family_t *pf, size_t alloc) {
+  if (alloc == 0) {
+    sfree(pf->fam.metric);
+    pf->metric_alloc = 0;
+    return 0;
+  }
+
   Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, (fam->n_metric + 1) * sizeof(*fam->metric));
+      realloc(pf->fam.metric, alloc * sizeof(*pf->fam.metric));
   if (tmp == NULL)
     return ENOMEM;
-  fam->metric = tmp;
 
+  pf->fam.metric = tmp;
+  pf->metric_alloc = alloc;
+  return 0;
+}
+
+/* metric_family_add_metric adds m to the metric list and the index of fam.
+ * The list grows exponentially, so adding a metric takes amortized
+ * logarithmic time. */
+static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
+                                    Io__Prometheus__Client__Metric *m) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
+  if (fam->n_metric == pf->metric_alloc) {
+    size_t alloc = (pf->metric_alloc > 0) ? 2 * pf->metric_alloc : 4;
+    int status = metric_family_resize(pf, alloc);
+    if (status != 0)
+      return status;
+  }
+
+  int status = c_avl_insert(pf->index, m, m);
+  if (status != 0)
+    return (status < 0) ? ENOMEM : EEXIST;
+
+  ((prom_metric_t *)m)->position = fam->n_metric;
   fam->metric[fam->n_metric] = m;
   fam->n_metric++;
 
-  /* Sort the metrics so that lookup is fast. */
-  qsort(fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
   return 0;
 }
 
 /* metric_family_delete_metric looks up and deletes the metric corresponding to
- * vl. */
+ * vl. The last metric of the list takes its place. */
 static int
 metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
                             value_list_t const *vl) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  size_t i;
-  for (i = 0; i < fam->n_metric; i++) {
-    if (metric_cmp(&key, &fam->metric[i]) == 0)
-      break;
-  }
-
-  if (i >= fam->n_metric)
+  Io__Prometheus__Client__Metric *m = NULL;
+  if (c_avl_remove(pf->index, key, NULL, (void *)&m) != 0)
     return ENOENT;
 
-  metric_destroy(fam->metric[i]);
-  if ((fam->n_metric - 1) > i)
-    memmove(&fam->metric[i], &fam->metric[i + 1],
-            ((fam->n_metric - 1) - i) * sizeof(fam->metric[i]));
-  fam->n_metric--;
+  family_invalidate(fam);
 
-  if (fam->n_metric == 0) {
-    sfree(fam->metric);
-    return 0;
+  size_t i = ((prom_metric_t *)m)->position;
+  assert(fam->metric[i] == m);
+  metric_destroy(m);
+
+  fam->n_metric--;
+  if (i != fam->n_metric) {
+    fam->metric[i] = fam->metric[fam->n_metric];
+    ((prom_metric_t *)fam->metric[i])->position = i;
   }
+  fam->metric[fam->n_metric] = NULL;
 
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, fam->n_metric * sizeof(*fam->metric));
-  if (tmp != NULL)
-    fam->metric = tmp;
+  /* Give memory back once the list is mostly empty. Failing to shrink is not
+   * an error. */
+  if (fam->n_metric == 0)
+    metric_family_resize(pf, 0);
+  else if ((pf->metric_alloc > 4) && (fam->n_metric < (pf->metric_alloc / 4)))
+    metric_family_resize(pf, pf->metric_alloc / 2);
 
   return 0;
 }
@@ -576,16 +1040,14 @@ metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
 static Io__Prometheus__Client__Metric *
 metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
                          value_list_t const *vl) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  /* Metrics are sorted in metric_family_add_metric() so that we can do a binary
-   * search here. */
-  Io__Prometheus__Client__Metric **m = bsearch(
-      &key, fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
-  if (m != NULL) {
-    return *m;
+  Io__Prometheus__Client__Metric *m = NULL;
+  if (c_avl_get(pf->index, key, (void *)&m) == 0) {
+    return m;
   }
 
   Io__Prometheus__Client__Metric *new_metric = metric_clone(key);
@@ -606,11 +1068,16 @@ metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
  * allocating it if necessary, and updates the metric to the latest value. */
 static int metric_family_update(Io__Prometheus__Client__MetricFamily *fam,
                                 data_set_t const *ds, value_list_t const *vl,
-                                size_t ds_index) {
+                                size_t ds_index,
+                                Io__Prometheus__Client__Metric **ret_metric) {
   Io__Prometheus__Client__Metric *m = metric_family_get_metric(fam, vl);
   if (m == NULL)
     return -1;
 
+  *ret_metric = m;
+  family_invalidate(fam);
+  if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__HISTOGRAM)
+    return metric_update_histogram(m, vl);
   return metric_update(m, vl->values[ds_index], ds->ds[ds_index].type, vl->time,
                        vl->interval);
 }
@@ -628,6 +1095,11 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
   }
   sfree(msg->metric);
 
+  prom_family_t *pf = (prom_family_t *)msg;
+  c_avl_destroy(pf->index);
+  pf->index = NULL;
+
+  family_invalidate(msg);
   sfree(msg);
 }
 
@@ -635,9 +1107,17 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
 static Io__Prometheus__Client__MetricFamily *
 metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                      size_t ds_index) {
-  Io__Prometheus__Client__MetricFamily *msg = calloc(1, sizeof(*msg));
-  if (msg == NULL)
+  prom_family_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
+    return NULL;
+
+  pf->index = c_avl_create(metric_index_cmp);
+  if (pf->index == NULL) {
+    sfree(pf);
     return NULL;
+  }
+
+  Io__Prometheus__Client__MetricFamily *msg = &pf->fam;
   io__prometheus__client__metric_family__init(msg);
 
   msg->name = name;
@@ -653,6 +1133,11 @@ metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
   msg->type = (ds->ds[ds_index].type == DS_TYPE_GAUGE)
                   ? IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE
                   : IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER;
+  /* Value lists carrying a whole latency histogram, see
+   * latency_counter_dispatch(). */
+  if ((vl->meta != NULL) &&
+      meta_data_exists(vl->meta, LATENCY_HISTOGRAM_META))
+    msg->type = IO__PROMETHEUS__CLIENT__METRIC_TYPE__HISTOGRAM;
   msg->has_type = 1;
 
   return msg;
@@ -826,17 +1311,32 @@ static struct MHD_Daemon *prom_start_daemon() {
     return NULL;
   }
 
-  unsigned int flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_DEBUG;
+  unsigned int flags = MHD_USE_DEBUG;
 #if MHD_VERSION >= 0x00095300
   flags |= MHD_USE_INTERNAL_POLLING_THREAD;
+#else
+  if (httpd_threads > 0)
+    flags |= MHD_USE_SELECT_INTERNALLY;
 #endif
 
-  struct MHD_Daemon *d = MHD_start_daemon(
-      flags, httpd_port,
-      /* MHD_AcceptPolicyCallback = */ NULL,
-      /* MHD_AcceptPolicyCallback arg = */ NULL, http_handler, NULL,
-      MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_EXTERNAL_LOGGER, prom_logger,
-      NULL, MHD_OPTION_END);
+  struct MHD_Daemon *d;
+  if (httpd_threads > 0) {
+    /* A fixed pool of threads, each polling a share of the connections. */
+    d = MHD_start_daemon(
+        flags, httpd_port,
+        /* MHD_AcceptPolicyCallback = */ NULL,
+        /* MHD_AcceptPolicyCallback arg = */ NULL, http_handler, NULL,
+        MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_EXTERNAL_LOGGER, prom_logger,
+        NULL, MHD_OPTION_THREAD_POOL_SIZE, (unsigned int)httpd_threads,
+        MHD_OPTION_END);
+  } else {
+    d = MHD_start_daemon(
+        flags | MHD_USE_THREAD_PER_CONNECTION, httpd_port,
+        /* MHD_AcceptPolicyCallback = */ NULL,
+        /* MHD_AcceptPolicyCallback arg = */ NULL, http_handler, NULL,
+        MHD_OPTION_LISTEN_SOCKET, fd, MHD_OPTION_EXTERNAL_LOGGER, prom_logger,
+        NULL, MHD_OPTION_END);
+  }
   if (d == NULL) {
     ERROR("write_prometheus plugin: MHD_start_daemon() failed.");
     close(fd);
@@ -862,6 +1362,568 @@ static struct MHD_Daemon *prom_start_daemon() {
 } /* }}} struct MHD_Daemon *prom_start_daemon */
 #endif
 
+/*
+ * Remote write: besides being scraped, the plugin can push samples to a
+ * Prometheus "remote_write" endpoint. Samples are distributed over a fixed
+ * number of shards by series, so that the samples of each series stay in
+ * order. Each shard queues samples as encoded TimeSeries messages, which
+ * concatenated form a WriteRequest, and its thread sends them in batches,
+ * retrying with exponential backoff like Prometheus' own queue manager.
+ * {{{ */
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+#define RW_DEFAULT_SHARDS 4
+#define RW_DEFAULT_CAPACITY 10000
+#define RW_DEFAULT_MAX_SAMPLES_PER_SEND 2000
+#define RW_DEFAULT_BATCH_SEND_DEADLINE TIME_T_TO_CDTIME_T_STATIC(5)
+#define RW_DEFAULT_MIN_BACKOFF MS_TO_CDTIME_T(30)
+#define RW_DEFAULT_MAX_BACKOFF TIME_T_TO_CDTIME_T_STATIC(5)
+#define RW_DEFAULT_TIMEOUT_MS 30000
+
+/* Protobuf wire format: field number << 3 | wire type. */
+#define RW_TAG_LEN(field) ((uint8_t)(((field) << 3) | 2))
+#define RW_TAG_FIXED64(field) ((uint8_t)(((field) << 3) | 1))
+#define RW_TAG_VARINT(field) ((uint8_t)((field) << 3))
+
+struct rw_queue_s;
+
+typedef struct {
+  struct rw_queue_s *queue;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool shutdown;
+
+  /* Encoded TimeSeries messages that have not been picked up yet. */
+  uint8_t *pending;
+  size_t pending_len;
+  size_t pending_size;
+  size_t pending_samples;
+  cdtime_t pending_since;
+
+  uint64_t dropped;
+  c_complain_t complaint;
+
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  pthread_t thread;
+  bool thread_running;
+} rw_shard_t;
+
+typedef struct rw_queue_s {
+  char *url;
+  struct curl_slist *headers;
+  int timeout_ms;
+
+  size_t capacity;
+  size_t max_samples_per_send;
+  cdtime_t batch_send_deadline;
+  cdtime_t min_backoff;
+  cdtime_t max_backoff;
+
+  rw_shard_t *shards;
+  size_t shards_num;
+} rw_queue_t;
+
+/* Protected by "metrics_lock". */
+static rw_queue_t *remote_write;
+
+static size_t rw_varint_len(uint64_t v) {
+  size_t len = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+static uint8_t *rw_put_varint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *(p++) = (uint8_t)((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  *(p++) = (uint8_t)v;
+  return p;
+}
+
+static uint8_t *rw_put_string(uint8_t *p, uint8_t tag, char const *s,
+                              size_t len) {
+  *(p++) = tag;
+  p = rw_put_varint(p, len);
+  memcpy(p, s, len);
+  return p + len;
+}
+
+static int rw_label_cmp(void const *a, void const *b) {
+  Io__Prometheus__Client__LabelPair const *l_a =
+      *((Io__Prometheus__Client__LabelPair **)a);
+  Io__Prometheus__Client__LabelPair const *l_b =
+      *((Io__Prometheus__Client__LabelPair **)b);
+  return strcmp(l_a->name, l_b->name);
+}
+
+/* rw_encode_series encodes one sample of the metric m as a TimeSeries message,
+ * including its field tag in the WriteRequest. The labels are the same as the
+ * ones exposed for scraping, plus "__name__", and are sorted by name as
+ * required by the protocol. Returns the encoded size or zero if it does not
+ * fit the buffer. */
+static size_t rw_encode_series(uint8_t *buffer, size_t buffer_size,
+                               Io__Prometheus__Client__MetricFamily const *fam,
+                               Io__Prometheus__Client__Metric const *m,
+                               cdtime_t t) {
+  Io__Prometheus__Client__LabelPair name = {
+      .name = "__name__",
+      .value = fam->name,
+  };
+  Io__Prometheus__Client__LabelPair *labels[4] = {&name};
+  size_t labels_num = 1;
+  for (size_t i = 0; (i < m->n_label) && (labels_num < 4); i++) {
+    labels[labels_num] = m->label[i];
+    labels_num++;
+  }
+  qsort(labels, labels_num, sizeof(*labels), rw_label_cmp);
+
+  size_t label_len[4];
+  size_t series_len = 0;
+  for (size_t i = 0; i < labels_num; i++) {
+    size_t n = strlen(labels[i]->name);
+    size_t v = strlen(labels[i]->value);
+    label_len[i] = 1 + rw_varint_len(n) + n + 1 + rw_varint_len(v) + v;
+    series_len += 1 + rw_varint_len(label_len[i]) + label_len[i];
+  }
+
+  int64_t timestamp_ms = (int64_t)CDTIME_T_TO_MS(t);
+  size_t sample_len = 1 + 8 + 1 + rw_varint_len((uint64_t)timestamp_ms);
+  series_len += 1 + rw_varint_len(sample_len) + sample_len;
+
+  size_t total = 1 + rw_varint_len(series_len) + series_len;
+  if (total > buffer_size)
+    return 0;
+
+  uint8_t *p = buffer;
+  *(p++) = RW_TAG_LEN(1); /* WriteRequest.timeseries */
+  p = rw_put_varint(p, series_len);
+
+  for (size_t i = 0; i < labels_num; i++) {
+    *(p++) = RW_TAG_LEN(1); /* TimeSeries.labels */
+    p = rw_put_varint(p, label_len[i]);
+    p = rw_put_string(p, RW_TAG_LEN(1), labels[i]->name,
+                      strlen(labels[i]->name));
+    p = rw_put_string(p, RW_TAG_LEN(2), labels[i]->value,
+                      strlen(labels[i]->value));
+  }
+
+  double value = (m->gauge != NULL) ? m->gauge->value : m->counter->value;
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  *(p++) = RW_TAG_LEN(2); /* TimeSeries.samples */
+  p = rw_put_varint(p, sample_len);
+  *(p++) = RW_TAG_FIXED64(1); /* Sample.value */
+  for (size_t i = 0; i < 8; i++)
+    *(p++) = (uint8_t)(bits >> (8 * i));
+  *(p++) = RW_TAG_VARINT(2); /* Sample.timestamp */
+  p = rw_put_varint(p, (uint64_t)timestamp_ms);
+
+  assert((size_t)(p - buffer) == total);
+  return total;
+}
+
+/* rw_series_hash selects the shard of a series. */
+static uint32_t rw_series_hash(Io__Prometheus__Client__MetricFamily const *fam,
+                               Io__Prometheus__Client__Metric const *m) {
+  uint32_t hash = 2166136261u; /* FNV-1a */
+  for (char const *s = fam->name; *s != 0; s++)
+    hash = (hash ^ (uint8_t)*s) * 16777619u;
+  for (size_t i = 0; i < m->n_label; i++)
+    for (char const *s = m->label[i]->value; *s != 0; s++)
+      hash = (hash ^ (uint8_t)*s) * 16777619u;
+  return hash;
+}
+
+/* rw_enqueue queues the current sample of m for remote write. If the shard's
+ * queue is full, the sample is dropped.
+ * NOTE: You must hold "metrics_lock" when calling this function! */
+static void rw_enqueue(Io__Prometheus__Client__MetricFamily const *fam,
+                       Io__Prometheus__Client__Metric const *m, cdtime_t t) {
+  uint8_t series[4096];
+  size_t len = rw_encode_series(series, sizeof(series), fam, m, t);
+  if (len == 0) {
+    ERROR("write_prometheus plugin: Encoding a sample of \"%s\" for remote "
+          "write failed.",
+          fam->name);
+    return;
+  }
+
+  rw_shard_t *shard = remote_write->shards +
+                      (rw_series_hash(fam, m) % remote_write->shards_num);
+
+  pthread_mutex_lock(&shard->lock);
+  if (shard->pending_samples >= remote_write->capacity) {
+    shard->dropped++;
+    c_complain(LOG_WARNING, &shard->complaint,
+               "write_prometheus plugin: The remote write queue is full. "
+               "Dropping samples (%" PRIu64 " so far).",
+               shard->dropped);
+    pthread_mutex_unlock(&shard->lock);
+    return;
+  }
+
+  if (shard->pending_len + len > shard->pending_size) {
+    size_t size = (shard->pending_size > 0) ? 2 * shard->pending_size : 65536;
+    while (size < shard->pending_len + len)
+      size *= 2;
+    uint8_t *tmp = realloc(shard->pending, size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      ERROR("write_prometheus plugin: realloc failed.");
+      return;
+    }
+    shard->pending = tmp;
+    shard->pending_size = size;
+  }
+
+  if (shard->pending_samples == 0)
+    shard->pending_since = cdtime();
+  memcpy(shard->pending + shard->pending_len, series, len);
+  shard->pending_len += len;
+  shard->pending_samples++;
+
+  if (shard->pending_samples == remote_write->max_samples_per_send)
+    pthread_cond_signal(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/* rw_batch_end returns the end of the first "max" TimeSeries messages in
+ * data[0..len). */
+static size_t rw_batch_end(uint8_t const *data, size_t len, size_t max,
+                           size_t *ret_samples) {
+  size_t pos = 0;
+  size_t samples = 0;
+  while ((pos < len) && (samples < max)) {
+    pos++; /* tag */
+    uint64_t series_len = 0;
+    for (int shift = 0; pos < len; shift += 7) {
+      series_len |= (uint64_t)(data[pos] & 0x7f) << shift;
+      if ((data[pos++] & 0x80) == 0)
+        break;
+    }
+    pos += series_len;
+    samples++;
+  }
+
+  *ret_samples = samples;
+  return (pos < len) ? pos : len;
+}
+
+static size_t rw_discard_callback(__attribute__((unused)) char *ptr,
+                                  size_t size, size_t nmemb,
+                                  __attribute__((unused)) void *userdata) {
+  return size * nmemb;
+}
+
+/* rw_post sends one WriteRequest. Returns zero on success, EAGAIN if the
+ * request should be retried and another errno value if it must be dropped. */
+static int rw_post(rw_shard_t *shard, char const *data, size_t len) {
+  rw_queue_t const *q = shard->queue;
+
+  curl_easy_setopt(shard->curl, CURLOPT_POSTFIELDSIZE, (long)len);
+  curl_easy_setopt(shard->curl, CURLOPT_POSTFIELDS, data);
+
+  CURLcode status = curl_easy_perform(shard->curl);
+  if (status != CURLE_OK) {
+    ERROR("write_prometheus plugin: Remote write to \"%s\" failed: %s",
+          q->url, shard->curl_errbuf);
+    return EAGAIN;
+  }
+
+  long code = 0;
+  curl_easy_getinfo(shard->curl, CURLINFO_RESPONSE_CODE, &code);
+  if ((code >= 200) && (code < 300))
+    return 0;
+
+  ERROR("write_prometheus plugin: Remote write to \"%s\" failed with HTTP "
+        "status %ld.",
+        q->url, code);
+  /* Like Prometheus, retry on server errors and rate limiting only. */
+  return ((code >= 500) || (code == 429)) ? EAGAIN : EINVAL;
+}
+
+/* rw_send sends a batch of samples, retrying with exponential backoff until
+ * it succeeds, fails permanently or the plugin shuts down. */
+static void rw_send(rw_shard_t *shard, uint8_t const *data, size_t len,
+                    size_t samples, char *encoded) {
+  rw_queue_t const *q = shard->queue;
+  size_t encoded_len = snappy_encode((char const *)data, len, encoded);
+  cdtime_t backoff = q->min_backoff;
+
+  while (42) {
+    int status = rw_post(shard, encoded, encoded_len);
+    if (status != EAGAIN)
+      break;
+
+    pthread_mutex_lock(&shard->lock);
+    if (!shard->shutdown) {
+      struct timespec until = CDTIME_T_TO_TIMESPEC(cdtime() + backoff);
+      pthread_cond_timedwait(&shard->cond, &shard->lock, &until);
+    }
+    bool shutdown = shard->shutdown;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (shutdown) {
+      WARNING("write_prometheus plugin: Dropping %" PRIsz " samples for "
+              "remote write on shutdown.",
+              samples);
+      return;
+    }
+
+    backoff *= 2;
+    if (backoff > q->max_backoff)
+      backoff = q->max_backoff;
+  }
+}
+
+static void *rw_shard_thread(void *arg) {
+  rw_shard_t *shard = arg;
+  rw_queue_t const *q = shard->queue;
+
+  uint8_t *batch = NULL;
+  size_t batch_size = 0;
+  char *encoded = NULL;
+  size_t encoded_size = 0;
+
+  pthread_mutex_lock(&shard->lock);
+  while (42) {
+    /* Wait for a full batch, the batch deadline or shutdown. */
+    while (!shard->shutdown &&
+           (shard->pending_samples < q->max_samples_per_send)) {
+      if (shard->pending_samples == 0) {
+        pthread_cond_wait(&shard->cond, &shard->lock);
+        continue;
+      }
+
+      cdtime_t deadline = shard->pending_since + q->batch_send_deadline;
+      if (cdtime() >= deadline)
+        break;
+      struct timespec until = CDTIME_T_TO_TIMESPEC(deadline);
+      pthread_cond_timedwait(&shard->cond, &shard->lock, &until);
+    }
+
+    if (shard->pending_samples == 0) {
+      if (shard->shutdown)
+        break;
+      continue;
+    }
+
+    /* Take all pending samples and send them in batches of at most
+     * "MaxSamplesPerSend". */
+    uint8_t *data = shard->pending;
+    size_t len = shard->pending_len;
+    size_t size = shard->pending_size;
+    shard->pending = batch;
+    shard->pending_size = batch_size;
+    shard->pending_len = 0;
+    shard->pending_samples = 0;
+    batch = data;
+    batch_size = size;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (encoded_size < snappy_encode_bound(len)) {
+      sfree(encoded);
+      encoded_size = snappy_encode_bound(len);
+      encoded = malloc(encoded_size);
+    }
+
+    size_t pos = 0;
+    while ((encoded != NULL) && (pos < len)) {
+      size_t samples = 0;
+      size_t end =
+          rw_batch_end(data + pos, len - pos, q->max_samples_per_send, &samples);
+      rw_send(shard, data + pos, end, samples, encoded);
+      pos += end;
+    }
+    if (encoded == NULL) {
+      ERROR("write_prometheus plugin: malloc(%" PRIsz ") failed.",
+            snappy_encode_bound(len));
+      encoded_size = 0;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  sfree(batch);
+  sfree(encoded);
+  return NULL;
+}
+
+static int rw_config(oconfig_item_t *ci) {
+  if (remote_write != NULL) {
+    ERROR("write_prometheus plugin: Only one `RemoteWrite' block is "
+          "supported.");
+    return -1;
+  }
+
+  rw_queue_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return ENOMEM;
+  q->timeout_ms = RW_DEFAULT_TIMEOUT_MS;
+  q->batch_send_deadline = RW_DEFAULT_BATCH_SEND_DEADLINE;
+  q->min_backoff = RW_DEFAULT_MIN_BACKOFF;
+  q->max_backoff = RW_DEFAULT_MAX_BACKOFF;
+
+  int shards = RW_DEFAULT_SHARDS;
+  int capacity = RW_DEFAULT_CAPACITY;
+  int max_samples = RW_DEFAULT_MAX_SAMPLES_PER_SEND;
+  /* The URL may be given as the block's argument. */
+  int status = 0;
+  if (ci->values_num > 0)
+    status = cf_util_get_string(ci, &q->url);
+
+  for (int i = 0; (status == 0) && (i < ci->children_num); i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("URL", child->key) == 0) {
+      sfree(q->url);
+      status = cf_util_get_string(child, &q->url);
+    } else if (strcasecmp("Header", child->key) == 0) {
+      char *header = NULL;
+      status = cf_util_get_string(child, &header);
+      if (status == 0) {
+        q->headers = curl_slist_append(q->headers, header);
+        sfree(header);
+      }
+    } else if (strcasecmp("Timeout", child->key) == 0)
+      status = cf_util_get_int(child, &q->timeout_ms);
+    else if (strcasecmp("Shards", child->key) == 0)
+      status = cf_util_get_int(child, &shards);
+    else if (strcasecmp("Capacity", child->key) == 0)
+      status = cf_util_get_int(child, &capacity);
+    else if (strcasecmp("MaxSamplesPerSend", child->key) == 0)
+      status = cf_util_get_int(child, &max_samples);
+    else if (strcasecmp("BatchSendDeadline", child->key) == 0)
+      status = cf_util_get_cdtime(child, &q->batch_send_deadline);
+    else if (strcasecmp("MinBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &q->min_backoff);
+    else if (strcasecmp("MaxBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &q->max_backoff);
+    else {
+      ERROR("write_prometheus plugin: Invalid `RemoteWrite' option \"%s\".",
+            child->key);
+      status = EINVAL;
+    }
+  }
+
+  if ((status == 0) && ((q->url == NULL) || (shards < 1) ||
+                        (capacity < 1) || (max_samples < 1) ||
+                        (q->min_backoff == 0) ||
+                        (q->max_backoff < q->min_backoff))) {
+    ERROR("write_prometheus plugin: `RemoteWrite' needs a URL, positive "
+          "Shards, Capacity and MaxSamplesPerSend and MinBackoff <= "
+          "MaxBackoff.");
+    status = EINVAL;
+  }
+
+  if (status != 0) {
+    sfree(q->url);
+    curl_slist_free_all(q->headers);
+    sfree(q);
+    return status;
+  }
+
+  q->shards_num = (size_t)shards;
+  q->capacity = (size_t)capacity;
+  q->max_samples_per_send = (size_t)max_samples;
+  q->headers = curl_slist_append(q->headers, "Content-Encoding: snappy");
+  q->headers =
+      curl_slist_append(q->headers, "Content-Type: application/x-protobuf");
+  q->headers =
+      curl_slist_append(q->headers, "X-Prometheus-Remote-Write-Version: 0.1.0");
+  q->headers = curl_slist_append(q->headers, "Expect:");
+
+  remote_write = q;
+  return 0;
+}
+
+static int rw_start(void) {
+  rw_queue_t *q = remote_write;
+  if ((q == NULL) || (q->shards != NULL))
+    return 0;
+
+  curl_global_init(CURL_GLOBAL_SSL);
+
+  q->shards = calloc(q->shards_num, sizeof(*q->shards));
+  if (q->shards == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < q->shards_num; i++) {
+    rw_shard_t *shard = q->shards + i;
+
+    shard->queue = q;
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->cond, NULL);
+    C_COMPLAIN_INIT(&shard->complaint);
+
+    shard->curl = curl_easy_init();
+    if (shard->curl == NULL) {
+      ERROR("write_prometheus plugin: curl_easy_init failed.");
+      return -1;
+    }
+    curl_easy_setopt(shard->curl, CURLOPT_URL, q->url);
+    curl_easy_setopt(shard->curl, CURLOPT_HTTPHEADER, q->headers);
+    curl_easy_setopt(shard->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(shard->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+    curl_easy_setopt(shard->curl, CURLOPT_ERRORBUFFER, shard->curl_errbuf);
+    curl_easy_setopt(shard->curl, CURLOPT_WRITEFUNCTION, rw_discard_callback);
+#ifdef HAVE_CURLOPT_TIMEOUT_MS
+    if (q->timeout_ms > 0)
+      curl_easy_setopt(shard->curl, CURLOPT_TIMEOUT_MS, (long)q->timeout_ms);
+#endif
+
+    int status = plugin_thread_create(&shard->thread, rw_shard_thread, shard,
+                                      "prometheus rw");
+    if (status != 0) {
+      ERROR("write_prometheus plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      return -1;
+    }
+    shard->thread_running = true;
+  }
+
+  return 0;
+}
+
+/* rw_stop sends the remaining samples and stops the shard threads of q, which
+ * must no longer be reachable through "remote_write". */
+static void rw_stop(rw_queue_t *q) {
+  if (q == NULL)
+    return;
+
+  for (size_t i = 0; (q->shards != NULL) && (i < q->shards_num); i++) {
+    pthread_mutex_lock(&q->shards[i].lock);
+    q->shards[i].shutdown = true;
+    pthread_cond_signal(&q->shards[i].cond);
+    pthread_mutex_unlock(&q->shards[i].lock);
+  }
+
+  for (size_t i = 0; (q->shards != NULL) && (i < q->shards_num); i++) {
+    rw_shard_t *shard = q->shards + i;
+
+    if (shard->thread_running)
+      pthread_join(shard->thread, NULL);
+    if (shard->curl != NULL)
+      curl_easy_cleanup(shard->curl);
+    sfree(shard->pending);
+    pthread_cond_destroy(&shard->cond);
+    pthread_mutex_destroy(&shard->lock);
+  }
+
+  sfree(q->shards);
+  sfree(q->url);
+  curl_slist_free_all(q->headers);
+  sfree(q);
+}
+#endif /* WRITE_PROMETHEUS_REMOTE_WRITE */
+/* }}} */
+
 /*
  * collectd callbacks
  */
@@ -881,8 +1943,34 @@ static int prom_config(oconfig_item_t *ci) {
       int status = cf_util_get_port_number(child);
       if (status > 0)
         httpd_port = (unsigned short)status;
+    } else if (strcasecmp("Threads", child->key) == 0) {
+#if MHD_VERSION >= 0x00090000
+      if ((cf_util_get_int(child, &httpd_threads) != 0) ||
+          (httpd_threads < 0)) {
+        ERROR("write_prometheus plugin: Option `Threads' needs a "
+              "non-negative number.");
+        return -1;
+      }
+#else
+      ERROR("write_prometheus plugin: Option `Threads' not supported. Please "
+            "upgrade libmicrohttpd to at least 0.9.0");
+      return -1;
+#endif
     } else if (strcasecmp("StalenessDelta", child->key) == 0) {
       cf_util_get_cdtime(child, &staleness_delta);
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      cf_util_get_boolean(child, &compression);
+    } else if (strcasecmp("ResponseCacheTime", child->key) == 0) {
+      cf_util_get_cdtime(child, &response_cache_time);
+    } else if (strcasecmp("RemoteWrite", child->key) == 0) {
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+      if (rw_config(child) != 0)
+        return -1;
+#else
+      ERROR("write_prometheus plugin: Option `RemoteWrite' not supported. "
+            "collectd has been built without libcurl.");
+      return -1;
+#endif
     } else {
       WARNING("write_prometheus plugin: Ignoring unknown configuration option "
               "\"%s\".",
@@ -911,6 +1999,13 @@ static int prom_init() {
           MHD_get_version());
   }
 
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+  if (rw_start() != 0) {
+    ERROR("write_prometheus plugin: Starting remote write failed.");
+    return -1;
+  }
+#endif
+
   return 0;
 }
 
@@ -924,13 +2019,20 @@ static int prom_write(data_set_t const *ds, value_list_t const *vl,
     if (fam == NULL)
       continue;
 
-    int status = metric_family_update(fam, ds, vl, i);
+    Io__Prometheus__Client__Metric *m = NULL;
+    int status = metric_family_update(fam, ds, vl, i, &m);
     if (status != 0) {
       ERROR("write_prometheus plugin: Updating metric \"%s\" failed with "
             "status %d",
             fam->name, status);
       continue;
     }
+
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+    /* Remote write only supports gauges and counters. */
+    if ((remote_write != NULL) && (m->histogram == NULL))
+      rw_enqueue(fam, m, vl->time);
+#endif
   }
 
   pthread_mutex_unlock(&metrics_lock);
@@ -982,6 +2084,24 @@ static int prom_shutdown() {
     httpd = NULL;
   }
 
+  pthread_mutex_lock(&responses_lock);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(responses); i++) {
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(responses[i]); j++) {
+      if (responses[i][j].res != NULL)
+        MHD_destroy_response(responses[i][j].res);
+      responses[i][j].res = NULL;
+    }
+  }
+  pthread_mutex_unlock(&responses_lock);
+
+#if WRITE_PROMETHEUS_REMOTE_WRITE
+  pthread_mutex_lock(&metrics_lock);
+  rw_queue_t *q = remote_write;
+  remote_write = NULL;
+  pthread_mutex_unlock(&metrics_lock);
+  rw_stop(q);
+#endif
+
   pthread_mutex_lock(&metrics_lock);
   if (metrics != NULL) {
     char *name;
@@ -48,6 +48,17 @@ struct wr_node_s {
   int max_set_duration;
   bool store_rates;
 
+  /* Commands are pipelined and their replies are only read once
+   * "batch_size" value lists have been appended or the oldest of them is
+   * "batch_timeout" old. With "transaction" set, each batch is wrapped in
+   * MULTI / EXEC. */
+  int batch_size;
+  cdtime_t batch_timeout;
+  bool transaction;
+  int batch_values;
+  int batch_replies;
+  cdtime_t batch_start;
+
   redisContext *conn;
   pthread_mutex_t lock;
 };
@@ -56,6 +67,113 @@ typedef struct wr_node_s wr_node_t;
 /*
  * Functions
  */
+static int wr_connect_nolock(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    redisFree(node->conn);
+    node->conn = NULL;
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  return 0;
+} /* }}} int wr_connect_nolock */
+
+static void wr_disconnect_nolock(wr_node_t *node) /* {{{ */
+{
+  if (node->conn != NULL) {
+    redisFree(node->conn);
+    node->conn = NULL;
+  }
+  node->batch_values = 0;
+  node->batch_replies = 0;
+} /* }}} void wr_disconnect_nolock */
+
+static int wr_append(wr_node_t *node, const char *format, ...) /* {{{ */
+{
+  va_list ap;
+  int status;
+
+  va_start(ap, format);
+  status = redisvAppendCommand(node->conn, format, ap);
+  va_end(ap);
+
+  if (status != REDIS_OK) {
+    ERROR("write_redis plugin: Appending command \"%s\" failed: %s", format,
+          node->conn->errstr);
+    return -1;
+  }
+
+  node->batch_replies++;
+  return 0;
+} /* }}} int wr_append */
+
+static void wr_check_reply(const redisReply *rr) /* {{{ */
+{
+  if (rr->type == REDIS_REPLY_ERROR) {
+    WARNING("write_redis plugin: Command failed: %s", rr->str);
+  } else if (rr->type == REDIS_REPLY_ARRAY) {
+    /* EXEC returns the replies of all queued commands. */
+    for (size_t i = 0; i < rr->elements; i++)
+      wr_check_reply(rr->element[i]);
+  }
+} /* }}} void wr_check_reply */
+
+/* Reads the replies of all pipelined commands. On connection errors the
+ * connection is dropped so that the next write reconnects. */
+static int wr_flush_nolock(wr_node_t *node) /* {{{ */
+{
+  if ((node->conn == NULL) || (node->batch_replies == 0))
+    return 0;
+
+  if (node->transaction && (wr_append(node, "EXEC") != 0)) {
+    wr_disconnect_nolock(node);
+    return -1;
+  }
+
+  while (node->batch_replies > 0) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void **)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: Reading replies from \"%s\" failed, "
+            "dropping %i value list(s): %s",
+            (node->host != NULL) ? node->host : "localhost",
+            node->batch_values, node->conn->errstr);
+      wr_disconnect_nolock(node);
+      return -1;
+    }
+    node->batch_replies--;
+
+    wr_check_reply(rr);
+    freeReplyObject(rr);
+  }
+
+  node->batch_values = 0;
+  return 0;
+} /* }}} int wr_flush_nolock */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -66,7 +184,6 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   size_t value_size;
   char *value_ptr;
   int status;
-  redisReply *rr;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
@@ -84,80 +201,72 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
+  if (wr_connect_nolock(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
 
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (node->batch_values == 0) {
+    node->batch_start = cdtime();
+    if (node->transaction)
+      status = wr_append(node, "MULTI");
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
-    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  if (status == 0)
+    status = wr_append(node, "ZADD %s %s %s", key, time, value);
 
-  if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
-  }
+  if ((status == 0) && (node->max_set_size >= 0))
+    status = wr_append(node, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                       (-1 * node->max_set_size) - 1);
 
-  if (node->max_set_duration > 0) {
+  if ((status == 0) && (node->max_set_duration > 0)) {
     /*
      * remove element, scored less than 'current-max_set_duration'
      * '(...' indicates 'less than' in redis CLI.
      */
-    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
-                      (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration));
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+    status = wr_append(node, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
+                       (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration));
   }
 
   /* TODO(octo): This is more overhead than necessary. Use the cache and
    * metadata to determine if it is a new metric and call SADD only once for
    * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
-    WARNING("SADD command error. ident:%s message:%s", ident,
-            node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  if (status == 0)
+    status = wr_append(
+        node, "SADD %svalues %s",
+        (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
+
+  if (status != 0) {
+    wr_disconnect_nolock(node);
+    pthread_mutex_unlock(&node->lock);
+    return status;
+  }
+
+  node->batch_values++;
+  if ((node->batch_values >= node->batch_size) ||
+      ((cdtime() - node->batch_start) >= node->batch_timeout))
+    status = wr_flush_nolock(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->batch_values > 0) &&
+      ((timeout == 0) || ((cdtime() - node->batch_start) >= timeout)))
+    status = wr_flush_nolock(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -165,10 +274,8 @@ static void wr_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  if (node->conn != NULL) {
-    redisFree(node->conn);
-    node->conn = NULL;
-  }
+  wr_flush_nolock(node);
+  wr_disconnect_nolock(node);
 
   sfree(node->host);
   sfree(node);
@@ -193,6 +300,9 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->max_set_size = -1;
   node->max_set_duration = -1;
   node->store_rates = true;
+  node->batch_size = 1;
+  node->batch_timeout = 0;
+  node->transaction = false;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -229,6 +339,16 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_duration);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_redis plugin: BatchSize must be at least 1.");
+        status = EINVAL;
+      }
+    } else if (strcasecmp("BatchTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->batch_timeout);
+    } else if (strcasecmp("Transaction", child->key) == 0) {
+      status = cf_util_get_boolean(child, &node->transaction);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -237,6 +357,9 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       break;
   } /* for (i = 0; i < ci->children_num; i++) */
 
+  if ((status == 0) && (node->batch_timeout == 0))
+    node->batch_timeout = plugin_get_interval();
+
   if (status == 0) {
     char cb_name[sizeof("write_redis/") + DATA_MAX_NAME_LEN];
 
@@ -247,6 +370,8 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
                                        .data = node,
                                        .free_func = wr_config_free,
                                    });
+    if ((status == 0) && (node->batch_size > 1))
+      plugin_register_flush(cb_name, wr_flush, &(user_data_t){.data = node});
   }
 
   if (status != 0)
@@ -42,6 +42,7 @@
 #define RIEMANN_PORT 5555
 #define RIEMANN_TTL_FACTOR 2.0
 #define RIEMANN_BATCH_MAX 8192
+#define RIEMANN_WINDOW 4
 
 struct riemann_host {
   c_complain_t init_complaint;
@@ -67,6 +68,31 @@ struct riemann_host {
   char *tls_cert_file;
   char *tls_key_file;
   struct timeval timeout;
+
+  /* Asynchronous mode: flushed batches are queued and sent by a sender thread,
+   * which keeps up to "window" batches unacknowledged. The queue and the spare
+   * messages are protected by "lock". */
+  bool async;
+  int window;
+  riemann_message_t **queue;
+  size_t queue_size;
+  size_t queue_head;
+  size_t queue_len;
+  pthread_cond_t queue_cond; /* signals the sender: batch queued */
+  pthread_cond_t space_cond; /* signals writers: batch dequeued */
+  pthread_t sender;
+  bool sender_running;
+  bool sender_shutdown;
+  /* Only used by the sender thread. */
+  riemann_message_t **inflight;
+  size_t inflight_head;
+  size_t inflight_num;
+
+  /* Sent messages are kept for reuse, so that their event arrays need not be
+   * reallocated for every batch. */
+  riemann_message_t **spare;
+  size_t spare_num;
+  size_t spare_size;
 };
 
 static char **riemann_tags;
@@ -417,13 +443,86 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
   return event;
 } /* }}} riemann_event_t *wrr_value_to_event */
 
+/* Frees the events of "msg" but keeps the message and its event array, so it
+ * can be filled again. */
+static void wrr_message_clear(riemann_message_t *msg) /* {{{ */
+{
+  for (size_t i = 0; i < msg->n_events; i++)
+    riemann_event_free(msg->events[i]);
+  msg->n_events = 0;
+} /* }}} void wrr_message_clear */
+
+/* host->lock must be held when calling this function. */
+static riemann_message_t *wrr_message_get(struct riemann_host *host) /* {{{ */
+{
+  if (host->spare_num > 0) {
+    host->spare_num--;
+    return host->spare[host->spare_num];
+  }
+
+  riemann_message_t *msg = riemann_message_new();
+  if (msg == NULL)
+    ERROR("write_riemann plugin: riemann_message_new failed.");
+  return msg;
+} /* }}} riemann_message_t *wrr_message_get */
+
+/* Returns a cleared message to the spare list. host->lock must be held when
+ * calling this function. */
+static void wrr_message_put(struct riemann_host *host, /* {{{ */
+                            riemann_message_t *msg) {
+  if (msg == NULL)
+    return;
+
+  if (host->spare_num < host->spare_size) {
+    host->spare[host->spare_num] = msg;
+    host->spare_num++;
+    return;
+  }
+  riemann_message_free(msg);
+} /* }}} void wrr_message_put */
+
+/* Appends the events of "vl" to "msg". On failure, "msg" is left unchanged. */
+static int wrr_value_list_append(struct riemann_host const *host, /* {{{ */
+                                 riemann_message_t *msg, data_set_t const *ds,
+                                 value_list_t const *vl, int *statuses) {
+  riemann_event_t *events[vl->values_len];
+  gauge_t *rates = NULL;
+
+  if (host->store_rates) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      ERROR("write_riemann plugin: uc_get_rate failed.");
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    events[i] = wrr_value_to_event(host, ds, vl, (int)i, rates, statuses[i]);
+    if (events[i] == NULL) {
+      for (size_t j = 0; j < i; j++)
+        riemann_event_free(events[j]);
+      sfree(rates);
+      return -1;
+    }
+  }
+  sfree(rates);
+
+  int status = riemann_message_append_events_n(msg, vl->values_len, events);
+  if (status != 0) {
+    ERROR("write_riemann plugin: out of memory");
+    for (size_t i = 0; i < vl->values_len; i++)
+      riemann_event_free(events[i]);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int wrr_value_list_append */
+
 static riemann_message_t *
 wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
                           data_set_t const *ds, value_list_t const *vl,
                           int *statuses) {
   riemann_message_t *msg;
-  size_t i;
-  gauge_t *rates = NULL;
 
   /* Initialize the Msg structure. */
   msg = riemann_message_new();
@@ -432,30 +531,165 @@ wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
     return NULL;
   }
 
-  if (host->store_rates) {
-    rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      ERROR("write_riemann plugin: uc_get_rate failed.");
-      riemann_message_free(msg);
-      return NULL;
-    }
+  if (wrr_value_list_append(host, msg, ds, vl, statuses) != 0) {
+    riemann_message_free(msg);
+    return NULL;
   }
 
-  for (i = 0; i < vl->values_len; i++) {
-    riemann_event_t *event;
+  return msg;
+} /* }}} riemann_message_t *wrr_value_list_to_message */
 
-    event = wrr_value_to_event(host, ds, vl, (int)i, rates, statuses[i]);
-    if (event == NULL) {
-      riemann_message_free(msg);
-      sfree(rates);
-      return NULL;
+/* Drops all unacknowledged batches, e.g. after the connection broke. Called by
+ * the sender thread without holding host->lock. */
+static void wrr_sender_reset(struct riemann_host *host) /* {{{ */
+{
+  if (host->inflight_num > 0)
+    c_complain(LOG_ERR, &host->init_complaint,
+               "write_riemann plugin: Connection to %s failed, %zu "
+               "unacknowledged batch(es) have been lost.",
+               host->name, host->inflight_num);
+
+  wrr_disconnect(host);
+
+  while (host->inflight_num > 0) {
+    riemann_message_t *msg = host->inflight[host->inflight_head];
+    host->inflight_head = (host->inflight_head + 1) % host->window;
+    host->inflight_num--;
+
+    wrr_message_clear(msg);
+    pthread_mutex_lock(&host->lock);
+    wrr_message_put(host, msg);
+    pthread_mutex_unlock(&host->lock);
+  }
+  host->inflight_head = 0;
+} /* }}} void wrr_sender_reset */
+
+/* Sends "msg" without waiting for the acknowledgement. Called by the sender
+ * thread without holding host->lock. */
+static int wrr_sender_send(struct riemann_host *host, /* {{{ */
+                           riemann_message_t *msg) {
+  int status = wrr_connect(host);
+  if (status == 0)
+    status = riemann_client_send_message(host->client, msg);
+
+  if (status != 0) {
+    wrr_sender_reset(host);
+
+    wrr_message_clear(msg);
+    pthread_mutex_lock(&host->lock);
+    wrr_message_put(host, msg);
+    pthread_mutex_unlock(&host->lock);
+    return status;
+  }
+
+  size_t idx = (host->inflight_head + host->inflight_num) % host->window;
+  host->inflight[idx] = msg;
+  host->inflight_num++;
+  return 0;
+} /* }}} int wrr_sender_send */
+
+/* Waits for the acknowledgement of the oldest unacknowledged batch. Riemann
+ * answers the messages of one connection in order. */
+static int wrr_sender_recv(struct riemann_host *host) /* {{{ */
+{
+  riemann_message_t *response = riemann_client_recv_message(host->client);
+  if (response == NULL) {
+    int status = errno;
+    wrr_sender_reset(host);
+    return (status != 0) ? status : -1;
+  }
+
+  int status = 0;
+  if (response->has_ok && !response->ok) {
+    c_complain(LOG_ERR, &host->init_complaint,
+               "write_riemann plugin: Riemann at %s rejected a batch: %s",
+               host->name, (response->error != NULL) ? response->error : "");
+    status = -1;
+  } else {
+    c_release(LOG_INFO, &host->init_complaint,
+              "write_riemann plugin: Batches to %s are acknowledged again.",
+              host->name);
+  }
+  riemann_message_free(response);
+
+  riemann_message_t *msg = host->inflight[host->inflight_head];
+  host->inflight_head = (host->inflight_head + 1) % host->window;
+  host->inflight_num--;
+
+  wrr_message_clear(msg);
+  pthread_mutex_lock(&host->lock);
+  wrr_message_put(host, msg);
+  pthread_mutex_unlock(&host->lock);
+
+  return status;
+} /* }}} int wrr_sender_recv */
+
+static void *wrr_sender_thread(void *arg) /* {{{ */
+{
+  struct riemann_host *host = arg;
+
+  pthread_mutex_lock(&host->lock);
+  while (42) {
+    while ((host->queue_len == 0) && (host->inflight_num == 0) &&
+           !host->sender_shutdown)
+      pthread_cond_wait(&host->queue_cond, &host->lock);
+
+    if ((host->queue_len == 0) && (host->inflight_num == 0))
+      break; /* shutdown */
+
+    riemann_message_t *msg = NULL;
+    if ((host->queue_len > 0) &&
+        (host->inflight_num < (size_t)host->window)) {
+      msg = host->queue[host->queue_head];
+      host->queue_head = (host->queue_head + 1) % host->queue_size;
+      host->queue_len--;
+      pthread_cond_signal(&host->space_cond);
     }
-    riemann_message_append_events(msg, event, NULL);
+    pthread_mutex_unlock(&host->lock);
+
+    /* Keep sending while there is room in the window. Once it is full, or
+     * there is nothing left to send, collect acknowledgements. */
+    if (msg != NULL)
+      wrr_sender_send(host, msg);
+    else
+      wrr_sender_recv(host);
+
+    pthread_mutex_lock(&host->lock);
   }
+  pthread_mutex_unlock(&host->lock);
 
-  sfree(rates);
-  return msg;
-} /* }}} riemann_message_t *wrr_value_list_to_message */
+  return NULL;
+} /* }}} void *wrr_sender_thread */
+
+/* Hands "msg" over to the sender thread, starting it if necessary. If the
+ * queue is full, waits for the sender to catch up, so that values are not lost
+ * while the server is merely slow. If the server is unreachable, the sender
+ * drops batches and the queue keeps moving. host->lock must be held when
+ * calling this function. */
+static int wrr_enqueue_nolock(struct riemann_host *host, /* {{{ */
+                              riemann_message_t *msg) {
+  if (!host->sender_running) {
+    int status = plugin_thread_create(&host->sender, wrr_sender_thread, host,
+                                      "riemann sender");
+    if (status != 0) {
+      ERROR("write_riemann plugin: plugin_thread_create failed: %s",
+            STRERROR(status));
+      wrr_message_clear(msg);
+      wrr_message_put(host, msg);
+      return status;
+    }
+    host->sender_running = true;
+  }
+
+  while (host->queue_len == host->queue_size)
+    pthread_cond_wait(&host->space_cond, &host->lock);
+
+  size_t idx = (host->queue_head + host->queue_len) % host->queue_size;
+  host->queue[idx] = msg;
+  host->queue_len++;
+  pthread_cond_signal(&host->queue_cond);
+  return 0;
+} /* }}} int wrr_enqueue_nolock */
 
 /*
  * Always call while holding host->lock !
@@ -470,11 +704,21 @@ static int wrr_batch_flush_nolock(cdtime_t timeout, struct riemann_host *host) {
       return status;
     }
   }
-  wrr_send_nolock(host, host->batch_msg);
-  riemann_message_free(host->batch_msg);
 
+  riemann_message_t *msg = host->batch_msg;
   host->batch_init = now;
   host->batch_msg = NULL;
+  if ((msg == NULL) || (msg->n_events == 0)) {
+    wrr_message_put(host, msg);
+    return status;
+  }
+
+  if (host->async)
+    return wrr_enqueue_nolock(host, msg);
+
+  status = wrr_send_nolock(host, msg);
+  wrr_message_clear(msg);
+  wrr_message_put(host, msg);
   return status;
 }
 
@@ -506,36 +750,26 @@ static int wrr_batch_flush(cdtime_t timeout,
 static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
                                     data_set_t const *ds,
                                     value_list_t const *vl, int *statuses) {
-  riemann_message_t *msg;
   size_t len;
   int ret;
   cdtime_t timeout;
 
-  msg = wrr_value_list_to_message(host, ds, vl, statuses);
-  if (msg == NULL)
-    return -1;
-
   pthread_mutex_lock(&host->lock);
 
   if (host->batch_msg == NULL) {
-    host->batch_msg = msg;
-  } else {
-    int status;
-
-    status = riemann_message_append_events_n(host->batch_msg, msg->n_events,
-                                             msg->events);
-    msg->n_events = 0;
-    msg->events = NULL;
-
-    riemann_message_free(msg);
-
-    if (status != 0) {
+    host->batch_msg = wrr_message_get(host);
+    if (host->batch_msg == NULL) {
       pthread_mutex_unlock(&host->lock);
-      ERROR("write_riemann plugin: out of memory");
       return -1;
     }
   }
 
+  /* The events are built straight into the batch message. */
+  if (wrr_value_list_append(host, host->batch_msg, ds, vl, statuses) != 0) {
+    pthread_mutex_unlock(&host->lock);
+    return -1;
+  }
+
   len = riemann_message_get_packed_size(host->batch_msg);
   ret = 0;
   if ((host->batch_max < 0) || (((size_t)host->batch_max) <= len)) {
@@ -567,6 +801,13 @@ static int wrr_notification(const notification_t *n, user_data_t *ud) /* {{{ */
   if (msg == NULL)
     return -1;
 
+  if (host->async) {
+    pthread_mutex_lock(&host->lock);
+    status = wrr_enqueue_nolock(host, msg);
+    pthread_mutex_unlock(&host->lock);
+    return status;
+  }
+
   status = wrr_send(host, msg);
   if (status != 0)
     c_complain(
@@ -603,6 +844,13 @@ static int wrr_write(const data_set_t *ds, /* {{{ */
     if (msg == NULL)
       return -1;
 
+    if (host->async) {
+      pthread_mutex_lock(&host->lock);
+      status = wrr_enqueue_nolock(host, msg);
+      pthread_mutex_unlock(&host->lock);
+      return status;
+    }
+
     status = wrr_send(host, msg);
 
     riemann_message_free(msg);
@@ -625,9 +873,35 @@ static void wrr_free(void *p) /* {{{ */
     return;
   }
 
+  if (host->sender_running) {
+    /* The sender thread sends what is queued and waits for the
+     * acknowledgements before it exits. */
+    host->sender_shutdown = true;
+    pthread_cond_signal(&host->queue_cond);
+    pthread_mutex_unlock(&host->lock);
+    pthread_join(host->sender, /* retval = */ NULL);
+    pthread_mutex_lock(&host->lock);
+    host->sender_running = false;
+  }
+
   wrr_disconnect(host);
 
-  pthread_mutex_lock(&host->lock);
+  while (host->queue_len > 0) {
+    riemann_message_free(host->queue[host->queue_head]);
+    host->queue_head = (host->queue_head + 1) % host->queue_size;
+    host->queue_len--;
+  }
+  for (size_t i = 0; i < host->spare_num; i++)
+    riemann_message_free(host->spare[i]);
+  if (host->batch_msg != NULL)
+    riemann_message_free(host->batch_msg);
+  sfree(host->queue);
+  sfree(host->inflight);
+  sfree(host->spare);
+
+  pthread_mutex_unlock(&host->lock);
+  pthread_cond_destroy(&host->queue_cond);
+  pthread_cond_destroy(&host->space_cond);
   pthread_mutex_destroy(&host->lock);
   sfree(host);
 } /* }}} void wrr_free */
@@ -645,6 +919,8 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   pthread_mutex_init(&host->lock, NULL);
+  pthread_cond_init(&host->queue_cond, NULL);
+  pthread_cond_init(&host->space_cond, NULL);
   C_COMPLAIN_INIT(&host->init_complaint);
   host->reference_count = 1;
   host->node = NULL;
@@ -662,6 +938,8 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
   host->client_type = RIEMANN_CLIENT_TCP;
   host->timeout.tv_sec = 0;
   host->timeout.tv_usec = 0;
+  host->async = false;
+  host->window = RIEMANN_WINDOW;
 
   status = cf_util_get_string(ci, &host->name);
   if (status != 0) {
@@ -706,6 +984,19 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &host->batch_timeout);
       if (status != 0)
         break;
+    } else if (strcasecmp("Asynchronous", child->key) == 0) {
+      status = cf_util_get_boolean(child, &host->async);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("Window", child->key) == 0) {
+      status = cf_util_get_int(child, &host->window);
+      if (status != 0)
+        break;
+      if (host->window < 1) {
+        ERROR("write_riemann plugin: Window must be a positive number.");
+        status = -1;
+        break;
+      }
     } else if (strcasecmp("Timeout", child->key) == 0) {
 #if RCC_VERSION_NUMBER >= 0x010800
       status = cf_util_get_int(child, (int *)&host->timeout.tv_sec);
@@ -796,6 +1087,28 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return status;
   }
 
+  if (host->async && (host->client_type == RIEMANN_CLIENT_UDP)) {
+    WARNING("write_riemann plugin: Asynchronous mode requires the TCP or TLS "
+            "protocol. Sending synchronously to \"%s\".",
+            host->name);
+    host->async = false;
+  }
+
+  if (host->async) {
+    host->queue_size = 4 * (size_t)host->window;
+    host->queue = calloc(host->queue_size, sizeof(*host->queue));
+    host->inflight = calloc((size_t)host->window, sizeof(*host->inflight));
+  }
+  /* Enough spare messages for a full queue, a full window and the batch. */
+  host->spare_size = host->queue_size + (host->async ? host->window : 0) + 1;
+  host->spare = calloc(host->spare_size, sizeof(*host->spare));
+  if ((host->spare == NULL) ||
+      (host->async && ((host->queue == NULL) || (host->inflight == NULL)))) {
+    ERROR("write_riemann plugin: calloc failed.");
+    wrr_free(host);
+    return ENOMEM;
+  }
+
   ssnprintf(callback_name, sizeof(callback_name), "write_riemann/%s",
             host->name);
 
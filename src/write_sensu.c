@@ -31,68 +31,32 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
 #include <stddef.h>
 
 #include <stdlib.h>
 #define SENSU_HOST "localhost"
 #define SENSU_PORT "3030"
 
-#ifdef HAVE_ASPRINTF
-#define my_asprintf asprintf
-#define my_vasprintf vasprintf
-#else
-/*
- * asprintf() is available from Solaris 10 update 11.
- * For older versions, use asprintf() portable implementation from
- * https://github.com/littlstar/asprintf.c/blob/master/
- * copyright (c) 2014 joseph werle <joseph.werle@gmail.com> under MIT license.
- */
+#define SENSU_BATCH_MAX 8192
+/* How long to wait for the Sensu client to acknowledge a message. */
+#define SENSU_REPLY_TIMEOUT_MS 2000
+/* Bounds of the delay between failed connection attempts. */
+#define SENSU_BACKOFF_MIN TIME_T_TO_CDTIME_T(1)
+#define SENSU_BACKOFF_MAX TIME_T_TO_CDTIME_T(60)
 
-static int my_vasprintf(char **str, const char *fmt, va_list args) {
-  int size = 0;
-  va_list tmpa;
-  // copy
-  va_copy(tmpa, args);
-  // apply variadic arguments to
-  // sprintf with format to get size
-  size = vsnprintf(NULL, size, fmt, tmpa);
-  // toss args
-  va_end(tmpa);
-  // return -1 to be compliant if
-  // size is less than 0
-  if (size < 0) {
-    return -1;
-  }
-  // alloc with size plus 1 for `\0'
-  *str = (char *)malloc(size + 1);
-  // return -1 to be compliant
-  // if pointer is `NULL'
-  if (NULL == *str) {
-    return -1;
-  }
-  // format string with original
-  // variadic arguments and set new size
-  size = vsprintf(*str, fmt, args);
-  return size;
-}
-
-static int my_asprintf(char **str, const char *fmt, ...) {
-  int size = 0;
-  va_list args;
-  // init variadic argumens
-  va_start(args, fmt);
-  // format and get size
-  size = my_vasprintf(str, fmt, args);
-  // toss args
-  va_end(args);
-  return size;
-}
-
-#endif
+/* Growable buffer the JSON messages are built in. */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} sensu_buf_t;
 
 struct str_list {
   int nb_strs;
@@ -118,6 +82,25 @@ struct sensu_host {
   int s;
   struct addrinfo *res;
   int reference_count;
+
+  /* JSON of the handler lists, built once from the configuration. */
+  char *metric_handlers_json;
+  char *notification_handlers_json;
+
+  bool persistent;
+  bool batch_mode;
+  size_t batch_max;
+  cdtime_t batch_timeout;
+  cdtime_t batch_init;
+
+  /* Messages waiting to be sent. They are preceded by a '[' and separated by
+   * commas, so that more than one of them can be sent as a JSON array. */
+  sensu_buf_t send_buf;
+  size_t send_buf_num;
+
+  cdtime_t next_connect;
+  cdtime_t connect_backoff;
+  c_complain_t connect_complaint;
 };
 
 static char *sensu_tags;
@@ -133,7 +116,7 @@ static int add_str_to_list(struct str_list *strs,
     ERROR("write_sensu plugin: Unable to alloc memory");
     return -1;
   }
-  strs->strs = realloc(strs->strs, strs->nb_strs + 1);
+  strs->strs = realloc(strs->strs, (strs->nb_strs + 1) * sizeof(*strs->strs));
   if (strs->strs == NULL) {
     strs->strs = old_strs_ptr;
     free(newstr);
@@ -154,12 +137,83 @@ static void free_str_list(struct str_list *strs) /* {{{ */
 }
 /* }}} void free_str_list */
 
+static int sensu_buf_reserve(sensu_buf_t *buf, size_t need) /* {{{ */
+{
+  if (buf->size - buf->len >= need)
+    return 0;
+
+  size_t size = (buf->size == 0) ? 1024 : buf->size;
+  while (size - buf->len < need)
+    size *= 2;
+
+  char *data = realloc(buf->data, size);
+  if (data == NULL) {
+    ERROR("write_sensu plugin: Unable to alloc memory");
+    return ENOMEM;
+  }
+  buf->data = data;
+  buf->size = size;
+  return 0;
+} /* }}} int sensu_buf_reserve */
+
+__attribute__((format(printf, 2, 3))) static int
+sensu_buf_printf(sensu_buf_t *buf, char const *format, ...) /* {{{ */
+{
+  while (true) {
+    size_t avail = buf->size - buf->len;
+    va_list ap;
+
+    va_start(ap, format);
+    int status = vsnprintf((buf->data != NULL) ? buf->data + buf->len : NULL,
+                           avail, format, ap);
+    va_end(ap);
+
+    if (status < 0) {
+      ERROR("write_sensu plugin: vsnprintf failed");
+      return -1;
+    }
+    if ((size_t)status < avail) {
+      buf->len += (size_t)status;
+      return 0;
+    }
+
+    status = sensu_buf_reserve(buf, (size_t)status + 1);
+    if (status != 0)
+      return status;
+  }
+} /* }}} int sensu_buf_printf */
+
+static void sensu_send_buf_reset(struct sensu_host *host) /* {{{ */
+{
+  host->send_buf.len = 0;
+  host->send_buf_num = 0;
+  host->batch_init = cdtime();
+} /* }}} void sensu_send_buf_reset */
+
+/* Doubles the delay until the next connection attempt. */
+static void sensu_connect_failed(struct sensu_host *host, /* {{{ */
+                                 cdtime_t now) {
+  if (host->connect_backoff == 0)
+    host->connect_backoff = SENSU_BACKOFF_MIN;
+  else if (host->connect_backoff < SENSU_BACKOFF_MAX / 2)
+    host->connect_backoff *= 2;
+  else
+    host->connect_backoff = SENSU_BACKOFF_MAX;
+  host->next_connect = now + host->connect_backoff;
+} /* }}} void sensu_connect_failed */
+
 static int sensu_connect(struct sensu_host *host) /* {{{ */
 {
   int e;
   char const *node;
   char const *service;
 
+  /* Back off after failed attempts instead of trying again for every
+   * message. */
+  cdtime_t now = cdtime();
+  if (now < host->next_connect)
+    return EAGAIN;
+
   // Resolve the target if we haven't done already
   if (!(host->flags & F_READY)) {
     memset(&service, 0, sizeof(service));
@@ -175,6 +229,7 @@ static int sensu_connect(struct sensu_host *host) /* {{{ */
     if ((e = getaddrinfo(node, service, &ai_hints, &(host->res))) != 0) {
       ERROR("write_sensu plugin: Unable to resolve host \"%s\": %s", node,
             gai_strerror(e));
+      sensu_connect_failed(host, now);
       return -1;
     }
     DEBUG("write_sensu plugin: successfully resolved host/port: %s/%s", node,
@@ -211,9 +266,16 @@ static int sensu_connect(struct sensu_host *host) /* {{{ */
   }
 
   if (host->s < 0) {
-    WARNING("write_sensu plugin: Unable to connect to sensu client");
+    sensu_connect_failed(host, now);
+    c_complain(LOG_WARNING, &host->connect_complaint,
+               "write_sensu plugin: Unable to connect to sensu client");
     return -1;
   }
+
+  host->connect_backoff = 0;
+  host->next_connect = 0;
+  c_release(LOG_INFO, &host->connect_complaint,
+            "write_sensu plugin: Connected to sensu client");
   return 0;
 } /* }}} int sensu_connect */
 
@@ -228,41 +290,26 @@ static void sensu_close_socket(struct sensu_host *host) /* {{{ */
 static char *build_json_str_list(const char *tag,
                                  struct str_list const *list) /* {{{ */
 {
-  int res;
-  char *ret_str = NULL;
-  char *temp_str;
+  sensu_buf_t buf = {0};
+
   if (list->nb_strs == 0) {
-    ret_str = malloc(1);
-    if (ret_str == NULL) {
+    char *ret_str = strdup("");
+    if (ret_str == NULL)
       ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str[0] = '\0';
+    return ret_str;
   }
 
-  res = my_asprintf(&temp_str, "\"%s\": [\"%s\"", tag, list->strs[0]);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    free(ret_str);
-    return NULL;
-  }
-  for (int i = 1; i < list->nb_strs; i++) {
-    res = my_asprintf(&ret_str, "%s, \"%s\"", temp_str, list->strs[i]);
-    free(temp_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    temp_str = ret_str;
-  }
-  res = my_asprintf(&ret_str, "%s]", temp_str);
-  free(temp_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
+  int status = sensu_buf_printf(&buf, "\"%s\": [\"%s\"", tag, list->strs[0]);
+  for (int i = 1; (status == 0) && (i < list->nb_strs); i++)
+    status = sensu_buf_printf(&buf, ", \"%s\"", list->strs[i]);
+  if (status == 0)
+    status = sensu_buf_printf(&buf, "]");
+
+  if (status != 0) {
+    free(buf.data);
     return NULL;
   }
-
-  return ret_str;
+  return buf.data;
 } /* }}} char *build_json_str_list*/
 
 static int sensu_format_name2(char *ret, int ret_len, const char *hostname,
@@ -336,208 +383,84 @@ static void in_place_replace_sensu_name_reserved(char *orig_name) /* {{{ */
   }
 } /* }}} char *replace_sensu_name_reserved */
 
-static char *sensu_value_to_json(struct sensu_host const *host, /* {{{ */
-                                 data_set_t const *ds, value_list_t const *vl,
-                                 size_t index, gauge_t const *rates) {
+#define BUFFER_ADD(...)                                                        \
+  do {                                                                         \
+    int add_status = sensu_buf_printf(buf, __VA_ARGS__);                       \
+    if (add_status != 0)                                                       \
+      return add_status;                                                       \
+  } while (0)
+
+/* Appends the message for the "index"th value of "vl" to host->send_buf. */
+static int sensu_value_to_json(struct sensu_host *host, /* {{{ */
+                               data_set_t const *ds, value_list_t const *vl,
+                               size_t index, gauge_t const *rates) {
+  sensu_buf_t *buf = &host->send_buf;
   char name_buffer[5 * DATA_MAX_NAME_LEN];
   char service_buffer[6 * DATA_MAX_NAME_LEN];
-  char *ret_str;
-  char *temp_str;
-  char *value_str;
-  int res;
-  // First part of the JSON string
-  const char *part1 = "{\"name\": \"collectd\", \"type\": \"metric\"";
-
-  char *handlers_str =
-      build_json_str_list("handlers", &(host->metric_handlers));
-  if (handlers_str == NULL) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
+  char value_str[64];
+
+  BUFFER_ADD("%s{\"name\": \"collectd\", \"type\": \"metric\"",
+             (host->send_buf_num == 0) ? "[" : ",");
 
   // incorporate the handlers
-  if (strlen(handlers_str) == 0) {
-    free(handlers_str);
-    ret_str = strdup(part1);
-    if (ret_str == NULL) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  } else {
-    res = my_asprintf(&ret_str, "%s, %s", part1, handlers_str);
-    free(handlers_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  }
+  if (host->metric_handlers_json[0] != 0)
+    BUFFER_ADD(", %s", host->metric_handlers_json);
 
-  if (host->include_source) {
-    res = my_asprintf(&temp_str, "%s, \"source\": \"%s\"", ret_str, vl->host);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (host->include_source)
+    BUFFER_ADD(", \"source\": \"%s\"", vl->host);
 
   // incorporate the plugin name information
-  res = my_asprintf(&temp_str, "%s, \"collectd_plugin\": \"%s\"", ret_str,
-                    vl->plugin);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD(", \"collectd_plugin\": \"%s\"", vl->plugin);
 
   // incorporate the plugin type
-  res = my_asprintf(&temp_str, "%s, \"collectd_plugin_type\": \"%s\"", ret_str,
-                    vl->type);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD(", \"collectd_plugin_type\": \"%s\"", vl->type);
 
   // incorporate the plugin instance if any
-  if (vl->plugin_instance[0] != 0) {
-    res = my_asprintf(&temp_str, "%s, \"collectd_plugin_instance\": \"%s\"",
-                      ret_str, vl->plugin_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (vl->plugin_instance[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin_instance\": \"%s\"", vl->plugin_instance);
 
   // incorporate the plugin type instance if any
-  if (vl->type_instance[0] != 0) {
-    res =
-        my_asprintf(&temp_str, "%s, \"collectd_plugin_type_instance\": \"%s\"",
-                    ret_str, vl->type_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (vl->type_instance[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin_type_instance\": \"%s\"",
+               vl->type_instance);
 
   // incorporate the data source type
-  if ((ds->ds[index].type != DS_TYPE_GAUGE) && (rates != NULL)) {
-    char ds_type[DATA_MAX_NAME_LEN];
-    snprintf(ds_type, sizeof(ds_type), "%s:rate",
-             DS_TYPE_TO_STRING(ds->ds[index].type));
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_type\": \"%s\"",
-                      ret_str, ds_type);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  } else {
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_type\": \"%s\"",
-                      ret_str, DS_TYPE_TO_STRING(ds->ds[index].type));
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if ((ds->ds[index].type != DS_TYPE_GAUGE) && (rates != NULL))
+    BUFFER_ADD(", \"collectd_data_source_type\": \"%s:rate\"",
+               DS_TYPE_TO_STRING(ds->ds[index].type));
+  else
+    BUFFER_ADD(", \"collectd_data_source_type\": \"%s\"",
+               DS_TYPE_TO_STRING(ds->ds[index].type));
 
   // incorporate the data source name
-  res = my_asprintf(&temp_str, "%s, \"collectd_data_source_name\": \"%s\"",
-                    ret_str, ds->ds[index].name);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD(", \"collectd_data_source_name\": \"%s\"", ds->ds[index].name);
 
   // incorporate the data source index
-  {
-    char ds_index[DATA_MAX_NAME_LEN];
-    snprintf(ds_index, sizeof(ds_index), "%" PRIsz, index);
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_index\": %s",
-                      ret_str, ds_index);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  BUFFER_ADD(", \"collectd_data_source_index\": %" PRIsz, index);
 
   // add key value attributes from config if any
-  for (size_t i = 0; i < sensu_attrs_num; i += 2) {
-    res = my_asprintf(&temp_str, "%s, \"%s\": \"%s\"", ret_str, sensu_attrs[i],
-                      sensu_attrs[i + 1]);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  for (size_t i = 0; i < sensu_attrs_num; i += 2)
+    BUFFER_ADD(", \"%s\": \"%s\"", sensu_attrs[i], sensu_attrs[i + 1]);
 
   // incorporate sensu tags from config if any
-  if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0)) {
-    res = my_asprintf(&temp_str, "%s, %s", ret_str, sensu_tags);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0))
+    BUFFER_ADD(", %s", sensu_tags);
 
   // calculate the value and set to a string
-  if (ds->ds[index].type == DS_TYPE_GAUGE) {
-    res = my_asprintf(&value_str, GAUGE_FORMAT, vl->values[index].gauge);
-    if (res == -1) {
-      free(ret_str);
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  } else if (rates != NULL) {
-    res = my_asprintf(&value_str, GAUGE_FORMAT, rates[index]);
-    if (res == -1) {
-      free(ret_str);
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  } else {
-    if (ds->ds[index].type == DS_TYPE_DERIVE) {
-      res = my_asprintf(&value_str, "%" PRIi64, vl->values[index].derive);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    } else if (ds->ds[index].type == DS_TYPE_ABSOLUTE) {
-      res = my_asprintf(&value_str, "%" PRIu64, vl->values[index].absolute);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    } else {
-      res = my_asprintf(&value_str, "%" PRIu64,
-                        (uint64_t)vl->values[index].counter);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    }
-  }
+  if (ds->ds[index].type == DS_TYPE_GAUGE)
+    snprintf(value_str, sizeof(value_str), GAUGE_FORMAT,
+             vl->values[index].gauge);
+  else if (rates != NULL)
+    snprintf(value_str, sizeof(value_str), GAUGE_FORMAT, rates[index]);
+  else if (ds->ds[index].type == DS_TYPE_DERIVE)
+    snprintf(value_str, sizeof(value_str), "%" PRIi64,
+             vl->values[index].derive);
+  else if (ds->ds[index].type == DS_TYPE_ABSOLUTE)
+    snprintf(value_str, sizeof(value_str), "%" PRIu64,
+             vl->values[index].absolute);
+  else
+    snprintf(value_str, sizeof(value_str), "%" PRIu64,
+             (uint64_t)vl->values[index].counter);
 
   // Generate the full service name
   sensu_format_name2(name_buffer, sizeof(name_buffer), vl->host, vl->plugin,
@@ -562,23 +485,15 @@ static char *sensu_value_to_json(struct sensu_host const *host, /* {{{ */
   // happy
   in_place_replace_sensu_name_reserved(service_buffer);
 
-  // finalize the buffer by setting the output and closing curly bracket
-  res = my_asprintf(&temp_str, "%s, \"output\": \"%s %s %lld\"}\n", ret_str,
-                    service_buffer, value_str,
-                    (long long)CDTIME_T_TO_TIME_T(vl->time));
-  free(ret_str);
-  free(value_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  // finalize the message by setting the output and closing curly bracket
+  BUFFER_ADD(", \"output\": \"%s %s %lld\"}", service_buffer, value_str,
+             (long long)CDTIME_T_TO_TIME_T(vl->time));
 
   DEBUG("write_sensu plugin: Successfully created json for metric: "
         "host = \"%s\", service = \"%s\"",
         vl->host, service_buffer);
-  return ret_str;
-} /* }}} char *sensu_value_to_json */
+  return 0;
+} /* }}} int sensu_value_to_json */
 
 /*
  * Uses replace_str2() implementation from
@@ -664,15 +579,13 @@ static char *replace_json_reserved(const char *message) /* {{{ */
   return msg;
 } /* }}} char *replace_json_reserved */
 
-static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
-                                        notification_t const *n) {
+/* Appends the message for "n" to host->send_buf. */
+static int sensu_notification_to_json(struct sensu_host *host, /* {{{ */
+                                      notification_t const *n) {
+  sensu_buf_t *buf = &host->send_buf;
   char service_buffer[6 * DATA_MAX_NAME_LEN];
   char const *severity;
-  char *ret_str;
-  char *temp_str;
   int status;
-  size_t i;
-  int res;
   // add the severity/status
   switch (n->severity) {
   case NOTIF_OKAY:
@@ -691,125 +604,43 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
     severity = "UNKNOWN";
     status = 3;
   }
-  res = my_asprintf(&temp_str, "{\"status\": %d", status);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD("%s{\"status\": %d", (host->send_buf_num == 0) ? "[" : ",",
+             status);
 
   // incorporate the timestamp
-  res = my_asprintf(&temp_str, "%s, \"timestamp\": %lld", ret_str,
-                    (long long)CDTIME_T_TO_TIME_T(n->time));
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD(", \"timestamp\": %lld", (long long)CDTIME_T_TO_TIME_T(n->time));
 
-  if (host->include_source) {
-    res = my_asprintf(&temp_str, "%s, \"source\": \"%s\"", ret_str, n->host);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (host->include_source)
+    BUFFER_ADD(", \"source\": \"%s\"", n->host);
 
-  char *handlers_str =
-      build_json_str_list("handlers", &(host->notification_handlers));
-  if (handlers_str == NULL) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    free(ret_str);
-    return NULL;
-  }
   // incorporate the handlers
-  if (strlen(handlers_str) != 0) {
-    res = my_asprintf(&temp_str, "%s, %s", ret_str, handlers_str);
-    free(ret_str);
-    free(handlers_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  } else {
-    free(handlers_str);
-  }
+  if (host->notification_handlers_json[0] != 0)
+    BUFFER_ADD(", %s", host->notification_handlers_json);
 
   // incorporate the plugin name information if any
-  if (n->plugin[0] != 0) {
-    res = my_asprintf(&temp_str, "%s, \"collectd_plugin\": \"%s\"", ret_str,
-                      n->plugin);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (n->plugin[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin\": \"%s\"", n->plugin);
 
   // incorporate the plugin type if any
-  if (n->type[0] != 0) {
-    res = my_asprintf(&temp_str, "%s, \"collectd_plugin_type\": \"%s\"",
-                      ret_str, n->type);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (n->type[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin_type\": \"%s\"", n->type);
 
   // incorporate the plugin instance if any
-  if (n->plugin_instance[0] != 0) {
-    res = my_asprintf(&temp_str, "%s, \"collectd_plugin_instance\": \"%s\"",
-                      ret_str, n->plugin_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (n->plugin_instance[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin_instance\": \"%s\"", n->plugin_instance);
 
   // incorporate the plugin type instance if any
-  if (n->type_instance[0] != 0) {
-    res =
-        my_asprintf(&temp_str, "%s, \"collectd_plugin_type_instance\": \"%s\"",
-                    ret_str, n->type_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (n->type_instance[0] != 0)
+    BUFFER_ADD(", \"collectd_plugin_type_instance\": \"%s\"",
+               n->type_instance);
 
   // add key value attributes from config if any
-  for (i = 0; i < sensu_attrs_num; i += 2) {
-    res = my_asprintf(&temp_str, "%s, \"%s\": \"%s\"", ret_str, sensu_attrs[i],
-                      sensu_attrs[i + 1]);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  for (size_t i = 0; i < sensu_attrs_num; i += 2)
+    BUFFER_ADD(", \"%s\": \"%s\"", sensu_attrs[i], sensu_attrs[i + 1]);
 
   // incorporate sensu tags from config if any
-  if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0)) {
-    res = my_asprintf(&temp_str, "%s, %s", ret_str, sensu_tags);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0))
+    BUFFER_ADD(", %s", sensu_tags);
 
   // incorporate the service name
   sensu_format_name2(service_buffer, sizeof(service_buffer),
@@ -817,125 +648,154 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
                      n->type_instance, host->separator);
   // replace sensu event name chars that are considered illegal
   in_place_replace_sensu_name_reserved(service_buffer);
-  res = my_asprintf(&temp_str, "%s, \"name\": \"%s\"", ret_str,
-                    &service_buffer[1]);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD(", \"name\": \"%s\"", &service_buffer[1]);
 
   // incorporate the check output
   if (n->message[0] != 0) {
     char *msg = replace_json_reserved(n->message);
-    if (msg == NULL) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      free(ret_str);
-      return NULL;
-    }
-    res = my_asprintf(&temp_str, "%s, \"output\": \"%s - %s\"", ret_str,
-                      severity, msg);
-    free(ret_str);
+    if (msg == NULL)
+      return ENOMEM;
+    status = sensu_buf_printf(buf, ", \"output\": \"%s - %s\"", severity, msg);
     free(msg);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
+    if (status != 0)
+      return status;
   }
 
   // Pull in values from threshold and add extra attributes
   for (notification_meta_t *meta = n->meta; meta != NULL; meta = meta->next) {
     if (strcasecmp("CurrentValue", meta->name) == 0 &&
-        meta->type == NM_TYPE_DOUBLE) {
-      res = my_asprintf(&temp_str, "%s, \"current_value\": \"%.8f\"", ret_str,
-                        meta->nm_value.nm_double);
-      free(ret_str);
-      if (res == -1) {
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-      ret_str = temp_str;
-    }
-    if (meta->type == NM_TYPE_STRING) {
-      res = my_asprintf(&temp_str, "%s, \"%s\": \"%s\"", ret_str, meta->name,
-                        meta->nm_value.nm_string);
-      free(ret_str);
-      if (res == -1) {
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-      ret_str = temp_str;
-    }
+        meta->type == NM_TYPE_DOUBLE)
+      BUFFER_ADD(", \"current_value\": \"%.8f\"", meta->nm_value.nm_double);
+    if (meta->type == NM_TYPE_STRING)
+      BUFFER_ADD(", \"%s\": \"%s\"", meta->name, meta->nm_value.nm_string);
   }
 
   // close the curly bracket
-  res = my_asprintf(&temp_str, "%s}\n", ret_str);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  BUFFER_ADD("}");
 
   DEBUG("write_sensu plugin: Successfully created JSON for notification: "
         "host = \"%s\", service = \"%s\", state = \"%s\"",
         n->host, service_buffer, severity);
-  return ret_str;
-} /* }}} char *sensu_notification_to_json */
+  return 0;
+} /* }}} int sensu_notification_to_json */
+
+#undef BUFFER_ADD
 
-static int sensu_send_msg(struct sensu_host *host, const char *msg) /* {{{ */
+/* Waits for the Sensu client to acknowledge a message, which it does by
+ * responding "ok" on the same connection. */
+static int sensu_read_reply(struct sensu_host *host) /* {{{ */
 {
-  int status = 0;
-  size_t buffer_len;
+  char reply[64];
+
+  struct pollfd pfd = {.fd = host->s, .events = POLLIN};
+  int status = poll(&pfd, 1, SENSU_REPLY_TIMEOUT_MS);
+  if (status == 0)
+    return ETIMEDOUT;
+  else if (status < 0)
+    return errno;
+
+  ssize_t n = recv(host->s, reply, sizeof(reply) - 1, 0);
+  if (n < 0)
+    return errno;
+  else if (n == 0)
+    return ECONNRESET;
+
+  reply[n] = 0;
+  if (strncmp(reply, "ok", 2) != 0) {
+    ERROR("write_sensu plugin: The sensu client rejected a message: %s",
+          reply);
+    return EINVAL;
+  }
+  return 0;
+} /* }}} int sensu_read_reply */
 
-  status = sensu_connect(host);
-  if (status != 0)
-    return status;
+static int sensu_send_msg(struct sensu_host *host, const char *msg,
+                          size_t msg_len) /* {{{ */
+{
+  /* A kept-open connection may have been closed by the Sensu client in the
+   * meantime, so a failure on it is retried once on a new connection. */
+  bool reused = (host->s >= 0);
 
-  buffer_len = strlen(msg);
+  while (true) {
+    int status = 0;
 
-  status = (int)swrite(host->s, msg, buffer_len);
-  sensu_close_socket(host);
+    if (host->s < 0) {
+      status = sensu_connect(host);
+      if (status != 0)
+        return status;
+    }
 
-  if (status != 0) {
-    ERROR("write_sensu plugin: Sending to Sensu at %s:%s failed: %s",
-          (host->node != NULL) ? host->node : SENSU_HOST,
-          (host->service != NULL) ? host->service : SENSU_PORT, STRERRNO);
-    return -1;
-  }
+    status = (int)swrite(host->s, msg, msg_len);
+    if ((status == 0) && host->persistent) {
+      status = sensu_read_reply(host);
+      if (status == ETIMEDOUT) {
+        WARNING("write_sensu plugin: The sensu client at %s:%s does not "
+                "acknowledge messages. Disabling persistent connections.",
+                (host->node != NULL) ? host->node : SENSU_HOST,
+                (host->service != NULL) ? host->service : SENSU_PORT);
+        host->persistent = false;
+        status = 0;
+      }
+    }
 
-  return 0;
+    if ((status == 0) && host->persistent)
+      return 0;
+
+    sensu_close_socket(host);
+    if ((status == 0) || (status == EINVAL))
+      return status;
+
+    if (!reused) {
+      ERROR("write_sensu plugin: Sending to Sensu at %s:%s failed: %s",
+            (host->node != NULL) ? host->node : SENSU_HOST,
+            (host->service != NULL) ? host->service : SENSU_PORT,
+            (status > 0) ? STRERROR(status) : STRERRNO);
+      return -1;
+    }
+    reused = false;
+  }
 } /* }}} int sensu_send_msg */
 
-static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
+/* Sends all messages in host->send_buf, a single one as an object and more
+ * than one as an array. */
+static int sensu_send(struct sensu_host *host) /* {{{ */
 {
   int status = 0;
 
-  status = sensu_send_msg(host, msg);
-  if (status != 0) {
+  if (host->send_buf_num == 0)
+    return 0;
+
+  status =
+      sensu_buf_printf(&host->send_buf, (host->send_buf_num > 1) ? "]\n" : "\n");
+  if (status == 0) {
+    char const *msg = host->send_buf.data;
+    size_t msg_len = host->send_buf.len;
+    if (host->send_buf_num == 1) {
+      msg++;
+      msg_len--;
+    }
+    status = sensu_send_msg(host, msg, msg_len);
+  }
+  sensu_send_buf_reset(host);
+
+  if ((status != 0) && (status != EAGAIN) && (status != EINVAL)) {
     host->flags &= ~F_READY;
     if (host->res != NULL) {
       freeaddrinfo(host->res);
       host->res = NULL;
     }
-    return status;
   }
 
-  return 0;
+  return status;
 } /* }}} int sensu_send */
 
 static int sensu_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
-  int statuses[vl->values_len];
   struct sensu_host *host = ud->data;
   gauge_t *rates = NULL;
-  char *msg;
 
   pthread_mutex_lock(&host->lock);
-  memset(statuses, 0, vl->values_len * sizeof(*statuses));
 
   if (host->store_rates) {
     rates = uc_get_rate(ds, vl);
@@ -946,44 +806,71 @@ static int sensu_write(const data_set_t *ds, /* {{{ */
     }
   }
   for (size_t i = 0; i < vl->values_len; i++) {
-    msg = sensu_value_to_json(host, ds, vl, (int)i, rates);
-    if (msg == NULL) {
+    size_t len = host->send_buf.len;
+    if (sensu_value_to_json(host, ds, vl, i, rates) != 0) {
+      host->send_buf.len = len;
       sfree(rates);
       pthread_mutex_unlock(&host->lock);
       return -1;
     }
-    status = sensu_send(host, msg);
-    free(msg);
-    if (status != 0) {
-      ERROR("write_sensu plugin: sensu_send failed with status %i", status);
-      pthread_mutex_unlock(&host->lock);
-      sfree(rates);
-      return status;
+    host->send_buf_num++;
+
+    if (!host->batch_mode || (host->send_buf.len >= host->batch_max)) {
+      status = sensu_send(host);
+      if (status != 0)
+        break;
     }
   }
   sfree(rates);
+
+  if ((status == 0) && (host->batch_timeout != 0) &&
+      (cdtime() - host->batch_init >= host->batch_timeout))
+    status = sensu_send(host);
+
+  if ((status != 0) && (status != EAGAIN))
+    ERROR("write_sensu plugin: sensu_send failed with status %i", status);
   pthread_mutex_unlock(&host->lock);
   return status;
 } /* }}} int sensu_write */
 
+static int sensu_flush(cdtime_t timeout, /* {{{ */
+                       const char __attribute__((unused)) * identifier,
+                       user_data_t *ud) {
+  struct sensu_host *host = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&host->lock);
+  if ((timeout == 0) || (cdtime() - host->batch_init >= timeout))
+    status = sensu_send(host);
+  pthread_mutex_unlock(&host->lock);
+
+  return status;
+} /* }}} int sensu_flush */
+
 static int sensu_notification(const notification_t *n,
                               user_data_t *ud) /* {{{ */
 {
   int status;
   struct sensu_host *host = ud->data;
-  char *msg;
 
   pthread_mutex_lock(&host->lock);
 
-  msg = sensu_notification_to_json(host, n);
-  if (msg == NULL) {
-    pthread_mutex_unlock(&host->lock);
-    return -1;
+  /* Notifications are never batched: queued metrics go out first and the
+   * notification right after them. */
+  status = sensu_send(host);
+  if (status == 0) {
+    size_t len = host->send_buf.len;
+    status = sensu_notification_to_json(host, n);
+    if (status != 0) {
+      host->send_buf.len = len;
+      pthread_mutex_unlock(&host->lock);
+      return -1;
+    }
+    host->send_buf_num++;
+    status = sensu_send(host);
   }
 
-  status = sensu_send(host, msg);
-  free(msg);
-  if (status != 0)
+  if ((status != 0) && (status != EAGAIN))
     ERROR("write_sensu plugin: sensu_send failed with status %i", status);
   pthread_mutex_unlock(&host->lock);
 
@@ -1017,6 +904,9 @@ static void sensu_free(void *p) /* {{{ */
   sfree(host->separator);
   free_str_list(&(host->metric_handlers));
   free_str_list(&(host->notification_handlers));
+  sfree(host->metric_handlers_json);
+  sfree(host->notification_handlers_json);
+  sfree(host->send_buf.data);
 
   pthread_mutex_unlock(&host->lock);
   pthread_mutex_destroy(&host->lock);
@@ -1048,6 +938,13 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
   host->metric_handlers.strs = NULL;
   host->notification_handlers.nb_strs = 0;
   host->notification_handlers.strs = NULL;
+  host->s = -1;
+  host->persistent = true;
+  host->batch_mode = false;
+  host->batch_max = SENSU_BATCH_MAX;
+  host->batch_timeout = plugin_get_interval();
+  host->batch_init = cdtime();
+  C_COMPLAIN_INIT(&host->connect_complaint);
   host->separator = strdup("/");
   if (host->separator == NULL) {
     ERROR("write_sensu plugin: Unable to alloc memory");
@@ -1120,6 +1017,29 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &host->include_source);
       if (status != 0)
         break;
+    } else if (strcasecmp("PersistentConnection", child->key) == 0) {
+      status = cf_util_get_boolean(child, &host->persistent);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("Batch", child->key) == 0) {
+      status = cf_util_get_boolean(child, &host->batch_mode);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = (int)host->batch_max;
+      status = cf_util_get_int(child, &tmp);
+      if (status != 0)
+        break;
+      if (tmp <= 0) {
+        WARNING("write_sensu plugin: BatchMaxSize must be positive.");
+        status = -1;
+        break;
+      }
+      host->batch_max = (size_t)tmp;
+    } else if (strcasecmp("BatchFlushTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &host->batch_timeout);
+      if (status != 0)
+        break;
     } else {
       WARNING("write_sensu plugin: ignoring unknown config "
               "option: \"%s\"",
@@ -1165,6 +1085,16 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  host->metric_handlers_json =
+      build_json_str_list("handlers", &host->metric_handlers);
+  host->notification_handlers_json =
+      build_json_str_list("handlers", &host->notification_handlers);
+  if ((host->metric_handlers_json == NULL) ||
+      (host->notification_handlers_json == NULL)) {
+    sensu_free(host);
+    return -1;
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_sensu/%s", host->name);
 
   user_data_t ud = {.data = host, .free_func = sensu_free};
@@ -1179,6 +1109,16 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
               callback_name, status);
     else /* success */
       host->reference_count++;
+
+    if ((status == 0) && host->batch_mode) {
+      status = plugin_register_flush(callback_name, sensu_flush, &ud);
+      if (status != 0)
+        WARNING("write_sensu plugin: plugin_register_flush (\"%s\") "
+                "failed with status %i.",
+                callback_name, status);
+      else
+        host->reference_count++;
+    }
   }
 
   if (host->notifications) {
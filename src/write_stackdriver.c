@@ -44,25 +44,68 @@
 #define MONITORING_SCOPE "https://www.googleapis.com/auth/monitoring"
 #endif
 
+/* The API accepts at most 200 time series per timeSeries.create request. */
+#define WG_MAX_BATCH_SIZE 200
+
+/* Renew OAuth tokens in the background this long before they expire. */
+#define WG_TOKEN_REFRESH_SLACK TIME_T_TO_CDTIME_T(300)
+
+struct wg_callback_s;
+typedef struct wg_callback_s wg_callback_t;
+
+/* A request waiting to be sent by one of the worker threads. */
+struct wg_request_s;
+typedef struct wg_request_s wg_request_t;
+struct wg_request_s {
+  char *payload;
+  bool is_descriptor;
+  /* metric descriptors only: the metric to unregister if creation fails */
+  data_set_t const *ds;
+  value_list_t vl;
+
+  wg_request_t *next;
+};
+
+struct wg_worker_s {
+  wg_callback_t *cb;
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  pthread_t thread;
+};
+typedef struct wg_worker_s wg_worker_t;
+
 struct wg_callback_s {
   /* config */
   char *email;
   char *project;
   char *url;
   sd_resource_t *resource;
+  size_t batch_size;
+  size_t max_request_size;
+  size_t workers_num;
 
   /* runtime */
   oauth_t *auth;
   sd_output_t *formatter;
-  CURL *curl;
-  char curl_errbuf[CURL_ERROR_SIZE];
   /* used by flush */
   size_t timeseries_count;
   cdtime_t send_buffer_init_time;
 
+  /* Requests are queued by the write callback and sent by the workers.
+   * Time series are only sent once all metric descriptors queued before them
+   * have been created. */
+  wg_worker_t *workers;
+  size_t workers_running;
+  wg_request_t *queue_head;
+  wg_request_t *queue_tail;
+  size_t queue_length;
+  size_t descriptors_inflight;
+  bool shutdown;
+  pthread_cond_t queue_cond; /* signals workers: request queued */
+  pthread_cond_t space_cond; /* signals writers: request dequeued */
+
   pthread_mutex_t lock;
 };
-typedef struct wg_callback_s wg_callback_t;
 
 struct wg_memory_s {
   char *memory;
@@ -174,30 +217,32 @@ static char *api_error_string(api_error_t *err, char *buffer,
 // ret_content, if not NULL, will contain the server's response.
 // If ret_content is provided and the server responds with a 4xx or 5xx error,
 // an appropriate message will be logged.
-static int do_post(wg_callback_t *cb, char const *url, void const *payload,
+static int do_post(wg_worker_t *w, char const *url, void const *payload,
                    wg_memory_t *ret_content) {
-  if (cb->curl == NULL) {
-    cb->curl = curl_easy_init();
-    if (cb->curl == NULL) {
+  if (w->curl == NULL) {
+    w->curl = curl_easy_init();
+    if (w->curl == NULL) {
       ERROR("write_stackdriver plugin: curl_easy_init() failed");
       return -1;
     }
 
-    curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-    curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(w->curl, CURLOPT_ERRORBUFFER, w->curl_errbuf);
+    curl_easy_setopt(w->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(w->curl, CURLOPT_USERAGENT,
+                     PACKAGE_NAME "/" PACKAGE_VERSION);
   }
 
-  curl_easy_setopt(cb->curl, CURLOPT_POST, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_URL, url);
+  curl_easy_setopt(w->curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(w->curl, CURLOPT_URL, url);
 
   long timeout_ms = 2 * CDTIME_T_TO_MS(plugin_get_interval());
   if (timeout_ms < 10000) {
     timeout_ms = 10000;
   }
-  curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+  curl_easy_setopt(w->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
 
   /* header */
-  char *auth_header = wg_get_authorization_header(cb);
+  char *auth_header = wg_get_authorization_header(w->cb);
   if (auth_header == NULL) {
     ERROR("write_stackdriver plugin: getting access token failed with");
     return -1;
@@ -206,25 +251,25 @@ static int do_post(wg_callback_t *cb, char const *url, void const *payload,
   struct curl_slist *headers =
       curl_slist_append(NULL, "Content-Type: application/json");
   headers = curl_slist_append(headers, auth_header);
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(w->curl, CURLOPT_HTTPHEADER, headers);
 
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, payload);
+  curl_easy_setopt(w->curl, CURLOPT_POSTFIELDS, payload);
 
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION,
+  curl_easy_setopt(w->curl, CURLOPT_WRITEFUNCTION,
                    ret_content ? wg_write_memory_cb : NULL);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, ret_content);
+  curl_easy_setopt(w->curl, CURLOPT_WRITEDATA, ret_content);
 
-  int status = curl_easy_perform(cb->curl);
+  int status = curl_easy_perform(w->curl);
 
   /* clean up that has to happen in any case */
   curl_slist_free_all(headers);
   sfree(auth_header);
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, NULL);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, NULL);
-  curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, NULL);
+  curl_easy_setopt(w->curl, CURLOPT_HTTPHEADER, NULL);
+  curl_easy_setopt(w->curl, CURLOPT_WRITEFUNCTION, NULL);
+  curl_easy_setopt(w->curl, CURLOPT_WRITEDATA, NULL);
 
   if (status != CURLE_OK) {
-    ERROR("write_stackdriver plugin: POST %s failed: %s", url, cb->curl_errbuf);
+    ERROR("write_stackdriver plugin: POST %s failed: %s", url, w->curl_errbuf);
     if (ret_content != NULL) {
       sfree(ret_content->memory);
       ret_content->size = 0;
@@ -233,7 +278,7 @@ static int do_post(wg_callback_t *cb, char const *url, void const *payload,
   }
 
   long http_code = 0;
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_getinfo(w->curl, CURLINFO_RESPONSE_CODE, &http_code);
 
   if (ret_content != NULL) {
     if ((http_code >= 400) && (http_code < 500)) {
@@ -248,14 +293,15 @@ static int do_post(wg_callback_t *cb, char const *url, void const *payload,
   return (int)http_code;
 } /* int do_post */
 
-static int wg_call_metricdescriptor_create(wg_callback_t *cb,
+static int wg_call_metricdescriptor_create(wg_worker_t *w,
                                            char const *payload) {
+  wg_callback_t *cb = w->cb;
   char url[1024];
   ssnprintf(url, sizeof(url), "%s/projects/%s/metricDescriptors", cb->url,
             cb->project);
   wg_memory_t response = {0};
 
-  int status = do_post(cb, url, payload, &response);
+  int status = do_post(w, url, payload, &response);
   if (status == -1) {
     ERROR("write_stackdriver plugin: POST %s failed", url);
     return -1;
@@ -271,13 +317,14 @@ static int wg_call_metricdescriptor_create(wg_callback_t *cb,
   return 0;
 } /* int wg_call_metricdescriptor_create */
 
-static int wg_call_timeseries_write(wg_callback_t *cb, char const *payload) {
+static int wg_call_timeseries_write(wg_worker_t *w, char const *payload) {
+  wg_callback_t *cb = w->cb;
   char url[1024];
   ssnprintf(url, sizeof(url), "%s/projects/%s/timeSeries", cb->url,
             cb->project);
   wg_memory_t response = {0};
 
-  int status = do_post(cb, url, payload, &response);
+  int status = do_post(w, url, payload, &response);
   if (status == -1) {
     ERROR("write_stackdriver plugin: POST %s failed", url);
     return -1;
@@ -299,27 +346,191 @@ static void wg_reset_buffer(wg_callback_t *cb) /* {{{ */
   cb->send_buffer_init_time = cdtime();
 } /* }}} wg_reset_buffer */
 
+static void wg_request_free(wg_request_t *r) /* {{{ */
+{
+  if (r == NULL)
+    return;
+
+  sfree(r->payload);
+  sfree(r);
+} /* }}} void wg_request_free */
+
+/* wg_enqueue_nolock appends a request to the send queue. If the workers are
+ * falling behind, it waits for the queue to drain, pushing back on the write
+ * threads. Takes ownership of "r". Must be called with cb->lock held. */
+static int wg_enqueue_nolock(wg_callback_t *cb, wg_request_t *r) /* {{{ */
+{
+  size_t queue_limit = 4 * cb->workers_num;
+
+  while ((cb->queue_length >= queue_limit) && !cb->shutdown)
+    pthread_cond_wait(&cb->space_cond, &cb->lock);
+
+  if (cb->shutdown) {
+    wg_request_free(r);
+    return ECANCELED;
+  }
+
+  r->next = NULL;
+  if (cb->queue_tail == NULL)
+    cb->queue_head = r;
+  else
+    cb->queue_tail->next = r;
+  cb->queue_tail = r;
+  cb->queue_length++;
+
+  pthread_cond_signal(&cb->queue_cond);
+  return 0;
+} /* }}} int wg_enqueue_nolock */
+
+/* wg_dequeue_nolock returns the next request the worker may send, or NULL.
+ * Must be called with cb->lock held. */
+static wg_request_t *wg_dequeue_nolock(wg_callback_t *cb) /* {{{ */
+{
+  wg_request_t *r = cb->queue_head;
+  if (r == NULL)
+    return NULL;
+  if (!r->is_descriptor && (cb->descriptors_inflight > 0))
+    return NULL;
+
+  cb->queue_head = r->next;
+  if (cb->queue_head == NULL)
+    cb->queue_tail = NULL;
+  cb->queue_length--;
+  r->next = NULL;
+
+  if (r->is_descriptor)
+    cb->descriptors_inflight++;
+
+  pthread_cond_signal(&cb->space_cond);
+  return r;
+} /* }}} wg_request_t *wg_dequeue_nolock */
+
+static void *wg_worker_thread(void *arg) /* {{{ */
+{
+  wg_worker_t *w = arg;
+  wg_callback_t *cb = w->cb;
+
+  pthread_mutex_lock(&cb->lock);
+  while (42) {
+    wg_request_t *r = wg_dequeue_nolock(cb);
+    if (r == NULL) {
+      if (cb->shutdown && (cb->queue_head == NULL))
+        break;
+
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() +
+                                                TIME_T_TO_CDTIME_T(10));
+      int status = pthread_cond_timedwait(&cb->queue_cond, &cb->lock, &ts);
+      if ((status == ETIMEDOUT) && (cb->auth != NULL)) {
+        /* Idle: renew the access token before it expires, so the next
+         * request does not have to wait for the token endpoint. */
+        pthread_mutex_unlock(&cb->lock);
+        oauth_refresh_token(cb->auth, WG_TOKEN_REFRESH_SLACK);
+        pthread_mutex_lock(&cb->lock);
+      }
+      continue;
+    }
+    pthread_mutex_unlock(&cb->lock);
+
+    int status;
+    if (r->is_descriptor) {
+      status = wg_call_metricdescriptor_create(w, r->payload);
+      if (status != 0)
+        ERROR("write_stackdriver plugin: wg_call_metricdescriptor_create "
+              "failed with status %d",
+              status);
+    } else {
+      status = wg_call_timeseries_write(w, r->payload);
+    }
+
+    if (cb->auth != NULL)
+      oauth_refresh_token(cb->auth, WG_TOKEN_REFRESH_SLACK);
+
+    pthread_mutex_lock(&cb->lock);
+    if (r->is_descriptor) {
+      /* Let the next write create the descriptor again. */
+      if (status != 0)
+        sd_output_unregister_metric(cb->formatter, r->ds, &r->vl);
+      cb->descriptors_inflight--;
+      pthread_cond_broadcast(&cb->queue_cond);
+    }
+    wg_request_free(r);
+  }
+  pthread_mutex_unlock(&cb->lock);
+
+  return NULL;
+} /* }}} void *wg_worker_thread */
+
+/* wg_workers_stop sends all queued requests and terminates the workers. */
+static void wg_workers_stop(wg_callback_t *cb) /* {{{ */
+{
+  pthread_mutex_lock(&cb->lock);
+  cb->shutdown = true;
+  pthread_cond_broadcast(&cb->queue_cond);
+  pthread_cond_broadcast(&cb->space_cond);
+  pthread_mutex_unlock(&cb->lock);
+
+  for (size_t i = 0; i < cb->workers_running; i++)
+    pthread_join(cb->workers[i].thread, /* retval = */ NULL);
+  cb->workers_running = 0;
+
+  for (size_t i = 0; i < cb->workers_num; i++) {
+    if (cb->workers[i].curl != NULL) {
+      curl_easy_cleanup(cb->workers[i].curl);
+      cb->workers[i].curl = NULL;
+    }
+  }
+
+  while (cb->queue_head != NULL) {
+    wg_request_t *r = cb->queue_head;
+    cb->queue_head = r->next;
+    wg_request_free(r);
+  }
+  cb->queue_tail = NULL;
+  cb->queue_length = 0;
+} /* }}} void wg_workers_stop */
+
 static int wg_callback_init(wg_callback_t *cb) /* {{{ */
 {
-  if (cb->curl != NULL)
+  if (cb->formatter != NULL)
     return 0;
 
+  if (cb->workers == NULL) {
+    cb->workers = calloc(cb->workers_num, sizeof(*cb->workers));
+    if (cb->workers == NULL) {
+      ERROR("write_stackdriver plugin: calloc failed.");
+      return -1;
+    }
+
+    for (size_t i = 0; i < cb->workers_num; i++) {
+      wg_worker_t *w = cb->workers + i;
+      w->cb = cb;
+
+      int status = plugin_thread_create(&w->thread, wg_worker_thread, w,
+                                        "stackdriver");
+      if (status != 0) {
+        ERROR("write_stackdriver plugin: plugin_thread_create failed: %s",
+              STRERROR(status));
+        break;
+      }
+      cb->workers_running++;
+    }
+    if (cb->workers_running == 0) {
+      sfree(cb->workers);
+      return -1;
+    }
+    /* The queue limit is derived from the number of workers. */
+    cb->workers_num = cb->workers_running;
+  }
+
   cb->formatter = sd_output_create(cb->resource);
   if (cb->formatter == NULL) {
     ERROR("write_stackdriver plugin: sd_output_create failed.");
     return -1;
   }
+  /* The formatter owns the resource now. */
+  cb->resource = NULL;
+  sd_output_set_max_size(cb->formatter, cb->max_request_size);
 
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
-    ERROR("write_stackdriver plugin: curl_easy_init failed.");
-    return -1;
-  }
-
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT,
-                   PACKAGE_NAME "/" PACKAGE_VERSION);
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
   wg_reset_buffer(cb);
 
   return 0;
@@ -340,10 +551,15 @@ static int wg_flush_nolock(cdtime_t timeout, wg_callback_t *cb) /* {{{ */
       return 0;
   }
 
-  char *payload = sd_output_reset(cb->formatter);
-  int status = wg_call_timeseries_write(cb, payload);
+  wg_request_t *r = calloc(1, sizeof(*r));
+  if (r == NULL) {
+    ERROR("write_stackdriver plugin: calloc failed.");
+    return ENOMEM;
+  }
+  r->payload = sd_output_reset(cb->formatter);
   wg_reset_buffer(cb);
-  return status;
+
+  return wg_enqueue_nolock(cb, r);
 } /* }}} wg_flush_nolock */
 
 static int wg_flush(cdtime_t timeout, /* {{{ */
@@ -359,7 +575,7 @@ static int wg_flush(cdtime_t timeout, /* {{{ */
 
   pthread_mutex_lock(&cb->lock);
 
-  if (cb->curl == NULL) {
+  if (cb->formatter == NULL) {
     status = wg_callback_init(cb);
     if (status != 0) {
       ERROR("write_stackdriver plugin: wg_callback_init failed.");
@@ -380,21 +596,31 @@ static void wg_callback_free(void *data) /* {{{ */
   if (cb == NULL)
     return;
 
+  if (cb->workers != NULL) {
+    wg_workers_stop(cb);
+    sfree(cb->workers);
+  }
+
   sd_output_destroy(cb->formatter);
   cb->formatter = NULL;
+  sd_resource_destroy(cb->resource);
+  cb->resource = NULL;
 
   sfree(cb->email);
   sfree(cb->project);
   sfree(cb->url);
 
   oauth_destroy(cb->auth);
-  if (cb->curl) {
-    curl_easy_cleanup(cb->curl);
-  }
 
+  pthread_cond_destroy(&cb->queue_cond);
+  pthread_cond_destroy(&cb->space_cond);
+  pthread_mutex_destroy(&cb->lock);
   sfree(cb);
 } /* }}} void wg_callback_free */
 
+/* wg_metric_descriptors_create queues the creation of the metric descriptors
+ * for vl and registers them with the formatter right away, so that values can
+ * be added to the current batch without waiting for the API. */
 static int wg_metric_descriptors_create(wg_callback_t *cb, const data_set_t *ds,
                                         const value_list_t *vl) {
   /* {{{ */
@@ -410,14 +636,26 @@ static int wg_metric_descriptors_create(wg_callback_t *cb, const data_set_t *ds,
       return status;
     }
 
-    status = wg_call_metricdescriptor_create(cb, buffer);
-    if (status != 0) {
-      ERROR("write_stackdriver plugin: wg_call_metricdescriptor_create failed "
-            "with "
-            "status %d",
-            status);
-      return status;
+    wg_request_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+      ERROR("write_stackdriver plugin: calloc failed.");
+      return ENOMEM;
     }
+    r->payload = strdup(buffer);
+    r->is_descriptor = true;
+    r->ds = ds;
+    r->vl = *vl;
+    r->vl.values = NULL;
+    r->vl.values_len = 0;
+    r->vl.meta = NULL;
+    if (r->payload == NULL) {
+      wg_request_free(r);
+      return ENOMEM;
+    }
+
+    status = wg_enqueue_nolock(cb, r);
+    if (status != 0)
+      return status;
   }
 
   return sd_output_register_metric(cb->formatter, ds, vl);
@@ -431,7 +669,7 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
 
   pthread_mutex_lock(&cb->lock);
 
-  if (cb->curl == NULL) {
+  if (cb->formatter == NULL) {
     int status = wg_callback_init(cb);
     if (status != 0) {
       ERROR("write_stackdriver plugin: wg_callback_init failed.");
@@ -446,9 +684,10 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     if (status == 0) { /* success */
       break;
     } else if (status == ENOBUFS) { /* success, flush */
-      wg_flush_nolock(0, cb);
-      status = 0;
-      break;
+      cb->timeseries_count++;
+      status = wg_flush_nolock(0, cb);
+      pthread_mutex_unlock(&cb->lock);
+      return status;
     } else if (status == EEXIST) {
       /* metric already in the buffer; flush and retry */
       wg_flush_nolock(0, cb);
@@ -467,6 +706,8 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
 
   if (status == 0) {
     cb->timeseries_count++;
+    if (cb->timeseries_count >= cb->batch_size)
+      status = wg_flush_nolock(0, cb);
   }
 
   pthread_mutex_unlock(&cb->lock);
@@ -556,7 +797,12 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   cb->url = strdup(GCM_API_URL);
+  cb->batch_size = WG_MAX_BATCH_SIZE;
+  cb->max_request_size = SD_OUTPUT_DEFAULT_MAX_SIZE;
+  cb->workers_num = 1;
   pthread_mutex_init(&cb->lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
+  pthread_cond_init(&cb->space_cond, /* attr = */ NULL);
 
   char *credential_file = NULL;
 
@@ -572,7 +818,34 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &credential_file);
     else if (strcasecmp("Resource", child->key) == 0)
       wg_config_resource(child, cb);
-    else {
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1) ||
+          (tmp > WG_MAX_BATCH_SIZE)) {
+        ERROR("write_stackdriver plugin: BatchSize must be between 1 and %d.",
+              WG_MAX_BATCH_SIZE);
+        wg_callback_free(cb);
+        return EINVAL;
+      }
+      cb->batch_size = (size_t)tmp;
+    } else if (strcasecmp("MaxRequestSize", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1024)) {
+        ERROR("write_stackdriver plugin: MaxRequestSize must be at least "
+              "1024.");
+        wg_callback_free(cb);
+        return EINVAL;
+      }
+      cb->max_request_size = (size_t)tmp;
+    } else if (strcasecmp("Threads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1)) {
+        ERROR("write_stackdriver plugin: Threads must be a positive number.");
+        wg_callback_free(cb);
+        return EINVAL;
+      }
+      cb->workers_num = (size_t)tmp;
+    } else {
       ERROR("write_stackdriver plugin: Invalid configuration option: %s.",
             child->key);
       wg_callback_free(cb);
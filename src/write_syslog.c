@@ -47,14 +47,20 @@
  *
  */
 
+#define _GNU_SOURCE /* For sendmmsg(2) */
+
 #include "collectd.h"
 #include "utils/common/common.h"
 
 #include "plugin.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
 #include "utils_random.h"
 
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #define WS_DEFAULT_NODE "localhost"
 
@@ -69,6 +75,27 @@
 /* Ethernet - (IPv6 + TCP) = 1500 - (40 + 32) = 1428 */
 #define WS_SEND_BUF_SIZE 1428
 
+#define WS_DEFAULT_TIMEOUT_MS 5000
+
+#define WS_DEFAULT_QUEUE_LENGTH 16
+
+/* Delay between two attempts to send a queued buffer. */
+#define WS_RETRY_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+
+/* Datagrams sent with a single sendmmsg(2) call. */
+#define WS_DATAGRAM_BATCH 64
+
+/* Messages on a stream are either terminated by a newline ("non-transparent
+ * framing") or prefixed with their length ("octet counting"), see RFC 6587.
+ * Each datagram holds exactly one message, see RFC 5426. */
+#define WS_FRAMING_NEWLINE 0
+#define WS_FRAMING_OCTET_COUNTING 1
+
+typedef struct {
+  char *data;
+  size_t len;
+} ws_buffer_t;
+
 /*
  * Private variables
  */
@@ -85,13 +112,37 @@ struct ws_callback {
   bool store_rates;
   bool always_append_ds;
 
-  char send_buf[WS_SEND_BUF_SIZE];
+  /* SOCK_STREAM or SOCK_DGRAM */
+  int socktype;
+  int framing;
+  int timeout_ms;
+  cdtime_t flush_interval;
+
+  /* With SOCK_DGRAM, the messages in the send buffer are separated by
+   * newlines, which are not sent. */
+  char *send_buf;
+  size_t send_buf_size;
   size_t send_buf_free;
   size_t send_buf_fill;
   cdtime_t send_buf_init_time;
 
   pthread_mutex_t send_lock;
 
+  /* Asynchronous mode: full send buffers are swapped into a ring of
+   * `queue_size' buffers, which the sender thread writes to the socket.
+   * The connection state is then only used by the sender thread. */
+  bool async;
+  ws_buffer_t *queue;
+  size_t queue_size;
+  size_t queue_head;
+  size_t queue_len;
+  pthread_cond_t queue_cond;
+  pthread_t sender_thread;
+  bool sender_running;
+  bool sender_shutdown;
+  uint64_t buffers_dropped;
+  c_complain_t queue_complaint;
+
   bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
   cdtime_t next_random_ttl;
@@ -104,31 +155,163 @@ static cdtime_t resolve_jitter;
  * Functions
  */
 static void ws_reset_buffer(struct ws_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
+  cb->send_buf[0] = 0;
+  cb->send_buf_free = cb->send_buf_size;
   cb->send_buf_fill = 0;
   cb->send_buf_init_time = cdtime();
 }
 
-static int ws_send_buffer(struct ws_callback *cb) {
-  ssize_t status = 0;
+static void ws_disconnect(struct ws_callback *cb) {
+  if (cb->sock_fd >= 0)
+    close(cb->sock_fd);
+  cb->sock_fd = -1;
+}
 
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    ERROR("write_syslog plugin: send failed with status %zi (%s)", status,
-          STRERRNO);
+/* Like swrite(), but gives up when the socket's send timeout expires instead
+ * of retrying forever. */
+static int ws_writev(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t status = writev(fd, iov, iovcnt);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
 
-    if (cb->sock_fd > 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
+    size_t done = (size_t)status;
+    while ((iovcnt > 0) && (done >= iov->iov_len)) {
+      done -= iov->iov_len;
+      iov++;
+      iovcnt--;
     }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
 
+  return 0;
+}
+
+/* Sends `num' datagrams on the connected socket, with as few system calls as
+ * possible. */
+static int ws_send_datagrams(int fd, struct iovec *iov, size_t num) {
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[WS_DATAGRAM_BATCH] = {{{0}}};
+  for (size_t i = 0; i < num; i++) {
+    msgs[i].msg_hdr.msg_iov = iov + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  size_t sent = 0;
+  while (sent < num) {
+    int status = sendmmsg(fd, msgs + sent, (unsigned int)(num - sent),
+                          /* flags = */ 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    sent += (size_t)status;
+  }
+#else
+  for (size_t i = 0; i < num; i++) {
+    ssize_t status = send(fd, iov[i].iov_base, iov[i].iov_len, /* flags = */ 0);
+    if ((status < 0) && (errno == EINTR)) {
+      i--;
+      continue;
+    }
+    if (status < 0)
+      return -1;
+  }
+#endif
+
+  return 0;
+}
+
+/* Sends each newline terminated message in `data' as a datagram. */
+static int ws_send_udp(struct ws_callback *cb, char *data, size_t len) {
+  struct iovec iov[WS_DATAGRAM_BATCH];
+  size_t num = 0;
+
+  char *end = data + len;
+  while (data < end) {
+    char *nl = memchr(data, '\n', (size_t)(end - data));
+    if (nl == NULL)
+      nl = end;
+
+    iov[num++] = (struct iovec){data, (size_t)(nl - data)};
+    data = nl + 1;
+
+    if ((num == WS_DATAGRAM_BATCH) || (data >= end)) {
+      if (ws_send_datagrams(cb->sock_fd, iov, num) != 0)
+        return -1;
+      num = 0;
+    }
+  }
+
+  return 0;
+}
+
+/* NOTE: In asynchronous mode, only the sender thread may call this function.
+ * Otherwise you must hold cb->send_lock. */
+static int ws_send_data(struct ws_callback *cb, char *data, size_t len) {
+  int status;
+
+  if (cb->socktype == SOCK_DGRAM)
+    status = ws_send_udp(cb, data, len);
+  else
+    status = ws_writev(cb->sock_fd, &(struct iovec){data, len}, 1);
+
+  if (status != 0) {
+    ERROR("write_syslog plugin: send failed: %s", STRERRNO);
+    ws_disconnect(cb);
     return -1;
   }
 
   return 0;
 }
 
+/* Hands the send buffer over to the sender thread by swapping it with a free
+ * buffer of the ring. If the ring is full, the data is dropped.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int ws_submit_nolock(struct ws_callback *cb) {
+  if (cb->queue_len >= cb->queue_size) {
+    cb->buffers_dropped++;
+    c_complain(LOG_WARNING, &cb->queue_complaint,
+               "write_syslog plugin: The send queue of %s:%s is full. "
+               "Dropping %" PRIsz " bytes (%" PRIu64 " buffers so far).",
+               cb->node ? cb->node : WS_DEFAULT_NODE,
+               cb->service ? cb->service : WS_DEFAULT_SERVICE,
+               cb->send_buf_fill, cb->buffers_dropped);
+    return -1;
+  }
+  c_release(LOG_INFO, &cb->queue_complaint,
+            "write_syslog plugin: The send queue of %s:%s has room again.",
+            cb->node ? cb->node : WS_DEFAULT_NODE,
+            cb->service ? cb->service : WS_DEFAULT_SERVICE);
+
+  ws_buffer_t *buf =
+      cb->queue + (cb->queue_head + cb->queue_len) % cb->queue_size;
+  char *tmp = buf->data;
+  buf->data = cb->send_buf;
+  buf->len = cb->send_buf_fill;
+  cb->send_buf = tmp;
+  cb->queue_len++;
+
+  pthread_cond_signal(&cb->queue_cond);
+  return 0;
+}
+
+static int ws_callback_init(struct ws_callback *cb);
+
+static int ws_send_buffer(struct ws_callback *cb) {
+  if (cb->async)
+    return ws_submit_nolock(cb);
+
+  return ws_send_data(cb, cb->send_buf, cb->send_buf_fill);
+}
+
 /* NOTE: You must hold cb->send_lock when calling this function! */
 static int ws_flush_nolock(cdtime_t timeout, struct ws_callback *cb) {
   int status;
@@ -157,6 +340,66 @@ static int ws_flush_nolock(cdtime_t timeout, struct ws_callback *cb) {
   return status;
 }
 
+/* Writes the buffers queued by ws_submit_nolock() to the socket. A buffer
+ * that cannot be sent is retried until the node is shut down, while new
+ * buffers keep queueing up behind it. With a FlushInterval, the thread also
+ * submits the partially filled send buffer once it is old enough. */
+static void *ws_sender_thread(void *arg) {
+  struct ws_callback *cb = arg;
+
+  pthread_mutex_lock(&cb->send_lock);
+  while (42) {
+    while ((cb->queue_len == 0) && !cb->sender_shutdown) {
+      if ((cb->flush_interval == 0) || (cb->send_buf_fill == 0)) {
+        pthread_cond_wait(&cb->queue_cond, &cb->send_lock);
+        continue;
+      }
+
+      struct timespec ts =
+          CDTIME_T_TO_TIMESPEC(cb->send_buf_init_time + cb->flush_interval);
+      if (pthread_cond_timedwait(&cb->queue_cond, &cb->send_lock, &ts) ==
+          ETIMEDOUT)
+        ws_flush_nolock(cb->flush_interval, cb);
+    }
+    if (cb->queue_len == 0)
+      break;
+
+    /* The buffer at the head is not touched by writers while it is queued. */
+    ws_buffer_t *buf = cb->queue + cb->queue_head;
+    bool shutdown = cb->sender_shutdown;
+    pthread_mutex_unlock(&cb->send_lock);
+
+    int status = ws_callback_init(cb);
+    if (status == 0)
+      status = ws_send_data(cb, buf->data, buf->len);
+
+    pthread_mutex_lock(&cb->send_lock);
+    if ((status != 0) && !shutdown) {
+      cdtime_t deadline = cdtime() + WS_RETRY_INTERVAL;
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      while (!cb->sender_shutdown &&
+             (pthread_cond_timedwait(&cb->queue_cond, &cb->send_lock, &ts) !=
+              ETIMEDOUT))
+        ;
+      continue;
+    }
+    if (status != 0) {
+      WARNING("write_syslog plugin: Dropping %" PRIsz " queued buffer(s) "
+              "on shutdown.",
+              cb->queue_len);
+      cb->queue_len = 0;
+      break;
+    }
+
+    buf->len = 0;
+    cb->queue_head = (cb->queue_head + 1) % cb->queue_size;
+    cb->queue_len--;
+  }
+  pthread_mutex_unlock(&cb->send_lock);
+
+  return NULL;
+}
+
 static cdtime_t new_random_ttl(void) {
   if (resolve_jitter == 0)
     return 0;
@@ -164,6 +407,56 @@ static cdtime_t new_random_ttl(void) {
   return (cdtime_t)cdrand_range(0, (long)resolve_jitter);
 }
 
+/* Connects with a timeout, so that an unreachable server does not block for
+ * the kernel's connect timeout. The timeout also applies to sending. */
+static int ws_connect(struct addrinfo *ai, int timeout_ms) {
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd < 0)
+    return -1;
+
+  set_sock_opts(fd);
+
+  int flags = fcntl(fd, F_GETFL);
+  int status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  if (status == 0) {
+    status = connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if ((status != 0) && (errno == EINPROGRESS)) {
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+      do
+        status = poll(&pfd, 1, timeout_ms);
+      while ((status < 0) && (errno == EINTR));
+
+      if (status == 0) {
+        errno = ETIMEDOUT;
+        status = -1;
+      } else if (status > 0) {
+        int err = 0;
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err,
+                   &(socklen_t){sizeof(err)});
+        errno = err;
+        status = (err == 0) ? 0 : -1;
+      }
+    }
+  }
+  if (status == 0)
+    status = fcntl(fd, F_SETFL, flags);
+
+  if (status != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  struct timeval tv = {
+      .tv_sec = timeout_ms / 1000,
+      .tv_usec = (timeout_ms % 1000) * 1000,
+  };
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  return fd;
+}
+
 static int ws_callback_init(struct ws_callback *cb) {
   int status;
   cdtime_t now;
@@ -171,7 +464,7 @@ static int ws_callback_init(struct ws_callback *cb) {
   const char *node = cb->node ? cb->node : WS_DEFAULT_NODE;
   const char *service = cb->service ? cb->service : WS_DEFAULT_SERVICE;
 
-  if (cb->sock_fd > 0)
+  if (cb->sock_fd >= 0)
     return 0;
 
   now = cdtime();
@@ -185,7 +478,8 @@ static int ws_callback_init(struct ws_callback *cb) {
     if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) < now) {
       cb->next_random_ttl = new_random_ttl();
       if (cb->connect_dns_failed_attempts_remaining > 0) {
-        /* Warning : this is run under send_lock mutex.
+        /* Warning : this is run under send_lock mutex or, in asynchronous
+         * mode, by the sender thread only.
          * This is why we do not use another mutex here.
          * */
         cb->ai_last_update = now;
@@ -209,7 +503,7 @@ static int ws_callback_init(struct ws_callback *cb) {
     struct addrinfo ai_hints = {
         .ai_family = AF_UNSPEC,
         .ai_flags = AI_ADDRCONFIG,
-        .ai_socktype = SOCK_STREAM,
+        .ai_socktype = cb->socktype,
     };
 
     status = getaddrinfo(node, service, &ai_hints, &cb->ai);
@@ -229,20 +523,9 @@ static int ws_callback_init(struct ws_callback *cb) {
 
   assert(cb->ai != NULL);
   for (struct addrinfo *ai = cb->ai; ai != NULL; ai = ai->ai_next) {
-    cb->sock_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-    if (cb->sock_fd < 0)
-      continue;
-
-    set_sock_opts(cb->sock_fd);
-
-    status = connect(cb->sock_fd, ai->ai_addr, ai->ai_addrlen);
-    if (status != 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
-      continue;
-    }
-
-    break;
+    cb->sock_fd = ws_connect(ai, cb->timeout_ms);
+    if (cb->sock_fd >= 0)
+      break;
   }
 
   if (cb->sock_fd < 0) {
@@ -258,8 +541,6 @@ static int ws_callback_init(struct ws_callback *cb) {
   }
   cb->connect_dns_failed_attempts_remaining = 1;
 
-  ws_reset_buffer(cb);
-
   return 0;
 }
 
@@ -273,10 +554,26 @@ static void ws_callback_free(void *data) {
 
   pthread_mutex_lock(&cb->send_lock);
 
-  ws_flush_nolock(0, cb);
+  if (cb->send_buf != NULL)
+    ws_flush_nolock(0, cb);
 
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
+  if (cb->sender_running) {
+    cb->sender_shutdown = true;
+    pthread_cond_signal(&cb->queue_cond);
+    pthread_mutex_unlock(&cb->send_lock);
+    pthread_join(cb->sender_thread, NULL);
+    pthread_mutex_lock(&cb->send_lock);
+    cb->sender_running = false;
+  }
+
+  ws_disconnect(cb);
+  if (cb->ai != NULL)
+    freeaddrinfo(cb->ai);
+
+  for (size_t i = 0; (cb->queue != NULL) && (i < cb->queue_size); i++)
+    sfree(cb->queue[i].data);
+  sfree(cb->queue);
+  sfree(cb->send_buf);
 
   sfree(cb->node);
   sfree(cb->service);
@@ -285,6 +582,7 @@ static void ws_callback_free(void *data) {
   sfree(cb->metrics_prefix);
 
   pthread_mutex_unlock(&cb->send_lock);
+  pthread_cond_destroy(&cb->queue_cond);
   pthread_mutex_destroy(&cb->send_lock);
 
   sfree(cb);
@@ -303,7 +601,7 @@ static int ws_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if (!cb->async && (cb->sock_fd < 0)) {
     status = ws_callback_init(cb);
     if (status != 0) {
       ERROR("write_syslog plugin: ws_callback_init failed.");
@@ -318,12 +616,12 @@ static int ws_flush(cdtime_t timeout,
   return status;
 }
 
+/* `rates' is NULL unless StoreRates is enabled. */
 static int ws_format_values(char *ret, size_t ret_len, int ds_num,
                             const data_set_t *ds, const value_list_t *vl,
-                            bool store_rates) {
+                            gauge_t const *rates) {
   size_t offset = 0;
   int status;
-  gauge_t *rates = NULL;
 
   assert(strcmp(ds->type, vl->type) == 0);
 
@@ -333,10 +631,8 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
     if (status < 1) {                                                          \
-      sfree(rates);                                                            \
       return -1;                                                               \
     } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
       return -1;                                                               \
     } else                                                                     \
       offset += ((size_t)status);                                              \
@@ -344,16 +640,9 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
 
   if (ds->ds[ds_num].type == DS_TYPE_GAUGE)
     BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
-  else if (store_rates) {
-    if (rates == NULL)
-      rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      WARNING("format_values: "
-              "uc_get_rate failed.");
-      return -1;
-    }
+  else if (rates != NULL)
     BUFFER_ADD(GAUGE_FORMAT, rates[ds_num]);
-  } else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
+  else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
     BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[ds_num].counter);
   else if (ds->ds[ds_num].type == DS_TYPE_DERIVE)
     BUFFER_ADD("%" PRIi64, vl->values[ds_num].derive);
@@ -362,13 +651,11 @@ static int ws_format_values(char *ret, size_t ret_len, int ds_num,
   else {
     ERROR("format_values plugin: Unknown data source type: %i",
           ds->ds[ds_num].type);
-    sfree(rates);
     return -1;
   }
 
 #undef BUFFER_ADD
 
-  sfree(rates);
   return 0;
 }
 
@@ -450,9 +737,28 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
     return -1;
   }
 
+  /* With octet counting, the message is prefixed with its length, without
+   * the trailing newline. */
+  char prefix[32] = "";
+  size_t prefix_len = 0;
+  if ((cb->socktype == SOCK_STREAM) &&
+      (cb->framing == WS_FRAMING_OCTET_COUNTING)) {
+    message_len--;
+    message[message_len] = 0;
+    prefix_len = (size_t)snprintf(prefix, sizeof(prefix), "%" PRIsz " ",
+                                  message_len);
+  }
+
+  if (prefix_len + message_len >= cb->send_buf_size) {
+    ERROR("write_syslog plugin: message of %" PRIsz " bytes does not fit "
+          "into the send buffer.",
+          prefix_len + message_len);
+    return -1;
+  }
+
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if (!cb->async && (cb->sock_fd < 0)) {
     status = ws_callback_init(cb);
     if (status != 0) {
       ERROR("write_syslog plugin: ws_callback_init failed.");
@@ -461,32 +767,49 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
     }
   }
 
-  if (message_len >= cb->send_buf_free) {
+  if (prefix_len + message_len >= cb->send_buf_free) {
     status = ws_flush_nolock(0, cb);
-    if (status != 0) {
+    /* In asynchronous mode, a full queue has already been reported and the
+     * buffer is free again. */
+    if ((status != 0) && !cb->async) {
       pthread_mutex_unlock(&cb->send_lock);
       return status;
     }
   }
 
   /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
+  assert(prefix_len + message_len < cb->send_buf_free);
+
+  /* The age of the buffer is that of its oldest message. Let the sender
+   * thread know when to flush it. */
+  if (cb->send_buf_fill == 0) {
+    cb->send_buf_init_time = cdtime();
+    if (cb->async && (cb->flush_interval > 0))
+      pthread_cond_signal(&cb->queue_cond);
+  }
 
   /* `message_len + 1' because `message_len' does not include the
    * trailing null byte. Neither does `send_buffer_fill'. */
+  memcpy(cb->send_buf + cb->send_buf_fill, prefix, prefix_len);
+  cb->send_buf_fill += prefix_len;
   memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
   cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
+  cb->send_buf_free -= prefix_len + message_len;
 
   DEBUG("write_syslog plugin: [%s]:%s buf %" PRIsz "/%" PRIsz
         " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->send_buf_fill, sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
+        cb->node, cb->service, cb->send_buf_fill, cb->send_buf_size,
+        100.0 * ((double)cb->send_buf_fill) / ((double)cb->send_buf_size),
         message);
 
+  /* Without a sender thread, old data is sent along with new messages. */
+  status = 0;
+  if (!cb->async && (cb->flush_interval > 0))
+    status = ws_flush_nolock(cb->flush_interval, cb);
+
   pthread_mutex_unlock(&cb->send_lock);
 
-  return 0;
+  return status;
 }
 
 static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
@@ -502,6 +825,22 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
+  /* The rates are looked up once for all data sources. */
+  gauge_t *rates = NULL;
+  if (cb->store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        continue;
+
+      rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        WARNING("write_syslog plugin: uc_get_rate failed.");
+        return -1;
+      }
+      break;
+    }
+  }
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     const char *ds_name = NULL;
 
@@ -512,17 +851,18 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
     status = ws_format_name(key, sizeof(key), vl, cb, ds_name);
     if (status != 0) {
       ERROR("write_syslog plugin: error with format_name");
+      sfree(rates);
       return status;
     }
 
     escape_string(key, sizeof(key));
     /* Convert the values to an ASCII representation and put that into
      * 'values'. */
-    status =
-        ws_format_values(values, sizeof(values), i, ds, vl, cb->store_rates);
+    status = ws_format_values(values, sizeof(values), i, ds, vl, rates);
     if (status != 0) {
       ERROR("write_syslog plugin: error with "
             "ws_format_values");
+      sfree(rates);
       return status;
     }
 
@@ -533,10 +873,12 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
     if (status != 0) {
       ERROR("write_syslog plugin: error with "
             "ws_send_message");
+      sfree(rates);
       return status;
     }
   }
 
+  sfree(rates);
   return 0;
 }
 
@@ -567,8 +909,15 @@ static int ws_config_tsd(oconfig_item_t *ci) {
   cb->sock_fd = -1;
   cb->connect_failed_log_enabled = 1;
   cb->next_random_ttl = new_random_ttl();
+  cb->socktype = SOCK_STREAM;
+  cb->framing = WS_FRAMING_NEWLINE;
+  C_COMPLAIN_INIT(&cb->queue_complaint);
 
   pthread_mutex_init(&cb->send_lock, NULL);
+  pthread_cond_init(&cb->queue_cond, NULL);
+
+  int buffer_size = 0;
+  int queue_length = WS_DEFAULT_QUEUE_LENGTH;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -587,12 +936,92 @@ static int ws_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->always_append_ds);
     else if (strcasecmp("Prefix", child->key) == 0)
       cf_util_get_string(child, &cb->metrics_prefix);
+    else if (strcasecmp("Protocol", child->key) == 0) {
+      char *protocol = NULL;
+      if (cf_util_get_string(child, &protocol) == 0) {
+        if (strcasecmp("TCP", protocol) == 0)
+          cb->socktype = SOCK_STREAM;
+        else if (strcasecmp("UDP", protocol) == 0)
+          cb->socktype = SOCK_DGRAM;
+        else
+          ERROR("write_syslog plugin: Invalid protocol: %s", protocol);
+        sfree(protocol);
+      }
+    } else if (strcasecmp("Framing", child->key) == 0) {
+      char *framing = NULL;
+      if (cf_util_get_string(child, &framing) == 0) {
+        if (strcasecmp("Newline", framing) == 0)
+          cb->framing = WS_FRAMING_NEWLINE;
+        else if (strcasecmp("OctetCounting", framing) == 0)
+          cb->framing = WS_FRAMING_OCTET_COUNTING;
+        else
+          ERROR("write_syslog plugin: Invalid framing: %s", framing);
+        sfree(framing);
+      }
+    } else if (strcasecmp("Timeout", child->key) == 0)
+      cf_util_get_int(child, &cb->timeout_ms);
+    else if (strcasecmp("BufferSize", child->key) == 0)
+      cf_util_get_int(child, &buffer_size);
+    else if (strcasecmp("FlushInterval", child->key) == 0)
+      cf_util_get_cdtime(child, &cb->flush_interval);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      cf_util_get_boolean(child, &cb->async);
+    else if (strcasecmp("QueueLength", child->key) == 0)
+      cf_util_get_int(child, &queue_length);
     else {
       ERROR("write_syslog plugin: Invalid configuration "
             "option: %s.",
             child->key);
+      ws_callback_free(cb);
+      return -1;
+    }
+  }
+
+  if (cb->timeout_ms <= 0)
+    cb->timeout_ms = WS_DEFAULT_TIMEOUT_MS;
+  if (buffer_size <= 0)
+    buffer_size = WS_SEND_BUF_SIZE;
+  else if (buffer_size < 1024) {
+    WARNING("write_syslog plugin: BufferSize %d is too small, using 1024.",
+            buffer_size);
+    buffer_size = 1024;
+  }
+  if (queue_length < 1) {
+    WARNING("write_syslog plugin: QueueLength must be at least 1.");
+    queue_length = 1;
+  }
+
+  bool buffers_failed = false;
+  cb->send_buf_size = (size_t)buffer_size;
+  cb->send_buf = malloc(cb->send_buf_size);
+  if (cb->async) {
+    cb->queue_size = (size_t)queue_length;
+    cb->queue = calloc(cb->queue_size, sizeof(*cb->queue));
+    for (size_t i = 0; (cb->queue != NULL) && (i < cb->queue_size); i++) {
+      cb->queue[i].data = malloc(cb->send_buf_size);
+      if (cb->queue[i].data == NULL)
+        buffers_failed = true;
+    }
+  }
+
+  if ((cb->send_buf == NULL) || buffers_failed ||
+      (cb->async && (cb->queue == NULL))) {
+    ERROR("write_syslog plugin: Allocating buffers failed.");
+    ws_callback_free(cb);
+    return -1;
+  }
+  ws_reset_buffer(cb);
+
+  if (cb->async) {
+    int status = plugin_thread_create(&cb->sender_thread, ws_sender_thread, cb,
+                                      "write_syslog send");
+    if (status != 0) {
+      ERROR("write_syslog plugin: Starting the sender thread failed: %s",
+            STRERROR(status));
+      ws_callback_free(cb);
       return -1;
     }
+    cb->sender_running = true;
   }
 
   snprintf(callback_name, sizeof(callback_name), "write_syslog/%s/%s",
@@ -45,10 +45,15 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
 #include "utils_cache.h"
+#include "utils_complain.h"
 #include "utils_random.h"
 
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #ifndef WT_DEFAULT_NODE
 #define WT_DEFAULT_NODE "localhost"
@@ -67,6 +72,30 @@
 #define WT_SEND_BUF_SIZE 1428
 #endif
 
+/* Request bodies sent to the HTTP API may be much larger. */
+#ifndef WT_HTTP_BUF_SIZE
+#define WT_HTTP_BUF_SIZE 65536
+#endif
+
+#ifndef WT_DEFAULT_TIMEOUT_MS
+#define WT_DEFAULT_TIMEOUT_MS 5000
+#endif
+
+#ifndef WT_DEFAULT_QUEUE_LENGTH
+#define WT_DEFAULT_QUEUE_LENGTH 16
+#endif
+
+/* Delay between two attempts to send a queued buffer. */
+#define WT_RETRY_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+
+#define WT_PROTOCOL_TELNET 0
+#define WT_PROTOCOL_HTTP 1
+
+typedef struct {
+  char *data;
+  size_t len;
+} wt_buffer_t;
+
 /*
  * Private variables
  */
@@ -82,13 +111,37 @@ struct wt_callback {
   bool store_rates;
   bool always_append_ds;
 
-  char send_buf[WT_SEND_BUF_SIZE];
+  /* With WT_PROTOCOL_HTTP, the send buffer holds JSON objects, each with a
+   * leading comma, which are posted to /api/put as one array. */
+  int protocol;
+  compress_method_t compression;
+  compress_stream_t *compressor;
+  compress_buffer_t body;
+  int timeout_ms;
+
+  char *send_buf;
+  size_t send_buf_size;
   size_t send_buf_free;
   size_t send_buf_fill;
   cdtime_t send_buf_init_time;
 
   pthread_mutex_t send_lock;
 
+  /* Asynchronous mode: full send buffers are swapped into a ring of
+   * `queue_size' buffers, which the sender thread writes to the socket.
+   * The connection state is then only used by the sender thread. */
+  bool async;
+  wt_buffer_t *queue;
+  size_t queue_size;
+  size_t queue_head;
+  size_t queue_len;
+  pthread_cond_t queue_cond;
+  pthread_t sender_thread;
+  bool sender_running;
+  bool sender_shutdown;
+  uint64_t buffers_dropped;
+  c_complain_t queue_complaint;
+
   bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
   cdtime_t next_random_ttl;
@@ -101,29 +154,243 @@ static cdtime_t resolve_jitter;
  * Functions
  */
 static void wt_reset_buffer(struct wt_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
+  cb->send_buf[0] = 0;
+  cb->send_buf_free = cb->send_buf_size;
   cb->send_buf_fill = 0;
   cb->send_buf_init_time = cdtime();
 }
 
-static int wt_send_buffer(struct wt_callback *cb) {
-  ssize_t status = 0;
+static void wt_disconnect(struct wt_callback *cb) {
+  if (cb->sock_fd >= 0)
+    close(cb->sock_fd);
+  cb->sock_fd = -1;
+}
 
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
-  if (status != 0) {
-    ERROR("write_tsdb plugin: send failed with status %zi (%s)", status,
-          STRERRNO);
+/* Like swrite(), but gives up when the socket's send timeout expires instead
+ * of retrying forever. */
+static int wt_writev(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t status = writev(fd, iov, iovcnt);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
 
-    close(cb->sock_fd);
-    cb->sock_fd = -1;
+    size_t done = (size_t)status;
+    while ((iovcnt > 0) && (done >= iov->iov_len)) {
+      done -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
 
+  return 0;
+}
+
+/* Reads an HTTP response from the API and checks its status code. The body
+ * is only kept for error messages. */
+static int wt_http_response(struct wt_callback *cb) {
+  char buffer[4096];
+  size_t fill = 0;
+  char *body = NULL;
+
+  while (body == NULL) {
+    if (fill >= sizeof(buffer) - 1) {
+      ERROR("write_tsdb plugin: HTTP response header too large.");
+      return -1;
+    }
+    ssize_t status = recv(cb->sock_fd, buffer + fill, sizeof(buffer) - 1 - fill,
+                          /* flags = */ 0);
+    if (status < 0 && errno == EINTR)
+      continue;
+    if (status <= 0) {
+      ERROR("write_tsdb plugin: Reading HTTP response failed: %s",
+            (status == 0) ? "connection closed" : STRERRNO);
+      return -1;
+    }
+    fill += (size_t)status;
+    buffer[fill] = 0;
+
+    body = strstr(buffer, "\r\n\r\n");
+  }
+  *body = 0;
+  body += 4;
+
+  int code = 0;
+  if (sscanf(buffer, "HTTP/%*s %d", &code) != 1) {
+    ERROR("write_tsdb plugin: Malformed HTTP response.");
     return -1;
   }
 
+  size_t content_length = 0;
+  bool keep_alive = true;
+  for (char *line = strstr(buffer, "\r\n"); line != NULL;
+       line = strstr(line, "\r\n")) {
+    line += 2;
+    if (strncasecmp(line, "Content-Length:", strlen("Content-Length:")) == 0)
+      content_length = (size_t)strtoull(line + strlen("Content-Length:"),
+                                        NULL, 10);
+    else if ((strncasecmp(line, "Connection:", strlen("Connection:")) == 0) &&
+             (strstr(line, "close") != NULL))
+      keep_alive = false;
+    else if (strncasecmp(line, "Transfer-Encoding:",
+                         strlen("Transfer-Encoding:")) == 0)
+      /* The length of a chunked body is unknown, start over next time. */
+      keep_alive = false;
+  }
+
+  /* Discard the rest of the body. */
+  size_t have = fill - (size_t)(body - buffer);
+  while (keep_alive && (have < content_length)) {
+    char discard[4096];
+    size_t want = content_length - have;
+    ssize_t status = recv(cb->sock_fd, discard,
+                          (want < sizeof(discard)) ? want : sizeof(discard),
+                          /* flags = */ 0);
+    if (status < 0 && errno == EINTR)
+      continue;
+    if (status <= 0) {
+      keep_alive = false;
+      break;
+    }
+    have += (size_t)status;
+  }
+
+  if (!keep_alive)
+    wt_disconnect(cb);
+
+  if ((code < 200) || (code >= 300)) {
+    ERROR("write_tsdb plugin: HTTP API returned status %d: %.200s", code,
+          body);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Posts the JSON objects in `data' to the HTTP API. */
+static int wt_send_http(struct wt_callback *cb, char const *data, size_t len) {
+  char const *encoding = compress_method_encoding(cb->compression);
+  struct iovec iov[4];
+  int iovcnt = 1;
+  size_t content_length;
+
+  if (cb->compressor != NULL) {
+    /* Replace the leading comma of the first object with a bracket. */
+    cb->body.len = 0;
+    int status = compress_stream_append(cb->compressor, "[", 1, &cb->body);
+    if (status == 0)
+      status = compress_stream_append(cb->compressor, data + 1, len - 1,
+                                      &cb->body);
+    if (status == 0)
+      status = compress_stream_append(cb->compressor, "]", 1, &cb->body);
+    if (status == 0)
+      status = compress_stream_finish(cb->compressor, &cb->body);
+    if (status != 0) {
+      ERROR("write_tsdb plugin: Compressing request body failed: %s",
+            STRERROR(status));
+      compress_stream_reset(cb->compressor);
+      return -1;
+    }
+
+    iov[iovcnt++] = (struct iovec){cb->body.data, cb->body.len};
+    content_length = cb->body.len;
+  } else {
+    iov[iovcnt++] = (struct iovec){"[", 1};
+    iov[iovcnt++] = (struct iovec){(char *)data + 1, len - 1};
+    iov[iovcnt++] = (struct iovec){"]", 1};
+    content_length = len + 1;
+  }
+
+  char header[1024];
+  int header_len = snprintf(
+      header, sizeof(header),
+      "POST /api/put HTTP/1.1\r\n"
+      "Host: %s:%s\r\n"
+      "Content-Type: application/json\r\n"
+      "%s%s%s"
+      "Content-Length: %" PRIsz "\r\n"
+      "\r\n",
+      cb->node ? cb->node : WT_DEFAULT_NODE,
+      cb->service ? cb->service : WT_DEFAULT_SERVICE,
+      (encoding != NULL) ? "Content-Encoding: " : "",
+      (encoding != NULL) ? encoding : "", (encoding != NULL) ? "\r\n" : "",
+      content_length);
+  if ((header_len < 0) || ((size_t)header_len >= sizeof(header))) {
+    ERROR("write_tsdb plugin: HTTP request header too large.");
+    return -1;
+  }
+  iov[0] = (struct iovec){header, (size_t)header_len};
+
+  if (wt_writev(cb->sock_fd, iov, iovcnt) != 0) {
+    ERROR("write_tsdb plugin: send failed: %s", STRERRNO);
+    wt_disconnect(cb);
+    return -1;
+  }
+
+  return wt_http_response(cb);
+}
+
+/* NOTE: In asynchronous mode, only the sender thread may call this function.
+ * Otherwise you must hold cb->send_lock. */
+static int wt_send_data(struct wt_callback *cb, char const *data, size_t len) {
+  if (cb->protocol == WT_PROTOCOL_HTTP)
+    return wt_send_http(cb, data, len);
+
+  if (wt_writev(cb->sock_fd, &(struct iovec){(char *)data, len}, 1) != 0) {
+    ERROR("write_tsdb plugin: send failed: %s", STRERRNO);
+    wt_disconnect(cb);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Hands the send buffer over to the sender thread by swapping it with a free
+ * buffer of the ring. If the ring is full, the data is dropped.
+ * NOTE: You must hold cb->send_lock when calling this function! */
+static int wt_submit_nolock(struct wt_callback *cb) {
+  if (cb->queue_len >= cb->queue_size) {
+    cb->buffers_dropped++;
+    c_complain(LOG_WARNING, &cb->queue_complaint,
+               "write_tsdb plugin: The send queue of %s:%s is full. "
+               "Dropping %" PRIsz " bytes (%" PRIu64 " buffers so far).",
+               cb->node ? cb->node : WT_DEFAULT_NODE,
+               cb->service ? cb->service : WT_DEFAULT_SERVICE,
+               cb->send_buf_fill, cb->buffers_dropped);
+    return -1;
+  }
+  c_release(LOG_INFO, &cb->queue_complaint,
+            "write_tsdb plugin: The send queue of %s:%s has room again.",
+            cb->node ? cb->node : WT_DEFAULT_NODE,
+            cb->service ? cb->service : WT_DEFAULT_SERVICE);
+
+  wt_buffer_t *buf =
+      cb->queue + (cb->queue_head + cb->queue_len) % cb->queue_size;
+  char *tmp = buf->data;
+  buf->data = cb->send_buf;
+  buf->len = cb->send_buf_fill;
+  cb->send_buf = tmp;
+  cb->queue_len++;
+
+  pthread_cond_signal(&cb->queue_cond);
   return 0;
 }
 
+static int wt_callback_init(struct wt_callback *cb);
+
+static int wt_send_buffer(struct wt_callback *cb) {
+  if (cb->async)
+    return wt_submit_nolock(cb);
+
+  return wt_send_data(cb, cb->send_buf, cb->send_buf_fill);
+}
+
 /* NOTE: You must hold cb->send_lock when calling this function! */
 static int wt_flush_nolock(cdtime_t timeout, struct wt_callback *cb) {
   int status;
@@ -152,6 +419,55 @@ static int wt_flush_nolock(cdtime_t timeout, struct wt_callback *cb) {
   return status;
 }
 
+/* Writes the buffers queued by wt_submit_nolock() to the socket. A buffer
+ * that cannot be sent is retried until the node is shut down, while new
+ * buffers keep queueing up behind it. */
+static void *wt_sender_thread(void *arg) {
+  struct wt_callback *cb = arg;
+
+  pthread_mutex_lock(&cb->send_lock);
+  while (42) {
+    while ((cb->queue_len == 0) && !cb->sender_shutdown)
+      pthread_cond_wait(&cb->queue_cond, &cb->send_lock);
+    if (cb->queue_len == 0)
+      break;
+
+    /* The buffer at the head is not touched by writers while it is queued. */
+    wt_buffer_t *buf = cb->queue + cb->queue_head;
+    bool shutdown = cb->sender_shutdown;
+    pthread_mutex_unlock(&cb->send_lock);
+
+    int status = wt_callback_init(cb);
+    if (status == 0)
+      status = wt_send_data(cb, buf->data, buf->len);
+
+    pthread_mutex_lock(&cb->send_lock);
+    if ((status != 0) && !shutdown) {
+      cdtime_t deadline = cdtime() + WT_RETRY_INTERVAL;
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      while (!cb->sender_shutdown &&
+             (pthread_cond_timedwait(&cb->queue_cond, &cb->send_lock, &ts) !=
+              ETIMEDOUT))
+        ;
+      continue;
+    }
+    if (status != 0) {
+      WARNING("write_tsdb plugin: Dropping %" PRIsz " queued buffer(s) "
+              "on shutdown.",
+              cb->queue_len);
+      cb->queue_len = 0;
+      break;
+    }
+
+    buf->len = 0;
+    cb->queue_head = (cb->queue_head + 1) % cb->queue_size;
+    cb->queue_len--;
+  }
+  pthread_mutex_unlock(&cb->send_lock);
+
+  return NULL;
+}
+
 static cdtime_t new_random_ttl(void) {
   if (resolve_jitter == 0)
     return 0;
@@ -159,6 +475,58 @@ static cdtime_t new_random_ttl(void) {
   return (cdtime_t)cdrand_range(0, (long)resolve_jitter);
 }
 
+/* Connects with a timeout, so that an unreachable server does not block for
+ * the kernel's connect timeout. The timeout also applies to sending and, for
+ * the HTTP API, to receiving. */
+static int wt_connect(struct addrinfo *ai, int timeout_ms) {
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd < 0)
+    return -1;
+
+  set_sock_opts(fd);
+
+  int flags = fcntl(fd, F_GETFL);
+  int status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  if (status == 0) {
+    status = connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if ((status != 0) && (errno == EINPROGRESS)) {
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+      do
+        status = poll(&pfd, 1, timeout_ms);
+      while ((status < 0) && (errno == EINTR));
+
+      if (status == 0) {
+        errno = ETIMEDOUT;
+        status = -1;
+      } else if (status > 0) {
+        int err = 0;
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err,
+                   &(socklen_t){sizeof(err)});
+        errno = err;
+        status = (err == 0) ? 0 : -1;
+      }
+    }
+  }
+  if (status == 0)
+    status = fcntl(fd, F_SETFL, flags);
+
+  if (status != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  struct timeval tv = {
+      .tv_sec = timeout_ms / 1000,
+      .tv_usec = (timeout_ms % 1000) * 1000,
+  };
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  return fd;
+}
+
 static int wt_callback_init(struct wt_callback *cb) {
   int status;
   cdtime_t now;
@@ -166,7 +534,7 @@ static int wt_callback_init(struct wt_callback *cb) {
   const char *node = cb->node ? cb->node : WT_DEFAULT_NODE;
   const char *service = cb->service ? cb->service : WT_DEFAULT_SERVICE;
 
-  if (cb->sock_fd > 0)
+  if (cb->sock_fd >= 0)
     return 0;
 
   now = cdtime();
@@ -180,7 +548,8 @@ static int wt_callback_init(struct wt_callback *cb) {
     if ((cb->ai_last_update + resolve_interval + cb->next_random_ttl) < now) {
       cb->next_random_ttl = new_random_ttl();
       if (cb->connect_dns_failed_attempts_remaining > 0) {
-        /* Warning : this is run under send_lock mutex.
+        /* Warning : this is run under send_lock mutex or, in asynchronous
+         * mode, by the sender thread only.
          * This is why we do not use another mutex here.
          * */
         cb->ai_last_update = now;
@@ -224,20 +593,9 @@ static int wt_callback_init(struct wt_callback *cb) {
 
   assert(cb->ai != NULL);
   for (struct addrinfo *ai = cb->ai; ai != NULL; ai = ai->ai_next) {
-    cb->sock_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-    if (cb->sock_fd < 0)
-      continue;
-
-    set_sock_opts(cb->sock_fd);
-
-    status = connect(cb->sock_fd, ai->ai_addr, ai->ai_addrlen);
-    if (status != 0) {
-      close(cb->sock_fd);
-      cb->sock_fd = -1;
-      continue;
-    }
-
-    break;
+    cb->sock_fd = wt_connect(ai, cb->timeout_ms);
+    if (cb->sock_fd >= 0)
+      break;
   }
 
   if (cb->sock_fd < 0) {
@@ -253,8 +611,6 @@ static int wt_callback_init(struct wt_callback *cb) {
   }
   cb->connect_dns_failed_attempts_remaining = 1;
 
-  wt_reset_buffer(cb);
-
   return 0;
 }
 
@@ -270,14 +626,33 @@ static void wt_callback_free(void *data) {
 
   wt_flush_nolock(0, cb);
 
-  close(cb->sock_fd);
-  cb->sock_fd = -1;
+  if (cb->sender_running) {
+    cb->sender_shutdown = true;
+    pthread_cond_signal(&cb->queue_cond);
+    pthread_mutex_unlock(&cb->send_lock);
+    pthread_join(cb->sender_thread, NULL);
+    pthread_mutex_lock(&cb->send_lock);
+    cb->sender_running = false;
+  }
+
+  wt_disconnect(cb);
+  if (cb->ai != NULL)
+    freeaddrinfo(cb->ai);
+
+  for (size_t i = 0; (cb->queue != NULL) && (i < cb->queue_size); i++)
+    sfree(cb->queue[i].data);
+  sfree(cb->queue);
+  sfree(cb->send_buf);
+  if (cb->compressor != NULL)
+    compress_stream_destroy(cb->compressor);
+  sfree(cb->body.data);
 
   sfree(cb->node);
   sfree(cb->service);
   sfree(cb->host_tags);
 
   pthread_mutex_unlock(&cb->send_lock);
+  pthread_cond_destroy(&cb->queue_cond);
   pthread_mutex_destroy(&cb->send_lock);
 
   sfree(cb);
@@ -296,7 +671,7 @@ static int wt_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if (!cb->async && (cb->sock_fd < 0)) {
     status = wt_callback_init(cb);
     if (status != 0) {
       ERROR("write_tsdb plugin: wt_callback_init failed.");
@@ -425,6 +800,96 @@ static int wt_format_name(char *ret, int ret_len, const value_list_t *vl,
   return 0;
 }
 
+/* Appends `len' bytes of `str' to `buffer' as a JSON string. */
+static int wt_json_string(char *buffer, size_t size, size_t *offset,
+                          const char *str, size_t len) {
+  size_t pos = *offset;
+
+  if (pos >= size)
+    return -1;
+  buffer[pos++] = '"';
+  for (size_t i = 0; i < len; i++) {
+    if ((str[i] == '"') || (str[i] == '\\')) {
+      if (pos >= size)
+        return -1;
+      buffer[pos++] = '\\';
+    } else if ((unsigned char)str[i] < 0x20) {
+      continue;
+    }
+    if (pos >= size)
+      return -1;
+    buffer[pos++] = str[i];
+  }
+  if (pos + 1 >= size)
+    return -1;
+  buffer[pos++] = '"';
+  buffer[pos] = 0;
+
+  *offset = pos;
+  return 0;
+}
+
+/* Appends a space separated list of "key=value" tags as JSON members. */
+static int wt_json_tags(char *buffer, size_t size, size_t *offset,
+                        const char *tags) {
+  while (*tags != 0) {
+    tags += strspn(tags, " ");
+    size_t len = strcspn(tags, " ");
+    if (len == 0)
+      break;
+
+    const char *eq = memchr(tags, '=', len);
+    if ((eq != NULL) && (eq != tags)) {
+      size_t key_len = (size_t)(eq - tags);
+
+      if (*offset + 1 >= size)
+        return -1;
+      buffer[(*offset)++] = ',';
+      if ((wt_json_string(buffer, size, offset, tags, key_len) != 0) ||
+          (*offset + 1 >= size))
+        return -1;
+      buffer[(*offset)++] = ':';
+      if (wt_json_string(buffer, size, offset, eq + 1, len - key_len - 1) != 0)
+        return -1;
+    }
+
+    tags += len;
+  }
+
+  return 0;
+}
+
+/* Formats a data point for the HTTP API, with a leading comma. */
+static int wt_format_json(char *buffer, size_t size, const char *key,
+                          const char *value, cdtime_t time, const char *host,
+                          const char *tags, const char *host_tags) {
+  size_t offset = 0;
+  int status;
+
+  /* escape_string() quotes keys containing special characters already. */
+  status = snprintf(buffer, size, ",{\"metric\":%s%s%s,\"timestamp\":%.0f,"
+                                  "\"value\":%s,\"tags\":{\"fqdn\":",
+                    (key[0] == '"') ? "" : "\"", key,
+                    (key[0] == '"') ? "" : "\"", CDTIME_T_TO_DOUBLE(time),
+                    value);
+  if ((status < 0) || ((size_t)status >= size))
+    return -1;
+  offset = (size_t)status;
+
+  if ((wt_json_string(buffer, size, &offset, host, strlen(host)) != 0) ||
+      (wt_json_tags(buffer, size, &offset, tags) != 0) ||
+      (wt_json_tags(buffer, size, &offset, host_tags) != 0))
+    return -1;
+
+  if (offset + 2 >= size)
+    return -1;
+  buffer[offset++] = '}';
+  buffer[offset++] = '}';
+  buffer[offset] = 0;
+
+  return (int)offset;
+}
+
 static int wt_send_message(const char *key, const char *value, cdtime_t time,
                            struct wt_callback *cb, const char *host,
                            meta_data_t *md) {
@@ -432,13 +897,16 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
   size_t message_len;
   char *temp = NULL;
   const char *tags = "";
-  char message[1024];
+  char message[2048];
   const char *host_tags = cb->host_tags ? cb->host_tags : "";
   const char *meta_tsdb = "tsdb_tags";
 
   /* skip if value is NaN */
   if (value[0] == 'n')
     return 0;
+  /* JSON has no representation for infinity either. */
+  if ((cb->protocol == WT_PROTOCOL_HTTP) && (strchr(value, 'n') != NULL))
+    return 0;
 
   if (md) {
     status = meta_data_get_string(md, meta_tsdb, &temp);
@@ -447,16 +915,19 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     } else if (status < 0) {
       ERROR("write_tsdb plugin: tags metadata get failure");
       sfree(temp);
-      pthread_mutex_unlock(&cb->send_lock);
       return status;
     } else {
       tags = temp;
     }
   }
 
-  status =
-      snprintf(message, sizeof(message), "put %s %.0f %s fqdn=%s %s %s\r\n",
-               key, CDTIME_T_TO_DOUBLE(time), value, host, tags, host_tags);
+  if (cb->protocol == WT_PROTOCOL_HTTP)
+    status = wt_format_json(message, sizeof(message), key, value, time, host,
+                            tags, host_tags);
+  else
+    status =
+        snprintf(message, sizeof(message), "put %s %.0f %s fqdn=%s %s %s\r\n",
+                 key, CDTIME_T_TO_DOUBLE(time), value, host, tags, host_tags);
   sfree(temp);
   if (status < 0)
     return -1;
@@ -469,9 +940,16 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
     return -1;
   }
 
+  if (message_len >= cb->send_buf_size) {
+    ERROR("write_tsdb plugin: message of %" PRIsz " bytes does not fit into "
+          "the send buffer.",
+          message_len);
+    return -1;
+  }
+
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if (!cb->async && (cb->sock_fd < 0)) {
     status = wt_callback_init(cb);
     if (status != 0) {
       ERROR("write_tsdb plugin: wt_callback_init failed.");
@@ -482,7 +960,9 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
 
   if (message_len >= cb->send_buf_free) {
     status = wt_flush_nolock(0, cb);
-    if (status != 0) {
+    /* In asynchronous mode, a full queue has already been reported and the
+     * buffer is free again. */
+    if ((status != 0) && !cb->async) {
       pthread_mutex_unlock(&cb->send_lock);
       return status;
     }
@@ -498,8 +978,8 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
   cb->send_buf_free -= message_len;
 
   DEBUG("write_tsdb plugin: [%s]:%s buf %" PRIsz "/%" PRIsz " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->send_buf_fill, sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
+        cb->node, cb->service, cb->send_buf_fill, cb->send_buf_size,
+        100.0 * ((double)cb->send_buf_fill) / ((double)cb->send_buf_size),
         message);
 
   pthread_mutex_unlock(&cb->send_lock);
@@ -583,8 +1063,17 @@ static int wt_config_tsd(oconfig_item_t *ci) {
   cb->sock_fd = -1;
   cb->connect_failed_log_enabled = 1;
   cb->next_random_ttl = new_random_ttl();
+  cb->protocol = WT_PROTOCOL_TELNET;
+  cb->compression = COMPRESS_NONE;
+  cb->timeout_ms = WT_DEFAULT_TIMEOUT_MS;
+  cb->queue_size = WT_DEFAULT_QUEUE_LENGTH;
+  C_COMPLAIN_INIT(&cb->queue_complaint);
 
   pthread_mutex_init(&cb->send_lock, NULL);
+  pthread_cond_init(&cb->queue_cond, NULL);
+
+  int buffer_size = 0;
+  int queue_length = WT_DEFAULT_QUEUE_LENGTH;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -599,6 +1088,38 @@ static int wt_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->store_rates);
     else if (strcasecmp("AlwaysAppendDS", child->key) == 0)
       cf_util_get_boolean(child, &cb->always_append_ds);
+    else if (strcasecmp("Protocol", child->key) == 0) {
+      char *protocol = NULL;
+      if (cf_util_get_string(child, &protocol) == 0) {
+        if (strcasecmp("Telnet", protocol) == 0)
+          cb->protocol = WT_PROTOCOL_TELNET;
+        else if (strcasecmp("HTTP", protocol) == 0)
+          cb->protocol = WT_PROTOCOL_HTTP;
+        else
+          ERROR("write_tsdb plugin: Invalid protocol: %s", protocol);
+        sfree(protocol);
+      }
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      char *method = NULL;
+      if (cf_util_get_string(child, &method) == 0) {
+        int status = compress_method_parse(method, &cb->compression);
+        if ((status == 0) && (cb->compression == COMPRESS_ZSTD))
+          status = EINVAL; /* OpenTSDB only decodes gzip. */
+        if (status != 0) {
+          ERROR("write_tsdb plugin: Compression \"%s\" is not supported.",
+                method);
+          cb->compression = COMPRESS_NONE;
+        }
+        sfree(method);
+      }
+    } else if (strcasecmp("Timeout", child->key) == 0)
+      cf_util_get_int(child, &cb->timeout_ms);
+    else if (strcasecmp("BufferSize", child->key) == 0)
+      cf_util_get_int(child, &buffer_size);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      cf_util_get_boolean(child, &cb->async);
+    else if (strcasecmp("QueueLength", child->key) == 0)
+      cf_util_get_int(child, &queue_length);
     else {
       ERROR("write_tsdb plugin: Invalid configuration "
             "option: %s.",
@@ -606,6 +1127,64 @@ static int wt_config_tsd(oconfig_item_t *ci) {
     }
   }
 
+  if ((cb->compression != COMPRESS_NONE) &&
+      (cb->protocol != WT_PROTOCOL_HTTP)) {
+    WARNING("write_tsdb plugin: Compression requires Protocol \"HTTP\".");
+    cb->compression = COMPRESS_NONE;
+  }
+  if (cb->timeout_ms <= 0)
+    cb->timeout_ms = WT_DEFAULT_TIMEOUT_MS;
+  if (buffer_size <= 0)
+    buffer_size = (cb->protocol == WT_PROTOCOL_HTTP) ? WT_HTTP_BUF_SIZE
+                                                     : WT_SEND_BUF_SIZE;
+  else if (buffer_size < 1024) {
+    WARNING("write_tsdb plugin: BufferSize %d is too small, using 1024.",
+            buffer_size);
+    buffer_size = 1024;
+  }
+  if (queue_length < 1) {
+    WARNING("write_tsdb plugin: QueueLength must be at least 1.");
+    queue_length = 1;
+  }
+
+  bool buffers_failed = false;
+  cb->send_buf_size = (size_t)buffer_size;
+  cb->send_buf = malloc(cb->send_buf_size);
+  if (cb->async) {
+    cb->queue_size = (size_t)queue_length;
+    cb->queue = calloc(cb->queue_size, sizeof(*cb->queue));
+    for (size_t i = 0; (cb->queue != NULL) && (i < cb->queue_size); i++) {
+      cb->queue[i].data = malloc(cb->send_buf_size);
+      if (cb->queue[i].data == NULL)
+        buffers_failed = true;
+    }
+  } else {
+    cb->queue_size = 0;
+  }
+  if (cb->compression != COMPRESS_NONE)
+    cb->compressor = compress_stream_create(cb->compression, /* level = */ 0);
+
+  if ((cb->send_buf == NULL) || buffers_failed ||
+      (cb->async && (cb->queue == NULL)) ||
+      ((cb->compression != COMPRESS_NONE) && (cb->compressor == NULL))) {
+    ERROR("write_tsdb plugin: Allocating buffers failed.");
+    wt_callback_free(cb);
+    return -1;
+  }
+  wt_reset_buffer(cb);
+
+  if (cb->async) {
+    int status = plugin_thread_create(&cb->sender_thread, wt_sender_thread, cb,
+                                      "write_tsdb send");
+    if (status != 0) {
+      ERROR("write_tsdb plugin: Starting the sender thread failed: %s",
+            STRERROR(status));
+      wt_callback_free(cb);
+      return -1;
+    }
+    cb->sender_running = true;
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_tsdb/%s/%s",
            cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
            cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE);
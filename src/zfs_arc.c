@@ -41,62 +41,10 @@ static value_to_rate_state_t l2_hits_state;
 static value_to_rate_state_t l2_misses_state;
 
 #if defined(KERNEL_LINUX)
-#include "utils_llist.h"
+#include "utils/kstat_file/kstat_file.h"
 #define ZOL_ARCSTATS_FILE "/proc/spl/kstat/zfs/arcstats"
 
-typedef llist_t kstat_t;
-
-static int put_zfs_value(kstat_t *ksp, char const *k, value_t v) {
-  llentry_t *e;
-  char *k_copy;
-  value_t *v_copy;
-
-  k_copy = strdup(k);
-  if (k_copy == NULL)
-    return ENOMEM;
-
-  v_copy = malloc(sizeof(*v_copy));
-  if (v_copy == NULL) {
-    sfree(k_copy);
-    return ENOMEM;
-  }
-  *v_copy = v;
-
-  e = llentry_create(k_copy, v_copy);
-  if (e == NULL) {
-    sfree(v_copy);
-    sfree(k_copy);
-    return ENOMEM;
-  }
-
-  llist_append(ksp, e);
-  return 0;
-}
-
-static long long get_zfs_value(kstat_t *ksp, const char *key) {
-  llentry_t *e;
-  value_t *v;
-
-  e = llist_search(ksp, key);
-  if (e == NULL) {
-    return -1;
-  }
-
-  v = e->value;
-  return (long long)v->derive;
-}
-
-static void free_zfs_values(kstat_t *ksp) {
-  if (ksp == NULL)
-    return;
-
-  for (llentry_t *e = llist_head(ksp); e != NULL; e = e->next) {
-    sfree(e->key);
-    sfree(e->value);
-  }
-
-  llist_destroy(ksp);
-}
+static kstat_file_t *arcstats;
 
 #elif defined(KERNEL_SOLARIS)
 
@@ -116,12 +64,7 @@ static long long get_zfs_value(kstat_t *ksp, char *name) {
 
 const char zfs_arcstat[] = "kstat.zfs.misc.arcstats.";
 
-#if !defined(kstat_t)
-typedef void kstat_t;
-#endif
-
-static long long get_zfs_value(kstat_t *dummy __attribute__((unused)),
-                               char const *name) {
+static long long get_zfs_value(char const *name) {
   char buffer[256];
   long long value;
   size_t valuelen = sizeof(value);
@@ -137,6 +80,99 @@ static long long get_zfs_value(kstat_t *dummy __attribute__((unused)),
 }
 #endif
 
+/* Statistics which are not simply dispatched as they are have a fixed slot at
+ * the beginning of za_stats. */
+enum {
+  ZA_DBUF_SIZE,
+  ZA_DNODE_SIZE,
+  ZA_BONUS_SIZE,
+  ZA_OTHER_SIZE,
+  ZA_L2_SIZE,
+  ZA_HITS,
+  ZA_MISSES,
+  ZA_L2_HITS,
+  ZA_L2_MISSES,
+  ZA_L2_READ_BYTES,
+  ZA_L2_WRITE_BYTES,
+  ZA_SPECIAL_NUM,
+};
+
+typedef struct {
+  char const *name;
+  int ds_type;
+  char const *type;
+  char const *type_instance;
+} za_stat_t;
+
+static za_stat_t const za_stats[] = {
+    [ZA_DBUF_SIZE] = {"dbuf_size", DS_TYPE_GAUGE, "cache_size", "dbuf_size"},
+    [ZA_DNODE_SIZE] = {"dnode_size", DS_TYPE_GAUGE, "cache_size",
+                       "dnode_size"},
+    [ZA_BONUS_SIZE] = {"bonus_size", DS_TYPE_GAUGE, "cache_size",
+                       "bonus_size"},
+    [ZA_OTHER_SIZE] = {"other_size", DS_TYPE_GAUGE, "cache_size",
+                       "other_size"},
+    [ZA_L2_SIZE] = {"l2_size", DS_TYPE_GAUGE, "cache_size", "L2"},
+    [ZA_HITS] = {"hits", DS_TYPE_DERIVE, NULL, NULL},
+    [ZA_MISSES] = {"misses", DS_TYPE_DERIVE, NULL, NULL},
+    [ZA_L2_HITS] = {"l2_hits", DS_TYPE_DERIVE, NULL, NULL},
+    [ZA_L2_MISSES] = {"l2_misses", DS_TYPE_DERIVE, NULL, NULL},
+    [ZA_L2_READ_BYTES] = {"l2_read_bytes", DS_TYPE_DERIVE, NULL, NULL},
+    [ZA_L2_WRITE_BYTES] = {"l2_write_bytes", DS_TYPE_DERIVE, NULL, NULL},
+
+    /* Sizes */
+    {"anon_size", DS_TYPE_GAUGE, "cache_size", "anon_size"},
+    {"c", DS_TYPE_GAUGE, "cache_size", "c"},
+    {"c_max", DS_TYPE_GAUGE, "cache_size", "c_max"},
+    {"c_min", DS_TYPE_GAUGE, "cache_size", "c_min"},
+    {"hdr_size", DS_TYPE_GAUGE, "cache_size", "hdr_size"},
+    {"metadata_size", DS_TYPE_GAUGE, "cache_size", "metadata_size"},
+    {"mfu_ghost_size", DS_TYPE_GAUGE, "cache_size", "mfu_ghost_size"},
+    {"mfu_size", DS_TYPE_GAUGE, "cache_size", "mfu_size"},
+    {"mru_ghost_size", DS_TYPE_GAUGE, "cache_size", "mru_ghost_size"},
+    {"mru_size", DS_TYPE_GAUGE, "cache_size", "mru_size"},
+    {"p", DS_TYPE_GAUGE, "cache_size", "p"},
+    {"size", DS_TYPE_GAUGE, "cache_size", "arc"},
+
+    /* Operations */
+    {"deleted", DS_TYPE_DERIVE, "cache_operation", "deleted"},
+#if defined(KERNEL_FREEBSD)
+    {"allocated", DS_TYPE_DERIVE, "cache_operation", "allocated"},
+#endif
+
+    /* Issue indicators */
+    {"mutex_miss", DS_TYPE_DERIVE, "mutex_operations", "miss"},
+    {"hash_collisions", DS_TYPE_DERIVE, "hash_collisions", ""},
+    {"memory_throttle_count", DS_TYPE_DERIVE, "memory_throttle_count", ""},
+
+    /* Evictions */
+    {"evict_l2_cached", DS_TYPE_DERIVE, "cache_eviction", "cached"},
+    {"evict_l2_eligible", DS_TYPE_DERIVE, "cache_eviction", "eligible"},
+    {"evict_l2_ineligible", DS_TYPE_DERIVE, "cache_eviction", "ineligible"},
+
+    /* Hits / misses */
+    {"demand_data_hits", DS_TYPE_DERIVE, "cache_result", "demand_data-hit"},
+    {"demand_metadata_hits", DS_TYPE_DERIVE, "cache_result",
+     "demand_metadata-hit"},
+    {"prefetch_data_hits", DS_TYPE_DERIVE, "cache_result",
+     "prefetch_data-hit"},
+    {"prefetch_metadata_hits", DS_TYPE_DERIVE, "cache_result",
+     "prefetch_metadata-hit"},
+    {"demand_data_misses", DS_TYPE_DERIVE, "cache_result",
+     "demand_data-miss"},
+    {"demand_metadata_misses", DS_TYPE_DERIVE, "cache_result",
+     "demand_metadata-miss"},
+    {"prefetch_data_misses", DS_TYPE_DERIVE, "cache_result",
+     "prefetch_data-miss"},
+    {"prefetch_metadata_misses", DS_TYPE_DERIVE, "cache_result",
+     "prefetch_metadata-miss"},
+    {"mfu_hits", DS_TYPE_DERIVE, "cache_result", "mfu-hit"},
+    {"mfu_ghost_hits", DS_TYPE_DERIVE, "cache_result", "mfu_ghost-hit"},
+    {"mru_hits", DS_TYPE_DERIVE, "cache_result", "mru-hit"},
+    {"mru_ghost_hits", DS_TYPE_DERIVE, "cache_result", "mru_ghost-hit"},
+};
+#define ZA_STATS_NUM STATIC_ARRAY_SIZE(za_stats)
+
 static void za_submit(const char *type, const char *type_instance,
                       value_t *values, size_t values_len) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -156,29 +192,22 @@ static void za_submit_gauge(const char *type, const char *type_instance,
   za_submit(type, type_instance, &(value_t){.gauge = value}, 1);
 }
 
-static int za_read_derive(kstat_t *ksp, const char *kstat_value,
-                          const char *type, const char *type_instance) {
-  long long tmp = get_zfs_value(ksp, (char *)kstat_value);
-  if (tmp == -1LL) {
-    DEBUG("zfs_arc plugin: Reading kstat value \"%s\" failed.", kstat_value);
-    return -1;
-  }
+static int za_submit_stat(size_t index, int64_t const *values,
+                          bool const *found) {
+  za_stat_t const *stat = za_stats + index;
 
-  za_submit(type, type_instance, &(value_t){.derive = (derive_t)tmp},
-            /* values_num = */ 1);
-  return 0;
-}
-
-static int za_read_gauge(kstat_t *ksp, const char *kstat_value,
-                         const char *type, const char *type_instance) {
-  long long tmp = get_zfs_value(ksp, (char *)kstat_value);
-  if (tmp == -1LL) {
-    DEBUG("zfs_arc plugin: Reading kstat value \"%s\" failed.", kstat_value);
+  if (!found[index]) {
+    DEBUG("zfs_arc plugin: Reading kstat value \"%s\" failed.", stat->name);
     return -1;
   }
 
-  za_submit(type, type_instance, &(value_t){.gauge = (gauge_t)tmp},
-            /* values_num = */ 1);
+  value_t v;
+  if (stat->ds_type == DS_TYPE_GAUGE)
+    v.gauge = (gauge_t)values[index];
+  else
+    v.derive = (derive_t)values[index];
+
+  za_submit(stat->type, stat->type_instance, &v, /* values_num = */ 1);
   return 0;
 }
 
@@ -197,59 +226,37 @@ static void za_submit_ratio(const char *type_instance, gauge_t hits,
   za_submit_gauge("cache_ratio", type_instance, ratio);
 }
 
+static int za_rate(gauge_t *ret_rate, size_t index, int64_t const *values,
+                   bool const *found, cdtime_t now,
+                   value_to_rate_state_t *state) {
+  if (!found[index])
+    return -1;
+  return value_to_rate(ret_rate, (value_t){.derive = (derive_t)values[index]},
+                       DS_TYPE_DERIVE, now, state);
+}
+
 static int za_read(void) {
   gauge_t arc_hits, arc_misses, l2_hits, l2_misses;
-  kstat_t *ksp = NULL;
+  int64_t values[ZA_STATS_NUM];
+  bool found[ZA_STATS_NUM];
 
 #if defined(KERNEL_LINUX)
-  FILE *fh;
-  char buffer[1024];
-
-  fh = fopen(ZOL_ARCSTATS_FILE, "r");
-  if (fh == NULL) {
-    ERROR("zfs_arc plugin: Opening \"%s\" failed: %s", ZOL_ARCSTATS_FILE,
+  /* The kstat headers (see kstat_seq_show_headers in module/spl/spl-kstat.c
+   * of the spl kernel module) are skipped by the reader, because their first
+   * fields are not among the keys. */
+  ssize_t status = kstat_file_read(arcstats, values, found);
+  if (status < 0) {
+    ERROR("zfs_arc plugin: Reading \"%s\" failed: %s", ZOL_ARCSTATS_FILE,
           STRERRNO);
     return -1;
-  }
-
-  /* Ignore the first two lines because they contain information about the rest
-   * of the file.
-   * See kstat_seq_show_headers module/spl/spl-kstat.c of the spl kernel module.
-   */
-  if ((fgets(buffer, sizeof(buffer), fh) == NULL) ||
-      (fgets(buffer, sizeof(buffer), fh) == NULL)) {
-    ERROR("zfs_arc plugin: \"%s\" does not contain at least two lines.",
+  } else if (status == 0) {
+    ERROR("zfs_arc plugin: \"%s\" does not contain any known statistics.",
           ZOL_ARCSTATS_FILE);
-    fclose(fh);
-    return -1;
-  }
-
-  ksp = llist_create();
-  if (ksp == NULL) {
-    ERROR("zfs_arc plugin: `llist_create' failed.");
-    fclose(fh);
     return -1;
   }
-
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    char *fields[3];
-    value_t v;
-    int status;
-
-    status = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
-    if (status != 3)
-      continue;
-
-    status = parse_value(fields[2], &v, DS_TYPE_DERIVE);
-    if (status != 0)
-      continue;
-
-    put_zfs_value(ksp, fields[0], v);
-  }
-
-  fclose(fh);
-
-#elif defined(KERNEL_SOLARIS)
+#else
+#if defined(KERNEL_SOLARIS)
+  kstat_t *ksp = NULL;
   get_kstat(&ksp, "zfs", 0, "arcstats");
   if (ksp == NULL) {
     ERROR("zfs_arc plugin: Cannot find zfs:0:arcstats kstat.");
@@ -257,109 +264,80 @@ static int za_read(void) {
   }
 #endif
 
-  /* Sizes */
-  za_read_gauge(ksp, "anon_size", "cache_size", "anon_size");
-  za_read_gauge(ksp, "c", "cache_size", "c");
-  za_read_gauge(ksp, "c_max", "cache_size", "c_max");
-  za_read_gauge(ksp, "c_min", "cache_size", "c_min");
-  za_read_gauge(ksp, "hdr_size", "cache_size", "hdr_size");
-  za_read_gauge(ksp, "metadata_size", "cache_size", "metadata_size");
-  za_read_gauge(ksp, "mfu_ghost_size", "cache_size", "mfu_ghost_size");
-  za_read_gauge(ksp, "mfu_size", "cache_size", "mfu_size");
-  za_read_gauge(ksp, "mru_ghost_size", "cache_size", "mru_ghost_size");
-  za_read_gauge(ksp, "mru_size", "cache_size", "mru_size");
-  za_read_gauge(ksp, "p", "cache_size", "p");
-  za_read_gauge(ksp, "size", "cache_size", "arc");
+  for (size_t i = 0; i < ZA_STATS_NUM; i++) {
+#if defined(KERNEL_SOLARIS)
+    long long tmp = get_zfs_value(ksp, (char *)za_stats[i].name);
+#else
+    long long tmp = get_zfs_value(za_stats[i].name);
+#endif
+    values[i] = (int64_t)tmp;
+    found[i] = (tmp != -1LL);
+  }
+#endif
+
+  for (size_t i = ZA_SPECIAL_NUM; i < ZA_STATS_NUM; i++)
+    za_submit_stat(i, values, found);
 
   /* The "other_size" value was replaced by more specific values in ZFS on Linux
    * version 0.7.0 (commit 25458cb)
    */
-  if (za_read_gauge(ksp, "dbuf_size", "cache_size", "dbuf_size") != 0 ||
-      za_read_gauge(ksp, "dnode_size", "cache_size", "dnode_size") != 0 ||
-      za_read_gauge(ksp, "bonus_size", "cache_size", "bonus_size") != 0)
-    za_read_gauge(ksp, "other_size", "cache_size", "other_size");
+  if (za_submit_stat(ZA_DBUF_SIZE, values, found) != 0 ||
+      za_submit_stat(ZA_DNODE_SIZE, values, found) != 0 ||
+      za_submit_stat(ZA_BONUS_SIZE, values, found) != 0)
+    za_submit_stat(ZA_OTHER_SIZE, values, found);
 
   /* The "l2_size" value has disappeared from Solaris some time in
    * early 2013, and has only reappeared recently in Solaris 11.2.
    * Stop trying if we ever fail to read it, so we don't spam the log.
    */
   static int l2_size_avail = 1;
-  if (l2_size_avail && za_read_gauge(ksp, "l2_size", "cache_size", "L2") != 0)
+  if (l2_size_avail && za_submit_stat(ZA_L2_SIZE, values, found) != 0)
     l2_size_avail = 0;
 
-  /* Operations */
-  za_read_derive(ksp, "deleted", "cache_operation", "deleted");
-#if defined(KERNEL_FREEBSD)
-  za_read_derive(ksp, "allocated", "cache_operation", "allocated");
-#endif
-
-  /* Issue indicators */
-  za_read_derive(ksp, "mutex_miss", "mutex_operations", "miss");
-  za_read_derive(ksp, "hash_collisions", "hash_collisions", "");
-  za_read_derive(ksp, "memory_throttle_count", "memory_throttle_count", "");
-
-  /* Evictions */
-  za_read_derive(ksp, "evict_l2_cached", "cache_eviction", "cached");
-  za_read_derive(ksp, "evict_l2_eligible", "cache_eviction", "eligible");
-  za_read_derive(ksp, "evict_l2_ineligible", "cache_eviction", "ineligible");
-
-  /* Hits / misses */
-  za_read_derive(ksp, "demand_data_hits", "cache_result", "demand_data-hit");
-  za_read_derive(ksp, "demand_metadata_hits", "cache_result",
-                 "demand_metadata-hit");
-  za_read_derive(ksp, "prefetch_data_hits", "cache_result",
-                 "prefetch_data-hit");
-  za_read_derive(ksp, "prefetch_metadata_hits", "cache_result",
-                 "prefetch_metadata-hit");
-  za_read_derive(ksp, "demand_data_misses", "cache_result", "demand_data-miss");
-  za_read_derive(ksp, "demand_metadata_misses", "cache_result",
-                 "demand_metadata-miss");
-  za_read_derive(ksp, "prefetch_data_misses", "cache_result",
-                 "prefetch_data-miss");
-  za_read_derive(ksp, "prefetch_metadata_misses", "cache_result",
-                 "prefetch_metadata-miss");
-  za_read_derive(ksp, "mfu_hits", "cache_result", "mfu-hit");
-  za_read_derive(ksp, "mfu_ghost_hits", "cache_result", "mfu_ghost-hit");
-  za_read_derive(ksp, "mru_hits", "cache_result", "mru-hit");
-  za_read_derive(ksp, "mru_ghost_hits", "cache_result", "mru_ghost-hit");
-
   cdtime_t now = cdtime();
 
   /* Ratios */
-  if ((value_to_rate(&arc_hits, (value_t){.derive = get_zfs_value(ksp, "hits")},
-                     DS_TYPE_DERIVE, now, &arc_hits_state) == 0) &&
-      (value_to_rate(&arc_misses,
-                     (value_t){.derive = get_zfs_value(ksp, "misses")},
-                     DS_TYPE_DERIVE, now, &arc_misses_state) == 0)) {
+  if ((za_rate(&arc_hits, ZA_HITS, values, found, now, &arc_hits_state) ==
+       0) &&
+      (za_rate(&arc_misses, ZA_MISSES, values, found, now,
+               &arc_misses_state) == 0)) {
     za_submit_ratio("arc", arc_hits, arc_misses);
   }
 
-  if ((value_to_rate(&l2_hits,
-                     (value_t){.derive = get_zfs_value(ksp, "l2_hits")},
-                     DS_TYPE_DERIVE, now, &l2_hits_state) == 0) &&
-      (value_to_rate(&l2_misses,
-                     (value_t){.derive = get_zfs_value(ksp, "l2_misses")},
-                     DS_TYPE_DERIVE, now, &l2_misses_state) == 0)) {
+  if ((za_rate(&l2_hits, ZA_L2_HITS, values, found, now, &l2_hits_state) ==
+       0) &&
+      (za_rate(&l2_misses, ZA_L2_MISSES, values, found, now,
+               &l2_misses_state) == 0)) {
     za_submit_ratio("L2", l2_hits, l2_misses);
   }
 
   /* I/O */
-  value_t l2_io[] = {
-      {.derive = (derive_t)get_zfs_value(ksp, "l2_read_bytes")},
-      {.derive = (derive_t)get_zfs_value(ksp, "l2_write_bytes")},
-  };
-  za_submit("io_octets", "L2", l2_io, STATIC_ARRAY_SIZE(l2_io));
-
-#if defined(KERNEL_LINUX)
-  free_zfs_values(ksp);
-#endif
+  if (found[ZA_L2_READ_BYTES] && found[ZA_L2_WRITE_BYTES]) {
+    value_t l2_io[] = {
+        {.derive = (derive_t)values[ZA_L2_READ_BYTES]},
+        {.derive = (derive_t)values[ZA_L2_WRITE_BYTES]},
+    };
+    za_submit("io_octets", "L2", l2_io, STATIC_ARRAY_SIZE(l2_io));
+  }
 
   return 0;
 } /* int za_read */
 
 static int za_init(void) /* {{{ */
 {
-#if defined(KERNEL_SOLARIS)
+#if defined(KERNEL_LINUX)
+  if (arcstats == NULL) {
+    char const *keys[ZA_STATS_NUM];
+    for (size_t i = 0; i < ZA_STATS_NUM; i++)
+      keys[i] = za_stats[i].name;
+
+    arcstats = kstat_file_create(ZOL_ARCSTATS_FILE, keys, ZA_STATS_NUM);
+    if (arcstats == NULL) {
+      ERROR("zfs_arc plugin: kstat_file_create failed.");
+      return -1;
+    }
+  }
+#elif defined(KERNEL_SOLARIS)
   /* kstats chain already opened by update_kstat (using *kc), verify everything
    * went fine. */
   if (kc == NULL) {
@@ -371,9 +349,20 @@ static int za_init(void) /* {{{ */
   return 0;
 } /* }}} int za_init */
 
+static int za_shutdown(void) /* {{{ */
+{
+#if defined(KERNEL_LINUX)
+  kstat_file_destroy(arcstats);
+  arcstats = NULL;
+#endif
+
+  return 0;
+} /* }}} int za_shutdown */
+
 void module_register(void) {
   plugin_register_init("zfs_arc", za_init);
   plugin_register_read("zfs_arc", za_read);
+  plugin_register_shutdown("zfs_arc", za_shutdown);
 } /* void module_register */
 
 /* vmi: set sw=8 noexpandtab fdm=marker : */
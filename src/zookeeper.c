@@ -29,18 +29,23 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/un.h>
 
 #define ZOOKEEPER_DEF_HOST "127.0.0.1"
 #define ZOOKEEPER_DEF_PORT "2181"
+/* The output of "mntr" has grown well beyond 4 KiB in ZooKeeper 3.6. */
+#define ZOOKEEPER_BUFFER_SIZE 65536
 
 static char *zk_host;
 static char *zk_port;
+static cdtime_t zk_timeout;
 
-static const char *config_keys[] = {"Host", "Port"};
+static const char *config_keys[] = {"Host", "Port", "Timeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int zookeeper_config(const char *key, const char *value) {
@@ -50,6 +55,13 @@ static int zookeeper_config(const char *key, const char *value) {
   } else if (strncmp(key, "Port", strlen("Port")) == 0) {
     sfree(zk_port);
     zk_port = strdup(value);
+  } else if (strncmp(key, "Timeout", strlen("Timeout")) == 0) {
+    double timeout = atof(value);
+    if (timeout <= 0) {
+      ERROR("zookeeper: Timeout must be positive.");
+      return -1;
+    }
+    zk_timeout = DOUBLE_TO_CDTIME_T(timeout);
   } else {
     return -1;
   }
@@ -84,45 +96,103 @@ static void zookeeper_submit_derive(const char *type, const char *type_inst,
   plugin_dispatch_values(&vl);
 } /* zookeeper_submit_derive */
 
+/* The server closes the connection after answering a four letter word, so a
+ * new connection is needed for every read. The address is resolved once and
+ * only looked up again after a connection failed. */
+static struct addrinfo *zk_ai_list;
+
+static void zookeeper_forget_address(void) {
+  if (zk_ai_list != NULL)
+    freeaddrinfo(zk_ai_list);
+  zk_ai_list = NULL;
+} /* void zookeeper_forget_address */
+
+/* Connects `sk' within `timeout' milliseconds. */
+static int zookeeper_connect_timeout(int sk, const struct addrinfo *ai,
+                                     int timeout) {
+  int flags = fcntl(sk, F_GETFL);
+  if ((flags < 0) || (fcntl(sk, F_SETFL, flags | O_NONBLOCK) != 0))
+    return -1;
+
+  int status = connect(sk, ai->ai_addr, ai->ai_addrlen);
+  if ((status != 0) && (errno == EINPROGRESS)) {
+    struct pollfd pfd = {.fd = sk, .events = POLLOUT};
+    do
+      status = poll(&pfd, 1, timeout);
+    while ((status < 0) && (errno == EINTR));
+
+    if (status == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    } else if (status < 0) {
+      return -1;
+    }
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(sk, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0)
+      return -1;
+    if (error != 0) {
+      errno = error;
+      return -1;
+    }
+    status = 0;
+  }
+  if (status != 0)
+    return -1;
+
+  return fcntl(sk, F_SETFL, flags);
+} /* int zookeeper_connect_timeout */
+
 static int zookeeper_connect(void) {
   int sk = -1;
   int status;
-  struct addrinfo *ai_list;
   const char *host;
   const char *port;
 
   host = (zk_host != NULL) ? zk_host : ZOOKEEPER_DEF_HOST;
   port = (zk_port != NULL) ? zk_port : ZOOKEEPER_DEF_PORT;
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_socktype = SOCK_STREAM};
+  if (zk_ai_list == NULL) {
+    struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                                .ai_socktype = SOCK_STREAM};
 
-  status = getaddrinfo(host, port, &ai_hints, &ai_list);
-  if (status != 0) {
-    INFO("getaddrinfo failed: %s",
-         (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
-    return -1;
+    status = getaddrinfo(host, port, &ai_hints, &zk_ai_list);
+    if (status != 0) {
+      INFO("getaddrinfo failed: %s",
+           (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
+      zk_ai_list = NULL;
+      return -1;
+    }
   }
 
-  for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+  cdtime_t timeout = (zk_timeout > 0) ? zk_timeout : plugin_get_interval();
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(timeout);
+
+  for (struct addrinfo *ai = zk_ai_list; ai != NULL; ai = ai->ai_next) {
     sk = socket(ai->ai_family, SOCK_STREAM, 0);
     if (sk < 0) {
       WARNING("zookeeper: socket(2) failed: %s", STRERRNO);
       continue;
     }
-    status = (int)connect(sk, ai->ai_addr, ai->ai_addrlen);
+    status = zookeeper_connect_timeout(sk, ai, (int)CDTIME_T_TO_MS(timeout));
     if (status != 0) {
+      WARNING("zookeeper: connect(2) failed: %s", STRERRNO);
       close(sk);
       sk = -1;
-      WARNING("zookeeper: connect(2) failed: %s", STRERRNO);
       continue;
     }
 
+    /* Bounds the time a hanging server can block the read. */
+    setsockopt(sk, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sk, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
     /* connected */
     break;
   }
 
-  freeaddrinfo(ai_list);
+  if (sk < 0)
+    zookeeper_forget_address();
   return sk;
 } /* int zookeeper_connect */
 
@@ -143,22 +213,26 @@ static int zookeeper_query(char *buffer, size_t buffer_size) {
     return -1;
   }
 
-  memset(buffer, 0, buffer_size);
   buffer_fill = 0;
 
+  /* One byte is kept for the terminating null byte. */
   while ((status = (int)recv(sk, buffer + buffer_fill,
-                             buffer_size - buffer_fill, /* flags = */ 0)) !=
-         0) {
+                             buffer_size - 1 - buffer_fill,
+                             /* flags = */ 0)) != 0) {
     if (status < 0) {
-      if ((errno == EAGAIN) || (errno == EINTR))
+      if (errno == EINTR)
         continue;
-      ERROR("zookeeper: Error reading from socket: %s", STRERRNO);
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        ERROR("zookeeper: Timeout reading from socket.");
+      else
+        ERROR("zookeeper: Error reading from socket: %s", STRERRNO);
       close(sk);
       return -1;
     }
 
     buffer_fill += (size_t)status;
   } /* while (recv) */
+  buffer[buffer_fill] = 0;
 
   status = 0;
   if (buffer_fill == 0) {
@@ -170,8 +244,42 @@ static int zookeeper_query(char *buffer, size_t buffer_size) {
   return status;
 } /* int zookeeper_query */
 
+typedef struct {
+  const char *key;
+  const char *type;
+  const char *type_instance;
+  bool derive;
+} zk_field_t;
+
+/* Sorted by key in zookeeper_init(), for bsearch(3). */
+static zk_field_t zk_fields[] = {
+    {"zk_avg_latency", "latency", "avg", false},
+    {"zk_min_latency", "latency", "min", false},
+    {"zk_max_latency", "latency", "max", false},
+    {"zk_packets_received", "packets", "received", true},
+    {"zk_packets_sent", "packets", "sent", true},
+    {"zk_num_alive_connections", "current_connections", NULL, false},
+    {"zk_outstanding_requests", "requests", "outstanding", false},
+    {"zk_znode_count", "gauge", "znode", false},
+    {"zk_watch_count", "gauge", "watch", false},
+    {"zk_ephemerals_count", "gauge", "ephemerals", false},
+    {"zk_open_file_descriptor_count", "file_handles", "open", false},
+    {"zk_max_file_descriptor_count", "file_handles", "max", false},
+    {"zk_approximate_data_size", "bytes", "approximate_data_size", false},
+    {"zk_followers", "count", "followers", false},
+    {"zk_synced_followers", "count", "synced_followers", false},
+    {"zk_pending_syncs", "count", "pending_syncs", false},
+    {"zk_last_proposal_size", "bytes", "last_proposal", false},
+    {"zk_min_proposal_size", "bytes", "min_proposal", false},
+    {"zk_max_proposal_size", "bytes", "max_proposal", false},
+};
+
+static int zk_field_compare(const void *a, const void *b) {
+  return strcmp(((const zk_field_t *)a)->key, ((const zk_field_t *)b)->key);
+} /* int zk_field_compare */
+
 static int zookeeper_read(void) {
-  char buf[4096];
+  static char buf[ZOOKEEPER_BUFFER_SIZE];
   char *ptr;
   char *save_ptr;
   char *line;
@@ -190,51 +298,24 @@ static int zookeeper_read(void) {
     if (strsplit(line, fields, 2) != 2) {
       continue;
     }
-#define FIELD_CHECK(check, expected)                                           \
-  (strncmp(check, expected, strlen(expected)) == 0)
-
-    if (FIELD_CHECK(fields[0], "zk_avg_latency")) {
-      zookeeper_submit_gauge("latency", "avg", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_min_latency")) {
-      zookeeper_submit_gauge("latency", "min", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_latency")) {
-      zookeeper_submit_gauge("latency", "max", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_packets_received")) {
-      zookeeper_submit_derive("packets", "received", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_packets_sent")) {
-      zookeeper_submit_derive("packets", "sent", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_num_alive_connections")) {
-      zookeeper_submit_gauge("current_connections", NULL, atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_outstanding_requests")) {
-      zookeeper_submit_gauge("requests", "outstanding", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_znode_count")) {
-      zookeeper_submit_gauge("gauge", "znode", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_watch_count")) {
-      zookeeper_submit_gauge("gauge", "watch", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_ephemerals_count")) {
-      zookeeper_submit_gauge("gauge", "ephemerals", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_open_file_descriptor_count")) {
-      zookeeper_submit_gauge("file_handles", "open", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_file_descriptor_count")) {
-      zookeeper_submit_gauge("file_handles", "max", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_approximate_data_size")) {
-      zookeeper_submit_gauge("bytes", "approximate_data_size", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_followers")) {
-      followers = atol(fields[1]);
-      zookeeper_submit_gauge("count", "followers", followers);
-    } else if (FIELD_CHECK(fields[0], "zk_synced_followers")) {
-      zookeeper_submit_gauge("count", "synced_followers", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_pending_syncs")) {
-      zookeeper_submit_gauge("count", "pending_syncs", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_last_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "last_proposal", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_min_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "min_proposal", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "max_proposal", atol(fields[1]));
-    } else {
+
+    const zk_field_t key = {.key = fields[0]};
+    const zk_field_t *f =
+        bsearch(&key, zk_fields, STATIC_ARRAY_SIZE(zk_fields),
+                sizeof(*zk_fields), zk_field_compare);
+    if (f == NULL) {
       DEBUG("Uncollected zookeeper MNTR field %s", fields[0]);
+      continue;
     }
+
+    long value = atol(fields[1]);
+    if (f->derive)
+      zookeeper_submit_derive(f->type, f->type_instance, value);
+    else
+      zookeeper_submit_gauge(f->type, f->type_instance, value);
+
+    if (strcmp(f->key, "zk_followers") == 0)
+      followers = value;
   }
   /* Reports 0 for followers, # when zk_followers present. Intended to be used
    * for quorum detection by taking max for each time period. */
@@ -243,8 +324,21 @@ static int zookeeper_read(void) {
   return 0;
 } /* zookeeper_read */
 
+static int zookeeper_init(void) {
+  qsort(zk_fields, STATIC_ARRAY_SIZE(zk_fields), sizeof(*zk_fields),
+        zk_field_compare);
+  return 0;
+} /* zookeeper_init */
+
+static int zookeeper_shutdown(void) {
+  zookeeper_forget_address();
+  return 0;
+} /* zookeeper_shutdown */
+
 void module_register(void) {
   plugin_register_config("zookeeper", zookeeper_config, config_keys,
                          config_keys_num);
+  plugin_register_init("zookeeper", zookeeper_init);
   plugin_register_read("zookeeper", zookeeper_read);
+  plugin_register_shutdown("zookeeper", zookeeper_shutdown);
 } /* void module_register */